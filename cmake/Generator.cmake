@@ -21,10 +21,10 @@
 # SOFTWARE.
 
 set(ALL_PARAMS "ALL_COLLS" "ALL_ALGOS" "ALL_PROTOS" "ALL_REDOPS" "ALL_TYPES")
-set(ALL_COLLS "AllGather" "AllReduce" "AllToAllPivot" "Broadcast" "Reduce" "ReduceScatter" "SendRecv")
-set(ALL_ALGOS "TREE" "RING" "COLLNET_DIRECT" "COLLNET_CHAIN")
+set(ALL_COLLS "AllGather" "AllReduce" "AllToAll" "AllToAllPivot" "Broadcast" "Reduce" "ReduceScatter" "SendRecv")
+set(ALL_ALGOS "TREE" "RING" "COLLNET_DIRECT" "COLLNET_CHAIN" "DIRECT" "RHD" "BRUCK")
 set(ALL_PROTOS "LL" "LL128" "SIMPLE")
-set(ALL_REDOPS "Sum" "Prod" "MinMax" "PreMulSum" "SumPostDiv")
+set(ALL_REDOPS "Sum" "Prod" "MinMax" "PreMulSum" "SumPostScale" "SumPostDiv")
 set(ALL_TYPES "int8_t" "uint8_t" "int32_t" "uint32_t" "int64_t" "uint64_t" "half" "float" "double" "hip_bfloat16" "rccl_float8" "rccl_bfloat8")
 
 set(FLOATS_LIST "half" "float" "double" "hip_bfloat16" "rccl_float8" "rccl_bfloat8")
@@ -64,14 +64,22 @@ set(FLOATS_LIST "half" "float" "double" "hip_bfloat16" "rccl_float8" "rccl_bfloa
 # make ONLY_FUNCS="AllReduce RING SIMPLE * *|ReduceScatter RING LL * float"
 #                         --- or ---
 # make ONLY_FUNCS="AllReduce RING SIMPLE|ReduceScatter RING LL * float"
-# make ONLY_FUNCS="AllReduce RING/TREE LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|AllGather RING LL/SIMPLE Sum int8_t|AllToAllPivot RING SIMPLE Sum int8_t|Broadcast RING LL/SIMPLE Sum int8_t|Reduce RING LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|ReduceScatter RING LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|SendRecv RING SIMPLE Sum int8_t"
+#
+# # bf16/fp32 Sum AllReduce, AllGather and ReduceScatter, plus SendRecv for point-to-point
+# make ONLY_FUNCS="AllGather|AllReduce * * Sum float/hip_bfloat16|ReduceScatter * * Sum float/hip_bfloat16|SendRecv"
+#
+# Algorithms and protocols that are left out are skipped by the tuner at runtime.
+# Collectives, reduction operations or types that are left out fail with ncclInvalidUsage.
+#
+# make ONLY_FUNCS="AllReduce RING/TREE LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|AllGather RING LL/SIMPLE Sum int8_t|AllToAll RING SIMPLE Sum int8_t|AllToAllPivot RING SIMPLE Sum int8_t|Broadcast RING LL/SIMPLE Sum int8_t|Reduce RING LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|ReduceScatter RING LL/SIMPLE Sum/MinMax int8_t/uint8_t/half/float/double/hip_bfloat16/rccl_float8/rccl_bfloat8|SendRecv RING SIMPLE Sum int8_t"
 
-set(AllGather_Params     "RING" "*"      "Sum" "int8_t")
-set(AllReduce_Params     "*"    "*"      "*"   "*")
+set(AllGather_Params     "RING/BRUCK" "*" "Sum" "int8_t")
+set(AllReduce_Params     "TREE/RING/COLLNET_DIRECT/COLLNET_CHAIN/DIRECT/RHD" "*" "*" "*")
+set(AllToAll_Params      "RING/BRUCK" "LL/SIMPLE" "Sum" "int8_t")
 set(AllToAllPivot_Params "RING" "SIMPLE" "Sum" "int8_t")
-set(Broadcast_Params     "RING" "*"      "Sum" "int8_t")
-set(Reduce_Params        "RING" "*"      "*"   "*")
-set(ReduceScatter_Params "RING" "*"      "*"   "*")
+set(Broadcast_Params     "TREE/RING" "*" "Sum" "int8_t")
+set(Reduce_Params        "TREE/RING" "*" "*"   "*")
+set(ReduceScatter_Params "RING/BRUCK" "*" "*" "*")
 set(SendRecv_Params      "RING" "SIMPLE" "Sum" "int8_t")
 
 #############################################################################################################
@@ -195,7 +203,7 @@ function(gen_device_table)
   foreach(func IN LISTS FUNC_LIST)
     string(FIND "${func}" "LL128" IS_LL128)
     if(NOT IS_LL128 EQUAL -1)
-      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(__gfx90a__) && defined(ENABLE_LL128)\n")
+      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(RCCL_LL128_DEVICE)\n")
       file(APPEND ${DEVICE_TABLE_H_FILE} "${func_declaration} ${func}();\n${func_declaration} ${func}_4();\n#else\n")
       string(REPLACE "LL128" "LL" func "${func}")
       file(APPEND ${DEVICE_TABLE_H_FILE} "${func_declaration} ${func}();\n${func_declaration} ${func}_4();\n#endif\n")
@@ -211,7 +219,7 @@ function(gen_device_table)
   foreach(func ${FUNC_LIST})
     string(FIND "${func}" "LL128" IS_LL128)
     if(NOT IS_LL128 EQUAL -1)
-      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(__gfx90a__) && defined(ENABLE_LL128)\n")
+      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(RCCL_LL128_DEVICE)\n")
       file(APPEND ${DEVICE_TABLE_H_FILE} "  ${func},\n#else\n")
       string(REPLACE "LL128" "LL" func "${func}")
       file(APPEND ${DEVICE_TABLE_H_FILE} "  ${func},\n#endif\n")
@@ -224,7 +232,7 @@ function(gen_device_table)
   foreach(func ${FUNC_LIST})
     string(FIND "${func}" "LL128" IS_LL128)
     if(NOT IS_LL128 EQUAL -1)
-      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(__gfx90a__) && defined(ENABLE_LL128)\n")
+      file(APPEND ${DEVICE_TABLE_H_FILE} "#if defined(RCCL_LL128_DEVICE)\n")
       file(APPEND ${DEVICE_TABLE_H_FILE} "  ${func}_4,\n#else\n")
       string(REPLACE "LL128" "LL" func "${func}")
       file(APPEND ${DEVICE_TABLE_H_FILE} "  ${func}_4,\n#endif\n")
@@ -411,10 +419,10 @@ function(gen_collectives)
     ## Store lower-case version of COLL
     string(TOLOWER ${coll} COLL_LOWER)
     string(REPLACE "scatter" "_scatter" COLL_LOWER ${COLL_LOWER})
-    if(NOT ${coll} STREQUAL "AllToAllPivot")
-      string(REPLACE "all" "all_" COLL_LOWER ${COLL_LOWER})
-    else()
+    if(${coll} STREQUAL "AllToAllPivot")
       string(REPLACE "pivot" "_pivot" COLL_LOWER ${COLL_LOWER})
+    elseif(NOT ${coll} STREQUAL "AllToAll")
+      string(REPLACE "all" "all_" COLL_LOWER ${COLL_LOWER})
     endif()
 
     ## Set name/path of the file
@@ -425,7 +433,7 @@ function(gen_collectives)
     file(WRITE ${FILE_PATH} "#include \"${COLL_LOWER}.h\"\n#include \"common.h\"\n\n")
     string(FIND "${list_name}" "LL128" IS_LL128)
     if(NOT IS_LL128 EQUAL -1)
-      file(APPEND ${FILE_PATH} "#if defined(__gfx90a__) && defined(ENABLE_LL128)\n")
+      file(APPEND ${FILE_PATH} "#if defined(RCCL_LL128_DEVICE)\n")
     endif()
     foreach(IMPL IN LISTS IMPL_LIST)
       file(APPEND ${FILE_PATH} "${IMPL}")
@@ -70,8 +70,92 @@ typedef struct {
   ncclResult_t (*destroy)();
 } ncclTuner_v1_t;
 
-typedef ncclTuner_v1_t ncclTuner_t;
+// Cost table value for algorithm/protocol combinations that must not be used
+#define NCCL_ALGO_PROTO_IGNORE -1.0
 
-#define NCCL_TUNER_PLUGIN_SYMBOL "ncclTunerPlugin_v1"
+// Communicator description passed to init()
+typedef struct {
+  int rank;
+  int nRanks;
+  int nNodes;
+  int localRanks;        // ranks on this node
+  int nChannels;         // channels set up for collectives
+  int collNetSupport;    // whether collnet is available on this communicator
+  int nvlsSupport;       // whether nvlink sharp is available on this communicator
+  int cudaArch;          // device architecture, e.g. 942 for gfx942
+  int topoType;          // intra-node topology type (RCCL_TOPO_* flags)
+  int nNetDevices;       // network devices seen by this rank
+  // NCCL's default cost model, flattened as [numFuncs][numAlgo][numProto].
+  // Latencies are in us, bandwidths in GB/s. Valid until destroy() is called.
+  const float* latencies;
+  const float* bandwidths;
+  int numFuncs;
+  int numAlgo;
+  int numProto;
+} ncclTunerCommInfo_v2_t;
+
+// Measured execution of a collective, passed to reportCollTime()
+typedef struct {
+  ncclFunc_t collType;
+  size_t nBytes;
+  int algorithm;
+  int protocol;
+  int nChannels;
+  float timeUs;          // kernel time measured with device events
+  size_t chunkSize;      // bytes per chunk, appended to v2: older plugins do not read it
+} ncclTunerCollResult_v2_t;
+
+typedef struct {
+  // Name of the tuner
+  const char* name;
+
+  // Initializes tuner states.
+  // Inputs:
+  //   - commInfo: communicator description. Each communicator initializes its own tuner.
+  //   - logFunction: a logFunction can be useful to integrate logging together with NCCL core.
+  // Outputs:
+  //   - context: tuner context object, passed back to every other call
+  ncclResult_t (*init)(const ncclTunerCommInfo_v2_t* commInfo, ncclDebugLogger_t logFunction, void** context);
+
+  // Gets info (algo, protocol, number of ctas and threads) for a given collective.
+  // Inputs:
+  //   - context: tuner context object
+  //   - collType: collective type , e.g., allreduce, allgather…
+  //   - nBytes: collective size in bytes
+  //   - numPipeOps: number of operations in the group
+  //   - numAlgo: number of algorithms in collCostTable
+  //   - numProto: number of protocols in collCostTable
+  //
+  // Outputs:
+  //   - nChannels: number of channels (hence CUs) to be used.
+  //
+  // InOut:
+  //   - collCostTable: collective cost table, indexed [algorithm][protocol], holding
+  //     NCCL's estimated time in us. Combinations which cannot be used are set to
+  //     NCCL_ALGO_PROTO_IGNORE. The plugin may change any other entry; NCCL picks
+  //     the combination with the lowest cost, so setting an entry to 0 forces it.
+  //
+  // If getCollInfo() does not return ncclSuccess, NCCL will fall back to the
+  // default tuning for the given collective.
+  // The plugin is allowed to leave nChannels at 0, in which case NCCL sets it.
+  ncclResult_t (*getCollInfo)(void* context, ncclFunc_t collType, size_t nBytes,
+                              int numPipeOps, float** collCostTable, int numAlgo, int numProto,
+                              int* nChannels);
+
+  // Optional, may be NULL. Called from the enqueue path with the measured time
+  // of a collective which ran alone in its kernel, so that the plugin can learn
+  // online. Results arrive in completion order, a few calls after the launch.
+  // Sampling is controlled by RCCL_TUNER_FEEDBACK_INTERVAL.
+  ncclResult_t (*reportCollTime)(void* context, const ncclTunerCollResult_v2_t* result);
+
+  // Terminates the plugin and cleans up any resources that the plugin allocated.
+  // context: tuner context object
+  ncclResult_t (*destroy)(void* context);
+} ncclTuner_v2_t;
+
+typedef ncclTuner_v2_t ncclTuner_t;
+
+#define NCCL_TUNER_PLUGIN_SYMBOL "ncclTunerPlugin_v2"
+#define NCCL_TUNER_PLUGIN_SYMBOL_V1 "ncclTunerPlugin_v1"
 
 #endif
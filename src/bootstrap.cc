@@ -85,10 +85,25 @@ static ncclResult_t bootstrapNetRecv(struct ncclSocket* sock, void* data, int si
 struct extInfo {
   int rank;
   int nranks;
+  int nroots;
+  int iroot; // Root this info is sent to
   union ncclSocketAddress extAddressListenRoot;
   union ncclSocketAddress extAddressListen;
 };
 
+// With several roots (ncclCommInitRankScalable), root i serves the contiguous block of
+// ranks [bootstrapRootFirstRank(i), bootstrapRootFirstRank(i+1)).
+static int bootstrapRootFirstRank(int iroot, int nranks, int nroots) {
+  return (int)((int64_t)iroot*nranks/nroots);
+}
+
+static int bootstrapRootOfRank(int rank, int nranks, int nroots) {
+  int iroot = (int)(((int64_t)rank*nroots + nroots-1)/nranks);
+  while (bootstrapRootFirstRank(iroot, nranks, nroots) > rank) iroot--;
+  while (iroot+1 < nroots && bootstrapRootFirstRank(iroot+1, nranks, nroots) <= rank) iroot++;
+  return iroot;
+}
+
 #include <sys/resource.h>
 
 static ncclResult_t setFilesLimit() {
@@ -104,7 +119,8 @@ static void *bootstrapRoot(void* rargs) {
   struct ncclSocket* listenSock = args->listenSock;
   uint64_t magic = args->magic;
   ncclResult_t res = ncclSuccess;
-  int nranks = 0, c = 0;
+  int nranks = 0, nroots = 1, iroot = 0, c = 0;
+  int firstRank = 0, lastRank = 0, nrecv = 0;
   struct extInfo info;
   union ncclSocketAddress *rankAddresses = NULL;
   union ncclSocketAddress *rankAddressesRoot = NULL; // for initial rank <-> root information exchange
@@ -123,12 +139,20 @@ static void *bootstrapRoot(void* rargs) {
 
     if (c == 0) {
       nranks = info.nranks;
+      nroots = info.nroots;
+      iroot = info.iroot;
+      // This root serves ranks [firstRank, lastRank]. With several roots, the first rank of the
+      // next block also checks in so that the last rank of this block can be given its address.
+      firstRank = bootstrapRootFirstRank(iroot, nranks, nroots);
+      lastRank = bootstrapRootFirstRank(iroot+1, nranks, nroots)-1;
+      nrecv = lastRank-firstRank+1 + (nroots > 1 ? 1 : 0);
       NCCLCHECKGOTO(ncclCalloc(&rankAddresses, nranks), res, out);
       NCCLCHECKGOTO(ncclCalloc(&rankAddressesRoot, nranks), res, out);
     }
 
-    if (nranks != info.nranks) {
-      WARN("Bootstrap Root : mismatch in rank count from procs %d : %d", nranks, info.nranks);
+    if (nranks != info.nranks || nroots != info.nroots || iroot != info.iroot) {
+      WARN("Bootstrap Root : mismatch in rank/root count from procs %d/%d/%d : %d/%d/%d",
+          nranks, nroots, iroot, info.nranks, info.nroots, info.iroot);
       goto out;
     }
 
@@ -142,12 +166,12 @@ static void *bootstrapRoot(void* rargs) {
     memcpy(rankAddresses+info.rank, &info.extAddressListen, sizeof(union ncclSocketAddress));
 
     ++c;
-    TRACE(NCCL_INIT, "Received connect from rank %d total %d/%d",  info.rank, c, nranks);
-  } while (c < nranks);
-  TRACE(NCCL_INIT, "COLLECTED ALL %d HANDLES", nranks);
+    TRACE(NCCL_INIT, "Received connect from rank %d total %d/%d",  info.rank, c, nrecv);
+  } while (c < nrecv);
+  TRACE(NCCL_INIT, "COLLECTED ALL %d HANDLES", nrecv);
 
   // Send the connect handle for the next rank in the AllGather ring
-  for (int r=0; r<nranks; ++r) {
+  for (int r=firstRank; r<=lastRank; ++r) {
     int next = (r+1) % nranks;
     struct ncclSocket sock;
     NCCLCHECKGOTO(ncclSocketInit(&sock, rankAddressesRoot+r, magic, ncclSocketTypeBootstrap), res, out);
@@ -155,7 +179,7 @@ static void *bootstrapRoot(void* rargs) {
     NCCLCHECKGOTO(bootstrapNetSend(&sock, rankAddresses+next, sizeof(union ncclSocketAddress)), res, out);
     NCCLCHECKGOTO(ncclSocketClose(&sock), res, out);
   }
-  TRACE(NCCL_INIT, "SENT OUT ALL %d HANDLES", nranks);
+  TRACE(NCCL_INIT, "SENT OUT ALL %d HANDLES", lastRank-firstRank+1);
 
 out:
   if (listenSock != NULL) {
@@ -216,7 +240,22 @@ struct unexConn {
   struct unexConn* next;
 };
 
+struct ncclBootstrapShared {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int nranks;
+  int refCount;
+  // Current allgather: ranks copy their block in, then read all blocks once everyone arrived
+  char* data;
+  size_t capacity;
+  int size;
+  int arrived;
+  int left;
+  uint64_t round;
+};
+
 struct bootstrapState {
+  struct ncclBootstrapShared* shared;
   struct ncclSocket listenSock;
   struct ncclSocket ringRecvSocket;
   struct ncclSocket ringSendSocket;
@@ -229,13 +268,146 @@ struct bootstrapState {
   int nranks;
   uint64_t magic;
   volatile uint32_t *abortFlag;
+  int peerAddressesReady; // peerCommAddresses is complete, point-to-point messages can be used
+  struct bootstrapRingNet* ringNet; // Allgather ring over the network plugin, NULL when not enabled
+};
+
+static ncclResult_t bootstrapInitPeers(struct bootstrapState* state, struct ncclComm* comm);
+
+// The allgather ring can also be connected through the network plugin once the socket
+// ring is up, so that allgathers run over the fabric and not the management network.
+// Point-to-point messages keep using sockets: each one is a short-lived connection, which
+// a network connection would make more expensive, not less.
+NCCL_PARAM(OobNetEnable, "OOB_NET_ENABLE", 0);
+
+struct bootstrapRingNet {
+  ncclNet_t* net;
+  void* listenComm;
+  void* sendComm;
+  void* recvComm;
 };
 
-ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm* comm) {
+static bool bootstrapAborted(struct bootstrapState* state) {
+  return state->abortFlag && __atomic_load_n(state->abortFlag, __ATOMIC_RELAXED);
+}
+
+static ncclResult_t bootstrapRingNetClose(struct bootstrapState* state) {
+  struct bootstrapRingNet* ring = state->ringNet;
+  if (ring == NULL) return ncclSuccess;
+  if (ring->sendComm) NCCLCHECK(ring->net->closeSend(ring->sendComm));
+  if (ring->recvComm) NCCLCHECK(ring->net->closeRecv(ring->recvComm));
+  if (ring->listenComm) NCCLCHECK(ring->net->closeListen(ring->listenComm));
+  free(ring);
+  state->ringNet = NULL;
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapRingNetInit(struct bootstrapState* state, struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  ncclNet_t* net = comm->ncclNet;
+  const char* ifName = ncclGetEnv("NCCL_OOB_NET_IFNAME");
+  char handle[NCCL_NET_HANDLE_MAXSIZE], nextHandle[NCCL_NET_HANDLE_MAXSIZE];
+  ncclNetDeviceHandle_t* sendDevHandle = NULL;
+  ncclNetDeviceHandle_t* recvDevHandle = NULL;
+  struct bootstrapRingNet* ring;
+  int ndev, dev = 0;
+
+  if (ncclParamOobNetEnable() == 0 || state->nranks == 1) return ncclSuccess;
+  // The socket network would only add a layer over the ring sockets
+  if (net == NULL || strcmp(net->name, "Socket") == 0) {
+    INFO(NCCL_INIT, "Bootstrap : NCCL_OOB_NET_ENABLE set but network is %s, keeping the socket ring", net ? net->name : "none");
+    return ncclSuccess;
+  }
+  NCCLCHECK(net->devices(&ndev));
+  if (ifName) {
+    for (dev = 0; dev < ndev; dev++) {
+      ncclNetProperties_t props;
+      NCCLCHECK(net->getProperties(dev, &props));
+      if (strcmp(props.name, ifName) == 0) break;
+    }
+  }
+  if (dev >= ndev) {
+    WARN("Bootstrap : no %s device%s%s for the allgather ring", net->name, ifName ? " named " : "", ifName ? ifName : "");
+    return ncclInvalidUsage;
+  }
+
+  NCCLCHECK(ncclCalloc(&ring, 1));
+  ring->net = net;
+  state->ringNet = ring;
+  NCCLCHECKGOTO(net->listen(dev, handle, &ring->listenComm), ret, fail);
+  // The ring sockets work both ways: my handle goes back to the previous rank, which connects to me
+  NCCLCHECKGOTO(bootstrapNetSend(&state->ringRecvSocket, handle, sizeof(handle)), ret, fail);
+  NCCLCHECKGOTO(bootstrapNetRecv(&state->ringSendSocket, nextHandle, sizeof(nextHandle)), ret, fail);
+  while (ring->sendComm == NULL || ring->recvComm == NULL) {
+    if (ring->sendComm == NULL) NCCLCHECKGOTO(net->connect(dev, NULL, nextHandle, &ring->sendComm, &sendDevHandle), ret, fail);
+    if (ring->recvComm == NULL) NCCLCHECKGOTO(net->accept(ring->listenComm, &ring->recvComm, &recvDevHandle), ret, fail);
+    if (bootstrapAborted(state)) { ret = ncclInternalError; goto fail; }
+  }
+  INFO(NCCL_INIT, "Bootstrap : allgather ring of rank %d connected over %s device %d", state->rank, net->name, dev);
+exit:
+  return ret;
+fail:
+  bootstrapRingNetClose(state);
+  goto exit;
+}
+
+static ncclResult_t bootstrapRingNetWait(struct bootstrapState* state, void* request) {
+  int done = 0;
+  while (!done) {
+    NCCLCHECK(state->ringNet->net->test(request, &done, NULL));
+    if (bootstrapAborted(state)) return ncclInternalError;
+  }
+  return ncclSuccess;
+}
+
+// Same ring algorithm as over the sockets. The buffer is registered for the call, which
+// is cheap next to the ring itself and lets the caller pass any host memory.
+static ncclResult_t bootstrapRingNetAllGather(struct bootstrapState* state, char* data, int size) {
+  struct bootstrapRingNet* ring = state->ringNet;
+  ncclNet_t* net = ring->net;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  void* sendMhandle = NULL;
+  void* recvMhandle = NULL;
+  ncclResult_t ret = ncclSuccess;
+
+  NCCLCHECKGOTO(net->regMr(ring->sendComm, data, (size_t)nranks*size, NCCL_PTR_HOST, &sendMhandle), ret, exit);
+  NCCLCHECKGOTO(net->regMr(ring->recvComm, data, (size_t)nranks*size, NCCL_PTR_HOST, &recvMhandle), ret, exit);
+  for (int i=0; i<nranks-1; i++) {
+    size_t rslice = (rank - i - 1 + nranks) % nranks;
+    size_t sslice = (rank - i + nranks) % nranks;
+    void* recvData = data+rslice*size;
+    int recvSize = size;
+    int tag = 0;
+    void* sendReq = NULL;
+    void* recvReq = NULL;
+
+    // Post the receive first, the send only goes once the next rank has posted its own
+    while (recvReq == NULL) {
+      NCCLCHECKGOTO(net->irecv(ring->recvComm, 1, &recvData, &recvSize, &tag, &recvMhandle, &recvReq), ret, exit);
+      if (bootstrapAborted(state)) { ret = ncclInternalError; goto exit; }
+    }
+    while (sendReq == NULL) {
+      NCCLCHECKGOTO(net->isend(ring->sendComm, data+sslice*size, size, tag, sendMhandle, &sendReq), ret, exit);
+      if (bootstrapAborted(state)) { ret = ncclInternalError; goto exit; }
+    }
+    NCCLCHECKGOTO(bootstrapRingNetWait(state, sendReq), ret, exit);
+    NCCLCHECKGOTO(bootstrapRingNetWait(state, recvReq), ret, exit);
+  }
+exit:
+  if (recvMhandle) net->deregMr(ring->recvComm, recvMhandle);
+  if (sendMhandle) net->deregMr(ring->sendComm, sendMhandle);
+  return ret;
+}
+
+ncclResult_t bootstrapInit(int nHandles, struct ncclBootstrapHandle* handles, struct ncclComm* comm) {
   int rank = comm->rank;
   int nranks = comm->nRanks;
+  int iroot = bootstrapRootOfRank(rank, nranks, nHandles);
+  int firstRank = bootstrapRootFirstRank(iroot, nranks, nHandles);
+  int nRootRanks = bootstrapRootFirstRank(iroot+1, nranks, nHandles)-firstRank;
+  struct ncclBootstrapHandle* handle = handles+iroot;
   struct bootstrapState* state;
-  struct ncclSocket* proxySocket;
   ncclSocketAddress nextAddr;
   struct ncclSocket sock, listenSockRoot;
   struct extInfo info = { 0 };
@@ -245,9 +417,10 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   state->nranks = nranks;
   state->abortFlag = comm->abortFlag;
   comm->bootstrap = state;
-  comm->magic = state->magic = handle->magic;
+  // All ranks use the first handle's magic among themselves, and the magic of their root to talk to it
+  comm->magic = state->magic = handles[0].magic;
 
-  TRACE(NCCL_INIT, "rank %d nranks %d", rank, nranks);
+  TRACE(NCCL_INIT, "rank %d nranks %d root %d/%d", rank, nranks, iroot, nHandles);
 
   // [RCCL] Register custom signal handlers if requested
   RegisterSignalHandlers();
@@ -255,19 +428,21 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
 
   info.rank = rank;
   info.nranks = nranks;
+  info.nroots = nHandles;
+  info.iroot = iroot;
   // Create socket for other ranks to contact me
   NCCLCHECK(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
   NCCLCHECK(ncclSocketListen(&state->listenSock));
   NCCLCHECK(ncclSocketGetAddr(&state->listenSock, &info.extAddressListen));
 
   // Create socket for root to contact me
-  NCCLCHECK(ncclSocketInit(&listenSockRoot, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+  NCCLCHECK(ncclSocketInit(&listenSockRoot, &bootstrapNetIfAddr, handle->magic, ncclSocketTypeBootstrap, comm->abortFlag));
   NCCLCHECK(ncclSocketListen(&listenSockRoot));
   NCCLCHECK(ncclSocketGetAddr(&listenSockRoot, &info.extAddressListenRoot));
 
   // stagger connection times to avoid an overload of the root
-  if (nranks > 128) {
-    long msec = rank;
+  if (nRootRanks > 128) {
+    long msec = rank-firstRank;
     struct timespec tv;
     tv.tv_sec = msec / 1000;
     tv.tv_nsec = 1000000 * (msec % 1000);
@@ -276,11 +451,22 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   }
 
   // send info on my listening socket to root
-  NCCLCHECK(ncclSocketInit(&sock, &handle->addr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+  NCCLCHECK(ncclSocketInit(&sock, &handle->addr, handle->magic, ncclSocketTypeBootstrap, comm->abortFlag));
   NCCLCHECK(ncclSocketConnect(&sock));
   NCCLCHECK(bootstrapNetSend(&sock, &info, sizeof(info)));
   NCCLCHECK(ncclSocketClose(&sock));
 
+  // The first rank of a block also goes to the previous root, which needs its address for
+  // the last rank of its own block. This links the blocks of all roots into a single ring.
+  if (nHandles > 1 && rank == firstRank) {
+    struct ncclBootstrapHandle* prevHandle = handles + (iroot+nHandles-1)%nHandles;
+    info.iroot = (iroot+nHandles-1)%nHandles;
+    NCCLCHECK(ncclSocketInit(&sock, &prevHandle->addr, prevHandle->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+    NCCLCHECK(ncclSocketConnect(&sock));
+    NCCLCHECK(bootstrapNetSend(&sock, &info, sizeof(info)));
+    NCCLCHECK(ncclSocketClose(&sock));
+  }
+
   // get info on my "next" rank in the bootstrap ring from root
   NCCLCHECK(ncclSocketInit(&sock));
   NCCLCHECK(ncclSocketAccept(&sock, &listenSockRoot));
@@ -293,11 +479,24 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   // Accept the connect request from the previous rank in the AllGather ring
   NCCLCHECK(ncclSocketInit(&state->ringRecvSocket));
   NCCLCHECK(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock));
+  NCCLCHECK(bootstrapRingNetInit(state, comm));
+
+  NCCLCHECK(bootstrapInitPeers(state, comm));
+  TRACE(NCCL_INIT, "rank %d nranks %d - DONE", rank, nranks);
+  return ncclSuccess;
+}
+
+// Exchanges the addresses of the point-to-point and proxy sockets, then starts the proxy
+static ncclResult_t bootstrapInitPeers(struct bootstrapState* state, struct ncclComm* comm) {
+  int rank = state->rank;
+  int nranks = state->nranks;
+  struct ncclSocket* proxySocket;
 
   // AllGather all listen handlers
   NCCLCHECK(ncclCalloc(&state->peerCommAddresses, nranks));
   NCCLCHECK(ncclSocketGetAddr(&state->listenSock, state->peerCommAddresses+rank));
   NCCLCHECK(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)));
+  state->peerAddressesReady = 1;
 
   // Create the service proxy
   NCCLCHECK(ncclCalloc(&state->peerProxyAddresses, nranks));
@@ -316,12 +515,120 @@ ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm*
   state->peerProxyAddressesUDS[rank] = getPidHash()+randId;
   NCCLCHECK(bootstrapAllGather(state, state->peerProxyAddressesUDS, sizeof(*state->peerProxyAddressesUDS)));
   NCCLCHECK(ncclProxyInit(comm, proxySocket, state->peerProxyAddresses, state->peerProxyAddressesUDS));
+  return ncclSuccess;
+}
 
-  TRACE(NCCL_INIT, "rank %d nranks %d - DONE", rank, nranks);
+ncclResult_t bootstrapSharedCreate(int nranks, struct ncclBootstrapShared** shared) {
+  struct ncclBootstrapShared* s;
+  NCCLCHECK(ncclCalloc(&s, 1));
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  s->nranks = nranks;
+  s->refCount = 1;
+  *shared = s;
+  return ncclSuccess;
+}
+
+ncclResult_t bootstrapSharedRelease(struct ncclBootstrapShared* shared) {
+  if (shared == NULL) return ncclSuccess;
+  pthread_mutex_lock(&shared->lock);
+  int refCount = --shared->refCount;
+  pthread_mutex_unlock(&shared->lock);
+  if (refCount > 0) return ncclSuccess;
+  pthread_mutex_destroy(&shared->lock);
+  pthread_cond_destroy(&shared->cond);
+  free(shared->data);
+  free(shared);
+  return ncclSuccess;
+}
+
+ncclResult_t bootstrapInitShared(struct ncclBootstrapShared* shared, uint64_t magic, struct ncclComm* comm) {
+  struct bootstrapState* state;
+  if (comm->nRanks != shared->nranks) {
+    WARN("Bootstrap : %d ranks for a shared bootstrap of %d", comm->nRanks, shared->nranks);
+    return ncclInternalError;
+  }
 
+  NCCLCHECK(ncclCalloc(&state, 1));
+  state->rank = comm->rank;
+  state->nranks = comm->nRanks;
+  state->abortFlag = comm->abortFlag;
+  pthread_mutex_lock(&shared->lock);
+  shared->refCount++;
+  pthread_mutex_unlock(&shared->lock);
+  state->shared = shared;
+  comm->bootstrap = state;
+  comm->magic = state->magic = magic;
+
+  TRACE(NCCL_INIT, "rank %d nranks %d shared", state->rank, state->nranks);
+
+  // [RCCL] Register custom signal handlers if requested
+  RegisterSignalHandlers();
+  // [/RCCL]
+
+  // No ring: allgathers go through the shared state
+  NCCLCHECK(ncclSocketInit(&state->ringSendSocket));
+  NCCLCHECK(ncclSocketInit(&state->ringRecvSocket));
+  NCCLCHECK(ncclSocketInit(&state->listenSock, &bootstrapNetIfAddr, comm->magic, ncclSocketTypeBootstrap, comm->abortFlag));
+  NCCLCHECK(ncclSocketListen(&state->listenSock));
+  NCCLCHECK(bootstrapInitPeers(state, comm));
+  TRACE(NCCL_INIT, "rank %d nranks %d shared - DONE", state->rank, state->nranks);
   return ncclSuccess;
 }
 
+// Waits on the shared state, with its lock held, until done() holds or the communicator aborts
+template<typename F>
+static ncclResult_t bootstrapSharedWait(struct bootstrapState* state, F done) {
+  struct ncclBootstrapShared* s = state->shared;
+  while (!done()) {
+    if (__atomic_load_n(state->abortFlag, __ATOMIC_RELAXED)) return ncclInternalError;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += 1000000;
+    if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+    pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t bootstrapSharedAllGather(struct bootstrapState* state, char* data, int size) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclBootstrapShared* s = state->shared;
+  int nranks = state->nranks;
+  uint64_t round;
+
+  pthread_mutex_lock(&s->lock);
+  // Let the ranks still reading the previous round finish
+  NCCLCHECKGOTO(bootstrapSharedWait(state, [&]() { return s->left == 0; }), ret, exit);
+  if (s->arrived == 0) {
+    if (s->capacity < (size_t)nranks*size) {
+      free(s->data);
+      s->capacity = 0;
+      NCCLCHECKGOTO(ncclCalloc(&s->data, (size_t)nranks*size), ret, exit);
+      s->capacity = (size_t)nranks*size;
+    }
+    s->size = size;
+  } else if (s->size != size) {
+    WARN("Bootstrap AllGather : rank %d has %d bytes, other ranks %d", state->rank, size, s->size);
+    ret = ncclInternalError;
+    goto exit;
+  }
+  memcpy(s->data+(size_t)state->rank*size, data+(size_t)state->rank*size, size);
+  round = s->round;
+  if (++s->arrived == nranks) {
+    s->arrived = 0;
+    s->left = nranks;
+    s->round++;
+    pthread_cond_broadcast(&s->cond);
+  }
+  NCCLCHECKGOTO(bootstrapSharedWait(state, [&]() { return s->round != round; }), ret, exit);
+  memcpy(data, s->data, (size_t)nranks*size);
+  if (--s->left == 0) pthread_cond_broadcast(&s->cond);
+exit:
+  pthread_mutex_unlock(&s->lock);
+  return ret;
+}
+
 ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm* comm, struct ncclComm* parent, int color, int key, int* parentRanks) {
   ncclResult_t ret = ncclSuccess;
   int rank = comm->rank;
@@ -357,11 +664,13 @@ ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm*
   NCCLCHECKGOTO(ncclSocketConnect(&state->ringSendSocket), ret, fail);
   // Accept the connect request from the previous rank in the AllGather ring
   NCCLCHECKGOTO(ncclSocketAccept(&state->ringRecvSocket, &state->listenSock), ret, fail);
+  NCCLCHECKGOTO(bootstrapRingNetInit(state, comm), ret, fail);
 
   // AllGather all listen handlers
   NCCLCHECKGOTO(ncclCalloc(&state->peerCommAddresses, nranks), ret, fail);
   memcpy(state->peerCommAddresses+rank, &listenAddr, sizeof(union ncclSocketAddress));
   NCCLCHECKGOTO(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union ncclSocketAddress)), ret, fail);
+  state->peerAddressesReady = 1;
 
   if (parent->config.splitShare) {
     /* map local rank to top parent local rank. */
@@ -395,6 +704,10 @@ fail:
   goto exit;
 }
 
+RCCL_PARAM(BootstrapBruckThreshold, "BOOTSTRAP_BRUCK_THRESHOLD", 64);
+
+static ncclResult_t bootstrapBruckAllGather(struct bootstrapState* state, char* data, int size);
+
 ncclResult_t bootstrapAllGather(void* commState, void* allData, int size) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   char* data = (char*)allData;
@@ -403,6 +716,28 @@ ncclResult_t bootstrapAllGather(void* commState, void* allData, int size) {
 
   TRACE(NCCL_INIT, "rank %d nranks %d size %d", rank, nranks, size);
 
+  if (state->shared) {
+    NCCLCHECK(bootstrapSharedAllGather(state, data, size));
+    TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
+    return ncclSuccess;
+  }
+
+  // Each Bruck step opens socket connections, a ring step over the network only takes microseconds
+  if (state->ringNet) {
+    NCCLCHECK(bootstrapRingNetAllGather(state, data, size));
+    TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
+    return ncclSuccess;
+  }
+
+  // The ring needs nranks-1 steps; once every rank can reach every other rank, use
+  // ceil(log2(nranks)) steps instead.
+  int64_t bruckThreshold = rcclParamBootstrapBruckThreshold();
+  if (state->peerAddressesReady && bruckThreshold > 0 && nranks >= bruckThreshold) {
+    NCCLCHECK(bootstrapBruckAllGather(state, data, size));
+    TRACE(NCCL_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
+    return ncclSuccess;
+  }
+
   /* Simple ring based AllGather
    * At each step i receive data from (rank-i-1) from left
    * and send previous step's data from (rank-i) to right
@@ -421,15 +756,21 @@ ncclResult_t bootstrapAllGather(void* commState, void* allData, int size) {
   return ncclSuccess;
 }
 
+// Connect to a peer and send the message header
+static ncclResult_t bootstrapSendSock(struct bootstrapState* state, int peer, int tag, struct ncclSocket* sock) {
+  NCCLCHECK(ncclSocketInit(sock, state->peerCommAddresses+peer, state->magic, ncclSocketTypeBootstrap));
+  NCCLCHECK(ncclSocketConnect(sock));
+  NCCLCHECK(bootstrapNetSend(sock, &state->rank, sizeof(int)));
+  NCCLCHECK(bootstrapNetSend(sock, &tag, sizeof(int)));
+  return ncclSuccess;
+}
+
 ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
   ncclResult_t ret = ncclSuccess;
   struct bootstrapState* state = (struct bootstrapState*)commState;
   struct ncclSocket sock;
 
-  NCCLCHECKGOTO(ncclSocketInit(&sock, state->peerCommAddresses+peer, state->magic, ncclSocketTypeBootstrap), ret, fail);
-  NCCLCHECKGOTO(ncclSocketConnect(&sock), ret, fail);
-  NCCLCHECKGOTO(bootstrapNetSend(&sock, &state->rank, sizeof(int)), ret, fail);
-  NCCLCHECKGOTO(bootstrapNetSend(&sock, &tag, sizeof(int)), ret, fail);
+  NCCLCHECKGOTO(bootstrapSendSock(state, peer, tag, &sock), ret, fail);
   NCCLCHECKGOTO(bootstrapNetSend(&sock, data, size), ret, fail);
 
 exit:
@@ -547,34 +888,35 @@ static void unexpectedFree(struct bootstrapState* state) {
   return;
 }
 
-// We can't know who we'll receive from, so we need to receive everything at once
-ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
-  ncclResult_t ret = ncclSuccess;
-  struct bootstrapState* state = (struct bootstrapState*)commState;
-  struct ncclSocket sock;
+// Find the connection of a peer/tag and consume its header
+static ncclResult_t bootstrapRecvSock(struct bootstrapState* state, int peer, int tag, struct ncclSocket* sock) {
   int newPeer, newTag;
 
   // Search unexpected connections first
   int found;
-  NCCLCHECK(unexpectedDequeue(state, peer, tag, &sock, &found));
-  if (found) {
-    NCCLCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, fail);
-    goto exit;
-  }
+  NCCLCHECK(unexpectedDequeue(state, peer, tag, sock, &found));
+  if (found) return ncclSuccess;
 
   // Then look for new connections
   while (1) {
-    NCCLCHECKGOTO(ncclSocketInit(&sock), ret, fail);
-    NCCLCHECKGOTO(ncclSocketAccept(&sock, &state->listenSock), ret, fail);
-    NCCLCHECKGOTO(bootstrapNetRecv(&sock, &newPeer, sizeof(int)), ret, fail);
-    NCCLCHECKGOTO(bootstrapNetRecv(&sock, &newTag, sizeof(int)), ret, fail);
-    if (newPeer == peer && newTag == tag) {
-      NCCLCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, fail);
-      goto exit;
-    }
+    NCCLCHECK(ncclSocketInit(sock));
+    NCCLCHECK(ncclSocketAccept(sock, &state->listenSock));
+    NCCLCHECK(bootstrapNetRecv(sock, &newPeer, sizeof(int)));
+    NCCLCHECK(bootstrapNetRecv(sock, &newTag, sizeof(int)));
+    if (newPeer == peer && newTag == tag) return ncclSuccess;
     // Unexpected connection. Save for later.
-    NCCLCHECKGOTO(unexpectedEnqueue(state, newPeer, newTag, &sock), ret, fail);
+    NCCLCHECK(unexpectedEnqueue(state, newPeer, newTag, sock));
   }
+}
+
+// We can't know who we'll receive from, so we need to receive everything at once
+ncclResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
+  ncclResult_t ret = ncclSuccess;
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  struct ncclSocket sock;
+
+  NCCLCHECKGOTO(bootstrapRecvSock(state, peer, tag, &sock), ret, fail);
+  NCCLCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, fail);
 exit:
   NCCLCHECK(ncclSocketClose(&sock));
   return ret;
@@ -582,6 +924,67 @@ fail:
   goto exit;
 }
 
+/* Bruck AllGather
+ * At step k, with d = 2^k, send the first min(d, nranks-d) blocks gathered so far to
+ * (rank-d) and append as many blocks from (rank+d). Blocks are kept rotated so that
+ * block i holds the data of (rank+i), then put back in place at the end.
+ * Messages can be larger than the socket buffers and every rank sends before it
+ * receives, so both directions are progressed together to avoid a cyclic wait.
+ */
+#define BOOTSTRAP_TAG_BRUCK (-16)
+
+static ncclResult_t bootstrapBruckAllGather(struct bootstrapState* state, char* data, int size) {
+  ncclResult_t ret = ncclSuccess;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  struct ncclSocket sendSock, recvSock;
+  bool sendOpen = false, recvOpen = false;
+  char* tmp = NULL;
+
+  NCCLCHECK(ncclCalloc(&tmp, (size_t)nranks*size));
+  memcpy(tmp, data+(size_t)rank*size, size);
+  for (int d=1, step=0; d<nranks; d<<=1, step++) {
+    int count = std::min(d, nranks-d);
+    int dst = (rank - d + nranks) % nranks;
+    int src = (rank + d) % nranks;
+    int bytes = count*size;
+    int recvBytes;
+    int sendOffset = 0, recvOffset = 0;
+    char* recvData = tmp+(size_t)d*size;
+
+    NCCLCHECKGOTO(bootstrapSendSock(state, dst, BOOTSTRAP_TAG_BRUCK-step, &sendSock), ret, fail);
+    sendOpen = true;
+    NCCLCHECKGOTO(ncclSocketSend(&sendSock, &bytes, sizeof(int)), ret, fail);
+    NCCLCHECKGOTO(bootstrapRecvSock(state, src, BOOTSTRAP_TAG_BRUCK-step, &recvSock), ret, fail);
+    recvOpen = true;
+    NCCLCHECKGOTO(ncclSocketRecv(&recvSock, &recvBytes, sizeof(int)), ret, fail);
+    if (recvBytes != bytes) {
+      WARN("Bootstrap AllGather : received %d bytes from rank %d instead of %d", recvBytes, src, bytes);
+      ret = ncclInternalError;
+      goto fail;
+    }
+    while (sendOffset < bytes || recvOffset < bytes) {
+      if (sendOffset < bytes) NCCLCHECKGOTO(ncclSocketProgress(NCCL_SOCKET_SEND, &sendSock, tmp, bytes, &sendOffset), ret, fail);
+      if (recvOffset < bytes) NCCLCHECKGOTO(ncclSocketProgress(NCCL_SOCKET_RECV, &recvSock, recvData, bytes, &recvOffset), ret, fail);
+    }
+    NCCLCHECKGOTO(ncclSocketClose(&sendSock), ret, fail);
+    sendOpen = false;
+    NCCLCHECKGOTO(ncclSocketClose(&recvSock), ret, fail);
+    recvOpen = false;
+  }
+  for (int i=1; i<nranks; i++) {
+    memcpy(data+(size_t)((rank+i)%nranks)*size, tmp+(size_t)i*size, size);
+  }
+
+exit:
+  free(tmp);
+  return ret;
+fail:
+  if (sendOpen) (void)ncclSocketClose(&sendSock);
+  if (recvOpen) (void)ncclSocketClose(&recvSock);
+  goto exit;
+}
+
 ncclResult_t bootstrapClose(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (state->unexpectedConnections != NULL) {
@@ -592,11 +995,13 @@ ncclResult_t bootstrapClose(void* commState) {
     }
   }
 
+  NCCLCHECK(bootstrapRingNetClose(state));
   NCCLCHECK(ncclSocketClose(&state->listenSock));
   NCCLCHECK(ncclSocketClose(&state->ringSendSocket));
   NCCLCHECK(ncclSocketClose(&state->ringRecvSocket));
 
   free(state->peerCommAddresses);
+  NCCLCHECK(bootstrapSharedRelease(state->shared));
   free(state);
 
   return ncclSuccess;
@@ -605,12 +1010,14 @@ ncclResult_t bootstrapClose(void* commState) {
 ncclResult_t bootstrapAbort(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (commState == NULL) return ncclSuccess;
+  NCCLCHECK(bootstrapRingNetClose(state));
   NCCLCHECK(ncclSocketClose(&state->listenSock));
   NCCLCHECK(ncclSocketClose(&state->ringSendSocket));
   NCCLCHECK(ncclSocketClose(&state->ringRecvSocket));
   free(state->peerCommAddresses);
   free(state->peerProxyAddresses);
   free(state->peerProxyAddressesUDS);
+  NCCLCHECK(bootstrapSharedRelease(state->shared));
   free(state);
   return ncclSuccess;
 }
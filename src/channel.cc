@@ -38,10 +38,12 @@ ncclResult_t initChannel(struct ncclComm* comm, int channelId) {
   if (channel->devPeers == NULL) {
     if (sharedRes->devPeers[channelId] == NULL) {
       NCCLCHECK(ncclCudaCallocAsync(sharedRes->devPeers + channelId, sharedRes->tpNRanks, sharedRes->deviceStream.cudaStream));
+      ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, sharedRes->tpNRanks*sizeof(struct ncclDevChannelPeer));
     }
     /* channel->devPeers is not shared, so just free it when calling commFree() */
     NCCLCHECK(ncclCudaCallocAsync(&channel->devPeers, nPeers, sharedRes->deviceStream.cudaStream));
     ncclCommPushCudaFree(comm, channel->devPeers);
+    ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, nPeers*sizeof(struct ncclDevChannelPeer*));
     NCCLCHECK(ncclCalloc(&channel->devPeersHostPtr, nPeers));
     for (int r = 0; r < nRanks; r++) {
       uintptr_t addr = (uintptr_t)(comm->sharedRes->devPeers[channelId] + comm->topParentRanks[r]);
@@ -53,6 +55,7 @@ ncclResult_t initChannel(struct ncclComm* comm, int channelId) {
   channel->ring.userRanks = ncclMemoryStackAlloc<int>(&comm->memPermanent, nRanks);
   NCCLCHECK(ncclCudaCallocAsync(&channel->devRingUserRanks, nRanks, sharedRes->deviceStream.cudaStream));
   ncclCommPushCudaFree(comm, channel->devRingUserRanks);
+  ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, nRanks*sizeof(int));
 
   /* guarantee addr has been copied into channel->devPeers */
   NCCLCHECK(ncclStrongStreamSynchronize(&sharedRes->deviceStream));
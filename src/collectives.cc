@@ -5,13 +5,169 @@
  ************************************************************************/
 
 #include "argcheck.h" // Need some checks here since we access comm
+#include "bootstrap.h"
 #include "collectives.h"
 #include "enqueue.h"
 #include "graph/topo.h"
+#include "group.h"
+#include "ipccache.h"
 #include "nccl.h"
 
 #include "msccl/msccl_lifecycle.h"
 
+#include <algorithm>
+
+// Copy engine AllGather: on a single node, every rank pulls the send buffers of
+// its peers into its own receive buffer with DMA copies, so that no CU is taken
+// away from concurrent compute. Ordering with the peers' streams relies on IPC
+// events, the host only exchanges buffer handles and takes part in a barrier.
+RCCL_PARAM(CeAllGather, "CE_ALLGATHER", 0);
+RCCL_PARAM(CeAllGatherMinBytes, "CE_ALLGATHER_MIN_BYTES", 4<<20);
+
+static bool ceAllGatherEnabled(ncclComm_t comm, size_t bytes, cudaStream_t stream) {
+  if (!rcclParamCeAllGather() || bytes < rcclParamCeAllGatherMinBytes()) return false;
+  // The host barriers need one rank per process and would deadlock in a group
+  // or with non-blocking communicators.
+  if (comm->nNodes != 1 || comm->nRanks < 2 || comm->intraRanks != 1 ||
+      comm->intraHighestTransportType != TRANSPORT_P2P) return false;
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  // IPC events can't be captured
+  struct ncclCudaGraph graph;
+  if (ncclCudaGetCapturingGraph(&graph, stream) != ncclSuccess || ncclCudaGraphValid(graph)) return false;
+  return true;
+}
+
+static ncclResult_t ceAllGatherInit(ncclComm_t comm) {
+  struct {
+    hipIpcEventHandle_t ready;
+    hipIpcEventHandle_t done;
+  } *handles;
+  const int localRanks = comm->localRanks;
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECK(ncclCalloc(&handles, localRanks));
+  CUDACHECKGOTO(hipEventCreateWithFlags(&comm->ceReadyEvent, hipEventDisableTiming|hipEventInterprocess), ret, exit);
+  CUDACHECKGOTO(hipEventCreateWithFlags(&comm->ceDoneEvent, hipEventDisableTiming|hipEventInterprocess), ret, exit);
+  CUDACHECKGOTO(hipIpcGetEventHandle(&handles[comm->localRank].ready, comm->ceReadyEvent), ret, exit);
+  CUDACHECKGOTO(hipIpcGetEventHandle(&handles[comm->localRank].done, comm->ceDoneEvent), ret, exit);
+  NCCLCHECKGOTO(bootstrapIntraNodeAllGather(comm->bootstrap, comm->localRankToRank, comm->localRank, localRanks, handles, sizeof(*handles)), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&comm->cePeerReadyEvents, localRanks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&comm->cePeerDoneEvents, localRanks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&comm->ceBuffers, localRanks), ret, exit);
+  for (int p=0; p<localRanks; p++) {
+    if (p == comm->localRank) continue;
+    CUDACHECKGOTO(hipIpcOpenEventHandle(comm->cePeerReadyEvents+p, handles[p].ready), ret, exit);
+    CUDACHECKGOTO(hipIpcOpenEventHandle(comm->cePeerDoneEvents+p, handles[p].done), ret, exit);
+  }
+  NCCLCHECKGOTO(ncclCeStreamsCreate(comm->ceStreams, &comm->ceNStreams), ret, exit);
+  for (int i=0; i<comm->ceNStreams; i++) {
+    CUDACHECKGOTO(hipEventCreateWithFlags(comm->ceJoinEvents+i, hipEventDisableTiming), ret, exit);
+  }
+  comm->ceInitialized = true;
+  INFO(NCCL_INIT, "Copy engine AllGather enabled with %d streams", comm->ceNStreams);
+exit:
+  free(handles);
+  return ret;
+}
+
+static ncclResult_t ceMapPeerBuffer(ncclComm_t comm, int peer, hipIpcMemHandle_t* handle, void** base) {
+  for (int i=0; i<comm->ceNMappings; i++) {
+    struct ncclCeIpcMapping* m = comm->ceMappings+i;
+    if (m->peer == peer && memcmp(&m->handle, handle, sizeof(*handle)) == 0) {
+      *base = m->base;
+      return ncclSuccess;
+    }
+  }
+  if (comm->ceNMappings == comm->ceMappingsCapacity) {
+    int capacity = comm->ceMappingsCapacity < 16 ? 16 : 2*comm->ceMappingsCapacity;
+    NCCLCHECK(ncclRealloc(&comm->ceMappings, comm->ceNMappings, capacity));
+    comm->ceMappingsCapacity = capacity;
+  }
+  NCCLCHECK(ncclIpcCacheOpen(handle, base));
+  struct ncclCeIpcMapping* m = comm->ceMappings+comm->ceNMappings++;
+  m->peer = peer;
+  m->handle = *handle;
+  m->base = *base;
+  return ncclSuccess;
+}
+
+static ncclResult_t ceAllGather(const void* sendbuff, void* recvbuff, size_t bytes, ncclComm_t comm, cudaStream_t stream) {
+  const int localRanks = comm->localRanks;
+  const int localRank = comm->localRank;
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (!comm->ceInitialized) NCCLCHECK(ceAllGatherInit(comm));
+
+  struct ncclCeBuffer* buffers = comm->ceBuffers;
+  void* base;
+  size_t size;
+  CUDACHECKGOTO(hipMemGetAddressRange(&base, &size, (void*)sendbuff), ret, exit);
+  CUDACHECKGOTO(hipIpcGetMemHandle(&buffers[localRank].handle, base), ret, exit);
+  buffers[localRank].offset = (const char*)sendbuff - (const char*)base;
+
+  // The send buffer is ready once the work queued before us on the stream is
+  // done. Exchanging the handles orders this record before the peers wait on it.
+  CUDACHECKGOTO(hipEventRecord(comm->ceReadyEvent, stream), ret, exit);
+  NCCLCHECKGOTO(bootstrapIntraNodeAllGather(comm->bootstrap, comm->localRankToRank, localRank, localRanks, buffers, sizeof(*buffers)), ret, exit);
+
+  CUDACHECKGOTO(hipEventRecord(comm->ceJoinEvents[0], stream), ret, exit);
+  for (int i=0; i<comm->ceNStreams; i++) {
+    CUDACHECKGOTO(hipStreamWaitEvent(comm->ceStreams[i], comm->ceJoinEvents[0], 0), ret, exit);
+  }
+  for (int i=1; i<localRanks; i++) {
+    int p = (localRank+i)%localRanks;
+    hipStream_t s = comm->ceStreams[i%comm->ceNStreams];
+    void* peerBase;
+    NCCLCHECKGOTO(ceMapPeerBuffer(comm, p, &buffers[p].handle, &peerBase), ret, exit);
+    CUDACHECKGOTO(hipStreamWaitEvent(s, comm->cePeerReadyEvents[p], 0), ret, exit);
+    CUDACHECKGOTO(hipMemcpyAsync((char*)recvbuff + comm->localRankToRank[p]*bytes, (char*)peerBase + buffers[p].offset, bytes, hipMemcpyDeviceToDevice, s), ret, exit);
+  }
+  {
+    char* dst = (char*)recvbuff + comm->rank*bytes;
+    if (dst != sendbuff) CUDACHECKGOTO(hipMemcpyAsync(dst, sendbuff, bytes, hipMemcpyDeviceToDevice, stream), ret, exit);
+  }
+  for (int i=0; i<comm->ceNStreams; i++) {
+    CUDACHECKGOTO(hipEventRecord(comm->ceJoinEvents[i], comm->ceStreams[i]), ret, exit);
+    CUDACHECKGOTO(hipStreamWaitEvent(stream, comm->ceJoinEvents[i], 0), ret, exit);
+  }
+
+  // Our send buffer must not be reused before every peer is done reading it.
+  CUDACHECKGOTO(hipEventRecord(comm->ceDoneEvent, stream), ret, exit);
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, comm->localRankToRank, localRank, localRanks, comm->localRankToRank[0]), ret, exit);
+  for (int p=0; p<localRanks; p++) {
+    if (p == localRank) continue;
+    CUDACHECKGOTO(hipStreamWaitEvent(stream, comm->cePeerDoneEvents[p], 0), ret, exit);
+  }
+exit:
+  return ret;
+}
+
+ncclResult_t ncclCeAllGatherFree(ncclComm_t comm) {
+  for (int i=0; i<comm->ceNMappings; i++) (void)ncclIpcCacheClose(comm->ceMappings[i].base);
+  free(comm->ceMappings);
+  if (!comm->ceInitialized) return ncclSuccess;
+  for (int p=0; p<comm->localRanks; p++) {
+    if (p == comm->localRank) continue;
+    (void)hipEventDestroy(comm->cePeerReadyEvents[p]);
+    (void)hipEventDestroy(comm->cePeerDoneEvents[p]);
+  }
+  free(comm->cePeerReadyEvents);
+  free(comm->cePeerDoneEvents);
+  free(comm->ceBuffers);
+  for (int i=0; i<comm->ceNStreams; i++) {
+    (void)hipEventDestroy(comm->ceJoinEvents[i]);
+    (void)hipStreamDestroy(comm->ceStreams[i]);
+  }
+  (void)hipEventDestroy(comm->ceReadyEvent);
+  (void)hipEventDestroy(comm->ceDoneEvent);
+  return ncclSuccess;
+}
+
+static bool compressAllGatherEnabled(ncclComm_t comm, ncclDataType_t datatype, cudaStream_t stream);
+#if defined(RCCL_FLOAT8)
+static ncclResult_t compressedAllGather(const void* sendbuff, void* recvbuff, size_t sendcount,
+    ncclDataType_t datatype, ncclComm_t comm, cudaStream_t stream);
+#endif
+
 NCCL_API(ncclResult_t, ncclAllGather, const void* sendbuff, void* recvbuff, size_t sendcount,
     ncclDataType_t datatype, ncclComm_t comm, cudaStream_t stream);
 ncclResult_t ncclAllGather(const void* sendbuff, void* recvbuff, size_t sendcount,
@@ -29,12 +185,268 @@ ncclResult_t ncclAllGather(const void* sendbuff, void* recvbuff, size_t sendcoun
       sendcount, datatype, 0, 0, ncclSum, mscclFuncAllGather, comm, stream);
   }
 
+  if (ceAllGatherEnabled(comm, msgsize, stream)) {
+    NCCLCHECK(ceAllGather(sendbuff, recvbuff, msgsize, comm, stream));
+    return ncclSuccess;
+  }
+#if defined(RCCL_FLOAT8)
+  if (compressAllGatherEnabled(comm, datatype, stream) && sendcount % RCCL_COMPRESS_BLOCK == 0) {
+    return compressedAllGather(sendbuff, recvbuff, sendcount, datatype, comm, stream);
+  }
+#endif
+
   struct ncclInfo info = { ncclFuncAllGather, "AllGather",
     sendbuff, recvbuff, sendcount, datatype, ncclSum, 0, comm, stream, /* Args */
     ALLGATHER_CHUNKSTEPS, ALLGATHER_SLICESTEPS };
   return ncclEnqueueCheck(&info);
 }
 
+// Sums of FP8, FP16 or BF16 data with FP32 accumulation: the reduce-scatter part
+// is an AllToAll of the inputs into a landing buffer, followed by a local kernel
+// that adds the nRanks slices in FP32 and rounds once. Traffic stays in the input
+// type and the same volume as a ring, but partial sums are no longer rounded to
+// that type at every hop. FP8 and FP16/BF16 are enabled separately.
+RCCL_PARAM(Fp8AccumReduce, "FP8_ACCUM_REDUCE", 0);
+RCCL_PARAM(Bf16AccumReduce, "BF16_ACCUM_REDUCE", 0);
+
+static bool accumEnabled(ncclComm_t comm, ncclDataType_t datatype, ncclRedOp_t op, cudaStream_t stream) {
+  if (comm == nullptr || comm->nRanks < 2 || op != ncclSum) return false;
+  switch (datatype) {
+#if defined(RCCL_FLOAT8)
+  case ncclFp8E4M3:
+  case ncclFp8E5M2:
+    if (!rcclParamFp8AccumReduce()) return false;
+    break;
+#endif
+  case ncclFloat16:
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16:
+#endif
+    if (!rcclParamBf16AccumReduce()) return false;
+    break;
+  default:
+    return false;
+  }
+  // The local kernel must run between the exchanges, which a non-blocking comm
+  // may still be issuing from its group thread when the call returns
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  // The landing buffer can be reallocated between calls, so it can't be captured
+  struct ncclCudaGraph graph;
+  if (ncclCudaGetCapturingGraph(&graph, stream) != ncclSuccess || ncclCudaGraphValid(graph)) return false;
+  return true;
+}
+
+static ncclResult_t accumReduceScatter(const void* sendbuff, void* recvbuff, size_t recvcount,
+    ncclDataType_t datatype, ncclComm_t comm, cudaStream_t stream) {
+  size_t stagingBytes = comm->nRanks*recvcount*ncclTypeSize(datatype);
+  if (stagingBytes > comm->accumStagingSize) {
+    if (comm->accumStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->accumStaging));
+      comm->accumStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->accumStaging, stagingBytes));
+    comm->accumStagingSize = stagingBytes;
+  }
+  NCCLCHECK(ncclAllToAll(sendbuff, comm->accumStaging, recvcount, datatype, comm, stream));
+  NCCLCHECK(ncclLaunchFp32AccumReduce(recvbuff, comm->accumStaging, comm->nRanks, recvcount, datatype, stream));
+  return ncclSuccess;
+}
+
+// Deterministic AllReduce and ReduceScatter: the inputs are exchanged with an AllToAll
+// and each rank reduces its slice locally in rank order, so every element is reduced
+// in the same order whatever the algorithm, protocol or number of channels the tuning
+// picks. AllReduce then gathers the slices. This moves the same bytes as a ring. The
+// elements left over when count isn't a multiple of nRanks are gathered whole and
+// reduced by every rank. Integer reductions and floating-point min/max give the same
+// result in any order, so they keep the tuned algorithms.
+RCCL_PARAM(Deterministic, "DETERMINISTIC", 0);
+
+static bool deterministicEnabled(ncclComm_t comm, ncclDataType_t datatype, ncclRedOp_t op) {
+  if (!rcclParamDeterministic() || comm == nullptr || comm->nRanks < 2) return false;
+  if (op == ncclMax || op == ncclMin) return false;
+  switch (datatype) {
+  case ncclInt8:
+  case ncclUint8:
+  case ncclInt32:
+  case ncclUint32:
+  case ncclInt64:
+  case ncclUint64:
+    return false;
+  default:
+    return true;
+  }
+}
+
+static ncclResult_t orderedReduce(const void* sendbuff, void* recvbuff, size_t count, bool allGather,
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, cudaStream_t stream) {
+  const int nRanks = comm->nRanks;
+  const size_t typeSize = ncclTypeSize(datatype);
+  // AllReduce of count elements, or ReduceScatter of count elements per rank
+  const size_t rankCount = allGather ? count / nRanks : count;
+  const size_t remCount = allGather ? count % nRanks : 0;
+  const size_t mainBytes = ROUNDUP(nRanks*rankCount*typeSize, 16);
+  size_t stagingBytes = mainBytes + nRanks*remCount*typeSize;
+  struct ncclInfo info = { allGather ? ncclFuncAllReduce : ncclFuncReduceScatter, allGather ? "AllReduce" : "ReduceScatter",
+    sendbuff, recvbuff, count, datatype, op, 0, comm, stream, /* Args */
+    ALLREDUCE_CHUNKSTEPS, ALLREDUCE_SLICESTEPS };
+  struct ncclDevRedOpFull opFull;
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  NCCLCHECK(ArgsCheck(&info));
+  // The local kernel must run between the exchanges, and the landing buffer can be
+  // reallocated between calls. Falling back to the tuned algorithms would lose the
+  // fixed order without telling anyone, so these calls are refused.
+  if (ncclGroupDepth > 0 || !comm->config.blocking) {
+    WARN("%s : RCCL_DETERMINISTIC reductions can't be called inside a group or on a non-blocking communicator", info.opName);
+    return ncclInvalidUsage;
+  }
+  struct ncclCudaGraph graph;
+  NCCLCHECK(ncclCudaGetCapturingGraph(&graph, stream));
+  if (ncclCudaGraphValid(graph)) {
+    WARN("%s : RCCL_DETERMINISTIC reductions can't be captured in a graph", info.opName);
+    return ncclInvalidUsage;
+  }
+  NCCLCHECK(ncclHostToDevRedOp(&opFull, op, datatype, comm));
+  if (stagingBytes > comm->orderedStagingSize) {
+    if (comm->orderedStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->orderedStaging));
+      comm->orderedStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->orderedStaging, stagingBytes));
+    comm->orderedStagingSize = stagingBytes;
+  }
+  char* remStaging = comm->orderedStaging + mainBytes;
+  char* rankRecv = allGather ? (char*)recvbuff + comm->rank*rankCount*typeSize : (char*)recvbuff;
+  char* remRecv = (char*)recvbuff + nRanks*rankCount*typeSize;
+
+  // Both exchanges read sendbuff before anything is written to recvbuff
+  NCCLCHECK(ncclGroupStart());
+  if (rankCount) NCCLCHECK(ncclAllToAll(sendbuff, comm->orderedStaging, rankCount, datatype, comm, stream));
+  if (remCount) NCCLCHECK(ncclAllGather((const char*)sendbuff + nRanks*rankCount*typeSize, remStaging, remCount, datatype, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  NCCLCHECK(ncclLaunchOrderedReduce(rankRecv, comm->orderedStaging, nRanks, rankCount, opFull, datatype, stream));
+  NCCLCHECK(ncclLaunchOrderedReduce(remRecv, remStaging, nRanks, remCount, opFull, datatype, stream));
+  if (allGather && rankCount) NCCLCHECK(ncclAllGather(rankRecv, recvbuff, rankCount, datatype, comm, stream));
+  return ncclSuccess;
+}
+
+// Block-scaled FP8 compression for sums of FP16/BF16/FP32 data across nodes.
+// The reduce-scatter part is an AllToAll of the compressed inputs, reduced
+// locally in FP32; AllReduce then compresses the reduced slice again for the
+// AllGather. This is lossy, each block keeps about 3 significant bits relative
+// to its largest element, so it is opt-in. AllGather, e.g. of FSDP weights, can be
+// compressed on its own: the slices are gathered in FP8 and dequantized on arrival.
+RCCL_PARAM(CompressReduce, "COMPRESS_REDUCE", 0);
+RCCL_PARAM(CompressAllGather, "COMPRESS_ALLGATHER", 0);
+
+static bool compressSupported(ncclComm_t comm, ncclDataType_t datatype, cudaStream_t stream) {
+#if defined(RCCL_FLOAT8)
+  if (comm == nullptr || comm->nNodes < 2) return false;
+  if (datatype != ncclFloat16 && datatype != ncclFloat32
+#if defined(RCCL_BFLOAT16)
+      && datatype != ncclBfloat16
+#endif
+     ) return false;
+  // The local kernels must run between the exchanges, which a non-blocking comm
+  // may still be issuing from its group thread when the call returns
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  // The staging buffer can be reallocated between calls, so it can't be captured
+  struct ncclCudaGraph graph;
+  if (ncclCudaGetCapturingGraph(&graph, stream) != ncclSuccess || ncclCudaGraphValid(graph)) return false;
+  return true;
+#else
+  return false;
+#endif
+}
+
+static bool compressEnabled(ncclComm_t comm, ncclDataType_t datatype, ncclRedOp_t op, cudaStream_t stream) {
+  return rcclParamCompressReduce() && op == ncclSum && compressSupported(comm, datatype, stream);
+}
+
+static bool compressAllGatherEnabled(ncclComm_t comm, ncclDataType_t datatype, cudaStream_t stream) {
+  return rcclParamCompressAllGather() && compressSupported(comm, datatype, stream);
+}
+
+#if defined(RCCL_FLOAT8)
+// Compressed data of nElts elements: FP8 values followed by the block scales
+static inline size_t compressedBytes(size_t nElts) {
+  return nElts + nElts/RCCL_COMPRESS_BLOCK*sizeof(float);
+}
+
+static ncclResult_t compressStaging(ncclComm_t comm, size_t stagingBytes, cudaStream_t stream) {
+  if (stagingBytes > comm->compressStagingSize) {
+    if (comm->compressStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->compressStaging));
+      comm->compressStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->compressStaging, stagingBytes));
+    comm->compressStagingSize = stagingBytes;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t compressedReduce(const void* sendbuff, void* recvbuff, size_t rankCount, bool allGather,
+    ncclDataType_t datatype, ncclComm_t comm, cudaStream_t stream) {
+  const int nRanks = comm->nRanks;
+  const size_t count = nRanks*rankCount;
+  const size_t rankBlocks = rankCount/RCCL_COMPRESS_BLOCK;
+  NCCLCHECK(compressStaging(comm, 2*compressedBytes(count) + (allGather ? compressedBytes(rankCount) : 0), stream));
+  // Compressed input, later the AllGather output
+  char* q0 = comm->compressStaging;
+  float* s0 = (float*)(q0 + count);
+  // Compressed slices received from all ranks
+  char* q1 = q0 + compressedBytes(count);
+  float* s1 = (float*)(q1 + count);
+  // Compressed reduced slice
+  char* q2 = q1 + compressedBytes(count);
+  float* s2 = (float*)(q2 + rankCount);
+
+  void* rankRecv = allGather ? (char*)recvbuff + comm->rank*rankCount*ncclTypeSize(datatype) : recvbuff;
+  NCCLCHECK(rcclCompressQuantize(q0, s0, sendbuff, count, datatype, stream));
+  NCCLCHECK(ncclGroupStart());
+  NCCLCHECK(ncclAllToAll(q0, q1, rankCount, ncclUint8, comm, stream));
+  NCCLCHECK(ncclAllToAll(s0, s1, rankBlocks, ncclFloat32, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  NCCLCHECK(rcclCompressReduce(rankRecv, allGather ? q2 : nullptr, s2, q1, s1, nRanks, rankCount, datatype, stream));
+  if (!allGather) return ncclSuccess;
+
+  NCCLCHECK(ncclGroupStart());
+  NCCLCHECK(ncclAllGather(q2, q0, rankCount, ncclUint8, comm, stream));
+  NCCLCHECK(ncclAllGather(s2, s0, rankBlocks, ncclFloat32, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  // The local slice is overwritten too, so that all ranks end up with the same result
+  NCCLCHECK(rcclCompressDequantize(recvbuff, q0, s0, count, datatype, stream));
+  return ncclSuccess;
+}
+
+static ncclResult_t compressedAllGather(const void* sendbuff, void* recvbuff, size_t sendcount,
+    ncclDataType_t datatype, ncclComm_t comm, cudaStream_t stream) {
+  const size_t count = comm->nRanks*sendcount;
+  const size_t rankBlocks = sendcount/RCCL_COMPRESS_BLOCK;
+  NCCLCHECK(compressStaging(comm, compressedBytes(sendcount) + compressedBytes(count), stream));
+  // Compressed local slice
+  char* q0 = comm->compressStaging;
+  float* s0 = (float*)(q0 + sendcount);
+  // Compressed slices of all ranks
+  char* q1 = q0 + compressedBytes(sendcount);
+  float* s1 = (float*)(q1 + count);
+
+  NCCLCHECK(rcclCompressQuantize(q0, s0, sendbuff, sendcount, datatype, stream));
+  NCCLCHECK(ncclGroupStart());
+  NCCLCHECK(ncclAllGather(q0, q1, sendcount, ncclUint8, comm, stream));
+  NCCLCHECK(ncclAllGather(s0, s1, rankBlocks, ncclFloat32, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  // The local slice goes through the compression too, so that all ranks end up with the same result
+  NCCLCHECK(rcclCompressDequantize(recvbuff, q1, s1, count, datatype, stream));
+  return ncclSuccess;
+}
+#endif
+
 NCCL_API(ncclResult_t, ncclAllReduce, const void* sendbuff, void* recvbuff, size_t count,
     ncclDataType_t datatype, ncclRedOp_t op, ncclComm* comm, cudaStream_t stream);
 ncclResult_t ncclAllReduce(const void* sendbuff, void* recvbuff, size_t count,
@@ -52,6 +464,21 @@ ncclResult_t ncclAllReduce(const void* sendbuff, void* recvbuff, size_t count,
   NvtxParamsAllReduce payload{count * ncclTypeSize(datatype), op};
   NVTX3_FUNC_WITH_PARAMS(AllReduce, AllReduceSchema, payload)
 
+#if defined(RCCL_FLOAT8)
+  if (compressEnabled(comm, datatype, op, stream) && count % (comm->nRanks*RCCL_COMPRESS_BLOCK) == 0) {
+    return compressedReduce(sendbuff, recvbuff, count / comm->nRanks, /*allGather=*/true, datatype, comm, stream);
+  }
+#endif
+  if (accumEnabled(comm, datatype, op, stream) && count % comm->nRanks == 0) {
+    size_t rankCount = count / comm->nRanks;
+    char* rankRecv = (char*)recvbuff + comm->rank*rankCount*ncclTypeSize(datatype);
+    NCCLCHECK(accumReduceScatter(sendbuff, rankRecv, rankCount, datatype, comm, stream));
+    return ncclAllGather(rankRecv, recvbuff, rankCount, datatype, comm, stream);
+  }
+  if (deterministicEnabled(comm, datatype, op) && count) {
+    return orderedReduce(sendbuff, recvbuff, count, /*allGather=*/true, datatype, op, comm, stream);
+  }
+
   if (mscclAvailable(comm->rank) && !mscclIsCaller()) {
     return mscclEnqueueCheck(
       sendbuff, nullptr, nullptr, recvbuff, nullptr, nullptr,
@@ -64,6 +491,142 @@ ncclResult_t ncclAllReduce(const void* sendbuff, void* recvbuff, size_t count,
   return ncclEnqueueCheck(&info);
 }
 
+// Reducing the tensors in one group lets the enqueue aggregate them as a single
+// collective: they share the tuning and the channels, and their work elements are
+// batched into the same plan, reading and writing every tensor in place.
+NCCL_API(ncclResult_t, ncclAllReduceCoalesced, const void* const sendbuffs[], void* const recvbuffs[], const size_t counts[],
+    int nTensors, ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream);
+ncclResult_t ncclAllReduceCoalesced(const void* const sendbuffs[], void* const recvbuffs[], const size_t counts[],
+    int nTensors, ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream) {
+  NCCLCHECK(PtrCheck(comm, "AllReduceCoalesced", "comm"));
+  if (nTensors < 0) {
+    WARN("AllReduceCoalesced : invalid number of tensors %d", nTensors);
+    return ncclInvalidArgument;
+  }
+  if (nTensors == 0) return ncclSuccess;
+  NCCLCHECK(PtrCheck((void*)sendbuffs, "AllReduceCoalesced", "sendbuffs"));
+  NCCLCHECK(PtrCheck((void*)recvbuffs, "AllReduceCoalesced", "recvbuffs"));
+  NCCLCHECK(PtrCheck((void*)counts, "AllReduceCoalesced", "counts"));
+
+  NCCLCHECK(ncclGroupStart());
+  for (int t=0; t<nTensors; t++) {
+    if (counts[t] == 0) continue;
+    NCCLCHECK(ncclAllReduce(sendbuffs[t], recvbuffs[t], counts[t], datatype, op, comm, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
+// Sparse AllReduce of COO rows, e.g. embedding gradients: each rank gives nnz rows
+// of rowCount values with their row index, and every rank gets the sum as a dense
+// array of nRows rows. The rows of every rank are broadcast and summed into the
+// dense array locally, unless the dense AllReduce moves fewer bytes.
+RCCL_PARAM(SparseDenseRatio, "SPARSE_DENSE_RATIO", 100); // Percent of the dense bytes the sparse path may move
+
+NCCL_API(ncclResult_t, ncclSparseAllReduce, const int64_t* indices, const void* values, size_t nnz, size_t rowCount,
+    void* recvbuff, size_t nRows, ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream);
+ncclResult_t ncclSparseAllReduce(const int64_t* indices, const void* values, size_t nnz, size_t rowCount,
+    void* recvbuff, size_t nRows, ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream) {
+  NCCLCHECK(PtrCheck(comm, "SparseAllReduce", "comm"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (op != ncclSum) {
+    WARN("SparseAllReduce : only ncclSum is supported");
+    return ncclInvalidArgument;
+  }
+  if (nRows == 0 || rowCount == 0) return ncclSuccess;
+  if (nnz) {
+    NCCLCHECK(PtrCheck((void*)indices, "SparseAllReduce", "indices"));
+    NCCLCHECK(PtrCheck((void*)values, "SparseAllReduce", "values"));
+  }
+  NCCLCHECK(PtrCheck(recvbuff, "SparseAllReduce", "recvbuff"));
+  // The row counts are exchanged on the host before anything is launched, and the
+  // broadcasts must be issued before the local reduction is queued
+  if (ncclGroupDepth > 0) {
+    WARN("SparseAllReduce : can't be called inside a group");
+    return ncclInvalidUsage;
+  }
+  if (!comm->config.blocking) {
+    WARN("SparseAllReduce : can't be called on a non-blocking communicator");
+    return ncclInvalidUsage;
+  }
+  struct ncclCudaGraph graph;
+  NCCLCHECK(ncclCudaGetCapturingGraph(&graph, stream));
+  if (ncclCudaGraphValid(graph)) {
+    WARN("SparseAllReduce : can't be captured in a graph");
+    return ncclInvalidUsage;
+  }
+
+  const int nRanks = comm->nRanks;
+  const size_t rowBytes = rowCount*ncclTypeSize(datatype);
+  if (comm->sparseCounts == nullptr) NCCLCHECK(ncclCalloc(&comm->sparseCounts, nRanks));
+  size_t* counts = comm->sparseCounts;
+  counts[comm->rank] = nnz;
+  NCCLCHECK(bootstrapAllGather(comm->bootstrap, counts, sizeof(size_t)));
+  size_t total = 0;
+  for (int r=0; r<nRanks; r++) total += counts[r];
+
+  CUDACHECK(cudaMemsetAsync(recvbuff, 0, nRows*rowBytes, stream));
+  size_t denseBytes = 2*(nRanks-1)*(nRows*rowBytes/nRanks);
+  size_t sparseBytes = total*(sizeof(int64_t) + rowBytes);
+  if (sparseBytes*100 >= denseBytes*rcclParamSparseDenseRatio()) {
+    INFO(NCCL_COLL, "SparseAllReduce: %zu rows out of %zu, dense AllReduce comm %p", total, nRows, comm);
+    NCCLCHECK(ncclLaunchSparseScatterReduce(recvbuff, indices, values, nnz, rowCount, nRows, datatype, stream));
+    return ncclAllReduce(recvbuff, recvbuff, nRows*rowCount, datatype, op, comm, stream);
+  }
+
+  const size_t indexBytes = ROUNDUP(total*sizeof(int64_t), 16);
+  size_t stagingBytes = indexBytes + total*rowBytes;
+  if (stagingBytes > comm->sparseStagingSize) {
+    if (comm->sparseStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->sparseStaging));
+      comm->sparseStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->sparseStaging, stagingBytes));
+    comm->sparseStagingSize = stagingBytes;
+  }
+  int64_t* allIndices = (int64_t*)comm->sparseStaging;
+  char* allValues = comm->sparseStaging + indexBytes;
+
+  // One broadcast per contributing rank, each gets channels of its own
+  NCCLCHECK(ncclGroupStart());
+  size_t offset = 0;
+  for (int r=0; r<nRanks; r++) {
+    if (counts[r] == 0) continue;
+    bool mine = r == comm->rank;
+    NCCLCHECK(ncclBroadcast(mine ? (const void*)indices : allIndices+offset, allIndices+offset, counts[r], ncclInt64, r, comm, stream));
+    NCCLCHECK(ncclBroadcast(mine ? values : allValues+offset*rowBytes, allValues+offset*rowBytes, counts[r]*rowCount, datatype, r, comm, stream));
+    offset += counts[r];
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclLaunchSparseScatterReduce(recvbuff, allIndices, allValues, total, rowCount, nRows, datatype, stream);
+}
+
+// On a single rank communicator the collectives built from send/recv groups only
+// move the rank's own block. It is copied on the stream right away, without going
+// through the p2p planner and kernel, which also works under graph capture.
+static ncclResult_t oneRankCopy(ncclComm_t comm, const char* opName, void* dst, const void* src, size_t bytes, int root, cudaStream_t stream) {
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (comm->suspended) {
+    WARN("%s: comm %p is suspended, call ncclCommResume first", opName, comm);
+    return ncclInvalidUsage;
+  }
+  if (root != 0) {
+    WARN("%s : invalid root %d (root should be in the 0..0 range)", opName, root);
+    return ncclInvalidArgument;
+  }
+  if (bytes == 0 || dst == src) return ncclSuccess;
+  NCCLCHECK(PtrCheck((void*)src, opName, "sendbuff"));
+  NCCLCHECK(PtrCheck(dst, opName, "recvbuff"));
+  INFO(NCCL_COLL, "%s: single rank copy of %zu bytes from %p to %p comm %p stream %p", opName, bytes, src, dst, comm, stream);
+  NCCLCHECK(ncclCudaMemcpyAsync((char*)dst, (char*)src, bytes, stream));
+  return ncclSuccess;
+}
+
+// Use the native alltoall kernel instead of a group of ncclSend/ncclRecv
+RCCL_PARAM(AllToAllKernelEnable, "ALLTOALL_KERNEL_ENABLE", 0);
+
 NCCL_API(ncclResult_t, ncclAllToAll, const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype,
   ncclComm_t comm, hipStream_t stream);
 ncclResult_t ncclAllToAll(const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype,
@@ -80,6 +643,7 @@ ncclResult_t ncclAllToAll(const void* sendbuff, void* recvbuff, size_t count, nc
       sendbuff, nullptr, nullptr, recvbuff, nullptr, nullptr,
       count, datatype, 0, 0, ncclSum, mscclFuncAllToAll, comm, stream);
   }
+  if (comm->nRanks == 1) return oneRankCopy(comm, "AllToAll", recvbuff, sendbuff, msgsize, 0, stream);
 
   size_t rankOffset = count * ncclTypeSize(datatype);
   size_t rankAlign = rankOffset & ((~rankOffset) + 1);
@@ -90,6 +654,12 @@ ncclResult_t ncclAllToAll(const void* sendbuff, void* recvbuff, size_t count, nc
       sendbuff, recvbuff, count, datatype, ncclSum, 0, comm, stream, /* Args */
       ALLTOALL_PIVOT_CHUNKSTEPS, ALLTOALL_PIVOT_SLICESTEPS };
     return ncclEnqueueCheck(&info);
+  } else if (rcclParamAllToAllKernelEnable() || ncclAllToAllUseBruck(comm, count, datatype)) {
+    // Small blocks always go through the kernel, which runs them with Bruck
+    struct ncclInfo info = { ncclFuncAllToAll, "AllToAll",
+      sendbuff, recvbuff, count, datatype, ncclSum, 0, comm, stream, /* Args */
+      ALLTOALL_CHUNKSTEPS, ALLTOALL_SLICESTEPS };
+    return ncclEnqueueCheck(&info);
   } else {
     int nRanks;
     NCCLCHECK(ncclCommCount(comm, &nRanks));
@@ -104,6 +674,120 @@ ncclResult_t ncclAllToAll(const void* sendbuff, void* recvbuff, size_t count, nc
   }
 }
 
+// Two-stage AllToAllv: data for other nodes is first gathered by the local rank
+// with the same local index as the destination, which then does a single
+// exchange with its peer on each node. Ranks only talk to their rail peers
+// across nodes, which divides the number of network connections by localRanks.
+RCCL_PARAM(AllToAllvHierarchical, "ALLTOALLV_HIERARCHICAL", 0);
+
+static bool allToAllvHierarchicalEnabled(ncclComm_t comm, cudaStream_t stream) {
+  if (!rcclParamAllToAllvHierarchical() || comm->nNodes < 2 || comm->localRanks < 2) return false;
+  for (int n=0; n<comm->nNodes; n++) {
+    if (comm->nodeRanks[n].localRanks != comm->localRanks) return false;
+  }
+  // The second stage sends what the first one received, each in a group of its own
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  // The staging buffer can be reallocated between calls, so it can't be captured
+  struct ncclCudaGraph graph;
+  if (ncclCudaGetCapturingGraph(&graph, stream) != ncclSuccess || ncclCudaGraphValid(graph)) return false;
+  return true;
+}
+
+// Gathers the send counts of all the local ranks. This rank forwards what the other
+// local ranks send to its rail peers, so it needs their counts.
+static ncclResult_t allToAllvExchangeCounts(ncclComm_t comm, const size_t sendcounts[]) {
+  if (comm->a2avCounts == nullptr) {
+    NCCLCHECK(ncclCalloc(&comm->a2avCounts, comm->localRanks*comm->nRanks));
+    NCCLCHECK(ncclCalloc(&comm->a2avOffsets, comm->localRanks*comm->nNodes));
+  }
+  memcpy(comm->a2avCounts+comm->localRank*comm->nRanks, sendcounts, comm->nRanks*sizeof(size_t));
+  NCCLCHECK(bootstrapIntraNodeAllGather(comm->bootstrap, comm->localRankToRank, comm->localRank, comm->localRanks,
+    comm->a2avCounts, comm->nRanks*sizeof(size_t)));
+  return ncclSuccess;
+}
+
+static ncclResult_t allToAllvHierarchical(const void *sendbuff, const size_t sendcounts[], const size_t sdispls[],
+    void *recvbuff, const size_t recvcounts[], const size_t rdispls[],
+    ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream) {
+  const int nRanks = comm->nRanks;
+  const int nNodes = comm->nNodes;
+  const int localRanks = comm->localRanks;
+  const int localRank = comm->localRank;
+  const int node = comm->node;
+  const size_t typeSize = ncclTypeSize(datatype);
+  const char* sbuf = (const char*)sendbuff;
+  char* rbuf = (char*)recvbuff;
+  size_t stagingBytes = 0;
+
+  // Without declared counts, every call exchanges them on the host
+  if (!comm->a2avCountsDeclared) {
+    NCCLCHECK(allToAllvExchangeCounts(comm, sendcounts));
+  } else if (memcmp(comm->a2avCounts+localRank*nRanks, sendcounts, nRanks*sizeof(size_t))) {
+    WARN("AllToAllv : send counts differ from the ones given to ncclAllToAllvDeclareCounts");
+    return ncclInvalidArgument;
+  }
+  size_t* counts = comm->a2avCounts;
+  size_t* offsets = comm->a2avOffsets;
+
+  for (int s=0; s<localRanks; s++) {
+    for (int n=0; n<nNodes; n++) {
+      offsets[s*nNodes+n] = stagingBytes;
+      if (n == node || s == localRank) continue;
+      int d = comm->nodeRanks[n].localRankToRank[localRank];
+      stagingBytes += counts[s*nRanks+d]*typeSize;
+    }
+  }
+  if (stagingBytes > comm->a2avStagingSize) {
+    if (comm->a2avStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->a2avStaging));
+      comm->a2avStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->a2avStaging, stagingBytes));
+    comm->a2avStagingSize = stagingBytes;
+  }
+  char* staging = comm->a2avStaging;
+
+  // Step 1: intra-node exchange. Besides its own data, each local peer p gets
+  // everything destined to the ranks with local index p on the other nodes.
+  NCCLCHECK(ncclGroupStart());
+  for (int p=0; p<localRanks; p++) {
+    int peer = comm->localRankToRank[p];
+    if (sendcounts[peer]) NCCLCHECK(ncclSend(sbuf + sdispls[peer]*typeSize, sendcounts[peer], datatype, peer, comm, stream));
+    if (recvcounts[peer]) NCCLCHECK(ncclRecv(rbuf + rdispls[peer]*typeSize, recvcounts[peer], datatype, peer, comm, stream));
+    if (p == localRank) continue;
+    for (int n=0; n<nNodes; n++) {
+      if (n == node) continue;
+      int d = comm->nodeRanks[n].localRankToRank[p];
+      if (sendcounts[d]) NCCLCHECK(ncclSend(sbuf + sdispls[d]*typeSize, sendcounts[d], datatype, peer, comm, stream));
+      size_t count = counts[p*nRanks+comm->nodeRanks[n].localRankToRank[localRank]];
+      if (count) NCCLCHECK(ncclRecv(staging + offsets[p*nNodes+n], count, datatype, peer, comm, stream));
+    }
+  }
+  NCCLCHECK(ncclGroupEnd());
+
+  // Step 2: inter-node exchange with the rank of the same local index on each
+  // other node, one block per source rank of the sending node.
+  NCCLCHECK(ncclGroupStart());
+  for (int n=0; n<nNodes; n++) {
+    if (n == node) continue;
+    int peer = comm->nodeRanks[n].localRankToRank[localRank];
+    for (int s=0; s<localRanks; s++) {
+      if (s == localRank) {
+        if (sendcounts[peer]) NCCLCHECK(ncclSend(sbuf + sdispls[peer]*typeSize, sendcounts[peer], datatype, peer, comm, stream));
+      } else {
+        size_t count = counts[s*nRanks+peer];
+        if (count) NCCLCHECK(ncclSend(staging + offsets[s*nNodes+n], count, datatype, peer, comm, stream));
+      }
+      int src = comm->nodeRanks[n].localRankToRank[s];
+      if (recvcounts[src]) NCCLCHECK(ncclRecv(rbuf + rdispls[src]*typeSize, recvcounts[src], datatype, peer, comm, stream));
+    }
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
 NCCL_API(ncclResult_t, ncclAllToAllv, const void *sendbuff, const size_t sendcounts[], const size_t sdispls[],
     void *recvbuff, const size_t recvcounts[], const size_t rdispls[],
     ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream);
@@ -128,6 +812,19 @@ ncclResult_t ncclAllToAllv(const void *sendbuff, const size_t sendcounts[], cons
       0, datatype, 0, 0, ncclSum, mscclFuncAllToAllv, comm, stream);
   }
 
+  if (comm->nRanks == 1) {
+    if (sendcounts[0] != recvcounts[0]) {
+      WARN("AllToAllv : send count %zu and receive count %zu differ on a single rank communicator", sendcounts[0], recvcounts[0]);
+      return ncclInvalidArgument;
+    }
+    size_t typeSize = ncclTypeSize(datatype);
+    return oneRankCopy(comm, "AllToAllv", (char*)recvbuff + rdispls[0]*typeSize, (char const*)sendbuff + sdispls[0]*typeSize,
+        sendcounts[0]*typeSize, 0, stream);
+  }
+  if (allToAllvHierarchicalEnabled(comm, stream)) {
+    return allToAllvHierarchical(sendbuff, sendcounts, sdispls, recvbuff, recvcounts, rdispls, datatype, comm, stream);
+  }
+
   int nRanks;
   NCCLCHECK(ncclCommCount(comm, &nRanks));
   NCCLCHECK(ncclGroupStart());
@@ -151,6 +848,137 @@ ncclResult_t ncclAllToAllv(const void *sendbuff, const size_t sendcounts[], cons
   return ncclSuccess;
 }
 
+// Send counts declared once for later hierarchical AllToAllv calls, so that they
+// skip the host exchange of the counts. The calls must then pass these counts.
+NCCL_API(ncclResult_t, ncclAllToAllvDeclareCounts, const size_t sendcounts[], ncclComm_t comm);
+ncclResult_t ncclAllToAllvDeclareCounts(const size_t sendcounts[], ncclComm_t comm) {
+  NCCLCHECK(PtrCheck(comm, "AllToAllvDeclareCounts", "comm"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  comm->a2avCountsDeclared = false;
+  if (sendcounts == nullptr) return ncclSuccess;
+  NCCLCHECK(allToAllvExchangeCounts(comm, sendcounts));
+  comm->a2avCountsDeclared = true;
+  return ncclSuccess;
+}
+
+// Variable-size AllGather and ReduceScatter run one Broadcast or Reduce per rank in a
+// group. The group is aggregated into a single launch, every block is pipelined
+// along the ring on its own, and only the bytes of each rank go on the wire.
+NCCL_API(ncclResult_t, ncclAllGatherv, const void* sendbuff, void* recvbuff, const size_t recvcounts[], const size_t displs[],
+    ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream);
+ncclResult_t ncclAllGatherv(const void* sendbuff, void* recvbuff, const size_t recvcounts[], const size_t displs[],
+    ncclDataType_t datatype, ncclComm_t comm, hipStream_t stream) {
+  NCCLCHECK(PtrCheck(comm, "AllGatherv", "comm"));
+  NCCLCHECK(PtrCheck((void*)recvcounts, "AllGatherv", "recvcounts"));
+  NCCLCHECK(PtrCheck((void*)displs, "AllGatherv", "displs"));
+  size_t msgsize = recvcounts[comm->rank] * ncclTypeSize(datatype);
+  constexpr nvtxPayloadSchemaEntry_t AllGathervSchema[] = {
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_SIZE, "Message size [bytes] (Send)"}
+  };
+  NVTX3_FUNC_WITH_PARAMS(AllGatherv, AllGathervSchema, msgsize)
+
+  NCCLCHECK(ncclGroupStart());
+  for (int r=0; r<comm->nRanks; r++) {
+    if (recvcounts[r] == 0) continue;
+    NCCLCHECK(ncclBroadcast(r == comm->rank ? sendbuff : NULL, ((char*)recvbuff) + displs[r]*ncclTypeSize(datatype),
+        recvcounts[r], datatype, r, comm, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclReduceScatterv, const void* sendbuff, void* recvbuff, const size_t sendcounts[], const size_t displs[],
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream);
+ncclResult_t ncclReduceScatterv(const void* sendbuff, void* recvbuff, const size_t sendcounts[], const size_t displs[],
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, hipStream_t stream) {
+  NCCLCHECK(PtrCheck(comm, "ReduceScatterv", "comm"));
+  NCCLCHECK(PtrCheck((void*)sendcounts, "ReduceScatterv", "sendcounts"));
+  NCCLCHECK(PtrCheck((void*)displs, "ReduceScatterv", "displs"));
+  size_t msgsize = sendcounts[comm->rank] * ncclTypeSize(datatype);
+  constexpr nvtxPayloadSchemaEntry_t ReduceScattervSchema[] = {
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_SIZE, "Message size [bytes] (Recv)"}
+  };
+  NVTX3_FUNC_WITH_PARAMS(ReduceScatterv, ReduceScattervSchema, msgsize)
+
+  NCCLCHECK(ncclGroupStart());
+  for (int r=0; r<comm->nRanks; r++) {
+    if (sendcounts[r] == 0) continue;
+    NCCLCHECK(ncclReduce(((char*)sendbuff) + displs[r]*ncclTypeSize(datatype), r == comm->rank ? recvbuff : NULL,
+        sendcounts[r], datatype, op, r, comm, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
+// Scatter-AllGather (van de Geijn) Broadcast for large messages: the root sends
+// block r of the buffer to rank r, then an AllGather rebuilds the whole buffer on
+// every rank. The ring broadcast crosses one link per rank, while the scatter and
+// the AllGather can use all the links of a fully connected node. 1 lets the tuning
+// model choose, 2 always uses it above the minimum size.
+RCCL_PARAM(BcastScatterAllGather, "BCAST_SCATTER_ALLGATHER", 0);
+RCCL_PARAM(BcastScatterAllGatherMinBytes, "BCAST_SCATTER_ALLGATHER_MIN_BYTES", 64<<20);
+
+// Lowest time the tuning model predicts for bytes of coll, -1 if it can't run
+static float bcastModelTime(ncclComm_t comm, ncclFunc_t coll, size_t bytes) {
+  struct ncclInfo info = {};
+  info.coll = coll;
+  info.comm = comm;
+  info.datatype = ncclInt8;
+  info.count = coll == ncclFuncAllGather ? bytes/comm->nRanks : bytes;
+  if (ncclInfoSetDerived(&info, comm->nRanks) != ncclSuccess) return -1;
+  float best = -1;
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    float time;
+    if (ncclTopoGetAlgoTime(&info, a, p, 1, &time) != ncclSuccess || time < 0) continue;
+    if (best < 0 || time < best) best = time;
+  }
+  return best;
+}
+
+static bool bcastScatterAllGatherEnabled(ncclComm_t comm, size_t bytes) {
+  int64_t mode = rcclParamBcastScatterAllGather();
+  if (mode == 0 || comm->nRanks < 3 || bytes < (size_t)rcclParamBcastScatterAllGatherMinBytes()) return false;
+  // The AllGather must start after the scatter completed, so two groups are used
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  if (mode == 2) return true;
+  // The scatter moves as much data as the AllGather, out of the root
+  float bcast = bcastModelTime(comm, ncclFuncBroadcast, bytes);
+  float allGather = bcastModelTime(comm, ncclFuncAllGather, bytes);
+  return bcast > 0 && allGather > 0 && 2*allGather < bcast;
+}
+
+static ncclResult_t bcastScatterAllGather(const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype, int root,
+    ncclComm_t comm, cudaStream_t stream) {
+  size_t typeSize = ncclTypeSize(datatype);
+  size_t align = std::max<size_t>(1, 16/typeSize);
+  size_t blockCount = count / comm->nRanks / align * align;
+  size_t blockBytes = blockCount * typeSize;
+  size_t tailCount = count - blockCount * comm->nRanks;
+  const char* send = (const char*)sendbuff;
+  char* recv = (char*)recvbuff;
+  bool isRoot = comm->rank == root;
+  INFO(NCCL_COLL, "Broadcast: scatter-allgather of %zu bytes from root %d, block %zu bytes comm %p", count*typeSize, root, blockBytes, comm);
+
+  NCCLCHECK(ncclGroupStart());
+  if (isRoot) {
+    for (int r=0; r<comm->nRanks; r++) {
+      if (r != root) NCCLCHECK(ncclSend(send + r*blockBytes, blockCount, datatype, r, comm, stream));
+    }
+  } else {
+    NCCLCHECK(ncclRecv(recv + comm->rank*blockBytes, blockCount, datatype, root, comm, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+
+  NCCLCHECK(ncclGroupStart());
+  // The root gathers its block from the send buffer, the other ranks in place
+  NCCLCHECK(ncclAllGather(isRoot ? send + root*blockBytes : recv + comm->rank*blockBytes, recv, blockCount, datatype, comm, stream));
+  if (tailCount) {
+    NCCLCHECK(ncclBroadcast(isRoot ? send + comm->nRanks*blockBytes : NULL, recv + comm->nRanks*blockBytes, tailCount, datatype, root, comm, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
 NCCL_API(ncclResult_t, ncclBroadcast, const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype, int root,
     ncclComm_t comm, cudaStream_t stream);
 ncclResult_t ncclBroadcast(const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype, int root,
@@ -172,6 +1000,10 @@ ncclResult_t ncclBroadcast(const void* sendbuff, void* recvbuff, size_t count, n
       count, datatype, root, 0, ncclSum, mscclFuncBroadcast, comm, stream);
   }
 
+  if (root >= 0 && root < comm->nRanks && bcastScatterAllGatherEnabled(comm, count*ncclTypeSize(datatype))) {
+    return bcastScatterAllGather(sendbuff, recvbuff, count, datatype, root, comm, stream);
+  }
+
   struct ncclInfo info = { ncclFuncBroadcast, "Broadcast",
     sendbuff, recvbuff, count, datatype, ncclSum, root, comm, stream, /* Args */
     BROADCAST_CHUNKSTEPS, BROADCAST_SLICESTEPS };
@@ -185,6 +1017,149 @@ ncclResult_t ncclBcast(void* buff, size_t count, ncclDataType_t datatype, int ro
   return ncclBroadcast(buff, buff, count, datatype, root, comm, stream);
 }
 
+// Two-stage Gather and Scatter across nodes: on every other node, the rank with
+// the same local index as the root collects or distributes the blocks of its
+// node over XGMI, so the root only does one network transfer per node.
+RCCL_PARAM(GatherScatterHierarchical, "GATHER_SCATTER_HIERARCHICAL", 1);
+
+static bool gatherScatterHierarchicalEnabled(ncclComm_t comm, cudaStream_t stream) {
+  if (!rcclParamGatherScatterHierarchical() || comm->nNodes < 2 || comm->nRanks == comm->nNodes) return false;
+  // The leaders forward the data between two groups
+  if (ncclGroupDepth > 0 || !comm->config.blocking) return false;
+  // The staging buffer can be reallocated between calls, so it can't be captured
+  struct ncclCudaGraph graph;
+  if (ncclCudaGetCapturingGraph(&graph, stream) != ncclSuccess || ncclCudaGraphValid(graph)) return false;
+  return true;
+}
+
+// Rank of node n that forwards the blocks of its node to or from root
+static int gatherScatterLeader(ncclComm_t comm, int n, int root) {
+  struct ncclNodeRanks* nodeRanks = comm->nodeRanks+n;
+  return nodeRanks->localRankToRank[comm->rankToLocalRank[root] % nodeRanks->localRanks];
+}
+
+// Moves the blocks of the ranks of node n between buff and peer. buff is indexed by
+// rank on the root and by local index on the leader; when the ranks of the node are
+// consecutive both layouts match and the blocks go in a single transfer.
+static ncclResult_t gatherScatterNode(ncclComm_t comm, bool send, char* buff, bool byRank, size_t count,
+    ncclDataType_t datatype, int n, int peer, cudaStream_t stream) {
+  struct ncclNodeRanks* nodeRanks = comm->nodeRanks+n;
+  const size_t bytes = count*ncclTypeSize(datatype);
+  if (nodeRanks->localRankToRank[nodeRanks->localRanks-1] - nodeRanks->localRankToRank[0] == nodeRanks->localRanks-1) {
+    char* b = buff + (byRank ? nodeRanks->localRankToRank[0]*bytes : 0);
+    if (send) NCCLCHECK(ncclSend(b, nodeRanks->localRanks*count, datatype, peer, comm, stream));
+    else NCCLCHECK(ncclRecv(b, nodeRanks->localRanks*count, datatype, peer, comm, stream));
+    return ncclSuccess;
+  }
+  for (int i=0; i<nodeRanks->localRanks; i++) {
+    char* b = buff + (byRank ? nodeRanks->localRankToRank[i] : i)*bytes;
+    if (send) NCCLCHECK(ncclSend(b, count, datatype, peer, comm, stream));
+    else NCCLCHECK(ncclRecv(b, count, datatype, peer, comm, stream));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t gatherScatterStaging(ncclComm_t comm, size_t stagingBytes, cudaStream_t stream) {
+  if (stagingBytes > comm->gatherStagingSize) {
+    if (comm->gatherStaging) {
+      // Previous operations on the stream may still use the old buffer
+      CUDACHECK(cudaStreamSynchronize(stream));
+      NCCLCHECK(ncclCudaFree(comm->gatherStaging));
+      comm->gatherStaging = nullptr;
+    }
+    NCCLCHECK(ncclCudaCalloc(&comm->gatherStaging, stagingBytes));
+    comm->gatherStagingSize = stagingBytes;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t gatherHierarchical(const void* sendbuff, void* recvbuff, size_t count,
+    ncclDataType_t datatype, int root, ncclComm_t comm, cudaStream_t stream) {
+  if (root < 0 || root >= comm->nRanks) {
+    WARN("Gather : invalid root %d (root should be in the 0..%d range)", root, comm->nRanks);
+    return ncclInvalidArgument;
+  }
+  const size_t bytes = count*ncclTypeSize(datatype);
+  const int rootNode = comm->rankToNode[root];
+  const int leader = comm->node == rootNode ? root : gatherScatterLeader(comm, comm->node, root);
+  char* staging = (char*)recvbuff;
+  if (comm->rank == leader && comm->node != rootNode) {
+    NCCLCHECK(gatherScatterStaging(comm, comm->localRanks*bytes, stream));
+    staging = comm->gatherStaging;
+  }
+
+  // Step 1: every rank sends its block to the root or to the leader of its node
+  NCCLCHECK(ncclGroupStart());
+  if (comm->rank == leader) {
+    for (int i=0; i<comm->localRanks; i++) {
+      int r = comm->localRankToRank[i];
+      NCCLCHECK(ncclRecv(staging + (comm->node == rootNode ? r : i)*bytes, count, datatype, r, comm, stream));
+    }
+  }
+  NCCLCHECK(ncclSend(sendbuff, count, datatype, leader, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+
+  // Step 2: the leaders forward the blocks of their node to the root
+  if (comm->rank != root && comm->rank != leader) return ncclSuccess;
+  NCCLCHECK(ncclGroupStart());
+  if (comm->rank == root) {
+    for (int n=0; n<comm->nNodes; n++) {
+      if (n == rootNode) continue;
+      NCCLCHECK(gatherScatterNode(comm, false, (char*)recvbuff, true, count, datatype, n, gatherScatterLeader(comm, n, root), stream));
+    }
+  } else {
+    NCCLCHECK(gatherScatterNode(comm, true, staging, false, count, datatype, comm->node, root, stream));
+  }
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
+static ncclResult_t scatterHierarchical(const void* sendbuff, void* recvbuff, size_t count,
+    ncclDataType_t datatype, int root, ncclComm_t comm, cudaStream_t stream) {
+  if (root < 0 || root >= comm->nRanks) {
+    WARN("Scatter : invalid root %d (root should be in the 0..%d range)", root, comm->nRanks);
+    return ncclInvalidArgument;
+  }
+  const size_t bytes = count*ncclTypeSize(datatype);
+  const int rootNode = comm->rankToNode[root];
+  const int leader = comm->node == rootNode ? root : gatherScatterLeader(comm, comm->node, root);
+  char* staging = nullptr;
+  if (comm->rank == leader && comm->node != rootNode) {
+    NCCLCHECK(gatherScatterStaging(comm, comm->localRanks*bytes, stream));
+    staging = comm->gatherStaging;
+  }
+
+  // Step 1: the root sends the blocks of each other node to its leader, and those
+  // of its own node directly
+  NCCLCHECK(ncclGroupStart());
+  if (comm->rank == root) {
+    for (int n=0; n<comm->nNodes; n++) {
+      if (n == rootNode) continue;
+      NCCLCHECK(gatherScatterNode(comm, true, (char*)sendbuff, true, count, datatype, n, gatherScatterLeader(comm, n, root), stream));
+    }
+    for (int i=0; i<comm->localRanks; i++) {
+      int r = comm->localRankToRank[i];
+      NCCLCHECK(ncclSend((const char*)sendbuff + r*bytes, count, datatype, r, comm, stream));
+    }
+  } else if (comm->rank == leader) {
+    NCCLCHECK(gatherScatterNode(comm, false, staging, false, count, datatype, comm->node, root, stream));
+  }
+  if (comm->node == rootNode) NCCLCHECK(ncclRecv(recvbuff, count, datatype, root, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  if (comm->node == rootNode) return ncclSuccess;
+
+  // Step 2: the leaders distribute the blocks of their node
+  NCCLCHECK(ncclGroupStart());
+  if (comm->rank == leader) {
+    for (int i=0; i<comm->localRanks; i++) {
+      NCCLCHECK(ncclSend(staging + i*bytes, count, datatype, comm->localRankToRank[i], comm, stream));
+    }
+  }
+  NCCLCHECK(ncclRecv(recvbuff, count, datatype, leader, comm, stream));
+  NCCLCHECK(ncclGroupEnd());
+  return ncclSuccess;
+}
+
 NCCL_API(ncclResult_t, ncclGather, const void* sendbuff, void* recvbuff, size_t sendcount,
     ncclDataType_t datatype, int root, ncclComm_t comm, hipStream_t stream);
 ncclResult_t ncclGather(const void* sendbuff, void* recvbuff, size_t sendcount,
@@ -205,11 +1180,15 @@ ncclResult_t ncclGather(const void* sendbuff, void* recvbuff, size_t sendcount,
         sendbuff, nullptr, nullptr, recvbuff, nullptr, nullptr,
         sendcount, datatype, root, 0, ncclSum, mscclFuncGather, comm, stream);
     }
+    if (comm->nRanks == 1) return oneRankCopy(comm, "Gather", recvbuff, sendbuff, payload.bytes, root, stream);
 
     int nRanks;
     NCCLCHECK(ncclCommCount(comm, &nRanks));
     size_t rankOffset = sendcount * ncclTypeSize(datatype);
     if (sendcount == 0) return ncclSuccess;
+    if (gatherScatterHierarchicalEnabled(comm, stream)) {
+      return gatherHierarchical(sendbuff, recvbuff, sendcount, datatype, root, comm, stream);
+    }
     int rank;
     NCCLCHECK(ncclCommUserRank(comm, &rank));
     NCCLCHECK(ncclGroupStart());
@@ -268,6 +1247,18 @@ ncclResult_t ncclReduceScatter(const void* sendbuff, void* recvbuff, size_t recv
   NvtxParamsReduceScatter payload{recvcount * ncclTypeSize(datatype), op};
   NVTX3_FUNC_WITH_PARAMS(ReduceScatter, ReduceScatterSchema, payload)
 
+#if defined(RCCL_FLOAT8)
+  if (compressEnabled(comm, datatype, op, stream) && recvcount % RCCL_COMPRESS_BLOCK == 0) {
+    return compressedReduce(sendbuff, recvbuff, recvcount, /*allGather=*/false, datatype, comm, stream);
+  }
+#endif
+  if (accumEnabled(comm, datatype, op, stream)) {
+    return accumReduceScatter(sendbuff, recvbuff, recvcount, datatype, comm, stream);
+  }
+  if (deterministicEnabled(comm, datatype, op) && recvcount) {
+    return orderedReduce(sendbuff, recvbuff, recvcount, /*allGather=*/false, datatype, op, comm, stream);
+  }
+
   if (mscclAvailable(comm->rank) && !mscclIsCaller()) {
     return mscclEnqueueCheck(
       sendbuff, nullptr, nullptr, recvbuff, nullptr, nullptr,
@@ -300,11 +1291,15 @@ ncclResult_t ncclScatter(const void* sendbuff, void* recvbuff, size_t recvcount,
         sendbuff, nullptr, nullptr, recvbuff, nullptr, nullptr,
         recvcount, datatype, root, 0, ncclSum, mscclFuncScatter, comm, stream);
     }
+    if (comm->nRanks == 1) return oneRankCopy(comm, "Scatter", recvbuff, sendbuff, payload.bytes, root, stream);
 
     int nRanks;
     NCCLCHECK(ncclCommCount(comm, &nRanks));
     size_t rankOffset = recvcount * ncclTypeSize(datatype);
     if (recvcount == 0) return ncclSuccess;
+    if (gatherScatterHierarchicalEnabled(comm, stream)) {
+      return scatterHierarchical(sendbuff, recvbuff, recvcount, datatype, root, comm, stream);
+    }
     int rank;
     NCCLCHECK(ncclCommUserRank(comm, &rank));
     NCCLCHECK(ncclGroupStart());
@@ -371,3 +1366,117 @@ ncclResult_t ncclRecv(void* recvbuff, size_t count, ncclDataType_t datatype, int
   NCCLCHECK(ncclGroupEnd());
   return ret;
 }
+
+// Persistent collectives: the arguments are checked and the buffers registered once,
+// then every ncclStart enqueues the collective as if it had been called directly. The
+// registration lets the enqueue path find the buffers in the registration cache, and
+// the tuning of a repeated collective comes from the communicator's tuning cache.
+struct ncclPersistentColl {
+  struct ncclInfo info;
+  void* sendHandle;
+  void* recvHandle;
+};
+
+static ncclResult_t persistentCollInit(struct ncclInfo* info, size_t sendBytes, size_t recvBytes, ncclPersistentColl_t* request) {
+  struct ncclComm* comm = info->comm;
+  struct ncclPersistentColl* p = NULL;
+  struct ncclInfo check;
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECK(PtrCheck(request, info->opName, "request"));
+  *request = NULL;
+  NCCLCHECK(PtrCheck(comm, info->opName, "comm"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  // ArgsCheck converts some collectives to bytes, keep the arguments as given
+  check = *info;
+  NCCLCHECK(ArgsCheck(&check));
+  NCCLCHECK(ncclCalloc(&p, 1));
+  p->info = *info;
+  // Broadcast only reads the send buffer of the root
+  if (sendBytes && (info->coll != ncclFuncBroadcast || comm->rank == info->root)) {
+    NCCLCHECKGOTO(ncclCommRegister(comm, (void*)info->sendbuff, sendBytes, &p->sendHandle), ret, fail);
+  }
+  if (recvBytes && info->recvbuff != info->sendbuff) {
+    NCCLCHECKGOTO(ncclCommRegister(comm, info->recvbuff, recvBytes, &p->recvHandle), ret, fail);
+  }
+  INFO(NCCL_COLL, "%s: persistent request %p, sendbuff %p recvbuff %p count %zu datatype %d comm %p",
+      info->opName, p, info->sendbuff, info->recvbuff, info->count, info->datatype, comm);
+  *request = p;
+  return ncclSuccess;
+fail:
+  if (p->sendHandle) ncclCommDeregister(comm, p->sendHandle);
+  free(p);
+  return ret;
+}
+
+NCCL_API(ncclResult_t, ncclAllReduceInit, const void* sendbuff, void* recvbuff, size_t count,
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, ncclPersistentColl_t* request);
+ncclResult_t ncclAllReduceInit(const void* sendbuff, void* recvbuff, size_t count,
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, ncclPersistentColl_t* request) {
+  struct ncclInfo info = { ncclFuncAllReduce, "AllReduce",
+    sendbuff, recvbuff, count, datatype, op, 0, comm, NULL, /* Args */
+    ALLREDUCE_CHUNKSTEPS, ALLREDUCE_SLICESTEPS };
+  size_t bytes = count*ncclTypeSize(datatype);
+  return persistentCollInit(&info, bytes, bytes, request);
+}
+
+NCCL_API(ncclResult_t, ncclReduceScatterInit, const void* sendbuff, void* recvbuff, size_t recvcount,
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, ncclPersistentColl_t* request);
+ncclResult_t ncclReduceScatterInit(const void* sendbuff, void* recvbuff, size_t recvcount,
+    ncclDataType_t datatype, ncclRedOp_t op, ncclComm_t comm, ncclPersistentColl_t* request) {
+  struct ncclInfo info = { ncclFuncReduceScatter, "ReduceScatter",
+    sendbuff, recvbuff, recvcount, datatype, op, 0, comm, NULL, /* Args */
+    REDUCESCATTER_CHUNKSTEPS, REDUCESCATTER_SLICESTEPS };
+  size_t bytes = recvcount*ncclTypeSize(datatype);
+  return persistentCollInit(&info, comm ? bytes*comm->nRanks : 0, bytes, request);
+}
+
+NCCL_API(ncclResult_t, ncclAllGatherInit, const void* sendbuff, void* recvbuff, size_t sendcount,
+    ncclDataType_t datatype, ncclComm_t comm, ncclPersistentColl_t* request);
+ncclResult_t ncclAllGatherInit(const void* sendbuff, void* recvbuff, size_t sendcount,
+    ncclDataType_t datatype, ncclComm_t comm, ncclPersistentColl_t* request) {
+  struct ncclInfo info = { ncclFuncAllGather, "AllGather",
+    sendbuff, recvbuff, sendcount, datatype, ncclSum, 0, comm, NULL, /* Args */
+    ALLGATHER_CHUNKSTEPS, ALLGATHER_SLICESTEPS };
+  size_t bytes = sendcount*ncclTypeSize(datatype);
+  return persistentCollInit(&info, bytes, comm ? bytes*comm->nRanks : 0, request);
+}
+
+NCCL_API(ncclResult_t, ncclBroadcastInit, const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype, int root,
+    ncclComm_t comm, ncclPersistentColl_t* request);
+ncclResult_t ncclBroadcastInit(const void* sendbuff, void* recvbuff, size_t count, ncclDataType_t datatype, int root,
+    ncclComm_t comm, ncclPersistentColl_t* request) {
+  struct ncclInfo info = { ncclFuncBroadcast, "Broadcast",
+    sendbuff, recvbuff, count, datatype, ncclSum, root, comm, NULL, /* Args */
+    BROADCAST_CHUNKSTEPS, BROADCAST_SLICESTEPS };
+  size_t bytes = count*ncclTypeSize(datatype);
+  return persistentCollInit(&info, bytes, bytes, request);
+}
+
+NCCL_API(ncclResult_t, ncclStart, ncclPersistentColl_t request, cudaStream_t stream);
+ncclResult_t ncclStart(ncclPersistentColl_t request, cudaStream_t stream) {
+  NCCLCHECK(PtrCheck(request, "Start", "request"));
+  struct ncclInfo* info = &request->info;
+  switch (info->coll) {
+    case ncclFuncAllReduce:
+      return ncclAllReduce(info->sendbuff, info->recvbuff, info->count, info->datatype, info->op, info->comm, stream);
+    case ncclFuncReduceScatter:
+      return ncclReduceScatter(info->sendbuff, info->recvbuff, info->count, info->datatype, info->op, info->comm, stream);
+    case ncclFuncAllGather:
+      return ncclAllGather(info->sendbuff, info->recvbuff, info->count, info->datatype, info->comm, stream);
+    case ncclFuncBroadcast:
+      return ncclBroadcast(info->sendbuff, info->recvbuff, info->count, info->datatype, info->root, info->comm, stream);
+    default:
+      WARN("Start : invalid persistent request %p", request);
+      return ncclInvalidArgument;
+  }
+}
+
+NCCL_API(ncclResult_t, ncclPersistentCollFree, ncclPersistentColl_t request);
+ncclResult_t ncclPersistentCollFree(ncclPersistentColl_t request) {
+  if (request == NULL) return ncclSuccess;
+  struct ncclComm* comm = request->info.comm;
+  if (request->sendHandle) NCCLCHECK(ncclCommDeregister(comm, request->sendHandle));
+  if (request->recvHandle) NCCLCHECK(ncclCommDeregister(comm, request->recvHandle));
+  free(request);
+  return ncclSuccess;
+}
@@ -23,6 +23,334 @@ std::chrono::steady_clock::time_point ncclEpoch;
 
 static __thread int tid = -1;
 
+/* Asynchronous logging, RCCL_DEBUG_ASYNC=1
+ * INFO and TRACE messages are not formatted by the thread logging them. It
+ * only copies the format pointer and the raw arguments into a ring of its own,
+ * without taking any lock, and a background thread formats the records and
+ * writes them out. WARN stays synchronous, as do messages with conversions the
+ * record format does not handle (%m, %n, long double). Messages are dropped,
+ * and counted, when the ring of a thread is full.
+ */
+#define DEBUG_ASYNC_RING_SIZE (1 << 20)
+#define DEBUG_ASYNC_MAX_RECORD 4096
+#define DEBUG_ASYNC_MAX_STRING 1024
+
+struct debugRecordHeader {
+  const char* fmt;
+  const char* filefunc;
+  double timestamp;
+  uint32_t size;          // Header and arguments, multiple of 8
+  int line;
+  int level;
+  int cudaDev;
+  unsigned long flags;
+};
+
+struct debugRing {
+  char* buff;
+  uint64_t head;          // Written by the logging thread
+  uint64_t tail;          // Written by the background thread
+  uint64_t dropped;
+  uint64_t reported;
+  int tid;
+  int exited;
+  struct debugRing* next;
+};
+
+static int debugAsync = 0;
+static int debugAsyncStop = 0;
+static pthread_t debugAsyncThread;
+static pthread_mutex_t debugRingsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct debugRing* debugRings = nullptr;
+
+// Marks the ring of a thread for release once the background thread drained it
+struct debugRingHolder {
+  struct debugRing* ring = nullptr;
+  ~debugRingHolder() { if (ring) __atomic_store_n(&ring->exited, 1, __ATOMIC_RELEASE); }
+};
+static thread_local debugRingHolder debugThreadRing;
+
+// One conversion of a format string
+struct debugConv {
+  const char* start;      // The '%'
+  const char* end;        // Past the conversion character
+  int stars;              // Number of '*' width/precision arguments
+  char length[3];
+  char conv;
+};
+
+// Returns the next conversion after fmt, false at the end of the string
+static bool debugNextConv(const char* fmt, struct debugConv* c) {
+  const char* p = strchr(fmt, '%');
+  while (p && p[1] == '%') p = strchr(p+2, '%');
+  if (p == nullptr) return false;
+  c->start = p++;
+  c->stars = 0;
+  while (*p && strchr("-+ #0'", *p)) p++;
+  if (*p == '*') { c->stars++; p++; } else while (*p >= '0' && *p <= '9') p++;
+  if (*p == '.') {
+    p++;
+    if (*p == '*') { c->stars++; p++; } else while (*p >= '0' && *p <= '9') p++;
+  }
+  int n = 0;
+  while (*p && strchr("hlzjtLq", *p) && n < 2) c->length[n++] = *p++;
+  c->length[n] = '\0';
+  c->conv = *p;
+  c->end = *p ? p+1 : p;
+  return true;
+}
+
+static void debugPut64(char** p, uint64_t v) { memcpy(*p, &v, 8); *p += 8; }
+static uint64_t debugGet64(const char** p) { uint64_t v; memcpy(&v, *p, 8); *p += 8; return v; }
+
+// Copies the arguments into out as 8-byte slots, strings inline. Returns the number
+// of bytes used, or -1 if the message must be formatted synchronously.
+static int debugPackArgs(char* out, size_t size, const char* fmt, va_list vargs) {
+  char* p = out;
+  char* end = out + size;
+  struct debugConv c;
+  while (debugNextConv(fmt, &c)) {
+    fmt = c.end;
+    if (p + 8*(c.stars+1) > end) return -1;
+    for (int s=0; s<c.stars; s++) debugPut64(&p, (int64_t)va_arg(vargs, int));
+    bool l = c.length[0] == 'l', ll = l && c.length[1] == 'l', h = c.length[0] == 'h', hh = h && c.length[1] == 'h';
+    switch (c.conv) {
+    case 'd': case 'i':
+      if (ll || c.length[0] == 'q') debugPut64(&p, (int64_t)va_arg(vargs, long long));
+      else if (l) debugPut64(&p, (int64_t)va_arg(vargs, long));
+      else if (c.length[0] == 'z') debugPut64(&p, (int64_t)va_arg(vargs, ssize_t));
+      else if (c.length[0] == 'j') debugPut64(&p, (int64_t)va_arg(vargs, intmax_t));
+      else if (c.length[0] == 't') debugPut64(&p, (int64_t)va_arg(vargs, ptrdiff_t));
+      else if (hh) debugPut64(&p, (int64_t)(signed char)va_arg(vargs, int));
+      else if (h) debugPut64(&p, (int64_t)(short)va_arg(vargs, int));
+      else debugPut64(&p, (int64_t)va_arg(vargs, int));
+      break;
+    case 'u': case 'o': case 'x': case 'X':
+      if (ll || c.length[0] == 'q') debugPut64(&p, (uint64_t)va_arg(vargs, unsigned long long));
+      else if (l) debugPut64(&p, (uint64_t)va_arg(vargs, unsigned long));
+      else if (c.length[0] == 'z') debugPut64(&p, (uint64_t)va_arg(vargs, size_t));
+      else if (c.length[0] == 'j') debugPut64(&p, (uint64_t)va_arg(vargs, uintmax_t));
+      else if (c.length[0] == 't') debugPut64(&p, (uint64_t)va_arg(vargs, ptrdiff_t));
+      else if (hh) debugPut64(&p, (uint64_t)(unsigned char)va_arg(vargs, unsigned int));
+      else if (h) debugPut64(&p, (uint64_t)(unsigned short)va_arg(vargs, unsigned int));
+      else debugPut64(&p, (uint64_t)va_arg(vargs, unsigned int));
+      break;
+    case 'c':
+      debugPut64(&p, (int64_t)va_arg(vargs, int));
+      break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+      if (c.length[0] == 'L') return -1;
+      double d = va_arg(vargs, double);
+      uint64_t v;
+      memcpy(&v, &d, 8);
+      debugPut64(&p, v);
+      break;
+    }
+    case 'p':
+      debugPut64(&p, (uint64_t)(uintptr_t)va_arg(vargs, void*));
+      break;
+    case 's': {
+      if (l) return -1;
+      const char* str = va_arg(vargs, const char*);
+      if (str == nullptr) str = "(null)";
+      size_t len = strnlen(str, DEBUG_ASYNC_MAX_STRING);
+      size_t slots = (len + 8) / 8;
+      if (p + 8*(slots+1) > end) return -1;
+      debugPut64(&p, len);
+      memcpy(p, str, len);
+      memset(p+len, 0, slots*8-len);
+      p += slots*8;
+      break;
+    }
+    default:
+      return -1;
+    }
+  }
+  return p - out;
+}
+
+// Formats fmt with the arguments packed by debugPackArgs, like vsnprintf
+static size_t debugFormatArgs(char* out, size_t size, const char* fmt, const char* args) {
+  size_t len = 0;
+  struct debugConv c;
+  char spec[64];
+  while (len < size-1) {
+    bool more = debugNextConv(fmt, &c);
+    // Literal text, with %% collapsed
+    const char* litEnd = more ? c.start : fmt + strlen(fmt);
+    while (fmt < litEnd && len < size-1) {
+      if (fmt[0] == '%' && fmt[1] == '%') fmt++;
+      out[len++] = *fmt++;
+    }
+    if (!more || len >= size-1) break;
+    fmt = c.end;
+    int stars[2] = { 0, 0 };
+    for (int s=0; s<c.stars; s++) stars[s] = (int)debugGet64(&args);
+    // Integers are printed from 64-bit values, with the length modifier replaced by ll
+    size_t specLen = std::min((size_t)(c.end - c.start - 1 - strlen(c.length)), sizeof(spec)-4);
+    memcpy(spec, c.start, specLen);
+    bool isInt = strchr("diuoxX", c.conv) != nullptr;
+    if (isInt) { spec[specLen++] = 'l'; spec[specLen++] = 'l'; }
+    spec[specLen++] = c.conv;
+    spec[specLen] = '\0';
+    uint64_t v = debugGet64(&args);
+    const char* str = nullptr;
+    double d;
+    if (c.conv == 's') { str = args; args += 8*((v + 8) / 8); }
+    memcpy(&d, &v, 8);
+    size_t avail = size - len;
+    int n;
+#define DEBUG_FORMAT(val) \
+    (c.stars == 0 ? snprintf(out+len, avail, spec, val) : \
+     c.stars == 1 ? snprintf(out+len, avail, spec, stars[0], val) : \
+                    snprintf(out+len, avail, spec, stars[0], stars[1], val))
+    if (isInt) n = strchr("di", c.conv) ? DEBUG_FORMAT((long long)v) : DEBUG_FORMAT((unsigned long long)v);
+    else if (c.conv == 'c') n = DEBUG_FORMAT((int)v);
+    else if (c.conv == 'p') n = DEBUG_FORMAT((void*)(uintptr_t)v);
+    else if (c.conv == 's') n = DEBUG_FORMAT(str);
+    else n = DEBUG_FORMAT(d);
+#undef DEBUG_FORMAT
+    if (n < 0) break;
+    len += std::min((size_t)n, avail-1);
+  }
+  out[len] = '\0';
+  return len;
+}
+
+static struct debugRing* debugGetRing() {
+  struct debugRing* ring = debugThreadRing.ring;
+  if (ring) return ring;
+  ring = (struct debugRing*)calloc(1, sizeof(struct debugRing));
+  if (ring == nullptr) return nullptr;
+  ring->buff = (char*)malloc(DEBUG_ASYNC_RING_SIZE);
+  if (ring->buff == nullptr) { free(ring); return nullptr; }
+  ring->tid = tid;
+  pthread_mutex_lock(&debugRingsLock);
+  ring->next = debugRings;
+  debugRings = ring;
+  pthread_mutex_unlock(&debugRingsLock);
+  debugThreadRing.ring = ring;
+  return ring;
+}
+
+// Returns false if the message must be logged synchronously
+static bool debugAsyncLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, int cudaDev, double timestamp, const char *fmt, va_list vargs) {
+  struct debugRing* ring = debugGetRing();
+  if (ring == nullptr) return false;
+  alignas(8) char record[DEBUG_ASYNC_MAX_RECORD];
+  struct debugRecordHeader* hdr = (struct debugRecordHeader*)record;
+  int argBytes = debugPackArgs(record+sizeof(*hdr), sizeof(record)-sizeof(*hdr), fmt, vargs);
+  if (argBytes < 0) return false;
+  hdr->fmt = fmt;
+  hdr->filefunc = filefunc;
+  hdr->timestamp = timestamp;
+  hdr->size = sizeof(*hdr) + argBytes;
+  hdr->line = line;
+  hdr->level = level;
+  hdr->cudaDev = cudaDev;
+  hdr->flags = flags;
+
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head + hdr->size - tail > DEBUG_ASYNC_RING_SIZE) {
+    __atomic_store_n(&ring->dropped, ring->dropped+1, __ATOMIC_RELAXED);
+    return true;
+  }
+  size_t offset = head % DEBUG_ASYNC_RING_SIZE;
+  size_t first = std::min((size_t)hdr->size, DEBUG_ASYNC_RING_SIZE - offset);
+  memcpy(ring->buff+offset, record, first);
+  memcpy(ring->buff, record+first, hdr->size-first);
+  __atomic_store_n(&ring->head, head+hdr->size, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Start of a log line, as printed for every level
+static size_t debugPrefix(char* buffer, size_t size, ncclDebugLogLevel level, unsigned long flags, const char* filefunc, int line, int tid, int cudaDev, double timestamp) {
+  size_t len = 0;
+  if (level == NCCL_LOG_WARN) {
+    len = snprintf(buffer, size, "\n%s:%d:%d [%d] %s:%d NCCL WARN ",
+                   hostname, pid, tid, cudaDev, filefunc, line);
+  } else if (level == NCCL_LOG_INFO) {
+    len = snprintf(buffer, size, "%s:%d:%d [%d] NCCL INFO ", hostname, pid, tid, cudaDev);
+  } else if (level == NCCL_LOG_TRACE && flags == NCCL_CALL) {
+    len = snprintf(buffer, size, "%s:%d:%d NCCL CALL ", hostname, pid, tid);
+  } else if (level == NCCL_LOG_TRACE) {
+    len = snprintf(buffer, size, "%s:%d:%d [%d] %f %s:%d NCCL TRACE ",
+                   hostname, pid, tid, cudaDev, timestamp, filefunc, line);
+  }
+  return std::min(len, size-1);
+}
+
+// Formats and writes the records of every ring, returns the number of records written
+static int debugAsyncDrain() {
+  int nRecords = 0;
+  pthread_mutex_lock(&debugRingsLock);
+  struct debugRing** prev = &debugRings;
+  while (*prev) {
+    struct debugRing* ring = *prev;
+    int exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = ring->tail;
+    while (tail < head) {
+      alignas(8) char record[DEBUG_ASYNC_MAX_RECORD];
+      size_t offset = tail % DEBUG_ASYNC_RING_SIZE;
+      struct debugRecordHeader hdr;
+      for (size_t i=0; i<sizeof(hdr); i++) ((char*)&hdr)[i] = ring->buff[(offset+i) % DEBUG_ASYNC_RING_SIZE];
+      size_t first = std::min((size_t)hdr.size, DEBUG_ASYNC_RING_SIZE - offset);
+      memcpy(record, ring->buff+offset, first);
+      memcpy(record+first, ring->buff, hdr.size-first);
+
+      char buffer[4096];
+      size_t len = debugPrefix(buffer, sizeof(buffer), (ncclDebugLogLevel)hdr.level, hdr.flags, hdr.filefunc, hdr.line, ring->tid, hdr.cudaDev, hdr.timestamp);
+      len += debugFormatArgs(buffer+len, sizeof(buffer)-len, hdr.fmt, record+sizeof(hdr));
+      if (len >= sizeof(buffer)) len = sizeof(buffer)-1;
+      buffer[len++] = '\n';
+      fwrite(buffer, 1, len, ncclDebugFile);
+      tail += hdr.size;
+      nRecords++;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->reported) {
+      fprintf(ncclDebugFile, "%s:%d:%d NCCL INFO RCCL_DEBUG_ASYNC dropped %lu messages, the log ring was full\n",
+          hostname, pid, ring->tid, dropped - ring->reported);
+      ring->reported = dropped;
+    }
+    // The thread is gone and will not write again
+    if (exited && tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+      *prev = ring->next;
+      free(ring->buff);
+      free(ring);
+    } else {
+      prev = &ring->next;
+    }
+  }
+  pthread_mutex_unlock(&debugRingsLock);
+  if (nRecords) fflush(ncclDebugFile);
+  return nRecords;
+}
+
+static void* debugAsyncMain(void*) {
+  while (!__atomic_load_n(&debugAsyncStop, __ATOMIC_ACQUIRE)) {
+    if (debugAsyncDrain() == 0) usleep(1000);
+  }
+  debugAsyncDrain();
+  return nullptr;
+}
+
+// A forked child has no background thread, it logs synchronously
+static void debugAsyncAtFork() {
+  debugAsync = 0;
+  debugAsyncStop = 1;
+}
+
+static void debugAsyncFinalize() {
+  if (__atomic_load_n(&debugAsyncStop, __ATOMIC_ACQUIRE)) return;
+  __atomic_store_n(&debugAsync, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&debugAsyncStop, 1, __ATOMIC_RELEASE);
+  pthread_join(debugAsyncThread, nullptr);
+}
+
 void ncclDebugInit() {
   pthread_mutex_lock(&ncclDebugLock);
   if (ncclDebugLevel != -1) { pthread_mutex_unlock(&ncclDebugLock); return; }
@@ -134,6 +462,16 @@ void ncclDebugInit() {
     }
   }
 
+  // Parameters cannot be used here, loading them logs
+  const char* asyncEnv = ncclGetEnv("RCCL_DEBUG_ASYNC");
+  if (tempNcclDebugLevel >= NCCL_LOG_INFO && asyncEnv && atoi(asyncEnv) == 1) {
+    if (pthread_create(&debugAsyncThread, NULL, debugAsyncMain, NULL) == 0) {
+      pthread_atfork(NULL, NULL, debugAsyncAtFork);
+      atexit(debugAsyncFinalize);
+      debugAsync = 1;
+    }
+  }
+
   ncclEpoch = std::chrono::steady_clock::now();
   __atomic_store_n(&ncclDebugLevel, tempNcclDebugLevel, __ATOMIC_RELEASE);
   pthread_mutex_unlock(&ncclDebugLock);
@@ -141,21 +479,17 @@ void ncclDebugInit() {
 
 NCCL_PARAM(WarnSetDebugInfo, "WARN_ENABLE_DEBUG_INFO", 0);
 
-/* Common logging function used by the INFO, WARN and TRACE macros
- * Also exported to the dynamically loadable Net transport modules so
- * they can share the debugging mechanisms and output files
- */
-void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+static void ncclDebugLogV(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, bool allowAsync, const char *fmt, va_list vargs) {
   if (__atomic_load_n(&ncclDebugLevel, __ATOMIC_ACQUIRE) == -1) ncclDebugInit();
   if (ncclDebugNoWarn != 0 && level == NCCL_LOG_WARN) { level = NCCL_LOG_INFO; flags = ncclDebugNoWarn; }
 
   // Save the last error (WARN) as a human readable string
   if (level == NCCL_LOG_WARN) {
     pthread_mutex_lock(&ncclDebugLock);
-    va_list vargs;
-    va_start(vargs, fmt);
-    (void) vsnprintf(ncclLastError, sizeof(ncclLastError), fmt, vargs);
-    va_end(vargs);
+    va_list args;
+    va_copy(args, vargs);
+    (void) vsnprintf(ncclLastError, sizeof(ncclLastError), fmt, args);
+    va_end(args);
     pthread_mutex_unlock(&ncclDebugLock);
   }
   if (ncclDebugLevel < level || ((flags & ncclDebugMask) == 0)) return;
@@ -164,33 +498,31 @@ void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *file
     tid = syscall(SYS_gettid);
   }
 
-  int cudaDev;
+  int cudaDev = -1;
   if (!(level == NCCL_LOG_TRACE && flags == NCCL_CALL)) {
     cudaGetDevice(&cudaDev);
   }
 
-  char buffer[4096];
-  size_t len = 0;
-  if (level == NCCL_LOG_WARN) {
-    len = snprintf(buffer, sizeof(buffer), "\n%s:%d:%d [%d] %s:%d NCCL WARN ",
-                   hostname, pid, tid, cudaDev, filefunc, line);
-    if (ncclParamWarnSetDebugInfo()) ncclDebugLevel = NCCL_LOG_INFO;
-  } else if (level == NCCL_LOG_INFO) {
-    len = snprintf(buffer, sizeof(buffer), "%s:%d:%d [%d] NCCL INFO ", hostname, pid, tid, cudaDev);
-  } else if (level == NCCL_LOG_TRACE && flags == NCCL_CALL) {
-    len = snprintf(buffer, sizeof(buffer), "%s:%d:%d NCCL CALL ", hostname, pid, tid);
-  } else if (level == NCCL_LOG_TRACE) {
+  double timestamp = 0;
+  if (level == NCCL_LOG_TRACE && flags != NCCL_CALL) {
     auto delta = std::chrono::steady_clock::now() - ncclEpoch;
-    double timestamp = std::chrono::duration_cast<std::chrono::duration<double>>(delta).count()*1000;
-    len = snprintf(buffer, sizeof(buffer), "%s:%d:%d [%d] %f %s:%d NCCL TRACE ",
-                   hostname, pid, tid, cudaDev, timestamp, filefunc, line);
+    timestamp = std::chrono::duration_cast<std::chrono::duration<double>>(delta).count()*1000;
+  }
+
+  if (allowAsync && level != NCCL_LOG_WARN && __atomic_load_n(&debugAsync, __ATOMIC_ACQUIRE)) {
+    va_list args;
+    va_copy(args, vargs);
+    bool queued = debugAsyncLog(level, flags, filefunc, line, cudaDev, timestamp, fmt, args);
+    va_end(args);
+    if (queued) return;
   }
 
+  char buffer[4096];
+  size_t len = debugPrefix(buffer, sizeof(buffer), level, flags, filefunc, line, tid, cudaDev, timestamp);
+  if (level == NCCL_LOG_WARN && ncclParamWarnSetDebugInfo()) ncclDebugLevel = NCCL_LOG_INFO;
+
   if (len) {
-    va_list vargs;
-    va_start(vargs, fmt);
     len += vsnprintf(buffer+len, sizeof(buffer)-len, fmt, vargs);
-    va_end(vargs);
     // vsnprintf may return len > sizeof(buffer) in the case of a truncated output.
     // Rewind len so that we can replace the final \0 by \n
     if (len > sizeof(buffer)) len = sizeof(buffer)-1;
@@ -199,6 +531,27 @@ void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *file
   }
 }
 
+/* Common logging function used by the INFO, WARN and TRACE macros
+ * Also exported to the dynamically loadable Net transport modules so
+ * they can share the debugging mechanisms and output files
+ */
+void ncclDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  va_list vargs;
+  va_start(vargs, fmt);
+  ncclDebugLogV(level, flags, filefunc, line, true, fmt, vargs);
+  va_end(vargs);
+}
+
+/* Logging function given to plugins. Their messages are always formatted
+ * synchronously, the format strings are not valid after the plugin is unloaded.
+ */
+void ncclPluginDebugLog(ncclDebugLogLevel level, unsigned long flags, const char *filefunc, int line, const char *fmt, ...) {
+  va_list vargs;
+  va_start(vargs, fmt);
+  ncclDebugLogV(level, flags, filefunc, line, false, fmt, vargs);
+  va_end(vargs);
+}
+
 NCCL_PARAM(SetThreadName, "SET_THREAD_NAME", 0);
 
 void ncclSetThreadName(pthread_t thread, const char *fmt, ...) {
@@ -0,0 +1,69 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "collectives.h"
+#include "device.h"
+#include "rccl_float8.h"
+#include <cuda_runtime.h>
+
+namespace {
+  // Each thread sums EltPerPack consecutive elements of every source in FP32
+  // and rounds to T once, instead of once per ring hop.
+  template<typename T, int EltPerPack>
+  __global__ __launch_bounds__(512, 1)
+  void fp32AccumReduce(T* dst, T const* src, int nSrcs, size_t nElts) {
+    constexpr bool Packed = EltPerPack*sizeof(T) == sizeof(uint64_t);
+    size_t nPacks = nElts/EltPerPack;
+    for (size_t p = blockIdx.x*(size_t)blockDim.x + threadIdx.x; p < nPacks; p += gridDim.x*(size_t)blockDim.x) {
+      union { uint64_t u64; T elts[sizeof(uint64_t)/sizeof(T)]; } in, out;
+      float acc[EltPerPack];
+      #pragma unroll
+      for (int e=0; e<EltPerPack; e++) acc[e] = 0.0f;
+      for (int s=0; s<nSrcs; s++) {
+        T const* ptr = src + s*nElts + p*EltPerPack;
+        if (Packed) in.u64 = *reinterpret_cast<uint64_t const*>(ptr);
+        else in.elts[0] = ptr[0];
+        #pragma unroll
+        for (int e=0; e<EltPerPack; e++) acc[e] += float(in.elts[e]);
+      }
+      #pragma unroll
+      for (int e=0; e<EltPerPack; e++) out.elts[e] = T(acc[e]);
+      T* d = dst + p*EltPerPack;
+      if (Packed) *reinterpret_cast<uint64_t*>(d) = out.u64;
+      else d[0] = out.elts[0];
+    }
+  }
+
+  template<typename T>
+  void const* fp32AccumKernel(bool packed) {
+    return packed ? (void const*)&fp32AccumReduce<T, sizeof(uint64_t)/sizeof(T)> : (void const*)&fp32AccumReduce<T, 1>;
+  }
+}
+
+ncclResult_t ncclLaunchFp32AccumReduce(void* dst, void const* src, int nSrcs, size_t nElts, ncclDataType_t type, cudaStream_t stream) {
+  // Sources are slices of the staging buffer, so 8-byte packs only depend on dst and nElts
+  bool packed = (nElts*ncclTypeSize(type))%8 == 0 && (uintptr_t)dst%8 == 0;
+  void const* kernel;
+  switch (type) {
+#if defined(RCCL_FLOAT8)
+  case ncclFp8E4M3: kernel = fp32AccumKernel<rccl_float8>(packed); break;
+  case ncclFp8E5M2: kernel = fp32AccumKernel<rccl_bfloat8>(packed); break;
+#endif
+  case ncclFloat16: kernel = fp32AccumKernel<half>(packed); break;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: kernel = fp32AccumKernel<hip_bfloat16>(packed); break;
+#endif
+  default: return ncclInvalidArgument;
+  }
+  if (nElts == 0) return ncclSuccess;
+  dim3 grid = {0, 1, 1};
+  grid.x = std::min(256, (int)divUp(nElts, 512*8));
+  dim3 block = {512, 1, 1};
+  void* args[4] = {&dst, &src, &nSrcs, &nElts};
+  CUDACHECK(cudaLaunchKernel(kernel, grid, block, args, 0, stream));
+  return ncclSuccess;
+}
@@ -10,7 +10,7 @@
 #include "primitives.h"
 
 namespace {
-  template<typename T, typename RedOp, typename Proto>
+  template<typename T, typename RedOp, typename Proto, int NRanks = 0>
 #if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
   __device__ void runRing(ncclWorkElem *args) {
 #else
@@ -20,7 +20,8 @@ namespace {
     const int nthreads = (int)args->nWarps * WARP_SIZE;
     ncclRing *ring = &ncclShmem.channel.ring;
     const int *ringRanks = ring->userRanks;
-    const int nranks = ncclShmem.comm.nRanks;
+    // Compile-time constant in the specializations of ncclRingNRanksDispatch
+    const int nranks = NRanks ? NRanks : ncclShmem.comm.nRanks;
     const size_t chunkCount = args->chunkCount;
     const size_t channelCount = args->workCount;
     const size_t gridOffset = args->workOffset;
@@ -156,21 +157,21 @@ template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
     using Proto = ProtoSimple<ALLGATHER_CHUNKSTEPS/ALLGATHER_SLICESTEPS, ALLGATHER_SLICESTEPS>;
-    runRing<T, RedOp, Proto>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, Proto, decltype(n)::value>(args); });
   }
 };
 
 template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
-    runRing<T, RedOp, ProtoLL>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, ProtoLL, decltype(n)::value>(args); });
   }
 };
 
 template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL128> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
-    runRing<T, RedOp, ProtoLL128>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, ProtoLL128, decltype(n)::value>(args); });
   }
 };
 
@@ -392,4 +393,74 @@ struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_COLLNET_DIRECT, NCC
       return;
     }
   }
-};
\ No newline at end of file
+};
+namespace {
+  // Bruck AllGather: at step k, the blocks gathered so far go to the rank 1<<k
+  // below while those of the rank 1<<k above arrive, so that all blocks are in
+  // place after ceil(log2(nRanks)) steps. A step moves min(1<<k, nRanks-(1<<k))
+  // blocks, contiguous in the output but for the wrap at nRanks. One channel
+  // runs the whole collective. Must match bruckProxySteps() in enqueue.cc.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runBruck(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runBruck(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int nranks = ncclShmem.comm.nRanks;
+    const ssize_t count = args->count;
+    const ssize_t total = count*nranks;
+    const ssize_t chunkCount = args->chunkCount;
+    T const *inputBuf = (T const*)args->sendbuff;
+    T *outputBuf = (T*)args->recvbuff;
+    const bool inPlace = inputBuf == outputBuf + rank*count;
+
+    for (int k = 0; k < ncclShmem.channel.bruck.nSteps; k++) {
+      int sendPeer = (rank + nranks - (1<<k)) % nranks;
+      int recvPeer = (rank + (1<<k)) % nranks;
+      const int nBlocks = min(1<<k, nranks-(1<<k));
+      const ssize_t n = nBlocks*count;
+      // Our first step sends our own block, copying it to the output on the way
+      Primitives<T, RedOp, FanSymmetric<1>, /*Direct=*/0, Proto, 0>
+        prims(tid, nthreads, &recvPeer, &sendPeer, k == 0 ? inputBuf : outputBuf, outputBuf, args->redOpArg);
+      for (ssize_t si = 0, ri = 0; si < n || ri < n; ) {
+        if (si < n) {
+          int nelem = ncclBruckChunk(si, count, nBlocks, nranks-rank, 0, 0, chunkCount);
+          ssize_t offset = (rank*count + si) % total;
+          if (k > 0) prims.send(offset, nelem);
+          else if (inPlace) prims.send(si, nelem);
+          else prims.copySend(si, offset, nelem);
+          si += nelem;
+        }
+        if (ri < n) {
+          int nelem = ncclBruckChunk(ri, count, nBlocks, nranks-recvPeer, 0, 0, chunkCount);
+          prims.recv((recvPeer*count + ri) % total, nelem);
+          ri += nelem;
+        }
+      }
+    }
+  }
+}
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllGather, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoLL128>(args);
+  }
+};
@@ -14,7 +14,7 @@
 #endif
 
 namespace {
-  template<typename T, typename RedOp, typename Proto>
+  template<typename T, typename RedOp, typename Proto, int NRanks = 0>
 #if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
   __device__ void runRing(ncclWorkElem *args) {
 #else
@@ -25,7 +25,8 @@ namespace {
     ncclRing *ring = &ncclShmem.channel.ring;
     int ringIx = ring->index;
     ssize_t chunkCount = args->chunkCount;
-    const int nranks = ncclShmem.comm.nRanks;
+    // Compile-time constant in the specializations of ncclRingNRanksDispatch
+    const int nranks = NRanks ? NRanks : ncclShmem.comm.nRanks;
     const ssize_t loopCount = nranks * chunkCount;
     ssize_t offset;
     ssize_t gridOffset = args->workOffset;
@@ -381,6 +382,10 @@ namespace {
       // to 3 dests. Use 70% for reduce and 30% for bcast.
       nthreadsSplit = (nthreads*7/(10*WARP_SIZE))*WARP_SIZE;
     }
+    if (args->treeSplit && nthreads >= 2*WARP_SIZE) {
+      // Split computed from the link bandwidths, keep at least a warp on each side
+      nthreadsSplit = min(max(nthreads*args->treeSplit/(100*WARP_SIZE), 1), nthreads/WARP_SIZE-1)*WARP_SIZE;
+    }
 
 #if defined(ENABLE_NPKIT)
     bool isNpKitThread = false;
@@ -555,7 +560,7 @@ template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
     using Proto = ProtoSimple<ALLREDUCE_CHUNKSTEPS/ALLREDUCE_SLICESTEPS, ALLREDUCE_SLICESTEPS>;
-    runRing<T, RedOp, Proto>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, Proto, decltype(n)::value>(args); });
   }
 };
 
@@ -997,7 +1002,7 @@ struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_COLLNET_CHAIN, NCCL
 template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
-    runRing<T, RedOp, ProtoLL>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, ProtoLL, decltype(n)::value>(args); });
   }
 };
 
@@ -1011,7 +1016,7 @@ struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL
 template<typename T, typename RedOp>
 struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL128> {
   __device__ __forceinline__ void run(ncclWorkElem *args) {
-    runRing<T, RedOp, ProtoLL128>(args);
+    ncclRingNRanksDispatch([&](auto n) { runRing<T, RedOp, ProtoLL128, decltype(n)::value>(args); });
     //LAUNCH_CLIQUE_KERNEL(AllReduceCliqueSplitKernel, RedOp, T, args);
   }
 };
@@ -1023,3 +1028,202 @@ struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL
     //LAUNCH_CLIQUE_KERNEL(AllReduceCliqueSplitKernel, RedOp, T, args);
   }
 };
+
+namespace {
+  // Direct AllReduce: each rank talks to every other rank of the node over the
+  // p2p connections (args->connIndex) of its channel. Peers are listed in rank
+  // order without ourselves, so peer i owns part i, or part i+1 past our rank.
+  __device__ __forceinline__ void directPeers(int* peers) {
+    const int rank = ncclShmem.comm.rank;
+    const int nranks = ncclShmem.comm.nRanks;
+    for (int r = 0, i = 0; r < nranks; r++) if (r != rank) peers[i++] = r;
+    peers[nranks-1] = -1;
+  }
+
+  // One-shot: send the input to all peers, then reduce what they sent with it.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runDirectOneShot(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runDirectOneShot(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const ssize_t chunkCount = args->chunkCount;
+    const ssize_t gridOffset = args->workOffset;
+    const ssize_t channelCount = args->workCount;
+    int peers[NCCL_MAX_DIRECT_ARITY+1];
+    directPeers(peers);
+
+    Primitives<T, RedOp, FanSymmetric<NCCL_MAX_DIRECT_ARITY>, /*Direct=*/0, Proto, 0>
+      prims(tid, nthreads, peers, peers, args->sendbuff, args->recvbuff, args->redOpArg, 0, args->connIndex, args->connIndex);
+
+    for (ssize_t elemOffset = 0; elemOffset < channelCount; elemOffset += chunkCount) {
+      ssize_t offset = gridOffset + elemOffset;
+      int nelem = min(chunkCount, channelCount - elemOffset);
+      prims.send(offset, nelem);
+      prims.recvReduceCopy(offset, offset, nelem, /*postOp=*/true);
+    }
+  }
+
+  // Two-shot: scatter part p to rank p, reduce our own part and send it to all
+  // peers, then gather their reduced parts. Needs scatter/gather, so Simple only.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runDirectTwoShot(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runDirectTwoShot(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int nranks = ncclShmem.comm.nRanks;
+    ssize_t chunkCount = args->chunkCount;
+    const ssize_t loopCount = nranks * chunkCount;
+    const ssize_t gridOffset = args->workOffset;
+    const ssize_t channelCount = args->workCount;
+    int peers[NCCL_MAX_DIRECT_ARITY+1];
+    directPeers(peers);
+
+    Primitives<T, RedOp, FanSymmetric<NCCL_MAX_DIRECT_ARITY>, /*Direct=*/0, Proto, 0>
+      prims(tid, nthreads, peers, peers, args->sendbuff, args->recvbuff, args->redOpArg, 0, args->connIndex, args->connIndex);
+
+    for (ssize_t elemOffset = 0; elemOffset < channelCount; elemOffset += loopCount) {
+      if (channelCount - elemOffset < loopCount) chunkCount = args->lastChunkCount;
+      ssize_t offset = gridOffset + elemOffset;
+      int nelem = min(loopCount, channelCount - elemOffset);
+      ssize_t partOffset = offset + rank*chunkCount;
+      int partElem = max((ssize_t)0, min(chunkCount, nelem - rank*chunkCount));
+      // Start each peer loop at our own rank so that links are not all hit in the same order
+      prims.scatter(offset, nelem, chunkCount, chunkCount, rank, rank);
+      prims.recvReduceCopySend(partOffset, partOffset, partElem, /*postOp=*/true);
+      prims.gather(offset, nelem, chunkCount, chunkCount, rank, rank);
+    }
+  }
+}
+
+// args->direct holds the number of shots picked by the host, see addDirectCollToPlan()
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_DIRECT, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    if (args->direct == 2) runDirectTwoShot<T, RedOp, ProtoSimple<1, 1>>(args);
+    else runDirectOneShot<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_DIRECT, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runDirectOneShot<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_DIRECT, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runDirectOneShot<T, RedOp, ProtoLL128>(args);
+  }
+};
+
+namespace {
+  // Sends sendCount elements from `in` and receives recvCount elements into the
+  // output, reducing them with `in` when asked, one chunk of each at a time so
+  // that both sides of an exchange make progress.
+  template<typename T, typename RedOp, typename Proto>
+  __device__ __forceinline__ void rhdExchange(ncclWorkElem *args, int peer, void const* in,
+      ssize_t sendOffset, ssize_t sendCount, ssize_t recvOffset, ssize_t recvCount, bool reduce, bool postOp) {
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const ssize_t chunkCount = args->chunkCount;
+    Primitives<T, RedOp, FanSymmetric<1>, /*Direct=*/0, Proto, 0>
+      prims(tid, nthreads, &peer, &peer, in, args->recvbuff, args->redOpArg);
+    for (ssize_t i = 0; i < sendCount || i < recvCount; i += chunkCount) {
+      if (i < sendCount) prims.send(sendOffset + i, min(chunkCount, sendCount - i));
+      if (i < recvCount) {
+        int nelem = min(chunkCount, recvCount - i);
+        if (reduce) prims.recvReduceCopy(recvOffset + i, recvOffset + i, nelem, postOp);
+        else prims.recv(recvOffset + i, nelem);
+      }
+    }
+  }
+
+  // Recursive halving-doubling (Rabenseifner): log2(n) reduce-scatter steps, each
+  // halving the part we own with the rank at distance 1<<k, then the same steps
+  // in reverse to gather. Parts are made of the 1<<nSteps blocks of the channel.
+  // Must match rhdProxySteps() in enqueue.cc.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runRhd(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runRhd(ncclWorkElem *args) {
+#endif
+    ncclRhd *rhd = &ncclShmem.channel.rhd;
+    const ssize_t gridOffset = args->workOffset;
+    const ssize_t channelCount = args->workCount;
+    const int nSteps = rhd->nSteps;
+    const int vrank = rhd->vrank;
+    void const* in = args->sendbuff;
+
+    if (rhd->extra != -1) {
+      if (vrank == -1) {
+        // Our data goes to the fold partner, which hands back the result
+        rhdExchange<T, RedOp, Proto>(args, rhd->extra, in, gridOffset, channelCount, 0, 0, false, false);
+        rhdExchange<T, RedOp, Proto>(args, rhd->extra, in, 0, 0, gridOffset, channelCount, false, false);
+        return;
+      }
+      rhdExchange<T, RedOp, Proto>(args, rhd->extra, in, 0, 0, gridOffset, channelCount, true, false);
+      in = args->recvbuff;
+    }
+
+    const ssize_t alignCount = max((ssize_t)1, (ssize_t)(16/sizeof(T)));
+    const ssize_t blockCount = divUp(divUp(channelCount, (ssize_t)1 << nSteps), alignCount) * alignCount;
+    auto blockOffset = [&](ssize_t b) -> ssize_t { return min(b*blockCount, channelCount); };
+    ssize_t lo = 0, nBlocks = (ssize_t)1 << nSteps;
+    for (int k = 0; k < nSteps; k++) {
+      ssize_t half = nBlocks/2;
+      ssize_t keep = (vrank & (1<<k)) ? lo+half : lo;
+      ssize_t give = (vrank & (1<<k)) ? lo : lo+half;
+      rhdExchange<T, RedOp, Proto>(args, rhd->peers[k], in,
+          gridOffset + blockOffset(give), blockOffset(give+half) - blockOffset(give),
+          gridOffset + blockOffset(keep), blockOffset(keep+half) - blockOffset(keep),
+          true, /*postOp=*/k == nSteps-1);
+      in = args->recvbuff;
+      lo = keep;
+      nBlocks = half;
+    }
+    for (int k = nSteps-1; k >= 0; k--) {
+      ssize_t other = (vrank & (1<<k)) ? lo-nBlocks : lo+nBlocks;
+      rhdExchange<T, RedOp, Proto>(args, rhd->peers[k], in,
+          gridOffset + blockOffset(lo), blockOffset(lo+nBlocks) - blockOffset(lo),
+          gridOffset + blockOffset(other), blockOffset(other+nBlocks) - blockOffset(other),
+          false, false);
+      lo = min(lo, other);
+      nBlocks *= 2;
+    }
+
+    if (rhd->extra != -1) {
+      rhdExchange<T, RedOp, Proto>(args, rhd->extra, in, gridOffset, channelCount, 0, 0, false, false);
+    }
+  }
+}
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RHD, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runRhd<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RHD, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runRhd<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllReduce, T, RedOp, NCCL_ALGO_RHD, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runRhd<T, RedOp, ProtoLL128>(args);
+  }
+};
@@ -0,0 +1,110 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "device.h"
+#include "collectives.h"
+#include "primitives.h"
+
+// Ring AllReduce for the epilogue operators of ncclRedOpCreateEpilogue, compiled
+// into their module only (see jit_redop.cc). It runs the ReduceScatter half of
+// the ring, applies the epilogue to each chunk once it is fully reduced, and sends
+// the result into the AllGather half, so the three stages overlap chunk by chunk.
+// The epilogue is called as Epilogue()(x, index, arg), index being the position
+// of x in the buffer and arg the pointer given when creating the operator.
+namespace {
+  template<typename T, typename RedOp, typename Epilogue, typename Proto>
+  __device__ __attribute__((noinline)) void runRingEpilogue(ncclWorkElem *args) {
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    ncclRing *ring = &ncclShmem.channel.ring;
+    int ringIx = ring->index;
+    ssize_t chunkCount = args->chunkCount;
+    const int nranks = ncclShmem.comm.nRanks;
+    const ssize_t loopCount = nranks * chunkCount;
+    ssize_t offset;
+    ssize_t gridOffset = args->workOffset;
+    ssize_t channelCount = args->workCount;
+    int nelem;
+    int chunk;
+    T* recvbuff = (T*)args->recvbuff;
+    void* arg = (void*)args->redOpArg;
+
+    Primitives<T, RedOp, FanSymmetric<1>, 0, Proto, 0> prims
+      (tid, nthreads, &ring->prev, &ring->next, args->sendbuff, args->recvbuff, args->redOpArg, 0, args->connIndex, args->connIndex);
+
+    for (ssize_t elemOffset = 0; elemOffset < channelCount; elemOffset += loopCount) {
+      ssize_t remCount = channelCount - elemOffset;
+      ssize_t chunkOffset;
+
+      if (remCount < loopCount) chunkCount = args->lastChunkCount;
+
+      auto modRanks = [&]__device__(int r)->int {
+        return r - (r >= nranks ? nranks : 0);
+      };
+
+      // step 0: push data to next GPU
+      chunk = modRanks(ringIx + nranks - 1);
+      chunkOffset = chunk * chunkCount;
+      offset = gridOffset + elemOffset + chunkOffset;
+      nelem = (int)min(chunkCount, remCount - chunkOffset);
+      prims.send(offset, nelem);
+
+      // k-2 steps: reduce and copy to next GPU
+      for (int j = 2; j < nranks; ++j) {
+        chunk = modRanks(ringIx + nranks - j);
+        chunkOffset = chunk * chunkCount;
+        offset = gridOffset + elemOffset + chunkOffset;
+        nelem = (int)min(chunkCount, remCount - chunkOffset);
+        prims.recvReduceSend(offset, nelem);
+      }
+
+      // step k-1: produce the final result of this chunk in the output, run the
+      // epilogue over it there, then push it to the next GPU
+      chunk = ringIx + 0;
+      chunkOffset = chunk * chunkCount;
+      offset = gridOffset + elemOffset + chunkOffset;
+      nelem = (int)min(chunkCount, remCount - chunkOffset);
+      prims.recvReduceCopy(offset, offset, nelem);
+      prims.groupSync();
+      for (int i = tid; i < nelem; i += nthreads) {
+        recvbuff[offset+i] = Epilogue()(recvbuff[offset+i], (size_t)(offset+i), arg);
+      }
+      prims.groupSync();
+      prims.sendFromOutput(offset, nelem);
+
+      // k-2 steps: copy to next GPU
+      for (int j = 1; j < nranks - 1; ++j) {
+        chunk = modRanks(ringIx + nranks - j);
+        chunkOffset = chunk * chunkCount;
+        offset = gridOffset + elemOffset + chunkOffset;
+        nelem = (int)min(chunkCount, remCount - chunkOffset);
+        prims.directRecvCopySend(offset, nelem);
+      }
+
+      // Make final copy from buffer to dest.
+      chunk = modRanks(ringIx + 1);
+      chunkOffset = chunk * chunkCount;
+      offset = gridOffset + elemOffset + chunkOffset;
+      nelem = (int)min(chunkCount, remCount - chunkOffset);
+      prims.directRecv(offset, nelem);
+    }
+  }
+}
+
+// Runs the elements of a work like RunWork of common.h
+template<typename T, typename RedOp, typename Epilogue, typename Proto>
+struct RunWorkEpilogue {
+  __device__ __forceinline__ void run(ncclWork *w) {
+    int wid = threadIdx.x / WARP_SIZE;
+    ncclWorkElem* we = w->header.type == ncclWorkTypeRegColl ? &w->regElems[0].elem : &w->elems[0];
+    int stride = w->header.type == ncclWorkTypeRegColl ? sizeof(ncclWorkElemReg) : sizeof(ncclWorkElem);
+    #pragma unroll 1
+    while ((char*)we + stride <= (char*)(w+1) && we->isUsed) {
+      if (wid < we->nWarps) runRingEpilogue<T, RedOp, Epilogue, Proto>(we);
+      we = (ncclWorkElem*)((char*)we + stride);
+    }
+  }
+};
@@ -0,0 +1,162 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "device.h"
+#include "collectives.h"
+#include "primitives.h"
+
+namespace {
+  // Each channel (bid) owns the peers at distance d = bid, bid+nChannels, ...
+  // The first half of the block receives from rank-d while the second half
+  // sends to rank+d, using the same p2p connectors as ncclSend/ncclRecv.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runAllToAll(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runAllToAll(ncclWorkElem *args) {
+#endif
+    const int nthreads = args->nWarps*WARP_SIZE;
+    const int nRecvThreads = nthreads/2;
+    const int nSendThreads = nthreads - nRecvThreads;
+    const bool isSend = threadIdx.x >= nRecvThreads;
+    const int tid = isSend ? threadIdx.x - nRecvThreads : threadIdx.x;
+    const uint8_t group = isSend ? 1 : 0;
+    const int rank = ncclShmem.comm.rank;
+    const int nRanks = ncclShmem.comm.nRanks;
+    const ssize_t count = args->count;
+    const ssize_t chunkCount = ncclShmem.comm.p2pChunkSize/sizeof(T);
+    const T* sendbuff = (const T*)args->sendbuff;
+    T* recvbuff = (T*)args->recvbuff;
+
+    for (int d = args->bid; d < nRanks; d += args->nChannels) {
+      if (d == 0) {
+        // Local copy, done by the send threads so that they do not wait on the receive half.
+        if (isSend && sendbuff + rank*count != recvbuff + rank*count) {
+          void* src = (void*)(sendbuff + rank*count);
+          void* dst = (void*)(recvbuff + rank*count);
+          reduceCopy<COLL_UNROLL, RedOp, T, 0,1,1, 0,1,1, /*PreOpSrcs=*/0>
+            (tid, nSendThreads, 0, nullptr, false, 1, &src, 1, &dst, count);
+        }
+        continue;
+      }
+      if (isSend) {
+        int const peer = (rank + d) % nRanks;
+        Primitives<T, RedOp, FanAsymmetric<0, 1>, 1, Proto, 1> prims
+          (tid, nSendThreads, nullptr, &peer, sendbuff + peer*count, nullptr, /*redOpArg(ignored)=*/0, group, args->connIndex, args->connIndex, nullptr, nullptr, chunkCount);
+        ssize_t offset = 0;
+        do {
+          int nelem = min(chunkCount, count-offset);
+          prims.directSend(offset, offset, nelem);
+          offset += nelem;
+        } while (offset < count);
+      } else {
+        int const peer = (rank - d + nRanks) % nRanks;
+        Primitives<T, RedOp, FanAsymmetric<1, 0>, 1, Proto, 1> prims
+          (tid, nRecvThreads, &peer, nullptr, nullptr, recvbuff + peer*count, /*redOpArg(ignored)=*/0, group, args->connIndex, args->connIndex, nullptr, nullptr, chunkCount);
+        ssize_t offset = 0;
+        do {
+          int nelem = min(chunkCount, count-offset);
+          prims.directRecv(offset, nelem);
+          offset += nelem;
+        } while (offset < count);
+      }
+    }
+  }
+}
+
+namespace {
+  // Bruck AllToAll for small blocks. Block j, meant for rank+j, is kept at tmp[j]
+  // in the channel scratch. At step k the blocks with bit k of j set are packed and
+  // sent to the rank 1<<k above, and replaced by those of the rank 1<<k below, so
+  // that tmp[j] ends up holding the block of rank-j. Each step is one message of
+  // at most nRanks/2 blocks, and there are ceil(log2(nRanks)) steps instead of
+  // nRanks-1 messages. One channel runs the whole collective on all the threads
+  // of the block. Must match bruckProxySteps() in enqueue.cc.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runBruck(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runBruck(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int nranks = ncclShmem.comm.nRanks;
+    const ssize_t count = args->count;
+    const ssize_t chunkCount = args->chunkCount;
+    T const *inputBuf = (T const*)args->sendbuff;
+    T *outputBuf = (T*)args->recvbuff;
+    T *tmp = (T*)ncclShmem.channel.bruck.scratch;
+    T *sendPack = tmp + nranks*count;
+    T *recvPack = sendPack + (nranks/2)*count;
+
+    // The input is only read here, so the collective can run in place
+    for (ssize_t i = tid; i < nranks*count; i += nthreads) {
+      tmp[i] = inputBuf[((rank + i/count) % nranks)*count + i%count];
+    }
+    __syncthreads();
+    for (int k = 0; k < ncclShmem.channel.bruck.nSteps; k++) {
+      const int dist = 1<<k;
+      int sendPeer = (rank + dist) % nranks;
+      int recvPeer = (rank + nranks - dist) % nranks;
+      const int nBlocks = ((nranks >> (k+1)) << k) + max(0, (nranks & (2*dist-1)) - dist);
+      const ssize_t n = nBlocks*count;
+      // Block b of the pack is block j of tmp, the b-th index with bit k set
+      for (ssize_t i = tid; i < n; i += nthreads) {
+        ssize_t b = i/count;
+        ssize_t j = ((b >> k) << (k+1)) | dist | (b & (dist-1));
+        sendPack[i] = tmp[j*count + i%count];
+      }
+      __syncthreads();
+      {
+        Primitives<T, RedOp, FanSymmetric<1>, /*Direct=*/0, Proto, 0>
+          prims(tid, nthreads, &recvPeer, &sendPeer, sendPack, recvPack, args->redOpArg);
+        for (ssize_t i = 0; i < n; i += chunkCount) {
+          int nelem = min(chunkCount, n-i);
+          prims.send(i, nelem);
+          prims.recv(i, nelem);
+        }
+      }
+      __syncthreads();
+      for (ssize_t i = tid; i < n; i += nthreads) {
+        ssize_t b = i/count;
+        ssize_t j = ((b >> k) << (k+1)) | dist | (b & (dist-1));
+        tmp[j*count + i%count] = recvPack[i];
+      }
+      __syncthreads();
+    }
+    for (ssize_t i = tid; i < nranks*count; i += nthreads) {
+      outputBuf[((rank + nranks - i/count) % nranks)*count + i%count] = tmp[i];
+    }
+  }
+}
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllToAll, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllToAll, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncAllToAll, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+#if defined(__gfx90a__)
+    runAllToAll<T, RedOp, ProtoSimple<1,1,8>>(args);
+#elif defined(__gfx908__) || defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
+    runAllToAll<T, RedOp, ProtoSimple<1,1,4>>(args);
+#else
+    runAllToAll<T, RedOp, ProtoSimple<1,1>>(args);
+#endif
+  }
+};
@@ -35,6 +35,8 @@ namespace {
     Primitives<T, RedOp, FanSymmetric<1>, 0, Proto, 0> prims
       (tid, nthreads, &ring->prev, &ring->next, args->sendbuff, args->recvbuff, /*redOpArg(ignored)=*/0);
 
+    // Each direction covers nranks/2 hops. With an even rank count both directions reach
+    // the opposite rank and each sends half of the chunk, with an odd count they don't meet.
     for (int num_hops = 0; num_hops <= nranks / 2; num_hops++) {
       const int src_rank = ring->userRanks[(nranks - num_hops) % nranks];
       const int dst_rank = ring->userRanks[num_hops];
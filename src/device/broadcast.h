@@ -86,6 +86,50 @@ namespace {
     }
 #endif
   }
+
+  // Tree Broadcast from any root: data comes in from the tree neighbor on the way
+  // to the root and is forwarded to all the other neighbors.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runTree(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runTree(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int root = args->root;
+    const size_t chunkCount = args->chunkCount;
+    const size_t channelCount = args->workCount;
+    const size_t gridOffset = args->workOffset;
+    const int* treeUps = ncclShmem.comm.treeUps + ncclShmem.channelId*ncclShmem.comm.nRanks;
+    int sendPeers[NCCL_MAX_TREE_PEERS];
+    int recvPeer = ncclTreeRootedPeers(treeUps, &ncclShmem.channel.tree, rank, root, sendPeers);
+    size_t offset;
+    int nelem;
+
+    T *inputBuf = (T*)args->sendbuff;
+    T *outputBuf = (T*)args->recvbuff;
+    Primitives<T, RedOp, FanAsymmetric<1, NCCL_MAX_TREE_PEERS>, 0, Proto, 0>
+      prims(tid, nthreads, &recvPeer, sendPeers, inputBuf, outputBuf, args->redOpArg, 0, args->connIndex, args->connIndex);
+
+    for (size_t elemOffset = 0; elemOffset < channelCount; elemOffset += chunkCount) {
+      offset = gridOffset + elemOffset;
+      nelem = min(chunkCount, channelCount - elemOffset);
+
+      if (rank == root) {
+        if (inputBuf == outputBuf) {
+          prims.send(offset, nelem);
+        } else {
+          prims.copySend(offset, offset, nelem);
+        }
+      } else if (sendPeers[0] == -1) {
+        prims.recv(offset, nelem);
+      } else {
+        prims.recvCopySend(offset, nelem);
+      }
+    }
+  }
 }
 
 template<typename T, typename RedOp>
@@ -108,4 +152,25 @@ struct RunWorkElement<ncclFuncBroadcast, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL
   __device__ __forceinline__ void run(ncclWorkElem *args) {
     runRing<T, RedOp, ProtoLL128>(args);
   }
-};
\ No newline at end of file
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncBroadcast, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncBroadcast, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncBroadcast, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoLL128>(args);
+  }
+};
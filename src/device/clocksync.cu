@@ -0,0 +1,30 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "device.h"
+#include <cuda_runtime.h>
+
+namespace {
+  // Ping-pong with the host through mapped memory: mbox[0] is the round posted
+  // by the host, mbox[1] the GPU timestamp and mbox[2] the round answered.
+  // A post of ~0 makes the kernel give up.
+  __global__ void clockSync(uint64_t volatile* mbox, int nRounds) {
+    for (int r = 1; r <= nRounds; r++) {
+      uint64_t posted;
+      while ((posted = mbox[0]) != (uint64_t)r && posted != ~0ULL);
+      if (posted == ~0ULL) return;
+      mbox[1] = wall_clock64();
+      __threadfence_system();
+      mbox[2] = r;
+    }
+  }
+}
+
+ncclResult_t ncclLaunchClockSync(uint64_t volatile* mbox, int nRounds, cudaStream_t stream) {
+  void* args[2] = {&mbox, &nRounds};
+  CUDACHECK(cudaLaunchKernel((void const*)&clockSync, dim3(1), dim3(1), args, 0, stream));
+  return ncclSuccess;
+}
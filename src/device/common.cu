@@ -23,6 +23,12 @@ __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void ncclDevKernel_Generic(st
 __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void ncclDevKernel_Generic_4(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead) {
   ncclKernelMain<-1, RunWorkNop, false, 4>(comm, channelMask, workHead);
 }
+__launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void ncclDevKernel_Persistent(struct ncclDevComm* comm, struct ncclDevPersistentSync* sync, struct ncclDevPersistentLaunch* launches, uint32_t* nDone) {
+  ncclPersistentKernelMain<RunWorkNop, 2>(comm, sync, launches, nDone);
+}
+__launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void ncclDevKernel_Persistent_4(struct ncclDevComm* comm, struct ncclDevPersistentSync* sync, struct ncclDevPersistentLaunch* launches, uint32_t* nDone) {
+  ncclPersistentKernelMain<RunWorkNop, 4>(comm, sync, launches, nDone);
+}
 #ifdef ENABLE_COLLTRACE
 __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void ncclDevKernelDebug_Generic(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead) {
   ncclKernelMain<-1, RunWorkNop, true, 2>(comm, channelMask, workHead);
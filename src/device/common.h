@@ -75,6 +75,7 @@
       collTrace->coll.nWarps = elems[0].nWarps; \
       collTrace->coll.bid = elems[0].bid; \
       collTrace->coll.nChannels = elems[0].nChannels; \
+      collTrace->coll.countLog2 = elems[0].count ? 63 - __clzll(elems[0].count) : 0; \
       collTrace->type = (launch_type) | ncclCollTraceCollElemType; \
     } \
   }
@@ -151,6 +152,22 @@ extern __shared__ ncclShmemData ncclShmem;
   extern __shared__ ulong2 ncclShmemPerWarp[ncclShmemScratchWarpSize()*(NCCL_MAX_NTHREADS/WARP_SIZE)/sizeof(ulong2)];
 #endif
 
+// Calls fn with std::integral_constant<int, N>, N being the communicator size for
+// the sizes ring loops are compiled for (RCCL_RING_NRANKS_SPECIALIZE: 2, 4, 8 and
+// 16 ranks), and 0, meaning ncclShmem.comm.nRanks, for any other size.
+template<typename F>
+__device__ __forceinline__ void ncclRingNRanksDispatch(F fn) {
+#if defined(RCCL_RING_NRANKS_SPECIALIZE)
+  switch (ncclShmem.comm.nRanks) {
+  case 2: fn(std::integral_constant<int, 2>()); return;
+  case 4: fn(std::integral_constant<int, 4>()); return;
+  case 8: fn(std::integral_constant<int, 8>()); return;
+  case 16: fn(std::integral_constant<int, 16>()); return;
+  }
+#endif
+  fn(std::integral_constant<int, 0>());
+}
+
 __device__ inline void* ncclScratchForWarp(int warp) {
   return (char*)ncclShmemPerWarp + warp*ncclShmemScratchWarpSize();
 }
@@ -225,6 +242,82 @@ static __forceinline__ __device__ void ncclRedopPtrDeref(struct ncclWorkElem* we
   }
 }
 
+// Runs the work structs of this block, starting with the one already in
+// ncclShmem.work and following workNext until isLast. The first warp loads the
+// next work into registers before running the current one, so the global memory
+// round trip overlaps with the execution and only an LDS store is left between
+// two works.
+template<int SpecializedFnId, typename SpecializedRunWork, bool COLLTRACE, int COLL_UNROLL>
+__forceinline__ __device__ void ncclRunWorkChain(struct ncclDevComm* comm, struct ncclWork* workHead) {
+  const int tid = threadIdx.x;
+  // RCCL_COLL_TIMINGS, graph launches are not in the fifo and are left out
+  struct ncclDevCollTiming* timing = nullptr;
+  uint64_t timingPos = 0;
+  if (tid == 0 && ncclShmem.comm.collTimings != nullptr && ncclShmem.work.header.inFifo) {
+    int c = ncclShmem.channelId;
+    timingPos = ncclShmem.comm.collTimingsCount[c]++;
+    timing = ncclShmem.comm.collTimings + c*(ncclShmem.comm.collTimingsMask+1) + (timingPos & ncclShmem.comm.collTimingsMask);
+    timing->start = wall_clock64();
+  }
+  while (true) {
+    // Notify host that all fifo reads are complete.
+    if (tid == 0 && ncclShmem.work.header.isLast && ncclShmem.work.header.inFifo) {
+      *ncclShmem.channel.workFifoDone = ncclShmem.work.header.doneAcks;
+    }
+
+    __syncwarp();
+    if (ncclShmem.work.header.type == ncclWorkTypeColl) {
+      if (tid < NCCL_MAX_WORK_ELEMENTS) ncclRedopPtrDeref(&ncclShmem.work.elems[tid]);
+    } else if (ncclShmem.work.header.type == ncclWorkTypeRegColl) {
+      if (tid < NCCL_MAX_WORK_ELEMENTS_REG) ncclRedopPtrDeref(&ncclShmem.work.regElems[tid].elem);
+    }
+    __synclds();
+
+    if (tid == 0) __insert_timestamp(__LINE__);
+
+    int workIxNext = ncclShmem.work.header.workNext;
+    bool isLast = ncclShmem.work.header.isLast;
+    bool prefetch = !isLast && 16*tid < sizeof(ncclWork);
+    ulong2 next;
+    if (prefetch) next = *(ulong2 const*)((char const*)(workHead + workIxNext) + 16*tid);
+
+    if (0 <= SpecializedFnId && ncclShmem.work.header.funcIndex == (unsigned)SpecializedFnId) {
+      SpecializedRunWork().run(&ncclShmem.work);
+    } else {
+#ifdef USE_INDIRECT_FUNCTION_CALL
+      if (COLL_UNROLL == 4)
+        ncclDevFuncTable_4[ncclShmem.work.header.funcIndex]();
+      else
+        ncclDevFuncTable[ncclShmem.work.header.funcIndex]();
+#else
+      if (COLL_UNROLL == 4)
+        NCCL_CALL_FUNCTIONS_4(ncclShmem.work.header.funcIndex);
+      else
+        NCCL_CALL_FUNCTIONS(ncclShmem.work.header.funcIndex);
+#endif
+    }
+
+    __synclds();
+    if (isLast) break;
+
+    if (prefetch) *(ulong2*)((char*)&ncclShmem.work + 16*tid) = next;
+
+    { // Check whether the last operation was aborted and make sure all threads exit
+      int aborted = tid == 0 ? *comm->abortFlag : 0;
+      if (__any(aborted)) { // publish ncclShmem.work
+        traceKernelEnd(ncclCollTraceAbortType);
+        break;
+      }
+    }
+    if (COLLTRACE && tid == 0) traceKernelLaunch(ncclCollTraceCollLaunchType);
+  }
+  if (timing) {
+    timing->end = wall_clock64();
+    __threadfence_system();
+    __atomic_store_n(&timing->tag, timingPos+1, __ATOMIC_RELAXED);
+  }
+}
+
 template<int SpecializedFnId, typename SpecializedRunWork, bool COLLTRACE, int COLL_UNROLL>
 __forceinline__ __device__ void ncclKernelMain(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead) {
   const int tid = threadIdx.x;
@@ -324,66 +417,94 @@ __forceinline__ __device__ void ncclKernelMain(struct ncclDevComm* comm, struct
   if (tid == 0) __insert_timestamp(__LINE__);
   if (COLLTRACE && tid == 0) traceKernelLaunch(ncclCollTraceKernelLaunchType);
 
-  while (true) {
-    // Notify host that all fifo reads are complete.
-    if (tid == 0 && ncclShmem.work.header.isLast && ncclShmem.work.header.inFifo) {
-      *ncclShmem.channel.workFifoDone = ncclShmem.work.header.doneAcks;
-    }
+  ncclRunWorkChain<SpecializedFnId, SpecializedRunWork, COLLTRACE, COLL_UNROLL>(comm, workHead);
+  if (COLLTRACE && tid == 0) traceKernelEnd(ncclCollTraceKernelEndType);
 
-    __syncwarp();
-    if (ncclShmem.work.header.type == ncclWorkTypeColl) {
-      if (tid < NCCL_MAX_WORK_ELEMENTS) ncclRedopPtrDeref(&ncclShmem.work.elems[tid]);
-    } else if (ncclShmem.work.header.type == ncclWorkTypeRegColl) {
-      if (tid < NCCL_MAX_WORK_ELEMENTS_REG) ncclRedopPtrDeref(&ncclShmem.work.regElems[tid].elem);
-    }
+#ifdef ENABLE_PROFILING
+  if (ncclShmem.comm.devProf->seq < PROFILE_NUM_LAUNCHES) {
     __synclds();
-
-    if (tid == 0) __insert_timestamp(__LINE__);
-
-    if (0 <= SpecializedFnId && ncclShmem.work.header.funcIndex == (unsigned)SpecializedFnId) {
-      SpecializedRunWork().run(&ncclShmem.work);
-    } else {
-#ifdef USE_INDIRECT_FUNCTION_CALL
-      if (COLL_UNROLL == 4)
-        ncclDevFuncTable_4[ncclShmem.work.header.funcIndex]();
-      else
-        ncclDevFuncTable[ncclShmem.work.header.funcIndex]();
-#else
-      if (COLL_UNROLL == 4)
-        NCCL_CALL_FUNCTIONS_4(ncclShmem.work.header.funcIndex);
-      else
-        NCCL_CALL_FUNCTIONS(ncclShmem.work.header.funcIndex);
+    copyToShmem16(tid, ncclShmem.comm.devProf+MAXCHANNELS*ncclShmem.prof.seq+blockIdx.x, &ncclShmem.prof, sizeof(struct ncclProf));
+    if (tid == 0) ncclShmem.comm.devProf[blockIdx.x].seq++;
+  }
 #endif
-    }
+}
 
-    int workIxNext = ncclShmem.work.header.workNext;
-    __synclds();
-    if (ncclShmem.work.header.isLast) break;
+// Persistent kernel: block b serves channel b for the lifetime of the
+// communicator and runs the launches posted by the host, in order.
+template<typename SpecializedRunWork, int COLL_UNROLL>
+__forceinline__ __device__ void ncclPersistentKernelMain(struct ncclDevComm* comm, struct ncclDevPersistentSync* sync,
+    struct ncclDevPersistentLaunch* launches, uint32_t* nDone) {
+  __shared__ struct ncclWork* launchHead;
+  __shared__ int launchIx;
+  const int tid = threadIdx.x;
+  const int channelId = blockIdx.x;
 
-    copyToShmem16(tid, &ncclShmem.work, workHead + workIxNext, sizeof(ncclWork));
+  if (tid == 0) {
+    ncclShmem.channelId = channelId;
+    ncclShmem.aborted = 0;
+  }
+  if (tid >= WARP_SIZE && tid < WARP_SIZE + NCCL_MAX_GROUPS)
+    ncclShmem.groups[tid-WARP_SIZE].barrier = 0;
+  if (tid >= 2*WARP_SIZE && tid < 2*WARP_SIZE + NCCL_MAX_GROUPS*NCCL_MAX_GROUPS)
+    ncclShmem.groups[(tid-2*WARP_SIZE)/NCCL_MAX_GROUPS].barrier_next[(tid-2*WARP_SIZE)%NCCL_MAX_GROUPS] = 0;
+  if (tid < 2*WARP_SIZE) {
+    if (tid < WARP_SIZE) copyToShmem16(tid, &ncclShmem.comm, comm, sizeof(ncclDevComm));
+    else copyToShmem16(tid-WARP_SIZE, &ncclShmem.channel, &((ncclDevCommAndChannels*)comm)->channels[channelId], sizeof(ncclDevChannel));
+  }
+  __synclds(); // publish shmem
 
-    { // Check whether the last operation was aborted and make sure all threads exit
-      int aborted = tid == 0 ? *comm->abortFlag : 0;
-      if (__any(aborted)) { // publish ncclShmem.work
-        traceKernelEnd(ncclCollTraceAbortType);
-        break;
+  uint64_t seq = 0;
+  while (true) {
+    if (tid == 0) {
+      // Wait for the doorbell, then find the first work of this channel
+      uint64_t posted;
+      while ((posted = __atomic_load_n(&sync->doorbell, __ATOMIC_ACQUIRE)) <= seq) {
+        if (*comm->abortFlag || __atomic_load_n(&sync->stop, __ATOMIC_RELAXED)) {
+          ncclShmem.aborted = 1;
+          break;
+        }
+        __builtin_amdgcn_s_sleep(1);
+      }
+      launchIx = -1;
+      if (!ncclShmem.aborted) {
+        // Same blockIdx -> channelId mapping as ncclKernelMain, inverted
+        struct ncclDevPersistentLaunch* l = launches + seq%NCCL_PERSISTENT_LAUNCHES;
+        uint64_t word = l->channelMask.masks[channelId/64];
+        if (word & (1ull<<(channelId%64))) {
+          int y = __popcll(word & ((1ull<<(channelId%64))-1));
+          for (int i = 0; i < channelId/64; i++) y += __popcll(l->channelMask.masks[i]);
+          launchHead = l->workHead;
+          launchIx = y;
+        }
       }
     }
-    if (COLLTRACE && tid == 0) traceKernelLaunch(ncclCollTraceCollLaunchType);
-  }
-  if (COLLTRACE && tid == 0) traceKernelEnd(ncclCollTraceKernelEndType);
+    __synclds();
+    if (ncclShmem.aborted) break;
+    int slot = seq%NCCL_PERSISTENT_LAUNCHES;
+    seq++;
+    if (launchIx < 0) continue;
 
-#ifdef ENABLE_PROFILING
-  if (ncclShmem.comm.devProf->seq < PROFILE_NUM_LAUNCHES) {
+    struct ncclWork* workHead = launchHead;
+    if (tid < WARP_SIZE) copyToShmem16(tid, &ncclShmem.work, workHead + launchIx, sizeof(ncclWork));
     __synclds();
-    copyToShmem16(tid, ncclShmem.comm.devProf+MAXCHANNELS*ncclShmem.prof.seq+blockIdx.x, &ncclShmem.prof, sizeof(struct ncclProf));
-    if (tid == 0) ncclShmem.comm.devProf[blockIdx.x].seq++;
+    ncclRunWorkChain<-1, SpecializedRunWork, false, COLL_UNROLL>(comm, workHead);
+
+    if (tid == 0) {
+      // The last block of the launch tells the launch stream it may go on
+      __threadfence_system();
+      if (atomicAdd(nDone + slot, 1) == launches[slot].nBlocks - 1) {
+        nDone[slot] = 0;
+        __threadfence_system();
+        __atomic_store_n(&sync->complete, seq, __ATOMIC_RELEASE);
+      }
+    }
   }
-#endif
 }
 
 __global__ void ncclDevKernel_Generic(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead);
 __global__ void ncclDevKernel_Generic_4(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead);
+__global__ void ncclDevKernel_Persistent(struct ncclDevComm* comm, struct ncclDevPersistentSync* sync, struct ncclDevPersistentLaunch* launches, uint32_t* nDone);
+__global__ void ncclDevKernel_Persistent_4(struct ncclDevComm* comm, struct ncclDevPersistentSync* sync, struct ncclDevPersistentLaunch* launches, uint32_t* nDone);
 #ifdef ENABLE_COLLTRACE
 __global__ void ncclDevKernelDebug_Generic(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead);
 __global__ void ncclDevKernelDebug_Generic_4(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead);
@@ -18,6 +18,17 @@
 
 #define __syncwarp()
 
+// Unroll multipliers of the 16-byte pack loop of reduceCopy, for copies (one source
+// and one destination) and for the other cases. gfx94x needs more bytes in flight
+// per CU to reach XGMI peak, so it unrolls copies 4x and reductions 2x.
+#if defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
+#define RCCL_COPY_PACK_UNROLL 4
+#define RCCL_REDUCE_PACK_UNROLL 2
+#else
+#define RCCL_COPY_PACK_UNROLL 2
+#define RCCL_REDUCE_PACK_UNROLL 1
+#endif
+
 // Define min for ssize_t
 inline __device__ int min(int a, ssize_t b) { return (a < b) ? a : b; }
 
@@ -223,7 +234,7 @@ __device__ __forceinline__ void reduceCopy(
         (nThreads, thread, redArg, preOpArgs, postOp,
          nSrcs, srcPtrFn, nDsts, dstPtrFn, nBytesBehind, nBytesAhead);
 #else
-      reduceCopyPacks<RedFn, T, Unroll*((MinSrcs == 1 && MinDsts == 1) ? 2 : 1), BigPackSize,
+      reduceCopyPacks<RedFn, T, Unroll*((MinSrcs == 1 && MinDsts == 1) ? RCCL_COPY_PACK_UNROLL : RCCL_REDUCE_PACK_UNROLL), BigPackSize,
         MultimemSrcs, MinSrcs, MaxSrcs, MultimemDsts, MinDsts, MaxDsts, PreOpSrcs>
         (nThreads, /*&*/thread, redArg, preOpArgs, postOp,
          nSrcs, srcPtrFn, nDsts, dstPtrFn, /*&*/nBytesBehind, /*&*/nBytesAhead);
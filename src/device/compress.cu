@@ -0,0 +1,143 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "collectives.h"
+#include "device.h"
+#include "rccl_float8.h"
+#include <cuda_runtime.h>
+
+#if defined(RCCL_FLOAT8)
+namespace {
+  // Largest finite rccl_float8 (e4m3 fnuz)
+  constexpr float fp8Max = 240.0f;
+  constexpr int BlockElts = RCCL_COMPRESS_BLOCK;
+  // Elements per lane, for the smallest wavefront we may run on
+  constexpr int MaxEltPerLane = BlockElts/32;
+
+  // One wavefront per block of BlockElts elements, each lane taking elements
+  // lane, lane+warpSize, ... so that loads and stores stay coalesced.
+  __device__ __forceinline__ float warpMaxAbs(float* v, int n) {
+    float m = 0.0f;
+    for (int k=0; k<n; k++) m = fmaxf(m, fabsf(v[k]));
+    for (int off = warpSize/2; off > 0; off /= 2) m = fmaxf(m, __shfl_xor(m, off));
+    return m;
+  }
+
+  __device__ __forceinline__ void quantizeBlock(float* v, int n, rccl_float8* q, float* scale, int lane) {
+    float amax = warpMaxAbs(v, n);
+    float s = amax > 0.0f ? amax/fp8Max : 1.0f;
+    for (int k=0; k<n; k++) q[lane + k*warpSize] = rccl_float8(v[k]/s);
+    if (lane == 0) *scale = s;
+  }
+
+  template<typename T>
+  __global__ __launch_bounds__(512, 1)
+  void compressQuantize(rccl_float8* q, float* scales, T const* src, size_t nElts) {
+    const int lane = threadIdx.x%warpSize;
+    const int n = BlockElts/warpSize;
+    const size_t nBlocks = nElts/BlockElts;
+    const size_t warp = (blockIdx.x*(size_t)blockDim.x + threadIdx.x)/warpSize;
+    const size_t nWarps = gridDim.x*(size_t)blockDim.x/warpSize;
+    for (size_t b = warp; b < nBlocks; b += nWarps) {
+      float v[MaxEltPerLane];
+      for (int k=0; k<n; k++) v[k] = float(src[b*BlockElts + lane + k*warpSize]);
+      quantizeBlock(v, n, q + b*BlockElts, scales + b, lane);
+    }
+  }
+
+  // Sums the nSrcs slices of nElts elements in FP32 into dst and, when qOut is
+  // set, also quantizes the result for the AllGather.
+  template<typename T>
+  __global__ __launch_bounds__(512, 1)
+  void compressReduce(T* dst, rccl_float8* qOut, float* scalesOut, rccl_float8 const* q, float const* scales, int nSrcs, size_t nElts) {
+    const int lane = threadIdx.x%warpSize;
+    const int n = BlockElts/warpSize;
+    const size_t nBlocks = nElts/BlockElts;
+    const size_t warp = (blockIdx.x*(size_t)blockDim.x + threadIdx.x)/warpSize;
+    const size_t nWarps = gridDim.x*(size_t)blockDim.x/warpSize;
+    for (size_t b = warp; b < nBlocks; b += nWarps) {
+      float acc[MaxEltPerLane];
+      for (int k=0; k<n; k++) acc[k] = 0.0f;
+      for (int s=0; s<nSrcs; s++) {
+        float scale = scales[s*nBlocks + b];
+        rccl_float8 const* in = q + s*nElts + b*BlockElts;
+        for (int k=0; k<n; k++) acc[k] += float(in[lane + k*warpSize])*scale;
+      }
+      for (int k=0; k<n; k++) dst[b*BlockElts + lane + k*warpSize] = T(acc[k]);
+      if (qOut) quantizeBlock(acc, n, qOut + b*BlockElts, scalesOut + b, lane);
+    }
+  }
+
+  template<typename T>
+  __global__ __launch_bounds__(512, 1)
+  void compressDequantize(T* dst, rccl_float8 const* q, float const* scales, size_t nElts) {
+    const int lane = threadIdx.x%warpSize;
+    const int n = BlockElts/warpSize;
+    const size_t nBlocks = nElts/BlockElts;
+    const size_t warp = (blockIdx.x*(size_t)blockDim.x + threadIdx.x)/warpSize;
+    const size_t nWarps = gridDim.x*(size_t)blockDim.x/warpSize;
+    for (size_t b = warp; b < nBlocks; b += nWarps) {
+      float scale = scales[b];
+      for (int k=0; k<n; k++) {
+        size_t i = b*BlockElts + lane + k*warpSize;
+        dst[i] = T(float(q[i])*scale);
+      }
+    }
+  }
+
+  ncclResult_t compressLaunch(void const* kernel, size_t nElts, void** args, cudaStream_t stream) {
+    if (nElts == 0) return ncclSuccess;
+    dim3 grid = {0, 1, 1};
+    grid.x = std::min(1024, (int)divUp(nElts, 8*BlockElts));
+    dim3 block = {512, 1, 1};
+    CUDACHECK(cudaLaunchKernel(kernel, grid, block, args, 0, stream));
+    return ncclSuccess;
+  }
+}
+
+ncclResult_t rcclCompressQuantize(void* q, float* scales, void const* src, size_t nElts, ncclDataType_t type, cudaStream_t stream) {
+  void const* kernel;
+  switch (type) {
+  case ncclFloat16:  kernel = (void const*)&compressQuantize<half>; break;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: kernel = (void const*)&compressQuantize<hip_bfloat16>; break;
+#endif
+  case ncclFloat32:  kernel = (void const*)&compressQuantize<float>; break;
+  default: return ncclInvalidArgument;
+  }
+  void* args[4] = {&q, &scales, &src, &nElts};
+  return compressLaunch(kernel, nElts, args, stream);
+}
+
+ncclResult_t rcclCompressReduce(void* dst, void* qOut, float* scalesOut, void const* q, float const* scales, int nSrcs, size_t nElts, ncclDataType_t type, cudaStream_t stream) {
+  void const* kernel;
+  switch (type) {
+  case ncclFloat16:  kernel = (void const*)&compressReduce<half>; break;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: kernel = (void const*)&compressReduce<hip_bfloat16>; break;
+#endif
+  case ncclFloat32:  kernel = (void const*)&compressReduce<float>; break;
+  default: return ncclInvalidArgument;
+  }
+  void* args[7] = {&dst, &qOut, &scalesOut, &q, &scales, &nSrcs, &nElts};
+  return compressLaunch(kernel, nElts, args, stream);
+}
+
+ncclResult_t rcclCompressDequantize(void* dst, void const* q, float const* scales, size_t nElts, ncclDataType_t type, cudaStream_t stream) {
+  void const* kernel;
+  switch (type) {
+  case ncclFloat16:  kernel = (void const*)&compressDequantize<half>; break;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: kernel = (void const*)&compressDequantize<hip_bfloat16>; break;
+#endif
+  case ncclFloat32:  kernel = (void const*)&compressDequantize<float>; break;
+  default: return ncclInvalidArgument;
+  }
+  void* args[4] = {&dst, &q, &scales, &nElts};
+  return compressLaunch(kernel, nElts, args, stream);
+}
+#endif
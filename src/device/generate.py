@@ -4,7 +4,7 @@ import sys
 
 # Order of redops, tys, protos, algos must match src/include/device.h
 all_colls =  ["Broadcast","Reduce","AllGather","ReduceScatter","AllReduce","SendRecv"]
-all_redops = ["Sum","Prod","MinMax","PreMulSum","SumPostDiv"]
+all_redops = ["Sum","Prod","MinMax","PreMulSum","SumPostScale","SumPostDiv"]
 all_tys =    ["i8","u8","i32","u32","i64","u64","f16","f32","f64","bf16"]
 all_protos = ["LL","LL128","SIMPLE"]
 all_algos =  ["TREE","RING","COLLNET_DIRECT","COLLNET_CHAIN","NVLS","NVLS_TREE"]
@@ -346,6 +346,7 @@ redop_to_cxx = {
   "Prod": "FuncProd",
   "MinMax": "FuncMinMax",
   "PreMulSum": "FuncPreMulSum",
+  "SumPostScale": "FuncSumPostScale",
   "SumPostDiv": "FuncSumPostDiv"
 }
 
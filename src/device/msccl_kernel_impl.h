@@ -78,16 +78,77 @@ __device__ __forceinline__ static void threadBlockCopy(
   }
 }
 
+// Load the part of a thread block descriptor that is used. Small schedules
+// only touch a few steps, so this saves most of the 5 KB copy at each launch.
+__device__ __forceinline__ static void mscclLoadThreadBlock(
+  struct mscclThreadBlock* dst, const struct mscclThreadBlock* src, int tid, int nthreads) {
+  const int nSteps = src->nSteps;
+  const int nDependencies = src->nDependencies;
+  const int nReductionSrcs = src->nReductionSrcs;
+  threadBlockCopy((uint32_t *)dst->transmissions, (uint32_t const *)src->transmissions,
+    nSteps * sizeof(struct mscclTransmission) / sizeof(uint32_t), tid, nthreads);
+  threadBlockCopy((uint32_t *)dst->dependentBid, (uint32_t const *)src->dependentBid,
+    DIVUP(nDependencies * sizeof(int8_t), sizeof(uint32_t)), tid, nthreads);
+  threadBlockCopy((uint32_t *)dst->dependentStep, (uint32_t const *)src->dependentStep,
+    DIVUP(nDependencies * sizeof(int16_t), sizeof(uint32_t)), tid, nthreads);
+  threadBlockCopy((uint32_t *)dst->reductionSrcOffsets, (uint32_t const *)src->reductionSrcOffsets,
+    DIVUP(nReductionSrcs * sizeof(int16_t), sizeof(uint32_t)), tid, nthreads);
+  threadBlockCopy((uint32_t *)&dst->sendPeer, (uint32_t const *)&src->sendPeer,
+    (sizeof(struct mscclThreadBlock) - offsetof(struct mscclThreadBlock, sendPeer)) / sizeof(uint32_t), tid, nthreads);
+}
+
+// Schedule of the thread block, as read by the interpreter. The library kernels
+// load the descriptor into LDS. The modules of msccl_jit.cc define one schedule
+// per thread block instead, with isConst set and every member a compile-time
+// constant, so that each step is inlined with its transmission known.
+struct mscclSchedShmem {
+  static constexpr bool isConst = false;
+  __device__ static void load(struct mscclAlgo* algo, int bid, int tid, int nthreads) {
+    mscclLoadThreadBlock(&mscclShmem.mscclTB, algo->mscclTBs + bid, tid, nthreads);
+  }
+  __device__ static int nSteps() { return mscclShmem.mscclTB.nSteps; }
+  __device__ static const struct mscclTransmission& transmission(int i) { return mscclShmem.mscclTB.transmissions[i]; }
+  __device__ static int dependentBid(int i) { return mscclShmem.mscclTB.dependentBid[i]; }
+  __device__ static int dependentStep(int i) { return mscclShmem.mscclTB.dependentStep[i]; }
+  __device__ static int reductionSrcOffset(int i) { return mscclShmem.mscclTB.reductionSrcOffsets[i]; }
+  __device__ static int sendPeer() { return mscclShmem.mscclTB.sendPeer; }
+  __device__ static int recvPeer() { return mscclShmem.mscclTB.recvPeer; }
+  __device__ static int channelId() { return mscclShmem.mscclTB.channelId; }
+};
+
+template<int I>
+struct mscclStepIndex {
+  __device__ constexpr operator int() const { return I; }
+};
+
+// Runs fn on the steps in order, until it returns false. The steps of a constant
+// schedule are unrolled into straight-line code.
+template<typename Sched, int I = 0, typename Fn>
+__device__ __forceinline__ static bool mscclForEachStep(Fn& fn) {
+  if constexpr (Sched::isConst) {
+    if constexpr (I < Sched::nSteps()) {
+      if (!fn(mscclStepIndex<I>())) return false;
+      return mscclForEachStep<Sched, I+1>(fn);
+    }
+    return true;
+  } else {
+    for (int i = 0; i < Sched::nSteps(); i++) {
+      if (!fn(i)) return false;
+    }
+    return true;
+  }
+}
+
 #define MSCCL_REDUCE_UNROLL_LOOP_A(numloops, BytePerPack) \
   for (int r = 0; r < numloops; r++) { \
-    srcOffset = srcBaseOffset + (ssize_t)mscclShmem.mscclTB.reductionSrcOffsets[t->reductionPointer+r] * sizePerMscclChunk; \
+    srcOffset = srcBaseOffset + (ssize_t)Sched::reductionSrcOffset(t.reductionPointer+r) * sizePerMscclChunk; \
     reduceInput = ld_volatile_global<BytePerPack>((uintptr_t)(srcPointer + srcOffset)); \
     o = applyReduce(redFn, reduceInput, o); \
   }
 
-template<typename T, typename RedOp, int BytePerPack>
+template<typename T, typename RedOp, typename Sched, int BytePerPack>
 __device__ __forceinline__ static void mscclReduce(int c, int numReductions, int currIdx, ssize_t sizePerMscclChunk, RedOp redFn,
-  struct mscclTransmission* t, ssize_t gridOffset, ssize_t &srcOffset, ssize_t dstOffset, T *srcPointer, T *dstPointer) {
+  const struct mscclTransmission& t, ssize_t gridOffset, ssize_t &srcOffset, ssize_t dstOffset, T *srcPointer, T *dstPointer) {
   const int elemsPerPack = BytePerPack/sizeof(T);
   T* dstIndex = dstPointer + dstOffset + currIdx*elemsPerPack;
   BytePack<BytePerPack> reduceInput;
@@ -112,7 +173,7 @@ __device__ __forceinline__ static void mscclReduce(int c, int numReductions, int
 }
 
 
-template<typename T, typename RedOp, typename Proto, bool fullOps>
+template<typename T, typename RedOp, typename Proto, bool fullOps, typename Sched = mscclSchedShmem>
 __device__ __forceinline__ void mscclRunInterpreter(
   struct ncclDevComm* comm, struct mscclAlgo* algo, struct mscclWork* work) {
   const int tid = threadIdx.x;
@@ -126,13 +187,11 @@ __device__ __forceinline__ void mscclRunInterpreter(
   }
 #endif
   // initialize mscclShmem.mscclTB
-  threadBlockCopy(
-    (uint32_t *)&mscclShmem.mscclTB, (uint32_t *)(algo->mscclTBs + bid),
-    sizeof(struct mscclThreadBlock) / sizeof(uint32_t), tid, nthreads);
+  Sched::load(algo, bid, tid, nthreads);
   __synclds(); // publish mscclShmem.mscclTB.channelId
 
   // initialize ncclShmem and mscclShmem.work
-  int channelId = mscclShmem.mscclTB.channelId;
+  int channelId = Sched::channelId();
   {
     void *dst, *src;
     int bytes = 0;
@@ -203,8 +262,8 @@ __device__ __forceinline__ void mscclRunInterpreter(
   T* thisInput = (T*)mscclShmem.work.sendBuff;
   T* thisOutput = (T*)mscclShmem.work.recvBuff;
   T* thisScratch = (T*)mscclShmem.work.scratchBuffer;
-  int recvPeer = mscclShmem.mscclTB.recvPeer;
-  int sendPeer = mscclShmem.mscclTB.sendPeer;
+  int recvPeer = Sched::recvPeer();
+  int sendPeer = Sched::sendPeer();
 
   const ssize_t chunkSize = int(Proto::calcBytePerStep()/sizeof(T) * (Proto::Id == NCCL_PROTO_SIMPLE ? MSCCL_CHUNKSTEPS : 1));
   int minChunkSize;
@@ -264,18 +323,18 @@ __device__ __forceinline__ void mscclRunInterpreter(
     ssize_t srcOffset, dstOffset;
     T *srcPointer, *dstPointer;
     int step = 0;
-    for (int i = 0; i < mscclShmem.mscclTB.nSteps; i++){
-      struct mscclTransmission* t = &mscclShmem.mscclTB.transmissions[i];
+    auto runStep = [&](auto i) -> bool {
+      auto const& t = Sched::transmission(i);
       // first wait if there is a dependence
-      int16_t numDependencies = t->numDependencies;
+      int16_t numDependencies = t.numDependencies;
       if (numDependencies > 0){
         if (tid < numDependencies) {
-          int16_t dependentPointer = t->dependencePointer;
-          int8_t dependentBid = mscclShmem.mscclTB.dependentBid[dependentPointer+tid];
-          int16_t dependentStep = mscclShmem.mscclTB.dependentStep[dependentPointer+tid];
+          int16_t dependentPointer = t.dependencePointer;
+          int8_t dependentBid = Sched::dependentBid(dependentPointer+tid);
+          int16_t dependentStep = Sched::dependentStep(dependentPointer+tid);
           uint64_t goalFlag = COMPUTE_FLAG(workIndex, iter, dependentStep);
           while (true){
-            uint64_t curFlag = __atomic_load_n(&(mscclFlags + dependentBid)->flag, (t->srcBuffer != MSCCL_OUTPUT_BUFFER) ? __ATOMIC_RELAXED : __ATOMIC_ACQUIRE);
+            uint64_t curFlag = __atomic_load_n(&(mscclFlags + dependentBid)->flag, (t.srcBuffer != MSCCL_OUTPUT_BUFFER) ? __ATOMIC_RELAXED : __ATOMIC_ACQUIRE);
             if (curFlag >= goalFlag && GET_WORKINDEX_FROM_FLAG(curFlag) == workIndex) break;
           }
         }
@@ -283,17 +342,17 @@ __device__ __forceinline__ void mscclRunInterpreter(
         barrier(nthreads);
       }
 
-      srcPointer = (t->srcBuffer == MSCCL_INPUT_BUFFER) ? thisInput : ((t->srcBuffer == MSCCL_OUTPUT_BUFFER) ? thisOutput : thisScratch);
-      dstPointer = (t->dstBuffer == MSCCL_INPUT_BUFFER) ? thisInput : ((t->dstBuffer == MSCCL_OUTPUT_BUFFER) ? thisOutput : thisScratch);
+      srcPointer = (t.srcBuffer == MSCCL_INPUT_BUFFER) ? thisInput : ((t.srcBuffer == MSCCL_OUTPUT_BUFFER) ? thisOutput : thisScratch);
+      dstPointer = (t.dstBuffer == MSCCL_INPUT_BUFFER) ? thisInput : ((t.dstBuffer == MSCCL_OUTPUT_BUFFER) ? thisOutput : thisScratch);
       prims.setDataPtrs(srcPointer, dstPointer);
 
-      int count = t->count;
+      int count = t.count;
       for (int c = 0; c < count; c += maxAllowedCount) {
-        srcOffset = gridOffset + (ssize_t) (t->srcOffset+c) * sizePerMscclChunk;
-        dstOffset = gridOffset + (ssize_t) (t->dstOffset+c) * sizePerMscclChunk;
+        srcOffset = gridOffset + (ssize_t) (t.srcOffset+c) * sizePerMscclChunk;
+        dstOffset = gridOffset + (ssize_t) (t.dstOffset+c) * sizePerMscclChunk;
         int thisCount = min(maxAllowedCount, count - c);
         int thisNelem = nelem * thisCount;
-        if (t->type == MSCCL_SEND) {
+        if (t.type == MSCCL_SEND) {
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_SEND_ENTRY)
             if (tid == 0) {
               NpKit::CollectGpuEventLDS(NPKIT_EVENT_MSCCL_SEND_ENTRY, thisNelem*sizeof(T), 0, NPKIT_GET_GPU_TIMESTAMP());
@@ -308,7 +367,7 @@ __device__ __forceinline__ void mscclRunInterpreter(
             }
 #endif
         }
-        else if (t->type == MSCCL_RECV) {
+        else if (t.type == MSCCL_RECV) {
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_RECV_ENTRY)
             if (tid == 0) {
               NpKit::CollectGpuEventLDS(NPKIT_EVENT_MSCCL_RECV_ENTRY, thisNelem*sizeof(T), 0, NPKIT_GET_GPU_TIMESTAMP());
@@ -322,25 +381,25 @@ __device__ __forceinline__ void mscclRunInterpreter(
             }
 #endif
         }
-        else if (t->type == MSCCL_REDUCE) {
-          int numReductions = t->numReductions;
+        else if (t.type == MSCCL_REDUCE) {
+          int numReductions = t.numReductions;
           int currIdx = tid;
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_REDUCE_ENTRY)
           if (tid == 0) {
             NpKit::CollectGpuEventLDS(NPKIT_EVENT_MSCCL_REDUCE_ENTRY, thisNelem*sizeof(T), 0, NPKIT_GET_GPU_TIMESTAMP());
           }
 #endif
-          dstOffset = gridOffset + (ssize_t) (t->dstOffset+c) * sizePerMscclChunk;
+          dstOffset = gridOffset + (ssize_t) (t.dstOffset+c) * sizePerMscclChunk;
           // process 16-byte packed elements
           const int elemsPerPack = 16/sizeof(T);
           while (currIdx < thisNelem/elemsPerPack) {
-            mscclReduce<T, RedOp, 16>(c, numReductions, currIdx, sizePerMscclChunk, redFn, t, gridOffset, srcOffset, dstOffset, srcPointer, dstPointer);
+            mscclReduce<T, RedOp, Sched, 16>(c, numReductions, currIdx, sizePerMscclChunk, redFn, t, gridOffset, srcOffset, dstOffset, srcPointer, dstPointer);
             currIdx += nthreads;
           }
           // process remaining elements
           currIdx = tid + (thisNelem/elemsPerPack)*elemsPerPack;
           if (currIdx < thisNelem) {
-            mscclReduce<T, RedOp, sizeof(T)>(c, numReductions, currIdx, sizePerMscclChunk, redFn, t, gridOffset, srcOffset, dstOffset, srcPointer, dstPointer);
+            mscclReduce<T, RedOp, Sched, sizeof(T)>(c, numReductions, currIdx, sizePerMscclChunk, redFn, t, gridOffset, srcOffset, dstOffset, srcPointer, dstPointer);
           }
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_REDUCE_EXIT)
           if (tid == 0) {
@@ -350,13 +409,13 @@ __device__ __forceinline__ void mscclRunInterpreter(
           barrier(nthreads);
           if (c == 0) step += (numReductions-1); // only advance step once!
         }
-        else if (fullOps && t->type == MSCCL_RECV_COPY_SEND)
+        else if (fullOps && t.type == MSCCL_RECV_COPY_SEND)
           prims.recvCopySend(dstOffset, thisNelem);
-        else if (fullOps && t->type == MSCCL_RECV_REDUCE_SEND)
+        else if (fullOps && t.type == MSCCL_RECV_REDUCE_SEND)
           prims.recvReduceSend(srcOffset, thisNelem);
-        else if (fullOps && t->type == MSCCL_RECV_REDUCE_COPY_SEND)
+        else if (fullOps && t.type == MSCCL_RECV_REDUCE_COPY_SEND)
           prims.recvReduceCopySend(srcOffset, dstOffset, thisNelem);
-        else if (fullOps && t->type == MSCCL_RECV_REDUCE_COPY) {
+        else if (fullOps && t.type == MSCCL_RECV_REDUCE_COPY) {
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_RECV_REDUCE_COPY_ENTRY)
           if (tid == 0) {
             NpKit::CollectGpuEventLDS(NPKIT_EVENT_MSCCL_RECV_REDUCE_COPY_ENTRY, thisNelem*sizeof(T), 0, NPKIT_GET_GPU_TIMESTAMP());
@@ -369,15 +428,17 @@ __device__ __forceinline__ void mscclRunInterpreter(
           }
 #endif
         }
-        else if (t->type == MSCCL_LOCAL_COPY)
+        else if (t.type == MSCCL_LOCAL_COPY)
           prims.localCopy(srcPointer+srcOffset, dstPointer+dstOffset, thisNelem);
         else
-          return;
+          return false;
       }
-      if (t->hasDependence && tid == nthreads-1)
-        __atomic_store_n(&mscclFlags[bid].flag, (uint64_t) COMPUTE_FLAG(workIndex, iter, step), (t->dstBuffer != MSCCL_SCRATCH_BUFFER) ? __ATOMIC_RELEASE : __ATOMIC_RELAXED);
+      if (t.hasDependence && tid == nthreads-1)
+        __atomic_store_n(&mscclFlags[bid].flag, (uint64_t) COMPUTE_FLAG(workIndex, iter, step), (t.dstBuffer != MSCCL_SCRATCH_BUFFER) ? __ATOMIC_RELEASE : __ATOMIC_RELAXED);
       step++;
-    }
+      return true;
+    };
+    if (!mscclForEachStep<Sched>(runStep)) return;
   }
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_MSCCL_RUN_EXIT)
   if (tid == 0) {
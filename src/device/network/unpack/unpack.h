@@ -17,12 +17,25 @@
 // #define ALIGNED_LOAD
 
 inline __device__ void load64gpu(const uint64_t* ptr, uint64_t &v) {
-  #if __CUDA_ARCH__ >= 700
+  #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
+      // The count is written by the NIC/proxy, it must not be cached across iterations
+      v = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+  #elif __CUDA_ARCH__ >= 700
       asm volatile("ld.relaxed.gpu.u64 {%0}, [%1];"
       : "=l"(v) : "l"(ptr));
   #else
-      // asm volatile("ld.volatile.global.u64 {%0}, [%1];"
-      // : "=l"(v) : "l"(ptr));
+      v = *(volatile const uint64_t*)ptr;
+  #endif
+}
+
+// __syncwarp() is a no-op with HIP. The lanes of a wavefront exchange page metadata
+// through shared memory, so keep the compiler from moving the LDS accesses across.
+inline __device__ void unpackWarpSync() {
+  #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
+      __builtin_amdgcn_fence(__ATOMIC_SEQ_CST, "wavefront");
+      __builtin_amdgcn_wave_barrier();
+  #else
+      __syncwarp();
   #endif
 }
 
@@ -211,7 +224,7 @@ inline __device__ void ncclNetDeviceUnpackInner(
   g_meta_struct = ncclShmem.groups[group].devicePlugin.unpack.g_meta[index];
   bounce_buf    = ncclShmem.devicePlugin.unpack.bounce_buf;
 
-  __syncwarp();
+  unpackWarpSync();
 
   head %= NCCL_NET_DEVICE_UNPACK_MAX_QUEUE_DEPTH;
 
@@ -238,7 +251,7 @@ inline __device__ void ncclNetDeviceUnpackInner(
       storeShmem128(shmemCvtPtr((uint64_t *)(s_meta + (w * PPW + t))), reg.u64[0], reg.u64[1]);
     }
 
-    __syncwarp();
+    unpackWarpSync();
 
     for (int x = 0; x < iter_meta_cnt; x++) {
       int meta_idx = x + w * PPW;
@@ -273,7 +286,7 @@ inline __device__ void ncclNetDeviceUnpackInner(
       }
     }
 
-    __syncwarp();
+    unpackWarpSync();
   }
 }
 
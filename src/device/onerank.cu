@@ -52,35 +52,40 @@ namespace {
   }
 }
 
+template<template<typename> class RedOp>
+static void const* oneRankKernel(ncclDataType_t eltType) {
+  switch (eltType) {
+  case ncclInt8:     return (void const*)&oneRankReduce<RedOp<int8_t>>;
+  case ncclUint8:    return (void const*)&oneRankReduce<RedOp<uint8_t>>;
+  case ncclInt32:    return (void const*)&oneRankReduce<RedOp<int32_t>>;
+  case ncclUint32:   return (void const*)&oneRankReduce<RedOp<uint32_t>>;
+  case ncclInt64:    return (void const*)&oneRankReduce<RedOp<int64_t>>;
+  case ncclUint64:   return (void const*)&oneRankReduce<RedOp<uint64_t>>;
+  case ncclFloat16:  return (void const*)&oneRankReduce<RedOp<half>>;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: return (void const*)&oneRankReduce<RedOp<hip_bfloat16>>;
+#endif
+#if defined(RCCL_FLOAT8)
+  case ncclFp8E4M3: return (void const*)&oneRankReduce<RedOp<rccl_float8>>;
+  case ncclFp8E5M2: return (void const*)&oneRankReduce<RedOp<rccl_bfloat8>>;
+#endif
+  case ncclFloat32:  return (void const*)&oneRankReduce<RedOp<float>>;
+  case ncclFloat64:  return (void const*)&oneRankReduce<RedOp<double>>;
+  default: return nullptr;
+  }
+}
+
 ncclResult_t ncclLaunchOneRank(void* dst, void const* src, size_t nElts, struct ncclDevRedOpFull redOp, ncclDataType_t eltType, cudaStream_t stream) {
   size_t eltSize = ncclTypeSize(eltType);
-  if (redOp.op != ncclDevPreMulSum) {
+  if (redOp.op != ncclDevPreMulSum && redOp.op != ncclDevSumPostScale) {
     if (dst != src) {
       NCCLCHECK(ncclCudaMemcpyAsync((char*)dst, (char*)src, nElts*eltSize, stream));
     }
     return ncclSuccess;
   }
 
-  void const* kernel;
-  switch (eltType) {
-  case ncclInt8:     kernel = (void const*)&oneRankReduce<FuncPreMulSum<int8_t>>; break;
-  case ncclUint8:    kernel = (void const*)&oneRankReduce<FuncPreMulSum<uint8_t>>; break;
-  case ncclInt32:    kernel = (void const*)&oneRankReduce<FuncPreMulSum<int32_t>>; break;
-  case ncclUint32:   kernel = (void const*)&oneRankReduce<FuncPreMulSum<uint32_t>>; break;
-  case ncclInt64:    kernel = (void const*)&oneRankReduce<FuncPreMulSum<int64_t>>; break;
-  case ncclUint64:   kernel = (void const*)&oneRankReduce<FuncPreMulSum<uint64_t>>; break;
-  case ncclFloat16:  kernel = (void const*)&oneRankReduce<FuncPreMulSum<half>>; break;
-#if defined(RCCL_BFLOAT16)
-  case ncclBfloat16: kernel = (void const*)&oneRankReduce<FuncPreMulSum<hip_bfloat16>>; break;
-#endif
-#if defined(RCCL_FLOAT8)
-  case ncclFp8E4M3: kernel = (void const*)&oneRankReduce<FuncPreMulSum<rccl_float8>>; break;
-  case ncclFp8E5M2: kernel = (void const*)&oneRankReduce<FuncPreMulSum<rccl_bfloat8>>; break;
-#endif
-  case ncclFloat32:  kernel = (void const*)&oneRankReduce<FuncPreMulSum<float>>; break;
-  case ncclFloat64:  kernel = (void const*)&oneRankReduce<FuncPreMulSum<double>>; break;
-  default: return ncclInvalidArgument;
-  }
+  void const* kernel = redOp.op == ncclDevSumPostScale ? oneRankKernel<FuncSumPostScale>(eltType) : oneRankKernel<FuncPreMulSum>(eltType);
+  if (kernel == nullptr) return ncclInvalidArgument;
   dim3 grid = {0, 1, 1};
   grid.x = std::min(32, (int)divUp(nElts*eltSize, 16<<10));
   dim3 block = {512, 1, 1};
@@ -9,6 +9,23 @@
 
 #include <type_traits>
 
+#if defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
+// On gfx94x, 16-byte accesses are done as one 128-bit vector so that they always
+// become a single non-temporal global_load/store_dwordx4 instead of depending
+// on the backend to merge two 64-bit accesses.
+typedef uint64_t ncclU64x2 __attribute__((ext_vector_type(2)));
+
+inline __device__ void load128(const uint64_t* ptr, uint64_t &v0, uint64_t &v1) {
+  ncclU64x2 v = __builtin_nontemporal_load((const ncclU64x2*)ptr);
+  v0 = v.x;
+  v1 = v.y;
+}
+
+inline __device__ void store128(uint64_t* ptr, uint64_t v0, uint64_t v1) {
+  ncclU64x2 v = {v0, v1};
+  __builtin_nontemporal_store(v, (ncclU64x2*)ptr);
+}
+#else
 inline __device__ void load128(const uint64_t* ptr, uint64_t &v0, uint64_t &v1) {
   v0 = __builtin_nontemporal_load(ptr);
   v1 = __builtin_nontemporal_load(ptr+1);
@@ -18,6 +35,7 @@ inline __device__ void store128(uint64_t* ptr, uint64_t v0, uint64_t v1) {
   __builtin_nontemporal_store(v0, ptr);
   __builtin_nontemporal_store(v1, ptr+1);
 }
+#endif
 
 inline __device__ uint64_t* shmemCvtPtr(volatile uint64_t* shmemGenericPtr) {
   return (uint64_t*)shmemGenericPtr;
@@ -250,14 +268,12 @@ DEFINE_ld_st__size(8, uint64_t, b64, l)
   template<> \
   __device__ __forceinline__ BytePack<16> ld_volatile_##space<16>(addr_cxx_ty addr) { \
     BytePack<16> ans; \
-    ans.u64[0] = __builtin_nontemporal_load((uint64_t*)addr); \
-    ans.u64[1] = __builtin_nontemporal_load((uint64_t*)addr+1); \
+    load128((uint64_t*)addr, ans.u64[0], ans.u64[1]); \
     return ans; \
   } \
   template<> \
   __device__ __forceinline__ void st_##space<16>(addr_cxx_ty addr, BytePack<16> value) { \
-    __builtin_nontemporal_store(value.u64[0], (uint64_t*)addr); \
-    __builtin_nontemporal_store(value.u64[1], (uint64_t*)addr+1); \
+    store128((uint64_t*)addr, value.u64[0], value.u64[1]); \
   }
 
 DEFINE_ld_st_16__space(global, uintptr_t, l)
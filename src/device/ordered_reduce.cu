@@ -0,0 +1,108 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "collectives.h"
+#include "common_kernel.h"
+#include "device.h"
+#include <cuda_runtime.h>
+
+namespace {
+  // Each thread reduces one pack of every source, always in source order, so the
+  // result doesn't depend on the launch shape.
+  template<typename RedOp, int PackBytes>
+  __global__ __launch_bounds__(512, 1)
+  void orderedReduce(void* dst, void const* src, int nSrcs, size_t nElts, uint64_t redOpArg, bool redOpArgIsPtr) {
+    using T = typename RedOp::EltType;
+    using Pack = BytePack<PackBytes>;
+    if (redOpArgIsPtr) {
+      if (redOpArg%2 != 0) {
+        redOpArg = *reinterpret_cast<uint8_t*>(redOpArg);
+      } else if (redOpArg%4 != 0) {
+        redOpArg = *reinterpret_cast<uint16_t*>(redOpArg);
+      } else if (redOpArg%8 != 0) {
+        redOpArg = *reinterpret_cast<uint32_t*>(redOpArg);
+      } else {
+        redOpArg = *reinterpret_cast<uint64_t*>(redOpArg);
+      }
+    }
+    RedOp fn(redOpArg);
+    size_t nPacks = nElts*sizeof(T)/PackBytes;
+    Pack const* in = (Pack const*)src;
+    for (size_t p = blockIdx.x*(size_t)blockDim.x + threadIdx.x; p < nPacks; p += gridDim.x*(size_t)blockDim.x) {
+      Pack acc = applyPreOp(fn, in[p]);
+      for (int s=1; s<nSrcs; s++) acc = applyReduce(fn, acc, applyPreOp(fn, in[s*nPacks + p]));
+      ((Pack*)dst)[p] = applyPostOp(fn, acc);
+    }
+  }
+
+  template<typename RedOp>
+  void const* orderedKernel(bool packed) {
+    using T = typename RedOp::EltType;
+    return packed ? (void const*)&orderedReduce<RedOp, 16> : (void const*)&orderedReduce<RedOp, sizeof(T)>;
+  }
+
+  template<template<typename> class RedOp>
+  void const* orderedKernel(ncclDataType_t type, bool packed) {
+    switch (type) {
+    case ncclInt8:     return orderedKernel<RedOp<int8_t>>(packed);
+    case ncclUint8:    return orderedKernel<RedOp<uint8_t>>(packed);
+    case ncclInt32:    return orderedKernel<RedOp<int32_t>>(packed);
+    case ncclUint32:   return orderedKernel<RedOp<uint32_t>>(packed);
+    case ncclInt64:    return orderedKernel<RedOp<int64_t>>(packed);
+    case ncclUint64:   return orderedKernel<RedOp<uint64_t>>(packed);
+    case ncclFloat16:  return orderedKernel<RedOp<half>>(packed);
+#if defined(RCCL_BFLOAT16)
+    case ncclBfloat16: return orderedKernel<RedOp<hip_bfloat16>>(packed);
+#endif
+#if defined(RCCL_FLOAT8)
+    case ncclFp8E4M3:  return orderedKernel<RedOp<rccl_float8>>(packed);
+    case ncclFp8E5M2:  return orderedKernel<RedOp<rccl_bfloat8>>(packed);
+#endif
+    case ncclFloat32:  return orderedKernel<RedOp<float>>(packed);
+    case ncclFloat64:  return orderedKernel<RedOp<double>>(packed);
+    default: return nullptr;
+    }
+  }
+
+  // Average of integers only
+  void const* orderedSumPostDivKernel(ncclDataType_t type, bool packed) {
+    switch (type) {
+    case ncclInt8:     return orderedKernel<FuncSumPostDiv<int8_t>>(packed);
+    case ncclUint8:    return orderedKernel<FuncSumPostDiv<uint8_t>>(packed);
+    case ncclInt32:    return orderedKernel<FuncSumPostDiv<int32_t>>(packed);
+    case ncclUint32:   return orderedKernel<FuncSumPostDiv<uint32_t>>(packed);
+    case ncclInt64:    return orderedKernel<FuncSumPostDiv<int64_t>>(packed);
+    case ncclUint64:   return orderedKernel<FuncSumPostDiv<uint64_t>>(packed);
+    default: return nullptr;
+    }
+  }
+}
+
+ncclResult_t ncclLaunchOrderedReduce(void* dst, void const* src, int nSrcs, size_t nElts, struct ncclDevRedOpFull redOp, ncclDataType_t type, cudaStream_t stream) {
+  size_t eltSize = ncclTypeSize(type);
+  // Sources are slices of the staging buffer, so 16-byte packs only depend on dst and nElts
+  bool packed = (nElts*eltSize)%16 == 0 && (uintptr_t)dst%16 == 0 && (uintptr_t)src%16 == 0;
+  void const* kernel;
+  switch (redOp.op) {
+  case ncclDevSum:          kernel = orderedKernel<FuncSum>(type, packed); break;
+  case ncclDevProd:         kernel = orderedKernel<FuncProd>(type, packed); break;
+  case ncclDevMinMax:       kernel = orderedKernel<FuncMinMax>(type, packed); break;
+  case ncclDevPreMulSum:    kernel = orderedKernel<FuncPreMulSum>(type, packed); break;
+  case ncclDevSumPostScale: kernel = orderedKernel<FuncSumPostScale>(type, packed); break;
+  case ncclDevSumPostDiv:   kernel = orderedSumPostDivKernel(type, packed); break;
+  default: return ncclInvalidArgument;
+  }
+  if (kernel == nullptr) return ncclInvalidArgument;
+  if (nElts == 0) return ncclSuccess;
+  size_t nPacks = nElts*eltSize/(packed ? 16 : eltSize);
+  dim3 grid = {0, 1, 1};
+  grid.x = std::min(256, (int)divUp(nPacks, 512));
+  dim3 block = {512, 1, 1};
+  void* args[6] = {&dst, &src, &nSrcs, &nElts, &redOp.scalarArg, &redOp.scalarArgIsPtr};
+  CUDACHECK(cudaLaunchKernel(kernel, grid, block, args, 0, stream));
+  return ncclSuccess;
+}
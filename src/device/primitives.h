@@ -15,38 +15,39 @@
 
 #define NCCL_SPINS_BEFORE_CHECK_ABORT 1000000
 
+// Synchronizes the nthreads threads of a primitives group. A group spanning the
+// whole block uses s_barrier; smaller groups must not hold up the other groups of
+// the block, so the first lane of each wave arrives on the LDS counter of the
+// group and then spins on it with plain LDS loads, leaving the counter free for
+// the arrivals.
+//
+// Outside gfx94x every thread still fences at device scope before it arrives.
+// The thread posting the next step to a peer may fence only at agent scope
+// (postPeer on gfx9), so the other threads' writes to peer and fine-grained
+// memory must not rely on its fence alone. gfx94x has never fenced here.
 #if defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
-#define barrier_by_group() do { \
-  if (nthreads == NCCL_MAX_NTHREADS) { \
-    __builtin_amdgcn_s_barrier(); \
-  } else { \
-    const int w = threadIdx.x/WARP_SIZE; \
-    const int wid = threadIdx.x%WARP_SIZE; \
-    if (wid == 0) { \
-      barrier_next[w] += nthreads/WARP_SIZE; \
-      atomicAdd((unsigned long long *)barriers, 1); \
-      while (atomicAdd((unsigned long long *)barriers, 0) < barrier_next[w]) __builtin_amdgcn_s_sleep(1); \
-      __asm__ __volatile__("s_wakeup"); \
-    } \
-  } \
-} while (0)
+#define barrier_group_release()
+#define barrier_group_acquire()
 #else
+#define barrier_group_release() __threadfence()
+#define barrier_group_acquire() __builtin_amdgcn_fence(__ATOMIC_ACQUIRE, "workgroup")
+#endif
 #define barrier_by_group() do { \
-  if (nthreads == NCCL_MAX_NTHREADS) { \
-    __threadfence(); __builtin_amdgcn_s_barrier(); \
+  barrier_group_release(); \
+  if (nthreads == (int)blockDim.x) { \
+    __builtin_amdgcn_s_barrier(); \
   } else { \
     const int w = threadIdx.x/WARP_SIZE; \
     const int wid = threadIdx.x%WARP_SIZE; \
-    __threadfence(); \
     if (wid == 0) { \
       barrier_next[w] += nthreads/WARP_SIZE; \
-      atomicAdd((unsigned long long *)barriers, 1); \
-      while (atomicAdd((unsigned long long *)barriers, 0) < barrier_next[w]) __builtin_amdgcn_s_sleep(1); \
+      __atomic_fetch_add(barriers, 1, __ATOMIC_RELAXED); \
+      while (__atomic_load_n(barriers, __ATOMIC_RELAXED) < barrier_next[w]) __builtin_amdgcn_s_sleep(1); \
       __asm__ __volatile__("s_wakeup"); \
     } \
   } \
+  barrier_group_acquire(); \
 } while (0)
-#endif
 
 /* Protocol classes: ProtoSimple, ProtoLL, ProtoLL128
  * We use these as template args to the Primtiives class instead of integral
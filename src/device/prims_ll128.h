@@ -51,11 +51,13 @@ class Primitives<T, RedOp, Fan, Direct, ProtoLL128, P2p>:
 
   uint64_t recvStep[MaxRecv];
   uint64_t sendStep[MaxSend];
+  int recvStepMask[MaxRecv]; // Pipeline depth of each connection minus one
+  int sendStepMask[MaxSend];
   uint64_t* recvBuff[MaxRecv];
   uint64_t* sendBuff[MaxSend];
 
-  inline __device__ int recvOffset(int i) { return (recvStep[i]%NCCL_STEPS)*stepSize; }
-  inline __device__ int sendOffset(int i) { return (sendStep[i]%NCCL_STEPS)*stepSize; }
+  inline __device__ int recvOffset(int i) { return (recvStep[i]&recvStepMask[i])*stepSize; }
+  inline __device__ int sendOffset(int i) { return (sendStep[i]&sendStepMask[i])*stepSize; }
   inline __device__ uint64_t* recvPtr(int i) { return recvBuff[i]+recvOffset(i); }
   inline __device__ uint64_t* sendPtr(int i) { return sendBuff[i]+sendOffset(i); }
   inline __device__ uint64_t recvFlag(int i) { return recvStep[i]+1; }
@@ -97,13 +99,13 @@ private:
   inline __device__ void waitSend(int nbytes) {
     if (sendConnHeadPtr) {
       int spins = 0;
-      while (sendConnHeadCache + NCCL_STEPS < sendConnHead + 1) {
+      while (sendConnHeadCache + sendStepMask[wid]+1 < sendConnHead + 1) {
         __builtin_amdgcn_s_sleep(1);
         sendConnHeadCache = __atomic_load_n(sendConnHeadPtr, __ATOMIC_RELAXED);
         if (checkAbort(spins, wid, 1)) break;
       }
       if (sendConnFifo) {
-        sendConnFifo[sendStep[wid]%NCCL_STEPS].size = nbytes;
+        sendConnFifo[sendStep[wid]&sendStepMask[wid]].size = nbytes;
       }
       sendConnHead += 1;
     }
@@ -231,6 +233,8 @@ private:
     uint64_t vr[ELEMS_PER_THREAD];
 
     __syncwarp();
+    // Each thread moves 16 bytes of its line with a single load128/store128, so
+    // that on gfx94x the flag and the data next to it travel in one dwordx4.
     /************************ Wait first recv ********************/
     if (RECV) {
       uint64_t* ptr = recvPtr(0)+ll128Offset;
@@ -241,8 +245,7 @@ private:
         needReload = false;
         #pragma unroll
         for (int u=0; u<ELEMS_PER_THREAD; u+=2) {
-          vr[u] = __builtin_nontemporal_load(ptr+u*WARP_SIZE);
-          vr[u+1] = __builtin_nontemporal_load(ptr+u*WARP_SIZE+1);
+          load128(ptr+u*WARP_SIZE, vr[u], vr[u+1]);
           needReload |= flagThread && (vr[u+1] != flag);
         }
         needReload &= (0 == checkAbort(spins, 0, 0));
@@ -284,8 +287,7 @@ private:
           needReload = false;
           #pragma unroll
           for (int u=0; u<ELEMS_PER_THREAD; u+=2) {
-            vr[u] = __builtin_nontemporal_load(ptr+u*WARP_SIZE);
-            vr[u+1] = __builtin_nontemporal_load(ptr+u*WARP_SIZE+1);
+            load128(ptr+u*WARP_SIZE, vr[u], vr[u+1]);
             needReload |= flagThread && (vr[u+1] != flag);
           }
           needReload &= (0 == checkAbort(spins, i, 0));
@@ -318,16 +320,14 @@ private:
         uint64_t* ptr = sendPtr(i)+ll128Offset;
         #pragma unroll
         for (int u=0; u<ELEMS_PER_THREAD; u+=2) {
-          __builtin_nontemporal_store(v[u], ptr+u*WARP_SIZE);
-          __builtin_nontemporal_store(flagThread ? flag : v[u+1], ptr+u*WARP_SIZE+1);
+          store128(ptr+u*WARP_SIZE, v[u], flagThread ? flag : v[u+1]);
         }
       }
       uint64_t flag = sendFlag(0);
       uint64_t* ptr = sendPtr(0)+ll128Offset;
       #pragma unroll
       for (int u=0; u<ELEMS_PER_THREAD; u+=2) {
-        __builtin_nontemporal_store(v[u], ptr+u*WARP_SIZE);
-        __builtin_nontemporal_store(flagThread ? flag : v[u+1], ptr+u*WARP_SIZE+1);
+        store128(ptr+u*WARP_SIZE, v[u], flagThread ? flag : v[u+1]);
       }
     }
     /********************** End Send ************************/
@@ -465,6 +465,7 @@ private:
   __device__ __forceinline__ void loadRecvConn(struct ncclConnInfo* conn, int i) {
     recvBuff[i] = (uint64_t*)conn->buffs[NCCL_PROTO_LL128];
     recvStep[i] = conn->step;
+    recvStepMask[i] = conn->nSteps-1;
     if (wid == i) recvConn = conn;
   }
   __device__ __forceinline__ void loadRecvSync() {
@@ -477,6 +478,7 @@ private:
   __device__ __forceinline__ void loadSendConn(struct ncclConnInfo* conn, int i) {
     sendBuff[i] = (uint64_t*)conn->buffs[NCCL_PROTO_LL128];
     sendStep[i] = conn->step;
+    sendStepMask[i] = conn->nSteps-1;
     if (wid == i) sendConn = conn;
   }
   __device__ __forceinline__ void loadSendSync() {
@@ -549,6 +551,11 @@ public:
   __device__ void sendFromOutput(intptr_t outIx, int eltN) {
     return GenericOp<0, 1, Output, -1>(outIx, -1, eltN, false);
   }
+  // Makes what the threads of the group wrote to the user buffers visible to
+  // all of them, for code running between two primitives
+  __device__ void groupSync() {
+    barrier();
+  }
   __device__ void recv(intptr_t outIx, int eltN, bool postOp=false) {
     return GenericOp<1, 0, -1, Output>(-1, outIx, eltN, postOp);
   }
@@ -54,6 +54,7 @@ class Primitives<
   T *directBuff;
   uint64_t *connStepPtr;
   uint64_t connStepCache; // Cache last seen value of (*connStepPtr)
+  int connStepMask;       // Pipeline depth of the connection minus one
   uint64_t* barriers;
   uint64_t* barrier_next;
   uint32_t* next_hdp_reg;
@@ -115,33 +116,33 @@ private:
     if (((flags & (Recv*RoleWaitRecv)) && !noRecvWait) ||
         ((flags & (Send*RoleWaitSend)) && !noSendWait)) {
       int spins = 0;
-      while (connStepCache + (isSendNotRecv ? NCCL_STEPS : 0) < step + StepPerSlice) {
+      while (connStepCache + (isSendNotRecv ? connStepMask+1 : 0) < step + StepPerSlice) {
         __builtin_amdgcn_s_sleep(1);
         connStepCache = loadStepValue(connStepPtr);
         if (checkAbort(spins)) break;
-        //if (spins == 0) printf("r=%d b=%d t=%d SPUN OUT got=%d want=%d\n", ncclShmem.comm.rank, blockIdx.x, threadIdx.x, int(connStepCache + (isSendNotRecv ? NCCL_STEPS : 0)), int(step+StepPerSlice));
-        if (spins == 0) traceData(__LINE__, threadIdx.x, int(connStepCache + (isSendNotRecv ? NCCL_STEPS : 0)), int(step+StepPerSlice));
+        //if (spins == 0) printf("r=%d b=%d t=%d SPUN OUT got=%d want=%d\n", ncclShmem.comm.rank, blockIdx.x, threadIdx.x, int(connStepCache + (isSendNotRecv ? connStepMask+1 : 0)), int(step+StepPerSlice));
+        if (spins == 0) traceData(__LINE__, threadIdx.x, int(connStepCache + (isSendNotRecv ? connStepMask+1 : 0)), int(step+StepPerSlice));
       }
       __asm__ __volatile__("s_wakeup");
     }
 
     if (flags & (Recv*RoleWaitRecv | Send*RoleWaitSend)) {
       if (flags & ConnFifoEnabled)
-        connFifo[step%NCCL_STEPS].size = nelts*sizeof(T);
+        connFifo[step&connStepMask].size = nelts*sizeof(T);
 
       void **ptrs = isSendNotRecv ? (ncclShmem.groups[group].dsts + Dst)
                                   : (ncclShmem.groups[group].srcs + Src);
       if (flags & UserBufferMode) {
          // Do nothing
-      } else if ((flags & ConnFifoEnabled) && connFifo[step%NCCL_STEPS].mode == NCCL_MODE_OFFSET) {
-        ptrs[index] = connEltsFifo + loadInt(&connFifo[step%NCCL_STEPS].offset)/sizeof(T);
+      } else if ((flags & ConnFifoEnabled) && connFifo[step&connStepMask].mode == NCCL_MODE_OFFSET) {
+        ptrs[index] = connEltsFifo + loadInt(&connFifo[step&connStepMask].offset)/sizeof(T);
       } else if (isSendNotRecv && DirectSend) {
         if (flags & (DirectWrite | NvlsDirectWrite)) {
           ptrs[index] = directBuff + dstIx + offset;
         } else if (flags & DirectRead) {  // empty send
           ptrs[index] = nullptr;
         } else {
-          ptrs[index] = connEltsFifo + (step%NCCL_STEPS)*stepSize;
+          ptrs[index] = connEltsFifo + (step&connStepMask)*stepSize;
         }
       } else if (!isSendNotRecv && DirectRecv) {
         if (flags & (DirectRead | NvlsDirectRead)) {
@@ -149,11 +150,11 @@ private:
         } else if (flags & DirectWrite) {
           ptrs[index] = directBuff + dstIx + offset;  // send to next from my output buffer
         } else {
-          ptrs[index] = connEltsFifo + (step%NCCL_STEPS)*stepSize;
+          ptrs[index] = connEltsFifo + (step&connStepMask)*stepSize;
         }
       }
       else {
-        ptrs[index] = connEltsFifo + (step%NCCL_STEPS)*stepSize;
+        ptrs[index] = connEltsFifo + (step&connStepMask)*stepSize;
       }
       if ((flags & (AnyNetDeviceUnpack)) && (flags & (Recv*RoleWaitRecv))) {
         ncclNetDeviceIncrementHead(group);
@@ -231,8 +232,9 @@ private:
         /* if user abort the kernel, we don't need to actually perform copy/reduce; just set size
          * to 0 to avoid unnecessary workload. */
         int workSize = ncclShmem.aborted ? 0 : sliceSize;
-        if (flags & AnyNetDeviceUnpack) {
-          ncclNetDeviceUnpack<Recv>(tid, tidInBlock, nworkers, group, ncclShmem.groups[group].devicePlugin.unpack.unpackNetDeviceIndexMask, Src, workSize);
+        int unpackMask = Recv ? ncclShmem.groups[group].devicePlugin.unpack.unpackNetDeviceIndexMask : 0;
+        if (unpackMask) {
+          ncclNetDeviceUnpack<Recv>(tid, tidInBlock, nworkers, group, unpackMask, Src, workSize);
           // Sync here to make sure all workers are reading from the updated srcs)
           subBarrier();
         }
@@ -430,17 +432,17 @@ public:
         if (flags & (Recv*RoleWaitRecv | Send*RoleWaitSend)) {
           bool isSendNotRecv = (Send && Recv) ? (flags & RoleWaitSend) : Send;
           int spins = 0;
-          while (connStepCache + (isSendNotRecv ? NCCL_STEPS : 0) < step + StepPerSlice) {
+          while (connStepCache + (isSendNotRecv ? connStepMask+1 : 0) < step + StepPerSlice) {
             connStepCache = loadStepValue(connStepPtr);
             if (checkAbort(spins)) break;
           }
           void **ptrs = isSendNotRecv ? ncclShmem.groups[group].dsts
                                       : ncclShmem.groups[group].srcs;
-          if ((flags & ConnFifoEnabled) && connFifo[step%NCCL_STEPS].mode == NCCL_MODE_OFFSET) {
-            int offset = loadInt(&connFifo[step%NCCL_STEPS].offset);
+          if ((flags & ConnFifoEnabled) && connFifo[step&connStepMask].mode == NCCL_MODE_OFFSET) {
+            int offset = loadInt(&connFifo[step&connStepMask].offset);
             ptrs[index] = connEltsFifo + offset/sizeof(T);
           } else {
-            ptrs[index] = connEltsFifo + (step%NCCL_STEPS)*stepSize;
+            ptrs[index] = connEltsFifo + (step&connStepMask)*stepSize;
           }
         }
         subBarrier();
@@ -454,7 +456,7 @@ public:
       if (flags & Send*RolePostSend) {
         dstSize = ncclShmem.groups[group].dstSizes[index];
         ncclShmem.groups[group].dstSizes[index] = 0;
-        if (flags & ConnFifoEnabled) connFifo[step%NCCL_STEPS].size = dstSize*sizeof(T);
+        if (flags & ConnFifoEnabled) connFifo[step&connStepMask].size = dstSize*sizeof(T);
       }
       barrier();
       if (flags & (Recv*(RoleWaitRecv|RolePostRecv) | Send*(RoleWaitSend|RolePostSend))) {
@@ -534,7 +536,7 @@ private:
     }
   }
 
-  __device__ __forceinline__ void loadRecvConn(ncclDevChannelPeer *peer, int connIndex, struct ncclWorkElem* e) {
+  __device__ __forceinline__ void loadRecvConn(ncclDevChannelPeer *peer, int connIndex, struct ncclWorkElem* e, struct ncclWorkElemP2p* p2p) {
     if (flags & (RoleWaitRecv|RolePostRecv)) {
       auto *conn = &peer->recv[connIndex];
       if (conn->netDeviceHandle.netDeviceType == NCCL_NET_DEVICE_UNPACK) {
@@ -546,6 +548,7 @@ private:
       }
       step = conn->step;
       step = roundUp(step, SlicePerChunk*StepPerSlice);
+      connStepMask = conn->nSteps-1;
       if (flags & RolePostRecv) {
         connStepPtr = conn->head;
         STORE(connStepPtr, step); // Return credits in case we rounded up.
@@ -568,6 +571,9 @@ private:
               flags |= (e->direct & NCCL_DIRECT_WRITE) ? DirectWrite :
                        (e->direct & NCCL_DIRECT_READ)  ? DirectRead  : 0;
             }
+          } else if ((conn->flags & (NCCL_IPC_READ|NCCL_IPC_WRITE)) && p2p != nullptr && p2p->ipcReg) {
+            // Always write: a read would let the sender return before the receiver is done
+            flags |= DirectWrite;
           } else if (conn->flags & (NCCL_DIRECT_WRITE|NCCL_DIRECT_READ)) {
             if (connIndex == 1 && P2p == 0) {
               flags |= DirectRead;  // scatter-reduce use direct pull
@@ -585,11 +591,12 @@ private:
     }
   }
 
-  __device__ __forceinline__ void loadSendConn(ncclDevChannelPeer *peer, int connIndex, struct ncclWorkElem* e) {
+  __device__ __forceinline__ void loadSendConn(ncclDevChannelPeer *peer, int connIndex, struct ncclWorkElem* e, struct ncclWorkElemP2p* p2p) {
     if (flags & (RoleWaitSend|RolePostSend)) {
       auto *conn = &peer->send[connIndex];
       step = conn->step;
       step = roundUp(step, SlicePerChunk*StepPerSlice);
+      connStepMask = conn->nSteps-1;
 
       connFifo = conn->connFifo;
       if (connFifo != nullptr) flags |= ConnFifoEnabled;
@@ -614,6 +621,9 @@ private:
               flags |= (e->direct & NCCL_DIRECT_WRITE) ? DirectWrite :
                        (e->direct & NCCL_DIRECT_READ)  ? DirectRead  : 0;
             }
+          } else if ((conn->flags & (NCCL_IPC_READ|NCCL_IPC_WRITE)) && p2p != nullptr && p2p->ipcReg) {
+            // Always write: a read would let the sender return before the receiver is done
+            flags |= DirectWrite;
           } else if (conn->flags & (NCCL_DIRECT_WRITE|NCCL_DIRECT_READ)) {
             if (connIndex == 1 && P2p == 0) {
               flags |= DirectRead;  // scatter-reduce use direct pull
@@ -673,26 +683,22 @@ private:
     if (flags & (RoleWaitRecv|RolePostRecv)) peer = recvPeers[index];
     if (flags & (RoleWaitSend|RolePostSend)) peer = sendPeers[index];
 
-    loadRecvConn(ncclShmem.channel.peers[peer], connIndexRecv, e);
-    loadSendConn(ncclShmem.channel.peers[peer], connIndexSend, e);
+    loadRecvConn(ncclShmem.channel.peers[peer], connIndexRecv, e, p2p);
+    loadSendConn(ncclShmem.channel.peers[peer], connIndexSend, e, p2p);
 
     if (p2p && p2p->reg) flags |= UserBufferMode;
 
-    // if (barrierAny(flags & NetDeviceUnpack)) {
-    //   flags |= AnyNetDeviceUnpack;
-    //   // g == 0 is the first ThreadPerSync # of threads of this warp
-    //   // g == 0 is also the RoleWaitRecv threads of this group, thus the thread ID will correlate to the peer index
-    //   if (g == 0) {
-    //     uint32_t mask = __ballot_sync((1U << ThreadPerSync) - 1, (flags & NetDeviceUnpack) ? 1 : 0);
-
-    //     // We only want to update the shared memory variable with a single thread
-    //     if (tid == 0) {
-    //       ncclShmem.groups[this->group].devicePlugin.unpack.unpackNetDeviceIndexMask = mask;
-    //     }
-    //   }
-    // }
+    // g == 0 holds the RoleWaitRecv threads, all in the first wavefront, and the thread ID
+    // correlates to the peer index. A ballot over that wavefront gives the unpack mask without
+    // a block barrier; the other threads read it from shared memory after the subBarrier in
+    // genericOp, and ~Primitives() keeps the next primitive from overwriting it early.
+    if (tid < WARP_SIZE) {
+      uint64_t mask = __ballot(g == 0 && (flags & NetDeviceUnpack));
+      if (mask) flags |= AnyNetDeviceUnpack;
+      if (tid == 0) ncclShmem.groups[this->group].devicePlugin.unpack.unpackNetDeviceIndexMask = (int)mask;
+    }
 
-    setDataPtrs(inputBuf, outputBuf, redOpArg, (struct ncclWorkElemReg*)e);
+    setDataPtrs(inputBuf, outputBuf, redOpArg, (struct ncclWorkElemReg*)e, p2p);
   }
 
   __forceinline__ __device__ ~Primitives() {
@@ -709,7 +715,7 @@ private:
       // We don't want the next CUDA kernel to overwrite the send buffer which
       // was accessed directly.
       uint64_t prevStep = step - StepPerSlice;
-      volatile ssize_t* ptr = &(connFifo[prevStep%NCCL_STEPS].size);
+      volatile ssize_t* ptr = &(connFifo[prevStep&connStepMask].size);
       while (*ptr != -1);
     }
 
@@ -722,7 +728,7 @@ private:
     barrier();
   }
 
-  __device__ void setDataPtrs(void const *inputBuf, void *outputBuf, uint64_t redOpArg, struct ncclWorkElemReg* e) {
+  __device__ void setDataPtrs(void const *inputBuf, void *outputBuf, uint64_t redOpArg, struct ncclWorkElemReg* e, struct ncclWorkElemP2p* p2p = nullptr) {
     if (flags & RoleInput) {
       userBuff = (T*)inputBuf;
       ncclShmem.redOpArgs[0] = redOpArg;  // scaler for local input
@@ -756,7 +762,12 @@ private:
         if (ptr != nullptr || checkAbort(spins)) break;
       }
 
-      if (slot) {
+      if (p2p != nullptr && p2p->ipcReg) {
+        // The receiver only signals it is ready through the slot, its pointer is
+        // not valid here. Use the mapping of its buffer made at capture time.
+        directBuff = (T*)ncclShmem.work.p2pPeerBuffs[group];
+        if (slot) *slot = nullptr;
+      } else if (slot) {
         directBuff = regUsed ? (T*)(e->dnOutputs[index]) :
                    reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(ptr) ^ reinterpret_cast<uintptr_t>(slot));
         *slot = nullptr;
@@ -834,6 +845,11 @@ private:
   __device__ __forceinline__ void sendFromOutput(intptr_t outIx, int eltN) {
     genericOp<0, 0, 0, 1, Output, -1>(outIx, -1, eltN, false);
   }
+  // Makes what the threads of the group wrote to the user buffers visible to
+  // all of them, for code running between two primitives
+  __device__ __forceinline__ void groupSync() {
+    barrier();
+  }
   __device__ __forceinline__ void directSend(intptr_t inpIx, intptr_t outIx, int eltN) {
     genericOp<0, 1, 0, 1, Input, -1>(inpIx, outIx, eltN, false);
   }
@@ -54,6 +54,44 @@ namespace {
       }
     }
   }
+
+  // Tree Reduce to any root: partial results come in from all the tree neighbors
+  // but the one on the way to the root, which they are sent to.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runTree(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runTree(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int root = args->root;
+    const size_t chunkCount = args->chunkCount;
+    const size_t channelCount = args->workCount;
+    const size_t gridOffset = args->workOffset;
+    const int* treeUps = ncclShmem.comm.treeUps + ncclShmem.channelId*ncclShmem.comm.nRanks;
+    int recvPeers[NCCL_MAX_TREE_PEERS];
+    int sendPeer = ncclTreeRootedPeers(treeUps, &ncclShmem.channel.tree, rank, root, recvPeers);
+    size_t offset;
+    int nelem;
+
+    Primitives<T, RedOp, FanAsymmetric<NCCL_MAX_TREE_PEERS, 1>, 0, Proto, 0>
+      prims(tid, nthreads, recvPeers, &sendPeer, args->sendbuff, args->recvbuff, args->redOpArg, 0, args->connIndex, args->connIndex);
+
+    for (size_t elemOffset = 0; elemOffset < channelCount; elemOffset += chunkCount) {
+      offset = gridOffset + elemOffset;
+      nelem = min(chunkCount, channelCount - elemOffset);
+
+      if (rank == root) {
+        prims.recvReduceCopy(offset, offset, nelem, /*postOp=*/true);
+      } else if (recvPeers[0] == -1) {
+        prims.send(offset, nelem);
+      } else {
+        prims.recvReduceSend(offset, nelem);
+      }
+    }
+  }
 }
 
 template<typename T, typename RedOp>
@@ -76,4 +114,25 @@ struct RunWorkElement<ncclFuncReduce, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_LL128
   __device__ __forceinline__ void run(ncclWorkElem *args) {
     runRing<T, RedOp, ProtoLL128>(args);
   }
-};
\ No newline at end of file
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduce, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduce, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduce, T, RedOp, NCCL_ALGO_TREE, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runTree<T, RedOp, ProtoLL128>(args);
+  }
+};
@@ -58,6 +58,7 @@ struct FuncMinMax {
   }
 };
 template<typename T> struct FuncPreMulSum;
+template<typename T> struct FuncSumPostScale;
 template<typename T> struct FuncSumPostDiv;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -530,6 +531,63 @@ struct Apply_PreOp<FuncPreMulSum<half>, /*EltPerPack=*/1> {
   };
 #endif
 
+////////////////////////////////////////////////////////////////////////////////
+// FuncSumPostScale
+
+// Sums like FuncSum, then multiplies the final result by a scale and flags
+// results that are not finite. opArg is the address of a ncclDevPostScaleArgs.
+template<typename T>
+struct FuncSumPostScale: FuncSum<T> {
+  using EltType = T;
+  float scale;
+  int* nonFinite;
+  __device__ FuncSumPostScale(uint64_t opArg=0): scale(1.0f), nonFinite(nullptr) {
+    struct ncclDevPostScaleArgs const* args = reinterpret_cast<struct ncclDevPostScaleArgs const*>(opArg);
+    if (args != nullptr) {
+      scale = args->scalePtr ? *args->scalePtr : args->scale;
+      nonFinite = args->nonFinite;
+    }
+  }
+};
+
+template<typename T>
+struct Apply_Reduce<FuncSumPostScale<T>, /*EltPerPack=*/1>:
+    Apply_Reduce<FuncSum<T>, 1> {
+  __device__ static BytePack<sizeof(T)> reduce(FuncSumPostScale<T> fn, BytePack<sizeof(T)> a, BytePack<sizeof(T)> b) {
+    // FuncSumPostScale reduce dispatches to FuncSum.
+    return Apply_Reduce<FuncSum<T>, 1>::reduce(FuncSum<T>(), a, b);
+  }
+};
+
+// 64-bit types are scaled in double, everything else in float
+template<typename T>
+struct PostScaleAcc { using Type = float; };
+template<> struct PostScaleAcc<double> { using Type = double; };
+template<> struct PostScaleAcc<int64_t> { using Type = double; };
+template<> struct PostScaleAcc<uint64_t> { using Type = double; };
+
+template<typename T>
+struct Apply_PostOp<FuncSumPostScale<T>, /*EltPerPack=*/1> {
+  static constexpr bool IsIdentity = false;
+  __device__ static BytePack<sizeof(T)> postOp(FuncSumPostScale<T> fn, BytePack<sizeof(T)> a) {
+    using Acc = typename PostScaleAcc<T>::Type;
+    Acc x = Acc(fromPack<T>(a)) * Acc(fn.scale);
+    // Racy but benign: every writer stores the same value
+    if (!isfinite(x) && fn.nonFinite) *fn.nonFinite = 1;
+    return toPack<T>(T(x));
+  }
+};
+
+template<>
+struct Apply_PostOp<FuncSumPostScale<half>, /*EltPerPack=*/1> {
+  static constexpr bool IsIdentity = false;
+  __device__ static BytePack<sizeof(half)> postOp(FuncSumPostScale<half> fn, BytePack<sizeof(half)> a) {
+    float x = __half2float(fromPack<half>(a)) * fn.scale;
+    if (!isfinite(x) && fn.nonFinite) *fn.nonFinite = 1;
+    return toPack<half>(__float2half(x));
+  }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // FuncSumPostDiv
 
@@ -700,6 +758,7 @@ struct Apply_LoadMultimem {
     using T = typename Fn::EltType;
     static constexpr bool IsSum = std::is_same<Fn, FuncSum<T>>::value ||
                                   std::is_same<Fn, FuncPreMulSum<T>>::value ||
+                                  std::is_same<Fn, FuncSumPostScale<T>>::value ||
                                   std::is_same<Fn, FuncSumPostDiv<T>>::value;
     static constexpr bool IsMinMax = std::is_same<Fn, FuncMinMax<T>>::value;
     static constexpr bool IsFloat = IsFloatingPoint<T>::value;
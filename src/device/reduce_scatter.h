@@ -300,4 +300,92 @@ struct RunWorkElement<ncclFuncReduceScatter, T, RedOp, NCCL_ALGO_COLLNET_DIRECT,
       return;
     }
   }
-};
\ No newline at end of file
+};
+namespace {
+  // Bruck ReduceScatter, the Bruck AllGather run backwards: at step k, from the
+  // last one down, the partial sums of the upper blocks still held go to the rank
+  // 1<<k above while those of the rank 1<<k below are reduced into the lower
+  // ones, until only our block is left. Block j counts from our own, and the
+  // partial sums of the first `held` ones, received at earlier steps, are in the
+  // channel scratch at j*count; the others are still in the input. One channel
+  // runs the whole collective. Must match bruckProxySteps() in enqueue.cc.
+  template<typename T, typename RedOp, typename Proto>
+#if defined(USE_INDIRECT_FUNCTION_CALL) && !defined(__gfx940__) && !defined(__gfx941__) && !defined(__gfx942__)
+  __device__ void runBruck(ncclWorkElem *args) {
+#else
+  __device__ __attribute__((noinline)) void runBruck(ncclWorkElem *args) {
+#endif
+    const int tid = threadIdx.x;
+    const int nthreads = (int)args->nWarps * WARP_SIZE;
+    const int rank = ncclShmem.comm.rank;
+    const int nranks = ncclShmem.comm.nRanks;
+    const ssize_t count = args->count;
+    const ssize_t total = count*nranks;
+    const ssize_t chunkCount = args->chunkCount;
+    T const *inputBuf = (T const*)args->sendbuff;
+    T *outputBuf = (T*)args->recvbuff;
+    T *scratch = (T*)ncclShmem.channel.bruck.scratch;
+    int held = 0;
+
+    for (int k = ncclShmem.channel.bruck.nSteps-1; k >= 0; k--) {
+      const int dist = 1<<k;
+      int sendPeer = (rank + dist) % nranks;
+      int recvPeer = (rank + nranks - dist) % nranks;
+      const int nBlocks = min(dist, nranks-dist);
+      const ssize_t n = nBlocks*count;
+      // Chunks also end where the source changes from scratch to input, for the
+      // sender (block dist+j) and the receiver (block j) of each step
+      const int sendCut = held-dist;
+      Primitives<T, RedOp, FanSymmetric<1>, /*Direct=*/0, Proto, 0>
+        prims(tid, nthreads, &recvPeer, &sendPeer, inputBuf, scratch, args->redOpArg);
+      for (ssize_t si = 0, ri = 0; si < n || ri < n; ) {
+        if (si < n) {
+          int nelem = ncclBruckChunk(si, count, nBlocks, nranks-sendPeer, sendCut, held, chunkCount);
+          if (dist + si/count < held) {
+            prims.setDataPtrs(scratch, scratch);
+            prims.send(dist*count + si, nelem);
+          } else {
+            prims.setDataPtrs(inputBuf, scratch);
+            prims.send((sendPeer*count + si) % total, nelem);
+          }
+          si += nelem;
+        }
+        if (ri < n) {
+          int nelem = ncclBruckChunk(ri, count, nBlocks, nranks-rank, sendCut, held, chunkCount);
+          // The last step only receives for our block, which goes to the output
+          T *dst = k == 0 ? outputBuf : scratch;
+          if (ri/count < held) {
+            prims.setDataPtrs(scratch, dst);
+            prims.recvReduceCopy(ri, ri, nelem, /*postOp=*/k == 0);
+          } else {
+            prims.setDataPtrs(inputBuf, dst);
+            prims.recvReduceCopy((rank*count + ri) % total, ri, nelem, /*postOp=*/k == 0);
+          }
+          ri += nelem;
+        }
+      }
+      held = max(held, nBlocks);
+    }
+  }
+}
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduceScatter, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_SIMPLE> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoSimple<1, 1>>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduceScatter, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_LL> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoLL>(args);
+  }
+};
+
+template<typename T, typename RedOp>
+struct RunWorkElement<ncclFuncReduceScatter, T, RedOp, NCCL_ALGO_BRUCK, NCCL_PROTO_LL128> {
+  __device__ __forceinline__ void run(ncclWorkElem *args) {
+    runBruck<T, RedOp, ProtoLL128>(args);
+  }
+};
@@ -14,7 +14,7 @@
 
 template<typename T, typename RedOp>
 struct RunWork<ncclFuncSendRecv, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
-  template<typename Proto>
+  template<typename Proto, int Direct=0>
   __device__ void runSend(const int tid, const int nthreads, const uint8_t group, struct ncclWorkElemP2p* args) {
     void* buff = reinterpret_cast<void*>(uintptr_t(args->buffHi32)<<32 | args->buffLo32);
     ssize_t count = reinterpret_cast<size_t>(size_t(args->countHi32)<<32 | args->countLo32);
@@ -83,7 +83,7 @@ struct RunWork<ncclFuncSendRecv, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
       int chunkSize = args->chunkSize/sizeof(T);
       if (args->proto == NCCL_PROTO_LL) chunkSize /= 2;
       int const peer = args->peer;
-      Primitives<T, RedOp, FanAsymmetric<0, 1>, 0, Proto, 1> prims
+      Primitives<T, RedOp, FanAsymmetric<0, 1>, Direct, Proto, 1> prims
         (tid, nthreads, nullptr, &peer, buff, nullptr, /*redOpArg(ignored)=*/0, group, args->connIndex, args->connIndex, nullptr, args, ncclShmem.comm.p2pChunkSize/sizeof(T));
 
 #if defined(ENABLE_NPKIT)
@@ -117,7 +117,7 @@ struct RunWork<ncclFuncSendRecv, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
     }
   }
 
-  template<typename Proto>
+  template<typename Proto, int Direct=0>
   __device__ void runRecv(const int tid, const int nthreads, const uint8_t group, struct ncclWorkElemP2p* args) {
 #if defined(ENABLE_NPKIT)
     bool isNpKitThread = (tid == 0);
@@ -144,7 +144,7 @@ struct RunWork<ncclFuncSendRecv, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
       int chunkSize = args->chunkSize/sizeof(T);
       if (args->proto == NCCL_PROTO_LL) chunkSize /= 2; // This is to account for chunkEffectiveSize
       int const peer = args->peer;
-      Primitives<T, RedOp, FanAsymmetric<1, 0>, 0, Proto, 1> prims
+      Primitives<T, RedOp, FanAsymmetric<1, 0>, Direct, Proto, 1> prims
         (tid, nthreads, &peer, nullptr, nullptr, buff, /*redOpArg(ignored)=*/0, group, args->connIndex, args->connIndex, nullptr, args, ncclShmem.comm.p2pChunkSize/sizeof(T));
 
 #if defined(ENABLE_NPKIT)
@@ -200,31 +200,32 @@ struct RunWork<ncclFuncSendRecv, T, RedOp, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE> {
     if (args->p2pType == ncclWorkP2pTypeUnused) return;
     if (tid >= nthreads || args->peer == -1) return;
 
+#if defined(__gfx90a__)
+    using Simple = ProtoSimple<1,1,8>;
+#elif defined(__gfx908__) || defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
+    using Simple = ProtoSimple<1,1,4>;
+#else
+    using Simple = ProtoSimple<1,1>;
+#endif
+
     // Select Proto here
     // This is to allow the same kernel to run multiple primitives on different warps (thread groups)
+    // Buffers registered at capture time (ipcReg) are written directly by the sender.
     if ((group%2) == 0) {
       if (args->proto == NCCL_PROTO_LL) {
         runRecv<ProtoLL>(tid, nthreads, group, args);
+      } else if (args->ipcReg) {
+        runRecv<Simple, 1>(tid, nthreads, group, args);
       } else {
-#if defined(__gfx90a__)
-        runRecv<ProtoSimple<1,1,8>>(tid, nthreads, group, args);
-#elif defined(__gfx908__) || defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
-        runRecv<ProtoSimple<1,1,4>>(tid, nthreads, group, args);
-#else
-        runRecv<ProtoSimple<1,1>>(tid, nthreads, group, args);
-#endif
+        runRecv<Simple>(tid, nthreads, group, args);
       }
     } else {
       if (args->proto == NCCL_PROTO_LL) {
         runSend<ProtoLL>(tid, nthreads, group, args);
+      } else if (args->ipcReg) {
+        runSend<Simple, 1>(tid, nthreads, group, args);
       } else {
-#if defined(__gfx90a__)
-        runSend<ProtoSimple<1,1,8>>(tid, nthreads, group, args);
-#elif defined(__gfx908__) || defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__)
-        runSend<ProtoSimple<1,1,4>>(tid, nthreads, group, args);
-#else
-        runSend<ProtoSimple<1,1>>(tid, nthreads, group, args);
-#endif
+        runSend<Simple>(tid, nthreads, group, args);
       }
     }
   }
@@ -0,0 +1,87 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "collectives.h"
+#include "common_kernel.h"
+#include "device.h"
+#include <cuda_runtime.h>
+
+namespace {
+  // Sums val into *ptr with a CAS loop on the aligned word holding it, so that
+  // every element type of reduce_kernel.h works, including 1 and 2 byte ones.
+  template<typename T>
+  __device__ __forceinline__ void atomicReduceSum(T* ptr, T val) {
+    using Pack = typename BytePackOf<T>::Pack;
+    FuncSum<T> fn;
+    if (sizeof(T) == 8) {
+      unsigned long long* word = (unsigned long long*)ptr;
+      unsigned long long old = *word, assumed;
+      do {
+        assumed = old;
+        Pack cur;
+        cur.native = assumed;
+        old = atomicCAS(word, assumed, (unsigned long long)applyReduce(fn, cur, toPack(val)).native);
+      } while (old != assumed);
+    } else {
+      unsigned int* word = (unsigned int*)((uintptr_t)ptr & ~uintptr_t(3));
+      int shift = 8*((uintptr_t)ptr & 3);
+      unsigned int mask = sizeof(T) == 4 ? 0xffffffffu : ((1u << 8*sizeof(T)) - 1) << shift;
+      unsigned int old = *word, assumed;
+      do {
+        assumed = old;
+        Pack cur;
+        cur.native = (assumed & mask) >> shift;
+        unsigned int next = (unsigned int)applyReduce(fn, cur, toPack(val)).native;
+        old = atomicCAS(word, assumed, (assumed & ~mask) | ((next << shift) & mask));
+      } while (old != assumed);
+    }
+  }
+
+  // Adds each row of values to the row of dst given by its index. Indices outside
+  // [0, nRows) are skipped.
+  template<typename T>
+  __global__ __launch_bounds__(512, 1)
+  void sparseScatterReduce(T* dst, int64_t const* indices, T const* values, size_t nnz, size_t rowCount, size_t nRows) {
+    size_t nElts = nnz*rowCount;
+    for (size_t i = blockIdx.x*(size_t)blockDim.x + threadIdx.x; i < nElts; i += gridDim.x*(size_t)blockDim.x) {
+      int64_t row = indices[i/rowCount];
+      if (row < 0 || (size_t)row >= nRows) continue;
+      atomicReduceSum(dst + row*rowCount + i%rowCount, values[i]);
+    }
+  }
+}
+
+ncclResult_t ncclLaunchSparseScatterReduce(void* dst, int64_t const* indices, void const* values, size_t nnz, size_t rowCount,
+    size_t nRows, ncclDataType_t type, cudaStream_t stream) {
+  void const* kernel;
+  switch (type) {
+  case ncclInt8:     kernel = (void const*)&sparseScatterReduce<int8_t>; break;
+  case ncclUint8:    kernel = (void const*)&sparseScatterReduce<uint8_t>; break;
+  case ncclInt32:    kernel = (void const*)&sparseScatterReduce<int32_t>; break;
+  case ncclUint32:   kernel = (void const*)&sparseScatterReduce<uint32_t>; break;
+  case ncclInt64:    kernel = (void const*)&sparseScatterReduce<int64_t>; break;
+  case ncclUint64:   kernel = (void const*)&sparseScatterReduce<uint64_t>; break;
+  case ncclFloat16:  kernel = (void const*)&sparseScatterReduce<half>; break;
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: kernel = (void const*)&sparseScatterReduce<hip_bfloat16>; break;
+#endif
+#if defined(RCCL_FLOAT8)
+  case ncclFp8E4M3:  kernel = (void const*)&sparseScatterReduce<rccl_float8>; break;
+  case ncclFp8E5M2:  kernel = (void const*)&sparseScatterReduce<rccl_bfloat8>; break;
+#endif
+  case ncclFloat32:  kernel = (void const*)&sparseScatterReduce<float>; break;
+  case ncclFloat64:  kernel = (void const*)&sparseScatterReduce<double>; break;
+  default: return ncclInvalidArgument;
+  }
+  if (nnz == 0 || rowCount == 0) return ncclSuccess;
+  dim3 grid = {0, 1, 1};
+  grid.x = std::min(256, (int)divUp(nnz*rowCount, 512*4));
+  dim3 block = {512, 1, 1};
+  void* args[6] = {&dst, &indices, &values, &nnz, &rowCount, &nRows};
+  CUDACHECK(cudaLaunchKernel(kernel, grid, block, args, 0, stream));
+  return ncclSuccess;
+}
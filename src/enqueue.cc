@@ -7,6 +7,8 @@
  ************************************************************************/
 
 #include "enqueue.h"
+#include "jit_redop.h"
+#include "hostcoll.h"
 #include "argcheck.h"
 #include "coll_net.h"
 #include "graph/topo.h"
@@ -20,7 +22,15 @@
 #include "rccl_vars.h"
 #include "transport.h"
 #include "common.h"
+#include "tuner.h"
+#include "autotune.h"
+#include "straggler.h"
+#include "stats.h"
+#include "ipccache.h"
+#include "profiler.h"
+#include "colltiming.h"
 #include <cassert>
+#include <cmath>
 #include <cstring> // std::memcpy
 #include <cinttypes> // PRIx64
 
@@ -53,6 +63,7 @@ static ncclResult_t initCollWorkElemReg(struct ncclComm* comm, struct ncclWorkEl
 static ncclResult_t computeCollChunkInfo(struct ncclInfo* collInfo, size_t nBytes, int nChannels);
 static ncclResult_t initCollProxyOp(struct ncclInfo* collInfo, int channelId, uint64_t opCount, uint32_t nsteps, struct ncclProxyOp* proxyOp);
 static ncclResult_t getTunerInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int numPipeOps);
+static ncclResult_t getAutotuneInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int* nChannels);
 static ncclResult_t topoGetAlgoInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int numPipeOps);
 static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo);
 static ncclResult_t computeCollWorkFunc(struct ncclInfo* collInfo);
@@ -60,43 +71,60 @@ static ncclResult_t getPatternInfo(struct ncclInfo* collInfo);
 static ncclResult_t getLoopInfo(struct ncclInfo* collInfo);
 static ncclResult_t getCollNetSupport(struct ncclInfo* info, int* collNetSupport);
 
-int ncclGetKernelIndex(struct ncclComm* comm) {
+ncclResult_t ncclGetKernelUnroll(int cudaDev, int* kernelUnroll) {
+  hipDeviceProp_t devProp;
+  CUDACHECK(hipGetDeviceProperties(&devProp, cudaDev));
+  *kernelUnroll = (IsArchMatch(devProp.gcnArchName, "gfx908") || (IsArchMatch(devProp.gcnArchName, "gfx94")
+    && devProp.multiProcessorCount > 80)) ? 0 : 1;
+  return ncclSuccess;
+}
+
+// unroll selects a kernel variant other than the communicator's, -1 keeps it
+int ncclGetKernelIndex(struct ncclComm* comm, int unroll = -1) {
 #if ENABLE_COLLTRACE
   int start_idx = comm->collTraceThread ? 2 : 0;
 #else
   int start_idx = 0;
 #endif
-  hipDeviceProp_t devProp;
-  CUDACHECK(hipGetDeviceProperties(&devProp, comm->cudaDev));
-  if(IsArchMatch(devProp.gcnArchName, "gfx908") || (IsArchMatch(devProp.gcnArchName, "gfx94")
-    && devProp.multiProcessorCount > 80))
-    return start_idx;
-  else
-    return start_idx + 1;
+  return start_idx + (unroll >= 0 ? unroll : comm->kernelUnroll);
 }
 
+// Kernel attributes are per device, so they are set once for each device the
+// process uses, and only on the kernels of the unroll variant that device
+// launches: querying a kernel is what makes HIP load its code object. A
+// negative kernelUnroll initializes both variants, for the autotuner.
+#define NCCL_KERNEL_INIT_MAX_DEVS 64
+static pthread_mutex_t kernelInitLock = PTHREAD_MUTEX_INITIALIZER;
+static bool kernelInitDone[NCCL_KERNEL_INIT_MAX_DEVS];
+static size_t kernelInitStackSize[NCCL_KERNEL_INIT_MAX_DEVS];
+
 // Returns maximum kernel stack size of all CUDA kernels
-ncclResult_t ncclInitKernelsForDevice(int cudaArch, size_t* maxStackSize) {
+ncclResult_t ncclInitKernelsForDevice(int cudaArch, int kernelUnroll, size_t* maxStackSize) {
   constexpr int KernelCount = sizeof(ncclKerns)/sizeof(ncclKerns[0]);
   ncclResult_t result = ncclSuccess;
+  int cudaDev;
 
   if (maxStackSize) *maxStackSize = 0;
   int carveout = ncclParamL1SharedMemoryCarveout();
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  bool cached = cudaDev < NCCL_KERNEL_INIT_MAX_DEVS;
+  if (cached) {
+    pthread_mutex_lock(&kernelInitLock);
+    if (kernelInitDone[cudaDev]) {
+      if (maxStackSize) *maxStackSize = kernelInitStackSize[cudaDev];
+      pthread_mutex_unlock(&kernelInitLock);
+      return ncclSuccess;
+    }
+  }
 
-  // Keep track if we already visited a function pointer.
-  void* lru[2] = {nullptr, nullptr};
-  for (int i=0; i < KernelCount; i++) {
+  for (int i=std::max(kernelUnroll, 0); i < KernelCount; i += kernelUnroll < 0 ? 1 : 2) {
     void* fn = ncclKerns[i].kernelFn;
-    if (fn == lru[0] || fn == lru[1]) goto next_kernel;
-    lru[1] = lru[0];
-    lru[0] = fn;
 
     if (maxStackSize) {
       cudaFuncAttributes attr = {0};
       if (cudaFuncGetAttributes(&attr, fn) != cudaSuccess)
         WARN("Failed to get kernel attributes");
       if (attr.localSizeBytes > *maxStackSize) *maxStackSize = attr.localSizeBytes;
-    ignore0:;
     }
 
     if (carveout) {
@@ -113,6 +141,14 @@ ncclResult_t ncclInitKernelsForDevice(int cudaArch, size_t* maxStackSize) {
     }
   next_kernel:;
   }
+  if (cached) {
+    // Only cache the stack size when it was computed
+    if (result == ncclSuccess && maxStackSize) {
+      kernelInitDone[cudaDev] = true;
+      kernelInitStackSize[cudaDev] = *maxStackSize;
+    }
+    pthread_mutex_unlock(&kernelInitLock);
+  }
   return result;
 }
 
@@ -191,7 +227,7 @@ static void finishWork(struct ncclWork* work, int WarpSize) {
 
 static ncclResult_t appendWorkElemP2p(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int channelId,
-    struct ncclWorkElemP2p const *elem, bool fuseOk
+    struct ncclWorkElemP2p const *elem, void* peerBuff, bool fuseOk
   ) {
   int funcIndex = ncclDevFuncId_P2p();
   if (funcIndex < 0) {
@@ -211,6 +247,7 @@ static ncclResult_t appendWorkElemP2p(
       }
       int e = chan->p2pTailElem[elem->p2pType-1];
       q->work.p2pElems[e] = *elem; // C++ struct assignment
+      q->work.p2pPeerBuffs[e] = peerBuff;
       chan->p2pTailElem[elem->p2pType-1] += 2;
       return ncclSuccess;
     }
@@ -223,6 +260,7 @@ static ncclResult_t appendWorkElemP2p(
   chan->p2pTailElem[ncclWorkP2pTypeRecv-1] = 0;
   chan->p2pTailElem[ncclWorkP2pTypeSend-1] = 1;
   q->work.p2pElems[chan->p2pTailElem[elem->p2pType-1]] = *elem; // C++ struct assignment
+  q->work.p2pPeerBuffs[chan->p2pTailElem[elem->p2pType-1]] = peerBuff;
   chan->p2pTailElem[elem->p2pType-1] += 2;
   chan->nWork += 1;
   ncclIntruQueueEnqueue(&chan->workQueue, q);
@@ -240,6 +278,12 @@ static ncclResult_t addProxyOpIfNeeded(struct ncclComm* comm, struct ncclKernelP
   return ncclSuccess;
 }
 
+// Direct AllReduce runs two-shot above comm->directOneShotBytes. LL and LL128
+// have no scatter/gather primitives and are always one-shot.
+static inline int directNShots(struct ncclInfo* collInfo) {
+  return collInfo->protocol == NCCL_PROTO_SIMPLE && collInfo->nBytes > collInfo->comm->directOneShotBytes ? 2 : 1;
+}
+
 static ncclResult_t computeCollSteps(struct ncclInfo* collInfo, size_t workCount, uint32_t* steps) {
   struct ncclComm* comm = collInfo->comm;
   if (collInfo->coll == ncclFuncAllReduce) {
@@ -249,6 +293,8 @@ static ncclResult_t computeCollSteps(struct ncclInfo* collInfo, size_t workCount
       *steps = DIVUP(workCount, comm->channels[0].collnetDirect.nHeads * collInfo->chunkCount) * collInfo->chunkSteps;
     else if (collInfo->algorithm == NCCL_ALGO_NVLS || collInfo->algorithm == NCCL_ALGO_NVLS_TREE)
       *steps = DIVUP(workCount, comm->channels[0].nvls.nHeads * collInfo->chunkCount) * collInfo->chunkSteps;
+    else if (collInfo->algorithm == NCCL_ALGO_DIRECT && directNShots(collInfo) == 2)
+      *steps = DIVUP(workCount, comm->nRanks * collInfo->chunkCount) * 2;
     else
       *steps = DIVUP(workCount, collInfo->chunkCount) * collInfo->chunkSteps;
   } else if (collInfo->coll == ncclFuncReduceScatter) {
@@ -292,6 +338,9 @@ static ncclResult_t computeCollLastChunkInfo(struct ncclInfo* collInfo, size_t w
     } else if (collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT) {
       size_t remCount = workCount % (comm->channels[0].collnetDirect.nHeads * collInfo->chunkCount);
       *lastChunkCount = DIVUP(DIVUP(remCount, comm->channels[0].collnetDirect.nHeads), alignCount) * alignCount;
+    } else if (collInfo->algorithm == NCCL_ALGO_DIRECT && directNShots(collInfo) == 2) {
+      size_t remCount = workCount % (comm->nRanks * collInfo->chunkCount);
+      *lastChunkCount = DIVUP(DIVUP(remCount, comm->nRanks), alignCount) * alignCount;
     } else {
       *lastChunkCount = collInfo->chunkCount;
     }
@@ -364,8 +413,8 @@ static ncclResult_t addCollnetCollToPlan(
 
   plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
   if (!plan->kernelSpecialized) {
-    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm)].kernelFn;
-    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm)].specialized;
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
   }
 
   if (comm->rank == 0) {
@@ -471,8 +520,8 @@ static ncclResult_t addTunedCollToPlan(
 
   plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
   if (!plan->kernelSpecialized) {
-    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm)].kernelFn;
-    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm)].specialized;
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
   }
 
   if (comm->rank == 0) {
@@ -485,9 +534,12 @@ fail:
   goto exit;
 }
 
+// Lays the collective out over channels [channelBase, channelBase+usableChannels),
+// filling each channel up to maxBytesPerChannel. With RCCL_CHANNEL_BALANCE, ring
+// channels are filled in proportion to their bandwidth instead.
 static ncclResult_t addCBDCollToPlan(
-    struct ncclComm* comm, struct ncclKernelPlan* plan, int usableChannels,
-    struct ncclInfo* collInfo, int* nWorkBudget
+    struct ncclComm* comm, struct ncclKernelPlan* plan, int channelBase, int usableChannels,
+    size_t maxBytesPerChannel, struct ncclInfo* collInfo, int* nWorkBudget
   ) {
   ncclResult_t ret = ncclSuccess;
   struct ncclKernelPlan::Channel *chans = plan->channels;
@@ -507,8 +559,20 @@ static ncclResult_t addCBDCollToPlan(
   NCCLCHECKGOTO(computeCollChunkInfo(collInfo, collInfo->aggnBytes, collInfo->nChannels), ret, fail);
   NCCLCHECKGOTO(computeCollAlignCount(collInfo, &alignCount), ret, fail);
   NCCLCHECKGOTO(initCollWorkElem(collInfo, &workElem), ret, fail);
-  for (int c = 0; c < usableChannels; c++) {
-    enqBytes = std::min(plan->maxBytesPerChannel - chans[c].collBytes, workBytesTotal);
+  bool balance = comm->channelBalance && collInfo->algorithm == NCCL_ALGO_RING && collInfo->coll != ncclFuncAllToAllPivot;
+  float bwTotal = 0;
+  if (balance) {
+    for (int c = channelBase; c < channelBase + usableChannels; c++) bwTotal += comm->channelBw[c];
+  }
+  for (int c = channelBase; c < channelBase + usableChannels; c++) {
+    size_t maxBytes = maxBytesPerChannel;
+    if (balance) {
+      maxBytes = (size_t)(maxBytesPerChannel * usableChannels * (comm->channelBw[c] / bwTotal));
+      maxBytes = ROUNDUP(maxBytes, NCCL_BYTES_ALIGNMENT);
+      // The last channel takes whatever rounding left over
+      if (c == channelBase + usableChannels - 1) maxBytes = std::max(maxBytes, chans[c].collBytes + workBytesTotal);
+    }
+    enqBytes = std::min(maxBytes - std::min(maxBytes, chans[c].collBytes), workBytesTotal);
     workCount = std::min(DIVUP(DIVUP(enqBytes, typeSize), alignCount) * alignCount, workCountTotal);
     enqBytes = workCount * typeSize;
 
@@ -518,7 +582,7 @@ static ncclResult_t addCBDCollToPlan(
       workElem.pivotA2ANumBiRings = collInfo->comm->topo->pivotA2ANumBiRings;
       workElem.bid = c;
     } else {
-      if (plan->maxBytesPerChannel <= chans[c].collBytes) continue;
+      if (maxBytes <= chans[c].collBytes) continue;
       if (workBytesTotal == 0) break;
 
       NCCLCHECKGOTO(computeCollLastChunkInfo(collInfo, workCount, alignCount, &lastChunkCount), ret, fail);
@@ -555,12 +619,370 @@ static ncclResult_t addCBDCollToPlan(
 
   plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
   if (!plan->kernelSpecialized) {
-    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm)].kernelFn;
-    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm)].specialized;
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
   }
 
   if (comm->rank == 0) {
-    TRACE(NCCL_COLL, "CBDColl enqueue coll %s(%s, %s, %s, %s), nChannels %d, count %ld (nbytes %ld), usableChannel %d, maxBytesPerChannel %ld, chunkCount %d, lastChunkCount %ld, funcIndex %d, nThreads %d", collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype), ncclAlgoToString(collInfo->algorithm), ncclProtoToString(collInfo->protocol), rnChannel, collInfo->count, collInfo->workBytes, usableChannels, plan->maxBytesPerChannel, collInfo->chunkCount, lastChunkCount, collInfo->workFuncIndex, collInfo->nThreads);
+    TRACE(NCCL_COLL, "CBDColl enqueue coll %s(%s, %s, %s, %s), nChannels %d, count %ld (nbytes %ld), usableChannel %d, maxBytesPerChannel %ld, chunkCount %d, lastChunkCount %ld, funcIndex %d, nThreads %d", collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype), ncclAlgoToString(collInfo->algorithm), ncclProtoToString(collInfo->protocol), rnChannel, collInfo->count, collInfo->workBytes, usableChannels, maxBytesPerChannel, collInfo->chunkCount, lastChunkCount, collInfo->workFuncIndex, collInfo->nThreads);
+  }
+
+exit:
+  return ret;
+fail:
+  goto exit;
+}
+
+// Native AllToAll is spread over the p2p channels: channel c handles peers at
+// distances d = c, c+nChannels, ... and reuses the p2p connectors.
+static inline int allToAllnChannels(struct ncclComm* comm) {
+  return std::min(comm->p2pnChannels, comm->nRanks);
+}
+
+static ncclResult_t addAllToAllCollToPlan(
+    struct ncclComm* comm, struct ncclKernelPlan* plan,
+    struct ncclInfo* collInfo, int* nWorkBudget
+  ) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclKernelPlan::Channel *chans = plan->channels;
+  struct ncclWorkElem workElem;
+  uint64_t opCount = uint64_t(plan->collOpCount++) << 1 | 0;
+  int nChannels = collInfo->nChannels;
+  int nRanks = comm->nRanks;
+  // count is the per-peer byte count since ncclInfoSetDerived() converted it to int8
+  size_t bytes = collInfo->count;
+  int stepSize = comm->p2pChunkSize;
+
+  collInfo->chunkCount = stepSize;
+  NCCLCHECKGOTO(initCollWorkElem(collInfo, &workElem), ret, fail);
+  workElem.connIndex = 1;
+  workElem.nChannels = nChannels;
+
+  for (int c = 0; c < nChannels; c++) {
+    workElem.bid = c;
+    *nWorkBudget += chans[c].nWork;
+    appendWorkElemColl(comm, plan, c, collInfo->workFuncIndex, &workElem);
+    *nWorkBudget -= chans[c].nWork;
+    chans[c].collBytes += bytes * DIVUP(nRanks - c, nChannels);
+  }
+
+  for (int d = 1; d < nRanks; d++) {
+    struct ncclProxyOp proxyOp = {};
+    proxyOp.channelId = d % nChannels;
+    proxyOp.sliceSteps = 1;
+    proxyOp.chunkSteps = 1;
+    proxyOp.dtype = ncclInt8;
+    proxyOp.redOp = ncclDevSum;
+    proxyOp.coll = ncclFuncAllToAll;
+    proxyOp.protocol = NCCL_PROTO_SIMPLE;
+    proxyOp.chunkSize = stepSize;
+    proxyOp.nbytes = std::min(bytes, (size_t)stepSize);
+    proxyOp.nsteps = DIVUP(bytes, stepSize);
+    proxyOp.opCount = opCount;
+    proxyOp.connIndex = 1;
+
+    proxyOp.pattern = ncclPatternSend;
+    proxyOp.root = (comm->rank + d) % nRanks;
+    NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+    proxyOp.pattern = ncclPatternRecv;
+    proxyOp.root = (comm->rank - d + nRanks) % nRanks;
+    NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+  }
+
+  plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
+  if (!plan->kernelSpecialized) {
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
+  }
+
+  if (comm->rank == 0) {
+    TRACE(NCCL_COLL, "allToAll enqueue coll %s(%s), nChannels %d, count %ld per peer, stepSize %d, funcIndex %d, nThreads %d", collInfo->opName, ncclDatatypeToString(collInfo->datatype), nChannels, collInfo->count, stepSize, collInfo->workFuncIndex, collInfo->nThreads);
+  }
+
+exit:
+  return ret;
+fail:
+  goto exit;
+}
+
+// Direct AllReduce splits the buffer evenly over channels [0, nChannels), whose
+// p2p connections to every peer were marked by directPreconnect().
+static ncclResult_t addDirectCollToPlan(
+    struct ncclComm* comm, struct ncclKernelPlan* plan,
+    struct ncclInfo* collInfo, int* nWorkBudget
+  ) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclKernelPlan::Channel *chans = plan->channels;
+  struct ncclWorkElem workElem;
+  uint64_t opCount = uint64_t(plan->collOpCount++) << 1 | 0;
+  uint32_t typeSize = ncclTypeSize(collInfo->datatype);
+  int nChannels = std::min(collInfo->nChannels, comm->directnChannels);
+  size_t alignCount, lastChunkCount, countPerChannels, workCount;
+  size_t workOffset = 0;
+  size_t remCount = collInfo->count;
+  int rnChannels = 0;
+
+  NCCLCHECKGOTO(computeCollAlignCount(collInfo, &alignCount), ret, fail);
+  countPerChannels = DIVUP(DIVUP(collInfo->count, nChannels), alignCount) * alignCount;
+  // Empty collectives still need one work element
+  nChannels = countPerChannels ? DIVUP(collInfo->count, countPerChannels) : 1;
+  NCCLCHECKGOTO(computeCollChunkInfo(collInfo, collInfo->nBytes, nChannels), ret, fail);
+  NCCLCHECKGOTO(initCollWorkElem(collInfo, &workElem), ret, fail);
+
+  for (int c = 0; c < nChannels; c++) {
+    workCount = std::min(countPerChannels, remCount);
+    NCCLCHECKGOTO(computeCollLastChunkInfo(collInfo, workCount, alignCount, &lastChunkCount), ret, fail);
+    NCCLCHECKGOTO(setCollWorkElem(workCount, workOffset, lastChunkCount, &workElem), ret, fail);
+
+    *nWorkBudget += chans[c].nWork;
+    appendWorkElemColl(comm, plan, c, collInfo->workFuncIndex, &workElem);
+    *nWorkBudget -= chans[c].nWork;
+
+    // One proxy op per channel, saved by the proxy for every peer
+    if (collInfo->nBytes != 0) {
+      uint32_t steps;
+      struct ncclProxyOp proxyOp;
+      NCCLCHECKGOTO(computeCollSteps(collInfo, workCount, &steps), ret, fail);
+      NCCLCHECKGOTO(initCollProxyOp(collInfo, c, opCount, steps, &proxyOp), ret, fail);
+      NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+    }
+
+    remCount -= workCount;
+    chans[c].collBytes += workCount * typeSize;
+    workOffset += workCount;
+    rnChannels++;
+  }
+
+  plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
+  if (!plan->kernelSpecialized) {
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
+  }
+
+  if (comm->rank == 0) {
+    TRACE(NCCL_COLL, "directColl enqueue coll %s(%s, %s, %s), %d-shot, nChannels %d, count %ld (nbytes %ld), chunkCount %d, lastChunkCount %ld, funcIndex %d, nThreads %d", collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype), ncclProtoToString(collInfo->protocol), workElem.direct, rnChannels, collInfo->count, collInfo->workBytes, collInfo->chunkCount, lastChunkCount, collInfo->workFuncIndex, collInfo->nThreads);
+  }
+
+exit:
+  return ret;
+fail:
+  goto exit;
+}
+
+// Steps each RHD peer of a channel sends and receives for workCount elements,
+// following runRhd() in all_reduce.h: peer k is rhd->peers[k], peer nSteps the
+// fold partner.
+static void rhdProxySteps(struct ncclRhd* rhd, size_t workCount, size_t chunkCount, size_t alignCount,
+    uint32_t* sendSteps, uint32_t* recvSteps) {
+  int nSteps = rhd->nSteps;
+  for (int k = 0; k <= nSteps; k++) sendSteps[k] = recvSteps[k] = 0;
+  if (rhd->extra != -1) {
+    sendSteps[nSteps] = recvSteps[nSteps] = DIVUP(workCount, chunkCount);
+    if (rhd->vrank == -1) return;
+  }
+  size_t blockCount = DIVUP(DIVUP(workCount, (size_t)1 << nSteps), alignCount) * alignCount;
+  auto blockOffset = [&](size_t b) { return std::min(b*blockCount, workCount); };
+  auto blockSteps = [&](size_t b, size_t n) { return (uint32_t)DIVUP(blockOffset(b+n) - blockOffset(b), chunkCount); };
+  size_t lo = 0, nBlocks = (size_t)1 << nSteps;
+  for (int k = 0; k < nSteps; k++) {
+    size_t half = nBlocks/2;
+    size_t keep = (rhd->vrank & (1<<k)) ? lo+half : lo;
+    size_t give = (rhd->vrank & (1<<k)) ? lo : lo+half;
+    sendSteps[k] += blockSteps(give, half);
+    recvSteps[k] += blockSteps(keep, half);
+    lo = keep;
+    nBlocks = half;
+  }
+  for (int k = nSteps-1; k >= 0; k--) {
+    size_t other = (rhd->vrank & (1<<k)) ? lo-nBlocks : lo+nBlocks;
+    sendSteps[k] += blockSteps(lo, nBlocks);
+    recvSteps[k] += blockSteps(other, nBlocks);
+    lo = std::min(lo, other);
+    nBlocks *= 2;
+  }
+}
+
+// RHD AllReduce splits the buffer evenly over channels [0, nChannels). Each peer
+// moves a different amount of data, so proxy ops are added per peer like p2p ops.
+static ncclResult_t addRhdCollToPlan(
+    struct ncclComm* comm, struct ncclKernelPlan* plan,
+    struct ncclInfo* collInfo, int* nWorkBudget
+  ) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclKernelPlan::Channel *chans = plan->channels;
+  struct ncclWorkElem workElem;
+  uint64_t opCount = uint64_t(plan->collOpCount++) << 1 | 0;
+  uint32_t typeSize = ncclTypeSize(collInfo->datatype);
+  int nChannels = std::min(collInfo->nChannels, comm->rhdnChannels);
+  size_t alignCount, countPerChannels, workCount;
+  size_t workOffset = 0;
+  size_t remCount = collInfo->count;
+  uint32_t sendSteps[NCCL_MAX_RHD_STEPS+1], recvSteps[NCCL_MAX_RHD_STEPS+1];
+
+  NCCLCHECKGOTO(computeCollAlignCount(collInfo, &alignCount), ret, fail);
+  countPerChannels = DIVUP(DIVUP(collInfo->count, nChannels), alignCount) * alignCount;
+  // Empty collectives still need one work element
+  nChannels = countPerChannels ? DIVUP(collInfo->count, countPerChannels) : 1;
+  NCCLCHECKGOTO(computeCollChunkInfo(collInfo, collInfo->nBytes, nChannels), ret, fail);
+  NCCLCHECKGOTO(initCollWorkElem(collInfo, &workElem), ret, fail);
+
+  for (int c = 0; c < nChannels; c++) {
+    struct ncclRhd* rhd = &comm->channels[c].rhd;
+    workCount = std::min(countPerChannels, remCount);
+    NCCLCHECKGOTO(setCollWorkElem(workCount, workOffset, collInfo->chunkCount, &workElem), ret, fail);
+
+    *nWorkBudget += chans[c].nWork;
+    appendWorkElemColl(comm, plan, c, collInfo->workFuncIndex, &workElem);
+    *nWorkBudget -= chans[c].nWork;
+
+    if (collInfo->nBytes != 0) {
+      rhdProxySteps(rhd, workCount, collInfo->chunkCount, std::max<size_t>(1, 16/typeSize), sendSteps, recvSteps);
+      for (int k = 0; k <= rhd->nSteps; k++) {
+        int peer = k < rhd->nSteps ? rhd->peers[k] : rhd->extra;
+        if (peer == -1) continue;
+        struct ncclProxyOp proxyOp;
+        NCCLCHECKGOTO(initCollProxyOp(collInfo, c, opCount, sendSteps[k], &proxyOp), ret, fail);
+        proxyOp.root = peer;
+        if (sendSteps[k]) {
+          proxyOp.pattern = ncclPatternSend;
+          NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+        }
+        if (recvSteps[k]) {
+          proxyOp.pattern = ncclPatternRecv;
+          proxyOp.nsteps = recvSteps[k];
+          NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+        }
+      }
+    }
+
+    remCount -= workCount;
+    chans[c].collBytes += workCount * typeSize;
+    workOffset += workCount;
+  }
+
+  plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
+  if (!plan->kernelSpecialized) {
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
+  }
+
+  if (comm->rank == 0) {
+    TRACE(NCCL_COLL, "rhdColl enqueue coll %s(%s, %s, %s), nChannels %d, count %ld (nbytes %ld), chunkCount %d, funcIndex %d, nThreads %d", collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype), ncclProtoToString(collInfo->protocol), nChannels, collInfo->count, collInfo->workBytes, collInfo->chunkCount, collInfo->workFuncIndex, collInfo->nThreads);
+  }
+
+exit:
+  return ret;
+fail:
+  goto exit;
+}
+
+// Largest per-peer message sent with the Bruck AllToAll, and the largest
+// step that still goes through LL
+RCCL_PARAM(AllToAllBruckThreshold, "ALLTOALL_BRUCK_THRESHOLD", 1024);
+RCCL_PARAM(AllToAllBruckLLThreshold, "ALLTOALL_BRUCK_LL_THRESHOLD", 65536);
+
+// The Bruck AllToAll keeps all the blocks and two packs of up to nRanks/2 blocks
+// in the channel scratch, see runBruck() in alltoall.h.
+bool ncclAllToAllUseBruck(struct ncclComm* comm, size_t count, ncclDataType_t datatype) {
+  size_t bytes = count*ncclTypeSize(datatype);
+  return comm->bruckSupport && comm->bruckScratch && bytes != 0 && bytes <= rcclParamAllToAllBruckThreshold() &&
+    2*comm->nRanks*bytes <= comm->bruckScratchBytes;
+}
+
+// Steps each Bruck peer sends and receives for a collective of count elements
+// per rank, following runBruck() in all_gather.h, reduce_scatter.h and
+// alltoall.h: step k sends to sendPeers[k] and receives from recvPeers[k].
+static void bruckProxySteps(struct ncclComm* comm, ncclFunc_t coll, size_t count, size_t chunkCount,
+    int* sendPeers, int* recvPeers, uint32_t* sendSteps, uint32_t* recvSteps) {
+  int rank = comm->rank, nranks = comm->nRanks;
+  int nSteps = comm->channels[0].bruck.nSteps;
+  bool allGather = coll == ncclFuncAllGather;
+  int held = 0;
+  if (coll == ncclFuncAllToAll) {
+    // Step k packs the blocks whose index has bit k set
+    for (int k = 0; k < nSteps; k++) {
+      int dist = 1<<k;
+      int nBlocks = ((nranks >> (k+1)) << k) + std::max(0, (nranks & (2*dist-1)) - dist);
+      sendPeers[k] = (rank+dist) % nranks;
+      recvPeers[k] = (rank+nranks-dist) % nranks;
+      sendSteps[k] = recvSteps[k] = DIVUP(nBlocks*count, chunkCount);
+    }
+    return;
+  }
+  for (int s = 0; s < nSteps; s++) {
+    int k = allGather ? s : nSteps-1-s;
+    int dist = 1<<k;
+    int nBlocks = std::min(dist, nranks-dist);
+    int up = (rank+dist) % nranks, down = (rank+nranks-dist) % nranks;
+    auto nChunks = [&](int wrap, int cut0, int cut1) {
+      uint32_t steps = 0;
+      for (int64_t i = 0; i < nBlocks*(int64_t)count; i += ncclBruckChunk(i, count, nBlocks, wrap, cut0, cut1, chunkCount)) steps++;
+      return steps;
+    };
+    // AllGather sends down and receives from above, ReduceScatter the other way
+    sendPeers[k] = allGather ? down : up;
+    recvPeers[k] = allGather ? up : down;
+    if (allGather) {
+      sendSteps[k] = nChunks(nranks-rank, 0, 0);
+      recvSteps[k] = nChunks(nranks-up, 0, 0);
+    } else {
+      sendSteps[k] = nChunks(nranks-up, held-dist, held);
+      recvSteps[k] = nChunks(nranks-rank, held-dist, held);
+      held = std::max(held, nBlocks);
+    }
+  }
+}
+
+// Bruck AllGather / ReduceScatter runs on a single channel, the least loaded of
+// [0, brucknChannels). Each peer moves a different amount of data, so proxy ops
+// are added per peer like p2p ops.
+static ncclResult_t addBruckCollToPlan(
+    struct ncclComm* comm, struct ncclKernelPlan* plan,
+    struct ncclInfo* collInfo, int* nWorkBudget
+  ) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclKernelPlan::Channel *chans = plan->channels;
+  struct ncclWorkElem workElem;
+  uint64_t opCount = uint64_t(plan->collOpCount++) << 1 | 0;
+  int sendPeers[NCCL_MAX_BRUCK_STEPS], recvPeers[NCCL_MAX_BRUCK_STEPS];
+  uint32_t sendSteps[NCCL_MAX_BRUCK_STEPS], recvSteps[NCCL_MAX_BRUCK_STEPS];
+  int c = 0;
+
+  for (int i = 1; i < comm->brucknChannels; i++) {
+    if (chans[i].collBytes < chans[c].collBytes) c = i;
+  }
+  NCCLCHECKGOTO(computeCollChunkInfo(collInfo, collInfo->nBytes, 1), ret, fail);
+  NCCLCHECKGOTO(initCollWorkElem(collInfo, &workElem), ret, fail);
+  NCCLCHECKGOTO(setCollWorkElem(collInfo->count, 0, collInfo->chunkCount, &workElem), ret, fail);
+
+  *nWorkBudget += chans[c].nWork;
+  appendWorkElemColl(comm, plan, c, collInfo->workFuncIndex, &workElem);
+  *nWorkBudget -= chans[c].nWork;
+
+  if (collInfo->nBytes != 0) {
+    bruckProxySteps(comm, collInfo->coll, collInfo->count, collInfo->chunkCount, sendPeers, recvPeers, sendSteps, recvSteps);
+    for (int k = 0; k < comm->channels[c].bruck.nSteps; k++) {
+      struct ncclProxyOp proxyOp;
+      NCCLCHECKGOTO(initCollProxyOp(collInfo, c, opCount, sendSteps[k], &proxyOp), ret, fail);
+      proxyOp.pattern = ncclPatternSend;
+      proxyOp.root = sendPeers[k];
+      NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+      proxyOp.pattern = ncclPatternRecv;
+      proxyOp.root = recvPeers[k];
+      proxyOp.nsteps = recvSteps[k];
+      NCCLCHECKGOTO(addProxyOpIfNeeded(comm, plan, &proxyOp), ret, fail);
+    }
+  }
+  chans[c].collBytes += collInfo->nBytes;
+
+  plan->threadPerBlock = std::max(plan->threadPerBlock, collInfo->nThreads);
+  if (!plan->kernelSpecialized) {
+    plan->kernelFn = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].kernelFn;
+    plan->kernelSpecialized = ncclKerns[ncclGetKernelIndex(comm, collInfo->autotuneKernel-1)].specialized;
+  }
+
+  if (comm->rank == 0) {
+    TRACE(NCCL_COLL, "bruckColl enqueue coll %s(%s, %s, %s), channel %d, count %ld (nbytes %ld), chunkCount %d, funcIndex %d, nThreads %d", collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype), ncclProtoToString(collInfo->protocol), c, collInfo->count, collInfo->nBytes, collInfo->chunkCount, collInfo->workFuncIndex, collInfo->nThreads);
   }
 
 exit:
@@ -573,9 +995,19 @@ NCCL_PARAM(P2pLLThreshold, "P2P_LL_THRESHOLD", 16384);
 
 // Put p2p op in plan assuming there is space in nWorkBudget, so you must
 // ensure *nWorkBudget >= 1 upon entry.
+RCCL_PARAM(P2pHeavyThreshold, "P2P_HEAVY_THRESHOLD", 4 << 20);
+
+// Number of channels a send/recv of bytes is spread over. Heavy ones, typically the
+// few large peers of a skewed AllToAllv, get more channels, hence more NICs. Both
+// sides see the same byte count and agree on the channels.
+static int p2pChannelsPerPeer(struct ncclComm* comm, size_t bytes) {
+  return bytes >= (size_t)rcclParamP2pHeavyThreshold() ? comm->p2pnChannelsPerPeerHeavy : comm->p2pnChannelsPerPeer;
+}
+
 static ncclResult_t addP2pToPlan(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget,
-    bool isSendNotRecv, int peer, int chunk, void *addr, size_t bytes, uint32_t connIndex, bool fuseOk
+    bool isSendNotRecv, int peer, int chunk, int nChannelsPeer, void *addr, size_t bytes, uint32_t connIndex,
+    bool ipcReg, void* peerBuff, bool fuseOk
   ) {
   struct ncclInfo info = {
     isSendNotRecv ? ncclFuncSend : ncclFuncRecv,
@@ -585,7 +1017,7 @@ static ncclResult_t addP2pToPlan(
   };
 
   int channelId;
-  NCCLCHECK(ncclChannelCompute(comm, peer, chunk%comm->p2pnChannelsPerPeer, info.coll, &channelId));
+  NCCLCHECK(ncclChannelCompute(comm, peer, chunk%nChannelsPeer, info.coll, &channelId));
   info.channelId = channelId;
 
   // 1 is connIndex
@@ -598,6 +1030,12 @@ static ncclResult_t addP2pToPlan(
   if (info.protocol == NCCL_PROTO_SIMPLE) {
     struct ncclReg* regRecord;
     NCCLCHECK(ncclRegFind(comm, addr, bytes, &regRecord));
+    struct ncclConnector* connector = isSendNotRecv ?
+      &comm->channels[channelId].peers[peer]->send[1] : &comm->channels[channelId].peers[peer]->recv[1];
+    bool useNet = connector->transportComm == (isSendNotRecv ? &netTransport.send : &netTransport.recv);
+    if (regRecord == NULL && addr != nullptr && peer != comm->rank && useNet && connector->proxyConn.sameProcess) {
+      NCCLCHECK(ncclRegAutoRegister(comm, addr, bytes, &regRecord));
+    }
     reg = regRecord && regRecord->nDevs ? 1 : 0;
   }
 
@@ -611,6 +1049,7 @@ static ncclResult_t addP2pToPlan(
   elem.peer = addr == nullptr ? -1 : peer;
   elem.nWarps = NCCL_MAX_NTHREADS/comm->WarpSize;
   elem.reg = proxyOp.reg;
+  elem.ipcReg = ipcReg && info.protocol == NCCL_PROTO_SIMPLE && addr != nullptr;
   elem.p2pType = isSendNotRecv ? ncclWorkP2pTypeSend : ncclWorkP2pTypeRecv;
   elem.buffLo32 = uint32_t(reinterpret_cast<uintptr_t>(addr));
   elem.buffHi32 = reinterpret_cast<uintptr_t>(addr)>>32;
@@ -621,7 +1060,7 @@ static ncclResult_t addP2pToPlan(
   elem.connIndex = connIndex;
 
   *nWorkBudget += plan->channels[channelId].nWork;
-  appendWorkElemP2p(comm, plan, channelId, &elem, fuseOk);
+  appendWorkElemP2p(comm, plan, channelId, &elem, elem.ipcReg ? peerBuff : nullptr, fuseOk);
   *nWorkBudget -= plan->channels[channelId].nWork;
 
   // Calculate the opCount after appendWorkElemP2p since it will always return
@@ -743,7 +1182,7 @@ static ncclResult_t registerIntraNodeBuffers(
         for (int sr=0; sr < 2; sr++) {
           // Get base address of mapping
           void* base;
-          CUDACHECK(cudaIpcOpenMemHandle(&base, handles[i].ipc[sr], cudaIpcMemLazyEnablePeerAccess));
+          NCCLCHECK(ncclIpcCacheOpen(&handles[i].ipc[sr], &base));
           // Get real buffer address by adding offset in the mapping
           (sr == 0 ? info->regBufSend : info->regBufRecv)[i] = (char*)base + handles[i].offset[sr];
           // Enqueue reminder to close memory handle
@@ -784,6 +1223,95 @@ exit:
   return ncclSuccess;
 }
 
+// Remembers what the plan runs so that a plan holding a single collective can be
+// timed for the tuner plugin.
+static void tunerNoteColl(struct ncclKernelPlan* plan, struct ncclInfo* collInfo) {
+  plan->tunerNColl++;
+  plan->tunerColl.collType = collInfo->coll;
+  plan->tunerColl.nBytes = collInfo->nBytes;
+  plan->tunerColl.algorithm = collInfo->algorithm;
+  plan->tunerColl.protocol = collInfo->protocol;
+  plan->tunerColl.nChannels = collInfo->nChannels;
+  plan->tunerColl.timeUs = 0;
+  plan->tunerColl.chunkSize = collInfo->chunkSize;
+  plan->tunerAutotuneSample = collInfo->autotuneSample;
+  if (plan->timingNColls++ == 0) plan->timingColl = plan->tunerColl;
+  plan->timingBytes += collInfo->nBytes;
+}
+
+RCCL_PARAM(FusedChannelPartition, "FUSED_CHANNEL_PARTITION", 1);
+RCCL_PARAM(TuningCache, "TUNING_CACHE", 1024);
+
+// Training loops enqueue the same collectives every step. With the built-in model the
+// tuning of a collective only depends on its class, its count and the count of the
+// aggregate it belongs to, so the result is cached per communicator. The tuner plugin
+// and the autotuner may answer differently over time and bypass the cache.
+static bool tuningCacheUsable(struct ncclComm* comm) {
+  if (comm->tuner != NULL || comm->autotune != NULL) return false;
+  if (comm->tuningCache == NULL) {
+    if (rcclParamTuningCache() <= 0) return false;
+    if (ncclCalloc(&comm->tuningCache, rcclParamTuningCache()) != ncclSuccess) return false;
+    comm->tuningCacheSize = rcclParamTuningCache();
+  }
+  return true;
+}
+
+static struct ncclTuningCacheEntry* tuningCacheSlot(struct ncclComm* comm, struct ncclInfo* info, size_t aggCount) {
+  uint64_t h = info->count * 0x9e3779b97f4a7c15ULL;
+  h ^= (aggCount + (h << 6) + (h >> 2)) * 0xbf58476d1ce4e5b9ULL;
+  h ^= ((uint64_t)info->coll << 16) | ((uint64_t)info->opFull.op << 8) | info->datatype;
+  h ^= h >> 31;
+  return comm->tuningCache + h % comm->tuningCacheSize;
+}
+
+static struct ncclTuningCacheEntry* tuningCacheFind(struct ncclComm* comm, struct ncclInfo* info, size_t aggCount) {
+  struct ncclTuningCacheEntry* e = tuningCacheSlot(comm, info, aggCount);
+  if (e->count == info->count && e->aggCount == aggCount && e->coll == info->coll &&
+      e->op == info->opFull.op && e->datatype == info->datatype) return e;
+  return NULL;
+}
+
+// Colliding entries are simply replaced
+static void tuningCacheInsert(struct ncclComm* comm, struct ncclInfo* info, size_t aggCount) {
+  struct ncclTuningCacheEntry* e = tuningCacheSlot(comm, info, aggCount);
+  e->count = info->count;
+  e->aggCount = aggCount;
+  e->coll = info->coll;
+  e->op = info->opFull.op;
+  e->datatype = info->datatype;
+  e->userTuned = info->userTuned;
+  e->algorithm = info->algorithm;
+  e->protocol = info->protocol;
+  e->pattern = info->pattern;
+  e->workFuncIndex = info->workFuncIndex;
+  e->nChannels = info->nChannels;
+  e->nThreads = info->nThreads;
+  e->aggnBytes = info->aggnBytes;
+}
+
+static void tuningCacheApply(struct ncclTuningCacheEntry* e, struct ncclInfo* info) {
+  info->userTuned = e->userTuned;
+  info->algorithm = e->algorithm;
+  info->protocol = e->protocol;
+  info->pattern = (ncclPattern_t)e->pattern;
+  info->workFuncIndex = e->workFuncIndex;
+  info->nChannels = e->nChannels;
+  info->nThreads = e->nThreads;
+  info->aggnBytes = e->aggnBytes;
+}
+
+// Collectives of the same class are aggregated and share channels.
+static inline bool sameCollClass(struct ncclInfo* a, struct ncclInfo* b) {
+  return a->coll == b->coll && a->opFull.op == b->opFull.op && a->datatype == b->datatype;
+}
+
+// Rooted collectives of the same class but from different roots, like the weight
+// broadcasts of pipeline stages, get channels of their own in a fused group.
+static inline bool sameChannelRun(struct ncclInfo* a, struct ncclInfo* b) {
+  if (!sameCollClass(a, b)) return false;
+  return (a->coll != ncclFuncBroadcast && a->coll != ncclFuncReduce) || a->root == b->root;
+}
+
 static ncclResult_t scheduleCollTasksToPlan(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget
   ) {
@@ -798,11 +1326,38 @@ static ncclResult_t scheduleCollTasksToPlan(
     while (!ncclIntruQueueEmpty(&tasks->collQueue)) {
       collInfo = ncclIntruQueueDequeue(&tasks->collQueue);
       if (collInfo->count == 0) continue;
+      if (collInfo->coll == ncclFuncAllToAll && ncclAllToAllUseBruck(comm, collInfo->count, collInfo->datatype)) {
+        // Small blocks are aggregated by the Bruck kernel, on all the threads of the block
+        size_t stepBytes = (comm->nRanks/2)*collInfo->count*ncclTypeSize(collInfo->datatype);
+        collInfo->algorithm = NCCL_ALGO_BRUCK;
+        collInfo->protocol = stepBytes <= rcclParamAllToAllBruckLLThreshold() ? NCCL_PROTO_LL : NCCL_PROTO_SIMPLE;
+        collInfo->pattern = ncclPatternBruck;
+        collInfo->nThreads = NCCL_MAX_NTHREADS;
+        collInfo->nChannels = 1;
+        NCCLCHECK(computeCollWorkFunc(collInfo));
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collBruckQueue, collInfo);
+        continue;
+      }
+      if (collInfo->coll == ncclFuncAllToAll) {
+        // Native alltoall does not go through the tuner nor the CBD layout
+        collInfo->algorithm = NCCL_ALGO_RING;
+        collInfo->protocol = NCCL_PROTO_SIMPLE;
+        collInfo->pattern = ncclPatternSend;
+        collInfo->nThreads = NCCL_MAX_NTHREADS;
+        collInfo->nChannels = allToAllnChannels(comm);
+        NCCLCHECK(computeCollWorkFunc(collInfo));
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collA2AQueue, collInfo);
+        continue;
+      }
       if (collInfo->algorithm == NCCL_ALGO_UNDEF) {
         struct ncclInfo* aggInfo = ncclMemoryStackAlloc<struct ncclInfo>(&comm->memScoped);
         struct ncclInfo* nextInfo = collInfo->next;
-        int nvlsSupport;
-        int collNetSupport;
+        int nvlsSupport = 0;
+        int collNetSupport = 0;
 
         memcpy(aggInfo, collInfo, sizeof(struct ncclInfo));
         while (nextInfo) {
@@ -814,29 +1369,58 @@ static ncclResult_t scheduleCollTasksToPlan(
           }
         }
 
-        nvlsSupport = comm->nvlsSupport && ncclNvlsSupported(aggInfo->opFull.op, aggInfo->datatype);
-        NCCLCHECK(getCollNetSupport(aggInfo, &collNetSupport));
-        NCCLCHECK(ncclInfoSetDerived(aggInfo, comm->nRanks));
-        NCCLCHECK(getTunerInfo(aggInfo, collNetSupport, nvlsSupport, 1));
-        NCCLCHECK(topoGetAlgoInfo(aggInfo, collNetSupport, nvlsSupport, 1));
-        NCCLCHECK(getChannnelThreadInfo(aggInfo));
-        NCCLCHECK(computeCollWorkFunc(aggInfo));
-        NCCLCHECK(getPatternInfo(aggInfo));
+        bool aggregated = aggInfo->count != collInfo->count;
+        int autotuneChannels = -1;
+        // Tuning is skipped when every collective of the aggregate was seen before
+        bool useCache = tuningCacheUsable(comm);
+        bool cached = useCache;
+        for (nextInfo = collInfo; cached && nextInfo && sameCollClass(nextInfo, aggInfo); nextInfo = nextInfo->next) {
+          cached = tuningCacheFind(comm, nextInfo, aggInfo->count) != NULL;
+        }
+        if (cached) {
+          comm->tuningCacheHits++;
+        } else {
+          if (useCache) comm->tuningCacheMisses++;
+          nvlsSupport = comm->nvlsSupport && ncclNvlsSupported(aggInfo->opFull.op, aggInfo->datatype);
+          NCCLCHECK(getCollNetSupport(aggInfo, &collNetSupport));
+          NCCLCHECK(ncclInfoSetDerived(aggInfo, comm->nRanks));
+          NCCLCHECK(getTunerInfo(aggInfo, collNetSupport, nvlsSupport, 1));
+          // The built-in autotuner only handles collectives that were not aggregated
+          if (comm->autotune && !aggregated) {
+            NCCLCHECK(getAutotuneInfo(aggInfo, collNetSupport, nvlsSupport, &autotuneChannels));
+          }
+          NCCLCHECK(topoGetAlgoInfo(aggInfo, collNetSupport, nvlsSupport, 1));
+          NCCLCHECK(getChannnelThreadInfo(aggInfo));
+          NCCLCHECK(computeCollWorkFunc(aggInfo));
+          NCCLCHECK(getPatternInfo(aggInfo));
+        }
 
         // Try to assign algo and proto to all possible collectives
         nextInfo = collInfo;
         while (nextInfo) {
           if (nextInfo->coll == aggInfo->coll && nextInfo->opFull.op == aggInfo->opFull.op && nextInfo->datatype == aggInfo->datatype) {
             NCCLCHECK(ncclInfoSetDerived(nextInfo, comm->nRanks));
-            NCCLCHECK(getTunerInfo(nextInfo, collNetSupport, nvlsSupport, 1));
-            nextInfo->algorithm = aggInfo->algorithm;
-            nextInfo->protocol = aggInfo->protocol;
-            nextInfo->nThreads = aggInfo->nThreads;
-            nextInfo->pattern = aggInfo->pattern;
-            nextInfo->workFuncIndex = aggInfo->workFuncIndex;
-            nextInfo->aggnBytes = aggInfo->nBytes;
-
-            NCCLCHECK(getChannnelThreadInfo(nextInfo));
+            if (cached) {
+              tuningCacheApply(tuningCacheFind(comm, nextInfo, aggInfo->count), nextInfo);
+            } else {
+              NCCLCHECK(getTunerInfo(nextInfo, collNetSupport, nvlsSupport, 1));
+              if (autotuneChannels >= 0) {
+                nextInfo->nChannels = autotuneChannels;
+                nextInfo->userTuned = autotuneChannels != 0;
+                nextInfo->autotuneSample = aggInfo->autotuneSample;
+                nextInfo->autotuneKernel = aggInfo->autotuneKernel;
+                nextInfo->autotuneThreads = aggInfo->autotuneThreads;
+              }
+              nextInfo->algorithm = aggInfo->algorithm;
+              nextInfo->protocol = aggInfo->protocol;
+              nextInfo->nThreads = aggInfo->nThreads;
+              nextInfo->pattern = aggInfo->pattern;
+              nextInfo->workFuncIndex = aggInfo->workFuncIndex;
+              nextInfo->aggnBytes = aggInfo->nBytes;
+
+              NCCLCHECK(getChannnelThreadInfo(nextInfo));
+              if (useCache) tuningCacheInsert(comm, nextInfo, aggInfo->count);
+            }
             // if possible, start registration
             registerIntraNodeBuffers(comm, plan, nextInfo);
             // accumulate channels
@@ -854,11 +1438,31 @@ static ncclResult_t scheduleCollTasksToPlan(
         usableChannels = std::max(usableChannels, comm->collChannels);
       }
 
-      if (collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT || collInfo->algorithm == NCCL_ALGO_COLLNET_CHAIN || (collInfo->algorithm == NCCL_ALGO_NVLS && comm->nNodes > 1)) {
+      if (collInfo->algorithm == NCCL_ALGO_DIRECT) {
+        // Direct colls run on the channels connected by directPreconnect()
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collDirectQueue, collInfo);
+      } else if (collInfo->algorithm == NCCL_ALGO_RHD) {
+        // RHD colls run on the channels connected by ncclTransportRhdConnect()
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collRhdQueue, collInfo);
+      } else if (collInfo->algorithm == NCCL_ALGO_BRUCK) {
+        // Bruck colls run on the channels connected by ncclTransportBruckConnect()
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collBruckQueue, collInfo);
+      } else if (collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT || collInfo->algorithm == NCCL_ALGO_COLLNET_CHAIN || (collInfo->algorithm == NCCL_ALGO_NVLS && comm->nNodes > 1)) {
         // substract collective which needs to be executed separately
         totalCBDBytes -= collInfo->workBytes;
         tasks->workBytesTotal -= collInfo->workBytes;
         ncclIntruQueueEnqueue(&tasks->collnetQueue, collInfo);
+      } else if (ncclDevRedOpIsJit(collInfo->opFull.op)) {
+        // Runs in the kernel of the module of its reduction, in a plan of its own
+        totalCBDBytes -= collInfo->workBytes;
+        tasks->workBytesTotal -= collInfo->workBytes;
+        ncclIntruQueueEnqueue(&tasks->collJitQueue, collInfo);
       } else if (collInfo->userTuned) {
         // substract collective which needs to be executed separately
         totalCBDBytes -= collInfo->workBytes;
@@ -869,44 +1473,198 @@ static ncclResult_t scheduleCollTasksToPlan(
       }
     }
 
-    tasks->usableChannels = std::min(usableChannels, accChannels);
+    // accChannels stays 0 when only native alltoall colls were queued
+    if (accChannels) tasks->usableChannels = std::min(usableChannels, accChannels);
+  }
+
+  // A stream bound to a partition keeps its CBD colls on that partition's slice of
+  // the channels, so that kernels from other partitions can run at the same time.
+  // Anything laid out over all channels makes the launch a full one again.
+  if (tasks->streamPart >= 0) {
+    int partChannels = comm->collChannels / comm->nStreamParts;
+    if (!ncclIntruQueueEmpty(&tasks->collTunedQueue) || !ncclIntruQueueEmpty(&tasks->collnetQueue) ||
+        !ncclIntruQueueEmpty(&tasks->collA2AQueue) || !ncclIntruQueueEmpty(&tasks->collDirectQueue) ||
+        !ncclIntruQueueEmpty(&tasks->collRhdQueue) || !ncclIntruQueueEmpty(&tasks->collBruckQueue) ||
+        !ncclIntruQueueEmpty(&tasks->collJitQueue)) {
+      partChannels = 0;
+    }
+    for (struct ncclInfo* info = ncclIntruQueueHead(&tasks->collCBDQueue); info != nullptr; info = info->next) {
+      if (info->coll == ncclFuncAllToAllPivot) partChannels = 0;
+    }
+    if (partChannels > 0) {
+      tasks->partBase = tasks->streamPart * partChannels;
+      tasks->usableChannels = std::min(tasks->usableChannels, partChannels);
+    } else {
+      tasks->streamPart = -1;
+    }
+  }
+
+  // Collectives of a runtime-compiled reduction come first, in a plan holding only
+  // the consecutive ones of the same reduction: the kernel of its module runs
+  // nothing else. The plans that follow take the other colls.
+  if (!ncclIntruQueueEmpty(&tasks->collJitQueue)) {
+    int jitOp = ncclIntruQueueHead(&tasks->collJitQueue)->opFull.op;
+    while (!ncclIntruQueueEmpty(&tasks->collJitQueue)) {
+      collInfo = ncclIntruQueueHead(&tasks->collJitQueue);
+      if (collInfo->opFull.op != jitOp || *nWorkBudget < collInfo->nChannels) break;
+
+      collInfo = ncclIntruQueueDequeue(&tasks->collJitQueue);
+      NCCLCHECK(addTunedCollToPlan(comm, plan, tasks->usableChannels, collInfo, nWorkBudget));
+      int unroll = collInfo->autotuneKernel > 0 ? collInfo->autotuneKernel-1 : std::max(comm->kernelUnroll, 0);
+      plan->jitKernel = ncclJitRedOpGet(jitOp)->kernels[unroll];
+      tunerNoteColl(plan, collInfo);
+      ncclStatsNoteColl(comm, collInfo);
+      tasks->nTasksColl -= 1;
+    }
+    return ncclSuccess;
   }
 
   /* Calculate maxBytesPerChannel for CBD colls and it should be 16 bytes aligned
    * Note: it it not hard upper bound for maxBytes, we can relax it if any optimization
    * is needed */
   plan->maxBytesPerChannel = DIVUP(DIVUP(totalCBDBytes, tasks->usableChannels), NCCL_BYTES_ALIGNMENT) * NCCL_BYTES_ALIGNMENT;
+
+  // Groups mixing several kinds of collectives (e.g. AllReduce and AllGather)
+  // give each run of the same (coll, op, datatype) its own range of channels,
+  // sized by bytes, so that the kinds run side by side in the kernel instead of
+  // one after the other on shared channels. Broadcasts and Reduces from different
+  // roots are separate runs.
+  int nRuns = 0;
+  int runBase[MAXCHANNELS], runChannels[MAXCHANNELS];
+  size_t runBytes[MAXCHANNELS], runTotal = 0;
+  if (rcclParamFusedChannelPartition() && !ncclIntruQueueEmpty(&tasks->collCBDQueue)) {
+    struct ncclInfo* prev = nullptr;
+    for (struct ncclInfo* info = ncclIntruQueueHead(&tasks->collCBDQueue); info != nullptr; info = info->next) {
+      if (info->coll == ncclFuncAllToAllPivot) { nRuns = 0; break; }
+      if (prev == nullptr || !sameChannelRun(prev, info)) {
+        if (nRuns == tasks->usableChannels) { nRuns = 0; break; }
+        runBytes[nRuns++] = 0;
+      }
+      runBytes[nRuns-1] += info->count * ncclTypeSize(info->datatype);
+      runTotal += info->count * ncclTypeSize(info->datatype);
+      prev = info;
+    }
+    if (nRuns > 1 && runTotal > 0) {
+      // At least one channel per run, the rest shared out by largest remainder
+      int left = tasks->usableChannels - nRuns;
+      size_t rem[MAXCHANNELS];
+      for (int r = 0; r < nRuns; r++) {
+        size_t share = runBytes[r] * left;
+        runChannels[r] = 1 + share / runTotal;
+        rem[r] = share % runTotal;
+      }
+      for (int r = 0; r < nRuns; r++) left -= runChannels[r] - 1;
+      while (left-- > 0) {
+        int best = 0;
+        for (int r = 1; r < nRuns; r++) if (rem[r] > rem[best]) best = r;
+        runChannels[best]++;
+        rem[best] = 0;
+      }
+      for (int r = 0; r < nRuns; r++) runBase[r] = r == 0 ? 0 : runBase[r-1] + runChannels[r-1];
+    } else {
+      nRuns = 0;
+    }
+  }
+
   // First enqueue CBD colls
+  int run = -1;
+  struct ncclInfo* prevInfo = nullptr;
   while (!ncclIntruQueueEmpty(&tasks->collCBDQueue)) {
     // Get nChannels and peek whether the budget allows before we enqueue
     collInfo = ncclIntruQueueHead(&tasks->collCBDQueue);
-    collInfo->nChannels = DIVUP(collInfo->aggnBytes * tasks->usableChannels, totalCBDBytes);
+    int channelBase = tasks->partBase;
+    int usableChannels = tasks->usableChannels;
+    size_t maxBytesPerChannel = plan->maxBytesPerChannel;
+    if (nRuns > 1) {
+      if (prevInfo == nullptr || !sameChannelRun(prevInfo, collInfo)) run++;
+      channelBase = tasks->partBase + runBase[run];
+      usableChannels = runChannels[run];
+      maxBytesPerChannel = DIVUP(DIVUP(runBytes[run], usableChannels), NCCL_BYTES_ALIGNMENT) * NCCL_BYTES_ALIGNMENT;
+      collInfo->nChannels = usableChannels;
+    } else {
+      collInfo->nChannels = DIVUP(collInfo->aggnBytes * tasks->usableChannels, totalCBDBytes);
+    }
     // Haven't got nChannels info yet, relax the budget boundary a bit.
     if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
 
     collInfo = ncclIntruQueueDequeue(&tasks->collCBDQueue);
-    NCCLCHECK(addCBDCollToPlan(comm, plan, tasks->usableChannels, collInfo, nWorkBudget));
+    prevInfo = collInfo;
+    NCCLCHECK(addCBDCollToPlan(comm, plan, channelBase, usableChannels, maxBytesPerChannel, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
     tasks->nTasksColl -= 1;
     tasks->workBytesTotal -= collInfo->count * ncclTypeSize(collInfo->datatype);
   }
 
-  // Then enqueue collnet colls
-  while (!ncclIntruQueueEmpty(&tasks->collnetQueue)) {
-    collInfo = ncclIntruQueueHead(&tasks->collnetQueue);
+  // Then enqueue collnet colls
+  while (!ncclIntruQueueEmpty(&tasks->collnetQueue)) {
+    collInfo = ncclIntruQueueHead(&tasks->collnetQueue);
+    if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
+
+    collInfo = ncclIntruQueueDequeue(&tasks->collnetQueue);
+    NCCLCHECK(addCollnetCollToPlan(comm, plan, tasks->usableChannels, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
+    tasks->nTasksColl -= 1;
+  }
+
+  // Then enqueue direct colls
+  while (!ncclIntruQueueEmpty(&tasks->collDirectQueue)) {
+    collInfo = ncclIntruQueueHead(&tasks->collDirectQueue);
+    if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
+
+    collInfo = ncclIntruQueueDequeue(&tasks->collDirectQueue);
+    NCCLCHECK(addDirectCollToPlan(comm, plan, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
+    tasks->nTasksColl -= 1;
+  }
+
+  // Then enqueue RHD colls
+  while (!ncclIntruQueueEmpty(&tasks->collRhdQueue)) {
+    collInfo = ncclIntruQueueHead(&tasks->collRhdQueue);
+    if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
+
+    collInfo = ncclIntruQueueDequeue(&tasks->collRhdQueue);
+    NCCLCHECK(addRhdCollToPlan(comm, plan, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
+    tasks->nTasksColl -= 1;
+  }
+
+  // Then enqueue Bruck colls
+  while (!ncclIntruQueueEmpty(&tasks->collBruckQueue)) {
+    collInfo = ncclIntruQueueHead(&tasks->collBruckQueue);
     if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
 
-    collInfo = ncclIntruQueueDequeue(&tasks->collnetQueue);
-    NCCLCHECK(addCollnetCollToPlan(comm, plan, tasks->usableChannels, collInfo, nWorkBudget));
+    collInfo = ncclIntruQueueDequeue(&tasks->collBruckQueue);
+    NCCLCHECK(addBruckCollToPlan(comm, plan, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
     tasks->nTasksColl -= 1;
   }
 
-  // Finally enqueue user-tuned colls
+  // Then enqueue user-tuned colls
   while (!ncclIntruQueueEmpty(&tasks->collTunedQueue)) {
     collInfo = ncclIntruQueueHead(&tasks->collTunedQueue);
     if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
 
     collInfo = ncclIntruQueueDequeue(&tasks->collTunedQueue);
     NCCLCHECK(addTunedCollToPlan(comm, plan, tasks->usableChannels, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
+    tasks->nTasksColl -= 1;
+  }
+
+  // Native alltoall colls go last, they use the p2p channels
+  while (!ncclIntruQueueEmpty(&tasks->collA2AQueue)) {
+    collInfo = ncclIntruQueueHead(&tasks->collA2AQueue);
+    if (*nWorkBudget < collInfo->nChannels) return ncclSuccess;
+
+    collInfo = ncclIntruQueueDequeue(&tasks->collA2AQueue);
+    NCCLCHECK(addAllToAllCollToPlan(comm, plan, collInfo, nWorkBudget));
+    tunerNoteColl(plan, collInfo);
+    ncclStatsNoteColl(comm, collInfo);
     tasks->nTasksColl -= 1;
   }
 
@@ -924,6 +1682,106 @@ static size_t calcP2pChunkSize(size_t totalSize, int minChannels, int maxChannel
 }
 
 RCCL_PARAM(P2pNetThreshold, "P2P_NET_THRESHOLD", 131072);
+RCCL_PARAM(P2pAdaptive, "P2P_ADAPTIVE", 1);
+
+// Largest piece a send/recv of bytes to/from peer is cut into, each piece going to the next
+// channel of the peer. Without RCCL_P2P_ADAPTIVE the split only depends on the comm size.
+static size_t p2pChunkBytesMax(struct ncclComm* comm, int peer, size_t bytes, int nChannelsMin, int nChannelsMax, ssize_t stepSize) {
+  if (!rcclParamP2pAdaptive()) {
+    ssize_t minSize = comm->nNodes > 1 ? stepSize/2 : stepSize/8;
+    ssize_t maxSize = comm->nNodes > 1 ? stepSize : stepSize*32;
+    return calcP2pChunkSize(bytes, nChannelsMin, nChannelsMax, minSize, maxSize);
+  }
+  // Size pieces by the transport to this peer, not by whether the comm spans nodes
+  ssize_t minSize = comm->rankToNode[peer] != comm->node ? stepSize/2 : stepSize/8;
+  int nChannels = ncclTopoP2pChannels(comm, peer, bytes, nChannelsMax);
+  return alignUp(std::max<size_t>(minSize, divUp(bytes, nChannels)), minSize);
+}
+
+// Capture-time registration of p2p receive buffers, in addition to GRAPH_REGISTER
+RCCL_PARAM(P2pGraphRegister, "P2P_GRAPH_REGISTER", 1);
+#define P2P_REG_TAG 0x50325052 // "P2PR", then P2P_REG_TAG+1 for the acknowledgements
+
+struct p2pIpcRegInfo {
+  cudaIpcMemHandle_t handle;
+  size_t offset;
+  int valid;
+};
+
+// Whether a p2p of bytes with peer can have its receive buffer mapped by the
+// sender: every channel it may use has to go through P2P/IPC, i.e. between
+// processes on XGMI or PCIe, without the copy engine. Both sides of the p2p come
+// to the same answer on their own.
+static bool p2pIpcRegEligible(struct ncclComm* comm, struct ncclKernelPlan* plan, bool isSendNotRecv, int peer, size_t bytes, int nChannelsPeer, uint16_t connIndex) {
+  if (!plan->persistent || !ncclParamGraphRegister() || !rcclParamP2pGraphRegister()) return false;
+  // Small ones are not worth a bootstrap round trip
+  if (peer == comm->rank || connIndex != 1 || bytes < (size_t)comm->p2pChunkSize) return false;
+  for (int c=0; c < nChannelsPeer; c++) {
+    int channelId;
+    if (ncclChannelCompute(comm, peer, c, isSendNotRecv ? ncclFuncSend : ncclFuncRecv, &channelId) != ncclSuccess) return false;
+    struct ncclConnector* connector = isSendNotRecv ?
+      &comm->channels[channelId].peers[peer]->send[1] : &comm->channels[channelId].peers[peer]->recv[1];
+    if (connector->transportComm != (isSendNotRecv ? &p2pTransport.send : &p2pTransport.recv)) return false;
+    if ((connector->conn.flags & (NCCL_IPC_READ|NCCL_IPC_WRITE)) == 0 || connector->conn.ptrExchange == nullptr) return false;
+  }
+  return true;
+}
+
+// Maps the receive buffer of a captured send into this process, so that the kernel
+// writes it directly instead of going through the FIFO of the connection. The
+// receiver posts the IPC handle of its buffer, the sender opens it and acknowledges,
+// then the receiver learns whether the mapping succeeded. Within a step this rank
+// only waits on the step its peers are at, so this cannot deadlock, as long as
+// every rank captures the same p2p operations. Mappings are closed with the plan.
+static ncclResult_t p2pIpcRegister(
+    struct ncclComm* comm, struct ncclKernelPlan* plan,
+    struct ncclTaskP2p* send, int sendPeer, int sendChannels, uint16_t sendIdx,
+    struct ncclTaskP2p* recv, int recvPeer, int recvChannels, uint16_t recvIdx
+  ) {
+  bool recvPosted = false;
+  if (recv && !recv->regChecked) {
+    recv->regChecked = true;
+    if (p2pIpcRegEligible(comm, plan, /*isSendNotRecv=*/false, recvPeer, recv->bytes, recvChannels, recvIdx)) {
+      struct p2pIpcRegInfo info = {};
+      void* base;
+      size_t size;
+      if (hipMemGetAddressRange(&base, &size, recv->buff) == hipSuccess &&
+          cudaIpcGetMemHandle(&info.handle, base) == cudaSuccess) {
+        info.offset = (char*)recv->buff - (char*)base;
+        info.valid = 1;
+      } else {
+        (void)cudaGetLastError();
+      }
+      NCCLCHECK(bootstrapSend(comm->bootstrap, recvPeer, P2P_REG_TAG, &info, sizeof(info)));
+      recvPosted = true;
+    }
+  }
+  if (send && !send->regChecked) {
+    send->regChecked = true;
+    if (p2pIpcRegEligible(comm, plan, /*isSendNotRecv=*/true, sendPeer, send->bytes, sendChannels, sendIdx)) {
+      struct p2pIpcRegInfo info;
+      int ack = 0;
+      void* base;
+      NCCLCHECK(bootstrapRecv(comm->bootstrap, sendPeer, P2P_REG_TAG, &info, sizeof(info)));
+      if (info.valid && ncclIpcCacheOpen(&info.handle, &base) == ncclSuccess) {
+        send->peerBuff = (char*)base + info.offset;
+        send->ipcReg = true;
+        struct ncclPointerList* q = ncclMemoryPoolAlloc<struct ncclPointerList>(&comm->memPool_ncclPointerList, &comm->memPermanent);
+        q->ptr = base;
+        ncclIntruQueueEnqueue(&plan->ipcMemQueue, q);
+        ack = 1;
+      }
+      NCCLCHECK(bootstrapSend(comm->bootstrap, sendPeer, P2P_REG_TAG+1, &ack, sizeof(ack)));
+      TRACE(NCCL_P2P, "rank %d send to %d of %zu bytes %s", comm->rank, sendPeer, send->bytes, ack ? "writes the peer buffer directly" : "not registered");
+    }
+  }
+  if (recvPosted) {
+    int ack;
+    NCCLCHECK(bootstrapRecv(comm->bootstrap, recvPeer, P2P_REG_TAG+1, &ack, sizeof(ack)));
+    recv->ipcReg = ack;
+  }
+  return ncclSuccess;
+}
 
 static ncclResult_t scheduleP2pTasksToPlan(
     struct ncclComm* comm, struct ncclKernelPlan* plan, int* nWorkBudget
@@ -943,9 +1801,8 @@ static ncclResult_t scheduleP2pTasksToPlan(
   // Compute how much to split operations
   // Natural step size matching buffer steps.
   ssize_t stepSize = comm->p2pChunkSize;
-  // Try to use all channels
-  int nChannelsMax = comm->p2pnChannelsPerPeer;
-  int nChannelsMin = nChannelsMax;
+  // Try to use all channels of the peer (see p2pChannelsPerPeer)
+  int nChannelsMin = comm->p2pnChannelsPerPeer;
   // Try to use all channels, but one channel per operation.
   while (nChannelsMin*nRanks > comm->p2pnChannels && nChannelsMin > 1) nChannelsMin /= 2;
 
@@ -976,10 +1833,10 @@ static ncclResult_t scheduleP2pTasksToPlan(
         char* sendPtr = send ? (char*)send->buff : nullptr;
         ssize_t recvBytes = recv ? recv->bytes : 0;
         ssize_t sendBytes = send ? send->bytes : 0;
-        ssize_t minSize = comm->nNodes > 1 ? stepSize/2 : stepSize/8;
-        ssize_t maxSize = comm->nNodes > 1 ? stepSize : stepSize*32;
-        ssize_t recvChunkBytesMax = calcP2pChunkSize(recvBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
-        ssize_t sendChunkBytesMax = calcP2pChunkSize(sendBytes, nChannelsMin, nChannelsMax, minSize, maxSize);
+        int recvChannels = p2pChannelsPerPeer(comm, recvBytes);
+        int sendChannels = p2pChannelsPerPeer(comm, sendBytes);
+        ssize_t recvChunkBytesMax = recv ? p2pChunkBytesMax(comm, recvPeer, recvBytes, nChannelsMin, recvChannels, stepSize) : 0;
+        ssize_t sendChunkBytesMax = send ? p2pChunkBytesMax(comm, sendPeer, sendBytes, nChannelsMin, sendChannels, stepSize) : 0;
         // Zero size send/recv are syncs, encode here with -1.
         recvBytes = recv && recvBytes == 0 ? -1 : recvBytes;
         sendBytes = send && sendBytes == 0 ? -1 : sendBytes;
@@ -995,6 +1852,7 @@ static ncclResult_t scheduleP2pTasksToPlan(
         if(comm->p2pNet && recvBytes > rcclParamP2pNetThreshold())
           recvIdx = NCCL_CONN_IDX_P2P_NET;
 
+        NCCLCHECK(p2pIpcRegister(comm, plan, send, sendPeer, sendChannels, sendIdx, recv, recvPeer, recvChannels, recvIdx));
         do {
           if ((i % (NCCL_MAX_WORK_ELEMENTS_P2P/2)) == 0) fuseOk = false;
           ssize_t recvChunkBytes = std::min(recvBytes, recvChunkBytesMax); // -1 preserved
@@ -1002,7 +1860,7 @@ static ncclResult_t scheduleP2pTasksToPlan(
           if (recvChunkBytes != 0) {
             if (recvChunkBytes == -1) recvChunkBytes = 0;
             if (*nWorkBudget < 1) return ncclSuccess; // ensure room in budget
-            NCCLCHECK(addP2pToPlan(comm, plan, nWorkBudget, /*isSendNotRecv=*/false, recvPeer, recv->chunk, recvPtr, recvChunkBytes, recvIdx, fuseOk));
+            NCCLCHECK(addP2pToPlan(comm, plan, nWorkBudget, /*isSendNotRecv=*/false, recvPeer, recv->chunk, recvChannels, recvPtr, recvChunkBytes, recvIdx, recv->ipcReg, nullptr, fuseOk));
             fuseOk = true;
             recvPtr += recvChunkBytes;
             recvBytes -= recvChunkBytes;
@@ -1016,7 +1874,9 @@ static ncclResult_t scheduleP2pTasksToPlan(
           if (sendChunkBytes != 0) {
             if (sendChunkBytes == -1) sendChunkBytes = 0;
             if (*nWorkBudget < 1) return ncclSuccess; // ensure room in budget
-            NCCLCHECK(addP2pToPlan(comm, plan, nWorkBudget, /*isSendNotRecv=*/true, sendPeer, send->chunk, sendPtr, sendChunkBytes, sendIdx, fuseOk));
+            // Where this chunk lands in the mapped receive buffer of the peer
+            void* sendPeerBuff = send->ipcReg ? (char*)send->peerBuff + (sendPtr - (char*)send->buff) : nullptr;
+            NCCLCHECK(addP2pToPlan(comm, plan, nWorkBudget, /*isSendNotRecv=*/true, sendPeer, send->chunk, sendChannels, sendPtr, sendChunkBytes, sendIdx, send->ipcReg, sendPeerBuff, fuseOk));
             fuseOk = true;
             sendPtr += sendChunkBytes;
             sendBytes -= sendChunkBytes;
@@ -1047,6 +1907,7 @@ static inline uint32_t rollingMin32(uint32_t a, uint32_t b) {
 // Spin until its safe to increase comm->workFifoSent to desiredSent.
 static void waitWorkFifoAvailable(struct ncclComm* comm, uint32_t desiredSent) {
   if (__builtin_expect(rollingLess32(comm->workFifoAckdMin + comm->workFifoDepth, desiredSent), false)) {
+    uint64_t t0 = 0;
     while (1) {
       // We have to poll for notifications from device.
       uint32_t* doneLive = comm->workFifoDone;
@@ -1079,9 +1940,74 @@ static void waitWorkFifoAvailable(struct ncclComm* comm, uint32_t desiredSent) {
 
       // See if that was enough.
       if (!rollingLess32(comm->workFifoAckdMin + comm->workFifoDepth, desiredSent)) break;
+      if (t0 == 0) t0 = clockNano();
       sched_yield();
     }
+    if (t0 != 0) {
+      comm->workFifoStalls++;
+      comm->workFifoStallNs += clockNano() - t0;
+      if (comm->workFifoDepth < comm->workFifoMaxDepth) comm->workFifoGrow = true;
+    }
+  }
+}
+
+int64_t ncclParamGdrCopyFifoEnable();
+RCCL_PARAM(WorkFifoWriteCombine, "WORK_FIFO_WC", 1);
+// Place the work FIFO in device memory written by the host through the BAR, so that
+// blocks fetch their first ncclWork from HBM rather than over PCIe. Independent of
+// NCCL_GDRCOPY_ENABLE; only used on devices with a large BAR.
+RCCL_PARAM(WorkFifoDevice, "WORK_FIFO_DEVICE", 0);
+
+ncclResult_t ncclWorkFifoAlloc(struct ncclComm* comm, int depth, struct ncclWork** heap, struct ncclWork** devHeap, void** gdrHandle) {
+  bool gdrFifo = ncclGdrCopyDevice(comm->cudaDev) && ncclParamGdrCopyFifoEnable() == 1;
+  bool devFifo = rcclParamWorkFifoDevice() && ncclGdrLargeBar(comm->cudaDev);
+  if (gdrFifo || devFifo) {
+    // The workFifoHeap lives in GDR mapped CUDA memory. The host only writes it
+    // (uploadWork() ends with a store fence), the GPU reads it from local memory.
+    NCCLCHECK(ncclGdrCudaCalloc(heap, devHeap, depth, gdrHandle, comm->sideStream));
+    ncclCommPushCudaGdrFree(comm, *gdrHandle);
+    ncclMemStatsAdd(&comm->memStats, ncclMemWorkFifo, false, depth*sizeof(struct ncclWork));
+    if (devFifo && !gdrFifo) INFO(NCCL_INIT, "Work FIFO of %d entries in device memory", depth);
+  } else {
+    // The workFifoHeap lives in cudaHost memory. The host only ever writes it,
+    // so write-combining lets uploadWork() stream whole plans over PCIe.
+    unsigned int flags = cudaHostAllocMapped;
+    if (rcclParamWorkFifoWriteCombine()) flags |= cudaHostAllocWriteCombined;
+    *gdrHandle = nullptr;
+    NCCLCHECK(ncclCudaHostCallocFlags(heap, depth, flags));
+    ncclCommPushCudaHostFree(comm, *heap);
+    ncclMemStatsAdd(&comm->memStats, ncclMemWorkFifo, true, depth*sizeof(struct ncclWork));
+    *devHeap = *heap;
   }
+  return ncclSuccess;
+}
+
+// Doubles the work fifo once all work already posted has been consumed. The old
+// heap stays allocated until the communicator is freed.
+static ncclResult_t growWorkFifo(struct ncclComm* comm) {
+  comm->workFifoGrow = false;
+  int depth = std::min(2*comm->workFifoDepth, comm->workFifoMaxDepth);
+  if (depth <= comm->workFifoDepth) return ncclSuccess;
+  struct ncclWork *heap, *devHeap;
+  void* gdrHandle;
+  NCCLCHECK(ncclWorkFifoAlloc(comm, depth, &heap, &devHeap, &gdrHandle));
+
+  // Wait for the device to drain the current fifo
+  uint64_t stalls = comm->workFifoStalls, stallNs = comm->workFifoStallNs;
+  waitWorkFifoAvailable(comm, comm->workFifoSent + comm->workFifoDepth);
+  comm->workFifoStalls = stalls;
+  comm->workFifoStallNs = stallNs;
+  comm->workFifoGrow = false;
+
+  NCCLCHECK(ncclCudaMemcpy(&comm->devComm->workFifoHeap, &devHeap, 1));
+  NCCLCHECK(ncclCudaMemcpy(&comm->devComm->workFifoDepth, &depth, 1));
+  INFO(NCCL_INIT, "Rank %d grew work fifo from %d to %d entries after %lu stalls (%.1f ms)",
+      comm->rank, comm->workFifoDepth, depth, comm->workFifoStalls, comm->workFifoStallNs/1e6);
+  comm->workFifoHeap = heap;
+  comm->devWorkFifoHeap = devHeap;
+  comm->workFifoHeapGdrHandle = gdrHandle;
+  comm->workFifoDepth = depth;
+  return ncclSuccess;
 }
 
 static ncclResult_t uploadWork(struct ncclComm* comm, struct ncclKernelPlan* plan) {
@@ -1090,12 +2016,9 @@ static ncclResult_t uploadWork(struct ncclComm* comm, struct ncclKernelPlan* pla
   int nWork = 0;
   for (int c=0; c < channelUbound; c++) nWork += plan->channels[c].nWork;
 
-  struct ncclWork* workHeap;
-  if (!persistent) {
-    workHeap = comm->workFifoHeap;
-  } else {
-    workHeap = ncclMemoryStackAlloc<struct ncclWork>(&comm->memScoped, nWork);
-  }
+  // Work structs are gathered in host memory first, then written to the fifo in
+  // at most two contiguous runs so that write-combining buffers stay full.
+  struct ncclWork* workHeap = ncclMemoryStackAlloc<struct ncclWork>(&comm->memScoped, nWork);
   uint32_t ixMask = persistent ? ~uint32_t(0) : comm->workFifoDepth-1;
   uint32_t ixSent;
   if (persistent) {
@@ -1132,15 +2055,18 @@ static ncclResult_t uploadWork(struct ncclComm* comm, struct ncclKernelPlan* pla
         q->work.header.doneAcks = ix+1;
         comm->channels[c].workFifoSent = ix+1;
       }
-      workHeap[ix & ixMask] = q->work; // C++ struct assignment
+      workHeap[ix - ixHead] = q->work; // C++ struct assignment
       q = q->next;
       if (q != nullptr) ix = ixSent++;
     }
   }
 
   if (!persistent) {
+    uint32_t first = std::min<uint32_t>(nWork, comm->workFifoDepth - (ixHead & ixMask));
+    memcpy(comm->workFifoHeap + (ixHead & ixMask), workHeap, first*sizeof(struct ncclWork));
+    memcpy(comm->workFifoHeap, workHeap + first, (nWork - first)*sizeof(struct ncclWork));
     comm->workFifoSent = ixSent;
-    if (comm->workFifoHeapGdrHandle != nullptr) wc_store_fence();
+    wc_store_fence();
     plan->workHead = &comm->devWorkFifoHeap[ixHead & ixMask];
   } else {
     NCCLCHECK(ncclCudaMalloc(&plan->workHead, nWork));
@@ -1245,7 +2171,7 @@ static ncclResult_t reclaimPlan(struct ncclComm* comm, struct ncclCommCallback*
     }
     while (!ncclIntruQueueEmpty(&plan->ipcMemQueue)) {
       struct ncclPointerList* q = ncclIntruQueueDequeue(&plan->ipcMemQueue);
-      CUDACHECKIGNORE(cudaIpcCloseMemHandle(q->ptr));
+      (void)ncclIpcCacheClose(q->ptr);
       ncclMemoryPoolFree(&comm->memPool_ncclPointerList, q);
     }
     /* free mcHandle */
@@ -1270,6 +2196,25 @@ static void persistentDestructor(void* plans_) {
   }
 }
 
+static int streamPartition(struct ncclComm* comm, cudaStream_t stream) {
+  for (int i=0; i<comm->nPartStreams; i++) {
+    if (comm->partStreams[i] == stream) return comm->partStreamIds[i];
+  }
+  return -1;
+}
+
+// Makes stream depend on the last launch of every partition whose channels it may
+// use: only its own partition, or all of them for a full launch (part < 0).
+static ncclResult_t waitPartLaunches(struct ncclComm* comm, cudaStream_t stream, int part) {
+  for (int p=0; p<comm->nStreamParts; p++) {
+    if (part >= 0 && p != part) continue;
+    if (comm->partLastStreams[p] != nullptr && comm->partLastStreams[p] != stream) {
+      CUDACHECK(hipStreamWaitEvent(stream, comm->partDoneEvents[p], 0));
+    }
+  }
+  return ncclSuccess;
+}
+
 ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
   ncclResult_t result = ncclSuccess;
   struct ncclTasks* tasks = &comm->tasks;
@@ -1279,13 +2224,23 @@ ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
   // Poll for callbacks sent to us from other threads. Typically these free
   // resources from to our memory pools.
   NCCLCHECK(ncclCommPollCallbacks(comm, /*waitSome=*/false));
+  // Hand completed kernel timings to the tuner plugin.
+  if (comm->tunerTimings) NCCLCHECK(ncclTunerPollTimings(comm, /*blocking=*/false));
+  // Grow the work fifo if the last launches ran out of it.
+  if (comm->workFifoGrow && !persistent) NCCLCHECK(growWorkFifo(comm));
 
   // We already have one frame present which holds all of our tasks (which we
   // are about to schedule). Now push an additional frame for allocating
   // work structs (see appendWorkElem() variants all use scoped allocation).
   ncclMemoryStackPush(&comm->memScoped);
 
+  if (!ncclIntruQueueEmpty(&tasks->collHostQueue)) NCCLCHECK(ncclHostCollLaunch(comm));
   if (tasks->nTasksColl + tasks->nTasksP2p != 0) {
+    tasks->streamPart = -1;
+    tasks->partBase = 0;
+    if (comm->nPartStreams != 0 && !persistent && tasks->numStreams == 1 && tasks->nTasksP2p == 0) {
+      tasks->streamPart = streamPartition(comm, tasks->streams->stream);
+    }
     do {
       struct ncclKernelPlan* plan = ncclMemoryPoolAlloc<struct ncclKernelPlan>(&comm->memPool_ncclKernelPlan, &comm->memPermanent);
       ncclIntruQueueEnqueue(&comm->planQueue, plan);
@@ -1306,7 +2261,9 @@ ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
         NCCLCHECKGOTO(scheduleCollTasksToPlan(comm, plan, &nWorkBudget), result, failure);
       }
       // And only drain p2p tasks once colls are depleted.
-      if (tasks->nTasksColl == 0 && tasks->nTasksP2p != 0) {
+      if (tasks->nTasksColl == 0 && tasks->nTasksP2p != 0 && plan->jitKernel == nullptr) {
+        // Kernels mixing p2p work are not timed for the tuner
+        plan->tunerNColl = 0;
         NCCLCHECKGOTO(scheduleP2pTasksToPlan(comm, plan, &nWorkBudget), result, failure);
       }
       if (nWorkBudget == nWorkBudgetOld) {
@@ -1320,6 +2277,8 @@ ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
       }
       finishPlan(plan);
     } while (tasks->nTasksColl + tasks->nTasksP2p != 0);
+    // Splitting a group across kernels because of the fifo budget serializes them.
+    if (nPlans > 1 && !persistent && comm->workFifoDepth < comm->workFifoMaxDepth) comm->workFifoGrow = true;
 
     struct ncclKernelPlan* planHead = ncclIntruQueueHead(&comm->planQueue);
     comm->unlaunchedPlansHead = planHead;
@@ -1337,20 +2296,32 @@ ncclResult_t ncclLaunchPrepare(struct ncclComm* comm) {
     //   6. deviceStream waits on userStream[0]
     //   7. userStream[1...] each waits on deviceStream
     // The two-level fan-in fan-out is because ncclStrongStreamWaitStream() requires
-    // at least one of the two streams to be strong-stream.
+    // at least one of the two streams to be strong-stream. Outside of graphs,
+    // userStream[0] instead waits on userStream[1...] directly in 2., and its wait
+    // on deviceStream is elided when it already holds its work, as after the
+    // previous launch from the same stream.
     cudaStream_t launchStream = tasks->streams->stream;
     NCCLCHECKGOTO(ncclStrongStreamAcquire(tasks->capturingGraph, &comm->sharedRes->deviceStream), result, failure);
 
-    if (tasks->numStreams != 1 || persistent) {
+    if (persistent) {
       // Create dependency for device stream on user streams. First from extra user
       // streams to deviceStream. Then deviceStream to first user stream.
       for (struct ncclCudaStreamList* l=tasks->streams->next; l != nullptr; l = l->next) {
         NCCLCHECKGOTO(ncclStrongStreamWaitStream(tasks->capturingGraph, &comm->sharedRes->deviceStream, l->stream), result, failure);
       }
       NCCLCHECKGOTO(ncclStrongStreamWaitStream(tasks->capturingGraph, launchStream, &comm->sharedRes->deviceStream), result, failure);
-    } else if (tasks->streams->stream != comm->lastStream && comm->lastStream != nullptr && !persistent) {
-      // Stream changed from last call, create dependency against last NCCL kernel launch
-      CUDACHECK(hipStreamWaitEvent(tasks->streams->stream, comm->doneEvent, 0));
+    } else if (tasks->numStreams != 1) {
+      NCCLCHECKGOTO(ncclStrongStreamWaitStream(tasks->capturingGraph, launchStream, &comm->sharedRes->deviceStream), result, failure);
+      for (struct ncclCudaStreamList* l=tasks->streams->next; l != nullptr; l = l->next) {
+        NCCLCHECKGOTO(ncclStrongStreamWaitStream(tasks->capturingGraph, launchStream, l->stream, &comm->sharedRes->deviceStream), result, failure);
+      }
+      NCCLCHECKGOTO(waitPartLaunches(comm, launchStream, -1), result, failure);
+    } else {
+      if (launchStream != comm->lastStream && comm->lastStream != nullptr) {
+        // Stream changed from last call, create dependency against last NCCL kernel launch
+        CUDACHECK(hipStreamWaitEvent(launchStream, comm->doneEvent, 0));
+      }
+      NCCLCHECKGOTO(waitPartLaunches(comm, launchStream, tasks->streamPart), result, failure);
     }
 
     if (persistent || comm->persistentRefs != 0 || ncclCudaLaunchBlocking) {
@@ -1399,17 +2370,118 @@ ncclResult_t ncclLaunchKernelBefore_NoUncapturedCuda(struct ncclComm* comm, stru
 NCCL_PARAM(MemSyncDomain, "MEM_SYNC_DOMAIN", cudaLaunchMemSyncDomainRemote);
 #endif
 
-ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan) {
+// Persistent kernel mode: one long-lived block per channel polls for launches
+// posted by the host, so that a launch only costs writing its descriptor plus two
+// stream memory operations. The launch stream rings the doorbell, then waits for
+// the kernel to report completion, which keeps stream semantics intact. Plans the
+// kernel cannot run (graph capture, multiple streams, colltrace) are launched the
+// usual way, after the persistent kernel went idle.
+// Note the persistent kernel keeps nChannels CUs busy and never completes, so
+// cudaDeviceSynchronize() will not return until the communicator is destroyed.
+RCCL_PARAM(PersistentKernel, "PERSISTENT_KERNEL", 0);
+
+static ncclResult_t persistentKernelStart(struct ncclComm* comm) {
+  struct ncclPersistentKernel* pk;
+  NCCLCHECK(ncclCalloc(&pk, 1));
+  pk->nChannels = std::max(comm->nChannels, comm->p2pnChannels);
+  NCCLCHECK(ncclCudaHostCalloc(&pk->launches, NCCL_PERSISTENT_LAUNCHES));
+  NCCLCHECK(ncclCudaHostCalloc(&pk->sync, 1));
+  NCCLCHECK(ncclCudaCalloc(&pk->nDone, NCCL_PERSISTENT_LAUNCHES));
+  CUDACHECK(hipStreamCreateWithFlags(&pk->stream, hipStreamNonBlocking));
+
+  void* fn = comm->kernelUnroll ? (void*)ncclDevKernel_Persistent_4 : (void*)ncclDevKernel_Persistent;
+  void* args[4] = {&comm->devComm, &pk->sync, &pk->launches, &pk->nDone};
+  CUDACHECK(hipLaunchKernel(fn, dim3(pk->nChannels), dim3(NCCL_MAX_NTHREADS), args, 0, pk->stream));
+  comm->persistentKernel = pk;
+  INFO(NCCL_INIT, "Rank %d started persistent kernel on %d channels", comm->rank, pk->nChannels);
+  return ncclSuccess;
+}
+
+static bool persistentKernelEligible(struct ncclComm* comm, struct ncclKernelPlan* plan) {
+  if (!ncclParamPersistentKernel() || plan->persistent || comm->tasks.numStreams != 1) return false;
+  if (plan->jitKernel != nullptr) return false;
+  if (comm->tasks.streamPart >= 0) return false;
+  if (ncclCudaLaunchBlocking) return false;
+#ifdef ENABLE_COLLTRACE
+  if (comm->collTraceThread) return false;
+#endif
+  return plan->channelUbound <= std::max(comm->nChannels, comm->p2pnChannels);
+}
+
+static ncclResult_t persistentKernelPost(struct ncclComm* comm, struct ncclKernelPlan* plan) {
+  struct ncclPersistentKernel* pk = comm->persistentKernel;
+  struct ncclDevPersistentSync* sync = pk->sync;
+  hipStream_t stream = comm->tasks.streams->stream;
+
+  // Wait for a free slot
+  while (pk->posted - __atomic_load_n(&sync->complete, __ATOMIC_ACQUIRE) >= NCCL_PERSISTENT_LAUNCHES) {
+    if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) return ncclInternalError;
+    sched_yield();
+  }
+  struct ncclDevPersistentLaunch* l = pk->launches + pk->posted%NCCL_PERSISTENT_LAUNCHES;
+  l->channelMask = plan->channelMask;
+  l->workHead = plan->workHead;
+  l->nBlocks = plan->channelCount;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  // Launches on another stream must not overtake the previous one
+  if (stream != pk->lastStream && pk->posted > 0) {
+    CUDACHECK(hipStreamWaitValue64(stream, &sync->complete, pk->posted, hipStreamWaitValueGte, ~0ull));
+  }
+  pk->posted++;
+  CUDACHECK(hipStreamWriteValue64(stream, &sync->doorbell, pk->posted, 0));
+  CUDACHECK(hipStreamWaitValue64(stream, &sync->complete, pk->posted, hipStreamWaitValueGte, ~0ull));
+  CUDACHECK(hipEventRecord(comm->doneEvent, stream));
+  pk->lastStream = stream;
+  comm->lastStream = stream;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclPersistentKernelStop(struct ncclComm* comm) {
+  struct ncclPersistentKernel* pk = comm->persistentKernel;
+  if (pk == nullptr) return ncclSuccess;
+  while (__atomic_load_n(&pk->sync->complete, __ATOMIC_ACQUIRE) < pk->posted) {
+    if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) break;
+    sched_yield();
+  }
+  __atomic_store_n(&pk->sync->stop, 1, __ATOMIC_RELEASE);
+  CUDACHECK(hipStreamSynchronize(pk->stream));
+  CUDACHECK(hipStreamDestroy(pk->stream));
+  NCCLCHECK(ncclCudaFree(pk->nDone));
+  NCCLCHECK(ncclCudaHostFree(pk->sync));
+  NCCLCHECK(ncclCudaHostFree(pk->launches));
+  free(pk);
+  comm->persistentKernel = nullptr;
+  return ncclSuccess;
+}
+
+static ncclResult_t launchPlanKernel(struct ncclComm* comm, struct ncclKernelPlan* plan) {
   struct ncclTasks* tasks = &comm->tasks;
+  if (persistentKernelEligible(comm, plan)) {
+    if (comm->persistentKernel == nullptr) NCCLCHECK(persistentKernelStart(comm));
+    return persistentKernelPost(comm, plan);
+  }
   void *fn = plan->kernelFn;
   cudaStream_t launchStream = tasks->streams->stream;
   dim3 grid = {(unsigned)plan->channelCount, 1, 1};
   dim3 block = {(unsigned)plan->threadPerBlock, 1, 1};
   size_t smem = ncclShmemDynamicSize(comm->cudaArch);
   void *args[3] = {&comm->devComm, &plan->channelMask, &plan->workHead};
+  if (plan->jitKernel != nullptr) {
+    CUDACHECK(hipModuleLaunchKernel(plan->jitKernel, grid.x, 1, 1, block.x, 1, 1, 0, launchStream, args, NULL));
+    if (tasks->numStreams == 1 && !plan->persistent) {
+      int part = tasks->streamPart;
+      CUDACHECK(hipEventRecord(part >= 0 ? comm->partDoneEvents[part] : comm->doneEvent, launchStream));
+      if (part >= 0) comm->partLastStreams[part] = launchStream;
+      else comm->lastStream = launchStream;
+    }
+    return ncclSuccess;
+  }
   if (tasks->numStreams == 1 && !plan->persistent) {
-    CUDACHECK(hipExtLaunchKernel(plan->kernelFn, grid, block, args, 0, tasks->streams->stream, NULL, comm->doneEvent, 0));
-    comm->lastStream = tasks->streams->stream;
+    int part = tasks->streamPart;
+    CUDACHECK(hipExtLaunchKernel(plan->kernelFn, grid, block, args, 0, tasks->streams->stream, NULL, part >= 0 ? comm->partDoneEvents[part] : comm->doneEvent, 0));
+    if (part >= 0) comm->partLastStreams[part] = tasks->streams->stream;
+    else comm->lastStream = tasks->streams->stream;
     return ncclSuccess;
   }
 
@@ -1464,6 +2536,22 @@ ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan
   return ncclSuccess;
 }
 
+int64_t rcclParamStatsTimeInterval();
+
+ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan) {
+  struct ncclTunerTiming* timing = nullptr;
+  cudaStream_t launchStream = comm->tasks.streams->stream;
+  if (plan->tunerNColl == 1 && !plan->persistent && (comm->tuner || comm->autotune || comm->straggler || rcclParamStatsTimeInterval() > 0)) {
+    NCCLCHECK(ncclTunerTimingStart(comm, plan, launchStream, &timing));
+  }
+  uint64_t launchStart = ncclProfilingEnabled() ? clockNano() : 0;
+  if (comm->collTimings) ncclCollTimingsLaunch(comm, plan);
+  NCCLCHECK(launchPlanKernel(comm, plan));
+  if (launchStart) NCCLCHECK(ncclProfilingRecordLaunch(comm->rank, comm->opCount, plan->channelCount, launchStart, clockNano()));
+  if (timing) NCCLCHECK(ncclTunerTimingEnd(comm, timing, launchStream));
+  return ncclSuccess;
+}
+
 ncclResult_t ncclLaunchKernelAfter_NoCuda(struct ncclComm* comm, struct ncclKernelPlan* plan) {
   if (!(plan->persistent || comm->persistentRefs != 0 || ncclCudaLaunchBlocking)) {
     // We are not using the host stream for proxy ops and reclaimation submission.
@@ -1480,12 +2568,32 @@ ncclResult_t ncclLaunchKernelAfter_NoCuda(struct ncclComm* comm, struct ncclKern
   return ncclSuccess;
 }
 
+// Number of launches after which the enqueue path is expected to stop allocating.
+RCCL_PARAM(EnqueueAllocWarmup, "ENQUEUE_ALLOC_WARMUP", 100);
+
+// Tracks heap allocations made by the memory stacks backing the enqueue path.
+static void countEnqueueMallocs(struct ncclComm* comm) {
+  uint64_t nMallocs = comm->memPermanent.nMallocs + comm->memScoped.nMallocs;
+  if (nMallocs != comm->enqueueMallocs) {
+    if (comm->enqueueLaunches >= (uint64_t)rcclParamEnqueueAllocWarmup()) {
+      if (comm->enqueueSteadyMallocs == 0) {
+        INFO(NCCL_ALLOC, "Rank %d: enqueue path still allocating from the heap after %lu launches",
+            comm->rank, comm->enqueueLaunches);
+      }
+      comm->enqueueSteadyMallocs += nMallocs - comm->enqueueMallocs;
+    }
+    comm->enqueueMallocs = nMallocs;
+  }
+  comm->enqueueLaunches++;
+}
+
 ncclResult_t ncclLaunchFinish(struct ncclComm* comm) {
   ncclResult_t result = ncclSuccess;
   struct ncclTasks* tasks = &comm->tasks;
   bool persistent = ncclCudaGraphValid(tasks->capturingGraph);
   tasks->workBytesTotal = 0; // Just in case subtraction during scheduleCollTasksToPlan() doesn't get to 0
 
+  countEnqueueMallocs(comm);
   // Deallocate ncclWork's. This frame exists so long as ncclLaunchPrepare
   // succeeded, and if it ncclLaunchPrepare didn't succeed we wouldn't be here.
   ncclMemoryStackPop(&comm->memScoped);
@@ -1501,8 +2609,8 @@ ncclResult_t ncclLaunchFinish(struct ncclComm* comm) {
     if (persistent || tasks->numStreams != 1) NCCLCHECKGOTO(ncclStrongStreamWaitStream(tasks->capturingGraph, &comm->sharedRes->deviceStream, launchStream, /*b_subsumes_a=*/true), result, resume1);
   resume1:
     // Create dependency for other user streams (skip launch stream) on deviceStream.
-    // Again, the user streams haven't been touched since deviceStream waited on them
-    // so we can say they are subsumed by deviceStream.
+    // Again, the user streams haven't been touched since deviceStream, or the launch
+    // stream it now clones, waited on them so we can say they are subsumed by deviceStream.
     struct ncclCudaStreamList* sl = tasks->streams->next;
     tasks->streams = nullptr; // Reset comm->tasks.streams to empty.
     while (sl != nullptr && (tasks->numStreams != 1 || persistent)) {
@@ -1531,6 +2639,8 @@ static inline ncclResult_t getCollNetSupport(struct ncclInfo* info, int* collNet
   case ncclFuncReduce:
   case ncclFuncReduceScatter:
     *collNetSupport &= info->comm->collNetSupportMatrix[netOp][info->datatype];
+    // The network plugin cannot apply a runtime-compiled reduction
+    if (ncclDevRedOpIsJit(info->opFull.op)) *collNetSupport = 0;
     break;
   default:
     break;
@@ -1538,6 +2648,88 @@ static inline ncclResult_t getCollNetSupport(struct ncclInfo* info, int* collNet
   return ncclSuccess;
 }
 
+// Whether the device function for this collective with algo/proto was built into
+// the library. Builds restricted with ONLY_FUNCS leave the others out, so tuning
+// has to fall back to the kernels that are present.
+static bool collDevFuncBuilt(struct ncclInfo* collInfo, int algo, int proto) {
+  // Runtime-compiled reductions only have ring and tree kernels, epilogues only
+  // ring AllReduce, see jit_redop.h
+  if (ncclDevRedOpIsJit(collInfo->opFull.op)) {
+    if (ncclJitRedOpGet(collInfo->opFull.op)->epilogue && algo != NCCL_ALGO_RING) return false;
+    return ncclJitRedOpFuncIndex(collInfo->coll, algo, proto) >= 0;
+  }
+  return ncclDevFuncId(collInfo->coll, collInfo->opFull.op, collInfo->datatype, algo, proto) >= 0;
+}
+
+// Fills the [algorithm][protocol] cost table (in us) with the default topology model.
+// Unusable combinations are set to NCCL_ALGO_PROTO_IGNORE; backup marks RING entries
+// that are only used when nothing else is available.
+static ncclResult_t topoGetCollCostTable(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int numPipeOps,
+    float table[][NCCL_NUM_PROTOCOLS], bool backup[][NCCL_NUM_PROTOCOLS]) {
+  struct ncclComm* comm = collInfo->comm;
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) {
+    for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+      table[a][p] = NCCL_ALGO_PROTO_IGNORE;
+      backup[a][p] = false;
+    }
+    if ((a == NCCL_ALGO_COLLNET_DIRECT || a == NCCL_ALGO_COLLNET_CHAIN) && collNetSupport != 1) continue;
+    if ((a == NCCL_ALGO_NVLS || a == NCCL_ALGO_NVLS_TREE) && nvlsSupport != 1) continue;
+    if (a == NCCL_ALGO_NVLS && collNetSupport != 1 && comm->nNodes > 1) continue;
+    if (a == NCCL_ALGO_DIRECT && (collInfo->coll != ncclFuncAllReduce || !comm->directSupport)) continue;
+    if (a == NCCL_ALGO_TREE && (collInfo->coll == ncclFuncBroadcast || collInfo->coll == ncclFuncReduce) && !comm->rootedTreeSupport) continue;
+    // RHD reduces partial results again at each step, which PreMulSum and SumPostScale cannot do
+    if (a == NCCL_ALGO_RHD && (collInfo->coll != ncclFuncAllReduce || !comm->rhdSupport || collInfo->opFull.op == ncclDevPreMulSum ||
+        collInfo->opFull.op == ncclDevSumPostScale)) continue;
+    if (a == NCCL_ALGO_BRUCK && ((collInfo->coll != ncclFuncAllGather && collInfo->coll != ncclFuncReduceScatter) || !comm->bruckSupport)) continue;
+    // Bruck ReduceScatter reduces partial sums again too, and keeps them in the channel scratch
+    if (a == NCCL_ALGO_BRUCK && collInfo->coll == ncclFuncReduceScatter && (collInfo->opFull.op == ncclDevPreMulSum || collInfo->opFull.op == ncclDevSumPostScale ||
+        collInfo->count*ncclTypeSize(collInfo->datatype)*comm->bruckScratchBlocks > comm->bruckScratchBytes)) continue;
+    /* now we only support single-node NVLS allgather and reducescatter */
+    if (a == NCCL_ALGO_NVLS && (collInfo->coll == ncclFuncAllGather || collInfo->coll == ncclFuncReduceScatter) && comm->nNodes > 1) continue;
+
+    for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+      if (p == NCCL_PROTO_LL128 && comm->topo->type != RCCL_TOPO_XGMI_ALL) continue;
+      float time;
+      NCCLCHECK(ncclTopoGetAlgoTime(collInfo, a, p, numPipeOps, &time, &backup[a][p]));
+      if (time >= 0 && collDevFuncBuilt(collInfo, a, p)) table[a][p] = time;
+    }
+  }
+  return ncclSuccess;
+}
+
+// Picks the cheapest combination of the cost table, falling back to backup entries.
+static void topoPickFromCostTable(float table[][NCCL_NUM_PROTOCOLS], bool backup[][NCCL_NUM_PROTOCOLS],
+    int* algorithm, int* protocol, float* minTime) {
+  float backupMinTime = 3600000000.0;
+  int backupAlgo = NCCL_ALGO_UNDEF; // back up algo and proto if no algo/proto is picked up.
+  int backupProto = NCCL_PROTO_UNDEF;
+  *minTime = 3600000000.0; // Hopefully no operation will take an hour to complete.
+  *algorithm = NCCL_ALGO_UNDEF;
+  *protocol = NCCL_PROTO_UNDEF;
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) {
+    for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+      float time = table[a][p];
+      if (time < 0) continue;
+      if (!backup[a][p]) {
+        if (time < *minTime) {
+          *algorithm = a;
+          *protocol = p;
+          *minTime = time;
+        }
+      } else if (time < backupMinTime) {
+        backupAlgo = a;
+        backupProto = p;
+        backupMinTime = time;
+      }
+    }
+  }
+  if (*algorithm == NCCL_ALGO_UNDEF) {
+    *algorithm = backupAlgo;
+    *protocol = backupProto;
+    *minTime = backupMinTime;
+  }
+}
+
 // numPipeOps: number of pipelined ops. Can be greater than 1 in aggregation mode. Used to adjust latency.
 static ncclResult_t topoGetAlgoInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int numPipeOps) {
   struct ncclComm* comm = collInfo->comm;
@@ -1546,49 +2738,29 @@ static ncclResult_t topoGetAlgoInfo(struct ncclInfo* collInfo, int collNetSuppor
     collInfo->protocol = NCCL_PROTO_SIMPLE;
   }
   else if (collInfo->algorithm == NCCL_ALGO_UNDEF || collInfo->protocol == NCCL_PROTO_UNDEF) {
-    float minTime = 3600000000.0; // Hopefully no operation will take an hour to complete.
-    float backupMinTime = 3600000000.0;
-    bool backup = false;
-    int backupAlgo = NCCL_ALGO_UNDEF; // back up algo and proto if no algo/proto is picked up.
-    int backupProto = NCCL_PROTO_UNDEF;
-    // Find algorithm / protocol.
-    collInfo->algorithm = -1;
-    collInfo->protocol = -1;
-    int nAlgos = NCCL_NUM_ALGORITHMS;
-    for (int a=0; a<nAlgos; a++) {
-      if ((a == NCCL_ALGO_COLLNET_DIRECT || a == NCCL_ALGO_COLLNET_CHAIN) && collNetSupport != 1) continue;
-      if ((a == NCCL_ALGO_NVLS || a == NCCL_ALGO_NVLS_TREE) && nvlsSupport != 1) continue;
-      if (a == NCCL_ALGO_NVLS && collNetSupport != 1 && comm->nNodes > 1) continue;
-      /* now we only support single-node NVLS allgather and reducescatter */
-      if (a == NCCL_ALGO_NVLS && (collInfo->coll == ncclFuncAllGather || collInfo->coll == ncclFuncReduceScatter) && comm->nNodes > 1) continue;
-
-      for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
-        if (p == NCCL_PROTO_LL128 && collInfo->comm->topo->type != RCCL_TOPO_XGMI_ALL) continue;
-        float time;
-        NCCLCHECK(ncclTopoGetAlgoTime(collInfo, a, p, numPipeOps, &time, &backup));
-        if (!backup) {
-          if (time >= 0 && time < minTime) {
-            collInfo->algorithm = a;
-            collInfo->protocol = p;
-            minTime = time;
-          }
-        } else {
-          if (time >= 0 && time < backupMinTime) {
-            backupAlgo = a;
-            backupProto = p;
-            backupMinTime = time;
-          }
-        }
-      }
-    }
-
+    float table[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    bool backup[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    float minTime;
+    NCCLCHECK(topoGetCollCostTable(collInfo, collNetSupport, nvlsSupport, numPipeOps, table, backup));
+    topoPickFromCostTable(table, backup, &collInfo->algorithm, &collInfo->protocol, &minTime);
     if (collInfo->algorithm == NCCL_ALGO_UNDEF || collInfo->protocol == NCCL_PROTO_UNDEF) {
-      if (backupAlgo == NCCL_ALGO_UNDEF || backupProto == NCCL_PROTO_UNDEF) {
-        WARN("Error : no algorithm/protocol available");
-        return ncclInternalError;
+      WARN("Error : no algorithm/protocol available");
+      return ncclInternalError;
+    }
+    int algo, proto, nChannels;
+    if (collInfo->coll < NCCL_NUM_FUNCTIONS && ncclTopoTuningOverride(collInfo->coll, collInfo->nBytes, &algo, &proto, &nChannels)) {
+      if (algo < 0) algo = collInfo->algorithm;
+      if (proto < 0) proto = collInfo->protocol;
+      // Only follow the file where the model says the combination can run
+      if (table[algo][proto] >= 0) {
+        collInfo->algorithm = algo;
+        collInfo->protocol = proto;
+        minTime = table[algo][proto];
+      }
+      if (nChannels > 0) {
+        collInfo->nChannels = nChannels;
+        collInfo->userTuned = true;
       }
-      collInfo->algorithm = backupAlgo;
-      collInfo->protocol = backupProto;
     }
     if (comm->rank == 0) INFO(NCCL_TUNING, "%ld Bytes -> Algo %d proto %d time %f", collInfo->nBytes, collInfo->algorithm, collInfo->protocol, minTime);
     TRACE(NCCL_COLL, "%ld Bytes -> Algo %d proto %d time %f", collInfo->nBytes, collInfo->algorithm, collInfo->protocol, minTime);
@@ -1598,18 +2770,42 @@ static ncclResult_t topoGetAlgoInfo(struct ncclInfo* collInfo, int collNetSuppor
 }
 
 // Use the default topo-based tuner if tuner plugin is not successful.
-// Call the plugin first. Let it set algo+proto, and/or nChannels.
-// Then, topoGetAlgoInfo will set algo/proto if not set, then nChannels and nThreads based on algo/proto.
+// Call the plugin first with the default cost table. Let it edit the table, and/or set nChannels.
+// The cheapest entry of the edited table gives algo+proto; if nothing is usable,
+// topoGetAlgoInfo will set algo/proto, then nChannels and nThreads based on algo/proto.
 // Finally, nChannels will be overriden by the plugin setting.
 static ncclResult_t getTunerInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int numPipeOps) {
+  struct ncclComm* comm = collInfo->comm;
   collInfo->algorithm = NCCL_ALGO_UNDEF;
   collInfo->protocol = NCCL_PROTO_UNDEF;
   collInfo->nChannels = 0;
-  if (collInfo->comm->tuner != NULL) {
-    NCCLCHECK(collInfo->comm->tuner->getCollInfo(
-          collInfo->coll, collInfo->nBytes,
-          collNetSupport, nvlsSupport, numPipeOps,
-          &collInfo->algorithm, &collInfo->protocol, &collInfo->nChannels));
+  if (comm->tuner != NULL && comm->nRanks > 1 && collInfo->coll < NCCL_NUM_FUNCTIONS) {
+    float table[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    float defaults[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    bool backup[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    float* tablePtrs[NCCL_NUM_ALGORITHMS];
+    NCCLCHECK(topoGetCollCostTable(collInfo, collNetSupport, nvlsSupport, numPipeOps, table, backup));
+    for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) {
+      // Protocols without buffers can't be used
+      for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) if (comm->buffSizes[p] == 0) table[a][p] = NCCL_ALGO_PROTO_IGNORE;
+      tablePtrs[a] = table[a];
+    }
+    memcpy(defaults, table, sizeof(table));
+    ncclResult_t ret = comm->tuner->getCollInfo(comm->tunerContext, collInfo->coll, collInfo->nBytes, numPipeOps,
+        tablePtrs, NCCL_NUM_ALGORITHMS, NCCL_NUM_PROTOCOLS, &collInfo->nChannels);
+    if (ret != ncclSuccess) {
+      INFO(NCCL_TUNING, "Tuner: getCollInfo failed (%d), using default tuning", ret);
+      collInfo->nChannels = 0;
+    } else {
+      float minTime;
+      // Unusable entries stay unusable. Entries the plugin changed are its own
+      // choice, they no longer count as backup.
+      for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+        if (defaults[a][p] == NCCL_ALGO_PROTO_IGNORE) table[a][p] = NCCL_ALGO_PROTO_IGNORE;
+        else if (table[a][p] != defaults[a][p]) backup[a][p] = false;
+      }
+      topoPickFromCostTable(table, backup, &collInfo->algorithm, &collInfo->protocol, &minTime);
+    }
   }
 
   /* We only honor nChannels decision when user sets the nChannels by tuner plugin or the coll picks
@@ -1621,7 +2817,49 @@ static ncclResult_t getTunerInfo(struct ncclInfo* collInfo, int collNetSupport,
   return ncclSuccess;
 }
 
+// Let the built-in autotuner pick algo/proto and nChannels from the default cost table.
+// *nChannels is left at -1 when the autotuner keeps the default tuning.
+static ncclResult_t getAutotuneInfo(struct ncclInfo* collInfo, int collNetSupport, int nvlsSupport, int* nChannels) {
+  struct ncclComm* comm = collInfo->comm;
+  float table[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+  bool backup[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+  *nChannels = -1;
+  if (comm->nRanks == 1 || collInfo->coll >= NCCL_NUM_FUNCTIONS) return ncclSuccess;
+  NCCLCHECK(topoGetCollCostTable(collInfo, collNetSupport, nvlsSupport, 1, table, backup));
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    if (comm->buffSizes[p] == 0) table[a][p] = NCCL_ALGO_PROTO_IGNORE;
+  }
+  NCCLCHECK(ncclAutotuneGetCollInfo(comm, collInfo, table, nChannels, &collInfo->autotuneSample));
+  if (*nChannels >= 0) {
+    collInfo->nChannels = *nChannels;
+    collInfo->userTuned = *nChannels != 0;
+  }
+  return ncclSuccess;
+}
+
 /* Compute nChannels and nThreads. */
+// Percentage of the best predicted bandwidth a bandwidth-bound Ring/Tree collective
+// may give up to run on fewer channels, leaving their CUs to the application and
+// saving power. 0 always uses every channel.
+RCCL_PARAM(EnergyBwTolerance, "ENERGY_BW_TOLERANCE", 0);
+
+// Fewest channels whose predicted bandwidth is within the tolerance of nc channels.
+// Channel bandwidth grows with the channels until it reaches that of the
+// bottleneck link, taken from the tuning table.
+static int energyChannels(struct ncclInfo* collInfo, int nc) {
+  struct ncclComm* comm = collInfo->comm;
+  int64_t tolerance = rcclParamEnergyBwTolerance();
+  if (tolerance <= 0 || collInfo->coll >= NCCL_NUM_FUNCTIONS || collInfo->protocol != NCCL_PROTO_SIMPLE) return nc;
+  float channelBw = comm->algoChannelBw[collInfo->coll][collInfo->algorithm];
+  if (channelBw <= 0) return nc;
+  float bestBw = std::min(comm->bandwidths[collInfo->coll][collInfo->algorithm][collInfo->protocol], nc*channelBw);
+  int n = (int)ceilf(bestBw * (100-std::min<int64_t>(tolerance, 99)) / 100 / channelBw);
+  n = std::max(1, std::min(n, nc));
+  if (n < nc) TRACE(NCCL_TUNING, "%ld Bytes algo %d: %d channels instead of %d (channel bw %.1f GB/s, best %.1f GB/s)",
+      collInfo->nBytes, collInfo->algorithm, n, nc, channelBw, bestBw);
+  return n;
+}
+
 static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
   struct ncclComm *comm = collInfo->comm;
   int nc = (collInfo->nChannels > 0) ? collInfo->nChannels : comm->nChannels;
@@ -1641,6 +2879,17 @@ static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
   } else if (collInfo->algorithm == NCCL_ALGO_NVLS || collInfo->algorithm == NCCL_ALGO_NVLS_TREE) {
     // NVLS should not need more than 16 channels to get peak BW.
     nc = comm->nvlsChannels;
+  } else if (collInfo->algorithm == NCCL_ALGO_DIRECT) {
+    // Only the first directnChannels channels are connected to every peer
+    nc = std::min(nc, comm->directnChannels);
+    while (collInfo->nBytes < nc*nt*threadThreshold && nc >= 2) nc--;
+  } else if (collInfo->algorithm == NCCL_ALGO_RHD) {
+    // Only the first rhdnChannels channels are connected to the RHD peers
+    nc = std::min(nc, comm->rhdnChannels);
+    while (collInfo->nBytes < nc*nt*threadThreshold && nc >= 2) nc--;
+  } else if (collInfo->algorithm == NCCL_ALGO_BRUCK) {
+    // Bruck runs each collective on a single channel
+    nc = 1;
   } else {
     // Ring/Tree channel tuning
     while (collInfo->nBytes < nc*nt*threadThreshold) {
@@ -1652,6 +2901,8 @@ static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
 #endif
       else break;
     }
+    // Channels set by the user or a tuner are kept
+    if (collInfo->nChannels == 0) nc = energyChannels(collInfo, nc);
   }
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
 #else
@@ -1662,6 +2913,7 @@ static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
   }
   nt = nt/WARP_SIZE < 3 ? 3*WARP_SIZE : nt;
 #endif
+  if (collInfo->autotuneThreads > 0) nt = std::min(nt, collInfo->autotuneThreads);
   if (collInfo->coll == ncclFuncAllReduce && comm->topo->pivotA2ANumBiRings == 3) {
     static int userTuneInput = -2;
     if (userTuneInput == -2) {
@@ -1673,7 +2925,7 @@ static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
         userTuneInput = 1;
     }
     collInfo->nChannels = nc;
-    if (!userTuneInput) {
+    if (!userTuneInput && collDevFuncBuilt(collInfo, NCCL_ALGO_TREE, NCCL_PROTO_LL) && collDevFuncBuilt(collInfo, NCCL_ALGO_RING, NCCL_PROTO_SIMPLE)) {
       // always respect user settings
       if (collInfo->nBytes <= 2200008) {
         collInfo->protocol = NCCL_PROTO_LL;
@@ -1684,7 +2936,7 @@ static ncclResult_t getChannnelThreadInfo(struct ncclInfo* collInfo) {
         collInfo->algorithm = NCCL_ALGO_RING;
       }
     }
-  } else if (collInfo->coll == ncclFuncAllReduce && comm->topo->treeDefined == 1) {
+  } else if (collInfo->coll == ncclFuncAllReduce && comm->topo->treeDefined == 1 && collDevFuncBuilt(collInfo, NCCL_ALGO_TREE, collInfo->protocol)) {
     collInfo->algorithm = NCCL_ALGO_TREE;
     collInfo->nChannels = nc;
   } else {
@@ -1705,6 +2957,7 @@ static ncclResult_t getPatternInfo(struct ncclInfo* collInfo) {
       collInfo->pattern =
         collInfo->algorithm == NCCL_ALGO_NVLS ? ncclPatternNvls :
         collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT ? ncclPatternCollnetDirect :
+        collInfo->algorithm == NCCL_ALGO_BRUCK ? ncclPatternBruck :
         ncclPatternRing; break;
     case ncclFuncAllToAllPivot:
       collInfo->pattern = ncclPatternRing; break;
@@ -1715,6 +2968,8 @@ static ncclResult_t getPatternInfo(struct ncclInfo* collInfo) {
         collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT ? ncclPatternCollnetDirect :
         collInfo->algorithm == NCCL_ALGO_COLLNET_CHAIN ? ncclPatternCollnetChain :
         collInfo->algorithm == NCCL_ALGO_TREE ? ncclPatternTreeUpDown :
+        collInfo->algorithm == NCCL_ALGO_DIRECT ? ncclPatternDirect :
+        collInfo->algorithm == NCCL_ALGO_RHD ? ncclPatternRhd :
         ncclPatternRingTwice; break;
     default:
       WARN("Unknown pattern for collective %d algorithm %d", collInfo->coll, collInfo->algorithm);
@@ -1726,9 +2981,20 @@ static ncclResult_t getPatternInfo(struct ncclInfo* collInfo) {
 RCCL_PARAM(IntraNetThreshold, "INTRANET_THRESHOLD", 8388608);
 
 static ncclResult_t computeCollWorkFunc(struct ncclInfo* collInfo) {
+  if (ncclDevRedOpIsJit(collInfo->opFull.op)) {
+    // Index of the function in the module of the reduction
+    collInfo->workFuncIndex = ncclJitRedOpFuncIndex(collInfo->coll, collInfo->algorithm, collInfo->protocol);
+    if (collInfo->workFuncIndex < 0) {
+      WARN("%s: %s with a custom reduction operator only supports the ring and tree algorithms", __func__, collInfo->opName);
+      return ncclInvalidUsage;
+    }
+    return ncclSuccess;
+  }
   collInfo->workFuncIndex = ncclDevFuncId(collInfo->coll, collInfo->opFull.op, collInfo->datatype, collInfo->algorithm, collInfo->protocol);
   if (collInfo->workFuncIndex < 0) {
-    WARN("%s: unsupported collective. Please ensure the collective has been enabled in build.", __func__);
+    WARN("%s: %s %s %s with algorithm %s protocol %s was not built into this library, see ONLY_FUNCS", __func__,
+        collInfo->opName, ncclOpToString(collInfo->op), ncclDatatypeToString(collInfo->datatype),
+        ncclAlgoToString(collInfo->algorithm), ncclProtoToString(collInfo->protocol));
     return ncclInvalidUsage;
   }
   return ncclSuccess;
@@ -1759,9 +3025,14 @@ static ncclResult_t initCollWorkElem(struct ncclInfo* collInfo, struct ncclWorkE
   if (collInfo->algorithm == NCCL_ALGO_COLLNET_DIRECT) {
     // Set direct direction for broadcast-gather (read or write)
     work->direct = (collInfo->nBytes / collInfo->nChannels <= 1024 * 1024) ? NCCL_DIRECT_WRITE : NCCL_DIRECT_READ;
+  } else if (collInfo->algorithm == NCCL_ALGO_DIRECT) {
+    // Direct uses the p2p connections, and `direct` holds its number of shots
+    work->connIndex = 1;
+    work->direct = directNShots(collInfo);
   } else {
     work->direct = 0;
   }
+  work->treeSplit = collInfo->algorithm == NCCL_ALGO_TREE ? collInfo->comm->treeSplit[collInfo->protocol] : 0;
   return ncclSuccess;
 }
 
@@ -1805,6 +3076,33 @@ static ncclResult_t initCollWorkElemReg(struct ncclComm* comm, struct ncclWorkEl
 }
 
 NCCL_PARAM(NvlsTreeChunkSize, "NVLSTREE_MAX_CHUNKSIZE", -2);
+RCCL_PARAM(CollNetChainPipeline, "COLLNET_CHAIN_PIPELINE", 0);
+// Size the chunks of pipelined algorithms from the tuning model instead of the fixed thresholds
+RCCL_PARAM(ChunkModel, "CHUNK_MODEL", 0);
+
+// Number of hops a chunk goes through in the pipelined algorithms, 0 for the others
+static int chunkPipelineDepth(struct ncclInfo* collInfo) {
+  struct ncclComm* comm = collInfo->comm;
+  if (collInfo->algorithm == NCCL_ALGO_TREE && collInfo->protocol != NCCL_PROTO_LL) return comm->channels[0].tree.depth;
+  if (collInfo->algorithm == NCCL_ALGO_RING && collInfo->protocol == NCCL_PROTO_SIMPLE &&
+      (collInfo->pattern == ncclPatternPipelineFrom || collInfo->pattern == ncclPatternPipelineTo)) return comm->nRanks;
+  return 0;
+}
+
+// A pipeline of depth hops moving B bytes per channel in chunks of C bytes takes
+// (B/C + depth-1) * (lat + C/bw), where lat and bw are the latency of a hop and the
+// bandwidth of a channel. The time is lowest for C = sqrt(B*lat*bw/(depth-1)).
+// The default chunk size is halved down to that, so it stays a valid chunk size.
+static int modelChunkSize(struct ncclInfo* collInfo, size_t nBytes, int nChannels, int depth, int chunkSize) {
+  struct ncclComm* comm = collInfo->comm;
+  float lat = comm->latencies[collInfo->coll][collInfo->algorithm][collInfo->protocol] / depth;
+  float bw = comm->bandwidths[collInfo->coll][collInfo->algorithm][collInfo->protocol] * 1e3 / comm->nChannels; // bytes/us
+  if (lat <= 0 || bw <= 0) return chunkSize;
+  float target = sqrtf((float)(nBytes / nChannels) * lat * bw / (depth - 1));
+  while (chunkSize / 2 >= std::max(target, 32768.0f)) chunkSize /= 2;
+  return chunkSize;
+}
+
 
 static ncclResult_t computeCollChunkInfo(struct ncclInfo* collInfo, size_t nBytes, int nChannels) {
   int stepSize = collInfo->comm->buffSizes[collInfo->protocol] / NCCL_STEPS;
@@ -1815,7 +3113,10 @@ static ncclResult_t computeCollChunkInfo(struct ncclInfo* collInfo, size_t nByte
   if (collInfo->protocol == NCCL_PROTO_LL) chunkSize /= 2;
   if (collInfo->protocol == NCCL_PROTO_LL128) chunkSize = (chunkSize / NCCL_LL128_LINEELEMS) * NCCL_LL128_DATAELEMS;
 
-  if (collInfo->algorithm == NCCL_ALGO_TREE && collInfo->protocol == NCCL_PROTO_SIMPLE) {
+  int depth = rcclParamChunkModel() ? chunkPipelineDepth(collInfo) : 0;
+  if (depth > 1) {
+    chunkSize = modelChunkSize(collInfo, nBytes, nChannels, depth, chunkSize);
+  } else if (collInfo->algorithm == NCCL_ALGO_TREE && collInfo->protocol == NCCL_PROTO_SIMPLE) {
     if (collInfo->pattern == ncclPatternTreeUpDown) {
       // Optimize chunkSize / nSteps
       while (collInfo->nBytes / (collInfo->nChannels*chunkSize) < collInfo->comm->channels[0].tree.depth*8 && chunkSize > 131072) chunkSize /= 2;
@@ -1838,9 +3139,15 @@ static ncclResult_t computeCollChunkInfo(struct ncclInfo* collInfo, size_t nByte
   } else if (collInfo->algorithm == NCCL_ALGO_COLLNET_CHAIN) {
     stepSize = collInfo->comm->buffSizes[NCCL_PROTO_SIMPLE] / NCCL_STEPS;
     chunkSize = std::min(256 * 1024, stepSize * chunkSteps);
-    while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth * 64 && chunkSize > 131072) chunkSize /= 2;
-    while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth * 8 && chunkSize > 65536) chunkSize /= 2;
-    while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth && chunkSize > 32768) chunkSize /= 2;
+    int64_t pipeline = rcclParamCollNetChainPipeline();
+    if (pipeline > 0) {
+      // Keep that many chunks in flight per GPU of the chain
+      while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth * pipeline && chunkSize > 32768) chunkSize /= 2;
+    } else {
+      while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth * 64 && chunkSize > 131072) chunkSize /= 2;
+      while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth * 8 && chunkSize > 65536) chunkSize /= 2;
+      while (nBytes / (nChannels * chunkSize) < collInfo->comm->channels[0].collnetChain.depth && chunkSize > 32768) chunkSize /= 2;
+    }
   } else if (collInfo->algorithm == NCCL_ALGO_NVLS) {
     int maxChunkSize = 131072;
     if (collInfo->comm->nNodes > 1 && collInfo->comm->bandwidths[ncclFuncAllReduce][NCCL_ALGO_NVLS][NCCL_PROTO_SIMPLE] < 150) maxChunkSize = 32768;
@@ -1884,7 +3191,8 @@ static ncclResult_t initCollProxyOp(struct ncclInfo* collInfo, int channelId, ui
   proxyOp->protocol = collInfo->protocol;
   proxyOp->dtype = collInfo->datatype;
   // Network sees avg as sum
-  proxyOp->redOp = collInfo->opFull.op == ncclDevPreMulSum || collInfo->opFull.op == ncclDevSumPostDiv ? ncclSum : collInfo->opFull.proxyOp;
+  proxyOp->redOp = collInfo->opFull.op == ncclDevPreMulSum || collInfo->opFull.op == ncclDevSumPostScale ||
+                   collInfo->opFull.op == ncclDevSumPostDiv ? ncclSum : collInfo->opFull.proxyOp;
   proxyOp->pattern = collInfo->pattern;
   proxyOp->coll = collInfo->coll;
   proxyOp->root = collInfo->root;
@@ -1901,6 +3209,7 @@ static ncclResult_t initCollProxyOp(struct ncclInfo* collInfo, int channelId, ui
       proxyOp->connIndex = NCCL_CONN_IDX_P2P_NET;
     }
   }
+  if (collInfo->algorithm == NCCL_ALGO_DIRECT) proxyOp->connIndex = 1;
 
   if (collInfo->pattern == ncclPatternCollnetDirect) {
     proxyOp->specifics.collnetDirect.nNodes = collInfo->comm->nNodes;
@@ -1912,7 +3221,7 @@ static ncclResult_t initCollProxyOp(struct ncclInfo* collInfo, int channelId, ui
   return ncclSuccess;
 }
 
-static ncclResult_t hostToDevRedOp(
+ncclResult_t ncclHostToDevRedOp(
     ncclDevRedOpFull *opFull, ncclRedOp_t op, ncclDataType_t datatype, ncclComm *comm
   ) {
   union {
@@ -2009,6 +3318,43 @@ static ncclResult_t hostToDevRedOp(
   return ncclSuccess;
 }
 
+// MSCCL++ competes with the cost table: it runs a collective when its modeled time
+// (comm->mscclppLat/Bw, see tuning.cc) beats the best algorithm RCCL would pick.
+// AllToAll has no entry in the table and is weighed against an AllGather of the
+// same size. RCCL_MSCCLPP_TUNING=0, or a collective without a model, falls back
+// to RCCL_MSCCLPP_THRESHOLD.
+RCCL_PARAM(MscclppTuning, "MSCCLPP_TUNING", 1);
+
+ncclResult_t ncclMscclppPreferred(struct ncclComm* comm, ncclFunc_t coll, size_t count, ncclDataType_t datatype, ncclRedOp_t op, bool* use) {
+  struct ncclInfo info = {};
+  float table[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+  bool backup[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+  int algorithm, protocol;
+  float rcclTime;
+  info.coll = coll == ncclFuncAllToAll ? ncclFuncAllGather : coll;
+  info.comm = comm;
+  info.count = count;
+  info.datatype = datatype;
+  info.op = op;
+  NCCLCHECK(ncclInfoSetDerived(&info, comm->nRanks));
+  NCCLCHECK(ncclHostToDevRedOp(&info.opFull, info.op, info.datatype, comm));
+  // MSCCL++ cannot run a runtime-compiled reduction
+  if (ncclDevRedOpIsJit(info.opFull.op)) {
+    *use = false;
+    return ncclSuccess;
+  }
+  if (!rcclParamMscclppTuning() || comm->mscclppBw[coll] == 0) {
+    *use = info.nBytes <= comm->mscclpp_threshold;
+    return ncclSuccess;
+  }
+  NCCLCHECK(topoGetCollCostTable(&info, 0, 0, 1, table, backup));
+  topoPickFromCostTable(table, backup, &algorithm, &protocol, &rcclTime);
+  float time = comm->mscclppLat[coll] + info.nBytes / (1000 * comm->mscclppBw[coll]);
+  *use = algorithm == NCCL_ALGO_UNDEF || time < rcclTime;
+  TRACE(NCCL_TUNING, "MSCCL++ coll %d %zu bytes: %.1f us, RCCL algo %d proto %d %.1f us", coll, info.nBytes, time, algorithm, protocol, rcclTime);
+  return ncclSuccess;
+}
+
 static int collCmp(struct ncclInfo *a, struct ncclInfo *b) {
   if (a->coll > b->coll)
     return 1;
@@ -2022,6 +3368,113 @@ static int collCmp(struct ncclInfo *a, struct ncclInfo *b) {
     return -1;
 }
 
+// Mark the p2p connections used by the native alltoall for pre-connect. This
+// only needs to happen once per communicator.
+static ncclResult_t allToAllPreconnect(struct ncclComm* comm) {
+  int nChannels = allToAllnChannels(comm);
+  for (int d = 1; d < comm->nRanks; d++) {
+    int channelId = d % nChannels;
+    int sendPeer = (comm->rank + d) % comm->nRanks;
+    int recvPeer = (comm->rank - d + comm->nRanks) % comm->nRanks;
+    if (comm->channels[channelId].peers[sendPeer]->send[1].connected == 0) {
+      comm->connectSend[sendPeer].masks[channelId/64] |= (1UL<<(channelId%64));
+      ncclGroupCommPreconnect(comm);
+    }
+    if (comm->channels[channelId].peers[recvPeer]->recv[1].connected == 0) {
+      comm->connectRecv[recvPeer].masks[channelId/64] |= (1UL<<(channelId%64));
+      ncclGroupCommPreconnect(comm);
+    }
+  }
+  comm->allToAllConnected = true;
+  return ncclSuccess;
+}
+
+// Mark the p2p connections of the Direct AllReduce, to every peer on each of its
+// channels, for pre-connect. They are set up by the group launch like those of
+// ncclSend/ncclRecv, without a graph so that P2P keeps its read mode, and with no
+// CPU barrier so that a first AllReduce may be graph captured.
+static ncclResult_t directPreconnect(struct ncclComm* comm) {
+  for (int c = 0; c < comm->directnChannels; c++) {
+    for (int peer = 0; peer < comm->nRanks; peer++) {
+      if (peer == comm->rank) continue;
+      if (comm->channels[c].peers[peer]->send[1].connected == 0) {
+        comm->connectSend[peer].masks[c/64] |= (1UL<<(c%64));
+        ncclGroupCommPreconnect(comm);
+      }
+      if (comm->channels[c].peers[peer]->recv[1].connected == 0) {
+        comm->connectRecv[peer].masks[c/64] |= (1UL<<(c%64));
+        ncclGroupCommPreconnect(comm);
+      }
+    }
+  }
+  comm->directConnected = true;
+  return ncclSuccess;
+}
+
+// Mark the send and recv p2p connections to peer for pre-connect, on the channels
+// ncclSend/ncclRecv would use. Returns whether anything needs connecting.
+ncclResult_t ncclP2pPreconnectMark(struct ncclComm* comm, int peer, bool* marked) {
+  *marked = false;
+  for (int isSend = 0; isSend < 2; isSend++) {
+    int channelBaseId;
+    NCCLCHECK(ncclChannelComputeBase(comm, peer, isSend ? ncclFuncSend : ncclFuncRecv, &channelBaseId));
+    for (int c = 0; c < comm->p2pnChannelsPerPeer; c++) {
+      int channelId;
+      NCCLCHECK(ncclChannelComputeFromBase(comm, channelBaseId, c, &channelId));
+      struct ncclChannelPeer* channelPeer = comm->channels[channelId].peers[peer];
+      struct channelMasks* connect = isSend ? comm->connectSend : comm->connectRecv;
+      struct ncclConnector* conns = isSend ? channelPeer->send : channelPeer->recv;
+      // P2P uses only 1 connector, plus the P2P_NET one when enabled (see taskAppend)
+      if (conns[1].connected == 0) {
+        connect[peer].masks[channelId/64] |= (1UL<<(channelId%64));
+        *marked = true;
+      }
+      if (comm->p2pNet && conns[NCCL_CONN_IDX_P2P_NET].connected == 0) {
+        connect[peer+comm->nRanks*NCCL_CONN_IDX_P2P_NET].masks[channelId/64] |= (1UL<<(channelId%64));
+        *marked = true;
+      }
+    }
+  }
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclCommPreconnect, ncclComm_t comm, int nPeers, const int* peers);
+ncclResult_t ncclCommPreconnect(ncclComm_t comm, int nPeers, const int* peers) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECK(PtrCheck(comm, "CommPreconnect", "comm"));
+  if (nPeers > 0) NCCLCHECK(PtrCheck(peers, "CommPreconnect", "peers"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (comm->suspended) {
+    WARN("CommPreconnect : comm %p is suspended", comm);
+    return ncclInvalidUsage;
+  }
+  for (int i = 0; i < nPeers; i++) {
+    if (peers[i] < 0 || peers[i] >= comm->nRanks) {
+      WARN("CommPreconnect : invalid peer %d, nRanks %d", peers[i], comm->nRanks);
+      return ncclInvalidArgument;
+    }
+  }
+
+  // Connections are set up by a group without tasks: in the background for
+  // non-blocking communicators, which report completion through ncclCommGetAsyncError.
+  NCCLCHECK(ncclGroupStartInternal());
+  ncclGroupCommJoin(comm);
+  for (int i = 0; i < nPeers; i++) {
+    bool marked;
+    if (peers[i] == comm->rank) continue;
+    NCCLCHECKGOTO(ncclP2pPreconnectMark(comm, peers[i], &marked), ret, fail);
+    if (marked) ncclGroupCommPreconnect(comm);
+  }
+exit:
+  ncclGroupErrCheck(ret);
+  NCCLCHECK(ncclGroupEndInternal());
+  if (!comm->config.blocking) (void) ncclCommGetAsyncError(comm, &ret);
+  return ret;
+fail:
+  goto exit;
+}
+
 // Converts `info` to a task and adds it to `comm->tasks`. The exception is with
 // single rank communicators, collectives are issued as `ncclMemcpyAsync`s and
 // thus don't need a task.
@@ -2049,9 +3502,14 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
     if (comm->rank != peer) {
       int channelBaseId;
       NCCLCHECK(ncclChannelComputeBase(comm, peer, info->coll, &channelBaseId));
-      if (!(isSendNotRecv ? tasks->peers[peer].sendSeen : tasks->peers[peer].recvSeen)) {
-        (isSendNotRecv ? tasks->peers[peer].sendSeen : tasks->peers[peer].recvSeen) = true;
-        for (int c=0; c < comm->p2pnChannelsPerPeer; c++) {
+      int nChannelsPeer = p2pChannelsPerPeer(comm, nBytes);
+      bool heavy = nChannelsPeer > comm->p2pnChannelsPerPeer;
+      bool* seen = isSendNotRecv ? &tasks->peers[peer].sendSeen : &tasks->peers[peer].recvSeen;
+      bool* heavySeen = isSendNotRecv ? &tasks->peers[peer].sendHeavySeen : &tasks->peers[peer].recvHeavySeen;
+      if (!*seen || (heavy && !*heavySeen)) {
+        *seen = true;
+        if (heavy) *heavySeen = true;
+        for (int c=0; c < nChannelsPeer; c++) {
           int channelId;
           NCCLCHECK(ncclChannelComputeFromBase(comm, channelBaseId, c, &channelId));
           if (isSendNotRecv) {
@@ -2083,9 +3541,22 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
   } else {
     // Copy reduction op state from op handle into info struct here since the
     // op handle may be destroyed before ncclGroupEnd().
-    NCCLCHECK(hostToDevRedOp(&info->opFull, info->op, info->datatype, comm));
+    NCCLCHECK(ncclHostToDevRedOp(&info->opFull, info->op, info->datatype, comm));
+    struct ncclJitRedOp* epilogue = ncclDevRedOpIsJit(info->opFull.op) ? ncclJitRedOpGet(info->opFull.op) : nullptr;
+    if (epilogue && !epilogue->epilogue) epilogue = nullptr;
+    if (epilogue && info->coll != ncclFuncAllReduce) {
+      WARN("%s: operators created by ncclRedOpCreateEpilogue only apply to AllReduce", info->opName);
+      return ncclInvalidArgument;
+    }
 
-    if (comm->nRanks == 1) {
+    if (info->hostColl) {
+      // Ordered on its stream by the host collective thread, not by a plan
+      return ncclHostCollAppend(comm, info);
+    } else if (comm->nRanks == 1 && epilogue) {
+      NCCLCHECK(ncclJitEpilogueLaunchOneRank(epilogue, info->recvbuff, info->sendbuff, info->count,
+          ncclTypeSize(info->datatype), info->opFull.scalarArg, info->stream));
+      return ncclSuccess;
+    } else if (comm->nRanks == 1) {
       NCCLCHECK(ncclLaunchOneRank(info->recvbuff, info->sendbuff, info->count, info->opFull, info->datatype, info->stream));
       return ncclSuccess;
     } else {
@@ -2097,10 +3568,20 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
       info->algorithm = NCCL_ALGO_UNDEF;
       info->protocol = NCCL_PROTO_UNDEF;
       info->userTuned = false;
+      info->autotuneSample = 0;
+      info->autotuneKernel = 0;
+      info->autotuneThreads = 0;
       memcpy(t, info, sizeof(struct ncclInfo));
       ncclIntruQueueSortEnqueue(&tasks->collQueue, t, collCmp);
       tasks->workBytesTotal += info->count * ncclTypeSize(info->datatype);
       tasks->nTasksColl += 1;
+      if (info->coll == ncclFuncAllToAll && !comm->allToAllConnected) NCCLCHECK(allToAllPreconnect(comm));
+      if (info->coll == ncclFuncAllReduce && comm->directSupport && !comm->directConnected) NCCLCHECK(directPreconnect(comm));
+      // The native alltoall only uses p2p connections
+      if (info->coll != ncclFuncAllToAll && !comm->collConnected) {
+        comm->collConnectRequested = true;
+        ncclGroupCommPreconnect(comm);
+      }
     }
   }
 
@@ -2133,6 +3614,20 @@ static ncclResult_t taskAppend(struct ncclComm* comm, struct ncclInfo* info) {
 }
 
 ncclResult_t ncclEnqueueCheck(struct ncclInfo* info) {
+  if (info->comm != nullptr && info->comm->suspended) {
+    WARN("%s: comm %p is suspended, call ncclCommResume first", info->opName, info->comm);
+    return ncclInvalidUsage;
+  }
+  // The autotuner exchanges its measurements with a collective of its own,
+  // which must be issued outside of any user group.
+  if (ncclGroupDepth == 0 && info->comm != nullptr && info->comm->autotune != nullptr) {
+    NCCLCHECK(ncclAutotuneProgress(info->comm, info->stream));
+  }
+  // Straggler detection counts every call and exchanges the same way
+  if (info->comm != nullptr && info->comm->straggler != nullptr) {
+    NCCLCHECK(ncclStragglerProgress(info->comm, info, info->stream));
+  }
+  uint64_t hostStart = ncclStatsHostStart();
   NCCLCHECK(ncclGroupStartInternal());
   ncclResult_t ret = ncclSuccess;
   int devOld = -1;
@@ -2147,14 +3642,20 @@ ncclResult_t ncclEnqueueCheck(struct ncclInfo* info) {
   }
   NCCLCHECKGOTO(ArgsCheck(info), ret, fail);
 
-  INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p task %d globalrank %d",
+  INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p task %d globalrank %d time %.3f",
       info->opName, info->comm->opCount, info->sendbuff, info->recvbuff, info->count,
       info->datatype, info->op, info->root, info->comm, info->comm->nRanks, info->stream,
       info->comm->tasks.nTasksP2p + info->comm->tasks.nTasksColl,
-      info->comm->localRankToRank[info->comm->localRank]);
+      info->comm->localRankToRank[info->comm->localRank], clockNano()/1e6);
   TRACE_CALL("nccl%s(%" PRIx64 ",%" PRIx64 ",%zi,%d,%d,%d,%p,%p)", info->opName, reinterpret_cast<int64_t>(info->sendbuff), reinterpret_cast<int64_t>(info->recvbuff), info->count, info->datatype, info->op, info->root, info->comm, info->stream);
 
+  if (info->comm->callTrace) NCCLCHECKGOTO(ncclCallTraceRecord(info->comm, info), ret, fail);
+  ncclStatsNoteCall(info->comm, info);
   NCCLCHECKGOTO(taskAppend(info->comm, info), ret, fail);
+  if (hostStart) {
+    ncclStatsAdd(&info->comm->stats.hostOps, 1);
+    ncclStatsHostEnd(&info->comm->stats, ncclStatsHostAppend, hostStart);
+  }
 
 exit:
   if (devOld != -1) CUDACHECK(cudaSetDevice(devOld));
@@ -2169,12 +3670,8 @@ fail:
   goto exit;
 }
 
-NCCL_API(ncclResult_t, ncclRedOpCreatePreMulSum, ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm);
-ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm) {
-  NCCLCHECK(PtrCheck(comm, "ncclRedOpCreatePreMulSum", "comm"));
-  /* join init thread before creating PreMulSum op. */
-  NCCLCHECK(ncclCommEnsureReady(comm));
-
+// Pops a free entry from comm->userRedOps, growing the array when it is full
+static ncclResult_t userRedOpAlloc(ncclComm_t comm, int* ixOut) {
   if (comm->userRedOpFreeHead == comm->userRedOpCapacity) {
     // double capacity and resize
     int cap = 2*comm->userRedOpCapacity;
@@ -2193,6 +3690,50 @@ ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t *op, void *scalar, ncclDataTyp
   comm->userRedOpFreeHead = user->freeNext;
 
   user->freeNext = -1; // allocated
+  user->devArgs = NULL;
+  *ixOut = ix;
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclCommSetStreamPartition, ncclComm_t comm, cudaStream_t stream, int partition);
+ncclResult_t ncclCommSetStreamPartition(ncclComm_t comm, cudaStream_t stream, int partition) {
+  NCCLCHECK(PtrCheck(comm, "CommSetStreamPartition", "comm"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (partition < -1 || partition >= comm->nStreamParts) {
+    WARN("CommSetStreamPartition : invalid partition %d, RCCL_STREAM_PARTITIONS gives %d", partition, comm->nStreamParts);
+    return ncclInvalidArgument;
+  }
+  int i = 0;
+  while (i < comm->nPartStreams && comm->partStreams[i] != stream) i++;
+  if (partition == -1) {
+    if (i == comm->nPartStreams) return ncclSuccess;
+    comm->nPartStreams--;
+    comm->partStreams[i] = comm->partStreams[comm->nPartStreams];
+    comm->partStreamIds[i] = comm->partStreamIds[comm->nPartStreams];
+    return ncclSuccess;
+  }
+  if (i == comm->nPartStreams) {
+    if (i == RCCL_MAX_PART_STREAMS) {
+      WARN("CommSetStreamPartition : at most %d streams can be bound", RCCL_MAX_PART_STREAMS);
+      return ncclInvalidUsage;
+    }
+    comm->partStreams[i] = stream;
+    comm->nPartStreams++;
+  }
+  comm->partStreamIds[i] = partition;
+  INFO(NCCL_COLL, "CommSetStreamPartition: comm %p rank %d stream %p partition %d/%d", comm, comm->rank, stream, partition, comm->nStreamParts);
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclRedOpCreatePreMulSum, ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm);
+ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t *op, void *scalar, ncclDataType_t datatype, ncclScalarResidence_t residence, ncclComm_t comm) {
+  NCCLCHECK(PtrCheck(comm, "ncclRedOpCreatePreMulSum", "comm"));
+  /* join init thread before creating PreMulSum op. */
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  int ix;
+  NCCLCHECK(userRedOpAlloc(comm, &ix));
+  ncclUserRedOp *user = &comm->userRedOps[ix];
   user->datatype = datatype;
   user->opFull.op = ncclDevPreMulSum;
   if (residence == ncclScalarHostImmediate) {
@@ -2208,6 +3749,117 @@ ncclResult_t ncclRedOpCreatePreMulSum(ncclRedOp_t *op, void *scalar, ncclDataTyp
   return ncclSuccess;
 }
 
+NCCL_API(ncclResult_t, ncclRedOpCreatePostScaleSum, ncclRedOp_t *op, float *scale, ncclScalarResidence_t residence, int *nonFinite, ncclDataType_t datatype, ncclComm_t comm);
+ncclResult_t ncclRedOpCreatePostScaleSum(ncclRedOp_t *op, float *scale, ncclScalarResidence_t residence, int *nonFinite, ncclDataType_t datatype, ncclComm_t comm) {
+  NCCLCHECK(PtrCheck(comm, "ncclRedOpCreatePostScaleSum", "comm"));
+  NCCLCHECK(PtrCheck(scale, "ncclRedOpCreatePostScaleSum", "scale"));
+  if (datatype < 0 || datatype >= ncclNumTypes) {
+    WARN("ncclRedOpCreatePostScaleSum : invalid type %d", datatype);
+    return ncclInvalidArgument;
+  }
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  // The kernels read the scale and the flag address from device memory, so that
+  // both fit in the 64-bit scalar argument of the work element
+  struct ncclDevPostScaleArgs args = {};
+  struct ncclDevPostScaleArgs* devArgs = NULL;
+  if (residence == ncclScalarHostImmediate) {
+    args.scale = *scale;
+  } else {
+    args.scale = 1.0f;
+    args.scalePtr = scale;
+  }
+  args.nonFinite = nonFinite;
+  int cudaDev;
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECK(cudaSetDevice(comm->cudaDev));
+  ncclResult_t ret = ncclCudaCalloc(&devArgs, 1);
+  if (ret == ncclSuccess) ret = ncclCudaMemcpy(devArgs, &args, 1);
+  CUDACHECK(cudaSetDevice(cudaDev));
+  if (ret != ncclSuccess) {
+    if (devArgs) ncclCudaFree(devArgs);
+    return ret;
+  }
+
+  int ix;
+  NCCLCHECK(userRedOpAlloc(comm, &ix));
+  ncclUserRedOp *user = &comm->userRedOps[ix];
+  user->datatype = datatype;
+  user->devArgs = devArgs;
+  user->opFull.op = ncclDevSumPostScale;
+  user->opFull.scalarArgIsPtr = false;
+  user->opFull.scalarArg = reinterpret_cast<uint64_t>(devArgs);
+  *op = ncclRedOp_t(int(ncclNumOps) + ix);
+  *op = ncclUserRedOpMangle(comm, *op);
+  TRACE_CALL("ncclRedOpCreatePostScaleSum(%d,%p,%d,%p,%d,%p)", *op, scale, residence, nonFinite, datatype, comm);
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclRedOpCreateCustom, ncclRedOp_t *op, const char *source, const char *functor, ncclDataType_t datatype, ncclComm_t comm);
+ncclResult_t ncclRedOpCreateCustom(ncclRedOp_t *op, const char *source, const char *functor, ncclDataType_t datatype, ncclComm_t comm) {
+  NCCLCHECK(PtrCheck(comm, "ncclRedOpCreateCustom", "comm"));
+  NCCLCHECK(PtrCheck(source, "ncclRedOpCreateCustom", "source"));
+  NCCLCHECK(PtrCheck(functor, "ncclRedOpCreateCustom", "functor"));
+  if (datatype < 0 || datatype >= ncclNumTypes) {
+    WARN("ncclRedOpCreateCustom : invalid type %d", datatype);
+    return ncclInvalidArgument;
+  }
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  // The module is shared by every communicator of the device using the same
+  // source, and outlives the operator
+  struct ncclJitRedOp* jit;
+  NCCLCHECK(ncclJitRedOpCreate(comm, source, functor, datatype, &jit));
+
+  int ix;
+  NCCLCHECK(userRedOpAlloc(comm, &ix));
+  ncclUserRedOp *user = &comm->userRedOps[ix];
+  user->datatype = datatype;
+  user->opFull.op = ncclDevRedOp_t(int(ncclNumDevRedOps) + jit->id);
+  user->opFull.proxyOp = ncclSum;
+  user->opFull.scalarArgIsPtr = false;
+  user->opFull.scalarArg = 0;
+  *op = ncclRedOp_t(int(ncclNumOps) + ix);
+  *op = ncclUserRedOpMangle(comm, *op);
+  TRACE_CALL("ncclRedOpCreateCustom(%d,%s,%d,%p)", *op, functor, datatype, comm);
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclRedOpCreateEpilogue, ncclRedOp_t *op, ncclRedOp_t reduceOp, const char *source, const char *functor, void *arg, ncclDataType_t datatype, ncclComm_t comm);
+ncclResult_t ncclRedOpCreateEpilogue(ncclRedOp_t *op, ncclRedOp_t reduceOp, const char *source, const char *functor, void *arg, ncclDataType_t datatype, ncclComm_t comm) {
+  NCCLCHECK(PtrCheck(comm, "ncclRedOpCreateEpilogue", "comm"));
+  NCCLCHECK(PtrCheck(source, "ncclRedOpCreateEpilogue", "source"));
+  NCCLCHECK(PtrCheck(functor, "ncclRedOpCreateEpilogue", "functor"));
+  if (datatype < 0 || datatype >= ncclNumTypes) {
+    WARN("ncclRedOpCreateEpilogue : invalid type %d", datatype);
+    return ncclInvalidArgument;
+  }
+  if (reduceOp != ncclSum && reduceOp != ncclProd) {
+    WARN("ncclRedOpCreateEpilogue : the reduction must be ncclSum or ncclProd, not %d", reduceOp);
+    return ncclInvalidArgument;
+  }
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  // Like ncclRedOpCreateCustom, one module per source and device; operators
+  // differing only by their argument share it
+  struct ncclJitRedOp* jit;
+  NCCLCHECK(ncclJitEpilogueCreate(comm, source, functor, reduceOp, datatype, &jit));
+
+  int ix;
+  NCCLCHECK(userRedOpAlloc(comm, &ix));
+  ncclUserRedOp *user = &comm->userRedOps[ix];
+  user->datatype = datatype;
+  user->opFull.op = ncclDevRedOp_t(int(ncclNumDevRedOps) + jit->id);
+  user->opFull.proxyOp = reduceOp;
+  // Handed to the epilogue as is, builtin reductions have no use for it
+  user->opFull.scalarArgIsPtr = false;
+  user->opFull.scalarArg = reinterpret_cast<uint64_t>(arg);
+  *op = ncclRedOp_t(int(ncclNumOps) + ix);
+  *op = ncclUserRedOpMangle(comm, *op);
+  TRACE_CALL("ncclRedOpCreateEpilogue(%d,%d,%s,%p,%d,%p)", *op, reduceOp, functor, arg, datatype, comm);
+  return ncclSuccess;
+}
+
 NCCL_API(ncclResult_t, ncclRedOpDestroy, ncclRedOp_t op, ncclComm_t comm);
 ncclResult_t ncclRedOpDestroy(ncclRedOp_t op, ncclComm_t comm) {
   if (0 <= int(op) && int(op) < int(ncclNumOps)) {
@@ -2228,6 +3880,10 @@ ncclResult_t ncclRedOpDestroy(ncclRedOp_t op, ncclComm_t comm) {
     WARN("ncclRedOpDestroy : operator unknown to this communicator.");
     return ncclInvalidArgument;
   }
+  if (comm->userRedOps[ix].devArgs) {
+    NCCLCHECK(ncclCudaFree(comm->userRedOps[ix].devArgs));
+    comm->userRedOps[ix].devArgs = NULL;
+  }
   // push to free list
   comm->userRedOps[ix].freeNext = comm->userRedOpFreeHead;
   comm->userRedOpFreeHead = ix;
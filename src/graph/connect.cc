@@ -10,13 +10,24 @@
 #include "trees.h"
 #include "rings.h"
 #include "topo.h"
+#include "rccl_vars.h"
 
 #include "msccl/msccl_lifecycle.h"
 
+#include <algorithm>
+
 /******************************************************************/
 /********************* Internode connection ***********************/
 /******************************************************************/
 
+int64_t rcclParamRailAligned();
+
+static int netRail(struct ncclTopoSystem* system, int64_t netId) {
+  int n;
+  if (ncclTopoIdToIndex(system, NET, netId, &n) != ncclSuccess) return -1;
+  return system->nodes[NET].nodes[n].net.rail;
+}
+
 ncclResult_t ncclTopoPreset(struct ncclComm* comm, struct ncclTopoGraph** graphs, struct ncclTopoRanks* topoRanks) {
   int rank = comm->rank;
   int localRanks = comm->topo->nodes[GPU].count;
@@ -41,6 +52,9 @@ ncclResult_t ncclTopoPreset(struct ncclComm* comm, struct ncclTopoGraph** graphs
     int* ringIntra = graphs[NCCL_ALGO_RING]->intra+c*localRanks;
     int* treeIntra = graphs[NCCL_ALGO_TREE]->intra+c*localRanks;
     int* collNetIntra = graphs[NCCL_ALGO_COLLNET_CHAIN]->intra+c*localRanks;
+    topoRanks->ringRecvRail[c] = netRail(comm->topo, graphs[NCCL_ALGO_RING]->inter[c*2]);
+    topoRanks->ringSendRail[c] = netRail(comm->topo, graphs[NCCL_ALGO_RING]->inter[c*2+1]);
+    topoRanks->treeRail[c] = netRail(comm->topo, graphs[NCCL_ALGO_TREE]->inter[c*2]);
 
     for (int i=0; i<localRanks; i++) {
       if (ringIntra[i] == rank) {
@@ -280,7 +294,39 @@ static ncclResult_t setTreeDown(struct ncclTree* tree, int* indexes, int d) {
   return ncclSuccess;
 }
 
-static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int* treeToChild0, int* treeToChild1, int* treePatterns) {
+// Number of inter-node trees. 2 is the double binary tree, larger even values
+// rotate more tree pairs over the channels, -1 uses one pair per NIC rail.
+RCCL_PARAM(TreeCount, "TREE_COUNT", 2);
+
+// Channel c uses trees 2*treePair[c] and 2*treePair[c]+1 of ncclGetMultiTree.
+// treeRails are the rails of node 0, so all ranks compute the same pairs.
+static void getTreePairs(struct ncclComm* comm, int* treeRails, int* nTrees, int* treePair) {
+  int64_t count = rcclParamTreeCount();
+  int nPairs = 1;
+  for (int c=0; c<comm->nChannels; c++) treePair[c] = 0;
+  if (count == -1) {
+    // Pairs numbered by increasing rail
+    int rails[MAXCHANNELS];
+    int nRails = 0;
+    for (int c=0; c<comm->nChannels; c++) {
+      if (treeRails[c] < 0 || std::find(rails, rails+nRails, treeRails[c]) != rails+nRails) continue;
+      rails[nRails++] = treeRails[c];
+    }
+    std::sort(rails, rails+nRails);
+    for (int c=0; c<comm->nChannels; c++) {
+      int* r = std::find(rails, rails+nRails, treeRails[c]);
+      if (r != rails+nRails) treePair[c] = r-rails;
+    }
+    nPairs = std::max(nRails, 1);
+  } else if (count > 2) {
+    nPairs = std::min<int64_t>(count/2, comm->nChannels);
+    for (int c=0; c<comm->nChannels; c++) treePair[c] = c % nPairs;
+  }
+  *nTrees = 2*nPairs;
+  if (*nTrees > 2 && comm->rank == 0) INFO(NCCL_GRAPH, "Trees : %d inter-node trees over %d channels", *nTrees, comm->nChannels);
+}
+
+static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int* treeToChild0, int* treeToChild1, int* treePatterns, int* treeRails) {
 
   const int channelLimit = IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx94") ? 2*CHANNEL_LIMIT : CHANNEL_LIMIT;
   const int nChannels = (comm->nChannels > channelLimit) ? comm->nChannels / 2 : comm->nChannels;
@@ -292,11 +338,14 @@ static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int*
 
   int t0u, t0d0, t0d1, t0ChildType, t1u, t1d0, t1d1, t1ChildType;
   int* ttp, *ttc0, *ttc1;
-  NCCLCHECK(ncclGetDtree(nNodes, node, &t0u, &t0d0, &t0d1, &t0ChildType, &t1u, &t1d0, &t1d1, &t1ChildType));
+  int nTrees, treePair[MAXCHANNELS];
+  getTreePairs(comm, treeRails, &nTrees, treePair);
   if (nChannels == comm->nChannels) {
     for (int c=0; c<nChannels; c++) {
        struct ncclChannel* channel0 = comm->channels+c;
        struct ncclChannel* channel1 = channel0+nChannels;
+       NCCLCHECK(ncclGetMultiTree(nNodes, node, nTrees, 2*treePair[c], &t0u, &t0d0, &t0d1, &t0ChildType));
+       NCCLCHECK(ncclGetMultiTree(nNodes, node, nTrees, 2*treePair[c]+1, &t1u, &t1d0, &t1d1, &t1ChildType));
        ttp = treeToParent+c*comm->nNodes;
        ttc0 = treeToChild0+c*comm->nNodes;
        ttc1 = treeToChild1+c*comm->nNodes;
@@ -323,6 +372,7 @@ static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int*
   } else {
     for (int c=0; c<nChannels; c++) {
        struct ncclChannel* channel0 = comm->channels+c;
+       NCCLCHECK(ncclGetMultiTree(nNodes, node, nTrees, 2*treePair[c], &t0u, &t0d0, &t0d1, &t0ChildType));
        ttp = treeToParent+c*comm->nNodes;
        ttc0 = treeToChild0+c*comm->nNodes;
        ttc1 = treeToChild1+c*comm->nNodes;
@@ -344,6 +394,7 @@ static ncclResult_t connectTrees(struct ncclComm* comm, int* treeToParent, int*
     }
     for (int c=nChannels; c<nChannels*2; c++) {
        struct ncclChannel* channel1 = comm->channels+c;
+       NCCLCHECK(ncclGetMultiTree(nNodes, node, nTrees, 2*treePair[c]+1, &t1u, &t1d0, &t1d1, &t1ChildType));
        ttp = treeToParent+c*comm->nNodes;
        ttc0 = treeToChild0+c*comm->nNodes;
        ttc1 = treeToChild1+c*comm->nNodes;
@@ -514,7 +565,79 @@ static ncclResult_t connectNvls(struct ncclComm* comm, int* nvlsHeads, int nHead
   return ncclSuccess;
 }
 
+RCCL_PARAM(RhdEnable, "RHD_ENABLE", 1);
+RCCL_PARAM(RhdMinNodes, "RHD_MIN_NODES", 4);
+RCCL_PARAM(RhdNChannels, "RHD_NCHANNELS", 4);
+
+// Recursive halving-doubling peers of the first rhdnChannels channels. Ranks are
+// numbered by their position in the ring of the channel counted from rank 0, so
+// that all ranks agree and the ranks of a node are next to each other.
+// RCCL_RHD_MIN_NODES=1 also allows single node comms.
+static ncclResult_t connectRhd(struct ncclComm* comm, int* rings) {
+  int nranks = comm->nRanks;
+  int nGroup = 1, nSteps = 0;
+  while (nGroup*2 <= nranks) { nGroup *= 2; nSteps++; }
+  int nExtra = nranks - nGroup;
+  comm->rhdSupport = rcclParamRhdEnable() && comm->nNodes >= std::max(1, (int)rcclParamRhdMinNodes()) &&
+    !comm->MNNVL && nSteps <= NCCL_MAX_RHD_STEPS;
+  if (!comm->rhdSupport) return ncclSuccess;
+  comm->rhdnChannels = std::max(1, std::min((int)rcclParamRhdNChannels(), comm->nChannels));
+
+  for (int c=0; c<comm->rhdnChannels; c++) {
+    struct ncclRhd* rhd = &comm->channels[c].rhd;
+    int* ring = rings+c*nranks; // Starts with our rank
+    int start = 0;
+    while (ring[start] != 0) start++;
+    int pos = (nranks-start)%nranks;
+    rhd->nSteps = nSteps;
+    if (pos < 2*nExtra) {
+      rhd->vrank = pos%2 ? pos/2 : -1;
+      rhd->extra = ring[(start+(pos^1))%nranks];
+    } else {
+      rhd->vrank = pos-nExtra;
+      rhd->extra = -1;
+    }
+    char line[1024];
+    sprintf(line, "RHD channel %d rank %d vrank %d extra %d peers", c, comm->rank, rhd->vrank, rhd->extra);
+    for (int k=0; k<nSteps; k++) {
+      int w = rhd->vrank ^ (1<<k);
+      rhd->peers[k] = rhd->vrank < 0 ? -1 : ring[(start+(w < nExtra ? 2*w+1 : w+nExtra))%nranks];
+      sprintf(line+strlen(line), " %d", rhd->peers[k]);
+    }
+    INFO(NCCL_GRAPH, "%s", line);
+  }
+  return ncclSuccess;
+}
+
+RCCL_PARAM(BruckEnable, "BRUCK_ENABLE", 1);
+RCCL_PARAM(BruckMinRanks, "BRUCK_MIN_RANKS", 64);
+RCCL_PARAM(BruckNChannels, "BRUCK_NCHANNELS", 2);
+RCCL_PARAM(BruckScratchSize, "BRUCK_SCRATCH_SIZE", 4194304); // Per channel
+
+// Bruck AllGather / ReduceScatter peers are the ranks at distance 1<<k, so only
+// the number of steps is kept per channel. ReduceScatter holds partial sums for
+// at most bruckScratchBlocks blocks at a time: the largest step after the first.
+static ncclResult_t connectBruck(struct ncclComm* comm) {
+  int nranks = comm->nRanks;
+  int nSteps = 0;
+  while ((1 << nSteps) < nranks) nSteps++;
+  comm->bruckSupport = rcclParamBruckEnable() && nranks >= std::max(2, (int)rcclParamBruckMinRanks()) &&
+    nSteps <= NCCL_MAX_BRUCK_STEPS;
+  if (!comm->bruckSupport) return ncclSuccess;
+  comm->brucknChannels = std::max(1, std::min((int)rcclParamBruckNChannels(), comm->nChannels));
+  comm->bruckScratchBytes = std::max((int64_t)0, rcclParamBruckScratchSize());
+  comm->bruckScratchBlocks = 0;
+  for (int k=1; k<nSteps; k++) comm->bruckScratchBlocks = std::max(comm->bruckScratchBlocks, std::min(1<<k, nranks-(1<<k)));
+  for (int c=0; c<comm->brucknChannels; c++) comm->channels[c].bruck.nSteps = nSteps;
+  INFO(NCCL_GRAPH, "Bruck: %d steps on %d channels, %d scratch blocks", nSteps, comm->brucknChannels, comm->bruckScratchBlocks);
+  return ncclSuccess;
+}
+
 // Legacy naming
+// Run the duplicated channels in the opposite direction on fully connected XGMI nodes,
+// so that every channel pair uses both directions of each link
+RCCL_PARAM(BidirRings, "BIDIR_RINGS", 0);
+
 NCCL_PARAM(MinNrings, "MIN_NRINGS", -2);
 NCCL_PARAM(MaxNrings, "MAX_NRINGS", -2);
 // New naming
@@ -607,6 +730,24 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
     }
   }
 
+  if (rcclParamRailAligned() && nNodes > 1 && comm->rank == 0) {
+    // Nodes whose NICs or rail numbering differ can still end up crossing rails
+    int ringCross = 0, treeCross = 0;
+    for (int c=0; c<nChannels; c++) {
+      for (int n=0; n<nNodes; n++) {
+        struct ncclTopoRanks* node = allTopoRanks[firstRanks[n]];
+        struct ncclTopoRanks* next = allTopoRanks[firstRanks[(n+1)%nNodes]];
+        if (node->ringSendRail[c] != next->ringRecvRail[c]) ringCross++;
+        if (node->treeRail[c] != allTopoRanks[firstRanks[0]]->treeRail[c]) treeCross++;
+      }
+    }
+    if (ringCross || treeCross) {
+      WARN("RCCL_RAIL_ALIGNED : %d ring and %d tree inter-node edges cross rails, check RCCL_NET_RAILS on all nodes", ringCross, treeCross);
+    } else {
+      INFO(NCCL_GRAPH, "RCCL_RAIL_ALIGNED : all %d channels stay on one rail across %d nodes", nChannels, nNodes);
+    }
+  }
+
   for (int n = 0; n < nNodes; n++) {
     int r = firstRanks[n];
     if (minHeadNum > allTopoRanks[r]->nvlsHeadNum)
@@ -622,7 +763,9 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
 
   // Connect rings and trees. This should also duplicate the channels.
   NCCLCHECK(connectRings(comm, ringRecv, ringSend, ringPrev, ringNext));
-  NCCLCHECK(connectTrees(comm, treeToParent, treeToChild0, treeToChild1, treePatterns));
+  int treeRails[MAXCHANNELS];
+  for (int c=0; c<nChannels; c++) treeRails[c] = allTopoRanks[firstRanks[0]]->treeRail[c];
+  NCCLCHECK(connectTrees(comm, treeToParent, treeToChild0, treeToChild1, treePatterns, treeRails));
 
   // Only use full MAXCHANNELS for gfx94x
   int maxChannels = IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx94") ?
@@ -632,9 +775,13 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
     maxChannels = std::min(64, maxChannels);
   }
 
-  // Duplicate ringPrev/ringNext for ncclBuildRing
-  if (nChannels <= maxChannels/2) memcpy(ringPrev+nChannels*nranks, ringPrev, nChannels*nranks*sizeof(int));
-  if (nChannels <= maxChannels/2) memcpy(ringNext+nChannels*nranks, ringNext, nChannels*nranks*sizeof(int));
+  // Duplicate ringPrev/ringNext for ncclBuildRing. Reversed rings swap prev and next, the
+  // GPU order stays the same and the second half of the data flows the other way.
+  bool bidirRings = rcclParamBidirRings() && nNodes == 1 && nranks > 2 && (comm->topo->type & RCCL_TOPO_XGMI_ALL) && nChannels <= maxChannels/2;
+  if (nChannels <= maxChannels/2) memcpy(ringPrev+nChannels*nranks, bidirRings ? ringNext : ringPrev, nChannels*nranks*sizeof(int));
+  if (nChannels <= maxChannels/2) memcpy(ringNext+nChannels*nranks, bidirRings ? ringPrev : ringNext, nChannels*nranks*sizeof(int));
+  int bidirChannels = nChannels;
+  if (bidirRings) INFO(NCCL_GRAPH, "Channels %d-%d run the rings of channels 0-%d in reverse", nChannels, 2*nChannels-1, nChannels-1);
 
   // Get number of channels after duplication
   int maxNchannels = std::min((int)ncclMaxNchannels(), maxChannels);
@@ -649,8 +796,8 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
     channel0->ring.next = ringNext[c*nranks+comm->rank];
 
     if (c + nChannels < MAXCHANNELS) {
-      channel1->ring.prev = channel0->ring.prev;
-      channel1->ring.next = channel0->ring.next;
+      channel1->ring.prev = bidirRings ? channel0->ring.next : channel0->ring.prev;
+      channel1->ring.next = bidirRings ? channel0->ring.prev : channel0->ring.next;
     }
   }
 
@@ -704,6 +851,12 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
   }
 
   comm->collChannels = comm->nChannels;
+  // Reversed channel pairs are the bi-rings the pivot AllToAll needs, whatever the GPU count
+  if (bidirRings && !comm->topo->pivotA2AEnabled && rcclParamPivotAlltoallEnable() && comm->collChannels % (2*bidirChannels) == 0) {
+    comm->topo->pivotA2AEnabled = true;
+    comm->topo->pivotA2ANumBiRings = bidirChannels;
+    INFO(NCCL_GRAPH, "Pivot AllToAll enabled on %d bi-rings", bidirChannels);
+  }
   // Support maximal channel usage for aggregation
   if (comm->nChannels < comm->nvlsChannels) {
     nChannels = comm->nChannels = copyChannels(comm, comm->nChannels, comm->nvlsChannels, ringPrev, ringNext);
@@ -712,6 +865,8 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
 
   // Create rings array and check all is fine
   NCCLCHECK(ncclBuildRings(nChannels, rings, comm->rank, comm->nRanks, ringPrev, ringNext));
+  NCCLCHECK(connectRhd(comm, rings));
+  NCCLCHECK(connectBruck(comm));
 
   free(ringRecv);
   free(ringSend);
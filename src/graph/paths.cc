@@ -447,7 +447,7 @@ ncclResult_t ncclTopoCheckGdr(struct ncclTopoSystem* system, int64_t busId, int
   return ncclSuccess;
 }
 
-// Set to 0 to disable the flush on Hopper when using GDR
+// Set to 1 to force the flush on Hopper and AMD GPUs when using GDR
 NCCL_PARAM(NetForceFlush, "NET_FORCE_FLUSH", 0);
 
 // Determine whether we need to flush the GDR recv buffers
@@ -456,6 +456,10 @@ ncclResult_t ncclTopoNeedFlush(struct ncclTopoSystem* system, int64_t busId, int
   NCCLCHECK(ncclTopoIdToIndex(system, GPU, busId, &g));
   struct ncclTopoNode* gpu = system->nodes[GPU].nodes+g;
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
+  // AMD GPUs see NIC writes to their memory in order with the completion the proxy waits
+  // for, so the flush read is only issued when forced.
+  *flush = ncclParamNetForceFlush();
+  if (*flush) INFO(NCCL_NET, "GPU %lx (%s) : GDR receives are flushed (NCCL_NET_FORCE_FLUSH)", busId, gpu->gpu.gcn);
 #else
   // Flush is required on Ampere and earlier
   *flush = gpu->gpu.cudaCompCap < 90 ? 1 : ncclParamNetForceFlush();
@@ -539,6 +543,26 @@ int ncclPxnDisable(struct ncclComm* comm) {
   return pxnDisable;
 }
 
+// Let ring graphs relay the traffic to a NIC through an NVLink/XGMI connected
+// GPU even when p2p does not use PXN. Point to point operations then see the
+// same paths as with NCCL_PXN_DISABLE=0 NCCL_P2P_PXN_LEVEL=0.
+RCCL_PARAM(CollPxn, "COLL_PXN", 0);
+
+int ncclPxnCollEnable(struct ncclComm* comm) {
+  static int pxnColl = -1;
+  if (pxnColl == -1) {
+    if (ncclPxnDisable(comm) == 0) {
+      pxnColl = 1;
+    } else if (comm && ncclNetVersion(comm) == 4) {
+      pxnColl = 0;
+    } else {
+      pxnColl = rcclParamCollPxn() ? 1 : 0;
+      if (pxnColl) INFO(NCCL_INIT, "PXN enabled for collectives only (RCCL_COLL_PXN=1)");
+    }
+  }
+  return pxnColl;
+}
+
 ncclResult_t ncclTopoGetPxnRanks(struct ncclComm* comm, int** intermediateRanks, int* nranks) {
   struct ncclTopoSystem* system = comm->topo;
   *nranks = 0;
@@ -677,7 +701,7 @@ ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm
     for (int g=0; g<system->nodes[GPU].count; g++) {
       // Check whether we can access the NIC through another NVLink-connected GPU (PXN)
       struct ncclTopoNode* gpu = system->nodes[GPU].nodes+g;
-      if (ncclPxnDisable(comm) != 1) {
+      if (ncclPxnCollEnable(comm)) {
         int localGpuIndex;
         NCCLCHECK(ncclTopoGetLocalGpu(system, system->nodes[NET].nodes[n].id, &localGpuIndex));
         if (localGpuIndex != g && localGpuIndex != -1) {
@@ -817,6 +841,42 @@ void ncclTopoFree(struct ncclTopoSystem* system) {
   free(system);
 }
 
+// Links and paths point inside the system, so a copy needs them moved over
+#define TOPO_CLONE_PTR(ptr, from, to) ((decltype(ptr))((char*)(to) + ((char*)(ptr) - (char*)(from))))
+
+ncclResult_t ncclTopoCloneSystem(struct ncclTopoSystem* system, struct ncclTopoSystem** copyRet) {
+  struct ncclTopoSystem* copy;
+  NCCLCHECK(ncclCalloc(&copy, 1));
+  memcpy(copy, system, sizeof(struct ncclTopoSystem));
+  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
+    for (int n=0; n<copy->nodes[t].count; n++) {
+      struct ncclTopoNode* node = copy->nodes[t].nodes+n;
+      for (int l=0; l<node->nlinks; l++) node->links[l].remNode = TOPO_CLONE_PTR(node->links[l].remNode, system, copy);
+      for (int p=0; p<NCCL_TOPO_NODE_TYPES; p++) node->paths[p] = NULL;
+    }
+  }
+  for (int t=0; t<NCCL_TOPO_NODE_TYPES; t++) {
+    for (int n=0; n<copy->nodes[t].count; n++) {
+      struct ncclTopoNode* node = copy->nodes[t].nodes+n;
+      for (int p=0; p<NCCL_TOPO_NODE_TYPES; p++) {
+        struct ncclTopoLinkList* paths = system->nodes[t].nodes[n].paths[p];
+        if (paths == NULL) continue;
+        if (ncclCalloc(node->paths+p, copy->nodes[p].count) != ncclSuccess) {
+          ncclTopoFree(copy);
+          return ncclSystemError;
+        }
+        memcpy(node->paths[p], paths, copy->nodes[p].count*sizeof(struct ncclTopoLinkList));
+        for (int i=0; i<copy->nodes[p].count; i++) {
+          struct ncclTopoLinkList* path = node->paths[p]+i;
+          for (int h=0; h<path->count; h++) path->list[h] = TOPO_CLONE_PTR(path->list[h], system, copy);
+        }
+      }
+    }
+  }
+  *copyRet = copy;
+  return ncclSuccess;
+}
+
 NCCL_PARAM(NChannelsPerNetPeer, "NCHANNELS_PER_NET_PEER", -1);
 NCCL_PARAM(NChannelsPerPeer, "NCHANNELS_PER_PEER", -2);
 
@@ -866,6 +926,7 @@ static ncclResult_t ncclTopoGetNchannels(struct ncclComm* comm, int g /*local gp
 
 NCCL_PARAM(MinP2pNChannels, "MIN_P2P_NCHANNELS", 1);
 NCCL_PARAM(MaxP2pNChannels, "MAX_P2P_NCHANNELS", MAXCHANNELS);
+RCCL_PARAM(P2pHeavyChannelsFactor, "P2P_HEAVY_CHANNELS_FACTOR", 2);
 
 static int nextPow2(int v) {
   int pow2 = 1;
@@ -911,6 +972,10 @@ ncclResult_t ncclTopoComputeP2pChannels(struct ncclComm* comm) {
     comm->p2pnChannels = std::min(nextPow2(comm->p2pnChannels), 4*CHANNEL_LIMIT);
   }
 
+  // Large send/recv (RCCL_P2P_HEAVY_THRESHOLD) to a peer may use more channels, and therefore more NICs
+  comm->p2pnChannelsPerPeerHeavy = std::min(comm->p2pnChannels, comm->p2pnChannelsPerPeer*std::max<int>(1, rcclParamP2pHeavyChannelsFactor()));
+  comm->p2pnChannelsPerPeerHeavy = std::max(comm->p2pnChannelsPerPeerHeavy, comm->p2pnChannelsPerPeer);
+
   // Init channels that weren't used so far
   for (int c=comm->nChannels; c<std::max(comm->nChannels, comm->p2pnChannels); c++) NCCLCHECK(initChannel(comm, c));
 
@@ -951,3 +1016,39 @@ int ncclTopoPathAllNVLink(struct ncclTopoSystem* system) {
   }
   return minPath >= PATH_PIX ? 0 : 1;
 }
+
+// Bandwidth this rank can give each ring channel towards its ring next: the path
+// bandwidth to the next GPU, or to the NIC for inter-node hops, divided by the
+// number of channels using the same GPU or NIC.
+ncclResult_t ncclTopoGetRingBw(struct ncclComm* comm, struct ncclTopoGraph* graph, float* bw) {
+  struct ncclTopoSystem* system = comm->topo;
+  int nChannels = comm->nChannels;
+  int links[MAXCHANNELS];
+  int g;
+  NCCLCHECK(ncclTopoRankToIndex(system, comm->rank, &g));
+  for (int c=0; c<nChannels; c++) {
+    int next = comm->channels[c].ring.next;
+    bw[c] = 0;
+    links[c] = -1;
+    if (next < 0 || next == comm->rank) continue;
+    if (comm->rankToNode[next] == comm->node) {
+      int p;
+      NCCLCHECK(ncclTopoRankToIndex(system, next, &p));
+      bw[c] = system->nodes[GPU].nodes[g].paths[GPU][p].bw;
+      links[c] = p;
+    } else {
+      int netDev, proxyRank, n, pg;
+      NCCLCHECK(ncclTopoGetNetDev(comm, comm->rank, graph, c, next, &netDev, &proxyRank));
+      NCCLCHECK(ncclTopoIdToIndex(system, NET, netDev, &n));
+      NCCLCHECK(ncclTopoRankToIndex(system, proxyRank, &pg));
+      bw[c] = system->nodes[GPU].nodes[pg].paths[NET][n].bw;
+      links[c] = system->nodes[GPU].count + n;
+    }
+  }
+  for (int c=0; c<nChannels; c++) {
+    int shared = 0;
+    for (int o=0; o<nChannels; o++) shared += links[o] == links[c];
+    if (links[c] >= 0) bw[c] /= shared;
+  }
+  return ncclSuccess;
+}
@@ -0,0 +1,269 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "core.h"
+#include "graph.h"
+#include "topo.h"
+#include "comm.h"
+#include "bootstrap.h"
+#include <algorithm>
+#include <vector>
+#include <pthread.h>
+
+// Optional link bandwidth probing at init. The XML topology gives every XGMI
+// and PCIe link the bandwidth of its type, so a degraded XGMI link or a GPU
+// whose PCIe link trained down looks like any other. With RCCL_TOPO_PROBE=1
+// each rank times DMA copies from its GPU to the other GPUs of the node and to
+// host memory, the node's ranks exchange their measurements, and links that are
+// well below their peers of the same nominal bandwidth are scaled down before
+// paths are computed, so that the search avoids them. All ranks of a node apply
+// the same measurements and end up with the same topology.
+
+RCCL_PARAM(TopoProbe, "TOPO_PROBE", 0);
+RCCL_PARAM(TopoProbeSize, "TOPO_PROBE_SIZE", 32 << 20);
+RCCL_PARAM(TopoProbeIters, "TOPO_PROBE_ITERS", 5);
+// A link is degraded when it measures below this percentage of the median of its class
+RCCL_PARAM(TopoProbeThreshold, "TOPO_PROBE_THRESHOLD", 80);
+
+#define PROBE_TAG 0x50524f42 // "PROB"
+
+struct probeRow {
+  int64_t busId;
+  float hostBw; // GB/s from/to pinned host memory, 0 if not measured
+  int nPeers;
+  int64_t peerBusId[NCCL_TOPO_MAX_NODES];
+  float peerBw[NCCL_TOPO_MAX_NODES]; // GB/s to the peer GPU
+};
+
+// Measurements are kept for the life of the process, so that communicators
+// created later (e.g. with ncclCommSplit) don't measure again
+static pthread_mutex_t probeCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static struct probeRow* probeCache[NCCL_TOPO_MAX_NODES];
+static int probeCacheCount = 0;
+
+static bool probeCacheGet(int64_t busId, struct probeRow* row) {
+  bool found = false;
+  pthread_mutex_lock(&probeCacheLock);
+  for (int i = 0; i < probeCacheCount; i++) {
+    if (probeCache[i]->busId == busId) { *row = *probeCache[i]; found = true; break; }
+  }
+  pthread_mutex_unlock(&probeCacheLock);
+  return found;
+}
+
+static void probeCachePut(struct probeRow* row) {
+  pthread_mutex_lock(&probeCacheLock);
+  if (probeCacheCount < NCCL_TOPO_MAX_NODES && ncclCalloc(probeCache+probeCacheCount, 1) == ncclSuccess) {
+    *probeCache[probeCacheCount++] = *row;
+  }
+  pthread_mutex_unlock(&probeCacheLock);
+}
+
+// Times iters copies of bytes, after one warmup copy. dstDev < 0 copies to host memory.
+static ncclResult_t probeTime(void* dst, int dstDev, void* src, int srcDev, size_t bytes, cudaStream_t stream, float* bw) {
+  cudaEvent_t start, stop;
+  float ms;
+  int iters = std::max<int64_t>(rcclParamTopoProbeIters(), 1);
+  ncclResult_t ret = ncclSuccess;
+  CUDACHECK(cudaEventCreate(&start));
+  CUDACHECKGOTO(cudaEventCreate(&stop), ret, fail_start);
+  for (int i = -1; i < iters; i++) {
+    if (i == 0) CUDACHECKGOTO(cudaEventRecord(start, stream), ret, fail);
+    if (dstDev < 0 || srcDev < 0) {
+      CUDACHECKGOTO(cudaMemcpyAsync(dst, src, bytes, cudaMemcpyDefault, stream), ret, fail);
+    } else {
+      CUDACHECKGOTO(cudaMemcpyPeerAsync(dst, dstDev, src, srcDev, bytes, stream), ret, fail);
+    }
+  }
+  CUDACHECKGOTO(cudaEventRecord(stop, stream), ret, fail);
+  CUDACHECKGOTO(cudaEventSynchronize(stop), ret, fail);
+  CUDACHECKGOTO(cudaEventElapsedTime(&ms, start, stop), ret, fail);
+  *bw = ms > 0 ? bytes*(double)iters/ms/1e6 : 0;
+fail:
+  (void)cudaEventDestroy(stop);
+fail_start:
+  (void)cudaEventDestroy(start);
+  return ret;
+}
+
+static ncclResult_t probePeer(int cudaDev, void* buff, size_t bytes, int64_t peerBusId, cudaStream_t stream, float* bw) {
+  char busIdStr[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+  int peerDev, canAccess = 0;
+  void* peerBuff = NULL;
+  *bw = 0;
+  NCCLCHECK(int64ToBusId(peerBusId, busIdStr));
+  // The peer GPU may not be visible to this process
+  if (cudaDeviceGetByPCIBusId(&peerDev, busIdStr) != cudaSuccess) { (void)cudaGetLastError(); return ncclSuccess; }
+  if (cudaDeviceCanAccessPeer(&canAccess, cudaDev, peerDev) != cudaSuccess || !canAccess) return ncclSuccess;
+  // Peer access is what the P2P transport enables later anyway
+  cudaError_t err = cudaDeviceEnablePeerAccess(peerDev, 0);
+  if (err != cudaSuccess && err != cudaErrorPeerAccessAlreadyEnabled) {
+    INFO(NCCL_GRAPH, "Topology probe: could not enable peer access to %s : %s", busIdStr, cudaGetErrorString(err));
+    (void)cudaGetLastError();
+    return ncclSuccess;
+  }
+  (void)cudaGetLastError();
+  CUDACHECK(cudaSetDevice(peerDev));
+  err = cudaMalloc(&peerBuff, bytes);
+  CUDACHECK(cudaSetDevice(cudaDev));
+  if (err != cudaSuccess) { (void)cudaGetLastError(); return ncclSuccess; }
+  ncclResult_t ret = probeTime(peerBuff, peerDev, buff, cudaDev, bytes, stream, bw);
+  CUDACHECK(cudaFree(peerBuff));
+  return ret;
+}
+
+static ncclResult_t probeMeasure(struct ncclComm* comm, int* localRanks, int nLocalRanks, int localRank, struct probeRow* row) {
+  size_t bytes = std::max<int64_t>(rcclParamTopoProbeSize(), 1 << 20);
+  bool cached = probeCacheGet(row->busId, row);
+  void* buff = NULL;
+  void* hostBuff = NULL;
+  cudaStream_t stream = NULL;
+  ncclResult_t ret = ncclSuccess;
+  if (!cached) {
+    CUDACHECKGOTO(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking), ret, fail);
+    CUDACHECKGOTO(cudaMalloc(&buff, bytes), ret, fail);
+    CUDACHECKGOTO(cudaHostAlloc(&hostBuff, bytes, cudaHostAllocDefault), ret, fail);
+    float d2h, h2d;
+    NCCLCHECKGOTO(probeTime(hostBuff, -1, buff, comm->cudaDev, bytes, stream, &d2h), ret, fail);
+    NCCLCHECKGOTO(probeTime(buff, comm->cudaDev, hostBuff, -1, bytes, stream, &h2d), ret, fail);
+    row->hostBw = std::min(d2h, h2d);
+  }
+  // At step s local rank i copies to local rank i+s, so that every GPU has a
+  // single writer and links are not shared between measurements
+  for (int s = 1; s < nLocalRanks; s++) {
+    NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, localRanks, localRank, nLocalRanks, PROBE_TAG), ret, fail);
+    if (cached) continue;
+    int peer = localRanks[(localRank+s)%nLocalRanks];
+    int64_t peerBusId = comm->peerInfo[peer].busId;
+    if (peerBusId == row->busId) continue;
+    float bw;
+    NCCLCHECKGOTO(probePeer(comm->cudaDev, buff, bytes, peerBusId, stream, &bw), ret, fail);
+    if (bw > 0 && row->nPeers < NCCL_TOPO_MAX_NODES) {
+      row->peerBusId[row->nPeers] = peerBusId;
+      row->peerBw[row->nPeers++] = bw;
+    }
+  }
+  if (!cached) probeCachePut(row);
+exit:
+  if (hostBuff) (void)cudaFreeHost(hostBuff);
+  if (buff) (void)cudaFree(buff);
+  if (stream) (void)cudaStreamDestroy(stream);
+  return ret;
+fail:
+  goto exit;
+}
+
+static float probeMedian(std::vector<float> v) {
+  std::sort(v.begin(), v.end());
+  return v.size() ? v[v.size()/2] : 0;
+}
+
+static void probeSortLinks(struct ncclTopoNode* node) {
+  std::stable_sort(node->links, node->links+node->nlinks,
+      [](const struct ncclTopoLink& a, const struct ncclTopoLink& b) { return a.bw > b.bw; });
+}
+
+static void probeScaleLink(struct ncclTopoNode* node, struct ncclTopoNode* remNode, int type, float ratio) {
+  for (int l = 0; l < node->nlinks; l++) {
+    if (node->links[l].remNode == remNode && node->links[l].type == type) node->links[l].bw *= ratio;
+  }
+  probeSortLinks(node);
+}
+
+// A measured link. Links are compared with the links of the same nominal
+// bandwidth, which is recorded before any of them is scaled.
+struct probeLink {
+  struct ncclTopoNode* node;
+  struct ncclTopoNode* remNode;
+  int type;
+  float nominal;
+  float measured;
+};
+
+static void probeApply(std::vector<struct probeLink>& links, const char* what) {
+  const float threshold = rcclParamTopoProbeThreshold()/100.0;
+  for (size_t i = 0; i < links.size(); i++) {
+    std::vector<float> peers;
+    for (auto& l : links) if (l.nominal == links[i].nominal) peers.push_back(l.measured);
+    float median = probeMedian(peers);
+    struct probeLink& l = links[i];
+    if (peers.size() < 2 || l.measured >= median*threshold) continue;
+    float ratio = l.measured/median;
+    char busId1[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE], busId2[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+    int64ToBusId(l.node->id, busId1);
+    int64ToBusId(l.remNode->id, busId2);
+    INFO(NCCL_GRAPH, "Topology probe: %s link %s -> %s measured %.1f GB/s, median %.1f GB/s, bw %.1f -> %.1f",
+        what, busId1, busId2, l.measured, median, l.nominal, l.nominal*ratio);
+    probeScaleLink(l.node, l.remNode, l.type, ratio);
+    probeScaleLink(l.remNode, l.node, l.type, ratio);
+  }
+}
+
+ncclResult_t ncclTopoProbeLinks(struct ncclComm* comm, struct ncclTopoSystem* system) {
+  if (rcclParamTopoProbe() == 0) return ncclSuccess;
+  struct probeRow* rows = NULL;
+  int* localRanks = NULL;
+  int nLocalRanks = 0, localRank = -1;
+  int nGpus = system->nodes[GPU].count;
+  ncclResult_t ret = ncclSuccess;
+  int cudaDev = -1;
+  std::vector<float> bw;
+
+  NCCLCHECK(ncclCalloc(&localRanks, comm->nRanks));
+  for (int r = 0; r < comm->nRanks; r++) {
+    if (comm->peerInfo[r].hostHash != comm->peerInfo[comm->rank].hostHash) continue;
+    if (r == comm->rank) localRank = nLocalRanks;
+    localRanks[nLocalRanks++] = r;
+  }
+  if (nLocalRanks == 1) goto exit;
+
+  CUDACHECKGOTO(cudaGetDevice(&cudaDev), ret, exit);
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&rows, nLocalRanks), ret, exit);
+  rows[localRank].busId = comm->busId;
+  NCCLCHECKGOTO(probeMeasure(comm, localRanks, nLocalRanks, localRank, rows+localRank), ret, exit);
+  NCCLCHECKGOTO(bootstrapIntraNodeAllGather(comm->bootstrap, localRanks, localRank, nLocalRanks, rows, sizeof(struct probeRow)), ret, exit);
+
+  bw.assign(nGpus*nGpus, 0);
+  {
+    // GPU-GPU is the slower of both directions when both were measured
+    std::vector<float> hostBw(nGpus, 0);
+    for (int r = 0; r < nLocalRanks; r++) {
+      int g;
+      if (ncclTopoIdToIndex(system, GPU, rows[r].busId, &g) != ncclSuccess) continue;
+      hostBw[g] = rows[r].hostBw;
+      for (int p = 0; p < rows[r].nPeers; p++) {
+        int h;
+        if (ncclTopoIdToIndex(system, GPU, rows[r].peerBusId[p], &h) != ncclSuccess) continue;
+        float b = rows[r].peerBw[p];
+        for (int k : { g*nGpus+h, h*nGpus+g }) bw[k] = bw[k] == 0 ? b : std::min(bw[k], b);
+      }
+    }
+
+    std::vector<struct probeLink> xgmi, pci;
+    for (int g = 0; g < nGpus; g++) {
+      struct ncclTopoNode* gpu = system->nodes[GPU].nodes+g;
+      for (int l = 0; l < gpu->nlinks; l++) {
+        struct ncclTopoLink* link = gpu->links+l;
+        if (link->type == LINK_NVL && link->remNode->type == GPU) {
+          int h = link->remNode - system->nodes[GPU].nodes;
+          // Each pair once
+          if (h > g && bw[g*nGpus+h] > 0) xgmi.push_back({ gpu, link->remNode, LINK_NVL, link->bw, bw[g*nGpus+h] });
+        } else if (link->type == LINK_PCI && hostBw[g] > 0) {
+          pci.push_back({ gpu, link->remNode, LINK_PCI, link->bw, hostBw[g] });
+        }
+      }
+    }
+    probeApply(xgmi, "XGMI");
+    probeApply(pci, "PCI");
+  }
+
+exit:
+  if (cudaDev >= 0) (void)cudaSetDevice(cudaDev);
+  free(rows);
+  free(localRanks);
+  return ret;
+}
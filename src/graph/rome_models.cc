@@ -888,6 +888,90 @@ static struct rcclRomeModel romeTopoModels[] = {
   rome_model_85, /* 42 */
 };
 
+#define ROME_NUM_MODELS ((int)(sizeof(romeTopoModels)/sizeof(romeTopoModels[0])))
+
+static bool checkOption(const char *options, const char *name);
+
+static uint64_t romeHash(uint64_t h, uint64_t v) {
+  return (h ^ v) * 0x100000001b3ULL;
+}
+
+// Hash of what a model matching needs to get equal whatever the GPU and NIC
+// numbering: the counts, the sorted XGMI row of each GPU and, when NICs get
+// permuted, the sorted GDR row of each NIC. The NUMA layout is added when numa
+// is set. A model can only match a system with the same signature.
+static uint64_t romeModelSignature(const struct rcclRomeModel* m, const char* pattern, bool numa) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint64_t rows[NCCL_TOPO_MAX_NODES];
+  uint8_t row[NCCL_TOPO_MAX_NODES];
+  h = romeHash(h, m->nGpus);
+  h = romeHash(h, m->nNics);
+  h = romeHash(h, m->nLinks);
+  if (numa) {
+    h = romeHash(h, m->nCpus);
+    for (const char* c = pattern; *c; c++) h = romeHash(h, *c);
+  }
+  for (int i = 0; i < m->nGpus; i++) {
+    memcpy(row, m->connMatrix+i*m->nGpus, m->nGpus);
+    std::sort(row, row+m->nGpus);
+    rows[i] = 0;
+    for (int j = 0; j < m->nGpus; j++) rows[i] = romeHash(rows[i], row[j]);
+  }
+  std::sort(rows, rows+m->nGpus);
+  for (int i = 0; i < m->nGpus; i++) h = romeHash(h, rows[i]);
+  if (m->nNics > 1) {
+    for (int i = 0; i < m->nNics; i++) {
+      memcpy(row, m->gdrLevel+i*m->nGpus, m->nGpus);
+      std::sort(row, row+m->nGpus);
+      rows[i] = 0;
+      for (int j = 0; j < m->nGpus; j++) rows[i] = romeHash(rows[i], row[j]);
+    }
+    std::sort(rows, rows+m->nNics);
+    for (int i = 0; i < m->nNics; i++) h = romeHash(h, rows[i]);
+  }
+  return h;
+}
+
+struct rcclRomeModelKey {
+  uint64_t signature;
+  int model;
+  bool operator<(const rcclRomeModelKey& k) const { return signature < k.signature || (signature == k.signature && model < k.model); }
+};
+
+// Models by signature with their NUMA layout, and models with disableNumaMatching by signature without it
+static struct rcclRomeModelKey romeModelsByNuma[ROME_NUM_MODELS];
+static struct rcclRomeModelKey romeModelsNoNuma[ROME_NUM_MODELS];
+static int romeModelsNoNumaCount;
+static pthread_once_t romeModelIndexOnce = PTHREAD_ONCE_INIT;
+
+static void romeModelIndexInit() {
+  for (int i = 0; i < ROME_NUM_MODELS; i++) {
+    romeModelsByNuma[i] = { romeModelSignature(romeTopoModels+i, romeTopoModels[i].pattern, true), i };
+    if (checkOption(romeTopoModels[i].options, "disableNumaMatching"))
+      romeModelsNoNuma[romeModelsNoNumaCount++] = { romeModelSignature(romeTopoModels+i, romeTopoModels[i].pattern, false), i };
+  }
+  std::sort(romeModelsByNuma, romeModelsByNuma+ROME_NUM_MODELS);
+  std::sort(romeModelsNoNuma, romeModelsNoNuma+romeModelsNoNumaCount);
+}
+
+static void romeModelLookup(struct rcclRomeModelKey* keys, int nKeys, uint64_t signature, int* models, int* nModels) {
+  struct rcclRomeModelKey key = { signature, -1 };
+  for (struct rcclRomeModelKey* k = std::lower_bound(keys, keys+nKeys, key); k < keys+nKeys && k->signature == signature; k++) {
+    models[(*nModels)++] = k->model;
+  }
+}
+
+// Indices of the models which may match the system, in table order. Models with
+// disableNumaMatching are also looked up without the NUMA layout unless numaOnly.
+static int romeModelCandidates(struct rcclRomeModel* topo, const char* pattern, bool numaOnly, int* models) {
+  int nModels = 0;
+  pthread_once(&romeModelIndexOnce, romeModelIndexInit);
+  romeModelLookup(romeModelsByNuma, ROME_NUM_MODELS, romeModelSignature(topo, pattern, true), models, &nModels);
+  if (!numaOnly) romeModelLookup(romeModelsNoNuma, romeModelsNoNumaCount, romeModelSignature(topo, pattern, false), models, &nModels);
+  std::sort(models, models+nModels);
+  return std::unique(models, models+nModels) - models;
+}
+
 /* Parse user defined rings. Format is like :
  * "0 1|1 0|0 1 2 3|3 2 1 0|N0 0 2 3 1 N1|1 3 2 0|0 1 2 3 4 5 6 7|N2 7 6 5 4 3 2 1 0 N1"
  * Network interfaces can be optionally specified by N prefix.
@@ -1417,76 +1501,55 @@ static ncclResult_t parseRomeSystem(struct ncclTopoSystem* system, struct rcclRo
   return ncclSuccess;
 }
 
-static bool permuteGpuIds(int *g, int n, int last, struct rcclRomeModel* ref, struct rcclRomeModel* topo, int* time, bool nbio, bool ignore_numa) {
-  (*time) ++;
-  if (n == last) {
-    int i, j;
-    // match GPU numa
-    if (!ignore_numa) {
-      for (i = 0; i < ref->nGpus; i++)
-        if (ref->gpuNuma[i] != topo->gpuNuma[g[i]]) break;
-      if (i < ref->nGpus) return false;
-    }
+// Checks GPU n of a permutation against GPUs 0..n, so that permutations get
+// pruned as soon as one position doesn't match
+static bool matchGpuId(int *g, int n, struct rcclRomeModel* ref, struct rcclRomeModel* topo, bool nbio, bool ignore_numa) {
+  int ngpus = ref->nGpus;
+  // match GPU numa
+  if (!ignore_numa && ref->gpuNuma[n] != topo->gpuNuma[g[n]]) return false;
+  for (int j = 0; j <= n; j++) {
     // match XGMI connection
-    for (i = 0; i < ref->nGpus; i++) {
-      for (j = 0; j < ref->nGpus; j++) {
-        if (ref->connMatrix[i*ref->nGpus+j] != topo->connMatrix[g[i]*ref->nGpus+g[j]]) break;
-        if ((ref->gpuIds[i]-ref->gpuIds[j])*(topo->gpuIds[g[i]]-topo->gpuIds[g[j]]) < 0) break;
-      }
-      if (j < ref->nGpus) break;
-    }
-    if (i < ref->nGpus) return false;
+    if (ref->connMatrix[n*ngpus+j] != topo->connMatrix[g[n]*ngpus+g[j]]) return false;
+    if (ref->connMatrix[j*ngpus+n] != topo->connMatrix[g[j]*ngpus+g[n]]) return false;
+    if ((ref->gpuIds[n]-ref->gpuIds[j])*(topo->gpuIds[g[n]]-topo->gpuIds[g[j]]) < 0) return false;
     // match NBIO
-    if (nbio) {
-      for (i = 0; i < ref->nGpus; i++) {
-        for (j = 0; j < ref->nGpus; j++) {
-          if (i == j) continue;
-          bool nbio_ref = (ref->gpuIds[i]&0xf0000) == (ref->gpuIds[j]&0xf0000);
-          bool nbio_topo = (topo->gpuIds[g[i]]&0xf0000) == (topo->gpuIds[g[j]]&0xf0000);
-          if (nbio_ref != nbio_topo) break;
-          if (nbio_ref && ((ref->gpuIds[i]-ref->gpuIds[j])*(topo->gpuIds[g[i]]-topo->gpuIds[g[j]]) < 0)) break;
-        }
-        if (j < ref->nGpus) break;
-      }
-      if (i < ref->nGpus) return false;
-    }
-    return true;
-  } else {
-    for (int i = n; i <= last; i++) {
-      std::swap(g[n], g[i]);
-      if (permuteGpuIds(g, n+1, last, ref, topo, time, nbio, ignore_numa)) return true;
-      std::swap(g[n], g[i]);
+    if (nbio && j != n) {
+      bool nbio_ref = (ref->gpuIds[n]&0xf0000) == (ref->gpuIds[j]&0xf0000);
+      bool nbio_topo = (topo->gpuIds[g[n]]&0xf0000) == (topo->gpuIds[g[j]]&0xf0000);
+      if (nbio_ref != nbio_topo) return false;
     }
   }
+  return true;
+}
+
+static bool permuteGpuIds(int *g, int n, int last, struct rcclRomeModel* ref, struct rcclRomeModel* topo, int* time, bool nbio, bool ignore_numa) {
+  (*time) ++;
+  for (int i = n; i <= last; i++) {
+    std::swap(g[n], g[i]);
+    if (matchGpuId(g, n, ref, topo, nbio, ignore_numa) &&
+        (n == last || permuteGpuIds(g, n+1, last, ref, topo, time, nbio, ignore_numa))) return true;
+    std::swap(g[n], g[i]);
+  }
   return false;
 }
 
+static bool matchNetId(int *n, int *g, int s, struct rcclRomeModel* ref, struct rcclRomeModel* topo, bool ignore_numa) {
+  // match NET numa
+  if (!ignore_numa && ref->nicNuma[s] != topo->nicNuma[n[s]]) return false;
+  // match gdr level
+  for (int j = 0; j < ref->nGpus; j++) {
+    if (ref->gdrLevel[s*ref->nGpus+j] != topo->gdrLevel[n[s]*ref->nGpus+g[j]]) return false;
+  }
+  return true;
+}
+
 static bool permuteNetIds(int *n, int *g, int s, int last, struct rcclRomeModel* ref, struct rcclRomeModel* topo, int* time, bool ignore_numa) {
   (*time) ++;
-  if (s == last) {
-    int i, j;
-    // match NET numa
-    if (!ignore_numa) {
-      for (i = 0; i < ref->nNics; i++) {
-        if (ref->nicNuma[i] != topo->nicNuma[n[i]]) break;
-      }
-      if (i < ref->nNics) return false;
-    }
-    // match gdr level
-    for (i = 0; i < ref->nNics; i++) {
-      for (j = 0; j < ref->nGpus; j++) {
-        if (ref->gdrLevel[i*ref->nGpus+j] != topo->gdrLevel[n[i]*ref->nGpus+g[j]]) break;
-      }
-      if (j < ref->nGpus) break;
-    }
-    if (i < ref->nNics) return false;
-    return true;
-  } else {
-    for (int i = s; i <= last; i++) {
-      std::swap(n[s], n[i]);
-      if (permuteNetIds(n, g, s+1, last, ref, topo, time, ignore_numa)) return true;
-      std::swap(n[s], n[i]);
-    }
+  for (int i = s; i <= last; i++) {
+    std::swap(n[s], n[i]);
+    if (matchNetId(n, g, s, ref, topo, ignore_numa) &&
+        (s == last || permuteNetIds(n, g, s+1, last, ref, topo, time, ignore_numa))) return true;
+    std::swap(n[s], n[i]);
   }
   return false;
 }
@@ -1536,7 +1599,11 @@ ncclResult_t parseRome4P2H(struct ncclTopoSystem* system, struct ncclTopoGraph*
   }
   if (i < romeTopo.nGpus) match_nbio = false;
 
-  for (i = 0; i < sizeof(romeTopoModels)/sizeof(romeTopoModels[0]); i++) {
+  int candidates[ROME_NUM_MODELS];
+  int nCandidates = romeModelCandidates(&romeTopo, pattern, false, candidates);
+  int c;
+  for (c = 0; c < nCandidates; c++) {
+    i = candidates[c];
     bool ignore_cpu = checkOption(romeTopoModels[i].options, "noCpuCheck");
     if (!ignore_cpu && (arch != NCCL_TOPO_CPU_ARCH_X86 || vendor != NCCL_TOPO_CPU_VENDOR_AMD || model != NCCL_TOPO_CPU_TYPE_ROME))
       continue;
@@ -1588,7 +1655,7 @@ ncclResult_t parseRome4P2H(struct ncclTopoSystem* system, struct ncclTopoGraph*
   }
   gettimeofday(&tve, NULL);
   float t = (tve.tv_sec - tvs.tv_sec)*1E3 + (tve.tv_usec - tvs.tv_usec)/1E3;
-  if (i >= sizeof(romeTopoModels)/sizeof(romeTopoModels[0])) {
+  if (c >= nCandidates) {
     //printf("No solution in %.2fms (%d iter)\n", t, time);
     return ncclSuccess;
   }
@@ -1684,7 +1751,11 @@ ncclResult_t parse1H16P(struct ncclTopoSystem* system, struct ncclTopoGraph* gra
   int *all_gpu_permutations = (int *)malloc(TOTAL_PERMUTE_COUNT*NUMA_CPUS*NUMA_GPUS*sizeof(int));
   struct timeval tvs, tve;
   gettimeofday(&tvs, NULL);
-  for (i = 0; i < sizeof(romeTopoModels)/sizeof(romeTopoModels[0]); i++) {
+  int candidates[ROME_NUM_MODELS];
+  int nCandidates = romeModelCandidates(&romeTopo, pattern, true, candidates);
+  int c;
+  for (c = 0; c < nCandidates; c++) {
+    i = candidates[c];
     if (romeTopo.nCpus != romeTopoModels[i].nCpus || romeTopo.nGpus != romeTopoModels[i].nGpus ||
       romeTopo.nNics != romeTopoModels[i].nNics || romeTopo.nLinks != romeTopoModels[i].nLinks) continue;
     if (strcmp(romeTopoModels[i].pattern, pattern)) continue;
@@ -1755,7 +1826,7 @@ ncclResult_t parse1H16P(struct ncclTopoSystem* system, struct ncclTopoGraph* gra
   }
   gettimeofday(&tve, NULL);
   float t = (tve.tv_sec - tvs.tv_sec)*1E3 + (tve.tv_usec - tvs.tv_usec)/1E3;
-  if (i >= sizeof(romeTopoModels)/sizeof(romeTopoModels[0])) {
+  if (c >= nCandidates) {
     //printf("No solution in %.2fms\n", t);
     return ncclSuccess;
   }
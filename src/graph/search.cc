@@ -11,6 +11,11 @@
 #include "xml.h"
 #include <math.h>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "rome_models.h"
 
 NCCL_PARAM(CrossNic, "CROSS_NIC", 2);
@@ -579,96 +584,102 @@ ncclResult_t ncclTopoSearchRecGpu(struct ncclTopoSystem* system, struct ncclTopo
   return ncclSuccess;
 }
 
-ncclResult_t ncclTopoSearchRecNet(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, struct ncclTopoGraph* saveGraph, int backToNet, int backToFirstRank, int* time) {
+// Search starting from the i-th NET of nets
+static ncclResult_t ncclTopoSearchRecNetBranch(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, struct ncclTopoGraph* saveGraph, int* nets, int netCount, int i, int backToNet, int backToFirstRank, int* time) {
   const int bw = graph->bwInter;
-  int* nets;
-  NCCLCHECK(ncclCalloc(&nets, system->nodes[NET].count));
-  int netCount;
-  NCCLCHECK(ncclTopoSelectNets(system, graph->typeInter, -1, nets, &netCount));
-  for (int i=0; i<netCount; i++) {
-    if (graph->pattern == NCCL_TOPO_PATTERN_NVLS && i>0) continue;
-    int n = nets[(graph->nChannels+i)%netCount];
-    struct ncclTopoNode* net = system->nodes[NET].nodes+n;
-    if (graph->collNet && net->net.collSupport == 0) continue;
-    if (net->net.bw < bw) continue;
-    if (graph->crossNic && (graph->nChannels & 1) && net->id != graph->inter[(graph->nChannels-1)*2+1]) continue;
-
-    graph->inter[graph->nChannels*2] = net->id;
-    graph->latencyInter = net->net.latency;
-
-    for (int i=0; i<system->nodes[NET].count; i++) {
-      if ((system->nodes[NET].nodes[i].net.asic == net->net.asic) &&
-          (system->nodes[NET].nodes[i].net.port == net->net.port)) {
-        system->nodes[NET].nodes[i].net.bw -= bw;
-      }
+  if (graph->pattern == NCCL_TOPO_PATTERN_NVLS && i>0) return ncclSuccess;
+  int n = nets[(graph->nChannels+i)%netCount];
+  struct ncclTopoNode* net = system->nodes[NET].nodes+n;
+  if (graph->collNet && net->net.collSupport == 0) return ncclSuccess;
+  if (net->net.bw < bw) return ncclSuccess;
+  if (graph->crossNic && (graph->nChannels & 1) && net->id != graph->inter[(graph->nChannels-1)*2+1]) return ncclSuccess;
+
+  graph->inter[graph->nChannels*2] = net->id;
+  graph->latencyInter = net->net.latency;
+
+  for (int i=0; i<system->nodes[NET].count; i++) {
+    if ((system->nodes[NET].nodes[i].net.asic == net->net.asic) &&
+        (system->nodes[NET].nodes[i].net.port == net->net.port)) {
+      system->nodes[NET].nodes[i].net.bw -= bw;
     }
+  }
 
-    if (graph->pattern == NCCL_TOPO_PATTERN_NVLS) {
-      // NVLS search only tries to find NIC:GPU combinations to compute the heads.
-      if (graph->nChannels < netCount) {
-        int gpu;
-        NCCLCHECK(ncclTopoGetLocalGpu(system, net->id, &gpu));
-        if (gpu != -1) NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, 0, time, NET, n, gpu));
-      }
-    } else {
-      if (graph->nChannels > 0) {
-        // Try to replay the last channel
-        int g;
-        NCCLCHECK(ncclTopoReplayGetGpu(system, graph, -1, &g));
-        NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, FORCED_ORDER_REPLAY, time, NET, n, g));
-      }
-      if (graph->nChannels == 0 || graph->sameChannels == 0) {
-        if (graph->nChannels == 0 && system->nodes[NVS].count == 0) {
-          // Always try the PCI order first to set a reference, but don't count in the timeout nor let it run for long
-          struct ncclTopoLinkList* paths = net->paths[GPU];
-          int f = 0, f_gdr = 0;
-          // find the first GPU that is closest to NIC
-          for (int i = 0; i<system->nodes[GPU].count; i++) {
-            if (paths[i].count <= paths[f].count) {
-              // prefer GPU direct RDMA
-              int gdr;
-              NCCLCHECK(ncclTopoCheckGdr(system, system->nodes[GPU].nodes[i].id, net->id, 0, &gdr));
-              if (paths[i].count < paths[f].count || (paths[i].count == paths[f].count && !f_gdr && gdr)) {
-                f = i;
-                f_gdr = gdr;
-              }
+  if (graph->pattern == NCCL_TOPO_PATTERN_NVLS) {
+    // NVLS search only tries to find NIC:GPU combinations to compute the heads.
+    if (graph->nChannels < netCount) {
+      int gpu;
+      NCCLCHECK(ncclTopoGetLocalGpu(system, net->id, &gpu));
+      if (gpu != -1) NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, 0, time, NET, n, gpu));
+    }
+  } else {
+    if (graph->nChannels > 0) {
+      // Try to replay the last channel
+      int g;
+      NCCLCHECK(ncclTopoReplayGetGpu(system, graph, -1, &g));
+      NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, FORCED_ORDER_REPLAY, time, NET, n, g));
+    }
+    if (graph->nChannels == 0 || graph->sameChannels == 0) {
+      if (graph->nChannels == 0 && system->nodes[NVS].count == 0) {
+        // Always try the PCI order first to set a reference, but don't count in the timeout nor let it run for long
+        struct ncclTopoLinkList* paths = net->paths[GPU];
+        int f = 0, f_gdr = 0;
+        // find the first GPU that is closest to NIC
+        for (int i = 0; i<system->nodes[GPU].count; i++) {
+          if (paths[i].count <= paths[f].count) {
+            // prefer GPU direct RDMA
+            int gdr;
+            NCCLCHECK(ncclTopoCheckGdr(system, system->nodes[GPU].nodes[i].id, net->id, 0, &gdr));
+            if (paths[i].count < paths[f].count || (paths[i].count == paths[f].count && !f_gdr && gdr)) {
+              f = i;
+              f_gdr = gdr;
             }
           }
-          int t = 1 << 10;
-          NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, FORCED_ORDER_PCI, &t, NET, n, 0));
-          if (t == -1) *time = -1;
         }
+        int t = 1 << 10;
+        NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, FORCED_ORDER_PCI, &t, NET, n, 0));
+        if (t == -1) *time = -1;
+      }
 
-        // Then try the most local GPUs
-        float maxBw = 0;
-        int minHops = 0xfffffff;
-        struct ncclTopoLinkList* paths = net->paths[GPU];
-        for (int g=0; g<system->nodes[GPU].count; g++) {
-          if (paths[g].bw > maxBw) {
-            maxBw = paths[g].bw;
-            minHops = paths[g].count;
-          } else if (paths[g].bw == maxBw && paths[g].count < minHops) {
-            minHops = paths[g].count;
-          }
+      // Then try the most local GPUs
+      float maxBw = 0;
+      int minHops = 0xfffffff;
+      struct ncclTopoLinkList* paths = net->paths[GPU];
+      for (int g=0; g<system->nodes[GPU].count; g++) {
+        if (paths[g].bw > maxBw) {
+          maxBw = paths[g].bw;
+          minHops = paths[g].count;
+        } else if (paths[g].bw == maxBw && paths[g].count < minHops) {
+          minHops = paths[g].count;
         }
-        if (maxBw >= bw) {
-          for (int i=0; i<system->nodes[GPU].count; i++) {
-            int g = (graph->nChannels+i)%system->nodes[GPU].count;
-            if (paths[g].bw == maxBw && paths[g].count == minHops) {
-              NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, 0, time, NET, n, g));
-            }
+      }
+      if (maxBw >= bw) {
+        for (int i=0; i<system->nodes[GPU].count; i++) {
+          int g = (graph->nChannels+i)%system->nodes[GPU].count;
+          if (paths[g].bw == maxBw && paths[g].count == minHops) {
+            NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, 0, time, NET, n, g));
           }
         }
       }
     }
+  }
 
-    for (int i=0; i<system->nodes[NET].count; i++) {
-      if ((system->nodes[NET].nodes[i].net.asic == net->net.asic) &&
-          (system->nodes[NET].nodes[i].net.port == net->net.port)) {
-        system->nodes[NET].nodes[i].net.bw += bw;
-      }
+  for (int i=0; i<system->nodes[NET].count; i++) {
+    if ((system->nodes[NET].nodes[i].net.asic == net->net.asic) &&
+        (system->nodes[NET].nodes[i].net.port == net->net.port)) {
+      system->nodes[NET].nodes[i].net.bw += bw;
     }
   }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTopoSearchRecNet(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, struct ncclTopoGraph* saveGraph, int backToNet, int backToFirstRank, int* time) {
+  int* nets;
+  NCCLCHECK(ncclCalloc(&nets, system->nodes[NET].count));
+  int netCount;
+  NCCLCHECK(ncclTopoSelectNets(system, graph->typeInter, -1, nets, &netCount));
+  for (int i=0; i<netCount; i++) {
+    NCCLCHECK(ncclTopoSearchRecNetBranch(system, graph, saveGraph, nets, netCount, i, backToNet, backToFirstRank, time));
+  }
   free(nets);
   return ncclSuccess;
 }
@@ -734,6 +745,144 @@ ncclResult_t ncclTopoSearchRec(struct ncclTopoSystem* system, struct ncclTopoGra
   return ncclSuccess;
 }
 
+/************************************/
+/* Parallel search                  */
+/************************************/
+
+// With RCCL_TOPO_SEARCH_THREADS > 1, the first level of a search from scratch is
+// split into branches (one per starting NET, or PCI order then one per starting
+// GPU), explored by threads on private copies of the system. Each branch gets
+// its own slice of the time budget and results are merged in branch order, so
+// the graph only depends on the thread count, not on scheduling: all ranks of a
+// node must use the same value.
+RCCL_PARAM(TopoSearchThreads, "TOPO_SEARCH_THREADS", 0);
+
+static ncclResult_t ncclTopoSearchBranchCount(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, int* nBranches) {
+  if (system->nodes[NET].count && system->nodes[GPU].count != system->nRanks) {
+    int* nets;
+    NCCLCHECK(ncclCalloc(&nets, system->nodes[NET].count));
+    NCCLCHECK(ncclTopoSelectNets(system, graph->typeInter, -1, nets, nBranches));
+    free(nets);
+  } else {
+    *nBranches = system->nodes[GPU].count+1;
+  }
+  return ncclSuccess;
+}
+
+// Same as the first level of ncclTopoSearchRec for graph->nChannels == 0, restricted to one branch
+static ncclResult_t ncclTopoSearchRecBranch(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, struct ncclTopoGraph* saveGraph, int b, int* time) {
+  int backToNet, backToFirstRank;
+  NCCLCHECK(ncclTopoSearchParams(system, graph->pattern, &backToNet, &backToFirstRank));
+  if (system->nodes[NET].count && system->nodes[GPU].count != system->nRanks) {
+    int* nets;
+    int netCount;
+    NCCLCHECK(ncclCalloc(&nets, system->nodes[NET].count));
+    NCCLCHECK(ncclTopoSelectNets(system, graph->typeInter, -1, nets, &netCount));
+    ncclResult_t ret = ncclTopoSearchRecNetBranch(system, graph, saveGraph, nets, netCount, b, backToNet, backToFirstRank, time);
+    free(nets);
+    return ret;
+  } else if (b == 0) {
+    NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, FORCED_ORDER_PCI, time, -1, -1, 0));
+  } else {
+    NCCLCHECK(ncclTopoSearchTryGpu(system, graph, saveGraph, 0, backToNet, backToFirstRank, 0, time, -1, -1, b-1));
+  }
+  return ncclSuccess;
+}
+
+struct ncclTopoSearchShared {
+  struct ncclTopoSystem* system;
+  struct ncclTopoGraph* graph;     // Starting point of every branch
+  struct ncclTopoGraph* saveGraph; // Best graph before this search
+  struct ncclTopoGraph* results;   // Best graph of each branch
+  int* times;                      // Time left by each branch, -1 when it found an optimal graph
+  int nBranches;
+  int budget;
+  int nextBranch;
+  int firstPerfect;                // Branches after this one don't count anymore
+  ncclResult_t ret;
+};
+
+static void* ncclTopoSearchWorker(void* arg) {
+  struct ncclTopoSearchShared* shared = (struct ncclTopoSearchShared*)arg;
+  struct ncclTopoSystem* system = NULL;
+  struct ncclTopoGraph* graph = NULL;
+  ncclResult_t ret = ncclSuccess;
+  NCCLCHECKGOTO(ncclTopoCloneSystem(shared->system, &system), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&graph, 1), ret, exit);
+  while (1) {
+    int b = __atomic_fetch_add(&shared->nextBranch, 1, __ATOMIC_RELAXED);
+    if (b >= shared->nBranches || b > __atomic_load_n(&shared->firstPerfect, __ATOMIC_RELAXED)) break;
+    memcpy(graph, shared->graph, sizeof(struct ncclTopoGraph));
+    memcpy(shared->results+b, shared->saveGraph, sizeof(struct ncclTopoGraph));
+    int time = shared->budget;
+    NCCLCHECKGOTO(ncclTopoSearchRecBranch(system, graph, shared->results+b, b, &time), ret, exit);
+    shared->times[b] = time;
+    if (time == -1) {
+      int first = __atomic_load_n(&shared->firstPerfect, __ATOMIC_RELAXED);
+      while (b < first && !__atomic_compare_exchange_n(&shared->firstPerfect, &first, b, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+  }
+exit:
+  if (ret != ncclSuccess) __atomic_store_n(&shared->ret, ret, __ATOMIC_RELAXED);
+  free(graph);
+  if (system) ncclTopoFree(system);
+  return NULL;
+}
+
+static ncclResult_t ncclTopoSearchRecParallel(struct ncclTopoSystem* system, struct ncclTopoGraph* graph, struct ncclTopoGraph* saveGraph, int* time) {
+  int nThreads = rcclParamTopoSearchThreads();
+  int nBranches = 0;
+  if (nThreads > 1 && graph->nChannels == 0 && graph->pattern != NCCL_TOPO_PATTERN_NVLS) {
+    NCCLCHECK(ncclTopoSearchBranchCount(system, graph, &nBranches));
+  }
+  if (nBranches < 2) return ncclTopoSearchRec(system, graph, saveGraph, time);
+  nThreads = std::min(nThreads, nBranches);
+
+  ncclResult_t ret = ncclSuccess;
+  struct ncclTopoSearchShared shared;
+  pthread_t* threads = NULL;
+  int nStarted = 0;
+  memset(&shared, 0, sizeof(shared));
+  shared.system = system;
+  shared.graph = graph;
+  shared.saveGraph = saveGraph;
+  shared.nBranches = nBranches;
+  // Same total work as the sequential search, spread over nThreads
+  shared.budget = std::max(1, (int)std::min((int64_t)*time, (int64_t)*time*nThreads/nBranches));
+  shared.firstPerfect = nBranches;
+  NCCLCHECKGOTO(ncclCalloc(&shared.results, nBranches), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&shared.times, nBranches), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&threads, nThreads-1), ret, exit);
+  // Which thread runs a branch doesn't change its result, so failing to start some is fine
+  for (; nStarted < nThreads-1; nStarted++) {
+    if (pthread_create(threads+nStarted, NULL, ncclTopoSearchWorker, &shared) != 0) break;
+  }
+  ncclTopoSearchWorker(&shared);
+  for (int t=0; t<nStarted; t++) pthread_join(threads[t], NULL);
+  NCCLCHECKGOTO(shared.ret, ret, exit);
+
+  {
+    int last = std::min(nBranches-1, shared.firstPerfect);
+    int timedOut = 0;
+    int64_t used = 0;
+    for (int b=0; b<=last; b++) {
+      int copy = 0;
+      NCCLCHECKGOTO(ncclTopoCompareGraphs(system, shared.results+b, saveGraph, &copy), ret, exit);
+      if (copy) memcpy(saveGraph, shared.results+b, sizeof(struct ncclTopoGraph));
+      if (shared.times[b] == 0) timedOut = 1;
+      else if (shared.times[b] > 0) used += shared.budget-shared.times[b];
+    }
+    if (shared.firstPerfect < nBranches) *time = -1;
+    else if (timedOut) *time = 0;
+    else *time = std::max(1, (int)(*time-used/nThreads));
+  }
+exit:
+  free(threads);
+  free(shared.times);
+  free(shared.results);
+  return ret;
+}
+
 /************************************/
 /* User defined graph from XML file */
 /************************************/
@@ -904,13 +1053,22 @@ float sm90SpeedArrayInter[] = { 48.0, 45.0, 42.0, 40.0, 30.0, 24.0, 22.0, 20.0,
 #endif
 
 RCCL_PARAM(ModelMatchingDisable, "MODEL_MATCHING_DISABLE", 0);
+// Keep inter-node ring and tree edges on one rail of a rail-optimized fabric
+RCCL_PARAM(RailAligned, "RAIL_ALIGNED", 0);
 
-ncclResult_t ncclTopoCompute(ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+static bool rcclRailPattern(int pattern) {
+  return pattern == NCCL_TOPO_PATTERN_RING || pattern == NCCL_TOPO_PATTERN_TREE ||
+         pattern == NCCL_TOPO_PATTERN_BALANCED_TREE || pattern == NCCL_TOPO_PATTERN_SPLIT_TREE;
+}
+
+static ncclResult_t ncclTopoComputeSearch(ncclTopoSystem* system, struct ncclTopoGraph* graph) {
   int ngpus = system->nodes[GPU].count;
   int crossNic = (system->nodes[NET].count > 1) &&
 	 (graph->pattern == NCCL_TOPO_PATTERN_RING ||
           graph->pattern == NCCL_TOPO_PATTERN_BALANCED_TREE ||
           graph->pattern == NCCL_TOPO_PATTERN_SPLIT_TREE) ? ncclParamCrossNic() : 0;
+  // A channel leaving through another NIC than it came in would change rail between nodes
+  if (rcclParamRailAligned() && rcclRailPattern(graph->pattern)) crossNic = 0;
   graph->crossNic = crossNic == 1 ? 1 : 0;
   graph->bwIntra = graph->bwInter = 0;
   graph->latencyInter = 0;
@@ -1017,7 +1175,7 @@ search:
   tmpGraph.nChannels = 0;
   globalTimeout -= time;
 
-  NCCLCHECK(ncclTopoSearchRec(system, &tmpGraph, graph, &time));
+  NCCLCHECK(ncclTopoSearchRecParallel(system, &tmpGraph, graph, &time));
 #if 0
   printf("Id %d Pattern %d, crossNic %d, Bw %g/%g, type %d/%d, channels %d-%d sameChannels %d -> nChannels %dx%g/%g %s\n", tmpGraph.id, tmpGraph.pattern, tmpGraph.crossNic, tmpGraph.bwInter, tmpGraph.bwIntra, tmpGraph.typeInter, tmpGraph.typeIntra, tmpGraph.minChannels, tmpGraph.maxChannels, tmpGraph.sameChannels, graph->nChannels, graph->bwInter, graph->bwIntra, time == 0 ? "TIMEOUT" : time == -1 ? "PERFECT" : "");
   for (int c=0; c<graph->nChannels; c++) {
@@ -1131,6 +1289,243 @@ done:
   return ncclSuccess;
 }
 
+/******************************/
+/* Persistent graph cache     */
+/******************************/
+
+// Search results only depend on the fused topology, on the graph inputs and on
+// the NCCL_/RCCL_ environment, so they can be reused across runs. Entries are
+// written to RCCL_GRAPH_CACHE_DIR, one file per key.
+#define RCCL_GRAPH_CACHE_MAGIC 0x52434c4743414345ULL
+
+struct rcclGraphCacheEntry {
+  uint64_t magic;
+  uint64_t key;
+  struct ncclTopoGraph graph;
+  // System state which model matching may set along with the graph
+  int type;
+  int netGdrLevel;
+  int tuning;
+  bool pivotA2AEnabled;
+  int pivotA2ANumBiRings;
+  bool treeDefined;
+  bool ll128Enabled;
+  float baseBw;
+  bool mscclEnabled;
+};
+
+extern char** environ;
+
+static uint64_t rcclGraphCacheHash(uint64_t hash, const void* data, size_t n) {
+  const char* c = (const char*)data;
+  for (size_t i = 0; i < n; i++) hash = ((hash << 5) + hash) ^ c[i];
+  return hash;
+}
+
+static uint64_t rcclGraphCacheKey(struct ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+  uint64_t key = 5381;
+  int version = NCCL_VERSION_CODE;
+  size_t graphSize = sizeof(struct ncclTopoGraph);
+  key = rcclGraphCacheHash(key, &version, sizeof(version));
+  key = rcclGraphCacheHash(key, &graphSize, sizeof(graphSize));
+  key = rcclGraphCacheHash(key, &system->xmlHash, sizeof(system->xmlHash));
+  key = rcclGraphCacheHash(key, &system->nRanks, sizeof(system->nRanks));
+  key = rcclGraphCacheHash(key, &system->nHosts, sizeof(system->nHosts));
+  key = rcclGraphCacheHash(key, &system->hostIdx, sizeof(system->hostIdx));
+  // Topology after trimming
+  for (int t = 0; t < NCCL_TOPO_NODE_TYPES; t++) {
+    key = rcclGraphCacheHash(key, &system->nodes[t].count, sizeof(int));
+  }
+  for (int g = 0; g < system->nodes[GPU].count; g++) {
+    key = rcclGraphCacheHash(key, &system->nodes[GPU].nodes[g].gpu.rank, sizeof(int));
+  }
+  // Graph inputs
+  key = rcclGraphCacheHash(key, &graph->id, sizeof(graph->id));
+  key = rcclGraphCacheHash(key, &graph->pattern, sizeof(graph->pattern));
+  key = rcclGraphCacheHash(key, &graph->collNet, sizeof(graph->collNet));
+  key = rcclGraphCacheHash(key, &graph->minChannels, sizeof(graph->minChannels));
+  key = rcclGraphCacheHash(key, &graph->maxChannels, sizeof(graph->maxChannels));
+  // Environment, combined independently of its order
+  uint64_t envHash = 0;
+  for (char** env = environ; env && *env; env++) {
+    if (strncmp(*env, "NCCL_", 5) != 0 && strncmp(*env, "RCCL_", 5) != 0) continue;
+    if (strncmp(*env, "NCCL_DEBUG", 10) == 0 || strncmp(*env, "RCCL_GRAPH_CACHE_DIR=", 21) == 0) continue;
+    envHash += getHash(*env, strlen(*env));
+  }
+  return rcclGraphCacheHash(key, &envHash, sizeof(envHash));
+}
+
+static bool rcclGraphCacheLoad(const char* dir, uint64_t key, struct ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/rccl_graph_%016lx.bin", dir, key);
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return false;
+  struct rcclGraphCacheEntry entry;
+  size_t n = fread(&entry, 1, sizeof(entry), file);
+  fclose(file);
+  if (n != sizeof(entry) || entry.magic != RCCL_GRAPH_CACHE_MAGIC || entry.key != key) {
+    INFO(NCCL_GRAPH, "Graph cache : ignoring invalid entry %s", path);
+    return false;
+  }
+  memcpy(graph, &entry.graph, sizeof(struct ncclTopoGraph));
+  system->type = entry.type;
+  system->netGdrLevel = entry.netGdrLevel;
+  system->tuning = entry.tuning;
+  system->pivotA2AEnabled = entry.pivotA2AEnabled;
+  system->pivotA2ANumBiRings = entry.pivotA2ANumBiRings;
+  system->treeDefined = entry.treeDefined;
+  system->ll128Enabled = entry.ll128Enabled;
+  system->baseBw = entry.baseBw;
+  system->mscclEnabled = entry.mscclEnabled;
+  INFO(NCCL_GRAPH, "Graph cache : pattern %d loaded %d channels from %s", graph->pattern, graph->nChannels, path);
+  return true;
+}
+
+static void rcclGraphCacheStore(const char* dir, uint64_t key, struct ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+  struct rcclGraphCacheEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.magic = RCCL_GRAPH_CACHE_MAGIC;
+  entry.key = key;
+  memcpy(&entry.graph, graph, sizeof(struct ncclTopoGraph));
+  entry.type = system->type;
+  entry.netGdrLevel = system->netGdrLevel;
+  entry.tuning = system->tuning;
+  entry.pivotA2AEnabled = system->pivotA2AEnabled;
+  entry.pivotA2ANumBiRings = system->pivotA2ANumBiRings;
+  entry.treeDefined = system->treeDefined;
+  entry.ll128Enabled = system->ll128Enabled;
+  entry.baseBw = system->baseBw;
+  entry.mscclEnabled = system->mscclEnabled;
+
+  // Ranks sharing a node write the same entry; write to a private file, then rename
+  char path[PATH_MAX], tmpPath[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/rccl_graph_%016lx.bin", dir, key);
+  snprintf(tmpPath, sizeof(tmpPath), "%s/.rccl_graph_%016lx.%d.tmp", dir, key, getpid());
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    INFO(NCCL_GRAPH, "Graph cache : unable to create %s : %s", dir, strerror(errno));
+    return;
+  }
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    INFO(NCCL_GRAPH, "Graph cache : unable to open %s : %s", tmpPath, strerror(errno));
+    return;
+  }
+  size_t n = fwrite(&entry, 1, sizeof(entry), file);
+  if (fclose(file) != 0 || n != sizeof(entry) || rename(tmpPath, path) != 0) {
+    INFO(NCCL_GRAPH, "Graph cache : unable to write %s", path);
+    unlink(tmpPath);
+    return;
+  }
+  INFO(NCCL_GRAPH, "Graph cache : pattern %d stored %d channels to %s", graph->pattern, graph->nChannels, path);
+}
+
+// Orders the channels round robin over the rails of their NICs, keeping the
+// search order within a rail. Every node applies the same order, so channel c
+// reaches the network on the same rail everywhere and connecting channel c
+// across nodes never crosses rails.
+static ncclResult_t rcclTopoAlignRails(struct ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+  if (!rcclParamRailAligned() || !rcclRailPattern(graph->pattern) || system->nodes[NET].count == 0) return ncclSuccess;
+  // Intra-node nets and tree bases are laid out per channel by the models
+  if (graph->nChannels < 2 || graph->nIntraChannels || graph->treeBase[0][0]) return ncclSuccess;
+  int ngpus = system->nodes[GPU].count;
+  int nChannels = graph->nChannels;
+  int rails[MAXCHANNELS];
+  bool used[MAXCHANNELS] = { false };
+  for (int c=0; c<nChannels; c++) {
+    int n;
+    NCCLCHECK(ncclTopoIdToIndex(system, NET, graph->inter[c*2], &n));
+    rails[c] = system->nodes[NET].nodes[n].net.rail;
+  }
+
+  int* intra;
+  int inter[MAXCHANNELS*2];
+  NCCLCHECK(ncclCalloc(&intra, nChannels*ngpus));
+  int last = INT_MIN;
+  for (int i=0; i<nChannels; i++) {
+    // Next rail above the last one, or the lowest rail once we went through all of them
+    int next = -1;
+    for (int wrap=0; wrap<2 && next == -1; wrap++) {
+      for (int c=0; c<nChannels; c++) {
+        if (used[c] || (wrap == 0 && rails[c] <= last)) continue;
+        if (next == -1 || rails[c] < rails[next]) next = c;
+      }
+    }
+    used[next] = true;
+    last = rails[next];
+    memcpy(intra+i*ngpus, graph->intra+next*ngpus, ngpus*sizeof(int));
+    inter[i*2] = graph->inter[next*2];
+    inter[i*2+1] = graph->inter[next*2+1];
+  }
+  memcpy(graph->intra, intra, nChannels*ngpus*sizeof(int));
+  memcpy(graph->inter, inter, nChannels*2*sizeof(int));
+  free(intra);
+  INFO(NCCL_GRAPH, "Pattern %d, %d channels ordered by NIC rail", graph->pattern, nChannels);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTopoCompute(ncclTopoSystem* system, struct ncclTopoGraph* graph) {
+  const char* cacheDir = ncclGetEnv("RCCL_GRAPH_CACHE_DIR");
+  // An explicit graph file always takes precedence over the cache
+  if (cacheDir == NULL || cacheDir[0] == '\0' || ncclGetEnv("NCCL_GRAPH_FILE")) {
+    NCCLCHECK(ncclTopoComputeSearch(system, graph));
+    return rcclTopoAlignRails(system, graph);
+  }
+
+  uint64_t key = rcclGraphCacheKey(system, graph);
+  if (!rcclGraphCacheLoad(cacheDir, key, system, graph)) {
+    NCCLCHECK(ncclTopoComputeSearch(system, graph));
+    rcclGraphCacheStore(cacheDir, key, system, graph);
+  }
+  return rcclTopoAlignRails(system, graph);
+}
+
+ncclResult_t ncclTopoRestrictGraph(struct ncclTopoSystem* refSystem, struct ncclTopoGraph* refGraph,
+    struct ncclTopoSystem* system, struct ncclTopoGraph* graph, int* valid) {
+  int refNgpus = refSystem->nodes[GPU].count;
+  int ngpus = system->nodes[GPU].count;
+  int multiNode = ngpus != system->nRanks;
+  int* intra = NULL;
+  *valid = 0;
+  // Model and user defined graphs only hold for the GPU set they were written for
+  if (refGraph->nIntraChannels || refGraph->treeBase[0][0] || refSystem->treeDefined) return ncclSuccess;
+  // A single GPU is cheap to search, and going from multi to single node changes what the search optimizes for
+  if (ngpus < 2 || ngpus > refNgpus || multiNode != (refNgpus != refSystem->nRanks)) return ncclSuccess;
+  NCCLCHECK(ncclCalloc(&intra, refGraph->nChannels*ngpus));
+  for (int c=0; c<refGraph->nChannels; c++) {
+    int n = 0;
+    for (int i=0; i<refNgpus; i++) {
+      int refIndex;
+      NCCLCHECK(getGpuIndex(refSystem, refGraph->intra[c*refNgpus+i], &refIndex));
+      int64_t id = refSystem->nodes[GPU].nodes[refIndex].id;
+      int g;
+      for (g=0; g<ngpus && system->nodes[GPU].nodes[g].id != id; g++);
+      if (g == ngpus) {
+        // Across nodes the first and last GPUs were picked for their NIC
+        if (multiNode && (i == 0 || i == refNgpus-1)) goto exit;
+        continue;
+      }
+      if (n == ngpus) goto exit;
+      intra[c*ngpus+n++] = system->nodes[GPU].nodes[g].gpu.rank;
+    }
+    if (n != ngpus) goto exit;
+    // Skipping a GPU must not put a hop on a slower path than the graph was searched with
+    int nHops = (refGraph->pattern == NCCL_TOPO_PATTERN_RING && !multiNode) ? ngpus : ngpus-1;
+    for (int i=0; i<nHops; i++) {
+      int g1, g2;
+      NCCLCHECK(getGpuIndex(system, intra[c*ngpus+i], &g1));
+      NCCLCHECK(getGpuIndex(system, intra[c*ngpus+(i+1)%ngpus], &g2));
+      if (system->nodes[GPU].nodes[g1].paths[GPU][g2].type > refGraph->typeIntra) goto exit;
+    }
+  }
+  memcpy(graph, refGraph, sizeof(struct ncclTopoGraph));
+  memset(graph->intra, 0, sizeof(graph->intra));
+  memcpy(graph->intra, intra, refGraph->nChannels*ngpus*sizeof(int));
+  *valid = 1;
+exit:
+  free(intra);
+  return ncclSuccess;
+}
+
 ncclResult_t ncclTopoPrintGraph(struct ncclTopoSystem* system, struct ncclTopoGraph* graph) {
   INFO(NCCL_GRAPH, "Pattern %d, crossNic %d, nChannels %d, bw %f/%f, type %s/%s, sameChannels %d", graph->pattern, graph->crossNic, graph->nChannels, graph->bwIntra, graph->bwInter, topoPathTypeStr[graph->typeIntra], topoPathTypeStr[graph->typeInter], graph->sameChannels);
   int ngpus = system->nodes[GPU].count;
@@ -334,6 +334,22 @@ ncclResult_t ncclTopoSortSystem(struct ncclTopoSystem* system) {
   return ncclSuccess;
 }
 
+// RCCL_NET_RAILS lists the rail of each net device, e.g. "0,1,2,3,0,1,2,3".
+// Devices it doesn't cover keep the rail attribute of the topology XML, which
+// defaults to the device index.
+static int rcclNetRail(int dev, int defaultRail) {
+  const char* str = ncclGetEnv("RCCL_NET_RAILS");
+  if (str == NULL) return defaultRail;
+  for (int d=0; *str; d++) {
+    char* end;
+    long rail = strtol(str, &end, 10);
+    if (end == str) break;
+    if (d == dev) return (int)rail;
+    str = *end == ',' ? end+1 : end;
+  }
+  return defaultRail;
+}
+
 ncclResult_t ncclTopoAddNet(struct ncclXmlNode* xmlNet, struct ncclTopoSystem* system, struct ncclTopoNode* nic, int64_t busId) {
   int dev;
   NCCLCHECK(xmlGetAttrInt(xmlNet, "dev", &dev));
@@ -355,6 +371,8 @@ ncclResult_t ncclTopoAddNet(struct ncclXmlNode* xmlNet, struct ncclTopoSystem* s
   NCCLCHECK(xmlGetAttrIntDefault(xmlNet, "gdr", &net->net.gdrSupport, 0));
   NCCLCHECK(xmlGetAttrIntDefault(xmlNet, "maxconn", &net->net.maxChannels, MAXCHANNELS));
   NCCLCHECK(xmlGetAttrIntDefault(xmlNet, "coll", &net->net.collSupport, 0));
+  NCCLCHECK(xmlGetAttrIntDefault(xmlNet, "rail", &net->net.rail, dev));
+  net->net.rail = rcclNetRail(dev, net->net.rail);
   net->net.busId = busId;
   ncclDebugNoWarn = 0;
 
@@ -800,6 +818,7 @@ ncclResult_t ncclTopoGetSystem(struct ncclComm* comm, struct ncclTopoSystem** sy
   }
 
   NCCLCHECK(ncclTopoGetSystemFromXml(xml, system));
+  NCCLCHECK(ncclTopoGetXmlHash(xml, &(*system)->xmlHash));
   free(xml);
   return ncclSuccess;
 }
@@ -981,6 +1000,32 @@ ncclResult_t ncclTopoGetCpuAffinity(struct ncclTopoSystem* system, int rank, cpu
   return ncclSuccess;
 }
 
+// CPUs of the NUMA node closest to a NIC, restricted to the ones this process may run on.
+// Returns an empty set when the NIC is unknown or none of its CPUs are usable.
+ncclResult_t ncclTopoGetNetCpuAffinity(struct ncclTopoSystem* system, int netDev, cpu_set_t* affinity) {
+  CPU_ZERO(affinity);
+  int n = -1;
+  for (int i=0; i<system->nodes[NET].count; i++) {
+    if (system->nodes[NET].nodes[i].id == netDev) n = i;
+  }
+  if (n == -1 || system->nodes[CPU].count == 0) return ncclSuccess;
+  struct ncclTopoNode* net = system->nodes[NET].nodes+n;
+  int cpuIndex = -1, minHops = 0;
+  for (int c=0; c<system->nodes[CPU].count; c++) {
+    if (net->paths[CPU] == NULL) break;
+    int nHops = net->paths[CPU][c].count;
+    if (cpuIndex == -1 || nHops < minHops) {
+      cpuIndex = c;
+      minHops = nHops;
+    }
+  }
+  if (cpuIndex == -1) return ncclSuccess;
+  cpu_set_t mask;
+  SYSCHECK(sched_getaffinity(0, sizeof(cpu_set_t), &mask), "sched_getaffinity");
+  CPU_AND(affinity, &mask, &system->nodes[CPU].nodes[cpuIndex].cpu.affinity);
+  return ncclSuccess;
+}
+
 ncclResult_t ncclTopoGetGpuCount(struct ncclTopoSystem* system, int* count) {
   *count = system->nodes[GPU].count;
   return ncclSuccess;
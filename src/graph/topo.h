@@ -140,6 +140,7 @@ struct ncclTopoNode {
       int collSupport;
       int maxChannels;
       int64_t busId;
+      int rail; // Index of the leaf switch plane the NIC is cabled to
     }net;
     struct {
       int arch;
@@ -183,6 +184,9 @@ struct ncclTopoSystem {
   // [RCCL] Track hostIdx and number of hosts to support rail-optimized rings/trees
   int nHosts;
   int hostIdx;
+
+  // [RCCL] Hash of the fused topology XML, used to key the graph cache
+  uint64_t xmlHash;
 };
 
 ncclResult_t ncclTopoGetNode(struct ncclTopoSystem* system, struct ncclTopoNode** node, int type, uint64_t id);
@@ -5,6 +5,8 @@
  ************************************************************************/
 
 #include "nccl.h"
+#include "checks.h"
+#include <algorithm>
 
 #define RANK_TO_INDEX(r) (rank > root ? rank-1 : rank)
 
@@ -107,3 +109,30 @@ ncclResult_t ncclGetDtree(int nranks, int rank, int* s0, int* d0_0, int* d0_1, i
   }
   return ncclSuccess;
 }
+
+/* Build nTrees trees, nTrees even, as nTrees/2 double binary trees rotated by
+ * nranks/(nTrees/2) ranks from one pair to the next. Roots and interior roles
+ * then move around the ranks, so the forwarding work of the trees is spread
+ * over more ranks. Trees 0 and 1 are the double binary tree.
+ *
+ * nranks=8, nTrees=4, tree 2 is tree 0 rotated by 4 :
+ *
+ * 0---4                 4---0
+ *    / \                   / \
+ *   2   6                 6   2
+ *  / \ / \               / \ / \
+ * 1  3 5  7             5  7 1  3
+ */
+ncclResult_t ncclGetMultiTree(int nranks, int rank, int nTrees, int tree, int* u, int* d0, int* d1, int* parentChildType) {
+  int nPairs = std::max(nTrees/2, 1);
+  int shift = ((tree/2) % nPairs) * nranks / nPairs;
+  int r = (rank - shift + nranks) % nranks;
+  int s[2], c0[2], c1[2], type[2] = { 0, 0 };
+  NCCLCHECK(ncclGetDtree(nranks, r, s, c0, c1, type, s+1, c0+1, c1+1, type+1));
+  int t = tree % 2;
+  *u = s[t] == -1 ? -1 : (s[t]+shift) % nranks;
+  *d0 = c0[t] == -1 ? -1 : (c0[t]+shift) % nranks;
+  *d1 = c1[t] == -1 ? -1 : (c1[t]+shift) % nranks;
+  *parentChildType = type[t];
+  return ncclSuccess;
+}
@@ -5,6 +5,9 @@
  * See LICENSE.txt for license information
  ************************************************************************/
 
+#include <errno.h>
+#include <math.h>
+#include <string.h>
 #include "core.h"
 #include "device.h"
 #include "comm.h"
@@ -54,10 +57,12 @@ ncclResult_t parseList(const char* str, const char* elems[], int nelems, int* li
 
 // Latencies in us, Bandwidths in GB/s
 // Tree { LL, LL128, Simple } , Ring { LL, LL128, Simple }
-static const float baseLat  [NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS] = {
+static float baseLat  [NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS] = {
        { 12.0, 12.0, 17.0 }, { 12.0, 12.0, 17.0 },   // Tree, Ring
        { 12.0, 12.0, 17.0 }, { 12.0, 12.0, 17.0 },   // Collnet Direct, Chain
-       {    0,    0,    0 }, {    0,    0,    0 }};  // NVLS, NVLS Tree
+       {    0,    0,    0 }, {    0,    0,    0 },   // NVLS, NVLS Tree
+       { 12.0, 12.0, 17.0 }, { 12.0, 12.0, 17.0 },   // Direct, RHD
+       { 12.0, 12.0, 17.0 }};                        // Bruck
 
 // NVLink, PCI, Network
 #define NCCL_HW_NVLINK 0
@@ -224,29 +229,29 @@ static struct tuningModel tuning_model_4 {
 static struct tuningModel tuning_model_5 {
   .hwLat = {
     /* NVLINK */
-    { /* Tree (LL/LL128/Simple)*/ { 0.8, 0.0, 2.5 }, /* Ring (LL/LL128/Simple)*/ { 0.8, 0.0, 3.6 }, /* CollNetDirect (Simple)*/ { 0.0, 0.0, 0.8 }, /* CollNetChain (Simple)*/ { 0.0, 0.0, 0.0 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
+    { /* Tree (LL/LL128/Simple)*/ { 0.8, 1.4, 2.5 }, /* Ring (LL/LL128/Simple)*/ { 0.8, 2.2, 3.6 }, /* CollNetDirect (Simple)*/ { 0.0, 0.0, 0.8 }, /* CollNetChain (Simple)*/ { 0.0, 0.0, 0.0 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
     /* PCI */
     { /* Tree (LL/LL128/Simple)*/ { 2.2, 2.2, 5.7 }, /* Ring (LL/LL128/Simple)*/ { 2.2, 2.2, 5.7 }, /* CollNetDirect (Simple)*/ { 0.0, 0.0, 5.7 }, /* CollNetChain (Simple)*/ { 0.0, 0.0, 5.7 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
     /* NET */
-    { /* Tree (LL/LL128/Simple)*/ { 12.5, 0.0, 22.4 }, /* Ring (LL/LL128/Simple)*/ { 9.5, 0.0, 19.8 }, /* CollNetDirect (Simple)*/ { 0.0, 0.0, 12.5 }, /* CollNetChain (Simple)*/ { 0.0, 0.0, 0.0 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
+    { /* Tree (LL/LL128/Simple)*/ { 12.5, 17.0, 22.4 }, /* Ring (LL/LL128/Simple)*/ { 9.5, 14.5, 19.8 }, /* CollNetDirect (Simple)*/ { 0.0, 0.0, 12.5 }, /* CollNetChain (Simple)*/ { 0.0, 0.0, 0.0 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
   },
 
   .bwRatio = {
     /* 2 nodes */
-    { /* Tree (LL/LL128/Simple)*/ { 0.41, 0.00, 1.00 }, /* Ring (LL/LL128/Simple)*/ { 0.41, 0.00, 1.00 }, /* CollNetDirect (Simple)*/ { 0.00, 0.00, 1.00 }, /* CollNetChain (Simple)*/ { 0.00, 0.00, 1.00 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
+    { /* Tree (LL/LL128/Simple)*/ { 0.41, 0.68, 1.00 }, /* Ring (LL/LL128/Simple)*/ { 0.41, 0.68, 1.00 }, /* CollNetDirect (Simple)*/ { 0.00, 0.00, 1.00 }, /* CollNetChain (Simple)*/ { 0.00, 0.00, 1.00 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
     /* more than 2 nodes */
-    { /* Tree (LL/LL128/Simple)*/ { 0.41, 0.00, 0.86 }, /* Ring (LL/LL128/Simple)*/ { 0.41, 0.00, 1.00 }, /* CollNetDirect (Simple)*/ { 0.00, 0.00, 1.00 }, /* CollNetChain (Simple)*/ { 0.00, 0.00, 1.00 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
+    { /* Tree (LL/LL128/Simple)*/ { 0.41, 0.60, 0.86 }, /* Ring (LL/LL128/Simple)*/ { 0.41, 0.68, 1.00 }, /* CollNetDirect (Simple)*/ { 0.00, 0.00, 1.00 }, /* CollNetChain (Simple)*/ { 0.00, 0.00, 1.00 }, /* NVLS */ { 0, 0, 0 }, /* NVLS Tree */ { 0, 0, 0 } },
   },
 
   .treeCorrectionFactor = {
     { 0.1, 0.1, 0.1, 0.1, 0.1, 1.0, 1.0, 0.8, 0.1, 0.4, 0.5, 1.0, 0.6, 0.4, 0.6, 0.1, 0.3, 0.4, 0.4, 0.3, 0.2, 0.2, 0.2, 0.2, 0.2, 0.2, 0.2, },
-    { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, },
+    { 0.1, 0.1, 0.1, 0.1, 0.1, 0.2, 0.3, 0.5, 0.8, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.9, 0.8, 0.7, 0.6, 0.5, 0.5, 0.4, 0.4, 0.4, 0.4, 0.4, 0.4, },
     { 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 1.0, 1.0, 1.0, 0.4, 1.0, 1.0, 1.0, 0.2, 0.7, 1.0, 1.0, 1.0, 0.8, 0.7, 0.7, 0.8, 0.8, 0.8, 0.9, },
   },
 
   .ringCorrectionFactor = {
     { 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 1.0, 0.1, 0.2, 0.2, 0.1, 0.5, 0.8, 1.0, 0.2, 0.4, 0.5, 0.4, 0.4, 0.3, 0.2, 0.2, 0.2, 0.2, 0.2, 0.2, },
-    { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, },
+    { 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.2, 0.4, 0.6, 0.8, 1.0, 1.0, 1.0, 1.0, 1.0, 0.9, 0.8, 0.7, 0.6, 0.5, 0.4, 0.3, 0.3, 0.3, 0.3, 0.3, 0.3, },
     { 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.7, 0.1, 0.1, 0.1, 0.1, 0.1, 1.0, 1.0, 1.0, 0.9, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, },
   },
 };
@@ -260,34 +265,301 @@ static struct tuningModel rcclTuningModel[] = {
   tuning_model_5,
 };
 
+// Direct AllReduce: every rank talks to every peer over its own link, so its
+// bandwidth is that of the slowest GPU to GPU path. Link efficiency and hop
+// latency are taken from the Ring model, the per-algorithm tables having no Direct entries.
+static float directLinkBw(struct ncclTopoSystem* system) {
+  float bw = 0;
+  for (int i=0; i<system->nodes[GPU].count; i++) {
+    for (int j=0; j<system->nodes[GPU].count; j++) {
+      if (i == j) continue;
+      float pathBw = system->nodes[GPU].nodes[i].paths[GPU][j].bw;
+      if (bw == 0 || pathBw < bw) bw = pathBw;
+    }
+  }
+  return bw;
+}
+
+static void directTuneModel(struct ncclComm* comm, int p, float linkBw) {
+  struct tuningModel* model = rcclTuningModel+comm->topo->tuning;
+  float hopLat = model->hwLat[NCCL_HW_NVLINK][NCCL_ALGO_RING][p];
+  // One-shot: each rank sends its whole buffer to all peers at once
+  float bw = linkBw * model->bwRatio[0][NCCL_ALGO_RING][p];
+  float lat = baseLat[NCCL_ALGO_DIRECT][p] + hopLat;
+  if (p == NCCL_PROTO_SIMPLE) {
+    // Two-shot: 1/nRanks of the buffer per peer, twice, for one extra hop
+    comm->directOneShotBw = bw;
+    comm->directOneShotLat = lat;
+    bw *= comm->nRanks / 2.0;
+    lat += hopLat;
+  }
+  comm->bandwidths[ncclFuncAllReduce][NCCL_ALGO_DIRECT][p] = bw;
+  comm->latencies[ncclFuncAllReduce][NCCL_ALGO_DIRECT][p] = lat;
+}
+
+// RHD AllReduce: moves the same data as Ring but over log2(nRanks) steps each
+// way, the first ones within the node. Ranks folded in the non power of two case
+// send and receive the whole buffer once more.
+static void rhdTuneModel(struct ncclComm* comm, struct ncclTopoGraph* ringGraph, int p, int nNodes, int intraHw) {
+  struct tuningModel* model = rcclTuningModel+comm->topo->tuning;
+  int nRanks = comm->nRanks;
+  int nSteps = log2i(nRanks);
+  int intraSteps = std::min(nSteps, log2i(nRanks/nNodes));
+  bool fold = (1 << nSteps) != nRanks;
+  float bw = nNodes <= 2 ? ringGraph->bwIntra : ringGraph->bwInter;
+  float busBw = comm->rhdnChannels * bw * model->bwRatio[nNodes <= 2 ? 0 : 1][NCCL_ALGO_RING][p];
+  busBw *= (1.0 * nRanks) / (2*(nRanks-1));
+  if (fold) busBw /= 2;
+  float intraLat = model->hwLat[intraHw][NCCL_ALGO_RING][p];
+  float interLat = model->hwLat[NCCL_HW_NET][NCCL_ALGO_RING][p] + (p == NCCL_PROTO_SIMPLE ? ringGraph->latencyInter : 0);
+  float lat = baseLat[NCCL_ALGO_RHD][p] + 2*(intraSteps*intraLat + (nSteps-intraSteps)*interLat);
+  if (fold) lat += 2*intraLat;
+  comm->bandwidths[ncclFuncAllReduce][NCCL_ALGO_RHD][p] = busBw;
+  comm->latencies[ncclFuncAllReduce][NCCL_ALGO_RHD][p] = lat;
+}
+
+// Bruck AllGather / ReduceScatter: moves the same data as Ring in ceil(log2(nRanks))
+// steps instead of nRanks-1, the first ones within the node, but on one channel.
+static void bruckTuneModel(struct ncclComm* comm, int coll, struct ncclTopoGraph* ringGraph, int p, int nNodes, int intraHw) {
+  struct tuningModel* model = rcclTuningModel+comm->topo->tuning;
+  int nRanks = comm->nRanks;
+  int nSteps = comm->channels[0].bruck.nSteps;
+  int intraSteps = std::min(nSteps, log2i(nRanks/nNodes));
+  float bw = nNodes <= 2 ? ringGraph->bwIntra : ringGraph->bwInter;
+  float busBw = bw * model->bwRatio[nNodes <= 2 ? 0 : 1][NCCL_ALGO_RING][p];
+  busBw *= (1.0 * nRanks) / (nRanks-1);
+  float intraLat = model->hwLat[intraHw][NCCL_ALGO_RING][p];
+  float interLat = model->hwLat[NCCL_HW_NET][NCCL_ALGO_RING][p] + (p == NCCL_PROTO_SIMPLE ? ringGraph->latencyInter : 0);
+  comm->bandwidths[coll][NCCL_ALGO_BRUCK][p] = busBw;
+  comm->latencies[coll][NCCL_ALGO_BRUCK][p] = baseLat[NCCL_ALGO_BRUCK][p] + intraSteps*intraLat + (nSteps-intraSteps)*interLat;
+}
+
+// MSCCL++ kernels exchange data with all the peers of the node at once, like
+// Direct one-shot: AllReduce moves the whole buffer over every link, the other
+// collectives 1/nRanks of it. Measured values can replace the model with
+// RCCL_MSCCLPP_LAT (us) and RCCL_MSCCLPP_BW (GB/s per link). Nothing is modeled
+// across nodes, where RCCL_MSCCLPP_THRESHOLD still applies.
+RCCL_PARAM(MscclppLat, "MSCCLPP_LAT", -1);
+RCCL_PARAM(MscclppBw, "MSCCLPP_BW", -1);
+
+static void mscclppTuneModel(struct ncclComm* comm, int nNodes, float linkBw) {
+  const int colls[] = { ncclFuncAllReduce, ncclFuncAllGather, ncclFuncReduceScatter, ncclFuncAllToAll };
+  struct tuningModel* model = rcclTuningModel+comm->topo->tuning;
+  for (int c=0; c<ncclNumFuncs; c++) comm->mscclppLat[c] = comm->mscclppBw[c] = 0;
+  if (nNodes != 1) return;
+  float lat = rcclParamMscclppLat() >= 0 ? rcclParamMscclppLat() :
+    baseLat[NCCL_ALGO_DIRECT][NCCL_PROTO_LL] + model->hwLat[NCCL_HW_NVLINK][NCCL_ALGO_RING][NCCL_PROTO_LL];
+  float bw = rcclParamMscclppBw() > 0 ? rcclParamMscclppBw() : linkBw * model->bwRatio[0][NCCL_ALGO_RING][NCCL_PROTO_LL];
+  for (int c : colls) {
+    comm->mscclppLat[c] = lat;
+    comm->mscclppBw[c] = c == ncclFuncAllReduce ? bw : bw * comm->nRanks;
+  }
+}
+
 /* Array indexes used below */
 #define VOLTA_COMPCAP_IDX 0
 #define AMPERE_COMPCAP_IDX 1
 #define HOPPER_COMPCAP_IDX 2
 
 // LL128 max BW per channel
-static const double llMaxBws[3][3] = {
+static double llMaxBws[3][3] = {
   /* Volta-N1/Intel-N2/Intel-N4) */ {39.0, 39.0, 20.4},
   /* Ampere-N1/AMD-N2/AMD-N4) */ {87.7, 22.5 /*avg of ring & tree*/, 19.0},
   /* Hopper-N1/AMD-N2/AMD-N4) */ {87.7, 22.5 /*avg of ring & tree*/, 19.0}
 };
 
-static const double perChMaxRingLL128Bws[3][3] = {
+static double perChMaxRingLL128Bws[3][3] = {
   /* Volta (N1/N2/N4) */  {20.0, 20.0, 20.0},
   /* Ampere (N1/N2/N4) */ {20.0, 20.0, 20.0},
   /* Hopper (N1/N2/N4) */ {36.7, 36.7, 36.7},
 };
-static const double perChMaxTreeLL128Bws[3][3] = {
+static double perChMaxTreeLL128Bws[3][3] = {
   /* Volta (N1/N2/N4) */  {20.0, 20.0, 20.0},
   /* Ampere (N1/N2/N4) */ {20.0, 20.0, 20.0},
   /* Hopper (N1/N2/N4) */ {36.7, 36.7, 29.0},
 };
-static const double perChMaxTreeBws[3][3] = {
+static double perChMaxTreeBws[3][3] = {
   /* Volta (N1/N2/N4) */  {26.5, 18.5, 10.0},
   /* Ampere (N1/N2/N4) */ {24.0, 23.6, 17.8},
   /* Hopper (N1/N2/N4) */ {38.7, 41.4, 36.0},
 };
 
+// Tuning file, RCCL_TUNING_FILE. Plain text, one setting per line, '#' starts a comment:
+//   version 1
+//   model <index>                                   selects the model changed by the lines below
+//   hwLat <NVLink|PCI|Net> <algo> <proto> <us>
+//   bwRatio <2nodes|Nnodes> <algo> <proto> <ratio>
+//   treeCorrection|ringCorrection <proto> <log2 bytes> <factor>
+//   baseLat <algo> <proto> <us>
+//   llMaxBw|perChMaxTreeBw|perChMaxRingLL128Bw|perChMaxTreeLL128Bw <row> <col> <GB/s>
+//   override <coll> <minBytes> <maxBytes> <algo|*> <proto|*> <nChannels>
+// Overrides force the algorithm, protocol and/or channel count of a collective for a
+// range of sizes, as long as the cost model considers the choice usable. The file is
+// read once per process and must be the same on all ranks. RCCL_TUNING_DUMP_FILE
+// writes the settings in effect in the same format.
+#define TUNING_FILE_VERSION 1
+#define TUNING_MAX_OVERRIDES 256
+
+static const char* tuningHwStr[] = { "NVLink", "PCI", "Net" };
+static const char* tuningBwRatioStr[] = { "2nodes", "Nnodes" };
+static const char* tuningCollStr[NCCL_NUM_FUNCTIONS] = { "Broadcast", "Reduce", "AllGather", "ReduceScatter", "AllReduce" };
+
+struct tuningOverride {
+  int coll;
+  size_t minBytes, maxBytes;
+  int algorithm, protocol, nChannels;
+};
+static struct tuningOverride tuningOverrides[TUNING_MAX_OVERRIDES];
+static int nTuningOverrides;
+static pthread_once_t tuningFileOnce = PTHREAD_ONCE_INIT;
+
+static int tuningIndex(const char* str, const char** names, int n, bool any) {
+  if (any && strcmp(str, "*") == 0) return -1;
+  for (int i=0; i<n; i++) if (strcasecmp(str, names[i]) == 0) return i;
+  return -2;
+}
+
+static double (*tuningMaxBwTable(const char* key))[3] {
+  if (strcmp(key, "llMaxBw") == 0) return llMaxBws;
+  if (strcmp(key, "perChMaxTreeBw") == 0) return perChMaxTreeBws;
+  if (strcmp(key, "perChMaxRingLL128Bw") == 0) return perChMaxRingLL128Bws;
+  if (strcmp(key, "perChMaxTreeLL128Bw") == 0) return perChMaxTreeLL128Bws;
+  return NULL;
+}
+
+// Returns false if the line is not a valid setting
+static bool tuningParseLine(char* line, struct tuningModel** model) {
+  char key[32], s1[32], s2[32], s3[32];
+  double v;
+  int i, j;
+  if (sscanf(line, "%31s", key) != 1) return false;
+  if (strcmp(key, "model") == 0) {
+    if (sscanf(line, "%*s %d", &i) != 1 || i < 0 || i >= (int)(sizeof(rcclTuningModel)/sizeof(rcclTuningModel[0]))) return false;
+    *model = rcclTuningModel+i;
+  } else if (strcmp(key, "hwLat") == 0 || strcmp(key, "bwRatio") == 0) {
+    bool lat = key[0] == 'h';
+    if (*model == NULL || sscanf(line, "%*s %31s %31s %31s %lf", s1, s2, s3, &v) != 4) return false;
+    int h = lat ? tuningIndex(s1, tuningHwStr, 3, false) : tuningIndex(s1, tuningBwRatioStr, 2, false);
+    int a = tuningIndex(s2, ncclAlgoStr, NCCL_NUM_ALGORITHMS, false);
+    int p = tuningIndex(s3, ncclProtoStr, NCCL_NUM_PROTOCOLS, false);
+    if (h < 0 || a < 0 || p < 0) return false;
+    if (lat) (*model)->hwLat[h][a][p] = v;
+    else (*model)->bwRatio[h][a][p] = v;
+  } else if (strcmp(key, "treeCorrection") == 0 || strcmp(key, "ringCorrection") == 0) {
+    if (*model == NULL || sscanf(line, "%*s %31s %d %lf", s1, &i, &v) != 3) return false;
+    int p = tuningIndex(s1, ncclProtoStr, NCCL_NUM_PROTOCOLS, false);
+    if (p < 0 || i < 0 || i >= 27) return false;
+    if (key[0] == 't') (*model)->treeCorrectionFactor[p][i] = v;
+    else (*model)->ringCorrectionFactor[p][i] = v;
+  } else if (strcmp(key, "baseLat") == 0) {
+    if (sscanf(line, "%*s %31s %31s %lf", s1, s2, &v) != 3) return false;
+    int a = tuningIndex(s1, ncclAlgoStr, NCCL_NUM_ALGORITHMS, false);
+    int p = tuningIndex(s2, ncclProtoStr, NCCL_NUM_PROTOCOLS, false);
+    if (a < 0 || p < 0) return false;
+    baseLat[a][p] = v;
+  } else if (tuningMaxBwTable(key)) {
+    if (sscanf(line, "%*s %d %d %lf", &i, &j, &v) != 3 || i < 0 || i >= 3 || j < 0 || j >= 3) return false;
+    tuningMaxBwTable(key)[i][j] = v;
+  } else if (strcmp(key, "override") == 0) {
+    struct tuningOverride o;
+    if (sscanf(line, "%*s %31s %zu %zu %31s %31s %d", s1, &o.minBytes, &o.maxBytes, s2, s3, &o.nChannels) != 6) return false;
+    o.coll = tuningIndex(s1, tuningCollStr, NCCL_NUM_FUNCTIONS, false);
+    o.algorithm = tuningIndex(s2, ncclAlgoStr, NCCL_NUM_ALGORITHMS, true);
+    o.protocol = tuningIndex(s3, ncclProtoStr, NCCL_NUM_PROTOCOLS, true);
+    if (o.coll < 0 || o.algorithm < -1 || o.protocol < -1 || o.nChannels < 0 || o.minBytes > o.maxBytes) return false;
+    if (nTuningOverrides == TUNING_MAX_OVERRIDES) {
+      WARN("Tuning file : more than %d overrides, ignoring the rest", TUNING_MAX_OVERRIDES);
+      return true;
+    }
+    tuningOverrides[nTuningOverrides++] = o;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void tuningLoadFile() {
+  const char* path = ncclGetEnv("RCCL_TUNING_FILE");
+  if (path == NULL) return;
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    WARN("Tuning file : unable to open %s : %s", path, strerror(errno));
+    return;
+  }
+  char line[512];
+  int lineNum = 0, version = -1, nSettings = 0;
+  struct tuningModel* model = NULL;
+  while (fgets(line, sizeof(line), f)) {
+    lineNum++;
+    char* comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+    char key[32];
+    if (sscanf(line, "%31s", key) != 1) continue;
+    if (version == -1) {
+      if (sscanf(line, "version %d", &version) != 1 || version != TUNING_FILE_VERSION) {
+        WARN("Tuning file %s : expected 'version %d' on the first line, ignoring the file", path, TUNING_FILE_VERSION);
+        break;
+      }
+      continue;
+    }
+    if (tuningParseLine(line, &model)) nSettings++;
+    else WARN("Tuning file %s:%d : ignoring invalid setting '%s'", path, lineNum, key);
+  }
+  fclose(f);
+  INFO(NCCL_TUNING|NCCL_ENV, "Tuning file %s : loaded %d settings, %d overrides", path, nSettings, nTuningOverrides);
+}
+
+bool ncclTopoTuningOverride(int coll, size_t nBytes, int* algorithm, int* protocol, int* nChannels) {
+  for (int i=0; i<nTuningOverrides; i++) {
+    struct tuningOverride* o = tuningOverrides+i;
+    if (o->coll != coll || nBytes < o->minBytes || nBytes > o->maxBytes) continue;
+    *algorithm = o->algorithm;
+    *protocol = o->protocol;
+    *nChannels = o->nChannels;
+    return true;
+  }
+  return false;
+}
+
+static void tuningDumpFile(struct ncclComm* comm) {
+  const char* path = ncclGetEnv("RCCL_TUNING_DUMP_FILE");
+  if (path == NULL) return;
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    WARN("Tuning file : unable to write %s : %s", path, strerror(errno));
+    return;
+  }
+  struct tuningModel* model = rcclTuningModel+comm->topo->tuning;
+  fprintf(f, "version %d\n", TUNING_FILE_VERSION);
+  fprintf(f, "# %d ranks, %d nodes\n", comm->nRanks, comm->nNodes);
+  fprintf(f, "model %d\n", comm->topo->tuning);
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    for (int h=0; h<3; h++) fprintf(f, "hwLat %s %s %s %g\n", tuningHwStr[h], ncclAlgoStr[a], ncclProtoStr[p], model->hwLat[h][a][p]);
+    for (int r=0; r<2; r++) fprintf(f, "bwRatio %s %s %s %g\n", tuningBwRatioStr[r], ncclAlgoStr[a], ncclProtoStr[p], model->bwRatio[r][a][p]);
+    fprintf(f, "baseLat %s %s %g\n", ncclAlgoStr[a], ncclProtoStr[p], baseLat[a][p]);
+  }
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) for (int i=0; i<27; i++) {
+    fprintf(f, "treeCorrection %s %d %g\n", ncclProtoStr[p], i, model->treeCorrectionFactor[p][i]);
+    fprintf(f, "ringCorrection %s %d %g\n", ncclProtoStr[p], i, model->ringCorrectionFactor[p][i]);
+  }
+  const char* maxBwKeys[] = { "llMaxBw", "perChMaxTreeBw", "perChMaxRingLL128Bw", "perChMaxTreeLL128Bw" };
+  for (int k=0; k<4; k++) for (int i=0; i<3; i++) for (int j=0; j<3; j++) {
+    fprintf(f, "%s %d %d %g\n", maxBwKeys[k], i, j, tuningMaxBwTable(maxBwKeys[k])[i][j]);
+  }
+  for (int i=0; i<nTuningOverrides; i++) {
+    struct tuningOverride* o = tuningOverrides+i;
+    fprintf(f, "override %s %zu %zu %s %s %d\n", tuningCollStr[o->coll], o->minBytes, o->maxBytes,
+        o->algorithm < 0 ? "*" : ncclAlgoStr[o->algorithm], o->protocol < 0 ? "*" : ncclProtoStr[o->protocol], o->nChannels);
+  }
+  fprintf(f, "# Resulting latency (us) / bandwidth (GB/s)\n");
+  for (int c=0; c<NCCL_NUM_FUNCTIONS; c++) for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    if (comm->bandwidths[c][a][p] == 0) continue;
+    fprintf(f, "# %s %s %s %.1f / %.1f\n", tuningCollStr[c], ncclAlgoStr[a], ncclProtoStr[p], comm->latencies[c][a][p], comm->bandwidths[c][a][p]);
+  }
+  fclose(f);
+  INFO(NCCL_TUNING, "Tuning file : model in effect written to %s", path);
+}
+
 // Network post overhead in ns (1000 = 1 us)
 NCCL_PARAM(NetOverhead, "NET_OVERHEAD", -2);
 
@@ -300,6 +572,77 @@ static float getNetOverhead(struct ncclComm* comm) {
   else return 1.0;
 }
 
+// Which protocols the tuning model may use for each algorithm. 2 means LL128 was
+// enabled by default rather than by the user.
+ncclResult_t ncclTopoGetProtoEnable(struct ncclComm* comm, struct ncclTopoGraph** graphs, int protoEnable[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS]) {
+  // All are enabled except ll128 which is enabled by default only in certain cases.
+  int userEnable[NCCL_NUM_PROTOCOLS] = { 1, 2, 1 };
+  const char *protoStr = ncclGetEnv("NCCL_PROTO");
+  if (protoStr) {
+    INFO(NCCL_ENV, "NCCL_PROTO set by environment to %s", protoStr);
+    NCCLCHECK(parseList(protoStr, ncclProtoStr, NCCL_NUM_PROTOCOLS, userEnable));
+  }
+  int minCompCap = comm->minCompCap, maxCompCap = comm->maxCompCap;
+  (void)minCompCap; (void)maxCompCap;
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    // Disable LL protocol on gfx12xx
+    int pEnable = (p == NCCL_PROTO_LL && IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx12")) ? 0 : userEnable[p];
+    if (pEnable == 2 && p == NCCL_PROTO_LL128) {
+#if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
+#if defined(ENABLE_LL128)
+      // Enable LL128 by default only on gfx90a and gfx94x with available tuning table
+      pEnable = (graphs[a]->typeInter <= PATH_PXB) && graphs[a]->typeIntra <= PATH_NVL &&
+        ((IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx90a") || IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx94")) &&
+         comm->topo->ll128Enabled) ? 1 : 0;
+#else
+      pEnable = 0;
+#endif
+#else
+      // Enable LL128 by default only on Volta/Ampere/Hopper+NVLink. Other cases are not tested and may cause silent data corruption.
+      pEnable = 1;
+      pEnable &= (graphs[a]->typeInter <= PATH_PXB || (minCompCap >= 90 && graphs[a]->typeInter <= PATH_PXN));
+      pEnable &= (graphs[a]->typeIntra <= PATH_NVB);
+      pEnable &= (minCompCap == maxCompCap);
+      switch (minCompCap) {
+      case 70: pEnable &= 1; break;
+      case 80: pEnable &= 1; break;
+      case 90: pEnable &= 1; break;
+      default: pEnable &= 0; break;
+      }
+      if (pEnable) pEnable = 2;
+#endif
+    }
+    protoEnable[a][p] = pEnable;
+  }
+  return ncclSuccess;
+}
+
+// Share of the warps the LL/LL128 tree AllReduce gives to reduce-up, the rest do
+// broadcast-down. 0 keeps the kernel's fixed 70/30 split, -1 derives it from the
+// tree graph bandwidths, 1-99 sets the percentage.
+RCCL_PARAM(TreeSplit, "TREE_SPLIT", 0);
+
+// Both phases cross the network once per node, but reduce-up also combines up to
+// three inputs at the intra-node rate. The faster XGMI is compared to the network,
+// the more the reduction and not the network limits reduce-up, so it gets more warps.
+static ncclResult_t setTreeSplit(struct ncclComm* comm, struct ncclTopoGraph* treeGraph) {
+  int64_t split = rcclParamTreeSplit();
+  memset(comm->treeSplit, 0, sizeof(comm->treeSplit));
+  if (split == 0) return ncclSuccess;
+  if (split > 0) {
+    split = std::min<int64_t>(split, 99);
+  } else {
+    if (comm->nNodes == 1 || treeGraph->bwInter <= 0) return ncclSuccess;
+    float ratio = treeGraph->bwIntra / treeGraph->bwInter;
+    if (ratio <= 1) return ncclSuccess;
+    split = std::min(70 + (int)(5*log2f(ratio)), 85);
+  }
+  comm->treeSplit[NCCL_PROTO_LL] = comm->treeSplit[NCCL_PROTO_LL128] = split;
+  INFO(NCCL_INIT|NCCL_TUNING, "Tree LL/LL128 split : %ld%% of the warps reduce up (bwIntra %.1f bwInter %.1f)",
+      split, treeGraph->bwIntra, treeGraph->bwInter);
+  return ncclSuccess;
+}
+
 ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCompCap, struct ncclTopoGraph** graphs) {
   int simpleDefaultThreads = (graphs[NCCL_ALGO_RING]->bwIntra*graphs[NCCL_ALGO_RING]->nChannels <= PCI_BW) ? 256 : NCCL_SIMPLE_MAX_NTHREADS;
   comm->maxThreads[NCCL_ALGO_RING][NCCL_PROTO_SIMPLE] =
@@ -324,6 +667,13 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
   comm->maxThreads[NCCL_ALGO_RING][NCCL_PROTO_LL128] = comm->maxThreads[NCCL_ALGO_TREE][NCCL_PROTO_LL128] =
     getNthreads("NCCL_LL128_NTHREADS", ncclParamLl128Nthreads(), NCCL_LL128_MAX_NTHREADS/4, NCCL_LL128_MAX_NTHREADS, NCCL_LL128_MAX_NTHREADS);
 #endif
+  comm->maxThreads[NCCL_ALGO_DIRECT][NCCL_PROTO_SIMPLE] = comm->maxThreads[NCCL_ALGO_TREE][NCCL_PROTO_SIMPLE];
+  comm->maxThreads[NCCL_ALGO_DIRECT][NCCL_PROTO_LL] = comm->maxThreads[NCCL_ALGO_RING][NCCL_PROTO_LL];
+  comm->maxThreads[NCCL_ALGO_DIRECT][NCCL_PROTO_LL128] = comm->maxThreads[NCCL_ALGO_RING][NCCL_PROTO_LL128];
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) comm->maxThreads[NCCL_ALGO_RHD][p] = comm->maxThreads[NCCL_ALGO_RING][p];
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) comm->maxThreads[NCCL_ALGO_BRUCK][p] = comm->maxThreads[NCCL_ALGO_RING][p];
+
+  pthread_once(&tuningFileOnce, tuningLoadFile);
 
   // MNNVL support - treat as a single NVLink connected node
   int nNodes = comm->MNNVL ? 1 : comm->nNodes;
@@ -347,6 +697,8 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
   int intraHw[NCCL_NUM_ALGORITHMS], hw[NCCL_NUM_ALGORITHMS];
   for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) intraHw[a] = graphs[a]->typeIntra == LINK_NVL ? NCCL_HW_NVLINK : NCCL_HW_PCI;
   for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) hw[a] = nNodes == 1 ? intraHw[a] : NCCL_HW_NET;
+  float directBw = comm->directSupport ? directLinkBw(comm->topo) : 0;
+  mscclppTuneModel(comm, nNodes, directLinkBw(comm->topo));
 
   for (int coll=0; coll<NCCL_NUM_FUNCTIONS; coll++) {
     int nsteps = coll == ncclFuncAllReduce ? 2*(nRanks-1) :
@@ -357,12 +709,27 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
       nNodes;
 
     for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) {
-      if (coll == ncclFuncBroadcast && a != NCCL_ALGO_RING) continue;
-      if (coll == ncclFuncReduce && a != NCCL_ALGO_RING) continue;
-      if (coll == ncclFuncReduceScatter && a != NCCL_ALGO_RING && a != NCCL_ALGO_NVLS && a != NCCL_ALGO_COLLNET_DIRECT) continue;
-      if (coll == ncclFuncAllGather && a != NCCL_ALGO_RING && a != NCCL_ALGO_NVLS && a != NCCL_ALGO_COLLNET_DIRECT) continue;
+      if (coll == ncclFuncBroadcast && a != NCCL_ALGO_RING && !(a == NCCL_ALGO_TREE && comm->rootedTreeSupport)) continue;
+      if (coll == ncclFuncReduce && a != NCCL_ALGO_RING && !(a == NCCL_ALGO_TREE && comm->rootedTreeSupport)) continue;
+      if (coll == ncclFuncReduceScatter && a != NCCL_ALGO_RING && a != NCCL_ALGO_NVLS && a != NCCL_ALGO_COLLNET_DIRECT && a != NCCL_ALGO_BRUCK) continue;
+      if (coll == ncclFuncAllGather && a != NCCL_ALGO_RING && a != NCCL_ALGO_NVLS && a != NCCL_ALGO_COLLNET_DIRECT && a != NCCL_ALGO_BRUCK) continue;
+      if (a == NCCL_ALGO_DIRECT && (coll != ncclFuncAllReduce || !comm->directSupport)) continue;
+      if (a == NCCL_ALGO_RHD && (coll != ncclFuncAllReduce || !comm->rhdSupport)) continue;
+      if (a == NCCL_ALGO_BRUCK && !comm->bruckSupport) continue;
 
       for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+        if (a == NCCL_ALGO_DIRECT) {
+          directTuneModel(comm, p, directBw);
+          continue;
+        }
+        if (a == NCCL_ALGO_RHD) {
+          rhdTuneModel(comm, graphs[NCCL_ALGO_RING], p, nNodes, intraHw[NCCL_ALGO_RING]);
+          continue;
+        }
+        if (a == NCCL_ALGO_BRUCK) {
+          bruckTuneModel(comm, coll, graphs[NCCL_ALGO_RING], p, nNodes, intraHw[NCCL_ALGO_RING]);
+          continue;
+        }
         if (a == NCCL_ALGO_TREE && p == NCCL_PROTO_SIMPLE && IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx94") && comm->topo->nodes[GPU].count == comm->topo->nRanks) continue;
         if ((a == NCCL_ALGO_NVLS || a == NCCL_ALGO_NVLS_TREE) && p != NCCL_PROTO_SIMPLE) continue;
         int collnet = (a == NCCL_ALGO_COLLNET_DIRECT || a == NCCL_ALGO_COLLNET_CHAIN) ? 1 : 0;
@@ -413,6 +780,8 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
           }
         }
 #endif
+        // The switch reduces at most at the speed of the NICs it offloads
+        if (collnet && comm->collNetBw > 0) busBw = std::min(busBw, 2*comm->collNetBw*graphs[a]->nChannels);
 
         // Convert bus BW to algorithm BW
         if (!(a == NCCL_ALGO_COLLNET_DIRECT && (coll == ncclFuncAllGather || coll == ncclFuncReduceScatter))) {
@@ -421,6 +790,11 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
           else if (a == NCCL_ALGO_NVLS || a == NCCL_ALGO_NVLS_TREE) ratio *= 5.0/6.0;
           else ratio *= .5;
           busBw *= ratio;
+          // A channel moves at most what the intra-node links of its graph channel carry,
+          // shared by the channels duplicated from it. With network or PCIe bottlenecks
+          // fewer channels than the communicator has reach busBw.
+          if (p == NCCL_PROTO_SIMPLE && (a == NCCL_ALGO_RING || a == NCCL_ALGO_TREE) && comm->nChannels > 0)
+            comm->algoChannelBw[coll][a] = graphs[a]->bwIntra * graphs[a]->nChannels / comm->nChannels * ratio;
         }
         comm->bandwidths[coll][a][p] = busBw;
         /* Ring bandwidth backup */
@@ -432,6 +806,7 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
         float interLat =  graphs[a]->latencyInter ? graphs[a]->latencyInter : rcclTuningModel[comm->topo->tuning].hwLat[NCCL_HW_NET][a][p];
         //if (nNodes > 1 && p == NCCL_PROTO_LL) intraLat *= 1.8;
         if (p == NCCL_PROTO_SIMPLE) interLat += graphs[a]->latencyInter;
+        if (collnet && comm->collNetLat > 0) interLat = comm->collNetLat;
 
         if (a == NCCL_ALGO_RING) {
           float lat = rcclTuningModel[comm->topo->tuning].hwLat[hw[a]][a][p];
@@ -470,15 +845,10 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
   }
 
   // Protocols/Algorithms enable/disable, and user overrides.
-  // All are enabled except ll128 which is enabled by default only in certain cases.
-  int protoEnable[NCCL_NUM_PROTOCOLS] = { 1, 2, 1 };
-  int algoEnable[NCCL_NUM_ALGORITHMS] = { 1, 1, 1, 1, 1, 1 };
+  int protoEnable[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+  int algoEnable[NCCL_NUM_ALGORITHMS] = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+  NCCLCHECK(ncclTopoGetProtoEnable(comm, graphs, protoEnable));
 
-  const char *protoStr = ncclGetEnv("NCCL_PROTO");
-  if (protoStr) {
-    INFO(NCCL_ENV, "NCCL_PROTO set by environment to %s", protoStr);
-    NCCLCHECK(parseList(protoStr, ncclProtoStr, NCCL_NUM_PROTOCOLS, protoEnable));
-  }
   const char *algoStr = ncclGetEnv("NCCL_ALGO");
   if (algoStr) {
     INFO(NCCL_ENV, "NCCL_ALGO set by environment to %s", algoStr);
@@ -507,31 +877,12 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
   }
 
   for (int c=0; c<NCCL_NUM_FUNCTIONS; c++) for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
-    // Disable LL protocol on gfx12xx
-    int pEnable = (p == NCCL_PROTO_LL && IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx12")) ? 0 : protoEnable[p];
-    if (pEnable == 2 && p == NCCL_PROTO_LL128) {
-#if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
-#if defined(ENABLE_LL128)
-      // Enable LL128 by default only on gfx90a with available tuning table
-      pEnable = (graphs[a]->typeInter <= PATH_PXB) && graphs[a]->typeIntra <= PATH_NVL &&
-        (IsArchMatch(comm->topo->nodes[GPU].nodes[0].gpu.gcn, "gfx90a") && comm->topo->ll128Enabled) ? 1 : 0;
-#else
-      pEnable = 0;
-#endif
-#else
-      // Enable LL128 by default only on Volta/Ampere/Hopper+NVLink. Other cases are not tested and may cause silent data corruption.
-      pEnable = 1;
-      pEnable &= (graphs[a]->typeInter <= PATH_PXB || (minCompCap >= 90 && graphs[a]->typeInter <= PATH_PXN));
-      pEnable &= (graphs[a]->typeIntra <= PATH_NVB);
-      pEnable &= (minCompCap == maxCompCap);
-      switch (minCompCap) {
-      case 70: pEnable &= 1; break;
-      case 80: pEnable &= 1; break;
-      case 90: pEnable &= !(CUDART_VERSION == 11080 && c == ncclFuncAllReduce && a == NCCL_ALGO_RING && comm->nRanks == 2); break;
-      default: pEnable &= 0; break;
-      }
-#endif
+    int pEnable = protoEnable[a][p];
+#if !defined(__HIP_PLATFORM_AMD__) && !defined(__HCC__) && !defined(__HIPCC__)
+    if (p == NCCL_PROTO_LL128 && protoEnable[a][p] == 2) {
+      pEnable = !(minCompCap == 90 && CUDART_VERSION == 11080 && c == ncclFuncAllReduce && a == NCCL_ALGO_RING && comm->nRanks == 2);
     }
+#endif
     if (pEnable == 0) comm->bandwidths[c][a][p] = 0;
     if (algoEnable[a] == 0) comm->bandwidths[c][a][p] = 0;
   }
@@ -548,7 +899,7 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
     if (available == false) {
       /* at least set ring algo available */
       for (int p = 0; p < NCCL_NUM_PROTOCOLS; p++)
-        comm->bandwidths[c][NCCL_ALGO_RING][p] = comm->ringbdw[c][p];
+        comm->bandwidths[c][NCCL_ALGO_RING][p] = comm->buffSizes[p] ? comm->ringbdw[c][p] : 0;
     }
   }
 
@@ -556,21 +907,24 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
     char line[1024];
     for (int block=0; block<2; block++) {
       sprintf(line, "  Algorithm   |");
-      for (int ba=0; ba<NCCL_NUM_ALGORITHMS/2; ba++) {
-	int a = block*NCCL_NUM_ALGORITHMS/2+ba;
+      for (int ba=0; ba<DIVUP(NCCL_NUM_ALGORITHMS,2); ba++) {
+	int a = block*DIVUP(NCCL_NUM_ALGORITHMS,2)+ba;
+        if (a >= NCCL_NUM_ALGORITHMS) continue;
         sprintf(line+strlen(line), " %14s   %14s   %14s |", "", ncclAlgoStr[a], "");
       }
       INFO(NCCL_TUNING, "%s", line);
       sprintf(line, "  Protocol    |");
-      for (int ba=0; ba<NCCL_NUM_ALGORITHMS/2; ba++) {
+      for (int ba=0; ba<DIVUP(NCCL_NUM_ALGORITHMS,2); ba++) {
+        if (block*DIVUP(NCCL_NUM_ALGORITHMS,2)+ba >= NCCL_NUM_ALGORITHMS) continue;
         for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
           sprintf(line+strlen(line), " %14s |", ncclProtoStr[p]);
         }
       }
       INFO(NCCL_TUNING, "%s", line);
       sprintf(line, " Max NThreads |");
-      for (int ba=0; ba<NCCL_NUM_ALGORITHMS/2; ba++) {
-	int a = block*NCCL_NUM_ALGORITHMS/2+ba;
+      for (int ba=0; ba<DIVUP(NCCL_NUM_ALGORITHMS,2); ba++) {
+	int a = block*DIVUP(NCCL_NUM_ALGORITHMS,2)+ba;
+        if (a >= NCCL_NUM_ALGORITHMS) continue;
         for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
           sprintf(line+strlen(line), " %14d |", comm->maxThreads[a][p]);
         }
@@ -578,8 +932,9 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
       INFO(NCCL_TUNING, "%s", line);
       for (int c=0; c<NCCL_NUM_FUNCTIONS; c++) {
         sprintf(line, "%13s |", ncclFuncStr[c]);
-        for (int ba=0; ba<NCCL_NUM_ALGORITHMS/2; ba++) {
-	  int a = block*NCCL_NUM_ALGORITHMS/2+ba;
+        for (int ba=0; ba<DIVUP(NCCL_NUM_ALGORITHMS,2); ba++) {
+	  int a = block*DIVUP(NCCL_NUM_ALGORITHMS,2)+ba;
+          if (a >= NCCL_NUM_ALGORITHMS) continue;
           for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
             sprintf(line+strlen(line), "%8.1f/%6.1f |", comm->latencies[c][a][p], comm->bandwidths[c][a][p]);
           }
@@ -621,9 +976,37 @@ ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCom
       comm->threadThresholds[NCCL_ALGO_RING][NCCL_PROTO_SIMPLE],
       comm->threadThresholds[NCCL_ALGO_COLLNET_DIRECT][NCCL_PROTO_SIMPLE],
       comm->threadThresholds[NCCL_ALGO_COLLNET_CHAIN][NCCL_PROTO_SIMPLE]);
+
+  // Per-channel bandwidth of send/recv, within a node and across nodes, for ncclTopoP2pChannels()
+  comm->p2pBw[0] = graphs[NCCL_ALGO_RING]->bwIntra;
+  comm->p2pBw[1] = nNodes > 1 ? graphs[NCCL_ALGO_RING]->bwInter : graphs[NCCL_ALGO_RING]->bwIntra;
+  NCCLCHECK(setTreeSplit(comm, graphs[NCCL_ALGO_TREE]));
+  if (comm->rank == 0) tuningDumpFile(comm);
   return ncclSuccess;
 }
 
+// Fixed cost of spreading a send/recv over one more channel: another work element for
+// the kernel, another proxy op, and a CTA taken from the other peers of the group.
+RCCL_PARAM(P2pChannelCostNs, "P2P_CHANNEL_COST_NS", 2000);
+RCCL_PARAM(P2pNetChannelCostNs, "P2P_NET_CHANNEL_COST_NS", 5000);
+
+int ncclTopoP2pChannels(struct ncclComm* comm, int peer, size_t bytes, int maxChannels) {
+  // Both sides of a send/recv must agree: everything used here is the same on the peer.
+  int net = comm->rankToNode[peer] != comm->node;
+  float bw = comm->p2pBw[net]; // GB/s, i.e. bytes per ns
+  if (bw <= 0) return maxChannels;
+  double costNs = net ? rcclParamP2pNetChannelCostNs() : rcclParamP2pChannelCostNs();
+  int best = 1;
+  double bestTime = costNs + bytes/bw;
+  for (int n = 2; n <= maxChannels; n *= 2) {
+    double time = n*costNs + bytes/(n*bw);
+    if (time >= bestTime) break;
+    best = n;
+    bestTime = time;
+  }
+  return best;
+}
+
 // Trees are not perfectly sticking to the model for medium sizes. Applying a static correction
 // factor is not ideal but works quite well. Powers of two, 64 B to 256MB.
 static float treeCorrectionFactor[NCCL_NUM_PROTOCOLS][23] = {
@@ -648,6 +1031,11 @@ ncclResult_t ncclTopoGetAlgoTime(struct ncclInfo* info, int algorithm, int proto
   if (bw == 0) {
     *time = -1.0; return ncclSuccess;
   }
+  // The table holds the two-shot cost, small Simple messages run one-shot
+  if (algorithm == NCCL_ALGO_DIRECT && protocol == NCCL_PROTO_SIMPLE && info->nBytes <= info->comm->directOneShotBytes) {
+    bw = info->comm->directOneShotBw;
+    lat = info->comm->directOneShotLat;
+  }
   int logSize = log2i(info->nBytes>>6);
 
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
@@ -18,6 +18,9 @@
 #include "archinfo.h"
 #if defined(__x86_64__)
 #include <cpuid.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #endif
 
 /*******************/
@@ -329,6 +332,7 @@ ncclResult_t ncclTopoGetXmlFromFile(const char* xmlTopoFile, struct ncclXml* xml
   INFO(NCCL_GRAPH, "Loading topology file %s", xmlTopoFile);
   struct xmlHandler handlers[] = { { "system", ncclTopoXmlLoadSystem } };
   xml->maxIndex = 0;
+  xmlResetIndex(xml);
   NCCLCHECK(xmlLoadSub(file, xml, NULL, handlers, 1));
   fclose(file);
   return ncclSuccess;
@@ -344,11 +348,32 @@ ncclResult_t ncclTopoGetXmlFromFile(const char* xmlTopoFile, struct ncclXml* xml
 static void memcpylower(char* dst, const char* src, const size_t size) {
   for (int i=0; i<size; i++) dst[i] = tolower(src[i]);
 }
+
+// Sysfs does not change for the life of the process: the PCI paths and the
+// attributes read from /sys are kept, so that only the first communicator walks
+// it. RCCL_TOPO_CACHE=0 reads it again for every communicator, along with the
+// rocm_smi queries cached in rocm_smi_wrap.cc.
+RCCL_PARAM(TopoCache, "TOPO_CACHE", 1);
+static std::mutex sysCacheMutex;
+static std::unordered_map<std::string, std::string> sysPathCache;
+static std::unordered_map<std::string, std::string> sysStrCache;
+
 static ncclResult_t getPciPath(const char* busId, char** path) {
   char busPath[] = "/sys/class/pci_bus/0000:00/../../0000:00:00.0";
   memcpylower(busPath+sizeof("/sys/class/pci_bus/")-1, busId, BUSID_REDUCED_SIZE-1);
   memcpylower(busPath+sizeof("/sys/class/pci_bus/0000:00/../../")-1, busId, BUSID_SIZE-1);
-  *path = realpath(busPath, NULL);
+  if (rcclParamTopoCache()) {
+    std::lock_guard<std::mutex> lock(sysCacheMutex);
+    auto it = sysPathCache.find(busPath);
+    if (it != sysPathCache.end()) {
+      *path = it->second.empty() ? NULL : strdup(it->second.c_str());
+    } else {
+      *path = realpath(busPath, NULL);
+      sysPathCache[busPath] = *path ? *path : "";
+    }
+  } else {
+    *path = realpath(busPath, NULL);
+  }
   if (*path == NULL) {
     WARN("Could not find real path of %s", busPath);
     return ncclSystemError;
@@ -359,6 +384,15 @@ static ncclResult_t getPciPath(const char* busId, char** path) {
 ncclResult_t ncclTopoGetStrFromSys(const char* path, const char* fileName, char* strValue) {
   char filePath[PATH_MAX];
   sprintf(filePath, "%s/%s", path, fileName);
+  bool cache = rcclParamTopoCache() && strncmp(filePath, "/sys/", 5) == 0;
+  if (cache) {
+    std::lock_guard<std::mutex> lock(sysCacheMutex);
+    auto it = sysStrCache.find(filePath);
+    if (it != sysStrCache.end()) {
+      strcpy(strValue, it->second.c_str());
+      return ncclSuccess;
+    }
+  }
   int offset = 0;
   FILE* file;
   if ((file = fopen(filePath, "r")) != NULL) {
@@ -374,6 +408,10 @@ ncclResult_t ncclTopoGetStrFromSys(const char* path, const char* fileName, char*
   } else {
     strValue[offset-1] = '\0';
   }
+  if (cache) {
+    std::lock_guard<std::mutex> lock(sysCacheMutex);
+    sysStrCache[filePath] = strValue;
+  }
   return ncclSuccess;
 }
 
@@ -460,8 +498,61 @@ ncclResult_t ncclTopoGetXmlFromCpu(struct ncclXmlNode* cpuNode, struct ncclXml*
   return ncclSuccess;
 }
 
+static uint32_t xmlPciHash(const char* busId) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (const char* c = busId; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u;
+  return h & (XML_PCI_INDEX_SIZE-1);
+}
+
+static bool xmlPciMatch(struct ncclXmlNode* node, const char* busId) {
+  const char* str;
+  if (node->type == NODE_TYPE_NONE || strcmp(node->name, "pci") != 0) return false;
+  if (xmlGetAttr(node, "busid", &str) != ncclSuccess || str == NULL) return false;
+  return strcmp(str, busId) == 0;
+}
+
+void xmlResetIndex(struct ncclXml* xml) {
+  memset(xml->pciIndex, 0, sizeof(xml->pciIndex));
+  xml->pciIndexed = 0;
+  xml->pciUnindexed = 0;
+}
+
+static void xmlIndexPci(struct ncclXml* xml, int index) {
+  struct ncclXmlNode* node = xml->nodes+index;
+  const char* busId;
+  if (strcmp(node->name, "pci") != 0) return;
+  if (xmlGetAttr(node, "busid", &busId) != ncclSuccess || busId == NULL) {
+    xml->pciUnindexed++;
+    return;
+  }
+  // A removed node with the same busid gives its slot to the new one
+  uint32_t slot = xmlPciHash(busId);
+  while (xml->pciIndex[slot] && !xmlPciMatch(xml->nodes+xml->pciIndex[slot]-1, busId) &&
+         xml->nodes[xml->pciIndex[slot]-1].type != NODE_TYPE_NONE) {
+    slot = (slot+1) & (XML_PCI_INDEX_SIZE-1);
+  }
+  xml->pciIndex[slot] = index+1;
+}
+
+ncclResult_t xmlFindPci(struct ncclXml* xml, const char* busId, struct ncclXmlNode** node) {
+  *node = NULL;
+  if (xml->pciIndexed > xml->maxIndex) xmlResetIndex(xml);
+  for (; xml->pciIndexed < xml->maxIndex; xml->pciIndexed++) xmlIndexPci(xml, xml->pciIndexed);
+  for (uint32_t slot = xmlPciHash(busId); xml->pciIndex[slot]; slot = (slot+1) & (XML_PCI_INDEX_SIZE-1)) {
+    struct ncclXmlNode* n = xml->nodes+xml->pciIndex[slot]-1;
+    if (xmlPciMatch(n, busId)) {
+      *node = n;
+      return ncclSuccess;
+    }
+  }
+  // Nodes that got their busid after being indexed can only be found by a scan
+  if (xml->pciUnindexed) NCCLCHECK(xmlFindTagKv(xml, "pci", node, "busid", busId));
+  return ncclSuccess;
+}
+
 ncclResult_t ncclTopoGetPciNode(struct ncclXml* xml, const char* busId, struct ncclXmlNode** pciNode) {
-  NCCLCHECK(xmlFindTagKv(xml, "pci", pciNode, "busid", busId));
+  NCCLCHECK(xmlFindPci(xml, busId, pciNode));
   if (*pciNode == NULL) {
     NCCLCHECK(xmlAddNode(xml, NULL, "pci", pciNode));
     NCCLCHECK(xmlSetAttr(*pciNode, "busid", busId));
@@ -581,7 +672,7 @@ ncclResult_t ncclTopoGetXmlFromSys(struct ncclXmlNode* pciNode, struct ncclXml*
             // Continue on the upper PCI switch
             for (int i = strlen(path)-1; i>0; i--) {
               if (path[i] == '/') {
-                NCCLCHECK(xmlFindTagKv(xml, "pci", &parent, "busid", path+i+1));
+                NCCLCHECK(xmlFindPci(xml, path+i+1, &parent));
                 if (parent == NULL) {
                   NCCLCHECK(xmlAddNode(xml, NULL, "pci", &parent));
                   NCCLCHECK(xmlSetAttr(parent, "busid", path+i+1));
@@ -847,11 +938,8 @@ ncclResult_t ncclTopoFillGpu(struct ncclXml* xml, const char* busId, struct nccl
   NCCLCHECK(ncclTopoGetXmlFromSys(node, xml));
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
   uint32_t devIndex = 0;
-  static int rocmsmiInit = 0;
-  if (rocmsmiInit == 0) {
-    rocmsmiInit = (rocm_smi_init() != ncclSuccess) ? 2 : 1;
-  }
-  if (rocmsmiInit == 1) {
+  // Initialized once per process, see rocm_smi_wrap.cc
+  if (rocm_smi_init() == ncclSuccess) {
     if (rocm_smi_getDeviceIndexByPciBusId(busId, &devIndex) != ncclSuccess) devIndex = -1;
   }
   NCCLCHECK(ncclTopoGetXmlFromGpu(node, devIndex, xml, gpuNode));
@@ -944,6 +1032,28 @@ ncclResult_t ncclTopoTrimXml(struct ncclXml* xml) {
   return ncclSuccess;
 }
 
+static uint64_t xmlHashStr(uint64_t hash, const char* str) {
+  // DJB2a, continued from the previous hash value
+  for (; *str; str++) hash = ((hash << 5) + hash) ^ *str;
+  return ((hash << 5) + hash) ^ '\0';
+}
+
+static void ncclTopoGetXmlHashRec(struct ncclXmlNode* node, uint64_t* hash) {
+  *hash = xmlHashStr(*hash, node->name);
+  for (int a=0; a<node->nAttrs; a++) {
+    *hash = xmlHashStr(*hash, node->attrs[a].key);
+    *hash = xmlHashStr(*hash, node->attrs[a].value);
+  }
+  for (int s=0; s<node->nSubs; s++) ncclTopoGetXmlHashRec(node->subs[s], hash);
+  *hash = xmlHashStr(*hash, "/");
+}
+
+ncclResult_t ncclTopoGetXmlHash(struct ncclXml* xml, uint64_t* hash) {
+  *hash = 5381;
+  if (xml->maxIndex > 0 && xml->nodes[0].type != NODE_TYPE_NONE) ncclTopoGetXmlHashRec(xml->nodes, hash);
+  return ncclSuccess;
+}
+
 /**************************************************/
 /* Parser rules for the user-defined graph search */
 /**************************************************/
@@ -38,9 +38,16 @@ struct ncclXmlNode {
   int nSubs;
 };
 
+// Open addressing table of "pci" nodes by busid, larger than MAX_NODES so it never fills
+#define XML_PCI_INDEX_SIZE 2048
+
 struct ncclXml {
   struct ncclXmlNode nodes[MAX_NODES];
   int maxIndex;
+  // Index used by xmlFindPci(), filled lazily from the nodes added since the last lookup
+  int pciIndex[XML_PCI_INDEX_SIZE]; // node index + 1, 0 when empty
+  int pciIndexed;                   // nodes below this one are in pciIndex
+  int pciUnindexed;                 // "pci" nodes that had no busid when they were indexed
 };
 
 /* File functions */
@@ -50,6 +57,10 @@ ncclResult_t ncclTopoDumpXmlToFile(const char* xmlTopoFile, struct ncclXml* xml)
 #define NCCL_GRAPH_XML_VERSION 1
 ncclResult_t ncclTopoGetXmlGraphFromFile(const char* xmlGraphFile, struct ncclXml* xml);
 
+/* Lookup of a "pci" node by busid, in constant time instead of a scan of all nodes */
+ncclResult_t xmlFindPci(struct ncclXml* xml, const char* busId, struct ncclXmlNode** node);
+void xmlResetIndex(struct ncclXml* xml);
+
 /* Auto-detect functions */
 ncclResult_t ncclTopoFillGpu(struct ncclXml* xml, const char* busId, struct ncclXmlNode** gpuNode);
 ncclResult_t ncclTopoFillNet(struct ncclXml* xml, const char* pciPath, const char* netName, struct ncclXmlNode** netNode);
@@ -57,6 +68,9 @@ ncclResult_t ncclTopoFillNet(struct ncclXml* xml, const char* pciPath, const cha
 /* Remove unneeded parts */
 ncclResult_t ncclTopoTrimXml(struct ncclXml* xml);
 
+/* Hash of the whole XML tree (names, attributes and structure) */
+ncclResult_t ncclTopoGetXmlHash(struct ncclXml* xml, uint64_t* hash);
+
 ncclResult_t ncclTopoGetStrFromSys(const char* path, const char* fileName, char* strValue);
 
 /**************/
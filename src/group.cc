@@ -11,6 +11,7 @@
 #include "enqueue.h"
 #include "transport.h"
 #include "channel.h"
+#include "hostcoll.h"
 #include <assert.h>
 
 #include "msccl/msccl_lifecycle.h"
@@ -27,6 +28,50 @@ __thread bool ncclGroupJobAbortFlag = false;
 
 void* ncclAsyncJobMain(void* arg);
 
+static pthread_mutex_t ncclAsyncExecutorLock = PTHREAD_MUTEX_INITIALIZER;
+static ncclAsyncExecutor_t ncclAsyncExecutor = NULL;
+static void* ncclAsyncExecutorData = NULL;
+
+NCCL_API(ncclResult_t, ncclSetAsyncExecutor, ncclAsyncExecutor_t executor, void* userData);
+ncclResult_t ncclSetAsyncExecutor(ncclAsyncExecutor_t executor, void* userData) {
+  pthread_mutex_lock(&ncclAsyncExecutorLock);
+  ncclAsyncExecutor = executor;
+  ncclAsyncExecutorData = userData;
+  pthread_mutex_unlock(&ncclAsyncExecutorLock);
+  INFO(NCCL_INIT, "Async jobs run on %s", executor ? "the user executor" : "their own thread");
+  return ncclSuccess;
+}
+
+static void ncclAsyncJobTask(void* arg) {
+  ncclAsyncJobMain(arg);
+}
+
+// Starts a job of a group on the user executor, or on a new thread without one
+static ncclResult_t ncclAsyncJobStart(struct ncclAsyncJob* job) {
+  pthread_mutex_lock(&ncclAsyncExecutorLock);
+  ncclAsyncExecutor_t executor = ncclAsyncExecutor;
+  void* userData = ncclAsyncExecutorData;
+  pthread_mutex_unlock(&ncclAsyncExecutorLock);
+  job->external = executor != NULL;
+  if (job->external) {
+    executor(ncclAsyncJobTask, job, userData);
+  } else {
+    SYSCHECK(pthread_create(&job->thread, nullptr, ncclAsyncJobMain, job), "pthread_create");
+  }
+  return ncclSuccess;
+}
+
+// Waits for a job started by ncclAsyncJobStart to return
+static ncclResult_t ncclAsyncJobJoin(struct ncclAsyncJob* job) {
+  if (job->external) {
+    // The task no longer touches the job once it is done
+    while (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) == ncclGroupJobRunning) usleep(1);
+  } else {
+    SYSCHECK(pthread_join(job->thread, nullptr), "pthread_join");
+  }
+  return ncclSuccess;
+}
+
 ncclResult_t ncclAsyncLaunch(
     struct ncclAsyncJob* job,
     ncclResult_t(*func)(struct ncclAsyncJob*),
@@ -73,7 +118,7 @@ void* ncclAsyncJobMain(void* arg) {
 
 ncclResult_t ncclAsyncJobComplete(struct ncclAsyncJob* job) {
   ncclResult_t ret;
-  SYSCHECK(pthread_join(job->thread, NULL), "pthread_join");
+  NCCLCHECK(ncclAsyncJobJoin(job));
   if (job->result != ncclSuccess) {
     WARN("ncclAsyncJobComplete: job %p failed, job error %d", job, job->result);
   }
@@ -119,11 +164,110 @@ ncclResult_t ncclPreconnectFunc(struct ncclAsyncJob* job_) {
   struct ncclComm* comm = job->comm;
   CUDACHECK(cudaSetDevice(comm->cudaDev));
   if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  if (comm->collConnectRequested) NCCLCHECK(ncclTransportCollConnect(comm));
+  if (comm->hostCollRequested && comm->hostColl == NULL) NCCLCHECK(ncclHostCollSetup(comm));
   NCCLCHECK(ncclTransportP2pSetup(comm, NULL, 1));
   if (comm->p2pNet) NCCLCHECK(ncclTransportP2pSetup(comm, NULL, NCCL_CONN_IDX_P2P_NET));
   return ncclSuccess;
 }
 
+// When a group covers several comms of one clique, e.g. the devices driven by a
+// single thread, the plans of all but the first comm are built concurrently on
+// a worker thread of each comm. Launches stay in order on the calling thread.
+RCCL_PARAM(ParallelPrepare, "PARALLEL_PREPARE", 1);
+
+enum ncclPrepareWorkerState { ncclPrepareIdle = 0, ncclPrepareRunning = 1, ncclPrepareExit = 2 };
+
+struct ncclPrepareWorker {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct ncclComm* comm;
+  int state;
+  ncclResult_t result;
+};
+
+static void* ncclPrepareWorkerMain(void* arg) {
+  struct ncclPrepareWorker* w = (struct ncclPrepareWorker*)arg;
+  struct ncclComm* comm = w->comm;
+  if (cudaSetDevice(comm->cudaDev) != cudaSuccess) w->result = ncclUnhandledCudaError;
+  if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  pthread_mutex_lock(&w->mutex);
+  while (true) {
+    while (w->state == ncclPrepareIdle) pthread_cond_wait(&w->cond, &w->mutex);
+    if (w->state == ncclPrepareExit) break;
+    pthread_mutex_unlock(&w->mutex);
+    if (w->result == ncclSuccess) {
+      uint64_t hostStart = ncclStatsHostStart();
+      w->result = ncclLaunchPrepare(comm);
+      ncclStatsHostEnd(&comm->stats, ncclStatsHostPlan, hostStart);
+    }
+    pthread_mutex_lock(&w->mutex);
+    __atomic_store_n(&w->state, ncclPrepareIdle, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
+
+static ncclResult_t ncclPrepareWorkerStart(struct ncclComm* comm) {
+  struct ncclPrepareWorker* w = comm->prepareWorker;
+  if (w == NULL) {
+    NCCLCHECK(ncclCalloc(&w, 1));
+    w->comm = comm;
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, ncclPrepareWorkerMain, w) != 0) {
+      WARN("Failed to create the plan preparation thread of comm %p", comm);
+      free(w);
+      return ncclSystemError;
+    }
+    ncclSetThreadName(w->thread, "NCCL Prep%2d", comm->cudaDev);
+    comm->prepareWorker = w;
+  }
+  pthread_mutex_lock(&w->mutex);
+  w->state = ncclPrepareRunning;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+  return ncclSuccess;
+}
+
+// The other comms of the clique finish preparing within a few microseconds of
+// this thread, so their workers are polled rather than waited for.
+static ncclResult_t ncclPrepareWorkerWait(struct ncclComm* comm) {
+  struct ncclPrepareWorker* w = comm->prepareWorker;
+  while (__atomic_load_n(&w->state, __ATOMIC_ACQUIRE) != ncclPrepareIdle) sched_yield();
+  return w->result;
+}
+
+ncclResult_t ncclPrepareWorkerFree(struct ncclComm* comm) {
+  struct ncclPrepareWorker* w = comm->prepareWorker;
+  if (w == NULL) return ncclSuccess;
+  pthread_mutex_lock(&w->mutex);
+  w->state = ncclPrepareExit;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+  pthread_join(w->thread, NULL);
+  pthread_mutex_destroy(&w->mutex);
+  pthread_cond_destroy(&w->cond);
+  free(w);
+  comm->prepareWorker = NULL;
+  return ncclSuccess;
+}
+
+// Comms of a clique can be prepared concurrently unless they are captured, as
+// capture modes are per thread, or share the streams of their resources.
+static bool prepareInParallel(struct ncclComm* head) {
+  if (!rcclParamParallelPrepare()) return false;
+  if (head->groupNext == nullptr || head->groupNext->intraComm0 != head->intraComm0) return false;
+  for (struct ncclComm* c = head; c != nullptr && c->intraComm0 == head->intraComm0; c = c->groupNext) {
+    if (ncclCudaGraphValid(c->tasks.capturingGraph)) return false;
+    for (struct ncclComm* d = head; d != c; d = d->groupNext) {
+      if (d->sharedRes == c->sharedRes) return false;
+    }
+  }
+  return true;
+}
+
 static ncclResult_t doLaunches(struct ncclComm* head) {
   ncclResult_t result = ncclSuccess;
   struct ncclComm* cliqueComm0 = head->intraComm0;
@@ -136,10 +280,37 @@ static ncclResult_t doLaunches(struct ncclComm* head) {
   do {
     struct ncclComm* comm = cliqueHead;
     bool capturingYes = false, capturingNo = false;
+    bool parallel = prepareInParallel(cliqueHead);
+    if (parallel) {
+      for (comm = cliqueHead->groupNext; comm != nullptr && comm->intraComm0 == cliqueComm0; comm = comm->groupNext) {
+        ncclResult_t ret = ncclPrepareWorkerStart(comm);
+        if (ret != ncclSuccess) {
+          for (struct ncclComm* c = cliqueHead->groupNext; c != comm; c = c->groupNext) (void)ncclPrepareWorkerWait(c);
+          result = ret;
+          goto failure;
+        }
+      }
+      comm = cliqueHead;
+    }
     do {
       (ncclCudaGraphValid(comm->tasks.capturingGraph) ? capturingYes : capturingNo) = true;
-      CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), result, failure);
-      NCCLCHECKGOTO(ncclLaunchPrepare(comm), result, failure);
+      ncclResult_t ret = ncclSuccess;
+      if (parallel && comm != cliqueHead) {
+        ret = ncclPrepareWorkerWait(comm);
+      } else {
+        uint64_t hostStart = ncclStatsHostStart();
+        if (cudaSetDevice(comm->cudaDev) != cudaSuccess) ret = ncclUnhandledCudaError;
+        if (ret == ncclSuccess) ret = ncclLaunchPrepare(comm);
+        ncclStatsHostEnd(&comm->stats, ncclStatsHostPlan, hostStart);
+      }
+      if (ret != ncclSuccess) {
+        // Workers must be done with their comms before the group is cleaned up
+        if (parallel) {
+          for (struct ncclComm* c = comm->groupNext; c != nullptr && c->intraComm0 == cliqueComm0; c = c->groupNext) (void)ncclPrepareWorkerWait(c);
+        }
+        result = ret;
+        goto failure;
+      }
       if (useBarrier) ncclCommIntraBarrierIn(comm, 1);
       comm = comm->groupNext;
     } while (comm != nullptr && comm->intraComm0 == cliqueComm0);
@@ -171,17 +342,26 @@ static ncclResult_t doLaunches(struct ncclComm* head) {
           if (plan != nullptr) {
             comm->unlaunchedPlansHead = plan->next;
             CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), result, failure);
+            uint64_t hostStart = ncclStatsHostStart();
             NCCLCHECKGOTO(ncclLaunchKernelBefore_NoUncapturedCuda(comm, plan), result, failure);
+            ncclStatsHostEnd(&comm->stats, ncclStatsHostUpload, hostStart);
+            hostStart = ncclStatsHostStart();
             NCCLCHECKGOTO(ncclLaunchKernel(comm, plan), result, failure);
+            ncclStatsHostEnd(&comm->stats, ncclStatsHostLaunch, hostStart);
+            if (hostStart) ncclStatsAdd(&comm->stats.hostLaunches, 1);
           }
           // Barrier reduction input indicates if we require further rounds.
           if (useBarrier) ncclCommIntraBarrierIn(comm, comm->unlaunchedPlansHead != nullptr ? 1 : 0);
           if (plan != nullptr) {
+            uint64_t hostStart = ncclStatsHostStart();
             NCCLCHECKGOTO(ncclLaunchKernelAfter_NoCuda(comm, plan), result, failure);
+            ncclStatsHostEnd(&comm->stats, ncclStatsHostLaunch, hostStart);
           }
         } else { // Final round.
           CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), result, failure);
+          uint64_t hostStart = ncclStatsHostStart();
           NCCLCHECKGOTO(ncclLaunchFinish(comm), result, failure);
+          ncclStatsHostEnd(&comm->stats, ncclStatsHostLaunch, hostStart);
         }
         comm = next;
       } while (comm != cliqueNextHead);
@@ -225,6 +405,8 @@ static void groupCleanup(struct ncclComm** groupCommHeadPtr, struct ncclComm** g
     for (int i = 0; i < comm->nRanks; i++) {
       comm->tasks.peers[i].sendSeen = false;
       comm->tasks.peers[i].recvSeen = false;
+      comm->tasks.peers[i].sendHeavySeen = false;
+      comm->tasks.peers[i].recvHeavySeen = false;
       for (int j = 0; j < MAXCHANNELS/64; j++) {
       	comm->connectSend[i].masks[j] = 0UL;
       	comm->connectRecv[i].masks[j] = 0UL;
@@ -310,7 +492,7 @@ static ncclResult_t groupLaunch(struct ncclAsyncJob *job_) {
   if (!ncclIntruQueueEmpty(asyncJobsMain)) {
     struct ncclAsyncJob* job = ncclIntruQueueHead(asyncJobsMain);
     do {
-      SYSCHECKGOTO(pthread_create(&job->thread, nullptr, ncclAsyncJobMain, job), ret, fail);
+      NCCLCHECKGOTO(ncclAsyncJobStart(job), ret, fail);
       job = job->next;
     } while (job != nullptr);
 
@@ -322,10 +504,7 @@ static ncclResult_t groupLaunch(struct ncclAsyncJob *job_) {
         if (state == ncclGroupJobRunning) {
           jobsDone = false;
         } else if (state == ncclGroupJobDone) {
-          if (pthread_join(job->thread, nullptr) != 0) {
-            WARN("Error waiting for pthread_join : %s", strerror(errno));
-            ret = ncclSystemError;
-          }
+          if (ncclAsyncJobJoin(job) != ncclSuccess) ret = ncclSystemError;
           job->state = ncclGroupJobJoined;
           if (job->result != ncclSuccess && ret == ncclSuccess) {
             ret = job->result;
@@ -21,8 +21,9 @@
 
 uint64_t clockNano(); // from utils.h with which we have a circular dependency
 
+// flags are cudaHostAlloc flags, ignored when host memory is device managed.
 template <typename T>
-ncclResult_t ncclCudaHostCallocDebug(T** ptr, size_t nelem, const char *filefunc, int line) {
+ncclResult_t ncclCudaHostCallocFlagsDebug(T** ptr, size_t nelem, unsigned int flags, const char *filefunc, int line) {
   ncclResult_t result = ncclSuccess;
   cudaStreamCaptureMode mode = cudaStreamCaptureModeRelaxed;
   *ptr = nullptr;
@@ -36,7 +37,7 @@ ncclResult_t ncclCudaHostCallocDebug(T** ptr, size_t nelem, const char *filefunc
     CUDACHECKGOTO(hipExtMallocWithFlags((void**)ptr, nelem*sizeof(T), hipDeviceMallocFinegrained), result, finish);
 #endif
   } else
-    CUDACHECKGOTO(hipHostMalloc(ptr, nelem*sizeof(T), cudaHostAllocMapped), result, finish);
+    CUDACHECKGOTO(hipHostMalloc(ptr, nelem*sizeof(T), flags), result, finish);
   memset(*ptr, 0, nelem*sizeof(T));
 finish:
   CUDACHECK(cudaThreadExchangeStreamCaptureMode(&mode));
@@ -44,6 +45,12 @@ finish:
   INFO(NCCL_ALLOC, "%s:%d Cuda Host Alloc Size %ld pointer %p", filefunc, line, nelem*sizeof(T), *ptr);
   return result;
 }
+#define ncclCudaHostCallocFlags(...) ncclCudaHostCallocFlagsDebug(__VA_ARGS__, __FILE__, __LINE__)
+
+template <typename T>
+ncclResult_t ncclCudaHostCallocDebug(T** ptr, size_t nelem, const char *filefunc, int line) {
+  return ncclCudaHostCallocFlagsDebug(ptr, nelem, cudaHostAllocMapped, filefunc, line);
+}
 #define ncclCudaHostCalloc(...) ncclCudaHostCallocDebug(__VA_ARGS__, __FILE__, __LINE__)
 
 inline ncclResult_t ncclCudaHostFree(void* ptr) {
@@ -97,6 +104,38 @@ static_assert(sizeof(struct allocationTracker) == 64, "allocationTracker must be
 #define MAX_ALLOC_TRACK_NGPU 32
 extern struct allocationTracker allocTracker[];
 
+// Memory allocated on behalf of a communicator, returned by ncclCommGetMemoryInfo.
+// The allocators above do not know which communicator they allocate for, so the
+// callers account what they allocate: into comm->memStats from the main thread,
+// into proxyState->memStats for the buffers the proxy allocates, which are shared
+// by the communicators split from the same parent.
+enum ncclMemCategory {
+  ncclMemChannels = 0,     // Device comm, channels, peers and ring ranks
+  ncclMemConnBuffers = 1,  // Transport buffers, also accounted per transport
+  ncclMemWorkFifo = 2,
+  ncclMemMsccl = 3,        // MSCCL scratch buffers and work fifo
+  ncclMemProxy = 4,        // Proxy staging buffers and shared memory for CE copies
+  ncclMemRegistered = 5,   // User buffers registered with the network or IPC
+  ncclMemOther = 6
+};
+static_assert(ncclMemOther+1 == NCCL_MEM_NUM_CATEGORIES, "ncclCommMemoryInfo_t must cover all categories");
+
+struct ncclMemStats {
+  uint64_t deviceBytes[NCCL_MEM_NUM_CATEGORIES];
+  uint64_t hostBytes[NCCL_MEM_NUM_CATEGORIES];
+  uint64_t connDeviceBytes[NCCL_MEM_NUM_TRANSPORTS];
+  uint64_t connHostBytes[NCCL_MEM_NUM_TRANSPORTS];
+};
+
+// bytes is negative when memory is released before the communicator is freed
+static inline void ncclMemStatsAdd(struct ncclMemStats* stats, enum ncclMemCategory category, bool host, int64_t bytes) {
+  __atomic_fetch_add((host ? stats->hostBytes : stats->deviceBytes) + category, (uint64_t)bytes, __ATOMIC_RELAXED);
+}
+static inline void ncclMemStatsAddConn(struct ncclMemStats* stats, int transport, bool host, int64_t bytes) {
+  ncclMemStatsAdd(stats, ncclMemConnBuffers, host, bytes);
+  __atomic_fetch_add((host ? stats->connHostBytes : stats->connDeviceBytes) + transport, (uint64_t)bytes, __ATOMIC_RELAXED);
+}
+
 #if CUDART_VERSION >= 11030
 
 #include <cuda.h>
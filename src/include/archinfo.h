@@ -36,4 +36,12 @@ int GetGcnArchName(int deviceId, char* out);
 double GetDeviceWallClockRateInKhz(int deviceId);
 bool IsArchMatch(char const* arch, char const* target);
 
+// Device memory types of P2P connection buffers
+#define ARCH_MEM_FINEGRAINED 0
+#define ARCH_MEM_UNCACHED 1
+#define ARCH_MEM_COARSEGRAINED 2
+// Default memory type for the flag-polled LL/LL128 FIFOs (simple false) or the
+// Simple protocol buffers (simple true) on arch
+int GetP2pBuffMemType(char const* arch, bool simple);
+
 #endif // ARCHINFO_H
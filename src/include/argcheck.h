@@ -13,5 +13,8 @@
 ncclResult_t PtrCheck(void* ptr, const char* opname, const char* ptrname);
 ncclResult_t ArgsCheck(struct ncclInfo* info);
 ncclResult_t CudaPtrCheck(const void* pointer, struct ncclComm* comm, const char* ptrname, const char* opname);
+// Device memory range cache used by CudaPtrCheck (RCCL_PTR_CACHE)
+ncclResult_t ncclPtrCacheInsert(const void* base, size_t size, int dev);
+void ncclPtrCacheRemove(const void* ptr);
 
 #endif
@@ -0,0 +1,80 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_AUTOTUNE_H_
+#define NCCL_AUTOTUNE_H_
+
+#include "nccl.h"
+#include "nccl_common.h"
+
+// Built-in online autotuner, enabled with RCCL_AUTOTUNE=1 when no tuner plugin
+// is loaded. Each (collective, log2 size) bucket first runs every candidate
+// algorithm/protocol/nChannels a few times, in the same order on all ranks.
+// The measured times are then reduced (max over ranks) with a small allreduce
+// issued between user groups, and the fastest candidate is locked in for the
+// rest of the communicator's life. Results can be kept in RCCL_AUTOTUNE_FILE.
+// With RCCL_AUTOTUNE_KERNELS=1 (the default) the candidates also cover the
+// two compiled unroll variants of the kernels and a half-size block for Ring
+// Simple, so that the fastest kernel variant is found per size bucket too.
+
+#define NCCL_AUTOTUNE_BUCKETS 48
+#define NCCL_AUTOTUNE_MAX_CANDIDATES 64
+
+struct ncclAutotuneCandidate {
+  int algorithm;
+  int protocol;
+  int nChannels; // 0 lets NCCL pick
+  int kernelUnroll; // -1 for the communicator's variant
+  int nThreads; // 0 lets NCCL pick
+};
+
+struct ncclAutotuneBucket {
+  int state;
+  int nCandidates;
+  struct ncclAutotuneCandidate candidates[NCCL_AUTOTUNE_MAX_CANDIDATES];
+  double sumUs[NCCL_AUTOTUNE_MAX_CANDIDATES];
+  int nSamples[NCCL_AUTOTUNE_MAX_CANDIDATES];
+  uint64_t calls;
+  int choice; // locked candidate, -1 for NCCL's default
+  struct ncclAutotuneBucket* next; // exchange queue
+};
+
+struct ncclAutotune {
+  struct ncclAutotuneBucket buckets[NCCL_NUM_FUNCTIONS][NCCL_AUTOTUNE_BUCKETS];
+  // Choices loaded from RCCL_AUTOTUNE_FILE, nChannels is -1 when absent
+  struct ncclAutotuneCandidate loaded[NCCL_NUM_FUNCTIONS][NCCL_AUTOTUNE_BUCKETS];
+  // Buckets done exploring, exchanged one at a time in this order
+  struct ncclAutotuneBucket* exchangeHead;
+  struct ncclAutotuneBucket* exchangeTail;
+  struct ncclAutotuneBucket* exchanging;
+  float* hostTimes;
+  float* devTimes;
+  hipEvent_t exchangeEvent;
+  bool internal; // set while the exchange allreduce is enqueued
+};
+
+struct ncclComm;
+struct ncclInfo;
+
+// True when both unroll variants of the kernels may be launched, so they must
+// all be initialized.
+bool ncclAutotuneKernelVariants();
+ncclResult_t ncclAutotuneInit(struct ncclComm* comm);
+// Writes locked choices to RCCL_AUTOTUNE_FILE and frees the autotuner.
+ncclResult_t ncclAutotuneFree(struct ncclComm* comm);
+
+// Picks algorithm/protocol/nChannels and the kernel variant for a collective from
+// the cost table of the default model. Leaves collInfo untouched when the default
+// should be used.
+// *sample is set to 1 + the candidate index when the launch must be timed, 0 otherwise.
+ncclResult_t ncclAutotuneGetCollInfo(struct ncclComm* comm, struct ncclInfo* collInfo,
+    float table[][NCCL_NUM_PROTOCOLS], int* nChannels, int* sample);
+// Measured time of a timed candidate.
+ncclResult_t ncclAutotuneReport(struct ncclComm* comm, ncclFunc_t coll, size_t nBytes, int candidate, float timeUs);
+// Called between user groups to exchange measurements and lock buckets in.
+ncclResult_t ncclAutotuneProgress(struct ncclComm* comm, hipStream_t stream);
+
+#endif
@@ -19,7 +19,15 @@ static_assert(sizeof(struct ncclBootstrapHandle) <= sizeof(ncclUniqueId), "Boots
 ncclResult_t bootstrapNetInit();
 ncclResult_t bootstrapCreateRoot(struct ncclBootstrapHandle* handle, bool idFromEnv);
 ncclResult_t bootstrapGetUniqueId(struct ncclBootstrapHandle* handle);
-ncclResult_t bootstrapInit(struct ncclBootstrapHandle* handle, struct ncclComm* comm);
+// handles holds one handle per bootstrap root (nHandles > 1 for ncclCommInitRankScalable)
+ncclResult_t bootstrapInit(int nHandles, struct ncclBootstrapHandle* handles, struct ncclComm* comm);
+// In-process bootstrap for communicators whose ranks are all created by this process
+// (ncclCommInitAll). The ranks allgather through memory instead of a root and a ring of
+// sockets; point-to-point messages still use sockets.
+struct ncclBootstrapShared;
+ncclResult_t bootstrapSharedCreate(int nranks, struct ncclBootstrapShared** shared);
+ncclResult_t bootstrapSharedRelease(struct ncclBootstrapShared* shared);
+ncclResult_t bootstrapInitShared(struct ncclBootstrapShared* shared, uint64_t magic, struct ncclComm* comm);
 ncclResult_t bootstrapSplit(struct ncclBootstrapHandle* handle, struct ncclComm* comm, struct ncclComm* parent, int color, int key, int* parentRanks);
 ncclResult_t bootstrapAllGather(void* commState, void* allData, int size);
 ncclResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size);
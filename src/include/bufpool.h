@@ -0,0 +1,38 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_BUFPOOL_H_
+#define NCCL_BUFPOOL_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Process-wide pool of connection buffers backed by the HIP virtual memory API,
+// enabled with RCCL_BUFFER_POOL=1. Each buffer keeps its virtual address for
+// the life of the connection, but the physical memory behind its data part
+// comes from a per-device pool. ncclCommSuspend() unmaps that memory and gives
+// it back to the pool, where communicators that are in use can pick it up, and
+// ncclCommResume() maps memory back before the communicator runs again. The
+// first granule holds the connection head/tail and is never unmapped.
+//
+// Only buffers that never leave the process are pooled: an IPC importer or a
+// NIC registration would keep using the physical pages the buffer had when it
+// was shared.
+
+// Whether connection buffers of this device can come from the pool
+bool ncclBufPoolEnabled(int cudaDev);
+// Allocates a zeroed buffer of size bytes on the current device on behalf of owner
+// (the proxy state that serves the connection). The first headerSize bytes are
+// private to the buffer; the rest may be released while the owner is suspended.
+ncclResult_t ncclBufPoolAlloc(void** ptr, size_t size, size_t headerSize, void* owner);
+// Whether ptr was returned by ncclBufPoolAlloc
+bool ncclBufPoolOwns(void* ptr);
+ncclResult_t ncclBufPoolFree(void* ptr);
+// Releases, or maps back, the data memory of every buffer allocated for owner
+ncclResult_t ncclBufPoolSuspend(void* owner);
+ncclResult_t ncclBufPoolResume(void* owner);
+
+#endif
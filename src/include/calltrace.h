@@ -0,0 +1,72 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_CALLTRACE_H_
+#define NCCL_CALLTRACE_H_
+
+#include "nccl.h"
+#include <stdint.h>
+
+// Binary capture of the calls going through ncclEnqueueCheck, for
+// tools/rccl_replayer. Enabled with RCCL_CALL_TRACE=<prefix>: every
+// communicator writes <prefix>.<commHash>.<rank>, a header followed by fixed
+// size records, through a shared mapping so that nothing is lost if the
+// application dies. The replayer keeps its own copy of these structures:
+// bump RCCL_CALL_TRACE_VERSION on any layout change.
+
+#define RCCL_CALL_TRACE_MAGIC "RCCLTRC"
+#define RCCL_CALL_TRACE_VERSION 1
+
+#define RCCL_CALL_TRACE_IN_PLACE 0x1 // sendbuff == recvbuff
+#define RCCL_CALL_TRACE_GROUPED  0x2 // issued between ncclGroupStart and ncclGroupEnd
+
+struct rcclCallTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t commHash;
+  int32_t rank;
+  int32_t nRanks;
+  int32_t cudaDev;
+  int32_t pid;
+  uint64_t nRecords; // updated after each record is complete
+  char hostname[64];
+  uint8_t reserved[16];
+};
+
+struct rcclCallTraceRecord {
+  uint64_t opCount;  // group calls share the opCount of their launch
+  uint64_t count;
+  uint64_t timeNs;   // host CLOCK_MONOTONIC
+  uint64_t stream;
+  int32_t root;      // or peer for Send/Recv
+  int32_t op;
+  uint16_t task;     // index of the task in its group
+  uint8_t func;      // ncclFunc_t
+  uint8_t datatype;
+  uint8_t flags;
+  uint8_t pad[3];
+};
+
+static_assert(sizeof(struct rcclCallTraceHeader) == 128, "Call trace header layout changed");
+static_assert(sizeof(struct rcclCallTraceRecord) == 48, "Call trace record layout changed");
+
+struct ncclCallTrace {
+  int fd;
+  struct rcclCallTraceHeader* header;
+  size_t mapBytes;
+  uint64_t capacity; // records that fit in the mapping
+};
+
+struct ncclComm;
+struct ncclInfo;
+
+ncclResult_t ncclCallTraceInit(struct ncclComm* comm);
+ncclResult_t ncclCallTraceFree(struct ncclComm* comm);
+// Appends info to the communicator's trace, called once per enqueued operation.
+ncclResult_t ncclCallTraceRecord(struct ncclComm* comm, struct ncclInfo* info);
+
+#endif
@@ -0,0 +1,26 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_CHANBUDGET_H_
+#define NCCL_CHANBUDGET_H_
+
+#include "nccl.h"
+
+struct ncclComm;
+
+// Process-wide budget of collective channels (CTAs) per GPU, enabled with
+// RCCL_CHANNEL_BUDGET=<n>. Each communicator is given a share of the budget of
+// its GPU proportional to its config priority among the communicators alive on
+// that GPU when it is created. All ranks must use the same number of channels,
+// so init takes the smallest share of all ranks and applies it as maxCTAs.
+// Communicators created earlier keep their share.
+
+// Registers comm on its device and returns the number of channels this rank
+// can give it, MAXCHANNELS when there is no budget.
+ncclResult_t ncclChannelBudgetRegister(struct ncclComm* comm, int* maxChannels);
+void ncclChannelBudgetUnregister(struct ncclComm* comm);
+
+#endif
@@ -0,0 +1,40 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_CLOCKSYNC_H_
+#define NCCL_CLOCKSYNC_H_
+
+#include "nccl.h"
+#include <stdint.h>
+
+// Correlation of the GPU wall clock (wall_clock64(), used by NPKit and
+// colltrace) with the host CLOCK_MONOTONIC used by the proxy profiler. A
+// sample is taken at init and another one at destroy to measure the drift.
+
+struct ncclClockSample {
+  uint64_t hostNs;   // CLOCK_MONOTONIC, middle of the round trip
+  uint64_t gpuTicks;
+  uint64_t errNs;    // half of the shortest round trip
+};
+
+struct ncclClockSync {
+  int valid;
+  struct ncclClockSample first;
+  struct ncclClockSample last;
+  double ticksPerNs; // nominal until the second sample is taken
+  int64_t realtimeOffsetNs; // CLOCK_REALTIME - CLOCK_MONOTONIC, for NPKit CPU events
+};
+
+struct ncclComm;
+
+// Takes the first sample when a device timeline is recorded (NPKit, colltrace,
+// RCCL_COLL_TIMINGS or NCCL_PROXY_PROFILE); does nothing otherwise.
+ncclResult_t ncclClockSyncInit(struct ncclComm* comm);
+// Takes the second sample and writes clock_sync_rank_<rank> to NPKIT_DUMP_DIR.
+ncclResult_t ncclClockSyncFinalize(struct ncclComm* comm);
+uint64_t ncclClockGpuToHostNs(struct ncclClockSync* sync, uint64_t gpuTicks);
+
+#endif
@@ -0,0 +1,48 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_COLLTIMING_H_
+#define NCCL_COLLTIMING_H_
+
+#include "nccl.h"
+#include "device.h"
+
+// Kernel timestamps returned by ncclCommGetCollTimings (RCCL_COLL_TIMINGS). Each
+// channel has a ring of ncclDevCollTiming in host memory, which thread 0 of its
+// block fills with wall_clock64() around the works of a launch. The device counts
+// the launches of each channel itself and the host counts them the same way when
+// it launches, so a record is matched to its launch by the tag the device writes
+// last. Plans captured in a graph are not timed, their works are not in the fifo.
+struct ncclKernelPlan;
+
+struct ncclCollTimingLaunch {
+  uint64_t seq;
+  int coll;
+  int nColls;
+  int algorithm;
+  int protocol;
+  int nChannels;
+  size_t bytes;
+  struct channelMasks channelMask;
+  uint64_t pos[MAXCHANNELS]; // of the launch in the ring of each channel
+};
+
+struct ncclCollTimings {
+  int nEntries; // power of 2, of every ring
+  struct ncclDevCollTiming* recs; // [MAXCHANNELS][nEntries]
+  uint64_t channelPos[MAXCHANNELS]; // launches counted by the host, per channel
+  struct ncclCollTimingLaunch* launches; // [nEntries]
+  uint64_t head; // launches recorded
+  uint64_t tail; // launches returned or lost
+  double ticksPerNs; // nominal, when clockSync is not valid
+};
+
+// Allocates the rings when RCCL_COLL_TIMINGS is set, from devCommSetup
+ncclResult_t ncclCollTimingsSetup(struct ncclComm* comm, struct ncclDevComm* devComm);
+// Describes a plan about to be launched
+void ncclCollTimingsLaunch(struct ncclComm* comm, struct ncclKernelPlan* plan);
+
+#endif
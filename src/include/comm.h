@@ -16,6 +16,10 @@
 #include "strongstream.h"
 #include "nccl_net.h"
 #include "register.h"
+#include "stats.h"
+#include "clocksync.h"
+#include "straggler.h"
+#include "calltrace.h"
 
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
 #define HIPRT_CB
@@ -49,7 +53,7 @@ struct ncclSendMem {
       void* ptrExchange;
       uint64_t redOpArgExchange[2];
       char pad2[CACHE_LINE_SIZE-sizeof(void*)-2*sizeof(uint64_t)];
-      int offsFifo[NCCL_STEPS];
+      int offsFifo[NCCL_MAX_STEPS];
     };
     char pad3[MEM_ALIGN];
   };
@@ -60,9 +64,9 @@ struct ncclRecvMem {
     struct {
       uint64_t tail;
       char pad1[CACHE_LINE_SIZE-sizeof(uint64_t)];
-      struct ncclConnFifo connFifo[NCCL_STEPS];
-      int sizesFifo[NCCL_STEPS];
-      int offsFifo[NCCL_STEPS];
+      struct ncclConnFifo connFifo[NCCL_MAX_STEPS];
+      int sizesFifo[NCCL_MAX_STEPS];
+      int offsFifo[NCCL_MAX_STEPS];
       int flush; // For GDRCopy-based flush
     };
     char pad4[MEM_ALIGN];
@@ -87,6 +91,7 @@ struct ncclUserRedOp {
   int freeNext; // -1=allocated, otherwise index of next free entry in array
   ncclDataType_t datatype;
   ncclDevRedOpFull opFull;
+  void* devArgs; // device memory owned by the operator, NULL for PreMulSum
 };
 
 struct ncclNodeRanks {
@@ -143,6 +148,8 @@ struct ncclChannel {
   struct ncclDirect collnetDirect;
   struct ncclTree binTree;
   struct ncclNvls nvls;
+  struct ncclRhd rhd;
+  struct ncclBruck bruck;
 
   int id; // index of this channel
   uint32_t workFifoSent; // last used work index+1
@@ -176,6 +183,33 @@ struct channelMasks {
         uint64_t masks[MAXCHANNELS/64];
 };
 
+// Persistent kernel mode: the host posts plans to a long-lived kernel instead of
+// launching one kernel per plan.
+#define NCCL_PERSISTENT_LAUNCHES 256
+
+struct ncclDevPersistentLaunch {
+  struct channelMasks channelMask;
+  struct ncclWork* workHead;
+  int nBlocks;
+};
+
+// Lives in cudaHost memory
+struct ncclDevPersistentSync {
+  uint64_t doorbell; // number of launches posted, written from the launch stream
+  uint64_t complete; // number of launches completed, written by the kernel
+  uint32_t stop;
+};
+
+struct ncclPersistentKernel {
+  hipStream_t stream; // the kernel runs here for the communicator's lifetime
+  struct ncclDevPersistentLaunch* launches; // cudaHost, NCCL_PERSISTENT_LAUNCHES entries
+  struct ncclDevPersistentSync* sync; // cudaHost
+  uint32_t* nDone; // device, blocks done per launch slot
+  uint64_t posted;
+  hipStream_t lastStream;
+  int nChannels;
+};
+
 struct ncclKernelPlan {
   // A kernel plan is also a callback that reclaims itself. Hence this must
   // be the first member.
@@ -187,6 +221,7 @@ struct ncclKernelPlan {
   bool persistent; // aka captured in a graph
   bool kernelSpecialized;
   void *kernelFn;
+  hipFunction_t jitKernel; // replaces kernelFn for the collectives of a runtime-compiled reduction
   int channelUbound; // only channels c < channelUbound are present
   int channelCount; // number of channels present
   struct channelMasks channelMask;
@@ -211,10 +246,69 @@ struct ncclKernelPlan {
     struct ncclIntruQueue<struct ncclProxyOp, &ncclProxyOp::enqNext> proxyOpQueue;
   } channels[MAXCHANNELS];
   size_t maxBytesPerChannel;
+
+  // Collective described to the tuner plugin when the plan holds only one
+  int tunerNColl;
+  ncclTunerCollResult_v2_t tunerColl;
+  int tunerAutotuneSample;
+  // First collective of the plan, their number and bytes, for RCCL_COLL_TIMINGS
+  ncclTunerCollResult_v2_t timingColl;
+  int timingNColls;
+  size_t timingBytes;
+};
+
+#define NCCL_TUNER_MAX_PENDING_TIMINGS 64
+
+#define RCCL_MAX_STREAM_PARTS 8
+#define RCCL_MAX_PART_STREAMS 64
+
+// Device timestamps of a collective reported to the tuner plugin
+struct ncclTunerTiming {
+  hipEvent_t start;
+  hipEvent_t end;
+  ncclTunerCollResult_v2_t result;
+  bool report;        // forwarded to the plugin
+  int autotuneSample; // forwarded to the built-in autotuner
+  int stragglerSlot;  // window slot of a straggler detection sample, or -1
+  uint64_t stragglerKey;
+};
+
+// Tuning decision for one collective of an aggregate, reused when the same
+// sequence of collectives is enqueued again (RCCL_TUNING_CACHE)
+struct ncclTuningCacheEntry {
+  size_t count;    // 0 when the entry is empty
+  size_t aggCount; // count of the whole aggregate the collective was tuned in
+  uint8_t coll;
+  uint8_t op;
+  uint8_t datatype;
+  bool userTuned;
+  int algorithm;
+  int protocol;
+  int pattern;
+  int workFuncIndex;
+  int nChannels;
+  int nThreads;
+  size_t aggnBytes;
+};
+
+struct ncclCeIpcMapping {
+  int peer; // local rank
+  hipIpcMemHandle_t handle;
+  void* base;
+};
+
+// Send buffer of a local rank, exchanged at every copy engine AllGather
+struct ncclCeBuffer {
+  hipIpcMemHandle_t handle;
+  size_t offset;
 };
 
 struct ncclComm {
   struct ncclMemoryStack memPermanent, memScoped;
+  // Heap allocations of the memory stacks, seen at the last launch, and those
+  // made after RCCL_ENQUEUE_ALLOC_WARMUP launches
+  uint64_t enqueueMallocs, enqueueSteadyMallocs;
+  uint64_t enqueueLaunches;
   // List of destructors to run when comm is destructed
   struct ncclDestructor* destructorHead;
 
@@ -246,6 +340,7 @@ struct ncclComm {
   cpu_set_t cpuAffinity; // CPU affinity of the GPU
   int WarpSize;
   int cudaArch; // matches __CUDA_ARCH__ of device
+  int kernelUnroll; // 1 when the device launches the Generic_4 kernels, see ncclGetKernelIndex
 
   int node;
   int nNodes;
@@ -273,7 +368,62 @@ struct ncclComm {
   // Channels (per peer) for p2p
   int p2pnChannels;
   int p2pnChannelsPerPeer;
+  int p2pnChannelsPerPeerHeavy; // Channels per peer of send/recv above RCCL_P2P_HEAVY_THRESHOLD
   int p2pChannels[MAXCHANNELS];
+  float p2pBw[2]; // Per-channel send/recv bandwidth within a node and across nodes
+  uint8_t treeSplit[NCCL_NUM_PROTOCOLS]; // see ncclWorkElem::treeSplit
+  // Latency (us) and per-NIC bandwidth (GB/s) of the CollNet plugin, 0 when it doesn't report them
+  float collNetLat;
+  float collNetBw;
+  // Whether the p2p connections of the native alltoall were marked for pre-connect
+  bool allToAllConnected;
+  // Runtime connection (NCCL_RUNTIME_CONNECT): rings and trees are connected by the
+  // first collective instead of during init, using the graphs saved here.
+  bool runtimeConn;
+  bool collConnectRequested;
+  bool collConnected;
+  struct ncclTopoGraph* runtimeRingGraph;
+  struct ncclTopoGraph* runtimeTreeGraph;
+  // Ring and tree graphs of this node before AllGather3, kept for split comms to
+  // restrict (RCCL_COMM_SPLIT_REUSE_GRAPHS)
+  struct ncclTopoGraph* splitGraphs;
+  // Scratch space for the hierarchical AllToAllv
+  char* a2avStaging;
+  size_t a2avStagingSize;
+  size_t* a2avCounts;
+  size_t* a2avOffsets;
+  // Send counts of the local ranks were given once with ncclAllToAllvDeclareCounts
+  bool a2avCountsDeclared;
+  // Landing buffer of the FP8/FP16/BF16 AllReduce/ReduceScatter with FP32 accumulation
+  char* accumStaging;
+  size_t accumStagingSize;
+  // Landing buffer of the deterministic AllReduce/ReduceScatter
+  char* orderedStaging;
+  size_t orderedStagingSize;
+  // Staging of the compressed AllReduce/ReduceScatter
+  char* compressStaging;
+  size_t compressStagingSize;
+  // Row counts of every rank and gathered COO rows of the sparse AllReduce
+  size_t* sparseCounts;
+  char* sparseStaging;
+  size_t sparseStagingSize;
+  // Blocks of its node held by a node leader of the hierarchical Gather/Scatter
+  char* gatherStaging;
+  size_t gatherStagingSize;
+  // Copy engine AllGather: IPC events shared with the local peers, side streams
+  // for the copies and the peer send buffers mapped so far
+  bool ceInitialized;
+  hipEvent_t ceReadyEvent;
+  hipEvent_t ceDoneEvent;
+  hipEvent_t* cePeerReadyEvents;
+  hipEvent_t* cePeerDoneEvents;
+  struct ncclCeBuffer* ceBuffers; // [localRanks]
+  hipStream_t ceStreams[RCCL_CE_MAX_STREAMS];
+  hipEvent_t ceJoinEvents[RCCL_CE_MAX_STREAMS];
+  int ceNStreams;
+  struct ncclCeIpcMapping* ceMappings;
+  int ceNMappings;
+  int ceMappingsCapacity;
 
   // Should this comm allocate LL buffers for network P2P connections?
   bool allocP2pNetLLBuffers;
@@ -287,6 +437,8 @@ struct ncclComm {
   float latencies[NCCL_NUM_FUNCTIONS][NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
   float bandwidths[NCCL_NUM_FUNCTIONS][NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
   float ringbdw[NCCL_NUM_FUNCTIONS][NCCL_NUM_PROTOCOLS];
+  // Simple bandwidth a single channel of Ring/Tree moves, 0 when not modeled
+  float algoChannelBw[NCCL_NUM_FUNCTIONS][NCCL_NUM_ALGORITHMS];
   int maxThreads[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
 
   /* This attribute can indicate the states of communicators and return code of
@@ -311,6 +463,10 @@ struct ncclComm {
   struct ncclWork* workFifoHeap;
   struct ncclWork* devWorkFifoHeap;
   void* workFifoHeapGdrHandle;
+  int workFifoMaxDepth; // NCCL_WORK_FIFO_DEPTH, workFifoDepth doubles up to it when full
+  bool workFifoGrow; // set when uploadWork() had to wait for fifo space
+  uint64_t workFifoStalls; // number of uploads that waited for fifo space
+  uint64_t workFifoStallNs; // total time spent waiting
 
   // Work completion notificaion
   uint32_t* workFifoDone/*[MAXCHANNELS]*/; // in cudaHost memory
@@ -348,6 +504,41 @@ struct ncclComm {
   /* sharable NVLS resource. */
   struct ncclNvlsSharedRes* nvlsResources;
 
+  // Direct AllReduce (NCCL_ALGO_DIRECT) on fully XGMI connected nodes. It runs on
+  // channels [0, directnChannels) over the p2p connections to every peer, one-shot
+  // up to directOneShotBytes and two-shot (reduce-scatter + allgather) above.
+  int directSupport;
+  int directnChannels;
+  ssize_t directOneShotBytes;
+  // Simple protocol one-shot cost, the tuning tables hold the two-shot one
+  float directOneShotLat;
+  float directOneShotBw;
+  bool directConnected;
+
+  // Recursive halving-doubling AllReduce (NCCL_ALGO_RHD), on channels [0, rhdnChannels)
+  // over the connections to the peers of channel->rhd.
+  int rhdSupport;
+  int rhdnChannels;
+
+  // Tree Broadcast and Reduce (NCCL_ALGO_TREE) from any root, over the trees of all
+  // channels. treeUps holds the tree parent of every rank, [channel][rank].
+  int rootedTreeSupport;
+  int* treeUps;
+  // RCCL_CHANNEL_BALANCE: ring hop bandwidth of each channel, the slowest over all
+  // ranks, which sizes the share of ring collectives given to each channel.
+  int channelBalance;
+  float channelBw[MAXCHANNELS];
+
+  // Bruck AllGather, ReduceScatter and small-block AllToAll (NCCL_ALGO_BRUCK), one channel
+  // of [0, brucknChannels) per collective. ReduceScatter keeps bruckScratchBlocks blocks of
+  // partial sums in the bruckScratchBytes scratch region of its channel, AllToAll all of
+  // its blocks.
+  int bruckSupport;
+  int brucknChannels;
+  int bruckScratchBlocks;
+  size_t bruckScratchBytes;
+  void* bruckScratch;
+
   // pools backed by comm->memPermanent
   struct ncclMemoryPool memPool_ncclProxyOp;
   struct ncclMemoryPool memPool_ncclKernelPlan;
@@ -358,6 +549,8 @@ struct ncclComm {
   struct ncclComm* groupNext;
   // Subset of those in groupNext list. Holds 0x1 if not needing preconnect.
   struct ncclComm* preconnectNext;
+  // Thread preparing the plans of this comm when a group spans several comms
+  struct ncclPrepareWorker* prepareWorker;
   int persistentRefs; // number of persistent plan-lists capturing this comm
   struct ncclTasks tasks;
 
@@ -377,6 +570,15 @@ struct ncclComm {
 
   hipEvent_t doneEvent;
   hipStream_t lastStream;
+  // Channel partitions of RCCL_STREAM_PARTITIONS. Launches from a stream bound with
+  // ncclCommSetStreamPartition() only use the channels of its partition, and only
+  // wait for the previous kernels of that partition and for unpartitioned ones.
+  int nStreamParts;
+  int nPartStreams;
+  hipStream_t partStreams[RCCL_MAX_PART_STREAMS];
+  int partStreamIds[RCCL_MAX_PART_STREAMS];
+  hipEvent_t partDoneEvents[RCCL_MAX_STREAM_PARTS];
+  hipStream_t partLastStreams[RCCL_MAX_STREAM_PARTS];
 
 #ifdef ENABLE_COLLTRACE
   struct ncclCollTrace* collTrace;
@@ -398,15 +600,59 @@ struct ncclComm {
   bool mscclppCompatible;
   struct mscclpp_ncclComm* mscclpp_comm;
   size_t mscclpp_threshold;
+  // MSCCL++ cost model per ncclFunc_t, bandwidth 0 where it is not modeled
+  float mscclppLat[ncclNumFuncs];
+  float mscclppBw[ncclNumFuncs];
 #endif
 
   // Whether this comm is compatible with MSCCL
   bool mscclCompatible;
+  // Last decision of the internal MSCCL scheduler, reused by same-shape calls
+  struct {
+    bool valid;
+    int func;
+    bool inPlace;
+    size_t count;
+    ncclDataType_t dataType;
+    bool scheduled;
+    mscclAlgoHandle_t handle;
+  } mscclLastSelect;
   // group job to support multi-thread FT
   struct ncclGroupJob *groupJob;
 
   // Tuning plugin
   ncclTuner_t* tuner;
+  void* tunerContext;
+  // Ring of kernel timings waiting to be reported to the tuner
+  struct ncclTunerTiming* tunerTimings;
+  uint64_t tunerTimingsHead;
+  uint64_t tunerTimingsTail;
+  uint64_t tunerFeedbackCount;
+  struct ncclAutotune* autotune;
+  struct ncclDevWindowState* devWindows;
+  struct ncclWin* wins;
+  // Collectives on host buffers, set up by the group of the first one
+  struct ncclHostColl* hostColl;
+  bool hostCollRequested;
+  struct ncclTuningCacheEntry* tuningCache;
+  int tuningCacheSize;
+  uint64_t tuningCacheHits;
+  uint64_t tuningCacheMisses;
+  struct ncclStraggler* straggler;
+  // Set between ncclCommSuspend and ncclCommResume
+  int suspended;
+  // RCCL_CALL_TRACE capture for the replayer
+  struct ncclCallTrace* callTrace;
+  // Counters returned by ncclCommGetStats
+  struct ncclStats stats;
+  // Memory returned by ncclCommGetMemoryInfo, with proxyState->memStats
+  struct ncclMemStats memStats;
+  // GPU wall clock vs. host CLOCK_MONOTONIC, for merged timelines
+  struct ncclClockSync clockSync;
+  // RCCL_COLL_TIMINGS rings read by ncclCommGetCollTimings
+  struct ncclCollTimings* collTimings;
+  // RCCL_PERSISTENT_KERNEL, started on first eligible launch
+  struct ncclPersistentKernel* persistentKernel;
   // buffer registration cache
   struct ncclRegCache regCache;
 };
@@ -490,6 +736,10 @@ static inline ncclRedOp_t ncclUserRedOpMangle(ncclComm *comm, ncclRedOp_t op) {
 }
 
 ncclResult_t ncclCommEnsureReady(ncclComm_t comm);
+ncclResult_t ncclCeAllGatherFree(ncclComm_t comm);
+// Frees the device windows the user did not destroy
+ncclResult_t ncclDevWindowFreeAll(struct ncclComm* comm);
+ncclResult_t ncclWinFreeAll(struct ncclComm* comm);
 ncclResult_t ncclCommSetAsyncError(ncclComm_t comm, ncclResult_t nextState);
 
 #endif
@@ -29,13 +29,17 @@ extern const char* ncclProtoStr[NCCL_NUM_PROTOCOLS];
 extern const char* funcNames[FUNC_INDEX_TOTAL];
 
 #define NCCL_MAX_OPS 2048
+// NCCL_STEPS is the default pipeline depth of a connection and sets the step size,
+// buffSizes/NCCL_STEPS. Connections can be given any power of two depth up to
+// NCCL_MAX_STEPS (ncclConnInfo::nSteps), their buffers growing accordingly.
 #define NCCL_STEPS 8
+#define NCCL_MAX_STEPS 16
 
 #include "net_device.h"
 
 enum ncclDevRedOp_t {
   ncclDevSum, ncclDevProd, ncclDevMinMax,
-  ncclDevPreMulSum, ncclDevSumPostDiv,
+  ncclDevPreMulSum, ncclDevSumPostScale, ncclDevSumPostDiv,
   ncclNumDevRedOps
 };
 struct ncclDevRedOpFull {
@@ -44,6 +48,13 @@ struct ncclDevRedOpFull {
   bool scalarArgIsPtr;
   uint64_t scalarArg;
 };
+// Device memory argument of ncclDevSumPostScale, created by
+// ncclRedOpCreatePostScaleSum(). scalarArg holds its address.
+struct ncclDevPostScaleArgs {
+  float scale;           // used when scalePtr is NULL
+  float const* scalePtr; // scale read by the kernel when set
+  int* nonFinite;        // set to 1 when a scaled result is NaN or Inf, may be NULL
+};
 
 union ncclLLFifoLine {
   /* Flags have to be *after* data, because otherwise, an incomplete receive
@@ -70,16 +81,20 @@ union ncclLLFifoLine {
 #define NCCL_LL_MAX_NTHREADS NCCL_MAX_NTHREADS
 #define NCCL_LL_LINES_PER_THREAD 8
 #ifdef TEST_LL_CLEANUP
-#define NCCL_LL_CLEAN_MASK 0x078 // Set to 0x100 to disable cleanup
+#define NCCL_LL_CLEAN_MASK 0x070 // Set to 0x100 to disable cleanup
 #define NCCL_LL_FLAG_MAX   0x100
 #define NCCL_LL_FLAG(a) ((uint32_t)((a) % NCCL_LL_FLAG_MAX))
 #else
-#define NCCL_LL_CLEAN_MASK 0x7ffffff8
+// Flags carry the low 31 bits of the step, so a connection only cleans its
+// buffer once every 2^31 steps
+#define NCCL_LL_CLEAN_MASK 0x7ffffff0
 #define NCCL_LL_FLAG(a) ((uint32_t)(a))
 #endif
-// Make sure the clean mask will last for at least NCCL_NSTEPS
-static_assert(NCCL_LL_CLEAN_MASK % NCCL_STEPS == 0, "Invalid NCCL_LL_CLEAN_MASK value");
+// Make sure the clean mask will last for at least NCCL_MAX_STEPS
+static_assert(NCCL_LL_CLEAN_MASK % NCCL_MAX_STEPS == 0, "Invalid NCCL_LL_CLEAN_MASK value");
 
+// LL128 lines are one 64-byte cache line: four threads store 16 bytes each, the
+// last 8 bytes of the line being the flag.
 #define NCCL_LL128_LINESIZE 64
 #define NCCL_LL128_LINEELEMS (NCCL_LL128_LINESIZE/sizeof(uint64_t))
 #define NCCL_LL128_DATAELEMS (NCCL_LL128_LINEELEMS-1)
@@ -90,6 +105,13 @@ static_assert(NCCL_LL_CLEAN_MASK % NCCL_STEPS == 0, "Invalid NCCL_LL_CLEAN_MASK
 #define NCCL_LL128_SHMEM_ELEMS_PER_THREAD 4
 #define NCCL_LL128_SHMEM_SIZE (NCCL_LL128_SHMEM_ELEMS_PER_THREAD*NCCL_LL128_MAX_NTHREADS)
 
+// Architectures that get LL128 device code. On the others the LL128 entries of
+// the device function table run the LL functions, and ncclTopoGetProtoEnable
+// never enables LL128 for them.
+#if defined(ENABLE_LL128) && (defined(__gfx90a__) || defined(__gfx940__) || defined(__gfx941__) || defined(__gfx942__))
+#define RCCL_LL128_DEVICE 1
+#endif
+
 #define NCCL_DIRECT_WRITE 0x01
 #define NCCL_DIRECT_READ  0x02
 #define NCCL_DIRECT_NIC   0x04
@@ -113,6 +135,7 @@ struct ncclConnInfo {
 
   uint64_t step;      // Keep where we are
   uint64_t llLastCleaning;
+  int nSteps;         // Pipeline depth, a power of two up to NCCL_MAX_STEPS
 
   // GPU's HDP_MEM_FLUSH_ADDR: HDP Memory Coherency Flush Control. This register
   // allows software to explicitly initiate a flush read to HDP memory. See more
@@ -162,6 +185,24 @@ struct ncclTree {
   int down[NCCL_MAX_TREE_ARITY];
 };
 
+// Tree Broadcast and Reduce see the tree of a channel as an undirected tree hanging
+// from the collective root. treeUps holds the tree parent of every rank on that
+// channel. Returns the neighbor on the path to root (-1 on the root itself) and
+// fills others with the remaining neighbors, -1 terminated.
+#define NCCL_MAX_TREE_PEERS (NCCL_MAX_TREE_ARITY+1)
+__host__ __device__ inline int ncclTreeRootedPeers(const int* treeUps, const struct ncclTree* tree, int rank, int root, int* others) {
+  int prev = -1, r = root;
+  while (r != -1 && r != rank) { prev = r; r = treeUps[r]; }
+  int toRoot = r == rank ? prev : tree->up;
+  int n = 0;
+  if (tree->up != -1 && tree->up != toRoot) others[n++] = tree->up;
+  for (int i=0; i<NCCL_MAX_TREE_ARITY; i++) {
+    if (tree->down[i] != -1 && tree->down[i] != toRoot) others[n++] = tree->down[i];
+  }
+  if (n < NCCL_MAX_TREE_PEERS) others[n] = -1;
+  return toRoot;
+}
+
 #define NCCL_MAX_DIRECT_ARITY 7
 struct ncclDirect {
   int depth;
@@ -191,6 +232,41 @@ struct ncclNvls {
   int nNodes;
 };
 
+// Recursive halving-doubling runs over the largest power of two group of ranks,
+// numbered by ring position so that the first steps stay within a node. In a
+// non power of two comm, the first ranks pair up: one folds its data into the
+// other before the exchanges (vrank -1, extra is the rank it folds into) and
+// gets the result back after them.
+#define NCCL_MAX_RHD_STEPS 16
+struct ncclRhd {
+  int nSteps;  // log2 of the group size
+  int vrank;   // Index in the group, -1 when folded into extra
+  int extra;   // Fold partner, -1 if none
+  int peers[NCCL_MAX_RHD_STEPS]; // Rank at vrank^(1<<k) of the group
+};
+
+// Bruck AllGather / ReduceScatter runs ceil(log2(nRanks)) steps with the ranks
+// at distance 1<<k. ReduceScatter keeps the partial sums of the blocks it will
+// send on in scratch, a region of the comm scratch buffer owned by the channel.
+#define NCCL_MAX_BRUCK_STEPS 16
+struct ncclBruck {
+  int nSteps;
+  void* scratch;
+};
+
+// Elements in the chunk at element i of a Bruck step moving nBlocks blocks of
+// count elements. Chunks end at the blocks given by wrap, cut0 and cut1 (counted
+// from the start of the step, ignored when out of range) so that both ends of a
+// connection cut a step into the same chunks. Used by the kernels and by the
+// proxy step count in enqueue.cc.
+__host__ __device__ inline int64_t ncclBruckChunk(int64_t i, int64_t count, int nBlocks, int wrap, int cut0, int cut1, int64_t chunkCount) {
+  int64_t end = nBlocks*count;
+  if (wrap*count > i && wrap*count < end) end = wrap*count;
+  if (cut0*count > i && cut0*count < end) end = cut0*count;
+  if (cut1*count > i && cut1*count < end) end = cut1*count;
+  return end-i < chunkCount ? end-i : chunkCount;
+}
+
 #define NCCL_MAX_CONNS 3
 struct ncclChannelPeer {
   struct ncclConnector send[NCCL_MAX_CONNS];
@@ -239,6 +315,7 @@ struct ncclWorkElem {
   };
   uint8_t nWarps;
   uint8_t direct;
+  uint8_t treeSplit; // percent of the warps runTreeSplit gives to reduce-up, 0 for the default
 
   uint32_t root:30, connIndex:2;
   const void *sendbuff;
@@ -281,6 +358,7 @@ struct ncclWorkElemP2p {
     };
   };
   uint8_t reg:1;
+  uint8_t ipcReg:1; // receive buffer mapped at capture time, written directly by the send
   uint16_t opCount:12;
   // Important not to use any fields with greater than 4-byte alignment since
   // we need sizeof(ncclWorkElemP2p)==28, but that would be padded up to 32 if
@@ -313,7 +391,11 @@ struct ncclWork {
   union {
     char pad[NCCL_WORK_SIZE - sizeof(struct ncclWorkHeader)];
     struct ncclWorkElem elems[NCCL_MAX_WORK_ELEMENTS];
-    struct ncclWorkElemP2p p2pElems[NCCL_MAX_WORK_ELEMENTS_P2P];
+    struct {
+      struct ncclWorkElemP2p p2pElems[NCCL_MAX_WORK_ELEMENTS_P2P];
+      // Peer receive buffer of each send element with ipcReg, for this chunk
+      void* p2pPeerBuffs[NCCL_MAX_WORK_ELEMENTS_P2P];
+    };
     struct ncclWorkElemReg regElems[NCCL_MAX_WORK_ELEMENTS_REG];
   };
 };
@@ -372,6 +454,7 @@ struct ncclCollTrace {
       uint8_t nWarps;
       uint8_t bid;
       uint8_t nChannels;
+      uint8_t countLog2; // log2 of the element count, keys the watchdog medians
     } coll;
     struct {
       int16_t peer;
@@ -400,9 +483,18 @@ struct alignas(16) ncclDevChannel {
   struct ncclDirect collnetDirect;
   struct ncclTree binTree;
   struct ncclNvls nvls;
+  struct ncclRhd rhd;
+  struct ncclBruck bruck;
   uint32_t* workFifoDone; // Location of done counter, device writes index+1 of last work processed
 };
 
+// Timestamps of a launch on a channel, in host memory (see colltiming.h)
+struct ncclDevCollTiming {
+  uint64_t start; // wall_clock64() before the first work of the channel
+  uint64_t end;   // and after the last one
+  uint64_t tag;   // 1 + position of the launch among those of the channel, written last
+};
+
 struct ncclDevComm {
   int rank;
   int nRanks;
@@ -416,6 +508,8 @@ struct ncclDevComm {
   struct ncclWork* workFifoHeap; // may be cudaHost or GDR memory
 
   int* collNetDenseToUserRank;
+  // Tree parent of every rank, [channel][rank], for tree Broadcast and Reduce
+  int* treeUps;
 
   // Flag to ask NCCL kernels to abort
   volatile uint32_t* abortFlag;
@@ -423,6 +517,11 @@ struct ncclDevComm {
   // Channels, device side
   struct ncclDevChannel* channels/*[MAXCHANNELS]*/;
 
+  // RCCL_COLL_TIMINGS rings, [MAXCHANNELS][collTimingsMask+1], and launches per channel
+  struct ncclDevCollTiming* collTimings;
+  uint64_t* collTimingsCount;
+  uint32_t collTimingsMask;
+
 #if defined(ENABLE_NPKIT)
   NpKitEventCollectContext* npKitEventCollectContexts;
   uint64_t* cpuTimestamp;
@@ -508,6 +607,30 @@ __host__ __device__ constexpr int ncclShmemDynamicSize(int cudaArch = NCCL_CUDA_
 // Launch a one-rank reduction on stream.
 ncclResult_t ncclLaunchOneRank(void* dst, void const* src, size_t nElts, struct ncclDevRedOpFull redOp, ncclDataType_t type, cudaStream_t stream);
 
+// Answers nRounds timestamp requests posted by the host in mbox, see clocksync.cc.
+ncclResult_t ncclLaunchClockSync(uint64_t volatile* mbox, int nRounds, cudaStream_t stream);
+
+// Sum nSrcs consecutive FP8/FP16/BF16 arrays of nElts elements into dst, accumulating in FP32.
+ncclResult_t ncclLaunchFp32AccumReduce(void* dst, void const* src, int nSrcs, size_t nElts, ncclDataType_t type, cudaStream_t stream);
+
+// Reduce nSrcs consecutive arrays of nElts elements into dst, always from the first to the last.
+ncclResult_t ncclLaunchOrderedReduce(void* dst, void const* src, int nSrcs, size_t nElts, struct ncclDevRedOpFull redOp, ncclDataType_t type, cudaStream_t stream);
+
+// Sum the nnz rows of rowCount values into the rows of dst given by indices, duplicates included.
+ncclResult_t ncclLaunchSparseScatterReduce(void* dst, int64_t const* indices, void const* values, size_t nnz, size_t rowCount,
+    size_t nRows, ncclDataType_t type, cudaStream_t stream);
+
+#if defined(RCCL_FLOAT8)
+
+// Block-scaled FP8 compression of FP16/BF16/FP32 data: each block of
+// RCCL_COMPRESS_BLOCK elements is stored as FP8 values and one FP32 scale.
+#define RCCL_COMPRESS_BLOCK 128
+ncclResult_t rcclCompressQuantize(void* q, float* scales, void const* src, size_t nElts, ncclDataType_t type, cudaStream_t stream);
+// Sums nSrcs compressed slices of nElts elements in FP32 into dst, and compresses the sum into qOut/scalesOut when qOut is not NULL.
+ncclResult_t rcclCompressReduce(void* dst, void* qOut, float* scalesOut, void const* q, float const* scales, int nSrcs, size_t nElts, ncclDataType_t type, cudaStream_t stream);
+ncclResult_t rcclCompressDequantize(void* dst, void const* q, float const* scales, size_t nElts, ncclDataType_t type, cudaStream_t stream);
+#endif
+
 // `ncclNvlsSupported()` needs to be in sync with "func_valid" in "src/device/generate.py"
 inline bool ncclNvlsSupported(int devRedOp, int type) {
   switch (type) {
@@ -535,48 +658,64 @@ inline bool ncclNvlsSupported(int devRedOp, int type) {
 // Map the rowIdx to funcIdx
 extern int const ncclDevFuncRowToId[];
 
+// AllReduce algorithms that have kernels, in the order of 'ALL_ALGOS' in Generator.cmake.
+// NVLS and NVLS_TREE have none, so Direct and RHD take the slots after CollNetChain.
+// Bruck comes last and only has AllGather, ReduceScatter and AllToAll kernels.
+#define NCCL_NUM_DEV_ALGORITHMS 6
+inline int ncclDevAlgoIndex(int algo) { return algo == NCCL_ALGO_DIRECT ? 4 : algo == NCCL_ALGO_RHD ? 5 : algo; }
+
 // `ncclFuncIndex()` needs to be in sync with 'ALL_COLLS' in Generate.cmake
 inline int ncclDevFuncId(int coll, int devRedOp, int type, int algo, int proto) {
   int row = 0;
+  algo = ncclDevAlgoIndex(algo);
   do {
-    // RING / <all_protos> / Sum / int8_t
+    // RING/BRUCK / <all_protos> / Sum / int8_t
     if (coll == ncclFuncAllGather) {
-      row += proto;
+      row += (algo == NCCL_ALGO_BRUCK) * NCCL_NUM_PROTOCOLS + proto;
       break;
     }
-    row += NCCL_NUM_PROTOCOLS;
+    row += 2 * NCCL_NUM_PROTOCOLS;
 
     // <all_algos> / <all_protos> / <all_redops> / <all_types>
     if (coll == ncclFuncAllReduce) {
       row += (((algo * NCCL_NUM_PROTOCOLS + proto) * ncclNumDevRedOps + devRedOp) * ncclNumTypes + type) - NCCL_NUM_FLOATS * (algo * NCCL_NUM_PROTOCOLS + proto);
       break;
     }
-    row += (NCCL_NUM_ALGORITHMS - 2) * NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
+    row += NCCL_NUM_DEV_ALGORITHMS * NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
+
+    // RING/BRUCK / LL/SIMPLE / Sum / int8_t
+    if (coll == ncclFuncAllToAll) {
+      row += (algo == NCCL_ALGO_BRUCK) * 2 + (proto == NCCL_PROTO_SIMPLE);
+      break;
+    }
+    row += 4;
 
     // RING / SIMPLE / Sum / int8_t
     if (coll == ncclFuncAllToAllPivot) break;
     row += 1;
 
-    // RING / <all_protos> / Sum / int8_t
+    // TREE/RING / <all_protos> / Sum / int8_t
     if (coll == ncclFuncBroadcast) {
-      row += proto;
+      row += (algo == NCCL_ALGO_RING) * NCCL_NUM_PROTOCOLS + proto;
       break;
     }
-    row += NCCL_NUM_PROTOCOLS;
+    row += 2 * NCCL_NUM_PROTOCOLS;
 
-    // RING / <all_protos> / <all_redops> / <all_types>
+    // TREE/RING / <all_protos> / <all_redops> / <all_types>
     if (coll == ncclFuncReduce) {
-      row += ((proto * ncclNumDevRedOps + devRedOp) * ncclNumTypes + type) - NCCL_NUM_FLOATS * proto; 
+      int algoProto = (algo == NCCL_ALGO_RING) * NCCL_NUM_PROTOCOLS + proto;
+      row += ((algoProto * ncclNumDevRedOps + devRedOp) * ncclNumTypes + type) - NCCL_NUM_FLOATS * algoProto;
       break;
     }
-    row += NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
+    row += 2 * NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
 
-    // RING / <all_protos> / <all_redops> / <all_types>
+    // RING/BRUCK / <all_protos> / <all_redops> / <all_types>
     if (coll == ncclFuncReduceScatter) {
-      row += ((proto * ncclNumDevRedOps + devRedOp) * ncclNumTypes + type) - NCCL_NUM_FLOATS * proto;
+      int algoProto = (algo == NCCL_ALGO_BRUCK) * NCCL_NUM_PROTOCOLS + proto;
+      row += ((algoProto * ncclNumDevRedOps + devRedOp) * ncclNumTypes + type) - NCCL_NUM_FLOATS * algoProto;
       break;
     }
-    row += NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
+    row += 2 * NCCL_NUM_PROTOCOLS * (ncclNumDevRedOps * ncclNumTypes - NCCL_NUM_FLOATS);
 
     // RING / SIMPLE / Sum / int8_t
     if (coll == ncclFuncSendRecv) break;
@@ -17,12 +17,26 @@
 #define NCCL_SIMPLE_ALIGNMENT (WARP_SIZE * 8LL * 16LL)
 #define NCCL_BYTES_ALIGNMENT 16
 
-ncclResult_t ncclInitKernelsForDevice(int cudaArch, size_t* maxStackSize);
+// Whether the device launches the Generic_4 (1) or the Generic (0) kernels
+ncclResult_t ncclGetKernelUnroll(int cudaDev, int* kernelUnroll);
+ncclResult_t ncclInitKernelsForDevice(int cudaArch, int kernelUnroll, size_t* maxStackSize);
 ncclResult_t ncclEnqueueCheck(struct ncclInfo* info);
+ncclResult_t ncclP2pPreconnectMark(struct ncclComm* comm, int peer, bool* marked);
 ncclResult_t ncclLaunchPrepare(struct ncclComm* comm);
+// Allocates a work fifo of the given depth, in GDR or write-combined cudaHost memory.
+ncclResult_t ncclWorkFifoAlloc(struct ncclComm* comm, int depth, struct ncclWork** heap, struct ncclWork** devHeap, void** gdrHandle);
 ncclResult_t ncclLaunchKernelBefore_NoUncapturedCuda(struct ncclComm* comm, struct ncclKernelPlan* plan);
 ncclResult_t ncclLaunchKernel(struct ncclComm* comm, struct ncclKernelPlan* plan);
 ncclResult_t ncclLaunchKernelAfter_NoCuda(struct ncclComm* comm, struct ncclKernelPlan* plan);
 ncclResult_t ncclLaunchFinish(struct ncclComm* comm);
+// Waits for the persistent kernel to drain its launches, then stops it.
+ncclResult_t ncclPersistentKernelStop(struct ncclComm* comm);
+// Device reduction of op for datatype, user created ops included
+ncclResult_t ncclHostToDevRedOp(ncclDevRedOpFull *opFull, ncclRedOp_t op, ncclDataType_t datatype, ncclComm *comm);
+// Whether ncclAllToAll of count elements per peer runs the Bruck kernel
+bool ncclAllToAllUseBruck(struct ncclComm* comm, size_t count, ncclDataType_t datatype);
+
+// Whether MSCCL++ should run a collective rather than RCCL, from the cost model
+ncclResult_t ncclMscclppPreferred(struct ncclComm* comm, ncclFunc_t coll, size_t count, ncclDataType_t datatype, ncclRedOp_t op, bool* use);
 
 #endif // End include guard
@@ -158,11 +158,19 @@ typedef struct gdr_mem_desc {
 } gdr_mem_desc_t;
 
 #if defined(__HIP_PLATFORM_AMD__) || defined(__HCC__) || defined(__HIPCC__)
+#include "rocmwrap.h"
+
 static gdr_t ncclGdrInit() {
   INFO(NCCL_INIT, "Enabled GDRCopy equivalent memory allocation");
   return (gdr_t)0x12345678L;
 }
 
+// The equivalent allocation is fine-grained device memory that the proxy writes with
+// plain CPU stores, which needs the whole VRAM to be visible through the BAR.
+static inline bool ncclGdrCopyDevice(int cudaDev) {
+  return ncclGdrCopy != NULL && ncclGdrLargeBar(cudaDev);
+}
+
 template <typename T>
 static ncclResult_t ncclGdrCudaCalloc(T** ptr, T** devPtr, size_t nelem, void** gdrHandle, hipStream_t stream) {
   gdr_info_t info;
@@ -306,6 +314,10 @@ static ncclResult_t ncclGdrCudaFree(void* gdrHandle) {
 
   return ncclSuccess;
 }
+
+static inline bool ncclGdrCopyDevice(int cudaDev) {
+  return ncclGdrCopy != NULL;
+}
 #endif
 
 #endif // End include guard
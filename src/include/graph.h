@@ -26,7 +26,11 @@ ncclResult_t ncclTopoPrint(struct ncclTopoSystem* system);
 
 ncclResult_t ncclTopoComputePaths(struct ncclTopoSystem* system, struct ncclComm* comm);
 void ncclTopoFree(struct ncclTopoSystem* system);
+// Deep copy, so that several searches can run on the same topology at once
+ncclResult_t ncclTopoCloneSystem(struct ncclTopoSystem* system, struct ncclTopoSystem** copy);
 ncclResult_t ncclTopoTrimSystem(struct ncclTopoSystem* system, struct ncclComm* comm);
+// Scale down XGMI and PCIe links that measure below their peers (RCCL_TOPO_PROBE)
+ncclResult_t ncclTopoProbeLinks(struct ncclComm* comm, struct ncclTopoSystem* system);
 ncclResult_t ncclTopoComputeP2pChannels(struct ncclComm* comm);
 ncclResult_t ncclTopoGetNvbGpus(struct ncclTopoSystem* system, int rank, int* nranks, int** ranks);
 int ncclTopoPathAllNVLink(struct ncclTopoSystem* system);
@@ -42,10 +46,15 @@ ncclResult_t ncclTopoGetLinkType(struct ncclTopoSystem* system, int cudaDev1, in
 ncclResult_t ncclTopoNeedFlush(struct ncclTopoSystem* system, int64_t busId, int* flush);
 ncclResult_t ncclTopoCheckNet(struct ncclTopoSystem* system, int64_t id1, int64_t id2, int* net);
 int ncclPxnDisable(struct ncclComm* comm);
+// Whether graphs may route GPU to NIC traffic through another GPU (PXN)
+int ncclPxnCollEnable(struct ncclComm* comm);
 ncclResult_t ncclTopoGetPxnRanks(struct ncclComm* comm, int** intermediateRanks, int* nranks);
+// Per-channel bandwidth of the ring hop to the next rank, shared by the channels on the same link
+ncclResult_t ncclTopoGetRingBw(struct ncclComm* comm, struct ncclTopoGraph* graph, float* bw);
 
 // Find CPU affinity
 ncclResult_t ncclTopoGetCpuAffinity(struct ncclTopoSystem* system, int rank, cpu_set_t* affinity);
+ncclResult_t ncclTopoGetNetCpuAffinity(struct ncclTopoSystem* system, int netDev, cpu_set_t* affinity);
 
 #define NCCL_TOPO_CPU_ARCH_X86 1
 #define NCCL_TOPO_CPU_ARCH_POWER 2
@@ -100,6 +109,11 @@ struct ncclTopoGraph {
   char treeBase[NCCL_TOPO_MAX_NODES][NCCL_TOPO_MAX_NODES*4];
 };
 ncclResult_t ncclTopoCompute(struct ncclTopoSystem* system, struct ncclTopoGraph* graph);
+// Derives graph from refGraph, searched on refSystem for a superset of the GPUs of
+// system, by dropping the GPUs system doesn't have. Leaves graph untouched and sets
+// *valid to 0 when the remaining hops don't hold up.
+ncclResult_t ncclTopoRestrictGraph(struct ncclTopoSystem* refSystem, struct ncclTopoGraph* refGraph,
+    struct ncclTopoSystem* system, struct ncclTopoGraph* graph, int* valid);
 
 ncclResult_t ncclTopoPrintGraph(struct ncclTopoSystem* system, struct ncclTopoGraph* graph);
 ncclResult_t ncclTopoDumpGraphs(struct ncclTopoSystem* system, int ngraphs, struct ncclTopoGraph** graphs);
@@ -114,6 +128,10 @@ struct ncclTopoRanks {
   int treeToChild1[MAXCHANNELS];
   int nvlsHeads[MAXCHANNELS];
   int nvlsHeadNum;
+  // Rail of the NIC each channel enters and leaves the node through, -1 without NIC
+  int ringRecvRail[MAXCHANNELS];
+  int ringSendRail[MAXCHANNELS];
+  int treeRail[MAXCHANNELS];
 };
 
 ncclResult_t ncclTopoPreset(struct ncclComm* comm, struct ncclTopoGraph** graphs, struct ncclTopoRanks* topoRanks);
@@ -123,6 +141,12 @@ ncclResult_t ncclTopoPostset(struct ncclComm* comm, int* firstRanks, int* treePa
 ncclResult_t ncclTreeBasePostset(struct ncclComm* comm, struct ncclTopoGraph* treeGraph);
 
 ncclResult_t ncclTopoTuneModel(struct ncclComm* comm, int minCompCap, int maxCompCap, struct ncclTopoGraph** graphs);
+// Algorithm, protocol and nChannels set by the RCCL_TUNING_FILE for coll at nBytes, -1 for the
+// algorithm/protocol and 0 for nChannels when left to the model. Returns false without an override.
+bool ncclTopoTuningOverride(int coll, size_t nBytes, int* algorithm, int* protocol, int* nChannels);
+// Number of channels (a power of two up to maxChannels) to spread a send/recv of bytes to/from peer over
+int ncclTopoP2pChannels(struct ncclComm* comm, int peer, size_t bytes, int maxChannels);
+ncclResult_t ncclTopoGetProtoEnable(struct ncclComm* comm, struct ncclTopoGraph** graphs, int protoEnable[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS]);
 #include "info.h"
 ncclResult_t ncclTopoGetAlgoTime(struct ncclInfo* info, int algorithm, int protocol, int numPipeOps, float* time, bool* backup = NULL);
 
@@ -31,6 +31,7 @@ typedef enum ncclGroupJobState {
 struct ncclAsyncJob {
   struct ncclAsyncJob* next;
   pthread_t thread;
+  bool external; // Runs on the user executor rather than on thread
   ncclResult_t result;
   ncclResult_t(*func)(struct ncclAsyncJob*);
   void(*undo)(struct ncclAsyncJob*);
@@ -62,6 +63,7 @@ struct ncclGroupJob {
 ncclResult_t ncclGroupStartInternal();
 ncclResult_t ncclGroupEndInternal();
 ncclResult_t ncclAsyncJobComplete(struct ncclAsyncJob* job);
+ncclResult_t ncclPrepareWorkerFree(struct ncclComm* comm);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,31 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HOSTCOLL_H_
+#define NCCL_HOSTCOLL_H_
+
+#include "info.h"
+
+// Collectives on host buffers (RCCL_HOST_COLL). A thread per communicator runs
+// them on the CPU over a ring of its own, through shared memory within a node and
+// the network plugin across nodes, ordered on the stream like the kernels. Every
+// rank has to pass host buffers of the same kind for a given collective.
+struct ncclHostColl;
+
+// Sets info->hostColl when the buffers of info are in host memory and the
+// collective is one the host thread runs. Called once info is derived.
+ncclResult_t ncclHostCollCheck(struct ncclInfo* info);
+// Whether a collective given these buffers takes the host path
+bool ncclHostCollBuffers(struct ncclComm* comm, ncclFunc_t coll, const void* sendbuff, const void* recvbuff, int root, size_t nBytes);
+// Queues a collective for which info->hostColl holds, from taskAppend
+ncclResult_t ncclHostCollAppend(struct ncclComm* comm, struct ncclInfo* info);
+// Creates the ring and the thread, from the pre-connect job of the group
+ncclResult_t ncclHostCollSetup(struct ncclComm* comm);
+// Hands the queued collectives to the thread and orders them on their streams
+ncclResult_t ncclHostCollLaunch(struct ncclComm* comm);
+ncclResult_t ncclHostCollFree(struct ncclComm* comm);
+
+#endif
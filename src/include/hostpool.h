@@ -0,0 +1,34 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_HOSTPOOL_H_
+#define NCCL_HOSTPOOL_H_
+
+#include "nccl.h"
+#include <stddef.h>
+
+// Process-wide arena of pinned, device-mapped host memory for connection
+// resources, enabled by default (RCCL_HOST_POOL=0 disables it). Memory is pinned
+// in slabs of RCCL_HOST_POOL_SLAB_SIZE bytes, each slab cut into blocks of one
+// power-of-two size class, so connecting many communicators reuses blocks
+// instead of pinning and mapping new memory every time. Empty slabs beyond
+// RCCL_HOST_POOL_CACHE bytes are unpinned.
+//
+// Slabs are shared by every caller using the same domain: -1 for the default
+// placement, otherwise a caller-chosen key such as the NIC a buffer is placed
+// next to. Slabs of a domain are allocated with the flags and the CPU affinity of
+// the caller that needs them. Blocks are zeroed and the device pointer is the
+// host pointer.
+
+ncclResult_t ncclHostPoolAlloc(void** ptr, size_t size, int domain, unsigned int flags);
+template <typename T>
+ncclResult_t ncclHostPoolCalloc(T** ptr, size_t nelem) {
+  return ncclHostPoolAlloc((void**)ptr, nelem*sizeof(T), -1, cudaHostAllocMapped);
+}
+// Also accepts memory from ncclCudaHostCalloc, which is freed directly
+ncclResult_t ncclHostPoolFree(void* ptr);
+
+#endif
@@ -29,7 +29,10 @@ typedef enum : uint8_t {
   ncclPatternNvls,
   ncclPatternNvlsTree,
   ncclPatternSend,
-  ncclPatternRecv
+  ncclPatternRecv,
+  ncclPatternDirect,
+  ncclPatternRhd,
+  ncclPatternBruck
 } ncclPattern_t;
 
 enum ncclRegBufferType {
@@ -77,16 +80,20 @@ struct ncclInfo {
   int algorithm;
   int protocol;
   bool userTuned;
+  int autotuneSample; // 1 + candidate index when timed by the autotuner
+  int autotuneKernel; // 1 + kernel unroll variant picked by the autotuner, 0 for the comm's
+  int autotuneThreads; // thread count picked by the autotuner, 0 for the default
+  bool hostColl; // buffers in host memory, run by the host collective thread (hostcoll.h)
   struct ncclInfo *next;
 };
 
 inline ncclResult_t ncclInfoSetDerived(struct ncclInfo* info, int nRanks) {
   info->nBytes = info->workBytes = info->count * ncclTypeSize(info->datatype);
-  if (info->coll == ncclFuncAllGather || info->coll == ncclFuncBroadcast || info->coll == ncclFuncAllToAllPivot) {
+  if (info->coll == ncclFuncAllGather || info->coll == ncclFuncBroadcast || info->coll == ncclFuncAllToAllPivot || info->coll == ncclFuncAllToAll) {
     info->count = info->workBytes;
     info->datatype = ncclInt8;
   }
-  if (info->coll == ncclFuncAllGather || info->coll == ncclFuncReduceScatter) info->nBytes *= nRanks; // count is per rank
+  if (info->coll == ncclFuncAllGather || info->coll == ncclFuncReduceScatter || info->coll == ncclFuncAllToAll) info->nBytes *= nRanks; // count is per rank
 
   /* compute buffer size for NVLS buffer registration */
   if (info->coll == ncclFuncAllGather) {
@@ -120,6 +127,11 @@ struct ncclTaskP2p {
   // Stateful chunk index. If a p2p gets "cut" over two plans this keeps track
   // of where it left off.
   int chunk;
+  // Capture-time registration (see p2pIpcRegister): the receive buffer is
+  // written directly by the peer, through peerBuff on the sending side.
+  bool regChecked;
+  bool ipcReg;
+  void* peerBuff;
 };
 
 struct ncclCudaStreamList {
@@ -129,6 +141,7 @@ struct ncclCudaStreamList {
 struct ncclTasks {
   struct Peer {
     bool sendSeen, recvSeen;
+    bool sendHeavySeen, recvHeavySeen; // Channels past p2pnChannelsPerPeer were checked too
     struct ncclIntruQueue<struct ncclTaskP2p, &ncclTaskP2p::next> sendQueue;
     struct ncclIntruQueue<struct ncclTaskP2p, &ncclTaskP2p::next> recvQueue;
   };
@@ -139,8 +152,23 @@ struct ncclTasks {
   struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collCBDQueue;
   // Queue for collnet
   struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collnetQueue;
+  // Queue for native alltoall collectives
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collA2AQueue;
+  // Queue for direct allreduce collectives
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collDirectQueue;
+  // Queue for recursive halving-doubling allreduce collectives
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collRhdQueue;
+  // Queue for Bruck allgather and reducescatter collectives
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collBruckQueue;
+  // Queue for collectives with a runtime-compiled reduction, see jit_redop.h
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collJitQueue;
+  // Queue for collectives on host buffers, see hostcoll.h
+  struct ncclIntruQueue<struct ncclInfo, &ncclInfo::next> collHostQueue;
   size_t workBytesTotal;
   int usableChannels;
+  // Channel partition of the launch and its first channel, or -1 and 0
+  int streamPart;
+  int partBase;
   bool sorted;
   struct Peer* peers/*[nRanks]*/;
   int *p2pSendOrder, *p2pRecvOrder;
@@ -0,0 +1,20 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_IPCCACHE_H_
+#define NCCL_IPCCACHE_H_
+
+#include "core.h"
+
+// Process-wide, reference counted cache of the mappings of legacy IPC handles.
+// Every communicator of the process opens peer buffers through it, so that a
+// new communicator or a split reuses the mappings of its parent instead of
+// opening the same handles again.
+ncclResult_t ncclIpcCacheOpen(const cudaIpcMemHandle_t* handle, void** ptr);
+// Releases a mapping returned by ncclIpcCacheOpen
+ncclResult_t ncclIpcCacheClose(void* ptr);
+
+#endif
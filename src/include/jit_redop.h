@@ -0,0 +1,79 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_JIT_REDOP_H_
+#define NCCL_JIT_REDOP_H_
+
+#include "device.h"
+
+// Reduction operators given as source text to ncclRedOpCreateCustom. hipRTC
+// compiles the functor with the ring and tree kernels of the library into a code
+// object of its own, cached on disk, which is loaded once per device and kept for
+// the life of the process. Collectives using such an operator run in that module:
+// their opFull.op is ncclNumDevRedOps plus the id of the module, so that they are
+// never aggregated with another operator, and their work funcIndex is the local
+// index below instead of an entry of the library function table.
+//
+// The epilogue operators of ncclRedOpCreateEpilogue are modules of the same kind,
+// built on a builtin reduction. They only run ring AllReduce, which applies the
+// epilogue to each chunk between its ReduceScatter and AllGather halves.
+
+#define NCCL_JIT_MAX_REDOPS 64
+
+// Collectives and algorithms the modules implement, each with every protocol.
+// Shared with the compiled source, which uses it for its case labels.
+constexpr int ncclJitRedOpFuncIndex(int coll, int algo, int proto) {
+  return (coll == ncclFuncAllReduce && algo == NCCL_ALGO_RING) ? 0*NCCL_NUM_PROTOCOLS + proto :
+         (coll == ncclFuncAllReduce && algo == NCCL_ALGO_TREE) ? 1*NCCL_NUM_PROTOCOLS + proto :
+         (coll == ncclFuncReduce && algo == NCCL_ALGO_RING) ? 2*NCCL_NUM_PROTOCOLS + proto :
+         (coll == ncclFuncReduceScatter && algo == NCCL_ALGO_RING) ? 3*NCCL_NUM_PROTOCOLS + proto : -1;
+}
+
+inline bool ncclDevRedOpIsJit(int devRedOp) { return devRedOp >= ncclNumDevRedOps; }
+
+#ifndef RCCL_JIT_SOURCE
+#include <string>
+#include <vector>
+
+struct ncclComm;
+
+struct ncclJitRedOp {
+  int id;
+  int cudaDev;
+  uint64_t hash; // of the compiled source, options and target
+  hipModule_t module;
+  hipFunction_t kernels[2]; // indexed like comm->kernelUnroll
+  bool epilogue;
+  hipFunction_t oneRank; // epilogue of a single rank communicator
+};
+
+// Compiles, or finds in the disk cache, and loads the module for the functor
+// named functor in source, reducing datatype, on the device of comm.
+ncclResult_t ncclJitRedOpCreate(struct ncclComm* comm, const char* source, const char* functor,
+    ncclDataType_t datatype, struct ncclJitRedOp** jit);
+// Same for an epilogue functor applied after reduceOp, ncclSum or ncclProd.
+ncclResult_t ncclJitEpilogueCreate(struct ncclComm* comm, const char* source, const char* functor,
+    ncclRedOp_t reduceOp, ncclDataType_t datatype, struct ncclJitRedOp** jit);
+// AllReduce of a single rank with an epilogue operator
+ncclResult_t ncclJitEpilogueLaunchOneRank(struct ncclJitRedOp* jit, void* dst, void const* src, size_t count,
+    size_t eltSize, uint64_t arg, hipStream_t stream);
+// Module of a devRedOp for which ncclDevRedOpIsJit() holds.
+struct ncclJitRedOp* ncclJitRedOpGet(int devRedOp);
+
+// Building blocks of every module, also used by the MSCCL kernels of
+// msccl_jit.cc. ncclJitPrepare gives the compile options for the device of comm
+// and the key of source, which covers the build of the library. ncclJitGetCode
+// reads the code object from the disk cache, named <name>.<hash>.co, or
+// compiles it and stores it there; what describes it in the logs.
+ncclResult_t ncclJitPrepare(struct ncclComm* comm, const std::string& source, std::vector<std::string>& options,
+    std::string& key, uint64_t* hash);
+ncclResult_t ncclJitGetCode(const char* name, const char* what, const std::string& source,
+    const std::vector<std::string>& options, const std::string& key, uint64_t hash, std::vector<char>& code);
+// Device type of datatype in the compiled sources, nullptr if there is none
+const char* ncclJitTypeName(ncclDataType_t datatype);
+#endif
+
+#endif
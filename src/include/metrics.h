@@ -0,0 +1,27 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_METRICS_H_
+#define NCCL_METRICS_H_
+
+#include "nccl.h"
+
+// Optional metrics exporter. When RCCL_METRICS_ENDPOINT is set, one thread per
+// process serves the counters of ncclCommGetStats and the kernel bus bandwidth
+// per collective and size bucket of every live communicator, in the Prometheus
+// text format, to HTTP GET requests on:
+//   unix:<path>  a Unix socket, %p in path is replaced by the pid
+//   tcp:<port>   a TCP port on all interfaces; when it is taken, the next free one
+//                of the following 64 is used, so that every process of a node gets one
+
+struct ncclComm;
+
+// Called once the communicator is initialized, starts the exporter on first use.
+ncclResult_t ncclMetricsRegister(struct ncclComm* comm);
+// Called before the communicator is freed. No-op for communicators never registered.
+ncclResult_t ncclMetricsDeregister(struct ncclComm* comm);
+
+#endif
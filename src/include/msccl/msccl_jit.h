@@ -0,0 +1,24 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef MSCCL_JIT_H_
+#define MSCCL_JIT_H_
+
+#include <hip/hip_runtime.h>
+
+#include "comm.h"
+#include "msccl/msccl_struct.h"
+
+// Kernel running hostAlgo with devRedOp on dataType, compiled by hipRTC with the
+// schedule of every thread block as constants (RCCL_MSCCL_JIT). nullptr when the
+// algorithm runs in the library interpreter.
+ncclResult_t mscclJitGetKernel(struct mscclAlgo* hostAlgo, ncclComm_t comm, int devRedOp,
+    ncclDataType_t dataType, hipFunction_t* kernel);
+
+// Forgets the kernels of hostAlgo before it is unloaded
+void mscclJitForgetAlgo(int rank, struct mscclAlgo* hostAlgo);
+
+#endif
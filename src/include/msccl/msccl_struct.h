@@ -62,7 +62,10 @@ struct mscclThreadBlock {
   int16_t recvPeer;
   uint16_t nSteps;
   int16_t channelId; // associated channel. -1 indicates a thread block with only local copies
-}; // 5384 bytes
+  uint16_t nDependencies; // entries of dependentBid/dependentStep in use
+  uint16_t nReductionSrcs; // entries of reductionSrcOffsets in use
+  int16_t pad[2];
+}; // 5392 bytes
 
 static_assert(sizeof(struct mscclThreadBlock) % sizeof(uint64_t) == 0, "Sanity check: sizeof(struct mscclThreadBlock) %% sizeof(uint64_t) != 0");
 
@@ -171,11 +174,25 @@ enum mscclCaptureStatus {
   mscclExistingCapture
 };
 
+// Sizes a MSCCL launch posts to its proxy-backed connections. Kept per
+// captured launch since graph replays must not see the sizes of later launches.
+struct mscclProxyParams {
+  size_t nBytes;
+  int stepSize;
+  int chunkSteps;
+  int sliceSteps;
+  int chunkSize;
+  int chunkEffectiveSize;
+  uint32_t maxAllowedCount;
+  ncclDataType_t dataType;
+};
+
 struct mscclProxyArg {
   struct mscclAlgo* hostAlgo;
   ncclComm_t comm;
-  mscclProxyArg(struct mscclAlgo* hostAlgo, ncclComm_t comm) 
-    : hostAlgo(hostAlgo), comm(comm) {}
+  struct mscclProxyParams params;
+  mscclProxyArg(struct mscclAlgo* hostAlgo, ncclComm_t comm, const struct mscclProxyParams& params)
+    : hostAlgo(hostAlgo), comm(comm), params(params) {}
 };
 
 typedef std::map<unsigned long long, std::vector<struct mscclProxyArg>> mscclSavedProxyArgs;
@@ -185,6 +202,7 @@ struct mscclThreadLocalStatus {
   mscclGroupStatus groupStatus;
   int groupDepth;
   std::vector<struct mscclSavedSchedulerParam> savedSchedulerParams;
+  int nSavedSchedulerParams; // entries of savedSchedulerParams in use
   unsigned long long captureId;
   mscclCaptureStatus captureStatus;
   hipGraph_t graph;
@@ -201,12 +219,25 @@ struct mscclWorkFifoStatus {
 
 typedef std::map<unsigned long long, mscclWorkFifoStatus> mscclSavedGraphWorkFifoStatus;
 
+// Algorithms of one (nRanks, func, in-place) that may be picked for message
+// sizes starting at startBytes, up to the next interval, in algoMetas order.
+struct mscclAlgoInterval {
+  int64_t startBytes;
+  std::vector<int> metaIdx;
+};
+
+struct mscclAlgoIndex {
+  int sizeMultiplier;
+  std::vector<struct mscclAlgoInterval> intervals; // sorted by startBytes
+};
+
 struct mscclStatus {
   std::vector<mscclAlgoHandle_t> freeAlgoHandles;
   std::map<mscclAlgoHandle_t, mscclAlgo *> hostAlgos;
   std::map<mscclAlgoHandle_t, mscclAlgo *> devAlgos;
   struct mscclFlag* syncFlags;
   std::map<size_t, void *> scratchBuffers;
+  size_t scratchPoolBytes; // largest scratch taken from the device pool, see RCCL_MSCCL_SCRATCH_POOL
   size_t nBytes;
   int stepSize;
   int chunkSteps;
@@ -222,11 +253,14 @@ struct mscclStatus {
   mscclSchedulerInterface* mscclSchedulerPtr;
   std::vector<mscclAlgoMeta> algoMetas;
   std::vector<std::map<int, mscclAlgoHandle_t>> rankToAlgoHandles;
+  std::map<uint64_t, struct mscclAlgoIndex> algoIndex;
   bool graphEnabled;
   bool graphFirstKernel;
   bool needsProxy;
   mscclWorkFifoStatus defaultWorkFifoStatus;
   mscclSavedGraphWorkFifoStatus graphWorkFifoStatus;
+  // by algorithm, devRedOp and type, see msccl_jit.cc; nullptr when interpreted
+  std::map<std::pair<struct mscclAlgo*, uint32_t>, hipFunction_t> jitKernels;
 };
 
 #pragma pack(push)
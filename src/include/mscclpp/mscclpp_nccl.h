@@ -36,6 +36,14 @@ extern ncclResult_t  (*mscclpp_ncclAllReduce)(const void* sendbuff, void* recvbu
 extern ncclResult_t  (*mscclpp_ncclAllGather)(const void* sendbuff, void* recvbuff, size_t sendcount,
     ncclDataType_t datatype, mscclpp_ncclComm_t comm, hipStream_t stream);
 
+/* See ncclReduceScatter. Optional, nullptr when the library does not provide it. */
+extern ncclResult_t  (*mscclpp_ncclReduceScatter)(const void* sendbuff, void* recvbuff, size_t recvcount,
+    ncclDataType_t datatype, ncclRedOp_t op, mscclpp_ncclComm_t comm, hipStream_t stream);
+
+/* See ncclAllToAll. Optional, nullptr when the library does not provide it. */
+extern ncclResult_t  (*mscclpp_ncclAllToAll)(const void* sendbuff, void* recvbuff, size_t count,
+    ncclDataType_t datatype, mscclpp_ncclComm_t comm, hipStream_t stream);
+
 namespace std {
   template <>
   struct hash<ncclUniqueId> {
@@ -13,7 +13,7 @@ typedef enum {NCCL_INIT=1, NCCL_COLL=2, NCCL_P2P=4, NCCL_SHM=8, NCCL_NET=16, NCC
 typedef void (*ncclDebugLogger_t)(ncclDebugLogLevel level, unsigned long flags, const char *file, int line, const char *fmt, ...);
 
 #define NCCL_NUM_ONERANK 12
-#define FUNC_INDEX_TOTAL 980 + NCCL_NUM_ONERANK
+#define FUNC_INDEX_TOTAL 1998 + NCCL_NUM_ONERANK
 
 #define NCCL_NUM_FUNCTIONS 5 // Send/Recv not included for now
 typedef enum {
@@ -26,10 +26,11 @@ typedef enum {
   ncclFuncSend = 6,
   ncclFuncRecv = 7,
   ncclFuncAllToAllPivot = 8,
-  ncclNumFuncs = 9
+  ncclFuncAllToAll = 9,
+  ncclNumFuncs = 10
 } ncclFunc_t;
 
-#define NCCL_NUM_ALGORITHMS 6 // Tree/Ring/CollNet*
+#define NCCL_NUM_ALGORITHMS 9 // Tree/Ring/CollNet*/NVLS*/Direct/RHD/Bruck
 #define NCCL_ALGO_UNDEF -1
 #define NCCL_ALGO_TREE 0
 #define NCCL_ALGO_RING 1
@@ -37,6 +38,9 @@ typedef enum {
 #define NCCL_ALGO_COLLNET_CHAIN 3
 #define NCCL_ALGO_NVLS 4
 #define NCCL_ALGO_NVLS_TREE 5
+#define NCCL_ALGO_DIRECT 6
+#define NCCL_ALGO_RHD 7
+#define NCCL_ALGO_BRUCK 8
 
 #define NCCL_NUM_PROTOCOLS 3 // Simple/LL/LL128
 #define NCCL_PROTO_UNDEF -1
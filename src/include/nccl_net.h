@@ -37,7 +37,104 @@ typedef struct {
   int netDeviceVersion;            // Version number for network offload
 } ncclNetProperties_v8_t;
 
-typedef ncclNetProperties_v8_t ncclNetProperties_t;
+typedef ncclNetProperties_v8_t ncclNetProperties_v9_t; // Unchanged in v9
+
+typedef ncclNetProperties_v9_t ncclNetProperties_t;
+
+// One buffer of a scatter-gather send or receive
+typedef struct {
+  void* data;
+  size_t size;
+  void* mhandle;
+} ncclNetIov_v9_t;
+
+// Per-request hints. Plugins may ignore them.
+typedef struct {
+  int priority;     // Requests with higher values should be serviced first, 0 by default
+  int trafficClass; // Traffic class of the request, -1 for the default of the comm
+} ncclNetReqHints_v9_t;
+
+#define NCCL_NET_TRAFFIC_CLASS_UNDEF -1
+
+// Settings of the NCCL communicator a connection belongs to, passed to connect.
+// Fields set to NCCL_NET_TRAFFIC_CLASS_UNDEF keep the plugin default.
+typedef struct {
+  int trafficClass; // Network traffic class (e.g. IB GRH traffic class / RoCE DSCP)
+  int serviceLevel; // Network service level (e.g. IB SL)
+} ncclNetCommConfig_v9_t;
+
+typedef struct {
+  // Name of the network (mainly for logs)
+  const char* name;
+  // Initialize the network.
+  ncclResult_t (*init)(ncclDebugLogger_t logFunction);
+  // Return the number of adapters.
+  ncclResult_t (*devices)(int* ndev);
+  // Get various device properties.
+  ncclResult_t (*getProperties)(int dev, ncclNetProperties_v9_t* props);
+  // Create a receiving object and provide a handle to connect to it. The
+  // handle can be up to NCCL_NET_HANDLE_MAXSIZE bytes and will be exchanged
+  // between ranks to create a connection.
+  ncclResult_t (*listen)(int dev, void* handle, void** listenComm);
+  // Connect to a handle and return a sending comm object for that peer.
+  // This call must not block for the connection to be established, and instead
+  // should return successfully with sendComm == NULL with the expectation that
+  // it will be called again until sendComm != NULL.
+  // If *sendDevComm points to a valid object, then NCCL is requesting device offload for this connection
+  // config may be NULL, and the plugin defaults apply to the whole connection.
+  ncclResult_t (*connect)(int dev, ncclNetCommConfig_v9_t* config, void* handle, void** sendComm, ncclNetDeviceHandle_v9_t** sendDevComm);
+  // Finalize connection establishment after remote peer has called connect.
+  // This call must not block for the connection to be established, and instead
+  // should return successfully with recvComm == NULL with the expectation that
+  // it will be called again until recvComm != NULL.
+  // If *recvDevComm points to a valid object, then NCCL is requesting device offload for this connection
+  ncclResult_t (*accept)(void* listenComm, void** recvComm, ncclNetDeviceHandle_v9_t** recvDevComm);
+  // Register/Deregister memory. Comm can be either a sendComm or a recvComm.
+  // Type is either NCCL_PTR_HOST or NCCL_PTR_CUDA.
+  ncclResult_t (*regMr)(void* comm, void* data, size_t size, int type, void** mhandle);
+  /* DMA-BUF support */
+  ncclResult_t (*regMrDmaBuf)(void* comm, void* data, size_t size, int type, uint64_t offset, int fd, void** mhandle);
+  ncclResult_t (*deregMr)(void* comm, void* mhandle);
+  // Asynchronous send to a peer.
+  // May return request == NULL if the call cannot be performed (or would block)
+  ncclResult_t (*isend)(void* sendComm, void* data, int size, int tag, void* mhandle, void** request);
+  // Asynchronous recv from a peer.
+  // May return request == NULL if the call cannot be performed (or would block)
+  ncclResult_t (*irecv)(void* recvComm, int n, void** data, int* sizes, int* tags, void** mhandles, void** request);
+  // Perform a flush/fence to make sure all data received with NCCL_PTR_CUDA is
+  // visible to the GPU
+  ncclResult_t (*iflush)(void* recvComm, int n, void** data, int* sizes, void** mhandles, void** request);
+  // Test whether a request is complete. If size is not NULL, it returns the
+  // number of bytes sent/received.
+  ncclResult_t (*test)(void* request, int* done, int* sizes);
+  // Close and free send/recv comm objects
+  ncclResult_t (*closeSend)(void* sendComm);
+  ncclResult_t (*closeRecv)(void* recvComm);
+  ncclResult_t (*closeListen)(void* listenComm);
+
+  // Copy the given mhandle to a dptr in a format usable by this plugin's device code
+  ncclResult_t (*getDeviceMr)(void* comm, void* mhandle, void** dptr_mhandle);
+
+  // Notify the plugin that a recv has completed by the device
+  ncclResult_t (*irecvConsumed)(void* recvComm, int n, void* request);
+
+  // The functions below are optional and may be NULL.
+  // Asynchronous send of the n buffers of iov, in order, as a single message.
+  // hints may be NULL.
+  ncclResult_t (*isendv)(void* sendComm, int n, ncclNetIov_v9_t* iov, int tag, ncclNetReqHints_v9_t* hints, void** request);
+  // Asynchronous receive of a single message, scattered over the n buffers of iov in order.
+  // hints may be NULL.
+  ncclResult_t (*irecvv)(void* recvComm, int n, ncclNetIov_v9_t* iov, int tag, ncclNetReqHints_v9_t* hints, void** request);
+  // Test n requests in order and stop at the first one that is not complete. The first
+  // *ndone requests are complete and released, and sizes[i] is the number of bytes sent or
+  // received by request i. Requests must all be sends or all be single receives.
+  ncclResult_t (*testAll)(int n, void** requests, int* ndone, int* sizes);
+} ncclNet_v9_t;
+
+typedef ncclNet_v9_t ncclNet_t;
+typedef ncclNetCommConfig_v9_t ncclNetCommConfig_t;
+
+#define NCCL_NET_PLUGIN_SYMBOL ncclNetPlugin_v9
 
 typedef struct {
   // Name of the network (mainly for logs)
@@ -94,10 +191,6 @@ typedef struct {
   ncclResult_t (*irecvConsumed)(void* recvComm, int n, void* request);
 } ncclNet_v8_t;
 
-typedef ncclNet_v8_t ncclNet_t;
-
-#define NCCL_NET_PLUGIN_SYMBOL ncclNetPlugin_v8
-
 typedef struct {
   void* mhandle;
   void* address;
@@ -0,0 +1,43 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_PROXY_BACKEND_H_
+#define NCCL_PROXY_BACKEND_H_
+
+#include "nccl.h"
+#include "nccl_common.h"
+
+// API to be implemented by an external proxy progress backend, loaded from
+// RCCL_PROXY_BACKEND_PLUGIN. Instead of starting progress threads, RCCL hands
+// each progress engine of its proxies to the backend, which drives it from an
+// execution context of its own: cores isolated from OS noise, or the host side
+// of an agent offloading the network to a DPU. A progress engine covers the
+// network, shared memory and copy engine transfers of its channels.
+
+// Progresses the ops of an engine once, with the device of the engine current.
+// *busy tells whether anything progressed. Once *done is set the engine has
+// stopped and must not be progressed again. An engine must only be progressed
+// by one thread at a time; different engines can be progressed concurrently.
+typedef ncclResult_t (*ncclProxyBackendProgress_v1_t)(void* engine, int* busy, int* done);
+
+typedef struct {
+  // Name of the backend
+  const char* name;
+  // Called once, when the first proxy of the process starts.
+  ncclResult_t (*init)(ncclDebugLogger_t logFunction, void** context);
+  // Takes over an engine of the proxy of device cudaDev. cpuMask lists the CPUs
+  // closest to the GPU or NIC of the proxy as a comma-separated hexadecimal mask,
+  // like Cpus_allowed in /proc/self/status, empty if unknown. Returning an error
+  // makes RCCL start a progress thread for the engine instead.
+  ncclResult_t (*attach)(void* context, int cudaDev, const char* cpuMask, void* engine,
+                         ncclProxyBackendProgress_v1_t progress);
+} ncclProxyBackend_v1_t;
+
+typedef ncclProxyBackend_v1_t ncclProxyBackend_t;
+
+#define NCCL_PROXY_BACKEND_PLUGIN_SYMBOL "ncclProxyBackendPlugin_v1"
+
+#endif
@@ -18,6 +18,12 @@ ncclResult_t ncclNetPluginInit();
 ncclResult_t ncclNetInit(struct ncclComm* comm);
 int ncclNetVersion(struct ncclComm* comm);
 
+// Network settings of the connections of comm, see ncclNet_t connect
+static inline void ncclNetGetCommConfig(struct ncclComm* comm, ncclNetCommConfig_t* config) {
+  config->trafficClass = comm->config.trafficClass == NCCL_CONFIG_UNDEF_INT ? NCCL_NET_TRAFFIC_CLASS_UNDEF : comm->config.trafficClass;
+  config->serviceLevel = comm->config.serviceLevel == NCCL_CONFIG_UNDEF_INT ? NCCL_NET_TRAFFIC_CLASS_UNDEF : comm->config.serviceLevel;
+}
+
 // Test whether the current GPU support GPU Direct RDMA.
 ncclResult_t ncclGpuGdrSupport(struct ncclComm* comm, int* gdrSupport);
 
@@ -33,6 +33,8 @@
 #define NVTX_SID_Scatter       13
 #define NVTX_SID_Send          14
 #define NVTX_SID_Recv          15
+#define NVTX_SID_AllGatherv    16
+#define NVTX_SID_ReduceScatterv 17
 
 // Define static schema ID for the reduction operation.
 #define NVTX_PAYLOAD_ENTRY_NCCL_REDOP 11 + NVTX_PAYLOAD_ENTRY_TYPE_SCHEMA_ID_STATIC_START
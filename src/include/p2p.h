@@ -38,4 +38,8 @@ ncclResult_t ncclP2pAllocateShareableBuffer(size_t size, ncclIpcDesc *ipcDesc, v
 ncclResult_t ncclP2pFreeShareableBuffer(ncclIpcDesc *ipcDesc);
 ncclResult_t ncclP2pImportShareableBuffer(struct ncclComm *comm, int tpPeer, size_t size, ncclIpcDesc *ipcDesc, void **devMemPtr);
 
+// CE memcpy support: copies of a connection are spread over several streams
+#define RCCL_CE_MAX_STREAMS 4
+ncclResult_t ncclCeStreamsCreate(cudaStream_t* streams, int* nStreams);
+
 #endif
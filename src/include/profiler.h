@@ -28,10 +28,20 @@ enum ncclProxyProfileState {
   ncclProxyProfileActive = 17,
 
   ncclProxyProfileAppend = 24,
-  ncclProxyProfileAppendEnd = 25
+  ncclProxyProfileAppendEnd = 25,
+
+  ncclProxyProfileKernelLaunch = 32
 };
 
+// Enabled with NCCL_PROXY_PROFILE=<file>, see src/misc/profiler.cc.
+bool ncclProfilingEnabled();
 ncclResult_t ncclProfilingRecord(struct ncclProxyArgs* args, int sub, int step, int state);
+// Host side of a kernel launch, CLOCK_MONOTONIC nanoseconds.
+ncclResult_t ncclProfilingRecordLaunch(int rank, uint64_t opCount, int nChannels, uint64_t startNs, uint64_t endNs);
+// Writes out the events recorded by the calling thread.
+void ncclProfilingFlush();
+// Same, and frees the thread's ring.
+void ncclProfilingThreadExit();
 void ncclProfilingDump();
 
 #endif
@@ -15,6 +15,7 @@
 #include "ipcsocket.h"
 #include "nccl_net.h"
 #include <pthread.h>
+#include "alloc.h"
 #include "shm.h"
 #include "p2p.h"
 
@@ -57,19 +58,13 @@ struct ncclProxyOp {
   union ncclProxyOpSpecifics specifics;
 
   struct ncclProxyOp *enqNext;
+  uint64_t postTime; // Set when RCCL_PROXY_APPEND_STATS is enabled
 };
 
-struct ncclProxySubArgs {
+// The progress functions mostly touch the step counters, keep them on the first
+// cache line together with the connection; per-step arrays come last.
+struct alignas(64) ncclProxySubArgs {
   struct ncclProxyConnection* connection;
-  int reg;
-  void* buffer;
-  void* mhandle;
-  int channelId;
-  int nsteps;
-  ssize_t nbytes;
-  int peer;
-
-  int groupSize; // Number of consecutive sub operations sharing the same recvComm
   uint64_t base;
   uint64_t posted;
   uint64_t received;
@@ -77,19 +72,31 @@ struct ncclProxySubArgs {
   uint64_t transmitted;
   uint64_t done;
   uint64_t end;
-  void* requests[NCCL_STEPS];
-  void* profilingEvents[NCCL_STEPS];
-  void* recvRequestsCache[NCCL_STEPS];
+
+  int nsteps;
+  int groupSize; // Number of consecutive sub operations sharing the same recvComm
+  int channelId;
+  int peer;
+  int reg;
+  ssize_t nbytes;
+  void* buffer;
+  void* mhandle;
+  void* requests[NCCL_MAX_STEPS];
+  void* profilingEvents[NCCL_MAX_STEPS];
+  uint64_t recvPostNs[NCCL_MAX_STEPS]; // Set when RCCL_STRAGGLER_DETECT is enabled
+  void* flushBatches[NCCL_MAX_STEPS]; // Flush shared with other receives, see NCCL_NET_FLUSH_BATCH
+  void* recvRequestsCache[NCCL_MAX_STEPS];
   int recvRequestsSubCount;
+  int sharedSlabs[NCCL_MAX_STEPS]; // Shared buffer slab held by each posted step, -1 if none
 
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_NET_SEND_ENTRY) && defined(ENABLE_NPKIT_EVENT_NET_SEND_EXIT)
-  int npKitSizesFifo[NCCL_STEPS];
-  uint64_t timestamp[NCCL_STEPS];
+  int npKitSizesFifo[NCCL_MAX_STEPS];
+  uint64_t timestamp[NCCL_MAX_STEPS];
 #endif
 };
 
+// Op header fields read by progressOps on every pass come first, the subs after.
 struct ncclProxyArgs {
-  struct ncclProxySubArgs subs[NCCL_PROXY_MAX_SUBS];
   proxyProgressFunc_t progress;
   int nsubs;
   int done;
@@ -103,8 +110,8 @@ struct ncclProxyArgs {
   uint8_t /*ncclFunc_t*/ coll;
   uint8_t protocol;
   int state;
-  char* sharedBuff[NCCL_STEPS];
-  int sharedSize[NCCL_STEPS];
+  char* sharedBuff[NCCL_MAX_STEPS];
+  int sharedSize[NCCL_MAX_STEPS];
 
   int idle;
   uint64_t hdp_flushed;
@@ -115,6 +122,8 @@ struct ncclProxyArgs {
   struct ncclProxyArgs** proxyAppendPtr;
 
   union ncclProxyOpSpecifics specifics;
+
+  struct ncclProxySubArgs subs[NCCL_PROXY_MAX_SUBS];
 };
 #define NCCL_MAX_NETDEVS 128
 
@@ -123,22 +132,35 @@ struct ncclProxyArgs {
 // Otherwise we'd be unable to post half of them to free new elements.
 #define MAX_OPS_PER_PEER (2*MAXCHANNELS*NCCL_MAX_WORK_ELEMENTS_P2P)
 
-struct ncclProxyOpsPool {
-  struct ncclProxyOp ops[MAX_OPS_PER_PEER*NCCL_MAX_LOCAL_RANKS];
+// Maximum number of progress threads per proxy; ops are sharded across them by channel
+#define NCCL_PROXY_MAX_PROGRESS_THREADS 8
+
+struct ncclProxyPostQueue {
+  // Lock-free MPSC list of posted ops: head owned by the progress thread,
+  // tail swapped by producers (see ncclProxyPost)
   volatile int nextOps;
   volatile int nextOpsEnd;
-  volatile int freeOps[NCCL_MAX_LOCAL_RANKS];
+  volatile int sleeping;
   pthread_mutex_t mutex;
   pthread_cond_t cond;
 };
 
+struct ncclProxyOpsPool {
+  struct ncclProxyOp ops[MAX_OPS_PER_PEER*NCCL_MAX_LOCAL_RANKS];
+  volatile int freeOps[NCCL_MAX_LOCAL_RANKS];
+  // One post queue per progress thread
+  int nQueues;
+  struct ncclProxyPostQueue queues[NCCL_PROXY_MAX_PROGRESS_THREADS];
+};
+
 struct ncclProxyOps {
   ncclProxyOpsPool* pool;
   ncclShmHandle_t handle;
   int count;
   int freeOp;
-  int nextOps;
-  int nextOpsEnd;
+  // Pending (not yet posted) ops for each post queue
+  int nextOps[NCCL_PROXY_MAX_PROGRESS_THREADS];
+  int nextOpsEnd[NCCL_PROXY_MAX_PROGRESS_THREADS];
 };
 
 struct ncclProxySharedP2p {
@@ -146,6 +168,13 @@ struct ncclProxySharedP2p {
   int64_t size;
   char* cudaBuff;
   char* hostBuff;
+  // Slabs of one p2p chunk, leased by posted steps and returned once they complete.
+  // Progress threads shard by channel but share the pool, hence the lock.
+  pthread_mutex_t slabLock;
+  int nSlabs;
+  int nFreeSlabs;
+  int* freeSlabs;
+  int slabHighWater;
   // CUDA IPC
   ncclIpcDesc ipcDesc;
   struct ncclProxyArgs* proxyAppend[MAXCHANNELS]; // Separate send and recv
@@ -164,12 +193,19 @@ struct ncclSharedNetComms {
 };
 
 struct ncclProxyPool;
+#define NCCL_PROXY_APPEND_WAIT_BUCKETS 16
+
 struct ncclProxyProgressState {
   // Used by main threads to send work to progress thread
   struct ncclProxyOpsPool* opsPool;
   ncclShmHandle_t handle;
   char opsPoolShmSuffix[6];
 
+  // Progress thread index and the post queue it consumes
+  struct ncclProxyState* proxyState;
+  int shard;
+  struct ncclProxyPostQueue* queue;
+
   pthread_t thread;
   volatile int stop;
   struct ncclProxyPeer** localPeers;
@@ -178,6 +214,41 @@ struct ncclProxyProgressState {
   struct ncclProxyArgs* pool;
   struct ncclProxyPool* pools;
   int nextOps;
+
+  // Progress policy (see RCCL_PROXY_PROGRESS_MODE) and time accounting, returned by
+  // ncclCommGetStats and only kept when RCCL_STATS_PROXY_TIME is set
+  int progressMode;
+  int timed;
+  uint64_t activeNs, idleNs, sleepNs;
+  // Passes of the progress loop that did something, read by the colltrace watchdog
+  volatile uint64_t progressCount;
+
+  // Adaptive append: current batch of (peer, opCount) groups taken per append,
+  // and the number of active ops after the last progress pass.
+  int appendBatch;
+  int nActive;
+  // Time ops waited in the post queue, log2 buckets of microseconds
+  uint64_t appendWaitHist[NCCL_PROXY_APPEND_WAIT_BUCKETS];
+  int appendBatchMax;
+  // Loop state kept across passes, see proxyProgressPass()
+  int appendCounter;
+  int lastIdle;
+
+  // Progressed by the shared thread of the device (RCCL_PROXY_SHARED_PROGRESS),
+  // or by an external backend (RCCL_PROXY_BACKEND_PLUGIN). sharedDone is set
+  // once either has dropped the engine.
+  int shared;
+  int external;
+  int sharedBusyPoll;
+  volatile int sharedDone;
+  struct ncclProxyProgressState* sharedNext;
+};
+
+enum ncclProxyProgressMode {
+  ncclProxyProgressBusyPoll = 0, // Never yield nor sleep, lowest latency
+  ncclProxyProgressYield    = 1, // sched_yield() when idle, sleep when no ops are posted (default)
+  ncclProxyProgressBackoff  = 2, // Exponential backoff up to RCCL_PROXY_BACKOFF_MAX_US, sleep when no ops are posted
+  ncclProxyProgressNumModes = 3
 };
 
 // Expected proxy response fifo
@@ -256,9 +327,19 @@ struct ncclProxyState {
   void** sharedDevMems;
   struct ncclIpcSocket peerIpcSock; // cuMEM API support (UDS)
   uint64_t *peerAddressesUDS; // cuMem API support (UDS)
+  uint64_t* peerRecvWaitNs; // RCCL_STRAGGLER_DETECT: receive time waiting on each peer
+  struct ncclMemStats memStats; // Buffers allocated by the proxy, see ncclCommGetMemoryInfo
 
   // Progress thread
   struct ncclProxyProgressState progressState;
+  // All progress threads; progressThreads[0] is &progressState, which also holds the setup-time state
+  struct ncclProxyProgressState* progressThreads[NCCL_PROXY_MAX_PROGRESS_THREADS];
+  int nProgressThreads;
+  cpu_set_t cpuAffinity;
+  int highPriority; // Progress threads busy-poll instead of yielding (ncclConfig_t highPriority)
+  int netAffinity; // cpuAffinity is the set of CPUs closest to the NIC rather than to the GPU
+  cpu_set_t* netCpuAffinity; // CPUs closest to each local NIC, indexed by netDev (RCCL_NET_NUMA_ALLOC)
+  int nNetCpuAffinity;
 
   // Queue of expected responses from the proxy
   struct ncclExpectedProxyResponse* expectedResponses;
@@ -327,8 +408,12 @@ ncclResult_t ncclPollProxyResponse(struct ncclComm* comm, struct ncclProxyConnec
 ncclResult_t ncclProxyClientGetFdBlocking(struct ncclComm* comm, int rank, void *handle, int* convertedFd);
 
 ncclResult_t ncclProxyStop(struct ncclComm* comm);
+ncclResult_t ncclProxyWakeAll(struct ncclComm* comm);
 ncclResult_t ncclProxyShmUnlink(struct ncclComm* comm);
 ncclResult_t ncclProxyDestroy(struct ncclComm* comm);
+// Prints the step counters of the active ops on a channel. Unlike the signal dump it only
+// reads the op lists, so it can run while the progress threads are active.
+void ncclProxyDumpChannel(struct ncclProxyState* proxyState, int channelId);
 
 ncclResult_t mscclSaveProxy(struct ncclComm* comm, struct ncclChannel* channel, int type, int peer, struct ncclProxyOp* op, int connIndex);
 #endif
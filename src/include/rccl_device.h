@@ -0,0 +1,109 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef RCCL_DEVICE_H_
+#define RCCL_DEVICE_H_
+
+#include <hip/hip_runtime.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Device-side communication from user kernels. ncclDevWindowCreate() gives every
+// rank of a single-node communicator a buffer that all the other GPUs can access
+// directly over P2P, together with signal counters. Kernels then move data
+// between the windows with ncclDevWindowPut/Get, order it with
+// ncclDevWindowSignal/Wait and reduce it with ncclDevWindowAllReduceSum, at the
+// granularity of a block and without any extra kernel launch.
+//
+// All functions below are block-scoped: every thread of the block must call them.
+
+#define NCCL_DEV_WINDOW_MAX_RANKS 64
+
+typedef struct ncclDevWindow {
+  int rank;
+  int nRanks;
+  size_t size;
+  char* buffs[NCCL_DEV_WINDOW_MAX_RANKS];        // Window of every rank, mapped on this GPU
+  uint64_t* signals[NCCL_DEV_WINDOW_MAX_RANKS];  // Signal counters of every rank, one per sender
+  uint64_t* barriers[NCCL_DEV_WINDOW_MAX_RANKS]; // Barrier counters of every rank, one per sender
+} ncclDevWindow_t;
+
+#if defined(__HIPCC__)
+
+__device__ inline void ncclDevWindowCopy(void* dst, const void* src, size_t bytes) {
+  if ((((uintptr_t)dst | (uintptr_t)src | bytes) & 15) == 0) {
+    uint4* d = (uint4*)dst;
+    const uint4* s = (const uint4*)src;
+    for (size_t i = threadIdx.x; i < bytes/16; i += blockDim.x) d[i] = s[i];
+  } else {
+    char* d = (char*)dst;
+    const char* s = (const char*)src;
+    for (size_t i = threadIdx.x; i < bytes; i += blockDim.x) d[i] = s[i];
+  }
+  __syncthreads();
+}
+
+// Copies bytes from local memory to offset dstOffset of the window of peer
+__device__ inline void ncclDevWindowPut(const ncclDevWindow_t* win, int peer, size_t dstOffset, const void* src, size_t bytes) {
+  ncclDevWindowCopy(win->buffs[peer] + dstOffset, src, bytes);
+}
+
+// Copies bytes from offset srcOffset of the window of peer to local memory
+__device__ inline void ncclDevWindowGet(const ncclDevWindow_t* win, int peer, size_t srcOffset, void* dst, size_t bytes) {
+  ncclDevWindowCopy(dst, win->buffs[peer] + srcOffset, bytes);
+}
+
+// Makes the writes of this block visible to peer, then increments the counter of
+// this rank in the signals of peer
+__device__ inline void ncclDevWindowSignal(const ncclDevWindow_t* win, int peer) {
+  __syncthreads();
+  if (threadIdx.x == 0) {
+    __threadfence_system();
+    __atomic_fetch_add(win->signals[peer] + win->rank, 1, __ATOMIC_RELEASE);
+  }
+  __syncthreads();
+}
+
+// Waits until peer has signalled this rank value times in total
+__device__ inline void ncclDevWindowWait(const ncclDevWindow_t* win, int peer, uint64_t value) {
+  if (threadIdx.x == 0) {
+    while (__atomic_load_n(win->signals[win->rank] + peer, __ATOMIC_ACQUIRE) < value);
+  }
+  __syncthreads();
+}
+
+// Waits for all ranks to reach the barrier. One block per rank takes part, and value
+// is the number of barriers this rank has entered, starting at 1.
+__device__ inline void ncclDevWindowBarrier(const ncclDevWindow_t* win, uint64_t value) {
+  __syncthreads();
+  if (threadIdx.x == 0) __threadfence_system();
+  __syncthreads();
+  for (int peer = threadIdx.x; peer < win->nRanks; peer += blockDim.x) {
+    __atomic_fetch_add(win->barriers[peer] + win->rank, 1, __ATOMIC_RELEASE);
+  }
+  for (int peer = threadIdx.x; peer < win->nRanks; peer += blockDim.x) {
+    while (__atomic_load_n(win->barriers[win->rank] + peer, __ATOMIC_ACQUIRE) < value);
+  }
+  __syncthreads();
+}
+
+// One-shot sum of count elements that every rank placed at offset of its own window.
+// The result goes to dst, which must not overlap the inputs. Two barriers are used,
+// value and value+1: after the second one the inputs may be overwritten.
+template<typename T>
+__device__ inline void ncclDevWindowAllReduceSum(const ncclDevWindow_t* win, size_t offset, size_t count, T* dst, uint64_t value) {
+  ncclDevWindowBarrier(win, value);
+  for (size_t i = threadIdx.x; i < count; i += blockDim.x) {
+    T sum = ((const T*)(win->buffs[0] + offset))[i];
+    for (int r = 1; r < win->nRanks; r++) sum += ((const T*)(win->buffs[r] + offset))[i];
+    dst[i] = sum;
+  }
+  ncclDevWindowBarrier(win, value+1);
+}
+
+#endif
+
+#endif
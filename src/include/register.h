@@ -14,6 +14,9 @@ struct ncclReg {
   int refs;
   uintptr_t addr;
   uint32_t state;
+  // automatic registration (RCCL_NET_AUTO_REGISTER), valid while the allocation is
+  int autoReg;
+  unsigned long long bufferId;
   // net reg
   int nDevs;
   int devs[MAXCHANNELS];
@@ -26,17 +29,27 @@ struct ncclReg {
   int dev;
   CUmemGenericAllocationHandle mcHandle;
   uintptr_t caddrs[NCCL_MAX_LOCAL_RANKS]; /* use to check if NVLS buffers match among intra-node ranks */
+  // idle list (refs == 0), oldest first
+  struct ncclReg* lruPrev;
+  struct ncclReg* lruNext;
 };
 
 struct ncclRegCache {
-  struct ncclReg **slots;
+  struct ncclReg **slots; // sorted by addr
+  uintptr_t* maxEnds;     // maxEnds[i] = max end address of slots[0..i]
   int capacity, population;
   uintptr_t pageSize;
+  // Regions deregistered by the user but kept registered for reuse
+  struct ncclReg* lruHead;
+  struct ncclReg* lruTail;
+  int nIdle;
   void* sComms[MAXCHANNELS];
   void* rComms[MAXCHANNELS];
 };
 
 ncclResult_t ncclRegCleanup(struct ncclComm* comm);
 ncclResult_t ncclRegFind(struct ncclComm* comm, const void* data, size_t size, struct ncclReg** reg);
+ncclResult_t ncclRegIsUserRegistered(struct ncclComm* comm, const void* data, bool* registered);
+ncclResult_t ncclRegAutoRegister(struct ncclComm* comm, const void* data, size_t size, struct ncclReg** reg);
 
 #endif
@@ -69,6 +69,8 @@ DECLARE_ROCM_PFN_EXTERN(hsa_system_get_info);
 DECLARE_ROCM_PFN_EXTERN(hsa_status_string);
 
 ncclResult_t rocmLibraryInit(void);
+// Whether the CPU can reach all of the device memory of cudaDev through the PCI BAR
+int ncclGdrLargeBar(int cudaDev);
 
 extern bool ncclCudaLaunchBlocking; // initialized by ncclCudaLibraryInit()
 
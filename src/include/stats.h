@@ -0,0 +1,71 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_STATS_H_
+#define NCCL_STATS_H_
+
+#include "nccl.h"
+#include "nccl_common.h"
+#include "param.h"
+#include "utils.h"
+
+#define NCCL_STATS_SIZE_BUCKETS 40
+
+// Always-on communicator counters returned by ncclCommGetStats. Everything is
+// updated with relaxed atomics on the enqueue path; proxy time, IB retries and
+// work fifo stalls are read from where they are already kept.
+
+struct ncclStats {
+  uint64_t collCalls[NCCL_STATS_NUM_COLLS];
+  uint64_t collBytes[NCCL_STATS_NUM_COLLS];
+  uint64_t algoProtoCalls[NCCL_STATS_NUM_ALGOS][NCCL_STATS_NUM_PROTOS];
+  uint64_t kernelTimeSamples;
+  uint64_t kernelTimeHist[NCCL_STATS_TIME_BUCKETS];
+  uint64_t timeCount; // eligible launches, to pick the timed ones
+  // Timed launches per collective and log2 of their size, for the metrics exporter
+  uint64_t sizeSamples[NCCL_STATS_NUM_COLLS][NCCL_STATS_SIZE_BUCKETS];
+  uint64_t sizeBytes[NCCL_STATS_NUM_COLLS][NCCL_STATS_SIZE_BUCKETS];
+  uint64_t sizeNs[NCCL_STATS_NUM_COLLS][NCCL_STATS_SIZE_BUCKETS];
+  uint64_t hostOps;
+  uint64_t hostLaunches;
+  uint64_t hostNs[NCCL_STATS_HOST_PHASES];
+};
+
+enum ncclStatsHostPhase {
+  ncclStatsHostAppend = 0,
+  ncclStatsHostPlan = 1,
+  ncclStatsHostUpload = 2,
+  ncclStatsHostLaunch = 3
+};
+
+struct ncclComm;
+struct ncclInfo;
+
+static inline void ncclStatsAdd(uint64_t* counter, uint64_t value) {
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+// One user call, counted when it is enqueued.
+void ncclStatsNoteCall(struct ncclComm* comm, struct ncclInfo* info);
+// One collective scheduled into a plan, with its final algorithm and protocol.
+void ncclStatsNoteColl(struct ncclComm* comm, struct ncclInfo* collInfo);
+// Whether the next single-collective launch should be timed for the histogram.
+bool ncclStatsSampleTime(struct ncclComm* comm);
+void ncclStatsNoteKernelTime(struct ncclComm* comm, int coll, size_t nBytes, float timeUs);
+
+// Proxy progress thread timing, see ncclProxyProgressState::timed.
+RCCL_PARAM_DECLARE(StatsProxyTime);
+
+// Host phase timing: start is 0 unless RCCL_STATS_HOST_TIME is set.
+RCCL_PARAM_DECLARE(StatsHostTime);
+static inline uint64_t ncclStatsHostStart() {
+  return rcclParamStatsHostTime() ? clockNano() : 0;
+}
+static inline void ncclStatsHostEnd(struct ncclStats* stats, enum ncclStatsHostPhase phase, uint64_t start) {
+  if (start) ncclStatsAdd(stats->hostNs + phase, clockNano() - start);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#ifndef NCCL_STRAGGLER_H_
+#define NCCL_STRAGGLER_H_
+
+#include "nccl.h"
+
+// Cross-rank straggler detection, enabled with RCCL_STRAGGLER_DETECT=1. One
+// single-collective launch out of RCCL_STRAGGLER_SAMPLE_INTERVAL is timed on
+// every rank. Since a collective ends at about the same time everywhere, the
+// rank that arrived last has the shortest kernel: max(time) - time is how late
+// each rank was. Every RCCL_STRAGGLER_WINDOW samples the times are allgathered
+// between user groups, like the autotuner exchange, and ranks that are the
+// last to arrive in most samples are reported together with the time the
+// proxy spent waiting on receives from them.
+
+struct ncclStraggler {
+  int window;
+  uint64_t nLaunches; // eligible launches, to pick the sampled ones
+  uint64_t nColls;    // user collectives, to place the exchanges
+  uint64_t nextExchange;
+  bool pending;       // an exchange is due at the next call outside of a group
+  bool internal;      // set while the exchange allgather is enqueued
+  bool exchanging;
+  // Per window slot: launch index (as double, -1 when absent) then time in us
+  double* hostSamples;  // 2*window
+  double* hostSend;     // copy of hostSamples being uploaded
+  double* devSamples;   // 2*window*nRanks, gathered
+  double* hostGathered; // 2*window*nRanks
+  hipEvent_t exchangeEvent;
+  // Accumulated over the communicator's life, per rank
+  double* lateUs;
+  uint64_t* lastCount;
+  uint64_t nSamples;
+  uint64_t* recvWaitNs; // proxy receive wait at the last report
+};
+
+struct ncclComm;
+struct ncclInfo;
+
+ncclResult_t ncclStragglerInit(struct ncclComm* comm);
+ncclResult_t ncclStragglerFree(struct ncclComm* comm);
+// Slot of the window a launch is timed in, -1 when it is not sampled.
+int ncclStragglerSampleSlot(struct ncclComm* comm, uint64_t* key);
+void ncclStragglerReport(struct ncclComm* comm, int slot, uint64_t key, float timeUs);
+// Called for every enqueued operation, before it is added to the group.
+ncclResult_t ncclStragglerProgress(struct ncclComm* comm, struct ncclInfo* info, hipStream_t stream);
+
+#endif
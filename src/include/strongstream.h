@@ -69,7 +69,8 @@ ncclResult_t ncclCudaGraphAddDestructor(struct ncclCudaGraph graph, cudaHostFn_t
  */
 struct ncclStrongStream;
 
-ncclResult_t ncclStrongStreamConstruct(struct ncclStrongStream* ss);
+// priority is a HIP stream priority, 0 being the default
+ncclResult_t ncclStrongStreamConstruct(struct ncclStrongStream* ss, int priority);
 ncclResult_t ncclStrongStreamDestruct(struct ncclStrongStream* ss);
 
 // Acquire-fence the strong stream.
@@ -113,6 +114,13 @@ ncclResult_t ncclStrongStreamWaitStream(
   struct ncclCudaGraph graph, cudaStream_t a, struct ncclStrongStream* b, bool b_subsumes_a=false
 );
 
+// Cause `a` to wait for the current state of `b`, neither being a strong stream.
+// Both must be capturing within `graph` if any. `ss` must be acquired and lends
+// its scratch event, it is left unchanged.
+ncclResult_t ncclStrongStreamWaitStream(
+  struct ncclCudaGraph graph, cudaStream_t a, cudaStream_t b, struct ncclStrongStream* ss
+);
+
 // Synchrnoization does not need the strong stream to be acquired.
 ncclResult_t ncclStrongStreamSynchronize(struct ncclStrongStream* ss);
 
@@ -120,6 +128,8 @@ ncclResult_t ncclStrongStreamSynchronize(struct ncclStrongStream* ss);
 
 struct ncclStrongStreamGraph; // internal to ncclStrongStream
 
+#define NCCL_STRONGSTREAM_MAX_ORDERED 4
+
 struct ncclStrongStream {
   // Used when not graph capturing.
   cudaStream_t cudaStream;
@@ -132,9 +142,13 @@ struct ncclStrongStream {
   // Tracks whether serialEvent needs to be recorded to upon Release().
   bool serialEventNeedsRecord;
   struct ncclStrongStreamGraph* graphHead;
-#else
-  cudaEvent_t scratchEvent;
+  // Streams known to already hold all the work of this one outside of graphs,
+  // because they waited on it or it was fast-forwarded to them, so that waiting
+  // on it again is implied by their order. Forgotten when work is added to it.
+  int orderedCount;
+  cudaStream_t orderedStreams[NCCL_STRONGSTREAM_MAX_ORDERED];
 #endif
+  cudaEvent_t scratchEvent;
 };
 
 #endif
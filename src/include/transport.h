@@ -48,7 +48,7 @@ struct ncclPeerInfo {
   nvmlGpuFabricInfoV_t fabricInfo;
 };
 
-#define CONNECT_SIZE 128
+#define CONNECT_SIZE 256
 struct ncclConnect {
   char data[CONNECT_SIZE];
 };
@@ -105,8 +105,19 @@ struct ncclTransport {
   struct ncclTransportComm recv;
 };
 
+// Pipeline depth of the connections of a transport, from its RCCL_<name>_STEPS
+// parameter. Steps keep the size of the default depth, buffSizes/NCCL_STEPS, so the
+// buffers of a connection are sized with ncclConnBuffSize().
+int ncclTransportSteps(int64_t steps, const char* name);
+static inline int ncclConnBuffSize(int buffSize, int nSteps) { return buffSize/NCCL_STEPS*nSteps; }
+
 ncclResult_t ncclTransportP2pConnect(struct ncclComm* comm, int channelId, int nrecv, int* peerRecv, int nsend, int* peerSend, int connIndex);
 ncclResult_t ncclTransportP2pSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, int connIndex, int* highestTransportType=NULL, bool* needsProxy=NULL);
+ncclResult_t ncclTransportRingConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph, bool* needsProxy);
+ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm, struct ncclTopoGraph* treeGraph, bool* needsProxy);
+ncclResult_t ncclTransportRhdConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph);
+ncclResult_t ncclTransportBruckConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph);
+ncclResult_t ncclTransportCollConnect(struct ncclComm* comm);
 
 // Currently we only support POSIX_FILE_DESCRIPTOR handle exchange
 #define USE_POSIX_FD 1
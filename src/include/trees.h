@@ -9,5 +9,6 @@
 
 ncclResult_t ncclGetBtree(int nranks, int rank, int* u0, int* d1, int* d0, int* parentChildType);
 ncclResult_t ncclGetDtree(int nranks, int rank, int* u0, int* d0_0, int* d0_1, int* parentChildType0, int* u1, int* d1_0, int* d1_1, int* parentChildType1);
+ncclResult_t ncclGetMultiTree(int nranks, int rank, int nTrees, int tree, int* u, int* d0, int* d1, int* parentChildType);
 
 #endif
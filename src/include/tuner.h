@@ -9,6 +9,7 @@
 #define NCCL_INT_TUNER_H_
 
 #include "nccl_tuner.h"
+#include "comm.h"
 
 // Tuning plugin to override NCCL's default algorithm/protocol tuning.
 
@@ -19,4 +20,14 @@ ncclResult_t ncclLoadTunerPlugin(ncclTuner_t** tuner);
 
 // Cleans up NCCL tuner plugin.
 ncclResult_t ncclCloseTunerPlugin(ncclTuner_t** tuner);
+
+// Kernel timing feedback for plugins implementing reportCollTime() and for the
+// built-in autotuner. Start/End bracket the kernel launch of a plan holding a
+// single collective, *timing is left NULL when the launch is not sampled.
+ncclResult_t ncclTunerTimingStart(struct ncclComm* comm, struct ncclKernelPlan* plan, cudaStream_t stream, struct ncclTunerTiming** timing);
+ncclResult_t ncclTunerTimingEnd(struct ncclComm* comm, struct ncclTunerTiming* timing, cudaStream_t stream);
+// Reports completed timings, in launch order.
+ncclResult_t ncclTunerPollTimings(struct ncclComm* comm, bool blocking);
+// Waits for pending timings, reports them and frees the events.
+ncclResult_t ncclTunerTimingsFree(struct ncclComm* comm);
 #endif
@@ -209,8 +209,12 @@ struct ncclMemoryStack {
 
   struct Hunk stub;
   struct Frame topFrame;
+  uint64_t nMallocs; // number of malloc() calls made by the stack so far
 };
 
+// Objects at least this big are not kept in hunks, see allocateSpilled().
+constexpr size_t ncclMemoryStackMaxHunkObject = 16<<20;
+
 inline void ncclMemoryStackConstruct(struct ncclMemoryStack* me) {
   me->stub.above = nullptr;
   me->stub.size = 0;
@@ -219,6 +223,7 @@ inline void ncclMemoryStackConstruct(struct ncclMemoryStack* me) {
   me->topFrame.end = 0;
   me->topFrame.unhunks = nullptr;
   me->topFrame.below = nullptr;
+  me->nMallocs = 0;
 }
 
 inline void* ncclMemoryStack::allocate(struct ncclMemoryStack* me, size_t size, size_t align) {
@@ -8,6 +8,7 @@
 
 #include "nccl.h"
 #include "channel.h"
+#include "chanbudget.h"
 #include "nvmlwrap.h"
 #include "gdrwrap.h"
 #include "bootstrap.h"
@@ -24,9 +25,15 @@
 #include "npkit/npkit.h"
 #endif
 #include "tuner.h"
+#include "autotune.h"
+#include "metrics.h"
+#include "profiler.h"
+#include "hostcoll.h"
+#include "colltiming.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <hip/hip_runtime.h>
+#include <unordered_map>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
@@ -68,9 +75,9 @@
 #endif
 
 const char* ncclFuncStr[NCCL_NUM_FUNCTIONS+2] = { "AllGather", "AllReduce", "AllToAllPivot", "Broadcast", "Reduce", "ReduceScatter", "SendRecv"};
-const char* ncclAlgoStr[NCCL_NUM_ALGORITHMS] = { "Tree", "Ring", "CollNetDirect", "CollNetChain", "NVLS", "NVLSTree" };
+const char* ncclAlgoStr[NCCL_NUM_ALGORITHMS] = { "Tree", "Ring", "CollNetDirect", "CollNetChain", "NVLS", "NVLSTree", "Direct", "RHD", "Bruck" };
 const char* ncclProtoStr[NCCL_NUM_PROTOCOLS] = { "LL", "LL128", "Simple" };
-const char* ncclDevRedOpStr[ncclNumDevRedOps] = { "Sum", "Prod", "MinMax", "PreMulSum", "SumPostDiv" };
+const char* ncclDevRedOpStr[ncclNumDevRedOps] = { "Sum", "Prod", "MinMax", "PreMulSum", "SumPostScale", "SumPostDiv" };
 const char *ncclTypeStr[ncclNumTypes] = {"_i8", "_u8", "_i32", "_u32", "_i64", "_u64", "_f16", "_f32", "_f64", "_b16"};
 
 NCCL_PARAM(GroupCudaStream, "GROUP_CUDA_STREAM", NCCL_GROUP_CUDA_STREAM);
@@ -221,18 +228,99 @@ void NCCL_NO_OPTIMIZE commPoison(ncclComm_t comm) {
 }
 
 RCCL_PARAM(KernelCollTraceEnable, "KERNEL_COLL_TRACE_ENABLE", 0);
+// Watchdog on the colltrace events, also started when KERNEL_COLL_TRACE_ENABLE is not set:
+// a channel running a work item with neither trace events nor proxy progress for this
+// long is reported once, and a collective slower than this many times the median of
+// the same kernel and size is warned about. 0 disables either check.
+RCCL_PARAM(KernelCollTraceWatchdogMs, "KERNEL_COLL_TRACE_WATCHDOG_MS", 0);
+RCCL_PARAM(KernelCollTraceSlowdown, "KERNEL_COLL_TRACE_SLOWDOWN", 0);
 
 #ifdef ENABLE_COLLTRACE
+#define COLLTRACE_MEDIAN_SAMPLES 32
+#define COLLTRACE_MEDIAN_MIN_SAMPLES 8
+
+// Work item in flight on a channel, as seen from its launch event
+struct collTraceChannel {
+  uint64_t lastEventNs;
+  uint64_t startTs;   // GPU time of the launch event, 0 when the channel is idle
+  uint64_t opCount;
+  int16_t funcIndex;
+  int16_t peers[2];   // recv and send peers of p2p work, -1 otherwise
+  uint8_t countLog2;
+  bool p2p, sampled, reported;
+};
+
+struct collTraceMedian {
+  float us[COLLTRACE_MEDIAN_SAMPLES];
+  int n, next;
+};
+
+// Compares a collective with the running median of the same kernel and size, then adds it
+static void collTraceSlowdown(struct ncclComm* comm, std::unordered_map<uint32_t, struct collTraceMedian>& medians,
+    int channel, struct collTraceChannel* ch, float us) {
+  struct collTraceMedian& m = medians[((uint32_t)ch->funcIndex << 8) | ch->countLog2];
+  if (m.n >= COLLTRACE_MEDIAN_MIN_SAMPLES) {
+    float sorted[COLLTRACE_MEDIAN_SAMPLES];
+    memcpy(sorted, m.us, m.n*sizeof(float));
+    std::nth_element(sorted, sorted + m.n/2, sorted + m.n);
+    float median = sorted[m.n/2];
+    if (us > median*rcclParamKernelCollTraceSlowdown()) {
+      WARN("Watchdog: rank %d channel %d %s opCount %lx count 2^%d took %.1f us, %.1fx the median of %.1f us",
+          comm->rank, channel, funcNames[ch->funcIndex], ch->opCount, ch->countLog2, us, us/median, median);
+    }
+  }
+  m.us[m.next] = us;
+  m.next = (m.next+1) % COLLTRACE_MEDIAN_SAMPLES;
+  m.n = std::min(m.n+1, COLLTRACE_MEDIAN_SAMPLES);
+}
+
+static void collTraceHang(struct ncclComm* comm, int channel, struct collTraceChannel* ch, uint64_t stalledNs) {
+  if (ch->p2p) {
+    WARN("Watchdog: rank %d channel %d no progress for %lu ms in %s opCount %lx, recv peer %d send peer %d",
+        comm->rank, channel, stalledNs/1000000, funcNames[ch->funcIndex], ch->opCount, ch->peers[0], ch->peers[1]);
+  } else {
+    struct ncclChannel* c = comm->channels+channel;
+    WARN("Watchdog: rank %d channel %d no progress for %lu ms in %s opCount %lx, ring %d->%d->%d tree up %d down %d/%d/%d",
+        comm->rank, channel, stalledNs/1000000, funcNames[ch->funcIndex], ch->opCount, c->ring.prev, comm->rank, c->ring.next,
+        c->tree.up, c->tree.down[0], c->tree.down[1], c->tree.down[2]);
+  }
+  if (comm->proxyState) ncclProxyDumpChannel(comm->proxyState, channel);
+}
+
+static uint64_t collTraceProxyProgress(struct ncclComm* comm) {
+  uint64_t count = 0;
+  if (comm->proxyState == NULL) return 0;
+  for (int t = 0; t < comm->proxyState->nProgressThreads; t++) {
+    if (comm->proxyState->progressThreads[t]) count += comm->proxyState->progressThreads[t]->progressCount;
+  }
+  return count;
+}
+
+// Seconds on the host CLOCK_MONOTONIC when the GPU clock is synchronized, so
+// that the trace lines up with NCCL_PROXY_PROFILE; GPU wall clock otherwise.
+static double collTraceTime(struct ncclComm* comm, uint64_t timeStamp, double freq) {
+  if (comm->clockSync.valid) return ncclClockGpuToHostNs(&comm->clockSync, timeStamp) / 1.0E9;
+  return (double)timeStamp / freq;
+}
+
 // Should be in sync with 'ALL_COLLS' in Generator.cmake
 void *ncclCommThreadMain(void *arg) {
   ncclComm_t comm = (ncclComm_t)arg;
   int head[MAXCHANNELS];
   double vega_gpu_rtc_freq;
+  const bool print = ncclDebugLevel >= NCCL_LOG_INFO && rcclParamKernelCollTraceEnable();
+  const uint64_t watchdogNs = std::max<int64_t>(rcclParamKernelCollTraceWatchdogMs(), 0)*1000000;
+  const bool slowdown = rcclParamKernelCollTraceSlowdown() > 0;
+  struct collTraceChannel channels[MAXCHANNELS];
+  std::unordered_map<uint32_t, struct collTraceMedian> medians;
+  uint64_t proxyProgress = 0;
 
   memset(head, 0, sizeof(int)*MAXCHANNELS);
+  memset(channels, 0, sizeof(channels));
   vega_gpu_rtc_freq = GetDeviceWallClockRateInKhz(comm->cudaDev) * 1.0E3;
   do {
     int numActiveChans = MAXCHANNELS;
+    uint64_t now = clockNano();
     for (int channel = 0; channel < MAXCHANNELS; channel++) {
       int tail = comm->collTraceTail[channel].tail%COLLTRACE_NUM_ITEMS;
       int count;
@@ -249,18 +337,45 @@ void *ncclCommThreadMain(void *arg) {
         uint8_t type = td->type;
         if (type == ncclCollTraceNotReady)
           break;
+        struct collTraceChannel* ch = channels+channel;
+        ch->lastEventNs = now;
+        ch->reported = false;
+        if (type != ncclCollTraceDataType && type != ncclCollTraceCollElemType && type != ncclCollTraceP2pElemType) {
+          uint8_t event = type&0xf;
+          // A work item ends at the next launch on its channel or at the kernel end
+          if (ch->startTs && ch->sampled && slowdown && event != ncclCollTraceAbortType)
+            collTraceSlowdown(comm, medians, channel, ch, (td->timeStamp - ch->startTs)*1.0E6/vega_gpu_rtc_freq);
+          ch->startTs = 0;
+          if (event == ncclCollTraceKernelLaunchType || event == ncclCollTraceCollLaunchType) {
+            ch->startTs = td->timeStamp;
+            ch->funcIndex = td->funcIndex;
+            ch->p2p = (type&0xf0) == ncclCollTraceP2pElemType;
+            ch->opCount = ch->p2p ? td->p2pOpCount[0] : td->opCount;
+            ch->peers[0] = ch->p2p ? td->p2p[0].peer : -1;
+            ch->peers[1] = ch->p2p ? td->p2p[1].peer : -1;
+            ch->countLog2 = td->coll.countLog2;
+            // One sample per collective, from its first channel
+            ch->sampled = (type&0xf0) == ncclCollTraceCollElemType && td->coll.bid == 0;
+          }
+        }
+        if (!print) {
+          td->type = ncclCollTraceNotReady;
+          head[channel] ++;
+          head[channel] %= COLLTRACE_NUM_ITEMS;
+          continue;
+        }
         char line[1024];
         int offset = 0;
         uint16_t fIdx = td->funcIndex;
         if (type == ncclCollTraceDataType) {
           sprintf(line, "## [%012.6f] [%02d:%02d] L:%04d DT %08x %016lx %016lx",
-            (double)(td->timeStamp)/vega_gpu_rtc_freq, comm->rank, td->bid,
+            collTraceTime(comm, td->timeStamp, vega_gpu_rtc_freq), comm->rank, td->bid,
             fIdx, td->data_0, td->opCount, td->data_1);
         } else {
           if (fIdx == ncclDevFuncId_P2p() || type == ncclCollTraceP2pElemType)
-            sprintf(line, "## [%012.6f] [%02d:%02d] %06x-%06x", (double)(td->timeStamp)/vega_gpu_rtc_freq, comm->rank, td->bid, td->p2pOpCount[0], td->p2pOpCount[1]);
+            sprintf(line, "## [%012.6f] [%02d:%02d] %06x-%06x", collTraceTime(comm, td->timeStamp, vega_gpu_rtc_freq), comm->rank, td->bid, td->p2pOpCount[0], td->p2pOpCount[1]);
           else
-            sprintf(line, "## [%012.6f] [%02d:%02d] %06lx", (double)(td->timeStamp)/vega_gpu_rtc_freq, comm->rank, td->bid, td->opCount);
+            sprintf(line, "## [%012.6f] [%02d:%02d] %06lx", collTraceTime(comm, td->timeStamp, vega_gpu_rtc_freq), comm->rank, td->bid, td->opCount);
           offset = strlen(line);
           if (type == ncclCollTraceCollElemType) {
             sprintf(line+offset, " CE %s nw %d bi %d nc %d busId %lx nRanks %d", funcNames[fIdx], td->coll.nWarps, td->coll.bid, td->coll.nChannels, comm->busId, comm->nRanks);
@@ -302,6 +417,21 @@ void *ncclCommThreadMain(void *arg) {
         head[channel] %= COLLTRACE_NUM_ITEMS;
       }
     }
+    if (watchdogNs) {
+      // Proxy progress counts for every channel, it is not tracked per channel
+      uint64_t progress = collTraceProxyProgress(comm);
+      bool proxyMoved = progress != proxyProgress;
+      proxyProgress = progress;
+      for (int channel = 0; channel < MAXCHANNELS; channel++) {
+        struct collTraceChannel* ch = channels+channel;
+        if (ch->startTs == 0) continue;
+        if (proxyMoved) ch->lastEventNs = now;
+        if (!ch->reported && now - ch->lastEventNs > watchdogNs) {
+          collTraceHang(comm, channel, ch, now - ch->lastEventNs);
+          ch->reported = true;
+        }
+      }
+    }
     if (comm->collTraceExit && numActiveChans == 0)
       break;
     usleep(1000); //sleep 1ms
@@ -369,6 +499,9 @@ static ncclResult_t commFree(ncclComm_t comm) {
   /* in commReclaim, we have guaranteed only last rank which calls ncclCommDestroy() will
    * free all intra-process communicators; therefore, we only need to focus on local
    * resource cleanup in commFree(). */
+  NCCLCHECK(ncclMetricsDeregister(comm));
+  ncclChannelBudgetUnregister(comm);
+  NCCLCHECK(ncclPrepareWorkerFree(comm));
   if (comm->proxyState && comm->proxyRefCountOld == 0 && comm->proxyState->thread) {
     pthread_join(comm->proxyState->thread, nullptr);
     if (comm->proxyState->threadUDS) {
@@ -377,10 +510,38 @@ static ncclResult_t commFree(ncclComm_t comm) {
     }
   }
 
+  for (int i = 0; i < comm->userRedOpCapacity; i++) {
+    if (comm->userRedOps[i].freeNext == -1 && comm->userRedOps[i].devArgs) ncclCudaFree(comm->userRedOps[i].devArgs);
+  }
   delete[] comm->userRedOps;
 
+  if (*comm->abortFlag == 0) NCCLCHECK(ncclClockSyncFinalize(comm));
+  // Kernel launches recorded by this thread
+  ncclProfilingFlush();
+
   free(comm->connectSend);
   free(comm->connectRecv);
+  if (comm->tuningCache) {
+    INFO(NCCL_TUNING, "Tuning cache: %lu hits, %lu misses", comm->tuningCacheHits, comm->tuningCacheMisses);
+    free(comm->tuningCache);
+  }
+  free(comm->runtimeRingGraph);
+  free(comm->runtimeTreeGraph);
+  free(comm->splitGraphs);
+
+  free(comm->a2avCounts);
+  free(comm->a2avOffsets);
+  if (comm->a2avStaging) NCCLCHECK(ncclCudaFree(comm->a2avStaging));
+  if (comm->accumStaging) NCCLCHECK(ncclCudaFree(comm->accumStaging));
+  if (comm->orderedStaging) NCCLCHECK(ncclCudaFree(comm->orderedStaging));
+  if (comm->compressStaging) NCCLCHECK(ncclCudaFree(comm->compressStaging));
+  if (comm->gatherStaging) NCCLCHECK(ncclCudaFree(comm->gatherStaging));
+  free(comm->sparseCounts);
+  if (comm->sparseStaging) NCCLCHECK(ncclCudaFree(comm->sparseStaging));
+  NCCLCHECK(ncclCeAllGatherFree(comm));
+  NCCLCHECK(ncclDevWindowFreeAll(comm));
+  NCCLCHECK(ncclWinFreeAll(comm));
+  NCCLCHECK(ncclHostCollFree(comm));
 
 #ifdef ENABLE_PROFILING
   struct ncclProf *prof, *prof_seq;
@@ -425,6 +586,9 @@ static ncclResult_t commFree(ncclComm_t comm) {
 
   if (comm->doneEvent != NULL)
     CUDACHECK(hipEventDestroy(comm->doneEvent));
+  for (int p=0; p<comm->nStreamParts; p++) {
+    if (comm->partDoneEvents[p] != NULL) CUDACHECK(hipEventDestroy(comm->partDoneEvents[p]));
+  }
 
   if (comm->sharedRes) {
     if (ncclAtomicRefCountDecrement(&comm->sharedRes->refCount) == 0) {
@@ -480,6 +644,8 @@ NCCL_PARAM(DisableGraphHelper, "GRAPH_HELPER_DISABLE", 0);
 // GDRCOPY support: FIFO_ENABLE when enabled locates a workFifo in CUDA memory
 NCCL_PARAM(GdrCopyFifoEnable, "GDRCOPY_FIFO_ENABLE", 1);
 NCCL_PARAM(WorkFifoDepth, "WORK_FIFO_DEPTH", 256<<10);
+RCCL_PARAM(WorkFifoInitDepth, "WORK_FIFO_INIT_DEPTH", 16<<10);
+RCCL_PARAM(StreamPartitions, "STREAM_PARTITIONS", 1);
 enum ncclLaunchMode ncclParamLaunchMode;
 
 
@@ -561,22 +727,37 @@ static ncclResult_t commAlloc(struct ncclComm* comm, struct ncclComm* parent, in
 
   comm->doneEvent = doneEvent;
   comm->lastStream = nullptr;
+  comm->nStreamParts = rcclParamStreamPartitions() > 1 ? std::min((int)rcclParamStreamPartitions(), RCCL_MAX_STREAM_PARTS) : 0;
+  for (int p=0; p<comm->nStreamParts; p++) {
+    CUDACHECK(hipEventCreateWithFlags(comm->partDoneEvents+p, hipEventDisableTiming));
+  }
   CUDACHECK(cudaGetDevice(&comm->cudaDev));
 
   NCCLCHECK(getBusId(comm->cudaDev, &comm->busId));
   comm->compCap = ncclCudaCompCap();
   TRACE(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx compCap %d", comm, rank, ndev, comm->cudaDev, comm->busId, comm->compCap);
 
+  // Latency critical communicators get the highest stream priority for their internal streams.
+  // Kernels run on the user stream, whose own priority applies per call.
+  int streamPriority = 0;
+  if (comm->config.highPriority) {
+    int leastPriority;
+    CUDACHECK(cudaDeviceGetStreamPriorityRange(&leastPriority, &streamPriority));
+    INFO(NCCL_INIT, "comm %p rank %d using stream priority %d", comm, rank, streamPriority);
+  }
+
   // RCCL: create persistent stream for calloc
-  CUDACHECK(hipStreamCreateWithFlags(&comm->sideStream, hipStreamNonBlocking));
+  CUDACHECK(hipStreamCreateWithPriority(&comm->sideStream, hipStreamNonBlocking, streamPriority));
   comm->checkPointers = ncclParamCheckPointers() == 1 ? true : false;
   comm->dmaBufSupport = (dmaBufSupported(comm) == ncclSuccess) ? true : false;
 
 #ifdef ENABLE_COLLTRACE
   NCCLCHECK(ncclCudaHostCalloc(&comm->collTraceTail, MAXCHANNELS));
   NCCLCHECK(ncclCudaHostCalloc(&comm->collTrace, COLLTRACE_NUM_ITEMS*MAXCHANNELS));
+  ncclMemStatsAdd(&comm->memStats, ncclMemOther, true, COLLTRACE_NUM_ITEMS*MAXCHANNELS*sizeof(struct ncclCollTrace));
   comm->collTraceExit = 0;
-  if ((ncclDebugLevel >= NCCL_LOG_INFO) && rcclParamKernelCollTraceEnable())
+  if (((ncclDebugLevel >= NCCL_LOG_INFO) && rcclParamKernelCollTraceEnable()) ||
+      rcclParamKernelCollTraceWatchdogMs() > 0 || rcclParamKernelCollTraceSlowdown() > 0)
     pthread_create(&comm->collTraceThread, NULL, ncclCommThreadMain, (void *)comm);
   else
     comm->collTraceThread = 0;
@@ -607,8 +788,8 @@ static ncclResult_t commAlloc(struct ncclComm* comm, struct ncclComm* parent, in
     sharedRes->owner = comm;
     sharedRes->tpNRanks = comm->nRanks;
     NCCLCHECK(ncclCalloc(&sharedRes->tpRankToLocalRank, comm->nRanks));
-    NCCLCHECK(ncclStrongStreamConstruct(&sharedRes->deviceStream));
-    NCCLCHECK(ncclStrongStreamConstruct(&sharedRes->hostStream));
+    NCCLCHECK(ncclStrongStreamConstruct(&sharedRes->deviceStream, streamPriority));
+    NCCLCHECK(ncclStrongStreamConstruct(&sharedRes->hostStream, streamPriority));
     comm->sharedRes = sharedRes;
     sharedRes->refCount = 1;
   } else {
@@ -638,6 +819,7 @@ static ncclResult_t devCommSetup(ncclComm_t comm) {
   NCCLCHECKGOTO(ncclStrongStreamAcquireUncaptured(&comm->sharedRes->deviceStream), ret, fail);
   NCCLCHECKGOTO(ncclCudaCallocAsync(&devCommAndChans, 1, comm->sharedRes->deviceStream.cudaStream), ret, fail);
   ncclCommPushCudaFree(comm, devCommAndChans);
+  ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, sizeof(struct ncclDevCommAndChannels));
   comm->devComm = &devCommAndChans->comm;
   tmpCommAndChans.comm.rank = comm->rank;
   tmpCommAndChans.comm.nRanks = nRanks;
@@ -650,37 +832,55 @@ static ncclResult_t devCommSetup(ncclComm_t comm) {
   tmpCommAndChans.comm.p2pChunkSize = comm->p2pChunkSize;
   tmpCommAndChans.comm.channels = &devCommAndChans->channels[0];
 
-  comm->workFifoDepth = ncclParamWorkFifoDepth();
-  if (0 != (comm->workFifoDepth & (comm->workFifoDepth-1))) {
-    WARN("NCCL_WORK_FIFO_DEPTH=%d is being ignored because it is not a power of 2.", comm->workFifoDepth);
-    comm->workFifoDepth = 64<<10;
+  comm->workFifoMaxDepth = ncclParamWorkFifoDepth();
+  if (0 != (comm->workFifoMaxDepth & (comm->workFifoMaxDepth-1))) {
+    WARN("NCCL_WORK_FIFO_DEPTH=%d is being ignored because it is not a power of 2.", comm->workFifoMaxDepth);
+    comm->workFifoMaxDepth = 64<<10;
+  }
+  // Start small and let the fifo grow up to NCCL_WORK_FIFO_DEPTH when launches run out of it.
+  comm->workFifoDepth = comm->workFifoMaxDepth;
+  if (rcclParamWorkFifoInitDepth() > 0) {
+    int64_t initDepth = rcclParamWorkFifoInitDepth();
+    if (0 != (initDepth & (initDepth-1))) {
+      WARN("RCCL_WORK_FIFO_INIT_DEPTH=%ld is being ignored because it is not a power of 2.", initDepth);
+    } else {
+      comm->workFifoDepth = std::min<int64_t>(initDepth, comm->workFifoMaxDepth);
+    }
   }
   tmpCommAndChans.comm.workFifoDepth = comm->workFifoDepth;
 
-  if (ncclGdrCopy != NULL && ncclParamGdrCopyFifoEnable() == 1) {
-    // The workFifoHeap lives in GDR mapped CUDA memory.
-    NCCLCHECKGOTO(ncclGdrCudaCalloc(&comm->workFifoHeap, &comm->devWorkFifoHeap, comm->workFifoDepth, &comm->workFifoHeapGdrHandle, comm->sideStream), ret, fail);
-    ncclCommPushCudaGdrFree(comm, comm->workFifoHeapGdrHandle);
-  } else {
-    // The workFifoHeap lives in cudaHost memory.
-    comm->workFifoHeapGdrHandle = nullptr;
-    NCCLCHECKGOTO(ncclCudaHostCalloc(&comm->workFifoHeap, comm->workFifoDepth), ret, fail);
-    ncclCommPushCudaHostFree(comm, comm->workFifoHeap);
-    comm->devWorkFifoHeap = comm->workFifoHeap;
-  }
+  NCCLCHECKGOTO(ncclWorkFifoAlloc(comm, comm->workFifoDepth, &comm->workFifoHeap, &comm->devWorkFifoHeap, &comm->workFifoHeapGdrHandle), ret, fail);
   tmpCommAndChans.comm.workFifoHeap = comm->devWorkFifoHeap;
 
   NCCLCHECKGOTO(ncclCudaHostCalloc(&comm->workFifoDone, MAXCHANNELS), ret, fail);
   ncclCommPushCudaHostFree(comm, comm->workFifoDone);
+  ncclMemStatsAdd(&comm->memStats, ncclMemWorkFifo, true, MAXCHANNELS*sizeof(*comm->workFifoDone));
   comm->workFifoSent = 0;
   comm->workFifoAckdMin = 0;
 
   if (comm->collNetDenseToUserRank != nullptr) {
     NCCLCHECKGOTO(ncclCudaCallocAsync(&tmpCommAndChans.comm.collNetDenseToUserRank, nRanks, comm->sharedRes->deviceStream.cudaStream), ret, fail);
     ncclCommPushCudaFree(comm, tmpCommAndChans.comm.collNetDenseToUserRank);
+    ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, nRanks*sizeof(int));
     NCCLCHECKGOTO(ncclCudaMemcpyAsync(tmpCommAndChans.comm.collNetDenseToUserRank, comm->collNetDenseToUserRank, nRanks, comm->sharedRes->deviceStream.cudaStream), ret, fail);
   }
 
+  tmpCommAndChans.comm.treeUps = nullptr;
+  if (comm->treeUps != nullptr) {
+    NCCLCHECKGOTO(ncclCudaCallocAsync(&tmpCommAndChans.comm.treeUps, comm->nChannels*nRanks, comm->sharedRes->deviceStream.cudaStream), ret, fail);
+    ncclCommPushCudaFree(comm, tmpCommAndChans.comm.treeUps);
+    ncclMemStatsAdd(&comm->memStats, ncclMemChannels, false, comm->nChannels*nRanks*sizeof(*comm->treeUps));
+    NCCLCHECKGOTO(ncclCudaMemcpyAsync(tmpCommAndChans.comm.treeUps, comm->treeUps, comm->nChannels*nRanks, comm->sharedRes->deviceStream.cudaStream), ret, fail);
+  }
+
+  if (comm->bruckSupport && comm->bruckScratchBlocks && comm->bruckScratchBytes) {
+    // Bruck ReduceScatter scratch, one region per channel
+    NCCLCHECKGOTO(ncclCudaCallocAsync((char**)&comm->bruckScratch, comm->bruckScratchBytes*comm->brucknChannels, comm->sharedRes->deviceStream.cudaStream), ret, fail);
+    ncclCommPushCudaFree(comm, comm->bruckScratch);
+    ncclMemStatsAdd(&comm->memStats, ncclMemOther, false, comm->bruckScratchBytes*comm->brucknChannels);
+    for (int c=0; c < comm->brucknChannels; c++) comm->channels[c].bruck.scratch = (char*)comm->bruckScratch + c*comm->bruckScratchBytes;
+  }
+
   for (int c=0; c < MAXCHANNELS; c++) {
     tmpCommAndChans.channels[c].peers = comm->channels[c].devPeers;
     tmpCommAndChans.channels[c].ring = comm->channels[c].ring;
@@ -690,6 +890,8 @@ static ncclResult_t devCommSetup(ncclComm_t comm) {
     tmpCommAndChans.channels[c].collnetDirect = comm->channels[c].collnetDirect;
     tmpCommAndChans.channels[c].binTree = comm->channels[c].binTree;
     tmpCommAndChans.channels[c].nvls = comm->channels[c].nvls;
+    tmpCommAndChans.channels[c].rhd = comm->channels[c].rhd;
+    tmpCommAndChans.channels[c].bruck = comm->channels[c].bruck;
     tmpCommAndChans.channels[c].workFifoDone = &comm->workFifoDone[c];
 
     if (comm->channels[c].ring.userRanks != nullptr) {
@@ -703,12 +905,15 @@ static ncclResult_t devCommSetup(ncclComm_t comm) {
   tmpCommAndChans.comm.collTraceThread = comm->collTraceThread;
 #endif
 
+  NCCLCHECKGOTO(ncclCollTimingsSetup(comm, &tmpCommAndChans.comm), ret, fail);
+
 #if defined(ENABLE_NPKIT)
   // Init NPKit
   NCCLCHECK(NpKit::Init(comm->rank));
   tmpCommAndChans.comm.npKitEventCollectContexts = NpKit::GetGpuEventCollectContexts();
   tmpCommAndChans.comm.cpuTimestamp = NpKit::GetCpuTimestamp();
 #endif
+  NCCLCHECKGOTO(ncclClockSyncInit(comm), ret, fail);
 
 #ifdef ENABLE_PROFILING
   NCCLCHECK(ncclCudaCalloc(&tmpCommAndChans.comm.devProf, MAXCHANNELS*PROFILE_NUM_LAUNCHES, comm->sideStream));
@@ -853,7 +1058,9 @@ NCCL_PARAM(P2pNetChunkSize, "P2P_NET_CHUNKSIZE", (1 << 17)); /* 128 kB */
 NCCL_PARAM(P2pPciChunkSize, "P2P_PCI_CHUNKSIZE", (1 << 17)); /* 128 kB */
 NCCL_PARAM(P2pNvlChunkSize, "P2P_NVL_CHUNKSIZE", (1 << 19)); /* 512 kB */
 
-static ncclResult_t computeBuffSizes(struct ncclComm* comm) {
+RCCL_PARAM(SkipUnusedProtoBuffers, "SKIP_UNUSED_PROTO_BUFFERS", 1);
+
+static ncclResult_t computeBuffSizes(struct ncclComm* comm, struct ncclTopoGraph** graphs) {
   int cpuArch, cpuVendor, cpuModel;
   NCCLCHECK(ncclTopoCpuType(comm->topo, &cpuArch, &cpuVendor, &cpuModel));
 
@@ -864,6 +1071,24 @@ static ncclResult_t computeBuffSizes(struct ncclComm* comm) {
     comm->buffSizes[p] = envs[p] != -2 ? envs[p] : defaults[p];
   }
 
+  // Don't allocate LL/LL128 buffers when the tuning model can never select them. SIMPLE is
+  // always needed for p2p. MSCCL algorithms pick their own protocol, so keep everything then.
+  if (rcclParamSkipUnusedProtoBuffers() && !(mscclEnabled() && (comm->topo->mscclEnabled || mscclForceEnabled()))) {
+    int protoEnable[NCCL_NUM_ALGORITHMS][NCCL_NUM_PROTOCOLS];
+    NCCLCHECK(ncclTopoGetProtoEnable(comm, graphs, protoEnable));
+    for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+      if (p == NCCL_PROTO_SIMPLE) continue;
+      bool used = false;
+      for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) used |= protoEnable[a][p] != 0;
+      // Split communicators sharing resources must not use protocols their parent skipped
+      if (comm->sharedRes->owner != comm && comm->sharedRes->owner->buffSizes[p] == 0) used = false;
+      if (!used) {
+        INFO(NCCL_INIT, "Protocol %s is not used, skipping its buffers", ncclProtoStr[p]);
+        comm->buffSizes[p] = 0;
+      }
+    }
+  }
+
   // MNNVL support
   if (!comm->MNNVL && comm->nNodes > 1) comm->p2pChunkSize = ncclParamP2pNetChunkSize();
   else if (comm->MNNVL || ncclTopoPathAllNVLink(comm->topo)) comm->p2pChunkSize = ncclParamP2pNvlChunkSize();
@@ -886,6 +1111,8 @@ static ncclResult_t computeBuffSizes(struct ncclComm* comm) {
 NCCL_PARAM(GraphDumpFileRank, "GRAPH_DUMP_FILE_RANK", 0);
 NCCL_PARAM(CollNetNodeThreshold, "COLLNET_NODE_THRESHOLD", 2);
 NCCL_PARAM(NvbPreconnect, "NVB_PRECONNECT", 0);
+NCCL_PARAM(RuntimeConnect, "RUNTIME_CONNECT", 0);
+RCCL_PARAM(P2pPreconnect, "P2P_PRECONNECT", 0);
 NCCL_PARAM(AllocP2pNetLLBuffers, "ALLOC_P2P_NET_LL_BUFFERS", 0);
 
 static ncclResult_t collNetTrySetup(ncclComm_t comm, ncclComm_t parent, struct ncclTopoGraph* collNetGraph) {
@@ -1122,6 +1349,86 @@ fail:
 
 // MNNVL: Flag to indicate whether to enable Multi-Node NVLink
 NCCL_PARAM(MNNVL, "MNNVL", -2);
+RCCL_PARAM(CommSplitReuseGraphs, "COMM_SPLIT_REUSE_GRAPHS", 0);
+RCCL_PARAM(DirectAllReduceEnable, "DIRECT_ALLREDUCE_ENABLE", 1);
+RCCL_PARAM(DirectNChannels, "DIRECT_NCHANNELS", 8);
+RCCL_PARAM(DirectOneShotThreshold, "DIRECT_ONESHOT_THRESHOLD", 262144);
+RCCL_PARAM(TreeBcastReduceEnable, "TREE_BCAST_REDUCE_ENABLE", 1);
+
+// Tree Broadcast and Reduce walk the trees from the collective root, which needs
+// the tree parent of every rank on every channel. RCCL_TREE_BCAST_REDUCE_ENABLE=2
+// also sets them up on single node comms, whose trees are chains.
+static ncclResult_t rootedTreeSetup(struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  int nRanks = comm->nRanks, nChannels = comm->nChannels;
+  int* ups = NULL;
+  comm->rootedTreeSupport = rcclParamTreeBcastReduceEnable() == 2 || (rcclParamTreeBcastReduceEnable() && comm->nNodes > 1);
+  if (!comm->rootedTreeSupport) return ncclSuccess;
+  NCCLCHECK(ncclCalloc(&ups, nRanks*nChannels));
+  for (int c=0; c<nChannels; c++) ups[comm->rank*nChannels+c] = comm->channels[c].tree.up;
+  NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, ups, nChannels*sizeof(int)), ret, exit);
+  comm->treeUps = ncclMemoryStackAlloc<int>(&comm->memPermanent, nChannels*nRanks);
+  for (int c=0; c<nChannels; c++) {
+    for (int r=0; r<nRanks; r++) comm->treeUps[c*nRanks+r] = ups[r*nChannels+c];
+  }
+  INFO(NCCL_INIT, "Tree Broadcast and Reduce enabled on %d channels", nChannels);
+exit:
+  free(ups);
+  return ret;
+}
+
+RCCL_PARAM(ChannelBalance, "CHANNEL_BALANCE", 0);
+
+// Channels whose ring goes through a slower or shared link get a smaller share of
+// ring collectives. Every rank must lay out collectives the same way, so each
+// channel is weighted by its slowest hop over all ranks.
+static ncclResult_t channelBalanceSetup(struct ncclComm* comm, struct ncclTopoGraph* ringGraph) {
+  ncclResult_t ret = ncclSuccess;
+  int nRanks = comm->nRanks, nChannels = comm->nChannels;
+  float* bws = NULL;
+  comm->channelBalance = 0;
+  if (!rcclParamChannelBalance() || nRanks == 1) return ncclSuccess;
+  NCCLCHECK(ncclCalloc(&bws, nRanks*nChannels));
+  NCCLCHECKGOTO(ncclTopoGetRingBw(comm, ringGraph, bws+comm->rank*nChannels), ret, exit);
+  NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, bws, nChannels*sizeof(float)), ret, exit);
+  for (int c=0; c<nChannels; c++) {
+    comm->channelBw[c] = bws[c];
+    for (int r=1; r<nRanks; r++) comm->channelBw[c] = std::min(comm->channelBw[c], bws[r*nChannels+c]);
+    if (comm->channelBw[c] <= 0) { comm->channelBalance = 0; goto exit; }
+    if (comm->channelBw[c] != comm->channelBw[0]) comm->channelBalance = 1;
+  }
+  if (comm->channelBalance) {
+    char line[1024];
+    line[0] = '\0';
+    for (int c=0; c<nChannels; c++) snprintf(line+strlen(line), sizeof(line)-strlen(line), " %.1f", comm->channelBw[c]);
+    INFO(NCCL_INIT, "Ring channel bandwidths%s GB/s", line);
+  }
+exit:
+  free(bws);
+  return ret;
+}
+
+// Restricts the ring and tree graphs of the parent to the GPUs of this node in the
+// split comm, so that splits skip the graph search. Graphs are only set when both
+// can be derived.
+static ncclResult_t commSplitDeriveGraphs(struct ncclComm* comm, struct ncclComm* parent, struct ncclTopoGraph* ringGraph, struct ncclTopoGraph* treeGraph, int* derived) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclTopoGraph* graphs = NULL;
+  int ringValid, treeValid;
+  *derived = 0;
+  NCCLCHECK(ncclCalloc(&graphs, 2));
+  NCCLCHECKGOTO(ncclTopoRestrictGraph(parent->topo, parent->splitGraphs+0, comm->topo, graphs+0, &ringValid), ret, exit);
+  NCCLCHECKGOTO(ncclTopoRestrictGraph(parent->topo, parent->splitGraphs+1, comm->topo, graphs+1, &treeValid), ret, exit);
+  if (ringValid && treeValid) {
+    graphs[1].nChannels = std::min(graphs[1].nChannels, graphs[0].nChannels);
+    memcpy(ringGraph, graphs+0, sizeof(struct ncclTopoGraph));
+    memcpy(treeGraph, graphs+1, sizeof(struct ncclTopoGraph));
+    *derived = 1;
+  }
+exit:
+  free(graphs);
+  return ret;
+}
 
 static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* parent = NULL) {
   // We use 2 AllGathers
@@ -1136,7 +1443,7 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   struct ncclTopoGraph treeGraph;
   struct ncclTopoGraph collNetGraph;
   struct ncclTopoGraph nvlsGraph;
-  struct ncclTopoGraph* graphs[] = { &treeGraph, &ringGraph, &collNetGraph, &collNetGraph, &nvlsGraph, &nvlsGraph };
+  struct ncclTopoGraph* graphs[] = { &treeGraph, &ringGraph, &collNetGraph, &collNetGraph, &nvlsGraph, &nvlsGraph, &ringGraph, &ringGraph, &ringGraph };
 
   struct graphInfo {
     int pattern;
@@ -1155,6 +1462,9 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
     bool pivotA2AEnabled;
     bool ll128Enabled;
     bool mscclEnabled;
+    int budgetChannels;
+    float collNetLat;
+    float collNetBw;
   };
 
   int nChannelsOrig;
@@ -1168,9 +1478,7 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   int *topParentLocalRanks = NULL;
   int tpProxyRank;
 
-  int highestTransportType = TRANSPORT_P2P;
-  bool needsProxy = false;
-  bool mscclNeedsProxy = needsProxy;
+  bool mscclNeedsProxy = false;
 
   // AllGather1 - begin
   NCCLCHECKGOTO(ncclCalloc(&comm->peerInfo, nranks+1), ret, fail); // Extra rank to represent CollNet root
@@ -1309,6 +1617,8 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   comm->topo->mscclEnabled = false;
   // Topology hint if tree has been defined by model or User
   comm->topo->treeDefined = false;
+  // Optionally measure link bandwidths, before they are used by paths and search
+  NCCLCHECKGOTO(ncclTopoProbeLinks(comm, comm->topo), ret, fail);
   // Compute paths between GPUs and NICs
   NCCLCHECKGOTO(ncclTopoComputePaths(comm->topo, comm), ret, fail);
   // Remove inaccessible GPUs and unused NICs
@@ -1364,22 +1674,35 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   }
 
   // Get rings and trees
-  memset(&ringGraph, 0, sizeof(struct ncclTopoGraph));
-  ringGraph.id = 0;
-  ringGraph.pattern = NCCL_TOPO_PATTERN_RING;
-  ringGraph.minChannels = 1;
-  ringGraph.maxChannels = MAXCHANNELS/2;
-  NCCLCHECKGOTO(ncclTopoCompute(comm->topo, &ringGraph), ret, fail);
+  int graphsDerived;
+  graphsDerived = 0;
+  if (parent && parent->splitGraphs) {
+    NCCLCHECKGOTO(commSplitDeriveGraphs(comm, parent, &ringGraph, &treeGraph, &graphsDerived), ret, fail);
+    if (graphsDerived) INFO(NCCL_INIT|NCCL_GRAPH, "comm %p rank %d restricted %d ring and %d tree channels of parent comm %p", comm, rank, ringGraph.nChannels, treeGraph.nChannels, parent);
+  }
+  if (!graphsDerived) {
+    memset(&ringGraph, 0, sizeof(struct ncclTopoGraph));
+    ringGraph.id = 0;
+    ringGraph.pattern = NCCL_TOPO_PATTERN_RING;
+    ringGraph.minChannels = 1;
+    ringGraph.maxChannels = MAXCHANNELS/2;
+    NCCLCHECKGOTO(ncclTopoCompute(comm->topo, &ringGraph), ret, fail);
+
+    memset(&treeGraph, 0, sizeof(struct ncclTopoGraph));
+    treeGraph.id = 1;
+    treeGraph.pattern = NCCL_TOPO_PATTERN_BALANCED_TREE;
+    treeGraph.collNet = 0;
+    treeGraph.minChannels = comm->topo->nodes[NET].count != 0 ? 1 : ringGraph.nChannels;
+    treeGraph.maxChannels = ringGraph.nChannels;
+    NCCLCHECKGOTO(ncclTopoCompute(comm->topo, &treeGraph), ret, fail);
+  }
   NCCLCHECKGOTO(ncclTopoPrintGraph(comm->topo, &ringGraph), ret, fail);
-
-  memset(&treeGraph, 0, sizeof(struct ncclTopoGraph));
-  treeGraph.id = 1;
-  treeGraph.pattern = NCCL_TOPO_PATTERN_BALANCED_TREE;
-  treeGraph.collNet = 0;
-  treeGraph.minChannels = comm->topo->nodes[NET].count != 0 ? 1 : ringGraph.nChannels;
-  treeGraph.maxChannels = ringGraph.nChannels;
-  NCCLCHECKGOTO(ncclTopoCompute(comm->topo, &treeGraph), ret, fail);
   NCCLCHECKGOTO(ncclTopoPrintGraph(comm->topo, &treeGraph), ret, fail);
+  if (rcclParamCommSplitReuseGraphs()) {
+    NCCLCHECKGOTO(ncclCalloc(&comm->splitGraphs, 2), ret, fail);
+    memcpy(comm->splitGraphs+0, &ringGraph, sizeof(struct ncclTopoGraph));
+    memcpy(comm->splitGraphs+1, &treeGraph, sizeof(struct ncclTopoGraph));
+  }
 
   memset(&collNetGraph, 0, sizeof(struct ncclTopoGraph));
   collNetGraph.id = 2;
@@ -1472,6 +1795,14 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   comm->topo->ll128Enabled =  comm->topo->ll128Enabled || rcclParamLL128ForceEnable();
   allGather3Data[rank].ll128Enabled = comm->topo->ll128Enabled;
   allGather3Data[rank].mscclEnabled = comm->topo->mscclEnabled;
+  NCCLCHECKGOTO(ncclChannelBudgetRegister(comm, &allGather3Data[rank].budgetChannels), ret, fail);
+  if (comm->collNetSupport && collNetGraph.nChannels) {
+    // In-network reduction plugins report the cost of the switch offload through their properties
+    ncclNetProperties_t props;
+    NCCLCHECKGOTO(collNetGetProperties(comm, collNetGraph.inter[0], &props), ret, fail);
+    allGather3Data[rank].collNetLat = props.latency > 0 ? props.latency : 0;
+    allGather3Data[rank].collNetBw = props.speed > 0 ? props.speed/8000.0 : 0;
+  }
 
   for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) {
     allGather3Data[rank].graphInfo[a].pattern = graphs[a]->pattern;
@@ -1543,11 +1874,18 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
   nChannelsOrig = comm->nChannels;
   NCCLCHECKGOTO(ncclCalloc(&allTopoRanks, comm->nRanks), ret, fail);
-  int nc;
+  int nc, budgetChannels;
   nc = allGather3Data[0].nc;
+  budgetChannels = allGather3Data[0].budgetChannels;
+  comm->collNetLat = allGather3Data[0].collNetLat;
+  comm->collNetBw = allGather3Data[0].collNetBw;
   for (int i=0; i<nranks; i++) {
     allTopoRanks[i] = &allGather3Data[i].topoRanks;
     nc = std::min(allGather3Data[i].nc, nc);
+    budgetChannels = std::min(allGather3Data[i].budgetChannels, budgetChannels);
+    // Slowest rank, and unknown (0) as soon as one rank doesn't report it
+    comm->collNetLat = allGather3Data[i].collNetLat == 0 ? 0 : comm->collNetLat == 0 ? 0 : std::max(allGather3Data[i].collNetLat, comm->collNetLat);
+    comm->collNetBw = std::min(allGather3Data[i].collNetBw, comm->collNetBw);
     // Make sure we align all ranks so that the tuning is consistent across ranks
     comm->topo->pivotA2AEnabled = comm->topo->pivotA2AEnabled && allGather3Data[i].pivotA2AEnabled;
     comm->topo->ll128Enabled = comm->topo->ll128Enabled && allGather3Data[i].ll128Enabled;
@@ -1564,6 +1902,14 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
     if (graphs[NCCL_ALGO_NVLS]->nChannels == 0) comm->nvlsSupport = 0;
   }
 
+  // All ranks apply the smallest budget so that they keep the same number of channels
+  if (budgetChannels < comm->config.maxCTAs) {
+    INFO(NCCL_INIT, "Channel budget limits maxCTAs from %d to %d", comm->config.maxCTAs, budgetChannels);
+    comm->config.maxCTAs = budgetChannels;
+    comm->config.minCTAs = std::min(comm->config.minCTAs, budgetChannels);
+    nc = std::min(nc, budgetChannels);
+  }
+
   comm->nChannels = treeGraph.nChannels = ringGraph.nChannels =
     (comm->topo->nodes[GPU].count != comm->topo->nRanks && comm->topo->nodes[NET].count)
     ? std::min(treeGraph.nChannels, ringGraph.nChannels) : ringGraph.nChannels;
@@ -1593,6 +1939,8 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
   NCCLCHECKGOTO(ncclTopoPostset(comm, nodesFirstRank, nodesTreePatterns, allTopoRanks, rings, graphs, nc), ret, fail);
   if (comm->topo->treeDefined) NCCLCHECK(ncclTreeBasePostset(comm, &treeGraph));
+  NCCLCHECKGOTO(rootedTreeSetup(comm), ret, fail);
+  NCCLCHECKGOTO(channelBalanceSetup(comm, &ringGraph), ret, fail);
 
   // AllGather3 - end
 
@@ -1610,7 +1958,7 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
   line[4095] = '\0';
   INFO(NCCL_INIT, "Trees%s comm %p nRanks %02d busId %lx", line, comm, comm->nRanks, comm->busId);
 
-  NCCLCHECKGOTO(computeBuffSizes(comm), ret, fail);
+  NCCLCHECKGOTO(computeBuffSizes(comm, graphs), ret, fail);
 
   // Compute nChannels per peer for p2p
   NCCLCHECKGOTO(ncclTopoComputeP2pChannels(comm), ret, fail);
@@ -1640,37 +1988,28 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
     NCCLCHECKGOTO(ncclProxyCreate(comm), ret, fail);
   }
 
-  // Connect with prev/next for each ring
   for (int c=0; c<comm->nChannels; c++) {
-    struct ncclChannel* channel = comm->channels+c;
     NCCLCHECKGOTO(setupChannel(comm, c, rank, nranks, rings+c*nranks), ret, fail);
-    if (comm->nRanks == 1) continue;
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, 0), ret, fail);
-  }
-  NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &ringGraph, 0, &highestTransportType, &needsProxy), ret, fail);
-  mscclNeedsProxy |= needsProxy;
-  if (ringGraph.nIntraChannels && rcclParamP2pNetDisable() == 0) {
-    comm->useIntraNet = 1;
-    // Connect NET for intranode use
-    for (int c=0; c<comm->nChannels; c++) {
-      struct ncclChannel* channel = comm->channels+c;
-      if (comm->nRanks == 1) continue;
-      NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, NCCL_CONN_IDX_P2P_NET), ret, fail);
-    }
-    NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &ringGraph, NCCL_CONN_IDX_P2P_NET), ret, fail);
   }
-  INFO(NCCL_INIT, "Connected all rings comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
-
-  // Connect Trees
-  for (int c=0; c<comm->nChannels; c++) {
-    struct ncclChannel* channel = comm->channels+c;
-    if (comm->nRanks == 1) continue;
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->tree.down, 1, &channel->tree.up, 0), ret, fail);
-    NCCLCHECKGOTO(ncclTransportP2pConnect(comm, c, 1, &channel->tree.up, NCCL_MAX_TREE_ARITY, channel->tree.down, 0), ret, fail);
+  if (ringGraph.nIntraChannels && rcclParamP2pNetDisable() == 0) comm->useIntraNet = 1;
+
+  // MSCCL needs to know at init whether ring/tree connections use a proxy
+  comm->runtimeConn = ncclParamRuntimeConnect() && comm->nRanks > 1 &&
+    !(mscclEnabled() && (comm->topo->mscclEnabled || mscclForceEnabled()));
+  if (comm->runtimeConn) {
+    // Defer ring and tree connections to the first collective
+    NCCLCHECKGOTO(ncclCalloc(&comm->runtimeRingGraph, 1), ret, fail);
+    NCCLCHECKGOTO(ncclCalloc(&comm->runtimeTreeGraph, 1), ret, fail);
+    memcpy(comm->runtimeRingGraph, &ringGraph, sizeof(struct ncclTopoGraph));
+    memcpy(comm->runtimeTreeGraph, &treeGraph, sizeof(struct ncclTopoGraph));
+    INFO(NCCL_INIT, "Runtime connection enabled, rings and trees will be connected on first use");
+  } else {
+    NCCLCHECKGOTO(ncclTransportRingConnect(comm, &ringGraph, &mscclNeedsProxy), ret, fail);
+    NCCLCHECKGOTO(ncclTransportTreeConnect(comm, &treeGraph, &mscclNeedsProxy), ret, fail);
+    NCCLCHECKGOTO(ncclTransportRhdConnect(comm, &ringGraph), ret, fail);
+    NCCLCHECKGOTO(ncclTransportBruckConnect(comm, &ringGraph), ret, fail);
+    comm->collConnected = true;
   }
-  NCCLCHECKGOTO(ncclTransportP2pSetup(comm, &treeGraph, 0, &highestTransportType, &needsProxy), ret, fail);
-  mscclNeedsProxy |= needsProxy;
-  INFO(NCCL_INIT, "Connected all trees");
 
   // Setup NVLS
   NCCLCHECKGOTO(ncclNvlsSetup(comm, parent), ret, fail);
@@ -1692,6 +2031,16 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
 
   TRACE(NCCL_INIT, "rank %d nranks %d - CONNECTED %d RINGS AND TREES", rank, nranks, comm->nChannels);
 
+  // Direct AllReduce needs a link from every GPU to every other one of a single node
+  comm->directSupport = rcclParamDirectAllReduceEnable() && comm->nNodes == 1 && !comm->MNNVL &&
+    nranks <= NCCL_MAX_DIRECT_ARITY+1 && comm->topo->nodes[GPU].count == nranks &&
+    (comm->topo->type & RCCL_TOPO_XGMI_ALL);
+  if (comm->directSupport) {
+    comm->directnChannels = std::max(1, std::min((int)rcclParamDirectNChannels(), comm->nChannels));
+    comm->directOneShotBytes = rcclParamDirectOneShotThreshold();
+    INFO(NCCL_INIT, "Direct AllReduce enabled, %d channels, one-shot up to %ld bytes", comm->directnChannels, comm->directOneShotBytes);
+  }
+
   // Compute time models for algorithm and protocol combinations
   NCCLCHECKGOTO(ncclTopoTuneModel(comm, comm->minCompCap, comm->maxCompCap, graphs), ret, fail);
 
@@ -1765,6 +2114,18 @@ static ncclResult_t initTransportsRank(struct ncclComm* comm, struct ncclComm* p
     NCCLCHECKGOTO(ncclTransportP2pSetup(comm, NULL, 1), ret, fail);
   }
 
+  if (rcclParamP2pPreconnect() && comm->nRanks > 1) {
+    // Speculatively connect p2p to every peer, so that the first ncclSend/ncclRecv
+    // or AllToAll with new peers does not have to set up connections.
+    for (int peer = 0; peer < comm->nRanks; peer++) {
+      bool marked;
+      if (peer != comm->rank) NCCLCHECKGOTO(ncclP2pPreconnectMark(comm, peer, &marked), ret, fail);
+    }
+    NCCLCHECKGOTO(ncclTransportP2pSetup(comm, NULL, 1), ret, fail);
+    if (comm->p2pNet) NCCLCHECKGOTO(ncclTransportP2pSetup(comm, NULL, NCCL_CONN_IDX_P2P_NET), ret, fail);
+    INFO(NCCL_INIT, "Connected p2p to all %d peers", comm->nRanks-1);
+  }
+
   // Connect to local net proxy
   tpProxyRank = comm->topParentRanks[comm->rank];
   NCCLCHECKGOTO(ncclProxyConnect(comm, TRANSPORT_NET, 1, tpProxyRank, &proxyConn), ret, fail);
@@ -1853,9 +2214,18 @@ struct ncclCommInitRankAsyncJob {
   // For ncclCommInitRank
   int nranks, myrank;
   ncclUniqueId commId;
+  // For ncclCommInitRankScalable, one ID per bootstrap root. commId is the first one.
+  int nId;
+  ncclUniqueId* commIds;
+  // For ncclCommInitAll, in-process bootstrap of all ranks
+  struct ncclBootstrapShared* bootstrapShared;
   // for ncclCommSplit
   struct ncclComm* parent;
   int color, key;
+  // for ncclCommShrink, parent ranks that are left out. The ranks are known
+  // locally, so the excluded ranks don't take part in any exchange.
+  int* excludeRanks;
+  int excludeRanksCount;
 };
 
 struct ncclCommFinalizeAsyncJob {
@@ -1864,6 +2234,38 @@ struct ncclCommFinalizeAsyncJob {
 };
 
 NCCL_PARAM(CommSplitShareResources, "COMM_SPLIT_SHARE_RESOURCES", NCCL_CONFIG_UNDEF_INT);
+RCCL_PARAM(CommSplitTopoOrder, "COMM_SPLIT_TOPO_ORDER", NCCL_CONFIG_UNDEF_INT);
+RCCL_PARAM(CommPriority, "COMM_PRIORITY", NCCL_CONFIG_UNDEF_INT);
+RCCL_PARAM(CommHighPriority, "COMM_HIGH_PRIORITY", NCCL_CONFIG_UNDEF_INT);
+
+// Topology order for ncclCommSplit: the parent's first ring already follows
+// XGMI hives, PCI switches and NICs, so ranks of a color are taken in the order
+// they appear on it. The ring is walked from the member with the lowest key so
+// that key still picks rank 0. All ranks see the same ring, hence the same order.
+static ncclResult_t commSplitTopoOrder(struct ncclComm* parent, int nRanks, int* parentRanks) {
+  if (parent->nRanks < 2 || parent->channels[0].ring.userRanks == NULL) return ncclSuccess;
+  int* ringPos;
+  NCCLCHECK(ncclCalloc(&ringPos, parent->nRanks));
+  // userRanks starts at our own rank, positions are made relative to parent rank 0
+  int* userRanks = parent->channels[0].ring.userRanks;
+  int zero = 0;
+  while (userRanks[zero] != 0) zero++;
+  for (int i = 0; i < parent->nRanks; i++) ringPos[userRanks[(zero+i)%parent->nRanks]] = i;
+  // parentRanks is sorted by key, so parentRanks[0] is where the walk starts
+  int start = ringPos[parentRanks[0]];
+  for (int i = 1; i < nRanks; i++) {
+    int r = parentRanks[i];
+    int pos = (ringPos[r] - start + parent->nRanks) % parent->nRanks;
+    int j = i;
+    while (j > 1 && (ringPos[parentRanks[j-1]] - start + parent->nRanks) % parent->nRanks > pos) {
+      parentRanks[j] = parentRanks[j-1];
+      j--;
+    }
+    parentRanks[j] = r;
+  }
+  free(ringPos);
+  return ncclSuccess;
+}
 
 static ncclResult_t commGetSplitInfo(struct ncclComm* comm, struct ncclComm* parent, int color, int key, int* nRanksRet, int* myRankRet, int* parentRanksRet) {
   int* colors = NULL;
@@ -1895,6 +2297,7 @@ static ncclResult_t commGetSplitInfo(struct ncclComm* comm, struct ncclComm* par
     parentRanksRet[insert] = i;
     nRanks++;
   }
+  if (comm->config.splitTopoOrder == 1) NCCLCHECKGOTO(commSplitTopoOrder(parent, nRanks, parentRanksRet), ret, fail);
 
   for (int i = 0; i < nRanks; i++) {
     if (parentRanksRet[i] == parent->rank) myRank = i;
@@ -1911,6 +2314,24 @@ fail:
   goto exit;
 }
 
+static ncclResult_t commGetShrinkInfo(struct ncclComm* parent, int* excludeRanks, int excludeRanksCount, int* nRanksRet, int* myRankRet, int* parentRanksRet) {
+  int nRanks = 0;
+  *myRankRet = -1;
+  for (int i = 0; i < parent->nRanks; i++) {
+    bool excluded = false;
+    for (int e = 0; e < excludeRanksCount; e++) excluded |= excludeRanks[e] == i;
+    if (excluded) continue;
+    if (i == parent->rank) *myRankRet = nRanks;
+    parentRanksRet[nRanks++] = i;
+  }
+  if (*myRankRet == -1) {
+    WARN("CommShrink : rank %d is in the list of excluded ranks", parent->rank);
+    return ncclInvalidArgument;
+  }
+  *nRanksRet = nRanks;
+  return ncclSuccess;
+}
+
 static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)job_;
   ncclComm_t comm = job->comm;
@@ -1920,6 +2341,7 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   int cudaDev = job->cudaDev;
   int* parentRanks = NULL;
   int cudaArch;
+  int kernelUnroll;
   int64_t stackSize;
   hipDeviceProp_t devProp;
 
@@ -1928,7 +2350,8 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   CUDACHECKGOTO(cudaDeviceGetAttribute(&archMinor, cudaDevAttrComputeCapabilityMinor, cudaDev), res, fail);
   cudaArch = 100*archMajor + 10*archMinor;
 
-  NCCLCHECK(ncclInitKernelsForDevice(cudaArch, &maxLocalSizeBytes));
+  NCCLCHECKGOTO(ncclGetKernelUnroll(cudaDev, &kernelUnroll), res, fail);
+  NCCLCHECK(ncclInitKernelsForDevice(cudaArch, ncclAutotuneKernelVariants() ? -1 : kernelUnroll, &maxLocalSizeBytes));
   // Set the maximum kernel stack size of all kernels to avoid
   // a CUDA memory reconfig on load (c.f. NVSHMEM issue)
 #ifdef USE_INDIRECT_FUNCTION_CALL
@@ -1946,7 +2369,13 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   }
 #endif
 
-  if (job->parent) {
+  if (job->parent && job->excludeRanks) {
+    NCCLCHECKGOTO(ncclCalloc(&parentRanks, job->parent->nRanks), res, fail);
+    NCCLCHECKGOTO(commGetShrinkInfo(job->parent, job->excludeRanks, job->excludeRanksCount, &job->nranks, &job->myrank, parentRanks), res, fail);
+    snprintf((char*)&job->commId, sizeof(job->commId), "%016lx-shrink-%x", job->parent->commHash, job->color);
+    NCCLCHECKGOTO(commAlloc(comm, job->parent, job->nranks, job->myrank), res, fail);
+    NCCLCHECKGOTO(bootstrapSplit((struct ncclBootstrapHandle*)&job->commId, comm, job->parent, job->color, job->key, parentRanks), res, fail);
+  } else if (job->parent) {
     NCCLCHECKGOTO(ncclCalloc(&parentRanks, job->parent->nRanks), res, fail);
     NCCLCHECKGOTO(commGetSplitInfo(comm, job->parent, job->color, job->key, &job->nranks, &job->myrank, parentRanks), res, fail);
     // Negative color does not create a new comm object. We needed to take part in the allgather, but we're done now.
@@ -1954,12 +2383,16 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
     snprintf((char*)&job->commId, sizeof(job->commId), "%016lx-%d", job->parent->commHash, job->color);
     NCCLCHECKGOTO(commAlloc(comm, job->parent, job->nranks, job->myrank), res, fail);
     NCCLCHECKGOTO(bootstrapSplit((struct ncclBootstrapHandle*)&job->commId, comm, job->parent, job->color, job->key, parentRanks), res, fail);
+  } else if (job->bootstrapShared) {
+    NCCLCHECKGOTO(commAlloc(comm, NULL, job->nranks, job->myrank), res, fail);
+    NCCLCHECKGOTO(bootstrapInitShared(job->bootstrapShared, ((struct ncclBootstrapHandle*)&job->commId)->magic, comm), res, fail);
   } else {
     NCCLCHECKGOTO(commAlloc(comm, NULL, job->nranks, job->myrank), res, fail);
-    NCCLCHECKGOTO(bootstrapInit((struct ncclBootstrapHandle*)&job->commId, comm), res, fail);
+    NCCLCHECKGOTO(bootstrapInit(job->nId, (struct ncclBootstrapHandle*)job->commIds, comm), res, fail);
   }
 
   comm->cudaArch = cudaArch;
+  comm->kernelUnroll = kernelUnroll;
   comm->commHash = getHash(job->commId.internal, NCCL_UNIQUE_ID_BYTES);
 
   INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx commId 0x%llx - Init START", comm, comm->rank, comm->nRanks, comm->cudaDev, comm->busId, (unsigned long long)hashUniqueId(job->commId));
@@ -1970,12 +2403,14 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
   if (rcclParamEnableMscclpp()) {
     hipDeviceProp_t devProp;
     CUDACHECK(hipGetDeviceProperties(&devProp, cudaDev));
-    comm->mscclppCompatible = IsArchMatch(devProp.gcnArchName, "gfx94");
+    comm->mscclppCompatible = IsArchMatch(devProp.gcnArchName, "gfx94") || IsArchMatch(devProp.gcnArchName, "gfx95");
     if (comm->mscclppCompatible) {
       NCCLCHECKGOTO(bootstrapIntraNodeBroadcast(comm->bootstrap, comm->localRankToRank, comm->localRank, comm->localRanks, 0, &(mscclpp_uniqueIdMap[job->commId]), sizeof(mscclpp_ncclUniqueId)), res, fail);
       TRACE_CALL("bootstrapIntraNodeBroadcast(rank=%d, nranks=%d, root=%d, bcastData=<mscclpp_ncclUniqueId>)", comm->localRank, comm->localRanks, 0);
       comm->mscclpp_threshold = rcclParamMscclppThreshold();
-      INFO(NCCL_INIT, "MSCCL++: Enabled! Msg size threshold=%zu", comm->mscclpp_threshold);
+      INFO(NCCL_INIT, "MSCCL++: Enabled! Msg size threshold=%zu, AllReduce model %.1f us + %.1f GB/s%s%s", comm->mscclpp_threshold,
+          comm->mscclppLat[ncclFuncAllReduce], comm->mscclppBw[ncclFuncAllReduce],
+          mscclpp_ncclReduceScatter ? ", ReduceScatter" : "", mscclpp_ncclAllToAll ? ", AllToAll" : "");
       NCCLCHECKGOTO(mscclpp_ncclCommInitRank(&(comm->mscclpp_comm), job->nranks, mscclpp_uniqueIdMap[job->commId], job->myrank), res, fail);
       TRACE_CALL("mscclpp_ncclCommInitRank (nranks=%d, myrank=%d)", job->nranks, job->myrank);
     } else {
@@ -1986,8 +2421,28 @@ static ncclResult_t ncclCommInitRankFunc(struct ncclAsyncJob* job_) {
 
   NCCLCHECKGOTO(ncclLoadTunerPlugin(&comm->tuner), res, fail);
   if (comm->tuner) {
-    NCCLCHECK(comm->tuner->init(comm->nRanks, comm->nNodes, ncclDebugLog));
-  }
+    ncclTunerCommInfo_v2_t tunerInfo;
+    tunerInfo.rank = comm->rank;
+    tunerInfo.nRanks = comm->nRanks;
+    tunerInfo.nNodes = comm->nNodes;
+    tunerInfo.localRanks = comm->localRanks;
+    tunerInfo.nChannels = comm->nChannels;
+    tunerInfo.collNetSupport = comm->collNetSupport;
+    tunerInfo.nvlsSupport = comm->nvlsSupport;
+    tunerInfo.cudaArch = comm->cudaArch;
+    tunerInfo.topoType = comm->topo->type;
+    tunerInfo.nNetDevices = comm->topo->nodes[NET].count;
+    tunerInfo.latencies = &comm->latencies[0][0][0];
+    tunerInfo.bandwidths = &comm->bandwidths[0][0][0];
+    tunerInfo.numFuncs = NCCL_NUM_FUNCTIONS;
+    tunerInfo.numAlgo = NCCL_NUM_ALGORITHMS;
+    tunerInfo.numProto = NCCL_NUM_PROTOCOLS;
+    NCCLCHECK(comm->tuner->init(&tunerInfo, ncclPluginDebugLog, &comm->tunerContext));
+  }
+  NCCLCHECKGOTO(ncclAutotuneInit(comm), res, fail);
+  NCCLCHECKGOTO(ncclStragglerInit(comm), res, fail);
+  NCCLCHECKGOTO(ncclCallTraceInit(comm), res, fail);
+  NCCLCHECKGOTO(ncclMetricsRegister(comm), res, fail);
 
   // update communicator state
   comm->initState = ncclSuccess;
@@ -2033,6 +2488,9 @@ static ncclResult_t envConfigOverride(ncclComm_t comm) {
   int minCTAsEnv;
   int maxCTAsEnv;
   int splitShareEnv;
+  int splitTopoOrderEnv;
+  int priorityEnv;
+  int highPriorityEnv;
 
   /* override configuration from env variable. */
   blockingEnv = ncclParamCommBlocking();
@@ -2073,6 +2531,21 @@ static ncclResult_t envConfigOverride(ncclComm_t comm) {
     comm->config.splitShare = splitShareEnv;
   }
 
+  splitTopoOrderEnv = rcclParamCommSplitTopoOrder();
+  if (splitTopoOrderEnv != NCCL_CONFIG_UNDEF_INT) {
+    comm->config.splitTopoOrder = splitTopoOrderEnv;
+  }
+
+  priorityEnv = rcclParamCommPriority();
+  if (priorityEnv != NCCL_CONFIG_UNDEF_INT) {
+    comm->config.priority = priorityEnv;
+  }
+
+  highPriorityEnv = rcclParamCommHighPriority();
+  if (highPriorityEnv != NCCL_CONFIG_UNDEF_INT) {
+    comm->config.highPriority = highPriorityEnv;
+  }
+
   /* cap channels if needed */
   if (comm->config.minCTAs > MAXCHANNELS) {
     WARN("minCTAs %d is larger than #channels upper limit %d, cap it to %d", comm->config.minCTAs, MAXCHANNELS, MAXCHANNELS);
@@ -2094,6 +2567,21 @@ static ncclResult_t envConfigOverride(ncclComm_t comm) {
     comm->config.splitShare = 0;
   }
 
+  if (comm->config.splitTopoOrder != 1 && comm->config.splitTopoOrder != 0) {
+    WARN("splitTopoOrder %d is not a valid value 0/1, set it to 0\n", comm->config.splitTopoOrder);
+    comm->config.splitTopoOrder = 0;
+  }
+
+  if (comm->config.priority < 1) {
+    WARN("priority %d is not a valid value, it must be at least 1, set it to 1\n", comm->config.priority);
+    comm->config.priority = 1;
+  }
+
+  if (comm->config.highPriority != 1 && comm->config.highPriority != 0) {
+    WARN("highPriority %d is not a valid value 0/1, set it to 0\n", comm->config.highPriority);
+    comm->config.highPriority = 0;
+  }
+
   return ret;
 }
 
@@ -2164,6 +2652,36 @@ static ncclResult_t parseCommConfig(ncclComm_t comm, ncclConfig_t *config) {
     goto fail;
   }
 
+  if (internalConfigPtr->splitTopoOrder != NCCL_CONFIG_UNDEF_INT && internalConfigPtr->splitTopoOrder != 0 && internalConfigPtr->splitTopoOrder != 1) {
+    WARN("Invalid config splitTopoOrder attribute value %d", internalConfigPtr->splitTopoOrder);
+    ret = ncclInvalidArgument;
+    goto fail;
+  }
+
+  if (internalConfigPtr->priority != NCCL_CONFIG_UNDEF_INT && internalConfigPtr->priority < 1) {
+    WARN("Invalid config priority attribute value %d", internalConfigPtr->priority);
+    ret = ncclInvalidArgument;
+    goto fail;
+  }
+
+  if (internalConfigPtr->highPriority != NCCL_CONFIG_UNDEF_INT && internalConfigPtr->highPriority != 0 && internalConfigPtr->highPriority != 1) {
+    WARN("Invalid config highPriority attribute value %d", internalConfigPtr->highPriority);
+    ret = ncclInvalidArgument;
+    goto fail;
+  }
+
+  if (internalConfigPtr->trafficClass != NCCL_CONFIG_UNDEF_INT && (internalConfigPtr->trafficClass < 0 || internalConfigPtr->trafficClass > 255)) {
+    WARN("Invalid config trafficClass attribute value %d", internalConfigPtr->trafficClass);
+    ret = ncclInvalidArgument;
+    goto fail;
+  }
+
+  if (internalConfigPtr->serviceLevel != NCCL_CONFIG_UNDEF_INT && (internalConfigPtr->serviceLevel < 0 || internalConfigPtr->serviceLevel > 15)) {
+    WARN("Invalid config serviceLevel attribute value %d", internalConfigPtr->serviceLevel);
+    ret = ncclInvalidArgument;
+    goto fail;
+  }
+
   /* default config value can be tuned on different platform. */
   NCCL_CONFIG_DEFAULT(internalConfigPtr, blocking, NCCL_CONFIG_UNDEF_INT, 1, "Blocking", "%d");
   NCCL_CONFIG_DEFAULT(internalConfigPtr, cgaClusterSize, NCCL_CONFIG_UNDEF_INT, 4, "CGA cluster size", "%d");
@@ -2171,6 +2689,12 @@ static ncclResult_t parseCommConfig(ncclComm_t comm, ncclConfig_t *config) {
   NCCL_CONFIG_DEFAULT(internalConfigPtr, maxCTAs, NCCL_CONFIG_UNDEF_INT, MAXCHANNELS, "Max CTAs", "%d");
   NCCL_CONFIG_DEFAULT(internalConfigPtr, netName, NCCL_CONFIG_UNDEF_PTR, NULL, "Net name", "%s");
   NCCL_CONFIG_DEFAULT(internalConfigPtr, splitShare, NCCL_CONFIG_UNDEF_INT, 0, "Split share", "%d");
+  NCCL_CONFIG_DEFAULT(internalConfigPtr, splitTopoOrder, NCCL_CONFIG_UNDEF_INT, 0, "Split topology order", "%d");
+  NCCL_CONFIG_DEFAULT(internalConfigPtr, priority, NCCL_CONFIG_UNDEF_INT, 1, "Priority", "%d");
+  NCCL_CONFIG_DEFAULT(internalConfigPtr, highPriority, NCCL_CONFIG_UNDEF_INT, 0, "High priority", "%d");
+  // Left undefined by default so the network plugin applies its own setting (e.g. NCCL_IB_TC)
+  NCCL_CONFIG_DEFAULT(internalConfigPtr, trafficClass, NCCL_CONFIG_UNDEF_INT, NCCL_CONFIG_UNDEF_INT, "Traffic class", "%d");
+  NCCL_CONFIG_DEFAULT(internalConfigPtr, serviceLevel, NCCL_CONFIG_UNDEF_INT, NCCL_CONFIG_UNDEF_INT, "Service level", "%d");
 
   /* assign config to communicator */
   comm->config.blocking = internalConfigPtr->blocking;
@@ -2179,6 +2703,11 @@ static ncclResult_t parseCommConfig(ncclComm_t comm, ncclConfig_t *config) {
   comm->config.maxCTAs = internalConfigPtr->maxCTAs;
   comm->config.netName = internalConfigPtr->netName;
   comm->config.splitShare = internalConfigPtr->splitShare;
+  comm->config.splitTopoOrder = internalConfigPtr->splitTopoOrder;
+  comm->config.priority = internalConfigPtr->priority;
+  comm->config.highPriority = internalConfigPtr->highPriority;
+  comm->config.trafficClass = internalConfigPtr->trafficClass;
+  comm->config.serviceLevel = internalConfigPtr->serviceLevel;
 
   NCCLCHECKGOTO(envConfigOverride(comm), ret, fail);
 
@@ -2188,14 +2717,20 @@ fail:
   goto exit;
 }
 
-static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, ncclUniqueId commId, int myrank, int cudaDev, ncclConfig_t *config) {
+static void ncclCommInitJobFree(void* job_) {
+  struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)job_;
+  free(job->commIds);
+  free(job);
+}
+
+static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, int nId, ncclUniqueId* commIds, int myrank, int cudaDev, ncclConfig_t *config, struct ncclBootstrapShared* bootstrapShared) {
   ncclResult_t res = ncclSuccess;
   ncclComm_t comm = NULL;
   struct ncclCommInitRankAsyncJob *job = NULL;
   const char* env = ncclGetEnv("NCCL_COMM_ID");
-  if (env && myrank == 0) {
+  if (env && myrank == 0 && nId == 1 && bootstrapShared == NULL) {
     INFO(NCCL_ENV, "NCCL_COMM_ID set by environment to %s", env);
-    NCCLCHECKGOTO(bootstrapCreateRoot((struct ncclBootstrapHandle*)&commId, true), res, fail);
+    NCCLCHECKGOTO(bootstrapCreateRoot((struct ncclBootstrapHandle*)commIds, true), res, fail);
   }
 
   NCCLCHECKGOTO(ncclInit(), res, fail);
@@ -2212,6 +2747,11 @@ static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, ncclUni
     res = ncclInvalidArgument;
     goto fail;
   }
+  if (nId < 1 || nId > nranks) {
+    WARN("Invalid number of unique IDs : %d for %d ranks", nId, nranks);
+    res = ncclInvalidArgument;
+    goto fail;
+  }
 
   NCCLCHECKGOTO(ncclCalloc(&comm, 1), res, fail);
   NCCLCHECKGOTO(ncclCudaHostCalloc((uint32_t**)&comm->abortFlag, 1), res, fail);
@@ -2225,10 +2765,14 @@ static ncclResult_t ncclCommInitRankDev(ncclComm_t* newcomm, int nranks, ncclUni
   NCCLCHECKGOTO(ncclCalloc(&job, 1), res, fail);
   job->comm = comm;
   job->nranks = nranks;
-  job->commId = commId; // C++ struct assignment
+  job->commId = commIds[0]; // C++ struct assignment
+  job->nId = nId;
+  NCCLCHECKGOTO(ncclCalloc(&job->commIds, nId), res, fail);
+  memcpy(job->commIds, commIds, nId*sizeof(ncclUniqueId));
   job->myrank = myrank;
   job->cudaDev = cudaDev;
-  NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, NULL, free, comm), res, fail);
+  job->bootstrapShared = bootstrapShared;
+  NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, NULL, ncclCommInitJobFree, comm), res, fail);
 
 exit:
   return ncclGroupErrCheck(res);
@@ -2266,15 +2810,19 @@ ncclResult_t ncclCommInitRank(ncclComm_t* newcomm, int nranks, ncclUniqueId comm
   NvtxParamsCommInitRank payload{myrank, nranks, cudaDev};
   NVTX3_FUNC_WITH_PARAMS(CommInitRank, CommInitRankSchema, payload)
 
-  NCCLCHECK(ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, &config));
+  NCCLCHECK(ncclCommInitRankDev(newcomm, nranks, 1, &commId, myrank, cudaDev, &config, NULL));
   return ncclSuccess;
 }
 
+// ncclCommInitAll ranks allgather through process memory rather than a bootstrap root
+RCCL_PARAM(BootstrapShared, "BOOTSTRAP_SHARED", 1);
+
 NCCL_API(ncclResult_t, ncclCommInitAll, ncclComm_t* comms, int ndev, const int* devlist);
 ncclResult_t ncclCommInitAll(ncclComm_t* comms, int ndev, const int* devlist) {
   ncclResult_t ret = ncclSuccess;
   int totalnDev;
   int *gpuFlags = NULL;
+  struct ncclBootstrapShared* bootstrapShared = NULL;
   ncclConfig_t config = NCCL_CONFIG_INITIALIZER;
 
   constexpr nvtxPayloadSchemaEntry_t CommInitAllSchema[] = {
@@ -2315,16 +2863,25 @@ ncclResult_t ncclCommInitAll(ncclComm_t* comms, int ndev, const int* devlist) {
   }
 
   ncclUniqueId uniqueId;
-  NCCLCHECKGOTO(ncclGetUniqueId(&uniqueId), ret, fail);
+  if (rcclParamBootstrapShared()) {
+    // All ranks are ours: no root, the ID only has to be unique for the commHash
+    NCCLCHECKGOTO(ncclInit(), ret, fail);
+    NCCLCHECKGOTO(getRandomData(&uniqueId, sizeof(uniqueId)), ret, fail);
+    NCCLCHECKGOTO(bootstrapSharedCreate(ndev, &bootstrapShared), ret, fail);
+  } else {
+    NCCLCHECKGOTO(ncclGetUniqueId(&uniqueId), ret, fail);
+  }
   NCCLCHECKGOTO(ncclGroupStart(), ret, fail);
   for (int i=0; i<ndev; i++) {
     // Ignore return codes .. we need to call ncclGroupEnd to clean up anyway
-    ncclCommInitRankDev(comms+i, ndev, uniqueId, i, devlist ? devlist[i] : i, &config);
+    ncclCommInitRankDev(comms+i, ndev, 1, &uniqueId, i, devlist ? devlist[i] : i, &config, bootstrapShared);
   }
   NCCLCHECKGOTO(ncclGroupEnd(), ret, fail);
 
 fail:
   free(gpuFlags);
+  // Communicators hold their own reference
+  (void) bootstrapSharedRelease(bootstrapShared);
   return ret;
 }
 
@@ -2354,7 +2911,36 @@ ncclResult_t ncclCommInitRankConfig(ncclComm_t *newcomm, int nranks, ncclUniqueI
     internalConfigPtr = &internalConfig;
   else
     internalConfigPtr = config;
-  NCCLCHECKGOTO(ncclCommInitRankDev(newcomm, nranks, commId, myrank, cudaDev, internalConfigPtr), ret, fail);
+  NCCLCHECKGOTO(ncclCommInitRankDev(newcomm, nranks, 1, &commId, myrank, cudaDev, internalConfigPtr, NULL), ret, fail);
+
+exit:
+  ncclGroupErrCheck(ret);
+  NCCLCHECK(ncclGroupEndInternal());
+  if (newcomm && *newcomm && !(*newcomm)->config.blocking) (void) ncclCommGetAsyncError(*newcomm, &ret);
+  return ret;
+fail:
+  if (newcomm && *newcomm && !(*newcomm)->config.blocking) (void) ncclCommSetAsyncError(*newcomm, ret);
+  goto exit;
+}
+
+NCCL_API(ncclResult_t, ncclCommInitRankScalable, ncclComm_t* newcomm, int nranks, int myrank, int nId, ncclUniqueId* commIds, ncclConfig_t* config);
+ncclResult_t ncclCommInitRankScalable(ncclComm_t* newcomm, int nranks, int myrank, int nId, ncclUniqueId* commIds, ncclConfig_t* config) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  int cudaDev;
+  ncclResult_t ret = ncclSuccess;
+  ncclConfig_t internalConfig = NCCL_CONFIG_INITIALIZER;
+  ncclConfig_t *internalConfigPtr = NULL;
+  NCCLCHECK(ncclGroupStartInternal());
+
+  rocmLibraryInit();
+  CUDACHECKGOTO(cudaGetDevice(&cudaDev), ret, fail);
+  NCCLCHECKGOTO(PtrCheck(commIds, "CommInitRankScalable", "commIds"), ret, fail);
+
+  if (config == NULL)
+    internalConfigPtr = &internalConfig;
+  else
+    internalConfigPtr = config;
+  NCCLCHECKGOTO(ncclCommInitRankDev(newcomm, nranks, nId, commIds, myrank, cudaDev, internalConfigPtr, NULL), ret, fail);
 
 exit:
   ncclGroupErrCheck(ret);
@@ -2383,6 +2969,7 @@ static ncclResult_t commDestroySync(struct ncclAsyncJob* job_) {
   if (comm->initState == ncclSuccess) {
     NCCLCHECKGOTO(ncclStrongStreamSynchronize(&comm->sharedRes->hostStream), ret, fail);
     NCCLCHECKGOTO(ncclStrongStreamSynchronize(&comm->sharedRes->deviceStream), ret, fail);
+    NCCLCHECKGOTO(ncclPersistentKernelStop(comm), ret, fail);
   }
   NCCLCHECKGOTO(ncclCommPollCallbacks(comm, false), ret, fail);
   // And keep polling until all graphs referencing us die.
@@ -2411,8 +2998,20 @@ static ncclResult_t commCleanup(ncclComm_t comm) {
     CUDACHECK(cudaSetDevice(commDevice));
   }
 
+  // No-op unless the comm was aborted or failed before commDestroySync()
+  NCCLCHECK(ncclPersistentKernelStop(comm));
+  INFO(NCCL_ALLOC, "Rank %d: %lu launches, %lu heap allocations in the enqueue path, %lu after warmup",
+      comm->rank, comm->enqueueLaunches, comm->enqueueMallocs, comm->enqueueSteadyMallocs);
+  if (comm->workFifoStalls) {
+    INFO(NCCL_INIT, "Rank %d: %lu kernel launches waited for work fifo space for %.1f ms in total, final depth %d",
+        comm->rank, comm->workFifoStalls, comm->workFifoStallNs/1e6, comm->workFifoDepth);
+  }
+  NCCLCHECK(ncclTunerTimingsFree(comm));
+  NCCLCHECK(ncclAutotuneFree(comm));
+  NCCLCHECK(ncclStragglerFree(comm));
+  NCCLCHECK(ncclCallTraceFree(comm));
   if (comm->tuner != NULL) {
-    NCCLCHECK(comm->tuner->destroy());
+    NCCLCHECK(comm->tuner->destroy(comm->tunerContext));
     NCCLCHECK(ncclCloseTunerPlugin(&comm->tuner));
   }
 
@@ -2616,6 +3215,22 @@ ncclResult_t ncclCommDestroy(ncclComm_t comm) {
   return ncclSuccess;
 }
 
+// Return from ncclCommAbort as soon as the device and the proxy were told to stop,
+// and free the resources of the comm on a background thread. The comm handle is
+// invalid on return, and a replacement comm can be created while the old one is
+// still being torn down.
+RCCL_PARAM(FastAbort, "FAST_ABORT", 0);
+
+static void* commReclaimThread(void* arg) {
+  ncclComm_t comm = (ncclComm_t)arg;
+  int rank = comm->rank, nranks = comm->nRanks, cudaDev = comm->cudaDev;
+  int64_t busId = comm->busId;
+  if (cudaSetDevice(cudaDev) != cudaSuccess) WARN("comm %p rank %d: cannot set device %d for the abort", comm, rank, cudaDev);
+  (void) commReclaim(comm);
+  INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx - Abort COMPLETE (background)", comm, rank, nranks, cudaDev, busId);
+  return NULL;
+}
+
 NCCL_API(ncclResult_t, ncclCommAbort, ncclComm_t comm);
 ncclResult_t ncclCommAbort(ncclComm_t comm) {
   if (comm == NULL) {
@@ -2641,22 +3256,41 @@ ncclResult_t ncclCommAbort(ncclComm_t comm) {
   /* init thread must be joined before we destroy the comm,
    * and we should ignore the init error here. */
   ncclCommEnsureReady(comm);
-
+  // Progress threads sleeping for work would only see the flag on their next wakeup
+  (void) ncclProxyWakeAll(comm);
+
+  if (rcclParamFastAbort()) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, commReclaimThread, comm) == 0) {
+      ncclSetThreadName(thread, "NCCL Abort%2d", cudaDev);
+      pthread_detach(thread);
+      INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx - Abort started", comm, rank, nranks, cudaDev, busId);
+      return ncclSuccess;
+    }
+    WARN("comm %p rank %d: failed to start the background abort, aborting synchronously", comm, rank);
+  }
   (void) commReclaim(comm);
   INFO(NCCL_INIT,"comm %p rank %d nranks %d cudaDev %d busId %lx - Abort COMPLETE", comm, rank, nranks, cudaDev, busId);
 
   return ncclSuccess;
 }
 
-NCCL_API(ncclResult_t, ncclCommSplit, ncclComm_t comm, int color, int key, ncclComm_t *newcomm, ncclConfig_t *config);
-ncclResult_t ncclCommSplit(ncclComm_t comm, int color, int key, ncclComm_t *newcomm, ncclConfig_t *config) {
+static void ncclCommSplitJobFree(void* job_) {
+  struct ncclCommInitRankAsyncJob* job = (struct ncclCommInitRankAsyncJob*)job_;
+  free(job->excludeRanks);
+  free(job);
+}
+
+// Creates a child of comm, either by color and key or, when excludeRanks is
+// set, from the ranks of comm that are not excluded.
+static ncclResult_t commSplit(ncclComm_t comm, int color, int key, int* excludeRanks, int excludeRanksCount, ncclComm_t *newcomm, ncclConfig_t *config, const char* opName) {
   struct ncclCommInitRankAsyncJob *job = NULL;
   struct ncclComm* childComm = NCCL_COMM_NULL;
   ncclResult_t res = ncclSuccess;
 
   NCCLCHECK(ncclGroupStartInternal());
-  NCCLCHECKGOTO(PtrCheck(comm, "CommSplit", "comm"), res, fail);
-  NCCLCHECKGOTO(PtrCheck(newcomm, "CommSplit", "newcomm"), res, fail);
+  NCCLCHECKGOTO(PtrCheck(comm, opName, "comm"), res, fail);
+  NCCLCHECKGOTO(PtrCheck(newcomm, opName, "newcomm"), res, fail);
   NCCLCHECKGOTO(ncclCommEnsureReady(comm), res, fail);
 
   /* *newcomm should be NCCL_COMM_NULL until comm split fully complete. */
@@ -2694,7 +3328,12 @@ ncclResult_t ncclCommSplit(ncclComm_t comm, int color, int key, ncclComm_t *newc
   job->color = color;
   job->key = key;
   job->cudaDev = comm->cudaDev;
-  NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, NULL, free, comm), res, fail);
+  if (excludeRanks) {
+    NCCLCHECKGOTO(ncclCalloc(&job->excludeRanks, excludeRanksCount > 0 ? excludeRanksCount : 1), res, fail);
+    memcpy(job->excludeRanks, excludeRanks, excludeRanksCount*sizeof(int));
+    job->excludeRanksCount = excludeRanksCount;
+  }
+  NCCLCHECKGOTO(ncclAsyncLaunch(&job->base, ncclCommInitRankFunc, NULL, ncclCommSplitJobFree, comm), res, fail);
 
 exit:
   ncclGroupErrCheck(res);
@@ -2712,6 +3351,32 @@ fail:
   goto exit;
 }
 
+NCCL_API(ncclResult_t, ncclCommSplit, ncclComm_t comm, int color, int key, ncclComm_t *newcomm, ncclConfig_t *config);
+ncclResult_t ncclCommSplit(ncclComm_t comm, int color, int key, ncclComm_t *newcomm, ncclConfig_t *config) {
+  return commSplit(comm, color, key, NULL, 0, newcomm, config, "CommSplit");
+}
+
+NCCL_API(ncclResult_t, ncclCommShrink, ncclComm_t comm, int* excludeRanksList, int excludeRanksCount, ncclComm_t* newcomm, ncclConfig_t* config);
+ncclResult_t ncclCommShrink(ncclComm_t comm, int* excludeRanksList, int excludeRanksCount, ncclComm_t* newcomm, ncclConfig_t* config) {
+  NCCLCHECK(PtrCheck(comm, "CommShrink", "comm"));
+  if (excludeRanksCount < 0 || excludeRanksCount >= comm->nRanks) {
+    WARN("CommShrink : invalid number of excluded ranks %d, nRanks %d", excludeRanksCount, comm->nRanks);
+    return ncclInvalidArgument;
+  }
+  if (excludeRanksCount > 0) NCCLCHECK(PtrCheck(excludeRanksList, "CommShrink", "excludeRanksList"));
+  // The surviving ranks agree on the exclusion list, in any order, which names the new comm
+  uint32_t color = 5381;
+  for (int e = 0; e < excludeRanksCount; e++) {
+    if (excludeRanksList[e] < 0 || excludeRanksList[e] >= comm->nRanks) {
+      WARN("CommShrink : invalid excluded rank %d, nRanks %d", excludeRanksList[e], comm->nRanks);
+      return ncclInvalidArgument;
+    }
+    color += (uint32_t)(excludeRanksList[e]+1) * 2654435761u;
+  }
+  INFO(NCCL_INIT, "CommShrink: comm %p rank %d excluding %d of %d ranks", comm, comm->rank, excludeRanksCount, comm->nRanks);
+  return commSplit(comm, (int)(color & 0x7fffffff), comm->rank, excludeRanksList, excludeRanksCount, newcomm, config, "CommShrink");
+}
+
 NCCL_API(const char*, ncclGetErrorString, ncclResult_t code);
 const char* ncclGetErrorString(ncclResult_t code) {
   switch (code) {
@@ -2857,6 +3522,11 @@ fallback:
   CUDACHECKGOTO(cudaMalloc(ptr, size), ret, fail);
 
 exit:
+  if (ret == ncclSuccess && ptr && *ptr) {
+    int dev;
+    CUDACHECK(cudaGetDevice(&dev));
+    NCCLCHECK(ncclPtrCacheInsert(*ptr, size, dev));
+  }
   return ret;
 fail:
   goto exit;
@@ -2869,6 +3539,7 @@ ncclResult_t  ncclMemFree(void *ptr) {
   int saveDevice;
 
   CUDACHECK(cudaGetDevice(&saveDevice));
+  ncclPtrCacheRemove(ptr);
 #if CUDART_VERSION >= 12010
   CUdevice ptrDev = 0;
   int mcSupport = 0;
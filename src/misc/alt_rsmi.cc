@@ -21,6 +21,7 @@
 #include <vector>
 #include <limits>
 #include <thread>
+#include <mutex>
 #include "alt_rsmi.h"
 #include "debug.h"
 
@@ -51,14 +52,22 @@ static const char *kPathDRMRoot = "/sys/class/drm";
 static const char *kKFDNodesPathRoot = "/sys/class/kfd/kfd/topology/nodes";
 static const uint32_t kAmdGpuId = 0x1002;
 
+// The tables below are shared by all threads of the process, so that only the
+// first communicator walks the KFD topology. They are filled under ARSMI_lock.
+static std::mutex ARSMI_lock;
+
 // Vector containing data about each node, ordered by bdf ID
-static thread_local std::vector<ARSMI_systemNode> ARSMI_orderedNodes;
+static std::vector<ARSMI_systemNode> ARSMI_orderedNodes;
 
-// 2-D matrix with link information between each pair of nodes.
-static thread_local std::vector<std::vector<ARSMI_linkInfo>> ARSMI_orderedLinks;
+// 2-D matrix with link information between each pair of nodes. The links of a
+// node are read the first time one of them is asked for.
+static std::vector<std::vector<ARSMI_linkInfo>> ARSMI_orderedLinks;
+static std::vector<bool> ARSMI_linksRead;
 
 // Number of devices recognized
-static thread_local int ARSMI_num_devices=-1;
+static int ARSMI_num_devices=-1;
+
+static int ARSMI_readLinks(int src_idx);
 
 
 // Public API functions
@@ -67,11 +76,13 @@ int ARSMI_init(void)
     std::string err_msg;
     uint32_t count = 0;
     std::multimap<uint64_t, ARSMI_systemNode> ARSMI_allSystemNodes;
+    std::lock_guard<std::mutex> lock(ARSMI_lock);
 
-    if (ARSMI_num_devices > 0) {
+    if (ARSMI_num_devices >= 0) {
         // has already been initialized
         return 0;
     }
+    ARSMI_orderedNodes.clear();
 
     auto node_dir = opendir(kKFDNodesPathRoot);
     if (node_dir == nullptr) {
@@ -126,7 +137,7 @@ int ARSMI_init(void)
         dentry = readdir(node_dir);
     }
 
-    ARSMI_num_devices = ARSMI_allSystemNodes.size();
+    int num_devices = ARSMI_allSystemNodes.size();
 
     for (auto i : ARSMI_allSystemNodes) {
         std::ostringstream ss;
@@ -207,90 +218,18 @@ int ARSMI_init(void)
         }
     }
 
-    // Part 2: generate Link Matrix
-    ARSMI_orderedLinks.resize(ARSMI_num_devices);
-    for (int i=0; i<ARSMI_num_devices; i++) {
-        ARSMI_orderedLinks[i].resize(ARSMI_num_devices);
-        for (int j = 0; j < ARSMI_num_devices; j++) {
+    // Part 2: allocate the Link Matrix, filled by ARSMI_readLinks
+    ARSMI_orderedLinks.resize(num_devices);
+    for (int i=0; i<num_devices; i++) {
+        ARSMI_orderedLinks[i].resize(num_devices);
+        for (int j = 0; j < num_devices; j++) {
             ARSMI_orderedLinks[i][j].src_node = std::numeric_limits<unsigned>::max();
             ARSMI_orderedLinks[i][j].dst_node = std::numeric_limits<unsigned>::max();
         }
     }
 
-    for (int src_idx = 0; src_idx < ARSMI_num_devices; src_idx++) {
-        struct ARSMI_systemNode node = ARSMI_orderedNodes[src_idx];
-        uint32_t src_id = node.s_node_id;
-
-        for (int i = 0; i < ARSMI_num_devices; i++) {
-            ARSMI_linkInfo info;
-            std::map<std::string, uint64_t> properties;
-            int ret = ARSMI_readLinkProperties(src_id, i, properties);
-            if (ret != 0){
-                continue;
-            }
-
-            uint64_t hops;
-            uint64_t type;
-            uint64_t weight;
-            uint64_t min_bandwidth;
-            uint64_t max_bandwidth;
-            uint64_t dst_id;
-
-            int ret_target = read_link_properties(src_id, i, "node_to", &dst_id, properties);
-            if (ret_target != 0) {
-                continue;
-            }
-            int dst_idx = getNodeIndex(dst_id);
-            if (dst_idx == -1) {
-                // Not all GPUs might be directly connected to all other GPUs.
-                // Will set default values in the topo_get_link_info function.
-                continue;
-            }
-            info.src_node = src_id;
-            info.dst_node = dst_id;
-
-            int ret_weight = read_link_properties(src_id, i, "weight", &weight, properties);
-            if (ret_weight != 0) {
-                WARN("Error reading link properties files");
-                return 1;
-            }
-            info.weight = weight;
-
-            int ret_type = read_link_properties(src_id, i, "type", &type, properties);
-            if (ret_type != 0) {
-                WARN("Error reading link properties files");
-                return 1;
-            }
-            if (type == 11){
-                info.type = ARSMI_IOLINK_TYPE_XGMI;
-                info.hops = 1;
-            }
-            else if (type == 2) {
-                info.type = ARSMI_IOLINK_TYPE_PCIEXPRESS;
-                // hard coding for now to 2
-                info.hops = 2;
-            }
-            else {
-                info.type = ARSMI_IOLINK_TYPE_UNDEFINED;
-                info.hops = 0;
-            }
-
-            int ret_min_bw = read_link_properties(src_id, i, "min_bandwidth", &min_bandwidth, properties);
-            if (ret_min_bw != 0) {
-                WARN("Error reading link properties files");
-                return 1;
-            }
-            info.min_bandwidth = min_bandwidth;
-
-            int ret_max_bw = read_link_properties(src_id, i, "max_bandwidth", &max_bandwidth, properties);
-            if (ret_max_bw != 0) {
-                return 1;
-            }
-            info.max_bandwidth = max_bandwidth;
-
-            ARSMI_orderedLinks[src_idx][dst_idx] = info;
-        }
-    }
+    ARSMI_linksRead.assign(num_devices, false);
+    ARSMI_num_devices = num_devices;
 
     return 0;
 }
@@ -298,14 +237,13 @@ int ARSMI_init(void)
 
 int ARSMI_get_num_devices (uint32_t *num_devices)
 {
-    int res = 0;
-
-    if (ARSMI_num_devices < 0) {
-        res = ARSMI_init();
+    int res = ARSMI_init();
+    if (res != 0) {
+        return res;
     }
 
     *num_devices = ARSMI_num_devices;
-    return res;
+    return 0;
 }
 
 int ARSMI_dev_pci_id_get(uint32_t dv_ind, uint64_t *bdfid)
@@ -314,11 +252,12 @@ int ARSMI_dev_pci_id_get(uint32_t dv_ind, uint64_t *bdfid)
         return EINVAL;
     }
 
-    if (ARSMI_num_devices < 0) {
-        int res = ARSMI_init();
-        if (res != 0) {
-            return res;
-        }
+    int res = ARSMI_init();
+    if (res != 0) {
+        return res;
+    }
+    if (dv_ind >= ARSMI_num_devices) {
+        return EINVAL;
     }
 
     *bdfid = ARSMI_orderedNodes[dv_ind].s_bdf;
@@ -334,24 +273,32 @@ int ARSMI_topo_get_link_info(uint32_t dv_ind_src, uint32_t dv_ind_dst,
         return EINVAL;
     }
 
-    if (ARSMI_num_devices < 0) {
-        int res = ARSMI_init();
-        if (res != 0) {
-            return res;
-        }
+    int res = ARSMI_init();
+    if (res != 0) {
+        return res;
     }
 
-    if (dv_ind_src < 0 || dv_ind_src > ARSMI_num_devices) {
+    if (dv_ind_src >= ARSMI_num_devices) {
         return EINVAL;
     }
-    if (dv_ind_dst < 0 || dv_ind_dst > ARSMI_num_devices) {
+    if (dv_ind_dst >= ARSMI_num_devices) {
         return EINVAL;
     }
 
     uint32_t src_id = ARSMI_orderedNodes[dv_ind_src].s_node_id;
     uint32_t dst_id = ARSMI_orderedNodes[dv_ind_dst].s_node_id;
 
-    ARSMI_linkInfo tinfo = ARSMI_orderedLinks[dv_ind_src][dv_ind_dst];
+    ARSMI_linkInfo tinfo;
+    {
+        std::lock_guard<std::mutex> lock(ARSMI_lock);
+        if (!ARSMI_linksRead[dv_ind_src]) {
+            res = ARSMI_readLinks(dv_ind_src);
+            if (res != 0) {
+                return res;
+            }
+        }
+        tinfo = ARSMI_orderedLinks[dv_ind_src][dv_ind_dst];
+    }
     if (tinfo.src_node != src_id || tinfo.dst_node != dst_id) {
         // Setting  default values.
         tinfo.hops = 2;
@@ -366,6 +313,87 @@ int ARSMI_topo_get_link_info(uint32_t dv_ind_src, uint32_t dv_ind_dst,
 }
 
 // Internal functions
+
+// Reads the links of the device src_idx, with ARSMI_lock held
+static int ARSMI_readLinks(int src_idx)
+{
+    struct ARSMI_systemNode node = ARSMI_orderedNodes[src_idx];
+    uint32_t src_id = node.s_node_id;
+
+    for (int i = 0; i < ARSMI_num_devices; i++) {
+        ARSMI_linkInfo info;
+        std::map<std::string, uint64_t> properties;
+        int ret = ARSMI_readLinkProperties(src_id, i, properties);
+        if (ret != 0){
+            continue;
+        }
+
+        uint64_t hops;
+        uint64_t type;
+        uint64_t weight;
+        uint64_t min_bandwidth;
+        uint64_t max_bandwidth;
+        uint64_t dst_id;
+
+        int ret_target = read_link_properties(src_id, i, "node_to", &dst_id, properties);
+        if (ret_target != 0) {
+            continue;
+        }
+        int dst_idx = getNodeIndex(dst_id);
+        if (dst_idx == -1) {
+            // Not all GPUs might be directly connected to all other GPUs.
+            // Will set default values in the topo_get_link_info function.
+            continue;
+        }
+        info.src_node = src_id;
+        info.dst_node = dst_id;
+
+        int ret_weight = read_link_properties(src_id, i, "weight", &weight, properties);
+        if (ret_weight != 0) {
+            WARN("Error reading link properties files");
+            return 1;
+        }
+        info.weight = weight;
+
+        int ret_type = read_link_properties(src_id, i, "type", &type, properties);
+        if (ret_type != 0) {
+            WARN("Error reading link properties files");
+            return 1;
+        }
+        if (type == 11){
+            info.type = ARSMI_IOLINK_TYPE_XGMI;
+            info.hops = 1;
+        }
+        else if (type == 2) {
+            info.type = ARSMI_IOLINK_TYPE_PCIEXPRESS;
+            // hard coding for now to 2
+            info.hops = 2;
+        }
+        else {
+            info.type = ARSMI_IOLINK_TYPE_UNDEFINED;
+            info.hops = 0;
+        }
+
+        int ret_min_bw = read_link_properties(src_id, i, "min_bandwidth", &min_bandwidth, properties);
+        if (ret_min_bw != 0) {
+            WARN("Error reading link properties files");
+            return 1;
+        }
+        info.min_bandwidth = min_bandwidth;
+
+        int ret_max_bw = read_link_properties(src_id, i, "max_bandwidth", &max_bandwidth, properties);
+        if (ret_max_bw != 0) {
+            return 1;
+        }
+        info.max_bandwidth = max_bandwidth;
+
+        ARSMI_orderedLinks[src_idx][dst_idx] = info;
+    }
+
+    ARSMI_linksRead[src_idx] = true;
+    return 0;
+}
+
 static int getNodeIndex(uint32_t node_id)
 {
     int res = -1;
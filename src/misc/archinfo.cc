@@ -73,3 +73,14 @@ bool IsArchMatch(char const* arch, char const* target) {
   // helper function to reduce clutter in code elsewhere.  Returns true on match.
   return (strncmp(arch, target, strlen(target)) == 0);
 }
+
+int GetP2pBuffMemType(char const* arch, bool simple) {
+#if defined(HIP_UNCACHED_MEMORY)
+  // gfx94x/gfx950 keep fine-grained memory coherent in L2, so bulk Simple data
+  // can stay cached there while the flags bypass it
+  if (simple && (IsArchMatch(arch, "gfx94") || IsArchMatch(arch, "gfx950"))) return ARCH_MEM_FINEGRAINED;
+  return ARCH_MEM_UNCACHED;
+#else
+  return ARCH_MEM_FINEGRAINED;
+#endif
+}
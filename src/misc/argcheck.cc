@@ -6,8 +6,105 @@
 
 #include "argcheck.h"
 #include "comm.h"
+#include "hostcoll.h"
+#include "register.h"
+#include <pthread.h>
+
+// Ranges of device memory known to be valid, so that CheckPointers does not need a
+// driver query for every buffer of every call. 1 caches only memory whose lifetime
+// RCCL sees (ncclMemAlloc until ncclMemFree, and buffers registered to the
+// communicator). 2 also caches any allocation once validated; it is then only safe
+// when buffers are not freed and their address reused while RCCL may be called on them.
+RCCL_PARAM(PtrCache, "PTR_CACHE", 1);
+
+struct ptrCacheRange {
+  uintptr_t base;
+  uintptr_t end;
+  int dev;
+};
+
+// Ranges are live allocations so they never overlap, sorted by base
+static struct ptrCacheRange* ptrCache = NULL;
+static int ptrCacheCount = 0, ptrCacheCapacity = 0;
+static pthread_mutex_t ptrCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+// First range starting after addr
+static int ptrCacheUpperBound(uintptr_t addr) {
+  int lo = 0, hi = ptrCacheCount;
+  while (lo < hi) {
+    int mid = (lo+hi)/2;
+    if (ptrCache[mid].base <= addr) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static bool ptrCacheLookup(const void* ptr, int* dev) {
+  uintptr_t addr = (uintptr_t)ptr;
+  bool found = false;
+  pthread_mutex_lock(&ptrCacheLock);
+  int i = ptrCacheUpperBound(addr)-1;
+  if (i >= 0 && addr < ptrCache[i].end) {
+    *dev = ptrCache[i].dev;
+    found = true;
+  }
+  pthread_mutex_unlock(&ptrCacheLock);
+  return found;
+}
+
+ncclResult_t ncclPtrCacheInsert(const void* base, size_t size, int dev) {
+  if (rcclParamPtrCache() == 0 || base == NULL || size == 0) return ncclSuccess;
+  ncclResult_t ret = ncclSuccess;
+  uintptr_t addr = (uintptr_t)base;
+  pthread_mutex_lock(&ptrCacheLock);
+  // Whatever overlaps the new allocation has been freed behind our back
+  int first = ptrCacheUpperBound(addr);
+  if (first > 0 && ptrCache[first-1].end > addr) first--;
+  int last = first;
+  while (last < ptrCacheCount && ptrCache[last].base < addr+size) last++;
+  if (last == first && ptrCacheCount == ptrCacheCapacity) {
+    int capacity = ptrCacheCapacity < 32 ? 32 : 2*ptrCacheCapacity;
+    NCCLCHECKGOTO(ncclRealloc(&ptrCache, ptrCacheCapacity, capacity), ret, exit);
+    ptrCacheCapacity = capacity;
+  }
+  memmove(ptrCache+first+1, ptrCache+last, (ptrCacheCount-last)*sizeof(struct ptrCacheRange));
+  ptrCacheCount += 1-(last-first);
+  ptrCache[first].base = addr;
+  ptrCache[first].end = addr+size;
+  ptrCache[first].dev = dev;
+exit:
+  pthread_mutex_unlock(&ptrCacheLock);
+  return ret;
+}
+
+void ncclPtrCacheRemove(const void* ptr) {
+  uintptr_t addr = (uintptr_t)ptr;
+  pthread_mutex_lock(&ptrCacheLock);
+  int i = ptrCacheUpperBound(addr)-1;
+  if (i >= 0 && addr < ptrCache[i].end) {
+    memmove(ptrCache+i, ptrCache+i+1, (ptrCacheCount-i-1)*sizeof(struct ptrCacheRange));
+    ptrCacheCount--;
+  }
+  pthread_mutex_unlock(&ptrCacheLock);
+}
 
 ncclResult_t CudaPtrCheck(const void* pointer, struct ncclComm* comm, const char* ptrname, const char* opname) {
+  int64_t cacheMode = rcclParamPtrCache();
+  if (cacheMode) {
+    int dev;
+    bool registered;
+    if (ptrCacheLookup(pointer, &dev)) {
+      if (dev != comm->cudaDev) {
+        WARN("%s : %s allocated on device %d mismatchs with NCCL device %d", opname, ptrname, dev, comm->cudaDev);
+        return ncclInvalidArgument;
+      }
+      return ncclSuccess;
+    }
+    // Registrations of this communicator were checked by ncclCommRegister and the
+    // user may not free them before deregistering
+    NCCLCHECK(ncclRegIsUserRegistered(comm, pointer, &registered));
+    if (registered) return ncclSuccess;
+  }
   cudaPointerAttributes attr;
   cudaError_t err = cudaPointerGetAttributes(&attr, pointer);
   if (err != cudaSuccess || attr.devicePointer == NULL) {
@@ -22,6 +119,19 @@ ncclResult_t CudaPtrCheck(const void* pointer, struct ncclComm* comm, const char
     WARN("%s : %s allocated on device %d mismatchs with NCCL device %d", opname, ptrname, attr.device, comm->cudaDev);
     return ncclInvalidArgument;
   }
+#if ROCM_VERSION < 50500
+  if (cacheMode == 2 && attr.memoryType == cudaMemoryTypeDevice) {
+#else
+  if (cacheMode == 2 && attr.type == cudaMemoryTypeDevice) {
+#endif
+    hipDeviceptr_t base;
+    size_t size;
+    if (hipMemGetAddressRange(&base, &size, (hipDeviceptr_t)pointer) == hipSuccess) {
+      NCCLCHECK(ncclPtrCacheInsert((void*)base, size, attr.device));
+    } else {
+      (void)hipGetLastError();
+    }
+  }
   return ncclSuccess;
 }
 
@@ -57,7 +167,9 @@ ncclResult_t ArgsCheck(struct ncclInfo* info) {
     return ncclInvalidArgument;
   }
 
-  if (info->comm->checkPointers) {
+  // Host buffers are not for the kernels but for the host collective thread
+  NCCLCHECK(ncclHostCollCheck(info));
+  if (info->comm->checkPointers && !info->hostColl) {
     if ((info->coll == ncclFuncSend || info->coll == ncclFuncRecv)) {
       if (info->count >0)
         NCCLCHECK(CudaPtrCheck(info->recvbuff, info->comm, "buff", info->opName));
@@ -0,0 +1,344 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <errno.h>
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "autotune.h"
+#include "bootstrap.h"
+#include "comm.h"
+#include "debug.h"
+#include "device.h"
+#include "info.h"
+#include "param.h"
+#include "tuner.h"
+
+RCCL_PARAM(Autotune, "AUTOTUNE", 0);
+RCCL_PARAM(AutotuneSamples, "AUTOTUNE_SAMPLES", 4);
+// Only explore combinations estimated within this factor of the best estimate
+RCCL_PARAM(AutotunePrune, "AUTOTUNE_PRUNE", 4);
+// Also explore the kernel unroll variants and block sizes
+RCCL_PARAM(AutotuneKernels, "AUTOTUNE_KERNELS", 1);
+
+static int64_t autotuneSamples() { return std::max<int64_t>(1, rcclParamAutotuneSamples()); }
+
+enum {
+  autotuneUnseen = 0,
+  autotuneExploring,
+  autotuneWaiting,    // queued for the exchange
+  autotuneExchanging, // exchange allreduce in flight
+  autotuneLocked
+};
+
+static int autotuneBucket(size_t nBytes) {
+  int l = 0;
+  while (nBytes >>= 1) l++;
+  return std::min(l, NCCL_AUTOTUNE_BUCKETS-1);
+}
+
+bool ncclAutotuneKernelVariants() {
+  return rcclParamAutotune() && rcclParamAutotuneKernels();
+}
+
+static void autotuneAddCandidate(struct ncclAutotuneBucket* b, int a, int p, int nChannels, int kernelUnroll = -1, int nThreads = 0) {
+  if (b->nCandidates == NCCL_AUTOTUNE_MAX_CANDIDATES) return;
+  struct ncclAutotuneCandidate* c = b->candidates + b->nCandidates++;
+  c->algorithm = a;
+  c->protocol = p;
+  c->nChannels = nChannels;
+  c->kernelUnroll = kernelUnroll;
+  c->nThreads = nThreads;
+}
+
+// Builds the list of candidates the first time a bucket is seen. The cost table
+// is the same on all ranks, so is the list.
+static void autotuneSetup(struct ncclComm* comm, struct ncclAutotuneBucket* b, struct ncclAutotuneCandidate* loaded, float table[][NCCL_NUM_PROTOCOLS]) {
+  b->choice = -1;
+  if (loaded->nChannels >= 0) {
+    if (loaded->algorithm == NCCL_ALGO_UNDEF) {
+      b->state = autotuneLocked;
+      return;
+    }
+    if (table[loaded->algorithm][loaded->protocol] != NCCL_ALGO_PROTO_IGNORE) {
+      // The other unroll variant is only initialized when kernels are tuned
+      int kernelUnroll = ncclAutotuneKernelVariants() ? loaded->kernelUnroll : -1;
+      autotuneAddCandidate(b, loaded->algorithm, loaded->protocol, loaded->nChannels, kernelUnroll, loaded->nThreads);
+      b->choice = 0;
+      b->state = autotuneLocked;
+      return;
+    }
+  }
+
+  float minCost = FLT_MAX;
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    if (table[a][p] >= 0) minCost = std::min(minCost, table[a][p]);
+  }
+  for (int a=0; a<NCCL_NUM_ALGORITHMS; a++) for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
+    if (table[a][p] < 0 || table[a][p] > minCost*rcclParamAutotunePrune()) continue;
+    autotuneAddCandidate(b, a, p, 0);
+    if (ncclAutotuneKernelVariants()) {
+      autotuneAddCandidate(b, a, p, 0, 1-comm->kernelUnroll);
+      // Smaller blocks only for Ring Simple, the other protocols size their buffer
+      // lines by the thread count
+      int nt = comm->maxThreads[a][p]/2;
+      if (a == NCCL_ALGO_RING && p == NCCL_PROTO_SIMPLE && nt >= 2*comm->WarpSize) autotuneAddCandidate(b, a, p, 0, -1, nt);
+    }
+    // Fewer channels leave CUs to concurrent compute and can be as fast for small sizes
+    if (a != NCCL_ALGO_RING && a != NCCL_ALGO_TREE) continue;
+    for (int div = 2; div <= 4; div *= 2) {
+      if (comm->collChannels/div >= 1) autotuneAddCandidate(b, a, p, comm->collChannels/div);
+    }
+  }
+  b->state = b->nCandidates > 1 ? autotuneExploring : autotuneLocked;
+}
+
+ncclResult_t ncclAutotuneGetCollInfo(struct ncclComm* comm, struct ncclInfo* collInfo,
+    float table[][NCCL_NUM_PROTOCOLS], int* nChannels, int* sample) {
+  struct ncclAutotune* at = comm->autotune;
+  *nChannels = -1;
+  *sample = 0;
+  if (at->internal || collInfo->coll >= NCCL_NUM_FUNCTIONS) return ncclSuccess;
+  int bucket = autotuneBucket(collInfo->nBytes);
+  struct ncclAutotuneBucket* b = &at->buckets[collInfo->coll][bucket];
+  if (b->state == autotuneUnseen) autotuneSetup(comm, b, &at->loaded[collInfo->coll][bucket], table);
+
+  int cand = -1;
+  if (b->state == autotuneExploring) {
+    cand = b->calls % b->nCandidates;
+    if (++b->calls == (uint64_t)b->nCandidates*autotuneSamples()) {
+      b->state = autotuneWaiting;
+      if (at->exchangeTail) at->exchangeTail->next = b;
+      else at->exchangeHead = b;
+      at->exchangeTail = b;
+    }
+  } else if (b->state == autotuneLocked) {
+    cand = b->choice;
+  }
+  if (cand < 0) return ncclSuccess;
+
+  // Candidates are shared by all ops and datatypes of a bucket, some may not
+  // support this one
+  struct ncclAutotuneCandidate* c = b->candidates + cand;
+  if (table[c->algorithm][c->protocol] == NCCL_ALGO_PROTO_IGNORE) return ncclSuccess;
+  collInfo->algorithm = c->algorithm;
+  collInfo->protocol = c->protocol;
+  *nChannels = c->nChannels;
+  collInfo->autotuneKernel = c->kernelUnroll+1;
+  collInfo->autotuneThreads = c->nThreads;
+  if (b->state != autotuneLocked) *sample = cand+1;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclAutotuneReport(struct ncclComm* comm, ncclFunc_t coll, size_t nBytes, int candidate, float timeUs) {
+  struct ncclAutotuneBucket* b = &comm->autotune->buckets[coll][autotuneBucket(nBytes)];
+  if (b->state != autotuneExploring && b->state != autotuneWaiting) return ncclSuccess;
+  if (candidate >= b->nCandidates) return ncclSuccess;
+  b->sumUs[candidate] += timeUs;
+  b->nSamples[candidate]++;
+  return ncclSuccess;
+}
+
+static void autotuneLock(struct ncclComm* comm, struct ncclAutotuneBucket* b) {
+  struct ncclAutotune* at = comm->autotune;
+  float best = FLT_MAX;
+  b->choice = -1;
+  for (int i=0; i<b->nCandidates; i++) {
+    if (at->hostTimes[i] < best) {
+      best = at->hostTimes[i];
+      b->choice = i;
+    }
+  }
+  b->state = autotuneLocked;
+  if (comm->rank == 0 && b->choice >= 0) {
+    int coll = (b - &at->buckets[0][0]) / NCCL_AUTOTUNE_BUCKETS;
+    int bucket = (b - &at->buckets[0][0]) % NCCL_AUTOTUNE_BUCKETS;
+    struct ncclAutotuneCandidate* c = b->candidates + b->choice;
+    INFO(NCCL_TUNING, "Autotune: %s 2^%d bytes -> Algo %s proto %s nChannels %d unroll %d nThreads %d time %f us (%d candidates)",
+        ncclFuncStr[coll], bucket, ncclAlgoStr[c->algorithm], ncclProtoStr[c->protocol], c->nChannels, c->kernelUnroll, c->nThreads, best, b->nCandidates);
+  }
+}
+
+ncclResult_t ncclAutotuneProgress(struct ncclComm* comm, hipStream_t stream) {
+  struct ncclAutotune* at = comm->autotune;
+  ncclResult_t ret = ncclSuccess;
+  int devOld = -1;
+  if (at->internal || (at->exchanging == nullptr && at->exchangeHead == nullptr)) return ncclSuccess;
+
+  CUDACHECK(hipGetDevice(&devOld));
+  if (devOld != comm->cudaDev) CUDACHECKGOTO(hipSetDevice(comm->cudaDev), ret, exit);
+  else devOld = -1;
+
+  if (at->exchanging) {
+    // Every rank launched its exchange at the same point, before this call
+    CUDACHECKGOTO(hipEventSynchronize(at->exchangeEvent), ret, exit);
+    autotuneLock(comm, at->exchanging);
+    at->exchanging = nullptr;
+  }
+  if (at->exchangeHead) {
+    struct ncclAutotuneBucket* b = at->exchangeHead;
+    at->exchangeHead = b->next;
+    if (at->exchangeHead == nullptr) at->exchangeTail = nullptr;
+    b->next = nullptr;
+
+    // All samples of this bucket have been launched by now
+    if (comm->tunerTimings) NCCLCHECKGOTO(ncclTunerPollTimings(comm, /*blocking=*/true), ret, exit);
+    for (int i=0; i<b->nCandidates; i++) {
+      at->hostTimes[i] = b->nSamples[i] ? b->sumUs[i]/b->nSamples[i] : FLT_MAX;
+    }
+    // Keep the slowest rank's time for every candidate
+    CUDACHECKGOTO(hipMemcpyAsync(at->devTimes, at->hostTimes, b->nCandidates*sizeof(float), hipMemcpyHostToDevice, stream), ret, exit);
+    at->internal = true;
+    ret = ncclAllReduce(at->devTimes, at->devTimes, b->nCandidates, ncclFloat32, ncclMax, comm, stream);
+    at->internal = false;
+    if (ret != ncclSuccess) goto exit;
+    CUDACHECKGOTO(hipMemcpyAsync(at->hostTimes, at->devTimes, b->nCandidates*sizeof(float), hipMemcpyDeviceToHost, stream), ret, exit);
+    CUDACHECKGOTO(hipEventRecord(at->exchangeEvent, stream), ret, exit);
+    b->state = autotuneExchanging;
+    at->exchanging = b;
+  }
+
+exit:
+  if (devOld != -1) CUDACHECK(hipSetDevice(devOld));
+  return ret;
+}
+
+// File format, one locked bucket per line:
+//   <coll> <nRanks> <nNodes> <log2 bytes> <algorithm> <protocol> <nChannels> <unroll> <nThreads>
+// with algorithm -1 when NCCL's default choice was the fastest. Lines without the
+// last two fields keep the default kernel.
+static void autotuneLoadFile(struct ncclComm* comm, const char* path, struct ncclAutotune* at) {
+  FILE* f = fopen(path, "r");
+  if (f == nullptr) {
+    INFO(NCCL_TUNING, "Autotune: no results in %s yet", path);
+    return;
+  }
+  char line[256];
+  int nLoaded = 0;
+  while (fgets(line, sizeof(line), f)) {
+    int coll, nRanks, nNodes, bucket, a, p, nc, unroll = -1, nt = 0;
+    if (line[0] == '#') continue;
+    if (sscanf(line, "%d %d %d %d %d %d %d %d %d", &coll, &nRanks, &nNodes, &bucket, &a, &p, &nc, &unroll, &nt) < 7) continue;
+    if (nRanks != comm->nRanks || nNodes != comm->nNodes) continue;
+    if (coll < 0 || coll >= NCCL_NUM_FUNCTIONS || bucket < 0 || bucket >= NCCL_AUTOTUNE_BUCKETS) continue;
+    if (a < NCCL_ALGO_UNDEF || a >= NCCL_NUM_ALGORITHMS || p < 0 || p >= NCCL_NUM_PROTOCOLS || nc < 0) continue;
+    if (unroll < -1 || unroll > 1 || nt < 0 || nt > NCCL_MAX_NTHREADS) continue;
+    at->loaded[coll][bucket].algorithm = a;
+    at->loaded[coll][bucket].protocol = p;
+    at->loaded[coll][bucket].nChannels = nc;
+    at->loaded[coll][bucket].kernelUnroll = unroll;
+    at->loaded[coll][bucket].nThreads = nt;
+    nLoaded++;
+  }
+  fclose(f);
+  INFO(NCCL_TUNING, "Autotune: loaded %d results from %s", nLoaded, path);
+}
+
+static void autotuneSaveFile(struct ncclComm* comm, const char* path, struct ncclAutotune* at) {
+  char* kept = nullptr;
+  size_t keptSize = 0;
+  FILE* f = open_memstream(&kept, &keptSize);
+  if (f == nullptr) return;
+  // Keep results of other communicator sizes and of buckets this run did not lock
+  FILE* old = fopen(path, "r");
+  if (old) {
+    char line[256];
+    while (fgets(line, sizeof(line), old)) {
+      int coll, nRanks, nNodes, bucket;
+      if (line[0] == '#') continue;
+      if (sscanf(line, "%d %d %d %d", &coll, &nRanks, &nNodes, &bucket) != 4) continue;
+      if (nRanks == comm->nRanks && nNodes == comm->nNodes &&
+          coll >= 0 && coll < NCCL_NUM_FUNCTIONS && bucket >= 0 && bucket < NCCL_AUTOTUNE_BUCKETS &&
+          at->buckets[coll][bucket].state == autotuneLocked) continue;
+      fputs(line, f);
+    }
+    fclose(old);
+  }
+  fclose(f);
+
+  f = fopen(path, "w");
+  if (f == nullptr) {
+    WARN("Autotune: unable to write results to %s : %s", path, strerror(errno));
+    free(kept);
+    return;
+  }
+  fprintf(f, "# coll nRanks nNodes log2Bytes algorithm protocol nChannels unroll nThreads\n");
+  if (kept) fputs(kept, f);
+  for (int c=0; c<NCCL_NUM_FUNCTIONS; c++) for (int i=0; i<NCCL_AUTOTUNE_BUCKETS; i++) {
+    struct ncclAutotuneBucket* b = &at->buckets[c][i];
+    if (b->state != autotuneLocked) continue;
+    if (b->choice < 0) {
+      fprintf(f, "%d %d %d %d %d %d %d %d %d\n", c, comm->nRanks, comm->nNodes, i, NCCL_ALGO_UNDEF, 0, 0, -1, 0);
+    } else {
+      struct ncclAutotuneCandidate* cand = b->candidates + b->choice;
+      fprintf(f, "%d %d %d %d %d %d %d %d %d\n", c, comm->nRanks, comm->nNodes, i, cand->algorithm, cand->protocol, cand->nChannels,
+          cand->kernelUnroll, cand->nThreads);
+    }
+  }
+  fclose(f);
+  free(kept);
+  INFO(NCCL_TUNING, "Autotune: saved results to %s", path);
+}
+
+ncclResult_t ncclAutotuneInit(struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclAutotune* at = nullptr;
+  int* ranks = nullptr;
+  const char* path = ncclGetEnv("RCCL_AUTOTUNE_FILE");
+
+  if (rcclParamAutotune() == 0 || comm->nRanks == 1) return ncclSuccess;
+  if (comm->tuner) {
+    INFO(NCCL_TUNING, "Autotune: tuner plugin loaded, built-in autotuner disabled");
+    return ncclSuccess;
+  }
+  if (!comm->config.blocking) {
+    INFO(NCCL_TUNING, "Autotune: not supported on non-blocking communicators");
+    return ncclSuccess;
+  }
+
+  NCCLCHECK(ncclCalloc(&at, 1));
+  for (int c=0; c<NCCL_NUM_FUNCTIONS; c++) for (int i=0; i<NCCL_AUTOTUNE_BUCKETS; i++) at->loaded[c][i].nChannels = -1;
+  if (path) {
+    // Rank 0's results are used everywhere so that all ranks make the same choices
+    if (comm->rank == 0) autotuneLoadFile(comm, path, at);
+    NCCLCHECKGOTO(ncclCalloc(&ranks, comm->nRanks), ret, fail);
+    for (int r=0; r<comm->nRanks; r++) ranks[r] = r;
+    NCCLCHECKGOTO(bootstrapIntraNodeBroadcast(comm->bootstrap, ranks, comm->rank, comm->nRanks, 0, at->loaded, sizeof(at->loaded)), ret, fail);
+  }
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&at->hostTimes, NCCL_AUTOTUNE_MAX_CANDIDATES), ret, fail);
+  NCCLCHECKGOTO(ncclCudaCalloc(&at->devTimes, NCCL_AUTOTUNE_MAX_CANDIDATES), ret, fail);
+  CUDACHECKGOTO(hipEventCreateWithFlags(&at->exchangeEvent, hipEventDisableTiming), ret, fail);
+  INFO(NCCL_INIT|NCCL_TUNING, "Autotune: enabled, %ld samples per candidate%s", autotuneSamples(),
+      ncclAutotuneKernelVariants() ? ", kernel variants included" : "");
+  comm->autotune = at;
+
+exit:
+  free(ranks);
+  return ret;
+fail:
+  if (at) {
+    if (at->hostTimes) ncclCudaHostFree(at->hostTimes);
+    if (at->devTimes) ncclCudaFree(at->devTimes);
+    free(at);
+  }
+  goto exit;
+}
+
+ncclResult_t ncclAutotuneFree(struct ncclComm* comm) {
+  struct ncclAutotune* at = comm->autotune;
+  if (at == nullptr) return ncclSuccess;
+  const char* path = ncclGetEnv("RCCL_AUTOTUNE_FILE");
+  if (path && comm->rank == 0) autotuneSaveFile(comm, path, at);
+  if (at->exchanging) (void)hipEventSynchronize(at->exchangeEvent);
+  CUDACHECK(hipEventDestroy(at->exchangeEvent));
+  NCCLCHECK(ncclCudaHostFree(at->hostTimes));
+  NCCLCHECK(ncclCudaFree(at->devTimes));
+  free(at);
+  comm->autotune = nullptr;
+  return ncclSuccess;
+}
@@ -0,0 +1,307 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "bufpool.h"
+#include "alloc.h"
+#include "argcheck.h"
+#include "bootstrap.h"
+#include "comm.h"
+#include "param.h"
+#include <pthread.h>
+
+RCCL_PARAM(BufferPool, "BUFFER_POOL", 0);
+// Unused physical memory kept per device for the next buffer or resume
+RCCL_PARAM(BufferPoolCache, "BUFFER_POOL_CACHE", 1LL << 30);
+
+#define BUFPOOL_MAX_DEVS 32
+
+struct bufPoolChunk {
+  hipMemGenericAllocationHandle_t handle;
+  size_t size;
+  struct bufPoolChunk* next;
+};
+
+struct bufPoolRegion {
+  char* ptr;
+  size_t size;       // reserved virtual range
+  size_t headerSize; // granule aligned part backed by header
+  int cudaDev;
+  void* owner;
+  hipMemGenericAllocationHandle_t header;
+  struct bufPoolChunk* data; // NULL while the owner is suspended
+  struct bufPoolRegion* next;
+};
+
+static pthread_mutex_t bufPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct bufPoolRegion* bufPoolRegions = NULL;
+static struct bufPoolChunk* bufPoolCached[BUFPOOL_MAX_DEVS];
+static size_t bufPoolCachedSize[BUFPOOL_MAX_DEVS];
+static int bufPoolSupported[BUFPOOL_MAX_DEVS]; // 0 unknown, 1 supported, -1 not supported
+
+static void bufPoolProp(int cudaDev, hipMemAllocationProp* prop) {
+  memset(prop, 0, sizeof(*prop));
+  prop->type = hipMemAllocationTypePinned;
+  prop->location.type = hipMemLocationTypeDevice;
+  prop->location.id = cudaDev;
+}
+
+bool ncclBufPoolEnabled(int cudaDev) {
+  if (rcclParamBufferPool() == 0 || cudaDev < 0 || cudaDev >= BUFPOOL_MAX_DEVS) return false;
+  int supported = __atomic_load_n(bufPoolSupported+cudaDev, __ATOMIC_RELAXED);
+  if (supported == 0) {
+    int vmm = 0;
+    if (hipDeviceGetAttribute(&vmm, hipDeviceAttributeVirtualMemoryManagementSupported, cudaDev) != hipSuccess) vmm = 0;
+    supported = vmm ? 1 : -1;
+    if (!vmm) INFO(NCCL_INIT|NCCL_ALLOC, "RCCL_BUFFER_POOL : device %d has no virtual memory support, buffers are not pooled", cudaDev);
+    __atomic_store_n(bufPoolSupported+cudaDev, supported, __ATOMIC_RELAXED);
+  }
+  return supported == 1;
+}
+
+// Peers in the process reach the buffers directly, so every GPU that can access
+// this one gets read/write access.
+static ncclResult_t bufPoolSetAccess(char* ptr, size_t size, int cudaDev) {
+  hipMemAccessDesc desc[BUFPOOL_MAX_DEVS];
+  int nDevs, n = 0;
+  CUDACHECK(hipGetDeviceCount(&nDevs));
+  for (int d = 0; d < std::min(nDevs, BUFPOOL_MAX_DEVS); d++) {
+    int access = 1;
+    if (d != cudaDev) CUDACHECK(hipDeviceCanAccessPeer(&access, d, cudaDev));
+    if (!access) continue;
+    desc[n].location.type = hipMemLocationTypeDevice;
+    desc[n].location.id = d;
+    desc[n].flags = hipMemAccessFlagsProtReadWrite;
+    n++;
+  }
+  CUDACHECK(hipMemSetAccess(ptr, size, desc, n));
+  return ncclSuccess;
+}
+
+// Stale data from another communicator could carry LL flags this one is waiting for
+static ncclResult_t bufPoolZero(char* ptr, size_t size) {
+  ncclResult_t ret = ncclSuccess;
+  cudaStreamCaptureMode mode = cudaStreamCaptureModeRelaxed;
+  cudaStream_t stream;
+  CUDACHECK(cudaThreadExchangeStreamCaptureMode(&mode));
+  CUDACHECKGOTO(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking), ret, exit);
+  CUDACHECKGOTO(cudaMemsetAsync(ptr, 0, size, stream), ret, destroy);
+  CUDACHECKGOTO(cudaStreamSynchronize(stream), ret, destroy);
+destroy:
+  CUDACHECK(cudaStreamDestroy(stream));
+exit:
+  CUDACHECK(cudaThreadExchangeStreamCaptureMode(&mode));
+  return ret;
+}
+
+// Called with bufPoolLock held
+static ncclResult_t bufPoolChunkGet(int cudaDev, size_t size, struct bufPoolChunk** chunk) {
+  for (struct bufPoolChunk** c = bufPoolCached+cudaDev; *c; c = &(*c)->next) {
+    if ((*c)->size != size) continue;
+    *chunk = *c;
+    *c = (*c)->next;
+    bufPoolCachedSize[cudaDev] -= size;
+    return ncclSuccess;
+  }
+  hipMemAllocationProp prop;
+  bufPoolProp(cudaDev, &prop);
+  struct bufPoolChunk* c;
+  NCCLCHECK(ncclCalloc(&c, 1));
+  hipError_t err = hipMemCreate(&c->handle, size, &prop, 0);
+  if (err != hipSuccess) {
+    WARN("RCCL_BUFFER_POOL : hipMemCreate of %zu bytes on device %d failed : %s", size, cudaDev, hipGetErrorString(err));
+    free(c);
+    return ncclUnhandledCudaError;
+  }
+  c->size = size;
+  *chunk = c;
+  return ncclSuccess;
+}
+
+// Called with bufPoolLock held
+static ncclResult_t bufPoolChunkPut(int cudaDev, struct bufPoolChunk* chunk) {
+  if (bufPoolCachedSize[cudaDev] + chunk->size > (size_t)rcclParamBufferPoolCache()) {
+    CUDACHECK(hipMemRelease(chunk->handle));
+    free(chunk);
+    return ncclSuccess;
+  }
+  chunk->next = bufPoolCached[cudaDev];
+  bufPoolCached[cudaDev] = chunk;
+  bufPoolCachedSize[cudaDev] += chunk->size;
+  return ncclSuccess;
+}
+
+// Called with bufPoolLock held
+static ncclResult_t bufPoolMapData(struct bufPoolRegion* r) {
+  size_t size = r->size - r->headerSize;
+  if (size == 0 || r->data) return ncclSuccess;
+  NCCLCHECK(bufPoolChunkGet(r->cudaDev, size, &r->data));
+  hipError_t err = hipMemMap(r->ptr+r->headerSize, size, 0, r->data->handle, 0);
+  if (err != hipSuccess) {
+    WARN("RCCL_BUFFER_POOL : hipMemMap of %zu bytes at %p failed : %s", size, r->ptr+r->headerSize, hipGetErrorString(err));
+    NCCLCHECK(bufPoolChunkPut(r->cudaDev, r->data));
+    r->data = NULL;
+    return ncclUnhandledCudaError;
+  }
+  NCCLCHECK(bufPoolSetAccess(r->ptr+r->headerSize, size, r->cudaDev));
+  return ncclSuccess;
+}
+
+// Called with bufPoolLock held
+static ncclResult_t bufPoolUnmapData(struct bufPoolRegion* r) {
+  if (r->data == NULL) return ncclSuccess;
+  CUDACHECK(hipMemUnmap(r->ptr+r->headerSize, r->size-r->headerSize));
+  NCCLCHECK(bufPoolChunkPut(r->cudaDev, r->data));
+  r->data = NULL;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclBufPoolAlloc(void** ptr, size_t size, size_t headerSize, void* owner) {
+  ncclResult_t ret = ncclSuccess;
+  hipMemAllocationProp prop;
+  size_t granularity = 0;
+  struct bufPoolRegion* r = NULL;
+  int cudaDev;
+  *ptr = NULL;
+  CUDACHECK(hipGetDevice(&cudaDev));
+  bufPoolProp(cudaDev, &prop);
+  CUDACHECK(hipMemGetAllocationGranularity(&granularity, &prop, hipMemAllocationGranularityMinimum));
+  ALIGN_SIZE(size, granularity);
+  ALIGN_SIZE(headerSize, granularity);
+  headerSize = std::min(std::max(headerSize, granularity), size);
+
+  NCCLCHECK(ncclCalloc(&r, 1));
+  r->size = size;
+  r->headerSize = headerSize;
+  r->cudaDev = cudaDev;
+  r->owner = owner;
+  CUDACHECKGOTO(hipMemAddressReserve((void**)&r->ptr, size, granularity, NULL, 0), ret, fail);
+  CUDACHECKGOTO(hipMemCreate(&r->header, headerSize, &prop, 0), ret, fail);
+  CUDACHECKGOTO(hipMemMap(r->ptr, headerSize, 0, r->header, 0), ret, fail);
+  NCCLCHECKGOTO(bufPoolSetAccess(r->ptr, headerSize, cudaDev), ret, fail);
+  pthread_mutex_lock(&bufPoolLock);
+  ret = bufPoolMapData(r);
+  if (ret == ncclSuccess) {
+    r->next = bufPoolRegions;
+    bufPoolRegions = r;
+  }
+  pthread_mutex_unlock(&bufPoolLock);
+  if (ret != ncclSuccess) goto fail;
+  NCCLCHECK(bufPoolZero(r->ptr, size));
+  INFO(NCCL_ALLOC, "RCCL_BUFFER_POOL : allocated %zu bytes at %p, %zu pooled, dev %d", size, r->ptr, size-headerSize, cudaDev);
+  *ptr = r->ptr;
+  return ncclSuccess;
+fail:
+  if (r->header) {
+    (void)hipMemUnmap(r->ptr, headerSize);
+    (void)hipMemRelease(r->header);
+  }
+  if (r->ptr) (void)hipMemAddressFree(r->ptr, size);
+  free(r);
+  return ret;
+}
+
+bool ncclBufPoolOwns(void* ptr) {
+  if (ptr == NULL) return false;
+  bool owns = false;
+  pthread_mutex_lock(&bufPoolLock);
+  for (struct bufPoolRegion* r = bufPoolRegions; r && !owns; r = r->next) owns = r->ptr == ptr;
+  pthread_mutex_unlock(&bufPoolLock);
+  return owns;
+}
+
+ncclResult_t ncclBufPoolFree(void* ptr) {
+  ncclResult_t ret = ncclSuccess;
+  struct bufPoolRegion* r = NULL;
+  pthread_mutex_lock(&bufPoolLock);
+  for (struct bufPoolRegion** p = &bufPoolRegions; *p; p = &(*p)->next) {
+    if ((*p)->ptr != ptr) continue;
+    r = *p;
+    *p = r->next;
+    break;
+  }
+  if (r) ret = bufPoolUnmapData(r);
+  pthread_mutex_unlock(&bufPoolLock);
+  if (r == NULL) {
+    WARN("RCCL_BUFFER_POOL : %p is not a pooled buffer", ptr);
+    return ncclInternalError;
+  }
+  CUDACHECK(hipMemUnmap(r->ptr, r->headerSize));
+  CUDACHECK(hipMemRelease(r->header));
+  CUDACHECK(hipMemAddressFree(r->ptr, r->size));
+  free(r);
+  return ret;
+}
+
+ncclResult_t ncclBufPoolSuspend(void* owner) {
+  ncclResult_t ret = ncclSuccess;
+  size_t released = 0;
+  pthread_mutex_lock(&bufPoolLock);
+  for (struct bufPoolRegion* r = bufPoolRegions; r && ret == ncclSuccess; r = r->next) {
+    if (r->owner != owner || r->data == NULL) continue;
+    released += r->data->size;
+    ret = bufPoolUnmapData(r);
+  }
+  pthread_mutex_unlock(&bufPoolLock);
+  if (released) INFO(NCCL_ALLOC, "RCCL_BUFFER_POOL : released %zu bytes of connection buffers to the pool", released);
+  return ret;
+}
+
+ncclResult_t ncclBufPoolResume(void* owner) {
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&bufPoolLock);
+  for (struct bufPoolRegion* r = bufPoolRegions; r && ret == ncclSuccess; r = r->next) {
+    if (r->owner != owner || r->data) continue;
+    ret = bufPoolMapData(r);
+    if (ret == ncclSuccess) ret = bufPoolZero(r->ptr+r->headerSize, r->size-r->headerSize);
+  }
+  pthread_mutex_unlock(&bufPoolLock);
+  return ret;
+}
+
+NCCL_API(ncclResult_t, ncclCommSuspend, ncclComm_t comm);
+ncclResult_t ncclCommSuspend(ncclComm_t comm) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  ncclResult_t ret = ncclSuccess;
+  int cudaDev;
+  NCCLCHECK(PtrCheck(comm, "CommSuspend", "comm"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (comm->suspended) {
+    WARN("CommSuspend : comm %p is already suspended", comm);
+    return ncclInvalidUsage;
+  }
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, exit);
+  // Operations are enqueued on user streams, so wait for everything on the device,
+  // then for the local peers, which read and write our buffers directly.
+  CUDACHECKGOTO(cudaDeviceSynchronize(), ret, exit);
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, comm->localRankToRank, comm->localRank, comm->localRanks, comm->localRankToRank[0]), ret, exit);
+  NCCLCHECKGOTO(ncclBufPoolSuspend(comm->proxyState), ret, exit);
+  comm->suspended = 1;
+exit:
+  CUDACHECK(cudaSetDevice(cudaDev));
+  return ret;
+}
+
+NCCL_API(ncclResult_t, ncclCommResume, ncclComm_t comm);
+ncclResult_t ncclCommResume(ncclComm_t comm) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  ncclResult_t ret = ncclSuccess;
+  int cudaDev;
+  NCCLCHECK(PtrCheck(comm, "CommResume", "comm"));
+  if (!comm->suspended) {
+    WARN("CommResume : comm %p is not suspended", comm);
+    return ncclInvalidUsage;
+  }
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, exit);
+  NCCLCHECKGOTO(ncclBufPoolResume(comm->proxyState), ret, exit);
+  // Peers must not write to our buffers before they are mapped again
+  NCCLCHECKGOTO(bootstrapBarrier(comm->bootstrap, comm->localRankToRank, comm->localRank, comm->localRanks, comm->localRankToRank[0]), ret, exit);
+  comm->suspended = 0;
+exit:
+  CUDACHECK(cudaSetDevice(cudaDev));
+  return ret;
+}
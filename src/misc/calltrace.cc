@@ -0,0 +1,125 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "calltrace.h"
+#include "comm.h"
+#include "debug.h"
+#include "group.h"
+#include "info.h"
+#include "param.h"
+
+// Records the mapping starts with, it doubles whenever it is full
+RCCL_PARAM(CallTraceRecords, "CALL_TRACE_RECORDS", 1 << 16);
+
+static size_t callTraceBytes(uint64_t nRecords) {
+  return sizeof(struct rcclCallTraceHeader) + nRecords*sizeof(struct rcclCallTraceRecord);
+}
+
+static ncclResult_t callTraceMap(struct ncclCallTrace* trace, uint64_t capacity) {
+  size_t bytes = callTraceBytes(capacity);
+  if (ftruncate(trace->fd, bytes) != 0) {
+    WARN("Call trace: failed to extend trace file to %zu bytes : %s", bytes, strerror(errno));
+    return ncclSystemError;
+  }
+  void* ptr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, trace->fd, 0);
+  if (ptr == MAP_FAILED) {
+    WARN("Call trace: failed to map %zu bytes : %s", bytes, strerror(errno));
+    return ncclSystemError;
+  }
+  if (trace->header) munmap(trace->header, trace->mapBytes);
+  trace->header = (struct rcclCallTraceHeader*)ptr;
+  trace->mapBytes = bytes;
+  trace->capacity = capacity;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCallTraceInit(struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclCallTrace* trace = nullptr;
+  struct rcclCallTraceHeader* header;
+  char path[PATH_MAX];
+
+  const char* prefix = ncclGetEnv("RCCL_CALL_TRACE");
+  if (prefix == nullptr || prefix[0] == '\0') return ncclSuccess;
+  snprintf(path, sizeof(path), "%s.%016lx.%d", prefix, comm->commHash, comm->rank);
+
+  NCCLCHECK(ncclCalloc(&trace, 1));
+  trace->fd = open(path, O_CREAT | O_TRUNC | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (trace->fd == -1) {
+    WARN("Call trace: could not open %s for writing : %s", path, strerror(errno));
+    ret = ncclSystemError;
+    goto fail;
+  }
+  NCCLCHECKGOTO(callTraceMap(trace, std::max<int64_t>(rcclParamCallTraceRecords(), 64)), ret, fail);
+
+  header = trace->header;
+  memcpy(header->magic, RCCL_CALL_TRACE_MAGIC, sizeof(RCCL_CALL_TRACE_MAGIC));
+  header->version = RCCL_CALL_TRACE_VERSION;
+  header->recordSize = sizeof(struct rcclCallTraceRecord);
+  header->commHash = comm->commHash;
+  header->rank = comm->rank;
+  header->nRanks = comm->nRanks;
+  header->cudaDev = comm->cudaDev;
+  header->pid = getpid();
+  getHostName(header->hostname, sizeof(header->hostname), '\0');
+  INFO(NCCL_INIT, "Call trace: recording enqueued operations to %s", path);
+  comm->callTrace = trace;
+  return ncclSuccess;
+fail:
+  if (trace->fd != -1) close(trace->fd);
+  free(trace);
+  // The trace is a debugging aid, never fail the communicator because of it
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCallTraceFree(struct ncclComm* comm) {
+  struct ncclCallTrace* trace = comm->callTrace;
+  if (trace == nullptr) return ncclSuccess;
+  uint64_t nRecords = trace->header->nRecords;
+  munmap(trace->header, trace->mapBytes);
+  // Drop the unused tail of the mapping
+  if (ftruncate(trace->fd, callTraceBytes(nRecords)) != 0) {
+    INFO(NCCL_ALL, "Call trace: failed to truncate trace file : %s", strerror(errno));
+  }
+  close(trace->fd);
+  free(trace);
+  comm->callTrace = nullptr;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclCallTraceRecord(struct ncclComm* comm, struct ncclInfo* info) {
+  struct ncclCallTrace* trace = comm->callTrace;
+  // Communicators are not used by several threads at once, no locking is needed
+  uint64_t n = trace->header->nRecords;
+  if (n == trace->capacity && callTraceMap(trace, 2*trace->capacity) != ncclSuccess) {
+    WARN("Call trace: stopping after %lu records", n);
+    NCCLCHECK(ncclCallTraceFree(comm));
+    return ncclSuccess;
+  }
+  struct rcclCallTraceRecord* r = (struct rcclCallTraceRecord*)(trace->header+1) + n;
+  r->opCount = comm->opCount;
+  r->count = info->count;
+  r->timeNs = clockNano();
+  r->stream = (uint64_t)info->stream;
+  r->root = info->root;
+  r->op = info->op;
+  r->task = comm->tasks.nTasksP2p + comm->tasks.nTasksColl;
+  r->func = info->coll;
+  r->datatype = info->datatype;
+  r->flags = (info->sendbuff == info->recvbuff ? RCCL_CALL_TRACE_IN_PLACE : 0) |
+             // ncclEnqueueCheck itself holds one level of group
+             (ncclGroupDepth > 1 ? RCCL_CALL_TRACE_GROUPED : 0);
+  __atomic_store_n(&trace->header->nRecords, n+1, __ATOMIC_RELEASE);
+  return ncclSuccess;
+}
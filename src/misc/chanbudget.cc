@@ -0,0 +1,65 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "chanbudget.h"
+#include "alloc.h"
+#include "comm.h"
+#include "param.h"
+#include <pthread.h>
+
+RCCL_PARAM(ChannelBudget, "CHANNEL_BUDGET", 0);
+
+struct channelBudgetEntry {
+  struct ncclComm* comm;
+  int cudaDev;
+  int priority;
+  struct channelBudgetEntry* next;
+};
+
+static pthread_mutex_t channelBudgetLock = PTHREAD_MUTEX_INITIALIZER;
+static struct channelBudgetEntry* channelBudgetComms = NULL;
+
+ncclResult_t ncclChannelBudgetRegister(struct ncclComm* comm, int* maxChannels) {
+  int budget = rcclParamChannelBudget();
+  *maxChannels = MAXCHANNELS;
+  if (budget <= 0) return ncclSuccess;
+
+  struct channelBudgetEntry* entry;
+  NCCLCHECK(ncclCalloc(&entry, 1));
+  entry->comm = comm;
+  entry->cudaDev = comm->cudaDev;
+  entry->priority = comm->config.priority;
+
+  int64_t prioritySum = 0;
+  int nComms = 0;
+  pthread_mutex_lock(&channelBudgetLock);
+  entry->next = channelBudgetComms;
+  channelBudgetComms = entry;
+  for (struct channelBudgetEntry* e = channelBudgetComms; e; e = e->next) {
+    if (e->cudaDev != entry->cudaDev) continue;
+    prioritySum += e->priority;
+    nComms++;
+  }
+  pthread_mutex_unlock(&channelBudgetLock);
+
+  *maxChannels = std::min<int64_t>(MAXCHANNELS, std::max<int64_t>(1, budget*entry->priority/prioritySum));
+  INFO(NCCL_INIT, "Channel budget : comm %p rank %d priority %d gets %d of %d channels on device %d (%d comms)",
+      comm, comm->rank, entry->priority, *maxChannels, budget, comm->cudaDev, nComms);
+  return ncclSuccess;
+}
+
+void ncclChannelBudgetUnregister(struct ncclComm* comm) {
+  struct channelBudgetEntry* entry = NULL;
+  pthread_mutex_lock(&channelBudgetLock);
+  for (struct channelBudgetEntry** e = &channelBudgetComms; *e; e = &(*e)->next) {
+    if ((*e)->comm != comm) continue;
+    entry = *e;
+    *e = entry->next;
+    break;
+  }
+  pthread_mutex_unlock(&channelBudgetLock);
+  free(entry);
+}
@@ -0,0 +1,115 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "archinfo.h"
+#include "clocksync.h"
+#include "comm.h"
+#include "device.h"
+#include "param.h"
+#include "profiler.h"
+#include "utils.h"
+
+// Round trips per sample, the shortest one is kept
+RCCL_PARAM(ClockSyncRounds, "CLOCK_SYNC_ROUNDS", 16);
+
+#define CLOCK_SYNC_TIMEOUT_NS 1000000000ULL
+
+static ncclResult_t clockSample(struct ncclComm* comm, struct ncclClockSample* sample) {
+  ncclResult_t ret = ncclSuccess;
+  int nRounds = std::max<int>(rcclParamClockSyncRounds(), 1);
+  uint64_t* mbox;
+  NCCLCHECK(ncclCudaHostCalloc(&mbox, 3));
+  sample->errNs = UINT64_MAX;
+  NCCLCHECKGOTO(ncclLaunchClockSync(mbox, nRounds, comm->sideStream), ret, exit);
+  for (uint64_t r = 1; r <= (uint64_t)nRounds; r++) {
+    uint64_t t0 = clockNano(), t1;
+    __atomic_store_n(mbox, r, __ATOMIC_RELEASE);
+    while (__atomic_load_n(mbox+2, __ATOMIC_ACQUIRE) != r) {
+      if (clockNano() - t0 > CLOCK_SYNC_TIMEOUT_NS) {
+        INFO(NCCL_INIT, "Clock sync: no answer from the GPU on round %lu", r);
+        __atomic_store_n(mbox, ~0ULL, __ATOMIC_RELEASE);
+        goto sync;
+      }
+    }
+    t1 = clockNano();
+    if ((t1-t0)/2 < sample->errNs) {
+      sample->errNs = (t1-t0)/2;
+      sample->hostNs = t0 + (t1-t0)/2;
+      sample->gpuTicks = __atomic_load_n(mbox+1, __ATOMIC_RELAXED);
+    }
+  }
+sync:
+  CUDACHECKGOTO(hipStreamSynchronize(comm->sideStream), ret, exit);
+exit:
+  NCCLCHECK(ncclCudaHostFree(mbox));
+  return ret;
+}
+
+ncclResult_t ncclClockSyncInit(struct ncclComm* comm) {
+  struct ncclClockSync* sync = &comm->clockSync;
+  bool needed = ncclProfilingEnabled();
+#if defined(ENABLE_NPKIT)
+  needed = true;
+#endif
+#ifdef ENABLE_COLLTRACE
+  if (comm->collTraceThread) needed = true;
+#endif
+  if (comm->collTimings) needed = true;
+  if (!needed) return ncclSuccess;
+
+  NCCLCHECK(clockSample(comm, &sync->first));
+  if (sync->first.errNs == UINT64_MAX) return ncclSuccess;
+  struct timespec rt;
+  clock_gettime(CLOCK_REALTIME, &rt);
+  sync->realtimeOffsetNs = (int64_t)(uint64_t(rt.tv_sec)*1000*1000*1000 + rt.tv_nsec) - (int64_t)clockNano();
+  sync->ticksPerNs = GetDeviceWallClockRateInKhz(comm->cudaDev) * 1.0E-6;
+  sync->last = sync->first;
+  sync->valid = 1;
+  INFO(NCCL_INIT, "Clock sync: GPU tick %lu at host %lu ns (+/- %lu ns), nominal %g ticks/ns",
+      sync->first.gpuTicks, sync->first.hostNs, sync->first.errNs, sync->ticksPerNs);
+  return ncclSuccess;
+}
+
+uint64_t ncclClockGpuToHostNs(struct ncclClockSync* sync, uint64_t gpuTicks) {
+  int64_t dTicks = (int64_t)(gpuTicks - sync->first.gpuTicks);
+  return sync->first.hostNs + (int64_t)(dTicks / sync->ticksPerNs);
+}
+
+ncclResult_t ncclClockSyncFinalize(struct ncclComm* comm) {
+  struct ncclClockSync* sync = &comm->clockSync;
+  if (!sync->valid) return ncclSuccess;
+
+  struct ncclClockSample last;
+  NCCLCHECK(clockSample(comm, &last));
+  // The drift is only meaningful once the uncertainty is small against the interval
+  if (last.errNs != UINT64_MAX && last.hostNs - sync->first.hostNs > 1000*(last.errNs + sync->first.errNs)) {
+    double nominal = sync->ticksPerNs;
+    sync->last = last;
+    sync->ticksPerNs = (double)(last.gpuTicks - sync->first.gpuTicks) / (last.hostNs - sync->first.hostNs);
+    INFO(NCCL_INIT, "Clock sync: GPU clock drift %.3f ppm over %.3f s", (sync->ticksPerNs/nominal - 1) * 1e6,
+        (last.hostNs - sync->first.hostNs) / 1e9);
+  }
+
+  const char* dir = ncclGetEnv("NPKIT_DUMP_DIR");
+  if (dir == NULL) return ncclSuccess;
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/clock_sync_rank_%d", dir, comm->rank);
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    WARN("Clock sync: could not write %s", path);
+    return ncclSystemError;
+  }
+  fprintf(f, "{\"host_ns\": %lu, \"gpu_ticks\": %lu, \"err_ns\": %lu, \"ticks_per_ns\": %.9f, \"realtime_offset_ns\": %ld, "
+      "\"last_host_ns\": %lu, \"last_gpu_ticks\": %lu}\n",
+      sync->first.hostNs, sync->first.gpuTicks, sync->first.errNs, sync->ticksPerNs, sync->realtimeOffsetNs,
+      sync->last.hostNs, sync->last.gpuTicks);
+  fclose(f);
+  return ncclSuccess;
+}
@@ -0,0 +1,131 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <string.h>
+
+#include "alloc.h"
+#include "archinfo.h"
+#include "argcheck.h"
+#include "clocksync.h"
+#include "colltiming.h"
+#include "comm.h"
+#include "core.h"
+#include "param.h"
+
+// Launches kept per channel for ncclCommGetCollTimings, rounded up to a power of
+// 2; 0 disables the timestamps
+RCCL_PARAM(CollTimings, "COLL_TIMINGS", 0);
+
+#define NCCL_COLL_TIMINGS_MAX (1<<16)
+
+ncclResult_t ncclCollTimingsSetup(struct ncclComm* comm, struct ncclDevComm* devComm) {
+  devComm->collTimings = nullptr;
+  devComm->collTimingsCount = nullptr;
+  devComm->collTimingsMask = 0;
+  int64_t n = rcclParamCollTimings();
+  if (n <= 0) return ncclSuccess;
+  int nEntries = 1;
+  while (nEntries < n && nEntries < NCCL_COLL_TIMINGS_MAX) nEntries <<= 1;
+
+  struct ncclCollTimings* t;
+  NCCLCHECK(ncclCalloc(&t, 1));
+  ncclCommPushFree(comm, t);
+  NCCLCHECK(ncclCalloc(&t->launches, nEntries));
+  ncclCommPushFree(comm, t->launches);
+  NCCLCHECK(ncclCudaHostCalloc(&t->recs, MAXCHANNELS*nEntries));
+  ncclCommPushCudaHostFree(comm, t->recs);
+  ncclMemStatsAdd(&comm->memStats, ncclMemOther, true, MAXCHANNELS*nEntries*sizeof(struct ncclDevCollTiming));
+  NCCLCHECK(ncclCudaCallocAsync(&devComm->collTimingsCount, MAXCHANNELS, comm->sharedRes->deviceStream.cudaStream));
+  ncclCommPushCudaFree(comm, devComm->collTimingsCount);
+  ncclMemStatsAdd(&comm->memStats, ncclMemOther, false, MAXCHANNELS*sizeof(uint64_t));
+  t->nEntries = nEntries;
+  t->ticksPerNs = GetDeviceWallClockRateInKhz(comm->cudaDev) * 1.0E-6;
+  devComm->collTimings = t->recs;
+  devComm->collTimingsMask = nEntries-1;
+  comm->collTimings = t;
+  INFO(NCCL_INIT, "Rank %d: timing the last %d launches of each channel", comm->rank, nEntries);
+  return ncclSuccess;
+}
+
+void ncclCollTimingsLaunch(struct ncclComm* comm, struct ncclKernelPlan* plan) {
+  struct ncclCollTimings* t = comm->collTimings;
+  if (plan->persistent) return;
+  struct ncclCollTimingLaunch* l = t->launches + (t->head & (t->nEntries-1));
+  l->seq = t->head++;
+  l->nColls = plan->timingNColls;
+  l->coll = l->nColls ? plan->timingColl.collType : ncclFuncSendRecv;
+  l->algorithm = l->nColls ? plan->timingColl.algorithm : -1;
+  l->protocol = l->nColls ? plan->timingColl.protocol : -1;
+  l->nChannels = plan->channelCount;
+  l->bytes = plan->timingBytes;
+  l->channelMask = plan->channelMask;
+  for (int c = 0; c < MAXCHANNELS; c++) {
+    if (plan->channelMask.masks[c/64] & (1ull<<(c%64))) l->pos[c] = t->channelPos[c]++;
+  }
+}
+
+static uint64_t collTimingNs(struct ncclComm* comm, uint64_t ticks) {
+  if (comm->clockSync.valid) return ncclClockGpuToHostNs(&comm->clockSync, ticks);
+  return (uint64_t)(ticks / comm->collTimings->ticksPerNs);
+}
+
+NCCL_API(ncclResult_t, ncclCommGetCollTimings, const ncclComm_t comm, ncclCollTiming_t* timings, int maxTimings, int* nTimings);
+ncclResult_t ncclCommGetCollTimings(const ncclComm_t comm, ncclCollTiming_t* timings, int maxTimings, int* nTimings) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+
+  NCCLCHECK(PtrCheck(comm, "CommGetCollTimings", "comm"));
+  NCCLCHECK(PtrCheck(nTimings, "CommGetCollTimings", "nTimings"));
+  if (maxTimings < 0) {
+    WARN("CommGetCollTimings : invalid maxTimings %d", maxTimings);
+    return ncclInvalidArgument;
+  }
+  if (maxTimings > 0) NCCLCHECK(PtrCheck(timings, "CommGetCollTimings", "timings"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  *nTimings = 0;
+  struct ncclCollTimings* t = comm->collTimings;
+  if (t == nullptr) return ncclSuccess;
+  uint64_t mask = t->nEntries-1;
+  // Launches whose description was overwritten are lost, seq shows the gap
+  if (t->head - t->tail > (uint64_t)t->nEntries) t->tail = t->head - t->nEntries;
+  while (*nTimings < maxTimings && t->tail != t->head) {
+    struct ncclCollTimingLaunch* l = t->launches + (t->tail & mask);
+    uint64_t start = UINT64_MAX, end = 0;
+    bool done = true, lost = false;
+    for (int c = 0; c < MAXCHANNELS && done; c++) {
+      if (!(l->channelMask.masks[c/64] & (1ull<<(c%64)))) continue;
+      struct ncclDevCollTiming* rec = t->recs + c*t->nEntries + (l->pos[c] & mask);
+      uint64_t tag = __atomic_load_n(&rec->tag, __ATOMIC_ACQUIRE);
+      if (tag != l->pos[c]+1) {
+        // A later launch of the channel reused the record
+        lost = tag > l->pos[c]+1;
+        done = false;
+        break;
+      }
+      start = std::min(start, rec->start);
+      end = std::max(end, rec->end);
+    }
+    if (lost) {
+      t->tail++;
+      continue;
+    }
+    // Launches complete in order on every channel, the next ones are not done either
+    if (!done) break;
+    ncclCollTiming_t* r = timings + *nTimings;
+    r->seq = l->seq;
+    r->coll = l->coll;
+    r->nColls = l->nColls;
+    r->algorithm = l->algorithm;
+    r->protocol = l->protocol;
+    r->nChannels = l->nChannels;
+    r->bytes = l->bytes;
+    r->startNs = collTimingNs(comm, start);
+    r->endNs = collTimingNs(comm, end);
+    t->tail++;
+    (*nTimings)++;
+  }
+  return ncclSuccess;
+}
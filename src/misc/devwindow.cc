@@ -0,0 +1,150 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "argcheck.h"
+#include "bootstrap.h"
+#include "comm.h"
+#include "ipccache.h"
+#include "p2p.h"
+#include "rccl_device.h"
+
+// Windows for the device-side API of rccl_device.h. Each rank allocates one shareable
+// buffer holding its signal counters followed by the data, the buffers are exchanged
+// like the p2p transport buffers, and the table of peer mappings is copied to the
+// device where user kernels read it.
+
+#define DEV_WINDOW_HEADER 4096
+
+struct ncclDevWindowState {
+  ncclDevWindow_t host;
+  ncclDevWindow_t* dev;
+  char* base;
+  size_t allocSize;
+  ncclIpcDesc ipcDesc;
+  char* peerBases[NCCL_DEV_WINDOW_MAX_RANKS];
+  bool imported[NCCL_DEV_WINDOW_MAX_RANKS];
+  struct ncclDevWindowState* next;
+};
+
+struct devWindowPeer {
+  ncclIpcDesc ipcDesc;
+  char* base;
+};
+
+static ncclResult_t devWindowFree(struct ncclComm* comm, struct ncclDevWindowState* w) {
+  for (int p=0; p<w->host.nRanks; p++) {
+    if (!w->imported[p]) continue;
+    if (ncclCuMemEnable()) {
+      NCCLCHECK(ncclCudaFree(w->peerBases[p]));
+    } else {
+      NCCLCHECK(ncclIpcCacheClose(w->peerBases[p]));
+    }
+  }
+  if (w->dev) NCCLCHECK(ncclCudaFree(w->dev));
+  if (w->base) {
+    NCCLCHECK(ncclP2pFreeShareableBuffer(&w->ipcDesc));
+    NCCLCHECK(ncclCudaFree(w->base));
+  }
+  free(w);
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclDevWindowCreate, ncclComm_t comm, size_t size, ncclDevWindow_t** window, void** localBuff);
+ncclResult_t ncclDevWindowCreate(ncclComm_t comm, size_t size, ncclDevWindow_t** window, void** localBuff) {
+  struct ncclDevWindowState* w = NULL;
+  struct devWindowPeer* peers = NULL;
+  struct ncclPeerInfo* myInfo;
+  ncclResult_t ret = ncclSuccess;
+  int cudaDev;
+
+  NCCLCHECK(PtrCheck(comm, "DevWindowCreate", "comm"));
+  NCCLCHECK(PtrCheck(window, "DevWindowCreate", "window"));
+  NCCLCHECK(PtrCheck(localBuff, "DevWindowCreate", "localBuff"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (comm->nNodes != 1 || comm->nRanks > NCCL_DEV_WINDOW_MAX_RANKS || comm->intraHighestTransportType != TRANSPORT_P2P) {
+    WARN("DevWindowCreate : all %d ranks must be on one node (%d nodes, max %d ranks) and reachable over P2P",
+        comm->nRanks, comm->nNodes, NCCL_DEV_WINDOW_MAX_RANKS);
+    return ncclInvalidUsage;
+  }
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, fail);
+
+  NCCLCHECKGOTO(ncclCalloc(&w, 1), ret, fail);
+  w->host.rank = comm->rank;
+  w->host.nRanks = comm->nRanks;
+  w->host.size = size;
+  w->allocSize = DEV_WINDOW_HEADER + ROUNDUP(size, DEV_WINDOW_HEADER);
+  NCCLCHECKGOTO(ncclP2pAllocateShareableBuffer(w->allocSize, &w->ipcDesc, (void**)&w->base), ret, fail);
+  // Counters must be zero before any peer can signal, the allgather below orders it
+  CUDACHECKGOTO(cudaMemset(w->base, 0, DEV_WINDOW_HEADER), ret, fail);
+
+  NCCLCHECKGOTO(ncclCalloc(&peers, comm->nRanks), ret, fail);
+  peers[comm->rank].ipcDesc = w->ipcDesc;
+  peers[comm->rank].base = w->base;
+  NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, peers, sizeof(*peers)), ret, fail);
+
+  myInfo = comm->peerInfo+comm->rank;
+  for (int p=0; p<comm->nRanks; p++) {
+    struct ncclPeerInfo* peerInfo = comm->peerInfo+p;
+    if (p == comm->rank) {
+      w->peerBases[p] = w->base;
+    } else if (!ncclCuMemEnable() && peerInfo->hostHash == myInfo->hostHash && peerInfo->pidHash == myInfo->pidHash) {
+      // Same process, the pointer is valid once peer access is enabled
+      cudaError_t err = cudaDeviceEnablePeerAccess(peerInfo->cudaDev, 0);
+      if (err != cudaSuccess && err != cudaErrorPeerAccessAlreadyEnabled) CUDACHECKGOTO(err, ret, fail);
+      (void)cudaGetLastError();
+      w->peerBases[p] = peers[p].base;
+    } else {
+      NCCLCHECKGOTO(ncclP2pImportShareableBuffer(comm, comm->topParentRanks[p], w->allocSize, &peers[p].ipcDesc, (void**)&w->peerBases[p]), ret, fail);
+      w->imported[p] = true;
+    }
+    w->host.signals[p] = (uint64_t*)w->peerBases[p];
+    w->host.barriers[p] = w->host.signals[p] + NCCL_DEV_WINDOW_MAX_RANKS;
+    w->host.buffs[p] = w->peerBases[p] + DEV_WINDOW_HEADER;
+  }
+  NCCLCHECKGOTO(ncclCudaCalloc(&w->dev, 1), ret, fail);
+  CUDACHECKGOTO(cudaMemcpy(w->dev, &w->host, sizeof(w->host), cudaMemcpyHostToDevice), ret, fail);
+
+  w->next = comm->devWindows;
+  comm->devWindows = w;
+  *window = w->dev;
+  *localBuff = w->host.buffs[comm->rank];
+  INFO(NCCL_INIT, "DevWindowCreate: comm %p rank %d window %p size %zu", comm, comm->rank, w->dev, size);
+
+exit:
+  free(peers);
+  CUDACHECK(cudaSetDevice(cudaDev));
+  return ret;
+fail:
+  if (w) devWindowFree(comm, w);
+  goto exit;
+}
+
+NCCL_API(ncclResult_t, ncclDevWindowDestroy, ncclComm_t comm, ncclDevWindow_t* window);
+ncclResult_t ncclDevWindowDestroy(ncclComm_t comm, ncclDevWindow_t* window) {
+  NCCLCHECK(PtrCheck(comm, "DevWindowDestroy", "comm"));
+  struct ncclDevWindowState** w = &comm->devWindows;
+  while (*w && (*w)->dev != window) w = &(*w)->next;
+  if (*w == NULL) {
+    WARN("DevWindowDestroy : unknown window %p", window);
+    return ncclInvalidArgument;
+  }
+  struct ncclDevWindowState* state = *w;
+  *w = state->next;
+  // Peers may still be accessing our window until they reach the barrier
+  NCCLCHECK(bootstrapBarrier(comm->bootstrap, comm->localRankToRank, comm->localRank, comm->localRanks, comm->localRankToRank[0]));
+  return devWindowFree(comm, state);
+}
+
+ncclResult_t ncclDevWindowFreeAll(struct ncclComm* comm) {
+  while (comm->devWindows) {
+    struct ncclDevWindowState* w = comm->devWindows;
+    comm->devWindows = w->next;
+    NCCLCHECK(devWindowFree(comm, w));
+  }
+  return ncclSuccess;
+}
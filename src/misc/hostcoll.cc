@@ -0,0 +1,731 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "bootstrap.h"
+#include "comm.h"
+#include "core.h"
+#include "graph.h"
+#include "group.h"
+#include "hostcoll.h"
+#include "net.h"
+#include "shm.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+
+// Collectives on host buffers run on a thread of the communicator instead of a
+// kernel: the ranks form the ring of channel 0, and each rank sends to the next
+// one through a fifo of slots, in shared memory created by the receiver when both
+// are on the same node, or in registered host memory over a connection of the
+// network plugin otherwise. The algorithms are those of the ring kernels,
+// reducing on the CPU with loops the compiler vectorizes. Like the windows of
+// rma.cc, the stream rings a doorbell when it reaches a collective and waits for
+// the thread to report its completion, so that there is no kernel launch and no
+// copy between host and device memory.
+
+RCCL_PARAM(HostColl, "HOST_COLL", 1);
+// Pinned host memory is also accessible to the kernels, it takes the host path
+// for collectives of up to this many bytes
+RCCL_PARAM(HostCollPinnedThreshold, "HOST_COLL_PINNED_THRESHOLD", 65536);
+
+#define HC_TAG 0x48434f00 // "HCO"
+#define HC_MAX_OPS 1024
+#define HC_SLOTS 8
+#define HC_SLOT_SIZE (1 << 16)
+// Ring steps send at most half of the fifo, so that a step never waits for the
+// next rank to consume the previous one
+#define HC_CHUNK_SLOTS (HC_SLOTS/2)
+
+enum hcRedOp { hcOpSum, hcOpProd, hcOpMin, hcOpMax, hcOpPreMulSum, hcOpSumPostDiv };
+
+struct hcSync {
+  uint64_t doorbell; // last collective of the slot the stream reached
+  uint64_t complete; // last collective of the slot done by the thread
+};
+
+struct hcShmFifo {
+  uint64_t head; // slots written by the sender
+  char pad0[120];
+  uint64_t tail; // slots consumed by the receiver
+  char pad1[120];
+  char data[HC_SLOTS*HC_SLOT_SIZE];
+};
+
+struct hcLinkInfo {
+  int isNet;
+  char shmPath[32];
+  char handle[NCCL_NET_HANDLE_MAXSIZE];
+};
+
+struct hcLink {
+  int isNet;
+  uint64_t head; // slots written to the fifo (send) or received in it (recv)
+  uint64_t tail; // slots known free (send) or consumed (recv)
+  // Same node
+  struct hcShmFifo* fifo;
+  ncclShmHandle_t shmHandle;
+  // Other nodes, slots in buff
+  void* listenComm;
+  void* netComm;
+  char* buff;
+  void* mhandle;
+  uint64_t posted; // isends or irecvs posted
+  int sizes[HC_SLOTS];
+  void* requests[HC_SLOTS];
+};
+
+struct hcOp {
+  ncclFunc_t coll;
+  ncclDataType_t datatype;
+  int redOp;
+  uint64_t scalar;
+  const char* sendbuff;
+  char* recvbuff;
+  size_t count;
+  int root;
+  uint64_t seq;
+  struct hcOp* next;
+};
+
+struct ncclHostColl {
+  struct ncclComm* comm;
+  int* ringRanks; // userRanks of the ring, from this rank
+  struct hcLink send, recv;
+  struct hcSync* sync; // [HC_MAX_OPS]
+  uint64_t seq;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct hcOp* queueHead, *queueTail;
+  pthread_t thread;
+  int threadStarted;
+  int stop;
+  ncclResult_t error;
+};
+
+// 0 for memory of the device, 1 for pinned host memory, 2 for pageable memory
+static int hcMemType(const void* ptr) {
+  cudaPointerAttributes attr;
+  if (cudaPointerGetAttributes(&attr, ptr) != cudaSuccess) {
+    (void)cudaGetLastError();
+    return 2;
+  }
+#if ROCM_VERSION < 50500
+  int type = attr.memoryType;
+#else
+  int type = attr.type;
+#endif
+  if (type == cudaMemoryTypeDevice || type == cudaMemoryTypeManaged) return 0;
+  return type == cudaMemoryTypeHost ? 1 : 2;
+}
+
+bool ncclHostCollBuffers(struct ncclComm* comm, ncclFunc_t coll, const void* sendbuff, const void* recvbuff, int root, size_t nBytes) {
+  if (!rcclParamHostColl() || comm->nRanks == 1) return false;
+  if (coll != ncclFuncAllReduce && coll != ncclFuncAllGather && coll != ncclFuncReduceScatter &&
+      coll != ncclFuncBroadcast && coll != ncclFuncReduce) return false;
+  int sendType = coll != ncclFuncBroadcast || comm->rank == root ? hcMemType(sendbuff) : -1;
+  int recvType = coll != ncclFuncReduce || comm->rank == root ? hcMemType(recvbuff) : -1;
+  if (sendType == 0 || recvType == 0) return false;
+  if (sendType == 2 || recvType == 2) return true;
+  return nBytes <= (size_t)rcclParamHostCollPinnedThreshold();
+}
+
+ncclResult_t ncclHostCollCheck(struct ncclInfo* info) {
+  info->hostColl = info->count != 0 &&
+    ncclHostCollBuffers(info->comm, info->coll, info->sendbuff, info->recvbuff, info->root, info->nBytes);
+  return ncclSuccess;
+}
+
+static ncclResult_t hcGetRedOp(struct ncclInfo* info, int* redOp, uint64_t* scalar) {
+  *scalar = info->opFull.scalarArg;
+  switch (info->opFull.op) {
+  case ncclDevSum: *redOp = hcOpSum; return ncclSuccess;
+  case ncclDevProd: *redOp = hcOpProd; return ncclSuccess;
+  case ncclDevMinMax: *redOp = info->op == ncclMin ? hcOpMin : hcOpMax; return ncclSuccess;
+  case ncclDevSumPostDiv: *redOp = hcOpSumPostDiv; return ncclSuccess;
+  case ncclDevPreMulSum:
+    if (!info->opFull.scalarArgIsPtr) {
+      *redOp = hcOpPreMulSum;
+      return ncclSuccess;
+    }
+    break;
+  default:
+    break;
+  }
+  WARN("%s: the reduction operator is not supported with host buffers, use a builtin operator or a PreMulSum with an immediate scalar", info->opName);
+  return ncclInvalidUsage;
+}
+
+ncclResult_t ncclHostCollAppend(struct ncclComm* comm, struct ncclInfo* info) {
+  struct ncclCudaGraph graph;
+  int redOp;
+  uint64_t scalar;
+  NCCLCHECK(ncclCudaGetCapturingGraph(&graph, info->stream));
+  if (ncclCudaGraphValid(graph)) {
+    WARN("%s: collectives on host buffers cannot be captured in a graph", info->opName);
+    return ncclInvalidUsage;
+  }
+  NCCLCHECK(hcGetRedOp(info, &redOp, &scalar));
+  ncclGroupCommJoin(comm);
+  struct ncclInfo* t = ncclMemoryStackAlloc<struct ncclInfo>(&comm->memScoped);
+  memcpy(t, info, sizeof(struct ncclInfo));
+  ncclIntruQueueEnqueue(&comm->tasks.collHostQueue, t);
+  if (comm->hostColl == NULL) {
+    comm->hostCollRequested = true;
+    ncclGroupCommPreconnect(comm);
+  }
+  return ncclSuccess;
+}
+
+/* Fifos */
+
+static ncclResult_t hcProgress(struct ncclHostColl* hc) {
+  ncclNet_t* net = hc->comm->ncclNet;
+  struct hcLink* s = &hc->send;
+  struct hcLink* r = &hc->recv;
+  int done;
+  if (s->isNet) {
+    while (s->posted < s->head) {
+      int slot = s->posted%HC_SLOTS;
+      NCCLCHECK(net->isend(s->netComm, s->buff+slot*HC_SLOT_SIZE, s->sizes[slot], 0, s->mhandle, s->requests+slot));
+      if (s->requests[slot] == NULL) break;
+      s->posted++;
+    }
+    while (s->tail < s->posted) {
+      int slot = s->tail%HC_SLOTS;
+      NCCLCHECK(net->test(s->requests[slot], &done, NULL));
+      if (!done) break;
+      s->requests[slot] = NULL;
+      s->tail++;
+    }
+  }
+  if (r->isNet) {
+    // Receives stay posted for the whole fifo, sizes are known by both sides
+    while (r->posted < r->tail + HC_SLOTS) {
+      int slot = r->posted%HC_SLOTS;
+      void* data = r->buff+slot*HC_SLOT_SIZE;
+      int size = HC_SLOT_SIZE, tag = 0;
+      NCCLCHECK(net->irecv(r->netComm, 1, &data, &size, &tag, &r->mhandle, r->requests+slot));
+      if (r->requests[slot] == NULL) break;
+      r->posted++;
+    }
+    while (r->head < r->posted) {
+      int slot = r->head%HC_SLOTS;
+      NCCLCHECK(net->test(r->requests[slot], &done, NULL));
+      if (!done) break;
+      r->requests[slot] = NULL;
+      r->head++;
+    }
+  }
+  if (__atomic_load_n(hc->comm->abortFlag, __ATOMIC_RELAXED) || __atomic_load_n(&hc->stop, __ATOMIC_ACQUIRE)) return ncclInternalError;
+  return ncclSuccess;
+}
+
+static ncclResult_t hcSendSlot(struct ncclHostColl* hc, char** slot) {
+  struct hcLink* s = &hc->send;
+  while (s->head - (s->isNet ? s->tail : __atomic_load_n(&s->fifo->tail, __ATOMIC_ACQUIRE)) >= HC_SLOTS) {
+    NCCLCHECK(hcProgress(hc));
+  }
+  *slot = (s->isNet ? s->buff : s->fifo->data) + (s->head%HC_SLOTS)*HC_SLOT_SIZE;
+  return ncclSuccess;
+}
+
+static ncclResult_t hcSendPost(struct hcLink* s, int size) {
+  s->sizes[s->head%HC_SLOTS] = size;
+  s->head++;
+  if (!s->isNet) __atomic_store_n(&s->fifo->head, s->head, __ATOMIC_RELEASE);
+  return ncclSuccess;
+}
+
+static ncclResult_t hcRecvSlot(struct ncclHostColl* hc, char** slot) {
+  struct hcLink* r = &hc->recv;
+  while ((r->isNet ? r->head : __atomic_load_n(&r->fifo->head, __ATOMIC_ACQUIRE)) <= r->tail) {
+    NCCLCHECK(hcProgress(hc));
+  }
+  *slot = (r->isNet ? r->buff : r->fifo->data) + (r->tail%HC_SLOTS)*HC_SLOT_SIZE;
+  return ncclSuccess;
+}
+
+static ncclResult_t hcRecvDone(struct hcLink* r) {
+  r->tail++;
+  if (!r->isNet) __atomic_store_n(&r->fifo->tail, r->tail, __ATOMIC_RELEASE);
+  return ncclSuccess;
+}
+
+/* Reductions */
+
+// Types without CPU arithmetic are reduced in float
+template<typename T> struct hcAcc {
+  typedef T A;
+  static A load(T x) { return x; }
+  static T store(A x) { return x; }
+};
+template<> struct hcAcc<half> {
+  typedef float A;
+  static A load(half x) { return __half2float(x); }
+  static half store(A x) { return __float2half(x); }
+};
+#if defined(RCCL_BFLOAT16)
+template<> struct hcAcc<hip_bfloat16> {
+  typedef float A;
+  static A load(hip_bfloat16 x) { return static_cast<float>(x); }
+  static hip_bfloat16 store(A x) { return static_cast<hip_bfloat16>(x); }
+};
+#endif
+#if defined(RCCL_FLOAT8)
+template<> struct hcAcc<rccl_float8> {
+  typedef float A;
+  static A load(rccl_float8 x) { return static_cast<float>(x); }
+  static rccl_float8 store(A x) { return static_cast<rccl_float8>(x); }
+};
+template<> struct hcAcc<rccl_bfloat8> {
+  typedef float A;
+  static A load(rccl_bfloat8 x) { return static_cast<float>(x); }
+  static rccl_bfloat8 store(A x) { return static_cast<rccl_bfloat8>(x); }
+};
+#endif
+
+template<typename T, int Op>
+struct hcFunc {
+  typedef typename hcAcc<T>::A A;
+  A scale;
+  uint64_t divisor;
+  hcFunc(uint64_t scalar) : scale(A(1)), divisor(scalar) {
+    if (Op == hcOpPreMulSum) {
+      T s;
+      memcpy(&s, &scalar, sizeof(T));
+      scale = hcAcc<T>::load(s);
+    }
+  }
+  A pre(A x) const { return Op == hcOpPreMulSum ? A(x*scale) : x; }
+  A post(A x) const {
+    if (Op != hcOpSumPostDiv) return x;
+    if (std::is_floating_point<A>::value) return A(x/A(divisor));
+    return std::is_signed<A>::value ? A(int64_t(x)/int64_t(divisor)) : A(uint64_t(x)/divisor);
+  }
+  A red(A a, A b) const {
+    return Op == hcOpProd ? A(a*b) : Op == hcOpMin ? (b < a ? b : a) : Op == hcOpMax ? (a < b ? b : a) : A(a+b);
+  }
+};
+
+template<typename T, int Op>
+static void hcCopyPre(const hcFunc<T, Op>& fn, const T* src, T* dst, size_t n) {
+  if (Op != hcOpPreMulSum) {
+    memcpy(dst, src, n*sizeof(T));
+    return;
+  }
+  for (size_t i = 0; i < n; i++) dst[i] = hcAcc<T>::store(fn.pre(hcAcc<T>::load(src[i])));
+}
+
+// dst may be own, for in-place collectives
+template<typename T, int Op, bool Post>
+static void hcReduce(const hcFunc<T, Op>& fn, const T* __restrict__ in, const T* own, T* dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    typename hcAcc<T>::A x = fn.red(hcAcc<T>::load(in[i]), fn.pre(hcAcc<T>::load(own[i])));
+    dst[i] = hcAcc<T>::store(Post ? fn.post(x) : x);
+  }
+}
+
+/* Ring primitives, each over as many slots as n elements take */
+
+template<typename T, int Op>
+struct hcPrims {
+  struct ncclHostColl* hc;
+  hcFunc<T, Op> fn;
+  static const size_t slotElems = HC_SLOT_SIZE/sizeof(T);
+
+  hcPrims(struct ncclHostColl* hc, uint64_t scalar) : hc(hc), fn(scalar) {}
+
+  ncclResult_t send(const T* own, size_t n) {
+    for (size_t i = 0; i < n; i += slotElems) {
+      size_t m = std::min(slotElems, n-i);
+      char* out;
+      NCCLCHECK(hcSendSlot(hc, &out));
+      hcCopyPre(fn, own+i, (T*)out, m);
+      NCCLCHECK(hcSendPost(&hc->send, m*sizeof(T)));
+    }
+    return ncclSuccess;
+  }
+  ncclResult_t recvReduceSend(const T* own, size_t n) {
+    for (size_t i = 0; i < n; i += slotElems) {
+      size_t m = std::min(slotElems, n-i);
+      char *in, *out;
+      NCCLCHECK(hcRecvSlot(hc, &in));
+      NCCLCHECK(hcSendSlot(hc, &out));
+      hcReduce<T, Op, false>(fn, (const T*)in, own+i, (T*)out, m);
+      NCCLCHECK(hcSendPost(&hc->send, m*sizeof(T)));
+      NCCLCHECK(hcRecvDone(&hc->recv));
+    }
+    return ncclSuccess;
+  }
+  // Final reduction into dst, also sent on when doSend
+  ncclResult_t recvReduceCopy(const T* own, T* dst, size_t n, bool doSend) {
+    for (size_t i = 0; i < n; i += slotElems) {
+      size_t m = std::min(slotElems, n-i);
+      char *in, *out;
+      NCCLCHECK(hcRecvSlot(hc, &in));
+      hcReduce<T, Op, true>(fn, (const T*)in, own+i, dst+i, m);
+      if (doSend) {
+        NCCLCHECK(hcSendSlot(hc, &out));
+        memcpy(out, dst+i, m*sizeof(T));
+        NCCLCHECK(hcSendPost(&hc->send, m*sizeof(T)));
+      }
+      NCCLCHECK(hcRecvDone(&hc->recv));
+    }
+    return ncclSuccess;
+  }
+  ncclResult_t recvCopy(T* dst, size_t n, bool doSend) {
+    for (size_t i = 0; i < n; i += slotElems) {
+      size_t m = std::min(slotElems, n-i);
+      char *in, *out;
+      NCCLCHECK(hcRecvSlot(hc, &in));
+      memcpy(dst+i, in, m*sizeof(T));
+      if (doSend) {
+        NCCLCHECK(hcSendSlot(hc, &out));
+        memcpy(out, in, m*sizeof(T));
+        NCCLCHECK(hcSendPost(&hc->send, m*sizeof(T)));
+      }
+      NCCLCHECK(hcRecvDone(&hc->recv));
+    }
+    return ncclSuccess;
+  }
+};
+
+/* Algorithms, those of the ring kernels (see device/all_reduce.h) */
+
+template<typename T, int Op>
+static ncclResult_t hcRun(struct ncclHostColl* hc, struct hcOp* op) {
+  hcPrims<T, Op> prims(hc, op->scalar);
+  const T* in = (const T*)op->sendbuff;
+  T* out = (T*)op->recvbuff;
+  const int* ur = hc->ringRanks;
+  int nranks = hc->comm->nRanks;
+  size_t count = op->count;
+  const size_t chunkElems = HC_CHUNK_SLOTS*prims.slotElems;
+
+  switch (op->coll) {
+  case ncclFuncAllReduce:
+    for (size_t base = 0; base < count; base += nranks*chunkElems) {
+      size_t realChunk = std::min(chunkElems, DIVUP(count-base, nranks));
+      auto off = [&](int c) { return std::min(count, base + c*realChunk); };
+      auto len = [&](int c) { return std::min(count, off(c) + realChunk) - off(c); };
+      int c = ur[nranks-1];
+      NCCLCHECK(prims.send(in+off(c), len(c)));
+      for (int j = 2; j < nranks; j++) {
+        c = ur[nranks-j];
+        NCCLCHECK(prims.recvReduceSend(in+off(c), len(c)));
+      }
+      c = ur[0];
+      NCCLCHECK(prims.recvReduceCopy(in+off(c), out+off(c), len(c), true));
+      for (int j = 1; j < nranks-1; j++) {
+        c = ur[nranks-j];
+        NCCLCHECK(prims.recvCopy(out+off(c), len(c), true));
+      }
+      c = ur[1];
+      NCCLCHECK(prims.recvCopy(out+off(c), len(c), false));
+    }
+    break;
+  case ncclFuncReduceScatter:
+    for (size_t base = 0; base < count; base += chunkElems) {
+      size_t n = std::min(chunkElems, count-base);
+      int c = ur[nranks-1];
+      NCCLCHECK(prims.send(in+c*count+base, n));
+      for (int j = 2; j < nranks; j++) {
+        c = ur[nranks-j];
+        NCCLCHECK(prims.recvReduceSend(in+c*count+base, n));
+      }
+      c = ur[0];
+      NCCLCHECK(prims.recvReduceCopy(in+c*count+base, out+base, n, false));
+    }
+    break;
+  case ncclFuncAllGather:
+    for (size_t base = 0; base < count; base += chunkElems) {
+      size_t n = std::min(chunkElems, count-base);
+      int c = ur[0];
+      if (in+base != out+c*count+base) memcpy(out+c*count+base, in+base, n*sizeof(T));
+      NCCLCHECK(prims.send(in+base, n));
+      for (int j = 1; j < nranks-1; j++) {
+        c = ur[nranks-j];
+        NCCLCHECK(prims.recvCopy(out+c*count+base, n, true));
+      }
+      c = ur[1];
+      NCCLCHECK(prims.recvCopy(out+c*count+base, n, false));
+    }
+    break;
+  case ncclFuncBroadcast:
+    // A chain from the root along the ring
+    if (hc->comm->rank == op->root) {
+      if (in != out) memcpy(out, in, count*sizeof(T));
+      NCCLCHECK(prims.send(in, count));
+    } else {
+      NCCLCHECK(prims.recvCopy(out, count, ur[1] != op->root));
+    }
+    break;
+  case ncclFuncReduce:
+    // A chain along the ring which ends at the root
+    if (hc->comm->rank == op->root) {
+      NCCLCHECK(prims.recvReduceCopy(in, out, count, false));
+    } else if (ur[nranks-1] == op->root) {
+      NCCLCHECK(prims.send(in, count));
+    } else {
+      NCCLCHECK(prims.recvReduceSend(in, count));
+    }
+    break;
+  default:
+    return ncclInternalError;
+  }
+  return ncclSuccess;
+}
+
+template<typename T>
+static ncclResult_t hcRunType(struct ncclHostColl* hc, struct hcOp* op) {
+  switch (op->redOp) {
+  case hcOpSum: return hcRun<T, hcOpSum>(hc, op);
+  case hcOpProd: return hcRun<T, hcOpProd>(hc, op);
+  case hcOpMin: return hcRun<T, hcOpMin>(hc, op);
+  case hcOpMax: return hcRun<T, hcOpMax>(hc, op);
+  case hcOpPreMulSum: return hcRun<T, hcOpPreMulSum>(hc, op);
+  case hcOpSumPostDiv: return hcRun<T, hcOpSumPostDiv>(hc, op);
+  }
+  return ncclInternalError;
+}
+
+static ncclResult_t hcRunOp(struct ncclHostColl* hc, struct hcOp* op) {
+  // Copies are done on bytes
+  if (op->coll == ncclFuncAllGather || op->coll == ncclFuncBroadcast) return hcRun<int8_t, hcOpSum>(hc, op);
+  switch (op->datatype) {
+  case ncclInt8: return hcRunType<int8_t>(hc, op);
+  case ncclUint8: return hcRunType<uint8_t>(hc, op);
+  case ncclInt32: return hcRunType<int32_t>(hc, op);
+  case ncclUint32: return hcRunType<uint32_t>(hc, op);
+  case ncclInt64: return hcRunType<int64_t>(hc, op);
+  case ncclUint64: return hcRunType<uint64_t>(hc, op);
+  case ncclFloat16: return hcRunType<half>(hc, op);
+  case ncclFloat32: return hcRunType<float>(hc, op);
+  case ncclFloat64: return hcRunType<double>(hc, op);
+#if defined(RCCL_BFLOAT16)
+  case ncclBfloat16: return hcRunType<hip_bfloat16>(hc, op);
+#endif
+#if defined(RCCL_FLOAT8)
+  case ncclFp8E4M3: return hcRunType<rccl_float8>(hc, op);
+  case ncclFp8E5M2: return hcRunType<rccl_bfloat8>(hc, op);
+#endif
+  default: return ncclInternalError;
+  }
+}
+
+/* Thread */
+
+static void* hcThreadMain(void* arg) {
+  struct ncclHostColl* hc = (struct ncclHostColl*)arg;
+  struct ncclComm* comm = hc->comm;
+  struct hcOp* op = NULL;
+  ncclResult_t ret = ncclSuccess;
+
+  if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+  while (true) {
+    pthread_mutex_lock(&hc->mutex);
+    while (hc->queueHead == NULL && !hc->stop) pthread_cond_wait(&hc->cond, &hc->mutex);
+    if (hc->stop) {
+      pthread_mutex_unlock(&hc->mutex);
+      break;
+    }
+    op = hc->queueHead;
+    hc->queueHead = op->next;
+    if (hc->queueHead == NULL) hc->queueTail = NULL;
+    pthread_mutex_unlock(&hc->mutex);
+
+    // Collectives run in the order they were launched, which is the same on every rank
+    struct hcSync* sync = hc->sync + op->seq%HC_MAX_OPS;
+    while (__atomic_load_n(&sync->doorbell, __ATOMIC_ACQUIRE) < op->seq) {
+      if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED) || __atomic_load_n(&hc->stop, __ATOMIC_ACQUIRE)) {
+        ret = ncclInternalError;
+        goto fail;
+      }
+      sched_yield();
+    }
+    NCCLCHECKGOTO(hcRunOp(hc, op), ret, fail);
+    __atomic_store_n(&sync->complete, op->seq, __ATOMIC_RELEASE);
+    // The last sends may not be posted to the plugin yet, the next rank waits for them
+    while (hc->send.isNet && hc->send.tail < hc->send.head) NCCLCHECKGOTO(hcProgress(hc), ret, fail);
+    free(op);
+    op = NULL;
+  }
+exit:
+  free(op);
+  return NULL;
+fail:
+  if (!__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED) && !__atomic_load_n(&hc->stop, __ATOMIC_ACQUIRE)) {
+    WARN("HostColl : rank %d failed with error %d", comm->rank, ret);
+    __atomic_store_n(&comm->asyncResult, ret, __ATOMIC_RELEASE);
+  }
+  // Release the streams waiting on collectives that will never complete
+  pthread_mutex_lock(&hc->mutex);
+  __atomic_store_n(&hc->error, ret, __ATOMIC_RELEASE);
+  while (hc->queueHead) {
+    struct hcOp* next = hc->queueHead->next;
+    free(hc->queueHead);
+    hc->queueHead = next;
+  }
+  hc->queueTail = NULL;
+  for (int s=0; s<HC_MAX_OPS; s++) __atomic_store_n(&hc->sync[s].complete, UINT64_MAX, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&hc->mutex);
+  goto exit;
+}
+
+ncclResult_t ncclHostCollLaunch(struct ncclComm* comm) {
+  struct ncclHostColl* hc = comm->hostColl;
+  while (!ncclIntruQueueEmpty(&comm->tasks.collHostQueue)) {
+    struct ncclInfo* info = ncclIntruQueueDequeue(&comm->tasks.collHostQueue);
+    struct hcOp* op;
+    NCCLCHECK(__atomic_load_n(&hc->error, __ATOMIC_ACQUIRE));
+    NCCLCHECK(ncclCalloc(&op, 1));
+    op->coll = info->coll;
+    op->datatype = info->datatype;
+    op->root = info->root;
+    op->sendbuff = (const char*)info->sendbuff;
+    op->recvbuff = (char*)info->recvbuff;
+    op->count = info->count;
+    (void)hcGetRedOp(info, &op->redOp, &op->scalar);
+
+    pthread_mutex_lock(&hc->mutex);
+    uint64_t seq = op->seq = ++hc->seq;
+    if (hc->queueTail) hc->queueTail->next = op;
+    else hc->queueHead = op;
+    hc->queueTail = op;
+    pthread_cond_signal(&hc->cond);
+    pthread_mutex_unlock(&hc->mutex);
+
+    // The slot is free once the collective that used it before completed
+    struct hcSync* sync = hc->sync + seq%HC_MAX_OPS;
+    while (seq > HC_MAX_OPS && __atomic_load_n(&sync->complete, __ATOMIC_ACQUIRE) < seq-HC_MAX_OPS) {
+      if (__atomic_load_n(&hc->error, __ATOMIC_ACQUIRE) != ncclSuccess) break;
+      sched_yield();
+    }
+    CUDACHECK(hipStreamWriteValue64(info->stream, &sync->doorbell, seq, 0));
+    CUDACHECK(hipStreamWaitValue64(info->stream, &sync->complete, seq, hipStreamWaitValueGte, ~0ull));
+  }
+  return ncclSuccess;
+}
+
+/* Setup */
+
+static ncclResult_t hcNetBuff(struct ncclComm* comm, struct hcLink* link) {
+  NCCLCHECK(ncclCudaHostCalloc(&link->buff, HC_SLOTS*HC_SLOT_SIZE));
+  NCCLCHECK(comm->ncclNet->regMr(link->netComm, link->buff, HC_SLOTS*HC_SLOT_SIZE, NCCL_PTR_HOST, &link->mhandle));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclHostCollSetup(struct ncclComm* comm) {
+  struct ncclRing* ring = &comm->channels[0].ring;
+  struct ncclHostColl* hc = NULL;
+  struct hcLinkInfo recvInfo = {}, sendInfo = {};
+  ncclNetDeviceHandle_t* devHandle = NULL;
+  ncclResult_t ret = ncclSuccess;
+  int netDev = 0;
+
+  NCCLCHECK(ncclCalloc(&hc, 1));
+  hc->comm = comm;
+  pthread_mutex_init(&hc->mutex, NULL);
+  pthread_cond_init(&hc->cond, NULL);
+  NCCLCHECKGOTO(ncclCalloc(&hc->ringRanks, comm->nRanks), ret, fail);
+  memcpy(hc->ringRanks, ring->userRanks, comm->nRanks*sizeof(int));
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&hc->sync, HC_MAX_OPS), ret, fail);
+
+  hc->send.isNet = comm->peerInfo[ring->next].hostHash != comm->peerInfo[comm->rank].hostHash;
+  hc->recv.isNet = comm->peerInfo[ring->prev].hostHash != comm->peerInfo[comm->rank].hostHash;
+  if (hc->send.isNet || hc->recv.isNet) NCCLCHECKGOTO(ncclTopoGetLocalNet(comm->topo, comm->rank, 0, &netDev), ret, fail);
+
+  // The receiver creates the fifo, or listens, and tells the previous rank
+  recvInfo.isNet = hc->recv.isNet;
+  if (hc->recv.isNet) {
+    NCCLCHECKGOTO(comm->ncclNet->listen(netDev, recvInfo.handle, &hc->recv.listenComm), ret, fail);
+  } else {
+    char shmPath[PATH_MAX];
+    shmPath[0] = '\0';
+    NCCLCHECKGOTO(ncclShmOpen(shmPath, sizeof(struct hcShmFifo), (void**)&hc->recv.fifo, NULL, 1, &hc->recv.shmHandle), ret, fail);
+    strncpy(recvInfo.shmPath, shmPath, sizeof(recvInfo.shmPath)-1);
+  }
+  NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, ring->prev, HC_TAG, &recvInfo, sizeof(recvInfo)), ret, fail);
+  NCCLCHECKGOTO(bootstrapRecv(comm->bootstrap, ring->next, HC_TAG, &sendInfo, sizeof(sendInfo)), ret, fail);
+  if (!hc->send.isNet) {
+    NCCLCHECKGOTO(ncclShmOpen(sendInfo.shmPath, sizeof(struct hcShmFifo), (void**)&hc->send.fifo, NULL, -1, &hc->send.shmHandle), ret, fail);
+  }
+  // Connect and accept are non-blocking, progress both together
+  if (hc->send.isNet || hc->recv.isNet) {
+    ncclNetCommConfig_t netConfig;
+    ncclNetGetCommConfig(comm, &netConfig);
+    while ((hc->send.isNet && hc->send.netComm == NULL) || (hc->recv.isNet && hc->recv.netComm == NULL)) {
+      if (hc->send.isNet && hc->send.netComm == NULL) NCCLCHECKGOTO(comm->ncclNet->connect(netDev, &netConfig, sendInfo.handle, &hc->send.netComm, &devHandle), ret, fail);
+      if (hc->recv.isNet && hc->recv.netComm == NULL) NCCLCHECKGOTO(comm->ncclNet->accept(hc->recv.listenComm, &hc->recv.netComm, &devHandle), ret, fail);
+      if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) {
+        ret = ncclInternalError;
+        goto fail;
+      }
+    }
+    if (hc->recv.isNet) {
+      NCCLCHECKGOTO(comm->ncclNet->closeListen(hc->recv.listenComm), ret, fail);
+      hc->recv.listenComm = NULL;
+      NCCLCHECKGOTO(hcNetBuff(comm, &hc->recv), ret, fail);
+    }
+    if (hc->send.isNet) NCCLCHECKGOTO(hcNetBuff(comm, &hc->send), ret, fail);
+  }
+
+  if (pthread_create(&hc->thread, NULL, hcThreadMain, hc) != 0) {
+    WARN("HostColl : failed to create the host collective thread");
+    ret = ncclSystemError;
+    goto fail;
+  }
+  hc->threadStarted = 1;
+  ncclSetThreadName(hc->thread, "NCCL HostColl%2d", comm->cudaDev);
+  comm->hostColl = hc;
+  comm->hostCollRequested = false;
+  INFO(NCCL_INIT, "HostColl: comm %p rank %d ring %d -> %d -> %d, sending via %s, receiving via %s", comm, comm->rank,
+      ring->prev, comm->rank, ring->next, hc->send.isNet ? "NET" : "SHM", hc->recv.isNet ? "NET" : "SHM");
+  return ncclSuccess;
+fail:
+  comm->hostColl = hc;
+  (void)ncclHostCollFree(comm);
+  return ret;
+}
+
+static ncclResult_t hcLinkFree(struct ncclComm* comm, struct hcLink* link, int isSend) {
+  ncclNet_t* net = comm->ncclNet;
+  if (link->shmHandle) NCCLCHECK(ncclShmClose(link->shmHandle));
+  if (link->mhandle) NCCLCHECK(net->deregMr(link->netComm, link->mhandle));
+  if (link->buff) NCCLCHECK(ncclCudaHostFree(link->buff));
+  if (link->listenComm) NCCLCHECK(net->closeListen(link->listenComm));
+  if (link->netComm) NCCLCHECK(isSend ? net->closeSend(link->netComm) : net->closeRecv(link->netComm));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclHostCollFree(struct ncclComm* comm) {
+  struct ncclHostColl* hc = comm->hostColl;
+  if (hc == NULL) return ncclSuccess;
+  comm->hostColl = NULL;
+  if (hc->threadStarted) {
+    pthread_mutex_lock(&hc->mutex);
+    __atomic_store_n(&hc->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&hc->cond);
+    pthread_mutex_unlock(&hc->mutex);
+    pthread_join(hc->thread, NULL);
+  }
+  while (hc->queueHead) {
+    struct hcOp* next = hc->queueHead->next;
+    free(hc->queueHead);
+    hc->queueHead = next;
+  }
+  NCCLCHECK(hcLinkFree(comm, &hc->send, 1));
+  NCCLCHECK(hcLinkFree(comm, &hc->recv, 0));
+  if (hc->sync) NCCLCHECK(ncclCudaHostFree(hc->sync));
+  pthread_mutex_destroy(&hc->mutex);
+  pthread_cond_destroy(&hc->cond);
+  free(hc->ringRanks);
+  free(hc);
+  return ncclSuccess;
+}
@@ -0,0 +1,121 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "hostpool.h"
+#include "alloc.h"
+#include "param.h"
+#include <pthread.h>
+#include <algorithm>
+
+RCCL_PARAM(HostPool, "HOST_POOL", 1);
+RCCL_PARAM(HostPoolSlabSize, "HOST_POOL_SLAB_SIZE", 4LL << 20);
+// Empty slabs kept pinned for later connections
+RCCL_PARAM(HostPoolCache, "HOST_POOL_CACHE", 64LL << 20);
+
+#define HOSTPOOL_MIN_SHIFT 12
+#define HOSTPOOL_NCLASSES 20 // 4KB to 2GB
+
+struct hostPoolSlab {
+  char* base;
+  size_t size;
+  size_t blockSize;
+  int domain;
+  int nBlocks;
+  int nFree;
+  int* freeBlocks; // Stack of the free block indexes
+  struct hostPoolSlab* next;
+};
+
+static pthread_mutex_t hostPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct hostPoolSlab* hostPoolSlabs = NULL;
+static size_t hostPoolEmptySize = 0;
+
+static int hostPoolClass(size_t size) {
+  int c = 0;
+  while (c < HOSTPOOL_NCLASSES && ((size_t)1 << (HOSTPOOL_MIN_SHIFT+c)) < size) c++;
+  return c;
+}
+
+// Called with hostPoolLock held
+static ncclResult_t hostPoolSlabAlloc(int domain, size_t blockSize, unsigned int flags, struct hostPoolSlab** slabPtr) {
+  struct hostPoolSlab* slab;
+  NCCLCHECK(ncclCalloc(&slab, 1));
+  slab->size = std::max(blockSize, (size_t)rcclParamHostPoolSlabSize());
+  slab->size = ROUNDUP(slab->size, blockSize);
+  slab->blockSize = blockSize;
+  slab->domain = domain;
+  slab->nBlocks = slab->nFree = slab->size/blockSize;
+  ncclResult_t ret = ncclCalloc(&slab->freeBlocks, slab->nBlocks);
+  if (ret == ncclSuccess) ret = ncclCudaHostCallocFlags(&slab->base, slab->size, flags);
+  if (ret != ncclSuccess) {
+    free(slab->freeBlocks);
+    free(slab);
+    return ret;
+  }
+  for (int b=0; b<slab->nBlocks; b++) slab->freeBlocks[b] = slab->nBlocks-1-b;
+  slab->next = hostPoolSlabs;
+  hostPoolSlabs = slab;
+  hostPoolEmptySize += slab->size;
+  INFO(NCCL_ALLOC, "Host pool : pinned slab %p of %zu bytes for blocks of %zu bytes, domain %d", slab->base, slab->size, blockSize, domain);
+  *slabPtr = slab;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclHostPoolAlloc(void** ptr, size_t size, int domain, unsigned int flags) {
+  int c = hostPoolClass(size);
+  if (rcclParamHostPool() == 0 || size == 0 || c == HOSTPOOL_NCLASSES) {
+    char* p;
+    NCCLCHECK(ncclCudaHostCallocFlags(&p, size, flags));
+    *ptr = p;
+    return ncclSuccess;
+  }
+  size_t blockSize = (size_t)1 << (HOSTPOOL_MIN_SHIFT+c);
+  ncclResult_t ret = ncclSuccess;
+  struct hostPoolSlab* slab;
+  pthread_mutex_lock(&hostPoolLock);
+  for (slab = hostPoolSlabs; slab; slab = slab->next) {
+    if (slab->domain == domain && slab->blockSize == blockSize && slab->nFree) break;
+  }
+  if (slab == NULL) NCCLCHECKGOTO(hostPoolSlabAlloc(domain, blockSize, flags, &slab), ret, exit);
+  if (slab->nFree == slab->nBlocks) hostPoolEmptySize -= slab->size;
+  *ptr = slab->base + slab->freeBlocks[--slab->nFree]*blockSize;
+  memset(*ptr, 0, size);
+exit:
+  pthread_mutex_unlock(&hostPoolLock);
+  return ret;
+}
+
+ncclResult_t ncclHostPoolFree(void* ptr) {
+  if (ptr == NULL) return ncclSuccess;
+  struct hostPoolSlab** slabPtr;
+  pthread_mutex_lock(&hostPoolLock);
+  for (slabPtr = &hostPoolSlabs; *slabPtr; slabPtr = &(*slabPtr)->next) {
+    struct hostPoolSlab* s = *slabPtr;
+    if ((char*)ptr >= s->base && (char*)ptr < s->base+s->size) break;
+  }
+  struct hostPoolSlab* slab = *slabPtr;
+  if (slab == NULL) {
+    pthread_mutex_unlock(&hostPoolLock);
+    return ncclCudaHostFree(ptr);
+  }
+  slab->freeBlocks[slab->nFree++] = ((char*)ptr - slab->base)/slab->blockSize;
+  if (slab->nFree < slab->nBlocks) {
+    pthread_mutex_unlock(&hostPoolLock);
+    return ncclSuccess;
+  }
+  if (hostPoolEmptySize + slab->size <= (size_t)rcclParamHostPoolCache()) {
+    hostPoolEmptySize += slab->size;
+    pthread_mutex_unlock(&hostPoolLock);
+    return ncclSuccess;
+  }
+  *slabPtr = slab->next;
+  pthread_mutex_unlock(&hostPoolLock);
+  INFO(NCCL_ALLOC, "Host pool : unpinning slab %p of %zu bytes", slab->base, slab->size);
+  ncclResult_t ret = ncclCudaHostFree(slab->base);
+  free(slab->freeBlocks);
+  free(slab);
+  return ret;
+}
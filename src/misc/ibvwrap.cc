@@ -194,6 +194,14 @@ ncclResult_t wrap_ibv_destroy_cq(struct ibv_cq *cq) {
   IBV_INT_CHECK_RET_ERRNO(ibvSymbols, ibv_internal_destroy_cq, ibv_internal_destroy_cq(cq), 0, "ibv_destroy_cq");
 }
 
+ncclResult_t wrap_ibv_create_srq(struct ibv_srq **ret, struct ibv_pd *pd, struct ibv_srq_init_attr *srq_init_attr) {
+  IBV_PTR_CHECK_ERRNO(ibvSymbols, ibv_internal_create_srq, ibv_internal_create_srq(pd, srq_init_attr), *ret, NULL, "ibv_create_srq");
+}
+
+ncclResult_t wrap_ibv_destroy_srq(struct ibv_srq *srq) {
+  IBV_INT_CHECK_RET_ERRNO(ibvSymbols, ibv_internal_destroy_srq, ibv_internal_destroy_srq(srq), 0, "ibv_destroy_srq");
+}
+
 ncclResult_t wrap_ibv_destroy_qp(struct ibv_qp *qp) {
   IBV_INT_CHECK_RET_ERRNO(ibvSymbols, ibv_internal_destroy_qp, ibv_internal_destroy_qp(qp), 0, "ibv_destroy_qp");
 }
@@ -0,0 +1,101 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "ipccache.h"
+#include "alloc.h"
+#include "param.h"
+#include <pthread.h>
+#include <string.h>
+
+// Mappings nobody references any more stay open so that the next communicator
+// can use them, up to this many. The least recently used ones are closed first.
+// An idle mapping keeps the memory of the peer alive until it is closed.
+RCCL_PARAM(IpcCacheIdle, "IPC_CACHE_IDLE", 64);
+
+struct ipcCacheEntry {
+  cudaIpcMemHandle_t handle;
+  int dev;
+  void* ptr;
+  int refs;
+  uint64_t lastUse;
+};
+
+static pthread_mutex_t ipcCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static struct ipcCacheEntry* ipcCache;
+static int ipcCacheCount, ipcCacheCapacity, ipcCacheIdleCount;
+static uint64_t ipcCacheClock;
+
+// Close idle mappings until at most maxIdle are left
+static ncclResult_t ipcCacheTrim(int maxIdle) {
+  while (ipcCacheIdleCount > maxIdle) {
+    int lru = -1;
+    for (int i=0; i<ipcCacheCount; i++) {
+      if (ipcCache[i].refs == 0 && (lru == -1 || ipcCache[i].lastUse < ipcCache[lru].lastUse)) lru = i;
+    }
+    struct ipcCacheEntry e = ipcCache[lru];
+    ipcCache[lru] = ipcCache[--ipcCacheCount];
+    ipcCacheIdleCount--;
+    int dev;
+    CUDACHECK(cudaGetDevice(&dev));
+    CUDACHECK(cudaSetDevice(e.dev));
+    cudaError_t err = cudaIpcCloseMemHandle(e.ptr);
+    CUDACHECK(cudaSetDevice(dev));
+    CUDACHECK(err);
+    TRACE(NCCL_P2P, "IPC cache closed %p on device %d", e.ptr, e.dev);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclIpcCacheOpen(const cudaIpcMemHandle_t* handle, void** ptr) {
+  ncclResult_t ret = ncclSuccess;
+  int dev;
+  CUDACHECK(cudaGetDevice(&dev));
+  pthread_mutex_lock(&ipcCacheLock);
+  for (int i=0; i<ipcCacheCount; i++) {
+    struct ipcCacheEntry* e = ipcCache+i;
+    if (e->dev == dev && memcmp(&e->handle, handle, sizeof(*handle)) == 0) {
+      if (e->refs++ == 0) ipcCacheIdleCount--;
+      e->lastUse = ++ipcCacheClock;
+      *ptr = e->ptr;
+      TRACE(NCCL_P2P, "IPC cache hit %p on device %d refs %d", e->ptr, dev, e->refs);
+      goto exit;
+    }
+  }
+  if (ipcCacheCount == ipcCacheCapacity) {
+    int capacity = ipcCacheCapacity ? 2*ipcCacheCapacity : 64;
+    NCCLCHECKGOTO(ncclRealloc(&ipcCache, ipcCacheCapacity, capacity), ret, exit);
+    ipcCacheCapacity = capacity;
+  }
+  CUDACHECKGOTO(cudaIpcOpenMemHandle(ptr, *handle, cudaIpcMemLazyEnablePeerAccess), ret, exit);
+  ipcCache[ipcCacheCount].handle = *handle;
+  ipcCache[ipcCacheCount].dev = dev;
+  ipcCache[ipcCacheCount].ptr = *ptr;
+  ipcCache[ipcCacheCount].refs = 1;
+  ipcCache[ipcCacheCount].lastUse = ++ipcCacheClock;
+  ipcCacheCount++;
+exit:
+  pthread_mutex_unlock(&ipcCacheLock);
+  return ret;
+}
+
+ncclResult_t ncclIpcCacheClose(void* ptr) {
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&ipcCacheLock);
+  int i = 0;
+  while (i < ipcCacheCount && ipcCache[i].ptr != ptr) i++;
+  if (i == ipcCacheCount || ipcCache[i].refs == 0) {
+    WARN("IPC cache: %p is not an open mapping", ptr);
+    ret = ncclInternalError;
+    goto exit;
+  }
+  if (--ipcCache[i].refs == 0) {
+    ipcCacheIdleCount++;
+    NCCLCHECKGOTO(ipcCacheTrim(rcclParamIpcCacheIdle() > 0 ? rcclParamIpcCacheIdle() : 0), ret, exit);
+  }
+exit:
+  pthread_mutex_unlock(&ipcCacheLock);
+  return ret;
+}
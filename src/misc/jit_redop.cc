@@ -0,0 +1,460 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#ifdef RCCL_HAVE_HIPRTC
+#include <hip/hiprtc.h>
+#endif
+
+#include "checks.h"
+#include "comm.h"
+#include "debug.h"
+#include "git_version.h"
+#include "jit_redop.h"
+#include "param.h"
+#include "utils.h"
+
+#define JIT_CACHE_MAGIC 0x5044524c4c434352ULL // "RCCLLRDP"
+#define JIT_CACHE_VERSION 1
+
+static pthread_mutex_t jitLock = PTHREAD_MUTEX_INITIALIZER;
+static struct ncclJitRedOp* jitRedOps[NCCL_JIT_MAX_REDOPS];
+static int jitNRedOps;
+
+struct jitCacheHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t pad;
+  uint64_t keySize; // the key text follows the header, then the code object
+  uint64_t codeSize;
+};
+
+// Element types of the compiled source, indexed by ncclDataType_t
+static const char* jitTypeNames[] = {
+  "int8_t", "uint8_t", "int32_t", "uint32_t", "int64_t", "uint64_t", "half", "float", "double",
+#if defined(RCCL_BFLOAT16)
+  "hip_bfloat16",
+#endif
+#if defined(RCCL_FLOAT8)
+  "rccl_float8", "rccl_bfloat8",
+#endif
+};
+
+// Wraps the user functor into a reduction function class of reduce_kernel.h and
+// dispatches the funcIndex of each work to the collective it names. The kernels
+// are the ones of common.cu, without the library function table.
+static const char* jitSourceInclude =
+  "#undef USE_INDIRECT_FUNCTION_CALL\n"
+  "#define RCCL_JIT_SOURCE 1\n"
+  "#include \"common.h\"\n";
+static const char* jitRedOpInclude =
+  "#include \"all_reduce.h\"\n"
+  "#include \"reduce.h\"\n"
+  "#include \"reduce_scatter.h\"\n";
+static const char* jitEpilogueInclude =
+  "#include \"all_reduce_epilogue.h\"\n";
+static const char* jitSourceHead =
+  "#include \"jit_redop.h\"\n"
+  "\n"
+  "__shared__ ncclShmemData ncclShmem;\n"
+  "#if __CUDA_ARCH__ < 700\n"
+  "  __shared__ ulong2 ncclShmemPerWarp[ncclShmemScratchWarpSize()*(NCCL_MAX_NTHREADS/WARP_SIZE)/sizeof(ulong2)];\n"
+  "#endif\n"
+  "\n"
+  "#line 1 \"user source\"\n";
+
+static const char* jitDeviceTable =
+  "template<int UNROLL> __device__ void rcclJitRunWork(unsigned short funcIndex);\n"
+  "__forceinline__ __device__ void NCCL_CALL_FUNCTIONS(unsigned short funcIndex) noexcept { rcclJitRunWork<2>(funcIndex); }\n"
+  "__forceinline__ __device__ void NCCL_CALL_FUNCTIONS_4(unsigned short funcIndex) noexcept { rcclJitRunWork<4>(funcIndex); }\n";
+
+static const char* jitKernels =
+  "struct RunWorkNop {\n"
+  "  __device__ void run(ncclWork *w) {}\n"
+  "};\n"
+  "extern \"C\" __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void rcclJitKernel(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead) {\n"
+  "  ncclKernelMain<-1, RunWorkNop, false, 2>(comm, channelMask, workHead);\n"
+  "}\n"
+  "extern \"C\" __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void rcclJitKernel_4(struct ncclDevComm* comm, struct channelMasks channelMask, struct ncclWork* workHead) {\n"
+  "  ncclKernelMain<-1, RunWorkNop, false, 4>(comm, channelMask, workHead);\n"
+  "}\n";
+
+static void jitSourceTail(std::string& src, const char* functor, const char* type) {
+  src += "\n#line 1 \"rccl jit\"\n";
+  src += "template<typename T>\n"
+         "struct FuncCustom { using EltType = T; __device__ FuncCustom(uint64_t opArg=0) {}; };\n"
+         "template<typename T>\n"
+         "struct Apply_Reduce<FuncCustom<T>, /*EltPerPack=*/1> {\n"
+         "  __device__ static BytePack<sizeof(T)> reduce(FuncCustom<T> fn, BytePack<sizeof(T)> a, BytePack<sizeof(T)> b) {\n"
+         "    return toPack<T>(";
+  src += functor;
+  src += "<T>()(fromPack<T>(a), fromPack<T>(b)));\n"
+         "  }\n"
+         "};\n"
+         "\n"
+         "#if defined(RCCL_LL128_DEVICE)\n"
+         "#define RCCL_JIT_LL128 NCCL_PROTO_LL128\n"
+         "#else\n"
+         "#define RCCL_JIT_LL128 NCCL_PROTO_LL\n"
+         "#endif\n"
+         "#define RCCL_JIT_FUNC(coll, algo, proto, runProto) \\\n"
+         "  case ncclJitRedOpFuncIndex(coll, algo, proto): \\\n"
+         "    RunWork<coll, T, FuncCustom<T>, algo, runProto, UNROLL>().run(&ncclShmem.work); break;\n"
+         "#define RCCL_JIT_FUNCS(coll, algo) \\\n"
+         "  RCCL_JIT_FUNC(coll, algo, NCCL_PROTO_LL, NCCL_PROTO_LL) \\\n"
+         "  RCCL_JIT_FUNC(coll, algo, NCCL_PROTO_LL128, RCCL_JIT_LL128) \\\n"
+         "  RCCL_JIT_FUNC(coll, algo, NCCL_PROTO_SIMPLE, NCCL_PROTO_SIMPLE)\n"
+         "\n"
+         "template<int UNROLL>\n"
+         "__device__ void rcclJitRunWork(unsigned short funcIndex) {\n"
+         "  using T = ";
+  src += type;
+  src += ";\n"
+         "  switch (funcIndex) {\n"
+         "  RCCL_JIT_FUNCS(ncclFuncAllReduce, NCCL_ALGO_RING)\n"
+         "  RCCL_JIT_FUNCS(ncclFuncAllReduce, NCCL_ALGO_TREE)\n"
+         "  RCCL_JIT_FUNCS(ncclFuncReduce, NCCL_ALGO_RING)\n"
+         "  RCCL_JIT_FUNCS(ncclFuncReduceScatter, NCCL_ALGO_RING)\n"
+         "  default: break;\n"
+         "  }\n"
+         "}\n"
+         "\n";
+  src += jitKernels;
+}
+
+// Epilogue operators only run ring AllReduce, see all_reduce_epilogue.h. The
+// module also has a kernel for communicators of a single rank, which apply the
+// epilogue to a copy of the input.
+static void jitEpilogueSourceTail(std::string& src, const char* functor, const char* redOp, const char* type) {
+  src += "\n#line 1 \"rccl jit\"\n";
+  src += "using RcclJitT = ";
+  src += type;
+  src += ";\n"
+         "using RcclJitRedOp = ";
+  src += redOp;
+  src += "<RcclJitT>;\n"
+         "using RcclJitEpilogue = ";
+  src += functor;
+  src += "<RcclJitT>;\n"
+         "\n"
+         "#if defined(RCCL_LL128_DEVICE)\n"
+         "#define RCCL_JIT_PROTO_LL128 ProtoLL128\n"
+         "#else\n"
+         "#define RCCL_JIT_PROTO_LL128 ProtoLL\n"
+         "#endif\n"
+         "#define RCCL_JIT_FUNC(proto, runProto) \\\n"
+         "  case ncclJitRedOpFuncIndex(ncclFuncAllReduce, NCCL_ALGO_RING, proto): \\\n"
+         "    RunWorkEpilogue<RcclJitT, RcclJitRedOp, RcclJitEpilogue, runProto>().run(&ncclShmem.work); break;\n"
+         "\n"
+         "template<int UNROLL>\n"
+         "__device__ void rcclJitRunWork(unsigned short funcIndex) {\n"
+         "  typedef ProtoSimple<ALLREDUCE_CHUNKSTEPS/ALLREDUCE_SLICESTEPS, ALLREDUCE_SLICESTEPS, UNROLL> RcclJitProtoSimple;\n"
+         "  switch (funcIndex) {\n"
+         "  RCCL_JIT_FUNC(NCCL_PROTO_LL, ProtoLL)\n"
+         "  RCCL_JIT_FUNC(NCCL_PROTO_LL128, RCCL_JIT_PROTO_LL128)\n"
+         "  RCCL_JIT_FUNC(NCCL_PROTO_SIMPLE, RcclJitProtoSimple)\n"
+         "  default: break;\n"
+         "  }\n"
+         "}\n"
+         "\n"
+         "extern \"C\" __launch_bounds__(512, 1) __global__ void rcclJitOneRank(void* dst, void const* src, size_t count, uint64_t arg) {\n"
+         "  for (size_t i = blockIdx.x*(size_t)blockDim.x + threadIdx.x; i < count; i += gridDim.x*(size_t)blockDim.x) {\n"
+         "    ((RcclJitT*)dst)[i] = RcclJitEpilogue()(((RcclJitT const*)src)[i], i, (void*)arg);\n"
+         "  }\n"
+         "}\n"
+         "\n";
+  src += jitKernels;
+}
+
+// Headers and compile options installed with the library, see CMakeLists.txt
+static ncclResult_t jitShareDir(std::string& dir) {
+  const char* env = ncclGetEnv("RCCL_JIT_DIR");
+  if (env && env[0]) {
+    dir = env;
+    return ncclSuccess;
+  }
+  Dl_info info;
+  if (dladdr((void*)ncclJitRedOpCreate, &info) == 0 || info.dli_fname == nullptr) {
+    WARN("JIT : unable to locate librccl, set RCCL_JIT_DIR to <prefix>/share/rccl/jit");
+    return ncclSystemError;
+  }
+  dir = info.dli_fname;
+  dir = dir.substr(0, dir.find_last_of('/') + 1) + "../share/rccl/jit";
+  return ncclSuccess;
+}
+
+// One definition of the library build per line, so that the device structures
+// have the same layout in the module as in the library
+static ncclResult_t jitOptions(const std::string& dir, const char* arch, std::vector<std::string>& options) {
+  std::string path = dir + "/rccl_jit_options.txt";
+  FILE* file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    WARN("JIT : unable to open %s : %s, is RCCL installed?", path.c_str(), strerror(errno));
+    return ncclSystemError;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), file)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strlen(line) > 2) options.push_back(line);
+  }
+  fclose(file);
+  options.push_back(std::string("--offload-arch=") + arch);
+  options.push_back("-O3");
+  options.push_back("-std=c++17");
+  options.push_back("-I" + dir + "/include");
+  options.push_back("-I" + dir + "/device");
+  options.push_back("-I" + dir + "/device/network/unpack");
+  return ncclSuccess;
+}
+
+static ncclResult_t jitCachePath(const char* name, uint64_t hash, char* path, size_t len) {
+  char dir[PATH_MAX];
+  const char* env = ncclGetEnv("RCCL_JIT_CACHE_DIR");
+  if (env && env[0]) {
+    snprintf(dir, sizeof(dir), "%s", env);
+  } else {
+    const char* home = getenv("HOME");
+    if (home == NULL || home[0] == '\0') return ncclInvalidUsage;
+    snprintf(dir, sizeof(dir), "%s/.cache/rccl/jit", home);
+  }
+  for (char* p = dir+1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    mkdir(dir, 0755);
+    *p = '/';
+  }
+  mkdir(dir, 0755);
+  if (snprintf(path, len, "%s/%s.%016lx.co", dir, name, hash) >= (int)len) return ncclInvalidUsage;
+  return ncclSuccess;
+}
+
+// Entries carry their whole key, a hash collision is a miss
+static bool jitCacheLoad(const char* path, const std::string& key, std::vector<char>& code) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return false;
+  struct jitCacheHeader header;
+  bool hit = fread(&header, sizeof(header), 1, file) == 1 && header.magic == JIT_CACHE_MAGIC &&
+      header.version == JIT_CACHE_VERSION && header.keySize == key.size();
+  if (hit) {
+    std::vector<char> stored(header.keySize);
+    code.resize(header.codeSize);
+    hit = fread(stored.data(), 1, stored.size(), file) == stored.size() && memcmp(stored.data(), key.data(), key.size()) == 0 &&
+        fread(code.data(), 1, code.size(), file) == code.size();
+  }
+  fclose(file);
+  return hit;
+}
+
+static void jitCacheStore(const char* path, const std::string& key, const std::vector<char>& code) {
+  // Ranks sharing the cache compile the same operator; write to a private file, then rename
+  char tmpPath[PATH_MAX];
+  if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, getpid()) >= (int)sizeof(tmpPath)) return;
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    INFO(NCCL_INIT, "JIT : unable to write cache %s : %s", tmpPath, strerror(errno));
+    return;
+  }
+  struct jitCacheHeader header = { JIT_CACHE_MAGIC, JIT_CACHE_VERSION, 0, key.size(), code.size() };
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(key.data(), 1, key.size(), file) == key.size() &&
+      fwrite(code.data(), 1, code.size(), file) == code.size();
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmpPath, path) != 0) unlink(tmpPath);
+}
+
+static ncclResult_t jitCompile(const char* name, const std::string& source, const std::vector<std::string>& options, std::vector<char>& code) {
+#ifdef RCCL_HAVE_HIPRTC
+  hiprtcProgram prog;
+  const char* headers[1] = { jitDeviceTable };
+  const char* headerNames[1] = { "device_table.h" };
+  std::string progName = std::string("rccl_jit_") + name + ".hip";
+  if (hiprtcCreateProgram(&prog, source.c_str(), progName.c_str(), 1, headers, headerNames) != HIPRTC_SUCCESS) {
+    WARN("JIT : hiprtcCreateProgram failed");
+    return ncclSystemError;
+  }
+  std::vector<const char*> opts;
+  for (auto& o : options) opts.push_back(o.c_str());
+  hiprtcResult res = hiprtcCompileProgram(prog, opts.size(), opts.data());
+  if (res != HIPRTC_SUCCESS) {
+    size_t logSize = 0;
+    std::string log;
+    if (hiprtcGetProgramLogSize(prog, &logSize) == HIPRTC_SUCCESS && logSize > 1) {
+      log.resize(logSize);
+      hiprtcGetProgramLog(prog, &log[0]);
+    }
+    WARN("JIT : compilation of %s failed : %s\n%s", progName.c_str(), hiprtcGetErrorString(res), log.c_str());
+    hiprtcDestroyProgram(&prog);
+    return ncclInvalidArgument;
+  }
+  size_t codeSize = 0;
+  res = hiprtcGetCodeSize(prog, &codeSize);
+  if (res == HIPRTC_SUCCESS) {
+    code.resize(codeSize);
+    res = hiprtcGetCode(prog, code.data());
+  }
+  hiprtcDestroyProgram(&prog);
+  if (res != HIPRTC_SUCCESS) {
+    WARN("JIT : unable to get the code object : %s", hiprtcGetErrorString(res));
+    return ncclSystemError;
+  }
+  return ncclSuccess;
+#else
+  WARN("JIT : RCCL was built without hipRTC, runtime compiled kernels are not available");
+  return ncclInvalidUsage;
+#endif
+}
+
+const char* ncclJitTypeName(ncclDataType_t datatype) {
+  if ((size_t)datatype >= sizeof(jitTypeNames)/sizeof(jitTypeNames[0])) return nullptr;
+  return jitTypeNames[datatype];
+}
+
+ncclResult_t ncclJitPrepare(struct ncclComm* comm, const std::string& source, std::vector<std::string>& options,
+    std::string& key, uint64_t* hash) {
+  hipDeviceProp_t prop;
+  CUDACHECK(hipGetDeviceProperties(&prop, comm->cudaDev));
+  std::string dir;
+  NCCLCHECK(jitShareDir(dir));
+  NCCLCHECK(jitOptions(dir, prop.gcnArchName, options));
+  // The build of the library is part of the key, a new one recompiles the modules
+  char version[64];
+  snprintf(version, sizeof(version), "%d-%s\n", NCCL_VERSION_CODE, rcclGitHash);
+  key = version;
+  for (auto& o : options) key += o + "\n";
+  key += source;
+  *hash = getHash(key.data(), key.size());
+  return ncclSuccess;
+}
+
+ncclResult_t ncclJitGetCode(const char* name, const char* what, const std::string& source,
+    const std::vector<std::string>& options, const std::string& key, uint64_t hash, std::vector<char>& code) {
+  char path[PATH_MAX];
+  bool cached = jitCachePath(name, hash, path, sizeof(path)) == ncclSuccess;
+  if (cached && jitCacheLoad(path, key, code)) {
+    INFO(NCCL_INIT, "JIT : %s loaded from %s", what, path);
+    return ncclSuccess;
+  }
+  uint64_t t0 = clockNano();
+  NCCLCHECK(jitCompile(name, source, options, code));
+  INFO(NCCL_INIT, "JIT : compiled %s in %.1f ms", what, (clockNano()-t0)/1e6);
+  if (cached) jitCacheStore(path, key, code);
+  return ncclSuccess;
+}
+
+// Reductions an epilogue operator can be built on. They take no argument, which
+// leaves the scalar argument of the work to the epilogue.
+static const char* jitEpilogueRedOp(ncclRedOp_t reduceOp) {
+  switch (reduceOp) {
+  case ncclSum: return "FuncSum";
+  case ncclProd: return "FuncProd";
+  default: return nullptr;
+  }
+}
+
+static ncclResult_t jitCreate(struct ncclComm* comm, const char* source, const char* functor,
+    ncclRedOp_t reduceOp, ncclDataType_t datatype, struct ncclJitRedOp** jit) {
+  ncclResult_t ret = ncclSuccess;
+  bool epilogue = reduceOp != ncclNumOps;
+  const char* kind = epilogue ? "epilogue" : "reduction operator";
+  if ((size_t)datatype >= sizeof(jitTypeNames)/sizeof(jitTypeNames[0])) {
+    WARN("JIT : invalid datatype %d", datatype);
+    return ncclInvalidArgument;
+  }
+  if (epilogue && jitEpilogueRedOp(reduceOp) == nullptr) {
+    WARN("JIT : epilogues only apply to ncclSum and ncclProd, not to operator %d", reduceOp);
+    return ncclInvalidArgument;
+  }
+  std::string src = jitSourceInclude;
+  src += epilogue ? jitEpilogueInclude : jitRedOpInclude;
+  src += jitSourceHead;
+  src += source;
+  if (epilogue) jitEpilogueSourceTail(src, functor, jitEpilogueRedOp(reduceOp), jitTypeNames[datatype]);
+  else jitSourceTail(src, functor, jitTypeNames[datatype]);
+  std::vector<std::string> options;
+  std::string key;
+  uint64_t hash;
+  NCCLCHECK(ncclJitPrepare(comm, src, options, key, &hash));
+
+  pthread_mutex_lock(&jitLock);
+  for (int i = 0; i < jitNRedOps; i++) {
+    if (jitRedOps[i]->hash == hash && jitRedOps[i]->cudaDev == comm->cudaDev) {
+      *jit = jitRedOps[i];
+      goto exit;
+    }
+  }
+  if (jitNRedOps == NCCL_JIT_MAX_REDOPS) {
+    WARN("JIT : at most %d custom reduction operators can be compiled per process", NCCL_JIT_MAX_REDOPS);
+    ret = ncclInvalidUsage;
+    goto exit;
+  }
+  {
+    std::vector<char> code;
+    std::string what = std::string(kind) + " " + functor + "<" + jitTypeNames[datatype] + ">";
+    NCCLCHECKGOTO(ncclJitGetCode("redop", what.c_str(), src, options, key, hash, code), ret, exit);
+
+    struct ncclJitRedOp* op;
+    int cudaDev;
+    CUDACHECKGOTO(hipGetDevice(&cudaDev), ret, exit);
+    NCCLCHECKGOTO(ncclCalloc(&op, 1), ret, exit);
+    // Modules are loaded on the current device
+    CUDACHECKGOTO(hipSetDevice(comm->cudaDev), ret, exit);
+    if (hipModuleLoadData(&op->module, code.data()) != hipSuccess ||
+        hipModuleGetFunction(&op->kernels[0], op->module, "rcclJitKernel") != hipSuccess ||
+        hipModuleGetFunction(&op->kernels[1], op->module, "rcclJitKernel_4") != hipSuccess ||
+        (epilogue && hipModuleGetFunction(&op->oneRank, op->module, "rcclJitOneRank") != hipSuccess)) {
+      WARN("JIT : unable to load the module of %s %s<%s>", kind, functor, jitTypeNames[datatype]);
+      if (op->module) (void)hipModuleUnload(op->module);
+      free(op);
+      (void)hipSetDevice(cudaDev);
+      ret = ncclUnhandledCudaError;
+      goto exit;
+    }
+    CUDACHECKGOTO(hipSetDevice(cudaDev), ret, exit);
+    op->id = jitNRedOps;
+    op->cudaDev = comm->cudaDev;
+    op->hash = hash;
+    op->epilogue = epilogue;
+    jitRedOps[op->id] = op;
+    __atomic_store_n(&jitNRedOps, jitNRedOps+1, __ATOMIC_RELEASE);
+    *jit = op;
+  }
+exit:
+  pthread_mutex_unlock(&jitLock);
+  return ret;
+}
+
+ncclResult_t ncclJitRedOpCreate(struct ncclComm* comm, const char* source, const char* functor,
+    ncclDataType_t datatype, struct ncclJitRedOp** jit) {
+  return jitCreate(comm, source, functor, ncclNumOps, datatype, jit);
+}
+
+ncclResult_t ncclJitEpilogueCreate(struct ncclComm* comm, const char* source, const char* functor,
+    ncclRedOp_t reduceOp, ncclDataType_t datatype, struct ncclJitRedOp** jit) {
+  return jitCreate(comm, source, functor, reduceOp, datatype, jit);
+}
+
+ncclResult_t ncclJitEpilogueLaunchOneRank(struct ncclJitRedOp* jit, void* dst, void const* src, size_t count,
+    size_t eltSize, uint64_t arg, hipStream_t stream) {
+  if (count == 0) return ncclSuccess;
+  unsigned int grid = std::min<size_t>(32, divUp(count*eltSize, 16<<10));
+  void* args[4] = { &dst, &src, &count, &arg };
+  CUDACHECK(hipModuleLaunchKernel(jit->oneRank, grid, 1, 1, 512, 1, 1, 0, stream, args, nullptr));
+  return ncclSuccess;
+}
+
+struct ncclJitRedOp* ncclJitRedOpGet(int devRedOp) {
+  int id = devRedOp - ncclNumDevRedOps;
+  if (id < 0 || id >= __atomic_load_n(&jitNRedOps, __ATOMIC_ACQUIRE)) return nullptr;
+  return jitRedOps[id];
+}
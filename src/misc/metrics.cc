@@ -0,0 +1,234 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <algorithm>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "comm.h"
+#include "debug.h"
+#include "metrics.h"
+#include "param.h"
+#include "stats.h"
+
+#define METRICS_MAX_COMMS 1024
+#define METRICS_TCP_PORT_TRIES 64
+
+static const char* metricsCollNames[NCCL_STATS_NUM_COLLS] = {
+  "Broadcast", "Reduce", "AllGather", "ReduceScatter", "AllReduce", "SendRecv", "Send", "Recv", "AllToAllPivot", "AllToAll"
+};
+
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct ncclComm* metricsComms[METRICS_MAX_COMMS];
+static int metricsNComms;
+static int metricsFd = -1;
+static bool metricsStarted; // also set when the endpoint could not be opened
+
+// Appends to a growing buffer, the page is rebuilt for every request
+struct metricsBuf {
+  char* data;
+  size_t size;
+  size_t capacity;
+};
+
+__attribute__((format(printf, 2, 3)))
+static void metricsPrintf(struct metricsBuf* b, const char* fmt, ...) {
+  for (;;) {
+    va_list args;
+    va_start(args, fmt);
+    int n = b->data ? vsnprintf(b->data + b->size, b->capacity - b->size, fmt, args) : -1;
+    va_end(args);
+    if (n >= 0 && b->size + n < b->capacity) {
+      b->size += n;
+      return;
+    }
+    size_t capacity = std::max<size_t>(b->capacity*2, 1<<16);
+    char* data = (char*)realloc(b->data, capacity);
+    if (data == nullptr) return;
+    b->data = data;
+    b->capacity = capacity;
+  }
+}
+
+// Bus bandwidth factor of nccl-tests, applied to the total bytes of the collective
+static double metricsBusBwFactor(int coll, int nRanks) {
+  switch (coll) {
+    case ncclFuncAllReduce: return 2.0*(nRanks-1)/nRanks;
+    case ncclFuncAllGather:
+    case ncclFuncReduceScatter:
+    case ncclFuncAllToAll: return (double)(nRanks-1)/nRanks;
+    default: return 1.0;
+  }
+}
+
+static void metricsComm(struct metricsBuf* b, struct ncclComm* comm) {
+  ncclCommStats_t s;
+  memset(&s, 0, sizeof(s));
+  s.size = sizeof(s);
+  if (ncclCommGetStats(comm, &s) != ncclSuccess) return;
+  char labels[128];
+  snprintf(labels, sizeof(labels), "comm=\"%lx\",rank=\"%d\",nranks=\"%d\",dev=\"%d\"",
+      comm->commHash, comm->rank, comm->nRanks, comm->cudaDev);
+
+  for (int c = 0; c < NCCL_STATS_NUM_COLLS; c++) {
+    if (s.collCalls[c] == 0) continue;
+    metricsPrintf(b, "rccl_coll_calls_total{%s,coll=\"%s\"} %lu\n", labels, metricsCollNames[c], s.collCalls[c]);
+    metricsPrintf(b, "rccl_coll_bytes_total{%s,coll=\"%s\"} %lu\n", labels, metricsCollNames[c], s.collBytes[c]);
+    double factor = metricsBusBwFactor(c, comm->nRanks);
+    for (int i = 0; i < NCCL_STATS_SIZE_BUCKETS; i++) {
+      uint64_t ns = __atomic_load_n(&comm->stats.sizeNs[c][i], __ATOMIC_RELAXED);
+      if (ns == 0) continue;
+      uint64_t bytes = __atomic_load_n(&comm->stats.sizeBytes[c][i], __ATOMIC_RELAXED);
+      metricsPrintf(b, "rccl_coll_busbw_gbps{%s,coll=\"%s\",size=\"%lu\"} %.3f\n", labels, metricsCollNames[c], 1UL << i, bytes*factor/ns);
+      metricsPrintf(b, "rccl_coll_timed_total{%s,coll=\"%s\",size=\"%lu\"} %lu\n", labels, metricsCollNames[c], 1UL << i,
+          __atomic_load_n(&comm->stats.sizeSamples[c][i], __ATOMIC_RELAXED));
+    }
+  }
+  metricsPrintf(b, "rccl_proxy_active_seconds_total{%s} %.6f\n", labels, s.proxyActiveNs/1e9);
+  metricsPrintf(b, "rccl_proxy_idle_seconds_total{%s} %.6f\n", labels, s.proxyIdleNs/1e9);
+  uint64_t total = s.proxyActiveNs + s.proxyIdleNs;
+  metricsPrintf(b, "rccl_proxy_utilization{%s} %.4f\n", labels, total ? (double)s.proxyActiveNs/total : 0.0);
+  metricsPrintf(b, "rccl_ib_retries_total{%s} %lu\n", labels, s.ibRetries);
+  metricsPrintf(b, "rccl_work_fifo_stalls_total{%s} %lu\n", labels, s.workFifoStalls);
+  metricsPrintf(b, "rccl_work_fifo_stall_seconds_total{%s} %.6f\n", labels, s.workFifoStallNs/1e9);
+}
+
+static void metricsServe(int fd) {
+  // The request itself does not matter, every path gets the metrics
+  char request[1024];
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  if (poll(&pfd, 1, 1000) > 0) (void)!read(fd, request, sizeof(request));
+
+  struct metricsBuf b = { nullptr, 0, 0 };
+  metricsPrintf(&b, "# TYPE rccl_coll_busbw_gbps gauge\n# TYPE rccl_proxy_utilization gauge\n");
+  pthread_mutex_lock(&metricsLock);
+  for (int i = 0; i < metricsNComms; i++) metricsComm(&b, metricsComms[i]);
+  pthread_mutex_unlock(&metricsLock);
+
+  char header[160];
+  int n = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", b.size);
+  if (write(fd, header, n) == n && b.size) (void)!write(fd, b.data, b.size);
+  free(b.data);
+}
+
+static void* metricsThreadMain(void*) {
+  for (;;) {
+    int fd = accept(metricsFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      WARN("Metrics : accept failed : %s, exporter stopped", strerror(errno));
+      return nullptr;
+    }
+    metricsServe(fd);
+    close(fd);
+  }
+}
+
+static ncclResult_t metricsOpen(const char* endpoint) {
+  if (strncmp(endpoint, "unix:", 5) == 0) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // Replace %p by the pid
+    char path[sizeof(addr.sun_path)];
+    const char* p = endpoint+5;
+    size_t len = 0;
+    for (; *p && len < sizeof(path)-1; p++) {
+      if (p[0] == '%' && p[1] == 'p') {
+        len += snprintf(path+len, sizeof(path)-len, "%d", getpid());
+        p++;
+      } else {
+        path[len++] = *p;
+      }
+    }
+    path[std::min(len, sizeof(path)-1)] = '\0';
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    SYSCHECK(metricsFd = socket(AF_UNIX, SOCK_STREAM, 0), "socket");
+    if (bind(metricsFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(metricsFd, 16) != 0) {
+      WARN("Metrics : unable to listen on %s : %s", path, strerror(errno));
+      return ncclSystemError;
+    }
+    INFO(NCCL_INIT, "Metrics : serving on unix socket %s", path);
+  } else if (strncmp(endpoint, "tcp:", 4) == 0) {
+    int base = atoi(endpoint+4);
+    SYSCHECK(metricsFd = socket(AF_INET, SOCK_STREAM, 0), "socket");
+    int port = base;
+    for (; port < base + METRICS_TCP_PORT_TRIES; port++) {
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_ANY);
+      addr.sin_port = htons(port);
+      if (bind(metricsFd, (struct sockaddr*)&addr, sizeof(addr)) == 0) break;
+      if (errno != EADDRINUSE) port = base + METRICS_TCP_PORT_TRIES;
+    }
+    if (port == base + METRICS_TCP_PORT_TRIES || listen(metricsFd, 16) != 0) {
+      WARN("Metrics : unable to listen on TCP ports %d-%d : %s", base, base + METRICS_TCP_PORT_TRIES - 1, strerror(errno));
+      return ncclSystemError;
+    }
+    INFO(NCCL_INIT, "Metrics : serving on TCP port %d", port);
+  } else {
+    WARN("Metrics : RCCL_METRICS_ENDPOINT=%s, expected unix:<path> or tcp:<port>", endpoint);
+    return ncclInvalidUsage;
+  }
+  return ncclSuccess;
+}
+
+// Opens the endpoint and starts the thread the first time a communicator registers.
+// Failures only disable the exporter, communicators work the same without it.
+static void metricsStart() {
+  const char* endpoint = ncclGetEnv("RCCL_METRICS_ENDPOINT");
+  metricsStarted = true;
+  if (endpoint == nullptr || endpoint[0] == '\0') return;
+  if (metricsOpen(endpoint) != ncclSuccess) goto fail;
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, metricsThreadMain, nullptr) != 0) {
+    WARN("Metrics : unable to start the exporter thread");
+    goto fail;
+  }
+  ncclSetThreadName(thread, "NCCL Metrics");
+  // Lives until the process exits, like the sockets it serves
+  pthread_detach(thread);
+  return;
+fail:
+  if (metricsFd >= 0) close(metricsFd);
+  metricsFd = -1;
+}
+
+ncclResult_t ncclMetricsRegister(struct ncclComm* comm) {
+  pthread_mutex_lock(&metricsLock);
+  if (!metricsStarted) metricsStart();
+  if (metricsFd >= 0) {
+    if (metricsNComms < METRICS_MAX_COMMS) {
+      metricsComms[metricsNComms++] = comm;
+    } else {
+      INFO(NCCL_INIT, "Metrics : more than %d communicators, comm %p is not exported", METRICS_MAX_COMMS, comm);
+    }
+  }
+  pthread_mutex_unlock(&metricsLock);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclMetricsDeregister(struct ncclComm* comm) {
+  pthread_mutex_lock(&metricsLock);
+  for (int i = 0; i < metricsNComms; i++) {
+    if (metricsComms[i] != comm) continue;
+    metricsComms[i] = metricsComms[--metricsNComms];
+    break;
+  }
+  pthread_mutex_unlock(&metricsLock);
+  return ncclSuccess;
+}
@@ -0,0 +1,199 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "checks.h"
+#include "debug.h"
+#include "jit_redop.h"
+#include "param.h"
+
+#include "msccl/msccl_jit.h"
+#include "msccl/msccl_status.h"
+
+// The interpreter of msccl_kernel_impl.h reads the type, peers, offsets and
+// dependencies of every step from the algorithm in LDS. Here the descriptor of
+// each thread block becomes a schedule of constants instead, and hipRTC compiles
+// the same interpreter with it, so its steps unroll into straight-line code
+// without the loads and branches on the transmission. The code grows with the
+// number of steps, so only algorithms of at most RCCL_MSCCL_JIT_MAX_STEPS steps,
+// over all their thread blocks, are compiled. Modules are compiled on the first
+// launch of each reduction and type, cached on disk by the hash of their source
+// like the reduction operators of jit_redop.cc, and shared by the ranks of the
+// process with the same schedule on the same device.
+RCCL_PARAM(MscclJit, "MSCCL_JIT", 0);
+RCCL_PARAM(MscclJitMaxSteps, "MSCCL_JIT_MAX_STEPS", 256);
+
+static std::mutex mscclJitMutex;
+static std::map<std::pair<uint64_t, int>, hipFunction_t> mscclJitModules; // by hash and device
+
+// Reductions and protocols of the library kernels, see MSCCL_IMPL_KERNEL_ENTRY_FUNC_DEVREDOP_TYPE
+static const char* mscclJitRedOps[] = { "FuncSum", "FuncProd", "FuncMinMax" }; // indexed by ncclDevRedOp_t
+static const char* mscclJitProtos[NCCL_NUM_PROTOCOLS] = {
+  "ProtoLL", "ProtoLL128", "ProtoSimple<MSCCL_CHUNKSTEPS/MSCCL_SLICESTEPS, MSCCL_SLICESTEPS, 2>" };
+
+static const char* mscclJitSourceHead =
+  "#undef USE_INDIRECT_FUNCTION_CALL\n"
+  "#define RCCL_JIT_SOURCE 1\n"
+  "#include \"common.h\"\n"
+  "#include \"msccl_kernel_impl.h\"\n"
+  "\n"
+  "__shared__ ncclShmemData ncclShmem;\n"
+  "#if __CUDA_ARCH__ < 700\n"
+  "  __shared__ ulong2 ncclShmemPerWarp[ncclShmemScratchWarpSize()*(NCCL_MAX_NTHREADS/WARP_SIZE)/sizeof(ulong2)];\n"
+  "#endif\n"
+  "__shared__ struct mscclShmemData mscclShmem;\n"
+  "// No collective of the library table runs here\n"
+  "template<int UNROLL> __device__ void rcclJitRunWork(unsigned short funcIndex) {}\n"
+  "\n";
+
+// A member function returning entry i of values, which only has constant indices
+// once the steps are unrolled
+static void mscclJitAppendTable(std::string& src, const char* name, const std::vector<int>& values) {
+  char line[64];
+  src += "  __device__ static constexpr int ";
+  src += name;
+  src += "(int i) {\n    switch (i) {\n";
+  for (size_t i = 0; i < values.size(); i++) {
+    snprintf(line, sizeof(line), "    case %zu: return %d;\n", i, values[i]);
+    src += line;
+  }
+  src += "    default: return 0;\n    }\n  }\n";
+}
+
+static void mscclJitAppendBlock(std::string& src, int bid, const struct mscclThreadBlock* tb) {
+  char line[512];
+  snprintf(line, sizeof(line),
+      "struct RcclMscclBlock%d {\n"
+      "  static constexpr bool isConst = true;\n"
+      "  __device__ static void load(struct mscclAlgo* algo, int bid, int tid, int nthreads) {}\n"
+      "  __device__ static constexpr int nSteps() { return %d; }\n"
+      "  __device__ static constexpr int sendPeer() { return %d; }\n"
+      "  __device__ static constexpr int recvPeer() { return %d; }\n"
+      "  __device__ static constexpr int channelId() { return %d; }\n",
+      bid, tb->nSteps, tb->sendPeer, tb->recvPeer, tb->channelId);
+  src += line;
+  src += "  __device__ static constexpr struct mscclTransmission transmission(int i) {\n    switch (i) {\n";
+  for (int i = 0; i < tb->nSteps; i++) {
+    const struct mscclTransmission* t = tb->transmissions + i;
+    snprintf(line, sizeof(line), "    case %d: return mscclTransmission{%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d};\n",
+        i, t->dependencePointer, t->numDependencies, t->reductionPointer, t->numReductions, t->srcOffset, t->dstOffset,
+        t->srcBuffer, t->dstBuffer, t->hasDependence, t->type, t->count);
+    src += line;
+  }
+  src += "    default: return mscclTransmission{};\n    }\n  }\n";
+  mscclJitAppendTable(src, "dependentBid", std::vector<int>(tb->dependentBid, tb->dependentBid + tb->nDependencies));
+  mscclJitAppendTable(src, "dependentStep", std::vector<int>(tb->dependentStep, tb->dependentStep + tb->nDependencies));
+  mscclJitAppendTable(src, "reductionSrcOffset",
+      std::vector<int>(tb->reductionSrcOffsets, tb->reductionSrcOffsets + tb->nReductionSrcs));
+  src += "};\n\n";
+}
+
+static void mscclJitSource(std::string& src, struct mscclAlgo* hostAlgo, int devRedOp, const char* type) {
+  src = mscclJitSourceHead;
+  for (int bid = 0; bid < hostAlgo->nBlocks; bid++) mscclJitAppendBlock(src, bid, hostAlgo->mscclTBs + bid);
+  src += "using RcclJitT = ";
+  src += type;
+  src += ";\n"
+         "using RcclJitRedOp = ";
+  src += mscclJitRedOps[devRedOp];
+  src += "<RcclJitT>;\n"
+         "using RcclJitProto = ";
+  src += mscclJitProtos[hostAlgo->protocol];
+  src += ";\n"
+         "\n"
+         "extern \"C\" __launch_bounds__(NCCL_MAX_NTHREADS, 1) __global__ void rcclMscclJitKernel(struct ncclDevComm* comm, struct mscclAlgo* algo, struct mscclWork* work) {\n"
+         "  switch (blockIdx.x) {\n";
+  char line[192];
+  for (int bid = 0; bid < hostAlgo->nBlocks; bid++) {
+    snprintf(line, sizeof(line),
+        "  case %d: mscclRunInterpreter<RcclJitT, RcclJitRedOp, RcclJitProto, false, RcclMscclBlock%d>(comm, algo, work); break;\n",
+        bid, bid);
+    src += line;
+  }
+  src += "  default: break;\n"
+         "  }\n"
+         "}\n";
+}
+
+static ncclResult_t mscclJitCompile(struct mscclAlgo* hostAlgo, ncclComm_t comm, int devRedOp,
+    ncclDataType_t dataType, hipFunction_t* kernel) {
+  *kernel = nullptr;
+  const char* type = ncclJitTypeName(dataType);
+  if (devRedOp >= (int)(sizeof(mscclJitRedOps)/sizeof(mscclJitRedOps[0])) || type == nullptr ||
+      hostAlgo->protocol < 0 || hostAlgo->protocol >= NCCL_NUM_PROTOCOLS) return ncclSuccess;
+  int nSteps = 0;
+  for (int bid = 0; bid < hostAlgo->nBlocks; bid++) nSteps += hostAlgo->mscclTBs[bid].nSteps;
+  if (nSteps > rcclParamMscclJitMaxSteps()) {
+    INFO(NCCL_INIT, "MSCCL: algorithm of %d steps is interpreted, RCCL_MSCCL_JIT_MAX_STEPS is %ld", nSteps, rcclParamMscclJitMaxSteps());
+    return ncclSuccess;
+  }
+
+  std::string src;
+  mscclJitSource(src, hostAlgo, devRedOp, type);
+  std::vector<std::string> options;
+  std::string key;
+  uint64_t hash;
+  NCCLCHECK(ncclJitPrepare(comm, src, options, key, &hash));
+
+  std::lock_guard<std::mutex> lock(mscclJitMutex);
+  auto itr = mscclJitModules.find({hash, comm->cudaDev});
+  if (itr != mscclJitModules.end()) {
+    *kernel = itr->second;
+    return ncclSuccess;
+  }
+  std::vector<char> code;
+  char what[256];
+  snprintf(what, sizeof(what), "MSCCL kernel of %d steps for %s<%s> %s", nSteps, mscclJitRedOps[devRedOp], type,
+      mscclJitProtos[hostAlgo->protocol]);
+  NCCLCHECK(ncclJitGetCode("msccl", what, src, options, key, hash, code));
+
+  // Modules are loaded on the current device
+  int cudaDev;
+  hipModule_t module = nullptr;
+  CUDACHECK(hipGetDevice(&cudaDev));
+  CUDACHECK(hipSetDevice(comm->cudaDev));
+  if (hipModuleLoadData(&module, code.data()) != hipSuccess ||
+      hipModuleGetFunction(kernel, module, "rcclMscclJitKernel") != hipSuccess) {
+    WARN("JIT : unable to load the module of %s", what);
+    if (module) (void)hipModuleUnload(module);
+    *kernel = nullptr;
+    (void)hipSetDevice(cudaDev);
+    return ncclUnhandledCudaError;
+  }
+  CUDACHECK(hipSetDevice(cudaDev));
+  mscclJitModules[{hash, comm->cudaDev}] = *kernel;
+  return ncclSuccess;
+}
+
+ncclResult_t mscclJitGetKernel(struct mscclAlgo* hostAlgo, ncclComm_t comm, int devRedOp,
+    ncclDataType_t dataType, hipFunction_t* kernel) {
+  *kernel = nullptr;
+  if (rcclParamMscclJit() == 0) return ncclSuccess;
+  mscclStatus& status = mscclGetStatus(comm->rank);
+  std::pair<struct mscclAlgo*, uint32_t> key(hostAlgo, (uint32_t)(devRedOp * ncclNumTypes + dataType));
+  auto itr = status.jitKernels.find(key);
+  if (itr != status.jitKernels.end()) {
+    *kernel = itr->second;
+    return ncclSuccess;
+  }
+  // A module that does not build leaves the algorithm to the interpreter, without trying again
+  if (mscclJitCompile(hostAlgo, comm, devRedOp, dataType, kernel) != ncclSuccess) {
+    INFO(NCCL_INIT, "MSCCL: runtime compilation failed, the algorithm is interpreted");
+    *kernel = nullptr;
+  }
+  status.jitKernels[key] = *kernel;
+  return ncclSuccess;
+}
+
+void mscclJitForgetAlgo(int rank, struct mscclAlgo* hostAlgo) {
+  mscclStatus& status = mscclGetStatus(rank);
+  auto itr = status.jitKernels.lower_bound({hostAlgo, 0});
+  while (itr != status.jitKernels.end() && itr->first.first == hostAlgo) itr = status.jitKernels.erase(itr);
+}
@@ -3,6 +3,7 @@
  * Licensed under the MIT License.
  ************************************************************************/
 
+#include <algorithm>
 #include <atomic>
 #include <map>
 #include <mutex>
@@ -17,12 +18,15 @@
 #include "checks.h"
 #include "graph/topo.h"
 
+#include "msccl/msccl_jit.h"
 #include "msccl/msccl_lifecycle.h"
 #include "msccl/msccl_parser.h"
 #include "msccl/msccl_setup.h"
 #include "msccl/msccl_status.h"
 
 #ifdef ENABLE_MSCCLPP
+#include "enqueue.h"
+#include "hostcoll.h"
 #include "mscclpp/mscclpp_nccl.h"
 #endif
 
@@ -90,6 +94,44 @@ static const char* mscclUnitTestAlgoDefaultDir = "msccl-unit-test-algorithms";
 static const char* mscclAlgoShareDirPath = "../share/rccl/msccl-algorithms";
 static const char* mscclUnitTestAlgoShareDirPath = "../share/rccl/msccl-unit-test-algorithms";
 
+static inline uint64_t mscclAlgoIndexKey(int nRanks, mscclFunc_t func, bool inPlace) {
+  return ((uint64_t)nRanks << 32) | ((uint64_t)func << 1) | (inPlace ? 1 : 0);
+}
+
+// Splits the size ranges of the loaded algorithms into disjoint intervals per
+// (nRanks, func, in-place), so that selection is a binary search.
+static void mscclBuildAlgoIndex(mscclStatus& status) {
+  status.algoIndex.clear();
+  std::map<uint64_t, std::vector<int>> groups;
+  for (size_t i = 0; i < status.algoMetas.size(); i++) {
+    auto &m = status.algoMetas[i];
+    if (m.inPlace) groups[mscclAlgoIndexKey(m.nRanks, m.func, true)].push_back(i);
+    if (m.outOfPlace) groups[mscclAlgoIndexKey(m.nRanks, m.func, false)].push_back(i);
+  }
+  for (auto& g : groups) {
+    std::vector<int64_t> bounds = { 0 };
+    for (int i : g.second) {
+      auto &m = status.algoMetas[i];
+      bounds.push_back(m.minBytes);
+      if (m.maxBytes != 0) bounds.push_back(m.maxBytes + 1);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    struct mscclAlgoIndex& index = status.algoIndex[g.first];
+    index.sizeMultiplier = status.algoMetas[g.second[0]].sizeMultiplier;
+    for (int64_t start : bounds) {
+      struct mscclAlgoInterval interval;
+      interval.startBytes = start;
+      for (int i : g.second) {
+        auto &m = status.algoMetas[i];
+        if (start >= m.minBytes && (m.maxBytes == 0 || start <= m.maxBytes)) interval.metaIdx.push_back(i);
+      }
+      index.intervals.push_back(std::move(interval));
+    }
+  }
+}
+
 static ncclResult_t mscclInternalSchedulerInit(ncclComm_t comm, int* numChannelsRequired) {
   static thread_local bool mscclAlgoMetaLoaded = false;
   mscclStatus& status = mscclGetStatus(comm->rank);
@@ -173,6 +215,7 @@ static ncclResult_t mscclInternalSchedulerInit(ncclComm_t comm, int* numChannels
     return ncclInvalidUsage;
   }
   status.rankToAlgoHandles.resize(status.algoMetas.size());
+  mscclBuildAlgoIndex(status);
   mscclAlgoMetaLoaded = true;
   return ncclSuccess;
 }
@@ -257,6 +300,9 @@ ncclResult_t mscclInit(ncclComm_t comm) {
     NCCLCHECK(ncclCudaCalloc(&status.syncFlags, MSCCL_MAX_NUM_THREAD_BLOCKS));
     status.lastStream = nullptr;
     NCCLCHECK(mscclInitWorkFifoStatus(&(status.defaultWorkFifoStatus)));
+    ncclMemStatsAdd(&comm->memStats, ncclMemMsccl, false, MSCCL_MAX_NUM_THREAD_BLOCKS*sizeof(*status.syncFlags) +
+        status.defaultWorkFifoStatus.workFifoDepth*sizeof(*status.defaultWorkFifoStatus.workFifo));
+    ncclMemStatsAdd(&comm->memStats, ncclMemMsccl, true, MSCCL_MAX_NUM_THREAD_BLOCKS*sizeof(*status.defaultWorkFifoStatus.workFifoDone));
 
     mscclSetInitialized(comm->rank);
   }
@@ -274,8 +320,8 @@ ncclResult_t mscclGroupStart() {
   return ncclSuccess;
 }
 
-static ncclResult_t mscclInternalSchedulerSelectAlgo(int rank, struct mscclSchedulerParam* param) {
-  mscclStatus& status = mscclGetStatus(rank);
+static ncclResult_t mscclInternalSchedulerSelectAlgo(ncclComm_t comm, struct mscclSchedulerParam* param) {
+  mscclStatus& status = mscclGetStatus(comm->rank);
   param->scheduled = false;
 
   // Current MSCCL doesn't support pre/post op
@@ -283,6 +329,15 @@ static ncclResult_t mscclInternalSchedulerSelectAlgo(int rank, struct mscclSched
     return ncclSuccess;
   }
 
+  // Host buffers are left to the host collective thread
+  if (param->func <= mscclFuncAllGather) {
+    static const ncclFunc_t funcs[] = { ncclFuncReduce, ncclFuncBroadcast, ncclFuncAllReduce, ncclFuncReduceScatter, ncclFuncAllGather };
+    if (ncclHostCollBuffers(comm, funcs[param->func], param->sendBuff, param->recvBuff, param->root,
+                            param->count * ncclTypeSize(param->dataType))) {
+      return ncclSuccess;
+    }
+  }
+
   // Whether the algorithm is in-place
   bool isInPlace = false;
   if (param->func == mscclFuncReduce ||
@@ -299,21 +354,40 @@ static ncclResult_t mscclInternalSchedulerSelectAlgo(int rank, struct mscclSched
     isInPlace = (char*)param->recvBuff == (char*)param->sendBuff + param->rank * param->count * ncclTypeSize(param->dataType);
   }
 
-  // Search suitable algorithms
-  for (size_t i = 0; i < status.algoMetas.size(); i++) {
-    auto &m = status.algoMetas[i];
-    size_t nBytes = param->count * ncclTypeSize(param->dataType) * m.sizeMultiplier;
-    bool msgSizeIsValid =
-      param->count > 0 && (param->count % m.nChunksPerLoop) == 0 &&
-      nBytes >= m.minBytes && (m.maxBytes == 0 || nBytes <= m.maxBytes);
-    if (msgSizeIsValid &&
-        m.nRanks == param->nRanks &&
-        m.func == param->func &&
-        (isInPlace ? m.inPlace : m.outOfPlace)) {
-      param->handle = status.rankToAlgoHandles[i][param->rank];
-      param->scheduled = true;
-      return ncclSuccess;
-    }
+  // Repeated calls of the same shape get the same answer
+  auto& last = comm->mscclLastSelect;
+  if (last.valid && last.func == param->func && last.inPlace == isInPlace &&
+      last.count == param->count && last.dataType == param->dataType) {
+    param->handle = last.handle;
+    param->scheduled = last.scheduled;
+    return ncclSuccess;
+  }
+  last.valid = true;
+  last.func = param->func;
+  last.inPlace = isInPlace;
+  last.count = param->count;
+  last.dataType = param->dataType;
+  last.scheduled = false;
+
+  // Search suitable algorithms, first loaded wins among those matching the size
+  auto it = status.algoIndex.find(mscclAlgoIndexKey(param->nRanks, param->func, isInPlace));
+  if (it == status.algoIndex.end() || param->count == 0) {
+    return ncclSuccess;
+  }
+  auto& intervals = it->second.intervals;
+  int64_t nBytes = param->count * ncclTypeSize(param->dataType) * it->second.sizeMultiplier;
+  auto interval = std::upper_bound(intervals.begin(), intervals.end(), nBytes,
+      [](int64_t bytes, const struct mscclAlgoInterval& in) { return bytes < in.startBytes; });
+  if (interval == intervals.begin()) {
+    return ncclSuccess;
+  }
+  for (int i : std::prev(interval)->metaIdx) {
+    if (param->count % status.algoMetas[i].nChunksPerLoop != 0) continue;
+    param->handle = status.rankToAlgoHandles[i][param->rank];
+    param->scheduled = true;
+    last.handle = param->handle;
+    last.scheduled = true;
+    return ncclSuccess;
   }
 
   return ncclSuccess;
@@ -326,7 +400,7 @@ static ncclResult_t mscclSchedulerSelectAlgo(struct mscclSavedSchedulerParam* pa
   } else {
     // Disable MSCCL algorithms if machine type is not matching
     if (param->comm->topo->mscclEnabled || mscclForceEnabled()) {
-      NCCLCHECK(mscclInternalSchedulerSelectAlgo(param->comm->rank, &(param->p)));
+      NCCLCHECK(mscclInternalSchedulerSelectAlgo(param->comm, &(param->p)));
     } else {
       param->p.scheduled = false;
     }
@@ -360,6 +434,10 @@ static ncclResult_t mscclSetSavedSchedulerParam(
   return ncclSuccess;
 }
 
+static inline struct mscclSavedSchedulerParam* mscclLastSavedParam(mscclThreadLocalStatus& threadLocalStatus) {
+  return &threadLocalStatus.savedSchedulerParams[threadLocalStatus.nSavedSchedulerParams-1];
+}
+
 static ncclResult_t mscclSaveCountsAndDispls(struct mscclSavedSchedulerParam* param) {
   if (param->p.sendCounts) {
     param->savedSendCounts.assign(param->p.sendCounts, param->p.sendCounts + param->p.nRanks);
@@ -376,24 +454,26 @@ static ncclResult_t mscclSaveCountsAndDispls(struct mscclSavedSchedulerParam* pa
 
 static ncclResult_t mscclRunSavedParams() {
   mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
-  for (auto& param : threadLocalStatus.savedSchedulerParams) {
-    INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p task %d globalrank %d",
+  for (int i = 0; i < threadLocalStatus.nSavedSchedulerParams; i++) {
+    auto& param = threadLocalStatus.savedSchedulerParams[i];
+    INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p task %d globalrank %d time %.3f",
     mscclFuncNames[param.p.func], param.p.opCount, param.p.sendBuff, param.p.recvBuff, param.p.count,
-    param.p.dataType, param.p.op, param.p.root, param.comm, param.p.nRanks, param.stream, param.comm->tasks.nTasksP2p + param.comm->tasks.nTasksColl, param.comm->localRankToRank[param.comm->localRank]);
+    param.p.dataType, param.p.op, param.p.root, param.comm, param.p.nRanks, param.stream, param.comm->tasks.nTasksP2p + param.comm->tasks.nTasksColl, param.comm->localRankToRank[param.comm->localRank], clockNano()/1e6);
 
     NCCLCHECK(mscclRunAlgo(
       param.p.sendBuff, param.p.sendCounts, param.p.sDisPls,
       param.p.recvBuff, param.p.recvCounts, param.p.rDisPls,
       param.p.count, param.p.dataType, param.p.root, param.p.peer, param.p.op, param.p.handle, param.comm, param.stream));
   }
-  threadLocalStatus.savedSchedulerParams.clear();
+  threadLocalStatus.nSavedSchedulerParams = 0;
   return ncclSuccess;
 }
 
 static ncclResult_t mscclFallBackSavedParams() {
   mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
   mscclSetIsCallerFlag();
-  for (auto& param : threadLocalStatus.savedSchedulerParams) {
+  for (int i = 0; i < threadLocalStatus.nSavedSchedulerParams; i++) {
+    auto& param = threadLocalStatus.savedSchedulerParams[i];
     switch (param.p.func) {
       case mscclFuncReduce:
         NCCLCHECK(ncclReduce(param.p.sendBuff, param.p.recvBuff, param.p.count, param.p.dataType,
@@ -447,9 +527,64 @@ static ncclResult_t mscclFallBackSavedParams() {
     }
   }
   mscclClearIsCallerFlag();
-  threadLocalStatus.savedSchedulerParams.clear();
+  threadLocalStatus.nSavedSchedulerParams = 0;
+  return ncclSuccess;
+}
+
+#ifdef ENABLE_MSCCLPP
+// Runs the collective with MSCCL++ when it is captured and the cost model prefers it
+static ncclResult_t mscclppEnqueue(const void* sendBuff, void* recvBuff, size_t count, ncclDataType_t dataType,
+    ncclRedOp_t op, int root, mscclFunc_t func, ncclComm_t comm, hipStream_t stream, bool* ran) {
+  mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
+  size_t nBytes = count * ncclTypeSize(dataType);
+  ncclFunc_t coll;
+  const char* name;
+  *ran = false;
+
+  if (threadLocalStatus.captureStatus == mscclUnknownCaptureStatus) {
+    INFO(NCCL_COLL, "MSCCL++: reading capture status");
+    NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
+  }
+  /* check if one rank per GPU and graph mode is enabled */
+  if (threadLocalStatus.captureStatus == mscclNoCapture || !comm->mscclCompatible) return ncclSuccess;
+
+  if (func == mscclFuncAllReduce && (nBytes & 31) == 0) {
+    coll = ncclFuncAllReduce;
+    name = "mscclpp_ncclAllReduce";
+  } else if (func == mscclFuncAllGather) {
+    coll = ncclFuncAllGather;
+    name = "mscclpp_ncclAllGather";
+  } else if (func == mscclFuncReduceScatter && mscclpp_ncclReduceScatter) {
+    coll = ncclFuncReduceScatter;
+    name = "mscclpp_ncclReduceScatter";
+  } else if (func == mscclFuncAllToAll && mscclpp_ncclAllToAll) {
+    coll = ncclFuncAllToAll;
+    name = "mscclpp_ncclAllToAll";
+  } else {
+    return ncclSuccess;
+  }
+  NCCLCHECK(ncclMscclppPreferred(comm, coll, count, dataType, op, ran));
+  if (!*ran) return ncclSuccess;
+
+  INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
+    name, comm->opCount, sendBuff, recvBuff, count, dataType, op, root, comm, comm->nRanks, stream);
+  switch (coll) {
+    case ncclFuncAllReduce:
+      NCCLCHECK(mscclpp_ncclAllReduce(sendBuff, recvBuff, count, dataType, op, comm->mscclpp_comm, stream));
+      break;
+    case ncclFuncAllGather:
+      NCCLCHECK(mscclpp_ncclAllGather(sendBuff, recvBuff, count, dataType, comm->mscclpp_comm, stream));
+      break;
+    case ncclFuncReduceScatter:
+      NCCLCHECK(mscclpp_ncclReduceScatter(sendBuff, recvBuff, count, dataType, op, comm->mscclpp_comm, stream));
+      break;
+    default:
+      NCCLCHECK(mscclpp_ncclAllToAll(sendBuff, recvBuff, count, dataType, comm->mscclpp_comm, stream));
+      break;
+  }
   return ncclSuccess;
 }
+#endif
 
 ncclResult_t mscclEnqueueCheck(
     const void* sendBuff, const size_t sendCounts[], const size_t sDisPls[],
@@ -458,45 +593,32 @@ ncclResult_t mscclEnqueueCheck(
     mscclFunc_t func, ncclComm_t comm, hipStream_t stream) {
   mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
 
-  threadLocalStatus.savedSchedulerParams.push_back({});
+  // Saved params are reused across calls, along with the capacity of their
+  // counts and displs vectors, so that steady state enqueues do not allocate.
+  if (threadLocalStatus.nSavedSchedulerParams == (int)threadLocalStatus.savedSchedulerParams.size()) {
+    threadLocalStatus.savedSchedulerParams.emplace_back();
+  }
+  threadLocalStatus.savedSchedulerParams[threadLocalStatus.nSavedSchedulerParams++].p = {};
   NCCLCHECK(mscclSetSavedSchedulerParam(
     sendBuff, sendCounts, sDisPls, recvBuff, recvCounts, rDisPls,
     count, dataType, root, peer, op, func, comm, stream,
-    &threadLocalStatus.savedSchedulerParams.back()));
-
-  size_t nBytes = count * ncclTypeSize(dataType);
+    mscclLastSavedParam(threadLocalStatus)));
 
   switch (threadLocalStatus.groupStatus) {
     case mscclNoGroup:
 #ifdef ENABLE_MSCCLPP
       if (comm->mscclppCompatible) {
-        if (threadLocalStatus.captureStatus == mscclUnknownCaptureStatus) {
-          INFO(NCCL_COLL, "MSCCL++: reading capture status");
-          NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
-        }
-
-        /* check if one rank per GPU and graph mode is enabled */
-        if ((threadLocalStatus.captureStatus != mscclNoCapture) && comm->mscclCompatible) {
-          if (func == mscclFuncAllReduce && nBytes <= comm->mscclpp_threshold && (nBytes & 31) == 0) {
-            INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
-              "mscclpp_ncclAllReduce", comm->opCount, sendBuff, recvBuff, count, dataType, op, root, comm, comm->nRanks, stream);
-            NCCLCHECK(mscclpp_ncclAllReduce(sendBuff, recvBuff, count, dataType, op, comm->mscclpp_comm, stream));
-            threadLocalStatus.savedSchedulerParams.clear();
-            break;
-          }
-          else if (func == mscclFuncAllGather && nBytes * comm->nRanks <= comm->mscclpp_threshold) {
-            INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
-              "mscclpp_ncclAllGather", comm->opCount, sendBuff, recvBuff, count, dataType, op, root, comm, comm->nRanks, stream);
-            NCCLCHECK(mscclpp_ncclAllGather(sendBuff, recvBuff, count, dataType, comm->mscclpp_comm, stream));
-            threadLocalStatus.savedSchedulerParams.clear();
-            break;
-          }
+        bool ran;
+        NCCLCHECK(mscclppEnqueue(sendBuff, recvBuff, count, dataType, op, root, func, comm, stream, &ran));
+        if (ran) {
+          threadLocalStatus.nSavedSchedulerParams = 0;
+          break;
         }
       }
 #endif
       if (comm->mscclCompatible) {
-          NCCLCHECK(mscclSchedulerSelectAlgo(&threadLocalStatus.savedSchedulerParams.back()));
-          if (threadLocalStatus.savedSchedulerParams.back().p.scheduled) {
+          NCCLCHECK(mscclSchedulerSelectAlgo(mscclLastSavedParam(threadLocalStatus)));
+          if (mscclLastSavedParam(threadLocalStatus)->p.scheduled) {
             NCCLCHECK(mscclRunSavedParams());
             break;
           }
@@ -506,35 +628,19 @@ ncclResult_t mscclEnqueueCheck(
     case mscclGroupSupportedOp:
 #ifdef ENABLE_MSCCLPP
       if (comm->mscclppCompatible) {
-        if (threadLocalStatus.captureStatus == mscclUnknownCaptureStatus) {
-          INFO(NCCL_COLL, "MSCCL++: reading capture status");
-          NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
-        }
-
-        /* check if one rank per GPU and graph mode is enabled */
-        if ((threadLocalStatus.captureStatus != mscclNoCapture) && comm->mscclCompatible) {
-          if (func == mscclFuncAllReduce && nBytes <= comm->mscclpp_threshold && (nBytes & 31) == 0) {
-            INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
-              "mscclpp_ncclAllReduce", comm->opCount, sendBuff, recvBuff, count, dataType, op, root, comm, comm->nRanks, stream);
-            NCCLCHECK(mscclpp_ncclAllReduce(sendBuff, recvBuff, count, dataType, op, comm->mscclpp_comm, stream));
-            threadLocalStatus.savedSchedulerParams.clear();
-            break;
-          }
-          else if (func == mscclFuncAllGather && nBytes * comm->nRanks <= comm->mscclpp_threshold) {
-            INFO(NCCL_COLL,"%s: opCount %lx sendbuff %p recvbuff %p count %zi datatype %d op %d root %d comm %p [nranks=%d] stream %p",
-              "mscclpp_ncclAllGather", comm->opCount, sendBuff, recvBuff, count, dataType, op, root, comm, comm->nRanks, stream);
-            NCCLCHECK(mscclpp_ncclAllGather(sendBuff, recvBuff, count, dataType, comm->mscclpp_comm, stream));
-            threadLocalStatus.savedSchedulerParams.clear();
-            break;
-          }
+        bool ran;
+        NCCLCHECK(mscclppEnqueue(sendBuff, recvBuff, count, dataType, op, root, func, comm, stream, &ran));
+        if (ran) {
+          threadLocalStatus.nSavedSchedulerParams = 0;
+          break;
         }
       }
 #endif
       if (comm->mscclCompatible) {
-          NCCLCHECK(mscclSchedulerSelectAlgo(&threadLocalStatus.savedSchedulerParams.back()));
-          if (threadLocalStatus.savedSchedulerParams.back().p.scheduled) {
+          NCCLCHECK(mscclSchedulerSelectAlgo(mscclLastSavedParam(threadLocalStatus)));
+          if (mscclLastSavedParam(threadLocalStatus)->p.scheduled) {
             // Only save counts and displs when there is suitable MSCCL algorithm for this
-            NCCLCHECK(mscclSaveCountsAndDispls(&threadLocalStatus.savedSchedulerParams.back()));
+            NCCLCHECK(mscclSaveCountsAndDispls(mscclLastSavedParam(threadLocalStatus)));
             break;
           }
         }
@@ -564,6 +670,7 @@ ncclResult_t mscclGroupEnd() {
 static ncclResult_t mscclInternalUnloadAlgo(int rank, mscclAlgoHandle_t mscclAlgoHandle) {
   mscclStatus& status = mscclGetStatus(rank);
 
+  mscclJitForgetAlgo(rank, status.hostAlgos[mscclAlgoHandle]);
   free(status.hostAlgos[mscclAlgoHandle]);
   status.hostAlgos.erase(mscclAlgoHandle);
 
@@ -613,10 +720,12 @@ ncclResult_t mscclTeardown(int rank) {
     status.hostAlgos.clear();
     status.devAlgos.clear();
     status.freeAlgoHandles.clear();
+    status.jitKernels.clear();
     for (auto &p : status.scratchBuffers) {
       CUDACHECK(hipFree(p.second));
     }
     status.scratchBuffers.clear();
+    status.scratchPoolBytes = 0;
     status.connectedAlgos.clear();
     if (status.mscclSchedulerPtr) {
       NCCLCHECK(status.mscclSchedulerPtr->teardown());
@@ -11,6 +11,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include "core.h"
 #include "collectives.h"
 #include "msccl/msccl_parser.h"
@@ -301,7 +303,7 @@ ncclResult_t mscclProtocolStrToId(const char *protocol, int *protocolId) {
   return ncclSuccess;
 }
 
-ncclResult_t mscclGetAlgoFromXmlFile(const char* str, struct mscclAlgo* algo, int rank) {
+static ncclResult_t mscclParseAlgoFromXmlFile(const char* str, struct mscclAlgo* algo, int rank) {
   struct mscclXml* xml;
   NCCLCHECK(ncclCalloc(&xml, 1));
   NCCLCHECK(mscclAlgoXmlLoad(str, xml, rank));
@@ -652,6 +654,8 @@ ncclResult_t mscclGetAlgoFromXmlFile(const char* str, struct mscclAlgo* algo, in
 
                   numTransfers++;
                   sTB->nSteps = numTransfers;
+                  sTB->nDependencies = numDependencies;
+                  sTB->nReductionSrcs = numReductions;
                 }
               }
             }
@@ -702,6 +706,119 @@ ncclResult_t mscclGetAlgoFromXmlFile(const char* str, struct mscclAlgo* algo, in
   return ncclSuccess;
 }
 
+// Parsed algorithms are kept in RCCL_MSCCL_ALGO_CACHE_DIR (default
+// $HOME/.cache/rccl/msccl), one file per XML file and rank, so that later
+// inits only read them back instead of re-parsing the XML. The header ties a
+// cache file to the XML contents and to this build's mscclAlgo layout.
+RCCL_PARAM(MscclAlgoCache, "MSCCL_ALGO_CACHE", 1);
+
+#define MSCCL_ALGO_CACHE_MAGIC 0x4143534d4c434352ULL // "RCCLMSCA"
+#define MSCCL_ALGO_CACHE_VERSION 2
+
+struct mscclAlgoCacheHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t algoSize;
+  int32_t rank;
+  int32_t pad;
+  uint64_t xmlSize;
+  uint64_t xmlHash;
+};
+
+static ncclResult_t mscclAlgoCacheDir(char* dir, size_t len) {
+  const char* env = ncclGetEnv("RCCL_MSCCL_ALGO_CACHE_DIR");
+  if (env && env[0]) {
+    snprintf(dir, len, "%s", env);
+    return ncclSuccess;
+  }
+  const char* home = getenv("HOME");
+  if (home == NULL || home[0] == '\0') return ncclInvalidUsage;
+  snprintf(dir, len, "%s/.cache/rccl/msccl", home);
+  return ncclSuccess;
+}
+
+static void mscclAlgoCacheMkdir(char* dir) {
+  for (char* p = dir+1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    mkdir(dir, 0755);
+    *p = '/';
+  }
+  mkdir(dir, 0755);
+}
+
+static ncclResult_t mscclAlgoCacheKey(const char* xmlFilePath, int rank, struct mscclAlgoCacheHeader* header, char* cachePath, size_t len) {
+  char dir[PATH_MAX];
+  if (mscclAlgoCacheDir(dir, sizeof(dir)) != ncclSuccess) return ncclInvalidUsage;
+
+  int fd = open(xmlFilePath, O_RDONLY);
+  if (fd < 0) return ncclSystemError;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return ncclSystemError; }
+  char* contents = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (contents == MAP_FAILED) return ncclSystemError;
+  memset(header, 0, sizeof(*header));
+  header->magic = MSCCL_ALGO_CACHE_MAGIC;
+  header->version = MSCCL_ALGO_CACHE_VERSION;
+  header->algoSize = sizeof(struct mscclAlgo);
+  header->rank = rank;
+  header->xmlSize = st.st_size;
+  header->xmlHash = getHash(contents, st.st_size);
+  munmap(contents, st.st_size);
+
+  const char* base = strrchr(xmlFilePath, '/');
+  base = base ? base+1 : xmlFilePath;
+  mscclAlgoCacheMkdir(dir);
+  if (snprintf(cachePath, len, "%s/%s.%016lx.r%d.bin", dir, base, header->xmlHash, rank) >= (int)len) return ncclInvalidUsage;
+  return ncclSuccess;
+}
+
+static bool mscclAlgoCacheLoad(const char* cachePath, const struct mscclAlgoCacheHeader* header, struct mscclAlgo* algo) {
+  int fd = open(cachePath, O_RDONLY);
+  if (fd < 0) return false;
+  const size_t size = sizeof(struct mscclAlgoCacheHeader) + sizeof(struct mscclAlgo);
+  struct stat st;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  bool hit = memcmp(map, header, sizeof(*header)) == 0;
+  if (hit) memcpy(algo, (char*)map + sizeof(*header), sizeof(struct mscclAlgo));
+  munmap(map, size);
+  return hit;
+}
+
+static void mscclAlgoCacheStore(const char* cachePath, const struct mscclAlgoCacheHeader* header, const struct mscclAlgo* algo) {
+  // Write to a private file and rename it so that ranks sharing the cache
+  // directory never see a partial entry.
+  char tmpPath[PATH_MAX];
+  if (snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", cachePath, getpid()) >= (int)sizeof(tmpPath)) return;
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    INFO(NCCL_INIT, "MSCCL: could not write algorithm cache %s : %s", tmpPath, strerror(errno));
+    return;
+  }
+  bool ok = fwrite(header, sizeof(*header), 1, file) == 1 && fwrite(algo, sizeof(*algo), 1, file) == 1;
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmpPath, cachePath) != 0) unlink(tmpPath);
+}
+
+ncclResult_t mscclGetAlgoFromXmlFile(const char* str, struct mscclAlgo* algo, int rank) {
+  struct mscclAlgoCacheHeader header;
+  char cachePath[PATH_MAX];
+  bool useCache = rcclParamMscclAlgoCache() && mscclAlgoCacheKey(str, rank, &header, cachePath, sizeof(cachePath)) == ncclSuccess;
+  if (useCache && mscclAlgoCacheLoad(cachePath, &header, algo)) {
+    TRACE(NCCL_INIT, "MSCCL: loaded %s for rank %d from cache %s", str, rank, cachePath);
+    return ncclSuccess;
+  }
+  NCCLCHECK(mscclParseAlgoFromXmlFile(str, algo, rank));
+  if (useCache) mscclAlgoCacheStore(cachePath, &header, algo);
+  return ncclSuccess;
+}
+
 ncclResult_t mscclXmlLoadSingleNode(FILE* file, struct mscclXmlNode* node) {
   memset(node, 0, sizeof(struct mscclXmlNode));
   return mscclXmlGetNode(file, node);
@@ -3,12 +3,17 @@
  * Licensed under the MIT License.
  ************************************************************************/
 
+#include <map>
+#include <mutex>
+
+#include "archinfo.h"
 #include "channel.h"
 #include "checks.h"
 #include "collectives.h"
 #include "proxy.h"
 #include "transport.h"
 
+#include "msccl/msccl_jit.h"
 #include "msccl/msccl_lifecycle.h"
 #ifdef COMPILE_MSCCL_KERNEL
 #include "msccl/msccl_kernel.h"
@@ -17,6 +22,11 @@
 #include "msccl/msccl_status.h"
 
 RCCL_PARAM(MscclWorkFifoDepth, "MSCCL_WORK_FIFO_DEPTH", 256<<10);
+// Take scratch buffers from a stream-ordered pool per device, shared by all communicators
+// of the process. Captured launches keep using the per-rank scratch buffers. Pool memory
+// is coarse-grained, so the default (-1) leaves gfx94x, whose blocks may run on XCDs
+// with separate L2s, on the fine-grained per-rank buffers.
+RCCL_PARAM(MscclScratchPool, "MSCCL_SCRATCH_POOL", -1);
 
 static inline size_t computeSizeNeeded(size_t nBytes, int nScratchChunks, int nChunksPerLoop) {
   return (nBytes * (size_t)nScratchChunks) / (size_t)nChunksPerLoop;
@@ -72,6 +82,39 @@ ncclResult_t mscclSetupScratch(struct mscclAlgo* hostAlgo, hipStream_t stream) {
   return ncclSuccess;
 }
 
+// One pool per device. Its release threshold is never reached, so memory returned by
+// hipFreeAsync stays in the pool and later launches, on any stream, allocate
+// without synchronizing.
+static std::mutex scratchPoolMutex;
+static std::map<int, hipMemPool_t> scratchPools; // nullptr when the device has no pool support
+
+static hipMemPool_t mscclScratchPool(int cudaDev) {
+  std::lock_guard<std::mutex> lock(scratchPoolMutex);
+  auto itr = scratchPools.find(cudaDev);
+  if (itr != scratchPools.end()) return itr->second;
+  hipMemPool_t pool = nullptr;
+  int supported = 0;
+  char arch[256] = "";
+  bool wanted = rcclParamMscclScratchPool() > 0 || (GetGcnArchName(cudaDev, arch) == 0 && !IsArchMatch(arch, "gfx94"));
+  if (wanted && hipDeviceGetAttribute(&supported, hipDeviceAttributeMemoryPoolsSupported, cudaDev) == hipSuccess && supported) {
+    hipMemPoolProps props = {};
+    props.allocType = hipMemAllocationTypePinned;
+    props.location.type = hipMemLocationTypeDevice;
+    props.location.id = cudaDev;
+    uint64_t threshold = UINT64_MAX;
+    if (hipMemPoolCreate(&pool, &props) != hipSuccess) {
+      pool = nullptr;
+    } else if (hipMemPoolSetAttribute(pool, hipMemPoolAttrReleaseThreshold, &threshold) != hipSuccess) {
+      (void)hipMemPoolDestroy(pool);
+      pool = nullptr;
+    }
+  }
+  (void)hipGetLastError();
+  INFO(NCCL_INIT, "MSCCL: %s stream-ordered scratch pool on device %d", pool ? "using a" : "no", cudaDev);
+  scratchPools[cudaDev] = pool;
+  return pool;
+}
+
 ncclResult_t mscclSetupSyncFlags(int rank, hipStream_t stream) {
   mscclStatus& status = mscclGetStatus(rank);
   mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
@@ -118,27 +161,52 @@ ncclResult_t mscclSetupConnections(struct mscclAlgo* hostAlgo, ncclComm_t comm)
   status.needsProxy |= needsProxy;
   mscclClearIsCallerFlag();
 
+  // Inter-node peers go through the net proxy, whose steps mscclSetupProxy posts per launch
+  int nConns = 0, nInterNode = 0;
+  for (int i = 0; i < hostAlgo->nChannels; i++) {
+    struct mscclChannelInfo* mCh = hostAlgo->mscclChannels + i;
+    for (int p = 0; p < mCh->nSendPeers; p++, nConns++) nInterNode += comm->rankToNode[mCh->sendPeerInfo[p].peer] != comm->node;
+    for (int p = 0; p < mCh->nRecvPeers; p++, nConns++) nInterNode += comm->rankToNode[mCh->recvPeerInfo[p].peer] != comm->node;
+  }
+  if (nInterNode > 0) {
+    INFO(NCCL_INIT|NCCL_NET, "MSCCL: %d of %d connections of the algorithm cross nodes", nInterNode, nConns);
+  }
+
   INFO(NCCL_INIT, "MSCCL: Setup connections finished, used %ld", allocTracker[comm->cudaDev].totalAllocSize);
   return ncclSuccess;
 }
 
-static ncclResult_t mscclSetupProxyImpl(struct mscclAlgo* hostAlgo, ncclComm_t comm) {
+static void mscclGetProxyParams(ncclComm_t comm, struct mscclProxyParams* params) {
   mscclStatus& status = mscclGetStatus(comm->rank);
-  mscclThreadLocalStatus& threadLocalStatus = mscclGetThreadLocalStatus();
+  params->nBytes = status.nBytes;
+  params->stepSize = status.stepSize;
+  params->chunkSteps = status.chunkSteps;
+  params->sliceSteps = status.sliceSteps;
+  params->chunkSize = status.chunkSize;
+  params->chunkEffectiveSize = status.chunkEffectiveSize;
+  params->maxAllowedCount = status.maxAllowedCount;
+  params->dataType = status.dataType;
+}
+
+// Posts the steps of every proxy-backed connection of the algorithm. Like the
+// ring path, each transmission of the kernel moves whole chunks of chunkSteps
+// steps and the net proxy posts them sliceSteps at a time, so inter-node
+// transfers are pipelined the same way.
+static ncclResult_t mscclSetupProxyImpl(struct mscclAlgo* hostAlgo, ncclComm_t comm, const struct mscclProxyParams* params) {
   struct ncclProxyOp proxyOp = {};
   proxyOp.connIndex = 0;
-  proxyOp.sliceSteps = status.sliceSteps;
-  proxyOp.chunkSteps = status.chunkSteps;
-  proxyOp.chunkSize = status.chunkSize;
+  proxyOp.sliceSteps = params->sliceSteps;
+  proxyOp.chunkSteps = params->chunkSteps;
+  proxyOp.chunkSize = params->chunkSize;
   proxyOp.protocol = hostAlgo->protocol;
-  proxyOp.dtype = status.dataType;
+  proxyOp.dtype = params->dataType;
   proxyOp.redOp = 0;
   proxyOp.pattern = 0;
   proxyOp.root = 0;
-  proxyOp.nbytes = status.stepSize*proxyOp.sliceSteps;
+  proxyOp.nbytes = params->stepSize*proxyOp.sliceSteps;
   proxyOp.opCount = comm->sharedRes->collOpCount;
-  int nLoops = (int)(DIVUP(status.nBytes, (size_t)((size_t)hostAlgo->nChunksPerLoop*(size_t)status.chunkEffectiveSize)));
-  int nLoopsChunkSteps = nLoops * status.chunkSteps;
+  int nLoops = (int)(DIVUP(params->nBytes, (size_t)((size_t)hostAlgo->nChunksPerLoop*(size_t)params->chunkEffectiveSize)));
+  int nLoopsChunkSteps = nLoops * params->chunkSteps;
   for (int ch = 0; ch < hostAlgo->nChannels; ch++) {
     proxyOp.channelId = ch;
     struct mscclChannelInfo* mscclChannel = hostAlgo->mscclChannels + ch;
@@ -148,7 +216,7 @@ static ncclResult_t mscclSetupProxyImpl(struct mscclAlgo* hostAlgo, ncclComm_t c
       int nRecvs = 0;
       for (int j = 0; j < recvPeer->nExistingCounts; j++){
         int c = recvPeer->existingCounts[j];
-        int nStepsInCount = DIVUP(c, status.maxAllowedCount);
+        int nStepsInCount = DIVUP(c, params->maxAllowedCount);
         nRecvs += recvPeer->nTransmissionsOfCount[c] * nStepsInCount;
       }
       proxyOp.nsteps = nLoopsChunkSteps * nRecvs;
@@ -161,7 +229,7 @@ static ncclResult_t mscclSetupProxyImpl(struct mscclAlgo* hostAlgo, ncclComm_t c
       int nSends = 0;
       for (int j = 0; j < sendPeer->nExistingCounts; j++){
         int c = sendPeer->existingCounts[j];
-        int nStepsInCount = DIVUP(c, status.maxAllowedCount);
+        int nStepsInCount = DIVUP(c, params->maxAllowedCount);
         nSends += sendPeer->nTransmissionsOfCount[c] * nStepsInCount;
       }
       proxyOp.nsteps = nLoopsChunkSteps * nSends;
@@ -179,8 +247,26 @@ static void HIPRT_CB mscclSetupProxyCallback(void *args) {
   std::vector<struct mscclProxyArg>* params = (std::vector<struct mscclProxyArg>*)args;
   INFO(NCCL_NET,"mscclSetupProxyCallback: proxy args size: %ld\n", params->size());
   for (auto &p : *params) {
-    mscclSetupProxyImpl(p.hostAlgo, p.comm);
+    mscclSetupProxyImpl(p.hostAlgo, p.comm, &p.params);
+  }
+}
+
+// Whether any connection used by the algorithm is progressed by the proxy thread.
+// Intra-node P2P connections are driven by the kernel alone.
+static bool mscclAlgoNeedsProxy(struct mscclAlgo* hostAlgo, ncclComm_t comm) {
+  for (int ch = 0; ch < hostAlgo->nChannels; ch++) {
+    struct mscclChannelInfo* mscclChannel = hostAlgo->mscclChannels + ch;
+    struct ncclChannel* ncclChannel = comm->channels + ch;
+    for (int i = 0; i < mscclChannel->nRecvPeers; i++) {
+      int peer = mscclChannel->recvPeerInfo[i].peer;
+      if (peer >= 0 && ncclChannel->peers[peer]->recv[0].proxyConn.proxyProgress != NULL) return true;
+    }
+    for (int i = 0; i < mscclChannel->nSendPeers; i++) {
+      int peer = mscclChannel->sendPeerInfo[i].peer;
+      if (peer >= 0 && ncclChannel->peers[peer]->send[0].proxyConn.proxyProgress != NULL) return true;
+    }
   }
+  return false;
 }
 
 ncclResult_t mscclSetupProxy(struct mscclAlgo* hostAlgo, ncclComm_t comm, hipStream_t stream) {
@@ -191,10 +277,14 @@ ncclResult_t mscclSetupProxy(struct mscclAlgo* hostAlgo, ncclComm_t comm, hipStr
     INFO(NCCL_NET, "mscclSetupProxy: reading capture status");
     NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
   }
+  struct mscclProxyParams params;
+  mscclGetProxyParams(comm, &params);
   if (threadLocalStatus.captureStatus == mscclNoCapture) {
     INFO(NCCL_NET,"mscclSetupProxy: no capture\n");
-    NCCLCHECK(mscclSetupProxyImpl(hostAlgo, comm));
-  } else if (status.needsProxy) {
+    NCCLCHECK(mscclSetupProxyImpl(hostAlgo, comm, &params));
+  } else if (status.needsProxy && mscclAlgoNeedsProxy(hostAlgo, comm)) {
+    // Only algorithms with proxy-progressed connections need a host node on
+    // replay, others run from the captured kernel alone.
     INFO(NCCL_NET,"mscclSetupProxy: capture\n");
     if (savedProxyArgs[threadLocalStatus.captureId].size() == 0) {
       INFO(NCCL_NET,"mscclSetupProxy: adding callback\n");
@@ -202,11 +292,11 @@ ncclResult_t mscclSetupProxy(struct mscclAlgo* hostAlgo, ncclComm_t comm, hipStr
       hipGraphNode_t callbackNode;
       hipHostNodeParams p;
       p.fn = mscclSetupProxyCallback;
-      auto params = &savedProxyArgs[threadLocalStatus.captureId];
-      p.userData = params;
+      auto args = &savedProxyArgs[threadLocalStatus.captureId];
+      p.userData = args;
       CUDACHECK(hipGraphAddHostNode(&callbackNode, threadLocalStatus.graph, nullptr, 0, &p));
     }
-    savedProxyArgs[threadLocalStatus.captureId].emplace_back(hostAlgo, comm);
+    savedProxyArgs[threadLocalStatus.captureId].emplace_back(hostAlgo, comm, params);
   }
   return ncclSuccess;
 }
@@ -351,8 +441,8 @@ static ncclResult_t hostToDevRedOp(
   MSCCL_KERNEL_ENTRY_DEVREDOP(Prod, false), \
   MSCCL_KERNEL_ENTRY_DEVREDOP(MinMax, false)
 
-// Except for ncclDevPreMulSum and ncclDevSumPostDiv required by ncclAvg
-void* mscclKernelEntries[(ncclNumDevRedOps-2) * ncclNumTypes * NCCL_NUM_PROTOCOLS] = {
+// Except for ncclDevPreMulSum and ncclDevSumPostDiv required by ncclAvg, and ncclDevSumPostScale
+void* mscclKernelEntries[(ncclNumDevRedOps-3) * ncclNumTypes * NCCL_NUM_PROTOCOLS] = {
 #ifdef COMPILE_MSCCL_KERNEL
   MSCCL_KERNEL_ENTRY()
 #endif
@@ -437,10 +527,28 @@ ncclResult_t mscclSetupKernel(const void* sendBuff, void* recvBuff, size_t count
     return ncclInternalError;
   }
 
+  if (threadLocalStatus.captureStatus == mscclUnknownCaptureStatus) {
+    INFO(NCCL_NET, "MSCCL: reading capture status");
+    NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
+  }
+
   mscclWork work;
   work.syncFlags = status.syncFlags;
   size_t sizeNeeded = computeSizeNeeded(status.nBytes, hostAlgo->nScratchChunks, hostAlgo->nChunksPerLoop);
-  if (sizeNeeded > 0) {
+  hipMemPool_t scratchPool = nullptr;
+  if (sizeNeeded > 0 && threadLocalStatus.captureStatus == mscclNoCapture && rcclParamMscclScratchPool() != 0) {
+    scratchPool = mscclScratchPool(comm->cudaDev);
+  }
+  if (scratchPool) {
+    // Power of two size classes, so that the pool can hand the same blocks out again
+    size_t sizeRounded = 1;
+    while (sizeRounded < sizeNeeded) sizeRounded *= 2;
+    CUDACHECK(hipMallocFromPoolAsync(&work.scratchBuffer, sizeRounded, scratchPool, stream));
+    if (sizeRounded > status.scratchPoolBytes) {
+      ncclMemStatsAdd(&comm->memStats, ncclMemMsccl, false, sizeRounded - status.scratchPoolBytes);
+      status.scratchPoolBytes = sizeRounded;
+    }
+  } else if (sizeNeeded > 0) {
     auto itr = status.scratchBuffers.lower_bound(sizeNeeded);
     if (itr == status.scratchBuffers.end()) {
       void *scratchBuffer = nullptr;
@@ -461,6 +569,8 @@ ncclResult_t mscclSetupKernel(const void* sendBuff, void* recvBuff, size_t count
       NCCLCHECK(ncclCudaMalloc((char**)&scratchBuffer, sizeRounded, hipDeviceMallocFinegrained));
 #endif
       work.scratchBuffer = status.scratchBuffers[sizeRounded] = scratchBuffer;
+      // Kept per rank until teardown, accounted to the communicator that needed it first
+      ncclMemStatsAdd(&comm->memStats, ncclMemMsccl, false, sizeRounded);
       TRACE(NCCL_INIT, "MSCCL: Allocated scratch buffer of size %lu on request (%lu)", sizeRounded, sizeNeeded);
     } else {
       work.scratchBuffer = itr->second;
@@ -480,10 +590,6 @@ ncclResult_t mscclSetupKernel(const void* sendBuff, void* recvBuff, size_t count
   work.fnIndex = fnIndex;
   INFO(NCCL_COLL, "MSCCL: typeMask %x fnIndex %d Setup Kernel finished", hostAlgo->typeMask, fnIndex);
 
-  if (threadLocalStatus.captureStatus == mscclUnknownCaptureStatus) {
-    INFO(NCCL_NET, "MSCCL: reading capture status");
-    NCCLCHECK(mscclGetCaptureStatus(comm->rank, stream));
-  }
   mscclWorkFifoStatus* workFifoStatus = nullptr;
   if (threadLocalStatus.captureStatus == mscclNoCapture) {
     workFifoStatus = &(status.defaultWorkFifoStatus);
@@ -521,8 +627,17 @@ ncclResult_t mscclSetupKernel(const void* sendBuff, void* recvBuff, size_t count
   workFifoStatus->workFifoSent = workFifoSent + numBlocks;
 
   void *args[3] = {&comm->devComm, &devAlgo, &workPtr};
-  void *func = mscclKernelEntries[fnIndex];
-  CUDACHECK(hipExtLaunchKernel(func, grid, block, args, 0, stream, NULL, comm->doneEvent, 0));
+  hipFunction_t jitKernel;
+  NCCLCHECK(mscclJitGetKernel(hostAlgo, comm, opFull.op, dataType, &jitKernel));
+  if (jitKernel) {
+    CUDACHECK(hipModuleLaunchKernel(jitKernel, grid.x, 1, 1, block.x, 1, 1, 0, stream, args, NULL));
+    CUDACHECK(hipEventRecord(comm->doneEvent, stream));
+  } else {
+    void *func = mscclKernelEntries[fnIndex];
+    CUDACHECK(hipExtLaunchKernel(func, grid, block, args, 0, stream, NULL, comm->doneEvent, 0));
+  }
+  // Back to the pool once the kernel is done, the next launch may reuse it right away
+  if (scratchPool) CUDACHECK(hipFreeAsync(work.scratchBuffer, stream));
   status.workIndex++;
   status.lastStream = stream;
   return ncclSuccess;
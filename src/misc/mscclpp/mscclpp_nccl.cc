@@ -18,6 +18,13 @@
     return false;                                               \
   }                                                             \
 } while (false)
+#define MSCCLPP_LOAD_OPTIONAL(HANDLE, X) do {                   \
+  (mscclpp_##X) = (decltype(mscclpp_##X))dlsym((HANDLE), (#X)); \
+  if (dlerror() != nullptr) {                                   \
+    INFO(NCCL_INIT, "MSCCL++: %s not available", (#X));         \
+    (mscclpp_##X) = nullptr;                                    \
+  }                                                             \
+} while (false)
 
 static const char mscclpp_nccl_lib_name[] = "libmscclpp_nccl.so";
 
@@ -26,6 +33,8 @@ MSCCLPP_DECLARE(ncclCommInitRank);
 MSCCLPP_DECLARE(ncclCommDestroy);
 MSCCLPP_DECLARE(ncclAllReduce);
 MSCCLPP_DECLARE(ncclAllGather);
+MSCCLPP_DECLARE(ncclReduceScatter);
+MSCCLPP_DECLARE(ncclAllToAll);
 
 bool mscclpp_init() {
   void* handle = dlopen(mscclpp_nccl_lib_name, RTLD_LAZY);
@@ -40,6 +49,8 @@ bool mscclpp_init() {
   MSCCLPP_LOAD(handle, ncclCommDestroy);
   MSCCLPP_LOAD(handle, ncclAllReduce);
   MSCCLPP_LOAD(handle, ncclAllGather);
+  MSCCLPP_LOAD_OPTIONAL(handle, ncclReduceScatter);
+  MSCCLPP_LOAD_OPTIONAL(handle, ncclAllToAll);
   return true;
 }
 
@@ -0,0 +1,195 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "argcheck.h"
+#include "bootstrap.h"
+#include "comm.h"
+#include "core.h"
+#include "graph.h"
+#include "net.h"
+#include "utils.h"
+#include <limits.h>
+
+// Point to point benchmark of the network plugin loaded by a communicator. It
+// uses the plugin the way the net transport does (listen/connect/accept, regMr,
+// isend/irecv/test, iflush for GPU buffers that need it) but from the calling
+// thread, so that NIC and plugin throughput can be measured without kernels or
+// proxy threads. Buffers are placed with the same topology checks as the net
+// transport: GPU memory when GDR is possible, pinned host memory otherwise.
+
+#define NET_BENCH_TAG 0x4e455442 // "NETB", distinct from the transport setup tags
+
+struct netBenchState {
+  int isSend;
+  int netDev;
+  int useGdr;
+  int needFlush;
+  void* listenComm;
+  void* netComm;
+  void* buff;
+  void* mhandle;
+  void* requests[NCCL_NET_MAX_REQUESTS];
+  void* flushRequest;
+};
+
+static ncclResult_t netBenchAlloc(struct netBenchState* s, size_t size) {
+  if (s->useGdr) {
+#if defined(HIP_UNCACHED_MEMORY)
+    NCCLCHECK(ncclCudaCalloc((char**)&s->buff, size, nullptr, hipDeviceMallocUncached));
+#else
+    NCCLCHECK(ncclCudaCalloc((char**)&s->buff, size, nullptr, hipDeviceMallocFinegrained));
+#endif
+  } else {
+    NCCLCHECK(ncclCudaHostCalloc((char**)&s->buff, size));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t netBenchConnect(struct ncclComm* comm, int peer, struct netBenchState* s) {
+  ncclNet_t* net = comm->ncclNet;
+  char handle[NCCL_NET_HANDLE_MAXSIZE];
+  ncclNetDeviceHandle_t* devHandle = NULL;
+  if (s->isSend) {
+    ncclNetCommConfig_t netConfig;
+    ncclNetGetCommConfig(comm, &netConfig);
+    NCCLCHECK(bootstrapRecv(comm->bootstrap, peer, NET_BENCH_TAG, handle, sizeof(handle)));
+    // Connect is non-blocking and returns a NULL comm until the peer accepts
+    while (s->netComm == NULL) NCCLCHECK(net->connect(s->netDev, &netConfig, handle, &s->netComm, &devHandle));
+  } else {
+    NCCLCHECK(net->listen(s->netDev, handle, &s->listenComm));
+    NCCLCHECK(bootstrapSend(comm->bootstrap, peer, NET_BENCH_TAG, handle, sizeof(handle)));
+    while (s->netComm == NULL) NCCLCHECK(net->accept(s->listenComm, &s->netComm, &devHandle));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t netBenchTest(ncclNet_t* net, void** request) {
+  int done = 0;
+  while (!done) NCCLCHECK(net->test(*request, &done, NULL));
+  *request = NULL;
+  return ncclSuccess;
+}
+
+// Runs n messages of size bytes with up to window of them in flight
+static ncclResult_t netBenchRun(ncclNet_t* net, struct netBenchState* s, int size, int n, int window) {
+  int tag = 0;
+  int posted = 0, completed = 0;
+  while (completed < n) {
+    // Post as many as the window allows; isend returns a NULL request until the receiver is ready
+    while (posted < n && posted - completed < window) {
+      void** request = s->requests + posted%window;
+      if (s->isSend) {
+        NCCLCHECK(net->isend(s->netComm, s->buff, size, tag, s->mhandle, request));
+      } else {
+        NCCLCHECK(net->irecv(s->netComm, 1, &s->buff, &size, &tag, &s->mhandle, request));
+      }
+      if (*request == NULL) break;
+      posted++;
+    }
+    if (completed == posted) continue;
+    void** request = s->requests + completed%window;
+    int done = 0;
+    NCCLCHECK(net->test(*request, &done, NULL));
+    if (!done) continue;
+    *request = NULL;
+    if (!s->isSend && s->needFlush && size > 0) {
+      NCCLCHECK(net->iflush(s->netComm, 1, &s->buff, &size, &s->mhandle, &s->flushRequest));
+      if (s->flushRequest) NCCLCHECK(netBenchTest(net, &s->flushRequest));
+    }
+    completed++;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t netBenchClose(ncclNet_t* net, struct netBenchState* s) {
+  if (s->mhandle) NCCLCHECK(net->deregMr(s->netComm, s->mhandle));
+  if (s->netComm) NCCLCHECK(s->isSend ? net->closeSend(s->netComm) : net->closeRecv(s->netComm));
+  if (s->listenComm) NCCLCHECK(net->closeListen(s->listenComm));
+  if (s->buff) NCCLCHECK(s->useGdr ? ncclCudaFree(s->buff) : ncclCudaHostFree(s->buff));
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclCommNetBench, const ncclComm_t comm, int peer, const ncclNetBenchConfig_t* config, ncclNetBenchResult_t* results, int* nResults);
+ncclResult_t ncclCommNetBench(const ncclComm_t comm, int peer, const ncclNetBenchConfig_t* config, ncclNetBenchResult_t* results, int* nResults) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  ncclNetBenchConfig_t defaultConfig = NCCL_NET_BENCH_CONFIG_INITIALIZER;
+  ncclNetBenchConfig_t cfg;
+  struct netBenchState s;
+  ncclNetProperties_t props;
+  ncclResult_t ret = ncclSuccess;
+  ncclNet_t* net;
+  int maxResults, cudaDev, proxyRank;
+  size_t bytes;
+
+  NCCLCHECK(PtrCheck(comm, "CommNetBench", "comm"));
+  NCCLCHECK(PtrCheck(results, "CommNetBench", "results"));
+  NCCLCHECK(PtrCheck(nResults, "CommNetBench", "nResults"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (peer < 0 || peer >= comm->nRanks || peer == comm->rank) {
+    WARN("CommNetBench : invalid peer %d, rank %d nRanks %d", peer, comm->rank, comm->nRanks);
+    return ncclInvalidArgument;
+  }
+  cfg = config ? *config : defaultConfig;
+  if (cfg.minBytes > cfg.maxBytes || cfg.maxBytes > INT_MAX || cfg.iters < 1 || cfg.warmups < 0 ||
+      cfg.window < 1 || cfg.window > NCCL_NET_MAX_REQUESTS) {
+    WARN("CommNetBench : invalid config, sizes %zu-%zu iters %d warmups %d window %d (max %d)",
+        cfg.minBytes, cfg.maxBytes, cfg.iters, cfg.warmups, cfg.window, NCCL_NET_MAX_REQUESTS);
+    return ncclInvalidArgument;
+  }
+  net = comm->ncclNet;
+  maxResults = *nResults;
+  *nResults = 0;
+
+  memset(&s, 0, sizeof(s));
+  s.isSend = comm->rank < peer;
+  s.netDev = cfg.netDev;
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, fail);
+  if (s.netDev < 0) {
+    NCCLCHECKGOTO(ncclTopoGetNetDev(comm, comm->rank, NULL, 0, s.isSend ? peer : comm->rank, &s.netDev, &proxyRank), ret, fail);
+  }
+  NCCLCHECKGOTO(net->getProperties(s.netDev, &props), ret, fail);
+  if (cfg.gdr < 0) {
+    NCCLCHECKGOTO(ncclTopoCheckGdr(comm->topo, comm->busId, s.netDev, s.isSend, &s.useGdr), ret, fail);
+  } else {
+    s.useGdr = cfg.gdr && (props.ptrSupport & NCCL_PTR_CUDA);
+    if (cfg.gdr && !s.useGdr) INFO(NCCL_NET, "CommNetBench : NET/%s/%d has no GPU memory support, using host memory", net->name, s.netDev);
+  }
+  if (s.useGdr && !s.isSend) NCCLCHECKGOTO(ncclTopoNeedFlush(comm->topo, comm->busId, &s.needFlush), ret, fail);
+  INFO(NCCL_NET, "CommNetBench : rank %d %s rank %d via NET/%s/%d%s, %zu-%zu bytes, window %d", comm->rank,
+      s.isSend ? "->" : "<-", peer, net->name, s.netDev, s.useGdr ? "/GDRDMA" : "", cfg.minBytes, cfg.maxBytes, cfg.window);
+
+  NCCLCHECKGOTO(netBenchAlloc(&s, std::max<size_t>(cfg.maxBytes, 1)), ret, fail);
+  NCCLCHECKGOTO(netBenchConnect(comm, peer, &s), ret, fail);
+  NCCLCHECKGOTO(net->regMr(s.netComm, s.buff, std::max<size_t>(cfg.maxBytes, 1), s.useGdr ? NCCL_PTR_CUDA : NCCL_PTR_HOST, &s.mhandle), ret, fail);
+
+  for (bytes = cfg.minBytes; bytes <= cfg.maxBytes && *nResults < maxResults; bytes = bytes ? bytes*2 : 1) {
+    double timeUs[2];
+    NCCLCHECKGOTO(netBenchRun(net, &s, (int)bytes, cfg.warmups, cfg.window), ret, fail);
+    uint64_t start = clockNano();
+    NCCLCHECKGOTO(netBenchRun(net, &s, (int)bytes, cfg.iters, cfg.window), ret, fail);
+    timeUs[0] = (clockNano() - start)/1e3;
+    // Both ranks report the slower side, which for a unidirectional stream is the receiver
+    NCCLCHECKGOTO(bootstrapSend(comm->bootstrap, peer, NET_BENCH_TAG, timeUs, sizeof(double)), ret, fail);
+    NCCLCHECKGOTO(bootstrapRecv(comm->bootstrap, peer, NET_BENCH_TAG, timeUs+1, sizeof(double)), ret, fail);
+
+    ncclNetBenchResult_t* r = results + (*nResults)++;
+    r->bytes = bytes;
+    r->gdr = s.useGdr;
+    r->timeUs = std::max(timeUs[0], timeUs[1]);
+    r->msgRate = cfg.iters/r->timeUs*1e6;
+    r->bwGBs = bytes*(double)cfg.iters/r->timeUs/1e3;
+    if (bytes == cfg.maxBytes) break;
+  }
+
+exit:
+  NCCLCHECK(netBenchClose(net, &s));
+  CUDACHECK(cudaSetDevice(cudaDev));
+  return ret;
+fail:
+  goto exit;
+}
@@ -1,19 +1,33 @@
 /*************************************************************************
  * Copyright (c) 2022, NVIDIA CORPORATION. All rights reserved.
+ * Modifications Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
  *
  * See LICENSE.txt for license information
  ************************************************************************/
 
 #include "profiler.h"
-
-//#define PROFILE_PROXY 1
-#ifdef PROFILE_PROXY
-#include "timer.h"
 #include "alloc.h"
+#include "debug.h"
+#include "param.h"
+#include "utils.h"
+#include <pthread.h>
+#include <string.h>
+
+// Proxy profiling is enabled at runtime with NCCL_PROXY_PROFILE=<file>. Each
+// thread records into its own ring of events without taking any lock, and
+// finished events are streamed to the file in batches as Chrome trace /
+// Perfetto JSON. The file is valid at any point of the run: the viewers
+// accept a trace without its closing bracket. Timestamps are CLOCK_MONOTONIC
+// microseconds, the host clock that device timestamps are converted to (see
+// clocksync.h), so that tools/scripts/npkit_trace_generator.py can merge them.
+
+// Events per thread ring, and finished events that trigger a write
+RCCL_PARAM(ProxyProfileEvents, "PROXY_PROFILE_EVENTS", 65536);
+RCCL_PARAM(ProxyProfileFlush, "PROXY_PROFILE_FLUSH", 4096);
 
 static const char* profilingStateSendStr[] = { "BufferWait", "GPUWait", "SendWait", "", "End" };
 static const char* profilingStateRecvStr[] = { "BufferWait", "RecvWait", "FlushWait", "GPUWait", "End" };
-static const char* profilingEventStr[] = { "SendRecv", "Sleep", "Idle", "Append" };
+static const char* profilingEventStr[] = { "SendRecv", "Sleep", "Idle", "Append", "KernelLaunch" };
 struct ncclProxyProfileEvent {
   double timestamp[6];
   uint64_t opCount;
@@ -22,22 +36,134 @@ struct ncclProxyProfileEvent {
   uint16_t channel;
   uint8_t type; // send / recv
   uint8_t opIndex;
+  uint8_t done;
 };
 
-struct ncclProxyProfileEvent* profilingEvents = NULL;
-int profilingIndex = 0;
-double profilingStart = 0;
-#define MAX_EVENTS 200000
+struct ncclProxyProfileRing {
+  struct ncclProxyProfileEvent* events;
+  uint64_t size;
+  uint64_t head;    // next event handed out
+  uint64_t flushed; // events before this one have been written
+  int tid;
+};
 
-ncclResult_t ncclProfilingRecord(struct ncclProxyArgs* args, int sub, int step, int state) {
-  if (profilingEvents == NULL) {
-    NCCLCHECK(ncclCalloc(&profilingEvents, MAX_EVENTS));
-    profilingStart = gettime();
+static pthread_once_t profilingOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t profilingLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* profilingFile = NULL;
+static uint64_t profilingNextId = 0;
+static int profilingNextTid = 0;
+static __thread struct ncclProxyProfileRing* profilingRing = NULL;
+
+static double profilingTime() { return clockNano()/1e3; }
+
+static void profilingInit() {
+  const char* str = ncclGetEnv("NCCL_PROXY_PROFILE");
+  if (str == NULL) return;
+  FILE* f = fopen(str, "w");
+  if (f == NULL) {
+    WARN("NCCL_PROXY_PROFILE: could not open %s for writing", str);
+    return;
   }
+  fprintf(f, "[\n");
+  profilingFile = f;
+}
+
+static ncclResult_t profilingRingAlloc(struct ncclProxyProfileRing** ring) {
+  struct ncclProxyProfileRing* r;
+  NCCLCHECK(ncclCalloc(&r, 1));
+  r->size = std::max<int64_t>(rcclParamProxyProfileEvents(), 64);
+  ncclResult_t ret = ncclCalloc(&r->events, r->size);
+  if (ret != ncclSuccess) { free(r); return ret; }
+  r->tid = __atomic_add_fetch(&profilingNextTid, 1, __ATOMIC_RELAXED);
+  *ring = profilingRing = r;
+  return ncclSuccess;
+}
+
+static void profilingWriteEvent(FILE* f, struct ncclProxyProfileEvent* e, uint64_t i, int tid) {
+  const int sendrecv = e->peer >= 0;
+  const char* typeStr = sendrecv ? (e->type == ncclPatternSend ? "Send" : "Recv") :
+    profilingEventStr[-(e->peer/8)];
+
+  if (sendrecv) {
+    int state = ncclProxyProfileBegin;
+    const char** stateStr = e->type == ncclPatternSend ? profilingStateSendStr : profilingStateRecvStr;
+    fprintf(f, "{\"name\": \"%s-%d-%d\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %lu, \"pid\": %d, \"tid\": %d, \"ts\": %f, \"args\": { \"opCount\": %ld, \"proxyOpIndex\":%d } },\n",
+        typeStr, e->peer, e->step, i, e->channel, tid, e->timestamp[state], e->opCount, e->opIndex);
+
+    while (state<ncclProxyProfileEnd) {
+      if (e->timestamp[state]) {
+        const char* name = stateStr[state];
+        fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %lu, \"pid\": %d, \"tid\": %d, \"ts\": %f },\n",
+            name, i, e->channel, tid, e->timestamp[state]);
+        state++;
+        // Events written before they finished have no end timestamp
+        while (state<ncclProxyProfileEnd && e->timestamp[state] == 0) state++;
+        fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"e\", \"id\": %lu, \"pid\": %d, \"tid\": %d, \"ts\": %f },\n",
+            name, i, e->channel, tid, e->timestamp[state]);
+      } else {
+        state++;
+      }
+    }
+
+    fprintf(f, "{\"name\": \"%s-%d-%d\", \"cat\": \"NET\", \"ph\": \"e\", \"id\": %lu, \"pid\": %d, \"tid\": %d, \"ts\": %f },\n",
+        typeStr, e->peer, e->step, i, e->channel, tid, e->timestamp[state]);
+  } else {
+    if (e->peer == -ncclProxyProfileKernelLaunch) {
+      fprintf(f, "{\"name\": \"%s\", \"cat\": \"LAUNCH\", \"ph\": \"b\", \"id\": %lu, \"pid\": -2, \"tid\": %d, \"ts\": %f, \"args\": { \"rank\": %d, \"opCount\": %ld, \"nChannels\": %d } },\n",
+          typeStr, i, tid, e->timestamp[0], e->step, e->opCount, e->channel);
+    } else if (e->peer == -ncclProxyProfileAppend) {
+      fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %lu, \"pid\": -1, \"tid\": %d, \"ts\": %f, \"args\": { \"added\": %ld } },\n",
+          typeStr, i, tid, e->timestamp[0], e->opCount);
+    } else {
+      fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %lu, \"pid\": -1, \"tid\": %d, \"ts\": %f },\n",
+          typeStr, i, tid, e->timestamp[0]);
+    }
+    bool launch = e->peer == -ncclProxyProfileKernelLaunch;
+    fprintf(f, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"e\", \"id\": %lu, \"pid\": %d, \"tid\": %d, \"ts\": %f },\n",
+        typeStr, launch ? "LAUNCH" : "NET", i, launch ? -2 : -1, tid, e->timestamp[1]);
+  }
+}
+
+// Writes the finished events at the tail of the ring, or all of them when force
+// is set. A full ring also gives up its oldest event even if it is unfinished:
+// the states that op records later land in the reused slot.
+static void profilingFlush(struct ncclProxyProfileRing* ring, bool force) {
+  uint64_t end = ring->flushed;
+  if (ring->head - ring->flushed == ring->size) end++;
+  while (end < ring->head && (force || ring->events[end%ring->size].done)) end++;
+  if (end == ring->flushed) return;
+  uint64_t id = __atomic_fetch_add(&profilingNextId, end - ring->flushed, __ATOMIC_RELAXED);
+  pthread_mutex_lock(&profilingLock);
+  for (uint64_t i = ring->flushed; i < end; i++) {
+    profilingWriteEvent(profilingFile, ring->events+(i%ring->size), id++, ring->tid);
+  }
+  fflush(profilingFile);
+  pthread_mutex_unlock(&profilingLock);
+  ring->flushed = end;
+}
+
+bool ncclProfilingEnabled() {
+  pthread_once(&profilingOnce, profilingInit);
+  return profilingFile != NULL;
+}
+
+static struct ncclProxyProfileEvent* profilingNewEvent(struct ncclProxyProfileRing* ring) {
+  if (ring->head - ring->flushed >= (uint64_t)rcclParamProxyProfileFlush() || ring->head - ring->flushed == ring->size) {
+    profilingFlush(ring, false);
+  }
+  struct ncclProxyProfileEvent* event = ring->events+(ring->head++ % ring->size);
+  memset(event, 0, sizeof(*event));
+  return event;
+}
+
+ncclResult_t ncclProfilingRecord(struct ncclProxyArgs* args, int sub, int step, int state) {
+  if (!ncclProfilingEnabled()) return ncclSuccess;
+  struct ncclProxyProfileRing* ring = profilingRing;
+  if (ring == NULL) NCCLCHECK(profilingRingAlloc(&ring));
+
   struct ncclProxyProfileEvent* event = NULL;
   if (state%8 == 0) {
-    if (profilingIndex == MAX_EVENTS) return ncclSuccess;
-    args->subs[sub].profilingEvents[step%NCCL_STEPS] = event = profilingEvents+profilingIndex++;
+    args->subs[sub].profilingEvents[step%NCCL_MAX_STEPS] = event = profilingNewEvent(ring);
     if (state == ncclProxyProfileBegin) {
       // Proxy operation information
       event->opCount = args->opCount;
@@ -48,68 +174,49 @@ ncclResult_t ncclProfilingRecord(struct ncclProxyArgs* args, int sub, int step,
       event->opIndex = (((uint64_t)args)/sizeof(struct ncclProxyArgs))%256;
     } else event->peer = -state;
   } else {
-    event = (struct ncclProxyProfileEvent*)args->subs[sub].profilingEvents[step%NCCL_STEPS];
-    if (state == ncclProxyProfileEnd) args->subs[sub].profilingEvents[step%NCCL_STEPS] = NULL;
+    event = (struct ncclProxyProfileEvent*)args->subs[sub].profilingEvents[step%NCCL_MAX_STEPS];
+    if (event == NULL) return ncclSuccess;
+    if (state == ncclProxyProfileEnd) args->subs[sub].profilingEvents[step%NCCL_MAX_STEPS] = NULL;
     if (state == ncclProxyProfileAppendEnd) event->opCount = args->opCount;
+    // Sleep, idle and append events only have a begin and an end
+    if (state == ncclProxyProfileEnd || event->peer < 0) event->done = 1;
   }
   // Timestamp
-  event->timestamp[state%8] = gettime()-profilingStart;
+  event->timestamp[state%8] = profilingTime();
   return ncclSuccess;
 }
 
-void ncclProfilingDump() {
-  static int dumpDone = 0;
-  if (dumpDone) return;
-  dumpDone = 1;
-  const char* str = ncclGetEnv("NCCL_PROXY_PROFILE");
-  if (!str) { free(profilingEvents); return; }
-  FILE* f = fopen(str, "w");
-  fprintf(f, "[\n");
+ncclResult_t ncclProfilingRecordLaunch(int rank, uint64_t opCount, int nChannels, uint64_t startNs, uint64_t endNs) {
+  if (!ncclProfilingEnabled()) return ncclSuccess;
+  struct ncclProxyProfileRing* ring = profilingRing;
+  if (ring == NULL) NCCLCHECK(profilingRingAlloc(&ring));
+  struct ncclProxyProfileEvent* event = profilingNewEvent(ring);
+  event->peer = -ncclProxyProfileKernelLaunch;
+  event->step = rank;
+  event->opCount = opCount;
+  event->channel = nChannels;
+  event->timestamp[0] = startNs/1e3;
+  event->timestamp[1] = endNs/1e3;
+  event->done = 1;
+  return ncclSuccess;
+}
 
-  for (int i=0; i<profilingIndex; i++) {
-    struct ncclProxyProfileEvent* e = profilingEvents+i;
-    const int sendrecv = e->peer >= 0;
-    const char* typeStr = sendrecv ? (e->type == ncclPatternSend ? "Send" : "Recv") :
-      profilingEventStr[-(e->peer/8)];
-
-
-    if (sendrecv) {
-      int state = ncclProxyProfileBegin;
-      const char** stateStr = e->type == ncclPatternSend ? profilingStateSendStr : profilingStateRecvStr;
-      fprintf(f, "{\"name\": \"%s-%d-%d\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %d, \"pid\": %d, \"tid\": 1, \"ts\": %f, \"args\": { \"opCount\": %ld, \"proxyOpIndex\":%d } },\n",
-          typeStr, e->peer, e->step, i, e->channel, e->timestamp[state], e->opCount, e->opIndex);
-
-      while (state<ncclProxyProfileEnd) {
-        if (e->timestamp[state]) {
-          const char* name = stateStr[state];
-          fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %d, \"pid\": %d, \"tid\": 1, \"ts\": %f },\n",
-              name, i, e->channel, e->timestamp[state]);
-          state++;
-          while (e->timestamp[state] == 0) state++;
-          fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"e\", \"id\": %d, \"pid\": %d, \"tid\": 1, \"ts\": %f },\n",
-              name, i, e->channel, e->timestamp[state]);
-        }
-      }
+void ncclProfilingFlush() {
+  if (profilingRing) profilingFlush(profilingRing, true);
+}
 
-      fprintf(f, "{\"name\": \"%s-%d-%d\", \"cat\": \"NET\", \"ph\": \"e\", \"id\": %d, \"pid\": %d, \"tid\": 1, \"ts\": %f },\n",
-          typeStr, e->peer, e->step, i, e->channel, e->timestamp[state]);
-    } else {
-      if (e->peer == -ncclProxyProfileAppend) {
-      fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %d, \"pid\": -1, \"tid\": 1, \"ts\": %f, \"args\": { \"added\": %ld } },\n",
-          typeStr, i, e->timestamp[0], e->opCount);
-      } else {
-        fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"b\", \"id\": %d, \"pid\": -1, \"tid\": 1, \"ts\": %f },\n",
-          typeStr, i, e->timestamp[0]);
-      }
-      fprintf(f, "{\"name\": \"%s\", \"cat\": \"NET\", \"ph\": \"e\", \"id\": %d, \"pid\": -1, \"tid\": 1, \"ts\": %f },\n",
-          typeStr, i, e->timestamp[1]);
-    }
-  }
-  fprintf(f, "{} ]\n");
-  fclose(f);
-  free(profilingEvents);
+void ncclProfilingThreadExit() {
+  struct ncclProxyProfileRing* ring = profilingRing;
+  if (ring == NULL) return;
+  profilingFlush(ring, true);
+  free(ring->events);
+  free(ring);
+  profilingRing = NULL;
+}
+
+void ncclProfilingDump() {
+  if (profilingFile == NULL) return;
+  pthread_mutex_lock(&profilingLock);
+  fflush(profilingFile);
+  pthread_mutex_unlock(&profilingLock);
 }
-#else
-ncclResult_t ncclProfilingRecord(struct ncclProxyArgs* args, int sub, int step, int state) { return ncclSuccess; }
-void ncclProfilingDump() {}
-#endif
@@ -0,0 +1,675 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include "alloc.h"
+#include "argcheck.h"
+#include "bootstrap.h"
+#include "collectives.h"
+#include "comm.h"
+#include "core.h"
+#include "graph.h"
+#include "ipccache.h"
+#include "net.h"
+#include "p2p.h"
+#include "register.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+// One-sided windows. Every rank exposes a buffer; ncclPut/ncclGet copy to or from
+// the window of a peer and ncclSignal bumps a counter the peer waits on with
+// ncclWaitSignal, ordered on a stream and without any call on the peer side.
+//
+// Windows of the same node are mapped through IPC, so operations on them are
+// copies and stream memory operations on the peer memory. Windows on other nodes
+// are served by a thread per window, over two network connections per pair of
+// ranks: the request connection carries headers and put data, which the thread
+// of the target writes into its window, and the reply connection carries get
+// data back. Like the persistent kernel, the stream rings a doorbell for every
+// operation on the network and waits for the thread to report its completion.
+// Buffers registered with ncclCommRegister are used as they are, others are
+// registered with the plugin for the duration of the operation.
+
+#define WIN_TAG 0x57494e00 // "WIN"
+#define WIN_MAX_OPS 1024
+
+enum winOpType { winOpPut, winOpGet, winOpSignal };
+enum winOpState { winOpWaiting, winOpPosting, winOpTesting };
+enum winInState { winInHeader, winInPut, winInGet };
+
+struct winHeader {
+  uint32_t type;
+  uint32_t size;
+  uint64_t offset;
+  uint64_t value;
+};
+
+// One per operation slot, in host memory the streams can access
+struct winSync {
+  uint64_t doorbell; // last operation of the slot the stream reached
+  uint64_t complete; // last operation of the slot done by the thread
+};
+
+struct winOp {
+  int type;
+  int state;
+  int peer;
+  uint64_t seq;
+  char* local;
+  size_t offset;
+  int size;
+  uint64_t value;
+  void* mhandle;
+  void* mhandleComm; // connection mhandle was registered on, NULL if it came from ncclCommRegister
+  int nRequests;
+  void* requests[2];
+  struct winOp* next;
+};
+
+struct winPeer {
+  int isNet;
+  size_t size; // of the window of the peer
+  uint64_t signalsSent;
+  // Same node
+  char* buff;
+  uint64_t* signal; // counter of this rank in the signals of the peer
+  char* ipcBase;
+  uint64_t* importedSignals;
+  // Other nodes
+  char handles[2][NCCL_NET_HANDLE_MAXSIZE]; // request and reply listen handles of the peer
+  void* listenComms[2];
+  void* reqSend, *reqRecv, *replySend, *replyRecv;
+  void* headerSendMh, *headerRecvMh;
+  void* winRecvMh, *winSendMh;
+  int ownWinRecvMh, ownWinSendMh;
+  struct winOp* posting;
+  int inState;
+  void* inRequest;
+};
+
+struct ncclWin {
+  struct ncclComm* comm;
+  char* buff;
+  size_t size;
+  struct winPeer* peers;
+  // Counters signalled by the ranks of the node, shareable, and by the other ranks
+  uint64_t* signals;
+  ncclIpcDesc signalsDesc;
+  uint64_t* netSignals;
+  int nNetPeers;
+  int netDev;
+  int needFlush;
+  struct winSync* sync;        // [WIN_MAX_OPS]
+  struct winHeader* headers;   // WIN_MAX_OPS outgoing, then one incoming per rank
+  uint64_t seq;
+  pthread_mutex_t mutex;
+  struct winOp* queueHead, *queueTail;
+  pthread_t thread;
+  int threadStarted;
+  int stop;
+  ncclResult_t error;
+  struct ncclWin* next;
+};
+
+struct winInfo {
+  size_t size;
+  char* buff;
+  uint64_t* signals;
+  ncclIpcDesc signalsDesc;
+  cudaIpcMemHandle_t buffHandle;
+  size_t buffOffset;
+};
+
+// Memory handle of data on netComm, preferring a registration made with ncclCommRegister
+static ncclResult_t winGetMr(struct ncclWin* w, void* netComm, void* data, size_t size, void** mhandle, int* owned) {
+  struct ncclReg* reg;
+  NCCLCHECK(ncclRegFind(w->comm, data, size, &reg));
+  if (reg && (reg->state & NET_REG_COMPLETE)) {
+    for (int d=0; d<reg->nDevs; d++) {
+      if (reg->devs[d] == w->netDev && reg->handles[d]) {
+        *mhandle = reg->handles[d];
+        *owned = 0;
+        return ncclSuccess;
+      }
+    }
+  }
+  NCCLCHECK(w->comm->ncclNet->regMr(netComm, data, size, NCCL_PTR_CUDA, mhandle));
+  *owned = 1;
+  return ncclSuccess;
+}
+
+static ncclResult_t winNetInit(struct ncclWin* w) {
+  struct ncclComm* comm = w->comm;
+  ncclNet_t* net = comm->ncclNet;
+  ncclNetDeviceHandle_t* devHandle = NULL;
+  ncclNetCommConfig_t netConfig;
+  ncclNetProperties_t props;
+  int gdrRead, gdrWrite, remaining;
+  char handles[2][NCCL_NET_HANDLE_MAXSIZE];
+
+  NCCLCHECK(ncclTopoGetLocalNet(comm->topo, comm->rank, 0, &w->netDev));
+  NCCLCHECK(net->getProperties(w->netDev, &props));
+  NCCLCHECK(ncclTopoCheckGdr(comm->topo, comm->busId, w->netDev, 1, &gdrRead));
+  NCCLCHECK(ncclTopoCheckGdr(comm->topo, comm->busId, w->netDev, 0, &gdrWrite));
+  if (!gdrRead || !gdrWrite || (props.ptrSupport & NCCL_PTR_CUDA) == 0) {
+    WARN("WinCreate : NET/%s/%d can't access GPU memory, windows on other nodes need GPU Direct RDMA", net->name, w->netDev);
+    return ncclInvalidUsage;
+  }
+  NCCLCHECK(ncclTopoNeedFlush(comm->topo, comm->busId, &w->needFlush));
+  ncclNetGetCommConfig(comm, &netConfig);
+
+  for (int p=0; p<comm->nRanks; p++) {
+    struct winPeer* peer = w->peers+p;
+    if (!peer->isNet) continue;
+    NCCLCHECK(net->listen(w->netDev, handles[0], peer->listenComms+0));
+    NCCLCHECK(net->listen(w->netDev, handles[1], peer->listenComms+1));
+    NCCLCHECK(bootstrapSend(comm->bootstrap, p, WIN_TAG, handles, sizeof(handles)));
+  }
+  for (int p=0; p<comm->nRanks; p++) {
+    struct winPeer* peer = w->peers+p;
+    if (peer->isNet) NCCLCHECK(bootstrapRecv(comm->bootstrap, p, WIN_TAG, peer->handles, sizeof(peer->handles)));
+  }
+  // Connect and accept are non-blocking, progress all of them together
+  do {
+    remaining = 0;
+    for (int p=0; p<comm->nRanks; p++) {
+      struct winPeer* peer = w->peers+p;
+      if (!peer->isNet) continue;
+      if (peer->reqSend == NULL) NCCLCHECK(net->connect(w->netDev, &netConfig, peer->handles[0], &peer->reqSend, &devHandle));
+      if (peer->replySend == NULL) NCCLCHECK(net->connect(w->netDev, &netConfig, peer->handles[1], &peer->replySend, &devHandle));
+      if (peer->reqRecv == NULL) NCCLCHECK(net->accept(peer->listenComms[0], &peer->reqRecv, &devHandle));
+      if (peer->replyRecv == NULL) NCCLCHECK(net->accept(peer->listenComms[1], &peer->replyRecv, &devHandle));
+      remaining += (peer->reqSend == NULL) + (peer->replySend == NULL) + (peer->reqRecv == NULL) + (peer->replyRecv == NULL);
+    }
+    if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) return ncclInternalError;
+  } while (remaining);
+
+  size_t headersSize = (WIN_MAX_OPS+comm->nRanks)*sizeof(struct winHeader);
+  for (int p=0; p<comm->nRanks; p++) {
+    struct winPeer* peer = w->peers+p;
+    if (!peer->isNet) continue;
+    for (int i=0; i<2; i++) {
+      NCCLCHECK(net->closeListen(peer->listenComms[i]));
+      peer->listenComms[i] = NULL;
+    }
+    NCCLCHECK(net->regMr(peer->reqSend, w->headers, headersSize, NCCL_PTR_HOST, &peer->headerSendMh));
+    NCCLCHECK(net->regMr(peer->reqRecv, w->headers, headersSize, NCCL_PTR_HOST, &peer->headerRecvMh));
+    if (w->size) {
+      NCCLCHECK(winGetMr(w, peer->reqRecv, w->buff, w->size, &peer->winRecvMh, &peer->ownWinRecvMh));
+      NCCLCHECK(winGetMr(w, peer->replySend, w->buff, w->size, &peer->winSendMh, &peer->ownWinSendMh));
+    }
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t winTest(ncclNet_t* net, void** request) {
+  int done = 0;
+  while (!done) NCCLCHECK(net->test(*request, &done, NULL));
+  *request = NULL;
+  return ncclSuccess;
+}
+
+static ncclResult_t winFlush(struct ncclWin* w, void* recvComm, void* data, int size, void* mhandle) {
+  void* request = NULL;
+  if (!w->needFlush || size == 0) return ncclSuccess;
+  NCCLCHECK(w->comm->ncclNet->iflush(recvComm, 1, &data, &size, &mhandle, &request));
+  if (request) NCCLCHECK(winTest(w->comm->ncclNet, &request));
+  return ncclSuccess;
+}
+
+// Serves the requests a peer on another node makes to our window
+static ncclResult_t winProgressIncoming(struct ncclWin* w, int p, int* idle) {
+  struct winPeer* peer = w->peers+p;
+  struct winHeader* header = w->headers+WIN_MAX_OPS+p;
+  ncclNet_t* net = w->comm->ncclNet;
+  void* data = w->buff+header->offset;
+  int size = header->size, tag = 0, done;
+
+  if (peer->inRequest == NULL) {
+    if (peer->inState == winInHeader) {
+      void* headerData = header;
+      size = sizeof(*header);
+      NCCLCHECK(net->irecv(peer->reqRecv, 1, &headerData, &size, &tag, &peer->headerRecvMh, &peer->inRequest));
+    } else if (peer->inState == winInPut) {
+      NCCLCHECK(net->irecv(peer->reqRecv, 1, &data, &size, &tag, &peer->winRecvMh, &peer->inRequest));
+    } else {
+      NCCLCHECK(net->isend(peer->replySend, data, size, tag, peer->winSendMh, &peer->inRequest));
+    }
+    if (peer->inRequest == NULL) return ncclSuccess;
+    *idle = 0;
+  }
+  NCCLCHECK(net->test(peer->inRequest, &done, NULL));
+  if (!done) return ncclSuccess;
+  peer->inRequest = NULL;
+  *idle = 0;
+
+  if (peer->inState == winInHeader) {
+    if (header->type == winOpSignal) {
+      // Signals from different streams may arrive out of order, keep the highest
+      if (header->value > w->netSignals[p]) __atomic_store_n(w->netSignals+p, header->value, __ATOMIC_RELEASE);
+    } else if (header->offset + header->size > w->size) {
+      WARN("Win : rank %d accessed [%lu, %lu) out of a window of %zu bytes", p,
+          header->offset, header->offset + header->size, w->size);
+      return ncclInternalError;
+    } else {
+      peer->inState = header->type == winOpPut ? winInPut : winInGet;
+    }
+    return ncclSuccess;
+  }
+  // Put data must reach GPU memory before a later signal can be seen
+  if (peer->inState == winInPut) NCCLCHECK(winFlush(w, peer->reqRecv, data, size, peer->winRecvMh));
+  peer->inState = winInHeader;
+  return ncclSuccess;
+}
+
+// Operations to one peer post their messages one after the other so that headers
+// and data do not interleave on the connections; completions overlap.
+static ncclResult_t winProgressOp(struct ncclWin* w, struct winOp* op, int* idle, int* complete) {
+  struct winPeer* peer = w->peers+op->peer;
+  struct winSync* sync = w->sync + op->seq%WIN_MAX_OPS;
+  ncclNet_t* net = w->comm->ncclNet;
+  int nRequests = op->type == winOpSignal ? 1 : 2;
+  *complete = 0;
+
+  if (op->state == winOpWaiting) {
+    if (peer->posting || __atomic_load_n(&sync->doorbell, __ATOMIC_ACQUIRE) < op->seq) return ncclSuccess;
+    struct winHeader* header = w->headers + op->seq%WIN_MAX_OPS;
+    header->type = op->type;
+    header->size = op->size;
+    header->offset = op->offset;
+    header->value = op->value;
+    peer->posting = op;
+    op->state = winOpPosting;
+  }
+  if (op->state == winOpPosting) {
+    while (op->nRequests < nRequests) {
+      void** request = op->requests+op->nRequests;
+      if (op->nRequests == 0) {
+        NCCLCHECK(net->isend(peer->reqSend, w->headers + op->seq%WIN_MAX_OPS, sizeof(struct winHeader), 0, peer->headerSendMh, request));
+      } else if (op->type == winOpPut) {
+        NCCLCHECK(net->isend(peer->reqSend, op->local, op->size, 0, op->mhandle, request));
+      } else {
+        void* data = op->local;
+        int size = op->size, tag = 0;
+        NCCLCHECK(net->irecv(peer->replyRecv, 1, &data, &size, &tag, &op->mhandle, request));
+      }
+      if (*request == NULL) return ncclSuccess;
+      op->nRequests++;
+      *idle = 0;
+    }
+    peer->posting = NULL;
+    op->state = winOpTesting;
+  }
+  for (int i=0; i<nRequests; i++) {
+    int done;
+    if (op->requests[i] == NULL) continue;
+    NCCLCHECK(net->test(op->requests[i], &done, NULL));
+    if (!done) return ncclSuccess;
+    op->requests[i] = NULL;
+    *idle = 0;
+  }
+  if (op->type == winOpGet) NCCLCHECK(winFlush(w, peer->replyRecv, op->local, op->size, op->mhandle));
+  if (op->mhandleComm) {
+    NCCLCHECK(net->deregMr(op->mhandleComm, op->mhandle));
+    op->mhandleComm = NULL;
+  }
+  __atomic_store_n(&sync->complete, op->seq, __ATOMIC_RELEASE);
+  *complete = 1;
+  return ncclSuccess;
+}
+
+static void* winThreadMain(void* arg) {
+  struct ncclWin* w = (struct ncclWin*)arg;
+  struct ncclComm* comm = w->comm;
+  struct winOp* ops = NULL, **opsTail = &ops;
+  ncclResult_t ret = ncclSuccess;
+
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, fail);
+  while (!__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE)) {
+    int idle = 1;
+    pthread_mutex_lock(&w->mutex);
+    if (w->queueHead) {
+      *opsTail = w->queueHead;
+      opsTail = &w->queueTail->next;
+      w->queueHead = w->queueTail = NULL;
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    for (int p=0; p<comm->nRanks; p++) {
+      if (w->peers[p].isNet) NCCLCHECKGOTO(winProgressIncoming(w, p, &idle), ret, fail);
+    }
+    for (struct winOp** op = &ops; *op; ) {
+      int complete;
+      NCCLCHECKGOTO(winProgressOp(w, *op, &idle, &complete), ret, fail);
+      if (!complete) {
+        op = &(*op)->next;
+        continue;
+      }
+      struct winOp* next = (*op)->next;
+      free(*op);
+      *op = next;
+      if (next == NULL) opsTail = op;
+    }
+    if (__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) {
+      ret = ncclInternalError;
+      goto fail;
+    }
+    if (idle) sched_yield();
+  }
+exit:
+  while (ops) {
+    struct winOp* next = ops->next;
+    if (ops->mhandleComm) (void)comm->ncclNet->deregMr(ops->mhandleComm, ops->mhandle);
+    free(ops);
+    ops = next;
+  }
+  return NULL;
+fail:
+  if (!__atomic_load_n(comm->abortFlag, __ATOMIC_RELAXED)) {
+    WARN("Win : rank %d window %p failed with error %d", comm->rank, w, ret);
+    __atomic_store_n(&comm->asyncResult, ret, __ATOMIC_RELEASE);
+  }
+  // Release the streams waiting on operations that will never complete
+  pthread_mutex_lock(&w->mutex);
+  __atomic_store_n(&w->error, ret, __ATOMIC_RELEASE);
+  *opsTail = w->queueHead;
+  w->queueHead = w->queueTail = NULL;
+  for (int s=0; s<WIN_MAX_OPS; s++) __atomic_store_n(&w->sync[s].complete, UINT64_MAX, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&w->mutex);
+  goto exit;
+}
+
+static ncclResult_t winEnqueue(struct ncclWin* w, int type, int peer, char* local, size_t offset, size_t bytes, uint64_t value, cudaStream_t stream) {
+  struct winPeer* p = w->peers+peer;
+  struct winOp* op;
+  int owned = 0;
+  NCCLCHECK(ncclCalloc(&op, 1));
+  op->type = type;
+  op->peer = peer;
+  op->local = local;
+  op->offset = offset;
+  op->size = (int)bytes;
+  op->value = value;
+  if (type != winOpSignal) {
+    void* netComm = type == winOpPut ? p->reqSend : p->replyRecv;
+    ncclResult_t ret = winGetMr(w, netComm, local, bytes, &op->mhandle, &owned);
+    if (ret != ncclSuccess) {
+      free(op);
+      return ret;
+    }
+    if (owned) op->mhandleComm = netComm;
+  }
+
+  pthread_mutex_lock(&w->mutex);
+  uint64_t seq = op->seq = ++w->seq;
+  if (w->queueTail) w->queueTail->next = op;
+  else w->queueHead = op;
+  w->queueTail = op;
+  pthread_mutex_unlock(&w->mutex);
+
+  // The slot is free once the operation that used it before completed
+  struct winSync* sync = w->sync + seq%WIN_MAX_OPS;
+  while (seq > WIN_MAX_OPS && __atomic_load_n(&sync->complete, __ATOMIC_ACQUIRE) < seq-WIN_MAX_OPS) {
+    if (__atomic_load_n(&w->error, __ATOMIC_ACQUIRE) != ncclSuccess) break;
+    sched_yield();
+  }
+
+  CUDACHECK(hipStreamWriteValue64(stream, &sync->doorbell, seq, 0));
+  CUDACHECK(hipStreamWaitValue64(stream, &sync->complete, seq, hipStreamWaitValueGte, ~0ull));
+  return ncclSuccess;
+}
+
+static ncclResult_t winDestroy(struct ncclWin* w) {
+  struct ncclComm* comm = w->comm;
+  ncclNet_t* net = comm->ncclNet;
+  if (w->threadStarted) {
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(w->thread, NULL);
+  }
+  while (w->queueHead) {
+    struct winOp* next = w->queueHead->next;
+    if (w->queueHead->mhandleComm) NCCLCHECK(net->deregMr(w->queueHead->mhandleComm, w->queueHead->mhandle));
+    free(w->queueHead);
+    w->queueHead = next;
+  }
+  for (int p=0; w->peers && p<comm->nRanks; p++) {
+    struct winPeer* peer = w->peers+p;
+    if (peer->ipcBase) NCCLCHECK(ncclIpcCacheClose(peer->ipcBase));
+    if (peer->importedSignals) {
+      if (ncclCuMemEnable()) {
+        NCCLCHECK(ncclCudaFree(peer->importedSignals));
+      } else {
+        NCCLCHECK(ncclIpcCacheClose(peer->importedSignals));
+      }
+    }
+    if (peer->headerSendMh) NCCLCHECK(net->deregMr(peer->reqSend, peer->headerSendMh));
+    if (peer->headerRecvMh) NCCLCHECK(net->deregMr(peer->reqRecv, peer->headerRecvMh));
+    if (peer->ownWinRecvMh) NCCLCHECK(net->deregMr(peer->reqRecv, peer->winRecvMh));
+    if (peer->ownWinSendMh) NCCLCHECK(net->deregMr(peer->replySend, peer->winSendMh));
+    for (int i=0; i<2; i++) if (peer->listenComms[i]) NCCLCHECK(net->closeListen(peer->listenComms[i]));
+    if (peer->reqSend) NCCLCHECK(net->closeSend(peer->reqSend));
+    if (peer->replySend) NCCLCHECK(net->closeSend(peer->replySend));
+    if (peer->reqRecv) NCCLCHECK(net->closeRecv(peer->reqRecv));
+    if (peer->replyRecv) NCCLCHECK(net->closeRecv(peer->replyRecv));
+  }
+  if (w->signals) {
+    NCCLCHECK(ncclP2pFreeShareableBuffer(&w->signalsDesc));
+    NCCLCHECK(ncclCudaFree(w->signals));
+  }
+  if (w->netSignals) NCCLCHECK(ncclCudaHostFree(w->netSignals));
+  if (w->sync) NCCLCHECK(ncclCudaHostFree(w->sync));
+  if (w->headers) NCCLCHECK(ncclCudaHostFree(w->headers));
+  pthread_mutex_destroy(&w->mutex);
+  free(w->peers);
+  free(w);
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclWinCreate, ncclComm_t comm, void* buff, size_t size, ncclWin_t* win);
+ncclResult_t ncclWinCreate(ncclComm_t comm, void* buff, size_t size, ncclWin_t* win) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  struct ncclWin* w = NULL;
+  struct winInfo* infos = NULL;
+  struct ncclPeerInfo* myInfo;
+  bool needIpc = false;
+  ncclResult_t ret = ncclSuccess;
+  int cudaDev;
+
+  NCCLCHECK(PtrCheck(comm, "WinCreate", "comm"));
+  NCCLCHECK(PtrCheck(win, "WinCreate", "win"));
+  NCCLCHECK(ncclCommEnsureReady(comm));
+  if (size) {
+    NCCLCHECK(PtrCheck(buff, "WinCreate", "buff"));
+    if (comm->checkPointers) NCCLCHECK(CudaPtrCheck(buff, comm, "buff", "WinCreate"));
+  }
+  CUDACHECK(cudaGetDevice(&cudaDev));
+  CUDACHECKGOTO(cudaSetDevice(comm->cudaDev), ret, fail);
+
+  NCCLCHECKGOTO(ncclCalloc(&w, 1), ret, fail);
+  pthread_mutex_init(&w->mutex, NULL);
+  w->comm = comm;
+  w->buff = (char*)buff;
+  w->size = size;
+  NCCLCHECKGOTO(ncclCalloc(&w->peers, comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclP2pAllocateShareableBuffer(comm->nRanks*sizeof(uint64_t), &w->signalsDesc, (void**)&w->signals), ret, fail);
+  // Counters must be zero before any peer can signal, the allgather below orders it
+  CUDACHECKGOTO(cudaMemset(w->signals, 0, comm->nRanks*sizeof(uint64_t)), ret, fail);
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&w->netSignals, comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&w->sync, WIN_MAX_OPS), ret, fail);
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&w->headers, WIN_MAX_OPS+comm->nRanks), ret, fail);
+
+  myInfo = comm->peerInfo+comm->rank;
+  for (int p=0; p<comm->nRanks; p++) {
+    struct ncclPeerInfo* peerInfo = comm->peerInfo+p;
+    if (peerInfo->hostHash == myInfo->hostHash && peerInfo->pidHash != myInfo->pidHash) needIpc = true;
+  }
+  NCCLCHECKGOTO(ncclCalloc(&infos, comm->nRanks), ret, fail);
+  infos[comm->rank].size = size;
+  infos[comm->rank].buff = w->buff;
+  infos[comm->rank].signals = w->signals;
+  infos[comm->rank].signalsDesc = w->signalsDesc;
+  if (needIpc && size) {
+    void* base;
+    size_t baseSize;
+    CUDACHECKGOTO(hipMemGetAddressRange(&base, &baseSize, buff), ret, fail);
+    CUDACHECKGOTO(cudaIpcGetMemHandle(&infos[comm->rank].buffHandle, base), ret, fail);
+    infos[comm->rank].buffOffset = w->buff - (char*)base;
+  }
+  NCCLCHECKGOTO(bootstrapAllGather(comm->bootstrap, infos, sizeof(*infos)), ret, fail);
+
+  for (int p=0; p<comm->nRanks; p++) {
+    struct ncclPeerInfo* peerInfo = comm->peerInfo+p;
+    struct winPeer* peer = w->peers+p;
+    peer->size = infos[p].size;
+    if (peerInfo->hostHash != myInfo->hostHash) {
+      peer->isNet = 1;
+      w->nNetPeers++;
+      continue;
+    }
+    if (p == comm->rank) {
+      peer->buff = w->buff;
+      peer->signal = w->signals+p;
+      continue;
+    }
+    if (peerInfo->pidHash == myInfo->pidHash) {
+      cudaError_t err = cudaDeviceEnablePeerAccess(peerInfo->cudaDev, 0);
+      if (err != cudaSuccess && err != cudaErrorPeerAccessAlreadyEnabled) CUDACHECKGOTO(err, ret, fail);
+      (void)cudaGetLastError();
+      peer->buff = infos[p].buff;
+    } else if (infos[p].size) {
+      NCCLCHECKGOTO(ncclIpcCacheOpen(&infos[p].buffHandle, (void**)&peer->ipcBase), ret, fail);
+      peer->buff = peer->ipcBase + infos[p].buffOffset;
+    }
+    if (!ncclCuMemEnable() && peerInfo->pidHash == myInfo->pidHash) {
+      peer->signal = infos[p].signals + comm->rank;
+    } else {
+      NCCLCHECKGOTO(ncclP2pImportShareableBuffer(comm, comm->topParentRanks[p], comm->nRanks*sizeof(uint64_t), &infos[p].signalsDesc, (void**)&peer->importedSignals), ret, fail);
+      peer->signal = peer->importedSignals + comm->rank;
+    }
+  }
+
+  if (w->nNetPeers) {
+    NCCLCHECKGOTO(winNetInit(w), ret, fail);
+    if (pthread_create(&w->thread, NULL, winThreadMain, w) != 0) {
+      WARN("WinCreate : failed to create the window thread");
+      ret = ncclSystemError;
+      goto fail;
+    }
+    w->threadStarted = 1;
+    ncclSetThreadName(w->thread, "NCCL Win%2d", comm->cudaDev);
+  }
+
+  w->next = comm->wins;
+  comm->wins = w;
+  *win = w;
+  INFO(NCCL_INIT, "WinCreate: comm %p rank %d window %p buff %p size %zu, %d peers over the network", comm, comm->rank, w, buff, size, w->nNetPeers);
+
+exit:
+  free(infos);
+  CUDACHECK(cudaSetDevice(cudaDev));
+  return ret;
+fail:
+  if (w) winDestroy(w);
+  goto exit;
+}
+
+NCCL_API(ncclResult_t, ncclWinFree, ncclWin_t win);
+ncclResult_t ncclWinFree(ncclWin_t win) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  NCCLCHECK(PtrCheck(win, "WinFree", "win"));
+  struct ncclComm* comm = win->comm;
+  struct ncclWin** w = &comm->wins;
+  while (*w && *w != win) w = &(*w)->next;
+  if (*w == NULL) {
+    WARN("WinFree : unknown window %p", win);
+    return ncclInvalidArgument;
+  }
+  *w = win->next;
+  // Peers may still be accessing our window until they reach the barrier
+  int* barrier;
+  NCCLCHECK(ncclCalloc(&barrier, comm->nRanks));
+  ncclResult_t ret = bootstrapAllGather(comm->bootstrap, barrier, sizeof(int));
+  free(barrier);
+  NCCLCHECK(ret);
+  return winDestroy(win);
+}
+
+ncclResult_t ncclWinFreeAll(struct ncclComm* comm) {
+  while (comm->wins) {
+    struct ncclWin* w = comm->wins;
+    comm->wins = w->next;
+    NCCLCHECK(winDestroy(w));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t winOpCheck(ncclWin_t win, int peer, size_t count, ncclDataType_t datatype, size_t offset, const char* opname, size_t* bytes) {
+  NCCLCHECK(PtrCheck(win, opname, "win"));
+  if (peer < 0 || peer >= win->comm->nRanks) {
+    WARN("%s : invalid peer %d, nRanks %d", opname, peer, win->comm->nRanks);
+    return ncclInvalidArgument;
+  }
+  if (datatype < 0 || datatype >= ncclNumTypes) {
+    WARN("%s : invalid type %d", opname, datatype);
+    return ncclInvalidArgument;
+  }
+  *bytes = count*ncclTypeSize(datatype);
+  if (offset > win->peers[peer].size || *bytes > win->peers[peer].size - offset) {
+    WARN("%s : [%zu, %zu) is out of the %zu bytes window of rank %d", opname, offset, offset + *bytes, win->peers[peer].size, peer);
+    return ncclInvalidArgument;
+  }
+  if (win->peers[peer].isNet && *bytes > INT_MAX) {
+    WARN("%s : %zu bytes to rank %d on another node, at most %d bytes per operation", opname, *bytes, peer, INT_MAX);
+    return ncclInvalidArgument;
+  }
+  return __atomic_load_n(&win->error, __ATOMIC_ACQUIRE);
+}
+
+NCCL_API(ncclResult_t, ncclPut, const void* sendbuff, size_t count, ncclDataType_t datatype, int peer, size_t targetOffset, ncclWin_t win, cudaStream_t stream);
+ncclResult_t ncclPut(const void* sendbuff, size_t count, ncclDataType_t datatype, int peer, size_t targetOffset, ncclWin_t win, cudaStream_t stream) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  size_t bytes;
+  NCCLCHECK(winOpCheck(win, peer, count, datatype, targetOffset, "Put", &bytes));
+  if (bytes == 0) return ncclSuccess;
+  struct winPeer* p = win->peers+peer;
+  if (p->isNet) return winEnqueue(win, winOpPut, peer, (char*)sendbuff, targetOffset, bytes, 0, stream);
+  CUDACHECK(cudaMemcpyAsync(p->buff+targetOffset, sendbuff, bytes, cudaMemcpyDeviceToDevice, stream));
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclGet, void* recvbuff, size_t count, ncclDataType_t datatype, int peer, size_t targetOffset, ncclWin_t win, cudaStream_t stream);
+ncclResult_t ncclGet(void* recvbuff, size_t count, ncclDataType_t datatype, int peer, size_t targetOffset, ncclWin_t win, cudaStream_t stream) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  size_t bytes;
+  NCCLCHECK(winOpCheck(win, peer, count, datatype, targetOffset, "Get", &bytes));
+  if (bytes == 0) return ncclSuccess;
+  struct winPeer* p = win->peers+peer;
+  if (p->isNet) return winEnqueue(win, winOpGet, peer, (char*)recvbuff, targetOffset, bytes, 0, stream);
+  CUDACHECK(cudaMemcpyAsync(recvbuff, p->buff+targetOffset, bytes, cudaMemcpyDeviceToDevice, stream));
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclSignal, int peer, ncclWin_t win, cudaStream_t stream);
+ncclResult_t ncclSignal(int peer, ncclWin_t win, cudaStream_t stream) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  size_t bytes;
+  NCCLCHECK(winOpCheck(win, peer, 0, ncclInt8, 0, "Signal", &bytes));
+  struct winPeer* p = win->peers+peer;
+  uint64_t value = __atomic_add_fetch(&p->signalsSent, 1, __ATOMIC_RELAXED);
+  if (p->isNet) return winEnqueue(win, winOpSignal, peer, NULL, 0, 0, value, stream);
+  CUDACHECK(hipStreamWriteValue64(stream, p->signal, value, 0));
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclWaitSignal, int peer, uint64_t value, ncclWin_t win, cudaStream_t stream);
+ncclResult_t ncclWaitSignal(int peer, uint64_t value, ncclWin_t win, cudaStream_t stream) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+  size_t bytes;
+  NCCLCHECK(winOpCheck(win, peer, 0, ncclInt8, 0, "WaitSignal", &bytes));
+  uint64_t* signal = win->peers[peer].isNet ? win->netSignals+peer : win->signals+peer;
+  CUDACHECK(hipStreamWaitValue64(stream, signal, value, hipStreamWaitValueGte, ~0ull));
+  return ncclSuccess;
+}
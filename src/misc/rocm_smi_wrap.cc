@@ -23,9 +23,31 @@ THE SOFTWARE.
 #include "alt_rsmi.h"
 #include "core.h"
 #include "utils.h"
+#include <pthread.h>
 
 static int is_wsl2 = -1;
 
+// rocm_smi is initialized once per process, and what is discovered is kept for
+// the life of the process as well (RCCL_TOPO_CACHE), so that only the first
+// communicator queries the devices. Links are queried one pair at a time, for the
+// pairs topology detection asks for.
+#define RSMI_CACHE_MAX_DEVS 64
+struct rsmiLinkCache {
+  bool valid;
+  RSMI_IO_LINK_TYPE type;
+  int hops;
+  int count;
+};
+static pthread_mutex_t rsmiCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static ncclResult_t rsmiInitResult = ncclNumResults; // not initialized yet
+static uint32_t rsmiNumDevs;
+static bool rsmiNumDevsValid;
+static uint64_t rsmiPciIds[RSMI_CACHE_MAX_DEVS];
+static bool rsmiPciIdsValid[RSMI_CACHE_MAX_DEVS];
+static struct rsmiLinkCache rsmiLinks[RSMI_CACHE_MAX_DEVS][RSMI_CACHE_MAX_DEVS];
+
+int64_t rcclParamTopoCache();
+
 #define ROCMSMICHECK(cmd) do {               \
   rsmi_status_t ret = cmd;                   \
   if( ret != RSMI_STATUS_SUCCESS ) {         \
@@ -46,7 +68,7 @@ static int is_wsl2 = -1;
 
 RCCL_PARAM(UseRocmSmiLib, "USE_ROCM_SMI_LIB", 0); // Opt-in environment variable for enabling using rocm_smi_lib instead of internal code
 
-ncclResult_t rocm_smi_init() {
+static ncclResult_t rocmSmiInit() {
   if (__atomic_load_n(&is_wsl2, __ATOMIC_ACQUIRE) == -1)
     __atomic_store_n(&is_wsl2, (access("/dev/dxg", F_OK) == -1) ? 0 : 1, __ATOMIC_RELEASE);
   if (__atomic_load_n(&is_wsl2, __ATOMIC_ACQUIRE)) {
@@ -70,15 +92,59 @@ ncclResult_t rocm_smi_init() {
   return ncclSuccess;
 }
 
+ncclResult_t rocm_smi_init() {
+  pthread_mutex_lock(&rsmiCacheLock);
+  if (rsmiInitResult == ncclNumResults) rsmiInitResult = rocmSmiInit();
+  ncclResult_t ret = rsmiInitResult;
+  pthread_mutex_unlock(&rsmiCacheLock);
+  return ret;
+}
+
+static ncclResult_t rocmSmiNumDevices(uint32_t* num_devs) {
+  if (rcclParamUseRocmSmiLib()) {
+    ROCMSMICHECK(rsmi_num_monitor_devices(num_devs));
+  } else {
+    ARSMICHECK(ARSMI_get_num_devices(num_devs));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t rocmSmiCachedNumDevices(uint32_t* num_devs) {
+  if (!rcclParamTopoCache()) return rocmSmiNumDevices(num_devs);
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&rsmiCacheLock);
+  if (!rsmiNumDevsValid && (ret = rocmSmiNumDevices(&rsmiNumDevs)) == ncclSuccess) rsmiNumDevsValid = true;
+  *num_devs = rsmiNumDevs;
+  pthread_mutex_unlock(&rsmiCacheLock);
+  return ret;
+}
+
+static ncclResult_t rocmSmiPciId(uint32_t deviceIndex, uint64_t* id) {
+  if (rcclParamUseRocmSmiLib()) {
+    ROCMSMICHECK(rsmi_dev_pci_id_get(deviceIndex, id));
+  } else {
+    ARSMICHECK(ARSMI_dev_pci_id_get(deviceIndex, id));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t rocmSmiCachedPciId(uint32_t deviceIndex, uint64_t* id) {
+  if (!rcclParamTopoCache() || deviceIndex >= RSMI_CACHE_MAX_DEVS) return rocmSmiPciId(deviceIndex, id);
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&rsmiCacheLock);
+  if (!rsmiPciIdsValid[deviceIndex] && (ret = rocmSmiPciId(deviceIndex, rsmiPciIds+deviceIndex)) == ncclSuccess) {
+    rsmiPciIdsValid[deviceIndex] = true;
+  }
+  *id = rsmiPciIds[deviceIndex];
+  pthread_mutex_unlock(&rsmiCacheLock);
+  return ret;
+}
+
 ncclResult_t rocm_smi_getNumDevice(uint32_t* num_devs) {
   if (__atomic_load_n(&is_wsl2, __ATOMIC_ACQUIRE))
     CUDACHECK(cudaGetDeviceCount((int *)num_devs));
   else
-    if (rcclParamUseRocmSmiLib()) {
-      ROCMSMICHECK(rsmi_num_monitor_devices(num_devs));
-    } else {
-      ARSMICHECK(ARSMI_get_num_devices(num_devs));
-    }
+    NCCLCHECK(rocmSmiCachedNumDevices(num_devs));
 
   return ncclSuccess;
 }
@@ -97,11 +163,7 @@ ncclResult_t rocm_smi_getDevicePciBusIdString(uint32_t deviceIndex, char* busId,
      *  | Device   | [ 7: 3] |
      *  | Function | [ 2: 0] |
      **/
-    if (rcclParamUseRocmSmiLib()) {
-      ROCMSMICHECK(rsmi_dev_pci_id_get(deviceIndex, &id));
-    } else {
-      ARSMICHECK(ARSMI_dev_pci_id_get(deviceIndex, &id));
-    }
+    NCCLCHECK(rocmSmiCachedPciId(deviceIndex, &id));
     snprintf(busId, len, "%04lx:%02lx:%02lx.%01lx", (id) >> 32, (id & 0xff00) >> 8, (id & 0xf8) >> 3, (id & 0x7));
   }
   return ncclSuccess;
@@ -128,18 +190,10 @@ ncclResult_t rocm_smi_getDeviceIndexByPciBusId(const char* pciBusId, uint32_t* d
      **/
     busid = ((busid&0xffff00000L)<<12)+((busid&0xff000L)>>4)+((busid&0xff0L)>>1)+(busid&0x7L);
 
-    if (rcclParamUseRocmSmiLib()) {
-      ROCMSMICHECK(rsmi_num_monitor_devices(&num_devs));
-    } else {
-      ARSMICHECK(ARSMI_get_num_devices(&num_devs));
-    }
+    NCCLCHECK(rocmSmiCachedNumDevices(&num_devs));
     for (i = 0; i < num_devs; i++) {
       uint64_t bdfid;
-      if (rcclParamUseRocmSmiLib()) {
-	ROCMSMICHECK(rsmi_dev_pci_id_get(i, &bdfid));
-      } else {
-	ARSMICHECK(ARSMI_dev_pci_id_get(i, &bdfid));
-      }
+      NCCLCHECK(rocmSmiCachedPciId(i, &bdfid));
 
       if (bdfid == busid) break;
     }
@@ -159,7 +213,7 @@ ncclResult_t rocm_smi_getDeviceIndexByPciBusId(const char* pciBusId, uint32_t* d
   }
 }
 
-ncclResult_t rocm_smi_getLinkInfo(int srcIndex, int dstIndex, RSMI_IO_LINK_TYPE* rsmi_type, int *hops, int *count) {
+static ncclResult_t rocmSmiLinkInfo(int srcIndex, int dstIndex, RSMI_IO_LINK_TYPE* rsmi_type, int *hops, int *count) {
   if (__atomic_load_n(&is_wsl2, __ATOMIC_ACQUIRE)) {
     *rsmi_type = RSMI_IOLINK_TYPE_PCIEXPRESS;
     *hops = 1;
@@ -199,3 +253,20 @@ ncclResult_t rocm_smi_getLinkInfo(int srcIndex, int dstIndex, RSMI_IO_LINK_TYPE*
 
   return ncclSuccess;
 }
+
+ncclResult_t rocm_smi_getLinkInfo(int srcIndex, int dstIndex, RSMI_IO_LINK_TYPE* rsmi_type, int *hops, int *count) {
+  if (!rcclParamTopoCache() || srcIndex < 0 || srcIndex >= RSMI_CACHE_MAX_DEVS || dstIndex < 0 || dstIndex >= RSMI_CACHE_MAX_DEVS) {
+    return rocmSmiLinkInfo(srcIndex, dstIndex, rsmi_type, hops, count);
+  }
+  ncclResult_t ret = ncclSuccess;
+  pthread_mutex_lock(&rsmiCacheLock);
+  struct rsmiLinkCache* link = &rsmiLinks[srcIndex][dstIndex];
+  if (!link->valid && (ret = rocmSmiLinkInfo(srcIndex, dstIndex, &link->type, &link->hops, &link->count)) == ncclSuccess) {
+    link->valid = true;
+  }
+  *rsmi_type = link->type;
+  *hops = link->hops;
+  *count = link->count;
+  pthread_mutex_unlock(&rsmiCacheLock);
+  return ret;
+}
@@ -11,7 +11,9 @@
 #include "hsa/hsa.h"
 #include "param.h"
 
+#include <ctype.h>
 #include <dlfcn.h>
+#include <limits.h>
 #include <sys/utsname.h>
 #include <fstream>
 
@@ -176,3 +178,42 @@ ncclResult_t rocmLibraryInit() {
   pthread_once(&initOnceControl, initOnceFunc);
   return initResult;
 }
+
+// The proxy can only write GDRCopy-style flags in device memory when the CPU sees
+// all of the VRAM through the PCI BAR (large BAR). amdgpu reports the visible and
+// total VRAM in sysfs; APUs have no BAR limit.
+#define ROCM_MAX_DEVS 64
+static int largeBarCache[ROCM_MAX_DEVS]; // 0 unknown, 1 large BAR, -1 small BAR
+
+static uint64_t readSysfsValue(const char* busId, const char* name) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/%s", busId, name);
+  std::ifstream file(path);
+  uint64_t value = 0;
+  if (!(file >> value)) return 0;
+  return value;
+}
+
+int ncclGdrLargeBar(int cudaDev) {
+  if (cudaDev < 0 || cudaDev >= ROCM_MAX_DEVS) return 0;
+  int cached = __atomic_load_n(largeBarCache+cudaDev, __ATOMIC_RELAXED);
+  if (cached) return cached == 1;
+  int integrated = 0;
+  char busId[32];
+  uint64_t visible = 0, total = 0;
+  if (hipDeviceGetAttribute(&integrated, hipDeviceAttributeIntegrated, cudaDev) == hipSuccess && integrated) {
+    cached = 1;
+  } else if (hipDeviceGetPCIBusId(busId, sizeof(busId), cudaDev) == hipSuccess) {
+    for (char* c = busId; *c; c++) *c = tolower(*c);
+    visible = readSysfsValue(busId, "mem_info_vis_vram_total");
+    total = readSysfsValue(busId, "mem_info_vram_total");
+    cached = (total && visible >= total) ? 1 : -1;
+  } else {
+    cached = -1;
+  }
+  INFO(NCCL_INIT, "GDRCOPY : device %d %s (visible VRAM %lu of %lu bytes)", cudaDev,
+      cached == 1 ? "has a large BAR, proxy flags can live in device memory" : "has no large BAR, proxy flags stay in host memory",
+      visible, total);
+  __atomic_store_n(largeBarCache+cudaDev, cached, __ATOMIC_RELAXED);
+  return cached == 1;
+}
@@ -0,0 +1,179 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "argcheck.h"
+#include "comm.h"
+#include "core.h"
+#include "info.h"
+#include "param.h"
+#include "stats.h"
+
+static_assert(NCCL_STATS_NUM_COLLS == ncclNumFuncs, "ncclCommStats_t must cover all ncclFunc_t");
+static_assert(NCCL_STATS_NUM_ALGOS == NCCL_NUM_ALGORITHMS, "ncclCommStats_t must cover all algorithms");
+static_assert(NCCL_STATS_NUM_PROTOS == NCCL_NUM_PROTOCOLS, "ncclCommStats_t must cover all protocols");
+static_assert(NCCL_MEM_NUM_TRANSPORTS == NTRANSPORTS, "ncclCommMemoryInfo_t must cover all transports");
+
+// Time one out of this many single-collective launches for the kernel time histogram; 0 disables it
+RCCL_PARAM(StatsTimeInterval, "STATS_TIME_INTERVAL", 64);
+// Accumulate host time per enqueue phase, costs a clock read at each phase boundary
+RCCL_PARAM(StatsHostTime, "STATS_HOST_TIME", 0);
+// Accumulate active and idle time of the proxy progress threads, costs a clock read per progress pass
+RCCL_PARAM(StatsProxyTime, "STATS_PROXY_TIME", 0);
+static_assert(NCCL_STATS_HOST_PHASES == ncclStatsHostLaunch+1, "ncclCommStats_t must cover all host phases");
+
+void ncclStatsNoteCall(struct ncclComm* comm, struct ncclInfo* info) {
+  if (info->coll < 0 || info->coll >= NCCL_STATS_NUM_COLLS) return;
+  ncclStatsAdd(comm->stats.collCalls + info->coll, 1);
+  ncclStatsAdd(comm->stats.collBytes + info->coll, info->count * ncclTypeSize(info->datatype));
+}
+
+void ncclStatsNoteColl(struct ncclComm* comm, struct ncclInfo* collInfo) {
+  if (collInfo->algorithm < 0 || collInfo->algorithm >= NCCL_STATS_NUM_ALGOS) return;
+  if (collInfo->protocol < 0 || collInfo->protocol >= NCCL_STATS_NUM_PROTOS) return;
+  ncclStatsAdd(&comm->stats.algoProtoCalls[collInfo->algorithm][collInfo->protocol], 1);
+}
+
+bool ncclStatsSampleTime(struct ncclComm* comm) {
+  int64_t interval = rcclParamStatsTimeInterval();
+  // Only the launching thread counts, the counter does not need to be atomic
+  return interval > 0 && comm->stats.timeCount++ % interval == 0;
+}
+
+void ncclStatsNoteKernelTime(struct ncclComm* comm, int coll, size_t nBytes, float timeUs) {
+  uint64_t us = timeUs > 0.0f ? (uint64_t)timeUs : 0;
+  int bucket = us ? 63 - __builtin_clzll(us) : 0;
+  ncclStatsAdd(&comm->stats.kernelTimeSamples, 1);
+  ncclStatsAdd(comm->stats.kernelTimeHist + std::min(bucket, NCCL_STATS_TIME_BUCKETS-1), 1);
+  if (coll < 0 || coll >= NCCL_STATS_NUM_COLLS || nBytes == 0 || timeUs <= 0.0f) return;
+  int sizeBucket = std::min(63 - __builtin_clzll(nBytes), NCCL_STATS_SIZE_BUCKETS-1);
+  ncclStatsAdd(&comm->stats.sizeSamples[coll][sizeBucket], 1);
+  ncclStatsAdd(&comm->stats.sizeBytes[coll][sizeBucket], nBytes);
+  ncclStatsAdd(&comm->stats.sizeNs[coll][sizeBucket], (uint64_t)(timeUs*1000.0f));
+}
+
+// Sum of the retransmission counters that mlx and bnxt drivers expose for a port.
+static uint64_t ibPortRetries(const char* devName, int port) {
+  static const char* counters[] = { "local_ack_timeout_err", "packet_seq_err", "implied_nak_seq_err" };
+  uint64_t total = 0;
+  for (int i = 0; i < (int)(sizeof(counters)/sizeof(counters[0])); i++) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/sys/class/infiniband/%s/ports/%d/hw_counters/%s", devName, port, counters[i]);
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) continue;
+    unsigned long long value;
+    if (fscanf(file, "%llu", &value) == 1) total += value;
+    fclose(file);
+  }
+  return total;
+}
+
+static ncclResult_t ibRetries(struct ncclComm* comm, uint64_t* retries) {
+  *retries = 0;
+  if (comm->ncclNet == nullptr) return ncclSuccess;
+  int nDevs;
+  NCCLCHECK(comm->ncclNet->devices(&nDevs));
+  for (int d = 0; d < nDevs; d++) {
+    ncclNetProperties_t props;
+    NCCLCHECK(comm->ncclNet->getProperties(d, &props));
+    // Socket devices have no counters, their directory just does not exist
+    if (props.name) *retries += ibPortRetries(props.name, props.port);
+  }
+  return ncclSuccess;
+}
+
+NCCL_API(ncclResult_t, ncclCommGetStats, const ncclComm_t comm, ncclCommStats_t* stats);
+ncclResult_t ncclCommGetStats(const ncclComm_t comm, ncclCommStats_t* stats) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+
+  NCCLCHECK(PtrCheck(comm, "CommGetStats", "comm"));
+  NCCLCHECK(PtrCheck(stats, "CommGetStats", "stats"));
+  if (stats->size < sizeof(stats->size)) {
+    WARN("CommGetStats : stats->size %zu is too small, set it to sizeof(ncclCommStats_t)", stats->size);
+    return ncclInvalidArgument;
+  }
+
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  ncclCommStats_t s;
+  memset(&s, 0, sizeof(s));
+  s.size = std::min(stats->size, sizeof(s));
+  for (int f = 0; f < NCCL_STATS_NUM_COLLS; f++) {
+    s.collCalls[f] = __atomic_load_n(comm->stats.collCalls+f, __ATOMIC_RELAXED);
+    s.collBytes[f] = __atomic_load_n(comm->stats.collBytes+f, __ATOMIC_RELAXED);
+  }
+  for (int a = 0; a < NCCL_STATS_NUM_ALGOS; a++) {
+    for (int p = 0; p < NCCL_STATS_NUM_PROTOS; p++) {
+      s.algoProtoCalls[a][p] = __atomic_load_n(&comm->stats.algoProtoCalls[a][p], __ATOMIC_RELAXED);
+    }
+  }
+  s.kernelTimeSamples = __atomic_load_n(&comm->stats.kernelTimeSamples, __ATOMIC_RELAXED);
+  for (int b = 0; b < NCCL_STATS_TIME_BUCKETS; b++) {
+    s.kernelTimeHist[b] = __atomic_load_n(comm->stats.kernelTimeHist+b, __ATOMIC_RELAXED);
+  }
+  // The proxy is shared with the communicators split from the same parent, if any
+  struct ncclProxyState* proxyState = comm->proxyState;
+  if (proxyState) {
+    for (int t = 0; t < proxyState->nProgressThreads; t++) {
+      struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+      if (state == nullptr) continue;
+      s.proxyActiveNs += __atomic_load_n(&state->activeNs, __ATOMIC_RELAXED);
+      s.proxyIdleNs += __atomic_load_n(&state->idleNs, __ATOMIC_RELAXED);
+      s.proxySleepNs += __atomic_load_n(&state->sleepNs, __ATOMIC_RELAXED);
+    }
+  }
+  NCCLCHECK(ibRetries(comm, &s.ibRetries));
+  s.workFifoStalls = __atomic_load_n(&comm->workFifoStalls, __ATOMIC_RELAXED);
+  s.workFifoStallNs = __atomic_load_n(&comm->workFifoStallNs, __ATOMIC_RELAXED);
+  s.hostOps = __atomic_load_n(&comm->stats.hostOps, __ATOMIC_RELAXED);
+  s.hostLaunches = __atomic_load_n(&comm->stats.hostLaunches, __ATOMIC_RELAXED);
+  for (int p = 0; p < NCCL_STATS_HOST_PHASES; p++) {
+    s.hostNs[p] = __atomic_load_n(comm->stats.hostNs+p, __ATOMIC_RELAXED);
+  }
+
+  memcpy(stats, &s, s.size);
+  return ncclSuccess;
+}
+
+static void memStatsAccumulate(ncclCommMemoryInfo_t* info, struct ncclMemStats* stats) {
+  for (int c = 0; c < NCCL_MEM_NUM_CATEGORIES; c++) {
+    info->deviceBytes[c] += __atomic_load_n(stats->deviceBytes+c, __ATOMIC_RELAXED);
+    info->hostBytes[c] += __atomic_load_n(stats->hostBytes+c, __ATOMIC_RELAXED);
+  }
+  for (int t = 0; t < NCCL_MEM_NUM_TRANSPORTS; t++) {
+    info->connDeviceBytes[t] += __atomic_load_n(stats->connDeviceBytes+t, __ATOMIC_RELAXED);
+    info->connHostBytes[t] += __atomic_load_n(stats->connHostBytes+t, __ATOMIC_RELAXED);
+  }
+}
+
+NCCL_API(ncclResult_t, ncclCommGetMemoryInfo, const ncclComm_t comm, ncclCommMemoryInfo_t* info);
+ncclResult_t ncclCommGetMemoryInfo(const ncclComm_t comm, ncclCommMemoryInfo_t* info) {
+  NVTX3_FUNC_RANGE_IN(nccl_domain);
+
+  NCCLCHECK(PtrCheck(comm, "CommGetMemoryInfo", "comm"));
+  NCCLCHECK(PtrCheck(info, "CommGetMemoryInfo", "info"));
+  if (info->size < sizeof(info->size)) {
+    WARN("CommGetMemoryInfo : info->size %zu is too small, set it to sizeof(ncclCommMemoryInfo_t)", info->size);
+    return ncclInvalidArgument;
+  }
+
+  NCCLCHECK(ncclCommEnsureReady(comm));
+
+  ncclCommMemoryInfo_t m;
+  memset(&m, 0, sizeof(m));
+  m.size = std::min(info->size, sizeof(m));
+  memStatsAccumulate(&m, &comm->memStats);
+  if (comm->proxyState) memStatsAccumulate(&m, &comm->proxyState->memStats);
+  if (comm->cudaDev < MAX_ALLOC_TRACK_NGPU) {
+    m.deviceTotalBytes = __atomic_load_n(&allocTracker[comm->cudaDev].totalAllocSize, __ATOMIC_RELAXED);
+  }
+  for (int p = 0; p < NCCL_STATS_NUM_PROTOS; p++) m.buffSizes[p] = comm->buffSizes[p];
+
+  memcpy(info, &m, m.size);
+  return ncclSuccess;
+}
@@ -0,0 +1,201 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+
+#include "comm.h"
+#include "debug.h"
+#include "group.h"
+#include "info.h"
+#include "param.h"
+#include "straggler.h"
+#include "tuner.h"
+
+RCCL_PARAM(StragglerDetect, "STRAGGLER_DETECT", 0);
+RCCL_PARAM(StragglerSampleInterval, "STRAGGLER_SAMPLE_INTERVAL", 64);
+RCCL_PARAM(StragglerWindow, "STRAGGLER_WINDOW", 16);
+// Minimum average lateness over a window for a rank to be reported
+RCCL_PARAM(StragglerThresholdUs, "STRAGGLER_THRESHOLD_US", 50);
+
+static int64_t stragglerInterval() { return std::max<int64_t>(1, rcclParamStragglerSampleInterval()); }
+
+ncclResult_t ncclStragglerInit(struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  struct ncclStraggler* s = nullptr;
+
+  if (rcclParamStragglerDetect() == 0 || comm->nRanks == 1) return ncclSuccess;
+  if (!comm->config.blocking) {
+    INFO(NCCL_INIT, "Straggler detection: not supported on non-blocking communicators");
+    return ncclSuccess;
+  }
+
+  NCCLCHECK(ncclCalloc(&s, 1));
+  s->window = std::min<int64_t>(std::max<int64_t>(1, rcclParamStragglerWindow()), 1024);
+  NCCLCHECKGOTO(ncclCalloc(&s->hostSamples, 2*s->window), ret, fail);
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&s->hostSend, 2*s->window), ret, fail);
+  NCCLCHECKGOTO(ncclCudaCalloc(&s->devSamples, 2*s->window*comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclCudaHostCalloc(&s->hostGathered, 2*s->window*comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclCalloc(&s->lateUs, comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclCalloc(&s->lastCount, comm->nRanks), ret, fail);
+  NCCLCHECKGOTO(ncclCalloc(&s->recvWaitNs, comm->nRanks), ret, fail);
+  CUDACHECKGOTO(hipEventCreateWithFlags(&s->exchangeEvent, hipEventDisableTiming), ret, fail);
+  for (int j=0; j<s->window; j++) s->hostSamples[j] = -1;
+  s->nextExchange = s->window*stragglerInterval();
+  INFO(NCCL_INIT, "Straggler detection: one launch out of %ld timed, exchanged every %d samples",
+      stragglerInterval(), s->window);
+  comm->straggler = s;
+  return ncclSuccess;
+fail:
+  if (s) {
+    free(s->hostSamples);
+    if (s->hostSend) ncclCudaHostFree(s->hostSend);
+    if (s->devSamples) ncclCudaFree(s->devSamples);
+    if (s->hostGathered) ncclCudaHostFree(s->hostGathered);
+    free(s->lateUs);
+    free(s->lastCount);
+    free(s->recvWaitNs);
+    free(s);
+  }
+  return ret;
+}
+
+// Receive time the proxy spent on a peer, see recvProxyProgress() in net.cc.
+static uint64_t stragglerRecvWaitNs(struct ncclComm* comm, int rank) {
+  struct ncclProxyState* proxyState = comm->proxyState;
+  if (proxyState == nullptr || proxyState->peerRecvWaitNs == nullptr) return 0;
+  int tpRank = comm->topParentRanks[rank];
+  return __atomic_load_n(proxyState->peerRecvWaitNs+tpRank, __ATOMIC_RELAXED);
+}
+
+// Looks at the samples present on all ranks in the last exchange. Every rank
+// runs the same analysis on the same data; rank 0 reports the stragglers and
+// the other ranks how long their proxy waited on them.
+static void stragglerAnalyze(struct ncclComm* comm, struct ncclStraggler* s) {
+  int nRanks = comm->nRanks, w = s->window;
+  int nValid = 0;
+  int* windowLast;
+  double* windowLate;
+  if (ncclCalloc(&windowLast, nRanks) != ncclSuccess) return;
+  if (ncclCalloc(&windowLate, nRanks) != ncclSuccess) { free(windowLast); return; }
+  for (int j=0; j<w; j++) {
+    double key = s->hostGathered[j];
+    bool valid = key >= 0;
+    for (int r=0; valid && r<nRanks; r++) {
+      double* g = s->hostGathered + 2*w*r;
+      valid = g[j] == key && g[w+j] >= 0;
+    }
+    if (!valid) continue;
+    double maxUs = 0;
+    int last = 0;
+    for (int r=0; r<nRanks; r++) {
+      double us = s->hostGathered[2*w*r+w+j];
+      maxUs = std::max(maxUs, us);
+      if (us < s->hostGathered[2*w*last+w+j]) last = r;
+    }
+    for (int r=0; r<nRanks; r++) windowLate[r] += maxUs - s->hostGathered[2*w*r+w+j];
+    windowLast[last]++;
+    nValid++;
+  }
+  s->nSamples += nValid;
+  for (int r=0; r<nRanks && nValid; r++) {
+    s->lateUs[r] += windowLate[r];
+    s->lastCount[r] += windowLast[r];
+    // Last to arrive in most samples, and by a margin
+    if (2*windowLast[r] <= nValid || windowLate[r]/nValid < rcclParamStragglerThresholdUs()) continue;
+    uint64_t waitNs = stragglerRecvWaitNs(comm, r);
+    if (comm->rank == 0) {
+      WARN("Straggler: rank %d (node %d, busId %lx) arrived last in %d/%d sampled collectives, %.1f us late on average (%lu/%lu since init)",
+          r, comm->rankToNode[r], comm->peerInfo[r].busId, windowLast[r], nValid, windowLate[r]/nValid, s->lastCount[r], s->nSamples);
+    } else if (waitNs > s->recvWaitNs[r]) {
+      INFO(NCCL_ALL, "Straggler: rank %d proxy waited %.3f ms on receives from straggler rank %d since the last report",
+          comm->rank, (waitNs - s->recvWaitNs[r])/1e6, r);
+    }
+  }
+  for (int r=0; r<nRanks; r++) s->recvWaitNs[r] = stragglerRecvWaitNs(comm, r);
+  free(windowLast);
+  free(windowLate);
+}
+
+ncclResult_t ncclStragglerFree(struct ncclComm* comm) {
+  struct ncclStraggler* s = comm->straggler;
+  if (s == nullptr) return ncclSuccess;
+  if (s->exchanging && hipEventSynchronize(s->exchangeEvent) == hipSuccess) stragglerAnalyze(comm, s);
+  if (comm->rank == 0 && s->nSamples) {
+    int worst = 0;
+    for (int r=1; r<comm->nRanks; r++) if (s->lateUs[r] > s->lateUs[worst]) worst = r;
+    INFO(NCCL_INIT, "Straggler: %lu samples exchanged, latest rank on average %d (%.1f us late, last in %lu)",
+        s->nSamples, worst, s->lateUs[worst]/s->nSamples, s->lastCount[worst]);
+  }
+  CUDACHECK(hipEventDestroy(s->exchangeEvent));
+  free(s->hostSamples);
+  NCCLCHECK(ncclCudaHostFree(s->hostSend));
+  NCCLCHECK(ncclCudaFree(s->devSamples));
+  NCCLCHECK(ncclCudaHostFree(s->hostGathered));
+  free(s->lateUs);
+  free(s->lastCount);
+  free(s->recvWaitNs);
+  free(s);
+  comm->straggler = nullptr;
+  return ncclSuccess;
+}
+
+int ncclStragglerSampleSlot(struct ncclComm* comm, uint64_t* key) {
+  struct ncclStraggler* s = comm->straggler;
+  if (s == nullptr) return -1;
+  uint64_t n = s->nLaunches++;
+  if (n % stragglerInterval()) return -1;
+  *key = n;
+  return (n / stragglerInterval()) % s->window;
+}
+
+void ncclStragglerReport(struct ncclComm* comm, int slot, uint64_t key, float timeUs) {
+  struct ncclStraggler* s = comm->straggler;
+  if (s == nullptr) return;
+  s->hostSamples[slot] = (double)key;
+  s->hostSamples[s->window+slot] = timeUs;
+}
+
+ncclResult_t ncclStragglerProgress(struct ncclComm* comm, struct ncclInfo* info, hipStream_t stream) {
+  struct ncclStraggler* s = comm->straggler;
+  ncclResult_t ret = ncclSuccess;
+  int devOld = -1;
+  int w = s->window;
+  if (s->internal) return ncclSuccess;
+  // Point-to-point calls differ between ranks, collectives are issued by all of them
+  if (info->coll != ncclFuncSend && info->coll != ncclFuncRecv && ++s->nColls >= s->nextExchange) {
+    s->pending = true;
+    s->nextExchange += w*stragglerInterval();
+  }
+  if (!s->pending || ncclGroupDepth != 0) return ncclSuccess;
+  s->pending = false;
+
+  CUDACHECK(hipGetDevice(&devOld));
+  if (devOld != comm->cudaDev) CUDACHECKGOTO(hipSetDevice(comm->cudaDev), ret, exit);
+  else devOld = -1;
+
+  if (s->exchanging) {
+    // Every rank launched its exchange at the same point, a window ago
+    CUDACHECKGOTO(hipEventSynchronize(s->exchangeEvent), ret, exit);
+    stragglerAnalyze(comm, s);
+    s->exchanging = false;
+  }
+  // Samples still in flight are simply missing from this exchange
+  if (comm->tunerTimings) NCCLCHECKGOTO(ncclTunerPollTimings(comm, /*blocking=*/false), ret, exit);
+  memcpy(s->hostSend, s->hostSamples, 2*w*sizeof(double));
+  CUDACHECKGOTO(hipMemcpyAsync(s->devSamples+2*w*comm->rank, s->hostSend, 2*w*sizeof(double), hipMemcpyHostToDevice, stream), ret, exit);
+  s->internal = true;
+  ret = ncclAllGather(s->devSamples+2*w*comm->rank, s->devSamples, 2*w, ncclFloat64, comm, stream);
+  s->internal = false;
+  if (ret != ncclSuccess) goto exit;
+  CUDACHECKGOTO(hipMemcpyAsync(s->hostGathered, s->devSamples, 2*w*comm->nRanks*sizeof(double), hipMemcpyDeviceToHost, stream), ret, exit);
+  CUDACHECKGOTO(hipEventRecord(s->exchangeEvent, stream), ret, exit);
+  s->exchanging = true;
+
+exit:
+  if (devOld != -1) CUDACHECK(hipSetDevice(devOld));
+  return ret;
+}
@@ -67,16 +67,16 @@ ncclResult_t ncclCudaGraphAddDestructor(struct ncclCudaGraph graph, cudaHostFn_t
 
 ////////////////////////////////////////////////////////////////////////////////
 
-ncclResult_t ncclStrongStreamConstruct(struct ncclStrongStream* ss) {
-  CUDACHECK(cudaStreamCreateWithFlags(&ss->cudaStream, cudaStreamNonBlocking));
+ncclResult_t ncclStrongStreamConstruct(struct ncclStrongStream* ss, int priority) {
+  CUDACHECK(cudaStreamCreateWithPriority(&ss->cudaStream, cudaStreamNonBlocking, priority));
   #if ROCM_VERSION >= 60100
     CUDACHECK(cudaEventCreateWithFlags(&ss->serialEvent, cudaEventDisableTiming));
     ss->everCaptured = false;
     ss->serialEventNeedsRecord = false;
     ss->graphHead = nullptr;
-  #else
-    CUDACHECK(cudaEventCreateWithFlags(&ss->scratchEvent, cudaEventDisableTiming));
+    ss->orderedCount = 0;
   #endif
+  CUDACHECK(cudaEventCreateWithFlags(&ss->scratchEvent, cudaEventDisableTiming));
   return ncclSuccess;
 }
 
@@ -102,14 +102,34 @@ ncclResult_t ncclStrongStreamDestruct(struct ncclStrongStream* ss) {
       }
       g = next;
     }
-  #else
-    CUDACHECK(cudaEventDestroy(ss->scratchEvent));
   #endif
+  CUDACHECK(cudaEventDestroy(ss->scratchEvent));
   return ncclSuccess;
 }
 
 NCCL_PARAM(GraphMixingSupport, "GRAPH_MIXING_SUPPORT", 0)
 
+#if ROCM_VERSION >= 60100
+// Once graphs mixed with uncaptured work have recorded serialEvent, its state is
+// no longer only that of cudaStream, so no wait on it can be elided.
+static bool orderedUsable(struct ncclStrongStream* ss) {
+  return !(ss->everCaptured && ncclParamGraphMixingSupport());
+}
+
+static bool orderedHas(struct ncclStrongStream* ss, cudaStream_t stream) {
+  for (int i=0; i < ss->orderedCount; i++) {
+    if (ss->orderedStreams[i] == stream) return true;
+  }
+  return false;
+}
+
+static void orderedAdd(struct ncclStrongStream* ss, cudaStream_t stream) {
+  if (orderedHas(ss, stream)) return;
+  if (ss->orderedCount < NCCL_STRONGSTREAM_MAX_ORDERED) ss->orderedCount++;
+  ss->orderedStreams[ss->orderedCount-1] = stream;
+}
+#endif
+
 static void ensureTips(struct ncclStrongStreamGraph* g, int n) {
   if (g->tipCapacity < n) {
     g->tipNodes = (cudaGraphNode_t*)realloc(g->tipNodes, n*sizeof(cudaGraphNode_t));
@@ -126,6 +146,7 @@ ncclResult_t ncclStrongStreamAcquire(
       if (mixing && ss->everCaptured) {
         CUDACHECK(cudaStreamWaitEvent(ss->cudaStream, ss->serialEvent, 0));
         ss->serialEventNeedsRecord = false;
+        ss->orderedCount = 0;
       }
     } else {
       ss->everCaptured = true;
@@ -188,6 +209,7 @@ ncclResult_t ncclStrongStreamAcquireUncaptured(struct ncclStrongStream* ss) {
       CUDACHECK(cudaStreamWaitEvent(ss->cudaStream, ss->serialEvent, 0));
     }
     ss->serialEventNeedsRecord = true; // Assume the caller is going to add work to stream.
+    ss->orderedCount = 0;
   #endif
   return ncclSuccess;
 }
@@ -239,6 +261,7 @@ ncclResult_t ncclStrongStreamLaunchHost(
       g->tipCount = 1;
     }
     ss->serialEventNeedsRecord = true;
+    ss->orderedCount = 0;
   #else
     CUDACHECK(cudaLaunchHostFunc(ss->cudaStream, fn, arg));
   #endif
@@ -267,6 +290,7 @@ ncclResult_t ncclStrongStreamLaunchKernel(
       g->tipCount = 1;
     }
     ss->serialEventNeedsRecord = true;
+    ss->orderedCount = 0;
   #else
     CUDACHECK(cudaLaunchKernel(fn, grid, block, args, sharedMemBytes, ss->cudaStream));
   #endif
@@ -292,11 +316,18 @@ ncclResult_t ncclStrongStreamWaitStream(
   ) {
   #if ROCM_VERSION >= 60100
     if (graph.graph == nullptr) {
+      // Nothing to do if `a` already holds the work of `b`
+      if (orderedUsable(b) && orderedHas(b, a->cudaStream)) return ncclSuccess;
+      // When `b` holds the work of `a`, `a` becomes a clone of `b`
+      bool clone = orderedUsable(a) && orderedHas(a, b->cudaStream);
       if (b->serialEventNeedsRecord) {
         b->serialEventNeedsRecord = false;
         CUDACHECK(cudaEventRecord(b->serialEvent, b->cudaStream));
       }
       CUDACHECK(cudaStreamWaitEvent(a->cudaStream, b->serialEvent, 0));
+      a->orderedCount = 0;
+      if (clone) orderedAdd(a, b->cudaStream);
+      orderedAdd(b, a->cudaStream);
     } else {
       struct ncclStrongStreamGraph* ag = a->graphHead;
       NCCLCHECK(checkGraphId(ag, graph.graphId));
@@ -304,6 +335,7 @@ ncclResult_t ncclStrongStreamWaitStream(
       NCCLCHECK(checkGraphId(bg, graph.graphId));
       if (b_subsumes_a) ag->tipCount = 0;
       mergeTips(ag, bg->tipNodes, bg->tipCount);
+      a->orderedCount = 0;
     }
     a->serialEventNeedsRecord = true;
   #else
@@ -322,8 +354,17 @@ ncclResult_t ncclStrongStreamWaitStream(
       // It is ok to use a->serialEvent to record b since we'll be setting
       // a->serialEventNeedsRecord so the event won't be considered accurate
       // until re-recorded.
+      bool clone = orderedUsable(a) && orderedHas(a, b);
       CUDACHECK(cudaEventRecord(a->serialEvent, b));
       CUDACHECK(cudaStreamWaitEvent(a->cudaStream, a->serialEvent, 0));
+      a->orderedCount = 0;
+      if (clone) {
+        // `b` held the work of `a`, which is now a clone of `b` that the event
+        // just recorded stands for: streams waiting on `a` next need no record.
+        orderedAdd(a, b);
+        a->serialEventNeedsRecord = false;
+        return ncclSuccess;
+      }
     } else {
       cudaStreamCaptureStatus status;
       unsigned long long bGraphId;
@@ -338,6 +379,7 @@ ncclResult_t ncclStrongStreamWaitStream(
       NCCLCHECK(checkGraphId(ag, graph.graphId));
       if (b_subsumes_a) ag->tipCount = 0;
       mergeTips(ag, bNodes, bCount);
+      a->orderedCount = 0;
     }
     a->serialEventNeedsRecord = true;
   #else
@@ -353,11 +395,14 @@ ncclResult_t ncclStrongStreamWaitStream(
   ) {
   #if ROCM_VERSION >= 60100
     if (graph.graph == nullptr) {
+      // Nothing to do if `a` already holds the work of `b`
+      if (orderedUsable(b) && orderedHas(b, a)) return ncclSuccess;
       if (b->serialEventNeedsRecord) {
         b->serialEventNeedsRecord = false;
         CUDACHECK(cudaEventRecord(b->serialEvent, b->cudaStream));
       }
       CUDACHECK(cudaStreamWaitEvent(a, b->serialEvent, 0));
+      orderedAdd(b, a);
     } else {
       struct ncclStrongStreamGraph* bg = b->graphHead;
       NCCLCHECK(checkGraphId(bg, graph.graphId));
@@ -372,9 +417,34 @@ ncclResult_t ncclStrongStreamWaitStream(
   return ncclSuccess;
 }
 
+ncclResult_t ncclStrongStreamWaitStream(
+    struct ncclCudaGraph graph, cudaStream_t a, cudaStream_t b, struct ncclStrongStream* ss
+  ) {
+  #if ROCM_VERSION >= 60100
+    if (graph.graph != nullptr) {
+      cudaStreamCaptureStatus status;
+      unsigned long long bGraphId;
+      cudaGraphNode_t const* bNodes;
+      size_t bCount = 0;
+      CUDACHECK(hipStreamGetCaptureInfo_v2(b, &status, &bGraphId, nullptr, &bNodes, &bCount));
+      if (status != cudaStreamCaptureStatusActive || graph.graphId != bGraphId) {
+        WARN("Stream is not being captured by the expected graph.");
+        return ncclInvalidUsage;
+      }
+      CUDACHECK(hipStreamUpdateCaptureDependencies(a, const_cast<cudaGraphNode_t*>(bNodes), bCount, cudaStreamAddCaptureDependencies));
+      return ncclSuccess;
+    }
+  #endif
+  CUDACHECK(cudaEventRecord(ss->scratchEvent, b));
+  CUDACHECK(cudaStreamWaitEvent(a, ss->scratchEvent, 0));
+  return ncclSuccess;
+}
+
 ncclResult_t ncclStrongStreamSynchronize(struct ncclStrongStream* ss) {
   #if ROCM_VERSION >= 60100
-    CUDACHECK(cudaStreamWaitEvent(ss->cudaStream, ss->serialEvent, 0));
+    // Outside of mixed graphs every record of serialEvent is already waited on
+    // by cudaStream, the wait is then implied by stream order.
+    if (!orderedUsable(ss)) CUDACHECK(cudaStreamWaitEvent(ss->cudaStream, ss->serialEvent, 0));
     ss->serialEventNeedsRecord = false;
   #endif
   CUDACHECK(cudaStreamSynchronize(ss->cudaStream));
@@ -10,13 +10,55 @@
 #include <stdlib.h>
 
 #include "debug.h"
-#include "nccl_tuner.h"
+#include "comm.h"
+#include "param.h"
+#include "tuner.h"
+#include "autotune.h"
+#include "stats.h"
+#include "straggler.h"
 
 pthread_mutex_t tunerPluginLock = PTHREAD_MUTEX_INITIALIZER;
 static int tunerPluginRefCount = -1;
 static void* tunerPluginLib = nullptr;
 ncclTuner_t* tunerSymbol = nullptr;
 
+// v1 plugins are wrapped so that the rest of NCCL only deals with v2.
+static ncclTuner_v1_t* tunerSymbol_v1 = nullptr;
+
+static ncclResult_t ncclTuner_v1_as_v2_init(const ncclTunerCommInfo_v2_t* commInfo, ncclDebugLogger_t logFunction, void** context) {
+  *context = nullptr;
+  return tunerSymbol_v1->init(commInfo->nRanks, commInfo->nNodes, logFunction);
+}
+
+static ncclResult_t ncclTuner_v1_as_v2_getCollInfo(void* context, ncclFunc_t collType, size_t nBytes,
+    int numPipeOps, float** collCostTable, int numAlgo, int numProto, int* nChannels) {
+  int collNetSupport = collCostTable[NCCL_ALGO_COLLNET_DIRECT][NCCL_PROTO_SIMPLE] != NCCL_ALGO_PROTO_IGNORE ||
+                       collCostTable[NCCL_ALGO_COLLNET_CHAIN][NCCL_PROTO_SIMPLE] != NCCL_ALGO_PROTO_IGNORE;
+  int nvlsSupport = collCostTable[NCCL_ALGO_NVLS][NCCL_PROTO_SIMPLE] != NCCL_ALGO_PROTO_IGNORE ||
+                    collCostTable[NCCL_ALGO_NVLS_TREE][NCCL_PROTO_SIMPLE] != NCCL_ALGO_PROTO_IGNORE;
+  int algorithm = NCCL_ALGO_UNDEF;
+  int protocol = NCCL_PROTO_UNDEF;
+  NCCLCHECK(tunerSymbol_v1->getCollInfo(collType, nBytes, collNetSupport, nvlsSupport, numPipeOps, &algorithm, &protocol, nChannels));
+  // Force the v1 choice by making it the cheapest entry, unless it is unusable
+  if (algorithm >= 0 && algorithm < numAlgo && protocol >= 0 && protocol < numProto &&
+      collCostTable[algorithm][protocol] != NCCL_ALGO_PROTO_IGNORE) {
+    collCostTable[algorithm][protocol] = 0.0;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclTuner_v1_as_v2_destroy(void* context) {
+  return tunerSymbol_v1->destroy();
+}
+
+static ncclTuner_v2_t ncclTuner_v1_as_v2 = {
+  nullptr,
+  ncclTuner_v1_as_v2_init,
+  ncclTuner_v1_as_v2_getCollInfo,
+  nullptr,
+  ncclTuner_v1_as_v2_destroy
+};
+
 ncclResult_t ncclLoadTunerPlugin(ncclTuner_t** tuner) {
   // Initialize to nullptr by default if plugin tuner cannot be loaded.
   *tuner = nullptr;
@@ -41,6 +83,14 @@ ncclResult_t ncclLoadTunerPlugin(ncclTuner_t** tuner) {
         }
       } else {
         tunerSymbol = (ncclTuner_t*)dlsym(tunerPluginLib, NCCL_TUNER_PLUGIN_SYMBOL);
+        if (tunerSymbol == nullptr) {
+          tunerSymbol_v1 = (ncclTuner_v1_t*)dlsym(tunerPluginLib, NCCL_TUNER_PLUGIN_SYMBOL_V1);
+          if (tunerSymbol_v1 != nullptr) {
+            INFO(NCCL_TUNING, "Tuner: found " NCCL_TUNER_PLUGIN_SYMBOL_V1 " in plugin (%s), no cost table or feedback.", name);
+            ncclTuner_v1_as_v2.name = tunerSymbol_v1->name;
+            tunerSymbol = &ncclTuner_v1_as_v2;
+          }
+        }
         if (tunerSymbol == nullptr) {
           INFO(NCCL_TUNING, "Tuner: failed to find " NCCL_TUNER_PLUGIN_SYMBOL " in plugin (%s), using default tuner instead.", name);
           dlclose(tunerPluginLib);
@@ -74,9 +124,90 @@ ncclResult_t ncclCloseTunerPlugin(ncclTuner_t** tuner) {
     }
     tunerPluginLib = nullptr;
     tunerSymbol = nullptr;
+    tunerSymbol_v1 = nullptr;
     *tuner = nullptr;
     tunerPluginRefCount = -1;
   }
   pthread_mutex_unlock(&tunerPluginLock);
   return ncclSuccess;
 }
+
+// Report one out of this many eligible collectives to the plugin; 0 disables feedback
+RCCL_PARAM(TunerFeedbackInterval, "TUNER_FEEDBACK_INTERVAL", 1);
+
+static bool tunerFeedbackEnabled(struct ncclComm* comm) {
+  return comm->tuner != nullptr && comm->tuner->reportCollTime != nullptr && rcclParamTunerFeedbackInterval() > 0;
+}
+
+ncclResult_t ncclTunerTimingStart(struct ncclComm* comm, struct ncclKernelPlan* plan, cudaStream_t stream, struct ncclTunerTiming** timing) {
+  *timing = nullptr;
+  if (plan->tunerColl.collType >= NCCL_NUM_FUNCTIONS) return ncclSuccess;
+  bool report = tunerFeedbackEnabled(comm) && comm->tunerFeedbackCount++ % rcclParamTunerFeedbackInterval() == 0;
+  bool stats = ncclStatsSampleTime(comm);
+  uint64_t stragglerKey = 0;
+  int stragglerSlot = ncclStragglerSampleSlot(comm, &stragglerKey);
+  if (!report && !stats && stragglerSlot < 0 && plan->tunerAutotuneSample == 0) return ncclSuccess;
+  // Never wait for a slot, just drop the sample when too many are in flight
+  if (comm->tunerTimingsHead - comm->tunerTimingsTail == NCCL_TUNER_MAX_PENDING_TIMINGS) return ncclSuccess;
+  if (comm->tunerTimings == nullptr) {
+    NCCLCHECK(ncclCalloc(&comm->tunerTimings, NCCL_TUNER_MAX_PENDING_TIMINGS));
+    for (int i = 0; i < NCCL_TUNER_MAX_PENDING_TIMINGS; i++) {
+      CUDACHECK(hipEventCreate(&comm->tunerTimings[i].start));
+      CUDACHECK(hipEventCreate(&comm->tunerTimings[i].end));
+    }
+  }
+  struct ncclTunerTiming* t = comm->tunerTimings + (comm->tunerTimingsHead % NCCL_TUNER_MAX_PENDING_TIMINGS);
+  t->result = plan->tunerColl;
+  t->report = report;
+  t->autotuneSample = plan->tunerAutotuneSample;
+  t->stragglerSlot = stragglerSlot;
+  t->stragglerKey = stragglerKey;
+  CUDACHECK(hipEventRecord(t->start, stream));
+  *timing = t;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTunerTimingEnd(struct ncclComm* comm, struct ncclTunerTiming* timing, cudaStream_t stream) {
+  CUDACHECK(hipEventRecord(timing->end, stream));
+  comm->tunerTimingsHead++;
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTunerPollTimings(struct ncclComm* comm, bool blocking) {
+  while (comm->tunerTimingsTail != comm->tunerTimingsHead) {
+    struct ncclTunerTiming* t = comm->tunerTimings + (comm->tunerTimingsTail % NCCL_TUNER_MAX_PENDING_TIMINGS);
+    if (blocking) {
+      CUDACHECK(hipEventSynchronize(t->end));
+    } else {
+      hipError_t err = hipEventQuery(t->end);
+      if (err == hipErrorNotReady) break;
+      CUDACHECK(err);
+    }
+    float ms;
+    CUDACHECK(hipEventElapsedTime(&ms, t->start, t->end));
+    t->result.timeUs = ms * 1000.0f;
+    comm->tunerTimingsTail++;
+    TRACE(NCCL_TUNING, "Tuner feedback: coll %d %zu bytes algo %d proto %d nChannels %d took %f us",
+        t->result.collType, t->result.nBytes, t->result.algorithm, t->result.protocol, t->result.nChannels, t->result.timeUs);
+    // Every timed kernel goes to the histogram, whichever consumer asked for it
+    ncclStatsNoteKernelTime(comm, t->result.collType, t->result.nBytes, t->result.timeUs);
+    if (t->report) NCCLCHECK(comm->tuner->reportCollTime(comm->tunerContext, &t->result));
+    if (t->autotuneSample && comm->autotune) {
+      NCCLCHECK(ncclAutotuneReport(comm, t->result.collType, t->result.nBytes, t->autotuneSample-1, t->result.timeUs));
+    }
+    if (t->stragglerSlot >= 0) ncclStragglerReport(comm, t->stragglerSlot, t->stragglerKey, t->result.timeUs);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTunerTimingsFree(struct ncclComm* comm) {
+  if (comm->tunerTimings == nullptr) return ncclSuccess;
+  NCCLCHECK(ncclTunerPollTimings(comm, /*blocking=*/true));
+  for (int i = 0; i < NCCL_TUNER_MAX_PENDING_TIMINGS; i++) {
+    CUDACHECK(hipEventDestroy(comm->tunerTimings[i].start));
+    CUDACHECK(hipEventDestroy(comm->tunerTimings[i].end));
+  }
+  free(comm->tunerTimings);
+  comm->tunerTimings = nullptr;
+  return ncclSuccess;
+}
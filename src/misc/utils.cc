@@ -200,11 +200,7 @@ void* ncclMemoryStack::allocateSpilled(struct ncclMemoryStack* me, size_t size,
   // this (reachable via `->above`) are empty.
   struct Hunk* top = me->topFrame.hunk;
   size_t mallocSize = 0;
-
-  // If we have lots of space left in hunk but that wasn't enough then we'll
-  // allocate the object unhunked.
-  if (me->topFrame.end - me->topFrame.bumper >= 8<<10)
-    goto unhunked;
+  constexpr size_t maxAlign = 64;
 
   // If we have another hunk (which must be empty) waiting above this one and
   // the object fits then use that.
@@ -219,24 +215,24 @@ void* ncclMemoryStack::allocateSpilled(struct ncclMemoryStack* me, size_t size,
     }
   }
 
-  { // If the next hunk we're going to allocate wouldn't be big enough but the
-    // Unhunk proxy fits in the current hunk then go allocate as unhunked.
-    size_t nextSize = (top ? top->size : 0) + (64<<10);
-    constexpr size_t maxAlign = 64;
-    if (nextSize < sizeof(struct Hunk) + maxAlign + size) {
-      uintptr_t uproxy = (me->topFrame.bumper + alignof(Unhunk)-1) & -uintptr_t(alignof(Unhunk));
-      if (uproxy + sizeof(struct Unhunk) <= me->topFrame.end)
-        goto unhunked;
-    }
+  // Very large objects are allocated out-of-band so that their memory is given
+  // back on pop. Anything else gets a new hunk big enough to hold it, which is
+  // kept and reused by later frames: once warmed up, the stack does not malloc.
+  if (size >= ncclMemoryStackMaxHunkObject) {
+    uintptr_t uproxy = (me->topFrame.bumper + alignof(Unhunk)-1) & -uintptr_t(alignof(Unhunk));
+    if (uproxy + sizeof(struct Unhunk) <= me->topFrame.end)
+      goto unhunked;
+  }
 
-    // At this point we must need another hunk, either to fit the object
-    // itself or its Unhunk proxy.
+  { // Insert a new hunk right above the top one.
+    size_t nextSize = std::max((top ? top->size : 0) + (64<<10), sizeof(struct Hunk) + maxAlign + size);
     mallocSize = nextSize;
     INFO(NCCL_ALLOC, "%s:%d memory stack hunk malloc(%llu)", __FILE__, __LINE__, (unsigned long long)mallocSize);
     struct Hunk *top1 = (struct Hunk*)malloc(mallocSize);
     if (top1 == nullptr) goto malloc_exhausted;
+    me->nMallocs++;
     top1->size = nextSize;
-    top1->above = nullptr;
+    top1->above = top ? top->above : nullptr;
     if (top) top->above = top1;
     top = top1;
     me->topFrame.hunk = top;
@@ -244,12 +240,10 @@ void* ncclMemoryStack::allocateSpilled(struct ncclMemoryStack* me, size_t size,
     me->topFrame.bumper = reinterpret_cast<uintptr_t>(top) + sizeof(struct Hunk);
   }
 
-  { // Try to fit object in the new top hunk.
+  { // Fit object in the new top hunk.
     uintptr_t uobj = (me->topFrame.bumper + align-1) & -uintptr_t(align);
-    if (uobj + size <= me->topFrame.end) {
-      me->topFrame.bumper = uobj + size;
-      return reinterpret_cast<void*>(uobj);
-    }
+    me->topFrame.bumper = uobj + size;
+    return reinterpret_cast<void*>(uobj);
   }
 
 unhunked:
@@ -264,6 +258,7 @@ unhunked:
     proxy->obj = malloc(mallocSize);
     INFO(NCCL_ALLOC, "%s:%d memory stack non-hunk malloc(%llu)", __FILE__, __LINE__, (unsigned long long)mallocSize);
     if (proxy->obj == nullptr) goto malloc_exhausted;
+    me->nMallocs++;
     return proxy->obj;
   }
 
@@ -350,6 +345,12 @@ const char* ncclAlgoToString(int algo) {
       return "NVLS";
     case NCCL_ALGO_NVLS_TREE:
       return "NVLS_TREE";
+    case NCCL_ALGO_DIRECT:
+      return "DIRECT";
+    case NCCL_ALGO_RHD:
+      return "RHD";
+    case NCCL_ALGO_BRUCK:
+      return "BRUCK";
     default:
       return "Unknown";
   }
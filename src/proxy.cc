@@ -12,10 +12,16 @@
 #include "socket.h"
 #include "shm.h"
 #include "profiler.h"
+#include "stats.h"
+#include "cpuset.h"
+#include "graph/topo.h"
+#include "ipccache.h"
+#include "nccl_proxy_backend.h"
 #define ENABLE_TIMER 0
 #include "timer.h"
 
 #include <sys/syscall.h>
+#include <dlfcn.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/time.h>
@@ -194,8 +200,13 @@ static ncclResult_t allocateArgs(struct ncclProxyProgressState* state, struct nc
   if (state->pool == NULL) {
     // Allocate a new pool of elements. Make sure we allocate the memory close
     // to the network thread
+    // Elements are cache line aligned, which calloc does not guarantee.
     struct ncclProxyPool* newPool;
-    NCCLCHECK(ncclCalloc(&newPool, 1));
+    if (posix_memalign((void**)&newPool, alignof(struct ncclProxyPool), sizeof(struct ncclProxyPool)) != 0) {
+      WARN("Failed to allocate %zu bytes for proxy args", sizeof(struct ncclProxyPool));
+      return ncclSystemError;
+    }
+    memset(newPool, 0, sizeof(struct ncclProxyPool));
 
     struct ncclProxyArgs* newElems = newPool->elems;
     // Chain newly allocated elements
@@ -433,19 +444,58 @@ static ncclResult_t ProxyAppend(struct ncclProxyProgressState* state, struct ncc
   return ncclSuccess;
 }
 
-ncclResult_t ncclProxyPost(struct ncclProxyOpsPool* pool, int nextOps, int nextOpsEnd) {
-  pthread_mutex_lock(&pool->mutex);
-  if (pool->nextOps == -1) {
-    pool->nextOps = nextOps;
-    pthread_cond_signal(&pool->cond);
-  } else {
-    pool->ops[pool->nextOpsEnd].next = nextOps;
+// Posted ops form one lock-free multi-producer/single-consumer list per
+// progress thread. Producers swap their chain end into queue->nextOpsEnd and
+// then link the chain after the previous tail, or publish it as queue->nextOps
+// if the list was empty. The mutex/cond pair is only used to wake up a sleeping
+// progress thread.
+ncclResult_t ncclProxyPost(struct ncclProxyOpsPool* pool, int q, int nextOps, int nextOpsEnd) {
+  struct ncclProxyPostQueue* queue = pool->queues+q;
+  int prev = __atomic_exchange_n(&queue->nextOpsEnd, nextOpsEnd, __ATOMIC_SEQ_CST);
+  if (prev != -1) {
+    __atomic_store_n(&pool->ops[prev].next, nextOps, __ATOMIC_RELEASE);
+    return ncclSuccess;
+  }
+  __atomic_store_n(&queue->nextOps, nextOps, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&queue->sleeping, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&queue->mutex);
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
   }
-  pool->nextOpsEnd = nextOpsEnd;
-  pthread_mutex_unlock(&pool->mutex);
   return ncclSuccess;
 }
 
+// Return the op posted after opIndex, or -1 if opIndex was the tail and the
+// list is now empty. Only called by the progress thread owning the queue.
+static int ncclProxyPostedNext(struct ncclProxyOpsPool* pool, struct ncclProxyPostQueue* queue, int opIndex) {
+  int next = __atomic_load_n(&pool->ops[opIndex].next, __ATOMIC_ACQUIRE);
+  if (next != -1) return next;
+  int tail = opIndex;
+  if (__atomic_compare_exchange_n(&queue->nextOpsEnd, &tail, -1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return -1;
+  // A producer swapped the tail but did not link its chain yet
+  while ((next = __atomic_load_n(&pool->ops[opIndex].next, __ATOMIC_ACQUIRE)) == -1) sched_yield();
+  return next;
+}
+
+// Select the progress thread for an op. Ops are sharded by channel so that all
+// ops of a connection are progressed by the same thread. CollNet and NVLS
+// share network resources across channels and always go to the first thread.
+static int ncclProxyOpQueue(struct ncclProxyOpsPool* pool, struct ncclProxyOp* op) {
+  if (pool->nQueues == 1) return 0;
+  switch (op->pattern) {
+  case ncclPatternCollnetChain:
+  case ncclPatternCollnetDirect:
+  case ncclPatternNvls:
+  case ncclPatternNvlsTree:
+    return 0;
+  default:
+    return op->channelId % pool->nQueues;
+  }
+}
+
+// Record the time ops wait in the post queue and report it when progress threads exit
+RCCL_PARAM(ProxyAppendStats, "PROXY_APPEND_STATS", 0);
+
 static ncclResult_t ncclLocalOpAppend(struct ncclComm* comm, struct ncclProxyConnector* proxyConn, struct ncclProxyOp* proxyOp) {
   int tpLocalRank = comm->topParentLocalRanks[comm->localRank];
   struct ncclProxyOps* proxyOps = comm->proxyState->proxyOps;
@@ -472,37 +522,45 @@ static ncclResult_t ncclLocalOpAppend(struct ncclComm* comm, struct ncclProxyCon
   memcpy(op, proxyOp, sizeof(struct ncclProxyOp));
   op->next = -1;
   op->connection = proxyConn->connection;
-  if (proxyOps->nextOps == -1) {
-    proxyOps->nextOps = proxyOps->nextOpsEnd = opIndex;
+  if (ncclParamProxyAppendStats()) op->postTime = clockNano();
+  int q = ncclProxyOpQueue(pool, op);
+  if (proxyOps->nextOps[q] == -1) {
+    proxyOps->nextOps[q] = proxyOps->nextOpsEnd[q] = opIndex;
   } else {
-    pool->ops[proxyOps->nextOpsEnd].next = opIndex;
-    proxyOps->nextOpsEnd = opIndex;
+    pool->ops[proxyOps->nextOpsEnd[q]].next = opIndex;
+    proxyOps->nextOpsEnd[q] = opIndex;
   }
   if (++proxyOps->count == MAX_OPS_PER_PEER) {
     // Post what we have so far to free some ops in the pool
     // Do not post last operations as we could have more coming with the same opCount, and posting
     // them in different batches would break proxyArgs aggregation with subs.
-    uint64_t lastOpCount = pool->ops[proxyOps->nextOpsEnd].opCount;
-    int lastOp = -1;
-    int toSend = 0;
-    int ops = 0;
-    for (int op= proxyOps->nextOps; op != proxyOps->nextOpsEnd; op=pool->ops[op].next) {
-      ops++;
-      if (pool->ops[op].opCount != lastOpCount) {
-        lastOp = op;
-        toSend = ops;
+    int posted = 0;
+    for (int q = 0; q < pool->nQueues; q++) {
+      if (proxyOps->nextOps[q] == -1) continue;
+      uint64_t lastOpCount = pool->ops[proxyOps->nextOpsEnd[q]].opCount;
+      int lastOp = -1;
+      int toSend = 0;
+      int ops = 0;
+      for (int op= proxyOps->nextOps[q]; op != proxyOps->nextOpsEnd[q]; op=pool->ops[op].next) {
+        ops++;
+        if (pool->ops[op].opCount != lastOpCount) {
+          lastOp = op;
+          toSend = ops;
+        }
       }
+      if (lastOp == -1) continue;
+      // Cut chain at lastOp
+      int nextOps = proxyOps->nextOps[q];
+      proxyOps->nextOps[q] = pool->ops[lastOp].next;
+      pool->ops[lastOp].next = -1;
+      NCCLCHECK(ncclProxyPost(proxyOps->pool, q, nextOps, lastOp));
+      proxyOps->count -= toSend;
+      posted += toSend;
     }
-    if (lastOp == -1) {
-      WARN("Unable to post incomplete proxy op chain %d..%d (opCount %ld)", proxyOps->nextOps, proxyOps->nextOpsEnd, lastOpCount);
+    if (posted == 0) {
+      WARN("Unable to post incomplete proxy op chain (%d ops)", proxyOps->count);
       return ncclInternalError;
     }
-    // Cut chain at lastOp
-    int nextOps = proxyOps->nextOps;
-    proxyOps->nextOps = pool->ops[lastOp].next;
-    pool->ops[lastOp].next = -1;
-    NCCLCHECK(ncclProxyPost(proxyOps->pool, nextOps, lastOp));
-    proxyOps->count -= toSend;
   }
   TIME_STOP(0);
   return ncclSuccess;
@@ -551,22 +609,28 @@ ncclResult_t ncclProxySaveOp(struct ncclComm* comm, struct ncclProxyOp* op, bool
       }
     } break;
   case ncclPatternTreeUp:
-  case ncclPatternTreeDown:
+  case ncclPatternTreeDown: {
+      // Reduce (up) and Broadcast (down) on the tree hanging from op->root
+      int others[NCCL_MAX_TREE_PEERS];
+      int toRoot = ncclTreeRootedPeers(comm->treeUps + op->channelId*comm->nRanks, &channel->tree, comm->rank, op->root, others);
+      int toRootType = op->pattern == ncclPatternTreeUp ? proxySend : proxyRecv;
+      NCCLCHECK(SaveProxy(comm, channel, toRootType, toRoot, op, 0, justInquire));
+      for (int i=0; i<NCCL_MAX_TREE_PEERS && others[i] != -1; i++) {
+        NCCLCHECK(SaveProxy(comm, channel, 1-toRootType, others[i], op, 0, justInquire));
+      }
+    } break;
   case ncclPatternTreeUpDown: {
-      if (op->pattern != ncclPatternTreeDown) { // Tree up
-        struct ncclTree* tree = &channel->tree;
-        for (int i=0; i<NCCL_MAX_TREE_ARITY; i++) {
-          NCCLCHECK(SaveProxy(comm, channel, proxyRecv, tree->down[i], op, 0, justInquire));
-        }
-        NCCLCHECK(SaveProxy(comm, channel, proxySend, tree->up, op, 0, justInquire));
+      struct ncclTree* tree = &channel->tree;
+      // Tree up
+      for (int i=0; i<NCCL_MAX_TREE_ARITY; i++) {
+        NCCLCHECK(SaveProxy(comm, channel, proxyRecv, tree->down[i], op, 0, justInquire));
       }
-      if (op->pattern != ncclPatternTreeUp) { // Tree down
-        struct ncclTree* tree = &channel->tree;
-        for (int i=0; i< NCCL_MAX_TREE_ARITY; i++) {
-          NCCLCHECK(SaveProxy(comm, channel, proxySend, tree->down[i], op, 0, justInquire));
-        }
-        NCCLCHECK(SaveProxy(comm, channel, proxyRecv, tree->up, op, 0, justInquire));
+      NCCLCHECK(SaveProxy(comm, channel, proxySend, tree->up, op, 0, justInquire));
+      // Tree down
+      for (int i=0; i< NCCL_MAX_TREE_ARITY; i++) {
+        NCCLCHECK(SaveProxy(comm, channel, proxySend, tree->down[i], op, 0, justInquire));
       }
+      NCCLCHECK(SaveProxy(comm, channel, proxyRecv, tree->up, op, 0, justInquire));
     } break;
   case ncclPatternCollnetChain: {
       NCCLCHECK(SaveProxy(comm, channel, proxySend, channel->collnetChain.up, op, 1, justInquire));
@@ -593,6 +657,13 @@ ncclResult_t ncclProxySaveOp(struct ncclComm* comm, struct ncclProxyOp* op, bool
       if (op->root == comm->rank) return ncclSuccess;
       NCCLCHECK(SaveProxy(comm, channel, op->pattern == ncclPatternSend ? proxySend : proxyRecv, op->root, op, op->connIndex, justInquire));
     } break;
+  case ncclPatternDirect: {
+      for (int peer=0; peer<comm->nRanks; peer++) {
+        if (peer == comm->rank) continue;
+        NCCLCHECK(SaveProxy(comm, channel, proxyRecv, peer, op, op->connIndex, justInquire));
+        NCCLCHECK(SaveProxy(comm, channel, proxySend, peer, op, op->connIndex, justInquire));
+      }
+    } break;
   }
   return ncclSuccess;
 }
@@ -693,6 +764,7 @@ static ncclResult_t removeOp(struct ncclProxyProgressState* state, struct ncclPr
 static ncclResult_t progressOps(struct ncclProxyState* proxyState, struct ncclProxyProgressState* state, struct ncclProxyArgs* opStart, int* idle) {
   struct ncclProxyArgs* prevOp = NULL;
   struct ncclProxyArgs* op = opStart;
+  int nActive = 0;
   while (op) {
     if (op->state == ncclProxyOpNone) return ncclInternalError;
     TIME_START(0); TIME_START(1);
@@ -706,42 +778,56 @@ static ncclResult_t progressOps(struct ncclProxyState* proxyState, struct ncclPr
     } else {
       prevOp = op;
       op = op->next;
+      nActive++;
     }
   }
+  state->nActive = nActive;
   return ncclSuccess;
 }
 
 NCCL_PARAM(ProxyAppendBatchSize, "PROXY_APPEND_BATCH_SIZE", 16);
+// Let the append batch grow up to RCCL_PROXY_APPEND_BATCH_MAX while ops are
+// left in the post queue, and append on every pass while few ops are active.
+RCCL_PARAM(ProxyAppendAdaptive, "PROXY_APPEND_ADAPTIVE", 1);
+RCCL_PARAM(ProxyAppendBatchMax, "PROXY_APPEND_BATCH_MAX", 256);
+RCCL_PARAM(ProxyAppendEagerOps, "PROXY_APPEND_EAGER_OPS", 4);
 
-static ncclResult_t ncclProxyGetPostedOps(struct ncclProxyState* proxyState, int* added) {
-  struct ncclProxyProgressState* state = &proxyState->progressState;
+static ncclResult_t ncclProxyGetPostedOps(struct ncclProxyState* proxyState, struct ncclProxyProgressState* state, int* added) {
   if (state->opsPool == NULL) return ncclInternalError;
   struct ncclProxyOpsPool* pool = state->opsPool;
+  struct ncclProxyPostQueue* queue = state->queue;
 
   struct ncclProxyArgs profArgs; // Only used for profiling purposes
   if (state->nextOps != -1) goto process_nextops;
 
-  // If we have ops to progress, no need to block waiting for something to arrive or even wait for the lock
-  // to be available. Exit, continue progress, and come back later.
-  if (state->active != NULL && (pool->nextOps == -1 || pthread_mutex_trylock(&pool->mutex) != 0)) return ncclSuccess;
+  // If we have ops to progress, no need to block waiting for something to arrive.
+  // Exit, continue progress, and come back later.
+  if (state->active != NULL && __atomic_load_n(&queue->nextOps, __ATOMIC_ACQUIRE) == -1) return ncclSuccess;
 
-  if (state->active == NULL) {
-    pthread_mutex_lock(&pool->mutex);
-    while (pool->nextOps == -1 && !state->stop) {
+  // In busy-poll mode never block either, the progress loop will simply call us again.
+  if (state->progressMode == ncclProxyProgressBusyPoll && __atomic_load_n(&queue->nextOps, __ATOMIC_ACQUIRE) == -1) return ncclSuccess;
+
+  if (state->active == NULL && __atomic_load_n(&queue->nextOps, __ATOMIC_ACQUIRE) == -1) {
+    uint64_t t0 = state->timed ? clockNano() : 0;
+    pthread_mutex_lock(&queue->mutex);
+    __atomic_store_n(&queue->sleeping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&queue->nextOps, __ATOMIC_SEQ_CST) == -1 && !state->stop &&
+           __atomic_load_n(proxyState->abortFlag, __ATOMIC_RELAXED) == 0) {
       struct ncclProxyArgs profArgs; // Only used for profiling purposes
       ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileSleep);
-      pthread_cond_wait(&pool->cond, &pool->mutex);
+      pthread_cond_wait(&queue->cond, &queue->mutex);
       ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileWakeup);
     }
-    if (state->stop) { // We might have been woken up to stop.
-      pthread_mutex_unlock(&pool->mutex);
-      return ncclSuccess;
-    }
+    __atomic_store_n(&queue->sleeping, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->mutex);
+    if (t0) state->sleepNs += clockNano() - t0;
+    if (state->stop) return ncclSuccess; // We might have been woken up to stop.
   }
 
-  state->nextOps = pool->nextOps;
-  pool->nextOps = pool->nextOpsEnd = -1;
-  pthread_mutex_unlock(&pool->mutex);
+  // Take ownership of the list head. Producers only write it again once we
+  // have consumed the tail, see ncclProxyPostedNext().
+  state->nextOps = __atomic_load_n(&queue->nextOps, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&queue->nextOps, -1, __ATOMIC_SEQ_CST);
   if (state->nextOps == -1) return ncclInternalError;
 
 process_nextops:
@@ -754,19 +840,26 @@ process_nextops:
   uint64_t lastOpCount = 0;
   int lastPeer = -1;
   int count = 0;
+  uint64_t now = ncclParamProxyAppendStats() ? clockNano() : 0;
   for (int opIndex = state->nextOps; opIndex != -1;) {
     struct ncclProxyOp* peerOp = pool->ops+opIndex;
     int peer = opIndex / MAX_OPS_PER_PEER;
     if ((lastOpCount && peerOp->opCount != lastOpCount) || ((lastPeer != -1) && peer != lastPeer)) count++;
-    if (count == ncclParamProxyAppendBatchSize()+1) break;
+    if (count == state->appendBatch+1) break;
     lastOpCount = peerOp->opCount;
     lastPeer = peer;
     if (peerOp->connection == NULL) return ncclInternalError;
     if (peerOp->next != -1) __builtin_prefetch(pool->ops+peerOp->next);
+    if (now) {
+      uint64_t waitUs = now > peerOp->postTime ? (now - peerOp->postTime)/1000 : 0;
+      int b = 0;
+      while (waitUs && b < NCCL_PROXY_APPEND_WAIT_BUCKETS-1) { waitUs >>= 1; b++; }
+      state->appendWaitHist[b]++;
+    }
     NCCLCHECK(ProxyAppend(state, peerOp));
     (*added)++;
     int lastOpIndex = opIndex;
-    opIndex = peerOp->next;
+    opIndex = ncclProxyPostedNext(pool, queue, opIndex);
     // Return op to peer pool
     if (freeOp[peer] == -1) {
       freeOpEnd[peer] = lastOpIndex;
@@ -776,24 +869,28 @@ process_nextops:
     freeOp[peer] = lastOpIndex;
     state->nextOps = opIndex;
   }
+  if (ncclParamProxyAppendAdaptive()) {
+    // Ops left behind: take twice as many next time. Drained with room to spare: shrink back.
+    int base = ncclParamProxyAppendBatchSize();
+    if (state->nextOps != -1) {
+      state->appendBatch = std::min<int>(state->appendBatch*2, std::max<int>(base, ncclParamProxyAppendBatchMax()));
+    } else if (count < state->appendBatch/4) {
+      state->appendBatch = std::max(base, state->appendBatch/2);
+    }
+    state->appendBatchMax = std::max(state->appendBatchMax, state->appendBatch);
+  }
 
   for (int i = 0; i < proxyState->tpLocalnRanks; i++) {
     if (freeOp[i] == -1) continue;
     int newFree = freeOp[i];
+    // The main thread may recycle free ops at any time and other progress threads may return
+    // ops to the same list, so push the chain atomically.
     int oldFree = pool->freeOps[i];
-    pool->ops[freeOpEnd[i]].next = oldFree;
-    if (oldFree == -1) {
-      // Nothing for the main thread to consume, we can set it.
-      pool->freeOps[i] = newFree;
-    } else {
-      // The main thread may recycle free ops at any time, replace the freeOps value atomically and check it worked.
+    while (1) {
+      pool->ops[freeOpEnd[i]].next = oldFree;
       int swap = __sync_val_compare_and_swap(pool->freeOps+i, oldFree, newFree);
-      if (swap != oldFree) {
-        if (swap != -1) return ncclInternalError;
-        // Ops were recycled while we were trying to swap, just set the value directly now.
-        pool->ops[freeOpEnd[i]].next = -1;
-        pool->freeOps[i] = newFree;
-      }
+      if (swap == oldFree) break;
+      oldFree = swap;
     }
   }
   profArgs.opCount = *added;
@@ -802,6 +899,31 @@ process_nextops:
   return ncclSuccess;
 }
 
+#define PROXY_DUMP_CHANNEL_MAX_OPS 32
+void ncclProxyDumpChannel(struct ncclProxyState* proxyState, int channelId) {
+  int nOps = 0;
+  for (int t = 0; t < proxyState->nProgressThreads; t++) {
+    struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+    if (state == NULL) continue;
+    for (struct ncclProxyArgs* op = state->active; op; op = op->next) {
+      for (struct ncclProxyArgs* peerOp = op; peerOp; peerOp = peerOp->nextPeer) {
+        for (int s = 0; s < peerOp->nsubs; s++) {
+          struct ncclProxySubArgs* sub = peerOp->subs+s;
+          if (sub->channelId != channelId) continue;
+          if (nOps++ == PROXY_DUMP_CHANNEL_MAX_OPS) {
+            WARN("Proxy channel %d: more active ops not shown", channelId);
+            return;
+          }
+          WARN("Proxy channel %d: opCount %lx %s peer %d steps %d posted %lu received %lu transmitted %lu done %lu",
+              channelId, peerOp->opCount, peerOp->pattern == ncclPatternSend ? "Send" : peerOp->pattern == ncclPatternRecv ? "Recv" : "Coll",
+              sub->peer, sub->nsteps, sub->posted, sub->received, sub->transmitted, sub->done);
+        }
+      }
+    }
+  }
+  if (nOps == 0) WARN("Proxy channel %d: no active ops", channelId);
+}
+
 #include <signal.h>
 static ncclProxyProgressState* ncclLastProxyState;
 void ncclDumpProxyState(int signal) {
@@ -844,72 +966,344 @@ static int setProxyThreadContext(struct ncclProxyState* proxyState) {
 // Set to SIGUSR1 or SIGUSR2 to help debug proxy state during hangs
 NCCL_PARAM(ProxyDumpSignal, "PROXY_DUMP_SIGNAL", -1);
 NCCL_PARAM(ProgressAppendOpFreq, "PROGRESS_APPENDOP_FREQ", 8);
+RCCL_PARAM(ProxyProgressMode, "PROXY_PROGRESS_MODE", ncclProxyProgressYield);
+RCCL_PARAM(ProxyBackoffSpins, "PROXY_BACKOFF_SPINS", 64);
+RCCL_PARAM(ProxyBackoffMaxUs, "PROXY_BACKOFF_MAX_US", 128);
+
+// Called when an iteration of the progress loop found nothing to do. Depending on the
+// progress mode we spin, yield, or sleep for an exponentially growing amount of time.
+static void proxyProgressIdleWait(struct ncclProxyProgressState* state, int* idleSpins, uint64_t* backoffNs) {
+  switch (state->progressMode) {
+  case ncclProxyProgressBusyPoll:
+    return;
+  case ncclProxyProgressBackoff:
+    if (++(*idleSpins) <= ncclParamProxyBackoffSpins()) {
+      sched_yield();
+    } else {
+      struct timespec ts = { 0, (long)*backoffNs };
+      nanosleep(&ts, NULL);
+      if (state->timed) state->sleepNs += *backoffNs;
+      *backoffNs = std::min<uint64_t>(*backoffNs*2, ncclParamProxyBackoffMaxUs()*1000);
+    }
+    return;
+  default:
+    sched_yield(); // No request progressed. Let others run.
+    return;
+  }
+}
 
-void* ncclProxyProgress(void *proxyState_) {
-  struct ncclProxyState* proxyState = (struct ncclProxyState*)proxyState_;
-  if (setProxyThreadContext(proxyState)) {
-    INFO(NCCL_INIT, "[Proxy Progress] Created CUDA context on device %d", proxyState->cudaDev);
-  } else if (cudaSetDevice(proxyState->cudaDev) != cudaSuccess) {
-    WARN("[Proxy Progress] Failed to set CUDA device %d", proxyState->cudaDev);
+RCCL_PARAM(ProxyProgressPin, "PROXY_PROGRESS_PIN", 1);
+RCCL_PARAM(ProxyNicAffinity, "PROXY_NIC_AFFINITY", 1);
+
+// With several progress threads, pin each of them to a different core close to the GPU
+// (and therefore to the NICs it uses) so that they do not compete with each other.
+// A single thread is only moved when it should follow the NIC rather than the GPU.
+static void proxyProgressSetAffinity(struct ncclProxyState* proxyState, struct ncclProxyProgressState* state) {
+  if (ncclParamProxyProgressPin() == 0) return;
+  int nCpus = CPU_COUNT(&proxyState->cpuAffinity);
+  if (nCpus == 0) return;
+  if (proxyState->nProgressThreads == 1) {
+    if (proxyState->netAffinity && sched_setaffinity(0, sizeof(cpu_set_t), &proxyState->cpuAffinity) == 0) {
+      char affinityStr[sizeof(cpu_set_t)*2];
+      if (ncclCpusetToStr(&proxyState->cpuAffinity, affinityStr) == ncclSuccess) {
+        INFO(NCCL_PROXY, "[Proxy Progress] dev %d pinned to NIC CPUs %s", proxyState->cudaDev, affinityStr);
+      }
+    }
+    return;
+  }
+  int target = state->shard % nCpus;
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (!CPU_ISSET(c, &proxyState->cpuAffinity)) continue;
+    if (target-- == 0) {
+      cpu_set_t mask;
+      CPU_ZERO(&mask);
+      CPU_SET(c, &mask);
+      if (sched_setaffinity(0, sizeof(cpu_set_t), &mask) == 0) {
+        INFO(NCCL_PROXY, "[Proxy Progress] dev %d thread %d pinned to CPU %d", proxyState->cudaDev, state->shard, c);
+      }
+      return;
+    }
   }
-  // if (CPU_COUNT(&comm->cpuAffinity)) sched_setaffinity(0, sizeof(cpu_set_t), &comm->cpuAffinity);
+}
 
-  struct ncclProxyProgressState* state = &proxyState->progressState;
+// Progress state set up by the thread about to drive it
+static void proxyProgressStateInit(struct ncclProxyProgressState* state) {
+  struct ncclProxyState* proxyState = state->proxyState;
   state->nextOps = -1;
-  const int sig = ncclParamProxyDumpSignal();
-  if (sig != -1) signal(sig, ncclDumpProxyState);
-  ncclLastProxyState = state;
-  char threadName[NCCL_THREAD_NAMELEN];
-  snprintf(threadName, NCCL_THREAD_NAMELEN, "NCCL Progress%2d", proxyState->cudaDev);
-  nvtxNameOsThreadA(syscall(SYS_gettid), threadName);
+  state->progressMode = ncclParamProxyProgressMode();
+  if (state->progressMode < 0 || state->progressMode >= ncclProxyProgressNumModes) {
+    WARN("[Proxy Progress] Invalid RCCL_PROXY_PROGRESS_MODE=%d, using %d", state->progressMode, ncclProxyProgressYield);
+    state->progressMode = ncclProxyProgressYield;
+  }
+  // Latency critical ops should not wait for the thread to be rescheduled
+  if (proxyState->highPriority) state->progressMode = ncclProxyProgressBusyPoll;
+  state->timed = rcclParamStatsProxyTime() != 0;
+  state->activeNs = state->idleNs = state->sleepNs = 0;
+  state->appendBatch = state->appendBatchMax = std::max<int>(ncclParamProxyAppendBatchSize(), 1);
+  memset(state->appendWaitHist, 0, sizeof(state->appendWaitHist));
+  state->appendCounter = 0;
+  state->lastIdle = 0;
+}
+
+static bool proxyProgressRunning(struct ncclProxyProgressState* state) {
+  return (state->stop == 0 || (state->stop == 1 && state->active)) && *state->proxyState->abortFlag == 0;
+}
 
-  int lastIdle = 0;
+// One pass of the progress loop: progress the active ops, then append posted ones.
+// busy tells whether anything progressed, wait whether the caller should back
+// off because the append found nothing.
+static void proxyProgressPass(struct ncclProxyProgressState* state, int* busy, int* wait) {
+  struct ncclProxyState* proxyState = state->proxyState;
+  struct ncclProxyArgs profArgs; // Only used for profiling purposes
+  int idle = 1;
+  *busy = 0;
+  *wait = 0;
+  ncclResult_t ret = progressOps(proxyState, state, state->active, &idle);
+  if (ret != ncclSuccess) {
+    __atomic_store_n(&proxyState->asyncResult, ret, __ATOMIC_RELEASE);
+    INFO(NCCL_ALL,"%s:%d -> %d [Progress Thread]", __FILE__, __LINE__, ret);
+    return;
+  }
+  if (state->lastIdle == 0 && idle == 1) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileIdle);
+  if (state->lastIdle == 1 && idle == 0) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileActive);
+  state->lastIdle = idle;
+  *busy = !idle;
   /* Too frequent call of ncclProxyGetPostedOps() will result in perf regression for small message
-   * communication. proxyOpAppendCounter is a counter that helps us decide if we need to append proxy ops.
-   * After each progress, proxyOpAppendCounter will increase by 1 and compare with environment variable
+   * communication. appendCounter is a counter that helps us decide if we need to append proxy ops.
+   * After each progress, appendCounter will increase by 1 and compare with environment variable
    * ncclParamProgressAppendOpFreq(). If they are equal, we will append proxy ops. This will decrease the
    * frequency of calling ncclProxyGetPostedOps() and reduce the perf impact. */
-  int proxyOpAppendCounter = 0;
-  struct ncclProxyArgs profArgs; // Only used for profiling purposes
-  while ((state->stop == 0 || (state->stop == 1 && state->active)) && *proxyState->abortFlag == 0) {
-    int idle = 1;
-    ncclResult_t ret = progressOps(proxyState, state, state->active, &idle);
+  // Adaptive: don't make posted ops wait while only a few ops are active or a backlog is left
+  bool eager = ncclParamProxyAppendAdaptive() && (state->nActive <= ncclParamProxyAppendEagerOps() || state->nextOps != -1);
+  if (idle || eager || (++state->appendCounter >= ncclParamProgressAppendOpFreq())) {
+    int added = 0;
+    state->appendCounter = 0;
+    TIME_START(3);
+    if (state->stop == 0)
+      ret = ncclProxyGetPostedOps(proxyState, state, &added);
+    if (added) { TIME_STOP(3); } else { TIME_CANCEL(3); }
     if (ret != ncclSuccess) {
       __atomic_store_n(&proxyState->asyncResult, ret, __ATOMIC_RELEASE);
       INFO(NCCL_ALL,"%s:%d -> %d [Progress Thread]", __FILE__, __LINE__, ret);
-      continue;
-    }
-    if (lastIdle == 0 && idle == 1) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileIdle);
-    if (lastIdle == 1 && idle == 0) ncclProfilingRecord(&profArgs, 0, 0, ncclProxyProfileActive);
-    if (idle || (++proxyOpAppendCounter == ncclParamProgressAppendOpFreq())) {
-      int added = 0;
-      proxyOpAppendCounter = 0;
-      TIME_START(3);
-      if (state->stop == 0)
-        ret = ncclProxyGetPostedOps(proxyState, &added);
-      if (added) { TIME_STOP(3); } else { TIME_CANCEL(3); }
-      if (ret != ncclSuccess) {
-        __atomic_store_n(&proxyState->asyncResult, ret, __ATOMIC_RELEASE);
-        INFO(NCCL_ALL,"%s:%d -> %d [Progress Thread]", __FILE__, __LINE__, ret);
+    }
+    if (added == 0) {
+      *wait = 1;
+    } else {
+      *busy = 1;
+    }
+  }
+  if (*busy) state->progressCount++;
+}
+
+static void proxyProgressReport(struct ncclProxyProgressState* state) {
+  struct ncclProxyState* proxyState = state->proxyState;
+  if (ncclParamProxyAppendStats()) {
+    char line[512];
+    int len = 0;
+    for (int b = 0; b < NCCL_PROXY_APPEND_WAIT_BUCKETS; b++) {
+      if (state->appendWaitHist[b] == 0) continue;
+      len += snprintf(line+len, sizeof(line)-len, " %s%dus:%lu", b == NCCL_PROXY_APPEND_WAIT_BUCKETS-1 ? ">=" : "<",
+          b == NCCL_PROXY_APPEND_WAIT_BUCKETS-1 ? 1 << (b-1) : 1 << b, state->appendWaitHist[b]);
+      if (len >= (int)sizeof(line)) break;
+    }
+    INFO(NCCL_PROXY, "[Proxy Progress] dev %d thread %d append wait%s, max batch %d",
+        proxyState->cudaDev, state->shard, len ? line : " none", state->appendBatchMax);
+  }
+}
+
+void* ncclProxyProgress(void *state_) {
+  struct ncclProxyProgressState* state = (struct ncclProxyProgressState*)state_;
+  struct ncclProxyState* proxyState = state->proxyState;
+  if (setProxyThreadContext(proxyState)) {
+    INFO(NCCL_INIT, "[Proxy Progress] Created CUDA context on device %d", proxyState->cudaDev);
+  } else if (cudaSetDevice(proxyState->cudaDev) != cudaSuccess) {
+    WARN("[Proxy Progress] Failed to set CUDA device %d", proxyState->cudaDev);
+  }
+  proxyProgressSetAffinity(proxyState, state);
+
+  if (state->shard == 0) {
+    const int sig = ncclParamProxyDumpSignal();
+    if (sig != -1) signal(sig, ncclDumpProxyState);
+    ncclLastProxyState = state;
+  }
+  char threadName[NCCL_THREAD_NAMELEN];
+  snprintf(threadName, NCCL_THREAD_NAMELEN, "NCCL Progress%2d", proxyState->cudaDev);
+  nvtxNameOsThreadA(syscall(SYS_gettid), threadName);
+
+  proxyProgressStateInit(state);
+  int idleSpins = 0;
+  uint64_t backoffNs = 1000;
+  uint64_t lastTime = state->timed ? clockNano() : 0;
+
+  while (proxyProgressRunning(state)) {
+    int busy, wait;
+    proxyProgressPass(state, &busy, &wait);
+    if (wait) proxyProgressIdleWait(state, &idleSpins, &backoffNs);
+    if (busy) {
+      idleSpins = 0;
+      backoffNs = 1000;
+    }
+    if (state->timed) {
+      uint64_t now = clockNano();
+      if (busy) state->activeNs += now - lastTime; else state->idleNs += now - lastTime;
+      lastTime = now;
+    }
+  }
+  proxyProgressReport(state);
+  ncclProfilingThreadExit();
+  return NULL;
+}
+
+// With RCCL_PROXY_SHARED_PROGRESS, the proxies of the process that use a single
+// progress thread on a device all get progressed by one thread, instead of one
+// thread per communicator. Every pass over the members gives each of them one
+// pass of the progress loop, so a busy communicator cannot starve the others.
+// Members never block waiting for ops: the thread backs off for all of them at
+// once, up to RCCL_PROXY_BACKOFF_MAX_US, or busy-polls if any member is high
+// priority. The thread exits once it has no member left.
+RCCL_PARAM(ProxySharedProgress, "PROXY_SHARED_PROGRESS", 0);
+
+#define NCCL_PROXY_SHARED_MAX_DEVS 64
+struct ncclProxySharedProgress {
+  pthread_mutex_t lock;
+  pthread_cond_t cond; // a member left
+  bool running;
+  struct ncclProxyProgressState* members;
+  struct ncclProxyProgressState* joining;
+};
+static struct ncclProxySharedProgress proxySharedProgress[NCCL_PROXY_SHARED_MAX_DEVS];
+static pthread_once_t proxySharedProgressOnce = PTHREAD_ONCE_INIT;
+
+static void proxySharedProgressInitOnce() {
+  for (int d = 0; d < NCCL_PROXY_SHARED_MAX_DEVS; d++) {
+    pthread_mutex_init(&proxySharedProgress[d].lock, NULL);
+    pthread_cond_init(&proxySharedProgress[d].cond, NULL);
+  }
+}
+
+static void* ncclProxySharedProgressMain(void* arg) {
+  int cudaDev = (int)(intptr_t)arg;
+  struct ncclProxySharedProgress* shared = proxySharedProgress+cudaDev;
+  if (cudaSetDevice(cudaDev) != cudaSuccess) {
+    WARN("[Proxy Progress] Failed to set CUDA device %d", cudaDev);
+  }
+  char threadName[NCCL_THREAD_NAMELEN];
+  snprintf(threadName, NCCL_THREAD_NAMELEN, "NCCL Progress%2d", cudaDev);
+  nvtxNameOsThreadA(syscall(SYS_gettid), threadName);
+
+  int idleSpins = 0;
+  uint64_t backoffNs = 1000;
+  while (1) {
+    pthread_mutex_lock(&shared->lock);
+    while (shared->joining) {
+      struct ncclProxyProgressState* state = shared->joining;
+      shared->joining = state->sharedNext;
+      proxyProgressStateInit(state);
+      // Never block on the post queue of one member, see above
+      state->sharedBusyPoll = state->progressMode == ncclProxyProgressBusyPoll;
+      state->progressMode = ncclProxyProgressBusyPoll;
+      state->sharedNext = shared->members;
+      shared->members = state;
+      if (shared->members->sharedNext == NULL) proxyProgressSetAffinity(state->proxyState, state);
+    }
+    bool busyPoll = false;
+    for (struct ncclProxyProgressState** s = &shared->members; *s != NULL;) {
+      struct ncclProxyProgressState* state = *s;
+      if (!proxyProgressRunning(state)) {
+        *s = state->sharedNext;
+        proxyProgressReport(state);
+        state->sharedDone = 1;
+        pthread_cond_broadcast(&shared->cond);
+        continue;
+      }
+      busyPoll |= state->sharedBusyPoll;
+      s = &state->sharedNext;
+    }
+    if (shared->members == NULL) {
+      shared->running = false;
+      pthread_mutex_unlock(&shared->lock);
+      break;
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    // Members only join and leave under the lock, at the top of the loop
+    int anyBusy = 0;
+    for (struct ncclProxyProgressState* state = shared->members; state != NULL; state = state->sharedNext) {
+      int busy, wait;
+      uint64_t t0 = state->timed ? clockNano() : 0;
+      proxyProgressPass(state, &busy, &wait);
+      if (t0) {
+        uint64_t t1 = clockNano();
+        if (busy) state->activeNs += t1 - t0; else state->idleNs += t1 - t0;
       }
-      if (added == 0) {
-        sched_yield(); // No request progressed. Let others run.
+      anyBusy |= busy;
+    }
+    if (anyBusy) {
+      idleSpins = 0;
+      backoffNs = 1000;
+    } else if (!busyPoll) {
+      if (++idleSpins <= ncclParamProxyBackoffSpins()) {
+        sched_yield();
+      } else {
+        struct timespec ts = { 0, (long)backoffNs };
+        nanosleep(&ts, NULL);
+        backoffNs = std::min<uint64_t>(backoffNs*2, ncclParamProxyBackoffMaxUs()*1000);
       }
     }
-    lastIdle = idle;
   }
+  ncclProfilingThreadExit();
   return NULL;
 }
 
+// Hands the single progress thread of proxyState to the shared thread of its device
+static ncclResult_t proxySharedProgressJoin(struct ncclProxyState* proxyState) {
+  struct ncclProxyProgressState* state = proxyState->progressThreads[0];
+  struct ncclProxySharedProgress* shared = proxySharedProgress+proxyState->cudaDev;
+  ncclResult_t ret = ncclSuccess;
+  pthread_once(&proxySharedProgressOnce, proxySharedProgressInitOnce);
+  pthread_mutex_lock(&shared->lock);
+  state->sharedNext = shared->joining;
+  shared->joining = state;
+  state->shared = 1;
+  if (!shared->running) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, ncclProxySharedProgressMain, (void*)(intptr_t)proxyState->cudaDev) != 0) {
+      WARN("[Proxy Progress] Failed to create the shared progress thread of device %d", proxyState->cudaDev);
+      shared->joining = state->sharedNext;
+      state->shared = 0;
+      ret = ncclSystemError;
+      goto exit;
+    }
+    pthread_detach(thread);
+    ncclSetThreadName(thread, "NCCL Progress%2d", proxyState->cudaDev);
+    shared->running = true;
+    INFO(NCCL_INIT|NCCL_PROXY, "Using a shared proxy progress thread on device %d", proxyState->cudaDev);
+  }
+exit:
+  pthread_mutex_unlock(&shared->lock);
+  return ret;
+}
+
+// Waits for the shared thread to drop a stopped member
+static void proxySharedProgressLeave(struct ncclProxyProgressState* state) {
+  struct ncclProxySharedProgress* shared = proxySharedProgress+state->proxyState->cudaDev;
+  pthread_mutex_lock(&shared->lock);
+  while (!state->sharedDone) pthread_cond_wait(&shared->cond, &shared->lock);
+  pthread_mutex_unlock(&shared->lock);
+}
+
 ncclResult_t ncclProxyStart(struct ncclComm* comm) {
   struct ncclProxyOps* proxyOps = comm->proxyState->proxyOps;
   if (proxyOps == NULL) return ncclSuccess;
   TIME_START(1);
   for (int r = 0; r < comm->sharedRes->tpNLocalRanks; r++) {
     struct ncclProxyOps* ops = proxyOps + r;
-    if (ops->pool == NULL || ops->nextOps == -1) continue;
-    NCCLCHECK(ncclProxyPost(ops->pool, ops->nextOps, ops->nextOpsEnd));
-    ops->nextOps = ops->nextOpsEnd = -1;
+    if (ops->pool == NULL) continue;
+    for (int q = 0; q < ops->pool->nQueues; q++) {
+      if (ops->nextOps[q] == -1) continue;
+      NCCLCHECK(ncclProxyPost(ops->pool, q, ops->nextOps[q], ops->nextOpsEnd[q]));
+      ops->nextOps[q] = ops->nextOpsEnd[q] = -1;
+    }
     ops->count = 0;
   }
   comm->opCount++;
@@ -917,32 +1311,152 @@ ncclResult_t ncclProxyStart(struct ncclComm* comm) {
   return ncclSuccess;
 }
 
-static ncclResult_t ncclProxyProgressCreate(struct ncclProxyState* proxyState) {
-  struct ncclProxyProgressState* state = &proxyState->progressState;
-  if (!state->thread) {
-    pthread_create(&state->thread, NULL, ncclProxyProgress, proxyState);
-    ncclSetThreadName(state->thread, "NCCL Progress%2d", proxyState->tpLocalnRanks);
+// External progress backend (RCCL_PROXY_BACKEND_PLUGIN). It is loaded with the
+// first proxy and kept for the life of the process, since it may still hold
+// engines of proxies being torn down.
+static pthread_mutex_t proxyBackendLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t proxyBackendCond = PTHREAD_COND_INITIALIZER; // an engine is done
+static int proxyBackendLoaded; // 0: not tried yet, 1: loaded, -1: none
+static ncclProxyBackend_t* proxyBackend;
+static void* proxyBackendContext;
+
+static ncclProxyBackend_t* proxyBackendLoad() {
+  pthread_mutex_lock(&proxyBackendLock);
+  if (proxyBackendLoaded == 0) {
+    proxyBackendLoaded = -1;
+    const char* name = getenv("RCCL_PROXY_BACKEND_PLUGIN");
+    if (name && name[0] != '\0') {
+      void* lib = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+      ncclProxyBackend_t* backend = lib ? (ncclProxyBackend_t*)dlsym(lib, NCCL_PROXY_BACKEND_PLUGIN_SYMBOL) : nullptr;
+      if (lib == nullptr) {
+        WARN("Proxy backend: failed to open %s (%s), using progress threads", name, dlerror());
+      } else if (backend == nullptr) {
+        WARN("Proxy backend: %s has no " NCCL_PROXY_BACKEND_PLUGIN_SYMBOL ", using progress threads", name);
+        dlclose(lib);
+      } else if (backend->init(ncclPluginDebugLog, &proxyBackendContext) != ncclSuccess) {
+        WARN("Proxy backend: init of '%s' failed, using progress threads", backend->name);
+        dlclose(lib);
+      } else {
+        INFO(NCCL_INIT|NCCL_PROXY, "Using proxy backend '%s' from %s", backend->name, name);
+        proxyBackend = backend;
+        proxyBackendLoaded = 1;
+      }
+    }
+  }
+  pthread_mutex_unlock(&proxyBackendLock);
+  return proxyBackend;
+}
+
+// ncclProxyBackendProgress_v1_t given to the backend
+static ncclResult_t proxyBackendProgress(void* engine, int* busy, int* done) {
+  struct ncclProxyProgressState* state = (struct ncclProxyProgressState*)engine;
+  *busy = 0;
+  *done = 0;
+  if (state->sharedDone) {
+    *done = 1;
+    return ncclSuccess;
+  }
+  if (!proxyProgressRunning(state)) {
+    proxyProgressReport(state);
+    pthread_mutex_lock(&proxyBackendLock);
+    state->sharedDone = 1;
+    pthread_cond_broadcast(&proxyBackendCond);
+    pthread_mutex_unlock(&proxyBackendLock);
+    *done = 1;
+    return ncclSuccess;
+  }
+  int wait;
+  uint64_t t0 = state->timed ? clockNano() : 0;
+  proxyProgressPass(state, busy, &wait);
+  if (t0) {
+    uint64_t t1 = clockNano();
+    if (*busy) state->activeNs += t1 - t0; else state->idleNs += t1 - t0;
   }
+  return __atomic_load_n(&state->proxyState->asyncResult, __ATOMIC_ACQUIRE);
+}
+
+static ncclResult_t proxyBackendAttach(struct ncclProxyState* proxyState, struct ncclProxyProgressState* state) {
+  char cpuMask[sizeof(cpu_set_t)*2+sizeof(cpu_set_t)/4+1] = "";
+  if (CPU_COUNT(&proxyState->cpuAffinity)) NCCLCHECK(ncclCpusetToStr(&proxyState->cpuAffinity, cpuMask));
+  proxyProgressStateInit(state);
+  // The backend polls, ops must not block it on an empty post queue
+  state->progressMode = ncclProxyProgressBusyPoll;
+  state->external = 1;
+  if (proxyBackend->attach(proxyBackendContext, proxyState->cudaDev, cpuMask, state, proxyBackendProgress) != ncclSuccess) {
+    state->external = 0;
+    return ncclInternalError;
+  }
+  INFO(NCCL_PROXY, "Proxy backend '%s' progresses engine %d of device %d", proxyBackend->name, state->shard, proxyState->cudaDev);
   return ncclSuccess;
 }
 
-ncclResult_t ncclProxyProgressDestroy(struct ncclProxyState* proxyState) {
-  struct ncclProxyProgressState* state = &proxyState->progressState;
+// Waits for the backend to report a stopped engine done
+static void proxyBackendLeave(struct ncclProxyProgressState* state) {
+  pthread_mutex_lock(&proxyBackendLock);
+  while (!state->sharedDone) pthread_cond_wait(&proxyBackendCond, &proxyBackendLock);
+  pthread_mutex_unlock(&proxyBackendLock);
+}
 
-  // Request the proxy to stop and then wake it
-  if (state->opsPool) {
-    pthread_mutex_lock(&state->opsPool->mutex);
-    state->stop = 1;
-    pthread_cond_signal(&state->opsPool->cond);
-    pthread_mutex_unlock(&state->opsPool->mutex);
-    pthread_join(state->thread, NULL);
+static ncclResult_t ncclProxyProgressCreate(struct ncclProxyState* proxyState) {
+  if (proxyBackendLoad() != nullptr) {
+    for (int t = 0; t < proxyState->nProgressThreads; t++) {
+      struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+      if (!state->external && !state->thread && proxyBackendAttach(proxyState, state) != ncclSuccess) {
+        INFO(NCCL_PROXY, "Proxy backend '%s' declined engine %d of device %d, starting a progress thread", proxyBackend->name, t, proxyState->cudaDev);
+      }
+    }
+  }
+  if (rcclParamProxySharedProgress() && proxyState->nProgressThreads == 1 && proxyState->cudaDev >= 0 &&
+      proxyState->cudaDev < NCCL_PROXY_SHARED_MAX_DEVS && !proxyState->progressThreads[0]->shared &&
+      !proxyState->progressThreads[0]->external) {
+    return proxySharedProgressJoin(proxyState);
   }
+  for (int t = 0; t < proxyState->nProgressThreads; t++) {
+    struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+    if (!state->thread && !state->external) {
+      pthread_create(&state->thread, NULL, ncclProxyProgress, state);
+      ncclSetThreadName(state->thread, "NCCL Progress%2d", proxyState->tpLocalnRanks);
+    }
+  }
+  return ncclSuccess;
+}
 
-  // Free off any memory allocated for the proxy arg pools
-  while (state->pools != NULL) {
-    struct ncclProxyPool *next = state->pools->next;
-    free(state->pools);
-    state->pools = next;
+// Wakes the sleeping progress threads so that they notice the abort flag right away
+ncclResult_t ncclProxyWakeAll(struct ncclComm* comm) {
+  struct ncclProxyState* proxyState = comm->proxyState;
+  if (proxyState == NULL) return ncclSuccess;
+  for (int t = 0; t < proxyState->nProgressThreads; t++) {
+    struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+    if (state == NULL || state->opsPool == NULL || state->queue == NULL) continue;
+    pthread_mutex_lock(&state->queue->mutex);
+    pthread_cond_broadcast(&state->queue->cond);
+    pthread_mutex_unlock(&state->queue->mutex);
+  }
+  return ncclSuccess;
+}
+
+ncclResult_t ncclProxyProgressDestroy(struct ncclProxyState* proxyState) {
+  for (int t = 0; t < proxyState->nProgressThreads; t++) {
+    struct ncclProxyProgressState* state = proxyState->progressThreads[t];
+
+    // Request the proxy to stop and then wake it
+    if (state->opsPool) {
+      pthread_mutex_lock(&state->queue->mutex);
+      state->stop = 1;
+      pthread_cond_signal(&state->queue->cond);
+      pthread_mutex_unlock(&state->queue->mutex);
+      if (state->shared) proxySharedProgressLeave(state);
+      else if (state->external) proxyBackendLeave(state);
+      else pthread_join(state->thread, NULL);
+    }
+
+    // Free off any memory allocated for the proxy arg pools
+    while (state->pools != NULL) {
+      struct ncclProxyPool *next = state->pools->next;
+      free(state->pools);
+      state->pools = next;
+    }
+    if (t > 0) free(state);
   }
 
   ncclProfilingDump();
@@ -1077,7 +1591,8 @@ ncclResult_t ncclProxyConnect(struct ncclComm* comm, int transport, int send, in
     struct ncclProxyOps* proxyOps = sharedProxyState->proxyOps + proxyConn->tpLocalRank;
     if (proxyOps->pool == NULL) {
       NCCLCHECK(ncclShmOpen(poolPath, sizeof(struct ncclProxyOpsPool), (void**)(&proxyOps->pool), NULL, 0, &proxyOps->handle));
-      proxyOps->nextOps = proxyOps->nextOpsEnd = proxyOps->freeOp = -1;
+      proxyOps->freeOp = -1;
+      for (int q = 0; q < NCCL_PROXY_MAX_PROGRESS_THREADS; q++) proxyOps->nextOps[q] = proxyOps->nextOpsEnd[q] = -1;
     }
   }
   INFO(NCCL_NET|NCCL_PROXY, "Connected to proxy localRank %d -> connection %p", proxyConn->tpLocalRank, proxyConn->connection);
@@ -1246,6 +1761,8 @@ fail:
   goto exit;
 }
 
+RCCL_PARAM(ProxyProgressThreads, "PROXY_PROGRESS_THREADS", 1);
+
 static ncclResult_t proxyProgressInit(struct ncclProxyState* proxyState) {
   struct ncclProxyProgressState* state = &proxyState->progressState;
   if (state->opsPool == NULL) {
@@ -1255,9 +1772,16 @@ static ncclResult_t proxyProgressInit(struct ncclProxyState* proxyState) {
     char shmPath[sizeof("/dev/shm/nccl-XXXXXX")];
     shmPath[0] = '\0';
     NCCLCHECK(ncclShmOpen(shmPath, size, (void**)&pool, NULL, proxyState->tpLocalnRanks + 1, &state->handle));
-    // Init pool
-    pool->nextOps = -1;
 
+    int nThreads = ncclParamProxyProgressThreads();
+    if (nThreads < 1 || nThreads > NCCL_PROXY_MAX_PROGRESS_THREADS) {
+      WARN("Invalid RCCL_PROXY_PROGRESS_THREADS=%d, must be between 1 and %d. Using 1.", nThreads, NCCL_PROXY_MAX_PROGRESS_THREADS);
+      nThreads = 1;
+    }
+    // Sharding is by channel, more threads than channels would sit idle
+    nThreads = std::min(nThreads, std::max(proxyState->nChannels, proxyState->p2pnChannels));
+
+    // Init pool
     for (int r = 0; r < proxyState->tpLocalnRanks; r++) {
       pool->freeOps[r] = r*MAX_OPS_PER_PEER;
       for (int i=0; i<MAX_OPS_PER_PEER-1; i++) pool->ops[r*MAX_OPS_PER_PEER+i].next = r*MAX_OPS_PER_PEER+i+1;
@@ -1268,14 +1792,35 @@ static ncclResult_t proxyProgressInit(struct ncclProxyState* proxyState) {
     pthread_mutexattr_t mutexAttr;
     pthread_mutexattr_init(&mutexAttr);
     pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(&pool->mutex, &mutexAttr);
     pthread_condattr_t condAttr;
+    pthread_condattr_init(&condAttr);
     pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
-    pthread_cond_init(&pool->cond, &condAttr);
+    pool->nQueues = nThreads;
+    for (int q = 0; q < nThreads; q++) {
+      struct ncclProxyPostQueue* queue = pool->queues+q;
+      queue->nextOps = -1;
+      queue->nextOpsEnd = -1;
+      pthread_mutex_init(&queue->mutex, &mutexAttr);
+      pthread_cond_init(&queue->cond, &condAttr);
+    }
     state->opsPool = pool;
 
     memcpy(state->opsPoolShmSuffix, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof("XXXXXX")-1);
 
+    // Additional progress threads only own their progress lists; setup-time state stays in progressState
+    proxyState->progressThreads[0] = state;
+    for (int t = 1; t < nThreads; t++) {
+      NCCLCHECK(ncclCalloc(proxyState->progressThreads+t, 1));
+      proxyState->progressThreads[t]->opsPool = pool;
+    }
+    for (int t = 0; t < nThreads; t++) {
+      proxyState->progressThreads[t]->proxyState = proxyState;
+      proxyState->progressThreads[t]->shard = t;
+      proxyState->progressThreads[t]->queue = pool->queues+t;
+    }
+    proxyState->nProgressThreads = nThreads;
+    if (nThreads > 1) INFO(NCCL_INIT|NCCL_PROXY, "Using %d proxy progress threads on device %d", nThreads, proxyState->cudaDev);
+
     // All ops structures are created, we can start the progress thread
     NCCLCHECK(ncclProxyProgressCreate(proxyState));
   }
@@ -1678,6 +2223,47 @@ ncclResult_t ncclProxyInit(struct ncclComm* comm, struct ncclSocket* sock, union
   return ncclSuccess;
 }
 
+// Defined in misc/straggler.cc
+int64_t rcclParamStragglerDetect();
+
+RCCL_PARAM(NetNumaAlloc, "NET_NUMA_ALLOC", 1);
+
+// Records the CPUs closest to each local NIC so that the net transport can place its
+// pinned host buffers on the NIC's NUMA node. When the GPU and its NIC sit on different
+// NUMA nodes and the job spans several nodes, the progress thread, which spends its time
+// polling the NIC, follows the NIC as well.
+static ncclResult_t proxyNetAffinityInit(struct ncclComm* comm, struct ncclProxyState* proxyState) {
+  struct ncclTopoSystem* system = comm->topo;
+  if (system == NULL) return ncclSuccess;
+  int nNets;
+  NCCLCHECK(ncclTopoGetNetCount(system, &nNets));
+  if (nNets == 0) return ncclSuccess;
+  if (rcclParamNetNumaAlloc()) {
+    int maxDev = -1;
+    for (int n=0; n<nNets; n++) maxDev = std::max(maxDev, (int)system->nodes[NET].nodes[n].id);
+    if (maxDev >= 0) {
+      NCCLCHECK(ncclCalloc(&proxyState->netCpuAffinity, maxDev+1));
+      proxyState->nNetCpuAffinity = maxDev+1;
+      for (int n=0; n<nNets; n++) {
+        int dev = system->nodes[NET].nodes[n].id;
+        if (dev >= 0) NCCLCHECK(ncclTopoGetNetCpuAffinity(system, dev, proxyState->netCpuAffinity+dev));
+      }
+    }
+  }
+  if (rcclParamProxyNicAffinity() && comm->nNodes > 1) {
+    int netDev;
+    cpu_set_t netMask;
+    NCCLCHECK(ncclTopoGetLocalNet(system, comm->rank, 0, &netDev));
+    if (netDev < 0) return ncclSuccess;
+    NCCLCHECK(ncclTopoGetNetCpuAffinity(system, netDev, &netMask));
+    if (CPU_COUNT(&netMask) && !CPU_EQUAL(&netMask, &comm->cpuAffinity)) {
+      proxyState->cpuAffinity = netMask;
+      proxyState->netAffinity = 1;
+    }
+  }
+  return ncclSuccess;
+}
+
 ncclResult_t ncclProxyCreate(struct ncclComm* comm) {
   /* proxyState is shared among parent comm and split comms. comm->proxyState->thread is
    * pthread_join()'d by commFree() in init.cc when the refCount reduces down to 0. */
@@ -1688,6 +2274,7 @@ ncclResult_t ncclProxyCreate(struct ncclComm* comm) {
     proxyState->tpnRanks = comm->nRanks;
     proxyState->tpLocalnRanks = comm->localRanks;
     proxyState->cudaDev = comm->cudaDev;
+    proxyState->highPriority = comm->config.highPriority;
     proxyState->abortFlag = comm->abortFlag;
     proxyState->p2pnChannels = comm->p2pnChannels;
     proxyState->p2pChunkSize = comm->p2pChunkSize;
@@ -1696,7 +2283,10 @@ ncclResult_t ncclProxyCreate(struct ncclComm* comm) {
     proxyState->dmaBufSupport = comm->dmaBufSupport;
     proxyState->ncclNet = comm->ncclNet;
     proxyState->ncclCollNet = comm->ncclCollNet;
+    proxyState->cpuAffinity = comm->cpuAffinity;
+    NCCLCHECK(proxyNetAffinityInit(comm, proxyState));
     memcpy(proxyState->buffSizes, comm->buffSizes, sizeof(comm->buffSizes));
+    if (rcclParamStragglerDetect()) NCCLCHECK(ncclCalloc(&proxyState->peerRecvWaitNs, comm->nRanks));
 
     pthread_create(&comm->proxyState->thread, NULL, ncclProxyService, comm->proxyState);
     ncclSetThreadName(comm->proxyState->thread, "NCCL Service %2d", comm->cudaDev);
@@ -1741,7 +2331,7 @@ ncclResult_t ncclProxyStop(struct ncclComm* comm) {
             }
             if (sharedProxyState->sharedDevMems[i]) {
               if (!ncclCuMemEnable()) {
-                CUDACHECK(cudaIpcCloseMemHandle(sharedProxyState->sharedDevMems[i]));
+                NCCLCHECK(ncclIpcCacheClose(sharedProxyState->sharedDevMems[i]));
               }
             }
             int type = ncclProxyMsgClose;
@@ -1762,6 +2352,8 @@ ncclResult_t ncclProxyDestroy(struct ncclComm* comm) {
   assert(sharedProxyState->refCount == 0);
   free(sharedProxyState->peerAddresses);
   free(sharedProxyState->peerAddressesUDS);
+  free(sharedProxyState->peerRecvWaitNs);
+  free(sharedProxyState->netCpuAffinity);
   free(sharedProxyState->peerSocks);
   free(sharedProxyState->proxyOps);
   free(sharedProxyState->sharedDevMems);
@@ -9,6 +9,8 @@
 #include "comm.h"
 #include "net.h"
 #include "register.h"
+#include "rocmwrap.h"
+#include <unistd.h>
 
 ncclResult_t ncclNetDeregister(struct ncclComm* comm, struct ncclReg* reg) {
   struct ncclRegCache* cache = &comm->regCache;
@@ -30,6 +32,7 @@ ncclResult_t ncclNetRegister(struct ncclComm* comm, void* addr, size_t size, str
   if (netCount == 0) return ncclSuccess;
 
   ncclResult_t ret = ncclSuccess;
+  bool useDmaBuf = comm->dmaBufSupport && pfn_hsa_amd_portable_export_dmabuf && comm->ncclNet->regMrDmaBuf;
 
   // Find local devices for p2p operations
   for (int c=0; c<comm->p2pnChannels; c++) {
@@ -41,6 +44,7 @@ ncclResult_t ncclNetRegister(struct ncclComm* comm, void* addr, size_t size, str
       reg->nDevs = 0;
       break;
     }
+    if ((props.ptrSupport & NCCL_PTR_DMABUF) == 0) useDmaBuf = false;
     int found = 0;
     for (int d=0; d<reg->nDevs; d++) if (reg->devs[d] == dev) found = 1;
     if (!found) reg->devs[reg->nDevs++] = dev;
@@ -64,14 +68,25 @@ ncclResult_t ncclNetRegister(struct ncclComm* comm, void* addr, size_t size, str
           goto end;
         }
         if (cache->sComms[dev] == NULL)
-          NCCLCHECKGOTO(comm->ncclNet->connect(dev, &netHandle, cache->sComms+dev, NULL), ret, end);
+          NCCLCHECKGOTO(comm->ncclNet->connect(dev, NULL, &netHandle, cache->sComms+dev, NULL), ret, end);
         if (cache->rComms[dev] == NULL)
           NCCLCHECKGOTO(comm->ncclNet->accept(lComm, cache->rComms+dev, NULL), ret, end);
         connected = (cache->rComms[dev] != NULL) && (cache->sComms[dev] != NULL);
       }
       NCCLCHECK(comm->ncclNet->closeListen(lComm));
     }
-    if (comm->ncclNet->regMr(cache->sComms[dev], addr, size, NCCL_PTR_CUDA, reg->handles+d) != ncclSuccess) {
+    ncclResult_t regRes = ncclInternalError;
+    if (useDmaBuf) {
+      /* DMA-BUF support */
+      int dmabuf_fd;
+      uint64_t offset;
+      if (pfn_hsa_amd_portable_export_dmabuf(addr, size, &dmabuf_fd, &offset) == HSA_STATUS_SUCCESS) {
+        regRes = comm->ncclNet->regMrDmaBuf(cache->sComms[dev], addr, size, NCCL_PTR_CUDA, offset, dmabuf_fd, reg->handles+d);
+        (void)close(dmabuf_fd);
+      }
+    }
+    if (regRes != ncclSuccess) regRes = comm->ncclNet->regMr(cache->sComms[dev], addr, size, NCCL_PTR_CUDA, reg->handles+d);
+    if (regRes != ncclSuccess) {
       reg->handles[d] = NULL;
       NCCLCHECK(ncclNetDeregister(comm, reg));
       reg->nDevs = 0;
@@ -84,23 +99,128 @@ end:
   return ret;
 }
 
+// Slots are kept sorted by start address, with a running maximum of the end
+// addresses. A lookup binary searches the last slot starting at or before the
+// region, then walks back only while an earlier slot may still cover it.
+static int regUpperBound(struct ncclRegCache* cache, uintptr_t addr) {
+  int lo = 0, hi = cache->population;
+  while (lo < hi) {
+    int mid = (lo+hi)/2;
+    if (cache->slots[mid]->addr <= addr) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static int regLookup(struct ncclRegCache* cache, uintptr_t addr, size_t pages, bool includeIdle, bool includeAuto) {
+  uintptr_t pageSize = cache->pageSize;
+  uintptr_t end = addr + pages*pageSize;
+  for (int slot = regUpperBound(cache, addr)-1; slot >= 0 && cache->maxEnds[slot] >= end; slot--) {
+    struct ncclReg* reg = cache->slots[slot];
+    if ((addr-reg->addr)/pageSize+pages <= reg->pages && (includeIdle || reg->refs > 0) && (includeAuto || !reg->autoReg)) return slot;
+  }
+  return -1;
+}
+
+static void regUpdateMaxEnds(struct ncclRegCache* cache, int from) {
+  for (int i=from; i<cache->population; i++) {
+    uintptr_t end = cache->slots[i]->addr + cache->slots[i]->pages*cache->pageSize;
+    cache->maxEnds[i] = (i > 0 && cache->maxEnds[i-1] > end) ? cache->maxEnds[i-1] : end;
+  }
+}
+
+static void regLruRemove(struct ncclRegCache* cache, struct ncclReg* reg) {
+  if (reg->lruPrev) reg->lruPrev->lruNext = reg->lruNext;
+  else cache->lruHead = reg->lruNext;
+  if (reg->lruNext) reg->lruNext->lruPrev = reg->lruPrev;
+  else cache->lruTail = reg->lruPrev;
+  reg->lruPrev = reg->lruNext = NULL;
+  cache->nIdle--;
+}
+
+static void regLruAppend(struct ncclRegCache* cache, struct ncclReg* reg) {
+  reg->lruNext = NULL;
+  reg->lruPrev = cache->lruTail;
+  if (cache->lruTail) cache->lruTail->lruNext = reg;
+  else cache->lruHead = reg;
+  cache->lruTail = reg;
+  cache->nIdle++;
+}
+
+static ncclResult_t regFreeSlot(struct ncclComm* comm, int slot) {
+  struct ncclRegCache* cache = &comm->regCache;
+  struct ncclReg* reg = cache->slots[slot];
+  NCCLCHECK(ncclNetDeregister(comm, reg));
+  if (reg->state & NVLS_REG_COMPLETE) {
+    NCCLCHECK(ncclNvlsDeregBuffer(&reg->mcHandle, reg->regAddr, reg->dev, reg->regSize));
+    reg->regAddr = (CUdeviceptr)NULL;
+  }
+  ncclMemStatsAdd(&comm->memStats, ncclMemRegistered, false, -(int64_t)(reg->pages*cache->pageSize));
+  free(reg);
+  memmove(cache->slots+slot, cache->slots+slot+1, (cache->population-slot-1)*sizeof(struct ncclReg*));
+  cache->population -= 1;
+  regUpdateMaxEnds(cache, slot);
+  return ncclSuccess;
+}
+
+static ncclResult_t regInsert(struct ncclComm* comm, uintptr_t addr, size_t pages, struct ncclReg** reg) {
+  struct ncclRegCache* cache = &comm->regCache;
+  uintptr_t pageSize = cache->pageSize;
+  if (cache->population == cache->capacity) { // must grow cache
+    cache->capacity = cache->capacity < 32 ? 32 : 2*cache->capacity;
+    NCCLCHECK(ncclRealloc(&cache->slots, cache->population, cache->capacity));
+    NCCLCHECK(ncclRealloc(&cache->maxEnds, cache->population, cache->capacity));
+  }
+  int slot = regUpperBound(cache, addr);
+  memmove(cache->slots+slot+1, cache->slots+slot, (cache->population-slot)*sizeof(struct ncclReg*));
+  NCCLCHECK(ncclCalloc(cache->slots+slot, 1));
+  struct ncclReg* regSlot = cache->slots[slot];
+  regSlot->addr = addr;
+  regSlot->pages = pages;
+  regSlot->refs = 1;
+  cache->population += 1;
+  regUpdateMaxEnds(cache, slot);
+  // User memory, counted so that idle cached registrations show up
+  ncclMemStatsAdd(&comm->memStats, ncclMemRegistered, false, pages*pageSize);
+  NCCLCHECK(ncclNetRegister(comm, (void*)addr, pages*pageSize, regSlot));
+  regSlot->state |= NET_REG_COMPLETE;
+  *reg = regSlot;
+  return ncclSuccess;
+}
+
 ncclResult_t ncclRegFind(struct ncclComm* comm, const void* data, size_t size, struct ncclReg** reg) {
   struct ncclRegCache* cache = &comm->regCache;
   uintptr_t pageSize = cache->pageSize;
   uintptr_t addr = (uintptr_t)data & -pageSize;
   size_t pages = ((uintptr_t)data + size - addr + pageSize-1)/pageSize;
 
-  *reg = NULL;
-  for (int slot=0; /*true*/; slot++) {
-    if (slot == cache->population || addr < cache->slots[slot]->addr) return ncclSuccess;
-    if ((addr >= cache->slots[slot]->addr) &&
-        ((addr-cache->slots[slot]->addr)/pageSize+pages) <= cache->slots[slot]->pages) {
-      *reg = cache->slots[slot];
-      return ncclSuccess;
+  int slot = regLookup(cache, addr, pages, false, true);
+  *reg = slot == -1 ? NULL : cache->slots[slot];
+  if (*reg && (*reg)->autoReg) {
+    // The allocation backing an automatic registration may have been freed and
+    // the address reused since; drop the registration if so.
+    unsigned long long bufferId = 0;
+    if (hipPointerGetAttribute(&bufferId, HIP_POINTER_ATTRIBUTE_BUFFER_ID, (hipDeviceptr_t)data) != hipSuccess || bufferId != (*reg)->bufferId) {
+      (void)hipGetLastError();
+      INFO(NCCL_INIT, "Dropping stale automatic registration %p pages %lx", (void*)(*reg)->addr, (*reg)->pages);
+      *reg = NULL;
+      NCCLCHECK(regFreeSlot(comm, slot));
     }
   }
+  return ncclSuccess;
 }
+// Whether data lies in a buffer the user registered and has not deregistered yet
+ncclResult_t ncclRegIsUserRegistered(struct ncclComm* comm, const void* data, bool* registered) {
+  struct ncclRegCache* cache = &comm->regCache;
+  *registered = cache->population > 0 && regLookup(cache, (uintptr_t)data & -cache->pageSize, 1, false, false) != -1;
+  return ncclSuccess;
+}
+
 NCCL_PARAM(LocalRegister, "LOCAL_REGISTER", 1);
+// Number of deregistered regions kept registered so that a later ncclCommRegister
+// of the same buffer is free. Only safe when deregistered buffers are not freed
+// and reallocated at the same address while the communicator is alive.
+RCCL_PARAM(RegCacheMaxIdle, "REG_CACHE_MAX_IDLE", 0);
 
 ncclResult_t ncclRegister(struct ncclComm* comm, void* data, size_t size, void** handle) {
   if (!ncclParamLocalRegister()) return ncclSuccess;
@@ -108,30 +228,48 @@ ncclResult_t ncclRegister(struct ncclComm* comm, void* data, size_t size, void**
   uintptr_t pageSize = cache->pageSize;
   uintptr_t addr = (uintptr_t)data & -pageSize;
   size_t pages = ((uintptr_t)data + size - addr + pageSize-1)/pageSize;
-  for (int slot=0; /*true*/; slot++) {
-    if ((slot == cache->population) || (addr < cache->slots[slot]->addr)) {
-      if (cache->population == cache->capacity) { // must grow cache
-        cache->capacity = cache->capacity < 32 ? 32 : 2*cache->capacity;
-        NCCLCHECK(ncclRealloc(&cache->slots, cache->population, cache->capacity));
-      }
-      memmove(cache->slots+slot+1, cache->slots+slot, (cache->population-slot)*sizeof(struct ncclReg*));
-      NCCLCHECK(ncclCalloc(cache->slots+slot, 1));
-      struct ncclReg* regSlot = cache->slots[slot];
-      regSlot->addr = addr;
-      regSlot->pages = pages;
-      regSlot->refs = 1;
-      NCCLCHECK(ncclNetRegister(comm, (void*)addr, pages*pageSize, regSlot));
-      regSlot->state |= NET_REG_COMPLETE;
-      cache->population += 1;
-      *handle = regSlot;
-      return ncclSuccess;
-    } else if ((addr >= cache->slots[slot]->addr) &&
-        ((addr-cache->slots[slot]->addr)/pageSize+pages) <= cache->slots[slot]->pages) {
-      cache->slots[slot]->refs++;
-      *handle = cache->slots[slot];
-      return ncclSuccess;
-    }
+
+  // Automatic registrations are owned by the cache and may be dropped at any
+  // time, so user registrations never share them.
+  int slot = regLookup(cache, addr, pages, true, false);
+  if (slot != -1) {
+    struct ncclReg* reg = cache->slots[slot];
+    if (reg->refs == 0) regLruRemove(cache, reg);
+    reg->refs++;
+    *handle = reg;
+    return ncclSuccess;
   }
+
+  NCCLCHECK(regInsert(comm, addr, pages, (struct ncclReg**)handle));
+  return ncclSuccess;
+}
+
+RCCL_PARAM(NetAutoRegister, "NET_AUTO_REGISTER", 0);
+RCCL_PARAM(NetAutoRegisterMinBytes, "NET_AUTO_REGISTER_MIN_BYTES", 1<<20);
+
+ncclResult_t ncclRegAutoRegister(struct ncclComm* comm, const void* data, size_t size, struct ncclReg** reg) {
+  *reg = NULL;
+  if (!rcclParamNetAutoRegister() || size < rcclParamNetAutoRegisterMinBytes()) return ncclSuccess;
+  // Register the whole allocation so that later buffers carved out of the same
+  // allocator segment hit the cache too.
+  hipDeviceptr_t base;
+  size_t baseSize;
+  unsigned long long bufferId;
+  if (hipMemGetAddressRange(&base, &baseSize, (hipDeviceptr_t)data) != hipSuccess ||
+      hipPointerGetAttribute(&bufferId, HIP_POINTER_ATTRIBUTE_BUFFER_ID, base) != hipSuccess) {
+    (void)hipGetLastError();
+    return ncclSuccess;
+  }
+  uintptr_t pageSize = comm->regCache.pageSize;
+  uintptr_t addr = (uintptr_t)base & -pageSize;
+  size_t pages = ((uintptr_t)base + baseSize - addr + pageSize-1)/pageSize;
+  NCCLCHECK(regInsert(comm, addr, pages, reg));
+  // The reference held by the cache keeps the registration until the
+  // communicator is destroyed or the allocation goes away.
+  (*reg)->autoReg = 1;
+  (*reg)->bufferId = bufferId;
+  INFO(NCCL_INIT|NCCL_NET, "Automatically registered buffer %p size %zu on %d NICs", base, baseSize, (*reg)->nDevs);
+  return ncclSuccess;
 }
 
 ncclResult_t ncclRegCleanup(struct ncclComm* comm) {
@@ -143,6 +281,7 @@ ncclResult_t ncclRegCleanup(struct ncclComm* comm) {
     free(cache->slots[i]);
   }
   free(cache->slots);
+  free(cache->maxEnds);
   for (int d=0; d<MAXCHANNELS; d++) {
     if (cache->sComms[d]) NCCLCHECK(comm->ncclNet->closeSend(cache->sComms[d]));
     if (cache->rComms[d]) NCCLCHECK(comm->ncclNet->closeRecv(cache->rComms[d]));
@@ -165,18 +304,21 @@ ncclResult_t ncclCommDeregister(const ncclComm_t comm, void* handle) {
   struct ncclRegCache* cache = &comm->regCache;
   int slot;
   for (slot=0; slot<cache->population && cache->slots[slot] != reg; slot++);
-  if (slot == cache->population) {
+  if (slot == cache->population || reg->refs == 0) {
     WARN("Deregister: Could not find handle");
     return ncclInvalidUsage;
   }
   if (--reg->refs) return ncclSuccess;
-  NCCLCHECK(ncclNetDeregister(comm, reg));
-  if (reg->state & NVLS_REG_COMPLETE) {
-    NCCLCHECK(ncclNvlsDeregBuffer(&reg->mcHandle, reg->regAddr, reg->dev, reg->regSize));
-    reg->regAddr = (CUdeviceptr)NULL;
+  int64_t maxIdle = rcclParamRegCacheMaxIdle();
+  if (maxIdle <= 0) return regFreeSlot(comm, slot);
+
+  regLruAppend(cache, reg);
+  while (cache->nIdle > maxIdle) {
+    struct ncclReg* victim = cache->lruHead;
+    regLruRemove(cache, victim);
+    for (slot = regUpperBound(cache, victim->addr)-1; cache->slots[slot] != victim; slot--);
+    INFO(NCCL_INIT, "Evicting idle registration %p pages %lx", (void*)victim->addr, victim->pages);
+    NCCLCHECK(regFreeSlot(comm, slot));
   }
-  free(reg);
-  memmove(cache->slots+slot, cache->slots+slot+1, (cache->population-slot-1)*sizeof(struct ncclReg*));
-  cache->population -= 1;
   return ncclSuccess;
 }
@@ -18,6 +18,17 @@ struct ncclTransport* ncclTransports[NTRANSPORTS] = {
   &collNetTransport
 };
 
+int ncclTransportSteps(int64_t steps, const char* name) {
+  // Ring and tree chunks are NCCL_STEPS/2 steps deep and must fit in the connection
+  if (steps < NCCL_STEPS/2 || steps > NCCL_MAX_STEPS || (steps & (steps-1))) {
+    static bool warned = false;
+    if (!warned) WARN("RCCL_%s_STEPS=%ld must be a power of two between %d and %d, using %d", name, steps, NCCL_STEPS/2, NCCL_MAX_STEPS, NCCL_STEPS);
+    warned = true;
+    return NCCL_STEPS;
+  }
+  return steps;
+}
+
 template <int type>
 static ncclResult_t selectTransport(struct ncclComm* comm, struct ncclTopoGraph* graph, struct ncclConnect* connect, int channelId, int peer, int connIndex, int* transportType, bool* needsProxy) {
   struct ncclPeerInfo* myInfo = comm->peerInfo+comm->rank;
@@ -42,6 +53,7 @@ static ncclResult_t selectTransport(struct ncclComm* comm, struct ncclTopoGraph*
     NCCLCHECK(transport->canConnect(&ret, comm->topo, graph, myInfo, peerInfo));
     if (ret) {
       connector->transportComm = transportComm;
+      connector->conn.nSteps = NCCL_STEPS; // Transports may go deeper in setup
       NCCLCHECK(transportComm->setup(comm, graph, myInfo, peerInfo, connect, connector, channelId, connIndex));
       if (transportType) *transportType = t;
       if (needsProxy) *needsProxy = (transportComm->proxyProgress != NULL);
@@ -351,6 +363,7 @@ int ncclTransportCollNetSetup(struct ncclComm* comm, struct ncclTopoGraph* collN
   struct ncclConnector* conn = (type == collNetRecv) ? root->recv+type : root->send+type;
   struct ncclTransportComm* transportComm = (type == collNetRecv) ? &(collNetTransport.recv) : &(collNetTransport.send);
   conn->transportComm = transportComm;
+  conn->conn.nSteps = NCCL_STEPS;
   // setup
   struct ncclConnect myConnect;
   if (isMaster) {
@@ -444,3 +457,103 @@ ncclResult_t ncclTransportCollNetFree(struct ncclComm* comm) {
   }
   return ncclSuccess;
 }
+
+// Connect with prev/next for each ring
+ncclResult_t ncclTransportRingConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph, bool* needsProxy) {
+  bool ringNeedsProxy = false;
+  if (comm->nRanks > 1) {
+    for (int c=0; c<comm->nChannels; c++) {
+      struct ncclChannel* channel = comm->channels+c;
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, 0));
+    }
+  }
+  NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, 0, NULL, &ringNeedsProxy));
+  if (comm->useIntraNet) {
+    // Connect NET for intranode use
+    if (comm->nRanks > 1) {
+      for (int c=0; c<comm->nChannels; c++) {
+        struct ncclChannel* channel = comm->channels+c;
+        NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->ring.prev, 1, &channel->ring.next, NCCL_CONN_IDX_P2P_NET));
+      }
+    }
+    NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, NCCL_CONN_IDX_P2P_NET));
+  }
+  if (needsProxy) *needsProxy |= ringNeedsProxy;
+  INFO(NCCL_INIT, "Connected all rings comm %p nRanks %02d busId %lx", comm, comm->nRanks, comm->busId);
+  return ncclSuccess;
+}
+
+ncclResult_t ncclTransportTreeConnect(struct ncclComm* comm, struct ncclTopoGraph* treeGraph, bool* needsProxy) {
+  bool treeNeedsProxy = false;
+  if (comm->nRanks > 1) {
+    for (int c=0; c<comm->nChannels; c++) {
+      struct ncclChannel* channel = comm->channels+c;
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, NCCL_MAX_TREE_ARITY, channel->tree.down, 1, &channel->tree.up, 0));
+      NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &channel->tree.up, NCCL_MAX_TREE_ARITY, channel->tree.down, 0));
+    }
+  }
+  NCCLCHECK(ncclTransportP2pSetup(comm, treeGraph, 0, NULL, &treeNeedsProxy));
+  if (needsProxy) *needsProxy |= treeNeedsProxy;
+  INFO(NCCL_INIT, "Connected all trees");
+  return ncclSuccess;
+}
+
+// Connect with the recursive halving-doubling peers of each RHD channel
+ncclResult_t ncclTransportRhdConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph) {
+  if (!comm->rhdSupport) return ncclSuccess;
+  for (int c=0; c<comm->rhdnChannels; c++) {
+    struct ncclRhd* rhd = &comm->channels[c].rhd;
+    if (rhd->extra != -1) NCCLCHECK(ncclTransportP2pConnect(comm, c, 1, &rhd->extra, 1, &rhd->extra, 0));
+    if (rhd->vrank != -1) NCCLCHECK(ncclTransportP2pConnect(comm, c, rhd->nSteps, rhd->peers, rhd->nSteps, rhd->peers, 0));
+  }
+  NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, 0));
+  INFO(NCCL_INIT, "Connected RHD peers on %d channels", comm->rhdnChannels);
+  return ncclSuccess;
+}
+
+// Connect with the ranks at distance 1<<k, both ways: AllGather sends down,
+// ReduceScatter and AllToAll send up
+ncclResult_t ncclTransportBruckConnect(struct ncclComm* comm, struct ncclTopoGraph* ringGraph) {
+  if (!comm->bruckSupport) return ncclSuccess;
+  int peers[2*NCCL_MAX_BRUCK_STEPS];
+  int nPeers = 0;
+  for (int k=0; k<comm->channels[0].bruck.nSteps; k++) {
+    peers[nPeers++] = (comm->rank + (1<<k)) % comm->nRanks;
+    peers[nPeers++] = (comm->rank + comm->nRanks - (1<<k)) % comm->nRanks;
+  }
+  for (int c=0; c<comm->brucknChannels; c++) {
+    NCCLCHECK(ncclTransportP2pConnect(comm, c, nPeers, peers, nPeers, peers, 0));
+  }
+  NCCLCHECK(ncclTransportP2pSetup(comm, ringGraph, 0));
+  INFO(NCCL_INIT, "Connected Bruck peers on %d channels", comm->brucknChannels);
+  return ncclSuccess;
+}
+
+// Runtime connection: rings and trees are connected by the first collective that
+// needs them instead of during init.
+ncclResult_t ncclTransportCollConnect(struct ncclComm* comm) {
+  ncclResult_t ret = ncclSuccess;
+  if (comm->collConnected) return ncclSuccess;
+  // p2p tasks of the current group share the connect masks with connIndex 0, keep
+  // them aside while rings and trees are connected.
+  size_t nMasks = comm->nRanks*NCCL_MAX_CONNS;
+  struct channelMasks* p2pSend = NULL, *p2pRecv = NULL;
+  NCCLCHECKGOTO(ncclCalloc(&p2pSend, nMasks), ret, exit);
+  NCCLCHECKGOTO(ncclCalloc(&p2pRecv, nMasks), ret, exit);
+  memcpy(p2pSend, comm->connectSend, nMasks*sizeof(struct channelMasks));
+  memcpy(p2pRecv, comm->connectRecv, nMasks*sizeof(struct channelMasks));
+  memset(comm->connectSend, 0, nMasks*sizeof(struct channelMasks));
+  memset(comm->connectRecv, 0, nMasks*sizeof(struct channelMasks));
+  NCCLCHECKGOTO(ncclTransportRingConnect(comm, comm->runtimeRingGraph, NULL), ret, restore);
+  NCCLCHECKGOTO(ncclTransportTreeConnect(comm, comm->runtimeTreeGraph, NULL), ret, restore);
+  NCCLCHECKGOTO(ncclTransportRhdConnect(comm, comm->runtimeRingGraph), ret, restore);
+  NCCLCHECKGOTO(ncclTransportBruckConnect(comm, comm->runtimeRingGraph), ret, restore);
+  comm->collConnected = true;
+restore:
+  memcpy(comm->connectSend, p2pSend, nMasks*sizeof(struct channelMasks));
+  memcpy(comm->connectRecv, p2pRecv, nMasks*sizeof(struct channelMasks));
+exit:
+  free(p2pSend);
+  free(p2pRecv);
+  return ret;
+}
@@ -14,6 +14,8 @@
 #include "gdrwrap.h"
 #include "shm.h"
 #include "p2p.h"
+#include "hostpool.h"
+#include "ipccache.h"
 #include "profiler.h"
 #include "graph.h"
 #include "graph/topo.h"
@@ -109,12 +111,14 @@ struct sendNetResources {
   char* buffers[NCCL_NUM_PROTOCOLS];
   int buffSizes[NCCL_NUM_PROTOCOLS];
   void* mhandles[NCCL_NUM_PROTOCOLS];
+  int nSteps;
   uint64_t step;
   uint64_t llLastCleaning;
   int netDeviceVersion;
   ncclNetDeviceType netDeviceType;
   ncclNetDeviceHandle_t* netDeviceHandle;
   volatile uint32_t* curr_hdp_reg;  // Curr GPU in ring (for rdma transport use only)
+  struct netShare* share; // NIC bandwidth shared with the other connections, or NULL
 };
 
 struct recvNetResources {
@@ -142,6 +146,7 @@ struct recvNetResources {
   char* buffers[NCCL_NUM_PROTOCOLS];
   int buffSizes[NCCL_NUM_PROTOCOLS];
   void* mhandles[NCCL_NUM_PROTOCOLS];
+  int nSteps;
   uint64_t step;
   uint64_t llLastCleaning;
   int netDeviceVersion;
@@ -165,9 +170,15 @@ static ncclResult_t canConnect(int* ret, struct ncclTopoSystem* topo, struct ncc
 
 NCCL_PARAM(NetSharedBuffers, "NET_SHARED_BUFFERS", -2);
 NCCL_PARAM(NetSharedComms, "NET_SHARED_COMMS", 1);
+// Pipeline depth of dedicated (ring/tree) network connections. Deeper pipelines keep
+// more data in flight on high latency links, at the cost of larger buffers.
+RCCL_PARAM(NetSteps, "NET_STEPS", NCCL_STEPS);
 
 #if defined(HIP_CONTIGUOUS_MEMORY)
 RCCL_PARAM(NetContiguousMem, "NET_CONTIGUOUS_MEM", 0);
+// Number of p2p chunk slabs in each shared buffer pool. The default, one per channel and shared step,
+// never runs out; a smaller pool saves memory and makes steps wait for slabs released by other peers.
+RCCL_PARAM(NetSharedPoolSlabs, "NET_SHARED_POOL_SLABS", -1);
 #endif
 
 struct setupReq {
@@ -180,6 +191,7 @@ struct setupReq {
   int needFlush;
   int channelId;
   int connIndex;
+  int nSteps;
   uint32_t* curr_hdp_reg;
 };
 
@@ -193,6 +205,8 @@ static ncclResult_t sendSetup(struct ncclComm* comm, struct ncclTopoGraph* graph
   int tpProxyRank;
 
   send->conn.shared = req.shared = (graph || mscclIsCaller()) ? 0 : ncclParamNetSharedBuffers() != -2 ? ncclParamNetSharedBuffers() : 1;
+  // Shared buffers are carved in slabs of the default step size and count
+  send->conn.nSteps = req.nSteps = req.shared ? NCCL_STEPS : ncclTransportSteps(rcclParamNetSteps(), "NET");
   req.channelId = channelId;
   req.connIndex = connIndex;
   req.curr_hdp_reg = 0;
@@ -236,6 +250,8 @@ static ncclResult_t recvSetup(struct ncclComm* comm, struct ncclTopoGraph* graph
   struct setupReq req = { 0 };
 
   recv->conn.shared = req.shared = (graph || mscclIsCaller()) ? 0 : ncclParamNetSharedBuffers() != -2 ? ncclParamNetSharedBuffers() : 1;
+  // Shared buffers are carved in slabs of the default step size and count
+  recv->conn.nSteps = req.nSteps = req.shared ? NCCL_STEPS : ncclTransportSteps(rcclParamNetSteps(), "NET");
   req.channelId = channelId;
   req.connIndex = connIndex;
   req.netDev = -1;
@@ -302,6 +318,7 @@ static ncclResult_t netDumpMap(struct connectMap* map) {
 
 struct netSendConnectArgs {
   ncclNetHandle_t handle;
+  ncclNetCommConfig_t config;
 };
 
 struct netRecvConnectArgs {
@@ -322,6 +339,7 @@ static ncclResult_t sendConnect(struct ncclComm* comm, struct ncclConnect* conne
     INFO(NCCL_PROXY, "sendConnect ncclProxyCallAsync opId=%p", opId);
     netSendConnectArgs args = {0};
     memcpy(&args.handle, connectInfo, sizeof(ncclNetHandle_t));
+    ncclNetGetCommConfig(comm, &args.config);
     NCCLCHECK(ncclProxyCallAsync(comm, &send->proxyConn, ncclProxyMsgConnect, &args, sizeof(netSendConnectArgs), sizeof(struct connectMap), opId));
   } else {
     opId =  send;
@@ -376,7 +394,7 @@ static ncclResult_t sendConnect(struct ncclComm* comm, struct ncclConnect* conne
   send->conn.tail = &recvMem->tail;
   send->conn.connFifo = recvMem->connFifo;
   // Only fuse P2P buffers, continue to allocate dedicated buffers for ring/tree
-  for (int i=0; i<NCCL_STEPS; i++) {
+  for (int i=0; i<NCCL_MAX_STEPS; i++) {
     send->conn.connFifo[i].offset = -1;
     recvMem->connFifo[i].mode = map->shared ? NCCL_MODE_OFFSET : NCCL_MODE_NORMAL;
   }
@@ -441,7 +459,7 @@ static ncclResult_t recvConnect(struct ncclComm* comm, struct ncclConnect* conne
   recv->conn.tail = gdcMem ? (uint64_t*)gdcMem : &recvMem->tail;
   recv->conn.connFifo = recvMem->connFifo;
   // Only fuse P2P buffers, continue to allocate dedicated buffers for ring/tree
-  for (int i=0; i<NCCL_STEPS; i++) {
+  for (int i=0; i<NCCL_MAX_STEPS; i++) {
     recvMem->connFifo[i].mode = map->shared ? NCCL_MODE_OFFSET : NCCL_MODE_NORMAL;
   }
 
@@ -487,7 +505,7 @@ static ncclResult_t sendFree(struct ncclConnector* send) {
           NCCLCHECK(ncclCuMemFree(map->mems[NCCL_NET_MAP_DEVMEM].gpuPtr));
         } else {
           // Legacy CUDA IPC support
-          CUDACHECK(cudaIpcCloseMemHandle(map->mems[NCCL_NET_MAP_DEVMEM].gpuPtr));
+          NCCLCHECK(ncclIpcCacheClose(map->mems[NCCL_NET_MAP_DEVMEM].gpuPtr));
         }
       }
     }
@@ -503,7 +521,28 @@ static ncclResult_t recvFree(struct ncclConnector* recv) {
 }
 
 #define NCCL_SHARED_STEPS 16
-static ncclResult_t sharedNetBuffersInit(struct ncclProxyState* proxyState, int cuda, int tpLocalRank, int type, int sameProcess,
+// Pinned host memory polled by the NIC is best placed on the NIC's NUMA node, which is not
+// always the GPU's. Allocate it while running on the NIC's CPUs so that the user (local)
+// memory policy puts the pages there.
+// The memory comes from the host pool, where NIC-local slabs are kept apart, one domain per NIC.
+static ncclResult_t netHostCalloc(struct ncclProxyState* proxyState, int netDev, char** ptr, size_t size) {
+  if (proxyState->netCpuAffinity == NULL || netDev < 0 || netDev >= proxyState->nNetCpuAffinity ||
+      CPU_COUNT(proxyState->netCpuAffinity+netDev) == 0) {
+    return ncclHostPoolCalloc(ptr, size);
+  }
+  cpu_set_t saved;
+  SYSCHECK(sched_getaffinity(0, sizeof(cpu_set_t), &saved), "sched_getaffinity");
+  if (CPU_EQUAL(&saved, proxyState->netCpuAffinity+netDev) ||
+      sched_setaffinity(0, sizeof(cpu_set_t), proxyState->netCpuAffinity+netDev) != 0) {
+    return ncclHostPoolCalloc(ptr, size);
+  }
+  ncclResult_t ret = ncclHostPoolAlloc((void**)ptr, size, netDev, cudaHostAllocMapped | hipHostMallocNumaUser);
+  SYSCHECK(sched_setaffinity(0, sizeof(cpu_set_t), &saved), "sched_setaffinity");
+  if (ret == ncclSuccess) TRACE(NCCL_NET, "NET/%d: allocated %zu bytes of host memory on the NIC NUMA node", netDev, size);
+  return ret;
+}
+
+static ncclResult_t sharedNetBuffersInit(struct ncclProxyState* proxyState, int cuda, int tpLocalRank, int netDev, int type, int sameProcess,
     int nChannels, char** gpuPtr, char** cpuPtr, int* size, ncclIpcDesc *ipcDesc) {
   if (cuda == 0 && sameProcess == 0) {
       WARN("PXN should not use host buffers for data");
@@ -521,8 +560,17 @@ static ncclResult_t sharedNetBuffersInit(struct ncclProxyState* proxyState, int
   struct ncclProxySharedP2p* state = type == 0 ? &peer->send : &peer->recv;
   state->refcount++;
   if (state->size == 0) {
-    state->size = (int64_t)nChannels * NCCL_SHARED_STEPS * proxyState->p2pChunkSize;
-
+    int nSlabs = nChannels * NCCL_SHARED_STEPS;
+    if (rcclParamNetSharedPoolSlabs() > 0) {
+      nSlabs = std::max<int>(NCCL_SHARED_STEPS, std::min<int64_t>(nSlabs, rcclParamNetSharedPoolSlabs()));
+    }
+    state->size = (int64_t)nSlabs * proxyState->p2pChunkSize;
+    NCCLCHECK(ncclCalloc(&state->freeSlabs, nSlabs));
+    // Hand out low slabs first so that a lightly used pool keeps touching the same pages
+    for (int i=0; i<nSlabs; i++) state->freeSlabs[i] = nSlabs-1-i;
+    state->nSlabs = state->nFreeSlabs = nSlabs;
+    state->slabHighWater = 0;
+    pthread_mutex_init(&state->slabLock, NULL);
   }
 
   if (size) *size = state->size;
@@ -544,9 +592,11 @@ static ncclResult_t sharedNetBuffersInit(struct ncclProxyState* proxyState, int
         cuda ? hipDeviceMallocFinegrained : hipDeviceMallocDefault));
 #endif
     }
+    ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, false, state->size);
   }
   if (!cuda && state->hostBuff == NULL) {
-    NCCLCHECK(ncclCudaHostCalloc(&state->hostBuff, state->size));
+    NCCLCHECK(netHostCalloc(proxyState, netDev, &state->hostBuff, state->size));
+    ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, true, state->size);
   }
   if (cpuPtr) *cpuPtr = cuda ? state->cudaBuff : state->hostBuff;
   if (gpuPtr) *gpuPtr = sameProcess ? *cpuPtr : NULL;
@@ -554,14 +604,37 @@ static ncclResult_t sharedNetBuffersInit(struct ncclProxyState* proxyState, int
   return ncclSuccess;
 }
 
-static ncclResult_t sharedBuffersGet(struct ncclProxyState* proxyState, int channel, int slot, int* offset, int* size) {
-  // Use different pools for different channels and also separate send/recv.
-  int globalSlot = (channel*NCCL_SHARED_STEPS)+slot;
-  *offset = proxyState->p2pChunkSize * globalSlot;
+static struct ncclProxySharedP2p* sharedBuffersState(struct ncclProxyState* proxyState, int tpLocalRank, int type) {
+  struct ncclProxyPeer* peer = proxyState->progressState.localPeers[tpLocalRank];
+  return type == 0 ? &peer->send : &peer->recv;
+}
+
+// Leases a slab of the shared buffer, separate for send and recv, unless *slab already holds one
+// (a post that is being retried). Returns *slab = -1 when the pool is exhausted.
+static ncclResult_t sharedBuffersGet(struct ncclProxyState* proxyState, int tpLocalRank, int type, int* slab, int* offset, int* size) {
+  if (*slab == -1) {
+    struct ncclProxySharedP2p* state = sharedBuffersState(proxyState, tpLocalRank, type);
+    pthread_mutex_lock(&state->slabLock);
+    *slab = state->nFreeSlabs ? state->freeSlabs[--state->nFreeSlabs] : -1;
+    state->slabHighWater = std::max(state->slabHighWater, state->nSlabs - state->nFreeSlabs);
+    pthread_mutex_unlock(&state->slabLock);
+  }
+  if (*slab == -1) return ncclSuccess;
+  *offset = proxyState->p2pChunkSize * *slab;
   if (size) *size = proxyState->p2pChunkSize;
   return ncclSuccess;
 }
 
+static ncclResult_t sharedBuffersPut(struct ncclProxyState* proxyState, int tpLocalRank, int type, int* slab) {
+  if (*slab == -1) return ncclSuccess;
+  struct ncclProxySharedP2p* state = sharedBuffersState(proxyState, tpLocalRank, type);
+  pthread_mutex_lock(&state->slabLock);
+  state->freeSlabs[state->nFreeSlabs++] = *slab;
+  pthread_mutex_unlock(&state->slabLock);
+  *slab = -1;
+  return ncclSuccess;
+}
+
 static ncclResult_t sharedNetBuffersDestroy(struct ncclProxyState* proxyState, int tpLocalRank, int type, struct ncclProxyConnection* connection) {
   if (proxyState->progressState.localPeers == NULL) NCCLCHECK(ncclInternalError);
   struct ncclProxyPeer* peer = proxyState->progressState.localPeers[tpLocalRank];
@@ -569,13 +642,17 @@ static ncclResult_t sharedNetBuffersDestroy(struct ncclProxyState* proxyState, i
   struct ncclProxySharedP2p* state = type == 0 ? &peer->send : &peer->recv;
   if (state->size == 0) NCCLCHECK(ncclInternalError);
   if (ncclAtomicRefCountDecrement(&state->refcount) == 0) {
+    INFO(NCCL_NET, "NET/Shared: %s pool of local rank %d used at most %d/%d slabs of %d bytes", type == 0 ? "send" : "recv",
+        tpLocalRank, state->slabHighWater, state->nSlabs, proxyState->p2pChunkSize);
+    free(state->freeSlabs);
+    pthread_mutex_destroy(&state->slabLock);
     if (state->cudaBuff) {
       if (!connection->sameProcess || ncclCuMemEnable()) {
         NCCLCHECK(ncclP2pFreeShareableBuffer(&state->ipcDesc));
       }
       NCCLCHECK(ncclCudaFree(state->cudaBuff));
     }
-    if (state->hostBuff) NCCLCHECK(ncclCudaHostFree(state->hostBuff));
+    if (state->hostBuff) NCCLCHECK(ncclHostPoolFree(state->hostBuff));
   }
 
   if (peer->send.refcount || peer->recv.refcount) return ncclSuccess;
@@ -595,10 +672,88 @@ static ncclResult_t proxySharedInit(struct ncclProxyConnection* connection, stru
   static int is_wsl2 = -1;
   if (is_wsl2 == -1)
     is_wsl2 = (access("/dev/dxg", F_OK) == -1) ? 0 : 1;
-  NCCLCHECK(sharedNetBuffersInit(proxyState, is_wsl2 == 0 ? 1 : 0, connection->tpLocalRank, 0, connection->sameProcess, nChannels, NULL, NULL, NULL, NULL));
+  NCCLCHECK(sharedNetBuffersInit(proxyState, is_wsl2 == 0 ? 1 : 0, connection->tpLocalRank, -1, 0, connection->sameProcess, nChannels, NULL, NULL, NULL, NULL));
   return ncclSuccess;
 }
 
+// With RCCL_NET_SHARE, the sends of the process going through a NIC share its
+// bandwidth between two traffic classes, collectives and p2p, weighted 1 and
+// RCCL_NET_SHARE_P2P_WEIGHT. Each class has a token bucket refilled at its
+// share of the link speed, up to RCCL_NET_SHARE_BURST_BYTES, and a bulk send
+// waits while the bucket of its class is empty. Buckets only throttle while
+// both classes have traffic; a class alone on the NIC gets all of it. Sends up
+// to RCCL_NET_SHARE_SMALL_BYTES are never held back nor charged, so latency
+// bound messages keep strict priority over the bulk of the other class.
+RCCL_PARAM(NetShare, "NET_SHARE", 0);
+RCCL_PARAM(NetShareP2pWeight, "NET_SHARE_P2P_WEIGHT", 4);
+RCCL_PARAM(NetShareSmallBytes, "NET_SHARE_SMALL_BYTES", 65536);
+RCCL_PARAM(NetShareBurstBytes, "NET_SHARE_BURST_BYTES", 4194304);
+
+#define NET_SHARE_MAX_DEVS 64
+#define NET_SHARE_IDLE_NS 200000 // a class without sends for that long yields its share
+enum { netShareColl = 0, netShareP2p = 1, netShareNClasses = 2 };
+
+struct netShare {
+  pthread_mutex_t lock;
+  double bytesPerNs; // link speed from the device properties
+  uint64_t last; // last refill
+  uint64_t lastWant[netShareNClasses]; // last time a send of the class was ready
+  double tokens[netShareNClasses];
+};
+static struct netShare netShares[NET_SHARE_MAX_DEVS];
+static pthread_once_t netShareOnce = PTHREAD_ONCE_INIT;
+
+static void netShareInitOnce() {
+  for (int d = 0; d < NET_SHARE_MAX_DEVS; d++) pthread_mutex_init(&netShares[d].lock, NULL);
+}
+
+static struct netShare* netShareGet(int netDev, int speedMbps) {
+  if (!rcclParamNetShare() || netDev < 0 || netDev >= NET_SHARE_MAX_DEVS || speedMbps <= 0) return NULL;
+  pthread_once(&netShareOnce, netShareInitOnce);
+  struct netShare* share = netShares+netDev;
+  pthread_mutex_lock(&share->lock);
+  if (share->bytesPerNs == 0) {
+    share->bytesPerNs = speedMbps/8000.0;
+    INFO(NCCL_NET, "NET/Share : device %d shared between collectives and p2p (weights 1:%ld) at %.1f GB/s",
+        netDev, rcclParamNetShareP2pWeight(), share->bytesPerNs);
+  }
+  pthread_mutex_unlock(&share->lock);
+  return share;
+}
+
+// Whether a bulk send of class cls may go now
+static bool netShareAdmit(struct netShare* share, int cls) {
+  uint64_t now = clockNano();
+  double weights[netShareNClasses] = { 1.0, (double)std::max(rcclParamNetShareP2pWeight(), 1L) };
+  double burst = (double)rcclParamNetShareBurstBytes();
+  bool ok;
+  pthread_mutex_lock(&share->lock);
+  share->lastWant[cls] = now;
+  bool active[netShareNClasses];
+  double sum = 0;
+  for (int c = 0; c < netShareNClasses; c++) {
+    active[c] = now - share->lastWant[c] < NET_SHARE_IDLE_NS;
+    if (active[c]) sum += weights[c];
+  }
+  double elapsed = (double)(now - share->last);
+  share->last = now;
+  for (int c = 0; c < netShareNClasses; c++) {
+    if (!active[c]) continue;
+    share->tokens[c] = std::min(share->tokens[c] + elapsed*share->bytesPerNs*weights[c]/sum, burst);
+  }
+  // Alone on the NIC, start a contended period with a full bucket
+  if (!active[cls^1]) share->tokens[cls] = burst;
+  ok = share->tokens[cls] > 0;
+  pthread_mutex_unlock(&share->lock);
+  return ok;
+}
+
+static void netShareCharge(struct netShare* share, int cls, int size) {
+  pthread_mutex_lock(&share->lock);
+  share->tokens[cls] -= size;
+  pthread_mutex_unlock(&share->lock);
+}
+
 static ncclResult_t sendProxySetup(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
   struct setupReq* req = (struct setupReq*) reqBuff;
   if (reqSize != sizeof(struct setupReq)) return ncclInternalError;
@@ -615,6 +770,7 @@ static ncclResult_t sendProxySetup(struct ncclProxyConnection* connection, struc
   resources->useGdr = req->useGdr;
   resources->channelId = req->channelId;
   resources->connIndex = req->connIndex;
+  resources->nSteps = req->nSteps;
   resources->curr_hdp_reg = req->curr_hdp_reg;
   ncclNetProperties_t props;
   NCCLCHECK(proxyState->ncclNet->getProperties(req->netDev, &props));
@@ -626,6 +782,7 @@ static ncclResult_t sendProxySetup(struct ncclProxyConnection* connection, struc
 
   resources->netDeviceVersion = props.netDeviceVersion;
   resources->netDeviceType = props.netDeviceType;
+  resources->share = netShareGet(req->netDev, props.speed);
 
   // We don't return any data
   if (respSize != 0) return ncclInternalError;
@@ -650,6 +807,7 @@ static ncclResult_t recvProxySetup(struct ncclProxyConnection* connection, struc
   resources->needFlush = req->needFlush;
   resources->channelId = req->channelId;
   resources->connIndex = req->connIndex;
+  resources->nSteps = req->nSteps;
   ncclNetProperties_t props;
   NCCLCHECK(proxyState->ncclNet->getProperties(req->netDev, &props));
   /* DMA-BUF support */
@@ -711,15 +869,15 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
         NCCLCHECK(ncclCalloc(progressState->netComms + resources->netDev, proxyState->tpnRanks));
       }
       struct ncclSharedNetComms* comms = progressState->netComms[resources->netDev] + resources->tpRemoteRank;
-      if (comms->sendComm[resources->channelId] == NULL) ret = proxyState->ncclNet->connect(resources->netDev, req->handle, comms->sendComm + resources->channelId, &resources->netDeviceHandle);
+      if (comms->sendComm[resources->channelId] == NULL) ret = proxyState->ncclNet->connect(resources->netDev, &req->config, req->handle, comms->sendComm + resources->channelId, &resources->netDeviceHandle);
       resources->netSendComm = comms->sendComm[resources->channelId];
       if (comms->sendComm[resources->channelId]) comms->sendRefCount[resources->channelId]++;
     } else {
-      ret = proxyState->ncclNet->connect(resources->netDev, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
+      ret = proxyState->ncclNet->connect(resources->netDev, &req->config, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
     }
   } else {
     // Connect to remote peer
-    ret = proxyState->ncclNet->connect(resources->netDev, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
+    ret = proxyState->ncclNet->connect(resources->netDev, &req->config, req->handle, &resources->netSendComm, &resources->netDeviceHandle);
     connection->proxyAppendPtr = &connection->proxyAppend;
   }
 
@@ -745,15 +903,15 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
 
   if (resources->shared == 0) { // Only allocate dedicated buffers for ring/tree, not for p2p
     for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
-      NCCL_NET_MAP_ADD_POINTER(map, 0, p!= NCCL_PROTO_LL && resources->useGdr, proxyState->buffSizes[p], buffs[p]);
-      resources->buffSizes[p] = proxyState->buffSizes[p];
+      resources->buffSizes[p] = ncclConnBuffSize(proxyState->buffSizes[p], resources->nSteps);
+      NCCL_NET_MAP_ADD_POINTER(map, 0, p!= NCCL_PROTO_LL && resources->useGdr, resources->buffSizes[p], buffs[p]);
     }
   } else {
     // Get shared buffers
     int bank = resources->useGdr ? NCCL_NET_MAP_SHARED_DEVMEM : NCCL_NET_MAP_SHARED_HOSTMEM;
     struct connectMapMem* mapMem = map->mems+bank;
     NCCLCHECK(sharedNetBuffersInit(
-          proxyState, resources->useGdr, resources->tpLocalRank, 0, map->sameProcess, proxyState->p2pnChannels,
+          proxyState, resources->useGdr, resources->tpLocalRank, resources->netDev, 0, map->sameProcess, proxyState->p2pnChannels,
           &mapMem->gpuPtr, &mapMem->cpuPtr, &mapMem->size, &mapMem->ipcDesc));
     resources->buffSizes[NCCL_PROTO_SIMPLE] = mapMem->size;
 
@@ -789,15 +947,17 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
 #endif
       }
       map->mems[NCCL_NET_MAP_DEVMEM].cpuPtr = map->mems[NCCL_NET_MAP_DEVMEM].gpuPtr;
+      ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, false, map->mems[NCCL_NET_MAP_DEVMEM].size);
     }
   }
   if (map->sameProcess) {
-    NCCLCHECK(ncclCudaHostCalloc(&map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr, map->mems[NCCL_NET_MAP_HOSTMEM].size));
+    NCCLCHECK(netHostCalloc(proxyState, resources->netDev, &map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr, map->mems[NCCL_NET_MAP_HOSTMEM].size));
     map->mems[NCCL_NET_MAP_HOSTMEM].gpuPtr = map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr;
   } else {
     NCCLCHECK(netCreateShm(map->mems+NCCL_NET_MAP_HOSTMEM));
   }
-  if (ncclGdrCopy && map->sameProcess && ncclParamGdrCopySyncEnable()) {
+  ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, true, map->mems[NCCL_NET_MAP_HOSTMEM].size);
+  if (ncclGdrCopyDevice(map->cudaDev) && map->sameProcess && ncclParamGdrCopySyncEnable()) {
     uint64_t *cpuPtr, *gpuPtr;
     NCCLCHECK(ncclGdrCudaCalloc(&cpuPtr, &gpuPtr, 1, &resources->gdrDesc, nullptr));
 
@@ -813,8 +973,8 @@ static ncclResult_t sendProxyConnect(struct ncclProxyConnection* connection, str
 
   // Don't give credits yet in shared mode.
   (resources->gdcSync ? *resources->gdcSync : resources->sendMem->head) =
-    (map->shared ? -NCCL_STEPS : 0);
-  for (int i=0; i<NCCL_STEPS; i++) resources->recvMem->connFifo[i].size = -1;
+    (map->shared ? -resources->nSteps : 0);
+  for (int i=0; i<NCCL_MAX_STEPS; i++) resources->recvMem->connFifo[i].size = -1;
 
   for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
     resources->buffers[p] = NCCL_NET_MAP_GET_POINTER(map, cpu, buffs[p]);
@@ -920,15 +1080,15 @@ static ncclResult_t recvProxyConnect(struct ncclProxyConnection* connection, str
 
   if (resources->shared == 0) { // Only allocate dedicated buffers for ring/tree, not for p2p
     for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
-      NCCL_NET_MAP_ADD_POINTER(map, 0, resources->useGdr, proxyState->buffSizes[p], buffs[p]);
-      resources->buffSizes[p] = proxyState->buffSizes[p];
+      resources->buffSizes[p] = ncclConnBuffSize(proxyState->buffSizes[p], resources->nSteps);
+      NCCL_NET_MAP_ADD_POINTER(map, 0, resources->useGdr, resources->buffSizes[p], buffs[p]);
     }
   } else {
     // Get shared buffers
     int bank = resources->useGdr ? NCCL_NET_MAP_SHARED_DEVMEM : NCCL_NET_MAP_SHARED_HOSTMEM;
     struct connectMapMem* mapMem = map->mems+bank;
     NCCLCHECK(sharedNetBuffersInit(
-          proxyState, resources->useGdr, resources->tpLocalRank, 1, 1, proxyState->p2pnChannels,
+          proxyState, resources->useGdr, resources->tpLocalRank, resources->netDev, 1, 1, proxyState->p2pnChannels,
           &mapMem->gpuPtr, &mapMem->cpuPtr, &mapMem->size, NULL));
     resources->buffSizes[NCCL_PROTO_SIMPLE] = mapMem->size;
     NCCL_NET_MAP_ADD_POINTER(map, 1, resources->useGdr, mapMem->size, buffs[NCCL_PROTO_SIMPLE]);
@@ -962,11 +1122,13 @@ static ncclResult_t recvProxyConnect(struct ncclProxyConnection* connection, str
 #endif
       }
       map->mems[NCCL_NET_MAP_DEVMEM].cpuPtr = map->mems[NCCL_NET_MAP_DEVMEM].gpuPtr;
+      ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, false, map->mems[NCCL_NET_MAP_DEVMEM].size);
     }
   }
-  NCCLCHECK(ncclCudaHostCalloc(&map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr, map->mems[NCCL_NET_MAP_HOSTMEM].size));
+  NCCLCHECK(netHostCalloc(proxyState, resources->netDev, &map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr, map->mems[NCCL_NET_MAP_HOSTMEM].size));
   map->mems[NCCL_NET_MAP_HOSTMEM].gpuPtr = map->mems[NCCL_NET_MAP_HOSTMEM].cpuPtr;
-  if (ncclGdrCopy && map->sameProcess) {
+  ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_NET, true, map->mems[NCCL_NET_MAP_HOSTMEM].size);
+  if (ncclGdrCopyDevice(proxyState->cudaDev) && map->sameProcess) {
     uint64_t *cpuPtr, *gpuPtr;
     NCCLCHECK(ncclGdrCudaCalloc(&cpuPtr, &gpuPtr, 2, &resources->gdrDesc, nullptr));
 
@@ -1038,7 +1200,7 @@ static ncclResult_t sendProxyFree(struct ncclProxyConnection* connection, struct
     }
     struct connectMapMem* mems = resources->map.mems;
     if (resources->map.sameProcess) {
-      NCCLCHECK(ncclCudaHostFree(mems[NCCL_NET_MAP_HOSTMEM].cpuPtr));
+      NCCLCHECK(ncclHostPoolFree(mems[NCCL_NET_MAP_HOSTMEM].cpuPtr));
     } else {
       NCCLCHECK(ncclShmClose(mems[NCCL_NET_MAP_HOSTMEM].createHandle));
     }
@@ -1082,7 +1244,7 @@ static ncclResult_t recvProxyFree(struct ncclProxyConnection* connection, struct
       }
     }
     struct connectMapMem* mems = resources->map.mems;
-    NCCLCHECK(ncclCudaHostFree(mems[NCCL_NET_MAP_HOSTMEM].cpuPtr));
+    NCCLCHECK(ncclHostPoolFree(mems[NCCL_NET_MAP_HOSTMEM].cpuPtr));
     NCCLCHECK(ncclCudaFree(mems[NCCL_NET_MAP_DEVMEM].cpuPtr));
     if (!resources->map.sameProcess || ncclCuMemEnable()) {
       // cuMem API support
@@ -1109,7 +1271,7 @@ static ncclResult_t recvProxyFree(struct ncclProxyConnection* connection, struct
   return ncclSuccess;
 }
 
-static_assert(NCCL_STEPS <= NCCL_NET_MAX_REQUESTS, "Not enough net requests to cover for steps");
+static_assert(NCCL_MAX_STEPS <= NCCL_NET_MAX_REQUESTS, "Not enough net requests to cover for steps");
 #define MAX_NET_SIZE (1024*1024*1024L) // Rather than send INT_MAX which is 2G-1, send a power of two.
 
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_NET_COLLECT_POLL_CNT)
@@ -1129,6 +1291,7 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
       // Set step base for next op
       resources->step = sub->base + sub->nsteps;
       sub->posted = sub->transmitted = sub->done = 0;
+      for (int i=0; i<NCCL_MAX_STEPS; i++) sub->sharedSlabs[i] = -1;
       for (uint64_t step=0; step<sub->nsteps; step++) ncclProfilingRecord(args, s, step, ncclProxyProfileBegin);
       if (sub->reg && sub->nbytes > 0) {
         NCCLCHECK(proxyState->ncclNet->regMr(resources->netSendComm, sub->buffer, sub->nbytes, NCCL_PTR_CUDA, &sub->mhandle));
@@ -1142,29 +1305,32 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
   args->idle = 1;
   if (args->state == ncclProxyOpProgress) {
     int p = args->protocol;
-    int maxDepth = std::min(NCCL_STEPS, NCCL_SHARED_STEPS/args->nsubs);
+    // All subs of an op go through connections of the same pipeline depth
+    int nSteps = ((struct sendNetResources*) (args->subs[0].connection->transportResources))->nSteps;
+    int maxDepth = std::min(nSteps, NCCL_SHARED_STEPS/args->nsubs);
     for (int s=0; s<args->nsubs; s++) {
       struct ncclProxySubArgs* sub = args->subs+s;
       if (sub->done == sub->nsteps) continue;
       struct sendNetResources* resources = (struct sendNetResources*) (sub->connection->transportResources);
       volatile struct ncclConnFifo* connFifo = (volatile struct ncclConnFifo*)resources->recvMem->connFifo;
-      int stepSize = resources->buffSizes[p] / NCCL_STEPS;
+      int stepSize = resources->buffSizes[p] / resources->nSteps;
       char* localBuff = NCCL_NET_MAP_GET_POINTER(&resources->map, cpu, buffs[p]);
       // Post buffers to the GPU
       if (sub->posted < sub->nsteps && sub->posted < sub->done + maxDepth) {
-        int buffSlot = (sub->base+sub->posted)%NCCL_STEPS;
+        int buffSlot = (sub->base+sub->posted)%resources->nSteps;
         if (resources->shared) {
           if (!sub->reg) {
-            int sharedBuffSlot = sub->posted%maxDepth;
             int offset;
-            NCCLCHECK(sharedBuffersGet(proxyState, sub->channelId, sharedBuffSlot*args->nsubs+s, &offset, NULL));
+            NCCLCHECK(sharedBuffersGet(proxyState, resources->tpLocalRank, 0, sub->sharedSlabs+buffSlot, &offset, NULL));
+            // Pool exhausted, wait for other steps to complete
+            if (sub->sharedSlabs[buffSlot] == -1) continue;
             resources->recvMem->connFifo[buffSlot].offset = offset;
             __sync_synchronize();
           }
           volatile uint64_t* sendHead = resources->gdcSync ? resources->gdcSync : &resources->sendMem->head;
           sub->posted += args->sliceSteps;
           // Only post one credit for registered buffer
-          if (sub->reg == 0 || sub->posted == args->sliceSteps) *sendHead = sub->base + sub->posted - NCCL_STEPS;
+          if (sub->reg == 0 || sub->posted == args->sliceSteps) *sendHead = sub->base + sub->posted - resources->nSteps;
           if (resources->gdcSync) wc_store_fence(); // Flush out WC write
         } else sub->posted += args->sliceSteps;
         for (uint64_t step=sub->posted-args->sliceSteps; step<sub->posted; step++) {
@@ -1174,8 +1340,8 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
         continue;
       }
       // Check whether we received data from the GPU and send it to the network
-      if (sub->transmitted < sub->posted && sub->transmitted < sub->done + NCCL_STEPS) {
-        int buffSlot = (sub->base+sub->transmitted)%NCCL_STEPS;
+      if (sub->transmitted < sub->posted && sub->transmitted < sub->done + resources->nSteps) {
+        int buffSlot = (sub->base+sub->transmitted)%resources->nSteps;
         volatile int* sizesFifo = resources->recvMem->sizesFifo;
         volatile uint64_t* recvTail = &resources->recvMem->tail;
         uint64_t tail = sub->base + (sub->reg ? 0 : sub->transmitted);
@@ -1213,6 +1379,9 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
           } else if (p == NCCL_PROTO_SIMPLE && resources->shared) {
             buff = sub->reg ? (char*)sub->buffer : localBuff+resources->recvMem->connFifo[buffSlot].offset;
           }
+          int shareClass = args->pattern == ncclPatternSend ? netShareP2p : netShareColl;
+          bool shareCharged = resources->share && size > rcclParamNetShareSmallBytes();
+          if (ready && shareCharged && !netShareAdmit(resources->share, shareClass)) ready = 0;
           if (ready) {
             // flush HDP if not done
             if (resources->curr_hdp_reg && args->hdp_flushed < *recvTail) {
@@ -1240,6 +1409,7 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
 #endif
 
               TRACE(NCCL_NET, "sendProxy [%ld/%d] Isend posted, req %p", sub->transmitted, buffSlot, sub->requests[buffSlot]);
+              if (shareCharged) netShareCharge(resources->share, shareClass, size);
               sizesFifo[buffSlot] = -1;
               // Make sure size is reset to zero before we update the head.
               __sync_synchronize();
@@ -1251,16 +1421,32 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
           }
         }
       }
-      // Check whether the network has completed some send operations.
-      if (sub->done < sub->transmitted) {
-        int done;
+      // Check whether the network has completed some send operations. A plugin with testAll
+      // tests the whole window of outstanding sends at once, and every completed one is retired.
+      int nTested = 0, nTestDone = 0;
+      int testSizes[NCCL_MAX_STEPS];
+      if (sub->done < sub->transmitted && proxyState->ncclNet->testAll && sub->reg == 0) {
+        void* testRequests[NCCL_MAX_STEPS];
+        for (uint64_t step=sub->done; step<sub->transmitted; step+=args->sliceSteps) {
+          testRequests[nTested++] = sub->requests[(sub->base+step)%resources->nSteps];
+        }
+        NCCLCHECK(proxyState->ncclNet->testAll(nTested, testRequests, &nTestDone, testSizes));
+      }
+      int done = 1;
+      for (int t=0; done && sub->done < sub->transmitted; t++) {
         int size;
-        int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
+        int buffSlot = (sub->base+sub->done)%resources->nSteps;
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_NET_SEND_ENTRY) && defined(ENABLE_NPKIT_EVENT_NET_SEND_EXIT)
         if (sub->timestamp[buffSlot] == 0)
           sub->timestamp[buffSlot] = *(volatile uint64_t*)NpKit::GetCpuTimestamp();
 #endif
-        NCCLCHECK(proxyState->ncclNet->test(sub->requests[buffSlot], &done, &size));
+        if (nTested) {
+          done = t < nTestDone;
+          size = done ? testSizes[t] : 0;
+        } else {
+          if (t > 0) break;
+          NCCLCHECK(proxyState->ncclNet->test(sub->requests[buffSlot], &done, &size));
+        }
         if (done) {
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_EVENT_NET_SEND_ENTRY) && defined(ENABLE_NPKIT_EVENT_NET_SEND_EXIT)
           NpKit::CollectCpuEvent(
@@ -1312,13 +1498,14 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
                 sub->nsteps++;
               } else {
                 // Signal the GPU the send is complete and it can return.
-                connFifo[sub->base%NCCL_STEPS].size = -1;
+                connFifo[sub->base%resources->nSteps].size = -1;
               }
             }
             // Make sure size is reset to -1 before we update the head.
             if (sub->reg == 0) connFifo[buffSlot].size = -1;
             __sync_synchronize();
             TRACE(NCCL_NET, "sendProxy [%ld/%d] request %p done", sub->done, buffSlot, sub->requests[buffSlot]);
+            if (resources->shared) NCCLCHECK(sharedBuffersPut(proxyState, resources->tpLocalRank, 0, sub->sharedSlabs+buffSlot));
             sub->done += args->sliceSteps;
             for (uint64_t step=sub->done-args->sliceSteps; step<sub->done; step++) ncclProfilingRecord(args, s, step, ncclProxyProfileEnd);
 
@@ -1349,6 +1536,24 @@ static ncclResult_t sendProxyProgress(struct ncclProxyState* proxyState, struct
   return ncclSuccess;
 }
 
+// Issue one GDR flush per net device for all the receives that completed during a progress
+// pass, instead of one per receive. The flush read is ordered behind every write the NIC made
+// to GPU memory before it, whichever connection the write belonged to.
+NCCL_PARAM(NetFlushBatch, "NET_FLUSH_BATCH", 0);
+
+struct netFlushBatch {
+  void* request;
+  int refs; // Receives waiting on the flush
+  int done;
+};
+
+static ncclResult_t netFlushBatchTest(struct ncclProxyState* proxyState, struct netFlushBatch* batch, int* done) {
+  if (!batch->done) NCCLCHECK(proxyState->ncclNet->test(batch->request, &batch->done, NULL));
+  *done = batch->done;
+  if (batch->done && --batch->refs == 0) free(batch);
+  return ncclSuccess;
+}
+
 static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct ncclProxyArgs* args) {
 #if defined(ENABLE_NPKIT) && defined(ENABLE_NPKIT_NET_COLLECT_POLL_CNT)
   g_npkit_net_poll_cnt++;
@@ -1386,6 +1591,8 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
       // Set step base for next op
       resources->step = sub->base + sub->nsteps;
       sub->posted = sub->received = sub->transmitted = sub->done = 0;
+      for (int i=0; i<NCCL_MAX_STEPS; i++) sub->sharedSlabs[i] = -1;
+      for (int i=0; i<NCCL_MAX_STEPS; i++) sub->flushBatches[i] = NULL;
       for (int i=0; i<groupSize; i++) sub[-i].groupSize = groupSize;
       for (uint64_t step=0; step<sub->nsteps; step++) ncclProfilingRecord(args, s, step, ncclProxyProfileBegin);
       if (sub->reg && sub->nbytes > 0) {
@@ -1400,7 +1607,9 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
   args->idle = 1;
   if (args->state == ncclProxyOpProgress) {
     int p = args->protocol;
-    int maxDepth = std::min(NCCL_STEPS, NCCL_SHARED_STEPS/args->nsubs);
+    // All subs of an op go through connections of the same pipeline depth
+    int nSteps = ((struct recvNetResources*) (args->subs[0].connection->transportResources))->nSteps;
+    int maxDepth = std::min(nSteps, NCCL_SHARED_STEPS/args->nsubs);
     for (int s=0; s<args->nsubs; s+=args->subs[s].groupSize) {
       struct ncclProxySubArgs* subGroup = args->subs+s;
       int subCount = 0;
@@ -1414,20 +1623,21 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
           if (sub->posted >= sub->done + maxDepth) { subCount = 0; break; }
           struct recvNetResources* resources = (struct recvNetResources*) (sub->connection->transportResources);
           if (sub->reg) maxDepth = 1;
-          int stepSize = resources->buffSizes[p] / NCCL_STEPS;
+          int stepSize = resources->buffSizes[p] / resources->nSteps;
           char* localBuff = NCCL_NET_MAP_GET_POINTER(&resources->map, cpu, buffs[p]);
-          int buffSlot = (sub->base+sub->posted)%NCCL_STEPS;
+          int buffSlot = (sub->base+sub->posted)%resources->nSteps;
           volatile struct ncclConnFifo* connFifo = (volatile struct ncclConnFifo*)resources->recvMem->connFifo;
           if (p == NCCL_PROTO_SIMPLE && resources->shared) {
             if (sub->reg) {
               // Wait until CUDA kernel has started before we access the user buffer directly.
-              if (connFifo[sub->base%NCCL_STEPS].size == -1) continue;
+              if (connFifo[sub->base%resources->nSteps].size == -1) continue;
               ptrs[subCount] = sub->buffer;
               sizes[subCount] = std::min(MAX_NET_SIZE, sub->nbytes);
             } else {
-              int sharedBuffSlot = sub->posted%maxDepth;
               int offset;
-              NCCLCHECK(sharedBuffersGet(proxyState, sub->channelId, sharedBuffSlot*args->nsubs+s+i, &offset, sizes+subCount));
+              NCCLCHECK(sharedBuffersGet(proxyState, resources->tpLocalRank, 1, sub->sharedSlabs+buffSlot, &offset, sizes+subCount));
+              // Pool exhausted, post the group later
+              if (sub->sharedSlabs[buffSlot] == -1) { subCount = 0; break; }
               connFifo[buffSlot].offset = offset;
               ptrs[subCount] = localBuff+offset;
             }
@@ -1442,14 +1652,24 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
           subCount++;
         }
       }
+      if (subCount == 0) {
+        // Give back the slabs leased for a group that could not be posted
+        for (int i=0; i<subGroup->groupSize; i++) {
+          struct ncclProxySubArgs* sub = subGroup + i;
+          if (sub->posted >= sub->nsteps) continue;
+          struct recvNetResources* resources = (struct recvNetResources*) (sub->connection->transportResources);
+          if (resources->shared) NCCLCHECK(sharedBuffersPut(proxyState, resources->tpLocalRank, 1, sub->sharedSlabs+(sub->base+sub->posted)%resources->nSteps));
+        }
+      }
       if (subCount) {
         uint64_t step = subGroup->posted;
         struct recvNetResources* resources = (struct recvNetResources*) (subGroup->connection->transportResources);
-        void** requestPtr = subGroup->requests+(step%NCCL_STEPS);
+        void** requestPtr = subGroup->requests+(step%NCCL_MAX_STEPS);
         NCCLCHECK(proxyState->ncclNet->irecv(resources->netRecvComm, subCount, ptrs, sizes, tags, mhandles, requestPtr));
         if (*requestPtr) {
-          subGroup->recvRequestsCache[step%NCCL_STEPS] = *requestPtr;
+          subGroup->recvRequestsCache[step%NCCL_MAX_STEPS] = *requestPtr;
           subGroup->recvRequestsSubCount = subCount;
+          if (proxyState->peerRecvWaitNs) subGroup->recvPostNs[step%NCCL_MAX_STEPS] = clockNano();
           for (int i=0; i<subGroup->groupSize; i++) {
             struct ncclProxySubArgs* sub = subGroup+i;
 
@@ -1461,7 +1681,7 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
 #else
                 sizes[i],
 #endif
-                uint64_t(sub->requests+(step%NCCL_STEPS))/sizeof(void*),
+                uint64_t(sub->requests+(step%NCCL_MAX_STEPS))/sizeof(void*),
                 *(volatile uint64_t*)NpKit::GetCpuTimestamp(), sub->channelId);
 #if defined(ENABLE_NPKIT_NET_COLLECT_POLL_CNT)
             g_npkit_net_poll_cnt = 0;
@@ -1477,6 +1697,13 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
     }
     if (args->idle == 0) return ncclSuccess;
 
+    // Flushes deferred by NCCL_NET_FLUSH_BATCH: group, step and buffer of one received chunk
+    int nFlush = 0;
+    int flushGroups[NCCL_PROXY_MAX_SUBS];
+    uint64_t flushSteps[NCCL_PROXY_MAX_SUBS];
+    void* flushPtrs[NCCL_PROXY_MAX_SUBS];
+    int flushSizes[NCCL_PROXY_MAX_SUBS];
+    void* flushMhandles[NCCL_PROXY_MAX_SUBS];
     for (int s=0; s<args->nsubs; s+=args->subs[s].groupSize) {
       struct ncclProxySubArgs* subGroup = args->subs+s;
       if (subGroup->posted > subGroup->received) {
@@ -1486,11 +1713,19 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
         int sizes[NCCL_PROXY_MAX_SUBS];
         void* mhandles[NCCL_PROXY_MAX_SUBS];
         for (int i=0; i<NCCL_PROXY_MAX_SUBS; i++) sizes[i] = 0;
-        NCCLCHECK(proxyState->ncclNet->test(subGroup->requests[step%NCCL_STEPS], &done, sizes));
+        NCCLCHECK(proxyState->ncclNet->test(subGroup->requests[step%NCCL_MAX_STEPS], &done, sizes));
         if (done) {
           int needFlush = 0;
           int totalSize = 0;
           int subIndex = 0;
+          if (proxyState->peerRecvWaitNs) {
+            // Time from posting to completion, charged to each sender of the group
+            uint64_t waitNs = clockNano() - subGroup->recvPostNs[step%NCCL_MAX_STEPS];
+            for (int i=0; i<subGroup->groupSize; i++) {
+              struct recvNetResources* resources = (struct recvNetResources*) (subGroup[i].connection->transportResources);
+              __atomic_fetch_add(proxyState->peerRecvWaitNs+resources->tpRemoteRank, waitNs, __ATOMIC_RELAXED);
+            }
+          }
           for (int i=0; i<NCCL_PROXY_MAX_SUBS; i++) totalSize += sizes[i];
           for (int i=0; i<subGroup->groupSize; i++) {
             struct ncclProxySubArgs* sub = subGroup + i;
@@ -1503,7 +1738,7 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
 #else
                 sizes[i],
 #endif
-                uint64_t(sub->requests+(step%NCCL_STEPS))/sizeof(void*),
+                uint64_t(sub->requests+(step%NCCL_MAX_STEPS))/sizeof(void*),
                 *(volatile uint64_t*)NpKit::GetCpuTimestamp(), sub->channelId);
 #if defined(ENABLE_NPKIT_NET_COLLECT_POLL_CNT)
             g_npkit_net_poll_cnt = 0;
@@ -1523,7 +1758,7 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
                   // There is a __sync_synchronize() later to ensure it is reset before it is set again by the GPU.
                   struct recvNetResources* resources = (struct recvNetResources*) (sub->connection->transportResources);
                   volatile struct ncclConnFifo* connFifo = (volatile struct ncclConnFifo*)resources->recvMem->connFifo;
-                  connFifo[sub->base%NCCL_STEPS].size = -1;
+                  connFifo[sub->base%resources->nSteps].size = -1;
                 }
               }
             }
@@ -1534,7 +1769,7 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
               if (resources->useGdr) needFlush |= resources->needFlush;
             }
           }
-          subGroup->requests[step%NCCL_STEPS] = NULL;
+          subGroup->requests[step%NCCL_MAX_STEPS] = NULL;
           if (totalSize > 0 && p == NCCL_PROTO_SIMPLE && needFlush) {
             // GDRCOPY support
             struct recvNetResources* resources = (struct recvNetResources*) (subGroup->connection->transportResources);
@@ -1552,9 +1787,9 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
                 struct ncclProxySubArgs* sub = subGroup + i;
                 if (step < sub->nsteps) {
                   struct recvNetResources* resources = (struct recvNetResources*) (sub->connection->transportResources);
-                  int stepSize = resources->buffSizes[p] / NCCL_STEPS;
+                  int stepSize = resources->buffSizes[p] / resources->nSteps;
                   char* localBuff = NCCL_NET_MAP_GET_POINTER(&resources->map, cpu, buffs[p]);
-                  int buffSlot = (sub->base+sub->received-args->sliceSteps)%NCCL_STEPS;
+                  int buffSlot = (sub->base+sub->received-args->sliceSteps)%resources->nSteps;
                   ptrs[subCount] = resources->shared ?
                     (sub->reg ? sub->buffer : localBuff+resources->recvMem->connFifo[buffSlot].offset) :
                     localBuff+buffSlot*stepSize;
@@ -1563,13 +1798,45 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
                 }
               }
               struct recvNetResources* resources = (struct recvNetResources*) (subGroup->connection->transportResources);
-              NCCLCHECK(proxyState->ncclNet->iflush(resources->netRecvComm, subCount, ptrs, sizes, mhandles, subGroup->requests+(step%NCCL_STEPS)));
+              int last = -1;
+              for (int i=0; i<subCount; i++) if (sizes[i]) last = i;
+              if (ncclParamNetFlushBatch() && last != -1) {
+                flushGroups[nFlush] = s;
+                flushSteps[nFlush] = step;
+                flushPtrs[nFlush] = ptrs[last];
+                flushSizes[nFlush] = sizes[last];
+                flushMhandles[nFlush] = mhandles[last];
+                nFlush++;
+              } else {
+                NCCLCHECK(proxyState->ncclNet->iflush(resources->netRecvComm, subCount, ptrs, sizes, mhandles, subGroup->requests+(step%NCCL_MAX_STEPS)));
+              }
             }
           }
           args->idle = 0;
         }
       }
     }
+    for (int f=0; f<nFlush; f++) {
+      if (flushGroups[f] == -1) continue;
+      // The first receive of each net device flushes for all the others
+      struct recvNetResources* resources = (struct recvNetResources*) (args->subs[flushGroups[f]].connection->transportResources);
+      int netDev = resources->netDev;
+      void* request = NULL;
+      NCCLCHECK(proxyState->ncclNet->iflush(resources->netRecvComm, 1, flushPtrs+f, flushSizes+f, flushMhandles+f, &request));
+      struct netFlushBatch* batch = NULL;
+      if (request) {
+        NCCLCHECK(ncclCalloc(&batch, 1));
+        batch->request = request;
+      }
+      for (int g=f; g<nFlush; g++) {
+        if (flushGroups[g] == -1) continue;
+        struct ncclProxySubArgs* subGroup = args->subs+flushGroups[g];
+        if (((struct recvNetResources*)subGroup->connection->transportResources)->netDev != netDev) continue;
+        subGroup->flushBatches[flushSteps[g]%NCCL_MAX_STEPS] = batch;
+        if (batch) batch->refs++;
+        flushGroups[g] = -1;
+      }
+    }
     if (args->idle == 0) return ncclSuccess;
 
     for (int s=0; s<args->nsubs; s+=args->subs[s].groupSize) {
@@ -1577,8 +1844,13 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
       if (subGroup->received > subGroup->transmitted) {
         uint64_t step = subGroup->transmitted;
         int done = 1;
-        void* request = subGroup->requests[step%NCCL_STEPS];
+        void* request = subGroup->requests[step%NCCL_MAX_STEPS];
+        struct netFlushBatch* batch = (struct netFlushBatch*)subGroup->flushBatches[step%NCCL_MAX_STEPS];
         if (request) NCCLCHECK(proxyState->ncclNet->test(request, &done, NULL));
+        if (batch) {
+          NCCLCHECK(netFlushBatchTest(proxyState, batch, &done));
+          if (done) subGroup->flushBatches[step%NCCL_MAX_STEPS] = NULL;
+        }
         if (done) {
           for (int i=0; i<subGroup->groupSize; i++) {
             struct ncclProxySubArgs* sub = subGroup + i;
@@ -1615,12 +1887,13 @@ static ncclResult_t recvProxyProgress(struct ncclProxyState* proxyState, struct
           while (done > sub->base + sub->done &&
               // LL and LL128 can acknowledge 0-bytes send before they even happen. Don't go past what we transmitted.
               sub->transmitted > sub->done) {
-            if (subGroup->recvRequestsCache[sub->done%NCCL_STEPS]) {
+            if (subGroup->recvRequestsCache[sub->done%NCCL_MAX_STEPS]) {
               // the multirecv requests are only cached in the first sub.
               if (proxyState->ncclNet->irecvConsumed)
-                NCCLCHECK(proxyState->ncclNet->irecvConsumed(resources->netRecvComm, subGroup->recvRequestsSubCount, subGroup->recvRequestsCache[sub->done%NCCL_STEPS]));
-              subGroup->recvRequestsCache[sub->done%NCCL_STEPS] = NULL;
+                NCCLCHECK(proxyState->ncclNet->irecvConsumed(resources->netRecvComm, subGroup->recvRequestsSubCount, subGroup->recvRequestsCache[sub->done%NCCL_MAX_STEPS]));
+              subGroup->recvRequestsCache[sub->done%NCCL_MAX_STEPS] = NULL;
             }
+            if (resources->shared) NCCLCHECK(sharedBuffersPut(proxyState, resources->tpLocalRank, 1, sub->sharedSlabs+(sub->base+sub->done)%resources->nSteps));
             sub->done += args->sliceSteps;
             for (uint64_t step=sub->done-args->sliceSteps; step<sub->done; step++) ncclProfilingRecord(args, s+i, step, ncclProxyProfileEnd);
             args->idle = 0;
@@ -39,6 +39,9 @@ struct ncclIbMr {
   ibv_mr *mr;
 };
 
+// Registrations of a device, shared by all the comms using its PD. Slots are sorted
+// by address and a registration contained in an existing MR takes a reference on
+// it instead of pinning the pages again.
 struct ncclIbMrCache {
   struct ncclIbMr *slots;
   int capacity, population;
@@ -54,6 +57,8 @@ struct alignas(64) ncclIbMergedDev {
   char devName[MAX_MERGED_DEV_NAME]; // Up to NCCL_IB_MAX_DEVS_PER_NIC * name size, and a character for each '+'
 };
 
+struct ncclIbSharedCq;
+
 static int ncclNIbDevs = -1;
 struct alignas(64) ncclIbDev {
   pthread_mutex_t lock;
@@ -72,6 +77,8 @@ struct alignas(64) ncclIbDev {
   struct ncclIbMrCache mrCache;
   int ar; // ADAPTIVE_ROUTING
   struct ibv_port_attr portAttr;
+  struct ncclIbSharedCq* sharedCq; // Protected by lock
+  int portDown; // Set by the async thread when the port goes down, see ncclIbFailQp
 };
 
 #define MAX_IB_DEVS 32
@@ -79,6 +86,8 @@ struct ncclIbMergedDev ncclIbMergedDevs[MAX_IB_DEVS];
 struct ncclIbDev ncclIbDevs[MAX_IB_DEVS];
 pthread_mutex_t ncclIbLock = PTHREAD_MUTEX_INITIALIZER;
 static int ncclIbRelaxedOrderingEnabled = 0;
+// Bumped on every port failure so that comms only rescan their QPs when something changed
+static uint64_t ncclIbPortEvents = 0;
 
 NCCL_PARAM(IbGidIndex, "IB_GID_INDEX", 0);
 NCCL_PARAM(IbTimeout, "IB_TIMEOUT", 18);
@@ -101,6 +110,16 @@ static void* ncclIbAsyncThreadMain(void* args) {
     if (ncclSuccess != wrap_ibv_event_type_str(&str, event.event_type)) { break; }
     if (event.event_type != IBV_EVENT_COMM_EST)
       WARN("NET/IB : %s:%d Got async event : %s", dev->devName, dev->portNum, str);
+    // Ports of a device share its context, so the event may be for a sibling port
+    if (event.event_type == IBV_EVENT_PORT_ERR || event.event_type == IBV_EVENT_PORT_ACTIVE || event.event_type == IBV_EVENT_DEVICE_FATAL) {
+      for (int d = 0; d < ncclNIbDevs; d++) {
+        struct ncclIbDev* ibDev = ncclIbDevs+d;
+        if (ibDev->context != dev->context) continue;
+        if (event.event_type != IBV_EVENT_DEVICE_FATAL && ibDev->portNum != event.element.port_num) continue;
+        __atomic_store_n(&ibDev->portDown, event.event_type != IBV_EVENT_PORT_ACTIVE, __ATOMIC_RELEASE);
+      }
+      if (event.event_type != IBV_EVENT_PORT_ACTIVE) __atomic_fetch_add(&ncclIbPortEvents, 1, __ATOMIC_RELEASE);
+    }
     if (ncclSuccess != wrap_ibv_ack_async_event(&event)) { break; }
   }
   return NULL;
@@ -497,6 +516,12 @@ struct ncclIbConnectionMetadata {
   char devName[MAX_MERGED_DEV_NAME];
   uint64_t fifoAddr;
   int ndevs;
+  int srq; // Receiver QPs use a shared receive queue, see ncclIbMultiSend
+  // Traffic class and service level of the connection. The sender picks them from its
+  // comm config and the receiver echoes them back, so both ends program the same values.
+  int tc;
+  int sl;
+  int failover; // Both ends can move traffic off a failed QP, see ncclIbFailQp
 };
 
 enum ncclIbCommState {
@@ -542,15 +567,22 @@ struct ncclIbRequest {
   int events[NCCL_IB_MAX_DEVS_PER_NIC];
   struct ncclIbNetCommDevBase* devBases[NCCL_IB_MAX_DEVS_PER_NIC];
   int nreqs;
+  int replays; // Chunks of a failed QP the sender has yet to confirm over the socket
   union {
     struct {
       int size;
       void* data;
       uint32_t lkeys[NCCL_IB_MAX_DEVS_PER_NIC];
       int offset;
+      int host; // data is in host memory, small writes can be inlined
     } send;
     struct {
       int* sizes;
+      // Failover only: QP each chunk comes on and whether it is still expected as a
+      // completion, as a replay notice, or already arrived
+      uint64_t idx;
+      int qps[NCCL_IB_MAX_DEVS_PER_NIC];
+      int chunks[NCCL_IB_MAX_DEVS_PER_NIC];
     } recv;
   };
 };
@@ -559,7 +591,7 @@ struct ncclIbNetCommDevBase {
   int ibDevN;
   struct ibv_pd* pd;
   struct ibv_cq* cq;
-  uint64_t pad[1];
+  struct ncclIbSharedCq* sharedCq; // Non-NULL when cq is the device-wide shared CQ
   struct ncclIbGidInfo gidInfo;
 };
 
@@ -576,13 +608,16 @@ struct alignas(64) ncclIbSendFifo {
   uint32_t nreqs;
   uint32_t tag;
   uint64_t idx;
-  char padding[24];
+  uint32_t reqId; // Receiver request, returned as immediate data in SRQ mode
+  char padding[20];
 };
 
 struct ncclIbQp {
   struct ibv_qp* qp;
   int devIndex;
   int remDevIdx;
+  int maxInline;
+  int failed; // Traffic moved to another QP, see ncclIbFailQp
 };
 
 struct ncclIbRemSizesFifo {
@@ -605,6 +640,7 @@ struct alignas(8) ncclIbSendCommDev {
 // Wrapper to track an MR per-device, if needed
 struct ncclIbMrHandle {
   ibv_mr* mrs[NCCL_IB_MAX_DEVS_PER_NIC];
+  int type;
 };
 
 struct alignas(32) ncclIbNetCommBase {
@@ -620,6 +656,95 @@ struct alignas(32) ncclIbNetCommBase {
   // Track necessary remDevInfo here
   int nRemDevs;
   struct ncclIbDevInfo remDevs[NCCL_IB_MAX_DEVS_PER_NIC];
+  // Receiver uses a shared receive queue: immediate data carries the receive request index and sizes go through the sizes fifo
+  int srq;
+  // NIC failover
+  int failover;
+  int nFailed;
+  int noticesClosed; // The peer closed the socket, no more failover notices
+  uint64_t portEvents; // ncclIbPortEvents when the QPs were last checked
+  uint64_t noticePoll;
+};
+
+// NIC failover: when a port of a merged NIC goes down or a QP gets an error completion,
+// the QP is moved to the error state and its traffic to a QP of another device. The
+// peer is told over the socket of the connection, which is otherwise idle once the QPs
+// are connected. The sender keeps the WR chains in flight on each QP and replays those
+// of a failed QP as plain RDMA writes, then notifies the receiver of every replayed
+// chunk once its write completed, in place of the immediate data that is lost.
+#define NCCL_IB_FAILOVER_QP_FAILED 1
+#define NCCL_IB_FAILOVER_REPLAYED 2
+#define NCCL_IB_FAILOVER_POLL_NS 1000000
+struct ncclIbFailoverMsg {
+  int type;
+  int qp; // QP index, the same on both ends
+  int reqId; // Receive request of a replayed chunk
+  uint64_t idx; // Fifo index of its message, tells a late notice from one for a reused request
+  int nreqs;
+  int lens[NCCL_NET_IB_MAX_RECVS]; // Bytes of the chunk for each receive
+  int sizes[NCCL_NET_IB_MAX_RECVS]; // Total size of each send
+};
+
+// State of a receive chunk
+#define NCCL_IB_CHUNK_CQE 0
+#define NCCL_IB_CHUNK_NOTICE 1
+#define NCCL_IB_CHUNK_DONE 2
+
+// Receiver fifo writes are told from receives by their wr_id, even when flushed
+#define NCCL_IB_CTS_WRID (1ULL<<32)
+#define NCCL_IB_CTS_SIGNALED (1ULL<<33)
+
+// Each chain posted on a send QP completes once, so a success retires the oldest one.
+// A message has at most one chain per device on any QP, replays included.
+#define NCCL_IB_FAILOVER_RING (NCCL_IB_MAX_DEVS_PER_NIC*MAX_REQUESTS)
+struct ncclIbFailoverChain {
+  uint64_t wr_id;
+  int nreqs;
+  int reqId; // Receive request
+  uint64_t idx;
+  int qp; // QP the receiver expects the chunk on
+  int replay; // Notify the receiver when it completes
+  struct {
+    int offset; // Into the send buffer
+    int len;
+    uint64_t addr; // Remote address of the chunk
+    uint32_t rkeys[NCCL_IB_MAX_DEVS_PER_NIC];
+  } chunks[NCCL_NET_IB_MAX_RECVS];
+};
+
+struct ncclIbFailoverRing {
+  struct ncclIbFailoverChain chains[NCCL_IB_FAILOVER_RING];
+  uint64_t head, tail;
+};
+
+// Selective signaling: only every Nth send WR on a QP requests a CQE. Unsignaled sends
+// are completed when a later signaled WR of the same QP completes, since a QP completes
+// its WRs in order. Producer is the posting thread, consumer may be a shared CQ poller.
+#define NCCL_IB_SIGNAL_RING (4*MAX_REQUESTS)
+#define NCCL_IB_SIGNAL_FENCE (1ULL<<63)
+struct ncclIbSendQpSignal {
+  uint64_t unsig[NCCL_IB_SIGNAL_RING]; // wr_id of unsignaled sends
+  uint64_t sigMark[NCCL_IB_SIGNAL_RING]; // unsigTail when each signaled WR was posted | FENCE
+  uint64_t unsigHead, unsigTail;
+  uint64_t sigHead, sigTail;
+  int count; // Sends posted since the last signaled one
+};
+
+// Doorbell coalescing: WR chains of consecutive sends are held back and posted with a
+// single ibv_post_send per QP.
+struct ncclIbSendBatch {
+  struct ibv_send_wr* wrs;
+  struct ibv_sge* sges;
+  int nwrs;
+  int nsends;
+};
+
+// QP spraying: bytes posted on a QP and not completed yet. Every send is signaled,
+// so each send completion on a QP retires the oldest length posted on it.
+struct ncclIbQpLoad {
+  int len[MAX_REQUESTS];
+  uint64_t head, tail;
+  uint64_t outstanding;
 };
 
 struct ncclIbSendComm {
@@ -633,6 +758,14 @@ struct ncclIbSendComm {
   struct ncclIbRemSizesFifo remSizesFifo;
   uint64_t fifoHead;
   int ar; // Use adaptive routing when all merged devices have it enabled
+  int signalInterval;
+  int postBatch;
+  struct ncclIbSendQpSignal* qpSignal; // [nqps], NULL when every send is signaled
+  struct ncclIbSendBatch* batch; // [nqps], NULL when sends are posted immediately
+  struct ncclIbQpLoad* qpLoad; // [nqps], NULL unless data is sprayed by QP load
+  struct ncclIbFailoverRing* failoverRings; // [nqps], NULL without failover
+  struct ncclIbFailoverMsg* notices; // Replay notices to send
+  int nNotices;
 };
 // The SendFifo needs to be 32-byte aligned and each element needs
 // to be a 32-byte multiple, so that an entry does not get split and
@@ -676,12 +809,141 @@ struct ncclIbRecvComm {
 static_assert((offsetof(struct ncclIbRecvComm, remFifo) % 32) == 0, "ncclIbRecvComm fifo must be 32-byte aligned");
 
 NCCL_PARAM(IbQpsPerConn, "IB_QPS_PER_CONNECTION", 1);
+NCCL_PARAM(IbSharedCq, "IB_SHARED_CQ", 0);
+NCCL_PARAM(IbSharedCqSize, "IB_SHARED_CQ_SIZE", 65536);
+NCCL_PARAM(IbSrq, "IB_SRQ", 0);
+NCCL_PARAM(IbSrqSize, "IB_SRQ_SIZE", 16384);
+NCCL_PARAM(IbSignalInterval, "IB_SIGNAL_INTERVAL", 1);
+NCCL_PARAM(IbPostBatch, "IB_POST_BATCH", 1);
+NCCL_PARAM(IbQpSpray, "IB_QP_SPRAY", 0);
+NCCL_PARAM(IbSplitDataOnQps, "IB_SPLIT_DATA_ON_QPS", 0);
+NCCL_PARAM(IbFailover, "IB_FAILOVER", 1);
+#define NCCL_IB_MAX_POST_BATCH 16
+
+// Failover needs every send WR chain to complete exactly once and the completions of a
+// comm to be processed by its own thread, so it is limited to the default posting modes.
+static int ncclIbFailoverCapable(int ndevs) {
+  return ncclParamIbFailover() && ndevs > 1 && ncclParamIbSplitDataOnQps() == 0 && ncclParamIbSharedCq() == 0 &&
+    ncclParamIbSrq() == 0 && ncclParamIbSignalInterval() <= 1 && ncclParamIbPostBatch() <= 1;
+}
 
 static void ncclIbAddEvent(struct ncclIbRequest* req, int devIndex, struct ncclIbNetCommDevBase* base) {
-  req->events[devIndex]++;
+  // Completions may already be processed by another thread when using a shared CQ
+  __atomic_fetch_add(&req->events[devIndex], 1, __ATOMIC_RELAXED);
   req->devBases[devIndex] = base;
 }
 
+// Shared CQ mode: all comms on a device share one CQ so that a single poll returns
+// completions for every peer. Completions are dispatched to their comm through a
+// qp_num lookup table, then to the request through wr_id as usual.
+// SRQ mode builds on it: all QPs of the device also share one receive queue, so
+// that receive WQEs no longer scale with the number of peers.
+#define NCCL_IB_SHARED_CQ_BUCKETS 1024
+struct ncclIbSharedCqQp {
+  uint32_t qpn;
+  int devIndex;
+  struct ncclIbNetCommBase* comm;
+  struct ncclIbSharedCqQp* next;
+};
+
+struct ncclIbSharedCq {
+  pthread_mutex_t lock; // Serializes polling and updates of the qp table
+  struct ibv_cq* cq;
+  int refs;
+  int cqe;  // Size of the CQ
+  int used; // CQ entries reserved by comms
+  struct ibv_srq* srq; // Shared receive queue, NULL unless NCCL_IB_SRQ is set
+  int srqSize;
+  int srqPosted; // Receive WQEs currently posted to the SRQ
+  struct ncclIbSharedCqQp* qps[NCCL_IB_SHARED_CQ_BUCKETS];
+};
+
+// Attach to the shared CQ of a device, reserving cqe entries. Returns NULL in *sharedCq
+// when the shared CQ is full so that the caller falls back to a private CQ.
+static ncclResult_t ncclIbSharedCqGet(struct ncclIbDev* ibDev, int cqe, struct ncclIbSharedCq** sharedCq) {
+  ncclResult_t res = ncclSuccess;
+  *sharedCq = NULL;
+  pthread_mutex_lock(&ibDev->lock);
+  if (ibDev->sharedCq == NULL) {
+    struct ncclIbSharedCq* cq;
+    NCCLCHECKGOTO(ncclCalloc(&cq, 1), res, exit);
+    cq->cqe = std::max<int>(ncclParamIbSharedCqSize(), cqe);
+    res = wrap_ibv_create_cq(&cq->cq, ibDev->context, cq->cqe, NULL, NULL, 0);
+    if (res != ncclSuccess) {
+      free(cq);
+      goto exit;
+    }
+    pthread_mutex_init(&cq->lock, NULL);
+    if (ncclParamIbSrq()) {
+      struct ibv_srq_init_attr srqAttr;
+      memset(&srqAttr, 0, sizeof(srqAttr));
+      srqAttr.attr.max_wr = cq->srqSize = ncclParamIbSrqSize();
+      srqAttr.attr.max_sge = 1;
+      if (wrap_ibv_create_srq(&cq->srq, ibDev->pd, &srqAttr) != ncclSuccess) {
+        INFO(NCCL_NET, "NET/IB : Failed to create SRQ on %s, using per-QP receive queues", ibDev->devName);
+        cq->srq = NULL;
+      }
+    }
+    ibDev->sharedCq = cq;
+    INFO(NCCL_NET, "NET/IB : Created shared CQ with %d entries on %s%s", cq->cqe, ibDev->devName, cq->srq ? " with SRQ" : "");
+  }
+  if (ibDev->sharedCq->used + cqe <= ibDev->sharedCq->cqe) {
+    ibDev->sharedCq->used += cqe;
+    ibDev->sharedCq->refs++;
+    *sharedCq = ibDev->sharedCq;
+  } else {
+    INFO(NCCL_NET, "NET/IB : Shared CQ on %s is full (%d entries), using a private CQ", ibDev->devName, ibDev->sharedCq->cqe);
+  }
+exit:
+  pthread_mutex_unlock(&ibDev->lock);
+  return res;
+}
+
+static ncclResult_t ncclIbSharedCqRelease(struct ncclIbDev* ibDev, int cqe) {
+  ncclResult_t res = ncclSuccess;
+  pthread_mutex_lock(&ibDev->lock);
+  struct ncclIbSharedCq* cq = ibDev->sharedCq;
+  cq->used -= cqe;
+  if (--cq->refs == 0) {
+    if (cq->srq) res = wrap_ibv_destroy_srq(cq->srq);
+    if (res == ncclSuccess) res = wrap_ibv_destroy_cq(cq->cq);
+    pthread_mutex_destroy(&cq->lock);
+    free(cq);
+    ibDev->sharedCq = NULL;
+  }
+  pthread_mutex_unlock(&ibDev->lock);
+  return res;
+}
+
+static ncclResult_t ncclIbSharedCqAddQp(struct ncclIbNetCommDevBase* base, struct ibv_qp* qp, struct ncclIbNetCommBase* comm, int devIndex) {
+  struct ncclIbSharedCq* cq = base->sharedCq;
+  if (cq == NULL) return ncclSuccess;
+  struct ncclIbSharedCqQp* entry;
+  NCCLCHECK(ncclCalloc(&entry, 1));
+  entry->qpn = qp->qp_num;
+  entry->devIndex = devIndex;
+  entry->comm = comm;
+  pthread_mutex_lock(&cq->lock);
+  entry->next = cq->qps[qp->qp_num % NCCL_IB_SHARED_CQ_BUCKETS];
+  cq->qps[qp->qp_num % NCCL_IB_SHARED_CQ_BUCKETS] = entry;
+  pthread_mutex_unlock(&cq->lock);
+  return ncclSuccess;
+}
+
+static void ncclIbSharedCqDelQp(struct ncclIbNetCommDevBase* base, struct ibv_qp* qp) {
+  struct ncclIbSharedCq* cq = base->sharedCq;
+  if (cq == NULL || qp == NULL) return;
+  pthread_mutex_lock(&cq->lock);
+  struct ncclIbSharedCqQp** entry = cq->qps + (qp->qp_num % NCCL_IB_SHARED_CQ_BUCKETS);
+  while (*entry && (*entry)->qpn != qp->qp_num) entry = &(*entry)->next;
+  if (*entry) {
+    struct ncclIbSharedCqQp* del = *entry;
+    *entry = del->next;
+    free(del);
+  }
+  pthread_mutex_unlock(&cq->lock);
+}
+
 ncclResult_t ncclIbInitCommDevBase(int ibDevN, struct ncclIbNetCommDevBase* base) {
   base->ibDevN = ibDevN;
   ncclIbDev* ibDev = ncclIbDevs + ibDevN;
@@ -699,14 +961,25 @@ ncclResult_t ncclIbInitCommDevBase(int ibDevN, struct ncclIbNetCommDevBase* base
   pthread_mutex_unlock(&ibDev->lock);
 
   // Recv requests can generate 2 completions (one for the post FIFO, one for the Recv).
-  NCCLCHECK(wrap_ibv_create_cq(&base->cq, ibDev->context, 2*MAX_REQUESTS*ncclParamIbQpsPerConn(), NULL, NULL, 0));
+  int cqe = 2*MAX_REQUESTS*ncclParamIbQpsPerConn();
+  base->sharedCq = NULL;
+  if (ncclParamIbSharedCq() || ncclParamIbSrq()) NCCLCHECK(ncclIbSharedCqGet(ibDev, cqe, &base->sharedCq));
+  if (base->sharedCq) {
+    base->cq = base->sharedCq->cq;
+  } else {
+    NCCLCHECK(wrap_ibv_create_cq(&base->cq, ibDev->context, cqe, NULL, NULL, 0));
+  }
 
   return ncclSuccess;
 }
 
 ncclResult_t ncclIbDestroyBase(struct ncclIbNetCommDevBase* base) {
   ncclResult_t res;
-  NCCLCHECK(wrap_ibv_destroy_cq(base->cq));
+  if (base->sharedCq) {
+    NCCLCHECK(ncclIbSharedCqRelease(ncclIbDevs+base->ibDevN, 2*MAX_REQUESTS*ncclParamIbQpsPerConn()));
+  } else {
+    NCCLCHECK(wrap_ibv_destroy_cq(base->cq));
+  }
 
   pthread_mutex_lock(&ncclIbDevs[base->ibDevN].lock);
   if (0 == --ncclIbDevs[base->ibDevN].pdRefs) {
@@ -718,6 +991,15 @@ returning:
   return res;
 }
 
+// Sends of at most this many bytes from host memory are written inline in the WQE,
+// saving the NIC a DMA read of the payload on the latency path. This covers the LL
+// buffers, which the net transport always keeps in host memory.
+NCCL_PARAM(IbInlineData, "IB_INLINE_DATA", 256);
+#define NCCL_IB_MAX_INLINE_DATA 512
+static int ncclIbInlineBytes() {
+  return std::min(std::max((int)ncclParamIbInlineData(), 0), NCCL_IB_MAX_INLINE_DATA);
+}
+
 ncclResult_t ncclIbCreateQp(uint8_t ib_port, struct ncclIbNetCommDevBase* base, int access_flags, struct ncclIbQp* qp) {
   struct ibv_qp_init_attr qpInitAttr;
   memset(&qpInitAttr, 0, sizeof(struct ibv_qp_init_attr));
@@ -729,8 +1011,21 @@ ncclResult_t ncclIbCreateQp(uint8_t ib_port, struct ncclIbNetCommDevBase* base,
   qpInitAttr.cap.max_recv_wr = MAX_REQUESTS;
   qpInitAttr.cap.max_send_sge = 1;
   qpInitAttr.cap.max_recv_sge = 1;
-  qpInitAttr.cap.max_inline_data = ncclParamIbUseInline() ? sizeof(struct ncclIbSendFifo) : 0;
-  NCCLCHECK(wrap_ibv_create_qp(&qp->qp, base->pd, &qpInitAttr));
+  qpInitAttr.cap.max_inline_data = std::max(ncclParamIbUseInline() ? (int)sizeof(struct ncclIbSendFifo) : 0, ncclIbInlineBytes());
+  if (base->sharedCq && base->sharedCq->srq) {
+    qpInitAttr.srq = base->sharedCq->srq;
+    qpInitAttr.cap.max_recv_wr = 0;
+  }
+  if (wrap_ibv_create_qp(&qp->qp, base->pd, &qpInitAttr) != ncclSuccess) {
+    // Not every provider supports that much inline data, fall back to what IB_USE_INLINE needs
+    int fifoInline = ncclParamIbUseInline() ? (int)sizeof(struct ncclIbSendFifo) : 0;
+    if (qpInitAttr.cap.max_inline_data == fifoInline) return ncclSystemError;
+    INFO(NCCL_NET, "NET/IB : Failed to create a QP with %d bytes of inline data, retrying with %d", qpInitAttr.cap.max_inline_data, fifoInline);
+    qpInitAttr.cap.max_inline_data = fifoInline;
+    NCCLCHECK(wrap_ibv_create_qp(&qp->qp, base->pd, &qpInitAttr));
+  }
+  // The provider reports what it actually supports
+  qp->maxInline = qpInitAttr.cap.max_inline_data;
   struct ibv_qp_attr qpAttr;
   memset(&qpAttr, 0, sizeof(struct ibv_qp_attr));
   qpAttr.qp_state = IBV_QPS_INIT;
@@ -741,7 +1036,7 @@ ncclResult_t ncclIbCreateQp(uint8_t ib_port, struct ncclIbNetCommDevBase* base,
   return ncclSuccess;
 }
 
-ncclResult_t ncclIbRtrQp(struct ibv_qp* qp, uint32_t dest_qp_num, struct ncclIbDevInfo* info) {
+ncclResult_t ncclIbRtrQp(struct ibv_qp* qp, uint32_t dest_qp_num, struct ncclIbDevInfo* info, int tc, int sl) {
   struct ibv_qp_attr qpAttr;
   memset(&qpAttr, 0, sizeof(struct ibv_qp_attr));
   qpAttr.qp_state = IBV_QPS_RTR;
@@ -757,12 +1052,12 @@ ncclResult_t ncclIbRtrQp(struct ibv_qp* qp, uint32_t dest_qp_num, struct ncclIbD
     qpAttr.ah_attr.grh.flow_label = 0;
     qpAttr.ah_attr.grh.sgid_index = ncclParamIbGidIndex();
     qpAttr.ah_attr.grh.hop_limit = 255;
-    qpAttr.ah_attr.grh.traffic_class = ncclParamIbTc();
+    qpAttr.ah_attr.grh.traffic_class = tc;
   } else {
     qpAttr.ah_attr.is_global = 0;
     qpAttr.ah_attr.dlid = info->lid;
   }
-  qpAttr.ah_attr.sl = ncclParamIbSl();
+  qpAttr.ah_attr.sl = sl;
   qpAttr.ah_attr.src_path_bits = 0;
   qpAttr.ah_attr.port_num = info->ib_port;
   NCCLCHECK(wrap_ibv_modify_qp(qp, &qpAttr, IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN | IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER));
@@ -797,7 +1092,7 @@ ncclResult_t ncclIbListen(int dev, void* opaqueHandle, void** listenComm) {
   return ncclSuccess;
 }
 
-ncclResult_t ncclIbConnect(int dev, void* opaqueHandle, void** sendComm, ncclNetDeviceHandle_t** /*sendDevComm*/) {
+ncclResult_t ncclIbConnect(int dev, ncclNetCommConfig_t* config, void* opaqueHandle, void** sendComm, ncclNetDeviceHandle_t** /*sendDevComm*/) {
   struct ncclIbHandle* handle = (struct ncclIbHandle*) opaqueHandle;
   struct ncclIbCommStage* stage = &handle->stage;
   struct ncclIbSendComm* comm = (struct ncclIbSendComm*)stage->comm;
@@ -816,20 +1111,32 @@ ncclResult_t ncclIbConnect(int dev, void* opaqueHandle, void** sendComm, ncclNet
   NCCLCHECK(ncclIbMalloc((void**)&comm, sizeof(struct ncclIbSendComm)));
   NCCLCHECK(ncclSocketInit(&comm->base.sock, &handle->connectAddr, handle->magic, ncclSocketTypeNetIb, NULL, 1));
   stage->comm = comm;
-  stage->state = ncclIbCommStateConnect;
   NCCLCHECK(ncclSocketConnect(&comm->base.sock));
 
-ib_connect_check:
-  /* since ncclSocketConnect is async, we must check if connection is complete */
-  NCCLCHECK(ncclSocketReady(&comm->base.sock, &ready));
-  if (!ready) return ncclSuccess;
-
-  // IB Setup
+  // IB Setup. None of it depends on the peer, so the QPs are created and the fifo
+  // registered while the socket connection is still being established.
   struct ncclIbMergedDev* mergedDev;
   mergedDev = ncclIbMergedDevs + dev;
   comm->base.ndevs = mergedDev->ndevs;
   comm->base.nqps = ncclParamIbQpsPerConn() * comm->base.ndevs; // We must have at least 1 qp per-device
   comm->base.isSend = true;
+  comm->signalInterval = std::min(std::max((int)ncclParamIbSignalInterval(), 1), MAX_REQUESTS);
+  comm->postBatch = std::min(std::max((int)ncclParamIbPostBatch(), 1), NCCL_IB_MAX_POST_BATCH);
+  if (comm->signalInterval > 1) NCCLCHECK(ncclCalloc(&comm->qpSignal, comm->base.nqps));
+  if (comm->postBatch > 1) {
+    NCCLCHECK(ncclCalloc(&comm->batch, comm->base.nqps));
+    for (int q = 0; q < comm->base.nqps; q++) {
+      NCCLCHECK(ncclCalloc(&comm->batch[q].wrs, comm->postBatch*(NCCL_NET_IB_MAX_RECVS+1)));
+      NCCLCHECK(ncclCalloc(&comm->batch[q].sges, comm->postBatch*(NCCL_NET_IB_MAX_RECVS+1)));
+    }
+  }
+  if (ncclParamIbQpSpray() && ncclParamIbSplitDataOnQps() && comm->base.nqps > 1) {
+    if (comm->signalInterval > 1) {
+      INFO(NCCL_NET, "NET/IB : QP spraying needs every send signaled, ignoring NCCL_IB_QP_SPRAY with NCCL_IB_SIGNAL_INTERVAL=%d", comm->signalInterval);
+    } else {
+      NCCLCHECK(ncclCalloc(&comm->qpLoad, comm->base.nqps));
+    }
+  }
 
   // Init PD, Ctx for each IB device
   comm->ar = 1; // Set to 1 for logic
@@ -841,6 +1148,13 @@ ib_connect_check:
 
   struct ncclIbConnectionMetadata meta;
   meta.ndevs = comm->base.ndevs;
+  meta.srq = 0;
+  meta.failover = ncclIbFailoverCapable(comm->base.ndevs);
+  meta.tc = (config && config->trafficClass != NCCL_NET_TRAFFIC_CLASS_UNDEF) ? config->trafficClass : ncclParamIbTc();
+  meta.sl = (config && config->serviceLevel != NCCL_NET_TRAFFIC_CLASS_UNDEF) ? config->serviceLevel : ncclParamIbSl();
+  if (meta.tc != ncclParamIbTc() || meta.sl != ncclParamIbSl()) {
+    INFO(NCCL_NET, "NET/IB : Dev %d connection uses traffic class %d service level %d from the comm config", dev, meta.tc, meta.sl);
+  }
 
   // Alternate QPs between devices
   int devIndex;
@@ -849,6 +1163,7 @@ ib_connect_check:
     ncclIbSendCommDev* commDev = comm->devs + devIndex;
     ncclIbDev* ibDev = ncclIbDevs + commDev->base.ibDevN;
     NCCLCHECK(ncclIbCreateQp(ibDev->portNum, &commDev->base, IBV_ACCESS_REMOTE_WRITE, comm->base.qps+q));
+    NCCLCHECK(ncclIbSharedCqAddQp(&commDev->base, comm->base.qps[q].qp, &comm->base, devIndex));
     comm->base.qps[q].devIndex = devIndex;
     meta.qpInfo[q].qpn      = comm->base.qps[q].qp->qp_num;
     meta.qpInfo[q].devIndex = comm->base.qps[q].devIndex;
@@ -905,12 +1220,18 @@ ib_connect_check:
   meta.fifoAddr = (uint64_t)comm->fifo;
   strncpy(meta.devName, mergedDev->devName, MAX_MERGED_DEV_NAME);
 
-  stage->state = ncclIbCommStateSend;
+  stage->state = ncclIbCommStateConnect;
   stage->offset = 0;
   NCCLCHECK(ncclIbMalloc((void**)&stage->buffer, sizeof(meta)));
 
   memcpy(stage->buffer, &meta, sizeof(meta));
 
+ib_connect_check:
+  /* since ncclSocketConnect is async, we must check if connection is complete */
+  NCCLCHECK(ncclSocketReady(&comm->base.sock, &ready));
+  if (!ready) return ncclSuccess;
+  stage->state = ncclIbCommStateSend;
+
 ib_send:
   NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_SEND, &comm->base.sock, stage->buffer, sizeof(meta), &stage->offset));
   if (stage->offset != sizeof(meta)) return ncclSuccess;
@@ -928,6 +1249,13 @@ ib_connect:
   memcpy(&remMeta, stage->buffer, sizeof(ncclIbConnectionMetadata));
 
   comm->base.nRemDevs = remMeta.ndevs;
+  comm->base.srq = remMeta.srq;
+  comm->base.failover = remMeta.failover;
+  if (comm->base.failover) {
+    NCCLCHECK(ncclCalloc(&comm->failoverRings, comm->base.nqps));
+    NCCLCHECK(ncclCalloc(&comm->notices, NCCL_IB_FAILOVER_RING));
+    comm->base.portEvents = ~0ULL; // Check the ports on the first send
+  }
   if (comm->base.nRemDevs != comm->base.ndevs) {
     mergedDev = ncclIbMergedDevs + dev;
     WARN("NET/IB : Local mergedDev=%s has a different number of devices=%d as remoteDev=%s nRemDevs=%d",
@@ -971,7 +1299,7 @@ ib_connect:
     if (remQpInfo->ece_supported && remQpInfo->ece_supported)
       NCCLCHECK(wrap_ibv_set_ece(qp, &remQpInfo->ece, &remQpInfo->ece_supported));
 
-    NCCLCHECK(ncclIbRtrQp(qp, remQpInfo->qpn, remDevInfo));
+    NCCLCHECK(ncclIbRtrQp(qp, remQpInfo->qpn, remDevInfo, remMeta.tc, remMeta.sl));
     NCCLCHECK(ncclIbRtsQp(qp));
   }
 
@@ -1020,26 +1348,9 @@ ncclResult_t ncclIbAccept(void* listenComm, void** recvComm, ncclNetDeviceHandle
 
   NCCLCHECK(ncclIbMalloc((void**)&rComm, sizeof(struct ncclIbRecvComm)));
   stage->comm = rComm;
-  stage->state = ncclIbCommStateAccept;
   NCCLCHECK(ncclSocketInit(&rComm->base.sock));
   NCCLCHECK(ncclSocketAccept(&rComm->base.sock, &lComm->sock));
 
-ib_accept_check:
-  NCCLCHECK(ncclSocketReady(&rComm->base.sock, &ready));
-  if (!ready) return ncclSuccess;
-
-  struct ncclIbConnectionMetadata remMeta;
-  stage->state = ncclIbCommStateRecv;
-  stage->offset = 0;
-  NCCLCHECK(ncclIbMalloc((void**)&stage->buffer, sizeof(remMeta)));
-
-ib_recv:
-  NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, &rComm->base.sock, stage->buffer, sizeof(remMeta), &stage->offset));
-  if (stage->offset != sizeof(remMeta)) return ncclSuccess;
-
-  /* copy back the received info */
-  memcpy(&remMeta, stage->buffer, sizeof(struct ncclIbConnectionMetadata));
-
   // IB setup
   // Pre-declare variables because of goto
   struct ncclIbMergedDev* mergedDev;
@@ -1048,20 +1359,15 @@ ib_recv:
   struct ncclIbRecvCommDev* rCommDev;
   struct ncclIbDevInfo* remDevInfo;
   struct ncclIbQp* qp;
+  int devIndex;
 
+  // Everything up to the creation of the QPs is local, do it while the sender
+  // connects and sends its metadata. Only the transitions to RTR/RTS need the peer.
   mergedDev = ncclIbMergedDevs + lComm->dev;
   rComm->base.ndevs = mergedDev->ndevs;
   rComm->base.nqps  = ncclParamIbQpsPerConn() * rComm->base.ndevs; // We must have at least 1 qp per-device
   rComm->base.isSend = false;
 
-  rComm->base.nRemDevs = remMeta.ndevs;
-  if (rComm->base.nRemDevs != rComm->base.ndevs) {
-    WARN("NET/IB : Local mergedDev %s has a different number of devices=%d as remote %s %d",
-      mergedDev->devName, rComm->base.ndevs, remMeta.devName, rComm->base.nRemDevs);
-  }
-
-  // Metadata to send back to requestor (sender)
-  struct ncclIbConnectionMetadata meta;
   for (int i = 0; i < rComm->base.ndevs; i++) {
     rCommDev = rComm->devs + i;
     ibDevN = mergedDev->devs[i];
@@ -1071,6 +1377,42 @@ ib_recv:
     NCCLCHECK(wrap_ibv_query_gid(ibDev->context, ibDev->portNum, ncclParamIbGidIndex(), &rCommDev->base.gidInfo.localGid));
   }
 
+  // Stripe QP creation across merged devs
+  devIndex = 0;
+  for (int q = 0; q < rComm->base.nqps; q++) {
+    qp = rComm->base.qps+q;
+    rCommDev = rComm->devs + devIndex;
+    ibDev = ncclIbDevs + rCommDev->base.ibDevN;
+    NCCLCHECK(ncclIbCreateQp(ibDev->portNum, &rCommDev->base, IBV_ACCESS_REMOTE_WRITE, qp));
+    NCCLCHECK(ncclIbSharedCqAddQp(&rCommDev->base, qp->qp, &rComm->base, devIndex));
+    qp->devIndex = devIndex;
+    devIndex = (devIndex + 1) % rComm->base.ndevs;
+  }
+  stage->state = ncclIbCommStateAccept;
+
+ib_accept_check:
+  NCCLCHECK(ncclSocketReady(&rComm->base.sock, &ready));
+  if (!ready) return ncclSuccess;
+
+  struct ncclIbConnectionMetadata remMeta;
+  stage->state = ncclIbCommStateRecv;
+  stage->offset = 0;
+  NCCLCHECK(ncclIbMalloc((void**)&stage->buffer, sizeof(remMeta)));
+
+ib_recv:
+  NCCLCHECK(ncclSocketProgress(NCCL_SOCKET_RECV, &rComm->base.sock, stage->buffer, sizeof(remMeta), &stage->offset));
+  if (stage->offset != sizeof(remMeta)) return ncclSuccess;
+
+  /* copy back the received info */
+  memcpy(&remMeta, stage->buffer, sizeof(struct ncclIbConnectionMetadata));
+
+  mergedDev = ncclIbMergedDevs + lComm->dev;
+  rComm->base.nRemDevs = remMeta.ndevs;
+  if (rComm->base.nRemDevs != rComm->base.ndevs) {
+    WARN("NET/IB : Local mergedDev %s has a different number of devices=%d as remote %s %d",
+      mergedDev->devName, rComm->base.ndevs, remMeta.devName, rComm->base.nRemDevs);
+  }
+
   // Copy remDevInfo for things like remGidInfo, remFifoAddr, etc.
   for (int i = 0; i < remMeta.ndevs; i++) {
     rComm->base.remDevs[i] = remMeta.devs[i];
@@ -1078,25 +1420,18 @@ ib_recv:
     rComm->base.remDevs[i].remoteGid.global.subnet_prefix = rComm->base.remDevs[i].spn;
   }
 
-  // Stripe QP creation across merged devs
+  // Metadata to send back to requestor (sender)
+  struct ncclIbConnectionMetadata meta;
+  meta.tc = remMeta.tc;
+  meta.sl = remMeta.sl;
   // Make sure to get correct remote peer dev and QP info
   int remDevIndex;
-  int devIndex;
-  devIndex = 0;
   for (int q = 0; q < rComm->base.nqps; q++) {
     remDevIndex = remMeta.qpInfo[q].devIndex;
     remDevInfo = remMeta.devs + remDevIndex;
     qp = rComm->base.qps+q;
-    rCommDev = rComm->devs + devIndex;
     qp->remDevIdx = remDevIndex;
 
-    // Local ibDevN
-    ibDevN = rComm->devs[devIndex].base.ibDevN;
-    ibDev = ncclIbDevs + ibDevN;
-    NCCLCHECK(ncclIbCreateQp(ibDev->portNum, &rCommDev->base, IBV_ACCESS_REMOTE_WRITE, qp));
-    qp->devIndex = devIndex;
-    devIndex = (devIndex + 1) % rComm->base.ndevs;
-
     // Set the ece (enhanced connection establishment) on this QP before RTR
     if (remMeta.qpInfo[q].ece_supported) {
       NCCLCHECK(wrap_ibv_set_ece(qp->qp, &remMeta.qpInfo[q].ece, &meta.qpInfo[q].ece_supported));
@@ -1107,7 +1442,7 @@ ib_recv:
         NCCLCHECK(wrap_ibv_query_ece(qp->qp, &meta.qpInfo[q].ece, &meta.qpInfo[q].ece_supported));
     }
 
-    NCCLCHECK(ncclIbRtrQp(qp->qp, remMeta.qpInfo[q].qpn, remDevInfo));
+    NCCLCHECK(ncclIbRtrQp(qp->qp, remMeta.qpInfo[q].qpn, remDevInfo, remMeta.tc, remMeta.sl));
     NCCLCHECK(ncclIbRtsQp(qp->qp));
   }
 
@@ -1133,6 +1468,7 @@ ib_recv:
       rCommDev->gpuFlush.sge.length = 1;
       rCommDev->gpuFlush.sge.lkey = rCommDev->gpuFlush.hostMr->lkey;
       NCCLCHECK(ncclIbCreateQp(ibDev->portNum, &rCommDev->base, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ, &rCommDev->gpuFlush.qp));
+      NCCLCHECK(ncclIbSharedCqAddQp(&rCommDev->base, rCommDev->gpuFlush.qp.qp, &rComm->base, i));
       struct ncclIbDevInfo devInfo;
       devInfo.lid         = ibDev->portAttr.lid;
       devInfo.link_layer  = ibDev->portAttr.link_layer;
@@ -1140,7 +1476,7 @@ ib_recv:
       devInfo.spn         = rCommDev->base.gidInfo.localGid.global.subnet_prefix;
       devInfo.iid         = rCommDev->base.gidInfo.localGid.global.interface_id;
       devInfo.mtu         = ibDev->portAttr.active_mtu;
-      NCCLCHECK(ncclIbRtrQp(rCommDev->gpuFlush.qp.qp, rCommDev->gpuFlush.qp.qp->qp_num, &devInfo));
+      NCCLCHECK(ncclIbRtrQp(rCommDev->gpuFlush.qp.qp, rCommDev->gpuFlush.qp.qp->qp_num, &devInfo, ncclParamIbTc(), ncclParamIbSl()));
       NCCLCHECK(ncclIbRtsQp(rCommDev->gpuFlush.qp.qp));
     }
 
@@ -1161,12 +1497,19 @@ ib_recv:
   }
   meta.fifoAddr = (uint64_t)rComm->sizesFifo;
 
+  rComm->base.srq = 0;
   for (int q = 0; q < rComm->base.nqps; q++) {
     meta.qpInfo[q].qpn      = rComm->base.qps[q].qp->qp_num;
     meta.qpInfo[q].devIndex = rComm->base.qps[q].devIndex;
+    if (rComm->base.qps[q].qp->srq) rComm->base.srq = 1;
   }
 
   meta.ndevs = rComm->base.ndevs;
+  meta.srq = rComm->base.srq;
+  meta.failover = rComm->base.failover = remMeta.failover && ncclIbFailoverCapable(rComm->base.ndevs) &&
+    rComm->base.nRemDevs == rComm->base.ndevs && !rComm->base.srq;
+  rComm->base.portEvents = ~0ULL;
+  if (rComm->base.failover) INFO(NCCL_NET, "NET/IB : %s connection fails over between its %d devices", mergedDev->devName, rComm->base.ndevs);
   strncpy(meta.devName, mergedDev->devName, MAX_MERGED_DEV_NAME);
 
   stage->state = ncclIbCommStateSend;
@@ -1206,6 +1549,7 @@ ncclResult_t ncclIbGetRequest(struct ncclIbNetCommBase* base, struct ncclIbReque
       r->devBases[0] = NULL;
       r->devBases[1] = NULL;
       r->events[0] = r->events[1] = 0;
+      r->replays = 0;
       *req = r;
       return ncclSuccess;
     }
@@ -1264,6 +1608,7 @@ ncclResult_t ncclIbRegMrDmaBufInternal(ncclIbNetCommDevBase* base, void* data, s
       goto returning;
     } else if ((addr >= cache->slots[slot].addr) &&
         ((addr-cache->slots[slot].addr)/pageSize+pages) <= cache->slots[slot].pages) {
+      TRACE(NCCL_NET,"regAddr=0x%lx size=%lld reusing mr at 0x%lx refs=%d", (unsigned long)addr, (long long)pages*pageSize, cache->slots[slot].addr, cache->slots[slot].refs+1);
       cache->slots[slot].refs += 1;
       *mhandle = cache->slots[slot].mr;
       res = ncclSuccess;
@@ -1290,6 +1635,7 @@ ncclResult_t ncclIbRegMrDmaBuf(void* comm, void* data, size_t size, int type, ui
   assert(size > 0);
   struct ncclIbNetCommBase* base = (struct ncclIbNetCommBase*) comm;
   struct ncclIbMrHandle* mhandleWrapper = (struct ncclIbMrHandle*) malloc(sizeof(struct ncclIbMrHandle));
+  mhandleWrapper->type = type;
   for (int i = 0; i < base->ndevs; i++) {
     // Each ncclIbNetCommDevBase is at different offset in send and recv netComms
     struct ncclIbNetCommDevBase* devComm = ncclIbGetNetCommDevBase(base, i);
@@ -1310,7 +1656,8 @@ ncclResult_t ncclIbDeregMrInternal(ncclIbNetCommDevBase* base, ibv_mr* mhandle)
   for (int i=0; i < cache->population; i++) {
     if (mhandle == cache->slots[i].mr) {
       if (0 == --cache->slots[i].refs) {
-        memmove(&cache->slots[i], &cache->slots[--cache->population], sizeof(struct ncclIbMr));
+        // Keep the slots sorted, lookups stop at the first higher address
+        memmove(&cache->slots[i], &cache->slots[i+1], (--cache->population-i)*sizeof(struct ncclIbMr));
         if (cache->population == 0) {
           free(cache->slots);
           cache->slots = NULL;
@@ -1341,7 +1688,398 @@ ncclResult_t ncclIbDeregMr(void* comm, void* mhandle) {
   return ncclSuccess;
 }
 
-NCCL_PARAM(IbSplitDataOnQps, "IB_SPLIT_DATA_ON_QPS", 0);
+static bool ncclIbSendSignal(struct ncclIbSendComm* comm, int qpIndex, uint64_t wr_id) {
+  if (comm->qpSignal == NULL) return true;
+  struct ncclIbSendQpSignal* s = comm->qpSignal+qpIndex;
+  bool full = s->unsigTail - __atomic_load_n(&s->unsigHead, __ATOMIC_ACQUIRE) >= NCCL_IB_SIGNAL_RING;
+  if (++s->count < comm->signalInterval && !full) {
+    s->unsig[s->unsigTail % NCCL_IB_SIGNAL_RING] = wr_id;
+    __atomic_store_n(&s->unsigTail, s->unsigTail+1, __ATOMIC_RELEASE);
+    return false;
+  }
+  s->count = 0;
+  s->sigMark[s->sigTail % NCCL_IB_SIGNAL_RING] = s->unsigTail;
+  __atomic_store_n(&s->sigTail, s->sigTail+1, __ATOMIC_RELEASE);
+  return true;
+}
+
+static ncclResult_t ncclIbSendFlush(struct ncclIbSendComm* comm, int qpIndex) {
+  struct ncclIbSendBatch* b = comm->batch+qpIndex;
+  if (b->nwrs == 0) return ncclSuccess;
+  struct ibv_send_wr* bad_wr;
+  NCCLCHECK(wrap_ibv_post_send(comm->base.qps[qpIndex].qp, b->wrs, &bad_wr));
+  b->nwrs = b->nsends = 0;
+  return ncclSuccess;
+}
+
+// Post the WR chain comm->wrs..lastWr on a QP, or append it to that QP's pending batch
+static ncclResult_t ncclIbSendPost(struct ncclIbSendComm* comm, int qpIndex, struct ibv_send_wr* lastWr) {
+  lastWr->send_flags = (lastWr->send_flags & IBV_SEND_INLINE) | (ncclIbSendSignal(comm, qpIndex, lastWr->wr_id) ? IBV_SEND_SIGNALED : 0);
+  if (comm->batch == NULL) {
+    struct ibv_send_wr* bad_wr;
+    NCCLCHECK(wrap_ibv_post_send(comm->base.qps[qpIndex].qp, comm->wrs, &bad_wr));
+    return ncclSuccess;
+  }
+  // The template WRs and sges are rewritten for the next QP/send, so take a copy
+  struct ncclIbSendBatch* b = comm->batch+qpIndex;
+  int n = lastWr - comm->wrs + 1;
+  for (int w = 0; w < n; w++) {
+    struct ibv_send_wr* wr = b->wrs+b->nwrs+w;
+    *wr = comm->wrs[w];
+    if (wr->num_sge) {
+      b->sges[b->nwrs+w] = *wr->sg_list;
+      wr->sg_list = b->sges+b->nwrs+w;
+    }
+    wr->next = w < n-1 ? wr+1 : NULL;
+  }
+  if (b->nwrs) b->wrs[b->nwrs-1].next = b->wrs+b->nwrs;
+  b->nwrs += n;
+  if (++b->nsends == comm->postBatch) NCCLCHECK(ncclIbSendFlush(comm, qpIndex));
+  return ncclSuccess;
+}
+
+// Called when a send is tested: post pending batches, and make sure trailing unsignaled
+// sends get a completion by posting a signaled 0-byte write when nothing signaled is in flight.
+static ncclResult_t ncclIbSendProgress(struct ncclIbSendComm* comm) {
+  for (int q = 0; q < comm->base.nqps; q++) {
+    if (comm->batch) NCCLCHECK(ncclIbSendFlush(comm, q));
+    if (comm->qpSignal == NULL) continue;
+    struct ncclIbSendQpSignal* s = comm->qpSignal+q;
+    if (__atomic_load_n(&s->sigHead, __ATOMIC_ACQUIRE) != s->sigTail) continue;
+    if (__atomic_load_n(&s->unsigHead, __ATOMIC_ACQUIRE) == s->unsigTail) continue;
+    ncclIbQp* qp = comm->base.qps+q;
+    struct ibv_send_wr wr;
+    memset(&wr, 0, sizeof(wr));
+    wr.opcode = IBV_WR_RDMA_WRITE;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.wr.rdma.remote_addr = comm->remSizesFifo.addr;
+    wr.wr.rdma.rkey = comm->remSizesFifo.rkeys[qp->devIndex];
+    s->count = 0;
+    s->sigMark[s->sigTail % NCCL_IB_SIGNAL_RING] = s->unsigTail | NCCL_IB_SIGNAL_FENCE;
+    __atomic_store_n(&s->sigTail, s->sigTail+1, __ATOMIC_RELEASE);
+    struct ibv_send_wr* bad_wr;
+    NCCLCHECK(wrap_ibv_post_send(qp->qp, &wr, &bad_wr));
+  }
+  return ncclSuccess;
+}
+
+// Splits size bytes (a multiple of align) over n QPs so that, given the bytes
+// already outstanding on each, they all drain at the same time: the least
+// loaded QPs are filled up to a common level. A slow QP thus gets less or no
+// data instead of holding up the whole message.
+static void ncclIbSprayLengths(uint64_t* load, int n, int size, int align, int* lens) {
+  int order[NCCL_IB_MAX_QPS];
+  for (int i = 0; i < n; i++) {
+    int j = i;
+    while (j > 0 && load[order[j-1]] > load[i]) { order[j] = order[j-1]; j--; }
+    order[j] = i;
+    lens[i] = 0;
+  }
+  // Take QPs in load order until the next one is already above the fill level
+  uint64_t sum = 0;
+  int k = 0;
+  while (k < n) {
+    sum += load[order[k++]];
+    if (k == n || load[order[k]]*k >= sum + size) break;
+  }
+  uint64_t level = (sum + size) / k;
+  int remaining = size;
+  for (int j = 0; j < k && remaining > 0; j++) {
+    int q = order[j];
+    int len = level > load[q] ? std::min((int)DIVUP(level - load[q], align) * align, remaining) : 0;
+    lens[q] = len;
+    remaining -= len;
+  }
+  lens[order[0]] += remaining;
+  for (int i = 0; i < n; i++) load[i] += lens[i];
+}
+
+static ncclResult_t ncclIbQpLoadCompletion(struct ncclIbSendComm* comm, struct ibv_wc* wc) {
+  int q = 0;
+  while (q < comm->base.nqps && comm->base.qps[q].qp->qp_num != wc->qp_num) q++;
+  if (q == comm->base.nqps) {
+    WARN("NET/IB: send completion for unknown qp_num %u", wc->qp_num);
+    return ncclInternalError;
+  }
+  struct ncclIbQpLoad* l = comm->qpLoad+q;
+  if (l->head == __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE)) {
+    WARN("NET/IB: send completion on qp %d with nothing posted", q);
+    return ncclInternalError;
+  }
+  __atomic_fetch_sub(&l->outstanding, (uint64_t)l->len[l->head % MAX_REQUESTS], __ATOMIC_RELAXED);
+  __atomic_store_n(&l->head, l->head+1, __ATOMIC_RELEASE);
+  return ncclSuccess;
+}
+
+// Any other QP that has not failed, preferably on another device
+static int ncclIbFailoverQp(struct ncclIbNetCommBase* base, int q) {
+  int fallback = -1;
+  for (int i = 1; i < base->nqps; i++) {
+    int h = (q+i) % base->nqps;
+    if (base->qps[h].failed) continue;
+    if (base->qps[h].devIndex != base->qps[q].devIndex) return h;
+    if (fallback == -1) fallback = h;
+  }
+  return fallback;
+}
+
+static ncclResult_t ncclIbFailoverPush(struct ncclIbSendComm* comm, int q, struct ncclIbFailoverChain* chain) {
+  struct ncclIbFailoverRing* ring = comm->failoverRings+q;
+  if (ring->tail - ring->head == NCCL_IB_FAILOVER_RING) {
+    WARN("NET/IB : too many sends in flight on qp %d to track them for failover", q);
+    return ncclInternalError;
+  }
+  ring->chains[ring->tail % NCCL_IB_FAILOVER_RING] = *chain;
+  ring->tail++;
+  return ncclSuccess;
+}
+
+// Post a chain of the failed QP from as plain RDMA writes on a healthy QP. Its requests
+// now expect that completion on the device of the new QP.
+static ncclResult_t ncclIbFailoverPost(struct ncclIbSendComm* comm, int from, struct ncclIbFailoverChain* chain) {
+  int h = ncclIbFailoverQp(&comm->base, from);
+  if (h == -1) {
+    WARN("NET/IB : no healthy qp left to replay the sends of qp %d", from);
+    return ncclRemoteError;
+  }
+  struct ncclIbQp* qp = comm->base.qps+h;
+  int fromDev = comm->base.qps[from].devIndex;
+  struct ibv_send_wr wrs[NCCL_NET_IB_MAX_RECVS];
+  struct ibv_sge sges[NCCL_NET_IB_MAX_RECVS];
+  int nwrs = 0;
+  for (int r = 0; r < chain->nreqs; r++) {
+    struct ncclIbRequest* req = comm->base.reqs+((chain->wr_id >> (r*8)) & 0xff);
+    ncclIbAddEvent(req, qp->devIndex, &comm->devs[qp->devIndex].base);
+    __atomic_fetch_sub(&req->events[fromDev], 1, __ATOMIC_RELEASE);
+    if (chain->chunks[r].len == 0) continue;
+    struct ibv_send_wr* wr = wrs+nwrs;
+    memset(wr, 0, sizeof(struct ibv_send_wr));
+    sges[nwrs].addr = (uint64_t)req->send.data + chain->chunks[r].offset;
+    sges[nwrs].length = chain->chunks[r].len;
+    sges[nwrs].lkey = req->send.lkeys[qp->devIndex];
+    wr->sg_list = sges+nwrs;
+    wr->num_sge = 1;
+    wr->opcode = IBV_WR_RDMA_WRITE;
+    wr->wr.rdma.remote_addr = chain->chunks[r].addr;
+    wr->wr.rdma.rkey = chain->chunks[r].rkeys[qp->remDevIdx];
+    if (nwrs) wrs[nwrs-1].next = wr;
+    nwrs++;
+  }
+  if (nwrs == 0) {
+    // No data, a 0-byte write like in ncclIbSendProgress gives the completion
+    memset(wrs, 0, sizeof(struct ibv_send_wr));
+    wrs[0].opcode = IBV_WR_RDMA_WRITE;
+    wrs[0].wr.rdma.remote_addr = comm->remSizesFifo.addr;
+    wrs[0].wr.rdma.rkey = comm->remSizesFifo.rkeys[qp->remDevIdx];
+    nwrs = 1;
+  }
+  wrs[nwrs-1].wr_id = chain->wr_id;
+  wrs[nwrs-1].send_flags = IBV_SEND_SIGNALED;
+  chain->replay = 1;
+  NCCLCHECK(ncclIbFailoverPush(comm, h, chain));
+  struct ibv_send_wr* bad_wr;
+  NCCLCHECK(wrap_ibv_post_send(qp->qp, wrs, &bad_wr));
+  return ncclSuccess;
+}
+
+// Account for a chunk of a receive arriving on QP q, by completion or by replay notice.
+// Duplicates happen when the sender replays a chunk whose write did land.
+static ncclResult_t ncclIbFailoverChunkDone(struct ncclIbRecvComm* comm, struct ncclIbRequest* req, int q, int len, int* sizes) {
+  if (req->type != NCCL_NET_IB_REQ_RECV) {
+    WARN("NET/IB: receive chunk on qp %d for req->type=%d", q, req->type);
+    return ncclInternalError;
+  }
+  for (int j = 0; j < comm->base.ndevs; j++) {
+    if (req->recv.qps[j] != q || req->recv.chunks[j] == NCCL_IB_CHUNK_DONE) continue;
+    if (req->nreqs == 1) {
+      req->recv.sizes[0] += len;
+    } else if (sizes) {
+      for (int r = 0; r < req->nreqs; r++) req->recv.sizes[r] = sizes[r];
+    }
+    if (req->recv.chunks[j] == NCCL_IB_CHUNK_CQE) {
+      __atomic_fetch_sub(&req->events[comm->base.qps[q].devIndex], 1, __ATOMIC_RELEASE);
+    } else {
+      req->replays--;
+    }
+    req->recv.chunks[j] = NCCL_IB_CHUNK_DONE;
+    break;
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclIbPostCts(struct ncclIbRecvComm* comm, struct ncclIbQp* ctsQp, int slot, int n, struct ncclIbRequest* signalReq);
+
+static ncclResult_t ncclIbFailoverReplay(struct ncclIbSendComm* comm, int q) {
+  struct ncclIbFailoverRing* ring = comm->failoverRings+q;
+  for (; ring->head < ring->tail; ring->head++) {
+    NCCLCHECK(ncclIbFailoverPost(comm, q, ring->chains + ring->head % NCCL_IB_FAILOVER_RING));
+  }
+  return ncclSuccess;
+}
+
+// The chunks still expected on QP q will come as replays. Fifo writes in flight on it
+// may be lost, so those of all pending receives are written again through QP h.
+static ncclResult_t ncclIbFailoverRecvQp(struct ncclIbRecvComm* comm, int q, int h) {
+  for (int i = 0; i < MAX_REQUESTS; i++) {
+    struct ncclIbRequest* req = comm->base.reqs+i;
+    if (req->type != NCCL_NET_IB_REQ_RECV) continue;
+    for (int j = 0; j < comm->base.ndevs; j++) {
+      if (req->recv.qps[j] != q || req->recv.chunks[j] != NCCL_IB_CHUNK_CQE) continue;
+      req->replays++;
+      req->recv.chunks[j] = NCCL_IB_CHUNK_NOTICE;
+      __atomic_fetch_sub(&req->events[comm->base.qps[q].devIndex], 1, __ATOMIC_RELEASE);
+    }
+    if (q < comm->base.ndevs) NCCLCHECK(ncclIbPostCts(comm, comm->base.qps+h, (req->recv.idx-1) % MAX_REQUESTS, req->nreqs, NULL));
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclIbFailQp(struct ncclIbNetCommBase* base, int q, const char* reason, bool notify) {
+  struct ncclIbQp* qp = base->qps+q;
+  if (qp->failed) return ncclSuccess;
+  int h = ncclIbFailoverQp(base, q);
+  qp->failed = 1;
+  base->nFailed++;
+  struct ncclIbDev* ibDev = ncclIbDevs + ncclIbGetNetCommDevBase(base, qp->devIndex)->ibDevN;
+  union ncclSocketAddress addr;
+  ncclSocketGetAddr(&base->sock, &addr);
+  char line[SOCKET_NAME_MAXLEN+1];
+  if (h == -1) {
+    WARN("NET/IB : %s qp %d on %s:%d to peer %s failed (%s) and no other device of the NIC is usable",
+        base->isSend ? "Send" : "Recv", q, ibDev->devName, ibDev->portNum, ncclSocketToString(&addr, line), reason);
+    return ncclRemoteError;
+  }
+  struct ncclIbDev* hDev = ncclIbDevs + ncclIbGetNetCommDevBase(base, base->qps[h].devIndex)->ibDevN;
+  WARN("NET/IB : %s qp %d on %s:%d to peer %s failed (%s), moving its traffic to qp %d on %s:%d",
+      base->isSend ? "Send" : "Recv", q, ibDev->devName, ibDev->portNum, ncclSocketToString(&addr, line), reason, h, hDev->devName, hDev->portNum);
+
+  // Flush the WRs still queued on it instead of waiting for their retries to run out
+  struct ibv_qp_attr qpAttr;
+  memset(&qpAttr, 0, sizeof(struct ibv_qp_attr));
+  qpAttr.qp_state = IBV_QPS_ERR;
+  NCCLCHECK(wrap_ibv_modify_qp(qp->qp, &qpAttr, IBV_QP_STATE));
+  if (notify && !base->noticesClosed) {
+    struct ncclIbFailoverMsg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = NCCL_IB_FAILOVER_QP_FAILED;
+    msg.qp = q;
+    NCCLCHECK(ncclSocketSend(&base->sock, &msg, sizeof(msg)));
+  }
+  if (base->isSend) return ncclIbFailoverReplay((struct ncclIbSendComm*)base, q);
+  return ncclIbFailoverRecvQp((struct ncclIbRecvComm*)base, q, h);
+}
+
+static ncclResult_t ncclIbFailoverSendNotices(struct ncclIbSendComm* comm) {
+  for (int n = 0; n < comm->nNotices && !comm->base.noticesClosed; n++) {
+    NCCLCHECK(ncclSocketSend(&comm->base.sock, comm->notices+n, sizeof(struct ncclIbFailoverMsg)));
+  }
+  comm->nNotices = 0;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclIbFailoverNotice(struct ncclIbNetCommBase* base, struct ncclIbFailoverMsg* msg) {
+  if (msg->qp < 0 || msg->qp >= base->nqps) {
+    WARN("NET/IB : failover notice type %d for unknown qp %d", msg->type, msg->qp);
+    return ncclInternalError;
+  }
+  if (msg->type == NCCL_IB_FAILOVER_QP_FAILED) return ncclIbFailQp(base, msg->qp, "reported by the peer", false);
+  if (msg->type == NCCL_IB_FAILOVER_REPLAYED && !base->isSend && msg->reqId >= 0 && msg->reqId < MAX_REQUESTS) {
+    struct ncclIbRequest* req = base->reqs+msg->reqId;
+    // The receive may be over already if the replayed chunk had landed the first time
+    if (req->type != NCCL_NET_IB_REQ_RECV || req->recv.idx != msg->idx) return ncclSuccess;
+    return ncclIbFailoverChunkDone((struct ncclIbRecvComm*)base, req, msg->qp, msg->lens[0], msg->sizes);
+  }
+  WARN("NET/IB : unexpected failover notice type %d", msg->type);
+  return ncclInternalError;
+}
+
+// Fail the QPs of ports that went down, send queued notices and process those of the peer
+static ncclResult_t ncclIbFailoverProgress(struct ncclIbNetCommBase* base) {
+  uint64_t portEvents = __atomic_load_n(&ncclIbPortEvents, __ATOMIC_ACQUIRE);
+  if (portEvents != base->portEvents) {
+    base->portEvents = portEvents;
+    for (int q = 0; q < base->nqps; q++) {
+      struct ncclIbDev* ibDev = ncclIbDevs + ncclIbGetNetCommDevBase(base, base->qps[q].devIndex)->ibDevN;
+      if (__atomic_load_n(&ibDev->portDown, __ATOMIC_ACQUIRE)) NCCLCHECK(ncclIbFailQp(base, q, "port down", true));
+    }
+  }
+  if (base->isSend) NCCLCHECK(ncclIbFailoverSendNotices((struct ncclIbSendComm*)base));
+
+  // Notices follow a failure, until then only look for one every now and then
+  if (base->nFailed == 0) {
+    uint64_t now = clockNano();
+    if (now - base->noticePoll < NCCL_IB_FAILOVER_POLL_NS) return ncclSuccess;
+    base->noticePoll = now;
+  }
+  while (!base->noticesClosed) {
+    struct ncclIbFailoverMsg msg;
+    int closed;
+    ncclResult_t res = ncclSocketTryRecv(&base->sock, &msg, sizeof(msg), &closed, false);
+    if (res == ncclInProgress) break;
+    NCCLCHECK(res);
+    if (closed) {
+      base->noticesClosed = 1;
+      break;
+    }
+    NCCLCHECK(ncclIbFailoverNotice(base, &msg));
+  }
+  return ncclSuccess;
+}
+
+// Failover handling of a completion. Sets handled unless the regular path must process it too.
+static ncclResult_t ncclIbFailoverCompletion(struct ncclIbNetCommBase* base, int i, struct ibv_wc* wc, bool* handled) {
+  *handled = true;
+  struct ncclIbRequest* req = base->reqs+(wc->wr_id & 0xff);
+  int q = 0;
+  while (q < base->nqps && base->qps[q].qp->qp_num != wc->qp_num) q++;
+  if (q == base->nqps) {
+    // GPU flush QP. The flush QP of the device data was replayed on is read too, so
+    // one on a failed device can be left out.
+    if (wc->status == IBV_WC_SUCCESS) *handled = false;
+    else __atomic_fetch_sub(&req->events[i], 1, __ATOMIC_RELEASE);
+    return ncclSuccess;
+  }
+  char reason[64];
+  snprintf(reason, sizeof(reason), "completion status %d vendor err %d", wc->status, wc->vendor_err);
+
+  if (base->isSend) {
+    struct ncclIbSendComm* comm = (struct ncclIbSendComm*)base;
+    // All chains of a failed QP were replayed elsewhere
+    if (base->qps[q].failed) return ncclSuccess;
+    if (wc->status != IBV_WC_SUCCESS) return ncclIbFailQp(base, q, reason, true);
+    struct ncclIbFailoverRing* ring = comm->failoverRings+q;
+    if (ring->head == ring->tail) {
+      WARN("NET/IB: send completion on qp %d with nothing posted", q);
+      return ncclInternalError;
+    }
+    struct ncclIbFailoverChain* chain = ring->chains + ring->head % NCCL_IB_FAILOVER_RING;
+    ring->head++;
+    if (chain->replay) {
+      struct ncclIbFailoverMsg* msg = comm->notices + comm->nNotices++;
+      memset(msg, 0, sizeof(struct ncclIbFailoverMsg));
+      msg->type = NCCL_IB_FAILOVER_REPLAYED;
+      msg->qp = chain->qp;
+      msg->reqId = chain->reqId;
+      msg->idx = chain->idx;
+      msg->nreqs = chain->nreqs;
+      for (int r = 0; r < chain->nreqs; r++) {
+        msg->lens[r] = chain->chunks[r].len;
+        msg->sizes[r] = base->reqs[(chain->wr_id >> (r*8)) & 0xff].send.size;
+      }
+    }
+    *handled = false;
+    return ncclSuccess;
+  }
+
+  if (wc->wr_id & NCCL_IB_CTS_WRID) {
+    // A signaled fifo write holds an event of its receive whatever its status
+    if (wc->wr_id & NCCL_IB_CTS_SIGNALED) __atomic_fetch_sub(&req->events[i], 1, __ATOMIC_RELEASE);
+  } else if (wc->status == IBV_WC_SUCCESS) {
+    NCCLCHECK(ncclIbFailoverChunkDone((struct ncclIbRecvComm*)base, req, q, wc->imm_data, NULL));
+  }
+  if (wc->status != IBV_WC_SUCCESS) return ncclIbFailQp(base, q, reason, true);
+  return ncclSuccess;
+}
 
 ncclResult_t ncclIbMultiSend(struct ncclIbSendComm* comm, int slot) {
   struct ncclIbRequest** reqs = comm->fifoReqs[slot];
@@ -1365,24 +2103,29 @@ ncclResult_t ncclIbMultiSend(struct ncclIbSendComm* comm, int slot) {
 
   // Write size as immediate data. In the case of multi-send, only write
   // 0 or 1 as size to indicate whether there was data sent or received.
+  // When the receiver uses an SRQ, the receive WQE no longer identifies the
+  // request, so the immediate data carries the receive request index and
+  // sizes always go through the sizes fifo.
+  const bool sizesFifo = nreqs > 1 || comm->base.srq;
   uint32_t immData = 0;
-  if (nreqs == 1) {
+  if (!sizesFifo) {
     immData = reqs[0]->send.size;
   } else {
     int* sizes = comm->remSizesFifo.elems[slot];
     for (int r=0; r<nreqs; r++) sizes[r] = reqs[r]->send.size;
     comm->remSizesFifo.sge.addr = (uint64_t)sizes;
     comm->remSizesFifo.sge.length = nreqs*sizeof(int);
+    if (comm->base.srq) immData = slots[0].reqId;
   }
 
   struct ibv_send_wr* lastWr = comm->wrs+nreqs-1;
-  if (nreqs > 1 || (comm->ar && reqs[0]->send.size > ncclParamIbArThreshold())) {
+  if (sizesFifo || (comm->ar && reqs[0]->send.size > ncclParamIbArThreshold())) {
     // When using ADAPTIVE_ROUTING, send the bulk of the data first as an
     // RDMA_WRITE, then a 0-byte RDMA_WRITE_WITH_IMM to trigger a remote
     // completion.
     lastWr++;
     memset(lastWr, 0, sizeof(struct ibv_send_wr));
-    if (nreqs > 1) {
+    if (sizesFifo) {
       // Write remote sizes Fifo
       lastWr->wr.rdma.remote_addr = comm->remSizesFifo.addr + slot*NCCL_NET_IB_MAX_RECVS*sizeof(int);
       lastWr->num_sge = 1;
@@ -1398,10 +2141,23 @@ ncclResult_t ncclIbMultiSend(struct ncclIbSendComm* comm, int slot) {
   // Multi-QP: make sure IB writes are multiples of 128B so that LL and LL128 protocols still work
   const int align = 128;
   int nqps = ncclParamIbSplitDataOnQps() ? comm->base.nqps : comm->base.ndevs;
+  // Every QP still gets one WR per send so that the receives posted in round
+  // robin are all consumed; with spraying only the data split follows QP load.
+  int sprayLens[NCCL_NET_IB_MAX_RECVS][NCCL_IB_MAX_QPS];
+  if (comm->qpLoad) {
+    uint64_t load[NCCL_IB_MAX_QPS];
+    for (int i = 0; i < nqps; i++) {
+      load[i] = __atomic_load_n(&comm->qpLoad[(comm->base.qpIndex+i)%comm->base.nqps].outstanding, __ATOMIC_RELAXED);
+    }
+    for (int r=0; r<nreqs; r++) {
+      ncclIbSprayLengths(load, nqps, DIVUP(reqs[r]->send.size, align) * align, align, sprayLens[r]);
+    }
+  }
   for (int i = 0; i < nqps; i++) {
     int qpIndex = comm->base.qpIndex;
     ncclIbQp* qp = comm->base.qps + qpIndex;
     int devIndex = qp->devIndex;
+    int qpBytes = 0;
     for (int r=0; r<nreqs; r++) {
       // Track this event for completion
       //ncclIbAddEvent(reqs[r], devIndex, &comm->devs[devIndex].base);
@@ -1409,31 +2165,68 @@ ncclResult_t ncclIbMultiSend(struct ncclIbSendComm* comm, int slot) {
       // Select proper rkey (needed even for 0-size send)
       comm->wrs[r].wr.rdma.rkey = slots[r].rkeys[qp->remDevIdx];
 
-      int chunkSize = DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
+      int chunkSize = comm->qpLoad ? sprayLens[r][i] : DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
       int length = std::min(reqs[r]->send.size-reqs[r]->send.offset, chunkSize);
+      // Immediate data adds up to the size on the receiver
+      if (!sizesFifo) lastWr->imm_data = std::max(length, 0);
       if (length <= 0) {
         comm->wrs[r].sg_list = NULL;
         comm->wrs[r].num_sge = 0;
       } else {
+        qpBytes += length;
         // Select proper lkey
         comm->sges[r].lkey = reqs[r]->send.lkeys[devIndex];
         comm->sges[r].length = length;
         comm->wrs[r].sg_list = comm->sges+r;
         comm->wrs[r].num_sge = 1;
       }
+      // Small host payloads are copied into the WQE when posted
+      comm->wrs[r].send_flags = 0;
+      if (length > 0 && reqs[r]->send.host && length <= std::min(ncclIbInlineBytes(), qp->maxInline)) {
+        comm->wrs[r].send_flags = IBV_SEND_INLINE;
+      }
     }
 
-    if (nreqs > 1) {
+    if (sizesFifo) {
       // Also make sure lastWr writes remote sizes using the right lkey
       comm->remSizesFifo.sge.lkey = comm->remSizesFifo.mrs[devIndex]->lkey;
       lastWr->wr.rdma.rkey = comm->remSizesFifo.rkeys[devIndex];
+      // The sizes are a few bytes of host memory, carry them in the completion WQE
+      lastWr->send_flags = comm->remSizesFifo.sge.length <= qp->maxInline ? IBV_SEND_INLINE : 0;
     }
 
-    struct ibv_send_wr* bad_wr;
-    NCCLCHECK(wrap_ibv_post_send(qp->qp, comm->wrs, &bad_wr));
+    if (comm->failoverRings) {
+      struct ncclIbFailoverChain chain;
+      chain.wr_id = wr_id;
+      chain.nreqs = nreqs;
+      chain.reqId = slots[0].reqId;
+      chain.idx = slots[0].idx;
+      chain.qp = qpIndex;
+      chain.replay = 0;
+      for (int r=0; r<nreqs; r++) {
+        chain.chunks[r].offset = reqs[r]->send.offset;
+        chain.chunks[r].len = comm->wrs[r].num_sge ? comm->sges[r].length : 0;
+        chain.chunks[r].addr = comm->wrs[r].wr.rdma.remote_addr;
+        for (int d = 0; d < NCCL_IB_MAX_DEVS_PER_NIC; d++) chain.chunks[r].rkeys[d] = slots[r].rkeys[d];
+      }
+      if (qp->failed) {
+        NCCLCHECK(ncclIbFailoverPost(comm, qpIndex, &chain));
+      } else {
+        NCCLCHECK(ncclIbFailoverPush(comm, qpIndex, &chain));
+        NCCLCHECK(ncclIbSendPost(comm, qpIndex, lastWr));
+      }
+    } else {
+      NCCLCHECK(ncclIbSendPost(comm, qpIndex, lastWr));
+    }
+    if (comm->qpLoad) {
+      struct ncclIbQpLoad* l = comm->qpLoad+qpIndex;
+      l->len[l->tail % MAX_REQUESTS] = qpBytes;
+      __atomic_fetch_add(&l->outstanding, (uint64_t)qpBytes, __ATOMIC_RELAXED);
+      __atomic_store_n(&l->tail, l->tail+1, __ATOMIC_RELEASE);
+    }
 
     for (int r=0; r<nreqs; r++) {
-      int chunkSize = DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
+      int chunkSize = comm->qpLoad ? sprayLens[r][i] : DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
       reqs[r]->send.offset += chunkSize;
       comm->sges[r].addr += chunkSize;
       comm->wrs[r].wr.rdma.remote_addr += chunkSize;
@@ -1450,6 +2243,7 @@ ncclResult_t ncclIbIsend(void* sendComm, void* data, int size, int tag, void* mh
   struct ncclIbSendComm* comm = (struct ncclIbSendComm*)sendComm;
   if (comm->base.ready == 0) { WARN("NET/IB: ncclIbIsend() called when comm->base.ready == 0"); return ncclInternalError; }
   if (comm->base.ready == 0) { *request = NULL; return ncclSuccess; }
+  if (comm->base.failover) NCCLCHECK(ncclIbFailoverProgress(&comm->base));
 
   struct ncclIbMrHandle* mhandleWrapper = (struct ncclIbMrHandle*) mhandle;
 
@@ -1489,6 +2283,7 @@ ncclResult_t ncclIbIsend(void* sendComm, void* data, int size, int tag, void* mh
     req->send.size = size;
     req->send.data = data;
     req->send.offset = 0;
+    req->send.host = mhandleWrapper->type == NCCL_PTR_HOST;
 
     // Populate events
     int nEvents = ncclParamIbSplitDataOnQps() ? comm->base.nqps : comm->base.ndevs;
@@ -1532,12 +2327,39 @@ ncclResult_t ncclIbIsend(void* sendComm, void* data, int size, int tag, void* mh
   return ncclSuccess;
 }
 
-ncclResult_t ncclIbPostFifo(struct ncclIbRecvComm* comm, int n, void** data, int* sizes, int* tags, void** mhandles, struct ncclIbRequest* req) {
+// Write the fifo elements of slot to the sender through ctsQp
+static ncclResult_t ncclIbPostCts(struct ncclIbRecvComm* comm, struct ncclIbQp* ctsQp, int slot, int n, struct ncclIbRequest* signalReq) {
   struct ibv_send_wr wr;
   memset(&wr, 0, sizeof(wr));
+  wr.wr.rdma.remote_addr = comm->remFifo.addr + slot*NCCL_NET_IB_MAX_RECVS*sizeof(struct ncclIbSendFifo);
+
+  // Lookup the correct fifoRkey
+  wr.wr.rdma.rkey = comm->base.remDevs[ctsQp->remDevIdx].fifoRkey;
+
+  // Set the correct sge properties
+  comm->devs[ctsQp->devIndex].fifoSge.addr   = (uint64_t)comm->remFifo.elems[slot];
+  comm->devs[ctsQp->devIndex].fifoSge.length = n*sizeof(struct ncclIbSendFifo);
+  wr.sg_list = &comm->devs[ctsQp->devIndex].fifoSge;
+  wr.num_sge = 1;
+
+  wr.opcode = IBV_WR_RDMA_WRITE;
+  wr.send_flags = comm->remFifo.flags; // IBV_SEND_INLINE
+  wr.wr_id = NCCL_IB_CTS_WRID;
+  if (signalReq) {
+    wr.send_flags |= IBV_SEND_SIGNALED;
+    wr.wr_id |= NCCL_IB_CTS_SIGNALED | (signalReq - comm->base.reqs);
+    ncclIbAddEvent(signalReq, ctsQp->devIndex, &comm->devs[ctsQp->devIndex].base);
+  }
 
+  struct ibv_send_wr* bad_wr;
+  NCCLCHECK(wrap_ibv_post_send(ctsQp->qp, &wr, &bad_wr));
+  return ncclSuccess;
+}
+
+ncclResult_t ncclIbPostFifo(struct ncclIbRecvComm* comm, int n, void** data, int* sizes, int* tags, void** mhandles, struct ncclIbRequest* req) {
   int slot = comm->remFifo.fifoTail%MAX_REQUESTS;
   req->recv.sizes = comm->sizesFifo[slot];
+  req->recv.idx = comm->remFifo.fifoTail+1;
   for (int i=0; i<n; i++) req->recv.sizes[i] = 0;
   struct ncclIbSendFifo* localElem = comm->remFifo.elems[slot];
 
@@ -1545,6 +2367,7 @@ ncclResult_t ncclIbPostFifo(struct ncclIbRecvComm* comm, int n, void** data, int
   // Since QPs are initialized by striping across devIndex, we can simply assign this to the same value
   ncclIbQp* ctsQp = comm->base.qps + comm->base.devIndex;
   comm->base.devIndex = (comm->base.devIndex + 1) % comm->base.ndevs;
+  if (ctsQp->failed) ctsQp = comm->base.qps + ncclIbFailoverQp(&comm->base, ctsQp - comm->base.qps);
 
   for (int i=0; i<n; i++) {
     localElem[i].addr = (uint64_t)data[i];
@@ -1558,20 +2381,8 @@ ncclResult_t ncclIbPostFifo(struct ncclIbRecvComm* comm, int n, void** data, int
     localElem[i].size = sizes[i]; // Sanity/Debugging
     localElem[i].tag = tags[i];
     localElem[i].idx = comm->remFifo.fifoTail+1;
+    localElem[i].reqId = req - comm->base.reqs;
   }
-  wr.wr.rdma.remote_addr = comm->remFifo.addr + slot*NCCL_NET_IB_MAX_RECVS*sizeof(struct ncclIbSendFifo);
-
-  // Lookup the correct fifoRkey
-  wr.wr.rdma.rkey = comm->base.remDevs[ctsQp->remDevIdx].fifoRkey;
-
-  // Set the correct sge properties
-  comm->devs[ctsQp->devIndex].fifoSge.addr   = (uint64_t)localElem;
-  comm->devs[ctsQp->devIndex].fifoSge.length = n*sizeof(struct ncclIbSendFifo);
-  wr.sg_list = &comm->devs[ctsQp->devIndex].fifoSge;
-  wr.num_sge = 1;
-
-  wr.opcode = IBV_WR_RDMA_WRITE;
-  wr.send_flags = comm->remFifo.flags; // IBV_SEND_INLINE
 
   // We need to occasionally post a request with the IBV_SEND_SIGNALED flag, otherwise
   // the send queue will never empty.
@@ -1596,25 +2407,40 @@ ncclResult_t ncclIbPostFifo(struct ncclIbRecvComm* comm, int n, void** data, int
   //
   // slot == devIndex - When writing to fifo slot N, and this QP lives on device index N, it should send signalled.
   // This works out that each fifo posting QP gets drained
-  if (slot == ctsQp->devIndex) {
-    wr.send_flags |= IBV_SEND_SIGNALED;
-    wr.wr_id = req - comm->base.reqs;
-    ncclIbAddEvent(req, ctsQp->devIndex, &comm->devs[ctsQp->devIndex].base);
-  }
-
-  struct ibv_send_wr* bad_wr;
-  NCCLCHECK(wrap_ibv_post_send(ctsQp->qp, &wr, &bad_wr));
+  NCCLCHECK(ncclIbPostCts(comm, ctsQp, slot, n, slot == ctsQp->devIndex ? req : NULL));
   comm->remFifo.fifoTail++;
 
   return ncclSuccess;
 }
 
+// Reserve one WQE in the SRQ of each QP we are about to post on. Returns false if an
+// SRQ is full, in which case the receive is retried later.
+static bool ncclIbSrqReserve(struct ncclIbRecvComm* comm, int nqps) {
+  for (int i = 0; i < nqps; i++) {
+    struct ncclIbQp* qp = comm->base.qps + (comm->base.qpIndex+i)%comm->base.nqps;
+    if (qp->qp->srq == NULL) continue;
+    struct ncclIbSharedCq* cq = comm->devs[qp->devIndex].base.sharedCq;
+    if (__atomic_add_fetch(&cq->srqPosted, 1, __ATOMIC_RELAXED) > cq->srqSize) {
+      for (int j = 0; j <= i; j++) {
+        struct ncclIbQp* qp = comm->base.qps + (comm->base.qpIndex+j)%comm->base.nqps;
+        if (qp->qp->srq) __atomic_fetch_sub(&comm->devs[qp->devIndex].base.sharedCq->srqPosted, 1, __ATOMIC_RELAXED);
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
 ncclResult_t ncclIbIrecv(void* recvComm, int n, void** data, int* sizes, int* tags, void** mhandles, void** request) {
   struct ncclIbRecvComm* comm = (struct ncclIbRecvComm*)recvComm;
   if (comm->base.ready == 0) { WARN("NET/IB: ncclIbIrecv() called when comm->base.ready == 0"); return ncclInternalError; }
   if (comm->base.ready == 0) { *request = NULL; return ncclSuccess; }
   if (n > NCCL_NET_IB_MAX_RECVS) return ncclInternalError;
 
+  // Select either all QPs, or one qp per-device
+  const int nqps = ncclParamIbSplitDataOnQps() ? comm->base.nqps : comm->base.ndevs;
+  if (comm->base.srq && !ncclIbSrqReserve(comm, nqps)) { *request = NULL; return ncclSuccess; }
+
   struct ncclIbRequest* req;
   NCCLCHECK(ncclIbGetRequest(&comm->base, &req));
   req->type = NCCL_NET_IB_REQ_RECV;
@@ -1632,15 +2458,25 @@ ncclResult_t ncclIbIrecv(void* recvComm, int n, void** data, int* sizes, int* ta
   wr.num_sge = 0;
 
   TIME_START(1);
-  // Select either all QPs, or one qp per-device
-  const int nqps = ncclParamIbSplitDataOnQps() ? comm->base.nqps : comm->base.ndevs;
-
   // Post recvs
   struct ibv_recv_wr* bad_wr;
   for (int i = 0; i < nqps; i++) {
     struct ncclIbQp* qp = comm->base.qps + comm->base.qpIndex;
-    ncclIbAddEvent(req, qp->devIndex, &comm->devs[qp->devIndex].base);
-    NCCLCHECK(wrap_ibv_post_recv(qp->qp, &wr, &bad_wr));
+    if (comm->base.failover) {
+      req->recv.qps[i] = comm->base.qpIndex;
+      req->recv.chunks[i] = qp->failed ? NCCL_IB_CHUNK_NOTICE : NCCL_IB_CHUNK_CQE;
+    }
+    if (qp->failed) {
+      // The sender replays this chunk on another QP
+      req->replays++;
+    } else {
+      ncclIbAddEvent(req, qp->devIndex, &comm->devs[qp->devIndex].base);
+      if (qp->qp->srq) {
+        NCCLCHECK(wrap_ibv_post_srq_recv(qp->qp->srq, &wr, &bad_wr));
+      } else {
+        NCCLCHECK(wrap_ibv_post_recv(qp->qp, &wr, &bad_wr));
+      }
+    }
     comm->base.qpIndex = (comm->base.qpIndex+1)%comm->base.nqps;
   }
 
@@ -1693,13 +2529,137 @@ ncclResult_t ncclIbIflush(void* recvComm, int n, void** data, int* sizes, void**
   return ncclSuccess;
 }
 
+// Process one completion for comm, on its device devIndex. With a shared CQ this may run on
+// a thread other than the one owning the comm, hence the atomic updates of the event counts.
+static ncclResult_t ncclIbSendEvents(struct ncclIbNetCommBase* comm, int i, uint64_t wr_id) {
+  struct ncclIbRequest* req = comm->reqs+(wr_id & 0xff);
+  for (int j = 0; j < req->nreqs; j++) {
+    struct ncclIbRequest* sendReq = comm->reqs+((wr_id >> (j*8)) & 0xff);
+    if ((sendReq->events[i] <= 0)) {
+      WARN("NET/IB: sendReq(%p)->events={%d,%d}, i=%d, j=%d <= 0", sendReq, sendReq->events[0], sendReq->events[1], i, j);
+      return ncclInternalError;
+    }
+    __atomic_fetch_sub(&sendReq->events[i], 1, __ATOMIC_RELEASE);
+  }
+  return ncclSuccess;
+}
+
+// A signaled send WR completed: retire the unsignaled sends posted before it on the same QP.
+static ncclResult_t ncclIbSendSignalCompletion(struct ncclIbSendComm* comm, int i, struct ibv_wc* wc, bool* fence) {
+  int q = 0;
+  while (q < comm->base.nqps && comm->base.qps[q].qp->qp_num != wc->qp_num) q++;
+  if (q == comm->base.nqps) {
+    WARN("NET/IB: send completion for unknown qp_num %u", wc->qp_num);
+    return ncclInternalError;
+  }
+  struct ncclIbSendQpSignal* s = comm->qpSignal+q;
+  uint64_t mark = s->sigMark[s->sigHead % NCCL_IB_SIGNAL_RING];
+  uint64_t end = mark & ~NCCL_IB_SIGNAL_FENCE;
+  while (s->unsigHead < end) {
+    NCCLCHECK(ncclIbSendEvents(&comm->base, i, s->unsig[s->unsigHead % NCCL_IB_SIGNAL_RING]));
+    __atomic_store_n(&s->unsigHead, s->unsigHead+1, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&s->sigHead, s->sigHead+1, __ATOMIC_RELEASE);
+  *fence = (mark & NCCL_IB_SIGNAL_FENCE) != 0;
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclIbCompletion(struct ncclIbNetCommBase* comm, int i, struct ibv_wc* wc) {
+  struct ncclIbRequest* req = comm->reqs+(wc->wr_id & 0xff);
+  if (wc->status == IBV_WC_SUCCESS && wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM && comm->srq) {
+    // The WQE came from the SRQ and may have been posted by any comm
+    req = comm->reqs+(wc->imm_data & 0xff);
+    struct ncclIbSharedCq* cq = ncclIbGetNetCommDevBase(comm, i)->sharedCq;
+    if (cq && cq->srq) __atomic_fetch_sub(&cq->srqPosted, 1, __ATOMIC_RELAXED);
+  }
+  if (comm->failover) {
+    bool handled;
+    NCCLCHECK(ncclIbFailoverCompletion(comm, i, wc, &handled));
+    if (handled) return ncclSuccess;
+  }
+  if (wc->status != IBV_WC_SUCCESS) {
+    union ncclSocketAddress addr;
+    ncclSocketGetAddr(&comm->sock, &addr);
+    char localGidString[INET6_ADDRSTRLEN] = "";
+    char remoteGidString[INET6_ADDRSTRLEN] = "";
+    const char* localGidStr = NULL, *remoteGidStr = NULL;
+    struct ncclIbNetCommDevBase* devBase = ncclIbGetNetCommDevBase(comm, i);
+    if (devBase->gidInfo.link_layer == IBV_LINK_LAYER_ETHERNET) {
+      localGidStr = inet_ntop(AF_INET6, &devBase->gidInfo.localGid, localGidString, sizeof(localGidString));
+      remoteGidStr = inet_ntop(AF_INET6, &comm->remDevs[i].remoteGid, remoteGidString, sizeof(remoteGidString));
+    }
+
+    char line[SOCKET_NAME_MAXLEN+1];
+    WARN("NET/IB : Got completion from peer %s with status=%d opcode=%d len=%d vendor err %d (%s)%s%s%s%s",
+        ncclSocketToString(&addr, line), wc->status, wc->opcode, wc->byte_len, wc->vendor_err, reqTypeStr[req->type],
+        localGidStr ?  " localGid ":"", localGidString, remoteGidStr ? " remoteGids":"", remoteGidString);
+    return ncclRemoteError;
+  }
+
+  #ifdef ENABLE_TRACE
+  union ncclSocketAddress addr;
+  ncclSocketGetAddr(&comm->sock, &addr);
+  char line[SOCKET_NAME_MAXLEN+1];
+  TRACE(NCCL_NET, "Got completion from peer %s with status=%d opcode=%d len=%d wr_id=%d r=%p type=%d events={%d,%d}, i=%d",
+      ncclSocketToString(&addr, line), wc->status, wc->opcode,wc->byte_len, wc->wr_id, req, req->type, req->events[0], req->events[1], i);
+  #endif
+  if (comm->isSend && ((struct ncclIbSendComm*)comm)->qpSignal) {
+    bool fence;
+    NCCLCHECK(ncclIbSendSignalCompletion((struct ncclIbSendComm*)comm, i, wc, &fence));
+    if (fence) return ncclSuccess;
+  }
+  if (req->type == NCCL_NET_IB_REQ_SEND) {
+    if (((struct ncclIbSendComm*)comm)->qpLoad) NCCLCHECK(ncclIbQpLoadCompletion((struct ncclIbSendComm*)comm, wc));
+    NCCLCHECK(ncclIbSendEvents(comm, i, wc->wr_id));
+  } else {
+    if (req && wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+      if (req->type != NCCL_NET_IB_REQ_RECV) {
+        WARN("NET/IB: wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM and req->type=%d", req->type);
+        return ncclInternalError;
+      }
+      if (req->nreqs == 1 && !comm->srq) {
+        req->recv.sizes[0] += wc->imm_data;
+      }
+    }
+    __atomic_fetch_sub(&req->events[i], 1, __ATOMIC_RELEASE);
+  }
+  return ncclSuccess;
+}
+
+// Poll the shared CQ of a device and dispatch completions to their comm. If another
+// thread is already polling, it will process our completions for us.
+static ncclResult_t ncclIbSharedCqPoll(struct ncclIbSharedCq* cq, int* wrDone) {
+  ncclResult_t res = ncclSuccess;
+  struct ibv_wc wcs[16];
+  *wrDone = 0;
+  if (pthread_mutex_trylock(&cq->lock) != 0) return ncclSuccess;
+  NCCLCHECKGOTO(wrap_ibv_poll_cq(cq->cq, 16, wcs, wrDone), res, exit);
+  for (int w=0; w<*wrDone; w++) {
+    struct ibv_wc *wc = wcs+w;
+    struct ncclIbSharedCqQp* entry = cq->qps[wc->qp_num % NCCL_IB_SHARED_CQ_BUCKETS];
+    while (entry && entry->qpn != wc->qp_num) entry = entry->next;
+    if (entry == NULL) {
+      WARN("NET/IB : Got completion for unknown QP %u on shared CQ, status=%d opcode=%d", wc->qp_num, wc->status, wc->opcode);
+      res = ncclInternalError;
+      goto exit;
+    }
+    NCCLCHECKGOTO(ncclIbCompletion(entry->comm, entry->devIndex, wc), res, exit);
+  }
+exit:
+  pthread_mutex_unlock(&cq->lock);
+  return res;
+}
+
 ncclResult_t ncclIbTest(void* request, int* done, int* sizes) {
   struct ncclIbRequest *r = (struct ncclIbRequest*)request;
   *done = 0;
+  if (r->base->failover) NCCLCHECK(ncclIbFailoverProgress(r->base));
   while (1) {
-    if (r->events[0] == 0 && r->events[1] == 0) {
+    if (__atomic_load_n(&r->events[0], __ATOMIC_ACQUIRE) == 0 && __atomic_load_n(&r->events[1], __ATOMIC_ACQUIRE) == 0 && r->replays == 0) {
       TRACE(NCCL_NET, "r=%p done", r);
       *done = 1;
+      // The receiver waits for the notices of the chunks replayed for this send
+      if (r->base->failover && r->type == NCCL_NET_IB_REQ_SEND) NCCLCHECK(ncclIbFailoverSendNotices((struct ncclIbSendComm*)r->base));
       if (sizes && r->type == NCCL_NET_IB_REQ_RECV) {
         for (int i=0; i<r->nreqs; i++) sizes[i] = r->recv.sizes[i];
       }
@@ -1710,6 +2670,11 @@ ncclResult_t ncclIbTest(void* request, int* done, int* sizes) {
       return ncclSuccess;
     }
 
+    if (r->type == NCCL_NET_IB_REQ_SEND) {
+      struct ncclIbSendComm* sendComm = (struct ncclIbSendComm*)r->base;
+      if (sendComm->batch || sendComm->qpSignal) NCCLCHECK(ncclIbSendProgress(sendComm));
+    }
+
     int totalWrDone = 0;
     int wrDone = 0;
     struct ibv_wc wcs[4];
@@ -1717,61 +2682,19 @@ ncclResult_t ncclIbTest(void* request, int* done, int* sizes) {
     for (int i = 0; i < NCCL_IB_MAX_DEVS_PER_NIC; i++) {
       TIME_START(3);
       // If we expect any completions from this device's CQ
-      if (r->events[i]) {
+      if (__atomic_load_n(&r->events[i], __ATOMIC_ACQUIRE)) {
+        if (r->devBases[i]->sharedCq) {
+          NCCLCHECK(ncclIbSharedCqPoll(r->devBases[i]->sharedCq, &wrDone));
+          totalWrDone += wrDone;
+          if (wrDone == 0) { TIME_CANCEL(3); } else { TIME_STOP(3); }
+          continue;
+        }
         NCCLCHECK(wrap_ibv_poll_cq(r->devBases[i]->cq, 4, wcs, &wrDone));
         totalWrDone += wrDone;
         if (wrDone == 0) { TIME_CANCEL(3); } else { TIME_STOP(3); }
         if (wrDone == 0) continue;
         for (int w=0; w<wrDone; w++) {
-          struct ibv_wc *wc = wcs+w;
-          if (wc->status != IBV_WC_SUCCESS) {
-            union ncclSocketAddress addr;
-            ncclSocketGetAddr(r->sock, &addr);
-            char localGidString[INET6_ADDRSTRLEN] = "";
-            char remoteGidString[INET6_ADDRSTRLEN] = "";
-            const char* localGidStr = NULL, *remoteGidStr = NULL;
-            if (r->devBases[i]->gidInfo.link_layer == IBV_LINK_LAYER_ETHERNET) {
-              localGidStr = inet_ntop(AF_INET6, &r->devBases[i]->gidInfo.localGid, localGidString, sizeof(localGidString));
-              remoteGidStr = inet_ntop(AF_INET6, &r->base->remDevs[i].remoteGid, remoteGidString, sizeof(remoteGidString));
-            }
-
-            char line[SOCKET_NAME_MAXLEN+1];
-            WARN("NET/IB : Got completion from peer %s with status=%d opcode=%d len=%d vendor err %d (%s)%s%s%s%s",
-                ncclSocketToString(&addr, line), wc->status, wc->opcode, wc->byte_len, wc->vendor_err, reqTypeStr[r->type],
-                localGidStr ?  " localGid ":"", localGidString, remoteGidStr ? " remoteGids":"", remoteGidString);
-            return ncclRemoteError;
-          }
-
-          union ncclSocketAddress addr;
-          ncclSocketGetAddr(r->sock, &addr);
-          struct ncclIbRequest* req = r->base->reqs+(wc->wr_id & 0xff);
-
-          #ifdef ENABLE_TRACE
-          char line[SOCKET_NAME_MAXLEN+1];
-          TRACE(NCCL_NET, "Got completion from peer %s with status=%d opcode=%d len=%d wr_id=%d r=%p type=%d events={%d,%d}, i=%d",
-              ncclSocketToString(&addr, line), wc->status, wc->opcode,wc->byte_len, wc->wr_id, req, req->type, req->events[0], req->events[1], i);
-          #endif
-          if (req->type == NCCL_NET_IB_REQ_SEND) {
-            for (int j = 0; j < req->nreqs; j++) {
-              struct ncclIbRequest* sendReq = r->base->reqs+((wc->wr_id >> (j*8)) & 0xff);
-              if ((sendReq->events[i] <= 0)) {
-                WARN("NET/IB: sendReq(%p)->events={%d,%d}, i=%d, j=%d <= 0", sendReq, sendReq->events[0], sendReq->events[1], i, j);
-                return ncclInternalError;
-              }
-              sendReq->events[i]--;
-            }
-          } else {
-            if (req && wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
-              if (req->type != NCCL_NET_IB_REQ_RECV) {
-                WARN("NET/IB: wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM and req->type=%d", req->type);
-                return ncclInternalError;
-              }
-              if (req->nreqs == 1) {
-                req->recv.sizes[0] += wc->imm_data;
-              }
-            }
-            req->events[i]--;
-          }
+          NCCLCHECK(ncclIbCompletion(r->base, i, wcs+w));
         }
       }
     }
@@ -1781,13 +2704,29 @@ ncclResult_t ncclIbTest(void* request, int* done, int* sizes) {
   }
 }
 
+// The first test reaps the completions of the whole window from the CQ, the following
+// requests then only have to check their event counts.
+ncclResult_t ncclIbTestAll(int n, void** requests, int* ndone, int* sizes) {
+  *ndone = 0;
+  for (int i=0; i<n; i++) {
+    int done;
+    NCCLCHECK(ncclIbTest(requests[i], &done, sizes ? sizes+i : NULL));
+    if (!done) break;
+    (*ndone)++;
+  }
+  return ncclSuccess;
+}
+
 ncclResult_t ncclIbCloseSend(void* sendComm) {
   struct ncclIbSendComm* comm = (struct ncclIbSendComm*)sendComm;
   if (comm) {
     NCCLCHECK(ncclSocketClose(&comm->base.sock));
 
-    for (int q = 0; q < comm->base.nqps; q++)
-      if (comm->base.qps[q].qp != NULL) NCCLCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    for (int q = 0; q < comm->base.nqps; q++) {
+      if (comm->base.qps[q].qp == NULL) continue;
+      ncclIbSharedCqDelQp(&comm->devs[comm->base.qps[q].devIndex].base, comm->base.qps[q].qp);
+      NCCLCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    }
 
     for (int i = 0; i < comm->base.ndevs; i++) {
       struct ncclIbSendCommDev* commDev = comm->devs + i;
@@ -1795,6 +2734,17 @@ ncclResult_t ncclIbCloseSend(void* sendComm) {
       if (comm->remSizesFifo.mrs[i] != NULL) NCCLCHECK(wrap_ibv_dereg_mr(comm->remSizesFifo.mrs[i]));
       NCCLCHECK(ncclIbDestroyBase(&commDev->base));
     }
+    if (comm->batch) {
+      for (int q = 0; q < comm->base.nqps; q++) {
+        free(comm->batch[q].wrs);
+        free(comm->batch[q].sges);
+      }
+      free(comm->batch);
+    }
+    free(comm->qpSignal);
+    free(comm->qpLoad);
+    free(comm->failoverRings);
+    free(comm->notices);
     free(comm);
   }
   TIME_PRINT("IB");
@@ -1806,12 +2756,16 @@ ncclResult_t ncclIbCloseRecv(void* recvComm) {
   if (comm) {
     NCCLCHECK(ncclSocketClose(&comm->base.sock));
 
-    for (int q = 0; q < comm->base.nqps; q++)
-      if (comm->base.qps[q].qp != NULL) NCCLCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    for (int q = 0; q < comm->base.nqps; q++) {
+      if (comm->base.qps[q].qp == NULL) continue;
+      ncclIbSharedCqDelQp(&comm->devs[comm->base.qps[q].devIndex].base, comm->base.qps[q].qp);
+      NCCLCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    }
 
     for (int i = 0; i < comm->base.ndevs; i++) {
       struct ncclIbRecvCommDev* commDev = comm->devs + i;
       if (comm->flushEnabled) {
+        ncclIbSharedCqDelQp(&commDev->base, commDev->gpuFlush.qp.qp);
         if (commDev->gpuFlush.qp.qp != NULL) NCCLCHECK(wrap_ibv_destroy_qp(commDev->gpuFlush.qp.qp));
         if (commDev->gpuFlush.hostMr != NULL) NCCLCHECK(wrap_ibv_dereg_mr(commDev->gpuFlush.hostMr));
       }
@@ -1852,6 +2806,9 @@ ncclNet_t ncclNetIb = {
   ncclIbCloseRecv,
   ncclIbCloseListen,
   NULL /* getDeviceMr */,
-  NULL /* irecvConsumed */
+  NULL /* irecvConsumed */,
+  NULL /* isendv */,
+  NULL /* irecvv */,
+  ncclIbTestAll
 };
 
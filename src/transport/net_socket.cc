@@ -15,6 +15,14 @@
 #include <poll.h>
 #include <limits.h>
 #include <fcntl.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define NCCL_SOCKET_URING 1
+#endif
+#endif
 
 /* Init functions */
 static int ncclNetIfs = -1;
@@ -113,9 +121,19 @@ ncclResult_t ncclNetSocketGetProperties(int dev, ncclNetProperties_t* props) {
 #define MAX_THREADS 16
 #define MAX_REQUESTS NCCL_NET_MAX_REQUESTS
 #define MIN_CHUNKSIZE (64*1024)
+// Interfaces a comm can stripe over, bounded by NCCL_NET_HANDLE_MAXSIZE
+#define MAX_STRIPE_IFS 3
 
 NCCL_PARAM(SocketNsocksPerThread, "NSOCKS_PERTHREAD", -2);
 NCCL_PARAM(SocketNthreads, "SOCKET_NTHREADS", -2);
+// Drive the data sockets from a single io_uring progressed by the proxy thread
+// instead of spawning helper threads.
+NCCL_PARAM(SocketIoUring, "SOCKET_IO_URING", 0);
+// Sends of at least this many bytes use zero-copy when io_uring is used, -1 disables
+NCCL_PARAM(SocketZeroCopyMinBytes, "SOCKET_ZEROCOPY_MIN_BYTES", 64*1024);
+// Spread the data sockets of a comm over the fastest interfaces, sockets per
+// interface following their speed, and stripe messages by measured throughput.
+NCCL_PARAM(SocketMultiNic, "SOCKET_MULTI_NIC", 0);
 
 enum ncclNetSocketCommState {
   ncclNetSocketCommStateStart = 0,
@@ -134,9 +152,12 @@ struct ncclNetSocketCommStage {
 
 struct ncclNetSocketHandle {
   union ncclSocketAddress connectAddr;
+  uint8_t nIfs;
+  uint8_t ifSocks[MAX_STRIPE_IFS]; // data sockets per interface, in socket order
   uint64_t magic; // random number to help debugging
   int nSocks;
   int nThreads;
+  union ncclSocketAddress stripeAddrs[MAX_STRIPE_IFS-1]; // interfaces after connectAddr's
   struct ncclNetSocketCommStage stage;
 };
 
@@ -148,6 +169,11 @@ struct ncclNetSocketTask {
   int offset;
   int used;
   ncclResult_t result;
+  // io_uring only: a send/recv is posted, zero-copy notifications still due
+  int inflight;
+  int zc;
+  int zcPending;
+  uint64_t doneTime; // striping: when the sender first saw it complete
 };
 
 struct ncclNetSocketRequest {
@@ -160,6 +186,8 @@ struct ncclNetSocketRequest {
   struct ncclNetSocketComm* comm;
   struct ncclNetSocketTask* tasks[MAX_SOCKETS];
   int nSubs;
+  uint8_t share[MAX_SOCKETS]; // striping: relative part of each socket
+  uint64_t startTime;
 };
 
 struct ncclNetSocketTaskQueue {
@@ -178,12 +206,17 @@ struct ncclNetSocketThreadResources {
 
 struct ncclNetSocketListenComm {
   struct ncclSocket sock;
+  struct ncclSocket stripeSocks[MAX_STRIPE_IFS-1];
   struct ncclNetSocketCommStage stage;
   int nSocks;
   int nThreads;
+  int nIfs;
+  uint8_t ifSocks[MAX_STRIPE_IFS];
   int dev;
 };
 
+struct ncclNetSocketUring;
+
 struct ncclNetSocketComm {
   struct ncclSocket ctrlSock;
   struct ncclSocket socks[MAX_SOCKETS];
@@ -192,9 +225,14 @@ struct ncclNetSocketComm {
   int nSocks;
   int nThreads;
   int nextSock;
+  int nIfs;
+  uint8_t ifSocks[MAX_STRIPE_IFS];
+  float sockRate[MAX_SOCKETS]; // striping: measured bytes/ns of each socket, sender only
   struct ncclNetSocketRequest requests[MAX_REQUESTS];
   pthread_t helperThread[MAX_THREADS];
   struct ncclNetSocketThreadResources threadResources[MAX_THREADS];
+  struct ncclNetSocketUring* uring;
+  int uringTried;
 };
 
 void* persistentSocketThread(void *args_) {
@@ -283,6 +321,71 @@ end:
   return ncclSuccess;
 }
 
+static int ncclNetSocketIfOfSock(int nIfs, const uint8_t* ifSocks, int sock) {
+  for (int k=0; k<nIfs; k++) {
+    if (sock < ifSocks[k]) return k;
+    sock -= ifSocks[k];
+  }
+  return 0;
+}
+
+// Picks the interfaces a comm stripes over, dev first then the fastest of the
+// others, and listens on each of them. Sockets are dealt to the interfaces in
+// proportion to their speed, so equal per-socket shares already weight them.
+static ncclResult_t ncclNetSocketStripeListen(struct ncclNetSocketListenComm* comm, struct ncclNetSocketHandle* handle) {
+  comm->nIfs = 1;
+  comm->ifSocks[0] = comm->nSocks;
+  if (ncclParamSocketMultiNic() && ncclNetIfs > 1) {
+    if (comm->nSocks < 2) {
+      INFO(NCCL_INIT|NCCL_NET, "NET/Socket : multi-NIC striping needs at least 2 data sockets, see NCCL_SOCKET_NTHREADS and NCCL_NSOCKS_PERTHREAD");
+    } else {
+      int ifs[MAX_STRIPE_IFS], speeds[MAX_STRIPE_IFS];
+      int maxIfs = std::min(MAX_STRIPE_IFS, comm->nSocks);
+      ifs[0] = comm->dev;
+      NCCLCHECK(ncclNetSocketGetSpeed(ncclNetSocketDevs[comm->dev].devName, speeds));
+      int nIfs = 1;
+      bool used[MAX_IFS] = { false };
+      used[comm->dev] = true;
+      while (nIfs < maxIfs) {
+        int best = -1, bestSpeed = 0;
+        for (int d=0; d<ncclNetIfs; d++) {
+          if (used[d]) continue;
+          int speed;
+          NCCLCHECK(ncclNetSocketGetSpeed(ncclNetSocketDevs[d].devName, &speed));
+          if (speed > bestSpeed) { best = d; bestSpeed = speed; }
+        }
+        if (best == -1) break;
+        used[best] = true;
+        ifs[nIfs] = best;
+        speeds[nIfs++] = bestSpeed;
+      }
+      // One socket each, then highest-averages apportionment of the rest
+      for (int k=0; k<nIfs; k++) comm->ifSocks[k] = 1;
+      for (int n=nIfs; n<comm->nSocks; n++) {
+        int best = 0;
+        for (int k=1; k<nIfs; k++) {
+          if ((double)speeds[k]/(comm->ifSocks[k]+1) > (double)speeds[best]/(comm->ifSocks[best]+1)) best = k;
+        }
+        comm->ifSocks[best]++;
+      }
+      for (int k=1; k<nIfs; k++) {
+        struct ncclSocket* sock = comm->stripeSocks+k-1;
+        NCCLCHECK(ncclSocketInit(sock, &ncclNetSocketDevs[ifs[k]].addr, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
+        NCCLCHECK(ncclSocketListen(sock));
+        NCCLCHECK(ncclSocketGetAddr(sock, handle->stripeAddrs+k-1));
+        comm->nIfs++;
+      }
+      for (int k=0; k<nIfs; k++) {
+        INFO(NCCL_INIT|NCCL_NET, "NET/Socket : striping interface %s (%d Mbps) gets %d of %d sockets",
+            ncclNetSocketDevs[ifs[k]].devName, speeds[k], comm->ifSocks[k], comm->nSocks);
+      }
+    }
+  }
+  handle->nIfs = comm->nIfs;
+  memcpy(handle->ifSocks, comm->ifSocks, sizeof(handle->ifSocks));
+  return ncclSuccess;
+}
+
 ncclResult_t ncclNetSocketListen(int dev, void* opaqueHandle, void** listenComm) {
   if (dev < 0 || dev >= ncclNetIfs) { // data transfer socket is based on specified dev
     return ncclInternalError;
@@ -300,11 +403,12 @@ ncclResult_t ncclNetSocketListen(int dev, void* opaqueHandle, void** listenComm)
   handle->nSocks = comm->nSocks;
   handle->nThreads = comm->nThreads;
   comm->dev = dev;
+  NCCLCHECK(ncclNetSocketStripeListen(comm, handle));
   *listenComm = comm;
   return ncclSuccess;
 }
 
-ncclResult_t ncclNetSocketConnect(int dev, void* opaqueHandle, void** sendComm, ncclNetDeviceHandle_t** /*sendDevComm*/) {
+ncclResult_t ncclNetSocketConnect(int dev, ncclNetCommConfig_t* /*config*/, void* opaqueHandle, void** sendComm, ncclNetDeviceHandle_t** /*sendDevComm*/) {
   if (dev < 0 || dev >= ncclNetIfs) { // data transfer socket is based on specified dev
     return ncclInternalError;
   }
@@ -325,10 +429,13 @@ ncclResult_t ncclNetSocketConnect(int dev, void* opaqueHandle, void** sendComm,
   comm->nSocks = handle->nSocks;
   comm->nThreads = handle->nThreads;
   comm->dev = dev;
+  comm->nIfs = std::max(1, (int)handle->nIfs);
+  memcpy(comm->ifSocks, handle->ifSocks, sizeof(comm->ifSocks));
   CUDACHECK(cudaGetDevice(&comm->cudaDev));
   for (; i<comm->nSocks+1; i++) {
     sock = (i == comm->nSocks) ? &comm->ctrlSock : comm->socks+i;
-    NCCLCHECK(ncclSocketInit(sock, &handle->connectAddr, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
+    int ifc = (i == comm->nSocks) ? 0 : ncclNetSocketIfOfSock(comm->nIfs, comm->ifSocks, i);
+    NCCLCHECK(ncclSocketInit(sock, ifc == 0 ? &handle->connectAddr : handle->stripeAddrs+ifc-1, handle->magic, ncclSocketTypeNetSocket, NULL, 1));
 
     stage->sock = sock;
     stage->state = ncclNetSocketCommStateConnect;
@@ -366,6 +473,8 @@ ncclResult_t ncclNetSocketAccept(void* listenComm, void** recvComm, ncclNetDevic
   rComm->nSocks = lComm->nSocks;
   rComm->nThreads = lComm->nThreads;
   rComm->dev = lComm->dev;
+  rComm->nIfs = lComm->nIfs;
+  memcpy(rComm->ifSocks, lComm->ifSocks, sizeof(rComm->ifSocks));
   CUDACHECK(cudaGetDevice(&rComm->cudaDev));
   for (; i<rComm->nSocks+1; i++) {
     uint8_t sendSockIdx;
@@ -375,7 +484,9 @@ ncclResult_t ncclNetSocketAccept(void* listenComm, void** recvComm, ncclNetDevic
     stage->sock = sock;
     stage->state = ncclNetSocketCommStateAccept;
     stage->iteration = i;
-    NCCLCHECK(ncclSocketAccept(sock, &lComm->sock));
+    // The peer connects sockets in order, so socket i arrives on its interface's listener
+    int ifc = (i == rComm->nSocks) ? 0 : ncclNetSocketIfOfSock(rComm->nIfs, rComm->ifSocks, i);
+    NCCLCHECK(ncclSocketAccept(sock, ifc == 0 ? &lComm->sock : lComm->stripeSocks+ifc-1));
 
 socket_accept_check:
     NCCLCHECK(ncclSocketReady(sock, &ready));
@@ -414,6 +525,7 @@ ncclResult_t ncclNetSocketGetRequest(struct ncclNetSocketComm* comm, int op, voi
       r->used = 1;
       r->comm = comm;
       r->nSubs = 0;
+      r->startTime = 0;
       *req = r;
       return ncclSuccess;
     }
@@ -448,6 +560,7 @@ ncclResult_t ncclNetSocketGetTask(struct ncclNetSocketComm* comm, int op, void*
     r->sock = comm->socks + comm->nextSock;
     r->offset = 0;
     r->result = ncclSuccess;
+    r->doneTime = 0;
     comm->nextSock = (comm->nextSock + 1) % comm->nSocks;
     r->used = 1;
     *req = r;
@@ -461,6 +574,255 @@ ncclResult_t ncclNetSocketGetTask(struct ncclNetSocketComm* comm, int op, void*
   return ncclInternalError;
 }
 
+#if defined(NCCL_SOCKET_URING)
+/* io_uring engine
+ *
+ * All subtasks of a comm are posted to one ring owned by the proxy thread, so
+ * a request split over nSocks sockets costs a single io_uring_enter() and no
+ * helper thread wakeups. Large sends use IORING_OP_SEND_ZC: the buffer must
+ * not be reused until the kernel posts the notification CQE, so a task is
+ * only complete once that notification has been reaped. The ring is set up
+ * through the raw syscalls to avoid depending on liburing.
+ */
+struct ncclNetSocketUring {
+  int fd;
+  unsigned sqEntries;
+  unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+  unsigned *cqHead, *cqTail, *cqMask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void* sqRing;
+  size_t sqRingSize;
+  void* cqRing;
+  size_t cqRingSize;
+  size_t sqesSize;
+  unsigned toSubmit;
+  int zeroCopy; // cleared if the kernel rejects IORING_OP_SEND_ZC
+  struct ncclNetSocketTask* tasks;
+  int nTasks;
+};
+
+static void ncclNetSocketUringFree(struct ncclNetSocketUring* u) {
+  if (u == NULL) return;
+  if (u->sqes) munmap(u->sqes, u->sqesSize);
+  if (u->cqRing && u->cqRing != u->sqRing) munmap(u->cqRing, u->cqRingSize);
+  if (u->sqRing) munmap(u->sqRing, u->sqRingSize);
+  if (u->fd >= 0) close(u->fd);
+  free(u->tasks);
+  free(u);
+}
+
+static ncclResult_t ncclNetSocketUringInit(struct ncclNetSocketComm* comm) {
+  struct ncclNetSocketUring* u;
+  NCCLCHECK(ncclCalloc(&u, 1));
+  u->fd = -1;
+  u->nTasks = MAX_REQUESTS * comm->nSocks;
+  unsigned entries = 1;
+  while (entries < (unsigned)u->nTasks) entries <<= 1;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  u->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0) {
+    INFO(NCCL_INIT|NCCL_NET, "NET/Socket : io_uring_setup failed : %s, using helper threads", strerror(errno));
+    ncclNetSocketUringFree(u);
+    return ncclSuccess;
+  }
+  u->sqEntries = p.sq_entries;
+  u->sqRingSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+  u->cqRingSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) u->sqRingSize = u->cqRingSize = std::max(u->sqRingSize, u->cqRingSize);
+  u->sqRing = mmap(NULL, u->sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sqRing == MAP_FAILED) { u->sqRing = NULL; goto fail; }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    u->cqRing = u->sqRing;
+  } else {
+    u->cqRing = mmap(NULL, u->cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if (u->cqRing == MAP_FAILED) { u->cqRing = NULL; goto fail; }
+  }
+  u->sqesSize = p.sq_entries*sizeof(struct io_uring_sqe);
+  u->sqes = (struct io_uring_sqe*)mmap(NULL, u->sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) { u->sqes = NULL; goto fail; }
+  u->sqHead  = (unsigned*)((char*)u->sqRing + p.sq_off.head);
+  u->sqTail  = (unsigned*)((char*)u->sqRing + p.sq_off.tail);
+  u->sqMask  = (unsigned*)((char*)u->sqRing + p.sq_off.ring_mask);
+  u->sqArray = (unsigned*)((char*)u->sqRing + p.sq_off.array);
+  u->cqHead  = (unsigned*)((char*)u->cqRing + p.cq_off.head);
+  u->cqTail  = (unsigned*)((char*)u->cqRing + p.cq_off.tail);
+  u->cqMask  = (unsigned*)((char*)u->cqRing + p.cq_off.ring_mask);
+  u->cqes    = (struct io_uring_cqe*)((char*)u->cqRing + p.cq_off.cqes);
+#if defined(IORING_CQE_F_NOTIF)
+  u->zeroCopy = ncclParamSocketZeroCopyMinBytes() >= 0;
+#endif
+  NCCLCHECK(ncclCalloc(&u->tasks, u->nTasks));
+
+  // The ring waits for readiness itself; blocking sockets let it park
+  // operations on the socket instead of completing them with -EAGAIN.
+  for (int i=0; i<comm->nSocks; i++) {
+    int flags = fcntl(comm->socks[i].fd, F_GETFL);
+    if (flags != -1) SYSCHECK(fcntl(comm->socks[i].fd, F_SETFL, flags & ~O_NONBLOCK), "fcntl");
+  }
+  comm->uring = u;
+  INFO(NCCL_INIT|NCCL_NET, "NET/Socket : Using io_uring with %d sockets, %u entries, zero-copy %s",
+      comm->nSocks, u->sqEntries, u->zeroCopy ? "enabled" : "disabled");
+  return ncclSuccess;
+fail:
+  INFO(NCCL_INIT|NCCL_NET, "NET/Socket : io_uring mmap failed : %s, using helper threads", strerror(errno));
+  ncclNetSocketUringFree(u);
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketUringSubmit(struct ncclNetSocketUring* u) {
+  while (u->toSubmit) {
+    int ret = syscall(__NR_io_uring_enter, u->fd, u->toSubmit, 0, 0, NULL, 0);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) return ncclSuccess; // retry on next test
+      WARN("NET/Socket : io_uring_enter failed : %s", strerror(errno));
+      return ncclSystemError;
+    }
+    u->toSubmit -= ret;
+  }
+  return ncclSuccess;
+}
+
+// Posts a send/recv for what is left of the task
+static ncclResult_t ncclNetSocketUringPost(struct ncclNetSocketUring* u, struct ncclNetSocketTask* t) {
+  unsigned tail = *u->sqTail;
+  if (tail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE) == u->sqEntries) {
+    NCCLCHECK(ncclNetSocketUringSubmit(u));
+    if (tail - __atomic_load_n(u->sqHead, __ATOMIC_ACQUIRE) == u->sqEntries) {
+      WARN("NET/Socket : io_uring submission queue full");
+      return ncclInternalError;
+    }
+  }
+  unsigned idx = tail & *u->sqMask;
+  struct io_uring_sqe* sqe = u->sqes+idx;
+  memset(sqe, 0, sizeof(*sqe));
+  int remaining = t->size - t->offset;
+  t->zc = 0;
+  if (t->op == NCCL_SOCKET_SEND) {
+    sqe->opcode = IORING_OP_SEND;
+#if defined(IORING_CQE_F_NOTIF)
+    if (u->zeroCopy && remaining >= ncclParamSocketZeroCopyMinBytes()) {
+      sqe->opcode = IORING_OP_SEND_ZC;
+      t->zc = 1;
+    }
+#endif
+    sqe->msg_flags = MSG_NOSIGNAL;
+  } else {
+    sqe->opcode = IORING_OP_RECV;
+    sqe->msg_flags = MSG_WAITALL;
+  }
+  sqe->fd = t->sock->fd;
+  sqe->addr = (uint64_t)(uintptr_t)((char*)t->data + t->offset);
+  sqe->len = remaining;
+  sqe->user_data = (uint64_t)(uintptr_t)t;
+  u->sqArray[idx] = idx;
+  __atomic_store_n(u->sqTail, tail+1, __ATOMIC_RELEASE);
+  u->toSubmit++;
+  t->inflight = 1;
+  return ncclSuccess;
+}
+
+// Reaps completions, reposting short transfers, then submits everything queued
+static ncclResult_t ncclNetSocketUringProgress(struct ncclNetSocketUring* u) {
+  unsigned head = *u->cqHead;
+  unsigned tail = __atomic_load_n(u->cqTail, __ATOMIC_ACQUIRE);
+  for (; head != tail; head++) {
+    struct io_uring_cqe* cqe = u->cqes + (head & *u->cqMask);
+    struct ncclNetSocketTask* t = (struct ncclNetSocketTask*)(uintptr_t)cqe->user_data;
+    int res = cqe->res;
+#if defined(IORING_CQE_F_NOTIF)
+    if (cqe->flags & IORING_CQE_F_NOTIF) { t->zcPending--; continue; }
+    if (cqe->flags & IORING_CQE_F_MORE) t->zcPending++;
+#endif
+    t->inflight = 0;
+    if (t->result != ncclSuccess) continue;
+    if (res < 0) {
+      if (t->zc && (res == -EINVAL || res == -EOPNOTSUPP)) {
+        INFO(NCCL_NET, "NET/Socket : zero-copy send not supported : %s, disabling it", strerror(-res));
+        u->zeroCopy = 0;
+      } else if (res != -EAGAIN && res != -EINTR) {
+        WARN("NET/Socket : io_uring %s failed : %s", t->op == NCCL_SOCKET_SEND ? "send" : "recv", strerror(-res));
+        t->result = ncclRemoteError;
+        continue;
+      }
+    } else if (res == 0 && t->op == NCCL_SOCKET_RECV) {
+      WARN("NET/Socket : connection closed by remote peer");
+      t->result = ncclRemoteError;
+      continue;
+    } else {
+      t->offset += res;
+    }
+    if (t->offset < t->size) NCCLCHECK(ncclNetSocketUringPost(u, t));
+  }
+  __atomic_store_n(u->cqHead, head, __ATOMIC_RELEASE);
+  NCCLCHECK(ncclNetSocketUringSubmit(u));
+  return ncclSuccess;
+}
+
+static ncclResult_t ncclNetSocketUringGetTask(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketTask** req) {
+  struct ncclNetSocketUring* u = comm->uring;
+  for (int i=0; i<u->nTasks; i++) {
+    struct ncclNetSocketTask* r = u->tasks+i;
+    if (r->used) continue;
+    r->op = op;
+    r->data = data;
+    r->size = size;
+    r->sock = comm->socks + comm->nextSock;
+    r->offset = 0;
+    r->result = ncclSuccess;
+    r->zcPending = 0;
+    r->doneTime = 0;
+    comm->nextSock = (comm->nextSock + 1) % comm->nSocks;
+    r->used = 1;
+    NCCLCHECK(ncclNetSocketUringPost(u, r));
+    *req = r;
+    return ncclSuccess;
+  }
+  WARN("NET/Socket : unable to allocate subtasks");
+  return ncclInternalError;
+}
+#else
+struct ncclNetSocketUring {};
+static void ncclNetSocketUringFree(struct ncclNetSocketUring* u) {}
+static ncclResult_t ncclNetSocketUringInit(struct ncclNetSocketComm* comm) {
+  INFO(NCCL_INIT|NCCL_NET, "NET/Socket : io_uring not supported by this build, using helper threads");
+  return ncclSuccess;
+}
+static ncclResult_t ncclNetSocketUringProgress(struct ncclNetSocketUring* u) { return ncclSuccess; }
+static ncclResult_t ncclNetSocketUringGetTask(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketTask** req) {
+  return ncclInternalError;
+}
+#endif
+
+static ncclResult_t ncclNetSocketNewTask(struct ncclNetSocketComm* comm, int op, void* data, int size, struct ncclNetSocketTask** req) {
+  if (comm->uring) return ncclNetSocketUringGetTask(comm, op, data, size, req);
+  return ncclNetSocketGetTask(comm, op, data, size, req);
+}
+
+// The sender gives every socket a share of each striped message in proportion
+// to its measured throughput and sends the shares along with the size, so
+// that both sides split the message the same way.
+static void ncclNetSocketStripeShares(struct ncclNetSocketComm* comm, uint8_t* share) {
+  float maxRate = 0;
+  for (int s=0; s<comm->nSocks; s++) maxRate = std::max(maxRate, comm->sockRate[s]);
+  for (int s=0; s<comm->nSocks; s++) {
+    float rate = comm->sockRate[s];
+    // Sockets not measured yet get a full share
+    share[s] = (maxRate > 0 && rate > 0) ? std::max(1, (int)(255*rate/maxRate + 0.5f)) : 255;
+  }
+}
+
+static void ncclNetSocketStripeUpdate(struct ncclNetSocketComm* comm, struct ncclNetSocketRequest* r) {
+  for (int i=0; i<r->nSubs; i++) {
+    struct ncclNetSocketTask* sub = r->tasks[i];
+    int s = sub->sock - comm->socks;
+    float rate = (float)sub->size / std::max((uint64_t)1, sub->doneTime - r->startTime);
+    comm->sockRate[s] = comm->sockRate[s] > 0 ? 0.875f*comm->sockRate[s] + 0.125f*rate : rate;
+  }
+}
+
 ncclResult_t ncclNetSocketTest(void* request, int* done, int* size) {
   *done = 0;
   struct ncclNetSocketRequest *r = (struct ncclNetSocketRequest*)request;
@@ -491,28 +853,57 @@ ncclResult_t ncclNetSocketTest(void* request, int* done, int* size) {
     r->size = data;
     r->offset = 0;
     r->used = 2; // done exchanging size
+    struct ncclNetSocketComm* comm = r->comm;
+    bool stripe = comm->nIfs > 1;
+    if (stripe) {
+      int shareOffset = 0;
+      if (r->op == NCCL_SOCKET_SEND) ncclNetSocketStripeShares(comm, r->share);
+      NCCLCHECK(ncclSocketWait(r->op, r->ctrlSock, r->share, comm->nSocks, &shareOffset));
+    }
     // divide into subtasks
     int chunkOffset = 0, i = 0;
-    if (r->comm->nSocks > 0) {
-      // each request can be divided up to nSocks tasks
-      int taskSize = std::max(MIN_CHUNKSIZE, DIVUP(r->size, r->comm->nSocks));
-      while (chunkOffset < r->size) {
-        int chunkSize = std::min(taskSize, r->size-chunkOffset);
-        NCCLCHECK(ncclNetSocketGetTask(r->comm, r->op, (char*)(r->data)+chunkOffset, chunkSize, r->tasks+i++));
-        chunkOffset += chunkSize;
+    if (comm->nSocks > 0) {
+      if (comm->uringTried == 0) {
+        comm->uringTried = 1;
+        if (ncclParamSocketIoUring()) NCCLCHECK(ncclNetSocketUringInit(comm));
+      }
+      if (stripe && r->size >= comm->nSocks*MIN_CHUNKSIZE) {
+        // one task per socket, sized by its share
+        int total = 0;
+        for (int s=0; s<comm->nSocks; s++) total += r->share[s];
+        comm->nextSock = 0;
+        if (r->op == NCCL_SOCKET_SEND) r->startTime = clockNano();
+        for (int s=0; s<comm->nSocks; s++) {
+          int chunkSize = (s == comm->nSocks-1) ? r->size-chunkOffset : (int)((int64_t)r->size*r->share[s]/total);
+          NCCLCHECK(ncclNetSocketNewTask(comm, r->op, (char*)(r->data)+chunkOffset, chunkSize, r->tasks+i++));
+          chunkOffset += chunkSize;
+        }
+      } else {
+        // each request can be divided up to nSocks tasks
+        int taskSize = std::max(MIN_CHUNKSIZE, DIVUP(r->size, comm->nSocks));
+        while (chunkOffset < r->size) {
+          int chunkSize = std::min(taskSize, r->size-chunkOffset);
+          NCCLCHECK(ncclNetSocketNewTask(comm, r->op, (char*)(r->data)+chunkOffset, chunkSize, r->tasks+i++));
+          chunkOffset += chunkSize;
+        }
       }
     }
     r->nSubs = i;
   }
   if (r->used == 2) { // already exchanged size
     if (r->nSubs > 0) {
+      if (r->comm->uring) NCCLCHECK(ncclNetSocketUringProgress(r->comm->uring));
       int nCompleted = 0;
       for (int i=0; i<r->nSubs; i++) {
         struct ncclNetSocketTask* sub = r->tasks[i];
         if (sub->result != ncclSuccess) return sub->result;
-        if (sub->offset == sub->size) nCompleted++;
+        if (sub->offset == sub->size && sub->inflight == 0 && sub->zcPending == 0) {
+          nCompleted++;
+          if (r->startTime && sub->doneTime == 0) sub->doneTime = clockNano();
+        }
       }
       if (nCompleted == r->nSubs) {
+        if (r->startTime) ncclNetSocketStripeUpdate(r->comm, r);
         if (size) *size = r->size;
         *done = 1;
         r->used = 0;
@@ -564,6 +955,7 @@ ncclResult_t ncclNetSocketCloseListen(void* opaqueComm) {
     int ready;
     NCCLCHECK(ncclSocketReady(&comm->sock, &ready));
     if (ready) NCCLCHECK(ncclSocketClose(&comm->sock));
+    for (int i=0; i<comm->nIfs-1; i++) NCCLCHECK(ncclSocketClose(comm->stripeSocks+i));
     free(comm);
   }
   return ncclSuccess;
@@ -583,6 +975,7 @@ ncclResult_t ncclNetSocketClose(void* opaqueComm) {
       }
       free(res->threadTaskQueue.tasks);
     }
+    ncclNetSocketUringFree(comm->uring);
     int ready;
     NCCLCHECK(ncclSocketReady(&comm->ctrlSock, &ready));
     if (ready) NCCLCHECK(ncclSocketClose(&comm->ctrlSock));
@@ -614,5 +1007,8 @@ ncclNet_t ncclNetSocket = {
   ncclNetSocketClose,
   ncclNetSocketCloseListen,
   NULL /* getDeviceMr */,
-  NULL /* irecvConsumed */
+  NULL /* irecvConsumed */,
+  NULL /* isendv */,
+  NULL /* irecvv */,
+  NULL /* testAll */
 };
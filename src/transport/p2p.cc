@@ -12,6 +12,8 @@
 #include "graph.h"
 #include "graph/topo.h"
 #include "p2p.h"
+#include "bufpool.h"
+#include "ipccache.h"
 
 enum p2pType { P2P_DIRECT, P2P_INTERMEDIATE, P2P_IPC, P2P_CUMEM };
 
@@ -21,10 +23,29 @@ struct ncclP2pBuff {
   ncclIpcDesc ipcDesc;
 };
 
+// Proxy setup request. Buffers only reached through direct pointers within the
+// process can be pooled (RCCL_BUFFER_POOL); headerSize is then the size of the
+// ncclSendMem/ncclRecvMem part that must stay mapped, and 0 otherwise.
+struct p2pSetupReq {
+  int size;
+  int headerSize;
+  int direct; // Every rank mapping the buffer shares the address space of its owner
+  int memType;
+  // Simple buffer allocated apart when its memory type differs, 0 if it is part of the buffer
+  int simpleSize;
+  int simpleMemType;
+};
+
+struct p2pSetupResp {
+  struct ncclP2pBuff p2pBuff;
+  struct ncclP2pBuff simpleBuff;
+};
+
 struct p2pConnectInfo {
   int rank;
   int read;
   struct ncclP2pBuff p2pBuff;
+  struct ncclP2pBuff simpleBuff; // Size 0 when the Simple buffer follows the others in p2pBuff
   // Used by CE memcpy
   char shmName[7];
   int shmSize;
@@ -52,7 +73,8 @@ struct p2pShmProxyInfo {
 
   // Used by CE memcpy progress only
   uint64_t step;
-  cudaStream_t stream;
+  cudaStream_t streams[RCCL_CE_MAX_STREAMS];
+  int nStreams;
   cudaEvent_t events[NCCL_STEPS];
 };
 static_assert(sizeof(p2pConnectInfo) <= CONNECT_SIZE, "P2P Connect info is too large");
@@ -65,6 +87,10 @@ struct p2pResources {
   };
   void* sendMemIpc;
   void* recvMemIpc;
+  // Simple buffer allocated apart from sendDevMem/recvDevMem (RCCL_P2P_SIMPLE_MEM_TYPE)
+  char* simpleBuff;
+  void* sendSimpleIpc;
+  void* recvSimpleIpc;
   // CE memcpy support
   struct p2pShmProxyInfo proxyInfo;
   struct p2pShm* shm;
@@ -79,6 +105,11 @@ struct p2pCuMemProxyInfo {
   struct ncclP2pBuff p2pBuff;
 };
 
+struct p2pProxyBuffs {
+  void* buff;
+  void* simpleBuff;
+};
+
 #include <sys/types.h>
 
 /* Convert a PCI busId string into a local cudaDev device index (cf. CUDA_VISIBLE_DEVICES) */
@@ -102,6 +133,16 @@ static int busIdToCudaDev(int64_t busId) {
 NCCL_PARAM(P2pUseCudaMemcpy, "P2P_USE_CUDA_MEMCPY", 0);
 static int useMemcpy = 0;
 static void initCeOperation();
+// Number of streams the proxy spreads CE copies over, per connection
+RCCL_PARAM(CeStreams, "CE_STREAMS", 2);
+
+ncclResult_t ncclCeStreamsCreate(cudaStream_t* streams, int* nStreams) {
+  *nStreams = std::min(std::max((int)rcclParamCeStreams(), 1), RCCL_CE_MAX_STREAMS);
+  for (int i=0; i<*nStreams; i++) {
+    CUDACHECK(cudaStreamCreateWithFlags(streams+i, cudaStreamNonBlocking));
+  }
+  return ncclSuccess;
+}
 
 /* Determine if two peers can communicate through p2p */
 ncclResult_t p2pCanConnect(int* ret, struct ncclTopoSystem* topo, struct ncclTopoGraph* graph, struct ncclPeerInfo* info1, struct ncclPeerInfo* info2) {
@@ -206,7 +247,7 @@ ncclResult_t p2pCanConnect(int* ret, struct ncclTopoSystem* topo, struct ncclTop
   } while (0)
 
 // cuMem API support
-ncclResult_t ncclP2pAllocateShareableBuffer(size_t size, ncclIpcDesc *ipcDesc, void **ptr) {
+static ncclResult_t p2pAllocateShareableBuffer(size_t size, unsigned int flags, ncclIpcDesc *ipcDesc, void **ptr) {
   if (ncclCuMemEnable()) {
 #if CUDART_VERSION >= 11030
     CUmemAllocationHandleType type = ncclCuMemHandleType;
@@ -225,11 +266,7 @@ ncclResult_t ncclP2pAllocateShareableBuffer(size_t size, ncclIpcDesc *ipcDesc, v
 #endif
   } else {
     // Allocate a CUDA buffer and generate an IPC handle for it
-#if defined(HIP_UNCACHED_MEMORY)
-    NCCLCHECK(ncclCudaCalloc((char **)ptr, size, nullptr, hipDeviceMallocUncached));
-#else
-    NCCLCHECK(ncclCudaCalloc((char **)ptr, size, nullptr, hipDeviceMallocFinegrained));
-#endif
+    NCCLCHECK(ncclCudaCalloc((char **)ptr, size, nullptr, flags));
     cudaError_t res = cudaIpcGetMemHandle(&ipcDesc->devIpc, *ptr);
     if (res != cudaSuccess) {
       WARN("cudaIpcGetMemHandle failed : %s", cudaGetErrorString(res));
@@ -242,6 +279,14 @@ ncclResult_t ncclP2pAllocateShareableBuffer(size_t size, ncclIpcDesc *ipcDesc, v
   return ncclSuccess;
 }
 
+ncclResult_t ncclP2pAllocateShareableBuffer(size_t size, ncclIpcDesc *ipcDesc, void **ptr) {
+#if defined(HIP_UNCACHED_MEMORY)
+  return p2pAllocateShareableBuffer(size, hipDeviceMallocUncached, ipcDesc, ptr);
+#else
+  return p2pAllocateShareableBuffer(size, hipDeviceMallocFinegrained, ipcDesc, ptr);
+#endif
+}
+
 ncclResult_t ncclP2pFreeShareableBuffer(ncclIpcDesc *ipcDesc) {
   return ncclSuccess;
 }
@@ -286,7 +331,7 @@ ncclResult_t ncclP2pImportShareableBuffer(struct ncclComm *comm, int tpPeer, siz
 #endif
   } else {
     // Legacy CUDA IPC
-    CUDACHECK(cudaIpcOpenMemHandle(devMemPtr, ipcDesc->devIpc, cudaIpcMemLazyEnablePeerAccess));
+    NCCLCHECK(ncclIpcCacheOpen(&ipcDesc->devIpc, devMemPtr));
   }
 
   INFO(NCCL_P2P, "Imported shareable buffer device %d size %zi ptr %p", comm->cudaDev, size, *devMemPtr);
@@ -295,8 +340,36 @@ ncclResult_t ncclP2pImportShareableBuffer(struct ncclComm *comm, int tpPeer, siz
 }
 
 // Setting this to non zero causes P2P to use Reads rather than Writes
+// Pipeline depth of P2P connections. XGMI reaches full bandwidth with fewer steps
+// in flight, a smaller depth saves buffer memory.
+RCCL_PARAM(P2pSteps, "P2P_STEPS", NCCL_STEPS);
+
+// The CE memcpy proxy copies buffers of the default depth
+static int p2pSteps() {
+  return useMemcpy ? NCCL_STEPS : ncclTransportSteps(rcclParamP2pSteps(), "P2P");
+}
+
 NCCL_PARAM(P2pReadEnable, "P2P_READ_ENABLE", -2);
 NCCL_PARAM(P2pDirectDisable, "P2P_DIRECT_DISABLE", 0);
+// Memory type of the LL/LL128 FIFOs and connection flags, and of the Simple buffers:
+// 0 fine-grained, 1 uncached, 2 coarse-grained, -1 for the default of the arch
+RCCL_PARAM(P2pLlMemType, "P2P_LL_MEM_TYPE", -1);
+RCCL_PARAM(P2pSimpleMemType, "P2P_SIMPLE_MEM_TYPE", -1);
+
+static unsigned int p2pMemFlags(int memType) {
+  if (memType == ARCH_MEM_UNCACHED) return hipDeviceMallocUncached;
+  if (memType == ARCH_MEM_COARSEGRAINED) return hipDeviceMallocDefault;
+  return hipDeviceMallocFinegrained;
+}
+
+// The Simple buffer gets its own allocation when its memory type differs. cuMem
+// and pooled allocations have no memory type to choose, nor does CE memcpy.
+static void p2pMemTypes(struct ncclComm* comm, struct p2pSetupReq* req) {
+  const char* arch = comm->topo->nodes[GPU].nodes[0].gpu.gcn;
+  req->memType = rcclParamP2pLlMemType() >= 0 ? rcclParamP2pLlMemType() : GetP2pBuffMemType(arch, false);
+  req->simpleMemType = rcclParamP2pSimpleMemType() >= 0 ? rcclParamP2pSimpleMemType() : GetP2pBuffMemType(arch, true);
+  if (ncclCuMemEnable() || useMemcpy || req->headerSize) req->simpleMemType = req->memType;
+}
 
 #define P2P_SAME_PID(MYINFO, PEERINFO) ((MYINFO->hostHash == PEERINFO->hostHash) && (MYINFO->pidHash == PEERINFO->pidHash))
 
@@ -375,11 +448,10 @@ ncclResult_t p2pSendSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, st
   // For CollNet, use write for scatter-reduce (conn 1), read for broadcast-gather (conn 0)
   if (graph && connIndex == 1) info->read = 0;
   const char* useReadStr = info->read ? "/read" : "";
+  send->conn.nSteps = p2pSteps();
 
   int sendSize = sizeof(struct ncclSendMem);
-  // For P2P Read the SIMPLE buffer is tagged on the end of the ncclSendMem structure
-  if (info->read) sendSize += comm->buffSizes[NCCL_PROTO_SIMPLE];
-  ALIGN_SIZE(sendSize, CUDA_IPC_MIN);
+  int simpleSize = info->read ? ncclConnBuffSize(comm->buffSizes[NCCL_PROTO_SIMPLE], send->conn.nSteps) : 0;
 
   if (intermediateRank == -1) {
     info->rank = myInfo->rank;
@@ -418,8 +490,27 @@ ncclResult_t p2pSendSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, st
     info->shmSize = resources->proxyInfo.shmSize;
     memcpy(info->shmName, resources->proxyInfo.shmName, sizeof(info->shmName));
   } else {
-    NCCLCHECK(ncclProxyCallBlocking(comm, &send->proxyConn, ncclProxyMsgSetup, &sendSize, sizeof(int), &info->p2pBuff, sizeof(struct ncclP2pBuff)));
+    struct p2pSetupReq req = {};
+    struct p2pSetupResp resp;
+    if (resources->type == P2P_DIRECT && ncclBufPoolEnabled(myInfo->cudaDev)) req.headerSize = sizeof(struct ncclSendMem);
+    req.direct = P2P_SAME_PID(myInfo, peerInfo) && P2P_SAME_PID(myInfo, (comm->peerInfo+info->rank));
+    p2pMemTypes(comm, &req);
+    // For P2P Read the SIMPLE buffer is tagged on the end of the ncclSendMem structure, unless it has its own memory type
+    if (req.simpleMemType != req.memType) {
+      req.simpleSize = simpleSize;
+      ALIGN_SIZE(req.simpleSize, CUDA_IPC_MIN);
+    } else {
+      sendSize += simpleSize;
+    }
+    ALIGN_SIZE(sendSize, CUDA_IPC_MIN);
+    req.size = sendSize;
+    NCCLCHECK(ncclProxyCallBlocking(comm, &send->proxyConn, ncclProxyMsgSetup, &req, sizeof(req), &resp, sizeof(resp)));
+    info->p2pBuff = resp.p2pBuff;
+    info->simpleBuff = resp.simpleBuff;
     NCCLCHECK(p2pMap(comm, &send->proxyConn, myInfo, comm->peerInfo+info->rank, &info->p2pBuff, (void**)&resources->sendDevMem, &resources->sendMemIpc));
+    if (info->simpleBuff.size) {
+      NCCLCHECK(p2pMap(comm, &send->proxyConn, myInfo, comm->peerInfo+info->rank, &info->simpleBuff, (void**)&resources->simpleBuff, &resources->sendSimpleIpc));
+    }
   }
 
   return ncclSuccess;
@@ -441,10 +532,12 @@ ncclResult_t p2pRecvSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, st
   // For CollNet, use write for scatter-reduce (conn 1), read for broadcast-gather (conn 0)
   if (graph && connIndex == 1) info->read = 0;
 
+  recv->conn.nSteps = p2pSteps();
+
   int recvSize = sizeof(struct ncclRecvMem);
   // For P2P Read the SIMPLE buffer is tagged on the end of the ncclSendMem structure
-  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) if (!(info->read && p == NCCL_PROTO_SIMPLE)) recvSize += comm->buffSizes[p];
-  ALIGN_SIZE(recvSize, CUDA_IPC_MIN);
+  for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) if (p != NCCL_PROTO_SIMPLE) recvSize += ncclConnBuffSize(comm->buffSizes[p], recv->conn.nSteps);
+  int simpleSize = info->read ? 0 : ncclConnBuffSize(comm->buffSizes[NCCL_PROTO_SIMPLE], recv->conn.nSteps);
 
   if (intermediateRank == -1) {
     info->rank = myInfo->rank;
@@ -470,9 +563,27 @@ ncclResult_t p2pRecvSetup(struct ncclComm* comm, struct ncclTopoGraph* graph, st
 
   tpProxyRank = comm->topParentRanks[info->rank];
   NCCLCHECK(ncclProxyConnect(comm, TRANSPORT_P2P, 0, tpProxyRank, &recv->proxyConn));
-  NCCLCHECK(ncclProxyCallBlocking(comm, &recv->proxyConn, ncclProxyMsgSetup, &recvSize, sizeof(int), &info->p2pBuff, sizeof(struct ncclP2pBuff)));
+  struct p2pSetupReq req = {};
+  struct p2pSetupResp resp;
+  if (resources->type == P2P_DIRECT && ncclBufPoolEnabled(myInfo->cudaDev)) req.headerSize = sizeof(struct ncclRecvMem);
+  req.direct = P2P_SAME_PID(myInfo, peerInfo) && P2P_SAME_PID(myInfo, (comm->peerInfo+info->rank));
+  p2pMemTypes(comm, &req);
+  if (req.simpleMemType != req.memType) {
+    req.simpleSize = simpleSize;
+    ALIGN_SIZE(req.simpleSize, CUDA_IPC_MIN);
+  } else {
+    recvSize += simpleSize;
+  }
+  ALIGN_SIZE(recvSize, CUDA_IPC_MIN);
+  req.size = recvSize;
+  NCCLCHECK(ncclProxyCallBlocking(comm, &recv->proxyConn, ncclProxyMsgSetup, &req, sizeof(req), &resp, sizeof(resp)));
+  info->p2pBuff = resp.p2pBuff;
+  info->simpleBuff = resp.simpleBuff;
 
   NCCLCHECK(p2pMap(comm, &recv->proxyConn, myInfo, comm->peerInfo+info->rank, &info->p2pBuff, (void**)&resources->recvDevMem, &resources->recvMemIpc));
+  if (info->simpleBuff.size) {
+    NCCLCHECK(p2pMap(comm, &recv->proxyConn, myInfo, comm->peerInfo+info->rank, &info->simpleBuff, (void**)&resources->simpleBuff, &resources->recvSimpleIpc));
+  }
   return ncclSuccess;
 }
 
@@ -483,16 +594,22 @@ static ncclResult_t p2pSendConnect(struct ncclComm* comm, struct ncclConnect* co
   struct p2pConnectInfo* info = (struct p2pConnectInfo*)connectInfo;
 
   NCCLCHECK(p2pMap(comm, &send->proxyConn, comm->peerInfo+rank, comm->peerInfo+info->rank, &info->p2pBuff, (void**)&remDevMem, &resources->recvMemIpc));
+  char* remSimple = NULL;
+  if (info->simpleBuff.size) {
+    NCCLCHECK(p2pMap(comm, &send->proxyConn, comm->peerInfo+rank, comm->peerInfo+info->rank, &info->simpleBuff, (void**)&remSimple, &resources->recvSimpleIpc));
+  }
 
   char* buff = (char*)(remDevMem+1);
   for (int p=0; p<NCCL_NUM_PROTOCOLS; p++) {
     if (info->read && p == NCCL_PROTO_SIMPLE) {
       /* For P2P Read the SIMPLE buffer is local (ncclSendMem) */
       if (resources->sendDevMem == NULL) return ncclInternalError; // We should not use read + memcpy
-      send->conn.buffs[p] = (char*)(resources->sendDevMem+1);
+      send->conn.buffs[p] = resources->simpleBuff ? resources->simpleBuff : (char*)(resources->sendDevMem+1);
+    } else if (p == NCCL_PROTO_SIMPLE && remSimple) {
+      send->conn.buffs[p] = remSimple;
     } else {
       send->conn.buffs[p] = buff;
-      buff += comm->buffSizes[p];
+      buff += ncclConnBuffSize(comm->buffSizes[p], send->conn.nSteps);
     }
   }
 
@@ -520,6 +637,7 @@ ncclResult_t p2pRecvConnect(struct ncclComm* comm, struct ncclConnect* connectIn
   struct p2pConnectInfo* info = (struct p2pConnectInfo*)connectInfo;
 
   struct ncclSendMem* remDevMem = NULL;
+  char* remSimple = NULL;
 
   if (useMemcpy) {
     char shmPath[PATH_MAX];
@@ -533,6 +651,9 @@ ncclResult_t p2pRecvConnect(struct ncclComm* comm, struct ncclConnect* connectIn
     recv->conn.head = &resources->devShm->sendMem.head;
   } else {
     NCCLCHECK(p2pMap(comm, &recv->proxyConn, comm->peerInfo+rank, comm->peerInfo+info->rank, &info->p2pBuff, (void**)&remDevMem, &resources->sendMemIpc));
+    if (info->simpleBuff.size) {
+      NCCLCHECK(p2pMap(comm, &recv->proxyConn, comm->peerInfo+rank, comm->peerInfo+info->rank, &info->simpleBuff, (void**)&remSimple, &resources->sendSimpleIpc));
+    }
 
     struct ncclRecvMem* devMem = resources->recvDevMem;
     recv->conn.tail = &devMem->tail;
@@ -546,10 +667,12 @@ ncclResult_t p2pRecvConnect(struct ncclComm* comm, struct ncclConnect* connectIn
     if (info->read && p == NCCL_PROTO_SIMPLE) {
       if (remDevMem == NULL) return ncclInternalError; // We should not use read + memcpy
       /* For P2P Read the SIMPLE buffer is remote (ncclSendMem) */
-      recv->conn.buffs[p] = (char*)(remDevMem+1);
+      recv->conn.buffs[p] = remSimple ? remSimple : (char*)(remDevMem+1);
+    } else if (p == NCCL_PROTO_SIMPLE && resources->simpleBuff) {
+      recv->conn.buffs[p] = resources->simpleBuff;
     } else {
       recv->conn.buffs[p] = buff;
-      buff += comm->buffSizes[p];
+      buff += ncclConnBuffSize(comm->buffSizes[p], recv->conn.nSteps);
     }
   }
   return ncclSuccess;
@@ -564,8 +687,10 @@ ncclResult_t p2pSendFree(struct ncclConnector* send) {
       if (resources->recvMemIpc) NCCLCHECK(ncclCudaFree(resources->recvMemIpc));
     }
     else {
-      if (resources->sendMemIpc) CUDACHECK(cudaIpcCloseMemHandle(resources->sendMemIpc));
-      if (resources->recvMemIpc) CUDACHECK(cudaIpcCloseMemHandle(resources->recvMemIpc));
+      if (resources->sendMemIpc) NCCLCHECK(ncclIpcCacheClose(resources->sendMemIpc));
+      if (resources->recvMemIpc) NCCLCHECK(ncclIpcCacheClose(resources->recvMemIpc));
+      if (resources->sendSimpleIpc) NCCLCHECK(ncclIpcCacheClose(resources->sendSimpleIpc));
+      if (resources->recvSimpleIpc) NCCLCHECK(ncclIpcCacheClose(resources->recvSimpleIpc));
     }
     free(resources);
   }
@@ -581,8 +706,10 @@ ncclResult_t p2pRecvFree(struct ncclConnector* recv) {
       if (resources->recvMemIpc) NCCLCHECK(ncclCudaFree(resources->recvMemIpc));
     }
     else {
-      if (resources->sendMemIpc) CUDACHECK(cudaIpcCloseMemHandle(resources->sendMemIpc));
-      if (resources->recvMemIpc) CUDACHECK(cudaIpcCloseMemHandle(resources->recvMemIpc));
+      if (resources->sendMemIpc) NCCLCHECK(ncclIpcCacheClose(resources->sendMemIpc));
+      if (resources->recvMemIpc) NCCLCHECK(ncclIpcCacheClose(resources->recvMemIpc));
+      if (resources->sendSimpleIpc) NCCLCHECK(ncclIpcCacheClose(resources->sendSimpleIpc));
+      if (resources->recvSimpleIpc) NCCLCHECK(ncclIpcCacheClose(resources->recvSimpleIpc));
       if (useMemcpy) {
         NCCLCHECK(ncclShmClose(resources->handle));
       }
@@ -592,6 +719,79 @@ ncclResult_t p2pRecvFree(struct ncclConnector* recv) {
   return ncclSuccess;
 }
 
+static ncclResult_t p2pProxyAllocBuffer(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState, struct p2pSetupReq* req,
+    size_t size, size_t headerSize, int memType, struct ncclP2pBuff* p2pBuff) {
+  if (req->direct && connection->sameProcess && !ncclCuMemEnable()) {
+    // Peers use the pointer directly, there is no IPC handle to create
+    memset(&p2pBuff->ipcDesc, 0, sizeof(p2pBuff->ipcDesc));
+    if (headerSize) {
+      NCCLCHECK(ncclBufPoolAlloc(&p2pBuff->directPtr, size, headerSize, proxyState));
+    } else {
+      NCCLCHECK(ncclCudaCalloc((char **)&p2pBuff->directPtr, size, nullptr, p2pMemFlags(memType)));
+    }
+  } else {
+    NCCLCHECK(p2pAllocateShareableBuffer(size, p2pMemFlags(memType), &p2pBuff->ipcDesc, &p2pBuff->directPtr));
+  }
+  p2pBuff->size = size;
+  ncclMemStatsAddConn(&proxyState->memStats, TRANSPORT_P2P, false, size);
+  return ncclSuccess;
+}
+
+static ncclResult_t p2pProxyFreeBuffer(void* ptr) {
+  if (ncclBufPoolOwns(ptr)) return ncclBufPoolFree(ptr);
+  return ncclCudaFree(ptr);
+}
+
+static ncclResult_t p2pProxySetupBuffers(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState, void* reqBuff, int reqSize, void* respBuff, int respSize) {
+  if (reqSize != sizeof(struct p2pSetupReq)) return ncclInternalError;
+  if (respSize != sizeof(struct p2pSetupResp)) return ncclInternalError;
+  struct p2pSetupReq* req = (struct p2pSetupReq*)reqBuff;
+  struct p2pSetupResp* resp = (struct p2pSetupResp*)respBuff;
+  memset(resp, 0, sizeof(*resp));
+  NCCLCHECK(p2pProxyAllocBuffer(connection, proxyState, req, req->size, req->headerSize, req->memType, &resp->p2pBuff));
+  if (ncclCuMemEnable()) {
+    // cuMem API support
+    struct p2pCuMemProxyInfo* proxyInfo;
+    NCCLCHECK(ncclCalloc(&proxyInfo, 1));
+    memcpy(&proxyInfo->p2pBuff, &resp->p2pBuff, sizeof(resp->p2pBuff));
+    connection->transportResources = proxyInfo;
+  } else {
+    struct p2pProxyBuffs* buffs;
+    NCCLCHECK(ncclCalloc(&buffs, 1));
+    buffs->buff = resp->p2pBuff.directPtr;
+    connection->transportResources = buffs;
+    if (req->simpleSize) {
+      NCCLCHECK(p2pProxyAllocBuffer(connection, proxyState, req, req->simpleSize, 0, req->simpleMemType, &resp->simpleBuff));
+      buffs->simpleBuff = resp->simpleBuff.directPtr;
+      TRACE(NCCL_INIT|NCCL_P2P, "P2P Simple buffer %p size %d memory type %d, other buffers memory type %d",
+          buffs->simpleBuff, req->simpleSize, req->simpleMemType, req->memType);
+    }
+  }
+  return ncclSuccess;
+}
+
+static ncclResult_t p2pProxyFreeBuffers(struct ncclProxyConnection* connection) {
+  if (ncclCuMemEnable()) {
+    // cuMem API support
+    struct p2pCuMemProxyInfo *proxyInfo = (struct p2pCuMemProxyInfo *) connection->transportResources;
+    if (proxyInfo) {
+      struct ncclP2pBuff *p2pBuff = &proxyInfo->p2pBuff;
+      ncclP2pFreeShareableBuffer(&p2pBuff->ipcDesc);
+      ncclCudaFree(p2pBuff->directPtr);
+      free(proxyInfo);
+    }
+  } else {
+    struct p2pProxyBuffs* buffs = (struct p2pProxyBuffs*)connection->transportResources;
+    if (buffs) {
+      // Do not check return code as CUDA may have already shut down
+      if (buffs->buff) p2pProxyFreeBuffer(buffs->buff);
+      if (buffs->simpleBuff) ncclCudaFree(buffs->simpleBuff);
+      free(buffs);
+    }
+  }
+  return ncclSuccess;
+}
+
 static ncclResult_t p2pSendProxySetup(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
   if (useMemcpy) {
     // CE memcpy support
@@ -614,46 +814,20 @@ static ncclResult_t p2pSendProxySetup(struct ncclProxyConnection* connection, st
     memcpy(proxyInfo->shmName, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof(proxyInfo->shmName));
 
     NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
+    ncclMemStatsAdd(&proxyState->memStats, ncclMemProxy, false, proxyState->buffSizes[NCCL_PROTO_SIMPLE]);
+    ncclMemStatsAdd(&proxyState->memStats, ncclMemProxy, true, proxyInfo->shmSize + sizeof(*proxyInfo->ceRecvMem));
 
     if (respSize != sizeof(struct p2pShmProxyInfo)) return ncclInternalError;
     memcpy(respBuff, proxyInfo, sizeof(struct p2pShmProxyInfo));
   } else {
-    if (reqSize != sizeof(int)) return ncclInternalError;
-    int size = *((int*)reqBuff);
-    if (respSize != sizeof(struct ncclP2pBuff)) return ncclInternalError;
-    struct ncclP2pBuff* p2pBuff = (struct ncclP2pBuff*)respBuff;
-    NCCLCHECK(ncclP2pAllocateShareableBuffer(size, &p2pBuff->ipcDesc, &p2pBuff->directPtr));
-    p2pBuff->size = size;
-    if (ncclCuMemEnable()) {
-      // cuMem API support
-      struct p2pCuMemProxyInfo* proxyInfo;
-      NCCLCHECK(ncclCalloc(&proxyInfo, 1));
-      memcpy(&proxyInfo->p2pBuff, p2pBuff, sizeof(*p2pBuff));
-      connection->transportResources = proxyInfo;
-    } else {
-      connection->transportResources = p2pBuff->directPtr;
-    }
+    NCCLCHECK(p2pProxySetupBuffers(connection, proxyState, reqBuff, reqSize, respBuff, respSize));
   }
   *done = 1;
   return ncclSuccess;
 }
 
 static ncclResult_t p2pRecvProxySetup(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState, void* reqBuff, int reqSize, void* respBuff, int respSize, int* done) {
-  if (reqSize != sizeof(int)) return ncclInternalError;
-  int size = *((int*)reqBuff);
-  if (respSize != sizeof(struct ncclP2pBuff)) return ncclInternalError;
-  struct ncclP2pBuff* p2pBuff = (struct ncclP2pBuff*)respBuff;
-  NCCLCHECK(ncclP2pAllocateShareableBuffer(size, &p2pBuff->ipcDesc, &p2pBuff->directPtr));
-  p2pBuff->size = size;
-  if (ncclCuMemEnable()) {
-    // cuMem API support
-    struct p2pCuMemProxyInfo* proxyInfo;
-    NCCLCHECK(ncclCalloc(&proxyInfo, 1));
-    memcpy(&proxyInfo->p2pBuff, p2pBuff, sizeof(*p2pBuff));
-    connection->transportResources = proxyInfo;
-  } else {
-    connection->transportResources = p2pBuff->directPtr;
-  }
+  NCCLCHECK(p2pProxySetupBuffers(connection, proxyState, reqBuff, reqSize, respBuff, respSize));
   *done = 1;
   return ncclSuccess;
 }
@@ -664,7 +838,7 @@ static ncclResult_t p2pSendProxyConnect(struct ncclProxyConnection* connection,
   if (reqSize != sizeof(void*)) return ncclInternalError;
   proxyInfo->recvFifo = *((char**)reqBuff);
 
-  CUDACHECK(cudaStreamCreateWithFlags(&proxyInfo->stream, cudaStreamNonBlocking));
+  NCCLCHECK(ncclCeStreamsCreate(proxyInfo->streams, &proxyInfo->nStreams));
   for (int i=0; i<NCCL_STEPS; i++) {
     CUDACHECK(cudaEventCreate(proxyInfo->events+i));
   }
@@ -680,44 +854,20 @@ static ncclResult_t p2pSendProxyFree(struct ncclProxyConnection* connection, str
       NCCLCHECK(ncclShmClose(proxyInfo->handle));
       NCCLCHECK(ncclCudaHostFree(proxyInfo->ceRecvMem));
       NCCLCHECK(ncclCudaFree(proxyInfo->ceDevBuff));
-      CUDACHECK(cudaStreamDestroy(proxyInfo->stream));
+      for (int i=0; i<proxyInfo->nStreams; i++) CUDACHECK(cudaStreamDestroy(proxyInfo->streams[i]));
       for (int i=0; i<NCCL_STEPS; i++) {
         CUDACHECK(cudaEventDestroy(proxyInfo->events[i]));
       }
       free(proxyInfo);
     }
   } else {
-    if (ncclCuMemEnable()) {
-      // cuMem API support
-      struct p2pCuMemProxyInfo *proxyInfo = (struct p2pCuMemProxyInfo *) connection->transportResources;
-      if (proxyInfo) {
-        struct ncclP2pBuff *p2pBuff = &proxyInfo->p2pBuff;
-        ncclP2pFreeShareableBuffer(&p2pBuff->ipcDesc);
-        ncclCudaFree(p2pBuff->directPtr);
-        free(proxyInfo);
-      }
-    } else {
-      // Do not check return code as CUDA may have already shut down
-      ncclCudaFree(connection->transportResources);
-    }
+    NCCLCHECK(p2pProxyFreeBuffers(connection));
   }
   return ncclSuccess;
 }
 
 static ncclResult_t p2pRecvProxyFree(struct ncclProxyConnection* connection, struct ncclProxyState* proxyState) {
-  if (ncclCuMemEnable()) {
-    struct p2pCuMemProxyInfo *proxyInfo = (struct p2pCuMemProxyInfo *) connection->transportResources;
-    if (proxyInfo) {
-      struct ncclP2pBuff *p2pBuff = &proxyInfo->p2pBuff;
-      ncclP2pFreeShareableBuffer(&p2pBuff->ipcDesc);
-      ncclCudaFree(p2pBuff->directPtr);
-      free(proxyInfo);
-    }
-  } else {
-    // Do not check return code as CUDA may have already shut down
-    ncclCudaFree(connection->transportResources);
-  }
-  return ncclSuccess;
+  return p2pProxyFreeBuffers(connection);
 }
 
 // CE memcpy support
@@ -744,27 +894,29 @@ static ncclResult_t p2pSendProxyProgress(struct ncclProxyState* proxyState, stru
           args->done++;
           continue;
       }
-      if (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps) {
+      volatile struct ncclConnFifo* connFifo = resources->ceRecvMem->connFifo;
+      volatile uint64_t* recvTail = &resources->ceRecvMem->tail;
+      // Check GPU has sent everything, and keep every ready step in flight across the copy streams
+      while (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps &&
+             *recvTail > sub->base+sub->transmitted) {
         int buffSlot = (sub->base+sub->transmitted)%NCCL_STEPS;
-        volatile struct ncclConnFifo* connFifo = resources->ceRecvMem->connFifo;
-        volatile uint64_t* recvTail = &resources->ceRecvMem->tail;
-        // Check GPU has sent everything
-        if ((*recvTail > sub->base+sub->transmitted)) {
-          int size = connFifo[buffSlot].size;
-          CUDACHECK(cudaMemcpyAsync(resources->recvFifo+buffSlot*stepSize, resources->ceDevBuff+buffSlot*stepSize, size, cudaMemcpyDeviceToDevice, resources->stream));
-          CUDACHECK(cudaEventRecord(resources->events[buffSlot], resources->stream));
-          sub->transmitted += args->sliceSteps;
-        }
+        cudaStream_t stream = resources->streams[buffSlot%resources->nStreams];
+        int size = connFifo[buffSlot].size;
+        CUDACHECK(cudaMemcpyAsync(resources->recvFifo+buffSlot*stepSize, resources->ceDevBuff+buffSlot*stepSize, size, cudaMemcpyDeviceToDevice, stream));
+        CUDACHECK(cudaEventRecord(resources->events[buffSlot], stream));
+        sub->transmitted += args->sliceSteps;
+        args->idle = 0;
       }
-      if (sub->done < sub->transmitted) {
+      // Steps may finish out of order on different streams, retire them in order
+      while (sub->done < sub->transmitted) {
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
         cudaError_t res = cudaEventQuery(resources->events[buffSlot]);
         if (res != cudaErrorNotReady) CUDACHECK(res);
-        if (res == cudaSuccess) {
-          sub->done += args->sliceSteps;
-          // Notify SHM
-          resources->shm->recvMem.tail = sub->base + sub->done;
-        }
+        if (res != cudaSuccess) break;
+        sub->done += args->sliceSteps;
+        args->idle = 0;
+        // Notify SHM
+        resources->shm->recvMem.tail = sub->base + sub->done;
         if (sub->done == sub->nsteps) {
           resources->step = sub->base + sub->nsteps;
           args->done++;
@@ -6,6 +6,8 @@
 
 #include "comm.h"
 #include "shm.h"
+#include "p2p.h"
+#include "hostpool.h"
 
 struct shmConnectInfo {
   char shmName[7];
@@ -89,6 +91,7 @@ static ncclResult_t shmSendSetup(struct ncclComm* comm, struct ncclTopoGraph* gr
   }
   info->shmSize = resources->shmSize = shmSize;
   NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1, &resources->hostHandle));
+  ncclMemStatsAddConn(&comm->memStats, TRANSPORT_SHM, true, resources->shmSize);
   TRACE(NCCL_SHM,"Opened shmName %s shmSize %d", shmPath, info->shmSize);
   memcpy(info->shmName, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof(info->shmName));
 
@@ -112,6 +115,7 @@ static ncclResult_t shmRecvSetup(struct ncclComm* comm, struct ncclTopoGraph* gr
   }
   info->shmSize = resources->shmSize = shmSize;
   NCCLCHECK(ncclShmOpen(shmPath, resources->shmSize, (void**)&resources->hostMem, (void**)&resources->devHostMem, 1, &resources->hostHandle));
+  ncclMemStatsAddConn(&comm->memStats, TRANSPORT_SHM, true, resources->shmSize);
   TRACE(NCCL_SHM,"Opened shmName %s shmSize %d", shmPath, info->shmSize);
   memcpy(info->shmName, shmPath+sizeof("/dev/shm/nccl-")-1, sizeof(info->shmName));
 
@@ -127,7 +131,8 @@ struct shmProxyInfo {
 
   // used by progress only
   uint64_t step;
-  cudaStream_t stream;
+  cudaStream_t streams[RCCL_CE_MAX_STREAMS];
+  int nStreams;
   cudaEvent_t events[NCCL_STEPS];
 };
 
@@ -230,8 +235,9 @@ static ncclResult_t shmSendProxyConnect(struct ncclProxyConnection* connection,
   if (reqSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
   memcpy(proxyInfo, reqBuff, reqSize);
   NCCLCHECK(ncclCudaCalloc(&proxyInfo->devFifo, proxyState->buffSizes[NCCL_PROTO_SIMPLE], nullptr));
-  NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
-  CUDACHECK(cudaStreamCreateWithFlags(&proxyInfo->stream, cudaStreamNonBlocking));
+  NCCLCHECK(ncclHostPoolCalloc(&proxyInfo->ceRecvMem, 1));
+  ncclMemStatsAdd(&proxyState->memStats, ncclMemProxy, false, proxyState->buffSizes[NCCL_PROTO_SIMPLE]);
+  NCCLCHECK(ncclCeStreamsCreate(proxyInfo->streams, &proxyInfo->nStreams));
   for (int i=0; i<NCCL_STEPS; i++) {
     CUDACHECK(cudaEventCreate(proxyInfo->events+i));
   }
@@ -248,8 +254,9 @@ static ncclResult_t shmRecvProxyConnect(struct ncclProxyConnection* connection,
   if (reqSize != sizeof(struct shmProxyInfo)) return ncclInternalError;
   memcpy(proxyInfo, reqBuff, reqSize);
   NCCLCHECK(ncclCudaCalloc(&proxyInfo->devFifo, proxyState->buffSizes[NCCL_PROTO_SIMPLE], nullptr));
-  NCCLCHECK(ncclCudaHostCalloc(&proxyInfo->ceRecvMem, 1));
-  CUDACHECK(cudaStreamCreateWithFlags(&proxyInfo->stream, cudaStreamNonBlocking));
+  NCCLCHECK(ncclHostPoolCalloc(&proxyInfo->ceRecvMem, 1));
+  ncclMemStatsAdd(&proxyState->memStats, ncclMemProxy, false, proxyState->buffSizes[NCCL_PROTO_SIMPLE]);
+  NCCLCHECK(ncclCeStreamsCreate(proxyInfo->streams, &proxyInfo->nStreams));
   for (int i=0; i<NCCL_STEPS; i++) {
     CUDACHECK(cudaEventCreate(proxyInfo->events+i));
   }
@@ -264,9 +271,9 @@ static ncclResult_t shmSendProxyFree(struct ncclProxyConnection* connection, str
   struct shmProxyInfo* resources = (struct shmProxyInfo*)connection->transportResources;
 
   if (resources) {
-    CUDACHECK(cudaStreamDestroy(resources->stream));
+    for (int i=0; i<resources->nStreams; i++) CUDACHECK(cudaStreamDestroy(resources->streams[i]));
     NCCLCHECK(ncclCudaFree(resources->devFifo));
-    NCCLCHECK(ncclCudaHostFree(resources->ceRecvMem));
+    NCCLCHECK(ncclHostPoolFree(resources->ceRecvMem));
     for (int i=0; i<NCCL_STEPS; i++) {
       CUDACHECK(cudaEventDestroy(resources->events[i]));
     }
@@ -279,9 +286,9 @@ static ncclResult_t shmRecvProxyFree(struct ncclProxyConnection* connection, str
   struct shmProxyInfo* resources = (struct shmProxyInfo*)connection->transportResources;
 
   if (resources) {
-    CUDACHECK(cudaStreamDestroy(resources->stream));
+    for (int i=0; i<resources->nStreams; i++) CUDACHECK(cudaStreamDestroy(resources->streams[i]));
     NCCLCHECK(ncclCudaFree(resources->devFifo));
-    NCCLCHECK(ncclCudaHostFree(resources->ceRecvMem));
+    NCCLCHECK(ncclHostPoolFree(resources->ceRecvMem));
     for (int i=0; i<NCCL_STEPS; i++) {
       CUDACHECK(cudaEventDestroy(resources->events[i]));
     }
@@ -313,29 +320,31 @@ static ncclResult_t shmSendProxyProgress(struct ncclProxyState* proxyState, stru
           args->done++;
           continue;
       }
-      if (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps) {
+      volatile struct ncclConnFifo* connFifo = resources->ceRecvMem->connFifo;
+      volatile uint64_t* recvTail = &resources->ceRecvMem->tail;
+      // Check GPU has sent everything, and keep every ready step in flight across the copy streams
+      while (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps &&
+             *recvTail > sub->base+sub->transmitted) {
         int buffSlot = (sub->base+sub->transmitted)%NCCL_STEPS;
-        volatile struct ncclConnFifo* connFifo = resources->ceRecvMem->connFifo;
-        volatile uint64_t* recvTail = &resources->ceRecvMem->tail;
-        // Check GPU has sent everything
-        if ((*recvTail > sub->base+sub->transmitted)) {
-          int size = connFifo[buffSlot].size;
-          CUDACHECK(cudaMemcpyAsync(resources->shmFifo+buffSlot*stepSize, resources->devFifo+buffSlot*stepSize, size, cudaMemcpyDeviceToHost, resources->stream));
-          CUDACHECK(cudaEventRecord(resources->events[buffSlot], resources->stream));
-          resources->recvMem->connFifo[buffSlot].size = size;
-          __sync_synchronize(); // make sure connFifo[].size is visible
-          sub->transmitted += args->sliceSteps;
-        }
+        cudaStream_t stream = resources->streams[buffSlot%resources->nStreams];
+        int size = connFifo[buffSlot].size;
+        CUDACHECK(cudaMemcpyAsync(resources->shmFifo+buffSlot*stepSize, resources->devFifo+buffSlot*stepSize, size, cudaMemcpyDeviceToHost, stream));
+        CUDACHECK(cudaEventRecord(resources->events[buffSlot], stream));
+        resources->recvMem->connFifo[buffSlot].size = size;
+        __sync_synchronize(); // make sure connFifo[].size is visible
+        sub->transmitted += args->sliceSteps;
+        args->idle = 0;
       }
-      if (sub->done < sub->transmitted) {
+      // Steps may finish out of order on different streams, retire them in order
+      while (sub->done < sub->transmitted) {
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
         cudaError_t res = cudaEventQuery(resources->events[buffSlot]);
         if (res != cudaErrorNotReady) CUDACHECK(res);
-        if (res == cudaSuccess) {
-          sub->done += args->sliceSteps;
-          // Notify SHM
-          resources->recvMem->tail = sub->base + sub->done;
-        }
+        if (res != cudaSuccess) break;
+        sub->done += args->sliceSteps;
+        args->idle = 0;
+        // Notify SHM
+        resources->recvMem->tail = sub->base + sub->done;
         if (sub->done == sub->nsteps) {
           resources->step = sub->base + sub->nsteps;
           args->done++;
@@ -372,27 +381,29 @@ static ncclResult_t shmRecvProxyProgress(struct ncclProxyState* proxyState, stru
           args->done++;
           continue;
       }
-      if (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps) {
+      volatile struct ncclConnFifo* connFifo = resources->recvMem->connFifo;
+      volatile uint64_t* recvTail = &resources->recvMem->tail;
+      // Check data is ready in SHM, and keep every ready step in flight across the copy streams
+      while (sub->transmitted < sub->done + NCCL_STEPS && sub->transmitted < sub->nsteps &&
+             *recvTail > sub->base+sub->transmitted) {
         int buffSlot = (sub->base+sub->transmitted)%NCCL_STEPS;
-        volatile struct ncclConnFifo* connFifo = resources->recvMem->connFifo;
-        volatile uint64_t* recvTail = &resources->recvMem->tail;
-        // Check data is ready in SHM
-        if ((*recvTail > sub->base+sub->transmitted)) {
-          int size = connFifo[buffSlot].size;
-          CUDACHECK(cudaMemcpyAsync(resources->devFifo+buffSlot*stepSize, resources->shmFifo+buffSlot*stepSize, size, cudaMemcpyHostToDevice, resources->stream));
-          CUDACHECK(cudaEventRecord(resources->events[buffSlot], resources->stream));
-          sub->transmitted += args->sliceSteps;
-        }
+        cudaStream_t stream = resources->streams[buffSlot%resources->nStreams];
+        int size = connFifo[buffSlot].size;
+        CUDACHECK(cudaMemcpyAsync(resources->devFifo+buffSlot*stepSize, resources->shmFifo+buffSlot*stepSize, size, cudaMemcpyHostToDevice, stream));
+        CUDACHECK(cudaEventRecord(resources->events[buffSlot], stream));
+        sub->transmitted += args->sliceSteps;
+        args->idle = 0;
       }
-      if (sub->done < sub->transmitted) {
+      // Steps may finish out of order on different streams, retire them in order
+      while (sub->done < sub->transmitted) {
         int buffSlot = (sub->base+sub->done)%NCCL_STEPS;
         cudaError_t res = cudaEventQuery(resources->events[buffSlot]);
         if (res != cudaErrorNotReady) CUDACHECK(res);
-        if (res == cudaSuccess) {
-          sub->done += args->sliceSteps;
-          // Notify GPU
-          resources->ceRecvMem->tail = sub->base + sub->done;
-        }
+        if (res != cudaSuccess) break;
+        sub->done += args->sliceSteps;
+        args->idle = 0;
+        // Notify GPU
+        resources->ceRecvMem->tail = sub->base + sub->done;
         if (sub->done == sub->nsteps) {
           resources->step = sub->base + sub->nsteps;
           args->done++;
@@ -120,4 +120,28 @@ namespace RcclUnitTesting
                            inPlaceList, managedMemList, useHipGraphList);
     testBed.Finalize();
   }
+
+  TEST(AllGather, Bruck)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllGather};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclUint8};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {65536, 1000, 13, 1};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Bruck is only set up from RCCL_BRUCK_MIN_RANKS ranks, 64 by default
+    setenv("RCCL_BRUCK_MIN_RANKS", "2", 1);
+    setenv("NCCL_ALGO", "Bruck", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+    unsetenv("RCCL_BRUCK_MIN_RANKS");
+  }
 }
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+
+namespace RcclUnitTesting
+{
+  // Prepare recvcounts/rdispls within options: uneven counts, zero on every third rank,
+  // and a gap after each block that must be left untouched
+  static void PrepareGathervCounts(int const totalRanks, int const chunkSize,
+                                   OptionalColArgs& options, size_t& numOutputElements)
+  {
+    size_t displ = 0;
+    for (int rank = 0; rank < totalRanks; ++rank)
+    {
+      options.recvcounts[rank] = (rank % 3 == 1) ? 0 : (1 + rank) * chunkSize + rank;
+      options.rdispls[rank]    = displ;
+      displ += options.recvcounts[rank] + rank;
+    }
+    numOutputElements = displ;
+  }
+
+  static void RunAllGathervSweep(TestBed& testBed,
+                                 std::vector<ncclDataType_t> const& dataTypes,
+                                 std::vector<int>            const& chunkSizes,
+                                 bool                        const  inPlace,
+                                 bool                        const  useHipGraph)
+  {
+    bool const useManagedMem = false;
+    OptionalColArgs options;
+
+    bool isCorrect = true;
+    for (int totalRanks : testBed.ev.GetNumGpusList())
+    for (int isMultiProcess : testBed.ev.GetIsMultiProcessList())
+    {
+      int const numProcesses = isMultiProcess ? totalRanks : 1;
+      testBed.InitComms(TestBed::GetDeviceIdsList(numProcesses, totalRanks));
+
+      for (int dataIdx = 0; dataIdx < dataTypes.size() && isCorrect; ++dataIdx)
+      for (int chunkIdx = 0; chunkIdx < chunkSizes.size() && isCorrect; ++chunkIdx)
+      {
+        if (testBed.ev.showNames)
+        {
+          std::string name = testBed.GetTestCaseName(totalRanks, isMultiProcess,
+                                                     ncclCollAllGatherv, dataTypes[dataIdx],
+                                                     ncclSum, -1, inPlace, useManagedMem, useHipGraph);
+          INFO("%s chunk %d\n", name.c_str(), chunkSizes[chunkIdx]);
+        }
+
+        size_t numOutputElements;
+        PrepareGathervCounts(totalRanks, chunkSizes[chunkIdx], options, numOutputElements);
+        for (int rank = 0; rank < totalRanks; ++rank)
+        {
+          testBed.SetCollectiveArgs(ncclCollAllGatherv,
+                                    dataTypes[dataIdx],
+                                    options.recvcounts[rank],
+                                    numOutputElements,
+                                    options,
+                                    -1,
+                                    0,
+                                    rank);
+        }
+        testBed.AllocateMem(inPlace, useManagedMem);
+        testBed.PrepareData();
+        testBed.ExecuteCollectives({}, useHipGraph);
+        testBed.ValidateResults(isCorrect);
+        testBed.DeallocateMem();
+      }
+      testBed.DestroyComms();
+    }
+    testBed.Finalize();
+  }
+
+  TEST(AllGatherv, OutOfPlace)
+  {
+    TestBed testBed;
+    RunAllGathervSweep(testBed, {ncclInt32, ncclFloat16, ncclFloat64}, {65536, 1000, 1}, false, false);
+  }
+
+  TEST(AllGatherv, OutOfPlaceGraph)
+  {
+    TestBed testBed;
+    RunAllGathervSweep(testBed, {ncclFloat32, ncclUint8}, {1000, 1}, false, true);
+  }
+
+  TEST(AllGatherv, InPlace)
+  {
+    TestBed testBed;
+    RunAllGathervSweep(testBed, {ncclFloat32, ncclInt8}, {65536, 7}, true, false);
+  }
+}
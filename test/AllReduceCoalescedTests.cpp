@@ -0,0 +1,88 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+
+namespace RcclUnitTesting
+{
+  // Prepare the tensors within options: uneven sizes including an empty tensor, each
+  // followed by a gap that must be left untouched
+  static void PrepareTensors(int const chunkSize, OptionalColArgs& options, size_t& numElements)
+  {
+    std::vector<size_t> const counts = {3 * (size_t)chunkSize, 0, 1, (size_t)chunkSize, 2 * (size_t)chunkSize + 5};
+    size_t displ = 0;
+    options.numTensors = counts.size();
+    for (int t = 0; t < options.numTensors; ++t)
+    {
+      options.sendcounts[t] = counts[t];
+      options.sdispls[t]    = displ;
+      displ += counts[t] + 4;
+    }
+    numElements = displ;
+  }
+
+  static void RunAllReduceCoalescedSweep(TestBed& testBed,
+                                         std::vector<ncclDataType_t> const& dataTypes,
+                                         std::vector<ncclRedOp_t>    const& redOps,
+                                         std::vector<int>            const& chunkSizes,
+                                         bool                        const  inPlace,
+                                         bool                        const  useHipGraph)
+  {
+    bool const useManagedMem = false;
+    OptionalColArgs options;
+
+    bool isCorrect = true;
+    for (int totalRanks : testBed.ev.GetNumGpusList())
+    for (int isMultiProcess : testBed.ev.GetIsMultiProcessList())
+    {
+      int const numProcesses = isMultiProcess ? totalRanks : 1;
+      testBed.InitComms(TestBed::GetDeviceIdsList(numProcesses, totalRanks));
+
+      for (int dataIdx = 0; dataIdx < dataTypes.size() && isCorrect; ++dataIdx)
+      for (int opIdx = 0; opIdx < redOps.size() && isCorrect; ++opIdx)
+      for (int chunkIdx = 0; chunkIdx < chunkSizes.size() && isCorrect; ++chunkIdx)
+      {
+        if (testBed.ev.showNames)
+        {
+          std::string name = testBed.GetTestCaseName(totalRanks, isMultiProcess,
+                                                     ncclCollAllReduceCoalesced, dataTypes[dataIdx],
+                                                     redOps[opIdx], -1, inPlace, useManagedMem, useHipGraph);
+          INFO("%s chunk %d\n", name.c_str(), chunkSizes[chunkIdx]);
+        }
+
+        size_t numElements;
+        PrepareTensors(chunkSizes[chunkIdx], options, numElements);
+        options.redOp = redOps[opIdx];
+        testBed.SetCollectiveArgs(ncclCollAllReduceCoalesced, dataTypes[dataIdx],
+                                  numElements, numElements, options);
+        testBed.AllocateMem(inPlace, useManagedMem);
+        testBed.PrepareData();
+        testBed.ExecuteCollectives({}, useHipGraph);
+        testBed.ValidateResults(isCorrect);
+        testBed.DeallocateMem();
+      }
+      testBed.DestroyComms();
+    }
+    testBed.Finalize();
+  }
+
+  TEST(AllReduceCoalesced, OutOfPlace)
+  {
+    TestBed testBed;
+    RunAllReduceCoalescedSweep(testBed, {ncclFloat32, ncclInt32, ncclFloat16}, {ncclSum, ncclMax}, {65536, 1000, 1}, false, false);
+  }
+
+  TEST(AllReduceCoalesced, OutOfPlaceGraph)
+  {
+    TestBed testBed;
+    RunAllReduceCoalescedSweep(testBed, {ncclFloat64, ncclUint8}, {ncclSum}, {1000}, false, true);
+  }
+
+  TEST(AllReduceCoalesced, InPlace)
+  {
+    TestBed testBed;
+    RunAllReduceCoalescedSweep(testBed, {ncclFloat32, ncclInt64}, {ncclSum, ncclAvg}, {65536, 7}, true, false);
+  }
+}
@@ -241,4 +241,73 @@ namespace RcclUnitTesting
     }
     testBed.Finalize();
   }
+
+  TEST(AllReduce, Direct)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllReduce};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclBfloat16};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclMax};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {1048576, 393221, 12888, 384};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Sizes on both sides of RCCL_DIRECT_ONESHOT_THRESHOLD run one-shot and two-shot
+    setenv("NCCL_ALGO", "Direct", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+  }
+
+  TEST(AllReduce, Rhd)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllReduce};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclInt32};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclMin};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {1048576, 393221, 384, 7};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Single node comms only get RHD peers with RCCL_RHD_MIN_NODES=1
+    setenv("RCCL_RHD_MIN_NODES", "1", 1);
+    setenv("NCCL_ALGO", "RHD", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+    unsetenv("RCCL_RHD_MIN_NODES");
+  }
+
+  TEST(AllReduce, Deterministic)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllReduce};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclFloat16, ncclInt32};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclAvg};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {1048576, 393221, 12887, 7};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false};
+
+    // The ordered reduction can't be called inside a group, so every rank is issued on its own
+    testBed.useUngroupedCalls = true;
+    setenv("RCCL_DETERMINISTIC", "1", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("RCCL_DETERMINISTIC");
+  }
 }
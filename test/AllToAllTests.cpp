@@ -4,7 +4,7 @@
  * See LICENSE.txt for license information
  ************************************************************************/
 
- // Note: InPlace is not supported for All-To-All
+ // Note: InPlace is only supported for All-To-All of small blocks, which run Bruck
 
 #include "TestBed.hpp"
 
@@ -86,6 +86,50 @@ namespace RcclUnitTesting
     testBed.Finalize();
   }
 
+  TEST(AllToAll, NativeKernel)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllToAll};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclUint8};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {1048576, 1024, 5685};
+    std::vector<bool>           const inPlaceList     = {false};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    setenv("RCCL_ALLTOALL_KERNEL_ENABLE", "1", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("RCCL_ALLTOALL_KERNEL_ENABLE");
+  }
+
+  TEST(AllToAll, Bruck)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollAllToAll};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclUint8};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {256, 100, 1};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Every per-peer block is under RCCL_ALLTOALL_BRUCK_THRESHOLD, and the Bruck kernel
+    // is the only AllToAll that supports in-place calls
+    setenv("RCCL_BRUCK_MIN_RANKS", "2", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("RCCL_BRUCK_MIN_RANKS");
+  }
+
     TEST(AllToAll, Channels)
   {
     TestBed testBed;
@@ -168,4 +168,66 @@ namespace RcclUnitTesting
     }
     testBed.Finalize();
   }
+
+  // Two AllToAllv in one group call with the hierarchical path requested: the group
+  // has to take the flat path, as the second stage of the hierarchical one would
+  // read the staging buffer before the first stage of the group has filled it
+  TEST(AllToAllv, HierarchicalInGroup)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclDataType_t> const& dataTypes       = {ncclFloat32, ncclUint8};
+    int                         const  numCollPerGroup = 2;
+    bool                        const  inPlace         = false;
+    bool                        const  useManagedMem   = false;
+    bool                        const  useHipGraph     = false;
+
+    OptionalColArgs options;
+
+    setenv("RCCL_ALLTOALLV_HIERARCHICAL", "1", 1);
+    bool isCorrect = true;
+    for (int totalRanks : testBed.ev.GetNumGpusList())
+    for (int isMultiProcess : testBed.ev.GetIsMultiProcessList())
+    {
+      int const numProcesses = isMultiProcess ? totalRanks : 1;
+      testBed.InitComms(TestBed::GetDeviceIdsList(numProcesses, totalRanks), numCollPerGroup);
+
+      // Prepare AllToAllV options
+      std::vector<size_t> numInputElements;
+      std::vector<size_t> numOutputElements;
+      PrepareCounts(totalRanks, 128, options, numInputElements, numOutputElements);
+
+      for (int dataIdx = 0; dataIdx < dataTypes.size() && isCorrect; ++dataIdx)
+      {
+        if (testBed.ev.showNames)
+        {
+          std::string name = testBed.GetTestCaseName(totalRanks, isMultiProcess,
+                                                     ncclCollAllToAllv, dataTypes[dataIdx],
+                                                     ncclSum, -1, inPlace, useManagedMem, useHipGraph);
+          INFO("%s (hierarchical, in group)\n", name.c_str());
+        }
+
+        for (int rank = 0; rank < totalRanks; ++rank)
+        {
+          testBed.SetCollectiveArgs(ncclCollAllToAllv,
+                                    dataTypes[dataIdx],
+                                    numInputElements[rank],
+                                    numOutputElements[rank],
+                                    options,
+                                    -1,
+                                    0,
+                                    rank);
+        }
+        testBed.AllocateMem(inPlace, useManagedMem);
+        testBed.PrepareData();
+        testBed.ExecuteCollectives({}, useHipGraph);
+        testBed.ValidateResults(isCorrect);
+        testBed.DeallocateMem();
+      }
+      testBed.DestroyComms();
+    }
+    testBed.Finalize();
+    unsetenv("RCCL_ALLTOALLV_HIERARCHICAL");
+  }
 }
@@ -120,4 +120,54 @@ namespace RcclUnitTesting
                            inPlaceList, managedMemList, useHipGraphList);
     testBed.Finalize();
   }
+
+  TEST(Broadcast, Tree)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollBroadcast};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclUint8};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum};
+    std::vector<int>            const roots           = {0, 1};
+    std::vector<int>            const numElements     = {1048576, 2500, 7};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Rooted trees are only set up on multi-node comms unless forced
+    setenv("RCCL_TREE_BCAST_REDUCE_ENABLE", "2", 1);
+    setenv("NCCL_ALGO", "Tree", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+    unsetenv("RCCL_TREE_BCAST_REDUCE_ENABLE");
+  }
+
+  TEST(Broadcast, ScatterAllGather)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollBroadcast};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclUint8};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum};
+    std::vector<int>            const roots           = {0, 1};
+    std::vector<int>            const numElements     = {1048576, 65543, 100};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // The two phases are skipped inside group calls, so every rank is issued on its own.
+    // Elements that do not fill a block go through a normal Broadcast.
+    testBed.useUngroupedCalls = true;
+    setenv("RCCL_BCAST_SCATTER_ALLGATHER", "2", 1);
+    setenv("RCCL_BCAST_SCATTER_ALLGATHER_MIN_BYTES", "0", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("RCCL_BCAST_SCATTER_ALLGATHER_MIN_BYTES");
+    unsetenv("RCCL_BCAST_SCATTER_ALLGATHER");
+  }
 }
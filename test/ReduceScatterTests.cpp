@@ -120,4 +120,51 @@ namespace RcclUnitTesting
                            inPlaceList, managedMemList, useHipGraphList);
     testBed.Finalize();
   }
+
+  TEST(ReduceScatter, Bruck)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollReduceScatter};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclInt64};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclMax};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {65536, 1000, 13, 1};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Bruck is only set up from RCCL_BRUCK_MIN_RANKS ranks, 64 by default
+    setenv("RCCL_BRUCK_MIN_RANKS", "2", 1);
+    setenv("NCCL_ALGO", "Bruck", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+    unsetenv("RCCL_BRUCK_MIN_RANKS");
+  }
+
+  TEST(ReduceScatter, Deterministic)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollReduceScatter};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclFloat16, ncclInt32};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclAvg};
+    std::vector<int>            const roots           = {0};
+    std::vector<int>            const numElements     = {65536, 1021, 1};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false};
+
+    // The ordered reduction can't be called inside a group, so every rank is issued on its own
+    testBed.useUngroupedCalls = true;
+    setenv("RCCL_DETERMINISTIC", "1", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("RCCL_DETERMINISTIC");
+  }
 }
@@ -0,0 +1,96 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+
+namespace RcclUnitTesting
+{
+  // Prepare sendcounts/sdispls within options: uneven counts, zero on every third rank,
+  // and a gap after each block that no rank receives
+  static void PrepareScattervCounts(int const totalRanks, int const chunkSize,
+                                    OptionalColArgs& options, size_t& numInputElements)
+  {
+    size_t displ = 0;
+    for (int rank = 0; rank < totalRanks; ++rank)
+    {
+      options.sendcounts[rank] = (rank % 3 == 1) ? 0 : (1 + rank) * chunkSize + rank;
+      options.sdispls[rank]    = displ;
+      displ += options.sendcounts[rank] + rank;
+    }
+    numInputElements = displ;
+  }
+
+  static void RunReduceScattervSweep(TestBed& testBed,
+                                     std::vector<ncclDataType_t> const& dataTypes,
+                                     std::vector<ncclRedOp_t>    const& redOps,
+                                     std::vector<int>            const& chunkSizes,
+                                     bool                        const  inPlace,
+                                     bool                        const  useHipGraph)
+  {
+    bool const useManagedMem = false;
+    OptionalColArgs options;
+
+    bool isCorrect = true;
+    for (int totalRanks : testBed.ev.GetNumGpusList())
+    for (int isMultiProcess : testBed.ev.GetIsMultiProcessList())
+    {
+      int const numProcesses = isMultiProcess ? totalRanks : 1;
+      testBed.InitComms(TestBed::GetDeviceIdsList(numProcesses, totalRanks));
+
+      for (int dataIdx = 0; dataIdx < dataTypes.size() && isCorrect; ++dataIdx)
+      for (int opIdx = 0; opIdx < redOps.size() && isCorrect; ++opIdx)
+      for (int chunkIdx = 0; chunkIdx < chunkSizes.size() && isCorrect; ++chunkIdx)
+      {
+        if (testBed.ev.showNames)
+        {
+          std::string name = testBed.GetTestCaseName(totalRanks, isMultiProcess,
+                                                     ncclCollReduceScatterv, dataTypes[dataIdx],
+                                                     redOps[opIdx], -1, inPlace, useManagedMem, useHipGraph);
+          INFO("%s chunk %d\n", name.c_str(), chunkSizes[chunkIdx]);
+        }
+
+        size_t numInputElements;
+        PrepareScattervCounts(totalRanks, chunkSizes[chunkIdx], options, numInputElements);
+        options.redOp = redOps[opIdx];
+        for (int rank = 0; rank < totalRanks; ++rank)
+        {
+          testBed.SetCollectiveArgs(ncclCollReduceScatterv,
+                                    dataTypes[dataIdx],
+                                    numInputElements,
+                                    options.sendcounts[rank],
+                                    options,
+                                    -1,
+                                    0,
+                                    rank);
+        }
+        testBed.AllocateMem(inPlace, useManagedMem);
+        testBed.PrepareData();
+        testBed.ExecuteCollectives({}, useHipGraph);
+        testBed.ValidateResults(isCorrect);
+        testBed.DeallocateMem();
+      }
+      testBed.DestroyComms();
+    }
+    testBed.Finalize();
+  }
+
+  TEST(ReduceScatterv, OutOfPlace)
+  {
+    TestBed testBed;
+    RunReduceScattervSweep(testBed, {ncclInt32, ncclFloat32, ncclFloat64}, {ncclSum, ncclMax}, {65536, 1000, 1}, false, false);
+  }
+
+  TEST(ReduceScatterv, OutOfPlaceGraph)
+  {
+    TestBed testBed;
+    RunReduceScattervSweep(testBed, {ncclFloat16, ncclUint8}, {ncclSum}, {1000, 1}, false, true);
+  }
+
+  TEST(ReduceScatterv, InPlace)
+  {
+    TestBed testBed;
+    RunReduceScattervSweep(testBed, {ncclFloat32}, {ncclProd, ncclAvg}, {65536, 7}, true, false);
+  }
+}
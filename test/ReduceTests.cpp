@@ -120,4 +120,28 @@ namespace RcclUnitTesting
                            inPlaceList, managedMemList, useHipGraphList);
     testBed.Finalize();
   }
+
+  TEST(Reduce, Tree)
+  {
+    TestBed testBed;
+
+    // Configuration
+    std::vector<ncclFunc_t>     const funcTypes       = {ncclCollReduce};
+    std::vector<ncclDataType_t> const dataTypes       = {ncclFloat32, ncclInt32};
+    std::vector<ncclRedOp_t>    const redOps          = {ncclSum, ncclProd};
+    std::vector<int>            const roots           = {0, 1};
+    std::vector<int>            const numElements     = {1048576, 2500, 7};
+    std::vector<bool>           const inPlaceList     = {false, true};
+    std::vector<bool>           const managedMemList  = {false};
+    std::vector<bool>           const useHipGraphList = {false, true};
+
+    // Rooted trees are only set up on multi-node comms unless forced
+    setenv("RCCL_TREE_BCAST_REDUCE_ENABLE", "2", 1);
+    setenv("NCCL_ALGO", "Tree", 1);
+    testBed.RunSimpleSweep(funcTypes, dataTypes, redOps, roots, numElements,
+                           inPlaceList, managedMemList, useHipGraphList);
+    testBed.Finalize();
+    unsetenv("NCCL_ALGO");
+    unsetenv("RCCL_TREE_BCAST_REDUCE_ENABLE");
+  }
 }
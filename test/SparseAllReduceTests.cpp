@@ -0,0 +1,99 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+#include "TestBed.hpp"
+
+namespace RcclUnitTesting
+{
+  // Prepare the number of rows of each rank within options: uneven, and zero on every third rank
+  static void PrepareSparseRows(int const totalRanks, int const nnzPerRank, OptionalColArgs& options)
+  {
+    for (int rank = 0; rank < totalRanks; ++rank)
+      options.sendcounts[rank] = (rank % 3 == 1) ? 0 : nnzPerRank * (1 + rank) + rank * (nnzPerRank > 0);
+  }
+
+  // ncclSparseAllReduce exchanges row counts on the host before launching, so it can't be
+  // called inside a group or captured: only multi-process runs issue it, one rank per process
+  static void RunSparseAllReduceSweep(TestBed& testBed,
+                                      std::vector<ncclDataType_t> const& dataTypes,
+                                      std::vector<int>            const& nnzPerRankList,
+                                      int                         const  rowCount,
+                                      int                         const  nRows)
+  {
+    bool const inPlace       = false;
+    bool const useManagedMem = false;
+    bool const useHipGraph   = false;
+    OptionalColArgs options;
+    options.redOp    = ncclSum;
+    options.rowCount = rowCount;
+
+    testBed.useUngroupedCalls = true;
+    bool isCorrect = true;
+    for (int totalRanks : testBed.ev.GetNumGpusList())
+    for (int isMultiProcess : testBed.ev.GetIsMultiProcessList())
+    {
+      if (!isMultiProcess) continue;
+      testBed.InitComms(TestBed::GetDeviceIdsList(totalRanks, totalRanks));
+
+      for (int dataIdx = 0; dataIdx < dataTypes.size() && isCorrect; ++dataIdx)
+      for (int nnzIdx = 0; nnzIdx < nnzPerRankList.size() && isCorrect; ++nnzIdx)
+      {
+        if (testBed.ev.showNames)
+        {
+          std::string name = testBed.GetTestCaseName(totalRanks, isMultiProcess,
+                                                     ncclCollSparseAllReduce, dataTypes[dataIdx],
+                                                     ncclSum, -1, inPlace, useManagedMem, useHipGraph);
+          INFO("%s nnz %d rows %d x %d\n", name.c_str(), nnzPerRankList[nnzIdx], nRows, rowCount);
+        }
+
+        PrepareSparseRows(totalRanks, nnzPerRankList[nnzIdx], options);
+        for (int rank = 0; rank < totalRanks; ++rank)
+        {
+          testBed.SetCollectiveArgs(ncclCollSparseAllReduce,
+                                    dataTypes[dataIdx],
+                                    options.sendcounts[rank] * rowCount,
+                                    (size_t)nRows * rowCount,
+                                    options,
+                                    -1,
+                                    0,
+                                    rank);
+        }
+        testBed.AllocateMem(inPlace, useManagedMem);
+        testBed.PrepareData();
+        testBed.ExecuteCollectives({}, useHipGraph);
+        testBed.ValidateResults(isCorrect);
+        testBed.DeallocateMem();
+      }
+      testBed.DestroyComms();
+    }
+    testBed.Finalize();
+  }
+
+  TEST(SparseAllReduce, Default)
+  {
+    TestBed testBed;
+    RunSparseAllReduceSweep(testBed, {ncclFloat32, ncclInt32}, {0, 1, 17}, 64, 4096);
+  }
+
+  TEST(SparseAllReduce, SparsePath)
+  {
+    TestBed testBed;
+    // Broadcast the rows of every rank, however many there are
+    setenv("RCCL_SPARSE_DENSE_RATIO", "1000000", 1);
+    RunSparseAllReduceSweep(testBed, {ncclFloat32, ncclFloat16, ncclInt64}, {0, 3, 12}, 33, 64);
+    RunSparseAllReduceSweep(testBed, {ncclFloat64, ncclUint8}, {5}, 8, 7);
+    unsetenv("RCCL_SPARSE_DENSE_RATIO");
+  }
+
+  TEST(SparseAllReduce, DensePath)
+  {
+    TestBed testBed;
+    // Scatter the rows locally then AllReduce the dense array, however few there are
+    setenv("RCCL_SPARSE_DENSE_RATIO", "0", 1);
+    RunSparseAllReduceSweep(testBed, {ncclFloat32, ncclFloat16, ncclInt32}, {0, 1, 40}, 129, 300);
+    RunSparseAllReduceSweep(testBed, {ncclFloat64, ncclInt8}, {5}, 1, 7);
+    unsetenv("RCCL_SPARSE_DENSE_RATIO");
+  }
+}
@@ -4,8 +4,14 @@
  * See LICENSE.txt for license information
  ************************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
 #include <gtest/gtest.h>
 #include <rccl/rccl.h>
+#include <rccl/rccl_device.h>
 
 #include "TestBed.hpp"
 #include "StandaloneUtils.hpp"
@@ -152,6 +158,225 @@ namespace RcclUnitTesting
       NCCLCHECK(ncclCommDestroy(comm));
   }
 
+  /**
+   * \brief Splits with splitTopoOrder: ranks follow the parent's ring, starting from the lowest key.
+   * ******************************************************************************************/
+  TEST(Standalone, SplitComms_TopoOrder)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    // Initialize the original comms
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // Split into one comm with reversed keys
+    ncclConfig_t config = NCCL_CONFIG_INITIALIZER;
+    config.splitTopoOrder = 1;
+    std::vector<ncclComm_t> subComms(numDevices);
+    NCCLCHECK(ncclGroupStart());
+    for (int localRank = 0; localRank < numDevices; localRank++)
+      NCCLCHECK(ncclCommSplit(comms[localRank], 0, numDevices - localRank, &subComms[localRank], &config));
+    NCCLCHECK(ncclGroupEnd());
+
+    // Validate results: a permutation whose rank 0 has the lowest key
+    std::vector<int> seen(numDevices, 0);
+    for (int i = 0; i < numDevices; i++) {
+      int subCommRank, subCommNRank;
+      NCCLCHECK(ncclCommUserRank(subComms[i], &subCommRank));
+      NCCLCHECK(ncclCommCount(subComms[i], &subCommNRank));
+
+      ASSERT_EQ(subCommNRank, numDevices);
+      ASSERT_GE(subCommRank, 0);
+      ASSERT_LT(subCommRank, numDevices);
+      seen[subCommRank]++;
+      if (i == numDevices - 1) ASSERT_EQ(subCommRank, 0);
+    }
+    for (int r = 0; r < numDevices; r++) ASSERT_EQ(seen[r], 1);
+
+    // Clean up comms
+    for (auto& subComm : subComms)
+      NCCLCHECK(ncclCommDestroy(subComm));
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Shrinks the comms made by ncclCommInitAll without the excluded ranks, checks the new
+   * ranks and runs an AllReduce and a Broadcast from new rank 0 over the shrunk comms.
+   * ******************************************************************************************/
+  static void ShrinkAndCheck(std::vector<ncclComm_t>& comms, std::vector<int> excluded, ncclConfig_t* config)
+  {
+    int const numDevices = comms.size();
+    std::vector<int> survivors;
+    for (int r = 0; r < numDevices; r++)
+      if (std::find(excluded.begin(), excluded.end(), r) == excluded.end()) survivors.push_back(r);
+    int const numSurvivors = survivors.size();
+
+    // Only the surviving ranks call ncclCommShrink
+    std::vector<ncclComm_t> newComms(numSurvivors);
+    NCCLCHECK(ncclGroupStart());
+    for (int i = 0; i < numSurvivors; i++)
+      NCCLCHECK(ncclCommShrink(comms[survivors[i]], excluded.data(), excluded.size(), &newComms[i], config));
+    NCCLCHECK(ncclGroupEnd());
+
+    // Ranks keep their order
+    for (int i = 0; i < numSurvivors; i++) {
+      int newRank, newNRanks;
+      ASSERT_EQ(ncclCommUserRank(newComms[i], &newRank), ncclSuccess);
+      ASSERT_EQ(ncclCommCount(newComms[i], &newNRanks), ncclSuccess);
+      ASSERT_EQ(newRank, i);
+      ASSERT_EQ(newNRanks, numSurvivors);
+    }
+
+    // New rank i contributes i+1 to the AllReduce, new rank 0 broadcasts its buffer
+    int const N = 65536;
+    std::vector<float*> sendBuf(numSurvivors), recvBuf(numSurvivors), bcastBuf(numSurvivors);
+    std::vector<hipStream_t> streams(numSurvivors);
+    for (int i = 0; i < numSurvivors; i++) {
+      HIPCALL(hipSetDevice(survivors[i]));
+      HIPCALL(hipMalloc(&sendBuf[i], N * sizeof(float)));
+      HIPCALL(hipMalloc(&recvBuf[i], N * sizeof(float)));
+      HIPCALL(hipMalloc(&bcastBuf[i], N * sizeof(float)));
+      HIPCALL(hipStreamCreate(&streams[i]));
+      std::vector<float> cpuSend(N, i + 1.0f);
+      std::vector<float> cpuBcast(N, i == 0 ? 42.0f : -1.0f);
+      HIPCALL(hipMemcpy(sendBuf[i], cpuSend.data(), N * sizeof(float), hipMemcpyHostToDevice));
+      HIPCALL(hipMemcpy(bcastBuf[i], cpuBcast.data(), N * sizeof(float), hipMemcpyHostToDevice));
+    }
+    NCCLCHECK(ncclGroupStart());
+    for (int i = 0; i < numSurvivors; i++) {
+      NCCLCHECK(ncclAllReduce(sendBuf[i], recvBuf[i], N, ncclFloat, ncclSum, newComms[i], streams[i]));
+      NCCLCHECK(ncclBroadcast(bcastBuf[i], bcastBuf[i], N, ncclFloat, 0, newComms[i], streams[i]));
+    }
+    NCCLCHECK(ncclGroupEnd());
+
+    float const expectedSum = numSurvivors * (numSurvivors + 1) / 2.0f;
+    for (int i = 0; i < numSurvivors; i++) {
+      HIPCALL(hipSetDevice(survivors[i]));
+      HIPCALL(hipStreamSynchronize(streams[i]));
+      std::vector<float> cpuRecv(N), cpuBcast(N);
+      HIPCALL(hipMemcpy(cpuRecv.data(), recvBuf[i], N * sizeof(float), hipMemcpyDeviceToHost));
+      HIPCALL(hipMemcpy(cpuBcast.data(), bcastBuf[i], N * sizeof(float), hipMemcpyDeviceToHost));
+      for (int j = 0; j < N; j++) {
+        EXPECT_EQ(cpuRecv[j], expectedSum) << "new rank " << i << " element " << j;
+        EXPECT_EQ(cpuBcast[j], 42.0f) << "new rank " << i << " element " << j;
+        if (cpuRecv[j] != expectedSum || cpuBcast[j] != 42.0f) break;
+      }
+    }
+
+    // Clean up the shrunk comms
+    for (int i = 0; i < numSurvivors; i++) {
+      HIPCALL(hipSetDevice(survivors[i]));
+      HIPCALL(hipFree(sendBuf[i]));
+      HIPCALL(hipFree(recvBuf[i]));
+      HIPCALL(hipFree(bcastBuf[i]));
+      HIPCALL(hipStreamDestroy(streams[i]));
+      NCCLCHECK(ncclCommDestroy(newComms[i]));
+    }
+  }
+
+  /**
+   * \brief Shrinks a comm without rank 0, the root of its collectives.
+   * ******************************************************************************************/
+  TEST(Standalone, ShrinkComms_ExcludeRankZero)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    ShrinkAndCheck(comms, {0}, nullptr);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Shrinks a comm without the last rank, sharing the parent's resources.
+   * ******************************************************************************************/
+  TEST(Standalone, ShrinkComms_ExcludeLastShared)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 3) {
+      GTEST_SKIP() << "This test requires at least 3 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    ncclConfig_t config = NCCL_CONFIG_INITIALIZER;
+    config.splitShare = 1;
+    ShrinkAndCheck(comms, {numDevices - 1}, &config);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Shrinks a comm without every odd rank, listed out of order, twice in a row.
+   * ******************************************************************************************/
+  TEST(Standalone, ShrinkComms_ExcludeOddRanks)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 4) {
+      GTEST_SKIP() << "This test requires at least 4 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    std::vector<int> excluded;
+    for (int r = numDevices - 1; r >= 0; r--)
+      if (r % 2) excluded.push_back(r);
+    ShrinkAndCheck(comms, excluded, nullptr);
+    // The parent comms stay usable and can be shrunk again
+    ShrinkAndCheck(comms, excluded, nullptr);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief ncclCommShrink rejects exclusion lists that are out of range or leave no rank.
+   * ******************************************************************************************/
+  TEST(Standalone, ShrinkComms_InvalidArgs)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    ncclComm_t newComm;
+    std::vector<int> all(numDevices);
+    for (int r = 0; r < numDevices; r++) all[r] = r;
+    int outOfRange[1] = {numDevices};
+    ASSERT_EQ(ncclCommShrink(comms[0], all.data(), numDevices, &newComm, nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommShrink(comms[0], outOfRange, 1, &newComm, nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommShrink(comms[0], all.data(), -1, &newComm, nullptr), ncclInvalidArgument);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
   /**
    * \brief Verify there is no regression in timing for each protocol [LL, LL128, Simple]
    * ******************************************************************************************/
@@ -298,4 +523,1049 @@ namespace RcclUnitTesting
       }
     }
   }
+
+  /**
+   * \brief Runs an AllReduce of N floats, rank r giving r+1, on the comms made by ncclCommInitAll
+   * and waits for it. Returns whether every rank got the sum.
+   * ******************************************************************************************/
+  static bool RunAllReduce(std::vector<ncclComm_t> const& comms, size_t const N)
+  {
+    int const numRanks = comms.size();
+    std::vector<float*> gpuBuf(numRanks);
+    std::vector<hipStream_t> streams(numRanks);
+    for (int rank = 0; rank < numRanks; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&gpuBuf[rank], N * sizeof(float)));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      std::vector<float> cpuBuf(N, rank + 1.0f);
+      HIPCALL(hipMemcpy(gpuBuf[rank], cpuBuf.data(), N * sizeof(float), hipMemcpyHostToDevice));
+    }
+    NCCLCHECK(ncclGroupStart());
+    for (int rank = 0; rank < numRanks; rank++)
+      NCCLCHECK(ncclAllReduce(gpuBuf[rank], gpuBuf[rank], N, ncclFloat, ncclSum, comms[rank], streams[rank]));
+    NCCLCHECK(ncclGroupEnd());
+
+    bool isCorrect = true;
+    float const expected = numRanks * (numRanks + 1) / 2.0f;
+    for (int rank = 0; rank < numRanks; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipStreamSynchronize(streams[rank]));
+      std::vector<float> cpuBuf(N);
+      HIPCALL(hipMemcpy(cpuBuf.data(), gpuBuf[rank], N * sizeof(float), hipMemcpyDeviceToHost));
+      for (size_t i = 0; i < N && isCorrect; i++) isCorrect = (cpuBuf[i] == expected);
+      HIPCALL(hipFree(gpuBuf[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+    }
+    return isCorrect;
+  }
+
+  /**
+   * \brief Checks the memory breakdown of ncclCommGetMemoryInfo before and after connecting.
+   * ******************************************************************************************/
+  TEST(Standalone, GetMemoryInfo)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // A size too small for the size field itself is rejected
+    ncclCommMemoryInfo_t info = {};
+    ASSERT_EQ(ncclCommGetMemoryInfo(comms[0], &info), ncclInvalidArgument);
+    info.size = sizeof(info);
+    ASSERT_EQ(ncclCommGetMemoryInfo(nullptr, &info), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetMemoryInfo(comms[0], nullptr), ncclInvalidArgument);
+
+    // Channels and the work fifo are set up at init, SIMPLE buffers are always sized
+    char const* buffSizeEnv = getenv("NCCL_BUFFSIZE");
+    int const expectedBuffSize = buffSizeEnv ? atoi(buffSizeEnv) : (1 << 22);
+    std::vector<ncclCommMemoryInfo_t> before(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      before[rank].size = sizeof(ncclCommMemoryInfo_t);
+      ASSERT_EQ(ncclCommGetMemoryInfo(comms[rank], &before[rank]), ncclSuccess);
+      ASSERT_EQ(before[rank].size, sizeof(ncclCommMemoryInfo_t));
+      EXPECT_GT(before[rank].deviceBytes[0], 0u);  // Channels
+      EXPECT_GT(before[rank].deviceBytes[2] + before[rank].hostBytes[2], 0u);  // WorkFifo
+      EXPECT_GT(before[rank].deviceTotalBytes, 0u);
+      EXPECT_EQ(before[rank].buffSizes[2], expectedBuffSize);
+    }
+
+    // Transport buffers are held once connected, and accounted per transport as well
+    ASSERT_TRUE(RunAllReduce(comms, 1 << 20));
+    for (int rank = 0; rank < numDevices; rank++) {
+      ncclCommMemoryInfo_t after = {};
+      after.size = sizeof(after);
+      ASSERT_EQ(ncclCommGetMemoryInfo(comms[rank], &after), ncclSuccess);
+      EXPECT_GT(after.deviceBytes[1] + after.hostBytes[1], 0u);
+      EXPECT_GE(after.deviceBytes[1] + after.hostBytes[1], before[rank].deviceBytes[1] + before[rank].hostBytes[1]);
+      uint64_t connDeviceBytes = 0, connHostBytes = 0;
+      for (int t = 0; t < NCCL_MEM_NUM_TRANSPORTS; t++) {
+        connDeviceBytes += after.connDeviceBytes[t];
+        connHostBytes += after.connHostBytes[t];
+      }
+      EXPECT_EQ(connDeviceBytes, after.deviceBytes[1]);
+      EXPECT_EQ(connHostBytes, after.hostBytes[1]);
+    }
+
+    // Only the first info->size bytes are written
+    ncclCommMemoryInfo_t partial;
+    memset(&partial, 0xff, sizeof(partial));
+    partial.size = offsetof(ncclCommMemoryInfo_t, hostBytes);
+    ASSERT_EQ(ncclCommGetMemoryInfo(comms[0], &partial), ncclSuccess);
+    ASSERT_EQ(partial.size, offsetof(ncclCommMemoryInfo_t, hostBytes));
+    EXPECT_GT(partial.deviceBytes[0], 0u);
+    EXPECT_NE(partial.deviceBytes[0], UINT64_MAX);
+    EXPECT_EQ(partial.hostBytes[0], UINT64_MAX);
+    EXPECT_EQ(partial.buffSizes[2], -1);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Runs AllReduces of several sizes with RCCL_COLL_TIMINGS set, and checks the records
+   * ncclCommGetCollTimings returns for them. Returns whether all checks passed.
+   * ******************************************************************************************/
+  static bool CheckCollTimings(int const numDevices)
+  {
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    std::vector<size_t> const counts = {1 << 20, 1024, 7, 1 << 16};
+    for (size_t count : counts)
+      EXPECT_TRUE(RunAllReduce(comms, count));
+
+    int const maxTimings = 64;
+    int const numCalls = counts.size();
+    std::vector<ncclCollTiming_t> timings(maxTimings);
+    for (int rank = 0; rank < numDevices; rank++) {
+      // Read the first record alone, then the others
+      int nTimings, nMore;
+      EXPECT_EQ(ncclCommGetCollTimings(comms[rank], timings.data(), 1, &nTimings), ncclSuccess);
+      EXPECT_EQ(nTimings, 1);
+      EXPECT_EQ(ncclCommGetCollTimings(comms[rank], timings.data() + 1, maxTimings - 1, &nMore), ncclSuccess);
+      nTimings += nMore;
+
+      // One kernel per AllReduce, in order
+      EXPECT_EQ(nTimings, numCalls) << "rank " << rank;
+      for (int i = 0; i < std::min(nTimings, numCalls); i++) {
+        ncclCollTiming_t const& t = timings[i];
+        EXPECT_EQ(t.seq, timings[0].seq + i);
+        EXPECT_EQ(t.coll, ncclCollAllReduce);
+        EXPECT_EQ(t.nColls, 1);
+        EXPECT_EQ(t.bytes, counts[i] * sizeof(float));
+        EXPECT_GE(t.algorithm, 0);
+        EXPECT_LT(t.algorithm, NCCL_STATS_NUM_ALGOS);
+        EXPECT_GE(t.protocol, 0);
+        EXPECT_LT(t.protocol, NCCL_STATS_NUM_PROTOS);
+        EXPECT_GT(t.nChannels, 0);
+        EXPECT_GE(t.endNs, t.startNs);
+        if (i > 0) EXPECT_GE(t.startNs, timings[i - 1].startNs);
+      }
+
+      // Records are returned once
+      EXPECT_EQ(ncclCommGetCollTimings(comms[rank], timings.data(), maxTimings, &nTimings), ncclSuccess);
+      EXPECT_EQ(nTimings, 0);
+    }
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+    return !::testing::Test::HasFailure();
+  }
+
+  /**
+   * \brief Checks the arguments of ncclCommGetCollTimings, and that it returns no records
+   * without RCCL_COLL_TIMINGS.
+   * ******************************************************************************************/
+  TEST(Standalone, GetCollTimings_Args)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // Argument checks, and no records unless RCCL_COLL_TIMINGS is set
+    ncclCollTiming_t timing;
+    int nTimings = -1;
+    ASSERT_EQ(ncclCommGetCollTimings(comms[0], &timing, -1, &nTimings), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetCollTimings(comms[0], nullptr, 1, &nTimings), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetCollTimings(comms[0], &timing, 1, nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetCollTimings(comms[0], nullptr, 0, &nTimings), ncclSuccess);
+    ASSERT_EQ(nTimings, 0);
+    if (getenv("RCCL_COLL_TIMINGS") == nullptr) {
+      ASSERT_TRUE(RunAllReduce(comms, 1024));
+      ASSERT_EQ(ncclCommGetCollTimings(comms[0], &timing, 1, &nTimings), ncclSuccess);
+      ASSERT_EQ(nTimings, 0);
+    }
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Checks the kernel timestamps returned by ncclCommGetCollTimings.
+   * ******************************************************************************************/
+  TEST(Standalone, GetCollTimings)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    // RCCL reads RCCL_COLL_TIMINGS once per process, so the checks run in a new one. The
+    // threadsafe style runs this test again there, nothing may initialize RCCL before.
+    GTEST_FLAG(death_test_style) = "threadsafe";
+    EXPECT_EXIT({
+        setenv("RCCL_COLL_TIMINGS", "64", 1);
+        exit(CheckCollTimings(numDevices) ? 0 : 1);
+      }, ::testing::ExitedWithCode(0), "");
+  }
+
+  /**
+   * \brief Checks the arguments of ncclCommGetStats, and that it copies up to stats->size bytes.
+   * ******************************************************************************************/
+  TEST(Standalone, GetStats_Args)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    ncclCommStats_t stats = {};
+    ASSERT_EQ(ncclCommGetStats(comms[0], &stats), ncclInvalidArgument);
+    stats.size = sizeof(stats);
+    ASSERT_EQ(ncclCommGetStats(nullptr, &stats), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetStats(comms[0], nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclCommGetStats(comms[0], &stats), ncclSuccess);
+    ASSERT_EQ(stats.size, sizeof(stats));
+
+    ncclCommStats_t partial;
+    memset(&partial, 0xff, sizeof(partial));
+    partial.size = offsetof(ncclCommStats_t, collBytes);
+    ASSERT_EQ(ncclCommGetStats(comms[0], &partial), ncclSuccess);
+    ASSERT_EQ(partial.size, offsetof(ncclCommStats_t, collBytes));
+    EXPECT_EQ(partial.collCalls[ncclCollAllReduce], stats.collCalls[ncclCollAllReduce]);
+    EXPECT_EQ(partial.collBytes[0], UINT64_MAX);
+    EXPECT_EQ(partial.proxySleepNs, UINT64_MAX);
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+  }
+
+  /**
+   * \brief Runs AllReduces and checks the counters ncclCommGetStats accumulated for them, with the
+   * host and proxy times enabled. Returns whether all checks passed.
+   * ******************************************************************************************/
+  static bool CheckStats(int const numDevices)
+  {
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    std::vector<ncclCommStats_t> before(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      before[rank].size = sizeof(ncclCommStats_t);
+      EXPECT_EQ(ncclCommGetStats(comms[rank], &before[rank]), ncclSuccess);
+    }
+
+    int const numCalls = 3;
+    size_t const N = 65536;
+    for (int i = 0; i < numCalls; i++)
+      EXPECT_TRUE(RunAllReduce(comms, N));
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      ncclCommStats_t after = {};
+      after.size = sizeof(after);
+      EXPECT_EQ(ncclCommGetStats(comms[rank], &after), ncclSuccess);
+
+      // Every call is counted once with its bytes, and scheduled with one algorithm and protocol
+      EXPECT_EQ(after.collCalls[ncclCollAllReduce] - before[rank].collCalls[ncclCollAllReduce], numCalls);
+      EXPECT_EQ(after.collBytes[ncclCollAllReduce] - before[rank].collBytes[ncclCollAllReduce], numCalls * N * sizeof(float));
+      uint64_t scheduled = 0;
+      for (int a = 0; a < NCCL_STATS_NUM_ALGOS; a++)
+        for (int p = 0; p < NCCL_STATS_NUM_PROTOS; p++)
+          scheduled += after.algoProtoCalls[a][p] - before[rank].algoProtoCalls[a][p];
+      EXPECT_EQ(scheduled, numCalls);
+
+      // RCCL_STATS_HOST_TIME=1
+      EXPECT_EQ(after.hostOps - before[rank].hostOps, numCalls);
+      EXPECT_GE(after.hostLaunches - before[rank].hostLaunches, 1u);
+      uint64_t hostNs = 0;
+      for (int p = 0; p < NCCL_STATS_HOST_PHASES; p++) hostNs += after.hostNs[p] - before[rank].hostNs[p];
+      EXPECT_GT(hostNs, 0u);
+
+      // RCCL_STATS_PROXY_TIME=1, the progress threads run once the comm is connected
+      EXPECT_GT(after.proxyActiveNs + after.proxyIdleNs, 0u);
+    }
+
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+    return !::testing::Test::HasFailure();
+  }
+
+  /**
+   * \brief Checks the counters returned by ncclCommGetStats.
+   * ******************************************************************************************/
+  TEST(Standalone, GetStats)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    // RCCL reads its parameters once per process, so the checks run in a new one. The
+    // threadsafe style runs this test again there, nothing may initialize RCCL before.
+    // MSCCL is disabled as its algorithms bypass the counters of the enqueue path.
+    GTEST_FLAG(death_test_style) = "threadsafe";
+    EXPECT_EXIT({
+        setenv("RCCL_MSCCL_ENABLE", "0", 1);
+        setenv("RCCL_STATS_HOST_TIME", "1", 1);
+        setenv("RCCL_STATS_PROXY_TIME", "1", 1);
+        exit(CheckStats(numDevices) ? 0 : 1);
+      }, ::testing::ExitedWithCode(0), "");
+  }
+
+  // Executor of the AsyncExecutor test, running each task on a new thread
+  struct TestExecutor
+  {
+    std::atomic<int>         numTasks{0};
+    std::mutex               lock;
+    std::vector<std::thread> threads;
+  };
+
+  static void TestExecutorSubmit(ncclAsyncTask_t task, void* arg, void* userData)
+  {
+    TestExecutor* executor = (TestExecutor*)userData;
+    std::lock_guard<std::mutex> guard(executor->lock);
+    executor->numTasks++;
+    executor->threads.emplace_back(task, arg);
+  }
+
+  /**
+   * \brief Creates comms with a user executor set by ncclSetAsyncExecutor, and checks that their
+   * async work ran on it and that they work. Once reset, splits no longer use it.
+   * ******************************************************************************************/
+  TEST(Standalone, AsyncExecutor)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    TestExecutor executor;
+    NCCLCHECK(ncclSetAsyncExecutor(TestExecutorSubmit, &executor));
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+    // The init of each rank, created within a group, is a task
+    EXPECT_GE(executor.numTasks.load(), numDevices);
+    EXPECT_TRUE(RunAllReduce(comms, 1 << 20));
+
+    NCCLCHECK(ncclSetAsyncExecutor(nullptr, nullptr));
+    int const numTasks = executor.numTasks.load();
+    std::vector<ncclComm_t> subComms(numDevices);
+    NCCLCHECK(ncclGroupStart());
+    for (int localRank = 0; localRank < numDevices; localRank++)
+      NCCLCHECK(ncclCommSplit(comms[localRank], 0, localRank, &subComms[localRank], NULL));
+    NCCLCHECK(ncclGroupEnd());
+    EXPECT_EQ(executor.numTasks.load(), numTasks);
+    EXPECT_TRUE(RunAllReduce(subComms, 1024));
+
+    for (auto& subComm : subComms)
+      NCCLCHECK(ncclCommDestroy(subComm));
+    for (auto& comm : comms)
+      NCCLCHECK(ncclCommDestroy(comm));
+    std::lock_guard<std::mutex> guard(executor.lock);
+    for (auto& thread : executor.threads)
+      thread.join();
+  }
+
+  /**
+   * \brief Starts persistent AllReduce, AllGather and in-place Broadcast requests several times
+   * with new inputs, and checks the results of each start.
+   * ******************************************************************************************/
+  TEST(Standalone, PersistentColl)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    int const N = 4096;
+    int const root = 1;
+    std::vector<float*> sendBuf(numDevices), recvBuf(numDevices), gatherBuf(numDevices), bcastBuf(numDevices);
+    std::vector<ncclPersistentColl_t> allReduce(numDevices), allGather(numDevices), bcast(numDevices);
+    std::vector<hipStream_t> streams(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&sendBuf[rank], N * sizeof(float)));
+      HIPCALL(hipMalloc(&recvBuf[rank], N * sizeof(float)));
+      HIPCALL(hipMalloc(&gatherBuf[rank], N * numDevices * sizeof(float)));
+      HIPCALL(hipMalloc(&bcastBuf[rank], N * sizeof(float)));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      ASSERT_EQ(ncclAllReduceInit(sendBuf[rank], recvBuf[rank], N, ncclFloat, ncclSum, comms[rank], &allReduce[rank]), ncclSuccess);
+      ASSERT_EQ(ncclAllGatherInit(sendBuf[rank], gatherBuf[rank], N, ncclFloat, comms[rank], &allGather[rank]), ncclSuccess);
+      ASSERT_EQ(ncclBroadcastInit(bcastBuf[rank], bcastBuf[rank], N, ncclFloat, root, comms[rank], &bcast[rank]), ncclSuccess);
+    }
+
+    // Invalid requests are rejected when created or started
+    ncclPersistentColl_t invalid;
+    ASSERT_EQ(ncclStart(nullptr, streams[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclAllReduceInit(sendBuf[0], recvBuf[0], N, ncclFloat, ncclSum, comms[0], nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclBroadcastInit(bcastBuf[0], bcastBuf[0], N, ncclFloat, numDevices, comms[0], &invalid), ncclInvalidArgument);
+    ASSERT_EQ(invalid, nullptr);
+
+    // Rank r gives r+1+iter, the root broadcasts 100+iter
+    for (int iter = 0; iter < 3; iter++) {
+      for (int rank = 0; rank < numDevices; rank++) {
+        HIPCALL(hipSetDevice(rank));
+        std::vector<float> cpuSend(N, rank + 1.0f + iter);
+        std::vector<float> cpuBcast(N, rank == root ? 100.0f + iter : -1.0f);
+        HIPCALL(hipMemcpy(sendBuf[rank], cpuSend.data(), N * sizeof(float), hipMemcpyHostToDevice));
+        HIPCALL(hipMemcpy(bcastBuf[rank], cpuBcast.data(), N * sizeof(float), hipMemcpyHostToDevice));
+      }
+      NCCLCHECK(ncclGroupStart());
+      for (int rank = 0; rank < numDevices; rank++) {
+        NCCLCHECK(ncclStart(allReduce[rank], streams[rank]));
+        NCCLCHECK(ncclStart(allGather[rank], streams[rank]));
+        NCCLCHECK(ncclStart(bcast[rank], streams[rank]));
+      }
+      NCCLCHECK(ncclGroupEnd());
+
+      float const expectedSum = numDevices * (numDevices + 1) / 2.0f + numDevices * iter;
+      for (int rank = 0; rank < numDevices; rank++) {
+        HIPCALL(hipSetDevice(rank));
+        HIPCALL(hipStreamSynchronize(streams[rank]));
+        std::vector<float> cpuRecv(N), cpuGather(N * numDevices), cpuBcast(N);
+        HIPCALL(hipMemcpy(cpuRecv.data(), recvBuf[rank], N * sizeof(float), hipMemcpyDeviceToHost));
+        HIPCALL(hipMemcpy(cpuGather.data(), gatherBuf[rank], N * numDevices * sizeof(float), hipMemcpyDeviceToHost));
+        HIPCALL(hipMemcpy(cpuBcast.data(), bcastBuf[rank], N * sizeof(float), hipMemcpyDeviceToHost));
+        for (int i = 0; i < N; i++) {
+          ASSERT_EQ(cpuRecv[i], expectedSum) << "iter " << iter << " rank " << rank << " element " << i;
+          ASSERT_EQ(cpuBcast[i], 100.0f + iter) << "iter " << iter << " rank " << rank << " element " << i;
+        }
+        for (int i = 0; i < N * numDevices; i++)
+          ASSERT_EQ(cpuGather[i], i / N + 1.0f + iter) << "iter " << iter << " rank " << rank << " element " << i;
+      }
+    }
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      NCCLCHECK(ncclPersistentCollFree(allReduce[rank]));
+      NCCLCHECK(ncclPersistentCollFree(allGather[rank]));
+      NCCLCHECK(ncclPersistentCollFree(bcast[rank]));
+      HIPCALL(hipFree(sendBuf[rank]));
+      HIPCALL(hipFree(recvBuf[rank]));
+      HIPCALL(hipFree(gatherBuf[rank]));
+      HIPCALL(hipFree(bcastBuf[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
+
+  // Each rank puts its chunk into the window of every rank at the offset of its rank, and gets
+  // back what its own window received. Then the ranks sum their chunks placed after those.
+  __global__ void DevWindowKernel(ncclDevWindow_t const* win, int const* chunk, size_t chunkInts,
+                                  int* gathered, int* sum)
+  {
+    size_t const chunkBytes = chunkInts * sizeof(int);
+    for (int peer = 0; peer < win->nRanks; peer++) {
+      ncclDevWindowPut(win, peer, win->rank * chunkBytes, chunk, chunkBytes);
+      ncclDevWindowSignal(win, peer);
+    }
+    for (int peer = 0; peer < win->nRanks; peer++)
+      ncclDevWindowWait(win, peer, 1);
+    ncclDevWindowGet(win, win->rank, 0, gathered, win->nRanks * chunkBytes);
+
+    size_t const sumOffset = win->nRanks * chunkBytes;
+    ncclDevWindowPut(win, win->rank, sumOffset, chunk, chunkBytes);
+    ncclDevWindowAllReduceSum(win, sumOffset, chunkInts, sum, 1);
+  }
+
+  /**
+   * \brief Moves data between device windows from a user kernel, and checks what each rank
+   * gathered in its window and the sum of ncclDevWindowAllReduceSum.
+   * ******************************************************************************************/
+  TEST(Standalone, DevWindow)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // Window creation is collective, each rank needs a thread
+    size_t const chunkInts = 1000;
+    size_t const windowBytes = (numDevices + 1) * chunkInts * sizeof(int);
+    std::vector<ncclDevWindow_t*> windows(numDevices);
+    std::vector<void*> localBuffs(numDevices);
+    std::vector<ncclResult_t> results(numDevices);
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < numDevices; rank++)
+      threads.emplace_back([&, rank]() {
+        HIPCALL(hipSetDevice(rank));
+        results[rank] = ncclDevWindowCreate(comms[rank], windowBytes, &windows[rank], &localBuffs[rank]);
+      });
+    for (auto& thread : threads) thread.join();
+    threads.clear();
+    if (results[0] == ncclInvalidUsage) {
+      for (auto& comm : comms)
+        NCCLCHECK(ncclCommDestroy(comm));
+      GTEST_SKIP() << "Device windows require all GPUs to be connected over P2P.";
+    }
+    for (int rank = 0; rank < numDevices; rank++) {
+      ASSERT_EQ(results[rank], ncclSuccess);
+      ASSERT_NE(localBuffs[rank], nullptr);
+    }
+    ncclDevWindow_t* invalid;
+    ASSERT_EQ(ncclDevWindowCreate(comms[0], windowBytes, &invalid, nullptr), ncclInvalidArgument);
+    ASSERT_EQ(ncclDevWindowDestroy(comms[0], windows[1]), ncclInvalidArgument);
+
+    // Rank r gives r*1000+i, the kernels of all ranks run at the same time
+    std::vector<int*> chunk(numDevices), gathered(numDevices), sum(numDevices);
+    std::vector<hipStream_t> streams(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&chunk[rank], chunkInts * sizeof(int)));
+      HIPCALL(hipMalloc(&gathered[rank], numDevices * chunkInts * sizeof(int)));
+      HIPCALL(hipMalloc(&sum[rank], chunkInts * sizeof(int)));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      std::vector<int> cpuChunk(chunkInts);
+      for (size_t i = 0; i < chunkInts; i++) cpuChunk[i] = rank * 1000 + i;
+      HIPCALL(hipMemcpy(chunk[rank], cpuChunk.data(), chunkInts * sizeof(int), hipMemcpyHostToDevice));
+    }
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      hipLaunchKernelGGL(DevWindowKernel, dim3(1), dim3(256), 0, streams[rank],
+                         windows[rank], chunk[rank], chunkInts, gathered[rank], sum[rank]);
+      HIPCALL(hipGetLastError());
+    }
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipStreamSynchronize(streams[rank]));
+      std::vector<int> cpuGathered(numDevices * chunkInts), cpuWindow(numDevices * chunkInts), cpuSum(chunkInts);
+      HIPCALL(hipMemcpy(cpuGathered.data(), gathered[rank], numDevices * chunkInts * sizeof(int), hipMemcpyDeviceToHost));
+      HIPCALL(hipMemcpy(cpuWindow.data(), localBuffs[rank], numDevices * chunkInts * sizeof(int), hipMemcpyDeviceToHost));
+      HIPCALL(hipMemcpy(cpuSum.data(), sum[rank], chunkInts * sizeof(int), hipMemcpyDeviceToHost));
+      for (int peer = 0; peer < numDevices; peer++)
+        for (size_t i = 0; i < chunkInts; i++) {
+          ASSERT_EQ(cpuGathered[peer * chunkInts + i], peer * 1000 + i) << "rank " << rank;
+          ASSERT_EQ(cpuWindow[peer * chunkInts + i], peer * 1000 + i) << "rank " << rank;
+        }
+      for (size_t i = 0; i < chunkInts; i++)
+        ASSERT_EQ(cpuSum[i], 1000 * numDevices * (numDevices - 1) / 2 + numDevices * i) << "rank " << rank;
+    }
+
+    for (int rank = 0; rank < numDevices; rank++)
+      threads.emplace_back([&, rank]() {
+        HIPCALL(hipSetDevice(rank));
+        results[rank] = ncclDevWindowDestroy(comms[rank], windows[rank]);
+      });
+    for (auto& thread : threads) thread.join();
+    for (int rank = 0; rank < numDevices; rank++) {
+      EXPECT_EQ(results[rank], ncclSuccess);
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipFree(chunk[rank]));
+      HIPCALL(hipFree(gathered[rank]));
+      HIPCALL(hipFree(sum[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
+
+  /**
+   * \brief Puts to and gets from one-sided windows, ordered with ncclSignal and ncclWaitSignal,
+   * and checks the data in the windows and the buffers read back.
+   * ******************************************************************************************/
+  TEST(Standalone, PutGetWindow)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // The window of rank r has a slot per rank, its own slot holds 100+r and the others -1
+    size_t const N = 1 << 16;
+    size_t const slotBytes = N * sizeof(float);
+    std::vector<float*> winBuf(numDevices), sendBuf(numDevices), recvBuf(numDevices);
+    std::vector<hipStream_t> streams(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&winBuf[rank], numDevices * slotBytes));
+      HIPCALL(hipMalloc(&sendBuf[rank], slotBytes));
+      HIPCALL(hipMalloc(&recvBuf[rank], slotBytes));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      std::vector<float> cpuWin(numDevices * N, -1.0f);
+      std::fill(cpuWin.begin() + rank * N, cpuWin.begin() + (rank + 1) * N, 100.0f + rank);
+      std::vector<float> cpuSend(N, rank + 1.0f);
+      HIPCALL(hipMemcpy(winBuf[rank], cpuWin.data(), numDevices * slotBytes, hipMemcpyHostToDevice));
+      HIPCALL(hipMemcpy(sendBuf[rank], cpuSend.data(), slotBytes, hipMemcpyHostToDevice));
+    }
+
+    // Window creation is collective, each rank needs a thread
+    std::vector<ncclWin_t> wins(numDevices);
+    std::vector<ncclResult_t> results(numDevices);
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < numDevices; rank++)
+      threads.emplace_back([&, rank]() {
+        HIPCALL(hipSetDevice(rank));
+        results[rank] = ncclWinCreate(comms[rank], winBuf[rank], numDevices * slotBytes, &wins[rank]);
+      });
+    for (auto& thread : threads) thread.join();
+    threads.clear();
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(results[rank], ncclSuccess);
+
+    // Out of range peers and accesses are rejected
+    ASSERT_EQ(ncclPut(sendBuf[0], N, ncclFloat, numDevices, 0, wins[0], streams[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclPut(sendBuf[0], N, ncclFloat, 1, (numDevices - 1) * slotBytes + 4, wins[0], streams[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclGet(recvBuf[0], N + 1, ncclFloat, 1, (numDevices - 1) * slotBytes, wins[0], streams[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclSignal(-1, wins[0], streams[0]), ncclInvalidArgument);
+
+    // Rank r puts r+1 into its slot of the window of the next rank, signals it, and waits for the
+    // signal of the previous rank. Then it gets the own slot of the next rank.
+    for (int rank = 0; rank < numDevices; rank++) {
+      int const next = (rank + 1) % numDevices;
+      int const prev = (rank + numDevices - 1) % numDevices;
+      HIPCALL(hipSetDevice(rank));
+      NCCLCHECK(ncclPut(sendBuf[rank], N, ncclFloat, next, rank * slotBytes, wins[rank], streams[rank]));
+      NCCLCHECK(ncclSignal(next, wins[rank], streams[rank]));
+      NCCLCHECK(ncclWaitSignal(prev, 1, wins[rank], streams[rank]));
+      NCCLCHECK(ncclGet(recvBuf[rank], N, ncclFloat, next, next * slotBytes, wins[rank], streams[rank]));
+    }
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      int const next = (rank + 1) % numDevices;
+      int const prev = (rank + numDevices - 1) % numDevices;
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipStreamSynchronize(streams[rank]));
+      std::vector<float> cpuWin(numDevices * N), cpuRecv(N);
+      HIPCALL(hipMemcpy(cpuWin.data(), winBuf[rank], numDevices * slotBytes, hipMemcpyDeviceToHost));
+      HIPCALL(hipMemcpy(cpuRecv.data(), recvBuf[rank], slotBytes, hipMemcpyDeviceToHost));
+      for (int slot = 0; slot < numDevices; slot++) {
+        float const expected = (slot == rank ? 100.0f + rank : slot == prev ? prev + 1.0f : -1.0f);
+        for (size_t i = 0; i < N; i++)
+          ASSERT_EQ(cpuWin[slot * N + i], expected) << "rank " << rank << " slot " << slot << " element " << i;
+      }
+      for (size_t i = 0; i < N; i++)
+        ASSERT_EQ(cpuRecv[i], 100.0f + next) << "rank " << rank << " element " << i;
+    }
+
+    for (int rank = 0; rank < numDevices; rank++)
+      threads.emplace_back([&, rank]() {
+        HIPCALL(hipSetDevice(rank));
+        results[rank] = ncclWinFree(wins[rank]);
+      });
+    for (auto& thread : threads) thread.join();
+    for (int rank = 0; rank < numDevices; rank++) {
+      EXPECT_EQ(results[rank], ncclSuccess);
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipFree(winBuf[rank]));
+      HIPCALL(hipFree(sendBuf[rank]));
+      HIPCALL(hipFree(recvBuf[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
+
+  // Out-of-place AllReduce of the float inputs of every rank, each with its own operator
+  static void AllReduceWithOps(std::vector<ncclComm_t> const& comms, std::vector<ncclRedOp_t> const& ops,
+                               std::vector<std::vector<float>> const& input, std::vector<std::vector<float>>& output)
+  {
+    int const numRanks = comms.size();
+    size_t const N = input[0].size();
+    std::vector<float*> sendBuf(numRanks), recvBuf(numRanks);
+    std::vector<hipStream_t> streams(numRanks);
+    for (int rank = 0; rank < numRanks; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&sendBuf[rank], N * sizeof(float)));
+      HIPCALL(hipMalloc(&recvBuf[rank], N * sizeof(float)));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      HIPCALL(hipMemcpy(sendBuf[rank], input[rank].data(), N * sizeof(float), hipMemcpyHostToDevice));
+    }
+    NCCLCHECK(ncclGroupStart());
+    for (int rank = 0; rank < numRanks; rank++)
+      NCCLCHECK(ncclAllReduce(sendBuf[rank], recvBuf[rank], N, ncclFloat, ops[rank], comms[rank], streams[rank]));
+    NCCLCHECK(ncclGroupEnd());
+
+    output.assign(numRanks, std::vector<float>(N));
+    for (int rank = 0; rank < numRanks; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipStreamSynchronize(streams[rank]));
+      HIPCALL(hipMemcpy(output[rank].data(), recvBuf[rank], N * sizeof(float), hipMemcpyDeviceToHost));
+      HIPCALL(hipFree(sendBuf[rank]));
+      HIPCALL(hipFree(recvBuf[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+    }
+  }
+
+  /**
+   * \brief Runs AllReduce with post-scaling sum operators, with the scale on the host and on
+   * the device, and checks the scaled results and the flag raised by non-finite results.
+   * ******************************************************************************************/
+  TEST(Standalone, RedOpPostScaleSum)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    ncclRedOp_t op;
+    float hostScale = 0.25f;
+    ASSERT_EQ(ncclRedOpCreatePostScaleSum(&op, nullptr, ncclScalarHostImmediate, nullptr, ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreatePostScaleSum(&op, &hostScale, ncclScalarHostImmediate, nullptr, ncclNumTypes, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreatePostScaleSum(&op, &hostScale, ncclScalarHostImmediate, nullptr, ncclFloat, nullptr), ncclInvalidArgument);
+
+    // Rank r gives r+1+i%4, small integers keep the sums and the scaled sums exact
+    size_t const N = (1 << 16) + 3;
+    std::vector<std::vector<float>> input(numDevices, std::vector<float>(N)), output;
+    for (int rank = 0; rank < numDevices; rank++)
+      for (size_t i = 0; i < N; i++) input[rank][i] = rank + 1.0f + i % 4;
+    auto sumAt = [&](size_t i) { return numDevices * (numDevices + 1) / 2.0f + numDevices * (float)(i % 4); };
+
+    std::vector<int*> nonFinite(numDevices);
+    std::vector<float*> devScale(numDevices);
+    std::vector<ncclRedOp_t> ops(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      float const two = 2.0f;
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&nonFinite[rank], sizeof(int)));
+      HIPCALL(hipMemset(nonFinite[rank], 0, sizeof(int)));
+      HIPCALL(hipMalloc(&devScale[rank], sizeof(float)));
+      HIPCALL(hipMemcpy(devScale[rank], &two, sizeof(float), hipMemcpyHostToDevice));
+    }
+    auto anyNonFinite = [&]() {
+      int any = 0;
+      for (int rank = 0; rank < numDevices; rank++) {
+        int flag;
+        HIPCALL(hipSetDevice(rank));
+        HIPCALL(hipMemcpy(&flag, nonFinite[rank], sizeof(int), hipMemcpyDeviceToHost));
+        any |= flag;
+      }
+      return any;
+    };
+
+    // Immediate scale, all results finite
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(ncclRedOpCreatePostScaleSum(&ops[rank], &hostScale, ncclScalarHostImmediate, nonFinite[rank], ncclFloat, comms[rank]), ncclSuccess);
+    // The scale was read at creation
+    hostScale = 100.0f;
+    AllReduceWithOps(comms, ops, input, output);
+    for (int rank = 0; rank < numDevices; rank++) {
+      for (size_t i = 0; i < N; i++)
+        ASSERT_EQ(output[rank][i], sumAt(i) * 0.25f) << "rank " << rank << " element " << i;
+      ASSERT_EQ(ncclRedOpDestroy(ops[rank], comms[rank]), ncclSuccess);
+    }
+    EXPECT_EQ(anyNonFinite(), 0);
+
+    // Scale in device memory, an infinite input raises the flag of the ranks producing it
+    size_t const infIdx = N / 2;
+    input[0][infIdx] = INFINITY;
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(ncclRedOpCreatePostScaleSum(&ops[rank], devScale[rank], ncclScalarDevice, nonFinite[rank], ncclFloat, comms[rank]), ncclSuccess);
+    AllReduceWithOps(comms, ops, input, output);
+    for (int rank = 0; rank < numDevices; rank++) {
+      for (size_t i = 0; i < N; i++) {
+        if (i == infIdx) ASSERT_TRUE(std::isinf(output[rank][i])) << "rank " << rank;
+        else ASSERT_EQ(output[rank][i], sumAt(i) * 2.0f) << "rank " << rank << " element " << i;
+      }
+      ASSERT_EQ(ncclRedOpDestroy(ops[rank], comms[rank]), ncclSuccess);
+    }
+    EXPECT_EQ(anyNonFinite(), 1);
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipFree(nonFinite[rank]));
+      HIPCALL(hipFree(devScale[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
+
+  /**
+   * \brief Runs AllReduce with an operator compiled from source by ncclRedOpCreateCustom and
+   * checks the results. Without hipRTC, creating the operator is an invalid usage.
+   * ******************************************************************************************/
+  TEST(Standalone, RedOpCreateCustom)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    char const* source =
+      "template<typename T>\n"
+      "struct AbsMax {\n"
+      "  __device__ T operator()(T a, T b) const {\n"
+      "    T x = a < T(0) ? -a : a;\n"
+      "    T y = b < T(0) ? -b : b;\n"
+      "    return x > y ? x : y;\n"
+      "  }\n"
+      "};\n";
+    ncclRedOp_t op;
+    ASSERT_EQ(ncclRedOpCreateCustom(&op, nullptr, "AbsMax", ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateCustom(&op, source, nullptr, ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateCustom(&op, source, "AbsMax", ncclNumTypes, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateCustom(&op, source, "AbsMax", ncclFloat, nullptr), ncclInvalidArgument);
+
+#ifndef RCCL_HAVE_HIPRTC
+    EXPECT_EQ(ncclRedOpCreateCustom(&op, source, "AbsMax", ncclFloat, comms[0]), ncclInvalidUsage);
+    for (int rank = 0; rank < numDevices; rank++)
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+#else
+    std::vector<ncclRedOp_t> ops(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      ncclResult_t const res = ncclRedOpCreateCustom(&ops[rank], source, "AbsMax", ncclFloat, comms[rank]);
+      if (res == ncclSystemError) {
+        for (int r = 0; r < numDevices; r++) NCCLCHECK(ncclCommDestroy(comms[r]));
+        GTEST_SKIP() << "The JIT headers are not installed, set RCCL_JIT_DIR to <prefix>/share/rccl/jit.";
+      }
+      ASSERT_EQ(res, ncclSuccess);
+    }
+    // Source that does not compile
+    EXPECT_EQ(ncclRedOpCreateCustom(&op, "struct AbsMax {", "AbsMax", ncclFloat, comms[0]), ncclInvalidArgument);
+
+    // Odd ranks give negative values, the result is the largest magnitude
+    size_t const N = (1 << 18) + 5;
+    std::vector<std::vector<float>> input(numDevices, std::vector<float>(N)), output;
+    for (int rank = 0; rank < numDevices; rank++)
+      for (size_t i = 0; i < N; i++) input[rank][i] = (rank % 2 ? -1.0f : 1.0f) * ((rank * 7 + i) % 13);
+
+    AllReduceWithOps(comms, ops, input, output);
+    for (int rank = 0; rank < numDevices; rank++) {
+      for (size_t i = 0; i < N; i++) {
+        float expected = 0.0f;
+        for (int r = 0; r < numDevices; r++) expected = std::max(expected, std::fabs(input[r][i]));
+        ASSERT_EQ(output[rank][i], expected) << "rank " << rank << " element " << i;
+      }
+      ASSERT_EQ(ncclRedOpDestroy(ops[rank], comms[rank]), ncclSuccess);
+    }
+
+    for (int rank = 0; rank < numDevices; rank++)
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+#endif
+  }
+
+  /**
+   * \brief Runs AllReduce with a bias and ReLU epilogue created by ncclRedOpCreateEpilogue and
+   * checks the results. Without hipRTC, creating the operator is an invalid usage.
+   * ******************************************************************************************/
+  TEST(Standalone, RedOpCreateEpilogue)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    size_t const numBias = 64;
+    char const* source =
+      "template<typename T>\n"
+      "struct BiasRelu {\n"
+      "  __device__ T operator()(T x, size_t index, void* arg) const {\n"
+      "    T y = x + ((T const*)arg)[index % 64];\n"
+      "    return y > T(0) ? y : T(0);\n"
+      "  }\n"
+      "};\n";
+    std::vector<float> cpuBias(numBias);
+    for (size_t j = 0; j < numBias; j++) cpuBias[j] = (float)(j % 5) - 2.0f;
+    std::vector<float*> bias(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&bias[rank], numBias * sizeof(float)));
+      HIPCALL(hipMemcpy(bias[rank], cpuBias.data(), numBias * sizeof(float), hipMemcpyHostToDevice));
+    }
+
+    ncclRedOp_t op;
+    ASSERT_EQ(ncclRedOpCreateEpilogue(&op, ncclMax, source, "BiasRelu", bias[0], ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, nullptr, "BiasRelu", bias[0], ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, source, nullptr, bias[0], ncclFloat, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, source, "BiasRelu", bias[0], ncclNumTypes, comms[0]), ncclInvalidArgument);
+    ASSERT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, source, "BiasRelu", bias[0], ncclFloat, nullptr), ncclInvalidArgument);
+
+#ifndef RCCL_HAVE_HIPRTC
+    EXPECT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, source, "BiasRelu", bias[0], ncclFloat, comms[0]), ncclInvalidUsage);
+#else
+    std::vector<ncclRedOp_t> ops(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      ncclResult_t const res = ncclRedOpCreateEpilogue(&ops[rank], ncclSum, source, "BiasRelu", bias[rank], ncclFloat, comms[rank]);
+      if (res == ncclSystemError) {
+        for (int r = 0; r < numDevices; r++) {
+          HIPCALL(hipSetDevice(r));
+          HIPCALL(hipFree(bias[r]));
+          NCCLCHECK(ncclCommDestroy(comms[r]));
+        }
+        GTEST_SKIP() << "The JIT headers are not installed, set RCCL_JIT_DIR to <prefix>/share/rccl/jit.";
+      }
+      ASSERT_EQ(res, ncclSuccess);
+    }
+    // Source that does not compile
+    EXPECT_EQ(ncclRedOpCreateEpilogue(&op, ncclSum, "struct BiasRelu {", "BiasRelu", bias[0], ncclFloat, comms[0]), ncclInvalidArgument);
+
+    // Sums of -4..4 per rank, plus a bias of -2..2, are clamped at zero on about half of the elements
+    size_t const N = (1 << 18) + 7;
+    std::vector<std::vector<float>> input(numDevices, std::vector<float>(N)), output;
+    for (int rank = 0; rank < numDevices; rank++)
+      for (size_t i = 0; i < N; i++) input[rank][i] = (float)(i % 9) - 4.0f;
+
+    AllReduceWithOps(comms, ops, input, output);
+    for (int rank = 0; rank < numDevices; rank++) {
+      for (size_t i = 0; i < N; i++) {
+        float const expected = std::max(0.0f, numDevices * input[0][i] + cpuBias[i % numBias]);
+        ASSERT_EQ(output[rank][i], expected) << "rank " << rank << " element " << i;
+      }
+    }
+
+    // Only AllReduce accepts epilogue operators
+    float* buf;
+    HIPCALL(hipSetDevice(0));
+    HIPCALL(hipMalloc(&buf, N * sizeof(float)));
+    EXPECT_EQ(ncclReduce(buf, buf, N, ncclFloat, ops[0], 0, comms[0], nullptr), ncclInvalidArgument);
+    HIPCALL(hipFree(buf));
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(ncclRedOpDestroy(ops[rank], comms[rank]), ncclSuccess);
+#endif
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipFree(bias[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
+
+  /**
+   * \brief Declares the AllToAllv send counts of every rank, checks that AllToAllv calls with
+   * those counts still deliver their blocks, then removes the declaration.
+   * ******************************************************************************************/
+  TEST(Standalone, AllToAllvDeclareCounts)
+  {
+    // Check for multi-gpu
+    int numDevices;
+    HIPCALL(hipGetDeviceCount(&numDevices));
+    if (numDevices < 2) {
+      GTEST_SKIP() << "This test requires at least 2 devices.";
+    }
+
+    std::vector<ncclComm_t> comms(numDevices);
+    NCCLCHECK(ncclCommInitAll(comms.data(), numDevices, nullptr));
+
+    // Rank r sends r+p+1 elements of value 1000*r+p to rank p
+    std::vector<std::vector<size_t>> sendcounts(numDevices, std::vector<size_t>(numDevices));
+    std::vector<std::vector<size_t>> sdispls(numDevices, std::vector<size_t>(numDevices));
+    std::vector<std::vector<size_t>> recvcounts(numDevices, std::vector<size_t>(numDevices));
+    std::vector<std::vector<size_t>> rdispls(numDevices, std::vector<size_t>(numDevices));
+    std::vector<size_t> sendTotal(numDevices, 0), recvTotal(numDevices, 0);
+    for (int rank = 0; rank < numDevices; rank++) {
+      for (int peer = 0; peer < numDevices; peer++) {
+        sendcounts[rank][peer] = rank + peer + 1;
+        sdispls[rank][peer] = sendTotal[rank];
+        sendTotal[rank] += sendcounts[rank][peer];
+        recvcounts[rank][peer] = peer + rank + 1;
+        rdispls[rank][peer] = recvTotal[rank];
+        recvTotal[rank] += recvcounts[rank][peer];
+      }
+    }
+
+    ASSERT_EQ(ncclAllToAllvDeclareCounts(sendcounts[0].data(), nullptr), ncclInvalidArgument);
+
+    // The counts are exchanged between the local ranks, each rank needs a thread
+    std::vector<ncclResult_t> results(numDevices);
+    std::vector<std::thread> threads;
+    for (int rank = 0; rank < numDevices; rank++)
+      threads.emplace_back([&, rank]() {
+        HIPCALL(hipSetDevice(rank));
+        results[rank] = ncclAllToAllvDeclareCounts(sendcounts[rank].data(), comms[rank]);
+      });
+    for (auto& thread : threads) thread.join();
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(results[rank], ncclSuccess);
+
+    std::vector<float*> sendBuf(numDevices), recvBuf(numDevices);
+    std::vector<hipStream_t> streams(numDevices);
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipMalloc(&sendBuf[rank], sendTotal[rank] * sizeof(float)));
+      HIPCALL(hipMalloc(&recvBuf[rank], recvTotal[rank] * sizeof(float)));
+      HIPCALL(hipStreamCreate(&streams[rank]));
+      std::vector<float> cpuSend(sendTotal[rank]);
+      for (int peer = 0; peer < numDevices; peer++)
+        std::fill_n(cpuSend.begin() + sdispls[rank][peer], sendcounts[rank][peer], 1000.0f * rank + peer);
+      HIPCALL(hipMemcpy(sendBuf[rank], cpuSend.data(), sendTotal[rank] * sizeof(float), hipMemcpyHostToDevice));
+    }
+
+    NCCLCHECK(ncclGroupStart());
+    for (int rank = 0; rank < numDevices; rank++)
+      NCCLCHECK(ncclAllToAllv(sendBuf[rank], sendcounts[rank].data(), sdispls[rank].data(),
+                              recvBuf[rank], recvcounts[rank].data(), rdispls[rank].data(),
+                              ncclFloat, comms[rank], streams[rank]));
+    NCCLCHECK(ncclGroupEnd());
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipStreamSynchronize(streams[rank]));
+      std::vector<float> cpuRecv(recvTotal[rank]);
+      HIPCALL(hipMemcpy(cpuRecv.data(), recvBuf[rank], recvTotal[rank] * sizeof(float), hipMemcpyDeviceToHost));
+      for (int peer = 0; peer < numDevices; peer++)
+        for (size_t i = 0; i < recvcounts[rank][peer]; i++)
+          ASSERT_EQ(cpuRecv[rdispls[rank][peer] + i], 1000.0f * peer + rank) << "rank " << rank << " peer " << peer;
+    }
+
+    // Removing the declaration doesn't exchange anything
+    for (int rank = 0; rank < numDevices; rank++)
+      ASSERT_EQ(ncclAllToAllvDeclareCounts(nullptr, comms[rank]), ncclSuccess);
+
+    for (int rank = 0; rank < numDevices; rank++) {
+      HIPCALL(hipSetDevice(rank));
+      HIPCALL(hipFree(sendBuf[rank]));
+      HIPCALL(hipFree(recvBuf[rank]));
+      HIPCALL(hipStreamDestroy(streams[rank]));
+      NCCLCHECK(ncclCommDestroy(comms[rank]));
+    }
+  }
 }
@@ -87,6 +87,16 @@ namespace RcclUnitTesting
         CHECK_CALL(this->outputGpu.AllocateGpuMem(this->numOutputBytesAllocated, useManagedMem, userRegistered));
         this->inputGpu.Attach(this->outputGpu.U1 + (this->globalRank * this->numInputBytesAllocated));
       }
+      else if (this->funcType == ncclCollAllGatherv)
+      {
+        CHECK_CALL(this->outputGpu.AllocateGpuMem(this->numOutputBytesAllocated, useManagedMem, userRegistered));
+        this->inputGpu.Attach(this->outputGpu.U1 + (this->options.rdispls[this->globalRank] * DataTypeToBytes(this->dataType)));
+      }
+      else if (this->funcType == ncclCollReduceScatterv)
+      {
+        CHECK_CALL(this->inputGpu.AllocateGpuMem(this->numInputBytesAllocated, useManagedMem, userRegistered));
+        this->outputGpu.Attach(this->inputGpu.U1 + (this->options.sdispls[this->globalRank] * DataTypeToBytes(this->dataType)));
+      }
       else
       {
         size_t const numBytes = std::max(this->numInputBytesAllocated, this->numOutputBytesAllocated);
@@ -102,6 +112,8 @@ namespace RcclUnitTesting
       CHECK_CALL(this->expected.AllocateCpuMem(this->numOutputBytesAllocated));
     }
     CHECK_CALL(this->outputCpu.AllocateCpuMem(this->numOutputBytesAllocated));
+    if (this->funcType == ncclCollSparseAllReduce)
+      CHECK_CALL(this->indicesGpu.AllocateGpuMem(this->options.sendcounts[this->globalRank] * sizeof(int64_t)));
     return TEST_SUCCESS;
   }
 
@@ -135,7 +147,7 @@ namespace RcclUnitTesting
     // If in-place, either only inputGpu or outputGpu was allocated
     if (this->inPlace)
     {
-      if (this->funcType == ncclCollGather)
+      if (this->funcType == ncclCollGather || this->funcType == ncclCollAllGatherv)
         this->outputGpu.FreeGpuMem();
       else
         this->inputGpu.FreeGpuMem(this->userRegistered);
@@ -148,6 +160,7 @@ namespace RcclUnitTesting
 
     this->outputCpu.FreeCpuMem();
     this->expected.FreeCpuMem();
+    this->indicesGpu.FreeGpuMem();
 
     if (this->localScalar.ptr != nullptr)
     {
@@ -176,13 +189,15 @@ namespace RcclUnitTesting
     case ncclCollAllToAllv:     ss << "ncclAllToAllv";     break;
     case ncclCollSend:          ss << "ncclSend";          break;
     case ncclCollRecv:          ss << "ncclRecv";          break;
+    case ncclCollAllGatherv:    ss << "ncclAllGatherv";    break;
+    case ncclCollReduceScatterv: ss << "ncclReduceScatterv"; break;
+    case ncclCollAllReduceCoalesced: ss << "ncclAllReduceCoalesced"; break;
+    case ncclCollSparseAllReduce: ss << "ncclSparseAllReduce"; break;
     default:                    ss << "[Unknown]";         break;
     }
 
     ss << " " << ncclDataTypeNames[this->dataType] << " ";
-    if (this->funcType == ncclCollReduce ||
-        this->funcType == ncclCollReduceScatter ||
-        this->funcType == ncclCollAllReduce)
+    if (CollectiveArgs::UsesReduce(this->funcType))
     {
       if (this->options.redOp < ncclNumOps)
       {
@@ -271,7 +286,10 @@ namespace RcclUnitTesting
   {
     return (funcType == ncclCollReduce    ||
             funcType == ncclCollAllReduce ||
-            funcType == ncclCollReduceScatter);
+            funcType == ncclCollReduceScatter ||
+            funcType == ncclCollReduceScatterv ||
+            funcType == ncclCollAllReduceCoalesced ||
+            funcType == ncclCollSparseAllReduce);
   }
 
   bool CollectiveArgs::UsesRoot(ncclFunc_t const funcType)
@@ -24,6 +24,10 @@ namespace RcclUnitTesting
     ncclCollAllToAllv,
     ncclCollSend,
     ncclCollRecv,
+    ncclCollAllGatherv,
+    ncclCollReduceScatterv,
+    ncclCollAllReduceCoalesced,
+    ncclCollSparseAllReduce,
     ncclNumFuncs
   } ncclFunc_t;
 
@@ -39,7 +43,11 @@ namespace RcclUnitTesting
     "AllToAll",
     "AllToAllv",
     "Send",
-    "Recv"
+    "Recv",
+    "AllGatherv",
+    "ReduceScatterv",
+    "AllReduceCoalesced",
+    "SparseAllReduce"
   };
 
   char const ncclDataTypeNames[ncclNumTypes][32] =
@@ -82,13 +90,27 @@ namespace RcclUnitTesting
     ScalarTransport scalarTransport;        // Used for custom reduction operators
     int             scalarMode = -1;        // -1 if scalar not used
 
-    // allToAllv args
+    // allToAllv args, AllGatherv uses the first totalRanks recvcounts/rdispls and
+    // ReduceScatterv the first totalRanks sendcounts/sdispls
     size_t          sendcounts[MAX_RANKS*MAX_RANKS];
     size_t          sdispls[MAX_RANKS*MAX_RANKS];
     size_t          recvcounts[MAX_RANKS*MAX_RANKS];
     size_t          rdispls[MAX_RANKS*MAX_RANKS];
+
+    // AllReduceCoalesced args, tensor t is sendcounts[t] elements at sdispls[t]
+    int             numTensors = 0;
+
+    // SparseAllReduce args, rank r gives sendcounts[r] rows of rowCount elements
+    size_t          rowCount = 0;
   };
 
+  // Row of the i-th row given by a rank to SparseAllReduce: rows come in pairs, and
+  // overlap with the rows of the other ranks
+  inline int64_t SparseRowIndex(int const rank, size_t const i, size_t const nRows)
+  {
+    return (rank * 7 + (i / 2) * 3) % nRows;
+  }
+
   // Function pointer for functions that operate on CollectiveArgs
   // e.g. For filling input / computing expected results
   typedef ErrCode (*CollFuncPtr)(CollectiveArgs &);
@@ -113,6 +135,7 @@ namespace RcclUnitTesting
     PtrUnion       outputGpu;
     PtrUnion       outputCpu;
     PtrUnion       expected;
+    PtrUnion       indicesGpu;              // SparseAllReduce row indices
     bool           inPlace;
     bool           useManagedMem;
     bool           userRegistered;
@@ -57,6 +57,44 @@ namespace RcclUnitTesting
     return TEST_SUCCESS;
   }
 
+  int getArchName(std::string* archName)
+  {
+    // Prepare parent->child pipe
+    int pipefd[2];
+    if (pipe(pipefd) == -1)
+    {
+      ERROR("Unable to create parent->child pipe for getting the architecture name\n");
+      return TEST_FAIL;
+    }
+    pid_t pid = fork();
+    if (0 == pid)
+    {
+      char gcn[64] = "unknown";
+      hipDeviceProp_t devProp;
+      if (hipGetDeviceProperties(&devProp, 0) == hipSuccess)
+      {
+        char *gcnArchNameToken = strtok(devProp.gcnArchName, ":");
+        if (gcnArchNameToken) snprintf(gcn, sizeof(gcn), "%s", gcnArchNameToken);
+      }
+      if (write(pipefd[1], gcn, sizeof(gcn)) != sizeof(gcn)) return TEST_FAIL;
+      close(pipefd[0]);
+      close(pipefd[1]);
+      exit(EXIT_SUCCESS);
+    }
+    else
+    {
+      int status;
+      char gcn[64];
+      if (read(pipefd[0], gcn, sizeof(gcn)) != sizeof(gcn)) return TEST_FAIL;
+      waitpid(pid, &status, 0);
+      assert(!status);
+      close(pipefd[0]);
+      close(pipefd[1]);
+      *archName = gcn;
+    }
+    return TEST_SUCCESS;
+  }
+
   int getDeviceCount(int *devices)
   {
     // Prepare parent->child pipe
@@ -111,6 +149,13 @@ namespace RcclUnitTesting
     useInteractive = GetEnvVar("UT_INTERACTIVE",  0);
     timeoutUs      = GetEnvVar("UT_TIMEOUT_US" ,  5000000);
     useMultithreading = GetEnvVar("UT_MULTITHREAD", false);
+    perfIters      = GetEnvVar("UT_PERF_ITERS",     0);
+    perfWarmups    = GetEnvVar("UT_PERF_WARMUPS",   5);
+    perfTolerance  = GetEnvVar("UT_PERF_TOLERANCE", 10);
+    perfRecord     = GetEnvVar("UT_PERF_RECORD",    0);
+    perfBaselineFile = getenv("UT_PERF_BASELINE") ? getenv("UT_PERF_BASELINE") : "";
+    archName       = "unknown";
+    if (perfIters > 0) getArchName(&archName);
 
     // Total number of reduction ops
     int numOps = ncclNumOps;
@@ -237,6 +282,11 @@ namespace RcclUnitTesting
         std::make_tuple("UT_INTERACTIVE"      , useInteractive, "Run in interactive mode"),
         std::make_tuple("UT_TIMEOUT_US"       , timeoutUs     , "Timeout limit for collective calls in us"),
         std::make_tuple("UT_MULTITHREAD"      , useMultithreading, "Multi-thread single-process ranks"),
+        std::make_tuple("UT_PERF_ITERS"       , perfIters     , "Timed iterations per case (0 to disable)"),
+        std::make_tuple("UT_PERF_WARMUPS"     , perfWarmups   , "Untimed iterations before timing"),
+        std::make_tuple("UT_PERF_TOLERANCE"   , perfTolerance , "Allowed busbw regression in percent"),
+        std::make_tuple("UT_PERF_RECORD"      , perfRecord    , "Record busbw baselines instead of checking"),
+        std::make_tuple("UT_PERF_BASELINE"    , -1            , "File of per-platform busbw baselines"),
       };
 
     printf("================================================================================\n");
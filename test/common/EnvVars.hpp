@@ -6,6 +6,7 @@
 
 #pragma once
 #include <hsa/hsa.h>
+#include <string>
 #include <vector>
 #include "rccl/rccl.h"
 
@@ -30,6 +31,12 @@ namespace RcclUnitTesting
     bool useInteractive; // Run in interactive mode                [UT_INTERACTIVE]
     int  timeoutUs;      // Set timeout for child in microseconds  [UT_TIMEOUT_US]
     bool useMultithreading; // Multi-thread single-process ranks   [UT_MULTITHREAD]
+    int  perfIters;      // Timed iterations per case, 0 disables   [UT_PERF_ITERS]
+    int  perfWarmups;    // Untimed iterations before timing       [UT_PERF_WARMUPS]
+    int  perfTolerance;  // Allowed busbw regression in percent    [UT_PERF_TOLERANCE]
+    bool perfRecord;     // Record busbw baselines, do not check   [UT_PERF_RECORD]
+    std::string perfBaselineFile; // Per-platform busbw baselines  [UT_PERF_BASELINE]
+    std::string archName;         // Architecture of the first GPU, e.g. gfx942
     bool isGfx94;        // Detects if architecture is gfx94
     bool isGfx12;        // Detects if architecture is gfx12
 
@@ -7,6 +7,7 @@
 #include "CollectiveArgs.hpp"
 #include "PrepDataFuncs.hpp"
 #include <cstdio>
+#include <vector>
 #include <hip/hip_runtime.h>
 
 namespace RcclUnitTesting
@@ -26,6 +27,10 @@ namespace RcclUnitTesting
     case ncclCollAllToAllv:     return DefaultPrepData_AllToAllv(collArgs);
     case ncclCollSend:          return DefaultPrepData_Send(collArgs);
     case ncclCollRecv:          return DefaultPrepData_Recv(collArgs);
+    case ncclCollAllGatherv:    return DefaultPrepData_AllGatherv(collArgs);
+    case ncclCollReduceScatterv: return DefaultPrepData_ReduceScatterv(collArgs);
+    case ncclCollAllReduceCoalesced: return DefaultPrepData_AllReduceCoalesced(collArgs);
+    case ncclCollSparseAllReduce: return DefaultPrepData_SparseAllReduce(collArgs);
     default:
       ERROR("Unknown func type %d\n", collArgs.funcType);
       return TEST_FAIL;
@@ -397,4 +402,179 @@ namespace RcclUnitTesting
                                          collArgs.options.root,
                                          false);
   }
+
+  ErrCode DefaultPrepData_AllGatherv(CollectiveArgs &collArgs)
+  {
+    CHECK_CALL(CheckAllocation(collArgs));
+    if (collArgs.numInputElements != collArgs.options.recvcounts[collArgs.globalRank])
+    {
+      ERROR("# of input elements must be recvcounts[rank] for AllGatherv\n");
+      return TEST_FAIL;
+    }
+
+    size_t const typeBytes      = DataTypeToBytes(collArgs.dataType);
+    size_t const numOutputBytes = collArgs.numOutputElements * typeBytes;
+
+    // Clear output for all ranks (done before filling input in case of in-place)
+    // Elements between the blocks of the ranks are expected to stay cleared
+    CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numOutputBytes));
+    CHECK_CALL(collArgs.expected.ClearCpuMem(numOutputBytes));
+
+    size_t maxCount = 0;
+    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
+      maxCount = std::max(maxCount, collArgs.options.recvcounts[rank]);
+    if (maxCount == 0) return TEST_SUCCESS;
+
+    // Each rank sends its pattern, which every rank receives at displs[rank]
+    PtrUnion tempInputCpu;
+    CHECK_CALL(tempInputCpu.AllocateCpuMem(maxCount * typeBytes));
+    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
+    {
+      size_t const numBytes = collArgs.options.recvcounts[rank] * typeBytes;
+      if (numBytes == 0) continue;
+      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.options.recvcounts[rank], rank, false));
+      if (rank == collArgs.globalRank)
+      {
+        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numBytes, hipMemcpyHostToDevice));
+      }
+      memcpy(collArgs.expected.U1 + collArgs.options.rdispls[rank] * typeBytes, tempInputCpu.ptr, numBytes);
+    }
+    CHECK_CALL(tempInputCpu.FreeCpuMem());
+    return TEST_SUCCESS;
+  }
+
+  ErrCode DefaultPrepData_ReduceScatterv(CollectiveArgs &collArgs)
+  {
+    CHECK_CALL(CheckAllocation(collArgs));
+    if (collArgs.numOutputElements != collArgs.options.sendcounts[collArgs.globalRank] ||
+        collArgs.numInputElements < collArgs.options.sdispls[collArgs.globalRank] + collArgs.numOutputElements)
+    {
+      ERROR("# of output elements must be sendcounts[rank], within the input, for ReduceScatterv\n");
+      return TEST_FAIL;
+    }
+
+    size_t const typeBytes      = DataTypeToBytes(collArgs.dataType);
+    size_t const numInputBytes  = collArgs.numInputElements * typeBytes;
+    size_t const numOutputBytes = collArgs.numOutputElements * typeBytes;
+
+    // Clear output for all ranks (done before filling input in case of in-place)
+    CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numOutputBytes));
+    if (numInputBytes == 0) return TEST_SUCCESS;
+
+    PtrUnion tempInputCpu;
+    PtrUnion tempResultCpu;
+    CHECK_CALL(tempInputCpu.AllocateCpuMem(numInputBytes));
+    CHECK_CALL(tempResultCpu.AllocateCpuMem(numInputBytes));
+
+    // If average or custom reduction operator is used, perform a summation instead
+    ncclRedOp_t const tempOp = (collArgs.options.redOp >= ncclAvg ? ncclSum : collArgs.options.redOp);
+
+    // Every rank reduces its whole input, each keeps the part at displs[rank]
+    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
+    {
+      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, collArgs.numInputElements, rank, false));
+      if (rank == collArgs.globalRank)
+      {
+        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, numInputBytes, hipMemcpyHostToDevice));
+      }
+      if (rank == 0)
+      {
+        memcpy(tempResultCpu.ptr, tempInputCpu.ptr, numInputBytes);
+      }
+      else
+      {
+        CHECK_CALL(tempResultCpu.Reduce(collArgs.dataType, collArgs.numInputElements,
+                                        tempInputCpu, tempOp));
+      }
+    }
+
+    // Perform averaging if necessary
+    if (collArgs.options.redOp == ncclAvg)
+    {
+      CHECK_CALL(tempResultCpu.DivideByInt(collArgs.dataType, collArgs.numInputElements, collArgs.totalRanks));
+    }
+
+    memcpy(collArgs.expected.U1,
+           tempResultCpu.U1 + collArgs.options.sdispls[collArgs.globalRank] * typeBytes,
+           numOutputBytes);
+    CHECK_CALL(tempInputCpu.FreeCpuMem());
+    CHECK_CALL(tempResultCpu.FreeCpuMem());
+    return TEST_SUCCESS;
+  }
+
+  ErrCode DefaultPrepData_AllReduceCoalesced(CollectiveArgs &collArgs)
+  {
+    // Reduce the whole buffer, then put back what lies outside of the tensors:
+    // zeros, or the input of this rank in case of in-place
+    CHECK_CALL(DefaultPrepData_Reduce(collArgs, true));
+
+    size_t const typeBytes      = DataTypeToBytes(collArgs.dataType);
+    size_t const numOutputBytes = collArgs.numOutputElements * typeBytes;
+    if (numOutputBytes == 0) return TEST_SUCCESS;
+
+    PtrUnion untouched;
+    CHECK_CALL(untouched.AllocateCpuMem(numOutputBytes));
+    if (collArgs.inPlace)
+      CHECK_CALL(untouched.FillPattern(collArgs.dataType, collArgs.numOutputElements, collArgs.globalRank, false));
+
+    // Tensors are in increasing displacement order
+    size_t end = 0;
+    for (int t = 0; t <= collArgs.options.numTensors; ++t)
+    {
+      size_t const start = (t < collArgs.options.numTensors ? collArgs.options.sdispls[t] : collArgs.numOutputElements);
+      if (start > end)
+        memcpy(collArgs.expected.U1 + end * typeBytes, untouched.U1 + end * typeBytes, (start - end) * typeBytes);
+      if (t < collArgs.options.numTensors)
+        end = std::max(end, start + collArgs.options.sendcounts[t]);
+    }
+    CHECK_CALL(untouched.FreeCpuMem());
+    return TEST_SUCCESS;
+  }
+
+  ErrCode DefaultPrepData_SparseAllReduce(CollectiveArgs &collArgs)
+  {
+    CHECK_CALL(CheckAllocation(collArgs));
+    size_t const rowCount = collArgs.options.rowCount;
+    if (rowCount == 0 || collArgs.numOutputElements % rowCount ||
+        collArgs.numInputElements != collArgs.options.sendcounts[collArgs.globalRank] * rowCount)
+    {
+      ERROR("# of input elements must be sendcounts[rank] rows, and output whole rows, for SparseAllReduce\n");
+      return TEST_FAIL;
+    }
+
+    size_t const typeBytes      = DataTypeToBytes(collArgs.dataType);
+    size_t const nRows          = collArgs.numOutputElements / rowCount;
+    size_t const numOutputBytes = collArgs.numOutputElements * typeBytes;
+
+    // Rows no rank gives stay zero, SparseAllReduce overwrites the whole output
+    CHECK_CALL(collArgs.outputGpu.ClearGpuMem(numOutputBytes));
+    CHECK_CALL(collArgs.expected.ClearCpuMem(numOutputBytes));
+
+    // Every rank adds each of its rows to the expected row, duplicates included
+    for (int rank = 0; rank < collArgs.totalRanks; ++rank)
+    {
+      size_t const nnz = collArgs.options.sendcounts[rank];
+      if (nnz == 0) continue;
+
+      PtrUnion tempInputCpu;
+      std::vector<int64_t> indices(nnz);
+      CHECK_CALL(tempInputCpu.AllocateCpuMem(nnz * rowCount * typeBytes));
+      CHECK_CALL(tempInputCpu.FillPattern(collArgs.dataType, nnz * rowCount, rank, false));
+      for (size_t i = 0; i < nnz; ++i)
+      {
+        indices[i] = SparseRowIndex(rank, i, nRows);
+        PtrUnion expectedRow, inputRow;
+        expectedRow.Attach(collArgs.expected.U1 + indices[i] * rowCount * typeBytes);
+        inputRow.Attach(tempInputCpu.U1 + i * rowCount * typeBytes);
+        CHECK_CALL(expectedRow.Reduce(collArgs.dataType, rowCount, inputRow, ncclSum));
+      }
+      if (rank == collArgs.globalRank)
+      {
+        CHECK_HIP(hipMemcpy(collArgs.inputGpu.ptr, tempInputCpu.ptr, nnz * rowCount * typeBytes, hipMemcpyHostToDevice));
+        CHECK_HIP(hipMemcpy(collArgs.indicesGpu.ptr, indices.data(), nnz * sizeof(int64_t), hipMemcpyHostToDevice));
+      }
+      CHECK_CALL(tempInputCpu.FreeCpuMem());
+    }
+    return TEST_SUCCESS;
+  }
 }
@@ -25,4 +25,8 @@ namespace RcclUnitTesting
   ErrCode DefaultPrepData_AllToAllv(CollectiveArgs &collArgs);
   ErrCode DefaultPrepData_Send(CollectiveArgs &collArgs);
   ErrCode DefaultPrepData_Recv(CollectiveArgs &collArgs);
+  ErrCode DefaultPrepData_AllGatherv(CollectiveArgs &collArgs);
+  ErrCode DefaultPrepData_ReduceScatterv(CollectiveArgs &collArgs);
+  ErrCode DefaultPrepData_AllReduceCoalesced(CollectiveArgs &collArgs);
+  ErrCode DefaultPrepData_SparseAllReduce(CollectiveArgs &collArgs);
 }
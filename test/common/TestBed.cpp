@@ -4,6 +4,8 @@
  * See LICENSE.txt for license information
  ************************************************************************/
 #include <unistd.h>
+#include <fstream>
+#include <sstream>
 #include "TestBed.hpp"
 #include <rccl/rccl.h>
 
@@ -50,7 +52,8 @@ namespace RcclUnitTesting
   TestBed::TestBed() :
     numDevicesAvailable(0),
     numActiveChildren(0),
-    numActiveRanks(0)
+    numActiveRanks(0),
+    useUngroupedCalls(false)
   {
     // Collect the number of GPUs
     this->numDevicesAvailable = ev.maxGpus;
@@ -340,6 +343,7 @@ namespace RcclUnitTesting
           PIPE_WRITE(childId, ev.timeoutUs);
           PIPE_WRITE(childId, currGroup);
           PIPE_WRITE(childId, useHipGraph);
+          PIPE_WRITE(childId, this->useUngroupedCalls);
           int tempCurrentRanks = currentRanks.size();
           PIPE_WRITE(childId, tempCurrentRanks);
           for (int rank = 0; rank < currentRanks.size(); ++rank){
@@ -423,6 +427,115 @@ namespace RcclUnitTesting
     InteractiveWait("Finishing LaunchGraphs");
   }
 
+  double TestBed::MeasureCollectives(int const groupId)
+  {
+    InteractiveWait("Starting MeasureCollectives");
+
+    int const cmd = TestBedChild::CHILD_TIME_COLL;
+    double usPerIter = 0;
+    for (int childId = 0; childId < this->numActiveChildren; ++childId)
+    {
+      EXPECT_EQ(write(childList[childId]->parentWriteFd, &cmd, sizeof(cmd)), sizeof(cmd));
+      EXPECT_EQ(write(childList[childId]->parentWriteFd, &groupId, sizeof(groupId)), sizeof(groupId));
+      EXPECT_EQ(write(childList[childId]->parentWriteFd, &ev.perfWarmups, sizeof(ev.perfWarmups)), sizeof(ev.perfWarmups));
+      EXPECT_EQ(write(childList[childId]->parentWriteFd, &ev.perfIters, sizeof(ev.perfIters)), sizeof(ev.perfIters));
+    }
+    // Children time concurrently, the collectives span all of them
+    for (int childId = 0; childId < this->numActiveChildren; ++childId)
+    {
+      double childUs = -1;
+      int response = TEST_FAIL;
+      if (read(childList[childId]->parentReadFd, &childUs, sizeof(childUs)) != sizeof(childUs) ||
+          read(childList[childId]->parentReadFd, &response, sizeof(response)) != sizeof(response) ||
+          response != TEST_SUCCESS)
+      {
+        ADD_FAILURE() << "Child " << childId << " failed to time collectives";
+        return -1;
+      }
+      usPerIter = (childUs < 0 || usPerIter < 0) ? -1 : std::max(usPerIter, childUs);
+    }
+
+    InteractiveWait("Finishing MeasureCollectives");
+    return usPerIter;
+  }
+
+  // Ratio between the bus bandwidth and the algorithm bandwidth, as reported by rccl-tests
+  static double BusBwFactor(ncclFunc_t const funcType, int const numRanks)
+  {
+    switch (funcType)
+    {
+    case ncclCollAllReduce:
+    case ncclCollAllReduceCoalesced: return 2.0 * (numRanks - 1) / numRanks;
+    case ncclCollAllGather:
+    case ncclCollReduceScatter:
+    case ncclCollGather:
+    case ncclCollScatter:
+    case ncclCollAllToAll:
+    case ncclCollAllToAllv:
+    case ncclCollAllGatherv:
+    case ncclCollReduceScatterv: return (double)(numRanks - 1) / numRanks;
+    default:                    return 1.0;
+    }
+  }
+
+  // Baselines of all architectures, "<arch> <key>" -> busbw in GB/s. Later lines win.
+  static std::map<std::string, double>& PerfBaselines(std::string const& fileName)
+  {
+    static std::map<std::string, double> baselines;
+    static bool loaded = false;
+    if (!loaded && !fileName.empty())
+    {
+      std::ifstream file(fileName);
+      std::string line;
+      while (std::getline(file, line))
+      {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::string arch, key;
+        double busBw;
+        if (ss >> arch >> key >> busBw) baselines[arch + " " + key] = busBw;
+      }
+      loaded = true;
+    }
+    return baselines;
+  }
+
+  void TestBed::CheckPerformance(std::string const& key, ncclFunc_t const funcType, size_t const numBytes, int const groupId)
+  {
+    if (ev.perfIters <= 0) return;
+
+    double const usPerIter = this->MeasureCollectives(groupId);
+    if (usPerIter <= 0) return;
+    double const algBw = numBytes / usPerIter / 1.0E3;
+    double const busBw = algBw * BusBwFactor(funcType, this->numActiveRanks);
+
+    std::map<std::string, double>& baselines = PerfBaselines(ev.perfBaselineFile);
+    std::string const fullKey = ev.archName + " " + key;
+    if (ev.perfRecord)
+    {
+      INFO("[PERF] %s %10.2f us algbw %8.2f GB/s busbw %8.2f GB/s (recorded)\n", key.c_str(), usPerIter, algBw, busBw);
+      if (ev.perfBaselineFile.empty()) return;
+      std::ofstream file(ev.perfBaselineFile, std::ios::app);
+      file << fullKey << " " << busBw << "\n";
+      EXPECT_TRUE(file.good()) << "Unable to append baseline to " << ev.perfBaselineFile;
+      baselines[fullKey] = busBw;
+      return;
+    }
+
+    auto it = baselines.find(fullKey);
+    if (it == baselines.end())
+    {
+      INFO("[PERF] %s %10.2f us algbw %8.2f GB/s busbw %8.2f GB/s (no baseline)\n", key.c_str(), usPerIter, algBw, busBw);
+      return;
+    }
+    double const minBusBw = it->second * (100 - ev.perfTolerance) / 100.0;
+    INFO("[PERF] %s %10.2f us algbw %8.2f GB/s busbw %8.2f GB/s baseline %8.2f GB/s\n",
+         key.c_str(), usPerIter, algBw, busBw, it->second);
+    EXPECT_GE(busBw, minBusBw) << "Performance regression for " << key << " on " << ev.archName << ": busbw "
+                               << busBw << " GB/s is more than " << ev.perfTolerance << "% below the baseline "
+                               << it->second << " GB/s";
+  }
+
   void TestBed::DeallocateMem(int const groupId, int const collId, int const rank)
   {
     InteractiveWait("Starting DeallocateMem");
@@ -668,6 +781,8 @@ namespace RcclUnitTesting
       if(enableSweep == false && (numGpus < 8 || numRanks < 8)) {
         continue;
       }
+      // Several ranks of one process always have to be issued in a group call
+      if (this->useUngroupedCalls && (!isMultiProcess || ranksPerGpu > 1)) continue;
       this->InitComms(TestBed::GetDeviceIdsList(numChildren, numGpus, ranksPerGpu));
       if (testing::Test::HasFailure())
       {
@@ -756,6 +871,17 @@ namespace RcclUnitTesting
             {
               ERROR("Incorrect output for %s\n", name.c_str());
             }
+            else if (ev.perfIters > 0 && !useHipGraphList[hgIdx])
+            {
+              size_t const numBytes = std::max(numInputElements, numOutputElements) * DataTypeToBytes(dataTypes[dtIdx]);
+              std::stringstream key;
+              key << ncclFuncNames[funcTypes[ftIdx]] << "_" << ncclDataTypeNames[dataTypes[dtIdx]];
+              if (CollectiveArgs::UsesReduce(funcTypes[ftIdx])) key << "_" << ncclRedOpNames[redOps[rdIdx]];
+              key << "_" << numRanks << "ranks" << (isMultiProcess ? "_MP" : "_SP")
+                  << (inPlaceList[ipIdx] ? "_IP" : "_OP") << (managedMemList[mmIdx] ? "_MM" : "_GM")
+                  << "_" << numBytes << "B";
+              this->CheckPerformance(key.str(), funcTypes[ftIdx], numBytes);
+            }
           }
         }
         this->DeallocateMem();
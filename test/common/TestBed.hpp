@@ -28,6 +28,7 @@ namespace RcclUnitTesting
     int                        numActiveChildren;     // List of active children (with usable RCCL comms)
     int                        numActiveRanks;        // Current # of ranks in use
     bool                       useBlocking;           // RCCL communication with blocking or non-blocking option
+    bool                       useUngroupedCalls;     // Issue a lone collective per process outside of a group call
     EnvVars                    ev;                    // Environment variables
 
     // Constructor - Creates one child process per detected GPU device that waits for further commands
@@ -103,6 +104,20 @@ namespace RcclUnitTesting
     // Launch instantiated graphs
     void LaunchGraphs(int const groupId = -1);
 
+    // Time ev.perfIters executions of a group with hipEvents, after ev.perfWarmups untimed ones
+    // - Returns the time per iteration of the slowest rank in us, or -1 if the group was not timed
+    double MeasureCollectives(int const groupId = 0);
+
+    // Measure a group of funcType collectives of numBytes each (the larger of input and output)
+    // and report algbw/busbw. The busbw is compared with the baseline stored under key for this
+    // GPU architecture in ev.perfBaselineFile, and the test fails if it is more than
+    // ev.perfTolerance percent lower. With ev.perfRecord the busbw is stored instead.
+    // No-op unless ev.perfIters > 0
+    void CheckPerformance(std::string const& key,
+                          ncclFunc_t  const  funcType,
+                          size_t      const  numBytes,
+                          int         const  groupId = 0);
+
     // Release allocated memory
     void DeallocateMem(int const groupId = -1, int const collId = -1, int const rank = -1);
 
@@ -71,6 +71,7 @@ namespace RcclUnitTesting
     this->verbose = verbose;
     this->printValues = printValues;
     this->useRankThreading = useRankThreading;
+    this->useUngroupedCalls = false;
   }
 
   int TestBedChild::InitPipes()
@@ -127,6 +128,7 @@ namespace RcclUnitTesting
       case CHILD_DEALLOCATE_MEM  : status = DeallocateMem();      break;
       case CHILD_DESTROY_COMMS   : status = DestroyComms();       break;
       case CHILD_DESTROY_GRAPHS  : status = DestroyGraphs();      break;
+      case CHILD_TIME_COLL       : status = TimeCollectives();    break;
       case CHILD_STOP            : goto stop;
       default: exit(0);
       }
@@ -447,65 +449,17 @@ namespace RcclUnitTesting
     return TEST_SUCCESS;
   }
 
-  ErrCode TestBedChild::ExecuteCollectives()
+  ErrCode TestBedChild::IssueGroup(int const groupId, std::vector<int> const& localRanksToExecute, bool const useHipGraph)
   {
-    int timeoutUs = 0;
-    int groupId = 0;
-    bool useHipGraph = false;
-
-    PIPE_READ(timeoutUs);
-    PIPE_READ(groupId);
-    PIPE_READ(useHipGraph);
-
-    int numRanksToExecute, tempRank;
-    std::vector<int> ranksToExecute = {};
-    PIPE_READ(numRanksToExecute);
-
-    for (int rank = 0; rank < numRanksToExecute; ++rank){
-      PIPE_READ(tempRank);
-      ranksToExecute.push_back(tempRank - this->rankOffset);
-    }
-    if (this->verbose) INFO("Child %d begins ExecuteCollectives() %s\n", this->childId, useHipGraph ? "(using hipGraphs)" : "");
-
-    // Determine which local ranks to execute on
-    std::vector<int> localRanksToExecute;
-    for (int localRank = 0; localRank < this->deviceIds.size(); ++localRank)
-    {
-      // If ranksToExeute is empty, execute all local ranks belonging to this child
-      if (!ranksToExecute.empty() &&
-          (std::count(ranksToExecute.begin(), ranksToExecute.end(), localRank) == 0)) continue;
-      localRanksToExecute.push_back(localRank);
-    }
-
-    numRanksToExecute = (int)localRanksToExecute.size();
-    this->graphs[groupId].resize(numRanksToExecute);
-    this->graphExecs[groupId].resize(numRanksToExecute);
-    this->graphEnabled[groupId].resize(numRanksToExecute);
-    for (int i = 0; i < numRanksToExecute; i++)
-    {
-      this->graphs[groupId][i].resize(this->numStreamsPerGroup[groupId]);
-      this->graphExecs[groupId][i].resize(this->numStreamsPerGroup[groupId]);
-      this->graphEnabled[groupId][i].resize(this->numStreamsPerGroup[groupId]);
-    }
-
-    // Start HIP graph stream capture if requested
-    if (useHipGraph)
-    {
-      for (int localRank : localRanksToExecute)
-      {
-        if (this->verbose) INFO("Capturing stream for group %d rank %d\n", groupId, localRank);
-        CHECK_HIP(hipSetDevice(this->deviceIds[localRank]));
-        for (int i = 0; i < this->numStreamsPerGroup[groupId]; i++)
-        {
-          CHECK_HIP(hipStreamBeginCapture(this->streams[groupId][localRank][i], hipStreamCaptureModeRelaxed));
-        }
-      }
-    }
+    int numThreadsToUse = this->useRankThreading ? (int)localRanksToExecute.size() : 1;
 
-    int numThreadsToUse = this->useRankThreading ? numRanksToExecute : 1;
+    // Tests of the paths RCCL only takes for ungrouped calls can ask for a lone
+    // collective on a blocking comm to be issued outside of a group call
+    bool const useGroupCall = !this->useUngroupedCalls || localRanksToExecute.size() > 1 ||
+                              this->numCollectivesInGroup[groupId] > 1 || this->useBlocking == false;
 
     // Start group call
-    CHILD_NCCL_CALL(ncclGroupStart(), "ncclGroupStart");
+    if (useGroupCall) CHILD_NCCL_CALL(ncclGroupStart(), "ncclGroupStart");
 
     // Loop over all collectives to be executed in group call
     for (int collId = 0; collId < this->numCollectivesInGroup[groupId]; ++collId)
@@ -669,6 +623,65 @@ namespace RcclUnitTesting
                                    this->streams[groupId][localRank][collArg.streamIdx]),
                           "ncclRecv");
           break;
+        case ncclCollAllGatherv:
+          CHILD_NCCL_CALL_RANK(errCode, ncclAllGatherv(
+                                        collArg.inputGpu.ptr,
+                                        collArg.outputGpu.ptr,
+                                        collArg.options.recvcounts,
+                                        collArg.options.rdispls,
+                                        collArg.dataType,
+                                        this->comms[localRank],
+                                        this->streams[groupId][localRank][collArg.streamIdx]),
+                          "ncclAllGatherv");
+          break;
+        case ncclCollReduceScatterv:
+          CHILD_NCCL_CALL_RANK(errCode, ncclReduceScatterv(
+                                            collArg.inputGpu.ptr,
+                                            collArg.outputGpu.ptr,
+                                            collArg.options.sendcounts,
+                                            collArg.options.sdispls,
+                                            collArg.dataType,
+                                            collArg.options.redOp,
+                                            this->comms[localRank],
+                                            this->streams[groupId][localRank][collArg.streamIdx]),
+                          "ncclReduceScatterv");
+          break;
+        case ncclCollAllReduceCoalesced:
+          {
+            std::vector<const void*> sendbuffs(collArg.options.numTensors);
+            std::vector<void*>       recvbuffs(collArg.options.numTensors);
+            size_t const typeBytes = DataTypeToBytes(collArg.dataType);
+            for (int t = 0; t < collArg.options.numTensors; ++t)
+            {
+              sendbuffs[t] = collArg.inputGpu.U1 + collArg.options.sdispls[t] * typeBytes;
+              recvbuffs[t] = collArg.outputGpu.U1 + collArg.options.sdispls[t] * typeBytes;
+            }
+            CHILD_NCCL_CALL_RANK(errCode, ncclAllReduceCoalesced(
+                                          sendbuffs.data(),
+                                          recvbuffs.data(),
+                                          collArg.options.sendcounts,
+                                          collArg.options.numTensors,
+                                          collArg.dataType,
+                                          collArg.options.redOp,
+                                          this->comms[localRank],
+                                          this->streams[groupId][localRank][collArg.streamIdx]),
+                            "ncclAllReduceCoalesced");
+          }
+          break;
+        case ncclCollSparseAllReduce:
+          CHILD_NCCL_CALL_RANK(errCode, ncclSparseAllReduce(
+                                        (int64_t const*)collArg.indicesGpu.ptr,
+                                        collArg.inputGpu.ptr,
+                                        collArg.options.sendcounts[collArg.globalRank],
+                                        collArg.options.rowCount,
+                                        collArg.outputGpu.ptr,
+                                        collArg.numOutputElements / collArg.options.rowCount,
+                                        collArg.dataType,
+                                        collArg.options.redOp,
+                                        this->comms[localRank],
+                                        this->streams[groupId][localRank][collArg.streamIdx]),
+                          "ncclSparseAllReduce");
+          break;
         default:
           ERROR("Unknown func type %d\n", collArg.funcType);
           RANK_RESULT(errCode, TEST_FAIL);
@@ -685,6 +698,7 @@ namespace RcclUnitTesting
       if (this->useRankThreading) CHECK_CALL(errCode);
     }
     // End group call
+    if (!useGroupCall) return TEST_SUCCESS;
     if (this->useBlocking == false)
     {
       // handle the ncclGroupEnd in case of non-blocking communication
@@ -703,6 +717,66 @@ namespace RcclUnitTesting
       // In case of blocking communication just call ncclGroupEnd
       CHILD_NCCL_CALL(ncclGroupEnd(), "ncclGroupEnd");
     }
+    return TEST_SUCCESS;
+  }
+
+  ErrCode TestBedChild::ExecuteCollectives()
+  {
+    int timeoutUs = 0;
+    int groupId = 0;
+    bool useHipGraph = false;
+
+    PIPE_READ(timeoutUs);
+    PIPE_READ(groupId);
+    PIPE_READ(useHipGraph);
+    PIPE_READ(this->useUngroupedCalls);
+
+    int numRanksToExecute, tempRank;
+    std::vector<int> ranksToExecute = {};
+    PIPE_READ(numRanksToExecute);
+
+    for (int rank = 0; rank < numRanksToExecute; ++rank){
+      PIPE_READ(tempRank);
+      ranksToExecute.push_back(tempRank - this->rankOffset);
+    }
+    if (this->verbose) INFO("Child %d begins ExecuteCollectives() %s\n", this->childId, useHipGraph ? "(using hipGraphs)" : "");
+
+    // Determine which local ranks to execute on
+    std::vector<int> localRanksToExecute;
+    for (int localRank = 0; localRank < this->deviceIds.size(); ++localRank)
+    {
+      // If ranksToExeute is empty, execute all local ranks belonging to this child
+      if (!ranksToExecute.empty() &&
+          (std::count(ranksToExecute.begin(), ranksToExecute.end(), localRank) == 0)) continue;
+      localRanksToExecute.push_back(localRank);
+    }
+
+    numRanksToExecute = (int)localRanksToExecute.size();
+    this->graphs[groupId].resize(numRanksToExecute);
+    this->graphExecs[groupId].resize(numRanksToExecute);
+    this->graphEnabled[groupId].resize(numRanksToExecute);
+    for (int i = 0; i < numRanksToExecute; i++)
+    {
+      this->graphs[groupId][i].resize(this->numStreamsPerGroup[groupId]);
+      this->graphExecs[groupId][i].resize(this->numStreamsPerGroup[groupId]);
+      this->graphEnabled[groupId][i].resize(this->numStreamsPerGroup[groupId]);
+    }
+
+    // Start HIP graph stream capture if requested
+    if (useHipGraph)
+    {
+      for (int localRank : localRanksToExecute)
+      {
+        if (this->verbose) INFO("Capturing stream for group %d rank %d\n", groupId, localRank);
+        CHECK_HIP(hipSetDevice(this->deviceIds[localRank]));
+        for (int i = 0; i < this->numStreamsPerGroup[groupId]; i++)
+        {
+          CHECK_HIP(hipStreamBeginCapture(this->streams[groupId][localRank][i], hipStreamCaptureModeRelaxed));
+        }
+      }
+    }
+
+    CHECK_CALL(IssueGroup(groupId, localRanksToExecute, useHipGraph));
 
     // Instantiate and launch HIP graph if requested
     if (useHipGraph)
@@ -812,6 +886,72 @@ namespace RcclUnitTesting
     return TEST_SUCCESS;
   }
 
+  ErrCode TestBedChild::TimeCollectives()
+  {
+    // Read values sent by parent [see TestBed::MeasureCollectives()]
+    int groupId, numWarmups, numIters;
+    PIPE_READ(groupId);
+    PIPE_READ(numWarmups);
+    PIPE_READ(numIters);
+
+    if (this->verbose) INFO("Child %d begins TimeCollectives() for group %d\n", this->childId, groupId);
+
+    // Re-registering user buffers on every iteration would leak handles, those groups are not timed
+    double usPerIter = -1.0;
+    bool canTime = numIters > 0;
+    std::vector<int> localRanks;
+    for (int localRank = 0; localRank < this->deviceIds.size(); ++localRank)
+    {
+      localRanks.push_back(localRank);
+      for (auto const& collArg : this->collArgs[groupId][localRank])
+        canTime &= !collArg.userRegistered;
+    }
+
+    if (canTime)
+    {
+      for (int iter = 0; iter < numWarmups; ++iter)
+        CHECK_CALL(IssueGroup(groupId, localRanks, false));
+
+      // Every stream of the group is timed, the slowest one bounds the group
+      std::vector<hipEvent_t> startEvents, stopEvents;
+      for (int localRank : localRanks)
+      {
+        CHECK_HIP(hipSetDevice(this->deviceIds[localRank]));
+        for (int i = 0; i < this->numStreamsPerGroup[groupId]; i++)
+        {
+          hipEvent_t start, stop;
+          CHECK_HIP(hipEventCreate(&start));
+          CHECK_HIP(hipEventCreate(&stop));
+          CHECK_HIP(hipEventRecord(start, this->streams[groupId][localRank][i]));
+          startEvents.push_back(start);
+          stopEvents.push_back(stop);
+        }
+      }
+      for (int iter = 0; iter < numIters; ++iter)
+        CHECK_CALL(IssueGroup(groupId, localRanks, false));
+      int eventIdx = 0;
+      for (int localRank : localRanks)
+      {
+        CHECK_HIP(hipSetDevice(this->deviceIds[localRank]));
+        for (int i = 0; i < this->numStreamsPerGroup[groupId]; i++, eventIdx++)
+          CHECK_HIP(hipEventRecord(stopEvents[eventIdx], this->streams[groupId][localRank][i]));
+      }
+      for (int i = 0; i < stopEvents.size(); i++)
+      {
+        float ms;
+        CHECK_HIP(hipEventSynchronize(stopEvents[i]));
+        CHECK_HIP(hipEventElapsedTime(&ms, startEvents[i], stopEvents[i]));
+        usPerIter = std::max(usPerIter, ms * 1000.0 / numIters);
+        CHECK_HIP(hipEventDestroy(startEvents[i]));
+        CHECK_HIP(hipEventDestroy(stopEvents[i]));
+      }
+    }
+    write(childWriteFd, &usPerIter, sizeof(usPerIter));
+
+    if (this->verbose) INFO("Child %d finishes TimeCollectives() with %.2f us per iteration\n", this->childId, usPerIter);
+    return TEST_SUCCESS;
+  }
+
   ErrCode TestBedChild::ValidateResults()
   {
     // Read values sent by parent [see TestBed::ValidateResults()]
@@ -33,7 +33,8 @@ namespace RcclUnitTesting
       CHILD_DESTROY_COMMS    = 9,  // DestroyComms()
       CHILD_DESTROY_GRAPHS   = 10, // DestroyGraphs()
       CHILD_STOP             = 11, // Stop()
-      NUM_CHILD_COMMANDS     = 12
+      CHILD_TIME_COLL        = 12, // MeasureCollectives()
+      NUM_CHILD_COMMANDS     = 13
     };
 
     char const ChildCommandNames[NUM_CHILD_COMMANDS][20] =
@@ -49,7 +50,8 @@ namespace RcclUnitTesting
       "DEALLOCATE_MEM",
       "DESTROY_COMMS",
       "DESTROY_GRAPHS",
-      "STOP"
+      "STOP",
+      "TIME_COLL"
     };
 
     // These variables remain constant for life of TestBedChild
@@ -70,6 +72,7 @@ namespace RcclUnitTesting
     int rankOffset;                                                   // Global rank offset for this child
     int numGroupCalls;                                                // Toatal # of group calls to be executed
     bool useBlocking;                                                 // RCCL communication with blocking or non-blocking option
+    bool useUngroupedCalls;                                           // Issue a lone collective outside of a group call
     std::vector<int> numCollectivesInGroup;                           // # of collectives to run per group call
     std::vector<int> numStreamsPerGroup;                              // # of different streams allowed per group call
     std::vector<ncclComm_t> comms;                                    // RCCL communicators for each rank
@@ -108,6 +111,12 @@ namespace RcclUnitTesting
     // Execute a group of collectives
     ErrCode ExecuteCollectives();
 
+    // Issue the collectives of a group for the given local ranks, without waiting for them
+    ErrCode IssueGroup(int const groupId, std::vector<int> const& localRanksToExecute, bool const useHipGraph);
+
+    // Time repeated executions of a group of collectives with hipEvents
+    ErrCode TimeCollectives();
+
     // Validate that output matches expected
     ErrCode ValidateResults();
 
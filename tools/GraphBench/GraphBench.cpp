@@ -20,9 +20,15 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
 #include <string>
+#include <sstream>
+#include <vector>
 #include <chrono>
 #include <hip/hip_runtime.h>
 #include <rccl/rccl.h>
@@ -49,174 +55,389 @@ THE SOFTWARE.
     }                                                                   \
   } while (0)
 
-int main(int argc, char **argv)
+// Graph-captured collective benchmark
+//
+// Sweeps collectives, sizes, channel counts and number of streams captured together in one
+// graph per rank, and reports the cost of each phase of the graph lifecycle:
+// - Capture:     stream capture of the ncclGroupStart/End block (builds persistent plans)
+// - Instantiate: hipGraphInstantiate
+// - Upload:      first launch of the instantiated graph
+// - Graph:       average replay latency, against NoGraph, the same calls launched eagerly
+// - Destroy:     hipGraphExecDestroy/hipGraphDestroy, which runs the graph destructors
+//                RCCL registered to release its persistent plans
+//
+// Configuration is read from environment variables:
+//   COLLS          Comma-separated list of AllReduce,AllGather,ReduceScatter,Broadcast,Reduce,AllToAll,SendRecv
+//   MIN_BYTES      Smallest per-rank buffer size                    (default: 4)
+//   MAX_BYTES      Largest per-rank buffer size                     (default: 64MB)
+//   STEP_FACTOR    Size multiplier between two steps                (default: 2)
+//   NUM_CHANNELS   Comma-separated channel counts, 0 for default    (default: 0)
+//   NUM_STREAMS    Comma-separated streams captured per rank        (default: 1)
+//   OPS_PER_STREAM Collectives enqueued on each stream              (default: 1)
+//   NUM_ITERATIONS / NUM_WARMUPS                                    (default: 20 / 3)
+//   CHECK          Validate AllReduce results                       (default: 1)
+//   CSV_FILE       Also write every result to this file
+
+enum CollType
 {
-  int nranks;
-  HIP_CALL(hipGetDeviceCount(&nranks));
+  CollAllReduce = 0,
+  CollAllGather,
+  CollReduceScatter,
+  CollBroadcast,
+  CollReduce,
+  CollAllToAll,
+  CollSendRecv,
+  NumCollTypes
+};
 
-  // Initialize communicators for each rank
-  ncclComm_t comm[nranks];
-  NCCL_CALL(ncclCommInitAll(comm, nranks, NULL));
+char const* collNames[NumCollTypes] =
+{
+  "AllReduce", "AllGather", "ReduceScatter", "Broadcast", "Reduce", "AllToAll", "SendRecv"
+};
+
+struct RankResources
+{
+  std::vector<hipStream_t> streams;
+  std::vector<int*>        sendbuf;
+  std::vector<int*>        recvbuf;
+  hipEvent_t               forkEvent;
+  std::vector<hipEvent_t>  joinEvents;
+};
 
-  // Allocate GPU resources
-  hipStream_t stream[nranks];
-  int* iputCpu[nranks];
-  int* iputGpu[nranks];
-  int* oputGpu[nranks];
-  int* oputCpu[nranks];
-  int* pattern;
-  int* expected;
+std::vector<std::string> SplitList(char const* str)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) if (!item.empty()) items.push_back(item);
+  return items;
+}
 
-  int maxN = (1<<24);
+std::vector<int> GetIntList(char const* name, char const* defaultStr)
+{
+  std::vector<int> values;
+  for (auto const& item : SplitList(getenv(name) ? getenv(name) : defaultStr))
+    values.push_back(atoi(item.c_str()));
+  return values;
+}
 
-  expected = (int*)calloc(maxN, sizeof(int));
+size_t GetSize(char const* name, size_t defaultVal)
+{
+  char const* str = getenv(name);
+  if (!str) return defaultVal;
+  char* end;
+  size_t val = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'G': case 'g': val <<= 30; break;
+  case 'M': case 'm': val <<= 20; break;
+  case 'K': case 'k': val <<= 10; break;
+  }
+  return val;
+}
+
+// Collectives that split the buffer between ranks need at least one element per rank
+bool IsSupportedSize(CollType coll, size_t numBytes, int nranks)
+{
+  size_t count = numBytes / sizeof(int);
+  if (count == 0) return false;
+  if (coll == CollAllGather || coll == CollReduceScatter || coll == CollAllToAll)
+    return count >= (size_t)nranks;
+  return true;
+}
+
+// numBytes is the size of each rank's buffers, as in rccl-tests
+void EnqueueColl(CollType coll, int rank, int nranks, size_t numBytes,
+                 int* sendbuf, int* recvbuf, ncclComm_t comm, hipStream_t stream)
+{
+  size_t count = numBytes / sizeof(int);
+  switch (coll) {
+  case CollAllReduce:
+    NCCL_CALL(ncclAllReduce(sendbuf, recvbuf, count, ncclInt, ncclSum, comm, stream));
+    break;
+  case CollAllGather:
+    NCCL_CALL(ncclAllGather(sendbuf, recvbuf, count / nranks, ncclInt, comm, stream));
+    break;
+  case CollReduceScatter:
+    NCCL_CALL(ncclReduceScatter(sendbuf, recvbuf, count / nranks, ncclInt, ncclSum, comm, stream));
+    break;
+  case CollBroadcast:
+    NCCL_CALL(ncclBroadcast(sendbuf, recvbuf, count, ncclInt, 0, comm, stream));
+    break;
+  case CollReduce:
+    NCCL_CALL(ncclReduce(sendbuf, recvbuf, count, ncclInt, ncclSum, 0, comm, stream));
+    break;
+  case CollAllToAll:
+    NCCL_CALL(ncclAllToAll(sendbuf, recvbuf, count / nranks, ncclInt, comm, stream));
+    break;
+  case CollSendRecv:
+    NCCL_CALL(ncclSend(sendbuf, count, ncclInt, (rank + 1) % nranks, comm, stream));
+    NCCL_CALL(ncclRecv(recvbuf, count, ncclInt, (rank + nranks - 1) % nranks, comm, stream));
+    break;
+  default:
+    break;
+  }
+}
+
+// All the collectives of one step, every rank and every stream in a single group
+void EnqueueAll(CollType coll, size_t numBytes, int numStreams, int opsPerStream,
+                std::vector<ncclComm_t>& comms, std::vector<RankResources>& res)
+{
+  int nranks = comms.size();
+  NCCL_CALL(ncclGroupStart());
   for (int r = 0; r < nranks; r++)
   {
     HIP_CALL(hipSetDevice(r));
-    HIP_CALL(hipStreamCreate(&stream[r]));
-    HIP_CALL(hipMalloc((void **)&iputGpu[r], maxN * sizeof(int)));
-    HIP_CALL(hipMalloc((void **)&oputGpu[r], maxN * sizeof(int)));
+    for (int s = 0; s < numStreams; s++)
+      for (int op = 0; op < opsPerStream; op++)
+        EnqueueColl(coll, r, nranks, numBytes, res[r].sendbuf[s], res[r].recvbuf[s], comms[r], res[r].streams[s]);
+  }
+  NCCL_CALL(ncclGroupEnd());
+}
 
-    iputCpu[r] = (int*) malloc(maxN * sizeof(int));
-    oputCpu[r] = (int*) malloc(maxN * sizeof(int));
-    pattern    = (int*) malloc(maxN * sizeof(int));
+void SyncAll(int numStreams, std::vector<RankResources>& res)
+{
+  for (int r = 0; r < (int)res.size(); r++)
+    for (int s = 0; s < numStreams; s++)
+      HIP_CALL(hipStreamSynchronize(res[r].streams[s]));
+}
 
-    for (int i = 0; i < maxN; i++)
-    {
-      iputCpu[r][i] = (r * 235 + i) % 2057;
-      oputCpu[r][i] = 0;
-      expected[i] += iputCpu[r][i];
+double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+{
+  auto delta = std::chrono::high_resolution_clock::now() - start;
+  return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(delta).count();
+}
 
-      pattern[i] = -1 - i;
+bool CheckAllReduce(size_t numBytes, int numStreams, std::vector<RankResources>& res,
+                    std::vector<int> const& expected, std::vector<int>& output)
+{
+  size_t count = numBytes / sizeof(int);
+  for (int r = 0; r < (int)res.size(); r++)
+  {
+    for (int s = 0; s < numStreams; s++)
+    {
+      HIP_CALL(hipMemcpy(output.data(), res[r].recvbuf[s], numBytes, hipMemcpyDeviceToHost));
+      for (size_t i = 0; i < count; i++)
+      {
+        if (output[i] != expected[i])
+        {
+          printf("\nERROR: Rank %d stream %d expected %d output %d at index %zu\n", r, s, expected[i], output[i], i);
+          return false;
+        }
+      }
+      HIP_CALL(hipMemset(res[r].recvbuf[s], 0xff, numBytes));
     }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  int nranks;
+  HIP_CALL(hipGetDeviceCount(&nranks));
 
-    HIP_CALL(hipMemcpy(iputGpu[r], iputCpu[r], maxN * sizeof(int), hipMemcpyHostToDevice));
-    HIP_CALL(hipMemcpy(oputGpu[r], oputCpu[r], maxN * sizeof(int), hipMemcpyHostToDevice));
+  std::vector<CollType> colls;
+  for (auto const& name : SplitList(getenv("COLLS") ? getenv("COLLS") : "AllReduce"))
+  {
+    int c = 0;
+    while (c < NumCollTypes && strcasecmp(name.c_str(), collNames[c])) c++;
+    if (c == NumCollTypes)
+    {
+      printf("[ERROR] Unknown collective %s\n", name.c_str());
+      exit(1);
+    }
+    colls.push_back((CollType)c);
   }
+  size_t           minBytes      = GetSize("MIN_BYTES", 4);
+  size_t           maxBytes      = GetSize("MAX_BYTES", 64 << 20);
+  int              stepFactor    = std::max(2, (int)GetSize("STEP_FACTOR", 2));
+  std::vector<int> channelCounts = GetIntList("NUM_CHANNELS", "0");
+  std::vector<int> streamCounts  = GetIntList("NUM_STREAMS", "1");
+  int              opsPerStream  = std::max(1, (int)GetSize("OPS_PER_STREAM", 1));
+  int              numIterations = std::max(1, (int)GetSize("NUM_ITERATIONS", 20));
+  int              numWarmups    = GetSize("NUM_WARMUPS", 3);
+  int              check         = GetSize("CHECK", 1);
+  char const*      csvFile       = getenv("CSV_FILE");
 
-  int numWarmups    = 3;
-  int numIterations = 5;
+  int maxStreams = 1;
+  for (int n : streamCounts) maxStreams = std::max(maxStreams, n);
 
-  hipGraph_t graphs[nranks];
-  hipGraphExec_t graphExec[nranks];
+  printf("Running on %d GPUs: sizes %zu to %zu bytes (x%d), %d op(s) per stream, %d iterations (%d warmups)\n",
+         nranks, minBytes, maxBytes, stepFactor, opsPerStream, numIterations, numWarmups);
+
+  // Allocate GPU resources, one pair of buffers per stream
+  size_t maxCount = maxBytes / sizeof(int);
+  std::vector<int> input(maxCount), expected(maxCount, 0), output(maxCount);
+  std::vector<RankResources> res(nranks);
+  for (int r = 0; r < nranks; r++)
+  {
+    HIP_CALL(hipSetDevice(r));
+    for (size_t i = 0; i < maxCount; i++)
+    {
+      input[i] = (r * 235 + i) % 2057;
+      expected[i] += input[i];
+    }
+    res[r].streams.resize(maxStreams);
+    res[r].sendbuf.resize(maxStreams);
+    res[r].recvbuf.resize(maxStreams);
+    res[r].joinEvents.resize(maxStreams);
+    HIP_CALL(hipEventCreateWithFlags(&res[r].forkEvent, hipEventDisableTiming));
+    for (int s = 0; s < maxStreams; s++)
+    {
+      HIP_CALL(hipStreamCreate(&res[r].streams[s]));
+      HIP_CALL(hipEventCreateWithFlags(&res[r].joinEvents[s], hipEventDisableTiming));
+      HIP_CALL(hipMalloc((void **)&res[r].sendbuf[s], maxBytes));
+      HIP_CALL(hipMalloc((void **)&res[r].recvbuf[s], maxBytes));
+      HIP_CALL(hipMemcpy(res[r].sendbuf[s], input.data(), maxBytes, hipMemcpyHostToDevice));
+      HIP_CALL(hipMemset(res[r].recvbuf[s], 0xff, maxBytes));
+    }
+  }
 
-  printf("%12s", "NumBytes");
-  for (int usingGraphs = 0; usingGraphs <= 1; usingGraphs++)
+  FILE* csv = csvFile ? fopen(csvFile, "w") : NULL;
+  if (csvFile && !csv)
   {
-    printf("%12s", "Setup");
-    for (int i = 1; i <= numIterations; ++i)
-      printf("%11s%d", usingGraphs ? "Graph" : "NoGraph", i);
-    printf("%12s", "Avg");
+    printf("[ERROR] Unable to open %s\n", csvFile);
+    exit(1);
   }
-  printf("%12s\n", "Speedup");
+  if (csv) fprintf(csv, "collective,bytes,channels,streams,opsPerStream,captureMs,instantiateMs,uploadMs,graphUs,noGraphUs,speedup,destroyMs\n");
+
+  std::vector<hipGraph_t>     graphs(nranks);
+  std::vector<hipGraphExec_t> graphExec(nranks);
+  std::vector<ncclComm_t>     comms(nranks);
 
-  for (int N = 1; N <= maxN; N *= 2)
+  for (int numChannels : channelCounts)
   {
-    printf("%12lu", N * sizeof(int));
+    // Channel counts are a property of the communicator
+    ncclUniqueId id;
+    ncclConfig_t config = NCCL_CONFIG_INITIALIZER;
+    if (numChannels > 0) config.minCTAs = config.maxCTAs = numChannels;
+    NCCL_CALL(ncclGetUniqueId(&id));
+    NCCL_CALL(ncclGroupStart());
+    for (int r = 0; r < nranks; r++)
+    {
+      HIP_CALL(hipSetDevice(r));
+      NCCL_CALL(ncclCommInitRankConfig(&comms[r], nranks, id, r, &config));
+    }
+    NCCL_CALL(ncclGroupEnd());
 
-    double average[2] = {};
-    for (int usingGraphs = 0; usingGraphs <= 1; usingGraphs++)
+    for (CollType coll : colls)
     {
-      auto setupStart = std::chrono::high_resolution_clock::now();
-      if (usingGraphs)
+      for (int numStreams : streamCounts)
       {
-        for (int r = 0; r < nranks; ++r)
-        {
-          HIP_CALL(hipSetDevice(r));
-          HIP_CALL(hipStreamBeginCapture(stream[r], hipStreamCaptureModeThreadLocal));
-        }
+        numStreams = std::max(1, numStreams);
+        printf("\n%s, channels %s, %d stream(s) per rank\n", collNames[coll],
+               numChannels > 0 ? std::to_string(numChannels).c_str() : "default", numStreams);
+        printf("%12s %12s %12s %12s %12s %12s %12s %12s\n", "NumBytes", "Capture(ms)", "Instant(ms)",
+               "Upload(ms)", "Graph(us)", "NoGraph(us)", "Speedup", "Destroy(ms)");
 
-        NCCL_CALL(ncclGroupStart());
-        for (int r = 0; r < nranks; ++r)
+        for (size_t numBytes = minBytes; numBytes <= maxBytes; numBytes *= stepFactor)
         {
-          HIP_CALL(hipSetDevice(r));
-          NCCL_CALL(ncclAllReduce(iputGpu[r], oputGpu[r], N, ncclInt, ncclSum, comm[r], stream[r]));
-        }
-        NCCL_CALL(ncclGroupEnd());
+          if (!IsSupportedSize(coll, numBytes, nranks)) continue;
+          bool checkResults = check && coll == CollAllReduce;
 
-        for (int r = 0; r < nranks; ++r)
-        {
-          //HIP_CALL(hipSetDevice(r));
-          HIP_CALL(hipStreamEndCapture(stream[r], &graphs[r]));
-        }
-
-        // Instantiating graphs
-        for (int r = 0; r < nranks; ++r)
-        {
-          HIP_CALL(hipSetDevice(r));
-          HIP_CALL(hipGraphInstantiate(&graphExec[r], graphs[r], NULL, NULL, 0));
-        }
-      }
-      auto setupDelta = std::chrono::high_resolution_clock::now() - setupStart;
-      double setupTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(setupDelta).count();
-      printf("%12.3f", setupTime);
-
-      // Perform iterations
-      average[usingGraphs] = 0;
-      for (int iteration = -numWarmups; iteration < numIterations; ++iteration)
-      {
-        auto cpuStart = std::chrono::high_resolution_clock::now();
-        if (usingGraphs)
-        {
-          for (int r = 0; r < nranks; r++)
+          // Capture all streams of a rank into one graph: the extra streams fork from and join
+          // back into the first one
+          auto start = std::chrono::high_resolution_clock::now();
+          for (int r = 0; r < nranks; ++r)
           {
             HIP_CALL(hipSetDevice(r));
-            HIP_CALL(hipGraphLaunch(graphExec[r], stream[r]));
+            HIP_CALL(hipStreamBeginCapture(res[r].streams[0], hipStreamCaptureModeThreadLocal));
+            HIP_CALL(hipEventRecord(res[r].forkEvent, res[r].streams[0]));
+            for (int s = 1; s < numStreams; s++)
+              HIP_CALL(hipStreamWaitEvent(res[r].streams[s], res[r].forkEvent, 0));
           }
-        }
-        else
-        {
-          NCCL_CALL(ncclGroupStart());
+          EnqueueAll(coll, numBytes, numStreams, opsPerStream, comms, res);
           for (int r = 0; r < nranks; ++r)
           {
             HIP_CALL(hipSetDevice(r));
-            NCCL_CALL(ncclAllReduce(iputGpu[r], oputGpu[r], N, ncclInt, ncclSum, comm[r], stream[r]));
+            for (int s = 1; s < numStreams; s++)
+            {
+              HIP_CALL(hipEventRecord(res[r].joinEvents[s], res[r].streams[s]));
+              HIP_CALL(hipStreamWaitEvent(res[r].streams[0], res[r].joinEvents[s], 0));
+            }
+            HIP_CALL(hipStreamEndCapture(res[r].streams[0], &graphs[r]));
           }
-          NCCL_CALL(ncclGroupEnd());
-        }
+          double captureMs = ElapsedMs(start);
 
-        for (int r = 0; r < nranks; r++)
-          HIP_CALL(hipStreamSynchronize(stream[r]));
+          start = std::chrono::high_resolution_clock::now();
+          for (int r = 0; r < nranks; ++r)
+          {
+            HIP_CALL(hipSetDevice(r));
+            HIP_CALL(hipGraphInstantiate(&graphExec[r], graphs[r], NULL, NULL, 0));
+          }
+          double instantiateMs = ElapsedMs(start);
 
-        auto cpuDelta = std::chrono::high_resolution_clock::now() - cpuStart;
-        double iterationTime = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(cpuDelta).count();
+          start = std::chrono::high_resolution_clock::now();
+          for (int r = 0; r < nranks; ++r)
+          {
+            HIP_CALL(hipSetDevice(r));
+            HIP_CALL(hipGraphLaunch(graphExec[r], res[r].streams[0]));
+          }
+          SyncAll(1, res);
+          double uploadMs = ElapsedMs(start);
 
-        // Check result and reset
-        bool isCorrect = true;
-        for (int r = 0; r < nranks && isCorrect; r++)
-        {
-          HIP_CALL(hipMemcpy(oputCpu[r], oputGpu[r], N * sizeof(int), hipMemcpyDeviceToHost));
-          for (int i = 0; i < N; i++)
+          // Replay latency
+          double graphUs = 0;
+          for (int iteration = -numWarmups; iteration < numIterations; ++iteration)
           {
-            if (oputCpu[r][i] != expected[i])
+            start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < nranks; r++)
             {
-              isCorrect = false;
-              printf("ERROR: Expected: %d Output %d at Index %d\n", expected[i], oputCpu[r][i], i);
-              exit(1);
+              HIP_CALL(hipSetDevice(r));
+              HIP_CALL(hipGraphLaunch(graphExec[r], res[r].streams[0]));
             }
+            SyncAll(1, res);
+            if (iteration >= 0) graphUs += ElapsedMs(start) * 1000.0;
           }
-          // Fill output with input for testing reasons
-          HIP_CALL(hipMemcpy(oputGpu[r], pattern, N * sizeof(int), hipMemcpyHostToDevice));
-        }
+          graphUs /= numIterations;
+          if (checkResults && !CheckAllReduce(numBytes, numStreams, res, expected, output)) exit(1);
 
-        if (iteration >= 0)
-        {
-          printf("%12.3f", iterationTime); fflush(stdout);
-          average[usingGraphs] += iterationTime;
+          start = std::chrono::high_resolution_clock::now();
+          for (int r = 0; r < nranks; r++)
+          {
+            HIP_CALL(hipSetDevice(r));
+            HIP_CALL(hipGraphExecDestroy(graphExec[r]));
+            HIP_CALL(hipGraphDestroy(graphs[r]));
+          }
+          double destroyMs = ElapsedMs(start);
+
+          // Same calls launched eagerly
+          double noGraphUs = 0;
+          for (int iteration = -numWarmups; iteration < numIterations; ++iteration)
+          {
+            start = std::chrono::high_resolution_clock::now();
+            EnqueueAll(coll, numBytes, numStreams, opsPerStream, comms, res);
+            SyncAll(numStreams, res);
+            if (iteration >= 0) noGraphUs += ElapsedMs(start) * 1000.0;
+          }
+          noGraphUs /= numIterations;
+          if (checkResults && !CheckAllReduce(numBytes, numStreams, res, expected, output)) exit(1);
+
+          printf("%12zu %12.3f %12.3f %12.3f %12.2f %12.2f %12.3f %12.3f\n", numBytes, captureMs, instantiateMs,
+                 uploadMs, graphUs, noGraphUs, noGraphUs / graphUs, destroyMs);
+          fflush(stdout);
+          if (csv)
+            fprintf(csv, "%s,%zu,%d,%d,%d,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f,%.3f\n", collNames[coll], numBytes, numChannels,
+                    numStreams, opsPerStream, captureMs, instantiateMs, uploadMs, graphUs, noGraphUs, noGraphUs / graphUs, destroyMs);
         }
       }
-      average[usingGraphs] /= numIterations;
-      printf("%12.3f", average[usingGraphs]);
+    }
 
-      for (int r = 0; r < nranks; r++)
-      {
-        HIP_CALL(hipSetDevice(r));
-        HIP_CALL(hipGraphDestroy(graphs[r]));
-        HIP_CALL(hipGraphExecDestroy(graphExec[r]));
-      }
+    for (int r = 0; r < nranks; r++)
+      NCCL_CALL(ncclCommDestroy(comms[r]));
+  }
+  if (csv) fclose(csv);
+
+  for (int r = 0; r < nranks; r++)
+  {
+    HIP_CALL(hipSetDevice(r));
+    HIP_CALL(hipEventDestroy(res[r].forkEvent));
+    for (int s = 0; s < maxStreams; s++)
+    {
+      HIP_CALL(hipEventDestroy(res[r].joinEvents[s]));
+      HIP_CALL(hipStreamDestroy(res[r].streams[s]));
+      HIP_CALL(hipFree(res[r].sendbuf[s]));
+      HIP_CALL(hipFree(res[r].recvbuf[s]));
     }
-    printf("%12.3f\n", average[0] / average[1]);
-    fflush(stdout);
   }
   return 0;
 }
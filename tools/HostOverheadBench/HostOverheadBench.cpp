@@ -0,0 +1,326 @@
+/*
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <strings.h>
+#include <chrono>
+#include <pthread.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+// Host overhead benchmark for the enqueue path
+//
+// Each thread drives one rank of a single-process communicator and issues a large number of
+// tiny operations, so that the time is dominated by the host side of RCCL rather than by the
+// GPU. It reports the wall time per operation and, with RCCL_STATS_HOST_TIME=1 (set by
+// default), where the library spent it according to ncclCommGetStats:
+// - Append: argument checks and task append inside the API call
+// - Plan:   ncclLaunchPrepare, scheduling the tasks of a group into kernel plans
+// - Upload: writing the work of a plan to the work fifo
+// - Launch: kernel launch, proxy posting and launch finish
+// Phase times are per operation and averaged over the threads.
+//
+// Configuration is read from environment variables:
+//   NUM_THREADS    Comma-separated thread (rank) counts, capped to the GPU count (default: 1,2,4,8)
+//   MODES          Comma-separated list of:                                     (default: allreduce,grouped,sendrecv)
+//                    allreduce  one ungrouped 1-element AllReduce per call
+//                    grouped    BATCH 1-element AllReduces per ncclGroupStart/End
+//                    sendrecv   BATCH send/recv pairs with both ring neighbors per group
+//   NUM_OPS        Operations issued per thread                                 (default: 1000000)
+//   BATCH          Operations per group in grouped and sendrecv modes           (default: 16)
+//   SYNC_INTERVAL  Operations between two stream synchronizations               (default: 1024)
+//   NUM_WARMUPS    Operations issued before timing                              (default: 1000)
+//   CSV_FILE       Also write every result to this file
+
+enum BenchMode
+{
+  ModeAllReduce = 0,
+  ModeGrouped,
+  ModeSendRecv,
+  NumModes
+};
+
+char const* modeNames[NumModes] = { "allreduce", "grouped", "sendrecv" };
+char const* phaseNames[NCCL_STATS_HOST_PHASES] = { "Append", "Plan", "Upload", "Launch" };
+
+struct ThreadArgs
+{
+  int                rank;
+  int                nranks;
+  ncclComm_t         comm;
+  hipStream_t        stream;
+  float*             sendbuf;
+  float*             recvbuf;
+  BenchMode          mode;
+  long               numOps;
+  int                batch;
+  int                syncInterval;
+  long               numWarmups;
+  pthread_barrier_t* barrier;
+  double             elapsedNs;
+  ncclCommStats_t    before;
+  ncclCommStats_t    after;
+};
+
+std::vector<std::string> SplitList(char const* str)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) if (!item.empty()) items.push_back(item);
+  return items;
+}
+
+long GetLong(char const* name, long defaultVal)
+{
+  char const* str = getenv(name);
+  return str ? atol(str) : defaultVal;
+}
+
+// Issues numOps operations, returns the number actually issued (a multiple of the batch)
+long IssueOps(ThreadArgs* args, long numOps)
+{
+  int  prev   = (args->rank + args->nranks - 1) % args->nranks;
+  int  next   = (args->rank + 1) % args->nranks;
+  int  batch  = args->mode == ModeAllReduce ? 1 : args->batch;
+  long issued = 0;
+  long sinceSync = 0;
+  while (issued < numOps)
+  {
+    switch (args->mode) {
+    case ModeAllReduce:
+      NCCL_CALL(ncclAllReduce(args->sendbuf, args->recvbuf, 1, ncclFloat, ncclSum, args->comm, args->stream));
+      break;
+    case ModeGrouped:
+      NCCL_CALL(ncclGroupStart());
+      for (int i = 0; i < batch; i++)
+        NCCL_CALL(ncclAllReduce(args->sendbuf + i, args->recvbuf + i, 1, ncclFloat, ncclSum, args->comm, args->stream));
+      NCCL_CALL(ncclGroupEnd());
+      break;
+    case ModeSendRecv:
+      // Each op is one send/recv pair; both directions so that every rank sees the same traffic
+      NCCL_CALL(ncclGroupStart());
+      for (int i = 0; i < batch; i++)
+      {
+        int peer = i % 2 ? prev : next;
+        int from = i % 2 ? next : prev;
+        NCCL_CALL(ncclSend(args->sendbuf + i, 1, ncclFloat, peer, args->comm, args->stream));
+        NCCL_CALL(ncclRecv(args->recvbuf + i, 1, ncclFloat, from, args->comm, args->stream));
+      }
+      NCCL_CALL(ncclGroupEnd());
+      break;
+    default:
+      break;
+    }
+    issued += batch;
+    sinceSync += batch;
+    // Bound the amount of queued work so that the work fifo never fills up
+    if (sinceSync >= args->syncInterval)
+    {
+      HIP_CALL(hipStreamSynchronize(args->stream));
+      sinceSync = 0;
+    }
+  }
+  HIP_CALL(hipStreamSynchronize(args->stream));
+  return issued;
+}
+
+void* BenchThread(void* ptr)
+{
+  ThreadArgs* args = (ThreadArgs*)ptr;
+  HIP_CALL(hipSetDevice(args->rank));
+  IssueOps(args, args->numWarmups);
+
+  args->before.size = sizeof(ncclCommStats_t);
+  NCCL_CALL(ncclCommGetStats(args->comm, &args->before));
+  pthread_barrier_wait(args->barrier);
+  auto start = std::chrono::high_resolution_clock::now();
+  args->numOps = IssueOps(args, args->numOps);
+  auto delta = std::chrono::high_resolution_clock::now() - start;
+  args->elapsedNs = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(delta).count();
+  args->after.size = sizeof(ncclCommStats_t);
+  NCCL_CALL(ncclCommGetStats(args->comm, &args->after));
+  pthread_barrier_wait(args->barrier);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  // Must be set before the first communicator reads it
+  setenv("RCCL_STATS_HOST_TIME", "1", 0);
+
+  int numDevices;
+  HIP_CALL(hipGetDeviceCount(&numDevices));
+
+  std::vector<int> threadCounts;
+  for (auto const& item : SplitList(getenv("NUM_THREADS") ? getenv("NUM_THREADS") : "1,2,4,8"))
+  {
+    int n = atoi(item.c_str());
+    if (n < 1) continue;
+    if (n > numDevices)
+    {
+      printf("[WARN] Skipping %d threads, only %d GPUs available\n", n, numDevices);
+      continue;
+    }
+    threadCounts.push_back(n);
+  }
+  std::vector<BenchMode> modes;
+  for (auto const& name : SplitList(getenv("MODES") ? getenv("MODES") : "allreduce,grouped,sendrecv"))
+  {
+    int m = 0;
+    while (m < NumModes && strcasecmp(name.c_str(), modeNames[m])) m++;
+    if (m == NumModes)
+    {
+      printf("[ERROR] Unknown mode %s\n", name.c_str());
+      exit(1);
+    }
+    modes.push_back((BenchMode)m);
+  }
+  long        numOps       = std::max(1L, GetLong("NUM_OPS", 1000000));
+  int         batch        = std::max(1L, GetLong("BATCH", 16));
+  int         syncInterval = std::max(1L, GetLong("SYNC_INTERVAL", 1024));
+  long        numWarmups   = std::max(0L, GetLong("NUM_WARMUPS", 1000));
+  char const* csvFile      = getenv("CSV_FILE");
+
+  FILE* csv = csvFile ? fopen(csvFile, "w") : NULL;
+  if (csvFile && !csv)
+  {
+    printf("[ERROR] Unable to open %s\n", csvFile);
+    exit(1);
+  }
+  if (csv) fprintf(csv, "mode,threads,batch,opsPerThread,opsPerSec,apiNsPerOp,appendNsPerOp,planNsPerOp,uploadNsPerOp,launchNsPerOp,opsPerLaunch,fifoStalls\n");
+
+  printf("%ld op(s) per thread, batch %d, sync every %d op(s), %ld warmup op(s), host phase timing %s\n",
+         numOps, batch, syncInterval, numWarmups, strcmp(getenv("RCCL_STATS_HOST_TIME"), "0") ? "on" : "off");
+  printf("%10s %8s %12s %12s %10s %10s %10s %10s %10s %10s\n", "Mode", "Threads", "Mops/s", "API(ns/op)",
+         phaseNames[0], phaseNames[1], phaseNames[2], phaseNames[3], "Ops/kern", "FifoStall");
+
+  for (int nranks : threadCounts)
+  {
+    std::vector<ncclComm_t> comms(nranks);
+    std::vector<int> devs(nranks);
+    for (int r = 0; r < nranks; r++) devs[r] = r;
+    NCCL_CALL(ncclCommInitAll(comms.data(), nranks, devs.data()));
+
+    std::vector<ThreadArgs> args(nranks);
+    for (int r = 0; r < nranks; r++)
+    {
+      HIP_CALL(hipSetDevice(r));
+      HIP_CALL(hipStreamCreate(&args[r].stream));
+      HIP_CALL(hipMalloc((void **)&args[r].sendbuf, batch * sizeof(float)));
+      HIP_CALL(hipMalloc((void **)&args[r].recvbuf, batch * sizeof(float)));
+      HIP_CALL(hipMemset(args[r].sendbuf, 0, batch * sizeof(float)));
+    }
+
+    for (BenchMode mode : modes)
+    {
+      pthread_barrier_t barrier;
+      pthread_barrier_init(&barrier, NULL, nranks);
+      std::vector<pthread_t> threads(nranks);
+      for (int r = 0; r < nranks; r++)
+      {
+        args[r].rank         = r;
+        args[r].nranks       = nranks;
+        args[r].comm         = comms[r];
+        args[r].mode         = mode;
+        args[r].numOps       = numOps;
+        args[r].batch        = batch;
+        args[r].syncInterval = syncInterval;
+        args[r].numWarmups   = numWarmups;
+        args[r].barrier      = &barrier;
+        pthread_create(&threads[r], NULL, BenchThread, &args[r]);
+      }
+      for (int r = 0; r < nranks; r++) pthread_join(threads[r], NULL);
+      pthread_barrier_destroy(&barrier);
+
+      // Average over the threads; the slowest one bounds the aggregate rate
+      double elapsedNs = 0, apiNs = 0, phaseNs[NCCL_STATS_HOST_PHASES] = {};
+      double totalOps = 0, hostOps = 0, launches = 0, stalls = 0;
+      for (int r = 0; r < nranks; r++)
+      {
+        elapsedNs = std::max(elapsedNs, args[r].elapsedNs);
+        apiNs    += args[r].elapsedNs / args[r].numOps;
+        totalOps += args[r].numOps;
+        hostOps  += args[r].after.hostOps - args[r].before.hostOps;
+        launches += args[r].after.hostLaunches - args[r].before.hostLaunches;
+        stalls   += args[r].after.workFifoStalls - args[r].before.workFifoStalls;
+        for (int p = 0; p < NCCL_STATS_HOST_PHASES; p++)
+          phaseNs[p] += args[r].after.hostNs[p] - args[r].before.hostNs[p];
+      }
+      apiNs /= nranks;
+      // Send/recv ops count a send and a recv in hostOps
+      double opsPerHostOp = mode == ModeSendRecv ? 0.5 : 1.0;
+      for (int p = 0; p < NCCL_STATS_HOST_PHASES; p++)
+        phaseNs[p] = hostOps ? phaseNs[p] / (hostOps * opsPerHostOp) : 0;
+      double opsPerLaunch = launches ? hostOps * opsPerHostOp / launches : 0;
+      double mopsPerSec = totalOps / elapsedNs * 1e3;
+
+      printf("%10s %8d %12.3f %12.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.0f\n", modeNames[mode], nranks, mopsPerSec,
+             apiNs, phaseNs[0], phaseNs[1], phaseNs[2], phaseNs[3], opsPerLaunch, stalls);
+      fflush(stdout);
+      if (csv)
+        fprintf(csv, "%s,%d,%d,%ld,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f,%.0f\n", modeNames[mode], nranks,
+                mode == ModeAllReduce ? 1 : batch, args[0].numOps, mopsPerSec * 1e6, apiNs,
+                phaseNs[0], phaseNs[1], phaseNs[2], phaseNs[3], opsPerLaunch, stalls);
+    }
+
+    for (int r = 0; r < nranks; r++)
+    {
+      HIP_CALL(hipSetDevice(r));
+      HIP_CALL(hipStreamDestroy(args[r].stream));
+      HIP_CALL(hipFree(args[r].sendbuf));
+      HIP_CALL(hipFree(args[r].recvbuf));
+      NCCL_CALL(ncclCommDestroy(comms[r]));
+    }
+  }
+  if (csv) fclose(csv);
+  return 0;
+}
@@ -0,0 +1,399 @@
+/*
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Latency jitter of small RCCL collectives under CPU / OS noise.
+//
+// Every GPU runs the same small collective in a tight loop, one host thread (OMP) or
+// one process (MPI) per GPU, with a barrier before each iteration so that all ranks
+// launch together. Background threads spin on the CPU for NOISE_DUTY percent of every
+// millisecond, either wherever the OS puts them, on the NUMA node closest to the GPU
+// (where RCCL places its proxy threads), or on another NUMA node. Latency is measured
+// on the host from the call to the end of hipStreamSynchronize, and reported as
+// p50/p99/p99.9 per GPU together with a timeline of the first TIMELINE_ITERS iterations.
+//
+// Proxy placement and progress policy are selected with the usual RCCL environment
+// variables (RCCL_PROXY_PROGRESS_MODE, RCCL_PROXY_PROGRESS_PIN, ...), so that the same
+// noise can be replayed against each of them.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <numa.h>
+#include <omp.h>
+#include <unistd.h>
+#include <rccl/rccl.h>
+
+#include "Common.hpp"
+#include "Compatibility.hpp"
+#include "GetClosestNumaNode.hpp"
+#include "Timeline.hpp"
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+
+#define NCCL_CALL(cmd)                                                                  \
+    do {                                                                                \
+        ncclResult_t res = (cmd);                                                       \
+        if (res != ncclSuccess)                                                         \
+        {                                                                               \
+            std::cout << "Encountered RCCL error (" << ncclGetErrorString(res)          \
+                      << ") at line " << __LINE__ << " in file " << __FILE__ << "\n";   \
+            exit(-1);                                                                   \
+        }                                                                               \
+    } while (0)
+
+#define LOAD(VAR)       __atomic_load_n((VAR),         __ATOMIC_ACQUIRE)
+#define STORE(DST, SRC) __atomic_store_n((DST), (SRC), __ATOMIC_RELEASE)
+
+enum
+{
+  NOISE_ANYWHERE  = 0,  // Left to the OS scheduler
+  NOISE_CLOSEST   = 1,  // NUMA node closest to the GPU, shared with the proxy threads
+  NOISE_OTHER     = 2,  // Next NUMA node
+  NUM_PLACEMENTS  = 3
+} NoisePlacement;
+
+char const* placementNames[NUM_PLACEMENTS] = { "anywhere", "closest NUMA", "other NUMA" };
+
+enum
+{
+  COLL_ALLREDUCE     = 0,
+  COLL_ALLGATHER     = 1,
+  COLL_BROADCAST     = 2,
+  COLL_REDUCESCATTER = 3,
+  NUM_COLLS          = 4
+} Collectives;
+
+char const* collNames[NUM_COLLS] = { "AllReduce", "AllGather", "Broadcast", "ReduceScatter" };
+
+uint64_t NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SetNumaNode(int numaId)
+{
+  // Move CPU thread to targeted NUMA node
+  if (numa_run_on_node(numaId))
+  {
+    printf("[ERROR] Unable to migrate to NUMA node %d\n", numaId);
+    exit(1);
+  }
+
+  // Set memory to allocate on targeted NUMA node
+  numa_set_preferred(numaId);
+}
+
+// Spins for dutyPercent of every millisecond and sleeps for the rest
+void NoiseThread(int const numaId, int const dutyPercent, bool* abortThread)
+{
+  if (numaId >= 0) SetNumaNode(numaId);
+  uint64_t const periodNs = 1000000;
+  uint64_t const busyNs   = periodNs * std::min(std::max(dutyPercent, 0), 100) / 100;
+  volatile uint64_t sink  = 0;
+  while (!LOAD(abortThread))
+  {
+    uint64_t const start = NowNs();
+    while (NowNs() - start < busyNs) sink = sink + 1;
+    if (busyNs < periodNs) usleep((periodNs - busyNs) / 1000);
+  }
+}
+
+void RunCollective(int coll, void* sendBuff, void* recvBuff, size_t numBytes, ncclComm_t comm, hipStream_t stream)
+{
+  // Sizes are per rank for AllGather and ReduceScatter, they are totals for the others
+  size_t const count = numBytes / sizeof(float);
+  switch (coll)
+  {
+  case COLL_ALLREDUCE:     NCCL_CALL(ncclAllReduce(sendBuff, recvBuff, count, ncclFloat, ncclSum, comm, stream)); break;
+  case COLL_ALLGATHER:     NCCL_CALL(ncclAllGather(sendBuff, recvBuff, count, ncclFloat, comm, stream)); break;
+  case COLL_BROADCAST:     NCCL_CALL(ncclBroadcast(sendBuff, recvBuff, count, ncclFloat, 0, comm, stream)); break;
+  case COLL_REDUCESCATTER: NCCL_CALL(ncclReduceScatter(sendBuff, recvBuff, count, ncclFloat, ncclSum, comm, stream)); break;
+  }
+}
+
+double Percentile(std::vector<double> const& sorted, double p)
+{
+  if (sorted.empty()) return 0;
+  size_t idx = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+  return sorted[idx];
+}
+
+int main(int argc, char **argv)
+{
+  // Initialize MPI (if supported) and check for NUMA support
+#ifdef MPI_SUPPORT
+  MPI_Init(&argc, &argv);
+#endif
+  if (numa_available() == -1)
+  {
+    printf("[ERROR] NUMA library not supported. Check to see if libnuma has been installed on this system\n");
+    exit(1);
+  }
+
+  int numAvailableGpus;
+  HIP_CALL(hipGetDeviceCount(&numAvailableGpus));
+
+  // Figure out how many GPUs total / which GPU this process is responsible for
+  int numUsedGpus, numTotalGpus, rank;
+#ifdef MPI_SUPPORT
+  numUsedGpus = 1;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numTotalGpus);
+  if (numTotalGpus > numAvailableGpus)
+  {
+    if (rank == 0) printf("[ERROR] Machine only has %d devices but %d ranks requested\n", numAvailableGpus, numTotalGpus);
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  if (rank == 0)
+  {
+    printf("Running MPI version with %d ranks\n", numTotalGpus);
+  }
+#else
+  numUsedGpus = numTotalGpus = numAvailableGpus;
+  printf("Running OMP version with %d ranks\n", numTotalGpus);
+  rank = 0;
+#endif
+
+  // Collect arguments from commandline or environment variable
+  #define GETARG(IDX, STR, DEFAULT) \
+    (argc > IDX ? atoi(argv[IDX]) : (getenv(STR) ? atoi(getenv(STR)) : DEFAULT))
+
+  int  numBytes         = GETARG(1, "NUM_BYTES",            1024);
+  int  numNoiseThreads  = GETARG(2, "NUM_NOISE_THREADS",       0);
+  int  noisePlacement   = GETARG(3, "NOISE_PLACEMENT",         1);
+  int  noiseDuty        = GETARG(4, "NOISE_DUTY",            100);
+  int  useNuma          = GETARG(5, "USE_NUMA",                1);
+  int  numIterations    = GETARG(6, "NUM_ITERATIONS",      10000);
+  int  numWarmups       = GETARG(7, "NUM_WARMUPS",           100);
+  int  totalIterations  = numWarmups + numIterations;
+
+  int  verbose          = (getenv("VERBOSE"       ) ? atoi(getenv("VERBOSE"))        : 1);
+  int  coll             = (getenv("COLL"          ) ? atoi(getenv("COLL"))           : COLL_ALLREDUCE);
+  int  timelineIters    = (getenv("TIMELINE_ITERS") ? atoi(getenv("TIMELINE_ITERS")) : 200);
+
+  if (coll < 0 || coll >= NUM_COLLS || noisePlacement < 0 || noisePlacement >= NUM_PLACEMENTS || numBytes < (int)sizeof(float))
+  {
+    if (rank == 0) printf("[ERROR] COLL must be in [0,%d), NOISE_PLACEMENT in [0,%d) and NUM_BYTES at least %zu\n",
+                          NUM_COLLS, NUM_PLACEMENTS, sizeof(float));
+    exit(1);
+  }
+
+  // Print off configuration and machine information
+  if (rank == 0)
+  {
+    printf("COLL              = %8s\n", collNames[coll]);
+    printf("NUM_BYTES         = %8d\n", numBytes);
+    printf("NUM_NOISE_THREADS = %8d\n", numNoiseThreads);
+    printf("NOISE_PLACEMENT   = %8d (%s)\n", noisePlacement, placementNames[noisePlacement]);
+    printf("NOISE_DUTY        = %8d\n", noiseDuty);
+    printf("USE_NUMA          = %8d\n", useNuma);
+    printf("NUM_ITERATIONS    = %8d\n", numIterations);
+    printf("NUM_WARMUPS       = %8d\n", numWarmups);
+    printf("RCCL_PROXY_PROGRESS_MODE = %s\n", getenv("RCCL_PROXY_PROGRESS_MODE") ? getenv("RCCL_PROXY_PROGRESS_MODE") : "(default)");
+  }
+
+  char archName[100];
+  for (int i = 0; i < numUsedGpus; i++)
+  {
+    hipDeviceProp_t prop;
+    HIP_CALL(hipGetDeviceProperties(&prop, i + rank));
+    sscanf(prop.gcnArchName, "%[^:]", archName);
+    if (verbose) printf("GPU %02d: %s: Closest NUMA: %d\n", i + rank, archName, GetClosestNumaNode(i + rank));
+  }
+
+  // Start noise threads, spread over the GPUs of this process
+  bool abortNoiseThreads = false;
+  std::vector<std::thread> noiseThreads;
+  int const numNumaNodes = numa_num_configured_nodes();
+  for (int i = 0; i < numNoiseThreads; i++)
+  {
+    int numaId = -1;
+    if (noisePlacement == NOISE_CLOSEST) numaId = GetClosestNumaNode(i % numUsedGpus + rank);
+    if (noisePlacement == NOISE_OTHER)   numaId = (GetClosestNumaNode(i % numUsedGpus + rank) + 1) % numNumaNodes;
+    noiseThreads.push_back(std::thread(NoiseThread, numaId, noiseDuty, &abortNoiseThreads));
+  }
+
+  // Create communicators
+  std::vector<ncclComm_t> comms(numUsedGpus);
+#ifdef MPI_SUPPORT
+  ncclUniqueId id;
+  if (rank == 0) NCCL_CALL(ncclGetUniqueId(&id));
+  MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
+  HIP_CALL(hipSetDevice(rank));
+  NCCL_CALL(ncclCommInitRank(&comms[0], numTotalGpus, id, rank));
+#else
+  NCCL_CALL(ncclCommInitAll(comms.data(), numUsedGpus, NULL));
+#endif
+
+  // Allocate per-GPU resources
+  size_t const recvBytes = (coll == COLL_ALLGATHER) ? (size_t)numBytes * numTotalGpus : numBytes;
+  size_t const sendBytes = (coll == COLL_REDUCESCATTER) ? (size_t)numBytes * numTotalGpus : numBytes;
+  std::vector<void*>       sendBuffs(numUsedGpus);
+  std::vector<void*>       recvBuffs(numUsedGpus);
+  std::vector<hipStream_t> streams(numUsedGpus);
+  for (int i = 0; i < numUsedGpus; i++)
+  {
+    HIP_CALL(hipSetDevice(i + rank));
+    if (useNuma) SetNumaNode(GetClosestNumaNode(i + rank));
+    HIP_CALL(hipMalloc(&sendBuffs[i], sendBytes));
+    HIP_CALL(hipMalloc(&recvBuffs[i], recvBytes));
+    HIP_CALL(hipMemset(sendBuffs[i], 0, sendBytes));
+    HIP_CALL(hipStreamCreate(&streams[i]));
+  }
+
+  // Allocate per-iteration resources
+  std::vector<std::vector<uint64_t>> hostStartTimes(numTotalGpus, std::vector<uint64_t>(totalIterations));
+  std::vector<std::vector<uint64_t>>  hostStopTimes(numTotalGpus, std::vector<uint64_t>(totalIterations));
+
+#ifndef MPI_SUPPORT
+  #pragma omp parallel num_threads(numTotalGpus)
+#endif
+  {
+#ifdef MPI_SUPPORT
+    int deviceId = rank;
+    int localIdx = 0;
+#else
+    int deviceId = omp_get_thread_num();
+    int localIdx = deviceId;
+#endif
+    HIP_CALL(hipSetDevice(deviceId));
+    if (useNuma) SetNumaNode(GetClosestNumaNode(deviceId));
+
+    for (int iteration = 0; iteration < totalIterations; iteration++)
+    {
+      // Wait for all threads to arrive before launching all collectives
+#ifdef MPI_SUPPORT
+      MPI_Barrier(MPI_COMM_WORLD);
+#else
+      #pragma omp barrier
+#endif
+      uint64_t cpuStart = NowNs();
+      RunCollective(coll, sendBuffs[localIdx], recvBuffs[localIdx], numBytes, comms[localIdx], streams[localIdx]);
+      HIP_CALL(hipStreamSynchronize(streams[localIdx]));
+      uint64_t cpuStop = NowNs();
+
+      hostStartTimes[deviceId][iteration] = cpuStart;
+      hostStopTimes [deviceId][iteration] = cpuStop;
+    }
+  }
+
+  // Stop all the noise threads
+  STORE(&abortNoiseThreads, true);
+  for (auto& t : noiseThreads)
+    t.join();
+
+  for (int i = 0; i < numUsedGpus; i++)
+  {
+    NCCL_CALL(ncclCommDestroy(comms[i]));
+    HIP_CALL(hipFree(sendBuffs[i]));
+    HIP_CALL(hipFree(recvBuffs[i]));
+    HIP_CALL(hipStreamDestroy(streams[i]));
+  }
+
+#ifdef MPI_SUPPORT
+  // Collect results from every rank
+  if (rank == 0)
+  {
+    for (int deviceId = 1; deviceId < numTotalGpus; deviceId++)
+    {
+      MPI_Recv(hostStartTimes[deviceId].data(), totalIterations * sizeof(uint64_t), MPI_BYTE, deviceId, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      MPI_Recv( hostStopTimes[deviceId].data(), totalIterations * sizeof(uint64_t), MPI_BYTE, deviceId, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+  }
+  else
+  {
+    MPI_Send(hostStartTimes[rank].data(), totalIterations * sizeof(uint64_t), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+    MPI_Send( hostStopTimes[rank].data(), totalIterations * sizeof(uint64_t), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+    goto end;
+  }
+#endif
+
+  {
+    // Latency percentiles, per GPU and over all GPUs (All times in usec)
+    std::vector<double> allLatencies;
+    std::vector<TimelineData> timelineData;
+    char buff[1000];
+
+    uint64_t origin = hostStartTimes[0][numWarmups];
+    for (int gpu = 1; gpu < numTotalGpus; gpu++)
+      origin = std::min(origin, hostStartTimes[gpu][numWarmups]);
+
+    printf("==========================================================================================\n");
+    printf("| %-8s |    MIN     |    P50     |    P99     |   P99.9    |    MAX     | >2x P50 |\n", "(usec)");
+    printf("==========================================================================================\n");
+    for (int gpu = 0; gpu <= numTotalGpus; gpu++)
+    {
+      std::vector<double> latencies;
+      if (gpu < numTotalGpus)
+      {
+        for (int iter = numWarmups; iter < totalIterations; iter++)
+        {
+          double const latency = (hostStopTimes[gpu][iter] - hostStartTimes[gpu][iter]) / 1000.0;
+          latencies.push_back(latency);
+          allLatencies.push_back(latency);
+
+          if (iter - numWarmups < timelineIters)
+          {
+            TimelineData td;
+            sprintf(buff, "GPU %02d", gpu); td.rowLabel = buff;
+            sprintf(buff, "Iteration %d", iter - numWarmups + 1); td.barLabel = buff;
+            sprintf(buff, "%.3f usec", latency); td.toolTip = buff;
+            td.startTime = (hostStartTimes[gpu][iter] - origin) / 1000;
+            td.stopTime  = (hostStopTimes [gpu][iter] - origin) / 1000;
+            timelineData.push_back(td);
+          }
+        }
+      }
+      else
+      {
+        latencies = allLatencies;
+      }
+      std::sort(latencies.begin(), latencies.end());
+      double const p50 = Percentile(latencies, 0.5);
+      size_t const numSlow = latencies.end() - std::upper_bound(latencies.begin(), latencies.end(), 2 * p50);
+
+      if (gpu < numTotalGpus) sprintf(buff, "GPU %02d", gpu);
+      else                    sprintf(buff, "ALL");
+      printf("| %-8s | %10.3f | %10.3f | %10.3f | %10.3f | %10.3f | %7zu |\n", buff,
+             latencies.front(), p50, Percentile(latencies, 0.99), Percentile(latencies, 0.999), latencies.back(), numSlow);
+    }
+    printf("==========================================================================================\n");
+
+    sprintf(buff, "rccl_timeline_%dx%s_%s_%dB_%dNoise_%s_Duty%d_Numa%d.html", numTotalGpus, archName, collNames[coll], numBytes,
+            numNoiseThreads, noisePlacement == NOISE_ANYWHERE ? "Anywhere" : noisePlacement == NOISE_CLOSEST ? "Closest" : "Other",
+            noiseDuty, useNuma);
+    printf("Timeline exported to %s\n", buff);
+    ExportToTimeLine(buff, "Device", "Iteration", timelineData);
+  }
+
+#ifdef MPI_SUPPORT
+end:
+  MPI_Barrier(MPI_COMM_WORLD);
+  MPI_Finalize();
+#endif
+  return 0;
+}
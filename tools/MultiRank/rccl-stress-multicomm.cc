@@ -0,0 +1,268 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ *
+ * See LICENSE.txt for license information
+ ************************************************************************/
+
+/* -*- Mode: C; c-basic-offset:4 ; indent-tabs-mode:nil -*- */
+
+/* Drives many communicators at once, the way TP/DP/EP groups of one job do:
+ * numComms communicators over the same numDevs devices, numStreams streams per
+ * communicator and device, and numThreads host threads each enqueueing the
+ * collectives of its share of the communicators. Sizes and collectives rotate
+ * through a mixed list so that small latency-bound and large bandwidth-bound
+ * operations share the proxy, the work fifo and the group code.
+ *
+ * Reports aggregate throughput and, per communicator, the GPU time of each
+ * operation on its first device (events around it on its stream), so that a
+ * communicator slowed down by shared state stands out from the others. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "hip/hip_runtime.h"
+#include "rccl.h"
+
+#define HIPCHECK(cmd) do {                         \
+  hipError_t e = cmd;                              \
+  if( e != hipSuccess ) {                          \
+    printf("Failed: HIP error %s:%d '%s'\n",             \
+        __FILE__,__LINE__,hipGetErrorString(e));   \
+    exit(EXIT_FAILURE);                             \
+  }                                                 \
+} while(0)
+
+
+#define NCCLCHECK(cmd) do {                         \
+  ncclResult_t r = cmd;                             \
+  if (r!= ncclSuccess) {                            \
+    printf("Failed, NCCL error %s:%d '%s'\n",             \
+        __FILE__,__LINE__,ncclGetErrorString(r));   \
+    exit(EXIT_FAILURE);                             \
+  }                                                 \
+} while(0)
+
+enum { COLL_ALLREDUCE = 0, COLL_ALLGATHER = 1, COLL_REDUCESCATTER = 2, NUM_COLLS = 3 };
+static const char* collNames[NUM_COLLS] = { "AllReduce", "AllGather", "ReduceScatter" };
+
+struct commState {
+    std::vector<ncclComm_t> comms;          // one per device
+    std::vector<float*> sendbuff, recvbuff; // one per device
+    std::vector<hipStream_t> streams;       // numStreams per device
+    std::vector<hipEvent_t> events;         // start/stop per window slot, first device
+    std::vector<float> latencies;           // us, on the first device
+    size_t bytes;
+    int ops;
+};
+
+static int numdevices=2;
+static int numcomms=4;
+static int numstreams=1;
+static int numthreads=4;
+static int iters=1000;
+static int window=32;
+static std::vector<size_t> sizes;
+
+static void print_help()
+{
+    printf("Usage: rccl-stress-multicomm <numDevs> <numComms> <numStreams> <numThreads>\n");
+    printf("   all arguments are optional, but have to be provided in this order\n");
+    printf("   numDevs    : number of devices, every communicator spans all of them (default: 2)\n");
+    printf("   numComms   : number of communicators (default: 4)\n");
+    printf("   numStreams : streams per communicator and device, used in turn (default: 1)\n");
+    printf("   numThreads : host threads, communicator c is driven by thread c %% numThreads (default: 4)\n");
+    printf("   ITERS      : operations per communicator (default: 1000)\n");
+    printf("   WINDOW     : operations between two synchronizations of a communicator (default: 32)\n");
+    printf("   SIZES      : comma separated list of bytes per rank (default: 1024,65536,1048576,16777216)\n");
+}
+
+static void parse_args(int argc, char **argv)
+{
+    if (argc > 1) numdevices = atoi(argv[1]);
+    if (argc > 2) numcomms   = atoi(argv[2]);
+    if (argc > 3) numstreams = atoi(argv[3]);
+    if (argc > 4) numthreads = atoi(argv[4]);
+    if (getenv("ITERS"))  iters  = atoi(getenv("ITERS"));
+    if (getenv("WINDOW")) window = atoi(getenv("WINDOW"));
+    const char* list = getenv("SIZES") ? getenv("SIZES") : "1024,65536,1048576,16777216";
+    for (const char* p = list; *p; ) {
+        sizes.push_back(strtoull(p, NULL, 0));
+        p = strchr(p, ',');
+        if (p == NULL) break;
+        p++;
+    }
+
+    int maxdevices;
+    HIPCHECK(hipGetDeviceCount(&maxdevices));
+    if (numdevices < 1 || numdevices > maxdevices || numcomms < 1 || numstreams < 1 || numthreads < 1 ||
+        iters < 1 || window < 1 || sizes.empty()) {
+        print_help();
+        exit(-1);
+    }
+    // A communicator is never used by two threads at once
+    if (numthreads > numcomms) {
+        printf("Using %d threads, one per communicator\n", numcomms);
+        numthreads = numcomms;
+    }
+    printf("%d devices, %d communicators, %d streams per communicator and device, %d threads, %d ops per communicator\n\n",
+           numdevices, numcomms, numstreams, numthreads, iters);
+}
+
+static size_t coll_bytes(int coll, size_t bytes)
+{
+    // Send and receive buffers hold numdevices chunks for the gather/scatter side
+    return coll == COLL_ALLREDUCE ? bytes : bytes * numdevices;
+}
+
+// Op i of communicator c: collective and size rotate, offset by c so comms differ at any time
+static void op_shape(int c, int i, int* coll, size_t* bytes)
+{
+    *coll  = (i + c) % NUM_COLLS;
+    *bytes = sizes[(i / NUM_COLLS + c) % sizes.size()];
+}
+
+static void enqueue_op(commState* cs, int c, int i)
+{
+    int coll; size_t bytes;
+    op_shape(c, i, &coll, &bytes);
+    size_t count = bytes / sizeof(float);
+    int slot = i % window;
+    int s = i % numstreams;
+
+    NCCLCHECK(ncclGroupStart());
+    for (int d = 0; d < numdevices; d++) {
+        hipStream_t stream = cs->streams[d*numstreams + s];
+        if (d == 0) HIPCHECK(hipEventRecord(cs->events[2*slot], stream));
+        if (coll == COLL_ALLREDUCE)
+            NCCLCHECK(ncclAllReduce(cs->sendbuff[d], cs->recvbuff[d], count, ncclFloat, ncclSum, cs->comms[d], stream));
+        else if (coll == COLL_ALLGATHER)
+            NCCLCHECK(ncclAllGather(cs->sendbuff[d], cs->recvbuff[d], count, ncclFloat, cs->comms[d], stream));
+        else
+            NCCLCHECK(ncclReduceScatter(cs->sendbuff[d], cs->recvbuff[d], count, ncclFloat, ncclSum, cs->comms[d], stream));
+    }
+    NCCLCHECK(ncclGroupEnd());
+    HIPCHECK(hipEventRecord(cs->events[2*slot+1], cs->streams[s]));
+    cs->bytes += coll_bytes(coll, bytes) * numdevices;
+    cs->ops++;
+}
+
+static void drain_window(commState* cs, int first, int n)
+{
+    for (size_t k = 0; k < cs->streams.size(); k++) HIPCHECK(hipStreamSynchronize(cs->streams[k]));
+    for (int i = first; i < first + n; i++) {
+        int slot = i % window;
+        float ms;
+        HIPCHECK(hipEventElapsedTime(&ms, cs->events[2*slot], cs->events[2*slot+1]));
+        cs->latencies.push_back(ms * 1000.0f);
+    }
+}
+
+// Round robin over this thread's communicators, one window of ops at a time
+static void thread_main(std::vector<commState>* states, int tid)
+{
+    for (int first = 0; first < iters; first += window) {
+        int n = std::min(window, iters - first);
+        for (int c = tid; c < numcomms; c += numthreads) {
+            HIPCHECK(hipSetDevice(0));
+            for (int i = first; i < first + n; i++) enqueue_op(&(*states)[c], c, i);
+        }
+        for (int c = tid; c < numcomms; c += numthreads) drain_window(&(*states)[c], first, n);
+    }
+}
+
+static float percentile(std::vector<float>& sorted, double p)
+{
+    size_t idx = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[])
+{
+    parse_args(argc, argv);
+    size_t maxbytes = 0;
+    for (size_t s : sizes) maxbytes = std::max(maxbytes, s * numdevices);
+
+    std::vector<int> devlist(numdevices);
+    for (int d = 0; d < numdevices; d++) devlist[d] = d;
+
+    std::vector<commState> states(numcomms);
+    for (int c = 0; c < numcomms; c++) {
+        commState& cs = states[c];
+        cs.comms.resize(numdevices);
+        NCCLCHECK(ncclCommInitAll(cs.comms.data(), numdevices, devlist.data()));
+        cs.sendbuff.resize(numdevices);
+        cs.recvbuff.resize(numdevices);
+        cs.streams.resize(numdevices * numstreams);
+        for (int d = 0; d < numdevices; d++) {
+            HIPCHECK(hipSetDevice(d));
+            HIPCHECK(hipMalloc(&cs.sendbuff[d], maxbytes));
+            HIPCHECK(hipMalloc(&cs.recvbuff[d], maxbytes));
+            HIPCHECK(hipMemset(cs.sendbuff[d], 0, maxbytes));
+            for (int s = 0; s < numstreams; s++) HIPCHECK(hipStreamCreateWithFlags(&cs.streams[d*numstreams+s], hipStreamNonBlocking));
+        }
+        HIPCHECK(hipSetDevice(0));
+        cs.events.resize(2 * window);
+        for (int e = 0; e < 2 * window; e++) HIPCHECK(hipEventCreate(&cs.events[e]));
+        cs.bytes = 0;
+        cs.ops = 0;
+    }
+
+    // One untimed pass to connect every communicator and algorithm
+    int saved_iters = iters;
+    iters = std::min(iters, (int)(NUM_COLLS * sizes.size()));
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numthreads; t++) threads.push_back(std::thread(thread_main, &states, t));
+        for (auto& t : threads) t.join();
+    }
+    iters = saved_iters;
+    for (auto& cs : states) { cs.latencies.clear(); cs.bytes = 0; cs.ops = 0; }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numthreads; t++) threads.push_back(std::thread(thread_main, &states, t));
+        for (auto& t : threads) t.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%6s %6s %8s %12s %12s %12s %12s\n", "comm", "thread", "ops", "p50(us)", "p99(us)", "max(us)", "GB/s");
+    size_t totalbytes = 0;
+    int totalops = 0;
+    std::vector<float> all;
+    for (int c = 0; c < numcomms; c++) {
+        commState& cs = states[c];
+        std::vector<float> sorted = cs.latencies;
+        std::sort(sorted.begin(), sorted.end());
+        printf("%6d %6d %8d %12.1f %12.1f %12.1f %12.2f\n", c, c % numthreads, cs.ops,
+               percentile(sorted, 0.5), percentile(sorted, 0.99), sorted.back(), cs.bytes / seconds / 1e9);
+        totalbytes += cs.bytes;
+        totalops += cs.ops;
+        all.insert(all.end(), sorted.begin(), sorted.end());
+    }
+    std::sort(all.begin(), all.end());
+    printf("\nAggregate: %.3f s, %.0f ops/s, %.2f GB/s of user buffers, latency p50 %.1f us p99 %.1f us\n",
+           seconds, totalops / seconds, totalbytes / seconds / 1e9, percentile(all, 0.5), percentile(all, 0.99));
+    printf("Collectives used:");
+    for (int c = 0; c < NUM_COLLS; c++) printf(" %s", collNames[c]);
+    printf(", sizes:");
+    for (size_t s : sizes) printf(" %zu", s);
+    printf("\n");
+
+    for (auto& cs : states) {
+        for (int d = 0; d < numdevices; d++) {
+            HIPCHECK(hipSetDevice(d));
+            HIPCHECK(hipFree(cs.sendbuff[d]));
+            HIPCHECK(hipFree(cs.recvbuff[d]));
+            for (int s = 0; s < numstreams; s++) HIPCHECK(hipStreamDestroy(cs.streams[d*numstreams+s]));
+            NCCLCHECK(ncclCommDestroy(cs.comms[d]));
+        }
+        for (auto e : cs.events) HIPCHECK(hipEventDestroy(e));
+    }
+    printf("Success \n");
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <mpi.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      MPI_Abort(MPI_COMM_WORLD, -1);                                    \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      MPI_Abort(MPI_COMM_WORLD, -1);                                    \
+    }                                                                   \
+  } while (0)
+
+// Network plugin benchmark
+//
+// Measures the network plugin RCCL loaded (IB, socket or an external plugin) with
+// ncclCommNetBench, which drives isend/irecv/test directly with RCCL's own device selection
+// and buffer placement, without GPU kernels or proxy threads. Rank r sends to rank r + n/2, so
+// with ranks laid out by node every pair crosses the network. Run with an even number of ranks:
+//   mpirun -np 2 --host nodeA,nodeB ./NetBench
+//
+// Configuration is read from environment variables:
+//   MIN_BYTES      Smallest message                                  (default: 8)
+//   MAX_BYTES      Largest message, swept by powers of two           (default: 64MB)
+//   NUM_ITERATIONS Messages per size                                 (default: 1000)
+//   NUM_WARMUPS    Messages per size before timing                   (default: 50)
+//   WINDOW         Messages in flight, up to 32                      (default: 8)
+//   NET_DEV        Network device, -1 for the one RCCL would use     (default: -1)
+//   GDR            -1 as RCCL would place buffers, 0 host, 1 GPU      (default: -1)
+//   CSV_FILE       Also write the results of every pair to this file
+
+size_t GetSize(char const* name, size_t defaultVal)
+{
+  char const* str = getenv(name);
+  if (!str) return defaultVal;
+  char* end;
+  size_t val = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'G': case 'g': val <<= 30; break;
+  case 'M': case 'm': val <<= 20; break;
+  case 'K': case 'k': val <<= 10; break;
+  }
+  return val;
+}
+
+int GetInt(char const* name, int defaultVal)
+{
+  char const* str = getenv(name);
+  return str ? atoi(str) : defaultVal;
+}
+
+int main(int argc, char **argv)
+{
+  int rank, nranks;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nranks < 2 || nranks % 2)
+  {
+    if (rank == 0) printf("[ERROR] NetBench needs an even number of ranks, got %d\n", nranks);
+    MPI_Finalize();
+    return 1;
+  }
+
+  // One GPU per local rank
+  MPI_Comm localComm;
+  int localRank, numDevices;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &localComm);
+  MPI_Comm_rank(localComm, &localRank);
+  HIP_CALL(hipGetDeviceCount(&numDevices));
+  HIP_CALL(hipSetDevice(localRank % numDevices));
+
+  ncclNetBenchConfig_t config = NCCL_NET_BENCH_CONFIG_INITIALIZER;
+  config.minBytes = GetSize("MIN_BYTES", config.minBytes);
+  config.maxBytes = GetSize("MAX_BYTES", config.maxBytes);
+  config.iters    = GetInt("NUM_ITERATIONS", config.iters);
+  config.warmups  = GetInt("NUM_WARMUPS", config.warmups);
+  config.window   = GetInt("WINDOW", config.window);
+  config.netDev   = GetInt("NET_DEV", config.netDev);
+  config.gdr      = GetInt("GDR", config.gdr);
+  char const* csvFile = getenv("CSV_FILE");
+
+  ncclUniqueId id;
+  ncclComm_t comm;
+  if (rank == 0) NCCL_CALL(ncclGetUniqueId(&id));
+  MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
+  NCCL_CALL(ncclCommInitRank(&comm, nranks, id, rank));
+
+  int peer = (rank + nranks / 2) % nranks;
+  std::vector<ncclNetBenchResult_t> results(64);
+  int nResults = results.size();
+  NCCL_CALL(ncclCommNetBench(comm, peer, &config, results.data(), &nResults));
+
+  // Senders print the results of their pair in order, with the receiver's buffer placement
+  int sendGdr[64], recvGdr[64];
+  for (int i = 0; i < nResults; i++) sendGdr[i] = results[i].gdr;
+  if (rank >= nranks / 2) MPI_Send(sendGdr, nResults, MPI_INT, peer, 0, MPI_COMM_WORLD);
+  else MPI_Recv(recvGdr, nResults, MPI_INT, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+  for (int p = 0; p < nranks / 2; p++)
+  {
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (rank != p) continue;
+    printf("\nRank %d -> rank %d, window %d, %d iterations\n", rank, peer, config.window, config.iters);
+    printf("%12s %8s %8s %12s %14s %12s\n", "Bytes", "SendMem", "RecvMem", "Time(us)", "MsgRate(M/s)", "BW(GB/s)");
+    // Senders append to the CSV file in turn, rank 0 creates it
+    FILE* csv = csvFile ? fopen(csvFile, rank == 0 ? "w" : "a") : NULL;
+    if (csvFile && !csv) printf("[ERROR] Unable to open %s\n", csvFile);
+    if (csv && rank == 0) fprintf(csv, "sender,receiver,bytes,sendGdr,recvGdr,timeUs,msgRate,bwGBs\n");
+    for (int i = 0; i < nResults; i++)
+    {
+      ncclNetBenchResult_t const& r = results[i];
+      printf("%12zu %8s %8s %12.1f %14.3f %12.3f\n", r.bytes, sendGdr[i] ? "GPU" : "Host", recvGdr[i] ? "GPU" : "Host",
+             r.timeUs, r.msgRate / 1e6, r.bwGBs);
+      if (csv)
+        fprintf(csv, "%d,%d,%zu,%d,%d,%.1f,%.0f,%.3f\n", rank, peer, r.bytes, sendGdr[i], recvGdr[i], r.timeUs, r.msgRate, r.bwGBs);
+    }
+    if (csv) fclose(csv);
+    fflush(stdout);
+  }
+
+  NCCL_CALL(ncclCommDestroy(comm));
+  MPI_Comm_free(&localComm);
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,172 @@
+#!/usr/bin/gawk -f
+# Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# Usage: extract_bw_heatmap.awk -v bwfile=<measured> [-v threshold=0.8] <rccl log> <measured>
+#
+# Builds an HTML heatmap of the rank to rank links used by the ring and tree channels
+# of an RCCL log (NCCL_DEBUG=INFO NCCL_DEBUG_SUBSYS=INIT,GRAPH):
+#   - channels per link, ring and tree, to spot links carrying more channels than others;
+#   - measured / predicted bandwidth per link, red below the threshold.
+# The measured file has one "src dst GB/s" line per directed rank pair (commas allowed),
+# e.g. from a pairwise sendrecv_perf or TransferBench run. The prediction is the ring
+# graph bandwidth per channel (intra or inter node, from the "Pattern" line) times the
+# number of ring channels on the link.
+
+BEGIN {
+  max_rank=0
+  ring_bw_intra=0
+  ring_bw_inter=0
+  tree_bw_intra=0
+  tree_bw_inter=0
+  if (threshold=="") threshold=0.8
+  col_start=2
+}
+
+FILENAME==bwfile {
+  gsub(",", " ")
+  if (NF>=3 && $1 ~ /^[0-9]+$/) measured[$1 "," $2]=$3
+  next
+}
+
+{
+  if($3=="NCCL" && $4=="INFO" && col_start==2) col_start=5
+  if($5=="NCCL" && $6=="INFO" && col_start==2) col_start=7
+  col_p1=col_start+1
+  col_p3=col_start+3
+  col_p4=col_start+4
+  col_p5=col_start+5
+  col_p6=col_start+6
+  col_p7=col_start+7
+  col_p8=col_start+8
+
+  # First graph of each kind, they are the same on every rank
+  if(match($0, /Pattern ([0-9]+), crossNic [0-9]+, nChannels [0-9]+, bw ([0-9.]+)\/([0-9.]+)/, ary)) {
+    if(ary[1]==4 && ring_bw_intra==0) {
+      ring_bw_intra=ary[2]; ring_bw_inter=ary[3]
+    } else if(ary[1]!=4 && tree_bw_intra==0) {
+      tree_bw_intra=ary[2]; tree_bw_inter=ary[3]
+    }
+  }
+
+  if($col_start=="Ring" && $col_p4=="->" && $col_p6=="->") {
+    chan=strtonum($col_p1)
+    rank=strtonum($col_p5)
+    next_rank=strtonum($col_p7)
+    if(!((rank "," next_rank "," chan) in rings)) {
+      rings[rank "," next_rank "," chan]=1
+      ring_links[rank "," next_rank]++
+    }
+    if(rank>max_rank) max_rank=rank
+  }
+
+  if($col_start=="Trees") {
+    col_1=col_start+1
+    col_2=col_start+2
+    do {
+      match($col_1, /\[([0-9]+)\]/, ary)
+      chan=strtonum(ary[1])
+      if(match($col_2, /(\-?[0-9]+)\/(\-?[0-9]+)\/(\-?[0-9]+)\->(\-?[0-9]+)\->(\-?[0-9]+)/, ary)) {
+        for(k=1;k<=3;k++) {
+          if(ary[k]!="-1" && !((ary[4] "," ary[k] "," chan) in trees)) {
+            trees[ary[4] "," ary[k] "," chan]=1
+            tree_links[ary[4] "," ary[k]]++
+          }
+        }
+      }
+      col_1=col_1+2
+      col_2=col_2+2
+    } while ($col_1!="")
+  }
+
+  if($col_p6=="via" || ($col_p6=="[receive]" && $col_p7=="via")) {
+    match($col_p3, /([0-9]+)\[.*\]/, ary)
+    s=ary[1]
+    match($col_p5, /([0-9]+)\[.*\]/, ary)
+    d=ary[1]
+    type=($col_p6=="via") ? $col_p7 : $col_p8
+    if(!((s "," d) in conn) || match(type,"NET"))
+      conn[s "," d]=type
+  }
+}
+
+function cell(color, text, tip) {
+  printf "<td style=\"background:%s\" title=\"%s\">%s</td>", color, tip, text
+}
+
+# White to blue with the share of the busiest link
+function load_color(n, max_n,   v) {
+  if (n==0) return "#ffffff"
+  v=int(255-180*n/max_n)
+  return sprintf("#%02x%02xff", v, v)
+}
+
+# Red below the threshold, yellow up to 1, green above
+function ratio_color(r) {
+  if (r<threshold) return "#ff8080"
+  if (r<1) return "#ffff80"
+  return "#80ff80"
+}
+
+function table_header(title) {
+  printf "<h2>%s</h2>\n<table><tr><th>src \\ dst</th>", title
+  for(d=0;d<=max_rank;d++) printf "<th>%d</th>", d
+  printf "</tr>\n"
+}
+
+END {
+  max_links=1
+  for(k in ring_links) if(ring_links[k]+tree_links[k]>max_links) max_links=ring_links[k]+tree_links[k]
+  for(k in tree_links) if(ring_links[k]+tree_links[k]>max_links) max_links=ring_links[k]+tree_links[k]
+
+  printf "<html><head><style>table{border-collapse:collapse;font-family:Helvetica}td,th{border:1px solid #888;padding:4px;text-align:center}</style></head><body>\n"
+  printf "<p>Ring graph %.1f/%.1f GB/s per channel (intra/inter), tree graph %.1f/%.1f GB/s. Threshold %.2f.</p>\n",
+         ring_bw_intra, ring_bw_inter, tree_bw_intra, tree_bw_inter, threshold
+
+  table_header("Channels per link (ring+tree)")
+  for(s=0;s<=max_rank;s++) {
+    printf "<tr><th>%d</th>", s
+    for(d=0;d<=max_rank;d++) {
+      n=ring_links[s "," d]+tree_links[s "," d]
+      cell(load_color(n, max_links), n ? (ring_links[s "," d]+0) "+" (tree_links[s "," d]+0) : "", conn[s "," d])
+    }
+    printf "</tr>\n"
+  }
+  printf "</table>\n"
+
+  table_header("Measured / predicted GB/s on ring links")
+  for(s=0;s<=max_rank;s++) {
+    printf "<tr><th>%d</th>", s
+    for(d=0;d<=max_rank;d++) {
+      k=s "," d
+      bw=match(conn[k],"NET") ? ring_bw_inter : ring_bw_intra
+      pred=ring_links[k]*bw
+      if (!(k in measured) || pred==0) {
+        cell("#ffffff", (k in measured) ? sprintf("%.1f", measured[k]) : "", conn[k])
+        continue
+      }
+      ratio=measured[k]/pred
+      if (ratio<threshold) degraded++
+      cell(ratio_color(ratio), sprintf("%.1f/%.1f", measured[k], pred), sprintf("%s %.0f%%", conn[k], 100*ratio))
+    }
+    printf "</tr>\n"
+  }
+  printf "</table>\n<p>%d links below %.0f%% of the prediction.</p>\n</body></html>\n", degraded, 100*threshold
+}
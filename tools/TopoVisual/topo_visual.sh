@@ -22,15 +22,18 @@
 DIR="$(cd -P "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 
 exit_error() {
-  echo "Usage: $0 [ -i input_filename ]"
+  echo "Usage: $0 [ -i input_filename ] [ -b measured_bandwidth_filename ]"
   exit 1
 }
 
-while getopts ":i:o:" options; do
+while getopts ":i:o:b:" options; do
   case "${options}" in
     i)
       INPUT_NAME=${OPTARG}
       ;;
+    b)
+      BW_NAME=${OPTARG}
+      ;;
     :)
       echo "Error: -${OPTARG} requires an argument."
       exit_error
@@ -47,6 +50,11 @@ then
 else
   $DIR/extract_topo.awk $INPUT_NAME | dot -Tpng -o "$INPUT_NAME.png"
   echo "Extracted topology from $INPUT_NAME to $INPUT_NAME.png"
+  if [ -n "$BW_NAME" ]
+  then
+    $DIR/extract_bw_heatmap.awk -v bwfile="$BW_NAME" $INPUT_NAME $BW_NAME > "$INPUT_NAME.heatmap.html"
+    echo "Link heatmap of $INPUT_NAME and $BW_NAME in $INPUT_NAME.heatmap.html"
+  fi
 fi
 
 exit 0
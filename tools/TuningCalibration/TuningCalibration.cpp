@@ -0,0 +1,479 @@
+/*
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <strings.h>
+#include <unistd.h>
+#include <mpi.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+
+#define HIP_CALL(cmd)                                                 \
+  do {                                                                \
+    hipError_t error = (cmd);                                         \
+    if (error != hipSuccess)                                          \
+    {                                                                   \
+      std::cout << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      MPI_Abort(MPI_COMM_WORLD, -1);                                    \
+    }                                                                   \
+  } while (0)
+
+#define NCCL_CALL(cmd) \
+  do { \
+    ncclResult_t error = (cmd);                 \
+    if (error != ncclSuccess)                   \
+    {                                           \
+      std::cout << "Encountered NCCL error (" << ncclGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      MPI_Abort(MPI_COMM_WORLD, -1);                                    \
+    }                                                                   \
+  } while (0)
+
+// Tuning model calibration
+//
+// Sweeps message sizes for every collective, algorithm and protocol the tuning model considers
+// usable on this cluster, fits the latency and bandwidth of each combination and writes a
+// tuning file for RCCL_TUNING_FILE. Run it once per cluster type with the job layout to tune:
+//   mpirun -np 16 --host nodeA:8,nodeB:8 ./TuningCalibration
+//
+// 1. A first communicator is created with RCCL_TUNING_DUMP_FILE set, which gives the model in
+//    effect: the usable combinations and their modeled latency (us) and bandwidth (GB/s).
+// 2. Every combination is forced with NCCL_ALGO/NCCL_PROTO on a communicator of its own and
+//    timed at every size, the default choice of RCCL is timed too.
+// 3. time(us) = lat + bytes / (1000 * bw) is fitted by least squares on the relative error, so
+//    small sizes weigh as much as large ones, with bytes the total size the model uses.
+// 4. The tuning file moves baseLat by the difference between the fitted and the modeled
+//    latency and scales bwRatio by the ratio of the fitted and the modeled bandwidth, averaged
+//    over the collectives. Direct, RHD and Bruck take their bandwidth from the Ring entries, so
+//    only Tree and Ring bandwidths are written.
+// 5. Where the measured best combination beats the default choice by more than THRESHOLD,
+//    the size range gets an override.
+// Running again with RCCL_TUNING_FILE pointing to the result shows the remaining error.
+//
+// Configuration is read from environment variables:
+//   COLLS          Comma-separated collectives        (default: AllReduce,AllGather,ReduceScatter,Broadcast,Reduce)
+//   MIN_BYTES      Smallest size, total bytes         (default: 1K)
+//   MAX_BYTES      Largest size, swept by powers of 2 (default: 256M)
+//   NUM_ITERATIONS Operations per size                (default: 20)
+//   NUM_WARMUPS    Operations per size before timing  (default: 5)
+//   THRESHOLD      Gain in percent for an override    (default: 10)
+//   OUTPUT_FILE    Tuning file to write               (default: rccl-tuning.txt)
+//   CSV_FILE       Also write every measurement to this file
+
+#define NUM_COLLS 5
+#define NUM_ALGOS 9
+#define NUM_PROTOS 3
+#define DEFAULT_COMBO -1
+
+// Order of the tuning file, which follows ncclFunc_t, ncclAlgoStr and ncclProtoStr
+char const* collNames[NUM_COLLS]   = { "Broadcast", "Reduce", "AllGather", "ReduceScatter", "AllReduce" };
+char const* algoNames[NUM_ALGOS]   = { "Tree", "Ring", "CollNetDirect", "CollNetChain", "NVLS", "NVLSTree", "Direct", "RHD", "Bruck" };
+char const* protoNames[NUM_PROTOS] = { "LL", "LL128", "Simple" };
+
+// Model in effect, from RCCL_TUNING_DUMP_FILE
+struct Model
+{
+  int   index;
+  float baseLat[NUM_ALGOS][NUM_PROTOS];
+  float bwRatio[2][NUM_ALGOS][NUM_PROTOS];
+  float lat[NUM_COLLS][NUM_ALGOS][NUM_PROTOS];
+  float bw[NUM_COLLS][NUM_ALGOS][NUM_PROTOS];   // 0 when the combination is not usable
+};
+
+struct Fit
+{
+  bool  valid;
+  float lat;
+  float bw;
+};
+
+size_t GetSize(char const* name, size_t defaultVal)
+{
+  char const* str = getenv(name);
+  if (!str) return defaultVal;
+  char* end;
+  size_t val = strtoull(str, &end, 10);
+  switch (*end) {
+  case 'G': case 'g': val <<= 30; break;
+  case 'M': case 'm': val <<= 20; break;
+  case 'K': case 'k': val <<= 10; break;
+  }
+  return val;
+}
+
+int GetInt(char const* name, int defaultVal)
+{
+  char const* str = getenv(name);
+  return str ? atoi(str) : defaultVal;
+}
+
+std::vector<std::string> SplitList(char const* str)
+{
+  std::vector<std::string> items;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) if (!item.empty()) items.push_back(item);
+  return items;
+}
+
+int FindName(char const* name, char const** names, int n)
+{
+  for (int i = 0; i < n; i++) if (strcasecmp(name, names[i]) == 0) return i;
+  return -1;
+}
+
+bool ReadModel(char const* path, Model* model)
+{
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+  memset(model, 0, sizeof(*model));
+  model->index = -1;
+  char line[512], s1[32], s2[32], s3[32], s4[32];
+  float v1, v2;
+  while (fgets(line, sizeof(line), f))
+  {
+    int a, p, c, r;
+    if (sscanf(line, "model %d", &model->index) == 1) continue;
+    if (sscanf(line, "baseLat %31s %31s %f", s1, s2, &v1) == 3)
+    {
+      if ((a = FindName(s1, algoNames, NUM_ALGOS)) >= 0 && (p = FindName(s2, protoNames, NUM_PROTOS)) >= 0)
+        model->baseLat[a][p] = v1;
+    }
+    else if (sscanf(line, "bwRatio %31s %31s %31s %f", s1, s2, s3, &v1) == 4)
+    {
+      r = strcasecmp(s1, "2nodes") == 0 ? 0 : 1;
+      if ((a = FindName(s2, algoNames, NUM_ALGOS)) >= 0 && (p = FindName(s3, protoNames, NUM_PROTOS)) >= 0)
+        model->bwRatio[r][a][p] = v1;
+    }
+    else if (sscanf(line, "# %31s %31s %31s %f / %f", s1, s2, s4, &v1, &v2) == 5)
+    {
+      if ((c = FindName(s1, collNames, NUM_COLLS)) >= 0 && (a = FindName(s2, algoNames, NUM_ALGOS)) >= 0 &&
+          (p = FindName(s4, protoNames, NUM_PROTOS)) >= 0)
+      {
+        model->lat[c][a][p] = v1;
+        model->bw[c][a][p]  = v2;
+      }
+    }
+  }
+  fclose(f);
+  return model->index >= 0;
+}
+
+// Runs iters operations of coll at total size bytes, returns the time per operation in us,
+// the slowest rank's, or -1 if RCCL refused the operation
+double TimeColl(ncclComm_t comm, hipStream_t stream, int coll, size_t bytes, int nranks, int rank,
+                void* sendbuf, void* recvbuf, int iters, int warmups)
+{
+  size_t count = bytes / sizeof(float);
+  // AllGather/ReduceScatter take the per-rank count
+  if (coll == 2 || coll == 3) count /= nranks;
+  hipEvent_t start, stop;
+  HIP_CALL(hipEventCreate(&start));
+  HIP_CALL(hipEventCreate(&stop));
+  ncclResult_t res = ncclSuccess;
+  for (int i = 0; i < warmups + iters && res == ncclSuccess; i++)
+  {
+    if (i == warmups) HIP_CALL(hipEventRecord(start, stream));
+    switch (coll) {
+    case 0: res = ncclBroadcast(sendbuf, recvbuf, count, ncclFloat, 0, comm, stream); break;
+    case 1: res = ncclReduce(sendbuf, recvbuf, count, ncclFloat, ncclSum, 0, comm, stream); break;
+    case 2: res = ncclAllGather(sendbuf, recvbuf, count, ncclFloat, comm, stream); break;
+    case 3: res = ncclReduceScatter(sendbuf, recvbuf, count, ncclFloat, ncclSum, comm, stream); break;
+    case 4: res = ncclAllReduce(sendbuf, recvbuf, count, ncclFloat, ncclSum, comm, stream); break;
+    }
+  }
+  HIP_CALL(hipEventRecord(stop, stream));
+  HIP_CALL(hipStreamSynchronize(stream));
+  float ms = 0;
+  if (res == ncclSuccess) HIP_CALL(hipEventElapsedTime(&ms, start, stop));
+  HIP_CALL(hipEventDestroy(start));
+  HIP_CALL(hipEventDestroy(stop));
+
+  double us = res == ncclSuccess ? ms * 1e3 / iters : -1;
+  double maxUs, minUs;
+  MPI_Allreduce(&us, &maxUs, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(&us, &minUs, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  if (minUs < 0 && rank == 0) printf("[WARN] %s refused at %zu bytes: %s\n", collNames[coll], bytes, ncclGetErrorString(res));
+  return minUs < 0 ? -1 : maxUs;
+}
+
+// Least squares fit of t = lat + bytes * k, weighted by 1/t^2 to fit the relative error
+Fit FitTimes(std::vector<size_t> const& sizes, std::vector<double> const& times)
+{
+  double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int n = 0;
+  for (size_t i = 0; i < sizes.size(); i++)
+  {
+    if (times[i] <= 0) continue;
+    double w = 1.0 / (times[i] * times[i]);
+    double x = sizes[i];
+    sw += w; sx += w * x; sy += w * times[i]; sxx += w * x * x; sxy += w * x * times[i];
+    n++;
+  }
+  Fit fit = { false, 0, 0 };
+  double det = sw * sxx - sx * sx;
+  if (n < 2 || det <= 0) return fit;
+  double k   = (sw * sxy - sx * sy) / det;
+  double lat = (sy - k * sx) / sw;
+  if (k <= 0) return fit;
+  fit.valid = true;
+  fit.lat   = std::max(0.0, lat);
+  fit.bw    = 1.0 / (1000.0 * k);
+  return fit;
+}
+
+void SetEnv(char const* name, char const* value)
+{
+  if (value) setenv(name, value, 1);
+  else unsetenv(name);
+}
+
+int main(int argc, char **argv)
+{
+  int rank, nranks;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  MPI_Comm localComm;
+  int localRank, numDevices;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &localComm);
+  MPI_Comm_rank(localComm, &localRank);
+  HIP_CALL(hipGetDeviceCount(&numDevices));
+  HIP_CALL(hipSetDevice(localRank % numDevices));
+  int nNodes = 0, isLeader = localRank == 0;
+  MPI_Allreduce(&isLeader, &nNodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+  std::vector<int> colls;
+  for (auto const& name : SplitList(getenv("COLLS") ? getenv("COLLS") : "AllReduce,AllGather,ReduceScatter,Broadcast,Reduce"))
+  {
+    int c = FindName(name.c_str(), collNames, NUM_COLLS);
+    if (c < 0)
+    {
+      if (rank == 0) printf("[ERROR] Unknown collective %s\n", name.c_str());
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    colls.push_back(c);
+  }
+  size_t      minBytes   = std::max(GetSize("MIN_BYTES", 1 << 10), sizeof(float) * nranks);
+  size_t      maxBytes   = std::max(GetSize("MAX_BYTES", 256 << 20), minBytes);
+  int         iters      = std::max(1, GetInt("NUM_ITERATIONS", 20));
+  int         warmups    = std::max(0, GetInt("NUM_WARMUPS", 5));
+  double      threshold  = GetInt("THRESHOLD", 10) / 100.0;
+  char const* outputFile = getenv("OUTPUT_FILE") ? getenv("OUTPUT_FILE") : "rccl-tuning.txt";
+  char const* csvFile    = getenv("CSV_FILE");
+
+  // Sizes are total bytes, rounded so that every rank gets whole floats
+  std::vector<size_t> sizes;
+  size_t align = sizeof(float) * nranks;
+  for (size_t b = minBytes; b <= maxBytes; b *= 2) sizes.push_back((b + align - 1) / align * align);
+
+  void *sendbuf, *recvbuf;
+  hipStream_t stream;
+  HIP_CALL(hipMalloc(&sendbuf, sizes.back()));
+  HIP_CALL(hipMalloc(&recvbuf, sizes.back()));
+  HIP_CALL(hipMemset(sendbuf, 0, sizes.back()));
+  HIP_CALL(hipStreamCreate(&stream));
+
+  // Keep what the user set, the forced combinations change NCCL_ALGO/NCCL_PROTO
+  std::string userAlgo  = getenv("NCCL_ALGO") ? getenv("NCCL_ALGO") : "";
+  std::string userProto = getenv("NCCL_PROTO") ? getenv("NCCL_PROTO") : "";
+  SetEnv("NCCL_ALGO", NULL);
+  SetEnv("NCCL_PROTO", NULL);
+
+  // Model in effect. Only rank 0 writes the dump, the usable combinations are broadcast.
+  char dumpFile[] = "/tmp/rccl-calibration-XXXXXX";
+  if (rank == 0)
+  {
+    int fd = mkstemp(dumpFile);
+    if (fd >= 0) close(fd);
+    SetEnv("RCCL_TUNING_DUMP_FILE", dumpFile);
+  }
+  ncclUniqueId id;
+  ncclComm_t defaultComm;
+  if (rank == 0) NCCL_CALL(ncclGetUniqueId(&id));
+  MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
+  NCCL_CALL(ncclCommInitRank(&defaultComm, nranks, id, rank));
+  SetEnv("RCCL_TUNING_DUMP_FILE", NULL);
+  Model model;
+  int ok = rank == 0 ? ReadModel(dumpFile, &model) : 1;
+  if (rank == 0) unlink(dumpFile);
+  MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (!ok)
+  {
+    if (rank == 0) printf("[ERROR] Unable to read the tuning model from RCCL, is RCCL_TUNING_DUMP_FILE supported?\n");
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MPI_Bcast(&model, sizeof(model), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+  // times[coll][combo][size], combo DEFAULT_COMBO is RCCL's own choice
+  int const numCombos = NUM_ALGOS * NUM_PROTOS;
+  std::vector<std::vector<std::vector<double>>> times(NUM_COLLS, std::vector<std::vector<double>>(numCombos + 1));
+  auto comboTimes = [&](int c, int combo) -> std::vector<double>& { return times[c][combo + 1]; };
+
+  if (rank == 0) printf("Calibrating %d ranks on %d node(s), model %d, %zu sizes from %zu to %zu bytes\n",
+                        nranks, nNodes, model.index, sizes.size(), sizes.front(), sizes.back());
+  for (int c : colls)
+  {
+    comboTimes(c, DEFAULT_COMBO).resize(sizes.size());
+    for (size_t s = 0; s < sizes.size(); s++)
+      comboTimes(c, DEFAULT_COMBO)[s] = TimeColl(defaultComm, stream, c, sizes[s], nranks, rank, sendbuf, recvbuf, iters, warmups);
+  }
+  NCCL_CALL(ncclCommDestroy(defaultComm));
+
+  for (int a = 0; a < NUM_ALGOS; a++) for (int p = 0; p < NUM_PROTOS; p++)
+  {
+    bool used = false;
+    for (int c : colls) used |= model.bw[c][a][p] > 0;
+    if (!used) continue;
+    SetEnv("NCCL_ALGO", algoNames[a]);
+    SetEnv("NCCL_PROTO", protoNames[p]);
+    ncclComm_t comm;
+    if (rank == 0) NCCL_CALL(ncclGetUniqueId(&id));
+    MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
+    NCCL_CALL(ncclCommInitRank(&comm, nranks, id, rank));
+    for (int c : colls)
+    {
+      if (model.bw[c][a][p] <= 0) continue;
+      std::vector<double>& t = comboTimes(c, a * NUM_PROTOS + p);
+      t.assign(sizes.size(), -1);
+      for (size_t s = 0; s < sizes.size(); s++)
+      {
+        t[s] = TimeColl(comm, stream, c, sizes[s], nranks, rank, sendbuf, recvbuf, iters, warmups);
+        if (t[s] < 0) break;
+      }
+      if (rank == 0) printf("Measured %s %s/%s\n", collNames[c], algoNames[a], protoNames[p]);
+      fflush(stdout);
+    }
+    NCCL_CALL(ncclCommDestroy(comm));
+  }
+  SetEnv("NCCL_ALGO", userAlgo.empty() ? NULL : userAlgo.c_str());
+  SetEnv("NCCL_PROTO", userProto.empty() ? NULL : userProto.c_str());
+
+  if (rank == 0)
+  {
+    FILE* csv = csvFile ? fopen(csvFile, "w") : NULL;
+    if (csvFile && !csv) printf("[ERROR] Unable to open %s\n", csvFile);
+    if (csv) fprintf(csv, "coll,algo,proto,bytes,timeUs\n");
+
+    // Fits, and the latency and bandwidth corrections they imply, averaged over the collectives
+    double latDelta[NUM_ALGOS][NUM_PROTOS] = {}, bwScaleLog[NUM_ALGOS][NUM_PROTOS] = {};
+    int    nFits[NUM_ALGOS][NUM_PROTOS] = {};
+    printf("\n%14s %14s %12s %12s %12s %12s\n", "Collective", "Algo/Proto", "ModelLat", "FitLat(us)", "ModelBw", "FitBw(GB/s)");
+    for (int c : colls) for (int a = 0; a < NUM_ALGOS; a++) for (int p = 0; p < NUM_PROTOS; p++)
+    {
+      std::vector<double> const& t = comboTimes(c, a * NUM_PROTOS + p);
+      if (t.empty()) continue;
+      if (csv) for (size_t s = 0; s < sizes.size(); s++)
+        if (t[s] > 0) fprintf(csv, "%s,%s,%s,%zu,%.2f\n", collNames[c], algoNames[a], protoNames[p], sizes[s], t[s]);
+      Fit fit = FitTimes(sizes, t);
+      if (!fit.valid) continue;
+      char name[32];
+      snprintf(name, sizeof(name), "%s/%s", algoNames[a], protoNames[p]);
+      printf("%14s %14s %12.1f %12.1f %12.1f %12.1f\n", collNames[c], name, model.lat[c][a][p], fit.lat, model.bw[c][a][p], fit.bw);
+      latDelta[a][p]   += fit.lat - model.lat[c][a][p];
+      bwScaleLog[a][p] += log(fit.bw / model.bw[c][a][p]);
+      nFits[a][p]++;
+    }
+    if (csv)
+    {
+      for (int c : colls) for (size_t s = 0; s < sizes.size(); s++)
+        fprintf(csv, "%s,default,default,%zu,%.2f\n", collNames[c], sizes[s], comboTimes(c, DEFAULT_COMBO)[s]);
+      fclose(csv);
+    }
+
+    FILE* f = fopen(outputFile, "w");
+    if (!f)
+    {
+      printf("[ERROR] Unable to write %s\n", outputFile);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int r = nNodes <= 2 ? 0 : 1;
+    fprintf(f, "version 1\n");
+    fprintf(f, "# Calibrated by TuningCalibration on %d ranks, %d node(s), %zu to %zu bytes\n", nranks, nNodes, sizes.front(), sizes.back());
+    fprintf(f, "model %d\n", model.index);
+    for (int a = 0; a < NUM_ALGOS; a++) for (int p = 0; p < NUM_PROTOS; p++)
+    {
+      if (nFits[a][p] == 0) continue;
+      fprintf(f, "baseLat %s %s %g\n", algoNames[a], protoNames[p], std::max(0.0, model.baseLat[a][p] + latDelta[a][p] / nFits[a][p]));
+      if (a <= 1) fprintf(f, "bwRatio %s %s %s %g\n", r ? "Nnodes" : "2nodes", algoNames[a], protoNames[p],
+                          model.bwRatio[r][a][p] * exp(bwScaleLog[a][p] / nFits[a][p]));
+    }
+
+    // Overrides where the measured best beats the default choice, adjacent sizes merged
+    printf("\n%14s %12s %12s %14s %12s\n", "Collective", "Bytes", "Default(us)", "Best", "Best(us)");
+    int nOverrides = 0;
+    for (int c : colls)
+    {
+      int    prevBest = DEFAULT_COMBO;
+      size_t rangeMin = 0;
+      for (size_t s = 0; s <= sizes.size(); s++)
+      {
+        int best = DEFAULT_COMBO;
+        if (s < sizes.size())
+        {
+          double defTime = comboTimes(c, DEFAULT_COMBO)[s], bestTime = defTime;
+          for (int combo = 0; combo < numCombos; combo++)
+          {
+            std::vector<double> const& t = comboTimes(c, combo);
+            if (t.empty() || t[s] <= 0) continue;
+            if (t[s] < bestTime) { bestTime = t[s]; best = combo; }
+          }
+          if (best != DEFAULT_COMBO && bestTime * (1 + threshold) > defTime) best = DEFAULT_COMBO;
+          if (best != DEFAULT_COMBO)
+          {
+            char name[32];
+            snprintf(name, sizeof(name), "%s/%s", algoNames[best / NUM_PROTOS], protoNames[best % NUM_PROTOS]);
+            printf("%14s %12zu %12.1f %14s %12.1f\n", collNames[c], sizes[s], defTime, name, bestTime);
+          }
+        }
+        // Close the range of the previous sizes when the choice changes
+        if (best != prevBest && prevBest != DEFAULT_COMBO)
+        {
+          fprintf(f, "override %s %zu %zu %s %s 0\n", collNames[c], rangeMin, sizes[s - 1],
+                  algoNames[prevBest / NUM_PROTOS], protoNames[prevBest % NUM_PROTOS]);
+          nOverrides++;
+        }
+        if (best != prevBest) rangeMin = s == 0 ? 0 : sizes[s - 1] + 1;
+        prevBest = best;
+      }
+    }
+    fclose(f);
+    printf("\nWrote %s with %d override(s), use it with RCCL_TUNING_FILE=%s\n", outputFile, nOverrides, outputFile);
+  }
+
+  HIP_CALL(hipFree(sendbuf));
+  HIP_CALL(hipFree(recvbuf));
+  HIP_CALL(hipStreamDestroy(stream));
+  MPI_Comm_free(&localComm);
+  MPI_Finalize();
+  return 0;
+}
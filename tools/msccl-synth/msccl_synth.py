@@ -0,0 +1,960 @@
+#!/usr/bin/env python3
+# Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+#
+# See LICENSE.txt for license information
+
+"""Synthesises MSCCL XML schedules from a topology XML.
+
+  generate  reads a topology (the format of NCCL_TOPO_FILE / NCCL_TOPO_DUMP_FILE and
+            tools/topo_expl/models) and writes a schedule for one collective and size range:
+              ring          one ring per channel; channels are the edge-disjoint directed
+                            rings that fit the XGMI links, so the channel count follows
+                            the link counts of the node
+              allpairs      every rank exchanges directly with every other rank,
+                            one pass, for fully connected nodes and small sizes
+              hierarchical  AllReduce over --nodes nodes: ring ReduceScatter in the node,
+                            ring AllReduce between nodes, ring AllGather in the node
+  validate  checks a schedule (generated or hand written) against the rules of
+            src/misc/msccl/msccl_parser.cc, then runs it symbolically on every rank:
+            unmatched or mismatched transfers, dependency cycles (deadlocks), buffer
+            races between thread blocks and wrong or double reductions are errors.
+  bench     loads the schedules of a directory into RCCL through rccl-tests, which
+            goes through the real parser (MSCCL WARNs fail the run), and compares the
+            bus bandwidth with MSCCL disabled.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import collections
+import os
+import re
+import subprocess
+import sys
+import xml.etree.ElementTree as ET
+
+# Limits of src/include/msccl/msccl_struct.h
+MSCCL_MAX_NUM_STEPS = 64
+MSCCL_MAX_NUM_THREAD_BLOCKS_PER_CHANNEL = 32
+MSCCL_MAX_NUM_THREAD_BLOCKS = 64
+MSCCL_MAX_COUNT = 72
+MSCCL_MAX_REDUCE_FUSION = 16
+MAXCHANNELS = 64
+
+# type: (send, recv, reads src, writes dst, reduces)
+OP_TYPES = {
+    "s":    (True,  False, True,  False, False),
+    "r":    (False, True,  False, True,  False),
+    "rcs":  (True,  True,  False, True,  False),
+    "rrs":  (True,  True,  True,  False, True),
+    "rrc":  (False, True,  True,  True,  True),
+    "rrcs": (True,  True,  True,  True,  True),
+    "cpy":  (False, False, True,  True,  False),
+    "re":   (False, False, True,  True,  True),
+    "nop":  (False, False, False, False, False),
+}
+
+SIZE_SUFFIXES = {"": 1, "K": 1 << 10, "M": 1 << 20, "G": 1 << 30}
+
+
+def parse_size(text):
+    m = re.fullmatch(r"(\d+)([KMG]?)B?", text.strip().upper())
+    if not m:
+        raise argparse.ArgumentTypeError("invalid size %s" % text)
+    return int(m.group(1)) * SIZE_SUFFIXES[m.group(2)]
+
+
+# ---------------------------------------------------------------------------
+# Topology
+
+class Topology:
+    def __init__(self, path):
+        root = ET.parse(path).getroot()
+        parents = {c: p for p in root.iter() for c in p}
+        self.gpus = {}      # rank -> busid
+        links = []
+        for gpu in root.iter("gpu"):
+            rank = int(gpu.get("rank"))
+            busid = parents[gpu].get("busid", "").lower()
+            self.gpus[rank] = busid
+            for x in gpu.iter("xgmi"):
+                links.append((rank, x.get("target").lower(), int(x.get("count", "1"))))
+        if not self.gpus:
+            raise SystemExit("%s: no <gpu> in topology" % path)
+        ranks = sorted(self.gpus)
+        if ranks != list(range(len(ranks))):
+            raise SystemExit("%s: GPU ranks %s are not 0..n-1" % (path, ranks))
+        self.n = len(ranks)
+        bus = {b: r for r, b in self.gpus.items()}
+        # Directed link capacity, XGMI links carry both directions
+        self.xgmi = collections.Counter()
+        for r, target, count in links:
+            if target in bus and bus[target] != r:
+                self.xgmi[(r, bus[target])] += count
+
+    def fully_connected(self):
+        return all(self.xgmi[(a, b)] > 0 for a in range(self.n) for b in range(self.n) if a != b)
+
+    def rings(self, max_rings):
+        """Greedy edge-disjoint directed Hamiltonian cycles over the XGMI links.
+
+        Each ring uses one unit of capacity of its links. Without XGMI (PCIe only)
+        a single ring in rank order is returned, channels then only add blocks. When the
+        XGMI links form no ring over all GPUs (several hives), one ring preferring XGMI
+        links over PCIe hops is returned with its reverse."""
+        if self.n == 1:
+            return [[0]]
+        if not self.xgmi:
+            return [list(range(self.n))]
+        cap = dict(self.xgmi)
+        rings = []
+        while len(rings) < max_rings:
+            ring = self._find_cycle(cap)
+            if ring is None:
+                break
+            for a, b in zip(ring, ring[1:] + ring[:1]):
+                cap[(a, b)] -= 1
+            rings.append(ring)
+        if not rings:
+            # PCIe hops get a capacity below every XGMI link so they are only taken when needed
+            cap = {(a, b): self.xgmi.get((a, b), 0) * self.n + 1 for a in range(self.n) for b in range(self.n) if a != b}
+            ring = self._find_cycle(cap)
+            hops = sum(1 for a, b in zip(ring, ring[1:] + ring[:1]) if not self.xgmi.get((a, b)))
+            print("note: no XGMI ring over all %d GPUs, using a ring with %d PCIe hop(s)" % (self.n, hops), file=sys.stderr)
+            rings = [ring, ring[:1] + ring[:0:-1]]
+        return rings
+
+    def _find_cycle(self, cap):
+        n = self.n
+        path, used = [0], {0}
+        # Bounded DFS, prefers the least used links so later rings still fit
+        budget = [200000]
+
+        def dfs():
+            budget[0] -= 1
+            if budget[0] < 0:
+                return False
+            cur = path[-1]
+            if len(path) == n:
+                return cap.get((cur, 0), 0) > 0
+            nexts = [b for b in range(n) if b not in used and cap.get((cur, b), 0) > 0]
+            nexts.sort(key=lambda b: (-cap[(cur, b)], (b - cur) % n))
+            for b in nexts:
+                path.append(b)
+                used.add(b)
+                if dfs():
+                    return True
+                path.pop()
+                used.discard(b)
+            return False
+
+        return list(path) if dfs() else None
+
+
+# ---------------------------------------------------------------------------
+# Schedule construction
+
+class Op:
+    def __init__(self, tb, type, src, dst, cnt, t):
+        self.tb, self.type, self.src, self.dst, self.cnt, self.t = tb, type, src, dst, cnt, t
+        self.deps = []      # (tb id, step) of other thread blocks
+        self.step = None
+        self.hasdep = False
+
+
+class ThreadBlock:
+    def __init__(self, gpu, id, send, recv, chan):
+        self.gpu, self.id, self.send, self.recv, self.chan = gpu, id, send, recv, chan
+        self.ops = []
+
+
+class Schedule:
+    """Thread blocks and their operations per rank.
+
+    Operations carry a logical time; the dependencies between thread blocks of one
+    rank are derived from it: an operation waits for the latest earlier operation of
+    each other thread block it has a read/write or write/write conflict with."""
+
+    def __init__(self, name, coll, ngpus, nchunks, nchannels, proto, ichunks, ochunks):
+        self.name, self.coll, self.ngpus, self.nchunks = name, coll, ngpus, nchunks
+        self.nchannels, self.proto, self.ichunks, self.ochunks = nchannels, proto, ichunks, ochunks
+        self.tbs = [[] for _ in range(ngpus)]
+        self.scratch = [0] * ngpus
+        self.tb_index = [{} for _ in range(ngpus)]
+
+    def tb(self, gpu, send, recv, chan):
+        key = (send, recv, chan)
+        if key not in self.tb_index[gpu]:
+            tb = ThreadBlock(gpu, len(self.tbs[gpu]), send, recv, chan)
+            self.tbs[gpu].append(tb)
+            self.tb_index[gpu][key] = tb
+        return self.tb_index[gpu][key]
+
+    def op(self, tb, type, src=None, dst=None, cnt=1, t=0):
+        """src/dst are (buffer, offset) with buffer in 'i', 'o', 's'."""
+        for b in (src, dst):
+            if b and b[0] == "s":
+                self.scratch[tb.gpu] = max(self.scratch[tb.gpu], b[1] + cnt)
+        tb.ops.append(Op(tb, type, src, dst, cnt, t))
+
+    def finalize(self):
+        for gpu in range(self.ngpus):
+            ops = [o for tb in self.tbs[gpu] for o in tb.ops]
+            for tb in self.tbs[gpu]:
+                tb.ops.sort(key=lambda o: o.t)
+            for o in ops:
+                o._r, o._w = footprint(self, gpu, o)
+            # Conflicts, only the latest earlier op of each thread block; program order covers the rest
+            for o in ops:
+                latest = {}
+                for p in ops:
+                    if p.tb is o.tb or p.t >= o.t:
+                        continue
+                    if (o._r & p._w) or (o._w & p._w) or (o._w & p._r):
+                        if p.tb.id not in latest or latest[p.tb.id].t < p.t:
+                            latest[p.tb.id] = p
+                o._depops = [latest[k] for k in sorted(latest)]
+            # Drop dependencies already waited for earlier in the same thread block
+            for tb in self.tbs[gpu]:
+                seen = {}
+                for o in tb.ops:
+                    keep = [p for p in o._depops if seen.get(p.tb.id, -1) < p.t]
+                    for p in keep:
+                        seen[p.tb.id] = p.t
+                    o._depops = keep
+            # A run of reductions into the same chunk waits for everything up front, so that
+            # the parser fuses it into one multi-source reduction
+            for tb in self.tbs[gpu]:
+                i = 0
+                while i < len(tb.ops):
+                    j = i + 1
+                    while (j < len(tb.ops) and j - i < MSCCL_MAX_REDUCE_FUSION and tb.ops[j].type == "re" == tb.ops[i].type
+                           and tb.ops[j].dst == tb.ops[i].dst and tb.ops[j].src[0] == tb.ops[i].src[0]):
+                        j += 1
+                    if j - i > 1:
+                        latest = {}
+                        for o in tb.ops[i:j]:
+                            for p in o._depops:
+                                if p.tb.id not in latest or latest[p.tb.id].t < p.t:
+                                    latest[p.tb.id] = p
+                            o._depops = []
+                        tb.ops[i]._depops = [latest[k] for k in sorted(latest)]
+                    i = j
+            # Step numbers count the nops that carry extra dependencies
+            for tb in self.tbs[gpu]:
+                s = 0
+                for o in tb.ops:
+                    s += max(0, len(o._depops) - 1)
+                    o.step = s
+                    s += 1
+                if s > MSCCL_MAX_NUM_STEPS:
+                    raise SystemExit("gpu %d thread block %d needs %d steps, more than %d" % (gpu, tb.id, s, MSCCL_MAX_NUM_STEPS))
+            for o in ops:
+                o.deps = [(p.tb.id, p.step) for p in o._depops]
+                for p in o._depops:
+                    p.hasdep = True
+
+    def xml(self, min_bytes, max_bytes):
+        lines = ['<algo name="%s" proto="%s" nchannels="%d" nchunksperloop="%d" ngpus="%d" coll="%s" inplace="1" outofplace="1" minBytes="%d" maxBytes="%d">'
+                 % (self.name, self.proto, self.nchannels, self.nchunks, self.ngpus, self.coll, min_bytes, max_bytes)]
+        for gpu in range(self.ngpus):
+            lines.append('  <gpu id="%d" i_chunks="%d" o_chunks="%d" s_chunks="%d">' % (gpu, self.ichunks, self.ochunks, self.scratch[gpu]))
+            for tb in self.tbs[gpu]:
+                lines.append('    <tb id="%d" send="%d" recv="%d" chan="%d">' % (tb.id, tb.send, tb.recv, tb.chan))
+                for o in tb.ops:
+                    first = o.step - max(0, len(o.deps) - 1)
+                    for k, (dtb, dstep) in enumerate(o.deps[:-1]):
+                        lines.append('      <step s="%d" type="nop" srcbuf="i" srcoff="-1" dstbuf="o" dstoff="-1" cnt="0" depid="%d" deps="%d" hasdep="0"/>'
+                                     % (first + k, dtb, dstep))
+                    depid, deps = o.deps[-1] if o.deps else (-1, -1)
+                    src = o.src or ("i", -1)
+                    dst = o.dst or ("o", -1)
+                    lines.append('      <step s="%d" type="%s" srcbuf="%s" srcoff="%d" dstbuf="%s" dstoff="%d" cnt="%d" depid="%d" deps="%d" hasdep="%d"/>'
+                                 % (o.step, o.type, src[0], src[1], dst[0], dst[1], o.cnt, depid, deps, int(o.hasdep)))
+                lines.append('    </tb>')
+            lines.append('  </gpu>')
+        lines.append('</algo>')
+        return "\n".join(lines) + "\n"
+
+
+def canonical(coll, ngpus, ichunks, ochunks, gpu, buf, off):
+    """Storage location of a chunk when the collective runs in place."""
+    if buf == "s":
+        return ("s", off)
+    if coll == "allgather" and buf == "i":
+        return ("o", gpu * ichunks + off)
+    if coll == "reducescatter" and buf == "o":
+        return ("i", gpu * ochunks + off)
+    if coll in ("allreduce", "reduce", "broadcast") and buf == "i":
+        return ("o", off)
+    return (buf, off)
+
+
+def footprint(sched, gpu, o):
+    """Locations read and written by an op, in place aliasing included."""
+    send, recv, rsrc, wdst, red = OP_TYPES[o.type]
+    r, w = set(), set()
+    for k in range(o.cnt):
+        if rsrc and o.src:
+            r.add(canonical(sched.coll, sched.ngpus, sched.ichunks, sched.ochunks, gpu, o.src[0], o.src[1] + k))
+        if send and not recv and o.src:
+            r.add(canonical(sched.coll, sched.ngpus, sched.ichunks, sched.ochunks, gpu, o.src[0], o.src[1] + k))
+        if wdst and o.dst:
+            loc = canonical(sched.coll, sched.ngpus, sched.ichunks, sched.ochunks, gpu, o.dst[0], o.dst[1] + k)
+            w.add(loc)
+            if o.type == "re":
+                r.add(loc)
+    return r, w
+
+
+# ---------------------------------------------------------------------------
+# Generators
+
+def ring_allreduce(sched, rings, nch, n):
+    for c in range(nch):
+        ring = rings[c % len(rings)]
+        for p, gpu in enumerate(ring):
+            tb = sched.tb(gpu, ring[(p + 1) % n], ring[(p - 1) % n], c)
+            chunk = lambda t: c * n + (p - t) % n
+            sched.op(tb, "s", src=("i", chunk(0)), t=0)
+            for t in range(1, n - 1):
+                sched.op(tb, "rrs", src=("i", chunk(t)), t=t)
+            sched.op(tb, "rrcs", src=("i", chunk(n - 1)), dst=("o", chunk(n - 1)), t=n - 1)
+            for t in range(n, 2 * n - 2):
+                sched.op(tb, "rcs", dst=("o", chunk(t)), t=t)
+            sched.op(tb, "r", dst=("o", chunk(2 * n - 2)), t=2 * n - 2)
+
+
+def ring_allgather(sched, rings, nch, n):
+    for c in range(nch):
+        ring = rings[c % len(rings)]
+        for p, gpu in enumerate(ring):
+            tb = sched.tb(gpu, ring[(p + 1) % n], ring[(p - 1) % n], c)
+            owner = lambda t: ring[(p - t) % n]
+            sched.op(tb, "s", src=("i", c), t=0)
+            sched.op(tb, "cpy", src=("i", c), dst=("o", gpu * nch + c), t=0.5)
+            for t in range(1, n - 1):
+                sched.op(tb, "rcs", dst=("o", owner(t) * nch + c), t=t)
+            sched.op(tb, "r", dst=("o", owner(n - 1) * nch + c), t=n - 1)
+
+
+def ring_reducescatter(sched, rings, nch, n):
+    for c in range(nch):
+        ring = rings[c % len(rings)]
+        for p, gpu in enumerate(ring):
+            tb = sched.tb(gpu, ring[(p + 1) % n], ring[(p - 1) % n], c)
+            owner = lambda t: ring[(p - t - 1) % n]
+            sched.op(tb, "s", src=("i", owner(0) * nch + c), t=0)
+            for t in range(1, n - 1):
+                sched.op(tb, "rrs", src=("i", owner(t) * nch + c), t=t)
+            sched.op(tb, "rrc", src=("i", gpu * nch + c), dst=("o", c), t=n - 1)
+
+
+def allpairs_allreduce(sched, nch, n):
+    # Rank g owns chunks g*nch..g*nch+nch-1: every peer sends them to g, g reduces and sends the result back
+    for gpu in range(n):
+        for c in range(nch):
+            own = gpu * nch + c
+            red = sched.tb(gpu, -1, -1, c)
+            sched.op(red, "cpy", src=("i", own), dst=("o", own), t=1)
+            slot = 0
+            for peer in range(n):
+                if peer == gpu:
+                    continue
+                tb = sched.tb(gpu, peer, peer, c)
+                sched.op(tb, "s", src=("i", peer * nch + c), t=0)
+                sched.op(tb, "r", dst=("s", slot * nch + c), t=0.5)
+                sched.op(red, "re", src=("s", slot * nch + c), dst=("o", own), t=2 + slot)
+                sched.op(tb, "s", src=("o", own), t=n + 2)
+                sched.op(tb, "r", dst=("o", peer * nch + c), t=n + 2.5)
+                slot += 1
+
+
+def allpairs_allgather(sched, nch, n):
+    for gpu in range(n):
+        for c in range(nch):
+            # After the sends: in place it rewrites the chunk they read
+            cp = sched.tb(gpu, -1, -1, c)
+            sched.op(cp, "cpy", src=("i", c), dst=("o", gpu * nch + c), t=1)
+            for peer in range(n):
+                if peer == gpu:
+                    continue
+                tb = sched.tb(gpu, peer, peer, c)
+                sched.op(tb, "s", src=("i", c), t=0)
+                sched.op(tb, "r", dst=("o", peer * nch + c), t=0.5)
+
+
+def hierarchical_allreduce(sched, rings, nch, nodes, local):
+    """ngpus = nodes*local, rank = node*local + local rank. Chunk block b (nodes chunks)
+    ends reduced over the node on local rank b, is reduced between nodes by the ring of
+    local rank b, then gathered in the node."""
+    n = nodes * local
+    for node in range(nodes):
+        for c in range(nch):
+            ring = rings[c % len(rings)]
+            base = c * n
+            for p, lr in enumerate(ring):
+                gpu = node * local + lr
+                blk = lambda b: base + b * nodes
+                tb = sched.tb(gpu, node * local + ring[(p + 1) % local], node * local + ring[(p - 1) % local], c)
+                # ReduceScatter in the node, block of ring position q is owned by local rank ring[q]
+                if local > 1:
+                    owner = lambda t: ring[(p - t - 1) % local]
+                    sched.op(tb, "s", src=("i", blk(owner(0))), cnt=nodes, t=0)
+                    for t in range(1, local - 1):
+                        sched.op(tb, "rrs", src=("i", blk(owner(t))), cnt=nodes, t=t)
+                    sched.op(tb, "rrc", src=("i", blk(lr)), dst=("o", blk(lr)), cnt=nodes, t=local - 1)
+                else:
+                    tb2 = sched.tb(gpu, -1, -1, c)
+                    sched.op(tb2, "cpy", src=("i", blk(lr)), dst=("o", blk(lr)), cnt=nodes, t=0)
+                # Ring AllReduce of the block between nodes, one chunk per node
+                t0 = local
+                if nodes > 1:
+                    xtb = sched.tb(gpu, ((node + 1) % nodes) * local + lr, ((node - 1) % nodes) * local + lr, c)
+                    chunk = lambda t: blk(lr) + (node - t) % nodes
+                    sched.op(xtb, "s", src=("o", chunk(0)), t=t0)
+                    for t in range(1, nodes - 1):
+                        sched.op(xtb, "rrs", src=("o", chunk(t)), t=t0 + t)
+                    sched.op(xtb, "rrcs", src=("o", chunk(nodes - 1)), dst=("o", chunk(nodes - 1)), t=t0 + nodes - 1)
+                    for t in range(nodes, 2 * nodes - 2):
+                        sched.op(xtb, "rcs", dst=("o", chunk(t)), t=t0 + t)
+                    sched.op(xtb, "r", dst=("o", chunk(2 * nodes - 2)), t=t0 + 2 * nodes - 2)
+                # AllGather of the blocks in the node
+                t1 = t0 + 2 * nodes
+                if local > 1:
+                    owner = lambda t: ring[(p - t) % local]
+                    sched.op(tb, "s", src=("o", blk(lr)), cnt=nodes, t=t1)
+                    for t in range(1, local - 1):
+                        sched.op(tb, "rcs", dst=("o", blk(owner(t))), cnt=nodes, t=t1 + t)
+                    sched.op(tb, "r", dst=("o", blk(owner(local - 1))), cnt=nodes, t=t1 + local - 1)
+
+
+def generate(args):
+    topo = Topology(args.topo)
+    local = topo.n
+    nodes = args.nodes
+    n = local * nodes
+    coll, algo = args.coll, args.algo
+    if algo == "auto":
+        if nodes > 1:
+            algo = "hierarchical"
+        elif topo.fully_connected() and args.max_bytes <= (1 << 20):
+            algo = "allpairs"
+        else:
+            algo = "ring"
+    if nodes > 1 and algo != "hierarchical":
+        raise SystemExit("--nodes > 1 needs --algo hierarchical")
+    if algo == "hierarchical" and coll != "allreduce":
+        raise SystemExit("the hierarchical schedule is only available for allreduce")
+    if algo == "allpairs" and coll == "reducescatter":
+        raise SystemExit("allpairs is available for allreduce and allgather")
+    if algo == "allpairs" and not topo.fully_connected():
+        print("warning: the node is not fully connected over XGMI, allpairs goes through PCIe for some pairs", file=sys.stderr)
+
+    rings = topo.rings(MAXCHANNELS)
+    if args.channels:
+        nch = args.channels
+    elif algo == "allpairs":
+        nch = 1
+    else:
+        # One channel per disjoint ring, the kernel needs enough blocks to fill the links
+        nch = len(rings) * args.blocks_per_ring
+    if algo == "allpairs":
+        tbs = nch * n
+    elif algo == "hierarchical":
+        tbs = nch * (1 + (nodes > 1) + (local == 1))
+    else:
+        tbs = nch
+    if nch > MAXCHANNELS or tbs > MSCCL_MAX_NUM_THREAD_BLOCKS:
+        raise SystemExit("%d channels need %d thread blocks per rank, at most %d channels and %d thread blocks are supported"
+                         % (nch, tbs, MAXCHANNELS, MSCCL_MAX_NUM_THREAD_BLOCKS))
+
+    proto = args.proto
+    if proto == "auto":
+        proto = "LL" if args.max_bytes <= (64 << 10) else "Simple"
+
+    perloop = n * nch
+    if coll == "allreduce":
+        ichunks, ochunks = perloop, perloop
+    elif coll == "allgather":
+        ichunks, ochunks = nch, perloop
+    else:
+        ichunks, ochunks = perloop, nch
+    name = args.name or "%s-%s-%dn-%dch" % (coll, algo, n, nch)
+    sched = Schedule(name, coll, n, perloop, nch, proto, ichunks, ochunks)
+    if algo == "ring":
+        {"allreduce": ring_allreduce, "allgather": ring_allgather, "reducescatter": ring_reducescatter}[coll](sched, rings, nch, n)
+    elif algo == "allpairs":
+        {"allreduce": allpairs_allreduce, "allgather": allpairs_allgather}[coll](sched, nch, n)
+    else:
+        hierarchical_allreduce(sched, rings, nch, nodes, local)
+    sched.finalize()
+    text = sched.xml(args.min_bytes, args.max_bytes)
+
+    errors = validate_text(text)
+    if errors:
+        for e in errors[:20]:
+            print("error: %s" % e, file=sys.stderr)
+        raise SystemExit("generated schedule is invalid, not written")
+    out = args.output or ("%s-%s-%s.xml" % (name, human(args.min_bytes), human(args.max_bytes)))
+    with open(out, "w") as f:
+        f.write(text)
+    print("%s: %s %s, %d ranks, %d channels (%d rings found), proto %s, %d-%d bytes, validated"
+          % (out, algo, coll, n, nch, len(rings), proto, args.min_bytes, args.max_bytes))
+
+
+def human(b):
+    for unit, div in (("gb", 1 << 30), ("mb", 1 << 20), ("kb", 1 << 10)):
+        if b >= div and b % div == 0:
+            return "%d%s" % (b // div, unit)
+    return "%db" % b
+
+
+# ---------------------------------------------------------------------------
+# Validation
+
+class Step:
+    pass
+
+
+def load_algo(text):
+    root = ET.fromstring(text)
+    if root.tag != "algo":
+        raise ValueError("top node is <%s>, expected <algo>" % root.tag)
+    return root
+
+
+def check_parser_rules(root, errors):
+    """Mirrors the checks of mscclGetAlgoFromXmlFile and returns the steps per (gpu, tb)."""
+    def attr(node, name, conv=int):
+        v = node.get(name)
+        if v is None:
+            raise ValueError("<%s> has no attribute %s" % (node.tag, name))
+        return conv(v)
+
+    prog = {}
+    ngpus = attr(root, "ngpus")
+    nch = attr(root, "nchannels")
+    proto = attr(root, "proto", str)
+    coll = attr(root, "coll", str)
+    for a in ("nchunksperloop", "minBytes", "maxBytes", "inplace", "outofplace"):
+        attr(root, a)
+    if proto not in ("Simple", "LL128", "LL"):
+        errors.append("protocol %s is not supported" % proto)
+    if coll not in ("reduce", "broadcast", "allreduce", "reducescatter", "allgather", "send", "recv", "gather", "scatter", "alltoall", "alltoallv"):
+        errors.append("unsupported collective %s" % coll)
+    if nch > MAXCHANNELS:
+        errors.append("nchannels %d > %d" % (nch, MAXCHANNELS))
+    # Chunks of the user buffers per loop; in place schedules may declare 0 input chunks
+    per_loop = attr(root, "nchunksperloop")
+    sizes = {"allgather": (per_loop // ngpus, per_loop), "reducescatter": (per_loop, per_loop // ngpus),
+             "allreduce": (per_loop, per_loop)}
+    meta = {"ngpus": ngpus, "coll": coll, "chunks": {}, "user": sizes.get(coll)}
+    gpus = [g for g in root if g.tag == "gpu"]
+    if sorted(attr(g, "id") for g in gpus) != list(range(ngpus)):
+        errors.append("gpu ids are not 0..%d" % (ngpus - 1))
+    for g in gpus:
+        gid = attr(g, "id")
+        ic, oc, sc = attr(g, "i_chunks"), attr(g, "o_chunks"), attr(g, "s_chunks")
+        meta["chunks"][gid] = (ic, oc, sc)
+        if sc < 0:
+            errors.append("gpu %d: s_chunks must not be negative" % gid)
+        chan_send = collections.Counter()
+        chan_recv = collections.Counter()
+        peer_chan = set()
+        ids = []
+        for tbn in g:
+            if tbn.tag != "tb":
+                continue
+            bid, recv, send, chan = attr(tbn, "id"), attr(tbn, "recv"), attr(tbn, "send"), attr(tbn, "chan")
+            where = "gpu %d tb %d" % (gid, bid)
+            ids.append(bid)
+            if bid < 0 or bid >= MSCCL_MAX_NUM_THREAD_BLOCKS:
+                errors.append("%s: thread block id out of range (max %d)" % (where, MSCCL_MAX_NUM_THREAD_BLOCKS))
+            if recv == gid or send == gid:
+                errors.append("%s: peer and gpu id must be different" % where)
+            if recv < -1 or send < -1 or recv >= ngpus or send >= ngpus:
+                errors.append("%s: wrong recv peer %d or send peer %d" % (where, recv, send))
+            if chan < 0 or chan >= nch:
+                errors.append("%s: invalid channel %d" % (where, chan))
+            # The kernel indexes connections by (peer, channel)
+            for kind, peer in (("send", send), ("recv", recv)):
+                if peer >= 0:
+                    if (kind, peer, chan) in peer_chan:
+                        errors.append("%s: a second thread block %ss to %d on channel %d" % (where, kind, peer, chan))
+                    peer_chan.add((kind, peer, chan))
+            if send >= 0:
+                chan_send[chan] += 1
+            if recv >= 0:
+                chan_recv[chan] += 1
+            steps = []
+            ndeps_pending = 0
+            red_prev = None
+            kstep = nfused = 0
+            for sn in tbn:
+                if sn.tag != "step":
+                    continue
+                st = Step()
+                st.s, st.type = attr(sn, "s"), attr(sn, "type", str)
+                st.srcbuf, st.srcoff = attr(sn, "srcbuf", str), attr(sn, "srcoff")
+                st.dstbuf, st.dstoff = attr(sn, "dstbuf", str), attr(sn, "dstoff")
+                st.cnt, st.depid, st.deps, st.hasdep = attr(sn, "cnt"), attr(sn, "depid"), attr(sn, "deps"), attr(sn, "hasdep")
+                swhere = "%s step %d" % (where, st.s)
+                if st.s < 0 or st.s >= MSCCL_MAX_NUM_STEPS:
+                    errors.append("%s: step out of range (max %d)" % (swhere, MSCCL_MAX_NUM_STEPS))
+                if st.type not in OP_TYPES:
+                    errors.append("%s: type %s is not supported" % (swhere, st.type))
+                    continue
+                for b in (st.srcbuf, st.dstbuf):
+                    if b not in ("i", "o", "s"):
+                        errors.append("%s: buffer %s is not supported" % (swhere, b))
+                if st.depid >= 0:
+                    ndeps_pending += 1
+                # The kernel step counter: nops advance it through the dependencies they carry,
+                # fused reductions one step per reduction
+                fused = (st.type == "re" and red_prev == (st.dstbuf, st.dstoff, st.srcbuf) and st.depid < 0)
+                if st.type == "nop":
+                    st.kstep = None
+                    steps.append(st)
+                    continue
+                if fused:
+                    nfused += 1
+                else:
+                    kstep += max(0, ndeps_pending - 1)
+                    if ndeps_pending > 0 and st.depid < 0:
+                        errors.append("%s: a chain of dependencies must end on this instruction" % swhere)
+                    ndeps_pending = 0
+                    nfused = 1
+                st.kstep = kstep
+                kstep += 1
+                if st.type == "re" and not st.hasdep and nfused < MSCCL_MAX_REDUCE_FUSION:
+                    red_prev = (st.dstbuf, st.dstoff, st.srcbuf)
+                else:
+                    red_prev = None
+                if st.cnt < 0 or st.cnt >= MSCCL_MAX_COUNT:
+                    errors.append("%s: count %d must be in [0, %d)" % (swhere, st.cnt, MSCCL_MAX_COUNT))
+                hs, hr, rs, wd, _ = OP_TYPES[st.type]
+                if hs and send < 0:
+                    errors.append("%s: send without a send peer" % swhere)
+                if hr and recv < 0:
+                    errors.append("%s: recv without a recv peer" % swhere)
+                checks = []
+                if st.type in ("s", "rrs", "rrcs", "cpy", "re"):
+                    checks.append((st.srcbuf, st.srcoff))
+                if st.type in ("r", "rcs", "rrcs", "cpy", "re"):
+                    checks.append((st.dstbuf, st.dstoff))
+                # Not checked by the parser, but read and written by the kernel all the same
+                extra = []
+                if st.type == "rrc":
+                    extra = [(st.srcbuf, st.srcoff), (st.dstbuf, st.dstoff)]
+                for b, off in checks + extra:
+                    limit = {"i": ic, "o": oc, "s": sc}.get(b, 0)
+                    if off < -1 or off >= limit:
+                        errors.append("%s: offset %d of buffer %s outside %d chunks" % (swhere, off, b, limit))
+                    elif off + st.cnt > limit:
+                        errors.append("%s: %d chunks at offset %d run past the %d chunks of buffer %s" % (swhere, st.cnt, off, limit, b))
+                if st.hasdep not in (0, 1):
+                    errors.append("%s: hasdep must be 0 or 1" % swhere)
+                steps.append(st)
+            if ndeps_pending:
+                errors.append("%s: dependencies after the last instruction" % where)
+            prog[(gid, bid)] = (send, recv, chan, steps)
+        if sorted(ids) != list(range(len(ids))):
+            errors.append("gpu %d: thread block ids must be 0..%d" % (gid, len(ids) - 1))
+        for chan, k in list(chan_send.items()) + list(chan_recv.items()):
+            if k > MSCCL_MAX_NUM_THREAD_BLOCKS_PER_CHANNEL:
+                errors.append("gpu %d: more than %d sends or recvs on channel %d" % (gid, MSCCL_MAX_NUM_THREAD_BLOCKS_PER_CHANNEL, chan))
+    return meta, prog
+
+
+def simulate(meta, prog, inplace, errors):
+    """Runs every thread block symbolically. Values are multisets of (rank, input chunk)."""
+    coll, ngpus = meta["coll"], meta["ngpus"]
+    mem = {}
+
+    def loc(gpu, buf, off):
+        ic, oc = meta["user"] or meta["chunks"][gpu][:2]
+        if inplace:
+            return (gpu,) + canonical(coll, ngpus, ic, oc, gpu, buf, off)
+        return (gpu, buf, off)
+
+    for gpu in range(ngpus):
+        ic = (meta["user"] or meta["chunks"][gpu])[0]
+        for k in range(ic):
+            mem[loc(gpu, "i", k)] = collections.Counter({(gpu, k): 1})
+
+    # A dependency on (tb, step) is released by the first flag store of tb at or after
+    # step, flags are only stored by hasdep=1 instructions
+    release = {}
+    for (gpu, bid), (_, _, _, steps) in prog.items():
+        for st in steps:
+            if st.depid < 0:
+                continue
+            key = (gpu, st.depid, st.deps)
+            if key in release:
+                continue
+            other = prog.get((gpu, st.depid))
+            idx = None
+            if other:
+                idx = next((j for j, o in enumerate(other[3]) if o.kstep is not None and o.hasdep and o.kstep >= st.deps), None)
+            if idx is None:
+                errors.append("gpu %d tb %d step %d: depends on tb %d step %d, but no hasdep=1 step of that thread block sets its flag that far"
+                              % (gpu, bid, st.s, st.depid, st.deps))
+            release[key] = idx
+    if errors:
+        return
+
+    pc = {k: 0 for k in prog}
+    queues = collections.defaultdict(collections.deque)
+    access = collections.defaultdict(list)  # location -> [(gpu, tb, op index, write)]
+    # Happens-before as bitsets, one bit per (tb, op)
+    opid = {}
+    for key, (_, _, _, steps) in prog.items():
+        for i in range(len(steps)):
+            opid[(key, i)] = len(opid)
+    hb = {}
+
+    def value(gpu, buf, off, what):
+        v = mem.get(loc(gpu, buf, off))
+        if v is None:
+            errors.append("gpu %d: %s reads %s[%d] before it is written" % (gpu, what, buf, off))
+            return collections.Counter()
+        return v
+
+    progress = True
+    while progress:
+        progress = False
+        for key, (send, recv, chan, steps) in prog.items():
+            gpu, bid = key
+            while pc[key] < len(steps):
+                i = pc[key]
+                st = steps[i]
+                # Dependencies of the nops before an instruction are waited for with it
+                if st.depid >= 0 and pc[(gpu, st.depid)] <= release[(gpu, st.depid, st.deps)]:
+                    break
+                if st.type in ("r", "rcs", "rrs", "rrc", "rrcs") and not queues[(recv, gpu, chan)]:
+                    break
+                before = hb.get((key, i - 1), 0) if i else 0
+                if st.depid >= 0:
+                    before |= hb[((gpu, st.depid), release[(gpu, st.depid, st.deps)])]
+                if st.type == "nop":
+                    hb[(key, i)] = before
+                    pc[key] += 1
+                    continue
+                ctx = "tb %d step %d %s" % (bid, st.s, st.type)
+                hs, hr, rs, wd, red = OP_TYPES[st.type]
+                vals = []
+                if hr:
+                    msg, sender_hb, cnt = queues[(recv, gpu, chan)].popleft()
+                    before |= sender_hb
+                    if cnt != st.cnt:
+                        errors.append("gpu %d %s: receives %d chunks from %d, %d were sent" % (gpu, ctx, st.cnt, recv, cnt))
+                        return
+                    vals = msg
+                if rs or st.type == "s":
+                    src = [value(gpu, st.srcbuf, st.srcoff + k, ctx) for k in range(st.cnt)]
+                    vals = [a + b for a, b in zip(vals, src)] if red and hr else src
+                if st.type == "re":
+                    vals = [value(gpu, st.dstbuf, st.dstoff + k, ctx) + v for k, v in enumerate(vals)]
+                me = 1 << opid[(key, i)]
+                hb[(key, i)] = before | me
+                # Races: conflicting accesses of other thread blocks must happen before this one
+                touched = []
+                if rs or st.type == "s":
+                    touched += [(loc(gpu, st.srcbuf, st.srcoff + k), False) for k in range(st.cnt)]
+                if wd:
+                    touched += [(loc(gpu, st.dstbuf, st.dstoff + k), True) for k in range(st.cnt)]
+                for l, write in touched:
+                    for (okey, oi, owrite) in access[l]:
+                        if okey != key and (write or owrite) and not (before >> opid[(okey, oi)]) & 1:
+                            errors.append("gpu %d: %s and tb %d step %d access %s[%d] without a dependency"
+                                          % (gpu, ctx, okey[1], prog[okey][3][oi].s, l[1], l[2]))
+                    access[l].append((key, i, write))
+                if wd:
+                    for k, v in enumerate(vals):
+                        mem[loc(gpu, st.dstbuf, st.dstoff + k)] = v
+                if hs:
+                    queues[(gpu, send, chan)].append((vals, hb[(key, i)], st.cnt))
+                pc[key] += 1
+                progress = True
+            if errors:
+                return
+
+    stuck = ["gpu %d tb %d at step %d (%s)" % (k[0], k[1], prog[k][3][pc[k]].s, prog[k][3][pc[k]].type)
+             for k in prog if pc[k] < len(prog[k][3])]
+    if stuck:
+        errors.append("deadlock, blocked: " + ", ".join(stuck[:8]) + (" ..." if len(stuck) > 8 else ""))
+        return
+    for q, msgs in queues.items():
+        if msgs:
+            errors.append("%d transfers from gpu %d to gpu %d on channel %d are never received" % (len(msgs), q[0], q[1], q[2]))
+
+    # Expected results
+    for gpu in range(ngpus):
+        if meta["user"] is None:
+            return
+        ic, oc = meta["user"]
+        for k in range(oc):
+            if coll == "allreduce":
+                want = collections.Counter({(r, k): 1 for r in range(ngpus)})
+            elif coll == "allgather":
+                want = collections.Counter({(k // ic, k % ic): 1})
+            elif coll == "reducescatter":
+                want = collections.Counter({(r, gpu * oc + k): 1 for r in range(ngpus)})
+            else:
+                return
+            got = mem.get(loc(gpu, "o", k))
+            if got != want:
+                desc = "nothing" if got is None else ("%d contributions%s" % (sum(got.values()), ", some twice" if any(v > 1 for v in got.values()) else ""))
+                errors.append("gpu %d: output chunk %d has %s, expected %d contributions" % (gpu, k, desc, len(want)))
+                return
+
+
+def validate_text(text):
+    errors = []
+    try:
+        root = load_algo(text)
+        meta, prog = check_parser_rules(root, errors)
+    except (ET.ParseError, ValueError) as e:
+        return [str(e)]
+    if errors:
+        return errors
+    modes = []
+    if root.get("outofplace") == "1":
+        modes.append(False)
+    if root.get("inplace") == "1":
+        modes.append(True)
+    for inplace in modes:
+        errs = []
+        simulate(meta, prog, inplace, errs)
+        errors += ["%s: %s" % ("in place" if inplace else "out of place", e) for e in errs]
+    return errors
+
+
+def validate(args):
+    failed = 0
+    for path in args.xml:
+        with open(path) as f:
+            errors = validate_text(f.read())
+        if errors:
+            failed += 1
+            print("%s: %d error(s)" % (path, len(errors)))
+            for e in errors[:args.max_errors]:
+                print("  " + e)
+        else:
+            print("%s: ok" % path)
+    return 1 if failed else 0
+
+
+# ---------------------------------------------------------------------------
+# Benchmark
+
+COLL_TESTS = {"allreduce": "all_reduce_perf", "allgather": "all_gather_perf", "reducescatter": "reduce_scatter_perf"}
+
+
+def run_test(cmd, env, show):
+    if show:
+        print("+ " + " ".join(cmd), file=sys.stderr)
+    p = subprocess.run(cmd, env=env, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    results = {}
+    warns = []
+    for line in p.stdout.splitlines():
+        if "WARN" in line and "MSCCL" in line:
+            warns.append(line.strip())
+        f = line.split()
+        # size count type redop root time algbw busbw ..., out of place columns first
+        if len(f) >= 8 and f[0].isdigit() and f[1].isdigit():
+            try:
+                results[int(f[0])] = float(f[7])
+            except ValueError:
+                pass
+    return p.returncode, results, warns, p.stdout
+
+
+def bench(args):
+    algo_dir = os.path.abspath(args.dir)
+    xmls = [x for x in sorted(os.listdir(algo_dir)) if x.endswith(".xml")]
+    if not xmls:
+        raise SystemExit("no .xml schedule in %s" % algo_dir)
+    colls = set()
+    for x in xmls:
+        root = ET.parse(os.path.join(algo_dir, x)).getroot()
+        colls.add(root.get("coll"))
+        errors = validate_text(open(os.path.join(algo_dir, x)).read())
+        if errors:
+            raise SystemExit("%s does not validate, first error: %s" % (x, errors[0]))
+    launcher = args.launcher.split() if args.launcher else []
+    status = 0
+    for coll in sorted(colls & set(COLL_TESTS)):
+        binary = os.path.join(args.rccl_tests, COLL_TESTS[coll])
+        if not os.access(binary, os.X_OK):
+            raise SystemExit("%s not found, --rccl-tests is the build directory of rccl-tests" % binary)
+        cmd = launcher + [binary, "-b", str(args.min_bytes), "-e", str(args.max_bytes), "-f", "2",
+                          "-g", str(args.gpus), "-n", str(args.iters), "-w", str(args.warmup), "-c", "1"]
+        env = dict(os.environ)
+        env.update({"MSCCL_ALGO_DIR": algo_dir, "RCCL_MSCCL_ENABLE": "1", "RCCL_MSCCL_FORCE_ENABLE": "1",
+                    "NCCL_DEBUG": env.get("NCCL_DEBUG", "WARN"), "NCCL_DEBUG_SUBSYS": "INIT,COLL"})
+        rc, msccl, warns, out = run_test(cmd, env, args.verbose)
+        if rc != 0 or warns:
+            print("%s with MSCCL failed (exit %d)" % (COLL_TESTS[coll], rc))
+            for w in warns[:10]:
+                print("  " + w)
+            if args.verbose or not warns:
+                print(out)
+            status = 1
+            continue
+        env["RCCL_MSCCL_ENABLE"] = "0"
+        rc, base, _, _ = run_test(cmd, env, args.verbose)
+        print("%s, busbw GB/s out of place" % coll)
+        print("%12s %10s %10s %8s" % ("bytes", "msccl", "default", "speedup"))
+        for size in sorted(msccl):
+            b = base.get(size)
+            print("%12d %10.2f %10s %8s" % (size, msccl[size], "%.2f" % b if b else "-",
+                                             "%.2f" % (msccl[size] / b) if b else "-"))
+    return status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd")
+    sub.required = True
+
+    g = sub.add_parser("generate", help="synthesise a schedule from a topology XML")
+    g.add_argument("--topo", required=True, help="topology XML of one node")
+    g.add_argument("--coll", required=True, choices=["allreduce", "allgather", "reducescatter"])
+    g.add_argument("--algo", default="auto", choices=["auto", "ring", "allpairs", "hierarchical"])
+    g.add_argument("--nodes", type=int, default=1, help="nodes of the job, hierarchical only (default 1)")
+    g.add_argument("--min-bytes", type=parse_size, default=0)
+    g.add_argument("--max-bytes", type=parse_size, default=parse_size("1G"))
+    g.add_argument("--proto", default="auto", choices=["auto", "Simple", "LL128", "LL"])
+    g.add_argument("--channels", type=int, default=0, help="override the channel count (default: from the rings found)")
+    g.add_argument("--blocks-per-ring", type=int, default=1, help="channels per ring found (default 1)")
+    g.add_argument("--name", help="algo name attribute")
+    g.add_argument("-o", "--output", help="output file (default: derived from the schedule)")
+
+    v = sub.add_parser("validate", help="check schedules like msccl_parser.cc and simulate them")
+    v.add_argument("xml", nargs="+")
+    v.add_argument("--max-errors", type=int, default=10)
+
+    b = sub.add_parser("bench", help="benchmark the schedules of a directory with rccl-tests")
+    b.add_argument("dir", help="directory of XML schedules, used as MSCCL_ALGO_DIR")
+    b.add_argument("--rccl-tests", required=True, help="build directory of rccl-tests")
+    b.add_argument("-g", "--gpus", type=int, default=8, help="GPUs per process (-g), 1 with a launcher")
+    b.add_argument("--launcher", help="command prefix, e.g. \"mpirun -np 16 --hostfile hosts\"")
+    b.add_argument("--min-bytes", type=parse_size, default=parse_size("1K"))
+    b.add_argument("--max-bytes", type=parse_size, default=parse_size("256M"))
+    b.add_argument("--iters", type=int, default=20)
+    b.add_argument("--warmup", type=int, default=5)
+    b.add_argument("--verbose", action="store_true")
+
+    args = parser.parse_args()
+    if args.cmd == "generate":
+        generate(args)
+        return 0
+    if args.cmd == "validate":
+        return validate(args)
+    return bench(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
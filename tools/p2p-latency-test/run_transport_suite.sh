@@ -0,0 +1,40 @@
+#!/bin/bash
+# Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+# Licensed under the MIT License.
+
+# Runs transport_latency_test for every transport and protocol between two GPUs.
+# Parameters are read once per process, so each configuration is its own run.
+# The transport RCCL actually picked is printed from its INIT log.
+# Usage: ./run_transport_suite.sh [dev0 dev1]      (MPI builds: MPIRUN="mpirun -np 2")
+
+DEVS=${@:-0 1}
+RUN="${MPIRUN} ./transport_latency_test"
+[ -z "${MPIRUN}" ] && RUN="./transport_latency_test ${DEVS}"
+export HSA_FORCE_FINE_GRAIN_PCIE=1
+
+declare -A TRANSPORTS=(
+  [p2p-write]="NCCL_P2P_READ_ENABLE=0"
+  [p2p-read]="NCCL_P2P_READ_ENABLE=1"
+  [p2p-ipc]="NCCL_P2P_DIRECT_DISABLE=1"
+  [shm]="NCCL_P2P_DISABLE=1"
+  [shm-memcpy]="NCCL_P2P_DISABLE=1 NCCL_SHM_USE_CUDA_MEMCPY=1"
+  [net-ib]="NCCL_P2P_DISABLE=1 NCCL_SHM_DISABLE=1 NCCL_NET=IB"
+  [net-socket]="NCCL_P2P_DISABLE=1 NCCL_SHM_DISABLE=1 NCCL_NET=Socket"
+)
+
+run() {
+  local name=$1; shift
+  echo "=== ${name}: $*"
+  env "$@" NCCL_DEBUG=INFO NCCL_DEBUG_SUBSYS=INIT ${RUN} > suite.log 2>&1
+  grep -m1 -o "via [A-Za-z/]*" suite.log | sed 's/^/    transport /'
+  grep -v "NCCL INFO" suite.log
+}
+
+for t in p2p-write p2p-read p2p-ipc shm shm-memcpy net-ib net-socket; do
+  run "${t} pingpong LL"     ${TRANSPORTS[$t]} MODE=pingpong
+  run "${t} pingpong Simple" ${TRANSPORTS[$t]} MODE=pingpong NCCL_P2P_LL_THRESHOLD=0
+  for proto in LL LL128 Simple; do
+    run "${t} allreduce ${proto}" ${TRANSPORTS[$t]} MODE=allreduce NCCL_ALGO=Ring NCCL_PROTO=${proto}
+  done
+done
+rm -f suite.log
@@ -0,0 +1,214 @@
+/*************************************************************************
+ * Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+ * Licensed under the MIT License.
+ ************************************************************************/
+
+// Small-message latency through the real RCCL transports and protocols.
+//
+// Two ranks (two GPUs of this process, or two MPI processes when built with MPI_DIR)
+// are connected by a regular communicator, so the transport and protocol are the ones
+// RCCL selects; force them with the usual environment (see run_transport_suite.sh).
+//   MODE=pingpong   ncclSend/ncclRecv round trips. LL up to NCCL_P2P_LL_THRESHOLD,
+//                   Simple above.
+//   MODE=allreduce  2-rank ring AllReduce, which moves one step each way; this is
+//                   the mode to compare LL, LL128 and Simple (NCCL_PROTO).
+// Every size is timed twice: "eager" launches each operation from the host and
+// includes the launch overhead, "graph" replays GRAPH_OPS operations captured in a
+// HIP graph and timed with events, which leaves kernel, transport and proxy time.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <hip/hip_runtime.h>
+#include <rccl/rccl.h>
+#include <iostream> //cerr
+#include <cstring>
+
+#ifdef MPI_SUPPORT
+#include <mpi.h>
+#endif
+
+#define HIPCHECK(cmd)                                                          \
+do {                                                                           \
+  hipError_t error = (cmd);                                                    \
+  if (error != hipSuccess)                                                     \
+  {                                                                            \
+    std::cerr << "Encountered HIP error (" << error << ") at line "            \
+              << __LINE__ << " in file " << __FILE__ << "\n";                  \
+    exit(-1);                                                                  \
+  }                                                                            \
+} while (0)
+
+#define NCCLCHECK(cmd)                                                         \
+do {                                                                           \
+  ncclResult_t res = (cmd);                                                    \
+  if (res != ncclSuccess)                                                      \
+  {                                                                            \
+    std::cerr << "Encountered RCCL error (" << ncclGetErrorString(res)         \
+              << ") at line " << __LINE__ << " in file " << __FILE__ << "\n";  \
+    exit(-1);                                                                  \
+  }                                                                            \
+} while (0)
+
+struct RankResult {
+  double eagerUs;  // per operation
+  double graphUs;
+};
+
+static int envInt(const char* name, int def) {
+  return getenv(name) ? atoi(getenv(name)) : def;
+}
+
+static void runOp(bool pingpong, int rank, void* sendBuff, void* recvBuff, size_t bytes, ncclComm_t comm, hipStream_t stream) {
+  if (!pingpong) {
+    NCCLCHECK(ncclAllReduce(sendBuff, recvBuff, bytes, ncclUint8, ncclSum, comm, stream));
+  } else if (rank == 0) {
+    NCCLCHECK(ncclSend(sendBuff, bytes, ncclUint8, 1, comm, stream));
+    NCCLCHECK(ncclRecv(recvBuff, bytes, ncclUint8, 1, comm, stream));
+  } else {
+    NCCLCHECK(ncclRecv(recvBuff, bytes, ncclUint8, 0, comm, stream));
+    NCCLCHECK(ncclSend(sendBuff, bytes, ncclUint8, 0, comm, stream));
+  }
+}
+
+// Runs on the thread (or process) that owns one rank, both ranks go through the same sequence
+static void runRank(int rank, int device, ncclComm_t comm, bool pingpong, const std::vector<size_t>& sizes,
+                    int warmup, int iters, int graphOps, std::vector<RankResult>* results) {
+  HIPCHECK(hipSetDevice(device));
+  size_t maxBytes = 0;
+  for (size_t s : sizes) maxBytes = std::max(maxBytes, s);
+  void *sendBuff, *recvBuff;
+  hipStream_t stream;
+  hipEvent_t start, stop;
+  HIPCHECK(hipMalloc(&sendBuff, maxBytes));
+  HIPCHECK(hipMalloc(&recvBuff, maxBytes));
+  HIPCHECK(hipMemset(sendBuff, 0, maxBytes));
+  HIPCHECK(hipStreamCreateWithFlags(&stream, hipStreamNonBlocking));
+  HIPCHECK(hipEventCreate(&start));
+  HIPCHECK(hipEventCreate(&stop));
+
+  for (size_t bytes : sizes) {
+    RankResult r;
+    for (int i = 0; i < warmup; i++) runOp(pingpong, rank, sendBuff, recvBuff, bytes, comm, stream);
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++) {
+      runOp(pingpong, rank, sendBuff, recvBuff, bytes, comm, stream);
+      HIPCHECK(hipStreamSynchronize(stream));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    r.eagerUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / iters;
+
+    hipGraph_t graph;
+    hipGraphExec_t graphExec;
+    HIPCHECK(hipStreamBeginCapture(stream, hipStreamCaptureModeThreadLocal));
+    for (int i = 0; i < graphOps; i++) runOp(pingpong, rank, sendBuff, recvBuff, bytes, comm, stream);
+    HIPCHECK(hipStreamEndCapture(stream, &graph));
+    HIPCHECK(hipGraphInstantiate(&graphExec, graph, NULL, NULL, 0));
+    HIPCHECK(hipGraphLaunch(graphExec, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    int launches = std::max(1, iters / graphOps);
+    HIPCHECK(hipEventRecord(start, stream));
+    for (int i = 0; i < launches; i++) HIPCHECK(hipGraphLaunch(graphExec, stream));
+    HIPCHECK(hipEventRecord(stop, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+    float ms;
+    HIPCHECK(hipEventElapsedTime(&ms, start, stop));
+    r.graphUs = ms * 1000.0 / (launches * graphOps);
+    HIPCHECK(hipGraphExecDestroy(graphExec));
+    HIPCHECK(hipGraphDestroy(graph));
+    results->push_back(r);
+  }
+
+  HIPCHECK(hipEventDestroy(start));
+  HIPCHECK(hipEventDestroy(stop));
+  HIPCHECK(hipStreamDestroy(stream));
+  HIPCHECK(hipFree(sendBuff));
+  HIPCHECK(hipFree(recvBuff));
+}
+
+int main(int argc, char** argv) {
+  const char* mode = getenv("MODE") ? getenv("MODE") : "pingpong";
+  bool pingpong = strcmp(mode, "allreduce") != 0;
+  int warmup = envInt("WARMUP", 1000);
+  int iters = envInt("ITERS", 10000);
+  int graphOps = std::max(1, envInt("GRAPH_OPS", 100));
+  std::vector<size_t> sizes;
+  std::string sizeList = getenv("SIZES") ? getenv("SIZES") : "8,64,512,4096,16384,65536";
+  for (size_t pos = 0; pos < sizeList.size();) {
+    size_t end = sizeList.find(',', pos);
+    if (end == std::string::npos) end = sizeList.size();
+    sizes.push_back(strtoull(sizeList.c_str() + pos, NULL, 0));
+    pos = end + 1;
+  }
+
+  std::vector<std::vector<RankResult>> results(2);
+  int rank = 0;
+#ifdef MPI_SUPPORT
+  int nranks;
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  if (nranks != 2) {
+    if (rank == 0) fprintf(stderr, "transport_latency_test needs exactly 2 MPI ranks\n");
+    MPI_Abort(MPI_COMM_WORLD, -1);
+  }
+  int device = argc > 1 + rank ? atoi(argv[1 + rank]) : envInt("LOCAL_DEVICE", rank);
+  ncclUniqueId id;
+  ncclComm_t comm;
+  if (rank == 0) NCCLCHECK(ncclGetUniqueId(&id));
+  MPI_Bcast(&id, sizeof(id), MPI_BYTE, 0, MPI_COMM_WORLD);
+  HIPCHECK(hipSetDevice(device));
+  NCCLCHECK(ncclCommInitRank(&comm, 2, id, rank));
+  runRank(rank, device, comm, pingpong, sizes, warmup, iters, graphOps, &results[rank]);
+  NCCLCHECK(ncclCommDestroy(comm));
+  // Both ranks time the same exchanges, rank 0 reports
+  if (rank == 1) {
+    MPI_Send(results[1].data(), results[1].size() * sizeof(RankResult), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+  } else {
+    results[1].resize(sizes.size());
+    MPI_Recv(results[1].data(), results[1].size() * sizeof(RankResult), MPI_BYTE, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+#else
+  if (argc != 1 && argc != 3) {
+    fprintf(stderr, "Usage: ./transport_latency_test [dev0 dev1]\n");
+    return -1;
+  }
+  int devices[2] = { argc == 3 ? atoi(argv[1]) : 0, argc == 3 ? atoi(argv[2]) : 1 };
+  ncclComm_t comms[2];
+  NCCLCHECK(ncclCommInitAll(comms, 2, devices));
+  std::thread threads[2];
+  for (int r = 0; r < 2; r++) {
+    threads[r] = std::thread(runRank, r, devices[r], comms[r], pingpong, std::cref(sizes), warmup, iters, graphOps, &results[r]);
+  }
+  for (int r = 0; r < 2; r++) threads[r].join();
+  for (int r = 0; r < 2; r++) NCCLCHECK(ncclCommDestroy(comms[r]));
+#endif
+
+  if (rank == 0) {
+    // A ping-pong is two one-way transfers; a 2-rank ring AllReduce is two steps,
+    // each sending one way on both ranks at once.
+    fprintf(stdout, "Mode %s (op is %s), NCCL_PROTO=%s\n", mode, pingpong ? "a round trip" : "one allreduce",
+            getenv("NCCL_PROTO") ? getenv("NCCL_PROTO") : "(default)");
+    fprintf(stdout, "%10s %14s %14s %14s %14s %14s\n", "bytes", "eager op(us)", "graph op(us)", "eager 1-way", "graph 1-way", "host/launch");
+    for (size_t s = 0; s < sizes.size(); s++) {
+      double eager = std::max(results[0][s].eagerUs, results[1][s].eagerUs);
+      double graph = std::max(results[0][s].graphUs, results[1][s].graphUs);
+      // Launch and synchronization cost per kernel, what graphs remove
+      int launchesPerOp = pingpong ? 2 : 1;
+      fprintf(stdout, "%10zu %14.2f %14.2f %14.2f %14.2f %14.2f\n", sizes[s], eager, graph, eager / 2, graph / 2,
+              (eager - graph) / launchesPerOp);
+    }
+  }
+#ifdef MPI_SUPPORT
+  MPI_Finalize();
+#endif
+  return 0;
+}
@@ -0,0 +1,372 @@
+/*
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file rccl_prims_bench.cpp
+ *
+ * Benchmark of the RCCL Primitives<> classes (prims_ll.h, prims_ll128.h, prims_simple.h)
+ *
+ * Every workgroup owns a loopback channel: the send and receive connections of its only peer
+ * share the same FIFO buffers and head/tail counters, so each recvReduceSend reads the slice
+ * sent by the previous one, reduces it with the user input and sends the result, which is
+ * the inner loop of a ring reduction, without any other GPU or proxy involved. The loop runs
+ * for every datatype/reduction pair of reduce_kernel.h, every protocol, the Simple unroll
+ * factors and the requested thread counts, and reports the bandwidth each workgroup (CU)
+ * achieved through the FIFO.
+ *
+ * Build against a configured RCCL build tree, which provides the hipified headers and the
+ * generated device_table.h (see Makefile).
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <hip/hip_runtime.h>
+#include "primitives.h"
+
+#define HIPCHECK(cmd)                                                   \
+  do {                                                                  \
+    hipError_t error = (cmd);                                           \
+    if (error != hipSuccess) {                                          \
+      std::cerr << "Encountered HIP error (" << hipGetErrorString(error) << ") at line " \
+                << __LINE__ << " in file " << __FILE__ << "\n";         \
+      exit(-1);                                                         \
+    }                                                                   \
+  } while (0)
+
+// Same definitions as src/device/common.cu; this binary does not link the RCCL kernels
+__shared__ ncclShmemData ncclShmem;
+#if __CUDA_ARCH__ < 700
+  __shared__ ulong2 ncclShmemPerWarp[ncclShmemScratchWarpSize()*(NCCL_MAX_NTHREADS/WARP_SIZE)/sizeof(ulong2)];
+#endif
+
+// FIFO sizes RCCL uses by default (DEFAULT_*BUFFSIZE in init.cc)
+static const int buffSizes[NCCL_NUM_PROTOCOLS] = {
+  NCCL_LL_LINES_PER_THREAD*NCCL_LL_MAX_NTHREADS*NCCL_STEPS*sizeof(union ncclLLFifoLine),
+  NCCL_LL128_ELEMS_PER_THREAD*NCCL_LL128_MAX_NTHREADS*NCCL_STEPS*sizeof(uint64_t),
+  1 << 22
+};
+static const char* protoNames[NCCL_NUM_PROTOCOLS] = { "LL", "LL128", "Simple" };
+static const char* opNames[] = { "sum", "prod", "minmax", "premulsum", "sumpostdiv" };
+
+struct BenchConfig {
+  int nBlocks;
+  int iters;
+  int warmups;
+  size_t userBytes;                 // Input/output region of each workgroup, cycled through
+  std::vector<int> threads;
+  std::vector<int> unrolls;
+  bool protos[NCCL_NUM_PROTOCOLS];
+  std::string types;                // Comma-separated filter, empty for all
+  std::string ops;
+  FILE* csv;
+};
+
+struct BenchResources {
+  struct ncclDevComm* comm;         // Device copy of the communicator fields the primitives read
+  struct ncclDevChannel* channels;  // One loopback channel per workgroup
+  uint32_t* abortFlag;
+  void* src;
+  void* dst;
+  uint64_t* cycles;
+  double wallClockGHz;
+};
+
+// Loads the loopback channel of this workgroup and runs nIters slices through it:
+// send, nIters-2 recvReduceSend, recv. Every op moves one chunk, the amount of data
+// a ring step moves for this protocol.
+template<typename T, typename RedOp, typename Proto>
+__global__ __launch_bounds__(NCCL_MAX_NTHREADS, 1)
+void primsBenchKernel(struct ncclDevComm* comm, struct ncclDevChannel* channels, T const* src, T* dst,
+                      size_t userElts, uint64_t redOpArg, int nIters, uint64_t* cycles) {
+  const int tid = threadIdx.x;
+  const int nthreads = blockDim.x;
+  if (tid == 0) {
+    ncclShmem.comm = *comm;
+    ncclShmem.channel = channels[blockIdx.x];
+    ncclShmem.channelId = blockIdx.x;
+    ncclShmem.aborted = 0;
+  }
+  if (tid < NCCL_MAX_NVLS_ARITY+1) ncclShmem.redOpArgs[tid] = redOpArg;
+  if (tid < NCCL_MAX_GROUPS) {
+    ncclShmem.groups[tid].barrier = 0;
+    for (int i = 0; i < NCCL_MAX_GROUPS; i++) ncclShmem.groups[tid].barrier_next[i] = 0;
+  }
+  __synclds();
+
+  int chunkElts = Proto::calcBytePerStep()/sizeof(T);
+  if (Proto::Id == NCCL_PROTO_SIMPLE) chunkElts *= ALLREDUCE_CHUNKSTEPS;
+  const size_t nChunks = userElts >= chunkElts ? userElts/chunkElts : 1;
+  src += blockIdx.x*userElts;
+  dst += blockIdx.x*userElts;
+
+  int peer = 0;
+  uint64_t start = wall_clock64();
+  {
+    Primitives<T, RedOp, FanSymmetric<1>, 0, Proto, 0> prims(tid, nthreads, &peer, &peer, src, dst, redOpArg);
+    prims.send(0, chunkElts);
+    for (int i = 1; i < nIters-1; i++) prims.recvReduceSend((i%nChunks)*chunkElts, chunkElts);
+    prims.recv(((nIters-1)%nChunks)*chunkElts, chunkElts);
+  }
+  if (tid == 0) cycles[blockIdx.x] = wall_clock64() - start;
+}
+
+template<typename T>
+uint64_t OneBits() {
+  // PreMulSum scalar, the primitives read it back from the low bytes of redOpArg
+  T one = T(1.0f);
+  uint64_t bits = 0;
+  memcpy(&bits, &one, sizeof(T));
+  return bits;
+}
+
+template<typename T, typename RedOp, typename Proto>
+void RunBench(BenchConfig const& cfg, BenchResources& res, char const* typeName, int op, int unroll, uint64_t redOpArg) {
+  for (int nthreads : cfg.threads) {
+    size_t userElts = cfg.userBytes/sizeof(T);
+    hipLaunchKernelGGL((primsBenchKernel<T, RedOp, Proto>), dim3(cfg.nBlocks), dim3(nthreads), 0, 0,
+                       res.comm, res.channels, (T const*)res.src, (T*)res.dst, userElts, redOpArg, cfg.warmups+2, res.cycles);
+    hipLaunchKernelGGL((primsBenchKernel<T, RedOp, Proto>), dim3(cfg.nBlocks), dim3(nthreads), 0, 0,
+                       res.comm, res.channels, (T const*)res.src, (T*)res.dst, userElts, redOpArg, cfg.iters, res.cycles);
+    HIPCHECK(hipGetLastError());
+    HIPCHECK(hipDeviceSynchronize());
+
+    std::vector<uint64_t> cycles(cfg.nBlocks);
+    HIPCHECK(hipMemcpy(cycles.data(), res.cycles, cfg.nBlocks*sizeof(uint64_t), hipMemcpyDeviceToHost));
+    size_t chunkBytes = Proto::Id == NCCL_PROTO_LL ? buffSizes[Proto::Id]/NCCL_STEPS/2 :
+                        Proto::Id == NCCL_PROTO_LL128 ? buffSizes[Proto::Id]/NCCL_STEPS*NCCL_LL128_DATAELEMS/NCCL_LL128_LINEELEMS :
+                        buffSizes[Proto::Id]/NCCL_STEPS*ALLREDUCE_CHUNKSTEPS;
+    chunkBytes = chunkBytes/sizeof(T)*sizeof(T);
+    double sum = 0, minBw = 1e30;
+    for (int b = 0; b < cfg.nBlocks; b++) {
+      double us = cycles[b]/res.wallClockGHz/1e3;
+      double bw = chunkBytes*(double)cfg.iters/us/1e3;
+      sum += bw;
+      minBw = std::min(minBw, bw);
+    }
+    double avgBw = sum/cfg.nBlocks;
+    printf("%-7s %-6s %-11s %6s %8d %10zu %12.2f %12.2f %12.2f\n", protoNames[Proto::Id], typeName, opNames[op],
+           Proto::Id == NCCL_PROTO_SIMPLE ? std::to_string(unroll).c_str() : "-", nthreads, chunkBytes, avgBw, minBw, sum);
+    fflush(stdout);
+    if (cfg.csv)
+      fprintf(cfg.csv, "%s,%s,%s,%d,%d,%zu,%d,%.3f,%.3f,%.3f\n", protoNames[Proto::Id], typeName, opNames[op],
+              Proto::Id == NCCL_PROTO_SIMPLE ? unroll : 0, nthreads, chunkBytes, cfg.nBlocks, avgBw, minBw, sum);
+  }
+}
+
+template<typename T, typename RedOp>
+void RunProtos(BenchConfig const& cfg, BenchResources& res, char const* typeName, int op, uint64_t redOpArg) {
+  if (cfg.protos[NCCL_PROTO_LL])
+    RunBench<T, RedOp, ProtoLL>(cfg, res, typeName, op, 0, redOpArg);
+  if (cfg.protos[NCCL_PROTO_LL128])
+    RunBench<T, RedOp, ProtoLL128>(cfg, res, typeName, op, 0, redOpArg);
+  if (cfg.protos[NCCL_PROTO_SIMPLE]) {
+    for (int unroll : cfg.unrolls) {
+      constexpr int SlicePerChunk = ALLREDUCE_CHUNKSTEPS/ALLREDUCE_SLICESTEPS;
+      switch (unroll) {
+      case 1: RunBench<T, RedOp, ProtoSimple<SlicePerChunk, ALLREDUCE_SLICESTEPS, 1>>(cfg, res, typeName, op, unroll, redOpArg); break;
+      case 2: RunBench<T, RedOp, ProtoSimple<SlicePerChunk, ALLREDUCE_SLICESTEPS, 2>>(cfg, res, typeName, op, unroll, redOpArg); break;
+      case 4: RunBench<T, RedOp, ProtoSimple<SlicePerChunk, ALLREDUCE_SLICESTEPS, 4>>(cfg, res, typeName, op, unroll, redOpArg); break;
+      case 8: RunBench<T, RedOp, ProtoSimple<SlicePerChunk, ALLREDUCE_SLICESTEPS, 8>>(cfg, res, typeName, op, unroll, redOpArg); break;
+      default: printf("[WARN] Unsupported unroll factor %d, use 1, 2, 4 or 8\n", unroll); break;
+      }
+    }
+  }
+}
+
+bool InList(std::string const& list, char const* name) {
+  if (list.empty()) return true;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) if (item == name) return true;
+  return false;
+}
+
+// All reductions of reduce_kernel.h; SumPostDiv (ncclAvg) only exists for integers
+template<typename T>
+void RunType(BenchConfig const& cfg, BenchResources& res, char const* typeName) {
+  if (!InList(cfg.types, typeName)) return;
+  if (InList(cfg.ops, opNames[0])) RunProtos<T, FuncSum<T>>(cfg, res, typeName, 0, 0);
+  if (InList(cfg.ops, opNames[1])) RunProtos<T, FuncProd<T>>(cfg, res, typeName, 1, 0);
+  if (InList(cfg.ops, opNames[2])) RunProtos<T, FuncMinMax<T>>(cfg, res, typeName, 2, 0);
+  if (InList(cfg.ops, opNames[3])) RunProtos<T, FuncPreMulSum<T>>(cfg, res, typeName, 3, OneBits<T>());
+  if constexpr (!IsFloatingPoint<T>::value) {
+    if (InList(cfg.ops, opNames[4])) RunProtos<T, FuncSumPostDiv<T>>(cfg, res, typeName, 4, 1);
+  }
+}
+
+// Builds the loopback channels: peer 0 of every channel sends into its own receive FIFO
+void SetupResources(BenchConfig const& cfg, BenchResources& res) {
+  HIPCHECK(hipMalloc((void**)&res.abortFlag, sizeof(uint32_t)));
+  HIPCHECK(hipMemset(res.abortFlag, 0, sizeof(uint32_t)));
+
+  std::vector<struct ncclDevChannel> channels(cfg.nBlocks);
+  for (int b = 0; b < cfg.nBlocks; b++) {
+    struct ncclDevChannelPeer peer;
+    memset(&peer, 0, sizeof(peer));
+    uint64_t* steps;  // head, tail
+    HIPCHECK(hipMalloc((void**)&steps, 2*sizeof(uint64_t)));
+    HIPCHECK(hipMemset(steps, 0, 2*sizeof(uint64_t)));
+    for (int p = 0; p < NCCL_NUM_PROTOCOLS; p++) {
+      char* buff;
+      HIPCHECK(hipMalloc((void**)&buff, buffSizes[p]));
+      HIPCHECK(hipMemset(buff, 0, buffSizes[p]));
+      peer.send[0].buffs[p] = peer.recv[0].buffs[p] = buff;
+    }
+    peer.send[0].head = peer.recv[0].head = steps;
+    peer.send[0].tail = peer.recv[0].tail = steps+1;
+
+    struct ncclDevChannelPeer* devPeer;
+    struct ncclDevChannelPeer** devPeers;
+    HIPCHECK(hipMalloc((void**)&devPeer, sizeof(peer)));
+    HIPCHECK(hipMemcpy(devPeer, &peer, sizeof(peer), hipMemcpyHostToDevice));
+    HIPCHECK(hipMalloc((void**)&devPeers, sizeof(devPeer)));
+    HIPCHECK(hipMemcpy(devPeers, &devPeer, sizeof(devPeer), hipMemcpyHostToDevice));
+
+    memset(&channels[b], 0, sizeof(channels[b]));
+    channels[b].peers = devPeers;
+    channels[b].ring.prev = channels[b].ring.next = 0;
+  }
+  HIPCHECK(hipMalloc((void**)&res.channels, cfg.nBlocks*sizeof(struct ncclDevChannel)));
+  HIPCHECK(hipMemcpy(res.channels, channels.data(), cfg.nBlocks*sizeof(struct ncclDevChannel), hipMemcpyHostToDevice));
+
+  struct ncclDevComm comm;
+  memset(&comm, 0, sizeof(comm));
+  comm.nRanks = 1;
+  comm.nNodes = 1;
+  for (int p = 0; p < NCCL_NUM_PROTOCOLS; p++) comm.buffSizes[p] = buffSizes[p];
+  comm.p2pChunkSize = buffSizes[NCCL_PROTO_SIMPLE]/NCCL_STEPS;
+  comm.abortFlag = res.abortFlag;
+  comm.channels = res.channels;
+  HIPCHECK(hipMalloc((void**)&res.comm, sizeof(comm)));
+  HIPCHECK(hipMemcpy(res.comm, &comm, sizeof(comm), hipMemcpyHostToDevice));
+
+  // Inputs are zero so that every reduction stays finite
+  HIPCHECK(hipMalloc(&res.src, cfg.nBlocks*cfg.userBytes));
+  HIPCHECK(hipMalloc(&res.dst, cfg.nBlocks*cfg.userBytes));
+  HIPCHECK(hipMemset(res.src, 0, cfg.nBlocks*cfg.userBytes));
+  HIPCHECK(hipMalloc((void**)&res.cycles, cfg.nBlocks*sizeof(uint64_t)));
+
+  int dev, wallClockKHz;
+  HIPCHECK(hipGetDevice(&dev));
+  HIPCHECK(hipDeviceGetAttribute(&wallClockKHz, hipDeviceAttributeWallClockRate, dev));
+  res.wallClockGHz = wallClockKHz/1e6;
+}
+
+std::vector<int> ParseIntList(char const* str) {
+  std::vector<int> values;
+  std::stringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ',')) if (!item.empty()) values.push_back(atoi(item.c_str()));
+  return values;
+}
+
+char* getCmdOption(char ** begin, char ** end, const std::string & option) {
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+bool cmdOptionExists(char** begin, char** end, const std::string& option) {
+    return std::find(begin, end, option) != end;
+}
+
+int main(int argc,char* argv[])
+{
+  if (cmdOptionExists(argv, argv + argc, "-h")) {
+    printf("./rccl_prims_bench -w workgroups -i iterations -t threads,... -u unrolls,... -p LL,LL128,Simple\n"
+           "                   -d i8,u8,i32,u32,i64,u64,f16,f32,f64,bf16,fp8e4m3,fp8e5m2 -r sum,prod,minmax,premulsum,sumpostdiv\n"
+           "                   -n bytes_per_workgroup -g gpu -o results.csv\n");
+    exit(0);
+  }
+
+  BenchConfig cfg;
+  char* opt;
+  cfg.nBlocks   = (opt = getCmdOption(argv, argv + argc, "-w")) ? atoi(opt) : 1;
+  cfg.iters     = (opt = getCmdOption(argv, argv + argc, "-i")) ? atoi(opt) : 2000;
+  cfg.warmups   = 100;
+  cfg.userBytes = (opt = getCmdOption(argv, argv + argc, "-n")) ? atol(opt) : 16 << 20;
+  cfg.threads   = ParseIntList((opt = getCmdOption(argv, argv + argc, "-t")) ? opt : "64,128,256");
+  cfg.unrolls   = ParseIntList((opt = getCmdOption(argv, argv + argc, "-u")) ? opt : "1,2,4");
+  cfg.types     = (opt = getCmdOption(argv, argv + argc, "-d")) ? opt : "";
+  cfg.ops       = (opt = getCmdOption(argv, argv + argc, "-r")) ? opt : "";
+  char const* protos = (opt = getCmdOption(argv, argv + argc, "-p")) ? opt : "LL,LL128,Simple";
+  for (int p = 0; p < NCCL_NUM_PROTOCOLS; p++) cfg.protos[p] = InList(protos, protoNames[p]);
+  cfg.iters = std::max(cfg.iters, 2);
+  cfg.nBlocks = std::max(cfg.nBlocks, 1);
+
+  int gpu = (opt = getCmdOption(argv, argv + argc, "-g")) ? atoi(opt) : 0;
+  HIPCHECK(hipSetDevice(gpu));
+  hipDeviceProp_t prop;
+  HIPCHECK(hipGetDeviceProperties(&prop, gpu));
+  std::vector<int> threads;
+  for (int n : cfg.threads) {
+    if (n < 2*prop.warpSize || n > NCCL_MAX_NTHREADS || n % prop.warpSize) {
+      printf("[WARN] Skipping %d threads: must be a multiple of %d between %d and %d\n", n, prop.warpSize, 2*prop.warpSize, NCCL_MAX_NTHREADS);
+      continue;
+    }
+    threads.push_back(n);
+  }
+  cfg.threads = threads;
+
+  opt = getCmdOption(argv, argv + argc, "-o");
+  cfg.csv = opt ? fopen(opt, "w") : NULL;
+  if (opt && !cfg.csv) {
+    printf("[ERROR] Unable to open %s\n", opt);
+    exit(1);
+  }
+  if (cfg.csv) fprintf(cfg.csv, "proto,type,op,unroll,threads,chunkBytes,workgroups,avgGBsPerCU,minGBsPerCU,totalGBs\n");
+
+  BenchResources res;
+  SetupResources(cfg, res);
+  printf("GPU %d (%s, %d CUs): %d workgroup(s), %d iterations, %zu bytes of user buffer per workgroup\n",
+         gpu, prop.gcnArchName, prop.multiProcessorCount, cfg.nBlocks, cfg.iters, cfg.userBytes);
+  printf("%-7s %-6s %-11s %6s %8s %10s %12s %12s %12s\n", "Proto", "Type", "Op", "Unroll", "Threads",
+         "Chunk(B)", "GB/s/CU", "Min GB/s/CU", "Total GB/s");
+
+  RunType<int8_t>(cfg, res, "i8");
+  RunType<uint8_t>(cfg, res, "u8");
+  RunType<int32_t>(cfg, res, "i32");
+  RunType<uint32_t>(cfg, res, "u32");
+  RunType<int64_t>(cfg, res, "i64");
+  RunType<uint64_t>(cfg, res, "u64");
+  RunType<half>(cfg, res, "f16");
+  RunType<float>(cfg, res, "f32");
+  RunType<double>(cfg, res, "f64");
+#if defined(RCCL_BFLOAT16)
+  RunType<hip_bfloat16>(cfg, res, "bf16");
+#endif
+#if defined(RCCL_FLOAT8)
+  RunType<rccl_float8>(cfg, res, "fp8e4m3");
+  RunType<rccl_bfloat8>(cfg, res, "fp8e5m2");
+#endif
+
+  if (cfg.csv) fclose(cfg.csv);
+  return 0;
+}
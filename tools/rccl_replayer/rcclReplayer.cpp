@@ -5,26 +5,57 @@
 #include <chrono>
 #include <mpi.h>
 #include <fstream>
+#include <sstream>
+#include <thread>
+#include <glob.h>
 
 #include "rcclReplayer.hpp"
 
 int main(int argc, char **argv)
 {
   MPI_Init(&argc, &argv);
-  if (argc <= 1) {
-    printf("Usage: %s logfile [numGpusPerMpiRank = 1]\n", argv[0]);
-    exit(1);
-  }
 
   // Parse rank information
   int mpiRank, numMpiRanks;
   MPI_Comm_rank(MPI_COMM_WORLD, &mpiRank);
   MPI_Comm_size(MPI_COMM_WORLD, &numMpiRanks);
 
-  // Parse command line arguments
-  char* logFilename       = argv[1];
-  int   numGpusPerMpiRank = (argc > 2 ? atoi(argv[2]) : 1);
-  int   parseOnly         = (argc > 3 ? atoi(argv[3]) : 0);
+  // Parse command line arguments, options may appear anywhere
+  PerfOptions perf;
+  std::vector<char*> args;
+  char* compareFiles[2] = {NULL, NULL};
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--perf")) {
+      perf.enabled = true;
+    } else if (!strcmp(argv[i], "--timing") && i+1 < argc) {
+      perf.originalTiming = !strcmp(argv[++i], "original");
+    } else if (!strcmp(argv[i], "--iters") && i+1 < argc) {
+      perf.iters = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--warmup") && i+1 < argc) {
+      perf.warmup = std::max(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--output") && i+1 < argc) {
+      perf.output = argv[++i];
+    } else if (!strcmp(argv[i], "--compare") && i+2 < argc) {
+      compareFiles[0] = argv[++i];
+      compareFiles[1] = argv[++i];
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  if (compareFiles[0]) {
+    int ret = (mpiRank == 0 ? ComparePerf(compareFiles[0], compareFiles[1]) : 0);
+    MPI_Finalize();
+    return ret;
+  }
+  if (args.size() == 0) {
+    printf("Usage: %s logfile [numGpusPerMpiRank = 1] [--perf [--timing fast|original] [--iters N] [--warmup N] [--output file]]\n", argv[0]);
+    printf("       %s --compare base.csv new.csv\n", argv[0]);
+    exit(1);
+  }
+  char* logFilename       = args[0];
+  int   numGpusPerMpiRank = (args.size() > 1 ? atoi(args[1]) : 1);
+  int   parseOnly         = (args.size() > 2 ? atoi(args[2]) : 0);
 
   CollectiveCalls collCalls;
   collCalls.firstGlobalRank = mpiRank * numGpusPerMpiRank;
@@ -80,6 +111,18 @@ int main(int argc, char **argv)
   }
   printf("Rank %d Done setting up communicators\n", mpiRank);
 
+  if (perf.enabled) {
+    ReplayPerf(collCalls, perf, mpiRank);
+    for (int commIdx = 0; commIdx < collCalls.numCommsPerRank; commIdx++) {
+      for (int i = 0; i < numGpusPerMpiRank; i++) {
+        NCCL_CALL(ncclCommDestroy(collCalls.localRankComms[i][commIdx]));
+        HIP_CALL(hipStreamDestroy(collCalls.localRankStreams[i][commIdx]));
+      }
+    }
+    MPI_Finalize();
+    return 0;
+  }
+
   int numSkippedCalls = 0;
   double runTime;
   std::ofstream datafile;
@@ -181,21 +224,10 @@ void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls
   cc.globalRankComms.resize(cc.numGlobalRanks);
   cc.groupCalls.clear();
 
-  FILE* fp = fopen(logFilename, "r");
-  if (!fp) {
-    printf("[ERROR] Unable to open file %s\n", logFilename);
-    exit(-1);
-  }
-
-  char line[2048];
-  LineItem li;
-  int lineNum = 0;
-
-  while (fgets(line, 2048, fp)) {
-    ++lineNum;
-
-    //Ignore invalid lines and collectives
-    if (!ParseLineItem(line, li) || li.nRanks != cc.numGlobalRanks) continue;
+  // Groups one logged task with the other tasks of its group call
+  auto addLineItem = [&](LineItem const& li, int lineNum) {
+    //Ignore collectives of other communicator sizes
+    if (li.nRanks != cc.numGlobalRanks) return;
 
     // Figure out commIdx for this globalrank
     int commIdx = -1;
@@ -236,6 +268,7 @@ void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls
       else if (li.task == 0) {
         gc.rankData[li.globalRank].lineNum = lineNum;
         gc.rankData[li.globalRank].commIdx = commIdx;
+        gc.rankData[li.globalRank].timeMs  = li.timeMs;
         gc.rankData[li.globalRank].tasks.push_back(taskInfo);
         found = true;
         break;
@@ -250,13 +283,31 @@ void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls
 
       GroupCall gc;
       gc.opCount = li.opCount;
+      gc.startMs = -1;
       gc.rankData[li.globalRank].commIdx = commIdx;
       gc.rankData[li.globalRank].lineNum = lineNum;
+      gc.rankData[li.globalRank].timeMs  = li.timeMs;
       gc.rankData[li.globalRank].tasks.push_back(taskInfo);
       cc.groupCalls.push_back(gc);
     }
+  };
+
+  if (!ReadCallTraces(logFilename, isFirstRank, addLineItem)) {
+    FILE* fp = fopen(logFilename, "r");
+    if (!fp) {
+      printf("[ERROR] Unable to open file %s\n", logFilename);
+      exit(-1);
+    }
+
+    char line[2048];
+    LineItem li;
+    int lineNum = 0;
+    while (fgets(line, 2048, fp)) {
+      ++lineNum;
+      if (ParseLineItem(line, li)) addLineItem(li, lineNum);
+    }
+    fclose(fp);
   }
-  fclose(fp);
 
   // Validate group calls
   // - For non Send/Recv, check that all ranks participate with same parameters count
@@ -314,6 +365,24 @@ void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls
     }
   }
 
+  // Offset of each group call from the start of the trace. Host clocks of different nodes are
+  // not synchronized, so each rank is measured against its own first call.
+  std::map<int, double> rankStartMs;
+  for (auto const& gc : cc.groupCalls) {
+    for (auto const& rd : gc.rankData) {
+      if (rd.second.timeMs < 0) continue;
+      if (rankStartMs.count(rd.first) == 0 || rd.second.timeMs < rankStartMs[rd.first])
+        rankStartMs[rd.first] = rd.second.timeMs;
+    }
+  }
+  for (auto& gc : cc.groupCalls) {
+    for (auto const& rd : gc.rankData) {
+      if (rd.second.timeMs < 0) { gc.startMs = -1; break; }
+      double offset = rd.second.timeMs - rankStartMs[rd.first];
+      if (gc.startMs < 0 || offset < gc.startMs) gc.startMs = offset;
+    }
+  }
+
   // Check number of comms per rank
   cc.numCommsPerRank = cc.globalRankComms[0].size();
   for (int i = 1; i < cc.numGlobalRanks; i++) {
@@ -325,16 +394,108 @@ void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls
   }
 }
 
+static bool ReadCallTraceHeader(FILE* fp, rcclCallTraceHeader& header)
+{
+  return fread(&header, sizeof(header), 1, fp) == 1 &&
+         !memcmp(header.magic, RCCL_CALL_TRACE_MAGIC, sizeof(RCCL_CALL_TRACE_MAGIC));
+}
+
+bool ReadCallTraces(char const* path, bool isFirstRank, std::function<void(LineItem const&, int)> const& addLineItem)
+{
+  // Either a single trace file or the prefix given to RCCL_CALL_TRACE
+  std::vector<std::string> filenames;
+  rcclCallTraceHeader header;
+  FILE* fp = fopen(path, "rb");
+  if (fp) {
+    if (ReadCallTraceHeader(fp, header)) filenames.push_back(path);
+    fclose(fp);
+  }
+  if (filenames.empty()) {
+    glob_t globbuf;
+    if (glob((std::string(path) + ".*").c_str(), 0, NULL, &globbuf) == 0) {
+      for (size_t i = 0; i < globbuf.gl_pathc; i++) filenames.push_back(globbuf.gl_pathv[i]);
+    }
+    globfree(&globbuf);
+  }
+
+  // ncclFunc_t values of src/include/nccl_common.h
+  auto funcType = [](int func) {
+    switch (func) {
+    case 0: return ncclCollBroadcast;
+    case 1: return ncclCollReduce;
+    case 2: return ncclCollAllGather;
+    case 3: return ncclCollReduceScatter;
+    case 4: return ncclCollAllReduce;
+    case 6: return ncclCollSend;
+    case 7: return ncclCollRecv;
+    case 8: case 9: return ncclCollAllToAll;
+    default: return ncclNumFuncs;
+    }
+  };
+
+  int numTraces = 0;
+  for (auto const& filename : filenames) {
+    fp = fopen(filename.c_str(), "rb");
+    if (!fp) continue;
+    if (!ReadCallTraceHeader(fp, header)) {
+      fclose(fp);
+      continue;
+    }
+    if (header.version != RCCL_CALL_TRACE_VERSION || header.recordSize != sizeof(rcclCallTraceRecord)) {
+      printf("[ERROR] %s: unsupported call trace version %u (record size %u)\n", filename.c_str(), header.version, header.recordSize);
+      exit(1);
+    }
+    if (isFirstRank && getenv("VERBOSE"))
+      printf("Reading %lu records of rank %d/%d from %s\n", header.nRecords, header.rank, header.nRanks, filename.c_str());
+
+    LineItem li;
+    memset(&li, 0, sizeof(li));
+    strncpy(li.hostname, header.hostname, sizeof(li.hostname) - 1);
+    li.pid        = header.pid;
+    li.cudaDev    = header.cudaDev;
+    li.nRanks     = header.nRanks;
+    li.globalRank = header.rank;
+    snprintf(li.comm, sizeof(li.comm), "%016lx", header.commHash);
+
+    rcclCallTraceRecord r;
+    for (uint64_t i = 0; i < header.nRecords && fread(&r, sizeof(r), 1, fp) == 1; i++) {
+      ncclFunc_t func = funcType(r.func);
+      if (func == ncclNumFuncs) {
+        if (isFirstRank) printf("[WARN] %s: skipping record %lu of unknown func %d\n", filename.c_str(), i, r.func);
+        continue;
+      }
+      strcpy(li.opName, ncclFuncNames[func]);
+      strcpy(li.sendbuff, "send");
+      strcpy(li.recvbuff, (r.flags & RCCL_CALL_TRACE_IN_PLACE) ? "send" : "recv");
+      li.opCount  = r.opCount;
+      li.count    = r.count;
+      li.datatype = r.datatype;
+      li.op       = r.op;
+      li.root     = r.root;
+      li.stream   = (void*)r.stream;
+      li.task     = r.task;
+      li.timeMs   = r.timeNs / 1e6;
+      addLineItem(li, i + 1);
+    }
+    fclose(fp);
+    numTraces++;
+  }
+  if (isFirstRank && numTraces) printf("Read %d binary call trace(s) from %s\n", numTraces, path);
+  return numTraces > 0;
+}
+
 bool ParseLineItem(char const* line, LineItem& li)
 {
-  return sscanf(line,
-                "%[^:]:%d:%d [%d] NCCL INFO %[^:]: opCount %x sendbuff %s "
-                "recvbuff %s count %lu datatype %d op %d root %d comm %s "
-                "[nranks=%d] stream %p task %d globalrank %d",
-                li.hostname, &li.pid, &li.tid, &li.cudaDev, li.opName,
-                &li.opCount, li.sendbuff, li.recvbuff,
-                &li.count, &li.datatype, &li.op, &li.root, li.comm,
-                &li.nRanks, &li.stream, &li.task, &li.globalRank) == 17;
+  int numFields = sscanf(line,
+                         "%[^:]:%d:%d [%d] NCCL INFO %[^:]: opCount %x sendbuff %s "
+                         "recvbuff %s count %lu datatype %d op %d root %d comm %s "
+                         "[nranks=%d] stream %p task %d globalrank %d time %lf",
+                         li.hostname, &li.pid, &li.tid, &li.cudaDev, li.opName,
+                         &li.opCount, li.sendbuff, li.recvbuff,
+                         &li.count, &li.datatype, &li.op, &li.root, li.comm,
+                         &li.nRanks, &li.stream, &li.task, &li.globalRank, &li.timeMs);
+  if (numFields < 18) li.timeMs = -1;
+  return numFields >= 17;
 }
 
 double ReplayRccl(CollectiveCalls const& cc, int groupIdx)
@@ -494,3 +655,342 @@ void ExecuteCollective(TaskInfo const& task, ncclComm_t const& comm, hipStream_t
     exit(1);
   }
 }
+
+void GroupCallSize(GroupCall const& gc, int numGlobalRanks, std::string& funcName, size_t& bytes, double& busBwFactor)
+{
+  RankData const& rd = gc.rankData.begin()->second;
+  TaskInfo const& first = rd.tasks[0];
+  double const n = numGlobalRanks;
+  funcName = (first.funcType == ncclCollSend || first.funcType == ncclCollRecv) ? "Send/Recv" : ncclFuncNames[first.funcType];
+
+  // Same conventions as rccl-tests: gathered/scattered sizes count all ranks' data
+  size_t sendBytes = 0, recvBytes = 0;
+  bytes = 0;
+  for (auto const& ti : rd.tasks) {
+    size_t const typeBytes = ti.count * DataTypeToBytes(ti.datatype);
+    switch (ti.funcType) {
+    case ncclCollAllGather: case ncclCollReduceScatter: case ncclCollGather: case ncclCollScatter: case ncclCollAllToAll:
+      bytes += numGlobalRanks * typeBytes;
+      break;
+    case ncclCollSend: sendBytes += typeBytes; break;
+    case ncclCollRecv: recvBytes += typeBytes; break;
+    default:
+      bytes += typeBytes;
+    }
+  }
+  bytes += std::max(sendBytes, recvBytes);
+
+  switch (first.funcType) {
+  case ncclCollAllReduce:
+    busBwFactor = 2*(n-1)/n;
+    break;
+  case ncclCollAllGather: case ncclCollReduceScatter: case ncclCollGather: case ncclCollScatter: case ncclCollAllToAll:
+    busBwFactor = (n-1)/n;
+    break;
+  default:
+    busBwFactor = 1;
+  }
+}
+
+void ReplayPerf(CollectiveCalls& cc, PerfOptions const& opts, int mpiRank)
+{
+  int const numLocalRanks = cc.localRankComms.size();
+  int const numGroups     = cc.groupCalls.size();
+  int const numSlots      = 1024;  // group calls in flight before waiting on the oldest one's events
+  auto alignUp = [](size_t bytes) { return (bytes + 255) & ~(size_t)255; };
+
+  // Buffers are allocated once, large enough for the biggest group call of each rank,
+  // so that nothing is allocated or synchronized between timed group calls
+  std::vector<size_t> sendPoolBytes(numLocalRanks, 256), recvPoolBytes(numLocalRanks, 256);
+  for (auto const& gc : cc.groupCalls) {
+    if (!gc.isValid) continue;
+    for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+      auto it = gc.rankData.find(cc.firstGlobalRank + localIdx);
+      if (it == gc.rankData.end()) continue;
+      size_t sendBytes = 0, recvBytes = 0;
+      for (auto const& task : it->second.tasks) {
+        std::pair<size_t, size_t> numBytes = GetSize(task, cc.numGlobalRanks);
+        if (task.inPlace) {
+          sendBytes += alignUp(std::max(numBytes.first, numBytes.second));
+        } else {
+          sendBytes += alignUp(numBytes.first);
+          recvBytes += alignUp(numBytes.second);
+        }
+      }
+      sendPoolBytes[localIdx] = std::max(sendPoolBytes[localIdx], sendBytes);
+      recvPoolBytes[localIdx] = std::max(recvPoolBytes[localIdx], recvBytes);
+    }
+  }
+
+  std::vector<char*> sendPool(numLocalRanks), recvPool(numLocalRanks);
+  std::vector<std::vector<hipEvent_t>> startEvents(numLocalRanks, std::vector<hipEvent_t>(numSlots));
+  std::vector<std::vector<hipEvent_t>> endEvents(numLocalRanks, std::vector<hipEvent_t>(numSlots));
+  for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+    HIP_CALL(hipSetDevice(cc.localGpuOffset + localIdx));
+    HIP_CALL(hipMalloc(&sendPool[localIdx], sendPoolBytes[localIdx]));
+    HIP_CALL(hipMalloc(&recvPool[localIdx], recvPoolBytes[localIdx]));
+    HIP_CALL(hipMemset(sendPool[localIdx], 0, sendPoolBytes[localIdx]));
+    HIP_CALL(hipMemset(recvPool[localIdx], 0, recvPoolBytes[localIdx]));
+    for (int slot = 0; slot < numSlots; slot++) {
+      HIP_CALL(hipEventCreate(&startEvents[localIdx][slot]));
+      HIP_CALL(hipEventCreate(&endEvents[localIdx][slot]));
+    }
+    HIP_CALL(hipDeviceSynchronize());
+  }
+
+  // Device time of each group call in the current iteration, slowest local rank
+  std::vector<double> iterTimeUs(numGroups), maxTimeUs(numGroups);
+  std::vector<double> sumTimeUs(numGroups, 0.0), minTimeUs(numGroups, 0.0);
+  std::vector<int>    slotGroup(numSlots, -1);
+  double wallSumMs = 0.0;
+
+  auto participates = [&](GroupCall const& gc, int localIdx) {
+    return gc.rankData.count(cc.firstGlobalRank + localIdx) != 0;
+  };
+  auto drain = [&](int slot) {
+    int const g = slotGroup[slot];
+    if (g < 0) return;
+    for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+      if (!participates(cc.groupCalls[g], localIdx)) continue;
+      float ms;
+      HIP_CALL(hipEventSynchronize(endEvents[localIdx][slot]));
+      HIP_CALL(hipEventElapsedTime(&ms, startEvents[localIdx][slot], endEvents[localIdx][slot]));
+      iterTimeUs[g] = std::max(iterTimeUs[g], ms * 1000.0);
+    }
+    slotGroup[slot] = -1;
+  };
+
+  if (mpiRank == 0)
+    printf("Performance mode: %d iteration(s) after %d warmup, %s timing\n",
+           opts.iters, opts.warmup, opts.originalTiming ? "original" : "back-to-back");
+  for (int iter = 0; iter < opts.warmup + opts.iters; iter++) {
+    std::fill(iterTimeUs.begin(), iterTimeUs.end(), 0.0);
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = std::chrono::steady_clock::now();
+    int numIssued = 0;
+    for (int g = 0; g < numGroups; g++) {
+      GroupCall const& gc = cc.groupCalls[g];
+      if (!gc.isValid) continue;
+      if (opts.originalTiming && gc.startMs >= 0)
+        std::this_thread::sleep_until(start + std::chrono::duration<double, std::milli>(gc.startMs));
+
+      int const slot = numIssued++ % numSlots;
+      drain(slot);
+      slotGroup[slot] = g;
+      for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+        if (!participates(gc, localIdx)) continue;
+        RankData const& rankData = gc.rankData.at(cc.firstGlobalRank + localIdx);
+        HIP_CALL(hipSetDevice(cc.localGpuOffset + localIdx));
+        HIP_CALL(hipEventRecord(startEvents[localIdx][slot], cc.localRankStreams[localIdx][rankData.commIdx]));
+      }
+
+      NCCL_CALL(ncclGroupStart());
+      for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+        if (!participates(gc, localIdx)) continue;
+        RankData const& rankData = gc.rankData.at(cc.firstGlobalRank + localIdx);
+        size_t sendOffset = 0, recvOffset = 0;
+        for (auto const& task : rankData.tasks) {
+          std::pair<size_t, size_t> numBytes = GetSize(task, cc.numGlobalRanks);
+          void* sendbuff = sendPool[localIdx] + sendOffset;
+          void* recvbuff = sendbuff;
+          if (task.inPlace) {
+            sendOffset += alignUp(std::max(numBytes.first, numBytes.second));
+          } else {
+            recvbuff = recvPool[localIdx] + recvOffset;
+            sendOffset += alignUp(numBytes.first);
+            recvOffset += alignUp(numBytes.second);
+          }
+          ExecuteCollective(task, cc.localRankComms[localIdx][rankData.commIdx],
+                            cc.localRankStreams[localIdx][rankData.commIdx], sendbuff, recvbuff);
+        }
+      }
+      NCCL_CALL(ncclGroupEnd());
+
+      for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+        if (!participates(gc, localIdx)) continue;
+        RankData const& rankData = gc.rankData.at(cc.firstGlobalRank + localIdx);
+        HIP_CALL(hipSetDevice(cc.localGpuOffset + localIdx));
+        HIP_CALL(hipEventRecord(endEvents[localIdx][slot], cc.localRankStreams[localIdx][rankData.commIdx]));
+      }
+    }
+    for (int slot = 0; slot < numSlots; slot++) drain(slot);
+    std::chrono::duration<double, std::milli> wall = std::chrono::steady_clock::now() - start;
+
+    // A group call takes as long as its slowest rank
+    double wallMs = wall.count(), maxWallMs;
+    MPI_Reduce(iterTimeUs.data(), maxTimeUs.data(), numGroups, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&wallMs, &maxWallMs, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (mpiRank != 0) continue;
+    printf("Iteration %d%s: %.3f msec\n", iter, iter < opts.warmup ? " (warmup)" : "", maxWallMs);
+    if (iter < opts.warmup) continue;
+    wallSumMs += maxWallMs;
+    for (int g = 0; g < numGroups; g++) {
+      sumTimeUs[g] += maxTimeUs[g];
+      if (iter == opts.warmup || maxTimeUs[g] < minTimeUs[g]) minTimeUs[g] = maxTimeUs[g];
+    }
+  }
+
+  for (int localIdx = 0; localIdx < numLocalRanks; localIdx++) {
+    HIP_CALL(hipSetDevice(cc.localGpuOffset + localIdx));
+    for (int slot = 0; slot < numSlots; slot++) {
+      HIP_CALL(hipEventDestroy(startEvents[localIdx][slot]));
+      HIP_CALL(hipEventDestroy(endEvents[localIdx][slot]));
+    }
+    HIP_CALL(hipFree(sendPool[localIdx]));
+    HIP_CALL(hipFree(recvPool[localIdx]));
+  }
+  if (mpiRank != 0) return;
+
+  // Per call report, and a breakdown per collective
+  std::ofstream datafile(opts.output);
+  if (!datafile.is_open()) {
+    printf("[ERROR] Unable to open file %s\n", opts.output.c_str());
+    return;
+  }
+  datafile << "callNumber, opCount, functionName, numTasks, count(numElements), datatype, bytes, startOffset(msec), "
+              "time(usec), minTime(usec), algBandwidth(GB/s), busBandwidth(GB/s)\n";
+
+  struct FuncSummary { int calls = 0; double timeUs = 0.0; double busBytes = 0.0; };
+  std::map<std::string, FuncSummary> funcSummary;
+  std::vector<std::pair<double, int>> slowest;
+  double totalTimeUs = 0.0;
+  for (int g = 0; g < numGroups; g++) {
+    GroupCall const& gc = cc.groupCalls[g];
+    if (!gc.isValid) continue;
+    std::string funcName;
+    size_t bytes;
+    double busBwFactor;
+    GroupCallSize(gc, cc.numGlobalRanks, funcName, bytes, busBwFactor);
+    TaskInfo const& ti = gc.rankData.begin()->second.tasks[0];
+    double const timeUs = sumTimeUs[g] / opts.iters;
+    double const algBw  = timeUs > 0 ? bytes / (timeUs * 1e3) : 0.0;
+    datafile << g << ", " << gc.opCount << ", " << funcName << ", " << gc.rankData.begin()->second.tasks.size() << ", "
+             << ti.count << ", " << DataTypeToName(ti.datatype) << ", " << bytes << ", " << gc.startMs << ", "
+             << timeUs << ", " << minTimeUs[g] << ", " << algBw << ", " << algBw * busBwFactor << "\n";
+
+    FuncSummary& fs = funcSummary[funcName];
+    fs.calls++;
+    fs.timeUs   += timeUs;
+    fs.busBytes += bytes * busBwFactor;
+    totalTimeUs += timeUs;
+    slowest.push_back(std::make_pair(timeUs, g));
+  }
+  datafile.close();
+
+  printf("\nWall time per iteration: %.3f msec, device time in collectives: %.3f msec\n",
+         wallSumMs / opts.iters, totalTimeUs / 1e3);
+  printf("%-16s %8s %14s %8s %14s\n", "Collective", "Calls", "Time(msec)", "Share", "BusBw(GB/s)");
+  for (auto const& fs : funcSummary) {
+    printf("%-16s %8d %14.3f %7.1f%% %14.2f\n", fs.first.c_str(), fs.second.calls, fs.second.timeUs / 1e3,
+           totalTimeUs > 0 ? 100.0 * fs.second.timeUs / totalTimeUs : 0.0,
+           fs.second.timeUs > 0 ? fs.second.busBytes / (fs.second.timeUs * 1e3) : 0.0);
+  }
+  std::sort(slowest.rbegin(), slowest.rend());
+  printf("\nSlowest calls:\n");
+  for (size_t i = 0; i < std::min<size_t>(slowest.size(), 10); i++) {
+    GroupCall const& gc = cc.groupCalls[slowest[i].second];
+    std::string funcName;
+    size_t bytes;
+    double busBwFactor;
+    GroupCallSize(gc, cc.numGlobalRanks, funcName, bytes, busBwFactor);
+    printf("  - Call %5d opCount %5d %16s %12zu bytes %12.2f usec\n",
+           slowest[i].second, gc.opCount, funcName.c_str(), bytes, slowest[i].first);
+  }
+  printf("Per call results written to %s\n", opts.output.c_str());
+}
+
+static bool ReadPerf(char const* filename, std::map<int, PerfRecord>& records)
+{
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    printf("[ERROR] Unable to open file %s\n", filename);
+    return false;
+  }
+  std::string line;
+  std::getline(file, line);  // header
+  while (std::getline(file, line)) {
+    std::vector<std::string> fields;
+    std::stringstream ss(line);
+    std::string field;
+    while (std::getline(ss, field, ',')) {
+      field.erase(0, field.find_first_not_of(' '));
+      fields.push_back(field);
+    }
+    if (fields.size() < 12) continue;
+    PerfRecord r;
+    r.callNumber = atoi(fields[0].c_str());
+    r.funcName   = fields[2];
+    r.bytes      = strtoull(fields[6].c_str(), NULL, 10);
+    r.timeUs     = atof(fields[8].c_str());
+    records[r.callNumber] = r;
+  }
+  return true;
+}
+
+int ComparePerf(char const* baseFilename, char const* newFilename)
+{
+  std::map<int, PerfRecord> baseRecords, newRecords;
+  if (!ReadPerf(baseFilename, baseRecords) || !ReadPerf(newFilename, newRecords)) return 1;
+
+  // Breakdown per collective and power-of-two size bucket, so that a tuning change can be
+  // judged on the sizes that dominate the workload
+  struct Bucket { int calls = 0; double baseUs = 0.0; double newUs = 0.0; };
+  std::map<std::pair<std::string, int>, Bucket> buckets;
+  std::vector<std::pair<double, int>> changes;
+  double baseTotalUs = 0.0, newTotalUs = 0.0;
+  int numMismatched = 0;
+
+  std::ofstream datafile("replayer_compare.csv");
+  if (!datafile.is_open()) {
+    printf("[ERROR] Unable to open file replayer_compare.csv\n");
+    return 1;
+  }
+  datafile << "callNumber, functionName, bytes, baseTime(usec), newTime(usec), speedup\n";
+  for (auto const& b : baseRecords) {
+    auto it = newRecords.find(b.first);
+    if (it == newRecords.end() || it->second.funcName != b.second.funcName || it->second.bytes != b.second.bytes) {
+      numMismatched++;
+      continue;
+    }
+    PerfRecord const& n = it->second;
+    int log2Bytes = 0;
+    while (log2Bytes < 63 && ((size_t)1 << (log2Bytes + 1)) <= b.second.bytes) log2Bytes++;
+    Bucket& bucket = buckets[std::make_pair(b.second.funcName, log2Bytes)];
+    bucket.calls++;
+    bucket.baseUs += b.second.timeUs;
+    bucket.newUs  += n.timeUs;
+    baseTotalUs   += b.second.timeUs;
+    newTotalUs    += n.timeUs;
+    changes.push_back(std::make_pair(n.timeUs - b.second.timeUs, b.first));
+    datafile << b.first << ", " << b.second.funcName << ", " << b.second.bytes << ", " << b.second.timeUs << ", "
+             << n.timeUs << ", " << (n.timeUs > 0 ? b.second.timeUs / n.timeUs : 0.0) << "\n";
+  }
+  datafile.close();
+  if (numMismatched)
+    printf("[WARN] %d call(s) missing or different in %s, were both reports made from the same log?\n", numMismatched, newFilename);
+
+  printf("Base: %s\nNew:  %s\n", baseFilename, newFilename);
+  printf("%-16s %12s %8s %14s %14s %9s\n", "Collective", "Size(bytes)", "Calls", "Base(msec)", "New(msec)", "Speedup");
+  for (auto const& e : buckets) {
+    printf("%-16s %12zu %8d %14.3f %14.3f %8.3fx\n", e.first.first.c_str(), (size_t)1 << e.first.second, e.second.calls,
+           e.second.baseUs / 1e3, e.second.newUs / 1e3, e.second.newUs > 0 ? e.second.baseUs / e.second.newUs : 0.0);
+  }
+  printf("%-16s %12s %8zu %14.3f %14.3f %8.3fx\n", "Total", "", changes.size(), baseTotalUs / 1e3, newTotalUs / 1e3,
+         newTotalUs > 0 ? baseTotalUs / newTotalUs : 0.0);
+
+  std::sort(changes.begin(), changes.end());
+  printf("\nLargest improvements:\n");
+  for (size_t i = 0; i < std::min<size_t>(changes.size(), 5) && changes[i].first < 0; i++) {
+    PerfRecord const& b = baseRecords[changes[i].second];
+    printf("  - Call %5d %16s %12zu bytes %12.2f -> %12.2f usec\n", b.callNumber, b.funcName.c_str(), b.bytes,
+           b.timeUs, newRecords[b.callNumber].timeUs);
+  }
+  printf("Largest regressions:\n");
+  for (size_t i = 0; i < std::min<size_t>(changes.size(), 5) && changes[changes.size()-1-i].first > 0; i++) {
+    PerfRecord const& b = baseRecords[changes[changes.size()-1-i].second];
+    printf("  - Call %5d %16s %12zu bytes %12.2f -> %12.2f usec\n", b.callNumber, b.funcName.c_str(), b.bytes,
+           b.timeUs, newRecords[b.callNumber].timeUs);
+  }
+  printf("Per call comparison written to replayer_compare.csv\n");
+  return 0;
+}
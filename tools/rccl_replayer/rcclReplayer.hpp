@@ -1,6 +1,9 @@
 #pragma once
 #include <map>
 #include <cstring>
+#include <cstdint>
+#include <functional>
+#include <string>
 
 #include <rccl/rccl.h>
 
@@ -11,6 +14,8 @@
 //                info->datatype, info->op, info->root, info->comm, info->comm->nRanks, info->stream,
 //                info->comm->tasks.nTasksP2p + info->comm->tasks.nTasksColl,
 //                info->comm->localRankToRank[info->comm->localRank]);
+// Newer logs end with "time %.3f", the host CLOCK_MONOTONIC time of the call in msec,
+// which performance mode uses to reproduce the original gaps between group calls.
 
 #define HIP_CALL(cmd)                                                   \
   do {                                                                  \
@@ -31,6 +36,42 @@
     }                                                           \
   } while(0)
 
+// NOTE: Binary call traces (RCCL_CALL_TRACE=<prefix>) are read with these copies of the
+// structures in src/include/calltrace.h, one file <prefix>.<commHash>.<rank> per communicator
+#define RCCL_CALL_TRACE_MAGIC    "RCCLTRC"
+#define RCCL_CALL_TRACE_VERSION  1
+#define RCCL_CALL_TRACE_IN_PLACE 0x1
+
+struct rcclCallTraceHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint64_t commHash;
+  int32_t  rank;
+  int32_t  nRanks;
+  int32_t  cudaDev;
+  int32_t  pid;
+  uint64_t nRecords;
+  char     hostname[64];
+  uint8_t  reserved[16];
+};
+
+struct rcclCallTraceRecord
+{
+  uint64_t opCount;
+  uint64_t count;
+  uint64_t timeNs;
+  uint64_t stream;
+  int32_t  root;
+  int32_t  op;
+  uint16_t task;
+  uint8_t  func;      // ncclFunc_t of src/include/nccl_common.h
+  uint8_t  datatype;
+  uint8_t  flags;
+  uint8_t  pad[3];
+};
+
 struct LineItem
 {
   char   hostname[MPI_MAX_PROCESSOR_NAME];
@@ -50,6 +91,7 @@ struct LineItem
   void*  stream;
   int    task;
   int    globalRank;
+  double timeMs;  // -1 when the log has no timestamps
 };
 
 // Enumeration of all collective functions currently supported
@@ -113,6 +155,7 @@ struct RankData
 {
   int                   lineNum;
   int                   commIdx;
+  double                timeMs;  // time of the first task, -1 when unknown
   std::vector<TaskInfo> tasks;
 };
 
@@ -120,9 +163,29 @@ struct GroupCall
 {
   bool isValid;
   int opCount;
+  double startMs;  // offset from the start of the trace, -1 when unknown
   std::map<int, RankData> rankData;
 };
 
+// Options of the performance mode (--perf)
+struct PerfOptions
+{
+  bool        enabled        = false;
+  bool        originalTiming = false;  // wait for the recorded gaps instead of running back to back
+  int         iters          = 1;
+  int         warmup         = 0;
+  std::string output         = "replayer_perf.csv";
+};
+
+// One row of a performance report, as read back by --compare
+struct PerfRecord
+{
+  int         callNumber;
+  std::string funcName;
+  size_t      bytes;
+  double      timeUs;
+};
+
 struct CollectiveCalls
 {
   int numGlobalRanks;
@@ -196,7 +259,7 @@ std::string getRedOp(ncclRedOp_t const op)
   }
 }
 
-ncclFunc_t GetFuncType(char* func)
+ncclFunc_t GetFuncType(char const* func)
 {
   for (int i = 0; i < ncclNumFuncs; i++)
     if (!strcmp(func, ncclFuncNames[i]) || !strcmp(func, mscclFuncNames[i])) return (ncclFunc_t)i;
@@ -207,6 +270,10 @@ ncclFunc_t GetFuncType(char* func)
 // parse the logs and assign them into lineItem
 bool ParseLineItem(char const* line, LineItem& li);
 
+// reads binary call traces at path, or <path>.* when path is a prefix, and hands every record over
+// as a LineItem with its record number. Returns false when path holds no binary trace
+bool ReadCallTraces(char const* path, bool isFirstRank, std::function<void(LineItem const&, int)> const& addLineItem);
+
 // this covers grouping the logs based on opCount and task number,
 // validatation of the groupCalls for both non-send/recv collectives and send/recv
 void ParseCollectives(char const* logFilename, bool isFirstRank, CollectiveCalls& collectiveCalls);
@@ -225,5 +292,15 @@ void dataToCsv(GroupCall const& gc, std::ofstream &datafile, double runTime);
 // global rank, element count and data type
 std::pair<size_t, size_t> GetSize(TaskInfo taskInfo, int numGlobalRanks);
 
+// Replays all group calls iters times with buffers allocated once, timing each group call with
+// events on every rank, and writes per call device time, algbw and busbw to opts.output
+void ReplayPerf(CollectiveCalls& cc, PerfOptions const& opts, int mpiRank);
+
+// Name, bytes (as in rccl-tests) and busbw/algbw factor of a group call, based on its first rank
+void GroupCallSize(GroupCall const& gc, int numGlobalRanks, std::string& funcName, size_t& bytes, double& busBwFactor);
+
+// Compares two performance reports of the same trace, per call and per collective
+int ComparePerf(char const* baseFilename, char const* newFilename);
+
 // executes the collective call (task)
 void ExecuteCollective(TaskInfo const& task, ncclComm_t const& comm, hipStream_t stream, const void *sendbuff, void *recvbuff);
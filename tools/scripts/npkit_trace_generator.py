@@ -4,6 +4,10 @@
 
 # example run
 # python3 ./[rccl]/tools/scripts/npkit_trace_generator.py --npkit_dump_dir=[npkit_dump_dir] --npkit_event_header_path=[rccl]/src/include/npkit/npkit_event.h --output_dir=/home/akollias/dev/
+#
+# When RCCL wrote clock_sync_rank_<rank> files (GPU wall clock vs. host CLOCK_MONOTONIC) into the dump
+# directory, GPU and CPU events are placed on the host monotonic clock, which is also the clock of the
+# NCCL_PROXY_PROFILE traces. Those can be merged in with --proxy_trace=<rank>:<file>, once per rank.
 
 import argparse
 import os
@@ -39,6 +43,34 @@ def parse_cpu_clock_scale(cpu_clock_den_file_path, cpu_clock_num_file_path):
         den = float(f.read())
     return den / num / 1e6
 
+def parse_clock_sync(npkit_dump_dir, rank):
+    clock_sync_file_path = os.path.join(npkit_dump_dir, 'clock_sync_rank_%d' % rank)
+    if not os.path.exists(clock_sync_file_path):
+        return None
+    with open(clock_sync_file_path, 'r') as f:
+        return json.load(f)
+
+def gpu_ticks_to_host_us(clock_sync, ticks):
+    return (clock_sync['host_ns'] + (ticks - clock_sync['gpu_ticks']) / clock_sync['ticks_per_ns']) / 1e3
+
+def load_proxy_trace(rank, proxy_trace_path):
+    # The profiler streams its trace and never writes the closing bracket
+    with open(proxy_trace_path, 'r') as f:
+        content = f.read().rstrip()
+    if not content.endswith(']'):
+        content = content.rstrip(',') + ']'
+    events = []
+    for event in json.loads(content):
+        if 'ts' not in event:
+            continue
+        # Proxy events use the channel as pid, keep them apart from the GPU and CPU events of the rank
+        event.setdefault('args', {})['proxy_pid'] = event['pid']
+        event['tid'] = 100000 + (event['pid'] + 2) * 1000 + event['tid']
+        event['pid'] = rank
+        event['id'] = '%d-%s' % (rank, event['id'])
+        events.append(event)
+    return events
+
 def parse_gpu_event(event_bytes):
     return {
         'id': int.from_bytes(event_bytes[0:1], byteorder='little', signed=False),
@@ -103,7 +135,7 @@ def parse_gpu_event_file_time(sync_dictionary, npkit_dump_dir, npkit_event_def,
             raw_content_idx += raw_event_size
     return len(sync_dictionary)
 
-def parse_gpu_event_file(rank_cpu_time_xcid, npkit_dump_dir, npkit_event_def, rank, buf_idx, gpu_clock_scale, cpu_clock_scale, dictionary_of_stats, warmup_runs=5):
+def parse_gpu_event_file(rank_cpu_time_xcid, npkit_dump_dir, npkit_event_def, rank, buf_idx, gpu_clock_scale, cpu_clock_scale, dictionary_of_stats, warmup_runs=5, clock_sync=None):
     gpu_event_file_path = os.path.join(npkit_dump_dir, 'gpu_events_rank_%d_buf_%d' % (rank, buf_idx))
     stats_key = 'gpu_rank_%d' % (rank)
     channel_stats = {}
@@ -152,9 +184,13 @@ def parse_gpu_event_file(rank_cpu_time_xcid, npkit_dump_dir, npkit_event_def, ra
                     curr_gpu_base_time = parsed_gpu_event['timestamp'] / gpu_clock_scale
                 event_type = npkit_event_def['id_to_type'][parsed_gpu_event['id']]
                 phase = 'B' if event_type.endswith('_ENTRY') else 'E'
+                if clock_sync is not None:
+                    event_ts = gpu_ticks_to_host_us(clock_sync, parsed_gpu_event['timestamp'])
+                else:
+                    event_ts = curr_cpu_base_time + parsed_gpu_event['timestamp'] / gpu_clock_scale - curr_gpu_base_time
                 gpu_events.append({
                     'ph': phase,
-                    'ts': curr_cpu_base_time + parsed_gpu_event['timestamp'] / gpu_clock_scale - curr_gpu_base_time,
+                    'ts': event_ts,
                     'pid': rank,
                     'tid': buf_idx + 1
 
@@ -180,7 +216,10 @@ def parse_gpu_event_file(rank_cpu_time_xcid, npkit_dump_dir, npkit_event_def, ra
 
                     for i in unfiltered_events:
                         if i['id'] == (current_id-1):
-                            event_start_ts = curr_cpu_base_time + i['timestamp'] / gpu_clock_scale - curr_gpu_base_time
+                            if clock_sync is not None:
+                                event_start_ts = gpu_ticks_to_host_us(clock_sync, i['timestamp'])
+                            else:
+                                event_start_ts = curr_cpu_base_time + i['timestamp'] / gpu_clock_scale - curr_gpu_base_time
                             break
                     delta_time = max(0.001, gpu_events[-1]['ts'] - event_start_ts) # delta needs to take the last begin
                     bandwidth = gpu_events[-1]['args']['size'] / delta_time / 1e3
@@ -210,7 +249,7 @@ def parse_gpu_event_file(rank_cpu_time_xcid, npkit_dump_dir, npkit_event_def, ra
             dictionary_of_stats[stats_key][key] = channel_stats[key]
     return gpu_events
 
-def parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clock_scale):
+def parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clock_scale, clock_sync=None):
     cpu_event_file_path = os.path.join(npkit_dump_dir, 'cpu_events_rank_%d_channel_%d' % (rank, channel))
     raw_event_size = 16
     cpu_events = []
@@ -222,6 +261,8 @@ def parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clo
     channel_shift = 1000
     unfiltered_events = []
     start_event_id = 0
+    # CPU events are stamped with the system clock, move them to the host monotonic clock
+    offset_us = clock_sync['realtime_offset_ns'] / 1e3 if clock_sync is not None else 0
     with open(cpu_event_file_path, 'rb') as f:
         raw_content = f.read()
         raw_content_size = len(raw_content)
@@ -235,7 +276,7 @@ def parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clo
             phase = 'B' if event_type.endswith('_ENTRY') else 'E'
             cpu_events.append({
                 'ph': phase,
-                'ts': parsed_cpu_event['timestamp'] / cpu_clock_scale,
+                'ts': parsed_cpu_event['timestamp'] / cpu_clock_scale - offset_us,
                 'pid': rank
             })
             slot = parsed_cpu_event['slot']
@@ -286,7 +327,7 @@ def parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clo
 
 
 
-def convert_npkit_dump_to_trace(npkit_dump_dir, output_dir, npkit_event_def, gpu_statistics, warmup_runs=0):
+def convert_npkit_dump_to_trace(npkit_dump_dir, output_dir, npkit_event_def, gpu_statistics, warmup_runs=0, proxy_traces=[]):
     files_in_dump_dir = next(os.walk(npkit_dump_dir))[2]
     gpu_event_files = [x for x in files_in_dump_dir if x.startswith('gpu_events_rank_')]
     cpu_event_files = [x for x in files_in_dump_dir if x.startswith('cpu_events_rank_')]
@@ -303,6 +344,9 @@ def convert_npkit_dump_to_trace(npkit_dump_dir, output_dir, npkit_event_def, gpu
 
         gpu_clock_file_path = os.path.join(npkit_dump_dir, 'gpu_clock_rate_rank_%d' % rank)
         gpu_clock_scale = parse_gpu_clock_scale(gpu_clock_file_path)
+        clock_sync = parse_clock_sync(npkit_dump_dir, rank)
+        if clock_sync is None and proxy_traces:
+            print('No clock_sync_rank_%d in %s, rank %d will not line up with its proxy trace' % (rank, npkit_dump_dir, rank))
 
         sync_dictionary = {} # per rank
         avg_time = {}
@@ -317,14 +361,18 @@ def convert_npkit_dump_to_trace(npkit_dump_dir, output_dir, npkit_event_def, gpu
                 avg_time[key] = avg_time[key] + (event['timestamp']/number_events)
 
         for buf_idx in buf_indices:
-            gpu_events = parse_gpu_event_file(avg_time, npkit_dump_dir, npkit_event_def, rank, buf_idx, gpu_clock_scale, cpu_clock_scale, dictionary_of_stats, warmup_runs)
+            gpu_events = parse_gpu_event_file(avg_time, npkit_dump_dir, npkit_event_def, rank, buf_idx, gpu_clock_scale, cpu_clock_scale, dictionary_of_stats, warmup_runs, clock_sync)
             trace['traceEvents'].extend(gpu_events)
 
 
         for channel in channels:
-            cpu_events = parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clock_scale)
+            cpu_events = parse_cpu_event_file(npkit_dump_dir, npkit_event_def, rank, channel, cpu_clock_scale, clock_sync)
             trace['traceEvents'].extend(cpu_events)
 
+    for proxy_trace in proxy_traces:
+        rank, proxy_trace_path = proxy_trace.split(':', 1)
+        trace['traceEvents'].extend(load_proxy_trace(int(rank), proxy_trace_path))
+
 
     trace['traceEvents'].sort(key=lambda x : x['ts'])
     trace['displayTimeUnit'] = 'ns'
@@ -346,9 +394,10 @@ if __name__ == '__main__':
     parser.add_argument('--output_dir', type=str, required=True, help='Path to output directory.')
     parser.add_argument('--gpu_run_stats', type=bool, nargs='?', const=True, default=False, help="print stats instead.")
     parser.add_argument('--warmup_runs', type=int, required=False, default=0, help="amount of warmup_runs on rccl.")
+    parser.add_argument('--proxy_trace', type=str, action='append', default=[], help="<rank>:<NCCL_PROXY_PROFILE file> to merge, can be repeated.")
     args = parser.parse_args()
     gpu_statistics = False
     if args.gpu_run_stats is not None:
         gpu_statistics = args.gpu_run_stats
     npkit_event_def = parse_npkit_event_header(args.npkit_event_header_path)
-    convert_npkit_dump_to_trace(args.npkit_dump_dir, args.output_dir, npkit_event_def, gpu_statistics, args.warmup_runs)
\ No newline at end of file
+    convert_npkit_dump_to_trace(args.npkit_dump_dir, args.output_dir, npkit_event_def, gpu_statistics, args.warmup_runs, args.proxy_trace)
\ No newline at end of file
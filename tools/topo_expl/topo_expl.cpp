@@ -43,6 +43,10 @@ THE SOFTWARE.
 #include <cstdio>
 #include <iostream>
 #include <cstring>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <sys/wait.h>
 #include "model.h"
 #include "utils.h"
 #include "topo.h"
@@ -164,43 +168,86 @@ NodeModelDesc model_descs[] = {
 NCCL_PARAM(MaxCTAs, "MAX_CTAS", MAXCHANNELS);
 NCCL_PARAM(MinCTAs, "MIN_CTAS", 1);
 
-int main(int argc,char* argv[])
-{
-  struct ncclComm *comm;
-  const int num_models = sizeof(model_descs) / sizeof(*model_descs);
-  int minCTAsEnv;
-  int maxCTAsEnv;
+static const char* baselineName(NodeModelDesc* desc, int numNodes, char* name, size_t len) {
+  // topo_8p_940.xml on 4 nodes -> topo_8p_940_4n.txt
+  snprintf(name, len, "%.*s_%dn.txt", (int)(strcspn(desc->filename, ".")), desc->filename, numNodes);
+  return name;
+}
 
-  if (!cmdOptionExists(argv, argv + argc, "-m")) {
-    printf("Usage: ./topo_expl -m model_id [-n numNodes=1]\n");
-    printf("List of model_id:\n");
-    for (int i = 0; i < num_models; i++)
-      printf("  %d: %s\n", i, model_descs[i].description);
-    exit(0);
+static void printGraph(FILE* f, const char* name, struct ncclComm* comm, struct ncclTopoGraph* graph) {
+  int ngpus = comm->topo->nodes[GPU].count;
+  fprintf(f, "graph %s pattern %d crossNic %d nChannels %d bw %.2f/%.2f type %s/%s sameChannels %d\n", name,
+      graph->pattern, graph->crossNic, graph->nChannels, graph->bwIntra, graph->bwInter,
+      topoPathTypeStr[graph->typeIntra], topoPathTypeStr[graph->typeInter], graph->sameChannels);
+  for (int c = 0; c < graph->nChannels; c++) {
+    fprintf(f, "  %s %d:", name, c);
+    if (comm->topo->nodes[NET].count) fprintf(f, " NET/%d", graph->inter[c*2]);
+    for (int g = 0; g < ngpus; g++) fprintf(f, " %d", graph->intra[c*ngpus+g]);
+    if (comm->topo->nodes[NET].count) fprintf(f, " NET/%d", graph->inter[c*2+1]);
+    fprintf(f, "\n");
   }
+}
 
-  int model_id = 0;
-  char *mi = getCmdOption(argv, argv + argc, "-m");
-  if (mi)
-    model_id = atol(mi);
-
-  if (model_id >= num_models) {
-      printf("Invalid model_id %d\n", model_id);
-      exit(0);
+// Everything that the search and the tuner decide for rank 0, plus the rings and
+// trees of all ranks, one fact per line so that a diff points at what moved
+static ncclResult_t printSummary(FILE* f, struct ncclComm* comm, int nranks, struct ncclTopoGraph* ringGraph, struct ncclTopoGraph* treeGraph) {
+  const int colls[] = { ncclFuncAllReduce, ncclFuncAllGather, ncclFuncReduceScatter, ncclFuncBroadcast, ncclFuncReduce };
+  fprintf(f, "nranks %d nnodes %d nChannels %d\n", nranks, comm[0].nNodes, comm[0].nChannels);
+  printGraph(f, "ring", comm, ringGraph);
+  printGraph(f, "tree", comm, treeGraph);
+  for (int c = 0; c < comm[0].nChannels; c++) {
+    fprintf(f, "channel %d ring:", c);
+    for (int r = 0; r < nranks; r++) fprintf(f, " %d", comm[0].channels[c].ring.userRanks[r]);
+    fprintf(f, "\n");
+  }
+  for (int r = 0; r < nranks; r++) {
+    for (int c = 0; c < comm[r].nChannels; c++) {
+      struct ncclTree* tree = &comm[r].channels[c].tree;
+      fprintf(f, "channel %d tree rank %d: up %d down %d %d %d\n", c, r, tree->up, tree->down[0], tree->down[1], tree->down[2]);
+    }
   }
+  for (int i = 0; i < (int)(sizeof(colls)/sizeof(colls[0])); i++) {
+    for (uint64_t len = 8; len <= 4294967296L; len *= 2) {
+      struct ncclInfo info;
+      float minTime = 3600000000.0;
+      memset(&info, 0, sizeof(info));
+      info.comm = &comm[0];
+      info.coll = (ncclFunc_t)colls[i];
+      info.nBytes = len;
+      info.algorithm = -1;
+      info.protocol = -1;
+      for (int a = 0; a < NCCL_NUM_ALGORITHMS; a++) {
+        for (int p = 0; p < NCCL_NUM_PROTOCOLS; p++) {
+          float time;
+          NCCLCHECK(ncclTopoGetAlgoTime(&info, a, p, 1, &time));
+          if (time >= 0 && time < minTime) {
+            info.algorithm = a;
+            info.protocol = p;
+            minTime = time;
+          }
+        }
+      }
+      if (info.algorithm == -1) {
+        fprintf(f, "tune %s %lu none\n", ncclFuncStr[colls[i]], len);
+      } else {
+        fprintf(f, "tune %s %lu %s %s %.1f\n", ncclFuncStr[colls[i]], len, ncclAlgoStr[info.algorithm], ncclProtoStr[info.protocol], minTime);
+      }
+    }
+  }
+  return ncclSuccess;
+}
 
+// Runs topology detection, graph search and tuning for one model. When summary
+// is set, the resulting graphs, channels and algorithm choices are written to it
+// in a stable format that batch mode compares against a baseline.
+static ncclResult_t runModel(int model_id, int numNodes, FILE* summary) {
+  struct ncclComm *comm;
+  int minCTAsEnv;
+  int maxCTAsEnv;
   NetworkModel network;
   NodeModel* node;
 
-  initCollNet();
-
   NodeModelDesc *desc = &model_descs[model_id];
-  int numNodes = desc->num_nodes;
-  if (cmdOptionExists(argv, argv + argc, "-n")) {
-    char *numNodesStr = getCmdOption(argv, argv + argc, "-n");
-    if (numNodesStr)
-      numNodes = atol(numNodesStr);
-  }
   for (int i=0; i < numNodes; i++) {
       node = new NodeModel(desc->filename);
       network.AddNode(node);
@@ -308,6 +355,8 @@ int main(int argc,char* argv[])
     INFO(NCCL_TUNING, "%10ld %s %s time %f", info.nBytes, ncclAlgoStr[info.algorithm], ncclProtoStr[info.protocol], minTime);
   }
 
+  if (summary) NCCLCHECK(printSummary(summary, comm, nranks, ringGraph, treeGraph));
+
   for (int i = 0; i < nranks; i++) {
     free(comm[i].connectSend);
     free(comm[i].connectRecv);
@@ -320,7 +369,157 @@ int main(int argc,char* argv[])
   free(peerInfo);
 
   free(comm);
+  free(nvlsGraph);
   printf("Done generating topology using %d: %s\n", model_id, desc->description);
+  return ncclSuccess;
+}
+
+// Runs one model in a child process, since the topology code keeps state in
+// globals, and returns its summary in out
+static int runModelChild(int model_id, int numNodes, std::string& out) {
+  int fds[2];
+  if (pipe(fds) != 0) return -1;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) { close(fds[0]); close(fds[1]); return -1; }
+  if (pid == 0) {
+    close(fds[0]);
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) { dup2(devNull, STDOUT_FILENO); close(devNull); }
+    FILE* f = fdopen(fds[1], "w");
+    ncclResult_t ret = f ? runModel(model_id, numNodes, f) : ncclSystemError;
+    if (f) fclose(f);
+    _exit(ret == ncclSuccess ? 0 : 1);
+  }
+  close(fds[1]);
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) out.append(buf, n);
+  close(fds[0]);
+  int status;
+  if (waitpid(pid, &status, 0) < 0) return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool readFile(const char* path, std::string& out) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) return false;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+  fclose(f);
+  return true;
+}
 
-  return 0;
+static std::vector<std::string> splitLines(const std::string& s) {
+  std::vector<std::string> lines;
+  size_t pos = 0;
+  while (pos < s.size()) {
+    size_t end = s.find('\n', pos);
+    if (end == std::string::npos) end = s.size();
+    lines.push_back(s.substr(pos, end-pos));
+    pos = end+1;
+  }
+  return lines;
+}
+
+// Prints the lines that differ, up to maxLines of them
+static void printDiff(const std::string& baseline, const std::string& current, int maxLines) {
+  std::vector<std::string> a = splitLines(baseline), b = splitLines(current);
+  int printed = 0;
+  for (size_t i = 0; i < std::max(a.size(), b.size()) && printed < maxLines; i++) {
+    const std::string* l1 = i < a.size() ? &a[i] : NULL;
+    const std::string* l2 = i < b.size() ? &b[i] : NULL;
+    if (l1 && l2 && *l1 == *l2) continue;
+    if (l1) printf("    - %s\n", l1->c_str());
+    if (l2) printf("    + %s\n", l2->c_str());
+    printed++;
+  }
+  if (printed == maxLines) printf("    ...\n");
+}
+
+// Runs every model. With recordDir the summaries are saved as the new baseline,
+// with baselineDir they are compared against the saved ones.
+static int runBatch(const char* baselineDir, const char* recordDir) {
+  const int num_models = sizeof(model_descs) / sizeof(*model_descs);
+  int nFail = 0, nDiff = 0, nNew = 0;
+  for (int i = 0; i < num_models; i++) {
+    NodeModelDesc* desc = &model_descs[i];
+    char name[256], path[PATH_MAX];
+    baselineName(desc, desc->num_nodes, name, sizeof(name));
+    std::string current;
+    if (runModelChild(i, desc->num_nodes, current) != 0) {
+      printf("[%2d] %-55s FAIL\n", i, desc->description);
+      nFail++;
+      continue;
+    }
+    const char* result = "OK";
+    if (baselineDir) {
+      std::string baseline;
+      snprintf(path, sizeof(path), "%s/%s", baselineDir, name);
+      if (!readFile(path, baseline)) {
+        result = "NEW";
+        nNew++;
+      } else if (baseline != current) {
+        printf("[%2d] %-55s DIFF %s\n", i, desc->description, path);
+        printDiff(baseline, current, 20);
+        nDiff++;
+        result = NULL;
+      }
+    }
+    if (recordDir) {
+      snprintf(path, sizeof(path), "%s/%s", recordDir, name);
+      FILE* f = fopen(path, "w");
+      if (f == NULL || fwrite(current.data(), 1, current.size(), f) != current.size()) {
+        printf("[%2d] %-55s could not write %s\n", i, desc->description, path);
+        nFail++;
+      }
+      if (f) fclose(f);
+    }
+    if (result) printf("[%2d] %-55s %s\n", i, desc->description, result);
+  }
+  printf("%d models, %d failed, %d differ from baseline, %d without baseline\n", num_models, nFail, nDiff, nNew);
+  return nFail || nDiff ? 1 : 0;
+}
+
+int main(int argc,char* argv[])
+{
+  const int num_models = sizeof(model_descs) / sizeof(*model_descs);
+
+  if (cmdOptionExists(argv, argv + argc, "-a")) {
+    initCollNet();
+    return runBatch(getCmdOption(argv, argv + argc, "-b"), getCmdOption(argv, argv + argc, "-r"));
+  }
+
+  if (!cmdOptionExists(argv, argv + argc, "-m")) {
+    printf("Usage: ./topo_expl -m model_id [-n numNodes=1] [-s]\n");
+    printf("       ./topo_expl -a [-b baseline_dir] [-r record_dir]\n");
+    printf("  -s  print the graphs, channels and algorithm choices at the end\n");
+    printf("  -a  run all models, comparing them to baseline_dir and/or saving them to record_dir\n");
+    printf("List of model_id:\n");
+    for (int i = 0; i < num_models; i++)
+      printf("  %d: %s\n", i, model_descs[i].description);
+    exit(0);
+  }
+
+  int model_id = 0;
+  char *mi = getCmdOption(argv, argv + argc, "-m");
+  if (mi)
+    model_id = atol(mi);
+
+  if (model_id >= num_models) {
+      printf("Invalid model_id %d\n", model_id);
+      exit(0);
+  }
+
+  initCollNet();
+
+  int numNodes = model_descs[model_id].num_nodes;
+  if (cmdOptionExists(argv, argv + argc, "-n")) {
+    char *numNodesStr = getCmdOption(argv, argv + argc, "-n");
+    if (numNodesStr)
+      numNodes = atol(numNodesStr);
+  }
+  FILE* summary = cmdOptionExists(argv, argv + argc, "-s") ? stdout : NULL;
+  return runModel(model_id, numNodes, summary);
 }